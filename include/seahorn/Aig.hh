@@ -0,0 +1,111 @@
+#ifndef __AIG__HH_
+#define __AIG__HH_
+/// And-inverter graphs of the bit-level BMC engine
+
+#include "ufo/Expr.hpp"
+#include "ufo/Smt/EZ3.hh"
+
+#include "boost/logic/tribool.hpp"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// A structurally hashed and-inverter graph. A literal is twice a
+  /// node plus a complement bit. Node 0 is the constant false, so the
+  /// literals 0 and 1 are false and true. The children of a node come
+  /// before it, so the nodes are in topological order
+  class Aig
+  {
+  public:
+    typedef unsigned Lit;
+
+    static Lit mkLit (unsigned node, bool neg) { return 2 * node + (neg ? 1 : 0); }
+    static unsigned node (Lit l) { return l >> 1; }
+    static bool isNeg (Lit l) { return l & 1; }
+    static Lit neg (Lit l) { return l ^ 1; }
+    static Lit mkFalse () { return 0; }
+    static Lit mkTrue () { return 1; }
+
+  private:
+    /// the children of every node. Inputs and node 0 have none
+    std::vector<std::pair<Lit, Lit> > m_nodes;
+    std::vector<bool> m_input;
+    unsigned m_inputs;
+    /// the node of a pair of children
+    std::unordered_map<uint64_t, unsigned> m_strash;
+
+    /// a node for a and b, a < b, without rewriting
+    Lit strash (Lit a, Lit b);
+
+  public:
+    Aig () : m_nodes (1, std::make_pair (0u, 0u)), m_input (1, false), m_inputs (0) {}
+
+    Lit mkInput ();
+    /// a and b, rewritten with the rules of two-level AIG
+    /// minimization, e.g., a & (a & c) = a & c and a & !(a & c) = a & !c
+    Lit mkAnd (Lit a, Lit b);
+    Lit mkOr (Lit a, Lit b) { return neg (mkAnd (neg (a), neg (b))); }
+    Lit mkXor (Lit a, Lit b);
+    Lit mkIff (Lit a, Lit b) { return neg (mkXor (a, b)); }
+    Lit mkIte (Lit c, Lit t, Lit e);
+
+    /// number of nodes, the constant included
+    unsigned size () const { return m_nodes.size (); }
+    unsigned numInputs () const { return m_inputs; }
+    unsigned numAnds () const { return size () - m_inputs - 1; }
+    bool isInput (unsigned n) const { return m_input [n]; }
+    bool isAnd (unsigned n) const { return n > 0 && !m_input [n]; }
+    Lit left (unsigned n) const { return m_nodes [n].first; }
+    Lit right (unsigned n) const { return m_nodes [n].second; }
+
+    /// merges the nodes that are functionally equivalent, up to
+    /// complement. Candidates are the nodes with the same values on
+    /// random inputs, and each merge is proven with z3 within a small
+    /// budget. The graph is rebuilt and roots are replaced by their
+    /// literals in it. Inputs stay inputs. Returns the literal of
+    /// every old node in the new graph
+    std::vector<Lit> fraig (std::vector<Lit> &roots, ufo::EZ3 &z3);
+  };
+
+  /// The Tseitin encoding of an Aig in a Z3 solver, with a constant
+  /// per node. Only the cones of the literals that are used are
+  /// encoded
+  class AigSat
+  {
+    const Aig &m_aig;
+    ExprFactory &m_efac;
+    /// names the constants of the nodes
+    std::string m_prefix;
+    ufo::ZSolver<ufo::EZ3> m_solver;
+    /// constant of every node that was encoded, null otherwise
+    ExprVector m_vars;
+    ufo::ZModel<ufo::EZ3> m_model;
+
+    Expr var (unsigned n);
+
+  public:
+    AigSat (const Aig &aig, ufo::EZ3 &z3, const std::string &prefix) :
+      m_aig (aig), m_efac (z3.get_efac ()), m_prefix (prefix),
+      m_solver (z3), m_model (z3) {}
+
+    /// the formula of l, after encoding its cone
+    Expr encode (Aig::Lit l);
+    /// asserts that l is true
+    void assertLit (Aig::Lit l);
+    /// checks the assertions, and the assumptions, within budget
+    boost::tribool solve (const std::vector<Aig::Lit> &assumptions,
+                          const ufo::ZBudget &budget = ufo::ZBudget ());
+    /// value of l in the model of the last sat answer. Inputs that
+    /// were never encoded are false
+    bool value (Aig::Lit l);
+  };
+}
+
+#endif
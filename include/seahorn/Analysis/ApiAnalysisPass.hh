@@ -46,19 +46,21 @@ namespace seahorn
   struct ApiCallInfo
   {
 
-    ApiCallInfo()
+    ApiCallInfo() : m_func(NULL), m_progress(0)
     { }
 
     ApiCallInfo(const ApiCallInfo & other)
     {
       m_bblist = other.m_bblist;
       m_func = other.m_func;
+      m_progress = other.m_progress;
     }
 
     ApiCallInfo& operator=(const ApiCallInfo & other)
     {
       m_bblist = other.m_bblist;
       m_func = other.m_func;
+      m_progress = other.m_progress;
 
       return *this;
     }
@@ -74,9 +76,16 @@ namespace seahorn
     // A pointer to the function itself
     const Function* m_func;
 
+    // the furthest progress on the sequence in the function, from its entry
+    unsigned int m_progress;
+
     std::vector<const Function*> m_path;
   };
 
+  // The progress on the API sequence at the exit of a function for each
+  // progress at its entry, i.e., the effect of calling it
+  typedef std::vector<unsigned int> ApiSummary;
+
   class ApiAnalysisPass : public ModulePass
   {
     // functions/instructions that call an API of interest
@@ -92,11 +101,27 @@ namespace seahorn
     // Dataflow analysis for each function
     std::vector<ApiCallInfo> m_apiAnalysis;
 
+    // Summaries of the defined functions, computed once, bottom-up over the
+    // SCCs of the call graph. A function of the SCC being summarized
+    // starts from the identity
+    DenseMap<const Function*, unsigned> m_summaryIdx;
+    std::vector<ApiSummary> m_summaries;
+
     void parseApiString(std::string apistring);
 
-    void findStartingPoints(const Function* F);
+    void findStartingPoints(const Function* F, DenseSet<const Function*> &visited);
+
+    // Progress at the exit of each block of F from the progress at its
+    // entry, using the summaries of the callees. Returns the progress at
+    // the returns of F
+    unsigned int flow(const Function &F, unsigned int entry,
+                      DenseMap<const BasicBlock*, unsigned int> &out);
+
+    // Summarizes the functions of a call graph SCC. Their callees in other
+    // SCCs are summarized
+    void summarize(const std::vector<const Function*> &scc);
 
-    void analyze(const Function *F, unsigned int& progress, ApiCallInfo& aci);
+    void analyze(const Function *F, ApiCallInfo& aci);
 
     void defineEntryFunction(Module &M); 
 
@@ -8,7 +8,8 @@
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
-#include "llvm/ADT/DenseSet.h"
+
+#include "seahorn/Analysis/FunctionBits.hh"
 
 namespace seahorn
 {
@@ -16,10 +17,8 @@ namespace seahorn
   
   class CanAccessMemory : public ModulePass
   {
-    /// functions that must access memory
-    DenseSet<const Function*> m_must;
-    /// functions that may access memory
-    DenseSet<const Function*> m_may;
+    /// functions that must access memory, and that may access memory
+    FunctionBits m_fns;
     
   public:
     static char ID;
@@ -28,9 +27,10 @@ namespace seahorn
     
     virtual bool runOnModule (Module &M);
     virtual void getAnalysisUsage (AnalysisUsage &AU) const;
-    bool canAccess (const Function *f) const;
+    bool canAccess (const Function *f) const
+    {return m_fns.may (f);}
     bool mustAccess (const Function *f) const
-    {return m_must.count (f) > 0;}
+    {return m_fns.must (f);}
     virtual const char* getPassName () const {return "CanAccessMemory";}
     
   };
@@ -7,7 +7,10 @@
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Function.h"
-#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include "seahorn/Analysis/FunctionBits.hh"
 
 namespace seahorn
 {
@@ -15,10 +18,12 @@ namespace seahorn
   
   class CanFail : public ModulePass
   {
-    /// functions that must fail
-    DenseSet<const Function*> m_must;
-    /// functions that may fail
-    DenseSet<const Function*> m_may;
+    /// functions that must fail, and that may fail
+    FunctionBits m_fns;
+    /// ids of the blocks of the functions that may fail
+    DenseMap<const BasicBlock*, unsigned> m_bbIds;
+    /// blocks that call a function that can fail
+    BitVector m_bbFail;
     
   public:
     static char ID;
@@ -27,9 +32,13 @@ namespace seahorn
     
     virtual bool runOnModule (Module &M);
     virtual void getAnalysisUsage (AnalysisUsage &AU) const;
-    bool canFail (const Function *f) const;
+    bool canFail (const Function *f) const
+    {return m_fns.may (f);}
     bool mustFail (const Function *f) const
-    {return m_must.count (f) > 0;}
+    {return m_fns.must (f);}
+    /// true if bb calls a function that can fail. A block of a
+    /// function that cannot fail cannot fail either
+    bool canFail (const BasicBlock *bb) const;
     
   };
 }
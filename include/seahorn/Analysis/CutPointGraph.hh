@@ -1,6 +1,8 @@
 #ifndef __CUTPOINT_GRAPH__H__
 #define __CUTPOINT_GRAPH__H__
 
+#include <deque>
+#include <iterator>
 #include <vector>
 
 #include "llvm/Pass.h"
@@ -19,6 +21,7 @@ namespace seahorn
 
   class CutPoint;
   class CutPointGraph;
+  class WeakTopologicalOrderPass;
   
   class CpEdge
   {
@@ -26,9 +29,13 @@ namespace seahorn
     
     CutPoint &m_src;
     CutPoint &m_dst;
+    unsigned m_id;
     
-    typedef std::vector<const BasicBlock*> BlockVector;
-    BlockVector m_bbs;
+    /// the blocks of the edge, a range of the flat block storage of
+    /// the parent graph
+    typedef const BasicBlock *const *BlockIterator;
+    BlockIterator m_begin;
+    BlockIterator m_end;
     
     CutPoint &source () {return m_src;}
     CutPoint &target () {return m_dst;}
@@ -36,28 +43,28 @@ namespace seahorn
     
   public:
     
-    CpEdge (CutPoint &s, CutPoint &d) : 
-      m_src (s), m_dst (d) {}
+    CpEdge (CutPoint &s, CutPoint &d, unsigned id) : 
+      m_src (s), m_dst (d), m_id (id), m_begin (nullptr), m_end (nullptr) {}
     
     inline const CutPointGraph &parent () const ;
     const CutPoint &source () const {return m_src;}
     const CutPoint &target () const {return m_dst;}
     
-    void push_back (const BasicBlock *b) { m_bbs.push_back (b); }
+    /// index of the edge in [0, parent ().numEdges ())
+    unsigned id () const {return m_id;}
+    unsigned size () const {return m_end - m_begin;}
     
-    typedef boost::indirect_iterator<BlockVector::iterator> iterator;
-    typedef boost::indirect_iterator<BlockVector::const_iterator> const_iterator;
-    typedef boost::indirect_iterator<BlockVector::reverse_iterator> reverse_iterator;
-    typedef boost::indirect_iterator<BlockVector::const_reverse_iterator> const_reverse_iterator;
+    typedef boost::indirect_iterator<BlockIterator> const_iterator;
+    typedef const_iterator iterator;
+    typedef boost::indirect_iterator<std::reverse_iterator<BlockIterator> > const_reverse_iterator;
+    typedef const_reverse_iterator reverse_iterator;
       
-    iterator begin () { return boost::make_indirect_iterator(m_bbs.begin ()); } 
-    iterator end () {return boost::make_indirect_iterator(m_bbs.end ());}
-    const_iterator begin () const {return boost::make_indirect_iterator(m_bbs.begin ());}
-    const_iterator end () const {return boost::make_indirect_iterator(m_bbs.end ());}
-    reverse_iterator rbegin () { return boost::make_indirect_iterator(m_bbs.rbegin ()); } 
-    reverse_iterator rend () {return boost::make_indirect_iterator(m_bbs.rend ());}
-    const_reverse_iterator rbegin () const {return boost::make_indirect_iterator(m_bbs.rbegin ());}
-    const_reverse_iterator rend () const {return boost::make_indirect_iterator(m_bbs.rend ());}
+    const_iterator begin () const {return boost::make_indirect_iterator(m_begin);}
+    const_iterator end () const {return boost::make_indirect_iterator(m_end);}
+    const_reverse_iterator rbegin () const 
+    {return boost::make_indirect_iterator(std::reverse_iterator<BlockIterator> (m_end));}
+    const_reverse_iterator rend () const 
+    {return boost::make_indirect_iterator(std::reverse_iterator<BlockIterator> (m_begin));}
   };
     
   class CutPoint
@@ -113,14 +120,22 @@ namespace seahorn
  
   class CutPointGraph : public FunctionPass
   {
-    typedef std::vector<boost::shared_ptr<CutPoint>> CpVector;
-    typedef std::vector<boost::shared_ptr<CpEdge>> CpEdgeVector;
+    /// deques keep the addresses of cut-points and edges stable
+    typedef std::deque<CutPoint> CpVector;
+    typedef std::deque<CpEdge> CpEdgeVector;
     
     CpVector m_cps;
     CpEdgeVector m_edges;
     
+    /// the blocks of all edges, edge by edge
+    std::vector<const BasicBlock*> m_edgeBbs;
+    /// maps the ids of a source and of a target cut-point to the id
+    /// of their edge
+    DenseMap<std::pair<unsigned,unsigned>, unsigned> m_edgeIds;
+    
     typedef DenseMap<const BasicBlock*, BitVector> BlockBitMap;
-    /// maps a basic block to ids of cut-points it can forward reach
+    /// maps a basic block to ids of cut-points it can forward reach.
+    /// Only needed while computing the edges
     BlockBitMap m_fwd;
     /// maps a basic block to ids of cut-points that can reach it
     BlockBitMap m_bwd;
@@ -128,23 +143,32 @@ namespace seahorn
     
     DenseMap<const BasicBlock*,  CutPoint *> m_bb;
     
+    /// topological order of the blocks ignoring the edges that enter
+    /// a cut-point
+    std::vector<const BasicBlock*> m_order;
+    
+    /// number of cut-points of the default selection: the entry, the
+    /// exit and the targets of back-edges
+    unsigned m_numDefaultCps;
+    
     CutPoint &newCp (const BasicBlock &bb)
     {
       if (isCutPoint (bb))
         return getCp (bb);
 
-      m_cps.push_back (boost::make_shared<CutPoint> (*this, m_cps.size (), bb));
+      m_cps.emplace_back (*this, m_cps.size (), bb);
       
-      CutPoint &res = *m_cps.back ();
+      CutPoint &res = m_cps.back ();
       m_bb [&bb] = &res;
       return res;
     }
     
     CpEdge &newEdge (CutPoint &s, CutPoint &d)
     {
-      m_edges.push_back (boost::make_shared<CpEdge> (s, d));
+      m_edgeIds [std::make_pair (s.id (), d.id ())] = m_edges.size ();
+      m_edges.emplace_back (s, d, m_edges.size ());
       
-      CpEdge &edg = *m_edges.back ();
+      CpEdge &edg = m_edges.back ();
       
       s.addSucc (edg);
       d.addPred (edg);
@@ -153,9 +177,12 @@ namespace seahorn
     
     
     void computeCutPoints (const Function &F, const TopologicalOrder &topo);
-    void computeFwdReach (const Function &F, const TopologicalOrder &topo);
-    void computeBwdReach (const Function &F, const TopologicalOrder &topo);
-    void computeEdges (const Function &F, const TopologicalOrder &topo);
+    void computeMinCutPoints (const Function &F, const TopologicalOrder &topo,
+                              const WeakTopologicalOrderPass &wto);
+    void computeOrder (const Function &F, const TopologicalOrder &topo);
+    void computeFwdReach (const Function &F);
+    void computeBwdReach (const Function &F);
+    void computeEdges (const Function &F);
     
     
     CpEdge* getEdge (CutPoint &s, CutPoint &d);
@@ -168,12 +195,23 @@ namespace seahorn
   public:
     static char ID;
     
-    CutPointGraph () : FunctionPass (ID) {}
+    CutPointGraph () : FunctionPass (ID), m_numDefaultCps (0) {}
     
     virtual void getAnalysisUsage (AnalysisUsage &AU) const;
     virtual bool runOnFunction (Function &F);
+    /// builds the graph of F outside of a pass manager. The exit
+    /// nodes of F must be unified. wto is needed if usesWto ()
+    void compute (Function &F, const TopologicalOrder &topo,
+                  const WeakTopologicalOrderPass *wto);
+    /// true if the cut-points are chosen with a weak topological
+    /// order (--horn-min-cutpoints)
+    static bool usesWto ();
     virtual void releaseMemory () 
-    { m_cps.clear (); m_edges.clear (); m_bb.clear (); }
+    { 
+      m_cps.clear (); m_edges.clear (); m_bb.clear (); 
+      m_edgeBbs.clear (); m_edgeIds.clear (); m_fwd.clear (); m_bwd.clear ();
+      m_order.clear ();
+    }
     
     bool isCutPoint (const BasicBlock &bb) const
     {
@@ -189,27 +227,35 @@ namespace seahorn
     }
     
     const CpEdge* getEdge (const CutPoint &s, const CutPoint &d) const;
+    
+    unsigned size () const {return m_cps.size ();}
+    /// number of cut-points the default selection would have
+    unsigned numDefaultCutPoints () const {return m_numDefaultCps;}
+    
+    /// edges are numbered densely and can index arrays
+    unsigned numEdges () const {return m_edges.size ();}
+    const CpEdge &edge (unsigned id) const {return m_edges [id];}
    
     /// returns true if the cutpoint can reach the basic block
     /// (without going through other cutpoints
     bool isFwdReach (const CutPoint &cp, const BasicBlock &bb) const;
     
-    typedef boost::indirect_iterator<CpVector::iterator> iterator;
-    typedef boost::indirect_iterator<CpVector::const_iterator> const_iterator;
-    typedef boost::indirect_iterator<CpVector::reverse_iterator> reverse_iterator;
-    typedef boost::indirect_iterator<CpVector::const_reverse_iterator> const_reverse_iterator;
+    typedef CpVector::iterator iterator;
+    typedef CpVector::const_iterator const_iterator;
+    typedef CpVector::reverse_iterator reverse_iterator;
+    typedef CpVector::const_reverse_iterator const_reverse_iterator;
 
-    iterator begin () { return make_indirect_iterator(m_cps.begin ()); } 
-    iterator end () {return make_indirect_iterator(m_cps.end ());}
-    const_iterator begin () const {return make_indirect_iterator(m_cps.begin ());}
-    const_iterator end () const {return make_indirect_iterator(m_cps.end ());}
-    reverse_iterator rbegin () { return make_indirect_iterator(m_cps.rbegin ()); } 
-    reverse_iterator rend () {return make_indirect_iterator(m_cps.rend ());}
-    const_reverse_iterator rbegin () const {return make_indirect_iterator(m_cps.rbegin ());}
-    const_reverse_iterator rend () const {return make_indirect_iterator(m_cps.rend ());}
+    iterator begin () { return m_cps.begin (); } 
+    iterator end () {return m_cps.end ();}
+    const_iterator begin () const {return m_cps.begin ();}
+    const_iterator end () const {return m_cps.end ();}
+    reverse_iterator rbegin () { return m_cps.rbegin (); } 
+    reverse_iterator rend () {return m_cps.rend ();}
+    const_reverse_iterator rbegin () const {return m_cps.rbegin ();}
+    const_reverse_iterator rend () const {return m_cps.rend ();}
 
-    const CutPoint &front () const {return *m_cps.front ();}
-    const CutPoint &back () const {return *m_cps.back ();}
+    const CutPoint &front () const {return m_cps.front ();}
+    const CutPoint &back () const {return m_cps.back ();}
     
     
     virtual void print (raw_ostream &out, const Module *M) const ;
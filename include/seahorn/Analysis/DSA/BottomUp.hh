@@ -5,6 +5,7 @@
 #include "llvm/IR/Function.h"
 #include "llvm/Pass.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 
 #include "seahorn/Analysis/DSA/Graph.hh"
 #include "seahorn/Analysis/DSA/CallSite.hh"
@@ -15,6 +16,7 @@ namespace llvm
   class DataLayout;
   class TargetLibraryInfo;
   class CallGraph;
+  class CallGraphNode;
 }
 
 using namespace llvm;
@@ -23,6 +25,9 @@ namespace seahorn
 {
   namespace dsa
   {
+    class LocalAnalysis;
+    class BatchCloner;
+    class GraphSpill;
 
     class BottomUpAnalysis {
 
@@ -30,6 +35,7 @@ namespace seahorn
 
       typedef std::shared_ptr<Graph> GraphRef;
       typedef llvm::DenseMap<const Function *, GraphRef> GraphMap;
+      typedef llvm::DenseSet<const Function *> FunctionSet;
       
      private:
 
@@ -40,6 +46,24 @@ namespace seahorn
       const TargetLibraryInfo &m_tli;
       CallGraph &m_cg;
       CalleeCallerMapping m_callee_caller_map;
+      /// if not null, the graphs of an SCC are spilled once all of
+      /// its callers are processed
+      GraphSpill *m_spill;
+
+      /// spills the graph of an SCC and drops it from graphs
+      void release (const std::vector<CallGraphNode*> &scc, GraphMap &graphs);
+
+      /// the SCCs of the call graph, callees first
+      struct SccDag;
+      void buildSccDag (SccDag &dag);
+
+      /// computes the graph of an SCC whose callees are all done
+      void processScc (const std::vector<CallGraphNode*> &scc,
+                       LocalAnalysis &la, GraphMap &graphs);
+
+      /// computes the graphs of the SCCs marked in todo, callees first
+      void processSccs (const SccDag &dag, const std::vector<bool> &todo,
+                        GraphMap &graphs);
 
      public:
 
@@ -50,14 +74,32 @@ namespace seahorn
 
       static void cloneAndResolveArguments (const DsaCallSite &CS, 
                                             Graph& calleeG, Graph& callerG);
+      /// as above, for one of the call sites of the caller of batch.
+      /// The caller graph is compressed by batch.finish ()
+      static void cloneAndResolveArguments (const DsaCallSite &CS, 
+                                            Graph& calleeG, BatchCloner &batch);
 
       BottomUpAnalysis (const DataLayout &dl,
                         const TargetLibraryInfo &tli,
                         CallGraph &cg) 
-          : m_dl(dl), m_tli(tli), m_cg(cg) {}
+          : m_dl(dl), m_tli(tli), m_cg(cg), m_spill (nullptr) {}
+
+      /// Spilled graphs are left null in the graph map. The
+      /// callee-caller mapping is then not kept, it would refer to
+      /// the nodes of spilled graphs
+      void setSpill (GraphSpill *spill) { m_spill = spill; }
 
       bool runOnModule (Module &M, GraphMap &graphs);
 
+      /// Recomputes the graphs of the functions in changed and of
+      /// their transitive callers, and keeps the graphs of all other
+      /// functions. changed must contain every function whose body
+      /// was edited or that is new since graphs were computed. New
+      /// graphs are created with sf. Afterwards, the callee-caller
+      /// mapping only covers the call sites of recomputed functions.
+      bool update (Module &M, const FunctionSet &changed, GraphMap &graphs,
+                   Graph::SetFactory &sf);
+
       typedef typename CalleeCallerMapping::const_iterator callee_caller_mapping_const_iterator;
       
       callee_caller_mapping_const_iterator callee_caller_mapping_begin () const 
@@ -75,13 +117,17 @@ namespace seahorn
       Graph::SetFactory m_setFactory;
       const DataLayout *m_dl;
       const TargetLibraryInfo *m_tli;
-      GraphMap m_graphs;
+      /// with --sea-dsa-bu-spill, spilled graphs are null until
+      /// getGraph reads them back
+      mutable GraphMap m_graphs;
+      std::unique_ptr<GraphSpill> m_spill;
       
     public:
 
       static char ID;
 
       BottomUp ();
+      ~BottomUp ();
 
       void getAnalysisUsage (AnalysisUsage &AU) const override;
 
@@ -0,0 +1,104 @@
+#ifndef __DSA_CACHE_HH_
+#define __DSA_CACHE_HH_
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+
+#include "seahorn/Analysis/DSA/Graph.hh"
+#include "seahorn/Analysis/DSA/Global.hh"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/* Binary serialization of the graphs of a global analysis */
+
+namespace llvm
+{
+  class Module;
+  class DataLayout;
+  class raw_ostream;
+}
+
+namespace seahorn
+{
+  namespace dsa
+  {
+    /// Writes the graphs that ga computed for the functions of M,
+    /// tagged with key. Values and types are written as their
+    /// position in M. Returns false, and writes nothing, if a graph
+    /// refers to something that has no position in M.
+    bool writeGraphs (const llvm::Module &M, const GlobalAnalysis &ga,
+                      llvm::StringRef key, llvm::raw_ostream &o);
+
+    /// Global analysis whose graphs are read from the output of
+    /// writeGraphs. Functions sharing a graph when written share it
+    /// when read.
+    class CachedGlobalAnalysis : public GlobalAnalysis
+    {
+     public:
+
+      typedef typename Graph::SetFactory SetFactory;
+
+     private:
+
+      typedef std::shared_ptr<Graph> GraphRef;
+
+      const llvm::DataLayout &m_dl;
+      SetFactory &m_setFactory;
+      /// contents of the cache and its expected key. The contents are
+      /// only used by runOnModule
+      llvm::StringRef m_data;
+      std::string m_key;
+      llvm::DenseMap<const llvm::Function*, GraphRef> m_graphs;
+      bool m_loaded;
+
+     public:
+
+      CachedGlobalAnalysis (const llvm::DataLayout &dl, SetFactory &setFactory,
+                            llvm::StringRef data, llvm::StringRef key)
+          : GlobalAnalysis (), m_dl (dl), m_setFactory (setFactory),
+            m_data (data), m_key (key), m_loaded (false) {}
+
+      /// reads the graphs. Leaves no graph if the data is malformed or
+      /// was written with another key
+      bool runOnModule (Module &M) override;
+
+      /// true if runOnModule read the graphs
+      bool isLoaded () const { return m_loaded; }
+
+      const Graph& getGraph (const Function& fn) const override;
+
+      Graph& getGraph (const Function& fn) override;
+
+      bool hasGraph (const Function& fn) const override;
+    };
+
+    /// Graphs written to a temporary file in the format of the cache
+    /// and read back on demand, so that graphs no one needs for a
+    /// while do not stay in memory
+    class GraphSpill
+    {
+      class Impl;
+      std::unique_ptr<Impl> m_impl;
+
+     public:
+
+      GraphSpill (const llvm::Module &M, const llvm::DataLayout &dl,
+                  Graph::SetFactory &setFactory);
+      ~GraphSpill ();
+
+      /// writes g, the graph of fns. Returns false if g is not written,
+      /// e.g., it refers to a value outside the module, and must be kept
+      bool spill (const std::vector<const llvm::Function*> &fns, const Graph &g);
+
+      bool isSpilled (const llvm::Function &fn) const;
+
+      /// reads back the graph of fn and sets it in graphs for all the
+      /// functions it was spilled with. Returns false if fn was not
+      /// spilled or the graph cannot be read
+      bool reload (const llvm::Function &fn, BottomUpAnalysis::GraphMap &graphs);
+    };
+  }
+}
+#endif
@@ -2,6 +2,10 @@
 #define __DSA__CLONER__HH_
 #include "seahorn/Analysis/DSA/Graph.hh"
 
+#include <memory>
+#include <utility>
+#include <vector>
+
 namespace seahorn
 {
   namespace dsa
@@ -13,25 +17,86 @@ namespace seahorn
     {
       Graph &m_graph;
       llvm::DenseMap<const Node*, Node*> m_map;
+      /// nodes that were merged into an existing node of the graph
+      /// instead of being cloned, with the cell they start at
+      llvm::DenseMap<const Node*, Cell> m_embed;
+      /// clones shared with another cloner, looked up before cloning
+      const Cloner *m_parent;
+      
+      /// the clone of n, or null
+      Node *findClone (const Node &n) const
+      {
+        auto it = m_map.find (&n);
+        if (it != m_map.end ()) return it->second;
+        return m_parent ? m_parent->findClone (n) : nullptr;
+      }
+      /// the cell n was merged into, or null
+      const Cell *findEmbed (const Node &n) const
+      {
+        auto it = m_embed.find (&n);
+        if (it != m_embed.end ()) return &it->second;
+        return m_parent ? m_parent->findEmbed (n) : nullptr;
+      }
+      
+      /// a cell of the graph for a cell of another graph
+      Cell cloneCell (const Cell &c);
+      
+      /// merges n into the node of c as unifying a clone of n at
+      /// offset 0 with c would have. Links of n that meet a link of c
+      /// are added to work
+      void embed (const Node &n, const Cell &c, 
+                  std::vector<std::pair<Cell, Cell> > &work);
       
     public:
-      Cloner (Graph &g) : m_graph(g) {}
+      Cloner (Graph &g) : m_graph(g), m_parent (nullptr) {}
+      /// a cloner that reuses the clones made by parent so far
+      Cloner (Graph &g, const Cloner &parent) : m_graph(g), m_parent (&parent) {}
       
       /// Returns a clone of a given node in the new graph
       /// Recursive clones nodes linked by this node as necessary
       Node &clone (const Node &n);
 
+      /// Unifies dst with a clone of the sub-graph of src. With
+      /// --sea-dsa-lazy-clone, the nodes of src that unify with a node
+      /// of the graph are merged into it and never copied
+      void unifyClone (const Cell &src, Cell &dst);
+
       /// Returns a cloned node that corresponds to the given node
       Node &at (const Node &n)
       {
         assert (hasNode (n));
-        auto it = m_map.find (&n);
-        assert (it != m_map.end ());
-        return *(it->second);
+        return *findClone (n);
       }
       
       /// Returns true if the node has already been cloned
-      bool hasNode (const Node &n) { return m_map.count (&n) > 0; }
+      bool hasNode (const Node &n) const { return findClone (n) != nullptr; }
+    };
+
+    /**
+     * Clones the graphs of the callees of one caller, call site by
+     * call site. The nodes reachable from the globals of a callee
+     * are cloned and unified once for all of its call sites, since
+     * every call site unifies them with the globals of the caller
+     * anyway. The other nodes are cloned for each call site, so the
+     * result is as precise as with a cloner per call site. The
+     * caller graph is compressed once, by finish ()
+     */
+    class BatchCloner
+    {
+      Graph &m_graph;
+      llvm::DenseMap<const Graph*, std::unique_ptr<Cloner> > m_globals;
+      
+    public:
+      BatchCloner (Graph &g) : m_graph (g) {}
+      
+      Graph &graph () { return m_graph; }
+      
+      /// the clones of the globals of callee, unified with the globals
+      /// of the caller on the first call. The parent of the cloner of
+      /// every call site to callee
+      const Cloner &globals (const Graph &callee);
+      
+      void finish () { m_graph.compress (); }
     };
   }
 }
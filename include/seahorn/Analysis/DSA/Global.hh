@@ -107,6 +107,7 @@ namespace seahorn
 
       typedef std::shared_ptr<Graph> GraphRef;
       typedef BottomUpAnalysis::GraphMap GraphMap;
+      typedef BottomUpAnalysis::FunctionSet FunctionSet;
       enum PropagationKind {DOWN, UP, NONE};
 
       const DataLayout &m_dl;
@@ -114,6 +115,19 @@ namespace seahorn
       CallGraph &m_cg;
       SetFactory &m_setFactory;
 
+      /// number of times the propagation changed each graph
+      llvm::DenseMap<const Graph*, unsigned> m_versions;
+      /// the last propagation decided at a call site and the versions
+      /// of the caller and callee graphs it was decided for
+      struct Decision
+      {
+        unsigned callerVersion;
+        unsigned calleeVersion;
+        PropagationKind kind;
+      };
+      llvm::DenseMap<const Instruction*, Decision> m_decisions;
+      unsigned m_decisionHits;
+
      public:
       GraphMap m_graphs;
 
@@ -129,16 +143,30 @@ namespace seahorn
             
       bool checkNoMorePropagation ();
 
+      /// top-down/bottom-up propagation, starting from the call sites
+      /// of bu, until no change
+      void propagate (Module &M, const BottomUpAnalysis &bu);
+
      public:
 
       ContextSensitiveGlobalAnalysis (const DataLayout &dl,
                                       const TargetLibraryInfo &tli,
                                       CallGraph &cg, SetFactory &setFactory) 
           : GlobalAnalysis (), 
-            m_dl(dl), m_tli(tli), m_cg(cg), m_setFactory (setFactory) {}
+            m_dl(dl), m_tli(tli), m_cg(cg), m_setFactory (setFactory),
+            m_decisionHits (0) {}
       
       bool runOnModule (Module &M) override;
 
+      /// Recomputes the graphs after M changed only in the functions
+      /// in changed, e.g., between two transformations. Only the
+      /// changed functions and their transitive callers are analyzed
+      /// again; propagation starts from their call sites. A callee that
+      /// is not analyzed again keeps what earlier callers propagated
+      /// to it, so the graphs are sound but might be less precise than
+      /// after runOnModule.
+      bool update (Module &M, const FunctionSet &changed);
+
       const Graph& getGraph (const Function& fn) const override;
 
       Graph& getGraph (const Function& fn) override;
@@ -9,7 +9,9 @@
 
 #include "llvm/ADT/ImmutableSet.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/Support/Allocator.h"
 
+#include <atomic>
 #include <functional>
 
 namespace llvm
@@ -33,10 +35,40 @@ namespace seahorn
     
     class FunctionalMapper;
     class DsaCallSite;
+    class Cloner;
+    class CacheIO;
+
+    /// forwarding chains walked to find the representative of a cell
+    struct ForwardingStats
+    {
+      /// number of cells whose node was forwarding
+      uint64_t chains;
+      /// forwarding links followed in total
+      uint64_t steps;
+      /// longest chain
+      unsigned longest;
+    };
+    ForwardingStats forwardingStats ();
+
+    /// nodes collapsed because they exceeded a budget
+    struct BudgetStats
+    {
+      /// nodes with too many fields
+      uint64_t fields;
+      /// nodes created in a graph, or in all graphs, with too many nodes
+      uint64_t nodes;
+      /// nodes unified after too many unifications
+      uint64_t unifications;
+    };
+    const BudgetStats &budgetStats ();
+    /// true if a budget is set. The budgets count in globals, so
+    /// graphs are then built one at a time
+    bool hasBudgets ();
 
     class Graph
     {
       friend class Node;
+      friend class CacheIO;
     public:
       typedef llvm::ImmutableSet<llvm::Type*> Set;
       typedef typename Set::Factory SetFactory;
@@ -44,9 +76,13 @@ namespace seahorn
       
       const llvm::DataLayout &m_dl;
       SetFactory &m_setFactory;
-      /// DSA nodes owned by this graph
-      typedef std::vector<std::unique_ptr<Node> > NodeVector;
+      /// DSA nodes owned by this graph. They are allocated in an arena
+      /// and all freed with the graph
+      llvm::SpecificBumpPtrAllocator<Node> m_allocator;
+      typedef std::vector<Node*> NodeVector;
       NodeVector m_nodes;
+      /// number of unifications of nodes of this graph
+      unsigned m_numUnify;
             
       /// Map from scalars to cells in this graph
       typedef llvm::DenseMap<const llvm::Value*, CellRef> ValueMap;
@@ -69,10 +105,17 @@ namespace seahorn
       
       struct IsGlobal 
       {bool operator() (const ValueMap::value_type &kv) const;};
+
+      /// collapses n, a new node without links, if the graph or all
+      /// graphs have too many nodes
+      void checkNodeBudget (Node &n);
+      /// counts a unification. True if there were too many
+      bool overUnifyBudget ();
       
     public:
 
-      Graph (const llvm::DataLayout &dl, SetFactory &sf) : m_dl (dl), m_setFactory (sf) {}
+      Graph (const llvm::DataLayout &dl, SetFactory &sf) :
+        m_dl (dl), m_setFactory (sf), m_numUnify (0) {}
       /// remove all forwarding nodes
       void compress ();
 
@@ -81,6 +124,9 @@ namespace seahorn
 
       Node &cloneNode (const Node &n);
 
+      /// gives the nodes fresh ids, in the order they were created
+      void renumberNodes ();
+
       /// iterate over nodes
       typedef boost::indirect_iterator<typename NodeVector::const_iterator> const_iterator; 
       const_iterator begin() const;
@@ -219,6 +265,8 @@ namespace seahorn
 
       friend class FunctionalMapper;
       friend class SimulationMapper;
+      friend class Cloner;
+      friend class CacheIO;
       struct NodeType
       {
         unsigned shadow:1;
@@ -331,7 +379,7 @@ namespace seahorn
       typedef boost::container::flat_set<const llvm::Value*> AllocaSet;
       AllocaSet m_alloca_sites;
 
-      static uint64_t m_id_factory;
+      static std::atomic<uint64_t> m_id_factory;
 
       uint64_t m_id; // global id for the node
 
@@ -378,6 +426,9 @@ namespace seahorn
 
       void writeTypes (llvm::raw_ostream &o) const;
 
+      /// collapses the node if it has too many fields
+      void checkFieldBudget ();
+
     public:
 
       /// delete copy constructor
@@ -512,13 +563,22 @@ namespace seahorn
     }
 
     void Cell::setLink (unsigned offset, const Cell &c)
-    { getNode ()->setLink(m_offset + offset, c); }
+    {
+      getNode ()->setLink(m_offset + offset, c);
+      getNode ()->checkFieldBudget ();
+    }
 
     void Cell::addLink (unsigned offset, Cell &c)
-    { getNode ()->addLink (m_offset + offset, c); }
+    {
+      getNode ()->addLink (m_offset + offset, c);
+      getNode ()->checkFieldBudget ();
+    }
 
     void Cell::addType (unsigned offset, const llvm::Type *t)
-    { getNode ()->addType(m_offset + offset, t); }
+    {
+      getNode ()->addType(m_offset + offset, t);
+      getNode ()->checkFieldBudget ();
+    }
 
     void Cell::growSize (unsigned o, const llvm::Type *t)
     {
@@ -11,6 +11,7 @@
 #include <boost/range/iterator_range.hpp>
 #include <boost/iterator/filter_iterator.hpp>
 #include <boost/bimap.hpp>
+#include <vector>
 
 /* Gather information for dsa clients and compute some stats */
 
@@ -91,12 +92,20 @@ namespace seahorn
       const llvm::TargetLibraryInfo &m_tli;
       GlobalAnalysis &m_dsa;
       bool m_verbose;
+      /// whether ids and accesses are computed on the first query
+      bool m_lazy;
+      const llvm::Module *m_module;
 
       NodeInfoMap m_nodes_map; // map Node to NodeInfo
       AllocSiteBiMap m_alloc_sites; // bimap allocation sites to id
       NamingMap m_names; // map Value to string name
 
       GraphSet m_seen_graphs;
+      /// lazy mode: graphs whose nodes have ids, accesses and
+      /// allocation site ids, and the functions of every graph
+      GraphSet m_done_graphs;
+      boost::unordered_map<Graph*, std::vector<const llvm::Function*> > m_graph_fns;
+      bool m_all_done;
       typedef typename NodeInfoMap::value_type binding_t;
       
       struct get_second : public std::unary_function<binding_t, NodeInfo> 
@@ -149,35 +158,55 @@ namespace seahorn
       void assignAllocSiteIdAndPrinting (live_nodes_const_range nodes, llvm::raw_ostream&o,
                                          std::string outFile);
 
+      /// lazy mode: computes the information of the graph of f, for
+      /// all the functions that share it
+      void ensureFunction (const llvm::Function &f);
+      /// lazy mode: computes the information of all graphs
+      void ensureAll ();
+
       void printMemoryAccesses (live_nodes_const_range nodes, llvm::raw_ostream&o) const;
 
       void printMemoryTypes (live_nodes_const_range nodes, llvm::raw_ostream&o) const;
       
       public:
        
+      // In lazy mode, runOnModule computes nothing: the ids and
+      // accesses of the nodes of a function are computed when the
+      // function is first queried, and report () prints the
+      // statistics on request. Allocation site ids are then numbered
+      // in the order of the queries instead of the order of the module
       InfoAnalysis (const llvm::DataLayout &dl, const llvm::TargetLibraryInfo &tli,
-                    GlobalAnalysis &dsa, bool verbose = true)
-          : m_dl (dl), m_tli (tli), m_dsa (dsa), m_verbose (verbose) {}
+                    GlobalAnalysis &dsa, bool verbose = true, bool lazy = false)
+          : m_dl (dl), m_tli (tli), m_dsa (dsa), m_verbose (verbose),
+            m_lazy (lazy), m_module (nullptr), m_all_done (false) {}
 
       bool runOnModule (llvm::Module &M);
-      bool runOnFunction (llvm::Function &fn);
+      bool runOnFunction (const llvm::Function &fn);
+
+      // print the statistics of all functions and store them in
+      // ufo::Stats. Done by runOnModule unless lazy
+      void report (llvm::raw_ostream &o);
 
       /// API for Dsa clients
 
       Graph* getDsaGraph (const llvm::Function& f) const;
 
-      bool isAccessed (const Node&n) const; 
+      // queries without a function compute the information of all
+      // functions in lazy mode
+      bool isAccessed (const Node&n); 
+      bool isAccessed (const llvm::Function &f, const Node&n); 
 
       // return unique numeric identifier for node n if found,
       // otherwise 0
-      unsigned int getDsaNodeId (const Node&n) const;
+      unsigned int getDsaNodeId (const Node&n);
+      unsigned int getDsaNodeId (const llvm::Function &f, const Node&n);
 
       // return unique numeric identifier for Value if it is an
       // allocation site, otherwise 0.
-      unsigned int getAllocSiteId (const llvm::Value* V) const;
+      unsigned int getAllocSiteId (const llvm::Value* V);
 
       // the inverse of getAllocSiteID
-      const llvm::Value* getAllocValue (unsigned int alloc_site_id) const;
+      const llvm::Value* getAllocValue (unsigned int alloc_site_id);
 
     };
 
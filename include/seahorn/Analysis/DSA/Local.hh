@@ -9,6 +9,9 @@
 
 #include "seahorn/Analysis/DSA/Graph.hh"
 
+#include <memory>
+#include <vector>
+
 namespace llvm 
 {
    class DataLayout;
@@ -25,12 +28,29 @@ namespace seahorn
     {
       const DataLayout &m_dl;
       const TargetLibraryInfo &m_tli;
+      /// the type set factories of the threads of precompute, and
+      /// the graphs they built that are not imported yet. The graphs
+      /// are destroyed first
+      std::vector<std::unique_ptr<Graph::SetFactory> > m_factories;
+      std::vector<std::unique_ptr<Graph> > m_precomputed;
+      DenseMap<const Function*, unsigned> m_precomputedIdx;
+
+      void build (Function &F, dsa::Graph &g);
 
     public:
       LocalAnalysis (const DataLayout &dl,
                      const TargetLibraryInfo &tli) :
         m_dl(dl), m_tli(tli) {}
 
+      /// builds the local graphs of fns on --sea-dsa-local-threads
+      /// threads, each thread with a type set factory of its own. A
+      /// graph is imported by runOnFunction, in the order of the
+      /// calls, where it gets fresh node ids. The result does not
+      /// depend on the schedule. Does nothing with one thread or if
+      /// a budget is set
+      void precompute (const std::vector<Function*> &fns);
+
+      /// adds the local graph of F to g
       void runOnFunction (Function &F, dsa::Graph &g);
       
     };
@@ -2,6 +2,9 @@
 #define __DSA_MAPPER__HH_
 #include "seahorn/Analysis/DSA/Graph.hh"
 
+#include "llvm/ADT/DenseMap.h"
+
+#include <deque>
 #include <unordered_map>
 #include <boost/container/flat_map.hpp>
 
@@ -31,27 +34,37 @@ namespace seahorn
 
     class SimulationMapper 
     {
-      /// the simulation relation: a node is simulated by a cell
-      typedef std::unordered_map<const Node*,
-                                 boost::container::flat_map<Node*,
-                                                            unsigned> > rel_type;
-      rel_type m_sim;
+      /// the simulation relation: a node is simulated by a cell. The
+      /// cells of a node are stored in m_rel at the position given by
+      /// m_index, so that they stay in place while the relation grows
+      typedef boost::container::flat_map<Node*, unsigned> cells_type;
+      llvm::DenseMap<const Node*, unsigned> m_index;
+      std::deque<std::pair<const Node*, cells_type> > m_rel;
+      /// fail as soon as a node is simulated by two cells
+      bool m_onlyFunction;
+
+      cells_type &cells (const Node &n);
+      const cells_type *cells (const Node &n) const
+      {
+        auto it = m_index.find (&n);
+        return it == m_index.end () ? nullptr : &m_rel [it->second].second;
+      }
+      void clear () { m_index.clear (); m_rel.clear (); }
 
     public:
 
-      SimulationMapper () {}
+      SimulationMapper (bool onlyFunction = false) :
+        m_onlyFunction (onlyFunction) {}
 
       bool insert (const Cell &c1, Cell &c2);
       bool insert (const Node &n1, Node &n2, unsigned offset);
 
       Cell get (const Node &n) const
       {
-        if (!m_sim.count (&n)) return Cell ();
-        auto &map = m_sim.at (&n);
-
-        if (map.size () != 1) return Cell ();
+        auto *map = cells (n);
+        if (!map || map->size () != 1) return Cell ();
         
-        auto kv = map.begin ();
+        auto kv = map->begin ();
         return Cell (*kv->first, kv->second);
       }
       
@@ -64,7 +77,7 @@ namespace seahorn
                      res.getOffset () + c.getOffset ());
       }
 
-      bool empty () const { return m_sim.empty (); }
+      bool empty () const { return m_rel.empty (); }
 
       // Return true if no cell can simulate more than one node
       bool isInjective (bool onlyModified = true) const;
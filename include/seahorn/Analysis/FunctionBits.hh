@@ -0,0 +1,85 @@
+#ifndef _FUNCTION_BITS__HH_
+#define _FUNCTION_BITS__HH_
+
+/**
+ * Must/may properties of the functions of a module as dense bitsets,
+ * e.g., whether a function can fail or can access memory
+ */
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SCCIterator.h"
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  class FunctionBits
+  {
+    /// id of a function, in the order of the module
+    DenseMap<const Function*, unsigned> m_ids;
+    BitVector m_must;
+    BitVector m_may;
+
+    int id (const Function *f) const
+    {
+      if (!f) return -1;
+      auto it = m_ids.find (f);
+      return it == m_ids.end () ? -1 : (int) it->second;
+    }
+
+  public:
+    void init (const Module &M)
+    {
+      m_ids.clear ();
+      for (const Function &F : M) m_ids.insert (std::make_pair (&F, m_ids.size ()));
+      m_must.clear ();
+      m_must.resize (m_ids.size ());
+      m_may.clear ();
+      m_may.resize (m_ids.size ());
+    }
+
+    void setMust (const Function *f)
+    { int i = id (f); if (i >= 0) m_must.set (i); }
+
+    bool must (const Function *f) const
+    { int i = id (f); return i >= 0 && m_must.test (i); }
+
+    bool may (const Function *f) const
+    { int i = id (f); return i >= 0 && (m_must.test (i) || m_may.test (i)); }
+
+    bool noneMust () const { return m_must.none (); }
+    unsigned countMust () const { return m_must.count (); }
+    unsigned countMay () const { return m_may.count (); }
+
+    /// a function that calls a function of may, or must, is in may.
+    /// One pass over the SCCs of CG, callees first
+    void propagate (CallGraph &CG)
+    {
+      for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
+      {
+        auto &scc = *it;
+        bool mark = false;
+        for (CallGraphNode *cgn : scc)
+        {
+          for (auto &calls : *cgn)
+            if (may (calls.second->getFunction ())) {mark = true; break;}
+          if (mark) break;
+        }
+        if (!mark) continue;
+        for (CallGraphNode *cgn : scc)
+        { int i = id (cgn->getFunction ()); if (i >= 0) m_may.set (i); }
+      }
+    }
+
+    template <typename OutputIterator>
+    void mays (OutputIterator out) const
+    {
+      for (auto &kv : m_ids)
+        if (m_may.test (kv.second)) *out++ = kv.first;
+    }
+  };
+}
+#endif /* _FUNCTION_BITS__HH_ */
@@ -0,0 +1,53 @@
+#ifndef _FUNCTION_CLASSES__HH_
+#define _FUNCTION_CLASSES__HH_
+
+/**
+ * Equivalence classes of functions whose bodies are identical up to
+ * names
+ */
+#include "llvm/IR/Function.h"
+#include "llvm/ADT/DenseMap.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// Functions are added callees first, e.g., in the order of the
+  /// call graph. Two functions are in the same class if their normal
+  /// forms are equal. The normal form numbers the arguments, blocks
+  /// and instructions by position, and the region ids of the
+  /// shadow.mem calls by first use, and names a called function by the
+  /// representative of its class. Globals and constants are kept, so
+  /// that the functions of a class read the same state
+  class FunctionClasses
+  {
+    /// the normal forms of the representatives, by their hash
+    std::unordered_multimap<size_t, std::pair<std::string, const Function*> > m_forms;
+    DenseMap<const Function*, const Function*> m_rep;
+
+  public:
+    /// adds F and returns the representative of its class, i.e., the
+    /// first function added with the same normal form. F if it is the
+    /// first, or if its body has no normal form
+    const Function &add (const Function &F);
+
+    /// the representative of F, F if it was not added
+    const Function &rep (const Function &F) const
+    {
+      auto it = m_rep.find (&F);
+      return it == m_rep.end () ? F : *it->second;
+    }
+
+    /// the normal form of the body of F. Empty if F has an instruction
+    /// whose state is not in its operands, e.g., inline assembly
+    std::string normalForm (const Function &F) const;
+
+    void clear () { m_forms.clear (); m_rep.clear (); }
+  };
+}
+
+#endif
@@ -7,12 +7,13 @@
 #include <deque>
 #include <memory>
 #include <type_traits>
+#include <limits>
+#include <tuple>
 
 #include <boost/shared_ptr.hpp>
 #include "boost/make_shared.hpp"
 #include "boost/range/iterator_range.hpp"
 #include "boost/iterator/indirect_iterator.hpp"
-#include "boost/optional.hpp"
 #include "boost/unordered_map.hpp"
 #include <boost/graph/graph_traits.hpp>
 #include <boost/graph/properties.hpp>
@@ -167,7 +168,13 @@ namespace seahorn
   };
 
 
-  /// Constructs a weak topological order of a BGL graph
+  /// Constructs a weak topological order of a BGL graph.
+  ///
+  /// Bourdoncle's algorithm runs with an explicit stack of frames, so
+  /// that long chains of vertices do not exhaust the native stack.
+  /// Vertices are numbered as they are discovered and the depth-first
+  /// numbers are kept in a vector indexed by these numbers. The
+  /// buffers are kept between calls of buildWto.
   template<typename G>
   class WeakTopoOrder {
 
@@ -177,67 +184,7 @@ namespace seahorn
 
    private:
 
-    // A helper class to extend an unsigned number with +oo;
-    class Number {
-
-      boost::optional<unsigned> m_n;
-
-     public:
-
-      // +oo
-      Number(): m_n (boost::none) { }
-
-      static Number plus_infinite () 
-      { return Number(); }
-      
-      Number(unsigned n): m_n (n) { }
-
-      Number (const Number& o): m_n (o.m_n) { }
-
-      Number& operator=(Number o) {
-        m_n = o.m_n;
-        return *this;
-      }
-
-      bool is_plus_infinite () const { return m_n == boost::none;}
-
-      bool is_finite() const { return !is_plus_infinite();}
-
-      unsigned number () const {
-        assert (is_finite());
-        return *m_n;
-      }
-
-      bool operator==(Number o) const {
-        if (is_plus_infinite() && o.is_plus_infinite())
-          return true;
-
-        if (is_plus_infinite() || o.is_plus_infinite())
-          return false;
-        
-        return (number() == o.number());
-      }
-      
-      bool operator<=(Number o) const {
-        if (is_plus_infinite() && o.is_plus_infinite()) 
-          return true;
-      
-        if (is_plus_infinite()) 
-          return false;
-        
-        if (o.is_plus_infinite()) 
-          return true;
-        
-        return (number() <= o.number());
-      }
-
-      void write(llvm::raw_ostream &o) const {
-        if (is_plus_infinite()) 
-          o << "+oo";
-        else 
-          o << number();
-      }
-    };
+    typedef typename boost::graph_traits<G>::out_edge_iterator edge_iterator;
 
     typedef WtoElement<vertex_t> wto_element_t;
     typedef WtoSingleton<vertex_t> wto_singleton_t;
@@ -245,104 +192,169 @@ namespace seahorn
 
     typedef boost::shared_ptr<wto_element_t> wto_element_ptr;
     typedef std::deque<wto_element_ptr> partition_t;
-    typedef boost::unordered_map <vertex_t, Number> dfn_map_t;
-    typedef std::vector<vertex_t> stack_t;
-    typedef boost::unordered_map <vertex_t, std::vector<wto_component_t> > nested_components_t;
+    typedef std::vector<vertex_t> heads_t;
+
+    /// depth-first number of a vertex whose component is done
+    static const unsigned Infinite = std::numeric_limits<unsigned>::max ();
+
+    /// a call of visit or of component in Bourdoncle's paper
+    struct Frame {
+      vertex_t v;
+      unsigned idx;
+      /// next successor of v
+      edge_iterator it, end;
+      /// lowest depth-first number reached from v
+      unsigned head;
+      bool loop;
+      /// true once v is known to be the head of a component, while
+      /// its component is built
+      bool component;
+      /// index in m_parts of the partition the element of v goes to
+      unsigned part;
+    };
 
     //! the graph 
     G* m_g;
 
     //! internal datastructures to compute the wto
-    dfn_map_t m_dfn;
-    stack_t m_stack;
+    boost::unordered_map<vertex_t, unsigned> m_index;
+    std::vector<vertex_t> m_vertices;
+    std::vector<unsigned> m_dfn;
+    std::vector<unsigned> m_stack;
+    std::vector<Frame> m_frames;
+    std::vector<partition_t> m_parts;
     unsigned m_cur_dfn_num;
 
     //! the resulting wto of the graph
     partition_t m_partition;  
-    //! map each vertex to its nested components
-    nested_components_t m_nested_components;
+    //! heads of the nested components of each vertex, outermost first
+    std::vector<heads_t> m_heads;
+    //! components of vertices that are not in the wto
+    heads_t m_no_components;
+
+    /// number of v, assigned on first use
+    unsigned index (vertex_t v) {
+      auto r = m_index.insert (std::make_pair (v, m_vertices.size ()));
+      if (r.second) {
+        m_vertices.push_back (v);
+        m_dfn.push_back (0);
+      }
+      return r.first->second;
+    }
 
-   private:
+    /// index of v if it is in the wto
+    const unsigned *find (vertex_t v) const {
+      auto it = m_index.find (v);
+      if (it == m_index.end () || it->second >= m_heads.size ()) return nullptr;
+      return &it->second;
+    }
 
-    // helper to avoid initializing all vertices to zero
-    Number getDfn(vertex_t v) const {
-      auto it = m_dfn.find(v);
-      if (it != m_dfn.end())
-        return it->second;
-      return 0;
+    heads_t &components(vertex_t v) {
+      const unsigned *idx = find (v);
+      return idx ? m_heads [*idx] : m_no_components;
     }
 
-    // as described in Bourdoncle's
-    partition_t component(vertex_t v) {
-      partition_t partition;
-      for (auto vw: boost::make_iterator_range(boost::out_edges (v, *m_g))) {
-        auto w = boost::target(vw, *m_g);
-        if (getDfn(w) == 0) visit(w, partition);
-      }
-      return partition;
+    void enter (vertex_t v, unsigned idx, unsigned part) {
+      m_stack.push_back (idx);
+      m_dfn [idx] = ++m_cur_dfn_num;
+      Frame f;
+      f.v = v;
+      f.idx = idx;
+      std::tie (f.it, f.end) = boost::out_edges (v, *m_g);
+      f.head = m_dfn [idx];
+      f.loop = false;
+      f.component = false;
+      f.part = part;
+      m_frames.push_back (f);
     }
 
-    // as described in Bourdoncle's
-    Number visit(vertex_t v, partition_t &partition) {
-      m_stack.push_back (v); 
-      m_dfn[v] = m_cur_dfn_num++;
-      auto head = getDfn(v);
-      bool loop = false;
-      for (auto vw: boost::make_iterator_range(boost::out_edges (v, *m_g))) {
-        auto w = boost::target(vw, *m_g);
-        auto min = getDfn(w);
-        if (min == 0)
-          min = visit (w, partition);
-        if (min <= head) {
-          head = min;
-          loop = true;
+    // as described in Bourdoncle's, with the recursion unrolled
+    void visit (vertex_t r) {
+      m_parts.resize (1);
+      enter (r, index (r), 0);
+
+      while (!m_frames.empty ()) {
+        Frame &f = m_frames.back ();
+
+        if (f.it != f.end) {
+          vertex_t w = boost::target (*f.it, *m_g);
+          ++f.it;
+          unsigned widx = index (w);
+          unsigned min = m_dfn [widx];
+          if (min == 0) {
+            // -- the successors of a head are visited into the
+            // -- partition of its component
+            enter (w, widx, f.component ? m_parts.size () - 1 : f.part);
+            continue;
+          }
+          if (!f.component && min <= f.head) {
+            f.head = min;
+            f.loop = true;
+          }
+          continue;
         }
-      }
 
-      if (head == getDfn(v)) { // v is the head of a component
-        m_dfn[v] = Number::plus_infinite();
-        auto element = m_stack.back();
-        m_stack.pop_back();
-        if (loop) {
-            while (!(element == v)) {
-              m_dfn[element] = 0; // reset
-              element = m_stack.back();
-              m_stack.pop_back();            
+        if (f.component) {
+          // -- the component of f.v is complete
+          wto_element_ptr c = boost::make_shared<wto_component_t> 
+            (f.v, std::move (m_parts.back ()));
+          m_parts.pop_back ();
+          m_parts [f.part].push_front (c);
+        }
+        else if (f.head == m_dfn [f.idx]) { // v is the head of a component
+          m_dfn [f.idx] = Infinite;
+          unsigned element = m_stack.back ();
+          m_stack.pop_back ();
+          if (f.loop) {
+            while (element != f.idx) {
+              m_dfn [element] = 0; // reset
+              element = m_stack.back ();
+              m_stack.pop_back ();
             }
-            partition.push_front(boost::static_pointer_cast<wto_element_t>
-                                 (boost::make_shared<wto_component_t> (v, component(v))));
-        } else {
-          partition.push_front(boost::static_pointer_cast<wto_element_t>
-                               (boost::make_shared<wto_singleton_t> (v)));
-          
+            // -- build the component from the successors of v
+            f.component = true;
+            std::tie (f.it, f.end) = boost::out_edges (f.v, *m_g);
+            m_parts.push_back (partition_t ());
+            continue;
+          }
+          m_parts [f.part].push_front 
+            (boost::make_shared<wto_singleton_t> (f.v));
+        }
+
+        // -- return the head of f to the caller
+        unsigned head = f.head;
+        m_frames.pop_back ();
+        if (m_frames.empty ()) break;
+        Frame &caller = m_frames.back ();
+        if (!caller.component && head <= caller.head) {
+          caller.head = head;
+          caller.loop = true;
         }
       }
-      return head;
+      m_partition.swap (m_parts.front ());
+      m_parts.clear ();
     }
 
     // This is for building the \omega function from Bourdoncle's paper.
     // \omega(c) is the set of heads of the (nested) components containing c
-    template<typename E, typename NestedComponentsTable>
-    class NestedComponentsVisitor: public WtoElementVisitor<E> {
-      typedef WtoElementVisitor<E> wto_element_visitor_t;
-      typedef typename wto_element_visitor_t::wto_singleton_t wto_singleton_t;
-      typedef typename wto_element_visitor_t::wto_component_t wto_component_t;
+    class NestedComponentsVisitor: public WtoElementVisitor<vertex_t> {
+      typedef WtoElementVisitor<vertex_t> wto_element_visitor_t;
 
-      std::vector<wto_component_t> m_nested_components;
-      NestedComponentsTable  &m_nested_components_table;
+      WeakTopoOrder &m_wto;
+      heads_t m_nested_components;
 
      public:
 
-      NestedComponentsVisitor (NestedComponentsTable  &t)
-          : wto_element_visitor_t(), m_nested_components_table(t) { }
+      NestedComponentsVisitor (WeakTopoOrder &wto)
+          : wto_element_visitor_t(), m_wto(wto) { }
 
       virtual void visit (const wto_singleton_t &s) {
-        m_nested_components_table[s.get()] = m_nested_components;
+        m_wto.m_heads[m_wto.m_index[s.get()]] = m_nested_components;
       }
       
       virtual void visit (const wto_component_t &c) {
-        m_nested_components.push_back(c);
-        m_nested_components_table[c.head()] = m_nested_components;
+        m_nested_components.push_back(c.head());
+        m_wto.m_heads[m_wto.m_index[c.head()]] = m_nested_components;
         for (auto &e : c) { e.accept(this); }
         m_nested_components.pop_back();
       }            
@@ -350,27 +362,18 @@ namespace seahorn
 
     // build a map from graph vertex to nested components in the wto
     void buildNestedComponents () {
-      NestedComponentsVisitor<vertex_t, nested_components_t> vis (m_nested_components);
+      m_heads.assign (m_vertices.size (), heads_t ());
+      NestedComponentsVisitor vis (*this);
       for (auto c: m_partition)
       { c->accept (&vis); }
     }
 
-    struct getHead : public std::unary_function<wto_component_t, vertex_t>
-    {
-      getHead () { }
-      vertex_t operator () (const wto_component_t &c) const { return c.head(); }
-    }; 
-
    public:
 
     typedef boost::indirect_iterator<typename partition_t::iterator> iterator;
     typedef boost::indirect_iterator<typename partition_t::const_iterator> const_iterator;
-    typedef boost::transform_iterator<getHead, 
-                                      typename std::vector<wto_component_t>::iterator > 
-    nested_components_iterator;
-    typedef boost::transform_iterator<getHead, 
-                                      typename std::vector<wto_component_t>::const_iterator > 
-    nested_components_const_iterator;
+    typedef typename heads_t::const_iterator nested_components_iterator;
+    typedef typename heads_t::const_iterator nested_components_const_iterator;
 
     
     WeakTopoOrder()
@@ -378,10 +381,17 @@ namespace seahorn
 
     void buildWto (G* g, vertex_t r) {
       m_g = g;
-      visit(r, m_partition);
+      // -- a wto can be rebuilt after the graph changed
+      m_partition.clear();
+      m_heads.clear();
+      m_index.clear();
+      m_vertices.clear();
+      m_cur_dfn_num = 0;
+      visit(r);
       buildNestedComponents();
-      // cleanup
+      // cleanup, the buffers keep their capacity
       m_stack.clear();
+      m_frames.clear();
       m_dfn.clear();
     }
 
@@ -398,22 +408,34 @@ namespace seahorn
     const_iterator begin () const { return boost::make_indirect_iterator(m_partition.begin());}
     const_iterator end () const  { return boost::make_indirect_iterator(m_partition.end());}
 
+    // -- whether v is reachable from the root, i.e., is in the wto
+    bool contains(vertex_t v) const 
+    { return find (v) != nullptr; }
+
+    // -- number of (nested) components containing v
+    unsigned nesting_depth(vertex_t v) const 
+    {
+      const unsigned *idx = find (v);
+      return idx ? m_heads [*idx].size () : 0;
+    }
+
+    // -- a vertex that is not in the wto has no components
     nested_components_iterator nested_components_begin(vertex_t v) 
-    { return boost::make_transform_iterator(m_nested_components[v].begin(), getHead()); }
+    { return components(v).begin(); }
     nested_components_iterator nested_components_end(vertex_t v) 
-    { return boost::make_transform_iterator(m_nested_components[v].end(), getHead()); }
+    { return components(v).end(); }
 
     nested_components_const_iterator nested_components_begin(vertex_t v) const 
     { 
-      auto it = m_nested_components.find(v);
-      assert (it != m_nested_components.end ());
-      return boost::make_transform_iterator(it->second.begin(), getHead()); 
+      const unsigned *idx = find (v);
+      assert (idx);
+      return m_heads [*idx].begin (); 
     }
     nested_components_const_iterator nested_components_end(vertex_t v) const 
     { 
-      auto it = m_nested_components.find(v);
-      assert (it != m_nested_components.end ());
-      return boost::make_transform_iterator(it->second.end(), getHead()); 
+      const unsigned *idx = find (v);
+      assert (idx);
+      return m_heads [*idx].end (); 
     }
     
   };  
@@ -31,6 +31,24 @@ namespace seahorn
     const_iterator begin () const {return m_wto.begin ();}
     const_iterator end () const {return m_wto.end ();}
    
+    /// number of components containing bb, 0 outside of any cycle
+    unsigned nestingDepth (const llvm::BasicBlock &bb) const
+    { return m_wto.nesting_depth (const_cast<llvm::BasicBlock*> (&bb)); }
+
+    /// true if bb is the head of a component
+    bool isHead (const llvm::BasicBlock &bb) const
+    {
+      llvm::BasicBlock *v = const_cast<llvm::BasicBlock*> (&bb);
+      if (m_wto.nesting_depth (v) == 0) return false;
+      // -- the innermost component of a head is its own
+      llvm::BasicBlock *inner = nullptr;
+      for (llvm::BasicBlock *h : 
+             boost::make_iterator_range (m_wto.nested_components_begin (v),
+                                         m_wto.nested_components_end (v)))
+        inner = h;
+      return inner == v;
+    }
+
     // TODO: wto_t has more methods that should be exposed here,
     // specially those to iterate over the nested components of a
     // given basic block.
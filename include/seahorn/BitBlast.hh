@@ -0,0 +1,95 @@
+#ifndef __BIT_BLAST__HH_
+#define __BIT_BLAST__HH_
+/// Bit-blasting of the bit-vector encodings of BvSmallSymExec
+
+#include "seahorn/Aig.hh"
+
+#include "ufo/Expr.hpp"
+#include "ufo/ExprBv.hh"
+
+#include <map>
+#include <utility>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// Translates quantifier-free formulas over Booleans, bit-vectors
+  /// and arrays from bit-vectors to bit-vectors into an Aig.
+  ///
+  /// Arrays are eliminated. An array constant defined by an equality,
+  /// e.g., a memory of SymExec, is replaced by its definition, and a
+  /// read of a store is a choice between the stored value and a read
+  /// of the array below. The reads of the other array constants are
+  /// fresh bits, constrained to be equal on equal indices. Terms that
+  /// cannot be translated, e.g., integers or other array equalities,
+  /// make the translation fail
+  class BitBlaster
+  {
+  public:
+    /// the bits of a bit-vector, least significant first
+    typedef std::vector<Aig::Lit> Bits;
+
+  private:
+    Aig &m_aig;
+    bool m_ok;
+
+    std::map<Expr, Aig::Lit> m_lits;
+    std::map<Expr, Bits> m_bits;
+    /// definitions of array constants
+    std::map<Expr, Expr> m_arrays;
+    std::map<std::pair<Expr, Expr>, Bits> m_reads;
+    /// indices and values of the reads of every undefined array
+    std::map<Expr, std::vector<std::pair<Bits, Bits> > > m_free;
+    /// constraints on the reads of undefined arrays
+    std::vector<Aig::Lit> m_constraints;
+    /// inputs of the Aig: constants and reads of undefined arrays
+    std::vector<std::pair<Expr, Bits> > m_inputs;
+
+    Aig::Lit fail () { m_ok = false; return Aig::mkFalse (); }
+    Bits input (Expr term, unsigned width);
+
+    Aig::Lit litRaw (Expr e);
+    Bits bitsRaw (Expr e);
+    /// the bits of the read of array a at idx, whose bits are i
+    Bits read (Expr a, Expr idx, const Bits &i);
+
+    /// -- circuits
+    Aig::Lit equal (const Bits &a, const Bits &b);
+    Aig::Lit ult (const Bits &a, const Bits &b);
+    Aig::Lit slt (const Bits &a, const Bits &b);
+    Bits mux (Aig::Lit c, const Bits &t, const Bits &e);
+    Bits add (const Bits &a, const Bits &b, Aig::Lit carry);
+    Bits negate (const Bits &a);
+    Bits mul (const Bits &a, const Bits &b);
+    /// quotient and remainder of unsigned division
+    void udivrem (const Bits &a, const Bits &b, Bits &q, Bits &r);
+    Bits sdiv (const Bits &a, const Bits &b);
+    Bits srem (const Bits &a, const Bits &b);
+    /// shifts left, or right with fill for the vacated bits
+    Bits shift (const Bits &a, const Bits &amount, bool left, bool arith);
+
+  public:
+    BitBlaster (Aig &aig) : m_aig (aig), m_ok (true) {}
+
+    /// true if every term so far could be translated
+    bool ok () const { return m_ok; }
+
+    /// records the definition x = t of an array constant. False if x
+    /// is not an array constant or is defined already
+    bool define (Expr x, Expr t);
+
+    /// the literal of a Boolean formula
+    Aig::Lit lit (Expr e);
+    /// the bits of a bit-vector term
+    Bits bits (Expr e);
+
+    /// literals that must hold together with the translated formulas
+    const std::vector<Aig::Lit> &constraints () const { return m_constraints; }
+    /// the terms of the inputs, with their bits
+    const std::vector<std::pair<Expr, Bits> > &inputs () const { return m_inputs; }
+  };
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "boost/logic/tribool.hpp"
 
 #include "ufo/Expr.hpp"
+#include "ufo/ExprHash.hpp"
 #include "ufo/Smt/EZ3.hh"
 
 #include "seahorn/Analysis/CutPointGraph.hh"
@@ -17,11 +18,49 @@
 
 #include "seahorn/Transforms/Instrumentation/ShadowMemDsa.hh"
 
+#include <map>
+#include <memory>
+
 namespace seahorn
 {
   using namespace expr;
   class BmcTrace;
   
+  /// Simplifies the side conditions of BmcEngine before they are
+  /// asserted. Folds constants and trivial ITEs, and eliminates every
+  /// equality that defines a constant not used before, e.g., the
+  /// copies of SymStore, by substituting it in all later conditions.
+  /// Definitions are kept to evaluate the eliminated constants
+  class BmcSimplifier
+  {
+    ExprFactory &m_efac;
+    /// eliminated constants and their definitions. The definitions
+    /// are over constants that are not eliminated
+    ExprMap m_defs;
+    ExprVector m_defLog;
+    /// constants of the conditions asserted so far and of m_defs
+    ExprHashSet m_seen;
+    ExprVector m_seenLog;
+    
+    void see (Expr e);
+    /// records the definition x = v if x is new. Returns false otherwise
+    bool define (Expr x, Expr v);
+    
+  public:
+    BmcSimplifier (ExprFactory &efac) : m_efac (efac) {}
+    
+    /// simplifies e. Returns null if nothing is left to assert
+    Expr simplify (Expr e);
+    /// e with the eliminated constants replaced by their definitions
+    Expr expand (Expr e) const { return m_defs.empty () ? e : replace (e, m_defs); }
+    
+    typedef std::pair<unsigned, unsigned> Mark;
+    Mark mark () const { return Mark (m_defLog.size (), m_seenLog.size ()); }
+    /// forgets the definitions and constants since m
+    void undo (const Mark &m);
+    void reset () { undo (Mark (0, 0)); }
+  };
+  
   class BmcEngine 
   {
     /// symbolic operational semantics
@@ -43,32 +82,91 @@ namespace seahorn
     const CutPointGraph *m_cpg;
     const llvm::Function* m_fn;
     
-    ufo::ZSolver<ufo::EZ3> m_smt_solver;
+    /// tactics applied by the solvers, see --horn-bmc-tactics
+    std::vector<std::string> m_tactics;
+    /// solver leased from the pool of the context
+    ufo::ZSolverPool<ufo::EZ3>::Lease m_lease;
+    ufo::ZSolver<ufo::EZ3> &m_smt_solver;
     
     /// path-condition for m_cps
     ExprVector m_side;
-    
+    /// size of m_side after the encoding of each edge of m_edges
+    std::vector<unsigned> m_sideEnd;
+    /// prefix of m_side asserted in m_smt_solver
+    unsigned m_asserted;
+    
+    /// number of cutpoints and size of m_side at each push ()
+    std::vector<std::pair<unsigned, unsigned> > m_frames;
+    
+    /// simplifier of --horn-bmc-simplify, if any
+    std::unique_ptr<BmcSimplifier> m_simp;
+    std::vector<BmcSimplifier::Mark> m_simpFrames;
+    /// asserts the i-th side condition, simplified
+    void assertSide (unsigned i);
+    /// e over the constants of the model of m_smt_solver
+    Expr expand (Expr e) const { return m_simp ? m_simp->expand (e) : e; }
+    
+    /// re-asserts the path-condition, re-opening a scope at every frame
+    void restoreSolver ();
+    
+    /// up to k edge variables of the trace to split on, most used
+    /// first. Literals implied by the path condition are added to
+    /// units instead. False if the path condition is unsat
+    bool splitLiterals (unsigned k, ExprVector &lits, ExprVector &units);
     
   public:
     BmcEngine (SmallStepSymExec &sem, ufo::EZ3 &zctx) : 
       m_sem (sem), m_efac (sem.efac ()), m_result (boost::indeterminate),
       m_cpg (nullptr), m_fn (nullptr),
-      m_smt_solver (zctx)
+      m_tactics (tactics (sem)), m_lease (leaseSolver (zctx, m_tactics)),
+      m_smt_solver (*m_lease),
+      m_asserted (0), m_simp (makeSimplifier (m_efac))
     {};
     
+    /// the simplifier of --horn-bmc-simplify, null if it is off
+    static BmcSimplifier *makeSimplifier (ExprFactory &efac);
+    /// the tactics of --horn-bmc-tactics for the encoding of sem,
+    /// empty if it is off
+    static std::vector<std::string> tactics (SmallStepSymExec &sem);
+    /// a solver of zctx that applies tactics. A plain one if a tactic
+    /// is unknown
+    static ufo::ZSolverPool<ufo::EZ3>::Lease
+    leaseSolver (ufo::EZ3 &zctx, std::vector<std::string> &tactics);
+    
+    /// extends the trace. Can be called after encode () or solve ()
+    /// in which case only the new edges are encoded
     void addCutPoint (const CutPoint &cp);
     
     SmallStepSymExec& sem () {return m_sem;}
     
     ufo::EZ3 &zctx () { return m_smt_solver.getContext (); }
     
-    /// constructs the path condition
+    /// constructs the path condition of the cutpoints added since
+    /// the last call and asserts it
     void encode ();
     /// checks satisfiability of the path condition
     boost::tribool solve ();
+    /// checks satisfiability of the path condition by splitting it
+    /// into 2^k cubes over the edge variables of the trace, solved
+    /// by threads solvers that share the unsat cores of their cubes.
+    /// Stops at the first sat cube. The solvers other than the one
+    /// of the engine need a concurrent expression factory
+    boost::tribool solveCubes (unsigned k, unsigned threads);
+    /// checks satisfiability of the path condition at the bit level:
+    /// bit-blasts it into an Aig, reduces it, and solves its CNF. A
+    /// model is lifted back to the solver of the engine, as after
+    /// solve (), which is used instead if the path condition cannot
+    /// be bit-blasted
+    boost::tribool solveAig ();
     /// returns the latest result from solve() 
     boost::tribool result () { return m_result; }
     
+    /// symbolic state at the i-th cutpoint. Available after encode ()
+    SymStore &state (unsigned i) { return m_states [i]; }
+    /// adds e to the path condition. e is over the values of the
+    /// states, e.g., an invariant evaluated in one of them
+    void assume (Expr e) { encode (); m_side.push_back (e); }
+    
     
     /// output current path condition in SMT-LIB2 format
     template<typename OutputStream>
@@ -81,12 +179,24 @@ namespace seahorn
     /// reset the engine
     void reset ();
     
+    /// encodes the current trace and saves it as a prefix to return to
+    void push ();
+    /// drops the cutpoints added since the matching push ()
+    void pop ();
+    /// number of push () not popped yet
+    unsigned numFrames () const { return m_frames.size (); }
+    /// number of cutpoints on the trace
+    unsigned size () const { return m_cps.size (); }
+    
     /// Returns the BMC trace (if available)
     BmcTrace getTrace ();
     
     /// Dump unsat core 
     /// Exposes internal details. Intendent to be used for debugging only
     void unsatCore (ExprVector &out);
+    /// index of the edge whose encoding contains the side condition
+    /// e of the path condition, -1 if there is none
+    int edgeOf (Expr e) const;
 
     friend class BmcTrace;
     
@@ -106,9 +216,27 @@ namespace seahorn
     /// of the corresponding cutpoint in BmcEngine
     SmallVector<unsigned, 8> m_cpId;
     
+    /// memo of evaluating expressions in each of the states of BmcEngine
+    std::vector<std::shared_ptr<DagVisitMemo> > m_evalMemo;
+    
+    /// true once m_bbs and m_cpId are computed
+    bool m_built;
+    /// values in m_model, without and with completion
+    ExprHashMap<Expr> m_modelMemo [2];
+    /// values of the registers at each location, without and with completion
+    std::map<std::pair<unsigned, const llvm::Value*>, Expr> m_valMemo [2];
     
     BmcTrace (BmcEngine &bmc, ufo::ZModel<ufo::EZ3> &model);
 
+    /// computes the trace of basic blocks, from an implicant of the
+    /// path condition, on first use
+    void build ();
+    
+    /// evaluates u in a state of BmcEngine
+    Expr evalStore (unsigned stateidx, Expr u);
+    /// evaluates e in the model
+    Expr modelEval (Expr e, bool complete);
+
     
     /// cutpoint id corresponding to the given location
     unsigned cpid (unsigned loc) const {return m_cpId[loc];}
@@ -122,15 +250,18 @@ namespace seahorn
     
     BmcTrace (const BmcTrace &other) :
       m_bmc (other.m_bmc), m_model (other.m_model),
-      m_bbs (other.m_bbs), m_cpId (other.m_cpId) {}
+      m_bbs (other.m_bbs), m_cpId (other.m_cpId),
+      m_evalMemo (other.m_evalMemo), m_built (other.m_built),
+      m_modelMemo {other.m_modelMemo [0], other.m_modelMemo [1]},
+      m_valMemo {other.m_valMemo [0], other.m_valMemo [1]} {}
     
     /// underlying BMC engine
     BmcEngine &engine () { return m_bmc; }
     /// The number of basic blocks in the trace 
-    unsigned size () const {return m_bbs.size ();}
+    unsigned size () { build (); return m_bbs.size ();}
     
     /// The basic block at a given location 
-    const llvm::BasicBlock* bb (unsigned loc) const {return m_bbs [loc];}
+    const llvm::BasicBlock* bb (unsigned loc) { build (); return m_bbs [loc];}
     
     /// The value of the instruction at the given location 
     Expr symb (unsigned loc, const llvm::Value &inst);
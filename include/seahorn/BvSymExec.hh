@@ -6,6 +6,8 @@
 #include "seahorn/SymExec.hh"
 #include "seahorn/Analysis/CanFail.hh"
 
+#include <map>
+
 namespace seahorn
 {
   
@@ -14,6 +16,47 @@ namespace seahorn
   Expr bvIntAbstract (Expr v);
   
   
+  /// Word-level rewriting of bit-vector terms, enabled by
+  /// --horn-bv-simplify. Folds numerals, extract/concat/zext chains,
+  /// shifts by a constant, low-bit masks and zero-extended concats,
+  /// and keeps sums in the form base + symbolic + numeral. When
+  /// disabled, every method builds the plain term
+  class BvRewriter
+  {
+    ExprFactory &m_efac;
+    
+    /// n as a numeral of width w
+    Expr num (mpz_class n, unsigned w);
+    /// n as a numeral of width w, for w of at most 64
+    Expr num64 (uint64_t n, unsigned w) {return bv::bvnum64 (n, w, m_efac);}
+    
+  public:
+    BvRewriter (ExprFactory &efac) : m_efac (efac) {}
+    
+    /// width of a bit-vector term, 0 if it is not known
+    static unsigned width (Expr e);
+    /// true if e is a numeral and stores its unsigned value in n
+    static bool isNum (Expr e, mpz_class &n);
+    /// true if e is a numeral of at most 64 bits and stores its
+    /// unsigned value in n
+    static bool isNum64 (Expr e, uint64_t &n) {return bv::toUint64 (e, n);}
+    
+    Expr extract (unsigned high, unsigned low, Expr v);
+    Expr concat (Expr hi, Expr lo);
+    Expr zext (Expr v, unsigned w);
+    Expr sext (Expr v, unsigned w);
+    
+    Expr add (Expr a, Expr b);
+    Expr sub (Expr a, Expr b);
+    Expr mul (Expr a, Expr b);
+    Expr band (Expr a, Expr b);
+    Expr bor (Expr a, Expr b);
+    Expr bxor (Expr a, Expr b);
+    Expr shl (Expr a, Expr b);
+    Expr lshr (Expr a, Expr b);
+    Expr ashr (Expr a, Expr b);
+  };
+  
   /// Bit-Vector Symbolic Execution
   class BvSmallSymExec : public SmallStepSymExec
   { 
@@ -23,16 +66,30 @@ namespace seahorn
     const DataLayout *m_td;
     const CanFail *m_canFail;
     
+    BvRewriter m_rw;
+    /// value of each instruction for the last values of its
+    /// operands, so that repeated patterns such as GEPs are encoded once
+    std::map<const Instruction*, std::pair<ExprVector, Expr> > m_instCache;
+    
+    /// computes the symbol of v
+    Expr mkSymb (const Value &v);
     
   public:
     BvSmallSymExec (ExprFactory &efac, Pass &pass, TrackLevel trackLvl = MEM) : 
-      SmallStepSymExec (efac), m_pass (pass), m_trackLvl (trackLvl)
+      SmallStepSymExec (efac), m_pass (pass), m_trackLvl (trackLvl), m_rw (efac)
     {
       m_td = &pass.getAnalysis<DataLayoutPass> ().getDataLayout ();
       m_canFail = pass.getAnalysisIfAvailable<CanFail> ();
+      m_ir = std::make_shared<EncodingIR> (*m_td, efac);
     }
     BvSmallSymExec (const BvSmallSymExec& o) : 
-      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl) {}
+      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl),
+      m_td (o.m_td), m_canFail (o.m_canFail), m_rw (o.m_efac) {}
+    
+    BvRewriter &rw () { return m_rw; }
+    /// the cached value of I for the operand values ops, null if none
+    Expr cachedValue (const Instruction &I, const ExprVector &ops);
+    void cacheValue (const Instruction &I, const ExprVector &ops, Expr v);
     
     Expr errorFlag (const BasicBlock &BB) override;
     
@@ -54,16 +111,14 @@ namespace seahorn
     virtual Expr memStart (unsigned id);
     virtual Expr memEnd (unsigned id);
     
+    /// the symbol of v, from the symbol table once it is computed
     virtual Expr symb (const Value &v);
     virtual const Value &conc (Expr v);
     virtual bool isTracked (const Value &v);
     virtual Expr lookup (SymStore &s, const Value &v);
     
-    Expr symbolicIndexedOffset (SymStore &s,
-                                Type *ptrTy,
-                                ArrayRef<Value *> Indicies);
-    unsigned storageSize (const llvm::Type *t) const;
-    unsigned fieldOff (const StructType *t, unsigned field) const;
+    /// the offset of gep from its base, from its encoding
+    Expr symbolicIndexedOffset (SymStore &s, const GetElementPtrInst &gep);
 
     uint64_t sizeInBits (const llvm::Value &v) const;
     uint64_t sizeInBits (const llvm::Type &t) const;
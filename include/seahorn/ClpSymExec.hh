@@ -31,10 +31,12 @@ namespace seahorn
       m_canFail = pass.getAnalysisIfAvailable<CanFail> ();
       zero = mkTerm<mpz_class> (0, m_efac);
       one  = mkTerm<mpz_class> (1, m_efac);
+      m_ir = std::make_shared<EncodingIR> (*m_td, efac);
     }
 
     ClpSmallSymExec (const ClpSmallSymExec& o) : 
-      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl) {}
+      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl),
+      m_td (o.m_td), m_canFail (o.m_canFail), zero (o.zero), one (o.one) {}
     
     Expr errorFlag (const BasicBlock &BB) override;
     virtual Expr memStart (unsigned id) { assert (false); return Expr (); }
@@ -60,11 +62,8 @@ namespace seahorn
     virtual bool isTracked (const Value &v);
     virtual Expr lookup (SymStore &s, const Value &v);
     
-    Expr ptrArith (SymStore &s, const Value& base, 
-                   SmallVectorImpl<const Value*> &ps,
-                   SmallVectorImpl<const Type *> &ts);
-    unsigned storageSize (const llvm::Type *t);
-    unsigned fieldOff (const StructType *t, unsigned field);
+    /// the address computed by gep, from its encoding
+    Expr ptrArith (SymStore &s, const GetElementPtrInst &gep);
   }; 
   
 }
@@ -4,6 +4,7 @@
 #include <vector>
 #include "seahorn/HornClauseDB.hh"
 #include "ufo/Expr.hpp"
+#include "llvm/Support/raw_ostream.h"
 
 namespace seahorn
 {
@@ -18,6 +19,8 @@ namespace seahorn
     {
       Expr m_head;
       Expr m_body;
+      /// put the body in negation normal form when printing
+      bool m_nnf;
       ExprFactory &m_efac;
       const HornClauseDB::expr_set_type &m_rels;
       
@@ -25,21 +28,25 @@ namespace seahorn
       
       ClpRule (Expr head, Expr constraints, ExprFactory &efac,
                const HornClauseDB::expr_set_type &rels): 
-          m_head (head), m_body (constraints), 
+          m_head (head), m_body (constraints), m_nnf (false),
           m_efac (efac), m_rels (rels) { }
       
       ClpRule (Expr head, Expr body, Expr constraints, ExprFactory &efac,
                const HornClauseDB::expr_set_type &rels): 
-          m_head (head), m_body (mk<AND> (body, constraints)), 
+          m_head (head), m_body (mk<AND> (body, constraints)), m_nnf (false),
           m_efac (efac), m_rels (rels) { }
       
       void addBody (Expr body) { m_body = body; }
       
       bool isFact () const { return !m_body; }
       
-      void normalize ();
+      /// the body is normalized when the rule is printed, which may
+      /// happen on a worker thread
+      void normalize () { m_nnf = true; }
       
-      void print (ostream &o) const;
+      /// prints the rule. Numeric subterms that the rule shares are
+      /// printed once, as the definition of a fresh variable
+      void print (raw_ostream &o) const;
     };
     
    private:
@@ -52,6 +59,12 @@ namespace seahorn
 
     ClpWrite (HornClauseDB &db, ExprFactory &efac);
 
+    /// prints the rules to out, one at a time. With more than one
+    /// thread, rules are printed concurrently into buffers that are
+    /// written in order, a window of rules at a time. The expression
+    /// factory must then be concurrent
+    void write (raw_ostream &out, unsigned threads = 1) const;
+
     string toString () const;
   };
 }
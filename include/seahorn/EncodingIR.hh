@@ -0,0 +1,113 @@
+#ifndef __ENCODING_IR__HH_
+#define __ENCODING_IR__HH_
+/// Theory-neutral facts about instructions, shared by the symbolic
+/// execution semantics
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Operator.h"
+
+#include "ufo/Expr.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// What a semantics needs to know about an instruction, other than
+  /// its operands, before it encodes it in its theory
+  struct EncInst
+  {
+    enum Kind
+    {
+      OTHER,
+      GEP,
+      /// -- calls to the shadow.mem functions
+      SHADOW_INIT,
+      SHADOW_LOAD,
+      SHADOW_STORE,
+      SHADOW_ARG_REF,
+      SHADOW_ARG_MOD,
+      SHADOW_ARG_NEW,
+      SHADOW_IN,
+      SHADOW_OUT,
+      SHADOW_ARG_INIT,
+      /// -- a shadow.mem function not in the list above
+      SHADOW_OTHER
+    };
+
+    Kind kind;
+    /// the memory region of a shadow.mem call, -1 if it has none
+    int64_t region;
+    /// the unique scalar of a shadow.mem call, null if none
+    const Value *scalar;
+    /// -- the address of a GEP is the base plus offset plus the sum
+    /// -- of every non-constant index times its scale
+    int64_t offset;
+    SmallVector<std::pair<const Value*, uint64_t>, 2> terms;
+    /// -- the value depends on its bits: a bitwise operation, a shift,
+    /// -- an unsigned division, an arithmetic operation that may wrap,
+    /// -- a truncation or a zero-extension of more than one bit.
+    /// -- Returned values are never bit-precise, so that summaries stay
+    /// -- over integers
+    bool bitPrecise;
+
+    EncInst () : kind (OTHER), region (-1), scalar (nullptr), offset (0),
+                 bitPrecise (false) {}
+
+    bool isShadow () const { return kind >= SHADOW_INIT; }
+
+    /// the offset of gep from its base, with constant indices folded
+    static void gepOffset (const GEPOperator &gep, const DataLayout &dl,
+                           EncInst &out);
+  };
+
+  /// The EncInst of every instruction of a function
+  class FunctionEncoding
+  {
+    DenseMap<const Instruction*, EncInst> m_insts;
+    /// returned for the instructions that need nothing
+    EncInst m_other;
+
+  public:
+    FunctionEncoding (const Function &F, const DataLayout &dl);
+
+    const EncInst &operator[] (const Instruction &I) const
+    {
+      auto it = m_insts.find (&I);
+      return it == m_insts.end () ? m_other : it->second;
+    }
+  };
+
+  /// Encodings of the functions of a module, computed once per
+  /// function when it is first asked for. The encodings only depend
+  /// on the module, so every semantics over the module can share
+  /// them. Threads lock only when the factory is concurrent
+  class EncodingIR
+  {
+    const DataLayout &m_dl;
+    expr::ExprFactory &m_efac;
+    std::mutex m_mutex;
+    std::map<const Function*, std::unique_ptr<FunctionEncoding> > m_functions;
+
+  public:
+    EncodingIR (const DataLayout &dl, expr::ExprFactory &efac) : m_dl (dl), m_efac (efac) {}
+
+    const DataLayout &dataLayout () const { return m_dl; }
+
+    const FunctionEncoding &function (const Function &F);
+    /// the encoding of I, which must be in a function
+    const EncInst &inst (const Instruction &I)
+    { return function (*I.getParent ()->getParent ()) [I]; }
+    /// forgets the encoding of F, e.g., when F changes
+    void removeFunction (const Function &F);
+  };
+}
+
+#endif
@@ -21,6 +21,9 @@ namespace seahorn
     FlatLargeHornifyFunction (HornifyModule &parent,
                               bool interproc = false) :
       HornifyFunction (parent, interproc) {}
+    FlatLargeHornifyFunction (HornifyModule &parent, HornClauseDB &db,
+                              bool interproc = false) :
+      HornifyFunction (parent, db, interproc) {}
 
     virtual void runOnFunction (Function &F);
   };
@@ -31,6 +34,9 @@ namespace seahorn
     FlatSmallHornifyFunction (HornifyModule &parent,
                               bool interproc = false) :
       HornifyFunction (parent, interproc) {}
+    FlatSmallHornifyFunction (HornifyModule &parent, HornClauseDB &db,
+                              bool interproc = false) :
+      HornifyFunction (parent, db, interproc) {}
 
     virtual void runOnFunction (Function &F);
   };
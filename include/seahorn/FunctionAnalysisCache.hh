@@ -0,0 +1,84 @@
+#ifndef __FUNCTION_ANALYSIS_CACHE__HH_
+#define __FUNCTION_ANALYSIS_CACHE__HH_
+/// Analyses of functions shared by the passes of one run
+
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+
+#include "seahorn/Analysis/CutPointGraph.hh"
+#include "seahorn/Analysis/TopologicalOrder.hh"
+#include "seahorn/Analysis/WeakTopologicalOrderPass.hh"
+#include "seahorn/LiveSymbols.hh"
+
+#include <map>
+#include <memory>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// The topological order, the cut-point graph and the live symbols
+  /// of the functions, computed once and shared by HornifyModule,
+  /// HornSolver, HornCex, BmcPass and HornEstimate. A module pass
+  /// that asks the pass manager for a function analysis gets it
+  /// computed again at every request, and only for the last function.
+  ///
+  /// The analyses of a function are dropped when the function
+  /// changes, i.e., when its blocks, their sizes or their terminators
+  /// differ from those it had when they were computed, or by
+  /// invalidate (). The exit nodes of a function are unified before
+  /// its first analysis, as by the pass manager. Live symbols depend
+  /// on the semantics they are computed with and are kept per
+  /// semantics object, until forget () is called with it
+  class FunctionAnalysisCache : public ImmutablePass
+  {
+    struct Entry
+    {
+      /// shape of the function when its analyses were computed
+      size_t stamp;
+      std::unique_ptr<TopologicalOrder> topo;
+      std::unique_ptr<WeakTopologicalOrderPass> wto;
+      std::unique_ptr<CutPointGraph> cpg;
+      std::map<const SmallStepSymExec*, std::unique_ptr<LiveSymbols> > live;
+      Entry () : stamp (0) {}
+    };
+    std::map<const Function*, Entry> m_fns;
+
+    /// the valid entry of F
+    Entry &entry (Function &F);
+
+  public:
+    static char ID;
+    FunctionAnalysisCache () : ImmutablePass (ID) {}
+
+    const TopologicalOrder &topo (Function &F);
+    CutPointGraph &cpg (Function &F);
+
+    /// the live symbols of F under sem, created but not run if they
+    /// are new, so that a caller can run them concurrently with those
+    /// of other functions
+    LiveSymbols &liveSymbols (Function &F, ExprFactory &efac, SmallStepSymExec &sem);
+    /// the live symbols of F under sem, without checking that F has
+    /// not changed. Null if none. Safe to call concurrently
+    const LiveSymbols *findLiveSymbols (const Function &F,
+                                        const SmallStepSymExec &sem) const;
+    LiveSymbols *findLiveSymbols (const Function &F, const SmallStepSymExec &sem)
+    {
+      const FunctionAnalysisCache &c = *this;
+      return const_cast<LiveSymbols*> (c.findLiveSymbols (F, sem));
+    }
+
+    void invalidate (const Function &F) { m_fns.erase (&F); }
+    /// drops the live symbols under sem, e.g., before it is destroyed
+    void forget (const SmallStepSymExec &sem);
+
+    /// a hash of the blocks of F, their sizes and their terminators
+    static size_t stamp (const Function &F);
+
+    virtual void getAnalysisUsage (AnalysisUsage &AU) const
+    { AU.setPreservesAll (); }
+    virtual const char* getPassName () const {return "FunctionAnalysisCache";}
+  };
+}
+
+#endif /* __FUNCTION_ANALYSIS_CACHE__HH_ */
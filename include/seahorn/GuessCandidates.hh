@@ -10,6 +10,9 @@
 #include <iostream>
 #include <boost/tokenizer.hpp>
 
+#include <map>
+#include <mutex>
+
 namespace seahorn
 {
   //Simple templates
@@ -19,6 +22,38 @@ namespace seahorn
                                               const std::string &filepath);
   void parseLemmasFromExpFile(Expr bvar, ExprVector& lemmas,
                               const std::string &filepath);
+
+  /// The templates of an experiment file, parsed once over a
+  /// placeholder integer variable. The candidates of a relation only
+  /// depend on the sorts of its arguments, so they are instantiated
+  /// once per signature
+  class CandidateTemplates
+  {
+    ExprFactory &m_efac;
+    /// placeholder of the templates
+    Expr m_var;
+    /// the default bounds, then the lines of the file
+    ExprVector m_templates;
+    /// candidates by the domain sorts of a relation
+    std::map<ExprVector, ExprVector> m_bySignature;
+    std::mutex m_lock;
+
+    ExprVector instantiate (Expr fdecl) const;
+
+  public:
+    CandidateTemplates (ExprFactory &efac);
+
+    /// adds the templates of filepath. Returns false if it cannot be read
+    bool load (const std::string &filepath);
+
+    /// the candidates of fdecl, as applyTemplatesFromExperimentFile
+    const ExprVector &apply (Expr fdecl);
+
+    /// the candidates of each relation of rels, instantiated on
+    /// threads if the factory is concurrent. out is in the order of rels
+    void applyAll (const ExprVector &rels, std::vector<ExprVector> &out,
+                   unsigned threads);
+  };
 }
 
 #endif
@@ -12,7 +12,21 @@ namespace seahorn
 {
   using namespace llvm;
 
-  std::unique_ptr<llvm::Module> createLLVMHarness (BmcTrace &trace, const DataLayout &dl);
+  /// Creates a module that defines the external functions called on
+  /// the trace to return their values on the trace. If valuesFile is
+  /// given, the values are written to it and loaded by the run-time
+  /// library instead of being embedded in the module
+  std::unique_ptr<llvm::Module> createLLVMHarness (BmcTrace &trace, const DataLayout &dl,
+                                                   StringRef valuesFile = "");
+
+  /// Creates the harness of a run of the fuzzing run-time
+  /// (sea-rt/fuzz.cpp) on M instrumented by KleeInternalize, from the
+  /// values it logged to fuzzLog. Returns null if the log cannot be
+  /// read
+  std::unique_ptr<llvm::Module> createLLVMHarness (const llvm::Module &M,
+                                                   StringRef fuzzLog,
+                                                   const DataLayout &dl,
+                                                   StringRef valuesFile = "");
 
 }
 
@@ -0,0 +1,55 @@
+#ifndef HORN_CHECKPOINT__HH_
+#define HORN_CHECKPOINT__HH_
+/// Checkpoints of a long Horn solver run
+
+#include "ufo/Expr.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace seahorn
+{
+  /// Checkpoints of --horn-checkpoint=PREFIX. The engine that runs
+  /// writes its state every --horn-checkpoint-period seconds, each
+  /// part to a file of its own in the binary format of ExprIO:
+  ///
+  ///   PREFIX.spacer   lemmas of Spacer, by relation, as written by
+  ///                   Houdini::saveInvariants
+  ///   PREFIX.houdini  candidates of Houdini, in the same format
+  ///   PREFIX.kind     depth up to which every base case of
+  ///                   k-induction is infeasible
+  ///
+  /// A file is replaced atomically, so a run killed at any time
+  /// leaves the last complete checkpoint. With --horn-resume, a fresh
+  /// run on the same program starts from the parts that exist.
+  /// Lemmas and candidates are checked again before they are used,
+  /// the depth is only taken for the same cutpoints and rules
+  class HornCheckpoint
+  {
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    static bool enabled ();
+    static bool resume ();
+    /// maximal time between two checkpoints, in milliseconds
+    static unsigned periodMs ();
+    /// the file of a part
+    static std::string file (const std::string &part);
+    /// true if checkpoints are enabled and a period passed since
+    /// last, which is then reset. Every writer keeps its own last
+    static bool due (clock::time_point &last);
+
+    /// writes the depth of a part, with a signature of the program
+    /// it is for, e.g., its numbers of cutpoints and rules
+    static bool saveDepth (const std::string &part, unsigned depth,
+                           const std::vector<unsigned> &sig,
+                           expr::ExprFactory &efac);
+    /// the depth saved for the same signature, 0 if there is none
+    static unsigned loadDepth (const std::string &part,
+                               const std::vector<unsigned> &sig,
+                               expr::ExprFactory &efac);
+  };
+}
+
+#endif
@@ -10,10 +10,14 @@
 #include <boost/container/flat_set.hpp>
 
 #include "ufo/Expr.hpp"
+#include "ufo/ExprHash.hpp"
 #include "ufo/Stats.hh"
 
 #include <algorithm>
+#include <atomic>
 #include <map>
+#include <list>
+#include <unordered_map>
 
 namespace seahorn
 {
@@ -21,55 +25,163 @@ namespace seahorn
   using namespace expr;
 
   class HornClauseDB;
+  /// A rule body => head. The body is kept as its conjuncts, with the
+  /// applications among them, so that passes walk the body without
+  /// splitting it again. Relations of the database occur in a body
+  /// only as conjuncts, i.e., in the applications
   class HornRule
   { 
     ExprVector m_vars;
     Expr m_head;
-    Expr m_body; 
+    /// the body, flattened: no conjunct is an AND or true
+    ExprVector m_conjuncts;
+    /// the conjuncts that are applications, without duplicates. The
+    /// applications of relations are among them
+    ExprVector m_apps;
+    /// the body as one formula, holding a reference. Built on first
+    /// use if the rule was made from conjuncts
+    mutable std::atomic<ENode*> m_body;
+    /// hash of head, body and variables. Rules do not change after
+    /// construction, so it is computed once
+    size_t m_hash;
+    
+    size_t computeHash () const
+    {
+      size_t res = expr::hash_value (m_head);
+      boost::hash_combine (res, boost::hash_range (m_conjuncts.begin (),
+                                                   m_conjuncts.end ()));
+      boost::hash_combine (res, boost::hash_range (m_vars.begin (), 
+                                                   m_vars.end ()));
+      return res;
+    }
+
+    void addConjuncts (Expr e)
+    {
+      if (isOpX<AND> (e))
+        for (unsigned i = 0; i < e->arity (); ++i) addConjuncts (e->arg (i));
+      else if (!isOpX<TRUE> (e))
+        m_conjuncts.push_back (e);
+    }
+
+    /// sets the body to e, or to the conjunction of m_conjuncts if e
+    /// is null and the conjunction is not built yet
+    void init (Expr e)
+    {
+      if (e) addConjuncts (e);
+      for (Expr c : m_conjuncts)
+        if (bind::isFapp (c) &&
+            std::find (m_apps.begin (), m_apps.end (), c) == m_apps.end ())
+          m_apps.push_back (c);
+      if (!e && m_conjuncts.size () <= 1)
+        e = m_conjuncts.empty () ? mk<TRUE> (m_head->efac ()) : m_conjuncts [0];
+      m_body = nullptr;
+      if (e) setBody (e);
+      m_hash = computeHash ();
+    }
+
+    /// m_body becomes e unless it is set. Returns the body
+    ENode *setBody (Expr e) const
+    {
+      ENode *old = nullptr;
+      intrusive_ptr_add_ref (&*e);
+      if (m_body.compare_exchange_strong (old, &*e)) return &*e;
+      // -- built by another thread
+      intrusive_ptr_release (&*e);
+      return old;
+    }
     
   public:
     template <typename Range>
     HornRule (Range &v, Expr b) : 
-      m_vars (boost::begin (v), boost::end (v)), 
-      m_head (b), m_body (mk<TRUE>(b->efac ())) 
+      m_vars (boost::begin (v), boost::end (v)), m_head (b)
     {
+      Expr body = mk<TRUE> (b->efac ());
       if ((b->arity () == 2) && isOpX<IMPL> (b))
       { 
-        m_body = b->left ();
+        body = b->left ();
         m_head = b->right ();
       }
       else 
       { assert (bind::isFapp (b)); }      
+      init (body);
     }
 
     template <typename Range>
     HornRule (Range &v, Expr head, Expr body) : 
-      m_vars (boost::begin (v), boost::end (v)), 
-      m_head (head), m_body (body) 
-    { }
+      m_vars (boost::begin (v), boost::end (v)), m_head (head)
+    { init (body); }
+
+    /// a rule whose body is the conjunction of conjuncts. The
+    /// conjunction is only built if body () or get () is called
+    template <typename Range>
+    HornRule (Range &v, Expr head, const ExprVector &conjuncts) :
+      m_vars (boost::begin (v), boost::end (v)), m_head (head)
+    {
+      for (Expr c : conjuncts) addConjuncts (c);
+      init (Expr ());
+    }
     
     HornRule (const HornRule &r) : 
-      m_vars (r.m_vars), 
-      m_head (r.m_head), m_body (r.m_body) 
-    {} 
-    
-    size_t hash () const
+      m_vars (r.m_vars), m_head (r.m_head), m_conjuncts (r.m_conjuncts),
+      m_apps (r.m_apps), m_body (nullptr), m_hash (r.m_hash)
     {
-      size_t res = expr::hash_value (m_head);
-      boost::hash_combine (res, m_body);
-      boost::hash_combine (res, boost::hash_range (m_vars.begin (), 
-                                                   m_vars.end ()));
-      return res;
+      ENode *b = r.m_body.load ();
+      if (b) setBody (Expr (b));
+    }
+
+    HornRule &operator= (const HornRule &r)
+    {
+      if (this == &r) return *this;
+      m_vars = r.m_vars;
+      m_head = r.m_head;
+      m_conjuncts = r.m_conjuncts;
+      m_apps = r.m_apps;
+      m_hash = r.m_hash;
+      ENode *b = m_body.exchange (nullptr);
+      if (b) intrusive_ptr_release (b);
+      b = r.m_body.load ();
+      if (b) setBody (Expr (b));
+      return *this;
     }
 
+    ~HornRule ()
+    {
+      ENode *b = m_body.load ();
+      if (b) intrusive_ptr_release (b);
+    }
+    
+    size_t hash () const { return m_hash; }
+
+    /// rules with the same hash are further compared structurally,
+    /// so that distinct rules are never equal
     bool operator==(const HornRule & other) const
-    { return hash() == other.hash ();}
+    { 
+      return hash() == other.hash () && m_head == other.m_head &&
+        m_conjuncts == other.m_conjuncts && m_vars == other.m_vars;
+    }
 
     bool operator<(const HornRule & other) const
-    { return hash() < other.hash ();}
+    { 
+      if (hash () != other.hash ()) return hash() < other.hash ();
+      std::less<ENode*> lt;
+      auto ltE = [&lt] (Expr x, Expr y) { return lt (&*x, &*y); };
+      if (m_head != other.m_head) return lt (&*m_head, &*other.m_head);
+      if (m_conjuncts != other.m_conjuncts)
+        return std::lexicographical_compare
+          (m_conjuncts.begin (), m_conjuncts.end (),
+           other.m_conjuncts.begin (), other.m_conjuncts.end (), ltE);
+      return std::lexicographical_compare 
+        (m_vars.begin (), m_vars.end (), 
+         other.m_vars.begin (), other.m_vars.end (), ltE);
+    }
 
     // return only the body of the horn clause
-    Expr body () const {return m_body;}
+    Expr body () const
+    {
+      ENode *b = m_body.load ();
+      if (!b) b = setBody (mknary<AND> (m_conjuncts.begin (), m_conjuncts.end ()));
+      return Expr (b);
+    }
 
     // return only the head of the horn clause
     Expr head () const {return m_head;}
@@ -77,16 +189,30 @@ namespace seahorn
     // return the implication body => head
     Expr get () const 
     { 
-      if (isOpX<TRUE> (m_body)) 
+      if (m_conjuncts.empty ()) 
         return m_head;
       else 
-        return mk<IMPL> (m_body, m_head);
+        return mk<IMPL> (body (), m_head);
     }
 
     const ExprVector &vars () const {return m_vars;} 
 
-    template<typename OutputIterator>
-    void used_relations (HornClauseDB &db, OutputIterator out);
+    /// conjuncts of the body: the arguments of its nested ANDs
+    const ExprVector &conjuncts () const { return m_conjuncts; }
+    /// conjuncts of the body that are applications
+    const ExprVector &apps () const { return m_apps; }
+
+    /// relations of db used in the body, without duplicates
+    template<typename DB, typename OutputIterator>
+    void used_relations (const DB &db, OutputIterator out) const;
+    /// applications of the relations of db in the body, without
+    /// duplicates, as get_all_pred_apps of the body
+    template<typename DB, typename OutputIterator>
+    void pred_apps (const DB &db, OutputIterator out) const
+    {
+      for (Expr a : m_apps)
+        if (db.hasRelation (bind::fname (a))) *out++ = a;
+    }
   };
 
 
@@ -95,7 +221,11 @@ namespace seahorn
     friend class HornRule;
   public:
 
-    typedef std::vector<HornRule> RuleVector;
+    /// a list so that rules can be removed in constant time
+    typedef std::list<HornRule> RuleVector;
+    /// dense identifier of a rule. Stable until compact ()
+    typedef unsigned RuleId;
+    typedef boost::container::flat_set<RuleId> rule_id_set;
     typedef boost::container::flat_set<Expr> expr_set_type;
     struct IsRelation : public std::unary_function<Expr, bool>
     {
@@ -109,50 +239,114 @@ namespace seahorn
     
     ExprFactory &m_efac;
     expr_set_type m_rels;
-    mutable ExprVector m_vars;
+    /// variables of the rules, without duplicates, in the order they
+    /// were first added
+    ExprVector m_vars;
+    ExprHashSet m_var_set;
     RuleVector m_rules;
     ExprVector m_queries;
     std::map<Expr, ExprVector> m_constraints;
     
-    /// indexes
+    /// indexes. Kept up to date as rules are added and removed
 
     
-    typedef boost::container::flat_set<HornRule*> horn_set_type;
-    typedef std::map<Expr, horn_set_type > index_type;
+    typedef ExprHashMap<rule_id_set> index_type;
     /// maps a relation to rules it appears in the body
-    index_type m_body_idx;
+    mutable index_type m_body_idx;
     /// maps a relation to rules it appears in the head
     index_type m_head_idx;
+    /// position in m_rules of every rule id. m_rules.end () for
+    /// removed rules (tombstones)
+    std::vector<RuleVector::iterator> m_rule_ids;
+    size_t m_num_tombstones;
+    /// maps the hash of a rule to its ids
+    std::unordered_multimap<size_t, RuleId> m_rule_idx;
     
-    const ExprVector &getVars () const;
+    void addVars (const ExprVector &vars)
+    {
+      for (const Expr &v : vars)
+        if (m_var_set.insert (v).second) m_vars.push_back (v);
+    }
 
     /// empty set sentinel
-    static horn_set_type m_empty_set;
+    static rule_id_set m_empty_set;
     
     /// resets all indexes
     void resetIndexes ();
+    /// adds rule id to the indexes
+    void indexRule (RuleId id);
+    /// removes rule id from the indexes
+    void unindexRule (RuleId id);
+    /// relations registered after the rules that may use them. Added
+    /// to the body index on the next lookup
+    mutable ExprVector m_pending_rels;
+    void indexPendingRelations () const;
 
   public:
 
-    HornClauseDB (ExprFactory &efac) : m_efac (efac) {}
+    HornClauseDB (ExprFactory &efac) : m_efac (efac), m_num_tombstones (0) {}
+    /// the indexes point to the rules of this database
+    HornClauseDB (const HornClauseDB &) = delete;
+    HornClauseDB &operator= (const HornClauseDB &) = delete;
     
     ExprFactory &getExprFactory () {return m_efac;}
+    /// removes all relations, rules, queries and constraints
+    void clear ();
+    /// allocates the indexes for the given number of rules,
+    /// relations and variables, so that they are not rehashed while
+    /// the database is built
+    void reserve (size_t rules, size_t rels, size_t vars);
     
-    void registerRelation (Expr fdecl) {m_rels.insert (fdecl);}
+    void registerRelation (Expr fdecl);
+    /// removes a relation and its constraints. Rules that use or
+    /// define it must be removed first
+    void removeRelation (Expr fdecl)
+    {
+      m_rels.erase (fdecl);
+      m_constraints.erase (fdecl);
+    }
     const expr_set_type& getRelations () const {return m_rels;}
     bool hasRelation (Expr fdecl) const
     { return m_rels.count (fdecl) > 0; }
     /// number of relational predicates
     unsigned relSize () { return m_rels.size ();}
     
-    /// -- build use/def indexes
+    /// -- rebuild use/def indexes from scratch. Not needed, the
+    /// -- indexes are updated by addRule, removeRule and registerRelation
     void buildIndexes ();
 
+    /// -- renumbers the rules densely, dropping the ids of removed
+    /// -- rules. Invalidates all RuleIds
+    void compact () { buildIndexes (); }
+    /// -- number of ids of removed rules
+    size_t numTombstones () const { return m_num_tombstones; }
+    /// -- ids are below this bound, including the removed ones
+    RuleId ruleIdBound () const { return m_rule_ids.size (); }
+
+    /// -- rule with the given id. The rule must not have been removed
+    const HornRule &getRule (RuleId id) const
+    {
+      assert (id < m_rule_ids.size () && m_rule_ids [id] != m_rules.end ());
+      return *m_rule_ids [id];
+    }
+    bool isLive (RuleId id) const
+    { return id < m_rule_ids.size () && m_rule_ids [id] != m_rules.end (); }
+
+    /// -- id of a rule equal to r, if any
+    bool findRule (const HornRule &r, RuleId &id) const
+    {
+      auto range = m_rule_idx.equal_range (r.hash ());
+      for (auto it = range.first; it != range.second; ++it)
+        if (*m_rule_ids [it->second] == r) { id = it->second; return true; }
+      return false;
+    }
+
     /// -- returns rules that use fdecl
-    /// -- i.e., rules in which fdecl appears in the body
-    /// -- requires indexes (see buildIndexes())
-    const horn_set_type &use (Expr fdecl) const
+    /// -- i.e., rules in which fdecl appears in the body. Valid until
+    /// -- the next change to the rules
+    const rule_id_set &use (Expr fdecl) const
     {
+      if (!m_pending_rels.empty ()) indexPendingRelations ();
       auto it = m_body_idx.find (fdecl);
       if (it == m_body_idx.end ()) return m_empty_set;
       return it->second;
@@ -160,8 +354,7 @@ namespace seahorn
     
     /// -- returns rules that define fdecl
     /// -- i.e., rules in which fdecl appears in the head
-    /// -- requires indexes (see buildIndexes())
-    const horn_set_type &def (Expr fdecl) const
+    const rule_id_set &def (Expr fdecl) const
     {
       auto it = m_head_idx.find (fdecl);
       if (it == m_head_idx.end ()) return m_empty_set;
@@ -175,35 +368,50 @@ namespace seahorn
       addRule (HornRule (vars, rule));
     }
 
-    void addRule (const HornRule &rule)
+    RuleId addRule (const HornRule &rule)
     {
       m_rules.push_back (rule);
-      boost::copy (rule.vars (), std::back_inserter (m_vars));
-      resetIndexes ();
-      
+      addVars (rule.vars ());
+      m_rule_ids.push_back (--m_rules.end ());
+      indexRule (m_rule_ids.size () - 1);
+      return m_rule_ids.size () - 1;
     }
     
-    const ExprVector &getVars ()
+    /// variables of the rules added so far, without duplicates.
+    /// Variables of removed rules are kept
+    const ExprVector &getVars () const { return m_vars; }
+
+    /// removes a rule. Its id becomes a tombstone until compact ()
+    void removeRule (RuleId id)
     {
-      // -- remove duplicates
-      std::sort (m_vars.begin (), m_vars.end ());
-      m_vars.erase (std::unique (m_vars.begin (), m_vars.end ()), m_vars.end ());
-      
-      return m_vars;
+      if (!isLive (id)) return;
+      unindexRule (id);
+      m_rules.erase (m_rule_ids [id]);
+      m_rule_ids [id] = m_rules.end ();
+      ++m_num_tombstones;
     }
 
+    /// removes one rule equal to r, if any
     void removeRule (const HornRule &r)
     {
-      m_rules.erase (std::remove (m_rules.begin(), m_rules.end(), r));
-      resetIndexes ();
+      RuleId id;
+      if (findRule (r, id)) removeRule (id);
     }
 
 
+    /// rules of the database. Rules must be added and removed with
+    /// addRule and removeRule so that the indexes stay up to date
     const RuleVector &getRules () const {return m_rules;}
     RuleVector &getRules () {return m_rules;}
 
+    /// adds the relations, rules, queries and constraints of o, in
+    /// the order they were added to o
+    void merge (const HornClauseDB &o);
+
     void addQuery (Expr q) {m_queries.push_back (q);}
     ExprVector getQueries () const {return m_queries;}
+    /// replaces the queries, e.g., to solve some of them on their own
+    void setQueries (const ExprVector &qs) {m_queries = qs;}
     bool hasQuery () const {return !m_queries.empty ();}
     
 
@@ -219,6 +427,14 @@ namespace seahorn
 
     raw_ostream& write (raw_ostream& o) const;
 
+    /// -- writes the database in the binary format of ExprIO.
+    /// -- Terminals that cannot be serialized, e.g., llvm::Value
+    /// -- names, are written as strings. Returns false on error
+    bool save (const std::string &fname) const;
+    /// -- adds the database written by save () to this one. Returns
+    /// -- false if the file is missing or malformed
+    bool load (const std::string &fname);
+
     /// load current HornClauseDB to a given FixedPoint object
     template <typename FP>
     void loadZFixedPoint (FP &fp,
@@ -226,11 +442,10 @@ namespace seahorn
                           bool skipQuery = false) const
     {
       ufo::ScopedStats _st_("HornClauseDB::loadZFixedPoint");
-      for (auto &p: getRelations ())
-        fp.registerRelation (p); 
-
-      for (auto &rule: getRules ())
-        fp.addRule (rule.vars (), rule.get ()); 
+      // -- in batches, so that the terms shared by the rules are
+      // -- marshaled once
+      fp.registerRelations (getRelations ());
+      fp.addRules (getRules ());
 
       for (auto &r : getRelations ())
         if (!skipConstraints && hasConstraints (r))
@@ -253,9 +468,21 @@ namespace seahorn
     
   };
 
-  template<typename OutputIterator>
-  void HornRule::used_relations (HornClauseDB &db, OutputIterator out)
-  {filter (body (), HornClauseDB::IsRelation(db), out);}
+  template<typename DB, typename OutputIterator>
+  void HornRule::used_relations (const DB &db, OutputIterator out) const
+  {
+    ExprVector rels;
+    for (Expr a : m_apps)
+    {
+      Expr rel = bind::fname (a);
+      if (db.hasRelation (rel) &&
+          std::find (rels.begin (), rels.end (), rel) == rels.end ())
+      {
+        rels.push_back (rel);
+        *out++ = rel;
+      }
+    }
+  }
 
   inline raw_ostream& operator <<(raw_ostream& o, const HornClauseDB &db)
   {
@@ -270,10 +497,17 @@ namespace seahorn
     callgraph_type m_callers;
     callgraph_type m_callees;
     Expr m_cg_entry;
+    /// number of rules that induce an edge caller -> callee
+    std::map<std::pair<Expr, Expr>, unsigned> m_edge_count;
 
     /// empty set sentinel
     static HornClauseDB::expr_set_type m_expr_empty_set;
 
+    /// edges (body relation, head relation) of a rule
+    void ruleEdges (const HornRule &rule,
+                    std::vector<std::pair<Expr, Expr> > &out) const;
+    void findEntry ();
+
   public:
     HornClauseDB& m_db;
     HornClauseDBCallGraph (HornClauseDB &db) : m_db (db), m_cg_entry(mk<FALSE>(db.getExprFactory ())) {}
@@ -281,6 +515,13 @@ namespace seahorn
     /// -- build call graph
     void buildCallGraph ();
 
+    /// -- updates the call graph after rule was added to the
+    /// -- database. Returns true if an edge was added
+    bool addRule (const HornRule &rule);
+    /// -- updates the call graph after rule was removed from the
+    /// -- database. Returns true if an edge was removed
+    bool removeRule (const HornRule &rule);
+
     /// -- returns an entry point of the call graph.
     bool hasEntry () const { return !isOpX<FALSE>(m_cg_entry); }
     Expr entry () const { assert(hasEntry()); return m_cg_entry; }
@@ -357,7 +598,7 @@ namespace seahorn
    * Return false if there are no bvars in all predicates in a rule, else return true.
    */
   bool hasBvarInRule(HornRule r, HornClauseDB &db,
-                          std::map<Expr, ExprVector> currentCandidates);
+                          const std::map<Expr, ExprVector> &currentCandidates);
 
 }
 #endif /* _HORN_CLAUSE_DB__H_ */
@@ -0,0 +1,169 @@
+#ifndef _HORN_CLAUSE_DB_SNAPSHOT__HH_
+#define _HORN_CLAUSE_DB_SNAPSHOT__HH_
+
+#include "seahorn/HornClauseDB.hh"
+
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// An immutable version of the relations, rules and queries of a
+  /// HornClauseDB. A snapshot is shared through a Ptr, and any number
+  /// of threads read it without locks while a Builder derives the
+  /// next version from it. Versions share their structure: the rules
+  /// are a persistent vector of fixed-size chunks, and the use and
+  /// def indexes map every relation to a shared set of rule ids, so a
+  /// new version copies only the chunks and the sets of the rules
+  /// that changed. Rule ids are those of the database of the first
+  /// version and are kept by every later one. Constraints are not
+  /// part of a snapshot
+  class HornClauseDBSnapshot
+  {
+  public:
+    typedef std::shared_ptr<const HornClauseDBSnapshot> Ptr;
+    typedef HornClauseDB::RuleId RuleId;
+    typedef HornClauseDB::rule_id_set rule_id_set;
+    typedef HornClauseDB::expr_set_type expr_set_type;
+    class Builder;
+
+  private:
+    /// rules with ids [k * ChunkSize, (k + 1) * ChunkSize) are in
+    /// chunk k. Removed ids are null
+    static const unsigned ChunkSize = 64;
+    typedef std::vector<std::shared_ptr<const HornRule> > Chunk;
+    typedef std::map<Expr, std::shared_ptr<const rule_id_set> > index_type;
+
+    unsigned m_version;
+    std::vector<std::shared_ptr<const Chunk> > m_chunks;
+    RuleId m_bound;
+    size_t m_size;
+    std::shared_ptr<const expr_set_type> m_rels;
+    std::shared_ptr<const ExprVector> m_queries;
+    /// relation -> rules that use it in the body
+    std::shared_ptr<const index_type> m_use;
+    /// relation -> rules with it in the head
+    std::shared_ptr<const index_type> m_def;
+
+    /// empty set sentinel
+    static rule_id_set m_empty_set;
+
+    HornClauseDBSnapshot () : m_version (0), m_bound (0), m_size (0) {}
+
+    const rule_id_set &lookup (const index_type &idx, Expr fdecl) const
+    {
+      auto it = idx.find (fdecl);
+      return it == idx.end () ? m_empty_set : *it->second;
+    }
+
+  public:
+    /// the first version, with the rules and the rule ids of db
+    static Ptr make (const HornClauseDB &db);
+
+    /// versions derived from one another are numbered in order
+    unsigned version () const { return m_version; }
+
+    /// ids are below this bound, including the removed ones
+    RuleId ruleIdBound () const { return m_bound; }
+    /// number of rules
+    size_t size () const { return m_size; }
+    bool isLive (RuleId id) const
+    { return id < m_bound && (*m_chunks [id / ChunkSize]) [id % ChunkSize]; }
+    /// the rule must not have been removed. The reference is valid as
+    /// long as the snapshot is
+    const HornRule &getRule (RuleId id) const
+    {
+      assert (isLive (id));
+      return *(*m_chunks [id / ChunkSize]) [id % ChunkSize];
+    }
+
+    /// rules in which fdecl appears in the body
+    const rule_id_set &use (Expr fdecl) const { return lookup (*m_use, fdecl); }
+    /// rules in which fdecl appears in the head
+    const rule_id_set &def (Expr fdecl) const { return lookup (*m_def, fdecl); }
+
+    const expr_set_type &getRelations () const { return *m_rels; }
+    bool hasRelation (Expr fdecl) const { return m_rels->count (fdecl) > 0; }
+    const ExprVector &getQueries () const { return *m_queries; }
+
+    /// calls f (id, rule) on every rule, in the order of the ids
+    template <typename F>
+    void forEachRule (F f) const
+    {
+      for (RuleId id = 0; id < m_bound; ++id)
+        if (isLive (id)) f (id, getRule (id));
+    }
+
+    /// adds the relations, rules and queries to db, e.g., to give
+    /// this version to a solver
+    void toDB (HornClauseDB &db) const;
+  };
+
+  /// Derives a new version from a snapshot. The parts of the base
+  /// that are changed are copied on their first change, everything
+  /// else is shared. A builder is used by one thread
+  class HornClauseDBSnapshot::Builder
+  {
+    friend class HornClauseDBSnapshot;
+    /// the next version
+    HornClauseDBSnapshot m_next;
+    /// parts of m_next that are not shared with a committed version,
+    /// and can be changed in place. Null if shared
+    std::vector<Chunk*> m_chunks;
+    std::map<Expr, rule_id_set*> m_use_sets;
+    std::map<Expr, rule_id_set*> m_def_sets;
+    index_type *m_use;
+    index_type *m_def;
+    expr_set_type *m_rels;
+
+    Chunk &chunk (unsigned k);
+    rule_id_set &indexSet (std::shared_ptr<const index_type> &idx,
+                           index_type *&own, std::map<Expr, rule_id_set*> &sets,
+                           Expr fdecl);
+    void unindex (std::shared_ptr<const index_type> &idx,
+                  index_type *&own, std::map<Expr, rule_id_set*> &sets,
+                  Expr fdecl, RuleId id);
+    /// the relations in the body of r
+    void usedRelations (const HornRule &r, ExprVector &out) const;
+    void reset ();
+
+  public:
+    explicit Builder (const HornClauseDBSnapshot &base);
+
+    RuleId addRule (const HornRule &r);
+    /// removes a rule. Its id is not reused
+    void removeRule (RuleId id);
+    /// rules added before the relation is registered are not in its
+    /// use index
+    void registerRelation (Expr fdecl);
+    void setQueries (const ExprVector &qs);
+
+    /// the current version
+    const HornClauseDBSnapshot &current () const { return m_next; }
+
+    /// publishes the changes as a new version. Later changes go to
+    /// the version after it
+    Ptr commit ();
+  };
+
+  struct IsSnapshotPredApp : public std::unary_function<Expr, bool>
+  {
+    const HornClauseDBSnapshot &m_db;
+    IsSnapshotPredApp (const HornClauseDBSnapshot &db) : m_db (db) {}
+
+    bool operator() (Expr e)
+    {return bind::isFapp (e) && m_db.hasRelation (bind::fname(e));}
+  };
+
+  template<typename OutputIterator>
+  void get_all_pred_apps (Expr e, const HornClauseDBSnapshot &db, OutputIterator out)
+  {filter (e, IsSnapshotPredApp (db), out);}
+
+  /// the body of r without its relations
+  Expr extractTransitionRelation (const HornRule &r, const HornClauseDBSnapshot &db);
+}
+
+#endif /* _HORN_CLAUSE_DB_SNAPSHOT__HH_ */
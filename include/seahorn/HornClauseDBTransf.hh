@@ -2,13 +2,60 @@
 #define _HORN_CLAUSE_DB_TRANSFORMATIONS__H_
 
 #include "seahorn/HornClauseDB.hh"
+#include "ufo/Smt/EZ3.hh"
 
 namespace seahorn
 {
 
+  class HornSliceModelConverter;
+  class HornSimplifyModelConverter;
+
   // Ensure all horn clause heads have only variables
   void normalizeHornClauseHeads (HornClauseDB &db);
 
+  // Cone-of-influence slicing. Removes the rules and relations that
+  // cannot be derived from the facts, or cannot reach a query.
+  // Relations of the queries are kept. Records the removed relations
+  // in conv. Returns the number of removed rules
+  unsigned sliceHornClauseDB (HornClauseDB &db, HornSliceModelConverter &conv);
+
+  // Inlines relations that have a single definition and a single
+  // use. Only linear rules are merged. If z3 is not null, the local
+  // variables of the merged rules are eliminated by quantifier
+  // elimination. Records the inlined relations in conv. Returns the
+  // number of inlined relations
+  unsigned inlineHornClauseDB (HornClauseDB &db, HornSimplifyModelConverter &conv,
+                               ufo::EZ3 *z3 = nullptr);
+
+  // Removes the arguments of relations that are never read, i.e.,
+  // that are variables occurring nowhere else in every rule using the
+  // relation. Reduced relations are replaced by new ones. Records
+  // them in conv. Returns the number of removed arguments
+  unsigned reduceHornClauseDBArity (HornClauseDB &db, 
+                                    HornSimplifyModelConverter &conv);
+
+  // Removes the arguments of relations that are constant, or equal
+  // to another argument, in every tuple derivable from the rules. The
+  // derivable tuples are over-approximated by a least fixpoint of
+  // constants and equalities that follow syntactically from the
+  // rules. Uses of a reduced relation keep the removed arguments as
+  // equalities. Records the relations in conv. Returns the number of
+  // removed arguments
+  unsigned propagateHornClauseDBArgs (HornClauseDB &db,
+                                      HornSimplifyModelConverter &conv);
+
+  // Removes the rules that are alpha-equivalent to another rule, and
+  // the rules subsumed by a rule with the same head whose body is a
+  // subset of theirs. Rules are compared syntactically, up to the
+  // names of their variables and the order of their conjuncts. The
+  // least model is unchanged. Returns the number of removed rules
+  unsigned dedupHornClauseDB (HornClauseDB &db);
+
+  // Runs inlining, arity reduction and argument propagation until
+  // none applies. Relations of the queries are kept. Returns the number of applied steps
+  unsigned simplifyHornClauseDB (HornClauseDB &db, HornSimplifyModelConverter &conv,
+                                 ufo::EZ3 *z3 = nullptr);
+
 }
 
 
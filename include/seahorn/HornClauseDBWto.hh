@@ -3,9 +3,12 @@
 
 #include "llvm/Support/raw_ostream.h"
 
+#include "ufo/ExprLlvm.hpp"
 #include "ufo/Stats.hh"
+#include "avy/AvyDebug.h"
 
 #include "seahorn/HornClauseDBBgl.hh"
+#include "seahorn/HornRelGraph.hh"
 #include "seahorn/Analysis/WeakTopologicalOrder.hh"
 
 namespace seahorn
@@ -26,6 +29,36 @@ namespace seahorn
 
     HornClauseDBCallGraph &m_callgraph;
     wto_t m_wto;
+    /// the call graph changed since the wto was built
+    bool m_dirty;
+    /// entry of the call graph the wto was built from
+    Expr m_root;
+    /// strongly connected component of every relation, in reverse
+    /// topological order of the call graph. Empty if stale
+    std::map<Expr, unsigned> m_scc;
+
+    /// the wto depends only on the part of the call graph reachable
+    /// from the entry. Returns whether an edge of rule starts in it
+    bool affectsWto (const HornRule &rule) const
+    {
+      if (m_dirty) return true;
+      if (!m_callgraph.hasEntry () || m_callgraph.entry () != m_root) return true;
+      ExprVector body;
+      rule.used_relations (m_callgraph.m_db, std::back_inserter (body));
+      for (Expr p : body) if (m_wto.contains (p)) return true;
+      return false;
+    }
+
+    /// components over a snapshot of the dependencies of the database
+    void buildSccs ()
+    {
+      m_scc.clear ();
+      HornRelGraph g (m_callgraph.m_db);
+      std::vector<unsigned> scc;
+      g.sccs (scc);
+      for (HornRelGraph::RelId i = 0; i < g.size (); ++i)
+        m_scc [g.rel (i)] = scc [i];
+    }
     
    public:
 
@@ -35,11 +68,12 @@ namespace seahorn
     typedef typename wto_t::nested_components_iterator head_iterator;
     typedef typename wto_t::nested_components_const_iterator head_const_iterator;
 
-    HornClauseDBWto(HornClauseDBCallGraph &callgraph): m_callgraph(callgraph) { }
+    HornClauseDBWto(HornClauseDBCallGraph &callgraph): 
+      m_callgraph(callgraph), m_dirty (false) { }
 
     // -- iterators to traverse the wto
-    iterator begin () {  return m_wto.begin(); }
-    iterator end () {  return m_wto.end(); }
+    iterator begin () {  update (); return m_wto.begin(); }
+    iterator end () {  update (); return m_wto.end(); }
 
     const_iterator begin () const {  return m_wto.begin(); }
     const_iterator end () const {  return m_wto.end(); }
@@ -50,29 +84,85 @@ namespace seahorn
     // -- innermost component.
 
     head_iterator heads_begin (Expr fdecl) 
-    { return m_wto.nested_components_begin(fdecl); }
+    { update (); return m_wto.nested_components_begin(fdecl); }
     head_iterator heads_end (Expr fdecl) 
-    { return m_wto.nested_components_end(fdecl); }
+    { update (); return m_wto.nested_components_end(fdecl); }
 
     head_const_iterator heads_begin (Expr fdecl) const 
     { return m_wto.nested_components_begin(fdecl); }
     head_const_iterator heads_end (Expr fdecl) const 
     { return m_wto.nested_components_end(fdecl); }
 
-    void buildWto () {
+    // -- whether fdecl is reachable from the entry, i.e., is in the wto
+    bool contains (Expr fdecl) { update (); return m_wto.contains (fdecl); }
+
+    // -- number of components containing fdecl. Relations in the
+    // -- innermost components have the largest depth
+    unsigned depth (Expr fdecl) { update (); return m_wto.nesting_depth (fdecl); }
+
+    // -- strongly connected component of fdecl. Components are
+    // -- numbered in reverse topological order of the call graph
+    unsigned scc (Expr fdecl) 
+    {
+      if (m_scc.empty ()) buildSccs ();
+      auto it = m_scc.find (fdecl);
+      assert (it != m_scc.end ());
+      return it->second;
+    }
 
-      Stats::resume ("wto");
+    // -- updates the wto after rule was added to the database. The
+    // -- wto is recomputed lazily, and only if the edges of the call
+    // -- graph reachable from the entry changed
+    void addRule (const HornRule &rule)
+    { 
+      if (m_callgraph.addRule (rule)) invalidate (rule);
+      else incremental ().inc ();
+    }
+    // -- updates the wto after rule was removed from the database
+    void removeRule (const HornRule &rule)
+    { 
+      if (m_callgraph.removeRule (rule)) invalidate (rule);
+      else incremental ().inc ();
+    }
+    // -- rebuilds the wto if the call graph changed
+    void update () { if (m_dirty) computeWto (); }
 
+    void buildWto () {
       m_callgraph.buildCallGraph();
+      computeWto ();
+    }
+
+   private:
+    // -- counted on every rule, so looked up once
+    static ufo::StatsCounter &incremental ()
+    {
+      static ufo::StatsCounter &c = ufo::Stats::counter ("wto.incremental");
+      return c;
+    }
+
+    void invalidate (const HornRule &rule)
+    {
+      m_scc.clear ();
+      if (affectsWto (rule)) m_dirty = true;
+      else incremental ().inc ();
+    }
+
+    void computeWto () {
+
+      ufo::Stats::resume ("wto");
+      m_dirty = false;
+      ufo::Stats::count ("wto.rebuild");
 
       if (!m_callgraph.hasEntry()) {
         errs () << "wto requires an entry point to the call graph\n";
+        ufo::Stats::stop ("wto");
         return;
       }
 
-      m_wto.buildWto(&m_callgraph, m_callgraph.entry());
+      m_root = m_callgraph.entry ();
+      m_wto.buildWto(&m_callgraph, m_root);
       
-      Stats::stop ("wto");
+      ufo::Stats::stop ("wto");
 
       LOG("horn-wto", 
           errs () << "WTO="; m_wto.write(errs()); errs () << "\n";);
@@ -0,0 +1,148 @@
+#ifndef HORN_COMPOSITIONAL__HH_
+#define HORN_COMPOSITIONAL__HH_
+/// Compositional solving of the Horn clauses of --horn-inter-proc
+
+#include "llvm/IR/Module.h"
+#include "boost/logic/tribool.hpp"
+
+#include "seahorn/HornClauseDB.hh"
+#include "seahorn/HornifyModule.hh"
+
+#include "ufo/Smt/EZ3.hh"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// Solves the database of HornifyModule one function at a time.
+  ///
+  /// The relations are split into units: the relations of a function,
+  /// or of the functions of a recursive cycle. A caller uses a callee
+  /// only through the summary relation of the callee, so a unit can
+  /// be solved alone once each callee summary is replaced by a single
+  /// rule from an over-approximation of it. Units are solved bottom-up
+  /// with the query "the unit fails when called without an error",
+  /// concurrently for the units of a level of the call graph. The
+  /// invariant of the summary of a unit that cannot fail is its
+  /// approximation in its callers; the approximation of any other
+  /// unit only has the constraints of the database.
+  ///
+  /// The unit of main is then solved with the queries of the
+  /// database. When its counterexample goes through the approximation
+  /// of a callee, that callee only is refined: its rules replace its
+  /// approximation, their own callees staying approximated, and the
+  /// query is asked again. A counterexample through no approximation
+  /// is a counterexample of the database.
+  ///
+  /// With a store, the results of the units are kept across runs,
+  /// keyed by a hash of the functions of the unit and of the hashes
+  /// of its callees. A unit whose functions and callees did not
+  /// change is not solved again.
+  class HornCompositional
+  {
+  public:
+    /// sets the parameters and budget of a fixedpoint of the engine
+    typedef std::function<void (ufo::ZFixedPoint<ufo::EZ3>&)> Setup;
+
+  private:
+    struct Unit
+    {
+      /// name of a function of the unit, for the log
+      std::string name;
+      std::vector<const Function*> fns;
+      ExprVector rels;
+      /// summary relations of the functions of the unit
+      ExprVector sums;
+      std::vector<HornClauseDB::RuleId> rules;
+      /// units whose summaries the rules use
+      std::set<unsigned> callees;
+      unsigned level;
+      /// hash of the functions of the unit and of its callees
+      std::string hash;
+      Unit () : level (0) {}
+    };
+
+    HornifyModule &m_hm;
+    HornClauseDB &m_db;
+    Setup m_setup;
+    unsigned m_threads;
+    /// do not add the constraints of the database to the fixedpoints
+    bool m_skipConstraints;
+
+    /// units, callees before callers
+    std::vector<Unit> m_units;
+    std::map<Expr, unsigned> m_unitOf;
+    /// the unit with the queries
+    unsigned m_root;
+
+    /// over-approximations of the summaries that are known. Written
+    /// by the workers of a level, read by those of the next ones
+    std::mutex m_mutex;
+    std::map<Expr, Expr> m_summaries;
+    /// units that can fail. Guarded by m_mutex
+    std::set<unsigned> m_canFail;
+
+    /// file of the results of the units of the previous runs
+    std::string m_store;
+
+    /// the fixedpoint of the last query of the root unit
+    std::unique_ptr<ufo::ZFixedPoint<ufo::EZ3> > m_fp;
+
+    /// splits the database into units. False if it cannot be split
+    bool split (Module &M);
+    /// canonical application of rel, over the arguments arg_i
+    Expr canonicalApp (Expr rel);
+    /// loads the rules of the concrete units into fp, and the
+    /// approximations of the summaries they use. The relations of
+    /// the approximations are added to abstract
+    void load (ufo::ZFixedPoint<ufo::EZ3> &fp, const std::set<unsigned> &concrete,
+               std::set<Expr> &abstract);
+    /// solves unit u alone and records the invariants of its
+    /// summaries if it cannot fail
+    void summarize (unsigned u, ufo::EZ3 &z3);
+    /// adds the time since start to the relations of unit in
+    /// HornRelStats
+    void solveTime (const Unit &unit, std::chrono::steady_clock::time_point start);
+
+    /// computes the hashes of the units, callees first
+    void hashUnits ();
+    /// takes the results of the units whose hash is in the store.
+    /// Their entries in solved are set
+    void loadStore (std::vector<bool> &solved);
+    /// replaces the store with the results of the units of this run
+    bool saveStore ();
+
+  public:
+    HornCompositional (HornifyModule &hm, Setup setup, unsigned threads,
+                       bool skipConstraints) :
+      m_hm (hm), m_db (hm.getHornClauseDB ()), m_setup (setup),
+      m_threads (threads), m_skipConstraints (skipConstraints), m_root (0) {}
+
+    /// prepares the units of the database, whose relations must be
+    /// those of the functions of M. False if the database has no
+    /// summaries or cannot be split along them
+    bool init (Module &M);
+
+    /// reuses and updates the results kept in fname. The file must
+    /// come from runs with the same options
+    void setStore (const std::string &fname) { m_store = fname; }
+
+    /// the answer for the queries of the database, as ZFixedPoint::query
+    boost::tribool solve ();
+
+    /// the fixedpoint of the last query of the unit of main. Its
+    /// counterexample is a counterexample of the database, but it
+    /// has no invariants of the approximated callees
+    std::unique_ptr<ufo::ZFixedPoint<ufo::EZ3> > &getZFixedPoint () { return m_fp; }
+  };
+}
+
+#endif /* HORN_COMPOSITIONAL__HH_ */
@@ -8,21 +8,37 @@
 #include "ufo/Smt/Z3n.hpp"
 #include "ufo/Smt/EZ3.hh"
 
+#include <functional>
+#include <unordered_map>
+
 namespace seahorn
 {
+  /// Definitions of the relations of a database, over bound
+  /// variables, keyed by fdecl. Hashed, since databases can have tens
+  /// of thousands of relations of which few are queried
   class HornDbModel
   {
   private:
-    ExprMap m_defs;
+    std::unordered_map<Expr, Expr> m_defs;
+    /// definitions that are computed when first queried. Maps a
+    /// relation to the fapp and the lemma of its definition
+    std::unordered_map<Expr, std::pair<Expr, std::function<Expr ()> > > m_lazy;
+
+    void materialize (Expr fdecl);
   public:
     HornDbModel() {}
     void addDef(Expr fapp, Expr lemma);
+    /// Like addDef, except that lemma () is only called when the
+    /// definition is first queried
+    void addLazyDef (Expr fapp, std::function<Expr ()> lemma);
     Expr getDef(Expr fapp);
     bool hasDef (Expr fdecl);
     virtual ~HornDbModel() {}
   };
 
   /// Extract HornDbModel of a given horn db from a ZFixedPoint. 
+  /// Definitions are extracted lazily, the fixedpoint must outlive
+  /// the queries to the model
   void initDBModelFromFP(HornDbModel &dbModel, HornClauseDB &db, ZFixedPoint<EZ3> &fp);
 }
 
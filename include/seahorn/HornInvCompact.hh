@@ -0,0 +1,46 @@
+#ifndef HORN_INV_COMPACT__HH_
+#define HORN_INV_COMPACT__HH_
+/// Smaller invariants with the same meaning, e.g., for --horn-answer
+
+#include "ufo/Expr.hpp"
+#include "ufo/Smt/EZ3.hh"
+
+#include <unordered_map>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// Compacts the invariants of a model before they are printed or
+  /// measured. An invariant is simplified, its conjunctions are
+  /// flattened, and the conjuncts that the others imply are removed,
+  /// first by cheap syntactic checks: duplicates, true, a disjunction
+  /// of which a disjunct is a conjunct or is implied by one, and a
+  /// bound of a term by a numeral that is weaker than another bound
+  /// of the same term. With SMT checks, a conjunct is also removed if
+  /// the conjuncts that are kept imply it within the timeout.
+  ///
+  /// Results are cached by invariant, which is hash-consed, so that
+  /// the invariants shared by several relations are compacted once
+  class HornInvCompactor
+  {
+    /// for z3_simplify and the SMT checks. Null if none
+    ufo::EZ3 *m_zctx;
+    /// of an SMT check in milliseconds. 0 means no SMT checks
+    unsigned m_smtTimeout;
+    std::unordered_map<Expr, Expr> m_cache;
+
+    /// the conjuncts of inv that are kept
+    void compactConjuncts (Expr inv, ExprVector &kept);
+
+  public:
+    /// only syntactic checks without zctx, or when smtTimeout is 0
+    HornInvCompactor (ufo::EZ3 *zctx = nullptr, unsigned smtTimeout = 0) :
+      m_zctx (zctx), m_smtTimeout (smtTimeout) {}
+
+    /// an invariant equivalent to inv, of at most its dag size
+    Expr compact (Expr inv);
+  };
+}
+
+#endif /* HORN_INV_COMPACT__HH_ */
@@ -0,0 +1,70 @@
+#ifndef HORN_LEMMA_QUEUE__HH_
+#define HORN_LEMMA_QUEUE__HH_
+/// Lemmas produced on a worker thread while the Horn solver runs
+
+#include "ufo/Expr.hpp"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// A lemma of a relation, as in HornClauseDB::addConstraint: the
+  /// application of the relation and a formula over its arguments
+  typedef std::pair<Expr, Expr> HornLemma;
+
+  /// A producer of lemmas, e.g. LoadCrab, registers a job that the
+  /// solver starts on a worker thread when it starts solving. The
+  /// job pushes lemmas as they are found and the solver takes them
+  /// between its queries. The expressions cross threads, so the
+  /// expression factory must be concurrent. Lemmas pushed without a
+  /// producer, e.g. by Houdini, are taken as soon as the solver has
+  /// loaded the rules.
+  class HornLemmaQueue
+  {
+  public:
+    typedef std::function<void (HornLemmaQueue&)> Producer;
+
+  private:
+    Producer m_producer;
+    std::thread m_worker;
+    std::mutex m_lock;
+    std::vector<HornLemma> m_lemmas;
+    bool m_done;
+    std::atomic<bool> m_cancel;
+
+  public:
+    HornLemmaQueue () : m_done (false), m_cancel (false) {}
+    HornLemmaQueue (const HornLemmaQueue &) = delete;
+    ~HornLemmaQueue () { stop (); }
+
+    /// registers the job that produces the lemmas
+    void setProducer (Producer p) { m_producer = p; }
+    bool hasProducer () const { return (bool)m_producer; }
+
+    /// runs the producer on a worker thread. Does nothing if there is
+    /// none or if it was already started
+    void start ();
+    /// runs the producer on this thread, to the end
+    void run ();
+    /// asks the producer to stop and waits for it
+    void stop ();
+
+    /// -- called by the producer, or before the solver starts
+    void push (Expr pred, Expr lemma);
+    /// true if the producer should stop early
+    bool cancelled () const { return m_cancel.load (std::memory_order_relaxed); }
+
+    /// moves the pending lemmas to out. Returns false once the
+    /// producer is done and there was nothing left to take
+    bool take (std::vector<HornLemma> &out);
+  };
+}
+
+#endif /* HORN_LEMMA_QUEUE__HH_ */
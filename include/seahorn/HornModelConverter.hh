@@ -15,9 +15,120 @@ namespace seahorn
   {
   public:
     // converts a model from one database to another. returns false on failure.
+    // the definitions of out may be computed when first queried, from
+    // a copy of in that out keeps
     virtual bool convert (HornDbModel &in, HornDbModel &out) = 0;
     virtual ~HornModelConverter() {}
   };
+
+  /// Rebuilds the model of a database from the model of its slice
+  /// (see sliceHornClauseDB). Relations that are not in the slice are
+  /// either unreachable from the facts, and so empty, or irrelevant to
+  /// the queries, and so unconstrained
+  class HornSliceModelConverter : public HornModelConverter
+  {
+    /// relations kept in the slice
+    ExprVector m_kept;
+    /// relations that cannot be derived
+    ExprVector m_empty;
+    /// relations that do not reach a query
+    ExprVector m_free;
+
+  public:
+    void addKept (Expr fdecl) { m_kept.push_back (fdecl); }
+    void addEmpty (Expr fdecl) { m_empty.push_back (fdecl); }
+    void addFree (Expr fdecl) { m_free.push_back (fdecl); }
+
+    const ExprVector &getEmpty () const { return m_empty; }
+    const ExprVector &getFree () const { return m_free; }
+
+    bool convert (HornDbModel &in, HornDbModel &out);
+  };
+
+  /// Rebuilds the model and the counterexamples of a database from
+  /// those of its simplification (see simplifyHornClauseDB). The
+  /// definition of an inlined relation is the projection of the body
+  /// of its rule, computed with quantifier elimination
+  class HornSimplifyModelConverter : public HornModelConverter
+  {
+  public:
+    /// a removed argument whose value is known: the constant value,
+    /// or, if value is null, the argument at position same
+    struct FixedArg
+    {
+      unsigned pos;
+      Expr value;
+      unsigned same;
+    };
+
+  private:
+    EZ3 &m_z3;
+
+    /// a relation inlined into the rule using it
+    struct Inlined
+    {
+      Expr rel;
+      /// the rule defining rel, and the relations in its body
+      Expr head;
+      Expr body;
+      ExprVector vars;
+      ExprVector apps;
+    };
+    /// a relation replaced by one with the arguments in kept. The
+    /// other arguments are unconstrained, unless they are fixed
+    struct Reduced
+    {
+      Expr rel;
+      Expr newRel;
+      std::vector<unsigned> kept;
+      std::vector<FixedArg> fixed;
+    };
+    /// the steps, in order. An index into m_inlined or m_reduced
+    std::vector<std::pair<bool, unsigned> > m_steps;
+    std::vector<Inlined> m_inlined;
+    std::vector<Reduced> m_reduced;
+    /// maps a new relation to its position in m_reduced
+    std::map<Expr, unsigned> m_newRels;
+
+    /// relations skipped by the merged rules, keyed by the original
+    /// relations of their source and destination. The source of a
+    /// fact is true
+    std::map<std::pair<Expr, Expr>, ExprVector> m_chains;
+    static const ExprVector m_empty_chain;
+
+    /// next index of the variables renamed apart by inlining
+    unsigned m_fresh;
+
+    /// app of an original relation equivalent to an app of a reduced one
+    Expr restoreApp (Expr app) const;
+
+  public:
+    HornSimplifyModelConverter (EZ3 &z3) : m_z3 (z3), m_fresh (0) {}
+
+    /// an index for the names of renamed variables, never returned
+    /// before by this converter, e.g., in an earlier round of
+    /// simplifyHornClauseDB
+    unsigned freshIndex () { return m_fresh++; }
+
+    void addInlined (Expr rel, const HornRule &def, const ExprVector &apps);
+    void addReduced (Expr rel, Expr newRel, const std::vector<unsigned> &kept,
+                     const std::vector<FixedArg> &fixed = std::vector<FixedArg> ());
+
+    /// the original relation of a relation of the simplified database
+    Expr origin (Expr fdecl) const;
+    /// relations between src and dst removed by inlining
+    const ExprVector &getChain (Expr src, Expr dst) const;
+    void addChain (Expr src, Expr dst, const ExprVector &chain)
+    { m_chains [std::make_pair (src, dst)] = chain; }
+
+    bool isIdentity () const { return m_steps.empty (); }
+
+    bool convert (HornDbModel &in, HornDbModel &out);
+
+    /// converts the rules of a counterexample of db, in the order of
+    /// ZFixedPoint::getCexRules, to rules of the original database
+    void convertCex (HornClauseDB &db, const ExprVector &in, ExprVector &out) const;
+  };
 }
 
 #endif
@@ -0,0 +1,77 @@
+#ifndef HORN_MODEL_VALIDATOR__HH_
+#define HORN_MODEL_VALIDATOR__HH_
+/// Independent check of the models of a HornClauseDB
+
+#include "seahorn/HornClauseDB.hh"
+#include "seahorn/HornDbModel.hh"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include "ufo/Expr.hpp"
+#include "ufo/Smt/Z3n.hpp"
+#include "ufo/Smt/EZ3.hh"
+
+#include <boost/logic/tribool.hpp>
+
+#include <memory>
+#include <unordered_map>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// Checks that a model, e.g., the invariants of Spacer or of
+  /// Houdini, satisfies every rule of a database: the body and the
+  /// definitions of its relations imply the definition of the
+  /// head. Each rule is an SMT query of its own, solved by a pool of
+  /// threads with a Z3 context each, without the solver that found
+  /// the model.
+  ///
+  /// Results are cached by query, which is hash-consed, so that a
+  /// rule whose definitions did not change is not checked again
+  class HornModelValidator
+  {
+    /// query to whether it is unsat, i.e., the rule holds
+    std::unordered_map<Expr, bool> m_cache;
+    /// the first rule found to fail by the last validate
+    std::unique_ptr<HornRule> m_failed;
+    unsigned m_checked;
+    unsigned m_cached;
+    /// of a validate in milliseconds, 0 if none
+    unsigned m_timeLimit;
+    /// of the workers, created by the first validate
+    std::unique_ptr<ufo::ZWorkerContexts<ufo::EZ3> > m_contexts;
+
+  public:
+    HornModelValidator () : m_checked (0), m_cached (0), m_timeLimit (0) {}
+
+    /// whether --horn-validate-model is set
+    static bool enabled ();
+
+    /// checks model against the rules of db, and against its queries
+    /// if queries is true. Returns false as soon as a rule fails, and
+    /// indeterminate if a check is unknown. Queries are checked in
+    /// threads only if the ExprFactory of db is concurrent. The
+    /// definitions of model are fetched by the calling thread
+    boost::tribool validate (HornClauseDB &db, HornDbModel &model,
+                             unsigned threads, bool queries = true);
+
+    /// validate stops after ms milliseconds, and is indeterminate if a
+    /// check did not finish. 0 means no limit
+    void setTimeLimit (unsigned ms) { m_timeLimit = ms; }
+
+    /// the rule that failed the last validate, null if none. A query
+    /// q fails as the rule q -> false
+    const HornRule *failedRule () const { return m_failed.get (); }
+
+    /// checks solved by the last validate, and answered from the cache
+    unsigned checked () const { return m_checked; }
+    unsigned cached () const { return m_cached; }
+
+    /// prints the outcome of the last validate, and publishes it to
+    /// Stats as HornValidate*
+    void report (boost::tribool res, llvm::raw_ostream &out) const;
+  };
+}
+
+#endif
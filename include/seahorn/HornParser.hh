@@ -0,0 +1,27 @@
+#ifndef _HORN_PARSER__H_
+#define _HORN_PARSER__H_
+
+#include "seahorn/HornClauseDB.hh"
+
+#include <istream>
+#include <string>
+
+namespace seahorn
+{
+  /// Loads Horn clauses in SMT-LIB2 format into db, without going
+  /// through Z3. Both the HORN logic of SMT-LIB2 (declare-fun and
+  /// universally quantified assertions) and the Z3 fixedpoint format
+  /// (declare-rel, declare-var, rule and query) are accepted. A clause
+  /// whose head is false becomes a rule for a fresh nullary relation
+  /// that is added as a query.
+  ///
+  /// Returns false and sets error if the input cannot be parsed or is
+  /// not a set of Horn clauses.
+  bool loadHornClauseDB (std::istream &in, HornClauseDB &db,
+                         std::string &error);
+
+  bool loadHornClauseDB (const std::string &fname, HornClauseDB &db,
+                         std::string &error);
+}
+
+#endif /* _HORN_PARSER__H_ */
@@ -0,0 +1,90 @@
+#ifndef HORN_PORTFOLIO__HH_
+#define HORN_PORTFOLIO__HH_
+/// Portfolio of Horn solving configurations run concurrently
+
+#include "boost/logic/tribool.hpp"
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <functional>
+
+namespace seahorn
+{
+  /// A configuration of HornSolver. Written as
+  ///   [houdini+]ENGINE[:PARAM=VALUE]...
+  /// e.g., spacer, pdr:pdr.utvpi=true, houdini+spacer:xform.slice=false.
+  /// The engine kind is k-induction on main, e.g., houdini+kind:max_k=10
+  /// and the engine compositional solves the functions one at a time
+  /// with spacer, e.g., compositional:spacer.reset_obligation_queue=false.
+  /// The engine staged tries the invariants of Crab and of Houdini
+  /// before spacer, with the parameters of spacer, e.g., staged
+  struct PortfolioConfig
+  {
+    /// the spec the configuration was parsed from
+    std::string name;
+    /// strengthen the clauses with Houdini invariants first
+    bool houdini;
+    /// value of the :engine parameter of the fixedpoint
+    std::string engine;
+    /// parameters of the fixedpoint, with the leading colon
+    std::vector<std::pair<std::string, std::string> > params;
+
+    PortfolioConfig () : houdini (false) {}
+
+    /// parses spec. Returns false if spec is malformed
+    static bool parse (const std::string &spec, PortfolioConfig &out);
+  };
+
+  /// Appends to specs the configurations of cluster in a file written
+  /// by py/sea_tune.py, best first. Every line is CLUSTER SPEC and #
+  /// starts a comment. A cluster that is not in the file gets those of
+  /// the cluster default. Returns false if the file cannot be read
+  bool loadTunedConfigs (const std::string &file, const std::string &cluster,
+                         std::vector<std::string> &specs);
+
+  /// A job of the portfolio. Runs in a child process and returns the
+  /// answer of the configuration
+  typedef std::function<boost::tribool ()> PortfolioJob;
+
+  struct PortfolioResult
+  {
+    /// index of the job that answered first. -1 if none did
+    int winner;
+    boost::tribool answer;
+    PortfolioResult () : winner (-1), answer (boost::indeterminate) {}
+  };
+
+  /// Runs every job in its own process and returns the first
+  /// definitive (sat or unsat) answer. The other jobs are asked to
+  /// stop with SIGTERM, which calls the hook of
+  /// setPortfolioCancelHook, and are killed if they do not exit
+  /// within graceMs. Workers have at most memLimitMb MB of address
+  /// space. 0 means no limit
+  ///
+  /// Workers are forked, not executed: every worker starts with the
+  /// expressions and the HornClauseDB of the parent, shared
+  /// copy-on-write, and neither reruns the front end nor reads the
+  /// database back. The pages of the parent count towards the
+  /// address space of a worker
+  PortfolioResult runPortfolio (const std::vector<PortfolioJob> &jobs,
+                                unsigned memLimitMb, unsigned graceMs = 1000);
+
+  /// Called with the index of a job and its answer as the job ends.
+  /// Returns false to stop the jobs that still run
+  typedef std::function<bool (size_t, boost::tribool)> PortfolioAnswerFn;
+
+  /// Runs every job in its own process, at most parallel at a time
+  /// (0 means all), and calls onAnswer as each job ends, in the order
+  /// in which they end. A job that dies without an answer ends with
+  /// indeterminate. The jobs are stopped as by runPortfolio
+  void runEach (const std::vector<PortfolioJob> &jobs, unsigned memLimitMb,
+                unsigned parallel, PortfolioAnswerFn onAnswer,
+                unsigned graceMs = 1000);
+
+  /// Called in a worker when it is asked to stop, e.g., to interrupt
+  /// the solver. Runs in a signal handler
+  void setPortfolioCancelHook (void (*hook) (void*), void *arg);
+}
+
+#endif /* HORN_PORTFOLIO__HH_ */
@@ -0,0 +1,52 @@
+#ifndef HORN_PROGRESS__HH_
+#define HORN_PROGRESS__HH_
+/// Live progress of a Horn solver run
+
+#include "ufo/Expr.hpp"
+
+#include <string>
+
+namespace seahorn
+{
+  /// Values published by the solver while it runs, e.g., the phase,
+  /// the Spacer levels and lemmas, and Z3 statistics, written as one
+  /// JSON line per period by a monitor thread, with the memory of the
+  /// process and the time since a value last changed. A scheduler
+  /// reading the lines can tell a stalled job from a slow one.
+  ///
+  /// The monitor only reads what the solver publishes: it never
+  /// touches Z3 or Stats, which are not thread-safe.
+  class HornProgress
+  {
+  public:
+    /// starts the monitor. dest is a file, or unix:PATH for a stream
+    /// socket. efac, if not null, is the factory whose memory is
+    /// reported. Returns false if dest cannot be opened
+    static bool start (const std::string &dest, unsigned periodMs,
+                       const expr::ExprFactory *efac);
+    /// writes a last line, publishes the values to Stats as
+    /// Progress.*, and stops the monitor
+    static void stop ();
+    static bool enabled ();
+
+    static void phase (const std::string &name);
+    static void set (const std::string &key, unsigned long v);
+    static void add (const std::string &key, unsigned long d);
+    /// removes the values whose key starts with prefix
+    static void clear (const std::string &prefix);
+    /// publishes the values to Stats as Progress.*. On the solver
+    /// thread only
+    static void toStats ();
+  };
+
+  /// sets the phase of HornProgress while alive
+  class ProgressPhase
+  {
+    std::string m_prev;
+  public:
+    ProgressPhase (const std::string &name);
+    ~ProgressPhase ();
+  };
+}
+
+#endif
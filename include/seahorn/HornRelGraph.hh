@@ -0,0 +1,84 @@
+#ifndef _HORN_REL_GRAPH__HH_
+#define _HORN_REL_GRAPH__HH_
+
+#include "seahorn/HornClauseDB.hh"
+
+#include <vector>
+#include <boost/range/iterator_range.hpp>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// Dependency graph of the relations of a HornClauseDB in
+  /// compressed sparse row form. Relations get dense ids in the
+  /// (sorted) order of getRelations (), and there is one edge p -> q
+  /// labelled with rule r for every rule r with head q that uses p in
+  /// its body. Built once from the use index of the database, it is a
+  /// snapshot: rules added or removed later are not reflected
+  class HornRelGraph
+  {
+  public:
+    typedef unsigned RelId;
+    typedef HornClauseDB::RuleId RuleId;
+    /// no relation, e.g., the head of a removed rule
+    static const RelId NoRel = (RelId) -1;
+
+    struct Edge
+    {
+      RelId rel;
+      RuleId rule;
+    };
+    typedef std::vector<Edge>::const_iterator edge_iterator;
+    typedef boost::iterator_range<edge_iterator> edge_range;
+
+  private:
+    /// sorted, as getRelations ()
+    ExprVector m_rels;
+    /// edges of relation i are [m_out_off [i], m_out_off [i+1])
+    std::vector<unsigned> m_out_off;
+    std::vector<Edge> m_out;
+    std::vector<unsigned> m_in_off;
+    std::vector<Edge> m_in;
+    /// head of every rule id, and number of relations in its body
+    std::vector<RelId> m_head;
+    std::vector<unsigned> m_body_size;
+
+  public:
+    explicit HornRelGraph (const HornClauseDB &db);
+
+    unsigned size () const { return m_rels.size (); }
+    unsigned numEdges () const { return m_out.size (); }
+
+    /// id of a relation, NoRel if fdecl is not one
+    RelId id (Expr fdecl) const;
+    Expr rel (RelId id) const { return m_rels [id]; }
+
+    /// edges to the heads of the rules that use id
+    edge_range succs (RelId id) const
+    { return edge_range (m_out.begin () + m_out_off [id],
+                         m_out.begin () + m_out_off [id + 1]); }
+    /// edges from the body relations of the rules that define id
+    edge_range preds (RelId id) const
+    { return edge_range (m_in.begin () + m_in_off [id],
+                         m_in.begin () + m_in_off [id + 1]); }
+
+    /// head of a rule, NoRel if the rule was removed or its head is
+    /// not a relation
+    RelId head (RuleId rule) const
+    { return rule < m_head.size () ? m_head [rule] : NoRel; }
+    /// number of distinct relations in the body of a rule
+    unsigned bodySize (RuleId rule) const
+    { return rule < m_body_size.size () ? m_body_size [rule] : 0; }
+    /// rule ids are below this bound
+    RuleId ruleIdBound () const { return m_head.size (); }
+
+    /// strongly connected component of every relation, numbered in
+    /// reverse topological order: the component of a relation is at
+    /// least that of any relation whose rules use it. Returns their
+    /// number
+    unsigned sccs (std::vector<unsigned> &out) const;
+  };
+}
+
+#endif /* _HORN_REL_GRAPH__HH_ */
@@ -0,0 +1,51 @@
+#ifndef HORN_REL_STATS__HH_
+#define HORN_REL_STATS__HH_
+/// Per-relation statistics of a Horn clause database
+
+#include "seahorn/HornClauseDB.hh"
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <string>
+
+namespace seahorn
+{
+  /// With --horn-rel-stats, tells which relations make a database
+  /// hard. A snapshot records for every relation its arity by sort,
+  /// the number of rules that define and use it, the size of the bodies
+  /// of the rules that define it as a DAG and as a tree, and its
+  /// component in the call graph and in the weak topological order.
+  /// HornifyModule takes a snapshot of the encoding and HornSolver of
+  /// the database it solves, after slicing and inlining. The solver
+  /// adds the time spent on a relation when it is known, i.e., the
+  /// time of its unit in the compositional engine, and the size of its
+  /// invariant.
+  ///
+  /// The snapshots are written as JSON, relations with the largest
+  /// bodies first, to the file of --horn-rel-stats and as the section
+  /// relations of --profile-json
+  class HornRelStats
+  {
+  public:
+    static bool enabled ();
+
+    /// records the relations of db under phase, e.g., hornify.
+    /// Replaces a snapshot of the same phase
+    static void snapshot (const std::string &phase, HornClauseDB &db);
+
+    /// adds secs of solving to the relations of the last snapshot in
+    /// rels, solved together as group. From any thread
+    static void addSolveTime (const ExprVector &rels, double secs,
+                              const std::string &group);
+    /// sets the DAG size of the invariant of rel in the last snapshot
+    static void setInvariantSize (Expr rel, size_t dag);
+
+    static void write (llvm::raw_ostream &OS);
+  };
+
+  /// Writes the snapshots of HornRelStats to the file of
+  /// --horn-rel-stats, if any
+  void writeRelStats ();
+}
+
+#endif /* HORN_REL_STATS__HH_ */
@@ -0,0 +1,67 @@
+#ifndef HORN_SERVER__HH_
+#define HORN_SERVER__HH_
+/// Long-lived verification server that answers jobs read as JSON lines
+
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace llvm
+{
+  class Pass;
+}
+
+namespace seahorn
+{
+  /// Runs one verification job in a child process of the server. The
+  /// arguments are the command-line options of the job followed by
+  /// its input file. Returns the exit code of the job. The answer of
+  /// the job is the Result statistic (TRUE or FALSE) that it sets
+  typedef std::function<int (const std::vector<std::string>&)> ServerJobFn;
+
+  struct ServerConfig
+  {
+    /// Unix socket to listen on. Jobs are read from stdin if empty
+    std::string socket;
+    /// limits of jobs that set none. 0 means no limit
+    unsigned timeoutSec;
+    unsigned memLimitMb;
+    /// port on localhost that serves the metrics of the server over
+    /// HTTP, in the Prometheus text format. None if 0
+    unsigned metricsPort;
+
+    ServerConfig () : timeoutSec (0), memLimitMb (0), metricsPort (0) {}
+  };
+
+  /// Serves jobs until the end of the input, or until the job
+  /// {"cmd": "shutdown"}. A job is a line
+  ///   {"id": "1", "file": "a.bc", "args": ["--horn-solve"],
+  ///    "timeout": 10, "mem": 4096}
+  /// where only file is required and timeout (seconds) and mem (MB)
+  /// override the limits of cfg. Each job runs fn in a forked process,
+  /// so it gets a fresh LLVMContext, ExprFactory and Z3 context while
+  /// the initialization of the server is shared. It is answered by a line
+  ///   {"id": "1", "status": "done", "result": "unsat", "exit": 0,
+  ///    "time": 0.42, "output": "unsat\n"}
+  /// where status is one of done, timeout, memout, error or crash,
+  /// result is sat, unsat or unknown and output is the standard output
+  /// of the job. Returns the exit code of the server
+  ///
+  /// With a metrics port, a thread of the server answers every HTTP
+  /// request with the job in flight and the time in its phase, the
+  /// histograms of the time of jobs and of their phases, and the
+  /// sums over the jobs of their counters and timers, e.g., the time
+  /// of Z3, the nodes of the ExprFactory and the hits of the caches.
+  /// A job sends them to the server at the end
+  int runServer (const ServerConfig &cfg, ServerJobFn fn);
+
+  /// true in the process of a job of the server
+  bool inServerJob ();
+  /// sets the phase of the job of the server, e.g., hornify or solve.
+  /// Does nothing outside of a job
+  void setServerJobPhase (const std::string &phase);
+  /// a pass that sets the phase of the job of the server when it runs
+  llvm::Pass *createServerPhasePass (const std::string &phase);
+}
+
+#endif /* HORN_SERVER__HH_ */
@@ -0,0 +1,33 @@
+#ifndef _HORN_SMT2_WRITER__HH_
+#define _HORN_SMT2_WRITER__HH_
+
+#include "seahorn/HornClauseDB.hh"
+#include "ufo/Expr.hpp"
+#include "ufo/Smt/EZ3.hh"
+
+#include "llvm/Support/raw_ostream.h"
+
+namespace seahorn
+{
+  using namespace ufo;
+
+  /// Writes a HornClauseDB in the SMT2 format of Z3 fixedpoints
+  /// without loading it into a fixedpoint. Declarations, rules and
+  /// queries are printed one at a time, so only one rule is held as
+  /// text at any point. Subterms shared within a rule are printed
+  /// once with let
+  class HornSmt2Writer
+  {
+    HornClauseDB &m_db;
+    EZ3 &m_z3;
+
+    void writeRelation (raw_ostream &out, Expr decl);
+  public:
+    HornSmt2Writer (HornClauseDB &db, EZ3 &z3) : m_db (db), m_z3 (z3) {}
+
+    /// writes the database. Constraints are not written
+    void write (raw_ostream &out);
+  };
+}
+
+#endif /* _HORN_SMT2_WRITER__HH_ */
@@ -5,6 +5,10 @@
 #include "llvm/IR/Module.h"
 #include "boost/logic/tribool.hpp"
 #include "seahorn/HornDbModel.hh"
+#include "seahorn/HornInvCompact.hh"
+#include "seahorn/HornModelConverter.hh"
+#include "seahorn/HornifyModule.hh"
+#include "seahorn/HornPortfolio.hh"
 
 #include "ufo/Smt/EZ3.hh"
 
@@ -16,26 +20,134 @@ namespace seahorn
   {
     boost::tribool m_result;
     std::unique_ptr<ufo::ZFixedPoint <ufo::EZ3> >  m_fp;
+    /// steps of --horn-inline
+    std::unique_ptr<HornSimplifyModelConverter> m_simplify;
+    Module *m_module;
+    /// true if the answer comes from k-induction. m_fp is then empty
+    bool m_kind;
+    /// true if the answer comes from the compositional engine. m_fp
+    /// then has the counterexample but not all invariants
+    bool m_compositional;
+    /// true if the answer comes from solving groups of the queries on
+    /// their own, see solveSplit. m_fp is then empty
+    bool m_split;
+    /// true if the answer comes from a stage of the staged engine
+    /// before spacer, see solveStaged. m_fp is then empty, and the
+    /// constraints of the database are the model
+    bool m_staged;
+    /// false if nothing after the solver reads the bodies of the
+    /// functions, which --horn-lean-mem then drops
+    bool m_keepModule;
+
+    /// what --horn-answer and --horn-estimate-size-invars print, by
+    /// function, so that they do not need the bodies
+    struct BlockAnswer
+    {
+      Expr pred;
+      ExprVector live;
+    };
+    struct FuncAnswer
+    {
+      std::string name;
+      std::vector<BlockAnswer> blocks;
+    };
+    std::vector<FuncAnswer> m_answerIndex;
+    /// of --horn-answer-compact, created when first used
+    std::unique_ptr<HornInvCompactor> m_compactor;
+
+    /// queries solved together and their answer, for
+    /// --horn-anytime-json. The groups of --horn-split-queries, or one
+    /// group of every query
+    struct QueryGroup
+    {
+      ExprVector queries;
+      boost::tribool result;
+    };
+    std::vector<QueryGroup> m_groups;
+    void indexAnswer (Module &M, HornifyModule &hm);
+    /// --horn-lean-mem, once the clauses of hm are in m_fp
+    void releaseBeforeQuery (HornifyModule &hm);
     
-    void printCex ();
+    /// solves the clauses of hm with one configuration, in m_fp
+    boost::tribool solve (HornifyModule &hm, const PortfolioConfig &cfg);
+    /// the kind engine. Runs KInduction on main, strengthened by the
+    /// constraints of the database, e.g., invariants of Houdini or Crab
+    boost::tribool solveKInduction (HornifyModule &hm, const PortfolioConfig &cfg);
+    /// the compositional engine. Solves the functions of the database
+    /// bottom-up, see HornCompositional
+    boost::tribool solveCompositional (HornifyModule &hm, const PortfolioConfig &cfg);
+    /// the staged engine. Stops at the first stage that answers: the
+    /// constraints of the database, e.g., the invariants of Crab, if
+    /// they are a model, then Houdini over the guessed candidates, and
+    /// then spacer warm-started from the constraints found. The first
+    /// two stages have a time slice each, and the outcome and the time
+    /// of every stage are recorded in Stats and --horn-staged-log
+    boost::tribool solveStaged (HornifyModule &hm, const PortfolioConfig &cfg);
+    /// the model of the answer of m_fp, or the constraints of db for
+    /// the staged engine
+    void getModel (HornClauseDB &db, HornDbModel &model);
+    /// runs the configurations of --horn-portfolio concurrently
+    boost::tribool solvePortfolio (HornifyModule &hm);
+    /// solves the groups of queries of --horn-split-queries
+    /// concurrently, each in a worker with the whole database, and
+    /// reports the answer of every group as it comes. Sat as soon as a
+    /// group is, and then solves that group again in m_fp for the
+    /// counterexample. Unsat if every group is
+    boost::tribool solveSplit (HornifyModule &hm, const PortfolioConfig &cfg);
+
+    /// adds the lemmas of fname, e.g., of --horn-spacer-lemmas or of
+    /// a checkpoint, that are still invariants of the database to its
+    /// constraints. The lemmas of a relation are matched by function,
+    /// cutpoint and signature
+    void loadLemmas (HornifyModule &hm, const std::string &fname);
+
+    void printCex (HornClauseDB &db);
     void estimateSizeInvars (Module &M);
 
-    void printInvars(Function &F, HornDbModel &model);
+    void printInvars(const FuncAnswer &fa, HornDbModel &model);
     void printInvars(Module &M, HornDbModel &model);
+    /// inv as it is printed or measured, see --horn-answer-compact
+    Expr compactInvariant (Expr inv);
+    /// writes to --horn-anytime-json the answer of every group of
+    /// queries, the counterexample, and the invariants found so far:
+    /// those of m_fp, or else the constraints of the database, e.g.,
+    /// the survivors of Houdini. slice is the model converter of
+    /// --horn-slice
+    void writeAnytime (Module &M, HornSliceModelConverter &slice);
+    /// writes the rules of the functions of M in db to --horn-write-pack,
+    /// with their summaries in model if not null
+    void writePack (Module &M, HornClauseDB &db, HornDbModel *model);
 
   public:
     static char ID;
     
-    HornSolver () : ModulePass(ID), m_result(boost::indeterminate) {}
+    /// keepModule is false if no pass after the solver reads the module
+    HornSolver (bool keepModule = true) :
+      ModulePass(ID), m_result(boost::indeterminate),
+      m_module (nullptr), m_kind (false), m_compositional (false),
+      m_split (false), m_staged (false), m_keepModule (keepModule) {}
     virtual ~HornSolver() {}
     
     virtual bool runOnModule (Module &M);
     virtual void getAnalysisUsage (AnalysisUsage &AU) const;
     virtual const char* getPassName () const {return "HornSolver";}
     ufo::ZFixedPoint<ufo::EZ3>& getZFixedPoint () {return *m_fp;}
+    /// rules of the counterexample, as ZFixedPoint::getCexRules, in
+    /// terms of the relations of the database before --horn-inline
+    void getCexRules (HornClauseDB &db, ExprVector &rules);
+    /// ground applications of the relations along the counterexample
+    /// of m_fp, in the order of ZFixedPoint::getGroundSatAnswer. False
+    /// if there are none, or if they are not over the relations of
+    /// the database, e.g., after --horn-inline
+    bool getGroundCex (ExprVector &apps);
     
     boost::tribool getResult () {return m_result;}
-    void releaseMemory () {m_fp.reset (nullptr);}
+    void releaseMemory ()
+    {
+      m_fp.reset (nullptr);
+      m_simplify.reset (nullptr);
+      m_compactor.reset (nullptr);
+    }
     
   };
 
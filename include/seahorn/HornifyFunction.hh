@@ -9,6 +9,8 @@
 #include "seahorn/UfoSymExec.hh"
 #include "seahorn/LiveSymbols.hh"
 
+#include <functional>
+
 /// Constructs Horn clauses for a single function
 
 namespace{
@@ -45,6 +47,13 @@ namespace seahorn
     
 
     void extractFunctionInfo (const BasicBlock &BB);
+
+    /// the rule of an edge, over the variables it adds to vars
+    typedef std::function<Expr (const CpEdge&, SymStore&, ExprSet&)> EdgeEncoder;
+    /// adds the rule encode () of every edge of cpg, in the order of
+    /// the edges. Large graphs are encoded on the threads of
+    /// --horn-threads, each with its own SymStore
+    void encodeEdges (const CutPointGraph &cpg, EdgeEncoder encode);
   public:
     HornifyFunction (HornifyModule &parent, bool interproc = false) :
       m_parent (parent), m_sem (m_parent.symExec ()), 
@@ -52,6 +61,13 @@ namespace seahorn
       m_zctx (parent.getZContext ()),
       m_efac (m_zctx.getExprFactory ()), m_interproc (interproc) {}
 
+    /// encodes into db instead of the database of parent
+    HornifyFunction (HornifyModule &parent, HornClauseDB &db, bool interproc) :
+      m_parent (parent), m_sem (m_parent.symExec ()), 
+      m_db (db),
+      m_zctx (parent.getZContext ()),
+      m_efac (m_zctx.getExprFactory ()), m_interproc (interproc) {}
+
     virtual ~HornifyFunction () {}
     HornClauseDB &getHornClauseDB () {return m_db;}
     virtual void runOnFunction (Function &F) = 0;
@@ -66,6 +82,9 @@ namespace seahorn
     SmallHornifyFunction (HornifyModule &parent, 
                           bool interproc = false) : 
       HornifyFunction (parent, interproc) {}
+    SmallHornifyFunction (HornifyModule &parent, HornClauseDB &db,
+                          bool interproc = false) :
+      HornifyFunction (parent, db, interproc) {}
     
     virtual void runOnFunction (Function &F);
   } ;
@@ -77,10 +96,28 @@ namespace seahorn
     LargeHornifyFunction (HornifyModule &parent, 
                           bool interproc = false) : 
       HornifyFunction (parent, interproc) {}
+    LargeHornifyFunction (HornifyModule &parent, HornClauseDB &db,
+                          bool interproc = false) :
+      HornifyFunction (parent, db, interproc) {}
     
     virtual void runOnFunction (Function &F);
   };
 
+  /// Declares the summary of a function without encoding its body,
+  /// e.g., for a function whose rules come from a SummaryPack
+  class SummaryHornifyFunction : public HornifyFunction
+  {
+  public:
+    SummaryHornifyFunction (HornifyModule &parent, HornClauseDB &db,
+                            bool interproc = true) :
+      HornifyFunction (parent, db, interproc) {}
+
+    virtual void runOnFunction (Function &F)
+    {
+      if (const BasicBlock *exit = findExitBlock (F)) extractFunctionInfo (*exit);
+    }
+  };
+
 }
 
 
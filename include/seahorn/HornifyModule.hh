@@ -3,27 +3,40 @@
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
+#include "llvm/ADT/DenseSet.h"
 
 #include "ufo/Expr.hpp"
 #include "ufo/Smt/EZ3.hh"
 #include "seahorn/UfoSymExec.hh"
 #include "seahorn/ClpSymExec.hh"
+#include "seahorn/RegionSlice.hh"
+#include "seahorn/SummaryPack.hh"
+#include "seahorn/Analysis/FunctionClasses.hh"
 
 #include "boost/smart_ptr/scoped_ptr.hpp"
 
 #include "seahorn/LiveSymbols.hh"
+#include "seahorn/FunctionAnalysisCache.hh"
 
 #include "seahorn/HornClauseDB.hh"
+#include "seahorn/HornLemmaQueue.hh"
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace llvm { class CallGraph; }
 
 namespace seahorn
 {
+  class HornifyFunction;
+
   using namespace expr;
   using namespace llvm;
   using namespace ufo;
   
   class HornifyModule : public llvm::ModulePass
   {
-    typedef llvm::DenseMap<const Function*, LiveSymbols> LiveSymbolsMap;
     typedef llvm::DenseMap<const BasicBlock*, Expr> PredDeclMap;
     
   protected:
@@ -31,21 +44,81 @@ namespace seahorn
     ExprFactory m_efac;
     EZ3 m_zctx;
     HornClauseDB m_db;
+    /// lemmas of m_db found while it is solved
+    HornLemmaQueue m_lemmas;
 
     const DataLayout *m_td;
     const CanFail *m_canFail;
     boost::scoped_ptr<SmallStepSymExec> m_sem;
     
-    LiveSymbolsMap m_ls;
+    /// cut-point graphs and live symbols, shared with the other passes
+    FunctionAnalysisCache *m_cache;
     PredDeclMap m_bbPreds;
+    /// protects m_bbPreds when functions are encoded concurrently
+    std::mutex m_bbPredsLock;
+
+    /// the encoded module
+    Module *m_module;
+    /// memory regions tracked with --horn-sem-regions
+    std::unique_ptr<RegionSlice> m_regions;
+    /// functions of --horn-summary-pack
+    std::unique_ptr<SummaryPack> m_pack;
+    /// functions identical up to names, for --horn-share-summaries
+    FunctionClasses m_classes;
+
+    /// file of the on-disk cache of the database. Empty if not cached
+    std::string m_cacheFile;
+    /// load the database from m_cacheFile instead of encoding M
+    bool m_loadCache;
+
+    /// encodes M into the database
+    bool encodeModule (Module &M);
+
+    /// functions reachable from main, for --horn-lazy
+    void neededFunctions (CallGraph &CG, const Function &main,
+                          DenseSet<const Function*> &out);
+    /// encoding of the --horn-step option for F. Adds the rules to db
+    HornifyFunction *mkHornifyFunction (Function &F, HornClauseDB &db);
+    /// with --horn-step=adaptive, true if F is cheaper to encode with
+    /// Large Step than with Small Step. Needs the live symbols of F
+    bool preferLargeStep (Function &F);
+    /// steps of runOnFunction that use the pass manager
+    void prepareFunction (Function &F);
+    /// computes the live symbols of F and encodes it into db
+    void encodeFunction (Function &F, HornClauseDB &db);
+    /// sizes the database and the factory by the size of M
+    void reserve (const Module &M);
+    /// adds the rules of F from the summary pack to db. Returns false
+    /// if F is not in the pack or its summary does not match
+    bool linkFunction (Function &F, HornClauseDB &db);
+    /// with --horn-share-summaries, the function encoded before F
+    /// whose body is identical to that of F up to names. Null if none
+    const Function *summaryClass (const Function &F);
+    /// gives F the summary of rep, which is encoded, instead of
+    /// encoding F. Returns false if rep has no summary
+    bool shareSummary (const Function &F, const Function &rep);
+    /// encodes fns, given in the order of the call graph, with
+    /// functions that do not depend on each other encoded concurrently
+    /// into buffers that are merged in order
+    void runOnSccsParallel (const std::vector<Function*> &fns,
+                            const std::vector<bool> &recursive,
+                            unsigned threads);
     
   public:
     static char ID;
     HornifyModule ();
-    virtual ~HornifyModule () {}
+    /// caches the database in cacheFile. If load is true, the
+    /// database is read from cacheFile and the module is not encoded,
+    /// so that the predicates are not related to basic blocks
+    HornifyModule (const std::string &cacheFile, bool load);
+    virtual ~HornifyModule ();
     ExprFactory& getExprFactory () {return m_efac;} 
     EZ3 &getZContext () {return m_zctx;}
     HornClauseDB& getHornClauseDB () {return m_db;}
+    HornLemmaQueue &getLemmaQueue () {return m_lemmas;}
+    /// number of threads of --horn-threads. The expression factory
+    /// is concurrent if it is larger than one
+    unsigned getThreads () const;
     virtual bool runOnModule (Module &M);
     virtual bool runOnFunction (Function &F);
     virtual void getAnalysisUsage (AnalysisUsage &AU) const;
@@ -72,14 +145,21 @@ namespace seahorn
     /// -- summary predicate for a function
     const Expr summaryPredicate (const Function &F)
     {
-      return m_sem->hasFunctionInfo (F) ?
+      return m_sem && m_sem->hasFunctionInfo (F) ?
         m_sem->getFunctionInfo (F).sumPred : Expr(0);
     }
     /// -- symbolic execution engine
     SmallStepSymExec &symExec () {return *m_sem;}
     
-    CutPointGraph &getCpg (Function &F)
-    {return getAnalysis<CutPointGraph> (F);}
+    /// with --horn-sem-regions, adds the memory regions read by the
+    /// functions of the counterexample cex, given by its rules, and
+    /// encodes the module again. All functions if cex is empty.
+    /// Returns false if no region was added
+    bool refineRegions (const ExprVector &cex);
+    /// true if only some memory regions are tracked
+    bool tracksRegions () const { return m_regions != nullptr; }
+    
+    CutPointGraph &getCpg (Function &F) {return m_cache->cpg (F);}
     
   };
 }
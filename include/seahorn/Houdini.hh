@@ -3,16 +3,20 @@
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
+#include "llvm/ADT/BitVector.h"
 #include "seahorn/HornClauseDB.hh"
 #include "seahorn/HornifyModule.hh"
 #include "seahorn/GuessCandidates.hh"
 #include "seahorn/HornDbModel.hh"
+#include "seahorn/HornCheckpoint.hh"
 
 #include "ufo/Expr.hpp"
+#include "ufo/ExprHash.hpp"
 #include "ufo/Smt/Z3n.hpp"
 #include "ufo/Smt/EZ3.hh"
 #include "seahorn/HornClauseDBWto.hh"
 
+
 namespace seahorn
 {
   using namespace llvm;
@@ -30,29 +34,123 @@ namespace seahorn
     virtual const char* getPassName () const {return "Houdini";}
   };
 
+  /// The candidates of Houdini while it runs, as a table of the
+  /// lemmas of each relation and a bitset of the ones that are still
+  /// candidates. Weakening only clears bits. The lemmas are
+  /// instantiated once per application, from the candidate model, and
+  /// conjunctions are only built for the queries of the solvers
+  class HoudiniCandidates
+  {
+    struct Rel
+    {
+      /// lemmas that are still candidates
+      llvm::BitVector alive;
+      /// the lemmas at the arguments of each application
+      ExprHashMap<ExprVector> insts;
+    };
+    HornDbModel *m_model;
+    ExprHashMap<Rel> m_rels;
+
+    Rel &rel (Expr fdecl);
+  public:
+    HoudiniCandidates() : m_model(nullptr) {}
+    /// interns the candidates of model, on first use of each relation
+    void init(HornDbModel &model) {m_model = &model; m_rels.clear();}
+    bool active() const {return m_model != nullptr;}
+    /// writes the remaining lemmas back to the model
+    void update();
+    void clear() {m_model = nullptr; m_rels.clear();}
+
+    /// every lemma of the relation of app, at the arguments of app.
+    /// References are valid until the next application is interned
+    const ExprVector &lemmas(Expr app);
+    const llvm::BitVector &alive(Expr fdecl) {return rel(fdecl).alive;}
+    /// the conjunction of the remaining lemmas at app
+    Expr conj(Expr app);
+    /// drops the lemmas at the head app that are false in m, only the
+    /// first one unless batch, or the first remaining lemma if none is
+    /// false and guess. Returns the number of dropped lemmas
+    unsigned weaken(Expr app, ZModel<EZ3> &m, bool batch, bool guess = true);
+  };
+
   class Houdini
   {
   public:
-	  Houdini(HornifyModule &hm) : m_hm(hm)  {}
+	  Houdini(HornifyModule &hm) : m_hm(hm), m_bvarToArgMemo(hm.getExprFactory()),
+		  m_rounds(0), m_dropped(0),
+		  m_deadline(HornCheckpoint::clock::time_point::max()) {}
 	  virtual ~Houdini() {}
   private:
 	  HornifyModule &m_hm;
 	  HornDbModel m_candidate_model;
+	  /// memo of replacing bound variables by their constants
+	  DagVisitMemo m_bvarToArgMemo;
+	  /// number of weakenings and of lemmas they dropped. Published as
+	  /// HoudiniRounds and HoudiniDropped
+	  unsigned m_rounds;
+	  unsigned m_dropped;
+	  /// part of the checkpoints of the candidates, none if empty
+	  std::string m_checkpoint;
+	  HornCheckpoint::clock::time_point m_lastCheckpoint;
+	  /// of the sequential strategies, see setDeadline
+	  HornCheckpoint::clock::time_point m_deadline;
+	  /// the candidates of m_candidate_model while runHoudini runs
+	  HoudiniCandidates m_cands;
 
 
     public:
       HornifyModule& getHornifyModule() {return m_hm;}
       HornDbModel& getCandidateModel() {return m_candidate_model;}
+      HoudiniCandidates& getCandidates() {return m_cands;}
+      /// records a weakening that dropped the given number of lemmas
+      void addWeakening(unsigned dropped) {m_rounds++; m_dropped += dropped;}
+      /// writes the candidates to the checkpoint part as the
+      /// sequential strategies weaken them, see HornCheckpoint
+      void setCheckpoint(const std::string &part) {m_checkpoint = part;}
+      /// writes the candidates if a checkpoint is due
+      void checkpoint();
+      /// runHoudini gives up at t, e.g., at the end of a time slice
+      void setDeadline(HornCheckpoint::clock::time_point t) {m_deadline = t;}
+      bool expired() const {return HornCheckpoint::clock::now() >= m_deadline;}
 
     public:
-      void runHoudini(int config);
+      /// Weakens the candidates until they are inductive and adds them
+      /// to the database. Returns false, and adds nothing, if it gave
+      /// up at the deadline
+      bool runHoudini(int config);
+      /// Runs Houdini on each strongly connected component of the
+      /// call graph once the components it depends on have reached a
+      /// fixpoint. Ready components are shared by threads workers,
+      /// each with its own Z3 context. Requires a concurrent
+      /// ExprFactory
+      void runHoudiniParallel(unsigned threads);
 
       void guessCandidates(HornClauseDB &db);
+      /// Replaces the candidates of the relations that have an
+      /// invariant in the file written by saveInvariants. Relations
+      /// are matched by name, i.e., by function and cutpoint, and by
+      /// signature. Returns the number of replaced candidates
+      unsigned loadCandidates(const std::string &fname);
+      /// Writes the candidates of all relations to fname
+      bool saveInvariants(const std::string &fname);
 
       //Functions for generating Positive Examples
-      void generatePositiveWitness(std::map<Expr, ExprVector> &relationToPositiveStateMap);
-      void getReachableStates(std::map<Expr, ExprVector> &relationToPositiveStateMap, Expr from_pred, Expr from_pred_state);
-      void getRuleHeadState(std::map<Expr, ExprVector> &relationToPositiveStateMap, HornRule r, Expr from_pred_state);
+      /// Samples reachable states of the relations by unrolling the
+      /// rules forward from the facts at most rounds times. Lemmas of
+      /// the candidates that are false in a sampled state are dropped
+      /// before any inductiveness check
+      void generatePositiveWitness(std::map<Expr, ExprVector> &relationToPositiveStateMap, unsigned rounds);
+      /// One round of generatePositiveWitness. Returns true if a new
+      /// state was found
+      bool getReachableStates(std::map<Expr, ExprVector> &relationToPositiveStateMap, unsigned &dropped);
+      /// Samples a state of the head of r from the newest states of
+      /// its body. Returns true if the state is new
+      bool getRuleHeadState(std::map<Expr, ExprVector> &relationToPositiveStateMap, HornRule r, unsigned &dropped);
+      /// Drops the lemmas of the candidates that are false in some
+      /// sampled state of their relation. The lemmas of a relation are
+      /// compiled once and evaluated on all of its states together.
+      /// Returns the number of dropped lemmas
+      unsigned filterSampledStates(const std::map<Expr, ExprVector> &relationToPositiveStateMap);
 
       //Add Houdini invs to default solver
       void addInvarCandsToProgramSolver();
@@ -69,17 +167,21 @@ namespace seahorn
 		  m_houdini(houdini), m_db_wto(db_wto), m_workList(workList) {}
 	  virtual void run() = 0;
 	  virtual bool validateRule(HornRule r, ZSolver<EZ3> &solver) = 0;
-	  void weakenRuleHeadCand(HornRule r, ZModel<EZ3> m);
+	  /// weakens the head candidate of r by m, the model of the check in
+	  /// the current scope of solver under assumptions, and by further
+	  /// models of that check with --horn-houdini-batch
+	  void weakenRuleHeadCand(HornRule r, ZSolver<EZ3> &solver, ZModel<EZ3> m,
+	                          const ExprVector &assumptions = ExprVector());
 	  void addUsedRulesBackToWorkList(HornClauseDBWto &db_wto, std::list<HornRule> &workList, HornRule r);
   };
 
   class Houdini_Naive : public HoudiniContext
   {
   private:
-	  ZSolver<EZ3> m_solver;
+	  ZSolverPool<EZ3>::Lease m_solver;
   public:
 	  Houdini_Naive(Houdini& houdini, HornClauseDBWto &db_wto, std::list<HornRule> &workList) :
-		  HoudiniContext(houdini, db_wto, workList), m_solver(houdini.getHornifyModule().getZContext()) {}
+		  HoudiniContext(houdini, db_wto, workList), m_solver(houdini.getHornifyModule().getZContext().solverPool().acquire()) {}
 	  void run();
 	  bool validateRule(HornRule r, ZSolver<EZ3> &solver);
   };
@@ -87,25 +189,48 @@ namespace seahorn
   class Houdini_Each_Solver_Per_Rule : public HoudiniContext
   {
   private:
-  	  std::map<HornRule, ZSolver<EZ3>> m_ruleToSolverMap;
+  	  std::map<HornRule, ZSolverPool<EZ3>::Lease> m_ruleToSolverMap;
   public:
   	  Houdini_Each_Solver_Per_Rule(Houdini& houdini, HornClauseDBWto &db_wto, std::list<HornRule> &workList) :
   		  HoudiniContext(houdini, db_wto, workList), m_ruleToSolverMap(assignEachRuleASolver()){}
   	  void run();
   	  bool validateRule(HornRule r, ZSolver<EZ3> &solver);
-  	  std::map<HornRule, ZSolver<EZ3>> assignEachRuleASolver();
+  	  std::map<HornRule, ZSolverPool<EZ3>::Lease> assignEachRuleASolver();
   };
 
   class Houdini_Each_Solver_Per_Relation : public HoudiniContext
   {
   private:
-	  std::map<Expr, ZSolver<EZ3>> m_relationToSolverMap;
+	  std::map<Expr, ZSolverPool<EZ3>::Lease> m_relationToSolverMap;
   public:
 	  Houdini_Each_Solver_Per_Relation(Houdini& houdini, HornClauseDBWto &db_wto, std::list<HornRule> &workList) :
 		  HoudiniContext(houdini, db_wto, workList), m_relationToSolverMap(assignEachRelationASolver()){}
 	  void run();
 	  bool validateRule(HornRule r, ZSolver<EZ3> &solver);
-	  std::map<Expr, ZSolver<EZ3>> assignEachRelationASolver();
+	  std::map<Expr, ZSolverPool<EZ3>::Lease> assignEachRelationASolver();
+  };
+
+  /// Every lemma of a candidate is guarded by an indicator literal
+  /// that holds while the lemma is a candidate. Each rule has a
+  /// solver in which its transition relation and the guarded lemmas
+  /// are asserted once. Validation is a check under the indicators
+  /// and weakening only turns indicators off
+  class Houdini_Assumptions : public HoudiniContext
+  {
+  private:
+	  /// indicator literal of each lemma of each relation
+	  std::map<Expr, ExprVector> m_indicators;
+	  /// relations of the head and of the body of each rule
+	  std::map<HornRule, ExprVector> m_ruleRels;
+	  std::map<HornRule, ZSolverPool<EZ3>::Lease> m_ruleToSolverMap;
+
+	  void assignEachRuleASolver();
+	  void addAssumptions(Expr rel, ExprVector &assumptions);
+  public:
+	  Houdini_Assumptions(Houdini& houdini, HornClauseDBWto &db_wto, std::list<HornRule> &workList) :
+		  HoudiniContext(houdini, db_wto, workList) {assignEachRuleASolver();}
+	  void run();
+	  bool validateRule(HornRule r, ZSolver<EZ3> &solver);
   };
 }
 
@@ -0,0 +1,98 @@
+#ifndef __KINDUCTION__HH_
+#define __KINDUCTION__HH_
+
+#include "boost/logic/tribool.hpp"
+
+#include "ufo/Expr.hpp"
+#include "ufo/Smt/EZ3.hh"
+
+#include "seahorn/Analysis/CutPointGraph.hh"
+#include "seahorn/SymExec.hh"
+#include "seahorn/Bmc.hh"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// k-induction over the cutpoint paths of a function that end in
+  /// a bad cutpoint, e.g., the return of main.
+  ///
+  /// The base case at depth k checks the paths with k edges from the
+  /// entry. The step case at depth k checks the paths with k edges
+  /// from any cutpoint, starting in any state that satisfies the
+  /// auxiliary invariants. If no base case up to k-1 and no step
+  /// case at k is feasible, the bad cutpoint is unreachable. Both
+  /// cases are explored depth-first by their own incremental
+  /// BmcEngine, so a prefix is encoded once for all its extensions
+  /// and infeasible prefixes are not extended.
+  ///
+  /// The engines live across the depths. The first cutpoint, and the
+  /// invariants of the step case at it, stay asserted, and every
+  /// depth is checked in its own scope. The feasibility of every
+  /// prefix that was solved is kept, so a depth only solves the
+  /// prefixes of its new frame and the paths to the bad cutpoint
+  class KInduction
+  {
+    /// an engine whose trace starts at a fixed cutpoint, with the
+    /// prefixes of the current trace that it solved so far
+    struct Unrolling
+    {
+      BmcEngine bmc;
+      /// cutpoints of the trace after the first one
+      std::vector<const CutPoint*> path;
+      /// feasibility of the solved prefixes, by path
+      std::map<std::vector<const CutPoint*>, bool> feasible;
+      Unrolling (SmallStepSymExec &sem, ufo::EZ3 &zctx) : bmc (sem, zctx) {}
+    };
+
+    SmallStepSymExec &m_sem;
+    ufo::EZ3 &m_zctx;
+    const CutPoint &m_entry;
+    const CutPoint &m_bad;
+
+    /// auxiliary invariants, over the registers of each cutpoint
+    std::map<const CutPoint*, ExprVector> m_invs;
+
+    /// depth of the last step case
+    unsigned m_depth;
+    /// called with k once every base case up to k is infeasible
+    std::function<void (unsigned)> m_onBase;
+
+    /// assumes the invariants of the last cutpoint of bmc
+    void strengthen (BmcEngine &bmc, const CutPoint &cp);
+
+    /// true if a path with left more edges from the last cutpoint of
+    /// the trace of u, cp, to the bad cutpoint is feasible
+    boost::tribool search (Unrolling &u, const CutPoint &cp, unsigned left,
+                           bool useInvs);
+
+  public:
+    KInduction (SmallStepSymExec &sem, ufo::EZ3 &zctx,
+                const CutPoint &entry, const CutPoint &bad) :
+      m_sem (sem), m_zctx (zctx), m_entry (entry), m_bad (bad), m_depth (0) {}
+
+    /// inv holds at every reachable state of cp. It is over the
+    /// registers live at cp, e.g., a lemma of Houdini or Crab
+    void addInvariant (const CutPoint &cp, Expr inv);
+
+    /// true if a path from the entry to the bad cutpoint is feasible,
+    /// false if the step case succeeds at a depth of at most maxK.
+    /// The base cases below from are known to be infeasible, e.g.,
+    /// from a checkpoint: they are not checked, and neither are the
+    /// step cases below from. Indeterminate once globalCancelToken
+    /// is cancelled
+    boost::tribool run (unsigned maxK, unsigned from = 1);
+    /// calls f with k whenever every base case up to k is infeasible
+    void onBase (std::function<void (unsigned)> f) { m_onBase = f; }
+
+    /// depth reached by run ()
+    unsigned depth () const { return m_depth; }
+  };
+}
+
+#endif
@@ -54,6 +54,7 @@ namespace seahorn
     {
       return m_edgeDefs[i];
     }
+    unsigned numEdgeDefs () const { return m_edgeDefs.size (); }
     
   };
   
@@ -84,6 +85,8 @@ namespace seahorn
     void patchArgsAndGlobals ();
     /// -- compute global live info by propagating local live info
     void globalPass ();
+    /// -- globalPass over bit-vectors of densely numbered symbols
+    void globalPassDense ();
      
   public:
     LiveSymbols (const Function &F, ExprFactory &efac, 
@@ -17,22 +17,26 @@ namespace seahorn
     struct AllocInfo
     {
       unsigned id;
-      unsigned start;
-      unsigned end;
+      uint64_t start;
+      uint64_t end;
     };
     
+    /// allocations in the order they were made, which is also the
+    /// order of their start addresses
     std::vector<AllocInfo> m_allocs;
     
     const DataLayout &m_dl;
     const TargetLibraryInfo &m_tli;
     
     // -- start byte of external memory
-    unsigned m_extMemStart;
+    uint64_t m_extMemStart;
     // -- end byte of external memory
-    unsigned m_extMemEnd;
+    uint64_t m_extMemEnd;
 
     // -- start of internally allocated memory
-    unsigned m_intMemStart;
+    uint64_t m_intMemStart;
+    // -- true if an allocation did not fit in the address space
+    bool m_overflow;
 
     BmcTrace &m_trace;
     ufo::ZModel<ufo::EZ3> m_model;
@@ -42,10 +46,12 @@ namespace seahorn
     MemSimulator (BmcTrace &bmc_trace,
                   const DataLayout &dl, const TargetLibraryInfo &tli) :
       m_dl (dl), m_tli (tli),
-      m_intMemStart (10 * 1024 * 1024),
+      m_intMemStart (10 * 1024 * 1024), m_overflow (false),
       m_trace (bmc_trace), m_model (zctx()) {}
     
-    const AllocInfo &alloc (unsigned sz);
+    const AllocInfo &alloc (uint64_t sz);
+    /// the allocation that contains addr, or nullptr
+    const AllocInfo *findAlloc (uint64_t addr) const;
     
     BmcTrace &trace () {return m_trace;}
     
@@ -26,6 +26,7 @@ DM-0002198
 namespace seahorn
 {
   llvm::Pass* createMarkInternalInlinePass ();
+  llvm::Pass* createMarkCostInlinePass ();
   llvm::Pass* createNondetInitPass ();
   llvm::Pass* createDeadNondetElimPass ();
   llvm::Pass* createDummyExitBlockPass ();
@@ -34,11 +35,15 @@ namespace seahorn
   llvm::Pass* createPromoteMemoryToRegisterPass ();
 
   llvm::Pass* createLoadCrabPass ();
+  llvm::Pass* createCrabDischargePass ();
   llvm::Pass* createShadowMemDsaPass (); // llvm dsa
   llvm::Pass* createShadowMemSeaDsaPass (); // seahorn dsa
   llvm::Pass* createStripShadowMemPass ();
+  llvm::Pass* createShadowMemOptPass ();
 
   llvm::Pass* createCutLoopsPass ();
+  llvm::Pass* createUnrollLoopsPass ();
+  llvm::Pass* createAccelerateLoopsPass ();
   llvm::Pass* createMarkFnEntryPass ();
 
   llvm::Pass* createPromoteMallocPass ();
@@ -48,22 +53,34 @@ namespace seahorn
   llvm::Pass* createStripUselessDeclarationsPass ();
 
   llvm::Pass* createPromoteBoolLoadsPass ();
+  llvm::Pass* createPromoteSmallArraysPass ();
 
   llvm::Pass* createEnumVerifierCallsPass ();
+  llvm::Pass* createSlicePropertiesPass (unsigned groups, unsigned group);
+  llvm::Pass* createSliceProgramPass ();
 
   llvm::Pass* createCanReadUndefPass ();
 
   llvm::Pass *createApiAnalysisPass(std::string &config);
 
   llvm::Pass* createBmcPass (llvm::raw_ostream* out, bool solve);
+  /// writes the predicted size of the Horn encoding of every
+  /// --horn-step option as JSON to file, or to the standard output if
+  /// file is "-"
+  llvm::Pass* createHornEstimatePass (const std::string &file);
 
   llvm::Pass* createProfilerPass();
+  /// writes the features of the program used to pick engines as
+  /// JSON to file, or to the standard output if file is "-"
+  llvm::Pass* createFeaturesPass (const std::string &file);
   llvm::Pass* createCFGPrinterPass ();
   llvm::Pass* createCFGOnlyPrinterPass ();
   llvm::Pass* createCFGViewerPass ();
   llvm::Pass* createCFGOnlyViewerPass ();
 
   llvm::Pass* createKleeInternalizePass ();
+  /// calls the coverage hook of sea-rt/fuzz.cpp at every basic block
+  llvm::Pass* createFuzzCoveragePass ();
 
   llvm::Pass* createWrapMemPass ();  
   llvm::Pass* createRenameNondetPass();
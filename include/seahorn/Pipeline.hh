@@ -0,0 +1,44 @@
+#ifndef _SEAHORN_PIPELINE__HH_
+#define _SEAHORN_PIPELINE__HH_
+
+/**
+ * The pre-processing and optimization stages of the front end as
+ * pass pipelines. They are shared by seapp, which runs them as a
+ * separate stage, and by seahorn --horn-pp, which runs them in the
+ * same process as the Horn encoding.
+ */
+#include <functional>
+
+namespace llvm
+{
+  class PassManagerBase;
+  class ModulePass;
+}
+
+namespace seahorn
+{
+  /// Adds the passes that seapp runs by default (including mixed
+  /// semantics and loop cutting when requested). They are configured
+  /// by the seapp command line options.
+  void addPreProcessingPasses (llvm::PassManagerBase &pass_manager);
+
+  /// Adds the optimizations of seaopt -O<level> that are safe for
+  /// verification
+  void addOptimizationPasses (llvm::PassManagerBase &pass_manager,
+                              unsigned level);
+
+  /// true if all functions are inlined (--horn-inline-all)
+  bool isInlineAll ();
+
+  /// adds passes to a pass manager
+  typedef std::function<void (llvm::PassManagerBase&)> PassesFn;
+
+  /// A pass that splits the module into at most threads partitions of
+  /// call graph components, runs the passes of addPasses on every
+  /// partition in parallel, each in its own LLVMContext, and links
+  /// the partitions back. The passes must be local to the functions
+  /// and keep their signatures (--pp-threads)
+  llvm::ModulePass *createSplitModulePass (unsigned threads, PassesFn addPasses);
+}
+
+#endif /* _SEAHORN_PIPELINE__HH_ */
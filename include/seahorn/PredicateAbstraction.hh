@@ -3,6 +3,7 @@
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
+#include "boost/logic/tribool.hpp"
 #include "seahorn/HornClauseDB.hh"
 #include "seahorn/HornifyModule.hh"
 #include "seahorn/HornDbModel.hh"
@@ -14,6 +15,9 @@
 #include "ufo/Smt/EZ3.hh"
 #include "seahorn/HornClauseDBWto.hh"
 
+#include <memory>
+#include <mutex>
+
 namespace seahorn
 {
 	using namespace llvm;
@@ -31,7 +35,7 @@ namespace seahorn
 		virtual ~PredAbsHornModelConverter() {}
 		bool convert (HornDbModel &in, HornDbModel &out);
 
-		void addRelToBoolToTerm(Expr rel, ExprMap &boolToTermMap) {m_relToBoolToTermMap.insert(std::make_pair(rel, boolToTermMap));}
+		void addRelToBoolToTerm(Expr rel, ExprMap &boolToTermMap) {m_relToBoolToTermMap[rel] = boolToTermMap;}
 		void setNewToOldPredMap(std::map<Expr, Expr> &newToOldMap) {m_newToOldPredMap = newToOldMap;}
 		void setAbsDB(HornClauseDB &db) {m_abs_db = &db;}
 	};
@@ -42,22 +46,71 @@ namespace seahorn
 	    std::map<Expr, Expr> m_oldToNewPredMap;
 	    std::map<Expr, Expr> m_newToOldPredMap;
 	    std::map<Expr, ExprVector> m_currentCandidates;
+	    /// bound variables of the candidate of each relation
+	    std::map<Expr, ExprVector> m_candBvars;
+	    /// rules of db and the ids of their abstractions in new_DB
+	    std::vector<const HornRule*> m_rules;
+	    std::vector<HornClauseDB::RuleId> m_absRuleIds;
+	    /// number of refinements so far. Names the refined relations
+	    unsigned m_refinements;
 
 	    HornifyModule& m_hm;
 
+	    /// with --horn-pabs-allsat, the abstract constraint of each
+	    /// rule over canonical indicators, by its constraint over
+	    /// the same indicators. Kept across refinements
+	    std::map<Expr, Expr> m_allSatCache;
+	    std::mutex m_allSatLock;
+	    /// solver contexts of the threads of generateAbstractRules
+	    std::unique_ptr<ufo::ZWorkerContexts<ufo::EZ3> > m_contexts;
+
+	    /// true if the candidate of rel is just 'true'. Its abstract
+	    /// relation keeps the arguments of rel
+	    bool isTrivialCand(Expr rel) const;
+
+	    /// generateAbstractRule, followed by allSatAbstractRule with
+	    /// --horn-pabs-allsat
+	    HornRule abstractRule(const HornRule &r, HornClauseDB &db);
+	    /// absRule, built by generateAbstractRule, with its constraint
+	    /// replaced by the disjunction of the assignments of the
+	    /// indicators of its predicates that satisfy it. They are
+	    /// enumerated on one solver, each blocked once found. absRule
+	    /// if an application keeps non-Boolean arguments or the
+	    /// enumeration gives up
+	    HornRule allSatAbstractRule(const HornRule &absRule, ufo::EZ3 &z3);
+
 	public:
-	    PredicateAbstractionAnalysis(HornifyModule &hm) : m_hm(hm) {}
+	    PredicateAbstractionAnalysis(HornifyModule &hm) :
+	      m_refinements(0), m_hm(hm),
+	      m_contexts(new ufo::ZWorkerContexts<ufo::EZ3>(hm.getExprFactory())) {}
 	    ~PredicateAbstractionAnalysis() {}
 
 		void guessCandidate(HornClauseDB &db);
 
-		Expr applyArgsToBvars(Expr cand, Expr fapp, std::map<Expr, ExprVector> currentCandidates);
-		ExprMap getBvarsToArgsMap(Expr fapp, std::map<Expr, ExprVector> currentCandidates);
+		Expr applyArgsToBvars(Expr cand, Expr fapp) const;
+		/// requires generateAbstractRelations
+		ExprMap getBvarsToArgsMap(Expr fapp) const;
 
 		void generateAbstractDB(HornClauseDB &db, HornClauseDB &new_DB, PredAbsHornModelConverter &converter);
 		void generateAbstractRelations(HornClauseDB &db, HornClauseDB &new_DB, PredAbsHornModelConverter &converter);
+		/// abstracts rel over its current candidates
+		void generateAbstractRelation(Expr rel, HornClauseDB &new_DB, PredAbsHornModelConverter &converter);
+		/// Abstracts the rules of db on --horn-threads threads if the
+		/// expression factory is concurrent. new_DB gets them in the
+		/// order of db
 		void generateAbstractRules(HornClauseDB &db, HornClauseDB &new_DB, PredAbsHornModelConverter &converter);
+		/// only reads the maps built by generateAbstractRelations
+		HornRule generateAbstractRule(const HornRule &r, HornClauseDB &db) const;
 		void generateAbstractQueries(HornClauseDB &db, HornClauseDB &new_DB);
+
+		/// Adds preds to the candidates of the relations of db and
+		/// re-abstracts, in new_DB, only the relations that got a new
+		/// predicate and the rules they appear in. Returns false if no
+		/// predicate is new
+		bool refine(HornClauseDB &db, HornClauseDB &new_DB, PredAbsHornModelConverter &converter,
+		            const std::map<Expr, ExprVector> &preds);
+		/// relation of db abstracted by absRel, null if none
+		Expr getOrigRel(Expr absRel) const;
 	};
 
 	class PredicateAbstraction : public llvm::ModulePass
@@ -77,6 +130,13 @@ namespace seahorn
 	    void printInvars(Function &F, HornDbModel &origModel);
 	    void printInvars(Module &M, HornDbModel &origModel);
 	private:
+	    /// Replays the counterexample of the abstraction with BMC over
+	    /// the cutpoints of main. Returns true if it is feasible. If it
+	    /// is not, preds gets the atoms of the unsat core over the live
+	    /// variables of each cutpoint
+	    boost::tribool checkCex(Module &M, PredicateAbstractionAnalysis &pabs,
+	                            std::map<Expr, ExprVector> &preds);
+
 	    std::unique_ptr<ufo::ZFixedPoint <ufo::EZ3> >  m_fp;
 	};
 }
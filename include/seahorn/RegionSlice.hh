@@ -0,0 +1,67 @@
+#ifndef __REGION_SLICE__HH_
+#define __REGION_SLICE__HH_
+/// Memory regions that the assertions of a module depend on
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/IR/Module.h"
+
+#include <map>
+#include <set>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// The shadow memory regions, by the ids of ShadowMemSeaDsa, in
+  /// the backward slice of the assertions. Values the branches and
+  /// the verifier.* calls depend on are in the slice, and so are the
+  /// regions they are loaded from and the values stored in those
+  /// regions.
+  ///
+  /// The region of a callee that corresponds to a region of a caller,
+  /// by the index of the shadow.mem.arg.* and shadow.mem.in/out calls,
+  /// is in the same class, so that a function and its callers agree
+  /// on the regions of its summary
+  class RegionSlice
+  {
+    /// union-find over the region ids
+    std::map<int64_t, int64_t> m_parent;
+    /// stores to the regions of every class
+    std::map<int64_t, std::vector<const Instruction*> > m_stores;
+    /// classes in the slice
+    std::set<int64_t> m_tracked;
+    /// values in the slice
+    DenseSet<const Value*> m_values;
+    /// return instructions and call sites of every function
+    DenseMap<const Function*, std::vector<const ReturnInst*> > m_rets;
+    DenseMap<const Function*, std::vector<const CallInst*> > m_calls;
+
+    int64_t find (int64_t id) const;
+    void unite (int64_t a, int64_t b);
+    /// adds the class of id and closes the slice
+    void addRegion (int64_t id, std::vector<const Value*> &wl);
+    /// computes the slice of the values in wl
+    void close (std::vector<const Value*> &wl);
+
+  public:
+    RegionSlice (const Module &M);
+
+    /// the region of a shadow memory value, -1 if v is none
+    static int64_t regionOf (const Value &v);
+
+    /// true if region id is in the slice. Only reads, so that
+    /// threads encoding functions can ask concurrently
+    bool isTracked (int64_t id) const { return m_tracked.count (find (id)) > 0; }
+    /// number of classes in the slice, and in the module
+    unsigned numTracked () const { return m_tracked.size (); }
+    unsigned numRegions () const;
+
+    /// adds the regions read by fns. Returns false if they are all
+    /// in the slice already
+    bool refine (const std::set<const Function*> &fns);
+  };
+}
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef __SUMMARY_PACK__HH_
+#define __SUMMARY_PACK__HH_
+/// Precompiled Horn encodings of library functions
+
+#include "seahorn/HornClauseDB.hh"
+
+#include "llvm/ADT/StringRef.h"
+
+#include "ufo/Expr.hpp"
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// The rules of the functions of a module, e.g., the models of
+  /// libc and of the runtime, with the summaries proven for them,
+  /// saved in the binary Expr format. A module that calls one of
+  /// the functions links its rules by name instead of encoding its
+  /// body again.
+  ///
+  /// The relations of a pack are named by strings. Linking maps the
+  /// summary of the function, and of the functions it calls, to the
+  /// summaries of the module, which must have the same signatures
+  class SummaryPack
+  {
+    struct Entry
+    {
+      Expr sumPred;
+      /// the summaries of the callees, by name
+      std::vector<std::pair<std::string, Expr> > callees;
+      /// the relations of the blocks of the function
+      ExprVector rels;
+      std::vector<HornRule> rules;
+      /// proven summary, as an application of sumPred and a lemma
+      /// over its arguments. Null if none
+      Expr sumApp;
+      Expr lemma;
+    };
+
+    ExprFactory &m_efac;
+    std::map<std::string, Entry> m_fns;
+
+  public:
+    /// of the format, and of the encoding it stores
+    static const unsigned version = 1;
+
+    SummaryPack (ExprFactory &efac) : m_efac (efac) {}
+
+    bool empty () const { return m_fns.empty (); }
+    unsigned size () const { return m_fns.size (); }
+    bool has (llvm::StringRef fn) const { return m_fns.count (fn.str ()) > 0; }
+
+    /// adds the rules of db with the relations rels of function fn, or
+    /// its summary sumPred, in the head. Facts about sumPred alone are
+    /// not added, the module that links fn declares them again. The
+    /// lemma, if not null, is a proven summary of fn over the
+    /// arguments of sumApp
+    void add (llvm::StringRef fn, Expr sumPred, const ExprVector &rels,
+              const HornClauseDB &db, Expr sumApp, Expr lemma);
+
+    bool save (const std::string &fname) const;
+    /// adds the functions of the pack in fname. A function already in
+    /// the pack is kept. Returns false if fname is not a pack of this
+    /// version
+    bool load (const std::string &fname);
+
+    /// adds the rules of fn to db, with its summary mapped to sumPred
+    /// and the summaries of its callees mapped by summary (). Returns
+    /// false, and leaves db unchanged, if the signatures do not match
+    bool link (llvm::StringRef fn, Expr sumPred,
+               std::function<Expr (llvm::StringRef)> summary,
+               HornClauseDB &db) const;
+  };
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef __GZIP_STREAM_HH_
+#define __GZIP_STREAM_HH_
+
+#include "llvm/Support/raw_ostream.h"
+
+#include <memory>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// A stream that gzip-compresses what is written to it into another
+  /// stream. Without zlib the data is written uncompressed
+  class raw_gzip_ostream : public raw_ostream
+  {
+    struct State;
+
+    raw_ostream &m_out;
+    std::unique_ptr<State> m_state;
+    /// bytes written before compression
+    uint64_t m_pos;
+
+    void write_impl (const char *ptr, size_t size) override;
+    uint64_t current_pos () const override { return m_pos; }
+
+  public:
+    raw_gzip_ostream (raw_ostream &out, int level = 6);
+    ~raw_gzip_ostream ();
+
+    /// flushes and writes the gzip trailer. Nothing can be written
+    /// afterwards
+    void close ();
+
+    /// true if output is compressed, i.e., zlib is available
+    static bool compresses ();
+  };
+}
+
+#endif
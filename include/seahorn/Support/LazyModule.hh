@@ -0,0 +1,22 @@
+#ifndef __LAZY_MODULE_HH_
+#define __LAZY_MODULE_HH_
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/SourceMgr.h"
+
+#include <memory>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// Reads the module in filename, like parseIRFile. With --lazy-load
+  /// the bitcode is read lazily and only the bodies of the functions
+  /// reachable from --entry are parsed: the other functions become
+  /// declarations. Null on error, described in err
+  std::unique_ptr<Module> loadModule (StringRef filename, SMDiagnostic &err,
+                                      LLVMContext &context);
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef __PASS_PROFILER_HH_
+#define __PASS_PROFILER_HH_
+
+#include "llvm/PassManager.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// A pass manager that, with --profile-json, measures the wall and
+  /// CPU time of every pass added to it. The time of a pass includes
+  /// the analyses that the pass manager schedules for it. Without
+  /// --profile-json it is a plain PassManager
+  class ProfilingPassManager : public llvm::PassManager
+  {
+    std::string m_pipeline;
+
+  public:
+    /// pipeline names the passes of this manager in the profile
+    ProfilingPassManager (StringRef pipeline);
+
+    void add (Pass *P) override;
+  };
+
+  /// Writes the statistics, the phases of ScopedStats and the times
+  /// of the passes as JSON to the file of --profile-json, if any
+  void writeProfile ();
+}
+
+#endif
@@ -0,0 +1,233 @@
+#ifndef __PERSISTENT_MAP_HH_
+#define __PERSISTENT_MAP_HH_
+/// A persistent hash map: a hash array mapped trie whose nodes are
+/// immutable and shared between copies. Copying a map is O(1) and an
+/// insertion copies only the path from the root to the modified leaf.
+
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace seahorn
+{
+  template <typename K, typename V,
+            typename Hash = std::hash<K>, typename Eq = std::equal_to<K> >
+  class PersistentMap
+  {
+  public:
+    typedef std::pair<K,V> value_type;
+
+  private:
+    static const unsigned Bits = 5;
+    static const unsigned Width = 1u << Bits;
+    static const unsigned HashBits = sizeof (std::size_t) * 8;
+
+    struct Node;
+    typedef std::shared_ptr<const Node> NodePtr;
+
+    /// An internal node has a child for every bit set in bitmap. A
+    /// leaf holds the entries of a single hash value
+    struct Node
+    {
+      uint32_t bitmap;
+      std::vector<NodePtr> kids;
+
+      std::size_t hash;
+      std::vector<value_type> entries;
+
+      Node () : bitmap (0), hash (0) {}
+      bool isLeaf () const { return !entries.empty (); }
+      unsigned pos (uint32_t bit) const { return popcount (bitmap & (bit - 1)); }
+    };
+
+    NodePtr m_root;
+    std::size_t m_size;
+
+    static unsigned popcount (uint32_t v)
+    {
+      v = v - ((v >> 1) & 0x55555555);
+      v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+      return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+    }
+
+    /// hashes of pointers have their low bits clear. Mix them so that
+    /// the first levels of the trie branch
+    static std::size_t hashOf (const K &k)
+    {
+      uint64_t h = Hash () (k);
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      h *= 0xc4ceb9fe1a85ec53ULL;
+      h ^= h >> 33;
+      return static_cast<std::size_t> (h);
+    }
+
+    static uint32_t bitOf (std::size_t h, unsigned shift)
+    { return 1u << ((h >> shift) & (Width - 1)); }
+
+    static NodePtr mkLeaf (std::size_t h, const value_type &kv)
+    {
+      auto n = std::make_shared<Node> ();
+      n->hash = h;
+      n->entries.push_back (kv);
+      return n;
+    }
+
+    /// n with kv inserted. Sets added if the key is new
+    static NodePtr insert (const NodePtr &n, unsigned shift, std::size_t h,
+                           const value_type &kv, bool &added)
+    {
+      if (!n) { added = true; return mkLeaf (h, kv); }
+
+      if (n->isLeaf ())
+      {
+        if (n->hash == h)
+        {
+          auto res = std::make_shared<Node> (*n);
+          for (value_type &e : res->entries)
+            if (Eq () (e.first, kv.first)) { e.second = kv.second; return res; }
+          res->entries.push_back (kv);
+          added = true;
+          return res;
+        }
+
+        // -- split the leaf, the hashes differ in a later level
+        assert (shift < HashBits);
+        auto res = std::make_shared<Node> ();
+        res->bitmap = bitOf (n->hash, shift);
+        res->kids.push_back (n);
+        return insert (res, shift, h, kv, added);
+      }
+
+      auto res = std::make_shared<Node> (*n);
+      uint32_t bit = bitOf (h, shift);
+      unsigned p = n->pos (bit);
+      if (n->bitmap & bit)
+        res->kids [p] = insert (n->kids [p], shift + Bits, h, kv, added);
+      else
+      {
+        res->bitmap |= bit;
+        res->kids.insert (res->kids.begin () + p, mkLeaf (h, kv));
+        added = true;
+      }
+      return res;
+    }
+
+  public:
+    /// iterates over the entries in no particular order
+    class const_iterator
+    {
+      /// internal nodes from the root and the next kid to visit
+      std::vector<std::pair<const Node*, unsigned> > m_stack;
+      const Node *m_leaf;
+      unsigned m_idx;
+
+      /// moves to the first entry at or after the top of the stack
+      void descend (const Node *n)
+      {
+        while (n && !n->isLeaf ())
+        {
+          m_stack.push_back (std::make_pair (n, 1u));
+          n = n->kids [0].get ();
+        }
+        m_leaf = n;
+        m_idx = 0;
+      }
+
+      void next ()
+      {
+        while (!m_stack.empty ())
+        {
+          auto &top = m_stack.back ();
+          if (top.second < top.first->kids.size ())
+          {
+            const Node *n = top.first->kids [top.second++].get ();
+            descend (n);
+            return;
+          }
+          m_stack.pop_back ();
+        }
+        m_leaf = nullptr;
+      }
+
+    public:
+      typedef std::forward_iterator_tag iterator_category;
+      typedef typename PersistentMap::value_type value_type;
+      typedef std::ptrdiff_t difference_type;
+      typedef const value_type* pointer;
+      typedef const value_type& reference;
+
+      const_iterator () : m_leaf (nullptr), m_idx (0) {}
+      explicit const_iterator (const Node *root) : m_leaf (nullptr), m_idx (0)
+      { descend (root); }
+
+      reference operator* () const { return m_leaf->entries [m_idx]; }
+      pointer operator-> () const { return &m_leaf->entries [m_idx]; }
+
+      const_iterator &operator++ ()
+      {
+        if (++m_idx >= m_leaf->entries.size ()) next ();
+        return *this;
+      }
+      const_iterator operator++ (int) { const_iterator r = *this; ++*this; return r; }
+
+      bool operator== (const const_iterator &o) const
+      { return m_leaf == o.m_leaf && (!m_leaf || m_idx == o.m_idx); }
+      bool operator!= (const const_iterator &o) const { return !(*this == o); }
+    };
+    typedef const_iterator iterator;
+
+    PersistentMap () : m_size (0) {}
+
+    std::size_t size () const { return m_size; }
+    bool empty () const { return m_size == 0; }
+    void clear () { m_root.reset (); m_size = 0; }
+    void swap (PersistentMap &o)
+    {
+      std::swap (m_root, o.m_root);
+      std::swap (m_size, o.m_size);
+    }
+
+    /// the value of k, null if there is none. Valid until the map is
+    /// modified or destroyed
+    const V *find (const K &k) const
+    {
+      std::size_t h = hashOf (k);
+      const Node *n = m_root.get ();
+      for (unsigned shift = 0; n; shift += Bits)
+      {
+        if (n->isLeaf ())
+        {
+          if (n->hash != h) return nullptr;
+          for (const value_type &e : n->entries)
+            if (Eq () (e.first, k)) return &e.second;
+          return nullptr;
+        }
+
+        uint32_t bit = bitOf (h, shift);
+        if (!(n->bitmap & bit)) return nullptr;
+        n = n->kids [n->pos (bit)].get ();
+      }
+      return nullptr;
+    }
+
+    std::size_t count (const K &k) const { return find (k) ? 1 : 0; }
+
+    /// maps k to v, replacing the old value of k if any
+    void insert (const K &k, const V &v)
+    {
+      bool added = false;
+      m_root = insert (m_root, 0, hashOf (k), value_type (k, v), added);
+      if (added) ++m_size;
+    }
+
+    const_iterator begin () const { return const_iterator (m_root.get ()); }
+    const_iterator end () const { return const_iterator (); }
+  };
+}
+
+#endif
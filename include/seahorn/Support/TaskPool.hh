@@ -0,0 +1,122 @@
+#ifndef __TASK_POOL_HH_
+#define __TASK_POOL_HH_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace seahorn
+{
+  /// Cancellation shared by the tasks of one or more pools. A token
+  /// is cancelled explicitly, or by its deadline once a pool that
+  /// uses it notices it. Tasks poll cancelled () between steps and
+  /// register a Hook around calls that do not poll, e.g., a Z3
+  /// query, so that cancel interrupts them
+  class CancelToken
+  {
+  public:
+    typedef std::chrono::steady_clock clock;
+
+  private:
+    std::atomic<bool> m_cancelled;
+    /// clock::time_point::max () if none
+    std::atomic<clock::rep> m_deadline;
+    std::mutex m_lock;
+    std::map<unsigned, std::function<void ()> > m_hooks;
+    unsigned m_nextHook;
+
+  public:
+    CancelToken ();
+    CancelToken (const CancelToken &) = delete;
+
+    /// cancels the token ms milliseconds from now. 0 means never
+    void setTimeout (unsigned ms);
+    void setDeadline (clock::time_point t);
+    clock::time_point deadline () const
+    { return clock::time_point (clock::duration (m_deadline.load ())); }
+    bool hasDeadline () const { return deadline () != clock::time_point::max (); }
+
+    /// true once cancel was called or the deadline passed
+    bool cancelled () const
+    { return m_cancelled.load (std::memory_order_relaxed) || clock::now () >= deadline (); }
+
+    /// cancels the token and calls the hooks in scope. From any
+    /// thread, but not from a signal handler
+    void cancel ();
+
+    /// While in scope, cancel calls f, e.g., the interrupt of the Z3
+    /// context of an in-flight query:
+    ///   CancelToken::Hook h (token, [&z3] { z3.interrupt (); });
+    /// f is called at once if the token is already cancelled
+    class Hook
+    {
+      CancelToken &m_token;
+      unsigned m_id;
+    public:
+      Hook (CancelToken &token, std::function<void ()> f);
+      Hook (const Hook &) = delete;
+      ~Hook ();
+    };
+  };
+
+  /// The token of the whole run, e.g., of the deadline of
+  /// --horn-deadline. Engines poll it between steps, and hook the Z3
+  /// context of their queries to it, so that they stop when it is
+  /// cancelled and report what they found so far
+  CancelToken &globalCancelToken ();
+
+  /// Runs the independent tasks of a parallel phase, e.g., the
+  /// functions of a level of the call graph, on a fixed number of
+  /// workers. The calling thread is worker 0. Idle workers take the
+  /// next task that is not started, so the load balances itself and
+  /// the tasks start in order. Once the token is cancelled, the tasks
+  /// that did not start are skipped.
+  ///
+  /// Under name, the pool records in Stats the time of the phase, the
+  /// time, the number and the skipped count of its tasks, and the
+  /// growth of the resident set size of the process while each task
+  /// ran. The workers share the address space, so the growth of a
+  /// task includes that of the tasks that ran at the same time. Tiny
+  /// tasks are measured one in a sample period, see StatsSampleTimer.
+  class TaskPool
+  {
+  public:
+    /// the worker, below threads (), and the index of the task
+    typedef std::function<void (unsigned, size_t)> Task;
+
+  private:
+    std::string m_name;
+    unsigned m_threads;
+    std::unique_ptr<CancelToken> m_own;
+    CancelToken *m_token;
+    unsigned m_memLimitMb;
+    unsigned m_samplePeriod;
+
+  public:
+    /// threads of 0 means as many as the hardware runs. Without a
+    /// token the pool has its own
+    TaskPool (const std::string &name, unsigned threads,
+              CancelToken *token = nullptr);
+
+    unsigned threads () const { return m_threads; }
+    /// the token of the tasks, e.g., to register hooks
+    CancelToken &token () { return *m_token; }
+
+    /// cancels the token when the resident set size of the process
+    /// goes above mb while the pool runs. 0 means no limit
+    void setMemLimit (unsigned mb) { m_memLimitMb = mb; }
+    /// measures the time and the memory of one task in period. Only
+    /// for pools of this name that did not run yet
+    void setSamplePeriod (unsigned period) { m_samplePeriod = period; }
+
+    /// runs task (w, k) for every k below n, on at most n workers.
+    /// Returns the number of tasks that ran
+    size_t run (size_t n, const Task &task);
+  };
+}
+
+#endif
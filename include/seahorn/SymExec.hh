@@ -2,13 +2,19 @@
 #define __SYM_EXEC__HH_
 
 #include "llvm/IR/InstVisitor.h"
+#include "llvm/IR/ValueHandle.h"
 #include "ufo/Expr.hpp"
 #include "ufo/ExprLlvm.hpp"
 #include "seahorn/SymStore.hh"
+#include "seahorn/EncodingIR.hh"
 #include "seahorn/Analysis/CutPointGraph.hh"
 
 #include "avy/AvyDebug.h"
 
+#include <map>
+#include <memory>
+#include <mutex>
+
 
 namespace seahorn
 {
@@ -49,11 +55,86 @@ namespace seahorn
   /// maps llvm::Function to seahorn::FunctionInfo
   typedef DenseMap<const llvm::Function*, FunctionInfo> FuncInfoMap;
 
+  /// Encodings of cutpoint edges over canonical values. A large-step
+  /// semantics encodes an edge once and instantiates the encoding in
+  /// the store of every later execution of the edge
+  class CpEdgeCache
+  {
+  public:
+    struct Encoding
+    {
+      /// end-points of the edge when it was encoded. Null once the
+      /// blocks are deleted
+      WeakVH src;
+      WeakVH dst;
+      /// registers read before they are written
+      ExprVector inputs;
+      /// registers havoced by the edge and the variants of their
+      /// first and last canonical value
+      std::vector<std::pair<Expr, std::pair<int,int> > > havocs;
+      /// registers and their canonical values at the end of the edge
+      std::vector<std::pair<Expr,Expr> > outputs;
+      /// side condition over the canonical values
+      ExprVector side;
+    };
+    typedef std::shared_ptr<const Encoding> EncodingPtr;
+    
+  private:
+    std::mutex m_mutex;
+    std::map<const CpEdge*, EncodingPtr> m_encodings;
+    
+  public:
+    /// the encoding of edg. Null if there is none or if the blocks of
+    /// edg changed since it was encoded
+    EncodingPtr lookup (const CpEdge &edg);
+    void insert (const CpEdge &edg, EncodingPtr enc);
+    /// drops all encodings, e.g., when the module changes
+    void clear ();
+  };
+  
+  /// Symbols of llvm values under a semantics. The values of a
+  /// function are entered all at once before the function is
+  /// encoded, after which their table is only read, so that threads
+  /// encoding different functions look symbols up without locking.
+  /// Other values, e.g., globals, are entered as they are first
+  /// asked for, under a lock when the factory is concurrent
+  class SymbolTable
+  {
+    typedef DenseMap<const Value*, Expr> ValueMap;
+    
+    ExprFactory &m_efac;
+    /// -- complete tables of functions, written by addFunction only
+    DenseMap<const Function*, ValueMap> m_functions;
+    /// -- all other values
+    std::mutex m_mutex;
+    ValueMap m_other;
+    
+  public:
+    SymbolTable (ExprFactory &efac) : m_efac (efac) {}
+    
+    /// the symbol of v, if it was entered. The symbol may be null
+    bool find (const Value &v, Expr &out);
+    void insert (const Value &v, Expr sym);
+    
+    /// enters the symbols of all the values of F under sem. Not
+    /// thread safe: called before F is encoded
+    void addFunction (const Function &F, SmallStepSymExec &sem);
+    /// forgets the symbols of F, e.g., when F changes
+    void removeFunction (const Function &F) { m_functions.erase (&F); }
+  };
+  
   class SmallStepSymExec
   {
   protected:
     ExprFactory &m_efac;
     FuncInfoMap m_fmap;
+    /// encodings of the cutpoint edges under this semantics
+    std::shared_ptr<CpEdgeCache> m_edgeCache;
+    /// symbols of the values under this semantics
+    std::shared_ptr<SymbolTable> m_symbols;
+    /// facts about the instructions that do not depend on the
+    /// theory. Set by the semantics that use it, and shared by copies
+    std::shared_ptr<EncodingIR> m_ir;
     
     Expr trueE;
     Expr falseE;
@@ -62,6 +143,8 @@ namespace seahorn
   public:
     SmallStepSymExec (ExprFactory &efac) : 
       m_efac (efac), 
+      m_edgeCache (std::make_shared<CpEdgeCache> ()),
+      m_symbols (std::make_shared<SymbolTable> (efac)),
       trueE (mk<TRUE> (m_efac)),
       falseE (mk<FALSE> (m_efac)),
       m_errorFlag (bind::boolConst (mkTerm<std::string> ("error.flag", m_efac))) {}
@@ -70,6 +153,9 @@ namespace seahorn
     SmallStepSymExec (const SmallStepSymExec &o) : 
       m_efac (o.m_efac), 
       m_fmap (o.m_fmap),
+      m_edgeCache (std::make_shared<CpEdgeCache> ()),
+      m_symbols (std::make_shared<SymbolTable> (o.m_efac)),
+      m_ir (o.m_ir),
       m_errorFlag (o.m_errorFlag) {}
     
     virtual ~SmallStepSymExec () {}
@@ -121,6 +207,22 @@ namespace seahorn
     virtual Expr memStart (unsigned id) = 0;
     virtual Expr memEnd (unsigned id) = 0;
     
+    /// cache of the encodings of cutpoint edges. Encodings depend on
+    /// the semantics, so each instance has its own
+    CpEdgeCache &edgeCache () { return *m_edgeCache; }
+    
+    /// symbols of the values under this semantics. Semantics that
+    /// use the table look their symbols up there first
+    SymbolTable &symbols () { return *m_symbols; }
+    /// computes the symbols of all the values of F at once, to be
+    /// shared by everything that encodes F
+    void addSymbols (const Function &F) { m_symbols->addFunction (F, *this); }
+    
+    /// the theory-neutral encoding of the instructions
+    EncodingIR &encoding () { return *m_ir; }
+    /// uses the encoding of o, so that semantics of the same module,
+    /// e.g., in a portfolio, analyze every function once
+    void shareEncoding (const SmallStepSymExec &o) { if (o.m_ir) m_ir = o.m_ir; }
   };
 
   /// -- computes verification condition for a CPG edge
@@ -3,6 +3,7 @@
 /// A symbolic store is a map from symbolic registers to symbolic values.
 
 #include "ufo/Expr.hpp"
+#include "seahorn/Support/PersistentMap.hh"
 
 #include "llvm/Support/raw_ostream.h"
 #include <memory>
@@ -44,7 +45,8 @@ namespace seahorn
     
   public:
     typedef std::shared_ptr<SymStore> SymStorePtr;
-    typedef std::unordered_map<Expr,Expr> ExprExprMap;
+    /// persistent, so that copies of a store share their entries
+    typedef PersistentMap<Expr,Expr> ExprExprMap;
     
   protected:
     /// Parent store, if any
@@ -113,23 +115,27 @@ namespace seahorn
     
     
     ExprFactory &getExprFactory () { return m_efac; }
+    /// true if reads and writes are tracked
+    bool tracksUse () const { return m_trackUse; }
     
     
     bool isDefined (Expr key) const { return m_Store.count (key) > 0; }
     
     Expr at (Expr key) const
     {
-      if (isDefined (key)) return m_Store.at (key);
-      return Expr(0);
+      const Expr *v = m_Store.find (key);
+      return v ? *v : Expr(0);
     }
     
     Expr eval (Expr exp) { return expr::dagVisit (m_evalVisitor, exp); }
+    /// evaluate reusing the results in memo. Only valid as long as
+    /// the store is not modified
+    Expr eval (Expr exp, DagVisitMemo &memo) 
+    { return expr::dagVisit (m_evalVisitor, exp, memo); }
     Expr operator() (Expr exp) { return eval (exp); }
     
-    typedef ExprExprMap::iterator iterator;
+    typedef ExprExprMap::const_iterator iterator;
     typedef ExprExprMap::const_iterator const_iterator;
-    iterator begin () { return m_Store.begin (); }
-    iterator end () { return m_Store.end (); }
     const_iterator begin () const { return m_Store.begin (); }
     const_iterator end () const { return m_Store.end (); }
    
@@ -13,6 +13,7 @@
 #include "llvm/Target/TargetLibraryInfo.h"
 #include "llvm/ADT/BitVector.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
 #include "llvm/Support/Debug.h"
 
 #include "boost/unordered_set.hpp"
@@ -113,6 +114,11 @@ namespace seahorn
     
     void instrumentErrAndSafeBlocks (IRBuilder<>B, Function &F);   
 
+    /// removes the checks of F that always hold or that are implied
+    /// by a dominating check, and moves loop invariant checks to the
+    /// loop preheader
+    bool optimizeChecks (Function &F);
+
     /************************************/
     /*   To shadow function parameters  */
     /************************************/
@@ -123,6 +129,20 @@ namespace seahorn
     DenseMap <const Function*,  
               std::pair<StoreInst*,StoreInst* > > m_ret_shadows;
 
+    // -- sparse mode: the pointer parameters (by position) and the
+    // -- functions whose pointer return value reach a checked
+    // -- dereference. Only those are shadowed.
+    bool m_sparse;
+    DenseMap <const Function*, BitVector> m_needed_args;
+    DenseSet <const Function*> m_needed_ret;
+
+    /// computes m_needed_args and m_needed_ret from the def-use
+    /// chains of the pointers of the checked dereferences
+    void computeNeededShadows (Module &M);
+
+    // true if shadow parameters can be added to F
+    bool canShadowParams (const Function *F);
+
     bool addFunShadowParams (Function *F, LLVMContext &ctx);  
 
     bool lookup (const Function *F) const
@@ -140,6 +160,31 @@ namespace seahorn
     }
 
     bool IsShadowableType (Type * ty) const { return ty->isPointerTy (); } 
+
+    // true if the formal parameter of F at position idx has (or gets)
+    // shadow parameters
+    bool hasShadowArg (const Function *F, unsigned idx) const
+    {
+      if (!IsShadowableType (F->getFunctionType ()->getParamType (idx)))
+        return false;
+      if (!m_sparse) return true;
+      auto it = m_needed_args.find (F);
+      return (it != m_needed_args.end () && it->second.test (idx));
+    }
+
+    // true if F gets shadow parameters for its return value
+    bool needsShadowRet (const Function *F) const
+    {
+      return (IsShadowableType (F->getReturnType ()) &&
+              (!m_sparse || m_needed_ret.count (F)));
+    }
+
+    // true if F has shadow parameters for its return value
+    bool hasShadowRet (const Function *F) const
+    {
+      auto it = m_ret_shadows.find (F);
+      return (it != m_ret_shadows.end () && it->second.first);
+    }
     
     // return the number of original arguments before the pass added
     // shadow parameters
@@ -171,13 +216,22 @@ namespace seahorn
     unsigned ChecksAdded;   //! Array bounds checks added
     unsigned ChecksSkipped; //! Array bounds checks ignored because store/load is safe
     unsigned ChecksUnable;  //! Array bounds checks unable to add
+    unsigned ChecksDischarged; //! Array bounds checks that always hold
+    unsigned ChecksRedundant;  //! Array bounds checks implied by another check
+    unsigned ChecksHoisted;    //! Array bounds checks moved out of a loop
+    unsigned ShadowsSkipped;   //! Pointer parameters and returns not shadowed
 
   public:
 
     BufferBoundsCheck () : llvm::ModulePass (ID), 
+                           m_sparse (false),
                            ChecksAdded (0), 
                            ChecksSkipped (0), 
-                           ChecksUnable (0) { }
+                           ChecksUnable (0),
+                           ChecksDischarged (0),
+                           ChecksRedundant (0),
+                           ChecksHoisted (0),
+                           ShadowsSkipped (0) { }
     
     virtual bool runOnModule (llvm::Module &M);
     virtual bool runOnFunction (Function &F);
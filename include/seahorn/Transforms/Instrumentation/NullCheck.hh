@@ -5,6 +5,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/ADT/DenseSet.h"
 
 namespace seahorn
 {
@@ -20,18 +21,21 @@ namespace seahorn
     
     unsigned  ChecksAdded; 
     unsigned  TrivialChecks; 
+    unsigned  RemovedChecks; 
     Function* ErrorFn;
     // Call graph of the program
     CallGraph * CG;    
 
     BasicBlock* createErrorBlock (Function &F, IRBuilder<> B);
     void insertNullCheck (Value *Ptr, IRBuilder<> B, Instruction* I);
+    // memory accesses of F whose pointer cannot be null
+    void findNonNullAccesses (Function &F, DenseSet<const Instruction*> &Safe);
 
    public:
     
     NullCheck () : 
         llvm::ModulePass (ID), 
-        ChecksAdded (0), TrivialChecks (0), ErrorFn (nullptr), CG (nullptr) { }
+        ChecksAdded (0), TrivialChecks (0), RemovedChecks (0), ErrorFn (nullptr), CG (nullptr) { }
     
     virtual bool runOnModule (llvm::Module &M);
     virtual bool runOnFunction (Function &F);
@@ -12,6 +12,8 @@
 
 #include "boost/container/flat_set.hpp"
 
+#include <map>
+
 using namespace seahorn::dsa;
 
 namespace seahorn
@@ -49,6 +51,31 @@ namespace seahorn
     typedef boost::container::flat_set<const Node*> NodeSet;
     DenseMap<const Function *, NodeSet> m_readList;
     DenseMap<const Function *, NodeSet > m_modList;
+    /// nodes of a function that its callers or its callees might
+    /// write. The other nodes share a single constant region
+    DenseMap<const Function *, NodeSet> m_writtenList;
+    /// function being instrumented
+    const Function *m_fn;
+
+    /// what a shadow region guards and contributes to the encoding
+    struct RegionInfo
+    {
+      const Node *node;
+      unsigned offset;
+      unsigned loads;
+      unsigned stores;
+      /// shadow.mem.in/out markers, i.e., arguments of function relations
+      unsigned relArgs;
+      /// parameters of calls
+      unsigned callArgs;
+      RegionInfo () : node (nullptr), offset (0), loads (0), stores (0),
+                      relArgs (0), callArgs (0) {}
+      unsigned weight () const { return loads + stores + relArgs + callArgs; }
+    };
+    /// regions by shadow id
+    std::map<unsigned, RegionInfo> m_regions;
+    RegionInfo &region (const Cell &c);
+    void writeRegions (llvm::raw_ostream &o) const;
     
     
     void declareFunctions (llvm::Module &M);
@@ -64,6 +91,10 @@ namespace seahorn
     /// compute read/modified information per function
     void computeReadMod ();
     void updateReadMod (Function &F, NodeSet &readSet, NodeSet &modSet);
+    /// compute the nodes written in some context of each function
+    void computeWritten ();
+    /// true if n is never written, in any context of f
+    bool isConstantRegion (const Node *n, const Function &f);
     
     bool isRead (const Cell &c, const Function &f);
     bool isRead (const Node* n, const Function &f);
@@ -73,7 +104,7 @@ namespace seahorn
   public:
     static char ID;
     
-    ShadowMemSeaDsa () : llvm::ModulePass (ID), m_max_id(0)
+    ShadowMemSeaDsa () : llvm::ModulePass (ID), m_max_id(0), m_fn (nullptr)
     {}
     
     virtual bool runOnModule (llvm::Module &M);
@@ -23,6 +23,7 @@ namespace seahorn
     ConstantExpr* hasCstExpr(Value *V, std::set<Value*> &visited);
     ConstantExpr* hasCstExpr(Value *Value);
     Instruction* lowerCstExpr(ConstantExpr * CEx, Instruction *I);
+    bool shareCstExprs(Function &F);
     
    public:
     
@@ -5,6 +5,7 @@
 #include "llvm/IR/DataLayout.h"
 #include "seahorn/SymExec.hh"
 #include "seahorn/Analysis/CanFail.hh"
+#include "seahorn/RegionSlice.hh"
 
 namespace seahorn
 {
@@ -16,17 +17,28 @@ namespace seahorn
    
     const DataLayout *m_td;
     const CanFail *m_canFail;
+    /// memory regions tracked at level MEM. All of them if null
+    const RegionSlice *m_regions;
     
+    /// computes the symbol of v
+    Expr mkSymb (const Value &v);
     
   public:
     UfoSmallSymExec (ExprFactory &efac, Pass &pass, TrackLevel trackLvl = MEM) : 
-      SmallStepSymExec (efac), m_pass (pass), m_trackLvl (trackLvl)
+      SmallStepSymExec (efac), m_pass (pass), m_trackLvl (trackLvl),
+      m_regions (nullptr)
     {
       m_td = &pass.getAnalysis<DataLayoutPass> ().getDataLayout ();
       m_canFail = pass.getAnalysisIfAvailable<CanFail> ();
+      m_ir = std::make_shared<EncodingIR> (*m_td, efac);
     }
     UfoSmallSymExec (const UfoSmallSymExec& o) : 
-      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl) {}
+      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl),
+      m_td (o.m_td), m_canFail (o.m_canFail), m_regions (o.m_regions) {}
+    
+    /// tracks only the memory regions of r. Set before any symbol is
+    /// computed
+    void setRegions (const RegionSlice *r) { m_regions = r; }
     
     Expr errorFlag (const BasicBlock &BB) override;
 
@@ -48,16 +60,34 @@ namespace seahorn
     virtual void execBr (SymStore &s, const BasicBlock &src, const BasicBlock &dst,
                          ExprVector &side, Expr act);
     
+    /// the symbol of v, from the symbol table once it is computed
     virtual Expr symb (const Value &v);
     virtual const Value &conc (Expr v);
     virtual bool isTracked (const Value &v);
+    /// the value of v as an integer, converted if v is a bit-vector
     virtual Expr lookup (SymStore &s, const Value &v);
     
-    Expr ptrArith (SymStore &s, const Value& base, 
-                   SmallVectorImpl<const Value*> &ps,
-                   SmallVectorImpl<const Type *> &ts);
-    unsigned storageSize (const llvm::Type *t);
-    unsigned fieldOff (const StructType *t, unsigned field);
+    /// with --horn-hybrid-bv, true if v is encoded as a bit-vector,
+    /// i.e., its instruction is bit-precise (see EncInst)
+    bool isBv (const Value &v);
+    /// the value of v as a bit-vector of width bits, converted if v
+    /// is an integer
+    Expr lookupBv (SymStore &s, const Value &v, unsigned width);
+    /// the signed integer of the bit-vector u of width bits
+    Expr bvToInt (Expr u, unsigned width);
+    
+    /// the address computed by gep, from its encoding
+    Expr ptrArith (SymStore &s, const GetElementPtrInst &gep);
+    /// the offset of p in the object it is derived from by geps and
+    /// casts, base. base is p if p is not derived from a pointer. Null
+    /// if an index is not tracked
+    Expr ptrOffset (SymStore &s, const Value &p, const Value *&base);
+    /// the address computed by gep, as its object plus its offset
+    Expr ptrBaseOffset (SymStore &s, const GetElementPtrInst &gep);
+    /// the size of the object allocated at base, 0 if it is unknown
+    uint64_t objectSize (const Value &base);
+    
+    const DataLayout &dataLayout () const { return *m_td; }
   }; 
   
 
@@ -68,6 +98,12 @@ namespace seahorn
     
     void execEdgBb (SymStore &s, const CpEdge &edge, 
                     const BasicBlock &bb, ExprVector &side, bool last = false);
+    /// encodes edge in s, without the cache
+    void encodeCpEdg (SymStore &s, const CpEdge &edge, ExprVector &side);
+    /// encoding of edge over canonical values
+    CpEdgeCache::EncodingPtr canonicalCpEdg (const CpEdge &edge);
+    /// executes the encoding enc of an edge in s
+    void instantiate (const CpEdgeCache::Encoding &enc, SymStore &s, ExprVector &side);
     
   public:
     UfoLargeSymExec (SmallStepSymExec &sem)
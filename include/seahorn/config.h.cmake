@@ -18,4 +18,7 @@
 /** Define whether ldd is available */
 #cmakedefine HAVE_LDD ${HAVE_LDD}
 
+/** Define whether zlib is available */
+#cmakedefine HAVE_ZLIB ${HAVE_ZLIB}
+
 #endif
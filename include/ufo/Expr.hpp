@@ -22,6 +22,8 @@ DM-0002198
 #pragma clang diagnostic ignored "-Wpotentially-evaluated-expression"
 
 #include <typeinfo>
+#include <typeindex>
+#include <type_traits>
 #include <algorithm>
 #include <set>
 #include <map>
@@ -35,6 +37,12 @@ DM-0002198
 #include <unordered_map>
 #include <memory>
 #include <array>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <climits>
+#include <cstdlib>
+#include <cxxabi.h>
 
 #include <gmpxx.h>
 
@@ -42,6 +50,7 @@ DM-0002198
 #include <boost/intrusive_ptr.hpp>
 #include <boost/interprocess/containers/flat_set.hpp>
 #include <boost/range/iterator_range.hpp>
+#include <boost/iterator/iterator_adaptor.hpp>
 #include <boost/range/adaptor/reversed.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 #include <boost/utility.hpp>
@@ -50,13 +59,19 @@ DM-0002198
 #include <boost/pool/pool_alloc.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "ufo/MemoryBudget.hpp"
+
 #define mk_it_range boost::make_iterator_range
 
-#define NOP_BASE(NAME) struct NAME : public expr::Operator {};
+#define NOP_BASE(NAME) struct NAME : public expr::Operator \
+  { typedef NAME op_family; };
 
 #define NOP(NAME,TEXT,STYLE,BASE)		\
-  struct __ ## NAME { static inline std::string name () { return TEXT; } }; \
-  typedef DefOp<__ ## NAME,BASE,STYLE> NAME;
+  struct __ ## NAME { static inline std::string name () { return TEXT; } \
+    static inline const char *id () { return #NAME; } };                 \
+  typedef DefOp<__ ## NAME,BASE,STYLE> NAME;                           \
+  inline bool __ ## NAME ## _registered ()                              \
+  { return expr::OpRegistrar<NAME>::registered; }
 
 
 
@@ -88,6 +103,159 @@ namespace expr
   //inline ENode* eptr (Expr e) { return e.get (); }
 
   class Operator;
+
+  /**
+   * The arguments of an expression node. Up to inline_capacity
+   * arguments are stored in the node itself, the arguments of nodes
+   * of larger arity spill into a heap array. Provides the read-only
+   * interface of std::vector.
+   */
+  class ENodeArgs : boost::noncopyable
+  {
+  public:
+    static const unsigned inline_capacity = 3;
+
+    /** a class rather than a pointer so that ++(e->args_begin ())
+        is valid */
+    class const_iterator : 
+      public boost::iterator_adaptor<const_iterator, ENode* const*>
+    {
+    public:
+      const_iterator () {}
+      explicit const_iterator (ENode* const *p) : 
+        const_iterator::iterator_adaptor_ (p) {}
+    };
+    typedef ENode* value_type;
+
+  private:
+    uint32_t m_size;
+    uint32_t m_capacity;
+    union 
+    {
+      ENode *m_inline [inline_capacity];
+      ENode **m_heap;
+    };
+    
+    bool isSpilled () const { return m_capacity > inline_capacity; }
+    ENode* const *data () const { return isSpilled () ? m_heap : m_inline; }
+    ENode **data () { return isSpilled () ? m_heap : m_inline; }
+    
+    void grow ()
+    {
+      uint32_t capacity = 2 * m_capacity;
+      ENode **heap = new ENode* [capacity];
+      std::copy (data (), data () + m_size, heap);
+      if (isSpilled ()) delete [] m_heap;
+      m_heap = heap;
+      m_capacity = capacity;
+    }
+    
+  public:
+    ENodeArgs () : m_size (0), m_capacity (inline_capacity) {}
+    ~ENodeArgs () { if (isSpilled ()) delete [] m_heap; }
+
+    size_t size () const { return m_size; }
+    bool empty () const { return m_size == 0; }
+    ENode *operator[] (size_t p) const { return data () [p]; }
+    ENode *front () const { return data () [0]; }
+    ENode *back () const { return data () [m_size - 1]; }
+    
+    const_iterator begin () const { return const_iterator (data ()); }
+    const_iterator end () const { return const_iterator (data () + m_size); }
+    
+    void push_back (ENode *a)
+    {
+      if (m_size == m_capacity) grow ();
+      data () [m_size++] = a;
+    }
+    
+    /** removes all arguments. A spilled array is kept for reuse */
+    void clear () { m_size = 0; }
+  };
+
+  /** 
+   * Returns a dense integer identifier of an operator type. Ids are
+   * assigned on first use, starting from 0.
+   */
+  inline unsigned denseOpId (const std::type_info &ti)
+  {
+    static std::mutex lock;
+    static std::unordered_map<std::type_index, unsigned> ids;
+    
+    std::lock_guard<std::mutex> _l (lock);
+    auto res = ids.insert (std::make_pair (std::type_index (ti), 
+                                           (unsigned) ids.size ()));
+    return res.first->second;
+  }
+
+  /**
+   * The kind of operator type O: its dense id, as returned by
+   * Operator::typeId () of an operator of type O. The id is computed
+   * once, so that comparing kinds is comparing integers.
+   */
+  template <typename O> inline unsigned opKind ()
+  {
+    static const unsigned id = denseOpId (typeid (O));
+    return id;
+  }
+
+  /**
+   * Global table of interned strings, used for the names of
+   * symbols. Every distinct string is stored once, together with its
+   * hash, and is never freed, so that a string is identified by the
+   * address of its entry: terminals of strings hash and compare in
+   * constant time, and the string itself is only read to print,
+   * order or marshal a name. Shared by all expression factories.
+   */
+  class StringPool
+  {
+  public:
+    /** entry of an interned string: the string and its hash */
+    typedef std::pair<const std::string, size_t> Entry;
+    typedef const Entry *Id;
+
+  private:
+    std::mutex m_lock;
+    std::unordered_map<std::string, size_t> m_strings;
+    /** bytes of the interned strings */
+    size_t m_bytes = 0;
+
+    static StringPool &instance ()
+    {
+      static StringPool *pool = new StringPool ();
+      return *pool;
+    }
+
+  public:
+    /** id of s, interning it if it is new */
+    static Id intern (const std::string &s)
+    {
+      StringPool &p = instance ();
+      std::lock_guard<std::mutex> _l (p.m_lock);
+      auto it = p.m_strings.find (s);
+      if (it == p.m_strings.end ())
+      {
+        std::hash<std::string> hasher;
+        it = p.m_strings.insert (std::make_pair (s, hasher (s))).first;
+        p.m_bytes += s.size ();
+      }
+      return &*it;
+    }
+
+    /** number of interned strings and their total length */
+    static size_t size ()
+    {
+      StringPool &p = instance ();
+      std::lock_guard<std::mutex> _l (p.m_lock);
+      return p.m_strings.size ();
+    }
+    static size_t bytes ()
+    {
+      StringPool &p = instance ();
+      std::lock_guard<std::mutex> _l (p.m_lock);
+      return p.m_bytes;
+    }
+  };
     
   /* An operator (a.k.a. a tag) of an expression node */
   class Operator
@@ -103,20 +271,81 @@ namespace expr
               -- might be ambiguous and brakets might be required
      **/
     virtual void Print (std::ostream &OS,
-			const std::vector<ENode*> &args,
+			const ENodeArgs &args,
 			int depth = 0, 
 			bool brkt = true) const = 0;
     virtual bool operator== (const Operator& rhs) const = 0;
     virtual bool operator< (const Operator& rhs) const = 0;
     virtual size_t hash () const = 0;
+    /** dense id of the type of the operator. See denseOpId() */
+    virtual unsigned typeId () const { return denseOpId (typeid (*this)); }
+    /** kind of the family of the operator, i.e., of the NOP_BASE it
+        is declared with. The kind of the operator if it has none */
+    virtual unsigned familyId () const { return typeId (); }
     virtual bool isMutable () const { return false; }
     /* Returns a heap-allocated clone of this */
     virtual Operator* clone (ExprFactoryAllocator &allocator) const = 0;
   };
 
 
+  /**
+   * Registry of all operators declared with NOP, indexed by the id
+   * (the C++ name) of the operator. Used to rebuild expressions from
+   * a serialized form (see ExprIO.hpp). Populated during static
+   * initialization and read-only afterwards.
+   */
+  class OpRegistry : boost::noncopyable
+  {
+    std::map<std::string, const Operator*> m_byId;
+    std::unordered_map<std::type_index, const char*> m_ids;
+
+    OpRegistry () {}
+  public:
+    static OpRegistry &get ()
+    {
+      static OpRegistry reg;
+      return reg;
+    }
+
+    bool add (const char *id, const Operator &proto)
+    {
+      bool res = m_byId.insert (std::make_pair (std::string (id), &proto)).second;
+      assert (res && "duplicate operator id");
+      m_ids [std::type_index (typeid (proto))] = id;
+      return res;
+    }
+
+    /** prototype of the operator with a given id, or NULL */
+    const Operator *find (const std::string &id) const
+    {
+      auto it = m_byId.find (id);
+      return it == m_byId.end () ? NULL : it->second;
+    }
+
+    /** id of a registered operator, or NULL */
+    const char *id (const Operator &op) const
+    {
+      auto it = m_ids.find (std::type_index (typeid (op)));
+      return it == m_ids.end () ? NULL : it->second;
+    }
+  };
+
+  template <typename Op>
+  struct OpRegistrar
+  {
+    static const bool registered;
+    static bool doRegister ()
+    {
+      static const Op proto = Op ();
+      return OpRegistry::get ().add (Op::op_type::id (), proto);
+    }
+  };
+
+  template <typename Op>
+  const bool OpRegistrar<Op>::registered = OpRegistrar<Op>::doRegister ();
+
   inline std::ostream &operator<<(std::ostream &OS, const Operator &V) {
-    std::vector<ENode*> x;
+    ENodeArgs x;
     V.Print (OS, x);
     return OS;
   }
@@ -128,22 +357,33 @@ namespace expr
   {
   private:
     // // -- no default constructor
-    ENode () : id(0), count(0), fac(NULL) {}
+    ENode () : id(0), count(0), fac(NULL), oper(NULL), hashCode(0) {}
     // // -- no copy constructor
-    ENode (const ENode &) : count(0), fac(NULL) {}
+    ENode (const ENode &) : count(0), fac(NULL), oper(NULL), hashCode(0) {}
   protected:
     /** unique identifier of this expression node */
     unsigned int id;
-    /** reference counter */
-    unsigned int count;
+    /** reference counter. Only updated atomically when the factory
+        is in concurrent mode */
+    std::atomic<unsigned int> count;
 
     ExprFactory *fac;
-    std::vector<ENode*> args;
+    ENodeArgs args;
 
-    std::shared_ptr<Operator> oper;
+    /** owned. Allocated by the allocator of the factory */
+    Operator *oper;
     
+    /** structural hash. Computed when the node is canonized */
+    size_t hashCode;
     
-    void Deref () { if (count > 0) count--; }
+    /** hash of the operator and the (pointers to the) arguments */
+    size_t structuralHash () const;
+    void setHash () { hashCode = structuralHash (); }
+    /** destroys the operator. Done when the node becomes garbage */
+    void releaseOp ();
+    
+    /** decrement reference counter and return the new value */
+    unsigned int Deref ();
 
 
     /** assigns a unique id to the node */
@@ -159,12 +399,17 @@ namespace expr
 
     /** returns the unique id of this expression */
     unsigned int getId () const { return id; }
+    /** returns the structural hash of this expression. Equal
+        expressions have equal hashes */
+    size_t hash () const { return hashCode; }
 
-    void Ref () { count++; }
-    bool isGarbage () const { return count == 0; }
+    void Ref ();
+    bool isGarbage () const 
+    { return count.load (std::memory_order_relaxed) == 0; }
     bool isMutable () const { return oper->isMutable (); }
 
-    unsigned int use_count () { return count; }
+    unsigned int use_count () 
+    { return count.load (std::memory_order_relaxed); }
 
     ENode* operator[] (size_t p) { return arg (p); }
     ENode* arg (size_t p) { return args [p]; }
@@ -180,7 +425,7 @@ namespace expr
     { return args.size () > 0 ? args [args.size () - 1] : NULL; }
     
 
-    typedef std::vector<ENode*>::const_iterator args_iterator;
+    typedef ENodeArgs::const_iterator args_iterator;
 
     bool args_empty () const { return args.empty () ; }
     args_iterator args_begin () const { return args.begin (); }
@@ -202,6 +447,10 @@ namespace expr
     friend struct std::less<expr::ENode*>;
   };
 
+  // -- nodes of arity up to ENodeArgs::inline_capacity fit one cache line
+  static_assert (sizeof (void*) != 8 || sizeof (ENode) <= 64, 
+                 "ENode does not fit a cache line");
+
   
 
   inline std::ostream &operator<<(std::ostream &OS, const ENode &V) {
@@ -217,47 +466,7 @@ namespace expr
 
   struct ENodeUniqueHash
   {
-    std::size_t operator() (const ENode *e) const
-    {
-      size_t res = e->op ().hash ();
-
-      size_t a = e->arity ();
-      if (a == 0) return res;
-
-      ENode::args_iterator it = e->args_begin ();
-      if (a >= 1) 
-	boost::hash_combine (res, *it);
-      
-      if (a >= 2)
-	boost::hash_combine (res, 
-			     boost::hash_range (it, e->args_end ()));
-
-      return res;
-      
-      // if (a == 2) 
-      // 	{
-      // 	  boost::hash_combine (res, *it);
-      // 	  ++it;
-      // 	  boost::hash_combine (res, *it);
-      // 	  return res;
-      // 	}
-      // if (a == 3) 
-      // 	{
-      // 	  boost::hash_combine (res, *it);
-      // 	  it++;
-      // 	  boost::hash_combine (res, *it);
-      // 	  it++;
-      // 	  boost::hash_combine (res, *it);
-      // 	  return res;
-      // 	}
-      
-      // // -- n-arry with more than 3 children
-      // boost::hash_combine (res, 
-      // 			   boost::hash_range (e->args_begin (), 
-      // 					      e->args_end ()));
-      // return res;
-      
-    }
+    std::size_t operator() (const ENode *e) const { return e->hash (); }
   };
     
   struct ENodeUniqueEqual
@@ -265,7 +474,7 @@ namespace expr
     bool operator () (ENode* const &e1, ENode* const &e2) const
     {
       // -- same type
-      if (typeid (e1->op ()) == typeid (e2->op ()))
+      if (e1->op ().typeId () == e2->op ().typeId ())
 	// -- same number of children
 	if (e1->arity () == e2->arity ())
 	  // -- operators (if have data) are equal
@@ -283,13 +492,13 @@ namespace expr
   {
     bool operator() (ENode* e1, ENode* e2)
     {
-      if (typeid (e1->op ()) == typeid (e2->op ()))
+      if (e1->op ().typeId () == e2->op ().typeId ())
 	{
 	  if (e1->op () == e2->op ())
-	    return lexicographical_compare (e1->args_begin (), 
-					    e1->args_end (),
-					    e2->args_begin (),
-					    e2->args_end ());
+	    return std::lexicographical_compare (e1->args_begin (), 
+						 e1->args_end (),
+						 e2->args_begin (),
+						 e2->args_end ());
 	  else
 	    return e1->op () < e2->op ();
 	}
@@ -299,6 +508,120 @@ namespace expr
     }
   };
 
+
+  /** 
+   * Open-addressing (linear probing) hash set of structurally unique
+   * nodes. All nodes in a table have operators of the same type. The
+   * hash of every node is stored next to it so that most probes do
+   * not touch the nodes.
+   */
+  class ENodeOpenTable
+  {
+    struct Slot 
+    {
+      size_t hash;
+      /** NULL for an empty slot */
+      ENode *node;
+    };
+    
+    std::vector<Slot> m_slots;
+    size_t m_size;
+    /** the table does not shrink below this capacity */
+    size_t m_reserved;
+    
+    size_t mask () const { return m_slots.size () - 1; }
+
+    void resize (size_t capacity)
+    {
+      std::vector<Slot> old;
+      old.swap (m_slots);
+      m_slots.resize (capacity, Slot {0, nullptr});
+      
+      for (const Slot &s : old)
+        if (s.node)
+        {
+          size_t i = s.hash & mask ();
+          while (m_slots [i].node) i = (i + 1) & mask ();
+          m_slots [i] = s;
+        }
+    }
+    
+  public:
+    ENodeOpenTable () : m_size (0), m_reserved (0) {}
+
+    size_t size () const { return m_size; }
+    bool empty () const { return m_size == 0; }
+    
+    /** 
+     * Returns the node in the table that is equal to n. If there is
+     * none, inserts n and returns it. h must be the hash of n
+     */
+    ENode *insert (ENode *n, size_t h)
+    {
+      // -- keep the load factor under 0.7
+      if (10 * (m_size + 1) > 7 * m_slots.size ()) 
+        resize (m_slots.empty () ? 16 : 2 * m_slots.size ());
+      
+      size_t i = h & mask ();
+      for (; m_slots [i].node; i = (i + 1) & mask ())
+        if (m_slots [i].hash == h && ENodeUniqueEqual () (m_slots [i].node, n))
+          return m_slots [i].node;
+      
+      m_slots [i].hash = h;
+      m_slots [i].node = n;
+      ++m_size;
+      return n;
+    }
+    
+    /** Removes n from the table. h must be the hash of n */
+    void erase (ENode *n, size_t h)
+    {
+      if (m_slots.empty ()) return;
+      
+      size_t i = h & mask ();
+      for (; m_slots [i].node != n; i = (i + 1) & mask ())
+        if (!m_slots [i].node) return;
+      
+      // -- backward-shift deletion: move up every entry of the
+      // -- cluster that will not be reachable after removing slot i
+      size_t j = i;
+      for (;;)
+      {
+        m_slots [i].node = nullptr;
+        for (;;)
+        {
+          j = (j + 1) & mask ();
+          if (!m_slots [j].node) break;
+          size_t k = m_slots [j].hash & mask ();
+          // -- entry j can stay if its home k is cyclically in (i, j]
+          if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+          break;
+        }
+        if (!m_slots [j].node) break;
+        m_slots [i] = m_slots [j];
+        i = j;
+      }
+      
+      --m_size;
+      if (m_slots.size () > 16 && 8 * m_size < m_slots.size () &&
+          m_slots.size () / 2 >= m_reserved)
+        resize (m_slots.size () / 2);
+    }
+
+    /** allocates the slots of n nodes */
+    void reserve (size_t n)
+    {
+      size_t capacity = m_slots.empty () ? 16 : m_slots.size ();
+      while (10 * n > 7 * capacity) capacity *= 2;
+      m_reserved = capacity;
+      if (capacity > m_slots.size ()) resize (capacity);
+    }
+
+    /** calls f (n) for every node n of the table */
+    template <typename F>
+    void forEach (F f) const
+    { for (const Slot &s : m_slots) if (s.node) f (s.node); }
+  };
   
   /**
    * A type erasure of a cache
@@ -330,113 +653,446 @@ namespace expr
   {
     ExprFactoryAllocator &m_efa;
     EFADeleter (ExprFactoryAllocator &efa) : m_efa (efa) {}
-    void operator() (void *p);
+    /** destroys and deallocates an operator cloned into m_efa */
+    void operator() (Operator *p);
   };
 
     
-  class ExprFactoryAllocator : boost::noncopyable
+  /** A pair of pools. The lock is only used in concurrent mode */
+  struct EFAArena : boost::noncopyable
   {
-  private:
     /** pool for tiny objects */
     boost::pool<> tiny;
     /** pool for small objects */
     boost::pool<> small;
+    std::mutex lock;
+
+    EFAArena () : tiny(8, 65536), small (64, 65536) {}
+
+    void *allocate (size_t n);
+    /** returns the size of the freed block, or 0 if the block was
+        not allocated by this arena */
+    size_t free (void *block);
+    /** frees every block of the pools at once */
+    void purge () { tiny.purge_memory (); small.purge_memory (); }
+    /** the next blocks of the pools have room for n objects */
+    void reserve (size_t n)
+    {
+      if (n > tiny.get_next_size ()) tiny.set_next_size (n);
+      if (n > small.get_next_size ()) small.set_next_size (n);
+    }
+  };
 
+  class ExprFactoryAllocator : boost::noncopyable
+  {
+  public:
+    /** number of arenas used in concurrent mode */
+    static const unsigned num_arenas = 16;
+    
+  private:
+    /** the arena of the sequential mode */
+    EFAArena m_arena;
+    /** per-thread arenas. Allocated only in  concurrent mode */
+    std::unique_ptr<EFAArena[]> m_arenas;
+
+    /** bytes in allocated blocks, and their maximum */
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_peakBytes;
+
+    /** index of the arena of the calling thread */
+    static unsigned threadArena ();
+
+    /** header of blocks too large for the pools. Keeps their size */
+    static const size_t large_header = 16;
+    static void *allocateLarge (size_t n);
+    /** frees a large block and returns its size */
+    static size_t freeLarge (void *block);
+
+    void addBytes (size_t n);
+    void subBytes (size_t n);
+    
   public:
-    ExprFactoryAllocator () : tiny(8, 65536), small (64, 65536) {};
+    ExprFactoryAllocator (bool concurrent = false) : m_bytes (0), m_peakBytes (0)
+    { if (concurrent) m_arenas.reset (new EFAArena [num_arenas]); }
     
+    bool isConcurrent () const { return m_arenas.get () != nullptr; }
+
     void *allocate (size_t n);
     void free (void *block);
+    /** frees every pool block at once, allocated or not. Large
+        blocks must have been freed before */
+    void purge ();
+    /** grows the pools by blocks of n objects, over all arenas */
+    void reserve (size_t n);
+
+    /** bytes currently allocated, in pool blocks and large
+        blocks. Includes nodes kept in the free list of the factory */
+    size_t bytes () const { return m_bytes.load (std::memory_order_relaxed); }
+    /** maximum of bytes () over the lifetime of the allocator */
+    size_t peakBytes () const { return m_peakBytes.load (std::memory_order_relaxed); }
     
     EFADeleter get_deleter ();    
   };
   
   
 
+  /**
+   * Accounting of the nodes of an ExprFactory: live, peak and total
+   * nodes per operator, nodes created under each profiling tag (see
+   * ExprProfileScope), and sizes of recorded formulas. Only
+   * maintained when enabled with ExprFactory::enableProfiling ().
+   */
+  class ExprFactoryProfile : boost::noncopyable
+  {
+  public:
+    struct Counters
+    {
+      size_t live;
+      size_t peak;
+      size_t total;
+      Counters () : live (0), peak (0), total (0) {}
+      
+      void inc () { ++total; if (++live > peak) peak = live; }
+      /** nodes created before profiling was enabled are not counted */
+      void dec () { if (live > 0) --live; }
+    };
+    
+    struct FormulaSize 
+    { 
+      size_t dag; 
+      /** saturates at SIZE_MAX */
+      size_t tree; 
+    };
+    
+  private:
+    const ExprFactoryAllocator &m_allocator;
+    const bool m_concurrent;
+    mutable std::mutex m_lock;
+    
+    Counters m_all;
+    /** indexed by Operator::typeId () */
+    std::vector<Counters> m_ops;
+    std::vector<std::string> m_opNames;
+    /** nodes created under a tag. Keyed by the address of the tag */
+    std::unordered_map<const char*, size_t> m_tags;
+    std::map<std::string, FormulaSize> m_formulas;
+
+    static std::string opName (const Operator &op)
+    {
+      if (const char *id = OpRegistry::get ().id (op)) return id;
+      int status = 0;
+      char *d = abi::__cxa_demangle (typeid (op).name (), NULL, NULL, &status);
+      std::string res = status == 0 ? d : typeid (op).name ();
+      std::free (d);
+      return res;
+    }
+
+    Counters &opCounters (const Operator &op)
+    {
+      unsigned id = op.typeId ();
+      if (id >= m_ops.size ()) 
+      {
+        m_ops.resize (id + 1);
+        m_opNames.resize (id + 1);
+      }
+      if (m_opNames [id].empty ()) m_opNames [id] = opName (op);
+      return m_ops [id];
+    }
+    
+  public:
+    ExprFactoryProfile (const ExprFactoryAllocator &a, bool concurrent) :
+      m_allocator (a), m_concurrent (concurrent) {}
+
+    /** the tag of the current thread. NULL if none */
+    static const char *&currentTag ()
+    {
+      static thread_local const char *tag = NULL;
+      return tag;
+    }
+    
+    void created (const Operator &op)
+    {
+      std::unique_lock<std::mutex> l (m_lock, std::defer_lock);
+      if (m_concurrent) l.lock ();
+      m_all.inc ();
+      opCounters (op).inc ();
+      if (const char *tag = currentTag ()) ++m_tags [tag];
+    }
+    
+    void destroyed (const Operator &op)
+    {
+      std::unique_lock<std::mutex> l (m_lock, std::defer_lock);
+      if (m_concurrent) l.lock ();
+      m_all.dec ();
+      opCounters (op).dec ();
+    }
+
+    /** records the DAG and tree size of e under name */
+    void recordFormula (const std::string &name, Expr e);
+
+    const Counters &nodes () const { return m_all; }
+    
+    /**
+     * Calls f (name, value) for every counter of the profile. Names
+     * are relative, e.g., live, op.PLUS.peak, tag.HornifyModule
+     */
+    template <typename F>
+    void forEach (F f) const
+    {
+      std::unique_lock<std::mutex> l (m_lock, std::defer_lock);
+      if (m_concurrent) l.lock ();
+      
+      f ("live", m_all.live);
+      f ("peak", m_all.peak);
+      f ("total", m_all.total);
+      f ("bytes", m_allocator.bytes ());
+      f ("peak_bytes", m_allocator.peakBytes ());
+      f ("strings", StringPool::size ());
+      f ("string_bytes", StringPool::bytes ());
+      for (size_t i = 0; i < m_ops.size (); ++i)
+      {
+        if (m_ops [i].total == 0) continue;
+        f ("op." + m_opNames [i] + ".live", m_ops [i].live);
+        f ("op." + m_opNames [i] + ".peak", m_ops [i].peak);
+        f ("op." + m_opNames [i] + ".total", m_ops [i].total);
+      }
+      // -- merge tags with the same name at different addresses
+      std::map<std::string, size_t> tags;
+      for (auto &kv : m_tags) tags [kv.first] += kv.second;
+      for (auto &kv : tags) f ("tag." + kv.first, kv.second);
+      for (auto &kv : m_formulas)
+      {
+        f ("formula." + kv.first + ".dag", kv.second.dag);
+        f ("formula." + kv.first + ".tree", kv.second.tree);
+      }
+    }
+
+    template <typename OutputStream>
+    void Print (OutputStream &OS) const
+    {
+      forEach ([&OS] (const std::string &name, size_t v) 
+               { OS << name << ": " << v << "\n"; });
+    }
+  };
+
+  /**
+   * Attributes the nodes created by the current thread while the
+   * scope is alive to a tag. Tags must be string literals (or
+   * otherwise outlive the profile). Scopes nest.
+   * Usage: ExprProfileScope _p ("HornifyFunction");
+   */
+  class ExprProfileScope : boost::noncopyable
+  {
+    const char *m_prev;
+  public:
+    ExprProfileScope (const char *tag) : m_prev (ExprFactoryProfile::currentTag ())
+    { ExprFactoryProfile::currentTag () = tag; }
+    ~ExprProfileScope () { ExprFactoryProfile::currentTag () = m_prev; }
+  };
+
   class ExprFactory : boost::noncopyable
   {
   protected:
 
-#define UNORDERED_SET_UNIQUE_TABLE 1
-#ifndef UNORDERED_SET_UNIQUE_TABLE
-    // -- type of unique table entry
-    typedef std::set<ENode*,LessENode> unique_entry_type;
+#ifdef EXPR_LEGACY_UNIQUE_TABLE
+    /// -- unique table indexed by the name of the type of the
+    /// -- operator. Kept to benchmark against the current layout
+    struct unique_type
+    {
+      typedef std::unordered_set<ENode*, 
+                                 ENodeUniqueHash, 
+                                 ENodeUniqueEqual> entry_type;
+      std::map<const char*, entry_type> m_map;
+      
+      ENode *insert (ENode *v, size_t h)
+      { return *m_map [typeid (v->op ()).name ()].insert (v).first; }
+      
+      void erase (ENode *v, size_t h)
+      {
+        auto it = m_map.find (typeid (v->op ()).name ());
+        // -- can only remove things that have been inserted before
+        assert (it != m_map.end ());
+        it->second.erase (v);
+        if (it->second.empty ()) m_map.erase (it);
+      }
+
+      template <typename F>
+      void forEach (F f) const
+      { for (auto &kv : m_map) for (ENode *n : kv.second) f (n); }
+
+      size_t size () const
+      {
+        size_t res = 0;
+        for (auto &kv : m_map) res += kv.second.size ();
+        return res;
+      }
+      /** room for a share nodes/total of the nodes of every table */
+      void reserve (size_t nodes, size_t total)
+      {
+        for (auto &kv : m_map) 
+          kv.second.reserve (nodes * kv.second.size () / total);
+      }
+    };
 #else
-    typedef std::unordered_set<ENode*, 
-                               ENodeUniqueHash, 
-                               ENodeUniqueEqual> unique_entry_type;
+    /// -- unique table with one open-addressing table per operator
+    /// -- type, indexed by the dense id of the type
+    struct unique_type
+    {
+      std::vector<ENodeOpenTable> m_tables;
+      
+      ENode *insert (ENode *v, size_t h)
+      {
+        unsigned id = v->op ().typeId ();
+        if (id >= m_tables.size ()) m_tables.resize (id + 1);
+        return m_tables [id].insert (v, h);
+      }
+      
+      void erase (ENode *v, size_t h)
+      {
+        unsigned id = v->op ().typeId ();
+        // -- can only remove things that have been inserted before
+        assert (id < m_tables.size ());
+        m_tables [id].erase (v, h);
+      }
+
+      template <typename F>
+      void forEach (F f) const
+      { for (const ENodeOpenTable &t : m_tables) t.forEach (f); }
+
+      size_t size () const
+      {
+        size_t res = 0;
+        for (const ENodeOpenTable &t : m_tables) res += t.size ();
+        return res;
+      }
+      /** room for a share nodes/total of the nodes of every table */
+      void reserve (size_t nodes, size_t total)
+      {
+        for (ENodeOpenTable &t : m_tables) 
+          if (!t.empty ()) t.reserve (nodes * t.size () / total);
+      }
+    };
 #endif
-    typedef const char* unique_key_type;
-    // -- type of the unique table
-    typedef std::map<unique_key_type,unique_entry_type> unique_type;
+
+    /** A shard of the unique table. In sequential mode only the
+        first shard is used and the lock is never taken */
+    struct UniqueShard
+    {
+      unique_type unique;
+      std::mutex lock;
+    };
+    
+    /** number of shards of the unique table in concurrent mode */
+    static const unsigned num_shards = 64;
 
     typedef boost::ptr_vector<CacheStub> caches_type;
     
+    /** true if the factory can be used by several threads at once */
+    const bool m_concurrent;
+    /** true if the factory is a region, see ExprFactory () */
+    const bool m_region;
 
     /** pool allocator */
     ExprFactoryAllocator allocator;
 
     /** list of registered caches */
     caches_type caches;
+    /** protects caches in concurrent mode. Recursive since a cache
+        may release expressions while being cleared */
+    std::recursive_mutex m_caches_lock;
     
     // -- unique table
-    unique_type unique;
+    std::array<UniqueShard, num_shards> m_shards;
 
     /** counter for assigning unique ids*/
-    unsigned int idCount;
+    std::atomic<unsigned int> idCount;
+
+    /** node accounting. NULL unless profiling is enabled */
+    std::unique_ptr<ExprFactoryProfile> m_profile;
     
     /** returns a unique id > 0 */
     unsigned int uniqueId () { return ++idCount; }
+
+    /** the shard of the unique table that owns a node with hash h */
+    UniqueShard &shard (size_t h)
+    {
+      if (!m_concurrent) return m_shards [0];
+      // -- low bits index the open-addressing tables, use high ones
+      return m_shards [(static_cast<uint64_t> (h) >> 40) % num_shards];
+    }
+    
+    /** 
+     * Remove val from unique table. Must be called with the lock of
+     * the shard of val held in concurrent mode.
+     */
+    void uniqueErase (UniqueShard &s, ENode *val, size_t h)
+    { s.unique.erase (val, h); }
     
     /** 
      * Remove value from unique table
      */
     void Remove (ENode *val)
     { 
+      if (m_profile) m_profile->destroyed (val->op ());
       clearCaches (val);
-      if (!val->isMutable ())
-	{
-	  unique_type::iterator it = unique.find (typeid (val->op ()).name ());
-	  // -- can only remove things that have been inserted before
-	  assert (it != unique.end ());
-	  it->second.erase (val);
-	  if (it->second.empty ()) unique.erase (it);
-	}
-
+      if (!val->isMutable ()) 
+      {
+        assert (!m_concurrent);
+        uniqueErase (m_shards [0], val, val->hash ());
+      }
       freeNode (val);
     }
 
     /**
      * Clear val from all registered caches
      */
-    void clearCaches (ENode *val) { for (CacheStub &c : caches) c.erase (val); }
+    void clearCaches (ENode *val) 
+    { 
+      if (m_concurrent)
+      {
+        std::lock_guard<std::recursive_mutex> _l (m_caches_lock);
+        for (CacheStub &c : caches) c.erase (val); 
+      }
+      else
+        for (CacheStub &c : caches) c.erase (val); 
+    }
     
     
 
     /**
-     * Return the canonical (unique) representetive of the input
+     * Return the canonical (unique) representetive of the input. The
+     * result is referenced on behalf of the caller. 
      */
     ENode* canonize (ENode* v)
     {
+      v->setHash ();
       if (v->isMutable ()) 
 	{
 	  v->setId (uniqueId ());
+          v->Ref ();
+          if (m_profile) m_profile->created (v->op ());
 	  return v;
 	}
       
-
-      std::pair<unique_entry_type::iterator,bool> x = 
-	unique [typeid (v->op ()).name ()].insert (v);
-      if (x.second) 
+      size_t h = v->hash ();
+      UniqueShard &s = shard (h);
+      std::unique_lock<std::mutex> l (s.lock, std::defer_lock);
+      if (m_concurrent) l.lock ();
+      
+      ENode *res = s.unique.insert (v, h);
+      // -- reference the result while the shard is locked so that it
+      // -- cannot be removed by a concurrent Deref
+      res->Ref ();
+      if (res == v) 
 	{ 
 	  v->setId (uniqueId ());
+          if (m_profile) m_profile->created (v->op ());
 	  return v;
 	}
-      else
-	{
-	  freeNode (v);
-	  return *x.first;
-	}
+
+      if (l.owns_lock ()) l.unlock ();
+      freeNode (v);
+      return res;
     }
 
     ENode* mkExpr (const Operator &op)
@@ -494,35 +1150,104 @@ namespace expr
 
 
 #define FREE_LIST_MAX_SIZE 1024*4
+    /** list of free nodes. Not used in concurrent mode */
     std::vector<ENode*> freeList;
+    /** frees a garbage node. Kids that become garbage are freed
+        iteratively so that deep expressions do not exhaust the stack */
     void freeNode (ENode *n);
+    /** frees n and dereferences its kids */
+    void releaseNode (ENode *n);
     ENode *allocNode (const Operator &op);
+    /** frees every node of a region at once */
+    void releaseRegion ();
 
-    
+    void concurrentDeref (ENode *val);
 
 
   public:
-    ExprFactory () : idCount(0) {}
+    /**
+     * When concurrent is true, the factory (including reference
+     * counting of its expressions) is safe to use from several
+     * threads at once. Registered caches are not protected and
+     * must be synchronized by their owners.
+     *
+     * When region is true, the factory is scoped to a job: a node
+     * that becomes garbage stays in the factory, so that dropping an
+     * expression is a decrement, until compact () or the destruction
+     * of the factory, which frees all nodes at once. Every
+     * expression of a region must be dropped before the region is
+     * destroyed.
+     */
+    ExprFactory (bool concurrent = false, bool region = false) : 
+      m_concurrent (concurrent), m_region (region), allocator (concurrent), 
+      idCount(0) {}
+    ~ExprFactory ();
+
+    bool isConcurrent () const { return m_concurrent; }
+    bool isRegion () const { return m_region; }
+    /** bytes of the allocator, see ExprFactoryAllocator::bytes
+        (). Can be read from any thread */
+    size_t bytes () const { return allocator.bytes (); }
 
+    /**
+     * Frees the garbage nodes, and the nodes kept for reuse. In a
+     * region, these are all the nodes that are no longer referenced.
+     * Not thread-safe with respect to other uses of the factory.
+     * Returns the number of nodes freed.
+     */
+    size_t compact ();
+
+    /**
+     * Makes room for nodes more nodes in the allocator, and in the
+     * unique table by the share of every operator of the nodes so
+     * far, so that building them does not rehash. Not thread-safe
+     * with respect to other uses of the factory.
+     */
+    void reserve (size_t nodes)
+    {
+      size_t total = 0;
+      for (UniqueShard &s : m_shards) total += s.unique.size ();
+      if (total > 0)
+        for (UniqueShard &s : m_shards) s.unique.reserve (nodes + total, total);
+      allocator.reserve (nodes);
+    }
+
+    /** 
+     * Starts (or stops) accounting of nodes. Nodes that exist when
+     * profiling is enabled are not accounted for. Not thread-safe
+     * with respect to other uses of the factory.
+     */
+    void enableProfiling (bool v = true)
+    {
+      if (!v) m_profile.reset ();
+      else if (!m_profile) 
+        m_profile.reset (new ExprFactoryProfile (allocator, m_concurrent));
+    }
+    /** the profile, or NULL if profiling is not enabled */
+    ExprFactoryProfile *getProfile () const { return m_profile.get (); }
+    
     /** Derefernce a value */
     void Deref (ENode* val)
     {
+      if (m_concurrent) { concurrentDeref (val); return; }
+      
       val->Deref ();
-      if (val->isGarbage ()) Remove (val);
+      // -- garbage of a region is freed by compact ()
+      if (val->isGarbage () && (!m_region || val->isMutable ())) Remove (val);
     }
 
     /** User functions */
-    Expr mkTerm (const Operator &o) { return Expr (mkExpr (o)); }
+    Expr mkTerm (const Operator &o) { return Expr (mkExpr (o), false); }
     Expr mkUnary (const Operator &o, Expr e) 
-    { return Expr (mkExpr (o, e.get ())); }
+    { return Expr (mkExpr (o, e.get ()), false); }
     Expr mkBin (const Operator &o, Expr e1, Expr e2)
-    { return Expr (mkExpr (o, e1.get (), e2.get ())); }
+    { return Expr (mkExpr (o, e1.get (), e2.get ()), false); }
     Expr mkTern (const Operator &o, Expr e1, Expr e2, 
 		 Expr e3)
-    { return Expr (mkExpr (o, e1.get (), e2.get (), e3.get ())); }
+    { return Expr (mkExpr (o, e1.get (), e2.get (), e3.get ()), false); }
     template <typename iterator>
     Expr mkNary (const Operator &o, iterator b, iterator e)
-    { return Expr (mkNExpr (o, b, e)); }
+    { return Expr (mkNExpr (o, b, e), false); }
     
     template <typename Range>
     Expr mkNary (const Operator &o, const Range &r)
@@ -534,6 +1259,8 @@ namespace expr
     {
       // -- to avoid double registration
       unregisterCache (cache);
+      std::unique_lock<std::recursive_mutex> l (m_caches_lock, std::defer_lock);
+      if (m_concurrent) l.lock ();
       caches.push_back (static_cast<CacheStub*> (new CacheStubTmpl<Cache> (cache)));
     }
     
@@ -541,6 +1268,8 @@ namespace expr
     bool unregisterCache (const Cache &cache)
     {
       const void *ptr = static_cast<const void*> (&cache);
+      std::unique_lock<std::recursive_mutex> l (m_caches_lock, std::defer_lock);
+      if (m_concurrent) l.lock ();
       
       for (caches_type::iterator it = caches.begin (), end = caches.end ();
 	   it != end; ++it)
@@ -557,9 +1286,7 @@ namespace expr
 
   inline ENode::ENode (ExprFactory &f, const Operator &o) :
     count(0), fac(&f), 
-    oper(o.clone (f.allocator), 
-	 f.allocator.get_deleter (),
-	 boost::pool_allocator<char> ()) {}
+    oper(o.clone (f.allocator)), hashCode(0) {}
 }
 
 inline void * operator new (size_t n, expr::ExprFactoryAllocator &alloc)
@@ -570,61 +1297,325 @@ inline void operator delete (void *p, expr::ExprFactoryAllocator &alloc)
 
 namespace expr
 {
-  inline void ExprFactory::freeNode (ENode *n)
+  inline void ENode::Ref ()
   {
-    if (freeList.size () < FREE_LIST_MAX_SIZE) 
-      {      
-	for (ENode *a : n->args) Deref (a);
-	n->args.clear ();
-	n->oper.reset ();
+    if (fac->isConcurrent ()) count.fetch_add (1, std::memory_order_relaxed);
+    else count.store (count.load (std::memory_order_relaxed) + 1, 
+                      std::memory_order_relaxed);
+  }
+  
+  inline unsigned int ENode::Deref ()
+  {
+    if (fac->isConcurrent ()) 
+      return count.fetch_sub (1, std::memory_order_acq_rel) - 1;
 
-	if (freeList.size () < FREE_LIST_MAX_SIZE) 
-	  { 
-	    assert (n->count == 0);
-	    freeList.push_back (n);
-	    return;
-	  }
-      }
+    unsigned int c = count.load (std::memory_order_relaxed);
+    if (c > 0) count.store (--c, std::memory_order_relaxed);
+    return c;
+  }
+
+  inline void ExprFactory::concurrentDeref (ENode *val)
+  {
+    // -- fast path: val is not about to become garbage
+    unsigned int c = val->count.load (std::memory_order_relaxed);
+    while (c > 1)
+      if (val->count.compare_exchange_weak (c, c - 1, 
+                                            std::memory_order_acq_rel))
+        return;
+    
+    // -- garbage of a region stays in the unique table, where
+    // -- canonize () can resurrect it
+    if (m_region && !val->isMutable ()) { val->Deref (); return; }
 
+    if (val->isMutable ())
+    {
+      // -- mutable nodes are not in the unique table and cannot be
+      // -- resurrected
+      if (val->Deref () == 0) 
+      {
+        if (m_profile) m_profile->destroyed (val->op ());
+        clearCaches (val);
+        freeNode (val);
+      }
+      return;
+    }
+    
+    // -- slow path. The last reference is dropped while holding the
+    // -- lock of the shard so that canonize() cannot resurrect the node
+    size_t h = val->hash ();
+    UniqueShard &s = shard (h);
+    {
+      std::lock_guard<std::mutex> _l (s.lock);
+      if (val->Deref () > 0) return;
+      uniqueErase (s, val, h);
+    }
+    
+    if (m_profile) m_profile->destroyed (val->op ());
+    clearCaches (val);
+    freeNode (val);
+  }
+  
+  /** garbage nodes waiting to be released by the current thread */
+  struct FreeWorklist
+  {
+    std::vector<ENode*> nodes;
+    /** true while the worklist is being drained */
+    bool active;
+    FreeWorklist () : active (false) {}
+  };
+  
+  inline FreeWorklist &freeWorklist ()
+  {
+    static thread_local FreeWorklist w;
+    return w;
+  }
+  
+  inline void ExprFactory::freeNode (ENode *n)
+  {
+    assert (n->isGarbage ());
+    FreeWorklist &w = freeWorklist ();
+    w.nodes.push_back (n);
+    // -- called while releasing the kids of another node
+    if (w.active) return;
+    
+    w.active = true;
+    while (!w.nodes.empty ())
+    {
+      ENode *g = w.nodes.back ();
+      w.nodes.pop_back ();
+      g->efac ().releaseNode (g);
+    }
+    w.active = false;
+  }
+  
+  inline void ExprFactory::releaseNode (ENode *n)
+  {
+    for (ENode *a : n->args) Deref (a);
+    n->args.clear ();
+    n->releaseOp ();
+      
+    if (!m_concurrent && freeList.size () < FREE_LIST_MAX_SIZE) 
+    { 
+      freeList.push_back (n); 
+      return;
+    }
+    
+    n->~ENode ();
     operator delete (static_cast<void*>(n), allocator);
   }
 
+  inline ExprFactory::~ExprFactory ()
+  {
+    if (m_region) { releaseRegion (); return; }
+    
+    for (ENode *n : freeList)
+    {
+      n->~ENode ();
+      operator delete (static_cast<void*>(n), allocator);
+    }
+  }
+
+  inline void ExprFactory::releaseRegion ()
+  {
+    // -- no reference counts, caches or unique table to update: the
+    // -- operators are destroyed, and the pools freed at once
+    for (UniqueShard &s : m_shards)
+      s.unique.forEach ([] (ENode *n) 
+                        { 
+                          n->args.clear (); 
+                          n->~ENode (); 
+                        });
+    for (ENode *n : freeList) n->~ENode ();
+    freeList.clear ();
+    allocator.purge ();
+  }
+
+  inline size_t ExprFactory::compact ()
+  {
+    size_t res = 0;
+    if (m_region)
+    {
+      std::vector<ENode*> garbage;
+      for (UniqueShard &s : m_shards)
+        s.unique.forEach ([&garbage] (ENode *n) 
+                          { if (n->isGarbage ()) garbage.push_back (n); });
+      
+      // -- kids that become garbage are freed with their parents
+      while (!garbage.empty ())
+      {
+        ENode *g = garbage.back ();
+        garbage.pop_back ();
+        for (ENode *a : g->args)
+        {
+          if (a->isMutable ()) Deref (a);
+          else if (a->Deref () == 0) garbage.push_back (a);
+        }
+        g->args.clear ();
+        
+        uniqueErase (shard (g->hash ()), g, g->hash ());
+        if (m_profile) m_profile->destroyed (g->op ());
+        clearCaches (g);
+        g->~ENode ();
+        operator delete (static_cast<void*>(g), allocator);
+        ++res;
+      }
+    }
+    
+    for (ENode *n : freeList)
+    {
+      n->~ENode ();
+      operator delete (static_cast<void*>(n), allocator);
+    }
+    res += freeList.size ();
+    std::vector<ENode*> ().swap (freeList);
+    return res;
+  }
+
   inline ENode *ExprFactory::allocNode (const Operator &op)
   {
-    if (freeList.empty ())
+    if (m_concurrent || freeList.empty ())
       return new(allocator) ENode (*this, op);
       
     ENode *res = freeList.back ();
     freeList.pop_back ();
-    res->oper.reset (op.clone (allocator), 
-		     allocator.get_deleter (),
-		     boost::pool_allocator<char> ());
+    res->oper = op.clone (allocator);
     assert (res->count == 0);
     return res;
   }
     
 
-  inline void *ExprFactoryAllocator::allocate (size_t n)
+  inline void *EFAArena::allocate (size_t n)
   { 
+    assert (n <= small.get_requested_size ());
     if (n <= tiny.get_requested_size ()) return tiny.malloc ();
-    else if (n <= small.get_requested_size ()) return small.malloc ();
+    return small.malloc ();
+  }
+
+  inline size_t EFAArena::free (void *block)
+  {
+    if (tiny.is_from (block)) 
+    {
+      tiny.free (block);
+      return tiny.get_requested_size ();
+    }
+    if (small.is_from (block)) 
+    {
+      small.free (block);
+      return small.get_requested_size ();
+    }
+    return 0;
+  }
+
+  inline unsigned ExprFactoryAllocator::threadArena ()
+  {
+    static std::atomic<unsigned> next (0);
+    static thread_local unsigned idx = next++ % num_arenas;
+    return idx;
+  }
+
+  inline void *ExprFactoryAllocator::allocateLarge (size_t n)
+  {
+    char *block = new char [n + large_header];
+    *reinterpret_cast<size_t*> (block) = n;
+    return static_cast<void*> (block + large_header);
+  }
+
+  inline size_t ExprFactoryAllocator::freeLarge (void *block)
+  {
+    char *b = static_cast<char*> (block) - large_header;
+    size_t n = *reinterpret_cast<size_t*> (b);
+    delete [] b;
+    return n;
+  }
+
+  inline void ExprFactoryAllocator::addBytes (size_t n)
+  {
+    size_t v;
+    if (isConcurrent ()) 
+      v = m_bytes.fetch_add (n, std::memory_order_relaxed) + n;
+    else
+    {
+      v = m_bytes.load (std::memory_order_relaxed) + n;
+      m_bytes.store (v, std::memory_order_relaxed);
+    }
+
+    size_t p = m_peakBytes.load (std::memory_order_relaxed);
+    while (v > p && 
+           !m_peakBytes.compare_exchange_weak (p, v, std::memory_order_relaxed));
+  }
+
+  inline void ExprFactoryAllocator::subBytes (size_t n)
+  {
+    if (isConcurrent ()) m_bytes.fetch_sub (n, std::memory_order_relaxed);
+    else m_bytes.store (m_bytes.load (std::memory_order_relaxed) - n, 
+                        std::memory_order_relaxed);
+  }
+
+  inline void *ExprFactoryAllocator::allocate (size_t n)
+  { 
+    if (n > m_arena.small.get_requested_size ())
+    {
+      addBytes (n);
+      return allocateLarge (n);
+    }
+    
+    addBytes (n <= m_arena.tiny.get_requested_size () ? 
+              m_arena.tiny.get_requested_size () : 
+              m_arena.small.get_requested_size ());
     
-    return static_cast<void*> (new char[n]);
+    if (!isConcurrent ()) return m_arena.allocate (n);
+
+    EFAArena &a = m_arenas [threadArena ()];
+    std::lock_guard<std::mutex> _l (a.lock);
+    return a.allocate (n);
   }
 
 
   inline void ExprFactoryAllocator::free (void *block) 
   { 
-    if (tiny.is_from (block)) tiny.free (block);
-    else if (small.is_from (block)) small.free (block);
-    else delete [] static_cast<char * const> (block); 
+    size_t n = 0;
+    if (!isConcurrent ())
+      n = m_arena.free (block);
+    else
+    {
+      // -- blocks are usually freed by the thread that allocated them,
+      // -- so start with the arena of the current thread
+      unsigned start = threadArena ();
+      for (unsigned i = 0; n == 0 && i < num_arenas; ++i)
+      {
+        EFAArena &a = m_arenas [(start + i) % num_arenas];
+        std::lock_guard<std::mutex> _l (a.lock);
+        n = a.free (block);
+      }
+    }
+    
+    if (n == 0) n = freeLarge (block);
+    subBytes (n);
   }  
 
+  inline void ExprFactoryAllocator::purge ()
+  {
+    m_arena.purge ();
+    if (isConcurrent ())
+      for (unsigned i = 0; i < num_arenas; ++i) m_arenas [i].purge ();
+    m_bytes.store (0, std::memory_order_relaxed);
+  }
+
+  inline void ExprFactoryAllocator::reserve (size_t n)
+  {
+    if (!isConcurrent ()) { m_arena.reserve (n); return; }
+    for (unsigned i = 0; i < num_arenas; ++i) 
+      m_arenas [i].reserve (n / num_arenas + 1);
+  }
+
   inline EFADeleter ExprFactoryAllocator::get_deleter () 
   { return EFADeleter (*this); }
 
-  inline void EFADeleter::operator() (void *p)
-  { operator delete (p, m_efa); }
+  inline void EFADeleter::operator() (Operator *p)
+  { 
+    p->~Operator ();
+    operator delete (static_cast<void*> (p), m_efa); 
+  }
 
   template <typename T>
   struct TerminalTrait {};
@@ -649,7 +1640,7 @@ namespace expr
     
 
     void Print (std::ostream &OS, 
-		const std::vector<ENode*> &args,
+		const ENodeArgs &args,
 		int depth = 0, 
 		bool brkt = true) const
     {
@@ -684,7 +1675,8 @@ namespace expr
     }
 
     size_t hash () const { return terminal_type::hash (val); }
-    
+
+    unsigned typeId () const { return opKind<this_type> (); }
   };
 
   template<> struct TerminalTrait<std::string>
@@ -705,6 +1697,71 @@ namespace expr
     
   };
 
+  /**
+   * Terminal of a string, i.e., of the name of a symbol. The string
+   * is interned in the StringPool and the terminal only holds its
+   * id, so that probes of the unique table hash and compare names in
+   * constant time however long they are. Ordering still compares
+   * the strings, so that sorting by name is unchanged.
+   */
+  template <>
+  class Terminal<std::string, TerminalTrait<std::string> > : public Operator
+  {
+  public:
+    typedef std::string base_type;
+    typedef TerminalTrait<std::string> terminal_type;
+    typedef Terminal<std::string, terminal_type> this_type;
+
+  protected:
+    StringPool::Id m_id;
+
+  public:
+    Terminal (const base_type &v) : m_id (StringPool::intern (v)) {}
+    Terminal (const this_type &o) : Operator (), m_id (o.m_id) {}
+
+    const base_type &get () const { return m_id->first; }
+    /** the interned id. Equal strings have equal ids */
+    StringPool::Id id () const { return m_id; }
+
+    this_type* clone (ExprFactoryAllocator &allocator) const
+    { return new (allocator) this_type (*this); }
+
+    void Print (std::ostream &OS,
+		const ENodeArgs &args,
+		int depth = 0,
+		bool brkt = true) const
+    { terminal_type::print (OS, get (), depth, brkt); }
+
+    bool operator== (const this_type &rhs) const
+    { return m_id == rhs.m_id; }
+
+    bool operator< (const this_type &rhs) const
+    { return m_id != rhs.m_id && get () < rhs.get (); }
+
+    bool operator== (const Operator& rhs) const
+    {
+      if (&rhs == this) return true;
+
+      const this_type *prhs = dynamic_cast<const this_type*> (&rhs);
+      return prhs != NULL && m_id == prhs->m_id;
+    }
+
+    bool operator< (const Operator& rhs) const
+    {
+      // x < x is false
+      if (&rhs == this) return false;
+
+      const this_type *prhs = dynamic_cast<const this_type*> (&rhs);
+
+      return (prhs == NULL) ?
+	typeid(this_type).before (typeid (rhs)) : *this < *prhs;
+    }
+
+    size_t hash () const { return m_id->second; }
+
+    unsigned typeId () const { return opKind<this_type> (); }
+  };
+
   template<> struct TerminalTrait<int>
   {
     static inline void print (std::ostream &OS, int s, int depth, bool brkt)
@@ -775,16 +1832,113 @@ namespace expr
     static inline bool equal_to (const mpz_class &v1, const mpz_class &v2)
     { return v1 == v2; }
     
-    static inline size_t hash (const mpz_class &v)
+    static inline size_t hash (const mpz_class &v)
+    {
+      std::string str = boost::lexical_cast<std::string> (v);
+      std::hash<std::string> hasher;
+      return hasher (str);
+    }
+    
+    
+
+
+  };
+
+  /**
+   * Terminal of an arbitrary precision integer. Values that fit a
+   * signed machine word are kept unboxed, so that creating, hashing
+   * and comparing small constants does not go through GMP. Larger
+   * values are boxed in an mpz_class. The representation is
+   * canonical and get() promotes to mpz_class on demand.
+   */
+  template <>
+  class Terminal<mpz_class, TerminalTrait<mpz_class> > : public Operator
+  {
+  public:
+    typedef mpz_class base_type;
+    typedef TerminalTrait<mpz_class> terminal_type;
+    typedef Terminal<mpz_class, terminal_type> this_type;
+    
+  protected:
+    /** the value if it fits a word */
+    long m_word;
+    /** the value if it does not fit a word. NULL otherwise */
+    std::unique_ptr<mpz_class> m_big;
+    
+  public:
+    Terminal (const base_type &v) : m_word (0)
+    {
+      if (v.fits_slong_p ()) m_word = v.get_si ();
+      else m_big.reset (new mpz_class (v));
+    }
+    Terminal (int v) : m_word (v) {}
+    Terminal (unsigned int v) : m_word (v) {}
+    Terminal (long v) : m_word (v) {}
+    Terminal (unsigned long v) : m_word (0)
+    {
+      if (v <= static_cast<unsigned long> (LONG_MAX)) 
+        m_word = static_cast<long> (v);
+      else m_big.reset (new mpz_class (v));
+    }
+    Terminal (const this_type &o) : Operator (), m_word (o.m_word)
+    { if (o.m_big) m_big.reset (new mpz_class (*o.m_big)); }
+
+    base_type get () const { return m_big ? *m_big : mpz_class (m_word); }
+    
+    /** true if the value is unboxed. Then the value is word () */
+    bool isWord () const { return !m_big; }
+    long word () const { return m_word; }
+    
+    this_type* clone (ExprFactoryAllocator &allocator) const
+    { return new (allocator) this_type (*this); }
+    
+    void Print (std::ostream &OS, 
+		const ENodeArgs &args,
+		int depth = 0, 
+		bool brkt = true) const
+    { terminal_type::print (OS, get (), depth, brkt); }
+    
+    bool operator== (const this_type &rhs) const
     {
-      std::string str = boost::lexical_cast<std::string> (v);
-      std::hash<std::string> hasher;
-      return hasher (str);
+      if (m_big && rhs.m_big) return *m_big == *rhs.m_big;
+      return !m_big && !rhs.m_big && m_word == rhs.m_word;
+    }
+
+    bool operator< (const this_type &rhs) const
+    {
+      if (!m_big && !rhs.m_big) return m_word < rhs.m_word;
+      if (m_big && rhs.m_big) return *m_big < *rhs.m_big;
+      return m_big ? mpz_cmp_si (m_big->get_mpz_t (), rhs.m_word) < 0 :
+        mpz_cmp_si (rhs.m_big->get_mpz_t (), m_word) > 0;
     }
     
+    bool operator== (const Operator& rhs) const
+    {
+      if (&rhs == this) return true;
+
+      const this_type *prhs = dynamic_cast<const this_type*> (&rhs);
+      return prhs != NULL && *this == *prhs;
+    }
+
+    bool operator< (const Operator& rhs) const
+    {
+      // x < x is false
+      if (&rhs == this) return false;
+
+      const this_type *prhs = dynamic_cast<const this_type*> (&rhs);
     
+      return (prhs == NULL) ? 
+	typeid(this_type).before (typeid (rhs)) : *this < *prhs;
+    }
 
+    size_t hash () const 
+    { 
+      if (m_big) return terminal_type::hash (*m_big);
+      std::hash<long> hasher;
+      return hasher (m_word);
+    }
 
+    unsigned typeId () const { return opKind<this_type> (); }
   };
 
 
@@ -835,7 +1989,7 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	if (args.size () >= 2) OS << "[";
 	if (args.size () == 1 && brkt) OS << "(";
@@ -852,7 +2006,7 @@ namespace expr
 	  }
 	  
 
-	for (std::vector<ENode*>::const_iterator it = args.begin (), 
+	for (ENodeArgs::const_iterator it = args.begin (), 
 	       end = args.end (); it != end; ++it)
 	  {
 	    OS << "\n";
@@ -873,7 +2027,7 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	
 	if (args.size () != 2) 
@@ -898,13 +2052,13 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	OS << name << "(";
       
 	
 	bool first = true;
-	for (std::vector<ENode*>::const_iterator it = args.begin (), 
+	for (ENodeArgs::const_iterator it = args.begin (), 
 	       end = args.end (); it != end; ++it)
 	  {
 	    if (!first) OS << ", ";
@@ -922,12 +2076,12 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	OS << "(" << name << " ";
       
 	bool first = true;
-	for (std::vector<ENode*>::const_iterator it = args.begin (), 
+	for (ENodeArgs::const_iterator it = args.begin (), 
 	       end = args.end (); it != end; ++it)
 	  {
 	    if (!first) OS << " ";
@@ -988,19 +2142,22 @@ namespace expr
     typedef P ps_type;
     
     void Print (std::ostream &OS, 
-		const std::vector<ENode*> &args,
+		const ENodeArgs &args,
 		int depth = 0, 
 		bool brkt = true) const
     { ps_type::print (OS, depth, brkt, op_type::name (), args);  }
 
     bool operator== (const Operator& rhs) const
-    { return typeid (*this) == typeid (rhs); }
+    { return typeId () == rhs.typeId (); }
 
 
     bool operator< (const Operator& rhs) const
     { return typeLT (this, &rhs); }
 
     size_t hash () const { return typeHash (this); }
+
+    unsigned typeId () const { return opKind<this_type> (); }
+    unsigned familyId () const { return opKind<base_type> (); }
     
     this_type * clone (ExprFactoryAllocator &allocator) const 
     { return new (allocator) this_type (*this); }
@@ -1012,6 +2169,35 @@ namespace expr
     for (args_iterator b = args.begin (), e = args.end ();
 	 b != e; ++b)
       efac().Deref (*b);
+    releaseOp ();
+  }
+
+  inline void ENode::releaseOp ()
+  {
+    if (!oper) return;
+    fac->allocator.get_deleter () (oper);
+    oper = NULL;
+  }
+
+  inline size_t ENode::structuralHash () const
+  {
+    size_t res = op ().hash ();
+    
+    size_t a = arity ();
+    if (a >= 1) boost::hash_combine (res, *args_begin ());
+    if (a >= 2)
+      boost::hash_combine (res, boost::hash_range (args_begin (), args_end ()));
+    
+    // -- finalizer of MurmurHash3. Structural hashes of nodes are
+    // -- mostly combinations of aligned pointers, mix them so that
+    // -- both low and high bits can be used as an index
+    uint64_t h = res;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return static_cast<size_t> (h);
   }
 
 
@@ -1019,17 +2205,19 @@ namespace expr
   template <typename iterator>
   void ENode::renew_args (iterator b, iterator e)
   {
-    std::vector<ENode*> old = args;
-    args = std::vector<ENode*> ();
+    std::vector<ENode*> old (args.begin (), args.end ());
+    args.clear ();
     
     // -- increment reference count of all new arguments
     for (; b != e; ++b)
       this->push_back (eptr (*b));
     
+    // -- only mutable nodes change their arguments, they are not in
+    // -- the unique table
+    setHash ();
+    
     // -- decrement reference count of all old arguments
-    for (args_iterator b = old.begin (), e = old.end ();
-	 b != e; ++b)
-      efac().Deref (*b);
+    for (ENode *a : old) efac().Deref (a);
   }
 
 
@@ -1136,19 +2324,180 @@ namespace expr
 
   typedef std::unordered_map<ENode*,Expr> DagVisitCache;
 
-  template <typename ExprVisitor> 
-  Expr visit (ExprVisitor &v, Expr expr, DagVisitCache &cache)
+  /** Looks up expr in a cache of a single dagVisit call */
+  inline bool findVisited (DagVisitCache &cache, Expr expr, Expr &res)
+  {
+    if (expr->use_count () <= 1) return false;
+    
+    DagVisitCache::const_iterator cit = cache.find (&*expr);
+    if (cit == cache.end ()) return false;
+    res = cit->second;
+    return true;
+  }
+  
+  /** Records the result of visiting expr. Only shared nodes are
+      cached since others are not visited twice in a single call */
+  inline void addVisited (DagVisitCache &cache, Expr expr, Expr res)
   {
     if (expr->use_count () > 1)
       {
-	DagVisitCache::const_iterator cit 
-	  = cache.find (&*expr);
-	if (cit != cache.end ()) return cit->second;
+	expr->Ref ();
+	cache[&*expr] = res;
       }
+  }
+  
+  /**
+   * A memo table of the results of a visitor that persists across
+   * calls to dagVisit. The memo is identified with a single visitor:
+   * it is only sound for visitors whose result on a term does not
+   * change over the lifetime of the memo.
+   *
+   * Keys are weak. The memo is registered with the factory and an
+   * entry is evicted when its key is deleted. A result is referenced
+   * unless it is the key itself, so that terms mapped to themselves
+   * can still be reclaimed. A result that strictly contains its key
+   * keeps the key alive until the memo is cleared.
+   */
+  class DagVisitMemo : boost::noncopyable, public ufo::BudgetedCache
+  {
+    typedef std::unordered_map<ENode*,ENode*> memo_type;
+    
+    ExprFactory &m_efac;
+    memo_type m_memo;
+    /** only used if the factory is concurrent */
+    std::mutex m_lock;
+
+    std::unique_lock<std::mutex> lock ()
+    {
+      std::unique_lock<std::mutex> l (m_lock, std::defer_lock);
+      if (m_efac.isConcurrent ()) l.lock ();
+      return l;
+    }
     
+    /** locked, so any thread may flush it if the factory is concurrent */
+    size_t flush ()
+    {
+      size_t n = size ();
+      clear ();
+      return n;
+    }
+
+  public:
+    DagVisitMemo (ExprFactory &efac) :
+      ufo::BudgetedCache ("dagVisitMemo", efac.isConcurrent ()), m_efac (efac) 
+    { m_efac.registerCache (*this); }
+    ~DagVisitMemo () 
+    { 
+      leaveBudget ();
+      m_efac.unregisterCache (*this); 
+      clear ();
+    }
     
-    VisitAction va = v(expr);
+    ExprFactory &efac () { return m_efac; }
+    size_t size () 
+    { 
+      std::unique_lock<std::mutex> l = lock ();
+      return m_memo.size (); 
+    }
+    
+    bool find (Expr expr, Expr &res)
+    {
+      std::unique_lock<std::mutex> l = lock ();
+      memo_type::const_iterator it = m_memo.find (&*expr);
+      if (it == m_memo.end ()) return false;
+      res = Expr (it->second);
+      return true;
+    }
+    
+    void insert (Expr expr, Expr res)
+    {
+      // -- mutable nodes may change under the memo
+      if (expr->isMutable ()) return;
+      
+      poll ();
+      std::unique_lock<std::mutex> l = lock ();
+      if (m_memo.insert (std::make_pair (&*expr, &*res)).second &&
+	  res != expr)
+	res->Ref ();
+    }
+    
+    /** called by the factory when val is deleted */
+    void erase (ENode *val)
+    {
+      ENode *res;
+      {
+	std::unique_lock<std::mutex> l = lock ();
+	memo_type::iterator it = m_memo.find (val);
+	if (it == m_memo.end ()) return;
+	res = it->second;
+	m_memo.erase (it);
+      }
+      // -- may delete other keys of this memo
+      if (res != val) m_efac.Deref (res);
+    }
+    
+    void clear ()
+    {
+      memo_type memo;
+      {
+	std::unique_lock<std::mutex> l = lock ();
+	memo.swap (m_memo);
+      }
+      for (memo_type::value_type &kv : memo)
+	if (kv.second != kv.first) m_efac.Deref (kv.second);
+    }
+  };
+  
+  inline bool findVisited (DagVisitMemo &memo, Expr expr, Expr &res)
+  { return memo.find (expr, res); }
+  
+  inline void addVisited (DagVisitMemo &memo, Expr expr, Expr res)
+  { memo.insert (expr, res); }
+  
+  /** A cache that remembers nothing. Used by visit() without a cache */
+  struct NoVisitCache {};
+  
+  inline bool findVisited (NoVisitCache &, Expr, Expr &) { return false; }
+  inline void addVisited (NoVisitCache &, Expr, Expr) {}
+  
+  /** 
+   * A frame of the explicit stack of visit(). The kids of res are
+   * visited one by one and their results are kept in the result
+   * buffer starting at position base.
+   */
+  struct VisitFrame
+  {
+    /** the visited expression */
+    Expr expr;
+    /** the expression whose kids are visited */
+    Expr res;
+    VisitAction va;
+    /** position of the result of the first kid in the result buffer */
+    size_t base;
+    /** the next kid to visit */
+    size_t next;
+    
+    VisitFrame (Expr e, Expr r, const VisitAction &a, size_t b) :
+      expr (e), res (r), va (a), base (b), next (0) {}
+  };
+  
+  /** 
+   * Starts visiting expr. Either pushes the result of expr to the
+   * result buffer or a new frame to the stack if the kids of expr
+   * must be visited first.
+   */
+  template <typename ExprVisitor, typename Cache>
+  void visitEnter (ExprVisitor &v, Expr expr, Cache &cache,
+		   std::vector<VisitFrame> &stack, std::vector<Expr> &results)
+  {
     Expr res;
+    if (findVisited (cache, expr, res)) 
+      {
+	results.push_back (res);
+	return;
+      }
+    
+    VisitAction va = v(expr);
 
     if (va.isSkipKids ())
       res = expr;
@@ -1157,41 +2506,83 @@ namespace expr
     else
       {
 	res = va.isChangeDoKidsRewrite () ? va.getExpr () : expr;
-	if (res->arity () > 0) 
+	if (res->arity () > 0)
 	  {
-	    bool changed = false;
-            std::vector<Expr> kids;
-
-	    for (ENode::args_iterator b = res->args_begin (), 
-		   e = res->args_end (); 
-		 b != e; ++b)
-	      {
-		Expr k = visit (v, *b, cache);
-		kids.push_back (k);
-		changed  = (changed || k.get () != *b);
-	      }
-	    
-	    if (changed)
-	      {
-		if (!res->isMutable ())
-		  res = res->getFactory ().mkNary (res->op (),
-						   kids.begin (),
-						   kids.end ());
-		else
-		  res->renew_args (kids.begin (), kids.end ());
-	      }
+	    stack.push_back (VisitFrame (expr, res, va, results.size ()));
+	    return;
 	  }
-    
 	res = va.rewrite (res);
       }
-
-    if (expr->use_count () > 1)
+    
+    addVisited (cache, expr, res);
+    results.push_back (res);
+  }
+  
+  /** 
+   * Finishes visiting the expression of frame f once the results of
+   * all of its kids are in the result buffer
+   */
+  template <typename Cache>
+  void visitLeave (VisitFrame &f, Cache &cache, std::vector<Expr> &results)
+  {
+    typedef std::vector<Expr>::iterator iterator;
+    iterator kb = results.begin () + f.base;
+    
+    bool changed = false;
+    iterator k = kb;
+    for (ENode::args_iterator b = f.res->args_begin (), 
+	   e = f.res->args_end (); b != e; ++b, ++k)
+      changed  = (changed || k->get () != *b);
+    
+    Expr res = f.res;
+    if (changed)
       {
-	expr->Ref ();
-	cache[&*expr] = res;
+	if (!res->isMutable ())
+	  res = res->getFactory ().mkNary (res->op (), kb, results.end ());
+	else
+	  res->renew_args (kb, results.end ());
       }
     
-    return res;
+    res = f.va.rewrite (res);
+    results.erase (kb, results.end ());
+    
+    addVisited (cache, f.expr, res);
+    results.push_back (res);
+  }
+  
+  /** 
+   * Visits expr with v, caching the results of sub-terms in cache
+   * (either a DagVisitCache, a DagVisitMemo, or a NoVisitCache).
+   *
+   * The traversal uses an explicit stack so that deep expressions do
+   * not exhaust the C++ stack. The visitor is called in the same
+   * (pre-)order as by a recursive traversal.
+   */
+  template <typename ExprVisitor, typename Cache> 
+  Expr visit (ExprVisitor &v, Expr expr, Cache &cache)
+  {
+    std::vector<VisitFrame> stack;
+    std::vector<Expr> results;
+    
+    visitEnter (v, expr, cache, stack, results);
+    while (!stack.empty ())
+      {
+	VisitFrame &f = stack.back ();
+	if (f.next < f.res->arity ())
+	  {
+	    // -- f is invalidated by visitEnter
+	    Expr kid = f.res->arg (f.next++);
+	    visitEnter (v, kid, cache, stack, results);
+	  }
+	else
+	  {
+	    visitLeave (f, cache, results);
+	    stack.pop_back ();
+	  }
+      }
+    
+    assert (results.size () == 1);
+    return results.back ();
   }  
 
   inline void clearDagVisitCache (DagVisitCache &cache)
@@ -1230,44 +2621,17 @@ namespace expr
     for (auto &e : vec) e = dv (e);
   }
 
+  /** dagVisit that reuses (and extends) the results in memo */
+  template <typename ExprVisitor> 
+  Expr dagVisit (ExprVisitor &v, Expr expr, DagVisitMemo &memo)
+  { return visit (v, expr, memo); }
+
+  /** Visits expr with v without caching any results */
   template <typename ExprVisitor>
   Expr visit (ExprVisitor &v, Expr expr)
   {
-    VisitAction va = v (expr);
-    
-    if (va.isSkipKids ()) return expr;
-
-    if (va.isChangeTo ()) return va.getExpr ();
-    
-    Expr res = va.isChangeDoKidsRewrite () ? va.getExpr () : expr;
-    
-    if (res->arity () == 0) return va.rewrite (res);
-
-    bool changed = false;
-    std::vector<Expr> kids;
-
-    for (ENode::args_iterator b = res->args_begin (), 
-	   e = res->args_end (); 
-	 b != e; ++b)
-      {
-	Expr k = visit (v, *b);
-	kids.push_back (k);
-	changed  = (changed || k.get () != *b);
-      }
-
-    if (changed)
-      {
-	if (!res->isMutable ())
-	  res = res->getFactory ().mkNary (res->op (),
-					   kids.begin (),
-					   kids.end ());
-	else
-	  res->renew_args (kids.begin (), kids.end ());
-      }
-    
-    res = va.rewrite (res);
-
-    return res;
+    NoVisitCache cache;
+    return visit (v, expr, cache);
   }
 
   /**********************************************************************/
@@ -1280,19 +2644,50 @@ namespace expr
   /* Inspection */
   /**********************************************************************/
   
+  namespace op_test
+  {
+    template <typename T> struct voider { typedef void type; };
+
+    /// -- any operator type: tested with a dynamic cast
+    template <typename O, typename = void> struct IsOp
+    {
+      static bool test (const Operator &op) 
+      { return dynamic_cast<const O*> (&op) != NULL; }
+    };
+
+    /// -- a family declared with NOP_BASE: its operators are declared
+    /// -- with NOP directly over it
+    template <typename O> 
+    struct IsOp<O, typename std::enable_if<std::is_same<typename O::op_family, 
+                                                        O>::value>::type>
+    {
+      static bool test (const Operator &op) 
+      { return op.familyId () == opKind<O> (); }
+    };
+
+    /// -- an operator declared with NOP: nothing derives from it
+    template <typename O> 
+    struct IsOp<O, typename voider<typename O::ps_type>::type>
+    {
+      static bool test (const Operator &op) 
+      { return op.typeId () == opKind<O> (); }
+    };
+  }
+
   // -- usage isOp<TYPE>(EXPR) . Returns true if top operator of
   // -- expression is a subclass of TYPE.
   template <typename O, typename T> bool isOp (T e)
-  {
-    const Operator *op = & (eptr(e)->op ());
-    const O *top = dynamic_cast<const O*>(op);
-    return top != NULL;
-  }
+  { return op_test::IsOp<O>::test (eptr(e)->op ()); }
   
   // -- usage isOpX<TYPE>(EXPR) . Returns true if top operator of
   // -- expression is of type TYPE.    
   template <typename O, typename T> bool isOpX (T e)
-  { return typeid (eptr (e)->op ()) == typeid (O); }
+  { return eptr (e)->op ().typeId () == opKind<O> (); }
+
+  // -- usage opKindOf(EXPR) . The kind of the top operator of the
+  // -- expression, to compare with opKind<TYPE> () or to index tables
+  template <typename T> unsigned opKindOf (T e)
+  { return eptr (e)->op ().typeId (); }
 
   /**********************************************************************/
   /* Creation */
@@ -1313,6 +2708,36 @@ namespace expr
     Terminal<T> op(v);
     return f.mkTerm (op);
   }
+
+  /** 
+   * mkTerm<mpz_class> of a machine integer. Does not construct an
+   * mpz_class unless the value does not fit a word.
+   */
+  template <typename T>
+  typename std::enable_if<std::is_same<T,mpz_class>::value, Expr>::type
+  mkTerm (long v, ExprFactory &f)
+  {
+    Terminal<mpz_class> op(v);
+    return f.mkTerm (op);
+  }
+  
+  template <typename T>
+  typename std::enable_if<std::is_same<T,mpz_class>::value, Expr>::type
+  mkTerm (unsigned long v, ExprFactory &f)
+  {
+    Terminal<mpz_class> op(v);
+    return f.mkTerm (op);
+  }
+  
+  template <typename T>
+  typename std::enable_if<std::is_same<T,mpz_class>::value, Expr>::type
+  mkTerm (int v, ExprFactory &f)
+  { return mkTerm<T> (static_cast<long> (v), f); }
+  
+  template <typename T>
+  typename std::enable_if<std::is_same<T,mpz_class>::value, Expr>::type
+  mkTerm (unsigned int v, ExprFactory &f)
+  { return mkTerm<T> (static_cast<unsigned long> (v), f); }
   
   template <typename T> T getTerm (Expr e)
   {
@@ -1412,6 +2837,12 @@ namespace expr
     NOP(ITE,"ite",FUNCTIONAL,BoolOp)
     NOP(IFF,"<->",INFIX,BoolOp)
 
+    namespace canon
+    {
+      template <typename T, typename Range>
+      Expr mknary (ExprFactory &efac, const Range &r);
+    }
+
     namespace boolop 
     {
       // -- logical AND. Applies simplifications
@@ -1478,8 +2909,15 @@ namespace expr
 	// -- reduce unary AND to the operand
 	if (boost::size (r) == 1) return *boost::begin (r);
 
-	// XXX add more logical simplifications
-	return mknary<AND> (r);
+	return canon::mknary<AND> (eptr (*boost::begin (r))->efac (), r);
+      }
+
+      template <typename R>
+      Expr lor (const R &r)
+      {
+	assert (boost::begin (r) != boost::end (r));
+	if (boost::size (r) == 1) return *boost::begin (r);
+	return canon::mknary<OR> (eptr (*boost::begin (r))->efac (), r);
       }
 
       struct CIRCSIZE : public std::unary_function<Expr,VisitAction>
@@ -1972,7 +3410,7 @@ namespace expr
 				  int depth,
 				  bool brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)	
+				  const ENodeArgs &args)	
 	{
 	  OS << "[";
 	  args [0]->Print (OS, depth, false);
@@ -1985,6 +3423,162 @@ namespace expr
     NOP(ITV,"itv",numeric::ITV_PS,NumericOp)
   }
 
+  namespace op
+  {
+    /**
+     * Canonical constructors of the associative and commutative
+     * operators AND, OR, PLUS and MULT. Unlike mk and mknary, which
+     * build exactly the given tree, they flatten nested applications
+     * of the operator, fold constants, and order the arguments
+     * structurally, so that equal terms built in different orders are
+     * the same node. The order does not depend on node ids, which
+     * depend on the interleaving of the threads of a concurrent
+     * factory. AND and OR also drop duplicates and are false (true)
+     * if an argument occurs negated. Opt-in: mk<AND> is unchanged.
+     */
+    namespace canon
+    {
+      namespace details
+      {
+        template <typename T> struct CanonOp;
+
+        template <> struct CanonOp<AND>
+        {
+          static const bool idempotent = true;
+          static Expr unit (ExprFactory &efac) { return mk<TRUE> (efac); }
+          static Expr zero (ExprFactory &efac) { return mk<FALSE> (efac); }
+          static bool isUnit (Expr e) { return isOpX<TRUE> (e); }
+          static bool isZero (Expr e) { return isOpX<FALSE> (e); }
+          static bool isConst (Expr e) { return false; }
+          static void fold (mpz_class &acc, Expr e) {}
+        };
+
+        template <> struct CanonOp<OR>
+        {
+          static const bool idempotent = true;
+          static Expr unit (ExprFactory &efac) { return mk<FALSE> (efac); }
+          static Expr zero (ExprFactory &efac) { return mk<TRUE> (efac); }
+          static bool isUnit (Expr e) { return isOpX<FALSE> (e); }
+          static bool isZero (Expr e) { return isOpX<TRUE> (e); }
+          static bool isConst (Expr e) { return false; }
+          static void fold (mpz_class &acc, Expr e) {}
+        };
+
+        /** integer numerals are added up */
+        template <> struct CanonOp<PLUS>
+        {
+          static const bool idempotent = false;
+          static Expr unit (ExprFactory &efac) { return mkTerm<mpz_class> (0, efac); }
+          static Expr zero (ExprFactory &efac) { return Expr (); }
+          static bool isUnit (Expr e) { return false; }
+          static bool isZero (Expr e) { return false; }
+          static bool isConst (Expr e) { return isOpX<MPZ> (e); }
+          static void fold (mpz_class &acc, Expr e) { acc += getTerm<mpz_class> (e); }
+        };
+
+        /** integer numerals are multiplied, 0 absorbs */
+        template <> struct CanonOp<MULT>
+        {
+          static const bool idempotent = false;
+          static Expr unit (ExprFactory &efac) { return mkTerm<mpz_class> (1, efac); }
+          static Expr zero (ExprFactory &efac) { return mkTerm<mpz_class> (0, efac); }
+          static bool isUnit (Expr e) { return false; }
+          static bool isZero (Expr e) { return false; }
+          static bool isConst (Expr e) { return isOpX<MPZ> (e); }
+          static void fold (mpz_class &acc, Expr e) { acc *= getTerm<mpz_class> (e); }
+        };
+
+        /**
+         * Compares operators, then arities, then arguments from the
+         * left. Nodes are hash-consed, so distinct nodes differ
+         * structurally and only the first pair of distinct arguments
+         * is compared
+         */
+        inline int structCmp (ENode *a, ENode *b)
+        {
+          if (a == b) return 0;
+          if (a->op () < b->op ()) return -1;
+          if (b->op () < a->op ()) return 1;
+          if (a->arity () != b->arity ()) return a->arity () < b->arity () ? -1 : 1;
+          for (size_t i = 0; i < a->arity (); ++i)
+            if (int c = structCmp (a->arg (i), b->arg (i))) return c;
+          // -- only for operators that order neither way
+          return a->getId () < b->getId () ? -1 : 1;
+        }
+
+        inline bool structLess (const Expr &a, const Expr &b)
+        { return structCmp (&*a, &*b) < 0; }
+      }
+
+      /** canonical application of T to the range [bgn, end) */
+      template <typename T, typename iterator>
+      Expr mknary (ExprFactory &efac, iterator bgn, iterator end)
+      {
+        typedef details::CanonOp<T> C;
+        mpz_class acc = std::is_same<T, PLUS>::value ? 0 : 1;
+        bool folded = false;
+
+        ExprVector args;
+        ExprVector todo (bgn, end);
+        std::reverse (todo.begin (), todo.end ());
+        while (!todo.empty ())
+        {
+          Expr e = todo.back ();
+          todo.pop_back ();
+          if (isOpX<T> (e))
+          {
+            for (size_t i = e->arity (); i > 0; --i) todo.push_back (e->arg (i - 1));
+            continue;
+          }
+          if (C::isZero (e)) return e;
+          if (C::isUnit (e)) continue;
+          if (C::isConst (e)) { C::fold (acc, e); folded = true; continue; }
+          args.push_back (e);
+        }
+
+        std::sort (args.begin (), args.end (), details::structLess);
+        if (C::idempotent)
+        {
+          args.erase (std::unique (args.begin (), args.end ()), args.end ());
+          // -- x and !x
+          for (const Expr &a : args)
+            if (isOpX<NEG> (a) &&
+                std::binary_search (args.begin (), args.end (),
+                                    a->left (), details::structLess))
+              return C::zero (efac);
+        }
+
+        if (folded)
+        {
+          Expr k = mkTerm<mpz_class> (acc, efac);
+          if (k == C::zero (efac)) return k;
+          // -- the numeral comes first
+          if (k != C::unit (efac) || args.empty ()) args.insert (args.begin (), k);
+        }
+
+        if (args.empty ()) return C::unit (efac);
+        if (args.size () == 1) return args [0];
+        return efac.mkNary (T (), args.begin (), args.end ());
+      }
+
+      template <typename T, typename Range>
+      Expr mknary (ExprFactory &efac, const Range &r)
+      { return mknary<T> (efac, boost::begin (r), boost::end (r)); }
+
+      template <typename T> Expr mk (Expr e1, Expr e2)
+      {
+        Expr args [] = {e1, e2};
+        return mknary<T> (e1->efac (), args, args + 2);
+      }
+
+      template <typename T> Expr mk (Expr e1, Expr e2, Expr e3)
+      {
+        Expr args [] = {e1, e2, e3};
+        return mknary<T> (e1->efac (), args, args + 3);
+      }
+    }
+  }
+
 
   namespace op
   {
@@ -2022,7 +3616,7 @@ namespace expr
 				  int depth,
 				  bool brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)
+				  const ENodeArgs &args)
 	{
 	  args [1]->Print (OS, depth, true);
 	  OS << "_";
@@ -2036,7 +3630,7 @@ namespace expr
 				  int depth,
 				  bool brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)
+				  const ENodeArgs &args)
 	{
 	  args [1]->Print (OS, depth, true);
 	  OS << "!";
@@ -2157,7 +3751,7 @@ namespace expr
 				  int depth,
 				  bool brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)	
+				  const ENodeArgs &args)	
 	{
 	  OS << "[" << name << " ";
 	  args[0]->Print (OS, depth+2, false);
@@ -2335,7 +3929,7 @@ namespace expr
 				  int depth, 
 				  int brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)
+				  const ENodeArgs &args)
 	{
 	  if (args.size () > 1) OS << "(";
 
@@ -2514,7 +4108,7 @@ namespace expr
                                   int depth,
                                   bool brkt,
                                   const std::string &name,
-                                  const std::vector<ENode*> &args)
+                                  const ENodeArgs &args)
         {
           OS << "(" << name << " ";
       
@@ -2866,6 +4460,38 @@ namespace expr
     visit (sz, e);
     return sz.count;
   }
+
+  inline void ExprFactoryProfile::recordFormula (const std::string &name, Expr e)
+  {
+    // -- tree size computed over the DAG, saturating on overflow
+    std::unordered_map<ENode*, size_t> sz;
+    std::vector<std::pair<ENode*, size_t> > stack;
+    stack.push_back (std::make_pair (e.get (), 0));
+    while (!stack.empty ())
+    {
+      ENode *n = stack.back ().first;
+      size_t &next = stack.back ().second;
+      if (next < n->arity ())
+      {
+        ENode *a = n->arg (next++);
+        if (!sz.count (a)) stack.push_back (std::make_pair (a, 0));
+        continue;
+      }
+      stack.pop_back ();
+      size_t t = 1;
+      for (ENode *a : mk_it_range (n->args_begin (), n->args_end ()))
+        t = sz [a] > SIZE_MAX - t ? SIZE_MAX : t + sz [a];
+      sz [n] = t;
+    }
+    
+    FormulaSize f;
+    f.dag = sz.size ();
+    f.tree = sz [e.get ()];
+    
+    std::unique_lock<std::mutex> l (m_lock, std::defer_lock);
+    if (m_concurrent) l.lock ();
+    m_formulas [name] = f;
+  }
   
 
   // -- replace all occurrences of s by t
@@ -2946,6 +4572,17 @@ namespace expr
     return dagVisit (rv, exp);
   }
 
+  /** 
+   * Replace using a persistent memo. The memo must only be used
+   * with maps that are equal to map.
+   */
+  template <typename M>
+  Expr replace (Expr exp, const M &map, DagVisitMemo &memo)
+  {
+    RV<M> rv(map);
+    return dagVisit (rv, exp, memo);
+  }
+
 
   /** Replace and simplify */
   template <typename M>
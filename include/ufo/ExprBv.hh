@@ -90,6 +90,61 @@ namespace expr
         return getTerm<mpz_class> (v->arg (0));
       }
 
+      /// the low width bits of n
+      inline uint64_t mask64 (uint64_t n, unsigned width)
+      {return width >= 64 ? n : n & ((uint64_t (1) << width) - 1);}
+
+      /// n, a value of width bits, sign-extended to 64 bits
+      inline int64_t sext64 (uint64_t n, unsigned width)
+      {
+        if (width == 0 || width >= 64) return static_cast<int64_t> (n);
+        uint64_t sign = uint64_t (1) << (width - 1);
+        n = mask64 (n, width);
+        return static_cast<int64_t> ((n ^ sign) - sign);
+      }
+
+      /// true if v is a bit-vector numeral of at most 64 bits, and
+      /// stores its unsigned value, modulo 2^width, in n. Numerals
+      /// that fit a word do not go through GMP
+      inline bool toUint64 (Expr v, uint64_t &n)
+      {
+        if (!is_bvnum (v)) return false;
+        unsigned w = width (v->arg (1));
+        if (w > 64) return false;
+
+        const mpz_class &z = getTerm<mpz_class> (v->arg (0));
+        if (sizeof (long) >= sizeof (int64_t) && z.fits_slong_p ())
+          n = static_cast<uint64_t> (z.get_si ());
+        else
+        {
+          // -- the non-negative remainder, of at most 64 bits
+          mpz_class r;
+          mpz_fdiv_r_2exp (r.get_mpz_t (), z.get_mpz_t (), w);
+          n = 0;
+          mpz_export (&n, nullptr, -1, sizeof (n), 0, 0, r.get_mpz_t ());
+        }
+        n = mask64 (n, w);
+        return true;
+      }
+
+      /// n as an arbitrary precision integer
+      inline mpz_class uint64ToMpz (uint64_t n)
+      {
+        if (sizeof (unsigned long) >= sizeof (uint64_t))
+          return mpz_class (static_cast<unsigned long> (n));
+        mpz_class z;
+        mpz_import (z.get_mpz_t (), 1, -1, sizeof (n), 0, 0, &n);
+        return z;
+      }
+
+      /// bit-vector numeral of the low bwidth bits of n, for bwidth
+      /// of at most 64
+      inline Expr bvnum64 (uint64_t n, unsigned bwidth, ExprFactory &efac)
+      {
+        assert (bwidth <= 64);
+        return bvnum (uint64ToMpz (mask64 (n, bwidth)), bwidth, efac);
+      }
+
 
       inline Expr bvConst (Expr v, unsigned width)
       {
@@ -168,6 +223,13 @@ namespace expr
       inline Expr zext (Expr v, unsigned width) 
       {return mk<BZEXT> (v, bvsort (width, v->efac ()));}
       
+      /// the bit-vector of width bits of the integer v, modulo 2^width
+      inline Expr int2bv (Expr v, unsigned width)
+      {return mk<INT2BV> (v, bvsort (width, v->efac ()));}
+      
+      /// the unsigned integer of the bit-vector v
+      inline Expr bv2int (Expr v) {return mk<BV2INT> (v);}
+      
     }
     
   }
@@ -0,0 +1,166 @@
+#ifndef __EXPR_DAG_PRINT_HPP_
+#define __EXPR_DAG_PRINT_HPP_
+
+#include <algorithm>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "ufo/Expr.hpp"
+
+/**
+ * Printing of large expressions as DAGs.
+ *
+ * operator<< prints an expression as a tree, which is exponential in
+ * the size of a DAG with sharing, and recursive. printDag instead
+ * names every subterm larger than a bound, once, in post-order:
+ *
+ *   let $1 = (AND x>0 y>0)
+ *   let $2 = (OR $1 (EQ z $1))
+ *   in $2
+ *
+ * Subterms up to the bound are printed by operator<<, and the named
+ * ones by the id of their operator in OpRegistry. The traversal is
+ * iterative, and the output is flushed to the stream in chunks of
+ * bounded size.
+ */
+namespace expr
+{
+  struct DagPrintOpts
+  {
+    /** subterms of at most this many tree nodes are printed inline */
+    size_t inlineSize;
+    /** at most this many named subterms are printed, 0 for all */
+    size_t maxNodes;
+    /** bytes buffered before a write to the stream */
+    size_t chunk;
+
+    DagPrintOpts () : inlineSize (16), maxNodes (0), chunk (1 << 16) {}
+  };
+
+  namespace dag_print_impl
+  {
+    /** name of the operator of a named subterm */
+    inline std::string opName (const ENode *e)
+    {
+      if (const char *id = OpRegistry::get ().id (e->op ())) return id;
+      std::ostringstream s;
+      s << e->op ();
+      return s.str ();
+    }
+  }
+
+  /** OS is a std::ostream or an llvm::raw_ostream */
+  template <typename OutputStream>
+  void printDag (OutputStream &OS, Expr root,
+                 const DagPrintOpts &opts = DagPrintOpts ())
+  {
+    if (!root) { OS << "NULL"; return; }
+
+    // -- post-order, with the tree size of each node up to the bound
+    std::unordered_map<const ENode*, size_t> size;
+    std::vector<ENode*> order;
+    std::vector<std::pair<ENode*, size_t> > stack;
+    stack.push_back (std::make_pair (root.get (), 0));
+    size [root.get ()] = 0;
+    while (!stack.empty ())
+    {
+      ENode *e = stack.back ().first;
+      size_t &next = stack.back ().second;
+      if (next < e->arity ())
+      {
+        ENode *a = e->arg (next++);
+        if (size.insert (std::make_pair (a, 0)).second)
+          stack.push_back (std::make_pair (a, 0));
+        continue;
+      }
+      size_t s = 1;
+      for (size_t i = 0; i < e->arity () && s <= opts.inlineSize; ++i)
+        s += size [e->arg (i)];
+      size [e] = std::min (s, opts.inlineSize + 1);
+      order.push_back (e);
+      stack.pop_back ();
+    }
+
+    std::unordered_map<const ENode*, unsigned> names;
+    for (ENode *e : order)
+      if (size [e] > opts.inlineSize) names [e] = 0;
+
+    std::string buf;
+    auto flush = [&] (bool force)
+      {
+        if (buf.empty () || (!force && buf.size () < opts.chunk)) return;
+        OS.write (buf.data (), buf.size ());
+        buf.clear ();
+      };
+    auto arg = [&] (std::ostringstream &out, ENode *a)
+      {
+        auto it = names.find (a);
+        if (it == names.end ()) out << *a;
+        else if (it->second) out << "$" << it->second;
+        else out << "...";
+      };
+
+    size_t total = names.size ();
+    size_t skip = opts.maxNodes && total > opts.maxNodes ? total - opts.maxNodes : 0;
+    if (skip)
+    {
+      std::ostringstream out;
+      out << "; " << skip << " named subterms omitted\n";
+      buf += out.str ();
+    }
+
+    // -- the last named subterms are printed, they are closest to the root
+    unsigned id = 0;
+    for (ENode *e : order)
+    {
+      auto it = names.find (e);
+      if (it == names.end ()) continue;
+      ++id;
+      if (id <= skip) continue;
+      it->second = id;
+
+      std::ostringstream out;
+      out << "let $" << id << " = (" << dag_print_impl::opName (e);
+      for (size_t i = 0; i < e->arity (); ++i)
+      {
+        out << " ";
+        arg (out, e->arg (i));
+      }
+      out << ")\n";
+      buf += out.str ();
+      flush (false);
+    }
+
+    std::ostringstream out;
+    if (!names.empty ()) out << "in ";
+    arg (out, root.get ());
+    buf += out.str ();
+    flush (true);
+  }
+
+  /** a streamable printDag, e.g., errs () << dag (e) */
+  struct DagPrinter
+  {
+    Expr e;
+    DagPrintOpts opts;
+  };
+
+  inline DagPrinter dag (Expr e, size_t maxNodes = 0)
+  {
+    DagPrinter p;
+    p.e = e;
+    p.opts.maxNodes = maxNodes;
+    return p;
+  }
+
+  inline std::ostream &operator<< (std::ostream &OS, const DagPrinter &p)
+  {
+    printDag (OS, p.e, p.opts);
+    return OS;
+  }
+}
+
+#endif
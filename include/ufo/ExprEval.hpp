@@ -0,0 +1,652 @@
+#ifndef __EXPR_EVAL_HPP_
+#define __EXPR_EVAL_HPP_
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ufo/Expr.hpp"
+
+/**
+ * Concrete evaluation of expressions on many assignments at once.
+ *
+ * A Program flattens the DAGs of one or more root expressions into a
+ * linear code with one instruction per distinct subterm, shared
+ * between the roots. Booleans, integers and bit-vectors of at most 64
+ * bits are machine words: integers are int64_t and an operation that
+ * overflows yields an unknown value, bit-vectors are kept zero
+ * extended. Any other operator or sort, e.g., arrays or reals, makes
+ * a root unsupported and the caller falls back to the solver.
+ *
+ * Assignments are given by column in a Batch, one row of values per
+ * variable, and the code runs over blocks of them so that every
+ * instruction is a short loop over contiguous values. A value may be
+ * unknown. Unknowns propagate, except where the known operands
+ * decide the result, e.g., false && x is false. For a boolean root, a
+ * known false is thus false under any value of the unknowns.
+ */
+namespace expr
+{
+  namespace eval
+  {
+    enum Kind { BOOL_K, INT_K, BV_K, NO_K };
+
+    struct Sort
+    {
+      Kind kind;
+      /** bits of a bit-vector */
+      unsigned width;
+
+      Sort (Kind k = NO_K, unsigned w = 0) : kind (k), width (w) {}
+      bool operator== (const Sort &o) const
+      { return kind == o.kind && width == o.width; }
+      bool operator!= (const Sort &o) const { return !(*this == o); }
+    };
+
+    /** the sort of a type expression, NO_K if it is not supported */
+    inline Sort sortOf (Expr ty)
+    {
+      using namespace op;
+      if (isOpX<BOOL_TY> (ty)) return Sort (BOOL_K, 1);
+      if (isOpX<INT_TY> (ty)) return Sort (INT_K, 64);
+      if (isOpX<BVSORT> (ty))
+      {
+        unsigned w = bv::width (ty);
+        if (w > 0 && w <= 64) return Sort (BV_K, w);
+      }
+      return Sort ();
+    }
+
+    inline uint64_t mask (unsigned width)
+    { return width >= 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << width) - 1; }
+
+    /** sign extension of a bit-vector of the given width */
+    inline int64_t sext (int64_t v, unsigned width)
+    {
+      unsigned s = 64 - width;
+      return (int64_t) ((uint64_t) v << s) >> s;
+    }
+
+    /** the value of a boolean, integer or bit-vector numeral, false
+        if e is not one or does not fit */
+    inline bool toValue (Expr e, int64_t &out)
+    {
+      using namespace op;
+      if (isOpX<TRUE> (e)) { out = 1; return true; }
+      if (isOpX<FALSE> (e)) { out = 0; return true; }
+      if (isOpX<MPZ> (e))
+      {
+        const mpz_class &n = getTerm<mpz_class> (e);
+        if (!n.fits_slong_p ()) return false;
+        out = n.get_si ();
+        return true;
+      }
+      if (bv::is_bvnum (e))
+      {
+        unsigned w = bv::width (e->arg (1));
+        if (w == 0 || w > 64) return false;
+        mpz_class n = bv::toMpz (e);
+        mpz_class r;
+        mpz_fdiv_r_2exp (r.get_mpz_t (), n.get_mpz_t (), w);
+        // -- two 32 bit halves, unsigned long may be narrow
+        mpz_class hi = r >> 32;
+        mpz_class lo = r - (hi << 32);
+        out = (int64_t) (((uint64_t) hi.get_ui () << 32) | (uint64_t) lo.get_ui ());
+        return true;
+      }
+      return false;
+    }
+
+    /** values of rows over size assignments, row-major: the values of
+        a row are contiguous */
+    class Batch
+    {
+      unsigned m_rows;
+      size_t m_size;
+      std::vector<int64_t> m_val;
+      std::vector<uint8_t> m_known;
+
+    public:
+      Batch (unsigned rows = 0, size_t size = 0) { resize (rows, size); }
+
+      /** every value is unknown afterwards */
+      void resize (unsigned rows, size_t size)
+      {
+        m_rows = rows;
+        m_size = size;
+        m_val.assign ((size_t) rows * size, 0);
+        m_known.assign ((size_t) rows * size, 0);
+      }
+
+      unsigned rows () const { return m_rows; }
+      size_t size () const { return m_size; }
+
+      void set (unsigned row, size_t j, int64_t v)
+      {
+        m_val [row * m_size + j] = v;
+        m_known [row * m_size + j] = 1;
+      }
+      bool known (unsigned row, size_t j) const
+      { return m_known [row * m_size + j]; }
+      int64_t value (unsigned row, size_t j) const
+      { return m_val [row * m_size + j]; }
+
+      const int64_t *values (unsigned row) const
+      { return m_val.data () + row * m_size; }
+      const uint8_t *knowns (unsigned row) const
+      { return m_known.data () + row * m_size; }
+      int64_t *values (unsigned row) { return m_val.data () + row * m_size; }
+      uint8_t *knowns (unsigned row) { return m_known.data () + row * m_size; }
+    };
+
+    class Program
+    {
+    public:
+      enum Code
+        {
+          I_CONST, I_VAR,
+          I_NOT, I_AND, I_OR, I_XOR, I_IMPL, I_ITE, I_EQ, I_NEQ,
+          I_LT, I_LE, I_ADD, I_SUB, I_MUL, I_NEG, I_DIV, I_MOD,
+          I_BNOT, I_BNEG, I_BADD, I_BSUB, I_BMUL, I_BAND, I_BOR, I_BXOR,
+          I_BUDIV, I_BUREM, I_BSDIV, I_BSREM, I_BULT, I_BULE, I_BSLT, I_BSLE,
+          I_BSHL, I_BLSHR, I_BASHR, I_BEXTRACT, I_BZEXT, I_BSEXT, I_BCONCAT
+        };
+
+      struct Insn
+      {
+        Code code;
+        /** sort of the result */
+        Sort sort;
+        /** operand registers, a register is the index of an insn */
+        unsigned a, b, c;
+        /** the constant, the variable, or the shift of an extract */
+        int64_t imm;
+      };
+
+      /** assignments evaluated together */
+      static const unsigned Block = 64;
+
+    private:
+      std::unordered_map<ENode*, unsigned> m_var_ids;
+      std::vector<Sort> m_var_sorts;
+      std::vector<Insn> m_code;
+      /** register of every compiled subterm, -1 if unsupported */
+      std::unordered_map<ENode*, int> m_reg;
+      std::vector<unsigned> m_roots;
+      /** the keys above, alive as long as the program */
+      ExprVector m_pinned;
+
+      unsigned push (Code code, Sort s, unsigned a = 0, unsigned b = 0,
+                     unsigned c = 0, int64_t imm = 0)
+      {
+        Insn i;
+        i.code = code; i.sort = s; i.a = a; i.b = b; i.c = c; i.imm = imm;
+        m_code.push_back (i);
+        return m_code.size () - 1;
+      }
+
+      const Sort &sortOf (unsigned reg) const { return m_code [reg].sort; }
+
+      /** arguments of e that are subterms, as opposed to parameters */
+      static std::pair<size_t, size_t> children (ENode *e)
+      {
+        using namespace op;
+        if (isOpX<BEXTRACT> (e)) return std::make_pair (2, 3);
+        if (isOpX<BSEXT> (e) || isOpX<BZEXT> (e)) return std::make_pair (0, 1);
+        if (isOpX<MPZ> (e) || isOpX<TRUE> (e) || isOpX<FALSE> (e) ||
+            bv::is_bvnum (Expr (e)))
+          return std::make_pair (0, 0);
+        return std::make_pair (0, e->arity ());
+      }
+
+      /** left fold of the arguments of e with a binary code */
+      int fold (ENode *e, Code code, Sort s)
+      {
+        if (e->arity () == 0) return -1;
+        int r = m_reg [e->arg (0)];
+        for (size_t i = 1; i < e->arity () && r >= 0; ++i)
+        {
+          int x = m_reg [e->arg (i)];
+          if (x < 0 || sortOf (x) != s || sortOf (r) != s) return -1;
+          r = push (code, s, r, x);
+        }
+        return r >= 0 && sortOf (r) == s ? r : -1;
+      }
+
+      /** the code of e, its arguments are compiled */
+      int emit (ENode *e)
+      {
+        using namespace op;
+        const Sort B (BOOL_K, 1), I (INT_K, 64);
+
+        auto it = m_var_ids.find (e);
+        if (it != m_var_ids.end ())
+        {
+          Sort s = m_var_sorts [it->second];
+          if (s.kind == NO_K) return -1;
+          return push (I_VAR, s, 0, 0, 0, it->second);
+        }
+
+        Expr ex (e);
+        int64_t v;
+        if (isOpX<TRUE> (e) || isOpX<FALSE> (e))
+          return toValue (ex, v) ? push (I_CONST, B, 0, 0, 0, v) : -1;
+        if (isOpX<MPZ> (e))
+          return toValue (ex, v) ? push (I_CONST, I, 0, 0, 0, v) : -1;
+        if (bv::is_bvnum (ex))
+          return toValue (ex, v) ?
+            push (I_CONST, Sort (BV_K, bv::width (e->arg (1))), 0, 0, 0, v) : -1;
+
+        std::pair<size_t, size_t> ch = children (e);
+        if (ch.first == ch.second) return -1;
+        for (size_t i = ch.first; i < ch.second; ++i)
+          if (m_reg [e->arg (i)] < 0) return -1;
+        auto arg = [&] (size_t i) { return (unsigned) m_reg [e->arg (i)]; };
+        auto bin = [&] (Code code, Sort s, Kind k) -> int
+          {
+            if (e->arity () != 2) return -1;
+            unsigned x = arg (0), y = arg (1);
+            if (sortOf (x).kind != k || sortOf (x) != sortOf (y)) return -1;
+            return push (code, s, x, y);
+          };
+
+        // -- booleans
+        if (isOpX<AND> (e)) return fold (e, I_AND, B);
+        if (isOpX<OR> (e)) return fold (e, I_OR, B);
+        if (isOpX<XOR> (e)) return fold (e, I_XOR, B);
+        if (isOpX<IMPL> (e)) return bin (I_IMPL, B, BOOL_K);
+        if (isOpX<IFF> (e)) return bin (I_EQ, B, BOOL_K);
+        if (isOpX<NEG> (e))
+          return e->arity () == 1 && sortOf (arg (0)) == B ? push (I_NOT, B, arg (0)) : -1;
+        if (isOpX<ITE> (e))
+        {
+          if (e->arity () != 3) return -1;
+          unsigned c = arg (0), t = arg (1), f = arg (2);
+          if (sortOf (c) != B || sortOf (t) != sortOf (f)) return -1;
+          return push (I_ITE, sortOf (t), c, t, f);
+        }
+        if (isOpX<EQ> (e) || isOpX<NEQ> (e))
+        {
+          if (e->arity () != 2 || sortOf (arg (0)) != sortOf (arg (1))) return -1;
+          return push (isOpX<EQ> (e) ? I_EQ : I_NEQ, B, arg (0), arg (1));
+        }
+
+        // -- integers
+        if (isOpX<LT> (e)) return bin (I_LT, B, INT_K);
+        if (isOpX<LEQ> (e)) return bin (I_LE, B, INT_K);
+        if (isOpX<GT> (e) && e->arity () == 2)
+          return sortOf (arg (0)) == I && sortOf (arg (1)) == I ?
+            push (I_LT, B, arg (1), arg (0)) : -1;
+        if (isOpX<GEQ> (e) && e->arity () == 2)
+          return sortOf (arg (0)) == I && sortOf (arg (1)) == I ?
+            push (I_LE, B, arg (1), arg (0)) : -1;
+        if (isOpX<PLUS> (e)) return fold (e, I_ADD, I);
+        if (isOpX<MULT> (e)) return fold (e, I_MUL, I);
+        if (isOpX<MINUS> (e))
+        {
+          if (e->arity () == 1)
+            return sortOf (arg (0)) == I ? push (I_NEG, I, arg (0)) : -1;
+          return fold (e, I_SUB, I);
+        }
+        if (isOpX<UN_MINUS> (e))
+          return e->arity () == 1 && sortOf (arg (0)) == I ? push (I_NEG, I, arg (0)) : -1;
+        if (isOpX<DIV> (e) || isOpX<IDIV> (e)) return bin (I_DIV, I, INT_K);
+        if (isOpX<MOD> (e)) return bin (I_MOD, I, INT_K);
+
+        // -- bit-vectors
+        if (!isOp<BvOp> (e)) return -1;
+        Sort s = sortOf (arg (ch.first));
+        if (s.kind != BV_K) return -1;
+        if (isOpX<BNOT> (e)) return e->arity () == 1 ? push (I_BNOT, s, arg (0)) : -1;
+        if (isOpX<BNEG> (e)) return e->arity () == 1 ? push (I_BNEG, s, arg (0)) : -1;
+        if (isOpX<BADD> (e)) return fold (e, I_BADD, s);
+        if (isOpX<BSUB> (e)) return fold (e, I_BSUB, s);
+        if (isOpX<BMUL> (e)) return fold (e, I_BMUL, s);
+        if (isOpX<BAND> (e)) return fold (e, I_BAND, s);
+        if (isOpX<BOR> (e)) return fold (e, I_BOR, s);
+        if (isOpX<BXOR> (e)) return fold (e, I_BXOR, s);
+        if (isOpX<BUDIV> (e)) return bin (I_BUDIV, s, BV_K);
+        if (isOpX<BUREM> (e)) return bin (I_BUREM, s, BV_K);
+        if (isOpX<BSDIV> (e)) return bin (I_BSDIV, s, BV_K);
+        if (isOpX<BSREM> (e)) return bin (I_BSREM, s, BV_K);
+        if (isOpX<BSHL> (e)) return bin (I_BSHL, s, BV_K);
+        if (isOpX<BLSHR> (e)) return bin (I_BLSHR, s, BV_K);
+        if (isOpX<BASHR> (e)) return bin (I_BASHR, s, BV_K);
+        if (isOpX<BULT> (e)) return bin (I_BULT, B, BV_K);
+        if (isOpX<BULE> (e)) return bin (I_BULE, B, BV_K);
+        if (isOpX<BSLT> (e)) return bin (I_BSLT, B, BV_K);
+        if (isOpX<BSLE> (e)) return bin (I_BSLE, B, BV_K);
+        if (isOpX<BUGT> (e) && e->arity () == 2 && sortOf (arg (1)) == s)
+          return push (I_BULT, B, arg (1), arg (0));
+        if (isOpX<BUGE> (e) && e->arity () == 2 && sortOf (arg (1)) == s)
+          return push (I_BULE, B, arg (1), arg (0));
+        if (isOpX<BSGT> (e) && e->arity () == 2 && sortOf (arg (1)) == s)
+          return push (I_BSLT, B, arg (1), arg (0));
+        if (isOpX<BSGE> (e) && e->arity () == 2 && sortOf (arg (1)) == s)
+          return push (I_BSLE, B, arg (1), arg (0));
+        if (isOpX<BEXTRACT> (e))
+        {
+          unsigned hi = bv::high (ex), lo = bv::low (ex);
+          if (hi < lo || hi >= s.width) return -1;
+          return push (I_BEXTRACT, Sort (BV_K, hi - lo + 1), arg (2), 0, 0, lo);
+        }
+        if (isOpX<BZEXT> (e) || isOpX<BSEXT> (e))
+        {
+          Sort t = eval::sortOf (e->arg (1));
+          if (t.kind != BV_K || t.width < s.width) return -1;
+          return push (isOpX<BZEXT> (e) ? I_BZEXT : I_BSEXT, t, arg (0));
+        }
+        if (isOpX<BCONCAT> (e))
+        {
+          if (e->arity () != 2 || sortOf (arg (1)).kind != BV_K) return -1;
+          unsigned w = s.width + sortOf (arg (1)).width;
+          if (w > 64) return -1;
+          return push (I_BCONCAT, Sort (BV_K, w), arg (0), arg (1), 0,
+                       sortOf (arg (1)).width);
+        }
+        return -1;
+      }
+
+      /** runs the code on n <= Block assignments starting at off */
+      void run (const Batch &in, size_t off, unsigned n,
+                std::vector<int64_t> &val, std::vector<uint8_t> &kn) const
+      {
+        for (unsigned r = 0; r < m_code.size (); ++r)
+        {
+          const Insn &I = m_code [r];
+          int64_t *out = &val [r * Block];
+          uint8_t *k = &kn [r * Block];
+          const int64_t *x = &val [I.a * Block], *y = &val [I.b * Block],
+            *z = &val [I.c * Block];
+          const uint8_t *kx = &kn [I.a * Block], *ky = &kn [I.b * Block],
+            *kz = &kn [I.c * Block];
+          const uint64_t m = mask (I.sort.width);
+          const unsigned w = I.sort.width;
+          const unsigned aw = m_code [I.a].sort.width;
+
+          // -- the result is known when all operands are
+          auto un = [&] (int64_t (*f) (int64_t, uint64_t, unsigned))
+            { for (unsigned j = 0; j < n; ++j)
+              { out [j] = f (x [j], m, aw); k [j] = kx [j]; } };
+
+          switch (I.code)
+          {
+          case I_CONST:
+            for (unsigned j = 0; j < n; ++j) { out [j] = I.imm; k [j] = 1; }
+            break;
+          case I_VAR:
+            {
+              const int64_t *v = in.values (I.imm) + off;
+              const uint8_t *kv = in.knowns (I.imm) + off;
+              for (unsigned j = 0; j < n; ++j) { out [j] = v [j]; k [j] = kv [j]; }
+            }
+            break;
+          case I_NOT:
+            for (unsigned j = 0; j < n; ++j) { out [j] = !x [j]; k [j] = kx [j]; }
+            break;
+          case I_AND:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              out [j] = x [j] & y [j];
+              k [j] = (kx [j] & ky [j]) | (kx [j] & !x [j]) | (ky [j] & !y [j]);
+            }
+            break;
+          case I_OR:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              out [j] = x [j] | y [j];
+              k [j] = (kx [j] & ky [j]) | (kx [j] & x [j]) | (ky [j] & y [j]);
+            }
+            break;
+          case I_IMPL:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              out [j] = !x [j] | y [j];
+              k [j] = (kx [j] & ky [j]) | (kx [j] & !x [j]) | (ky [j] & y [j]);
+            }
+            break;
+          case I_XOR:
+            for (unsigned j = 0; j < n; ++j)
+            { out [j] = x [j] ^ y [j]; k [j] = kx [j] & ky [j]; }
+            break;
+          case I_ITE:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              out [j] = x [j] ? y [j] : z [j];
+              k [j] = kx [j] ? (x [j] ? ky [j] : kz [j])
+                : (ky [j] & kz [j] & (y [j] == z [j]));
+            }
+            break;
+          case I_EQ:
+            for (unsigned j = 0; j < n; ++j)
+            { out [j] = x [j] == y [j]; k [j] = kx [j] & ky [j]; }
+            break;
+          case I_NEQ:
+            for (unsigned j = 0; j < n; ++j)
+            { out [j] = x [j] != y [j]; k [j] = kx [j] & ky [j]; }
+            break;
+          case I_LT:
+            for (unsigned j = 0; j < n; ++j)
+            { out [j] = x [j] < y [j]; k [j] = kx [j] & ky [j]; }
+            break;
+          case I_LE:
+            for (unsigned j = 0; j < n; ++j)
+            { out [j] = x [j] <= y [j]; k [j] = kx [j] & ky [j]; }
+            break;
+          case I_ADD:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              int64_t s = (int64_t) ((uint64_t) x [j] + (uint64_t) y [j]);
+              out [j] = s;
+              k [j] = kx [j] & ky [j] & (((x [j] ^ s) & (y [j] ^ s)) >= 0);
+            }
+            break;
+          case I_SUB:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              int64_t s = (int64_t) ((uint64_t) x [j] - (uint64_t) y [j]);
+              out [j] = s;
+              k [j] = kx [j] & ky [j] & (((x [j] ^ y [j]) & (x [j] ^ s)) >= 0);
+            }
+            break;
+          case I_MUL:
+            for (unsigned j = 0; j < n; ++j)
+            {
+#ifdef __SIZEOF_INT128__
+              __int128 p = (__int128) x [j] * y [j];
+              out [j] = (int64_t) p;
+              k [j] = kx [j] & ky [j] & (p == (__int128) out [j]);
+#else
+              bool small = x [j] == (int32_t) x [j] && y [j] == (int32_t) y [j];
+              out [j] = small ? x [j] * y [j] : 0;
+              k [j] = kx [j] & ky [j] & small;
+#endif
+            }
+            break;
+          case I_NEG:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              out [j] = (int64_t) (0 - (uint64_t) x [j]);
+              k [j] = kx [j] & (x [j] != INT64_MIN);
+            }
+            break;
+          case I_DIV:
+          case I_MOD:
+            // -- euclidean, the remainder is never negative
+            for (unsigned j = 0; j < n; ++j)
+            {
+              bool ok = y [j] != 0 && !(x [j] == INT64_MIN && y [j] == -1);
+              int64_t q = ok ? x [j] / y [j] : 0, rm = ok ? x [j] % y [j] : 0;
+              if (rm < 0) { if (y [j] > 0) { --q; rm += y [j]; } else { ++q; rm -= y [j]; } }
+              out [j] = I.code == I_DIV ? q : rm;
+              k [j] = kx [j] & ky [j] & ok;
+            }
+            break;
+          case I_BNOT:
+            un ([] (int64_t a, uint64_t m, unsigned) { return (int64_t) (~(uint64_t) a & m); });
+            break;
+          case I_BNEG:
+            un ([] (int64_t a, uint64_t m, unsigned) { return (int64_t) ((0 - (uint64_t) a) & m); });
+            break;
+          case I_BZEXT:
+            un ([] (int64_t a, uint64_t, unsigned) { return a; });
+            break;
+          case I_BSEXT:
+            un ([] (int64_t a, uint64_t m, unsigned aw) { return (int64_t) ((uint64_t) sext (a, aw) & m); });
+            break;
+          case I_BEXTRACT:
+            for (unsigned j = 0; j < n; ++j)
+            { out [j] = (int64_t) (((uint64_t) x [j] >> I.imm) & m); k [j] = kx [j]; }
+            break;
+          case I_BCONCAT:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              out [j] = (int64_t) (((uint64_t) x [j] << I.imm) | (uint64_t) y [j]);
+              k [j] = kx [j] & ky [j];
+            }
+            break;
+          case I_BADD: case I_BSUB: case I_BMUL: case I_BAND: case I_BOR: case I_BXOR:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              uint64_t a = x [j], b = y [j], s;
+              switch (I.code)
+              {
+              case I_BADD: s = a + b; break;
+              case I_BSUB: s = a - b; break;
+              case I_BMUL: s = a * b; break;
+              case I_BAND: s = a & b; break;
+              case I_BOR: s = a | b; break;
+              default: s = a ^ b; break;
+              }
+              out [j] = (int64_t) (s & m);
+              k [j] = kx [j] & ky [j];
+            }
+            break;
+          case I_BUDIV:
+          case I_BUREM:
+            // -- as in SMT-LIB, x / 0 is all ones and x % 0 is x
+            for (unsigned j = 0; j < n; ++j)
+            {
+              uint64_t a = x [j], b = y [j];
+              out [j] = (int64_t) (I.code == I_BUDIV ? (b ? a / b : m) : (b ? a % b : a));
+              k [j] = kx [j] & ky [j];
+            }
+            break;
+          case I_BSDIV:
+          case I_BSREM:
+            // -- truncating as C, the division by zero is left unknown
+            for (unsigned j = 0; j < n; ++j)
+            {
+              int64_t a = sext (x [j], w), b = sext (y [j], w);
+              bool ok = b != 0 && !(a == INT64_MIN && b == -1);
+              int64_t s = ok ? (I.code == I_BSDIV ? a / b : a % b) : 0;
+              out [j] = (int64_t) ((uint64_t) s & m);
+              k [j] = kx [j] & ky [j] & ok;
+            }
+            break;
+          case I_BULT: case I_BULE: case I_BSLT: case I_BSLE:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              uint64_t a = x [j], b = y [j];
+              int64_t sa = sext (x [j], aw), sb = sext (y [j], aw);
+              out [j] = I.code == I_BULT ? a < b : I.code == I_BULE ? a <= b :
+                I.code == I_BSLT ? sa < sb : sa <= sb;
+              k [j] = kx [j] & ky [j];
+            }
+            break;
+          case I_BSHL: case I_BLSHR: case I_BASHR:
+            for (unsigned j = 0; j < n; ++j)
+            {
+              uint64_t a = x [j], b = y [j], s;
+              if (I.code == I_BASHR)
+                s = (uint64_t) (sext (x [j], w) >> (b < w ? b : w - 1)) & m;
+              else if (b >= w) s = 0;
+              else s = I.code == I_BSHL ? (a << b) & m : a >> b;
+              out [j] = (int64_t) s;
+              k [j] = kx [j] & ky [j];
+            }
+            break;
+          }
+        }
+      }
+
+    public:
+      /** declares a variable of a given type, its index is its row in
+          the batches given to eval */
+      unsigned addVar (Expr v, Expr ty)
+      {
+        auto res = m_var_ids.insert (std::make_pair (v.get (), m_var_sorts.size ()));
+        if (res.second)
+        {
+          m_var_sorts.push_back (eval::sortOf (ty));
+          m_pinned.push_back (v);
+        }
+        return res.first->second;
+      }
+
+      /** compiles e, returns its row in the batches computed by eval or
+          -1 if e uses an unsupported operator, sort or variable */
+      int addRoot (Expr e)
+      {
+        // -- post-order, shared with the roots compiled before
+        std::vector<std::pair<ENode*, size_t> > stack;
+        if (!m_reg.count (e.get ()))
+          stack.push_back (std::make_pair (e.get (), children (e.get ()).first));
+        while (!stack.empty ())
+        {
+          ENode *n = stack.back ().first;
+          size_t &next = stack.back ().second;
+          if (!m_var_ids.count (n) && next < children (n).second)
+          {
+            ENode *a = n->arg (next++);
+            if (!m_reg.count (a))
+              stack.push_back (std::make_pair (a, children (a).first));
+            continue;
+          }
+          stack.pop_back ();
+          if (m_reg.count (n)) continue;
+          int r = emit (n);
+          m_reg [n] = r;
+          m_pinned.push_back (Expr (n));
+        }
+        int r = m_reg [e.get ()];
+        if (r < 0) return -1;
+        m_roots.push_back (r);
+        return m_roots.size () - 1;
+      }
+
+      unsigned numVars () const { return m_var_sorts.size (); }
+      unsigned numRoots () const { return m_roots.size (); }
+      /** number of instructions */
+      size_t size () const { return m_code.size (); }
+      Sort rootSort (unsigned root) const { return m_code [m_roots [root]].sort; }
+
+      /** the roots under every assignment of in, a row per variable,
+          into out, a row per root */
+      void eval (const Batch &in, Batch &out) const
+      {
+        assert (in.rows () >= numVars ());
+        out.resize (numRoots (), in.size ());
+        std::vector<int64_t> val (m_code.size () * Block);
+        std::vector<uint8_t> kn (m_code.size () * Block);
+        for (size_t off = 0; off < in.size (); off += Block)
+        {
+          unsigned n = std::min<size_t> (Block, in.size () - off);
+          run (in, off, n, val, kn);
+          for (unsigned r = 0; r < m_roots.size (); ++r)
+          {
+            const int64_t *v = &val [m_roots [r] * Block];
+            const uint8_t *k = &kn [m_roots [r] * Block];
+            int64_t *ov = out.values (r) + off;
+            uint8_t *ok = out.knowns (r) + off;
+            for (unsigned j = 0; j < n; ++j) { ov [j] = v [j]; ok [j] = k [j]; }
+          }
+        }
+      }
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,235 @@
+#ifndef __EXPR_HASH_HPP_
+#define __EXPR_HASH_HPP_
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "ufo/Expr.hpp"
+
+/**
+ * Hash containers of expressions for the hot paths of the tools.
+ *
+ * Expressions are hash-consed, so a key is identified by its node:
+ * ExprHashSet and ExprHashMap compare keys as pointers and hash them
+ * by the structural hash that every node computes once when it is
+ * canonized. They are open-addressing tables with linear probing
+ * that store the hash next to the key, like the unique table of the
+ * factory, so that a lookup is a few compares of adjacent slots and
+ * never walks a tree or a bucket list.
+ *
+ * Iteration order depends on the hashes, which depend on the
+ * addresses of the nodes, and changes from run to run. Use ExprSet
+ * and ExprMap where the order of the elements is observable.
+ * Insertions invalidate iterators and references into the table.
+ */
+namespace expr
+{
+  namespace hash_detail
+  {
+    inline const Expr &key (const Expr &e) { return e; }
+    template <typename V>
+    inline const Expr &key (const std::pair<Expr,V> &kv) { return kv.first; }
+
+    /** open-addressing table of entries E keyed by an Expr */
+    template <typename E>
+    class ExprOpenTable
+    {
+    protected:
+      struct Slot
+      {
+        size_t hash;
+        /** an empty slot has a null key */
+        E entry;
+      };
+
+      std::vector<Slot> m_slots;
+      size_t m_size;
+
+      size_t mask () const { return m_slots.size () - 1; }
+      static bool full (const Slot &s) { return key (s.entry).get () != nullptr; }
+
+      void rehash (size_t capacity)
+      {
+        std::vector<Slot> old;
+        old.swap (m_slots);
+        m_slots.resize (capacity, Slot {0, E ()});
+        for (Slot &s : old)
+          if (full (s))
+          {
+            size_t i = s.hash & mask ();
+            while (full (m_slots [i])) i = (i + 1) & mask ();
+            m_slots [i].hash = s.hash;
+            m_slots [i].entry = std::move (s.entry);
+          }
+      }
+
+      /** slot of k, or of the empty slot where k would go */
+      size_t probe (const Expr &k, size_t h) const
+      {
+        size_t i = h & mask ();
+        while (full (m_slots [i]) && key (m_slots [i].entry) != k)
+          i = (i + 1) & mask ();
+        return i;
+      }
+
+      /** slot of k, filled with mkEntry () if k is new */
+      template <typename F>
+      std::pair<size_t,bool> insertSlot (const Expr &k, F mkEntry)
+      {
+        assert (k);
+        // -- keep the load factor under 0.7
+        if (10 * (m_size + 1) > 7 * m_slots.size ())
+          rehash (m_slots.empty () ? 16 : 2 * m_slots.size ());
+        size_t h = k->hash ();
+        size_t i = probe (k, h);
+        if (full (m_slots [i])) return std::make_pair (i, false);
+        m_slots [i].hash = h;
+        m_slots [i].entry = mkEntry ();
+        ++m_size;
+        return std::make_pair (i, true);
+      }
+
+      size_t findSlot (const Expr &k) const
+      {
+        if (m_size == 0 || !k) return m_slots.size ();
+        size_t i = probe (k, k->hash ());
+        return full (m_slots [i]) ? i : m_slots.size ();
+      }
+
+    public:
+      template <bool Const>
+      class iter : public std::iterator<std::forward_iterator_tag, E>
+      {
+        typedef typename std::conditional<Const, const Slot, Slot>::type slot_type;
+        typedef typename std::conditional<Const, const E, E>::type entry_type;
+        slot_type *m_it, *m_end;
+        void skip () { while (m_it != m_end && !full (*m_it)) ++m_it; }
+      public:
+        iter () : m_it (nullptr), m_end (nullptr) {}
+        iter (slot_type *it, slot_type *end) : m_it (it), m_end (end) { skip (); }
+        /** a const iterator from a mutable one */
+        template <bool C, typename = typename std::enable_if<Const && !C>::type>
+        iter (const iter<C> &o) : m_it (o.m_it), m_end (o.m_end) {}
+
+        entry_type &operator* () const { return m_it->entry; }
+        entry_type *operator-> () const { return &m_it->entry; }
+        iter &operator++ () { ++m_it; skip (); return *this; }
+        iter operator++ (int) { iter res = *this; ++*this; return res; }
+        bool operator== (const iter &o) const { return m_it == o.m_it; }
+        bool operator!= (const iter &o) const { return m_it != o.m_it; }
+
+        template <bool C> friend class iter;
+      };
+      typedef iter<false> iterator;
+      typedef iter<true> const_iterator;
+
+    protected:
+      iterator at (size_t i)
+      { return iterator (m_slots.data () + i, m_slots.data () + m_slots.size ()); }
+      const_iterator at (size_t i) const
+      { return const_iterator (m_slots.data () + i, m_slots.data () + m_slots.size ()); }
+
+    public:
+      ExprOpenTable () : m_size (0) {}
+
+      size_t size () const { return m_size; }
+      bool empty () const { return m_size == 0; }
+      void clear () { m_slots.clear (); m_size = 0; }
+
+      /** allocates the slots of n entries */
+      void reserve (size_t n)
+      {
+        size_t capacity = m_slots.empty () ? 16 : m_slots.size ();
+        while (10 * n > 7 * capacity) capacity *= 2;
+        if (capacity > m_slots.size ()) rehash (capacity);
+      }
+
+      iterator begin () { return at (0); }
+      iterator end () { return at (m_slots.size ()); }
+      const_iterator begin () const { return at (0); }
+      const_iterator end () const { return at (m_slots.size ()); }
+
+      iterator find (const Expr &k) { return at (findSlot (k)); }
+      const_iterator find (const Expr &k) const { return at (findSlot (k)); }
+      size_t count (const Expr &k) const
+      { return findSlot (k) < m_slots.size () ? 1 : 0; }
+
+      /** removes k. Returns the number of removed entries */
+      size_t erase (const Expr &k)
+      {
+        size_t i = findSlot (k);
+        if (i == m_slots.size ()) return 0;
+
+        // -- backward-shift deletion, as ENodeOpenTable::erase
+        size_t j = i;
+        for (;;)
+        {
+          m_slots [i].entry = E ();
+          for (;;)
+          {
+            j = (j + 1) & mask ();
+            if (!full (m_slots [j])) break;
+            size_t h = m_slots [j].hash & mask ();
+            if (i <= j ? (i < h && h <= j) : (i < h || h <= j)) continue;
+            break;
+          }
+          if (!full (m_slots [j])) break;
+          m_slots [i].hash = m_slots [j].hash;
+          m_slots [i].entry = std::move (m_slots [j].entry);
+          i = j;
+        }
+        --m_size;
+        return 1;
+      }
+    };
+  }
+
+  /** set of expressions, see ExprHash.hpp */
+  class ExprHashSet : public hash_detail::ExprOpenTable<Expr>
+  {
+  public:
+    typedef Expr value_type;
+
+    ExprHashSet () {}
+    template <typename Iterator>
+    ExprHashSet (Iterator bgn, Iterator end)
+    { for (; bgn != end; ++bgn) insert (*bgn); }
+
+    std::pair<iterator,bool> insert (const Expr &e)
+    {
+      auto res = insertSlot (e, [&e] () { return e; });
+      return std::make_pair (at (res.first), res.second);
+    }
+  };
+
+  /** map from expressions to V, see ExprHash.hpp */
+  template <typename V>
+  class ExprHashMap : public hash_detail::ExprOpenTable<std::pair<Expr,V> >
+  {
+    typedef hash_detail::ExprOpenTable<std::pair<Expr,V> > base_type;
+  public:
+    typedef Expr key_type;
+    typedef V mapped_type;
+    typedef std::pair<Expr,V> value_type;
+    typedef typename base_type::iterator iterator;
+    typedef typename base_type::const_iterator const_iterator;
+
+    std::pair<iterator,bool> insert (const value_type &kv)
+    {
+      auto res = this->insertSlot (kv.first, [&kv] () { return kv; });
+      return std::make_pair (this->at (res.first), res.second);
+    }
+
+    V &operator[] (const Expr &k)
+    {
+      auto res = this->insertSlot (k, [&k] () { return value_type (k, V ()); });
+      return this->m_slots [res.first].entry.second;
+    }
+  };
+}
+
+#endif
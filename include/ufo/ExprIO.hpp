@@ -2,5 +2,482 @@
 #define __EXPR_IO_HPP_
 
 #include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdio>
+#include <set>
+#include <sstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ufo/Expr.hpp"
+
+/**
+ * Binary serialization of expression DAGs.
+ *
+ * The format is a flat table of nodes in post-order (arguments before
+ * their parents), so sharing is preserved and a reader rebuilds the
+ * DAG in a single pass without recursion. Every section is 8-byte
+ * aligned and addressed by offset from the start of the file so that
+ * a file can be decoded directly from a memory mapping.
+ *
+ *   Header  magic, byte-order tag, version, counts and section offsets
+ *   Ops     numOps   x { u32 name offset, u32 name length } into Blob
+ *   Nodes   numNodes x { u32 op, u32 arity, u32 data, u32 size }
+ *           For an operator node, data is the index of its first
+ *           argument in Args. For a terminal, data/size locate the
+ *           payload in Blob.
+ *   Args    u32 node indices, each smaller than the index of its parent
+ *   Roots   numRoots x u32 node index
+ *   Blob    operator ids and terminal payloads
+ *
+ * Non-terminal operators are identified by their id in OpRegistry,
+ * i.e., every operator declared with NOP is supported. Terminals are
+ * supported for the value types of the expression language
+ * (strings, machine and arbitrary precision numbers, bound variables
+ * and bit-vector sorts). Terminals holding pointers (e.g., llvm::Value)
+ * cannot be serialized.
+ */
+namespace expr
+{
+  namespace exprio
+  {
+    namespace detail
+    {
+      const char magic [8] = {'S','E','A','E','X','P','R','\0'};
+      const uint32_t byteOrder = 0x01020304;
+      const uint32_t version = 1;
+
+      struct Header
+      {
+        char magic [8];
+        uint32_t byteOrder;
+        uint32_t version;
+        uint32_t numOps;
+        uint32_t numNodes;
+        uint32_t numArgs;
+        uint32_t numRoots;
+        uint64_t opsOff;
+        uint64_t nodesOff;
+        uint64_t argsOff;
+        uint64_t rootsOff;
+        uint64_t blobOff;
+        uint64_t blobSize;
+      };
+
+      struct OpEntry { uint32_t off; uint32_t len; };
+      struct NodeEntry { uint32_t op; uint32_t arity; uint32_t data; uint32_t size; };
+
+      inline uint64_t align8 (uint64_t v) { return (v + 7) & ~uint64_t (7); }
+
+      template <typename T>
+      void putRaw (std::string &out, const T &v)
+      { out.append (reinterpret_cast<const char*> (&v), sizeof (T)); }
+
+      template <typename T>
+      bool getRaw (const char *data, size_t size, T &v)
+      {
+        if (size != sizeof (T)) return false;
+        std::memcpy (&v, data, sizeof (T));
+        return true;
+      }
+
+      /** Encoders/decoders of terminal payloads */
+      class TerminalCodec
+      {
+      public:
+        /** id of a terminal, or NULL if op is not a supported terminal */
+        static const char *id (const Operator &op)
+        {
+          const std::type_info &t = typeid (op);
+          if (t == typeid (STRING)) return "term:string";
+          if (t == typeid (INT)) return "term:int";
+          if (t == typeid (UINT)) return "term:uint";
+          if (t == typeid (ULONG)) return "term:ulong";
+          if (t == typeid (MPZ)) return "term:mpz";
+          if (t == typeid (MPQ)) return "term:mpq";
+          if (t == typeid (BVAR)) return "term:bvar";
+          if (t == typeid (BVSORT)) return "term:bvsort";
+          return NULL;
+        }
+
+        static void encode (const Operator &op, std::string &out)
+        {
+          const std::type_info &t = typeid (op);
+          if (t == typeid (STRING))
+            out += static_cast<const STRING&> (op).get ();
+          else if (t == typeid (INT))
+            putRaw (out, static_cast<const INT&> (op).get ());
+          else if (t == typeid (UINT))
+            putRaw (out, static_cast<const UINT&> (op).get ());
+          else if (t == typeid (ULONG))
+            putRaw (out, static_cast<const ULONG&> (op).get ());
+          else if (t == typeid (MPZ))
+          {
+            const MPZ &z = static_cast<const MPZ&> (op);
+            // -- a tag followed by either a machine word or hex digits
+            if (z.isWord ())
+            {
+              out += 'w';
+              putRaw (out, z.word ());
+            }
+            else
+            {
+              out += 'h';
+              out += z.get ().get_str (16);
+            }
+          }
+          else if (t == typeid (MPQ))
+            out += static_cast<const MPQ&> (op).get ().get_str (16);
+          else if (t == typeid (BVAR))
+            putRaw (out, static_cast<const BVAR&> (op).get ().var);
+          else if (t == typeid (BVSORT))
+            putRaw (out, static_cast<const BVSORT&> (op).get ().m_width);
+          else
+            assert (0 && "unsupported terminal");
+        }
+
+        /** decodes a terminal with a given id. Returns NULL on error */
+        static Expr decode (const std::string &id,
+                            const char *data, size_t size,
+                            ExprFactory &efac)
+        {
+          if (id == "term:string")
+            return mkTerm<std::string> (std::string (data, size), efac);
+          if (id == "term:int")
+          {
+            int v;
+            return getRaw (data, size, v) ? mkTerm<int> (v, efac) : Expr ();
+          }
+          if (id == "term:uint")
+          {
+            unsigned int v;
+            return getRaw (data, size, v) ? mkTerm<unsigned int> (v, efac) : Expr ();
+          }
+          if (id == "term:ulong")
+          {
+            unsigned long v;
+            return getRaw (data, size, v) ? mkTerm<unsigned long> (v, efac) : Expr ();
+          }
+          if (id == "term:mpz")
+          {
+            if (size == 0) return Expr ();
+            if (data [0] == 'w')
+            {
+              long v;
+              return getRaw (data + 1, size - 1, v) ?
+                mkTerm<mpz_class> (v, efac) : Expr ();
+            }
+            mpz_class v;
+            if (data [0] != 'h' ||
+                v.set_str (std::string (data + 1, size - 1), 16) != 0)
+              return Expr ();
+            return mkTerm (v, efac);
+          }
+          if (id == "term:mpq")
+          {
+            mpq_class v;
+            if (v.set_str (std::string (data, size), 16) != 0) return Expr ();
+            return mkTerm (v, efac);
+          }
+          if (id == "term:bvar")
+          {
+            unsigned v;
+            return getRaw (data, size, v) ?
+              mkTerm (bind::BoundVar (v), efac) : Expr ();
+          }
+          if (id == "term:bvsort")
+          {
+            unsigned v;
+            return getRaw (data, size, v) ? bv::bvsort (v, efac) : Expr ();
+          }
+          return Expr ();
+        }
+      };
+    }
+
+    /**
+     * Writes the DAG rooted at roots to OS. Returns false if the DAG
+     * contains an operator that cannot be serialized.
+     */
+    template <typename Range>
+    bool write (std::ostream &OS, const Range &roots)
+    {
+      using namespace detail;
+
+      std::unordered_map<const ENode*, uint32_t> ids;
+      std::map<std::string, uint32_t> opIdx;
+      std::vector<OpEntry> ops;
+      std::vector<NodeEntry> nodes;
+      std::vector<uint32_t> args;
+      std::vector<uint32_t> rootIds;
+      std::string blob;
+
+      auto opIndex = [&] (const char *id) -> uint32_t
+      {
+        auto it = opIdx.find (id);
+        if (it != opIdx.end ()) return it->second;
+        OpEntry o;
+        o.off = blob.size ();
+        o.len = std::strlen (id);
+        blob.append (id, o.len);
+        ops.push_back (o);
+        opIdx [id] = ops.size () - 1;
+        return ops.size () - 1;
+      };
+
+      // -- iterative post-order: (node, index of next argument to visit)
+      std::vector<std::pair<ENode*, size_t> > stack;
+      for (Expr r : roots)
+      {
+        if (ids.count (r.get ()) == 0) stack.push_back (std::make_pair (r.get (), 0));
+        while (!stack.empty ())
+        {
+          ENode *n = stack.back ().first;
+          size_t &next = stack.back ().second;
+          if (next < n->arity ())
+          {
+            ENode *kid = n->arg (next++);
+            if (ids.count (kid) == 0) stack.push_back (std::make_pair (kid, 0));
+            continue;
+          }
+          stack.pop_back ();
+          if (ids.count (n)) continue;
+
+          NodeEntry ne;
+          ne.arity = n->arity ();
+          if (const char *tid = TerminalCodec::id (n->op ()))
+          {
+            assert (n->arity () == 0);
+            ne.op = opIndex (tid);
+            ne.data = blob.size ();
+            TerminalCodec::encode (n->op (), blob);
+            ne.size = blob.size () - ne.data;
+          }
+          else if (const char *oid = OpRegistry::get ().id (n->op ()))
+          {
+            ne.op = opIndex (oid);
+            ne.data = args.size ();
+            ne.size = 0;
+            for (const ENode *kid : mk_it_range (n->args_begin (), n->args_end ()))
+              args.push_back (ids [kid]);
+          }
+          else
+            return false;
+
+          uint32_t id = nodes.size ();
+          nodes.push_back (ne);
+          ids [n] = id;
+        }
+        rootIds.push_back (ids [r.get ()]);
+      }
+
+      Header h;
+      std::memset (&h, 0, sizeof (h));
+      std::memcpy (h.magic, magic, sizeof (magic));
+      h.byteOrder = byteOrder;
+      h.version = version;
+      h.numOps = ops.size ();
+      h.numNodes = nodes.size ();
+      h.numArgs = args.size ();
+      h.numRoots = rootIds.size ();
+      h.opsOff = align8 (sizeof (Header));
+      h.nodesOff = align8 (h.opsOff + ops.size () * sizeof (OpEntry));
+      h.argsOff = align8 (h.nodesOff + nodes.size () * sizeof (NodeEntry));
+      h.rootsOff = align8 (h.argsOff + args.size () * sizeof (uint32_t));
+      h.blobOff = align8 (h.rootsOff + rootIds.size () * sizeof (uint32_t));
+      h.blobSize = blob.size ();
+
+      uint64_t pos = 0;
+      auto emit = [&] (uint64_t off, const void *data, size_t size)
+      {
+        static const char zeros [8] = {0};
+        assert (off >= pos && off - pos < 8);
+        OS.write (zeros, off - pos);
+        if (size > 0) OS.write (static_cast<const char*> (data), size);
+        pos = off + size;
+      };
+
+      emit (0, &h, sizeof (h));
+      emit (h.opsOff, ops.data (), ops.size () * sizeof (OpEntry));
+      emit (h.nodesOff, nodes.data (), nodes.size () * sizeof (NodeEntry));
+      emit (h.argsOff, args.data (), args.size () * sizeof (uint32_t));
+      emit (h.rootsOff, rootIds.data (), rootIds.size () * sizeof (uint32_t));
+      emit (h.blobOff, blob.data (), blob.size ());
+      return OS.good ();
+    }
+
+    /**
+     * Reads the DAG stored in [data, data+size), e.g., a mapped file,
+     * and appends its roots to out. Returns false if the buffer is
+     * malformed or refers to an unknown operator.
+     */
+    template <typename OutputIterator>
+    bool read (const char *data, size_t size, ExprFactory &efac,
+               OutputIterator out)
+    {
+      using namespace detail;
+
+      if (size < sizeof (Header)) return false;
+      Header h;
+      std::memcpy (&h, data, sizeof (h));
+      if (std::memcmp (h.magic, magic, sizeof (magic)) != 0 ||
+          h.byteOrder != byteOrder || h.version != version)
+        return false;
+
+      auto fits = [size] (uint64_t off, uint64_t n, size_t sz)
+      { return off <= size && n <= (size - off) / sz; };
+      if (!fits (h.opsOff, h.numOps, sizeof (OpEntry)) ||
+          !fits (h.nodesOff, h.numNodes, sizeof (NodeEntry)) ||
+          !fits (h.argsOff, h.numArgs, sizeof (uint32_t)) ||
+          !fits (h.rootsOff, h.numRoots, sizeof (uint32_t)) ||
+          !fits (h.blobOff, h.blobSize, 1))
+        return false;
+
+      const char *blob = data + h.blobOff;
+
+      // -- resolve the operator table. A terminal has no prototype
+      std::vector<std::string> opIds (h.numOps);
+      std::vector<const Operator*> protos (h.numOps);
+      for (uint32_t i = 0; i < h.numOps; ++i)
+      {
+        OpEntry o;
+        std::memcpy (&o, data + h.opsOff + i * sizeof (OpEntry), sizeof (o));
+        if (uint64_t (o.off) + o.len > h.blobSize) return false;
+        opIds [i].assign (blob + o.off, o.len);
+        protos [i] = OpRegistry::get ().find (opIds [i]);
+        if (protos [i] == NULL && opIds [i].compare (0, 5, "term:") != 0)
+          return false;
+      }
+
+      ExprVector nodes;
+      nodes.reserve (h.numNodes);
+      ExprVector kids;
+      for (uint32_t i = 0; i < h.numNodes; ++i)
+      {
+        NodeEntry ne;
+        std::memcpy (&ne, data + h.nodesOff + i * sizeof (NodeEntry), sizeof (ne));
+        if (ne.op >= h.numOps) return false;
+
+        Expr e;
+        if (protos [ne.op] == NULL)
+        {
+          if (ne.arity != 0 || uint64_t (ne.data) + ne.size > h.blobSize)
+            return false;
+          e = TerminalCodec::decode (opIds [ne.op], blob + ne.data,
+                                     ne.size, efac);
+        }
+        else if (ne.arity == 0)
+          e = efac.mkTerm (*protos [ne.op]);
+        else
+        {
+          if (uint64_t (ne.data) + ne.arity > h.numArgs) return false;
+          kids.clear ();
+          for (uint32_t j = 0; j < ne.arity; ++j)
+          {
+            uint32_t k;
+            std::memcpy (&k, data + h.argsOff + (ne.data + j) * sizeof (uint32_t),
+                         sizeof (k));
+            if (k >= i) return false;
+            kids.push_back (nodes [k]);
+          }
+          e = efac.mkNary (*protos [ne.op], kids.begin (), kids.end ());
+        }
+        if (!e) return false;
+        nodes.push_back (e);
+      }
+
+      for (uint32_t i = 0; i < h.numRoots; ++i)
+      {
+        uint32_t k;
+        std::memcpy (&k, data + h.rootsOff + i * sizeof (uint32_t), sizeof (k));
+        if (k >= h.numNodes) return false;
+        *out++ = nodes [k];
+      }
+      return true;
+    }
+
+    /** Writes the DAG rooted at roots into a file */
+    template <typename Range>
+    bool save (const std::string &fname, const Range &roots)
+    {
+      std::ofstream OS (fname.c_str (), std::ios::binary | std::ios::trunc);
+      return OS && write (OS, roots);
+    }
+
+    /** Like save(), but through a temporary file so that a reader
+        never sees a partial file */
+    template <typename Range>
+    bool saveAtomic (const std::string &fname, const Range &roots)
+    {
+      std::string tmp = fname + ".tmp" + std::to_string (::getpid ());
+      if (!save (tmp, roots))
+      {
+        std::remove (tmp.c_str ());
+        return false;
+      }
+      return std::rename (tmp.c_str (), fname.c_str ()) == 0;
+    }
+
+    /** Replaces the terminals that cannot be written, e.g., the ones
+        holding pointers, by strings of how they print. Distinct
+        terminals that print the same get a suffix */
+    inline void nameOpaqueTerminals (std::vector<Expr> &roots, ExprFactory &efac)
+    {
+      struct IsOpaque : public std::unary_function<Expr, bool>
+      {
+        bool operator() (Expr e)
+        {
+          return e->arity () == 0 && !detail::TerminalCodec::id (e->op ()) &&
+            !OpRegistry::get ().id (e->op ());
+        }
+      };
+
+      ExprSet opaque;
+      for (Expr e : roots) filter (e, IsOpaque (), std::inserter (opaque, opaque.end ()));
+      if (opaque.empty ()) return;
+
+      ExprMap names;
+      std::set<std::string> used;
+      for (Expr e : opaque)
+      {
+        std::ostringstream os;
+        os << *e;
+        std::string name = os.str ();
+        for (unsigned k = 1; !used.insert (name).second; ++k)
+          name = os.str () + "!" + std::to_string (k);
+        names [e] = mkTerm<std::string> (name, efac);
+      }
+      for (Expr &e : roots) e = replace (e, names);
+    }
+
+    /** Maps a file written by save() into memory and reads it */
+    template <typename OutputIterator>
+    bool load (const std::string &fname, ExprFactory &efac,
+               OutputIterator out)
+    {
+      int fd = ::open (fname.c_str (), O_RDONLY);
+      if (fd < 0) return false;
+
+      struct stat st;
+      if (::fstat (fd, &st) != 0 || st.st_size == 0)
+      {
+        ::close (fd);
+        return false;
+      }
+
+      void *data = ::mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      ::close (fd);
+      if (data == MAP_FAILED) return false;
+
+      bool res = read (static_cast<const char*> (data), st.st_size, efac, out);
+      ::munmap (data, st.st_size);
+      return res;
+    }
+  }
+}
 
 #endif
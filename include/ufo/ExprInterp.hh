@@ -37,7 +37,7 @@ namespace expr
                                   int depth,
                                   bool brkt,
                                   const std::string &name,
-                                  const std::vector<ENode*> &args)
+                                  const ENodeArgs &args)
         {
           OS << "[";
           unsigned sz = args.size ();
@@ -62,7 +62,7 @@ namespace expr
                                   int depth,
                                   bool brkt,
                                   const std::string &name,
-                                  const std::vector<ENode*> &args)
+                                  const ENodeArgs &args)
         {
           
           if (args.size () == 1) args [0]->Print (OS, depth, false);
@@ -2,6 +2,7 @@
 #define __EXPR__LLVM__HPP_
 
 #include "ufo/Expr.hpp"
+#include "ufo/ExprDagPrint.hpp"
 
 #include <boost/functional/hash.hpp>
 
@@ -31,6 +32,13 @@ namespace expr
     OS << boost::lexical_cast<std::string> (n);
     return OS;
   }
+
+  inline llvm::raw_ostream &operator<<(llvm::raw_ostream &OS,
+                                       const DagPrinter &p)
+  {
+    printDag (OS, p.e, p.opts);
+    return OS;
+  }
   
   using namespace llvm;
   template<> struct TerminalTrait<const Function*>
@@ -135,6 +143,9 @@ namespace expr
     // https://llvm.org/svn/llvm-project/polly/trunk/lib/Support/GICHelper.cpp
     // return v.getSExtValue ();
 
+    if (sizeof (long) >= sizeof (int64_t) && v.getMinSignedBits () <= 64)
+      return mpz_class (static_cast<long> (v.getSExtValue ()));
+
     APInt abs;
     abs = v.isNegative () ? v.abs () : v;
     
@@ -147,6 +158,15 @@ namespace expr
 
     return v.isNegative () ? mpz_class(-res) : res;
   }
+
+  /** Creates an integer terminal of v. Assumes that v is signed.
+      Values that fit a word do not go through GMP */
+  inline Expr mkTerm (const APInt &v, ExprFactory &efac)
+  {
+    if (sizeof (long) >= sizeof (int64_t) && v.getMinSignedBits () <= 64)
+      return mkTerm<mpz_class> (static_cast<long> (v.getSExtValue ()), efac);
+    return mkTerm<mpz_class> (toMpz (v), efac);
+  }
   
   inline mpz_class toMpz (const Value *v)
   {
@@ -184,6 +204,10 @@ namespace expr
 
   inline APInt toAPInt (unsigned numBits, const mpz_class &v)
   {
+    // -- a word is truncated, or sign-extended, to numBits
+    if (sizeof (long) >= sizeof (int64_t) && v.fits_slong_p ())
+      return APInt (numBits, static_cast<uint64_t> (v.get_si ()), true);
+
     uint64_t *p = nullptr;
     size_t sz;
 
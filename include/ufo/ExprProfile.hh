@@ -0,0 +1,39 @@
+#ifndef _EXPR_PROFILE__HH_
+#define _EXPR_PROFILE__HH_
+/// Publishing of ExprFactory profiles through Stats
+
+#include "ufo/Expr.hpp"
+#include "ufo/Stats.hh"
+
+namespace ufo
+{
+  /// Copies the profile of efac into Stats counters named prefix.*
+  inline void publishExprProfile (const expr::ExprFactory &efac,
+                                  const std::string &prefix)
+  {
+    const expr::ExprFactoryProfile *p = efac.getProfile ();
+    if (!p) return;
+    p->forEach ([&prefix] (const std::string &name, size_t v)
+                { Stats::uset (prefix + "." + name, v); });
+  }
+
+  /// Publishes the profile of efac whenever statistics are printed.
+  /// Call removeExprProfileHook before efac is destroyed.
+  inline void addExprProfileHook (const expr::ExprFactory &efac,
+                                  const std::string &prefix)
+  {
+    const expr::ExprFactory *pefac = &efac;
+    Stats::addPrintHook (prefix, [pefac, prefix] ()
+                         { publishExprProfile (*pefac, prefix); });
+  }
+
+  /// Publishes a last time and removes the hook of addExprProfileHook
+  inline void removeExprProfileHook (const expr::ExprFactory &efac,
+                                     const std::string &prefix)
+  {
+    publishExprProfile (efac, prefix);
+    Stats::removePrintHook (prefix);
+  }
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef __MEMORY_BUDGET_HPP_
+#define __MEMORY_BUDGET_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+/**
+ * A memory budget of the process, shared by the caches that can be
+ * rebuilt on demand: the marshal and query caches of ZContext and
+ * the persistent memos of dagVisit.
+ *
+ * A cache derives from BudgetedCache and calls poll () at a point
+ * where it may drop its entries, e.g., when a marshaling starts.
+ * Once the resident set size of the process goes above the budget,
+ * the cache that was used least recently is chosen for eviction, one
+ * every check while the pressure lasts. A cache that is safe to flush
+ * from any thread is flushed at once; any other one flushes itself at
+ * its next poll, in the thread that uses it. The size is read at most
+ * once every checkPeriod (). Evictions are reported by Stats as
+ * memory.*
+ */
+namespace ufo
+{
+  class BudgetedCache;
+
+  class MemoryBudget
+  {
+  public:
+    /** totals of the evictions, and those of every kind of cache */
+    struct Counters
+    {
+      unsigned long checks;
+      unsigned long pressure;
+      unsigned long evictions;
+      unsigned long entries;
+      std::map<std::string,unsigned long> byName;
+      Counters () : checks (0), pressure (0), evictions (0), entries (0) {}
+    };
+
+  private:
+    friend class BudgetedCache;
+    typedef std::chrono::steady_clock clock;
+
+    static clock::duration checkPeriod () { return std::chrono::milliseconds (10); }
+
+    struct State
+    {
+      /** in MB, 0 means no budget. Set by --mem-budget */
+      unsigned budgetMb;
+      std::atomic<unsigned long> tick;
+      std::atomic<clock::rep> nextCheck;
+      std::mutex lock;
+      /** guarded by lock */
+      std::vector<BudgetedCache*> caches;
+      Counters counters;
+      State () : budgetMb (0), tick (0), nextCheck (0) {}
+    };
+
+    static State &state ()
+    {
+      static State s;
+      return s;
+    }
+
+    /** called by poll. Chooses a victim if the process is over the
+        budget. Returns the victim if the caller must flush it */
+    static BudgetedCache *check ();
+    static void evicted (const BudgetedCache &c, size_t entries);
+
+  public:
+    /** the budget in MB. A reference, so that an option can be
+        stored in it directly. 0 means no budget */
+    static unsigned &budgetMb () { return state ().budgetMb; }
+
+    /** resident set size of the process in KB, 0 if unknown */
+    static long rssKb ()
+    {
+      long pages = 0, rss = 0;
+      FILE *f = std::fopen ("/proc/self/statm", "r");
+      if (!f) return 0;
+      if (std::fscanf (f, "%ld %ld", &pages, &rss) != 2) rss = 0;
+      std::fclose (f);
+      return rss * (sysconf (_SC_PAGESIZE) / 1024);
+    }
+
+    /** a copy of the counters */
+    static Counters counters ()
+    {
+      State &s = state ();
+      std::lock_guard<std::mutex> l (s.lock);
+      return s.counters;
+    }
+  };
+
+  /**
+   * A cache under the memory budget. Registered for its lifetime.
+   * flush () drops the entries that can be rebuilt and returns how
+   * many were dropped
+   */
+  class BudgetedCache
+  {
+    friend class MemoryBudget;
+    std::string m_name;
+    /** flush () may be called by any thread */
+    bool m_anyThread;
+    std::atomic<unsigned long> m_lastUse;
+    /** chosen for eviction, to be flushed at the next poll */
+    std::atomic<bool> m_evict;
+    bool m_registered;
+
+  protected:
+    BudgetedCache (const std::string &name, bool anyThread) :
+      m_name (name), m_anyThread (anyThread),
+      m_lastUse (MemoryBudget::state ().tick++), m_evict (false),
+      m_registered (true)
+    {
+      MemoryBudget::State &s = MemoryBudget::state ();
+      std::lock_guard<std::mutex> l (s.lock);
+      s.caches.push_back (this);
+    }
+
+    BudgetedCache (const BudgetedCache &) = delete;
+
+    virtual ~BudgetedCache () { leaveBudget (); }
+
+    /** unregisters the cache. To be called first by the destructor of
+        a cache that may be flushed by any thread */
+    void leaveBudget ()
+    {
+      MemoryBudget::State &s = MemoryBudget::state ();
+      std::lock_guard<std::mutex> l (s.lock);
+      if (!m_registered) return;
+      m_registered = false;
+      s.caches.erase (std::find (s.caches.begin (), s.caches.end (), this));
+    }
+
+    virtual size_t flush () = 0;
+
+    /** records a use of the cache, and flushes it if it was chosen */
+    void poll ()
+    {
+      MemoryBudget::State &s = MemoryBudget::state ();
+      if (s.budgetMb == 0) return;
+      m_lastUse.store (s.tick++, std::memory_order_relaxed);
+
+      BudgetedCache *victim = MemoryBudget::check ();
+      if (victim == this || m_evict.load (std::memory_order_relaxed))
+      {
+        m_evict = false;
+        MemoryBudget::evicted (*this, flush ());
+      }
+    }
+
+  public:
+    const std::string &cacheName () const { return m_name; }
+  };
+
+  inline BudgetedCache *MemoryBudget::check ()
+  {
+    State &s = state ();
+    clock::rep now = clock::now ().time_since_epoch ().count ();
+    clock::rep next = s.nextCheck.load (std::memory_order_relaxed);
+    // -- one thread checks in a period
+    if (now < next ||
+        !s.nextCheck.compare_exchange_strong
+        (next, now + checkPeriod ().count ()))
+      return nullptr;
+
+    bool over = rssKb () > 1024L * s.budgetMb;
+    BudgetedCache *victim = nullptr;
+    {
+      std::lock_guard<std::mutex> l (s.lock);
+      ++s.counters.checks;
+      if (!over) return nullptr;
+      ++s.counters.pressure;
+      for (BudgetedCache *c : s.caches)
+        if (!c->m_evict && (!victim || c->m_lastUse < victim->m_lastUse))
+          victim = c;
+      if (!victim) return nullptr;
+      if (!victim->m_anyThread)
+      {
+        victim->m_evict = true;
+        return victim;
+      }
+      // -- flushed with the lock held, so that it is not deleted. Then
+      // -- the next cache in LRU order is the next victim
+      s.counters.evictions++;
+      size_t n = victim->flush ();
+      victim->m_lastUse = s.tick++;
+      s.counters.entries += n;
+      s.counters.byName [victim->m_name] += n;
+    }
+    return nullptr;
+  }
+
+  inline void MemoryBudget::evicted (const BudgetedCache &c, size_t entries)
+  {
+    State &s = state ();
+    std::lock_guard<std::mutex> l (s.lock);
+    s.counters.evictions++;
+    s.counters.entries += entries;
+    s.counters.byName [c.m_name] += entries;
+  }
+}
+
+#endif
@@ -30,9 +30,19 @@ DM-0002198
 
 
 #include <sstream>
+#include <fstream>
+#include <cstdint>
+#include <climits>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
 
 #include <unordered_map>
 #include <unordered_set>
+#include <list>
 
 #include <boost/range/algorithm/sort.hpp>
 #include <boost/range/algorithm/copy.hpp>
@@ -43,6 +53,9 @@ DM-0002198
 
 #include "ufo/Expr.hpp"
 #include "ufo/ExprInterp.hh"
+#include "ufo/MemoryBudget.hpp"
+#include "ufo/Stats.hh"
+#include "ufo/Trace.hh"
 
 namespace z3
 {
@@ -164,7 +177,8 @@ namespace ufo
 	res.push_back (z3.toExpr (gast));
       }
 
-    return mknary<AND> (mk<FALSE> (e->efac ()), res);
+    // -- an empty goal is valid
+    return mknary<AND> (mk<TRUE> (e->efac ()), res);
   }
 
 
@@ -210,24 +224,406 @@ namespace ufo
   template <typename Z> class ZSolver;
   template <typename Z> class ZModel;
   template <typename Z> class ZFixedPoint;
+  template <typename Z> class ZSolverPool;
+  template <typename Z> class ZQueryCache;
   template <typename Z> class ZParams;
 
   template <typename V>
   void z3n_set_param (char const *p, V v) { z3::set_param (p, v); }
   inline void z3n_reset_params () { z3::reset_params (); }
 
+  /**
+   * Resource limits of a solver call. Zero means unbounded. The
+   * timeout is in milliseconds. The rlimit is in the resource units
+   * of Z3, which, unlike time, are the same across runs and
+   * machines. Fixedpoints only honour the timeout
+   */
+  struct ZBudget
+  {
+    unsigned timeout;
+    unsigned rlimit;
+    ZBudget (unsigned t = 0, unsigned r = 0) : timeout (t), rlimit (r) {}
+    bool unbounded () const { return timeout == 0 && rlimit == 0; }
+  };
+
+  /** telemetry of one call to a solver or a fixedpoint */
+  struct ZQueryRecord
+  {
+    /** sequence number of the call */
+    size_t id;
+    /** solve, solveAssuming or query */
+    const char *kind;
+    /** wall time, in seconds */
+    double wall;
+    /** resource units used by the call */
+    uint64_t rlimit;
+    /** number of assertions (rules and queries of a fixedpoint) */
+    size_t assertions;
+    /** number of distinct terms of the assertions */
+    size_t dagSize;
+    boost::tribool result;
+    ZBudget budget;
+
+    ZQueryRecord () : id (0), kind (""), wall (0), rlimit (0),
+                      assertions (0), dagSize (0),
+                      result (boost::indeterminate) {}
+  };
+
+  /**
+   * Telemetry of all solver and fixedpoint calls of the process.
+   * Disabled by default. When enabled, keeps totals and the slowest
+   * calls, published in Stats as z3.telemetry.*, and optionally
+   * writes every call as a line of JSON to a log file
+   */
+  class ZTelemetry
+  {
+    struct State
+    {
+      bool enabled;
+      size_t calls;
+      size_t unknown;
+      double wall;
+      uint64_t rlimit;
+      size_t maxSlowest;
+      /** slowest first */
+      std::vector<ZQueryRecord> slowest;
+      std::ofstream log;
+      /** calls may be recorded by different threads */
+      std::mutex lock;
+      State () : enabled (false), calls (0), unknown (0), wall (0),
+                 rlimit (0), maxSlowest (10) {}
+    };
+
+    static State &state ()
+    {
+      static State s;
+      return s;
+    }
+
+    static void registerStats ()
+    {
+      static bool done = (Stats::addPrintHook ("z3.telemetry", [] ()
+        {
+          State &s = state ();
+          Stats::uset ("z3.telemetry.calls", s.calls);
+          Stats::uset ("z3.telemetry.unknown", s.unknown);
+          Stats::uset ("z3.telemetry.wall_ms", s.wall * 1000);
+          Stats::uset ("z3.telemetry.krlimit", s.rlimit / 1000);
+
+          std::ostringstream out;
+          for (const ZQueryRecord &r : s.slowest)
+            out << (out.tellp () > 0 ? "; #" : "#") << r.id << " " << r.kind << " " << r.wall << "s"
+                << " rlimit=" << r.rlimit << " asserts=" << r.assertions
+                << " dag=" << r.dagSize << " " << resultName (r.result);
+          if (!s.slowest.empty ()) Stats::sset ("z3.telemetry.slowest", out.str ());
+        }), true);
+      (void) done;
+    }
+
+    static const char *resultName (boost::tribool r)
+    {
+      if (r) return "sat";
+      if (!r) return "unsat";
+      return "unknown";
+    }
+
+  public:
+    static void enable (bool v = true) { state ().enabled = v; registerStats (); }
+    static bool enabled () { return state ().enabled; }
+    /** number of slowest calls that are kept */
+    static void setMaxSlowest (size_t v) { state ().maxSlowest = v; }
+
+    /** logs every call to path. Returns false if it cannot be written */
+    static bool setLog (const std::string &path)
+    {
+      State &s = state ();
+      if (s.log.is_open ()) s.log.close ();
+      s.log.open (path.c_str (), std::ios::out | std::ios::trunc);
+      return s.log.is_open ();
+    }
+
+    /** id of the next call */
+    static size_t nextId () { return state ().calls; }
+
+    static void record (const ZQueryRecord &r)
+    {
+      State &s = state ();
+      std::lock_guard<std::mutex> l (s.lock);
+      ++s.calls;
+      if (boost::indeterminate (r.result)) ++s.unknown;
+      s.wall += r.wall;
+      s.rlimit += r.rlimit;
+
+      std::vector<ZQueryRecord> &v = s.slowest;
+      if (v.size () < s.maxSlowest || (!v.empty () && v.back ().wall < r.wall))
+      {
+        auto pos = std::upper_bound (v.begin (), v.end (), r,
+                                     [] (const ZQueryRecord &x, const ZQueryRecord &y)
+                                     { return x.wall > y.wall; });
+        v.insert (pos, r);
+        if (v.size () > s.maxSlowest) v.pop_back ();
+      }
+
+      if (s.log.is_open ())
+      {
+        s.log << "{\"id\": " << r.id << ", \"kind\": \"" << r.kind << "\""
+              << ", \"wall\": " << r.wall << ", \"rlimit\": " << r.rlimit
+              << ", \"assertions\": " << r.assertions
+              << ", \"dag\": " << r.dagSize
+              << ", \"result\": \"" << resultName (r.result) << "\""
+              << ", \"timeout\": " << r.budget.timeout
+              << ", \"rlimit_budget\": " << r.budget.rlimit << "}\n";
+        s.log.flush ();
+      }
+    }
+
+    static const std::vector<ZQueryRecord> &slowest () { return state ().slowest; }
+
+    static void clear ()
+    {
+      State &s = state ();
+      s.calls = s.unknown = 0;
+      s.wall = 0;
+      s.rlimit = 0;
+      s.slowest.clear ();
+    }
+
+    /** value of the rlimit count statistic, 0 if there is none */
+    static uint64_t rlimitCount (Z3_context ctx, Z3_stats st)
+    {
+      Z3_stats_inc_ref (ctx, st);
+      uint64_t res = 0;
+      for (unsigned i = 0; i < Z3_stats_size (ctx, st); ++i)
+        if (std::string (Z3_stats_get_key (ctx, st, i)) == "rlimit count"
+            && Z3_stats_is_uint (ctx, st, i))
+          res = Z3_stats_get_uint_value (ctx, st, i);
+      Z3_stats_dec_ref (ctx, st);
+      return res;
+    }
+  };
+
+  /**
+   * Telemetry of one call. Started on construction. Does nothing if
+   * telemetry is disabled
+   */
+  class ZQueryTimer
+  {
+    /** the call as an event of the timeline of ufo::Trace */
+    ScopedTrace m_trace;
+    bool m_on;
+    ZQueryRecord m_rec;
+    std::chrono::steady_clock::time_point m_start;
+
+  public:
+    ZQueryTimer (const char *kind, const ZBudget &b) :
+      m_trace (kind, "z3"), m_on (ZTelemetry::enabled ())
+    {
+      if (!m_on) return;
+      m_rec.kind = kind;
+      m_rec.budget = b;
+      m_start = std::chrono::steady_clock::now ();
+    }
+
+    bool enabled () const { return m_on; }
+
+    /** size of the query, computed only if telemetry is enabled */
+    void setSize (size_t assertions, Expr conj)
+    {
+      m_rec.assertions = assertions;
+      if (conj) m_rec.dagSize = dagSize (conj);
+    }
+
+    /** records the call. rlimit is the number of resource units used */
+    void done (boost::tribool res, uint64_t rlimit)
+    {
+      if (!m_on) return;
+      std::chrono::duration<double> d = std::chrono::steady_clock::now () - m_start;
+      m_rec.id = ZTelemetry::nextId ();
+      m_rec.wall = d.count ();
+      m_rec.rlimit = rlimit;
+      m_rec.result = res;
+      ZTelemetry::record (m_rec);
+    }
+  };
+
+
 
 
   using namespace boost;
 
+  /**
+   * Marshaled terms kept by a ZContext across calls to toAst, and so
+   * across resets of the solvers of the context. Used by the
+   * marshaler in place of the per-call table of marshaled terms.
+   *
+   * Every call to toAst is a generation. Terms are first cached as
+   * young; a term that is used again in a later generation is
+   * promoted to old. When the cache holds more than its budget of
+   * terms, the least recently used young terms are evicted first,
+   * then the least recently used old ones. Pinned terms are never
+   * evicted and are not counted against the budget. Eviction only
+   * happens between generations.
+   */
+  class ZMarshalCache : boost::noncopyable
+  {
+  public:
+    typedef std::pair<const Expr, z3::ast> value_type;
+    typedef const value_type *const_iterator;
+
+    /** totals over all caches. Published as z3.marshal.* in
+        Stats. Atomic since contexts may be used by different threads */
+    struct Counters
+    {
+      std::atomic<size_t> hits;
+      std::atomic<size_t> misses;
+      std::atomic<size_t> evictions;
+
+      Counters () : hits (0), misses (0), evictions (0) {}
+      /** snapshot of o */
+      Counters (const Counters &o) :
+        hits (o.hits.load ()), misses (o.misses.load ()), evictions (o.evictions.load ()) {}
+    };
+
+    static Counters &counters ()
+    {
+      static Counters c;
+      return c;
+    }
+
+    /** default budget, in terms */
+    static const size_t default_budget = 1 << 18;
+
+  private:
+    enum Segment { YOUNG = 0, OLD = 1, PINNED = 2 };
+
+    struct Entry
+    {
+      value_type kv;
+      unsigned gen;
+      Segment seg;
+      Entry (Expr e, z3::ast a, unsigned g) : kv (e, a), gen (g), seg (YOUNG) {}
+    };
+    typedef std::list<Entry> list_type;
+
+    /** most recently used first */
+    list_type m_lists [3];
+    std::unordered_map<ENode*, list_type::iterator> m_map;
+    unsigned m_gen;
+    size_t m_budget;
+
+    static void registerStats ()
+    {
+      static bool done = (Stats::addPrintHook ("z3.marshal", [] ()
+        {
+          Stats::uset ("z3.marshal.hits", counters ().hits);
+          Stats::uset ("z3.marshal.misses", counters ().misses);
+          Stats::uset ("z3.marshal.evictions", counters ().evictions);
+        }), true);
+      (void) done;
+    }
+
+    void move (list_type::iterator it, Segment seg)
+    {
+      m_lists [seg].splice (m_lists [seg].begin (), m_lists [it->seg], it);
+      it->seg = seg;
+    }
+
+  public:
+    ZMarshalCache () : m_gen (0), m_budget (default_budget)
+    { registerStats (); }
+
+    size_t size () const { return m_map.size (); }
+    size_t budget () const { return m_budget; }
+    void setBudget (size_t v) { m_budget = v; }
+
+    /** starts a new generation. Evicts terms over the budget */
+    void newGeneration ()
+    {
+      ++m_gen;
+      while (m_lists [YOUNG].size () + m_lists [OLD].size () > m_budget)
+      {
+        list_type &l = m_lists [YOUNG].empty () ? m_lists [OLD] : m_lists [YOUNG];
+        m_map.erase (&*l.back ().kv.first);
+        l.pop_back ();
+        ++counters ().evictions;
+      }
+    }
+
+    size_t count (Expr e) const { return m_map.count (&*e); }
+    const_iterator end () const { return NULL; }
+    const_iterator find (Expr e)
+    {
+      auto it = m_map.find (&*e);
+      if (it == m_map.end ()) return end ();
+
+      ++counters ().hits;
+      Entry &entry = *it->second;
+      // -- reused by a later generation
+      if (entry.gen != m_gen)
+      {
+        entry.gen = m_gen;
+        if (entry.seg != PINNED) move (it->second, OLD);
+      }
+      return &entry.kv;
+    }
+
+    void insert (const value_type &kv)
+    {
+      if (m_map.count (&*kv.first)) return;
+      ++counters ().misses;
+      m_lists [YOUNG].push_front (Entry (kv.first, kv.second, m_gen));
+      m_map [&*kv.first] = m_lists [YOUNG].begin ();
+    }
+
+    /** keeps e in the cache until unpinned. Returns false if e is not cached */
+    bool pin (Expr e)
+    {
+      auto it = m_map.find (&*e);
+      if (it == m_map.end ()) return false;
+      if (it->second->seg != PINNED) move (it->second, PINNED);
+      return true;
+    }
+
+    void unpin (Expr e)
+    {
+      auto it = m_map.find (&*e);
+      if (it != m_map.end () && it->second->seg == PINNED) 
+        move (it->second, OLD);
+    }
+
+    /** evicts every term that is not pinned. Returns their number */
+    size_t flushUnpinned ()
+    {
+      size_t n = 0;
+      for (Segment seg : {YOUNG, OLD})
+      {
+        for (Entry &entry : m_lists [seg]) m_map.erase (&*entry.kv.first);
+        n += m_lists [seg].size ();
+        m_lists [seg].clear ();
+      }
+      counters ().evictions += n;
+      return n;
+    }
+
+    void clear ()
+    {
+      m_map.clear ();
+      for (list_type &l : m_lists) l.clear ();
+    }
+  };
+
   /**
    * AST manager. Responsible for converting between Z3 ast and Expr.
    *
+   * The marshal, unmarshal and query caches of the context are under
+   * the MemoryBudget. Under pressure they are flushed by the thread
+   * that uses the context, when it next converts a term.
+   *
    * \tparam M marshaler that converts from Expr to z3::ast
    * \tparam U unmarshaler that converts from z3::ast to Expr
    */
   template <typename M, typename U>
-  class ZContext : boost::noncopyable
+  class ZContext : boost::noncopyable, public BudgetedCache
   {
   private:
     typedef ZContext<M,U> this_type;
@@ -240,30 +636,74 @@ namespace ufo
     z3::context ctx;
 
     cache_type cache;
+    /** marshaled terms that are not in cache. Declared after ctx so
+        that it is destroyed first */
+    ZMarshalCache m_marshalCache;
+    /** unmarshaled terms, shared by all conversions (e.g., by all
+        model evaluations) of the context. Flushed when it grows
+        over the budget of the marshal cache */
+    ast_expr_map m_unmarshalCache;
+    /** created on first use */
+    std::unique_ptr<ZSolverPool<this_type> > m_solverPool;
+    /** created on first use */
+    std::unique_ptr<ZQueryCache<this_type> > m_queryCache;
 
     void init ()
     {
       Z3_set_ast_print_mode (ctx, Z3_PRINT_SMTLIB2_COMPLIANT);
     }
 
+    size_t flush ()
+    {
+      size_t n = m_marshalCache.flushUnpinned () + m_unmarshalCache.size ();
+      m_unmarshalCache.clear ();
+      if (m_queryCache)
+      {
+        n += m_queryCache->size ();
+        m_queryCache->clear ();
+      }
+      return n;
+    }
+
   protected:
     z3::context &get_ctx () { return ctx; }
 
     z3::ast toAst (Expr e)
     {
-      expr_ast_map seen;
-      return M::marshal (e, get_ctx (), cache.left, seen);
+      poll ();
+      m_marshalCache.newGeneration ();
+      return M::marshal (e, get_ctx (), cache.left, m_marshalCache);
+    }
+    /** marshals the terms of a range as a single generation, so that
+        the subterms they share are marshaled once and none is
+        evicted before the last term is done */
+    template <typename Range, typename OutputIterator>
+    void toAsts (const Range &es, OutputIterator out)
+    {
+      poll ();
+      m_marshalCache.newGeneration ();
+      for (Expr e : es)
+        *out++ = M::marshal (e, get_ctx (), cache.left, m_marshalCache);
     }
     Expr toExpr (z3::ast a)
     {
       if (!a) return Expr();
 
-      ast_expr_map seen;
-      return U::unmarshal (a, get_efac (), cache.right, seen);
+      poll ();
+      if (m_unmarshalCache.size () > m_marshalCache.budget ()) 
+        m_unmarshalCache.clear ();
+      return U::unmarshal (a, get_efac (), cache.right, m_unmarshalCache);
     }
 
     ExprFactory &get_efac () { return efac; }
 
+    z3::ast translateAst (const z3::ast &a, this_type &to)
+    {
+      z3::ast res (to.ctx, Z3_translate (ctx, a, to.ctx));
+      to.ctx.check_error ();
+      return res;
+    }
+
     typedef std::unordered_set<Z3_func_decl> Z3_func_decl_set;
 
     void allDecls (Z3_ast a, Z3_func_decl_set &seen)
@@ -284,14 +724,87 @@ namespace ufo
 
   public:
 
-    ZContext (ExprFactory &ef) : efac(ef) { init (); }
-    ZContext (ExprFactory &ef, z3::config &c) : efac (ef), ctx(c) { init (); }
+    ZContext (ExprFactory &ef) : BudgetedCache ("z3.context", false), efac(ef)
+    { init (); }
+    ZContext (ExprFactory &ef, z3::config &c) :
+      BudgetedCache ("z3.context", false), efac (ef), ctx(c) { init (); }
+
+    ~ZContext () 
+    { 
+      m_solverPool.reset ();
+      m_queryCache.reset ();
+      m_marshalCache.clear (); 
+      m_unmarshalCache.clear ();
+      cache.clear (); 
+    }
 
-    ~ZContext () { cache.clear (); }
+    /**
+     * Marshals e and keeps it in the marshal cache until unpinned.
+     * For terms that are marshaled over and over again, e.g., the
+     * transition relation of a rule
+     */
+    void pinAst (Expr e)
+    {
+      toAst (e);
+      m_marshalCache.pin (e);
+    }
+    void unpinAst (Expr e) { m_marshalCache.unpin (e); }
+
+    /**
+     * Makes e available in the context to, of the same ExprFactory,
+     * without marshaling it there: the term of e in this context is
+     * copied with Z3_translate and cached in to, and so are the
+     * constants and declarations it uses, so that to unmarshals them.
+     * Neither context may be used by another thread meanwhile
+     */
+    void translate (Expr e, this_type &to)
+    {
+      assert (&efac == &to.efac);
+      z3::ast a (toAst (e));
+      if (to.m_marshalCache.count (e) == 0)
+        to.m_marshalCache.insert (ZMarshalCache::value_type (e, translateAst (a, to)));
+
+      ExprVector decls;
+      filter (e, [this, &to] (Expr x)
+              { return cache.left.count (x) > 0 && to.cache.left.count (x) == 0; },
+              std::back_inserter (decls));
+      for (Expr d : decls)
+        to.cache.left.insert (typename cache_type::left_map::value_type
+                              (d, translateAst (cache.left.find (d)->second, to)));
+      static StatsCounter &translated = Stats::counter ("z3.translate");
+      translated.inc ();
+    }
+
+    /** maximum number of (unpinned) terms in the marshal cache */
+    void setMarshalCacheBudget (size_t v) { m_marshalCache.setBudget (v); }
+    void clearMarshalCache () 
+    { 
+      m_marshalCache.clear (); 
+      m_unmarshalCache.clear ();
+    }
+    const ZMarshalCache &getMarshalCache () const { return m_marshalCache; }
+
+    /** pool of solvers shared by all clients of the context */
+    ZSolverPool<this_type> &solverPool ()
+    {
+      if (!m_solverPool) m_solverPool.reset (new ZSolverPool<this_type> (*this));
+      return *m_solverPool;
+    }
+
+    /** answers of the queries of the solvers of the context. Disabled
+        until ZQueryCache::enable () is called */
+    ZQueryCache<this_type> &queryCache ()
+    {
+      if (!m_queryCache) m_queryCache.reset (new ZQueryCache<this_type> (*this));
+      return *m_queryCache;
+    }
 
     template <typename V>
     void set (char const *p, V v) { ctx.set (p, v); }
 
+    /** interrupts the running solver or fixedpoint of the context */
+    void interrupt () { Z3_interrupt (ctx); }
+
     std::string toSmtLib (Expr e)
     { return boost::lexical_cast<std::string> (this->toAst (e)); }
 
@@ -450,9 +963,27 @@ namespace ufo
     Z& z3;
     z3::context &ctx;
     z3::params params;
+    /** budget set by set (ZBudget), if any */
+    bool m_hasBudget;
+    ZBudget m_budget;
 
   public:
-    ZParams (Z &z) : z3(z), ctx(z.get_ctx ()), params (z.get_ctx ())  {}
+    ZParams (Z &z) : z3(z), ctx(z.get_ctx ()), params (z.get_ctx ()),
+                     m_hasBudget (false) {}
+
+    /** sets the :timeout and :rlimit parameters of a solver. A
+        solver that is set with these parameters restores them after
+        calls with their own budget. Fixedpoints do not have an
+        :rlimit, see ZFixedPoint::setBudget */
+    void set (const ZBudget &b)
+    {
+      m_hasBudget = true;
+      m_budget = b;
+      params.set (":timeout", b.timeout > 0 ? b.timeout : UINT_MAX);
+      params.set (":rlimit", b.rlimit);
+    }
+    bool hasBudget () const { return m_hasBudget; }
+    const ZBudget &getBudget () const { return m_budget; }
     void set (std::string k, bool b) { params.set (k.c_str (), b); }
     void set (std::string k, unsigned n) { params.set (k.c_str (), n); }
     void set (std::string k, double n) { params.set (k.c_str (), n); }
@@ -471,6 +1002,366 @@ namespace ufo
   };
 
 
+  /**
+   * Answers of satisfiability queries, shared by the solvers of a
+   * ZContext. A query is the set of assertions of a solver together
+   * with the set of assumptions it is checked under. Both are
+   * normalized (ordered by id, without duplicates) and kept as
+   * hash-consed terms, so the same query asserted in a different
+   * order finds the same answer. The model of a sat answer and the
+   * core of an unsat answer are only kept if the solver asked for
+   * them.
+   *
+   * The cache is optionally backed by a file that keeps sat and
+   * unsat answers, and unsat cores, across runs. An entry of the file
+   * holds the normalized SMT-LIB text of its query, which is looked
+   * up by hash and compared in full on a hit. The file is only
+   * appended to. Models are only kept in memory.
+   *
+   * Unknown answers are not cached: they depend on the budget of the
+   * check, and a later check with a larger budget may decide the
+   * query. Sat and unsat answers hold under any budget.
+   */
+  template <typename Z>
+  class ZQueryCache : boost::noncopyable
+  {
+  public:
+    struct Answer
+    {
+      boost::tribool result;
+      /** model of a sat answer, if one was asked for */
+      std::shared_ptr<ZModel<Z> > model;
+      /** whether core is the unsat core of an unsat answer */
+      bool hasCore;
+      ExprVector core;
+      Answer () : result (boost::indeterminate), hasCore (false) {}
+    };
+    typedef std::shared_ptr<const Answer> answer_ptr;
+
+    /** a normalized query */
+    struct Query
+    {
+      ExprVector assertions;
+      ExprVector assumptions;
+      std::pair<Expr,Expr> key;
+    };
+
+    /** totals over all caches. Published as z3.query_cache.* in
+        Stats. Atomic since contexts may be used by different threads */
+    struct Counters
+    {
+      std::atomic<size_t> hits;
+      std::atomic<size_t> misses;
+      std::atomic<size_t> diskHits;
+
+      Counters () : hits (0), misses (0), diskHits (0) {}
+      /** snapshot of o */
+      Counters (const Counters &o) :
+        hits (o.hits.load ()), misses (o.misses.load ()), diskHits (o.diskHits.load ()) {}
+    };
+
+    static Counters &counters ()
+    {
+      static Counters c;
+      return c;
+    }
+
+    /** default capacity, in queries */
+    static const size_t default_capacity = 1 << 14;
+
+  private:
+    typedef std::pair<Expr,Expr> key_type;
+    struct KeyHash
+    {
+      size_t operator() (const key_type &k) const
+      { return k.first->hash () * 31 + k.second->hash (); }
+    };
+    typedef std::list<std::pair<key_type, answer_ptr> > list_type;
+
+    /** an answer read from the backing file */
+    struct DiskAnswer
+    {
+      char result;
+      bool hasCore;
+      /** positions of the core in the assumptions ordered by text */
+      std::vector<unsigned> core;
+      /** normalized text of the query */
+      std::string text;
+      DiskAnswer () : result ('?'), hasCore (false) {}
+    };
+
+    Z &m_z3;
+    bool m_enabled;
+    size_t m_capacity;
+    /** most recently used first */
+    list_type m_lru;
+    std::unordered_map<key_type, typename list_type::iterator, KeyHash> m_map;
+
+    std::unordered_map<uint64_t, DiskAnswer> m_disk;
+    std::ofstream m_out;
+
+    static void registerStats ()
+    {
+      static bool done = (Stats::addPrintHook ("z3.query_cache", [] ()
+        {
+          Stats::uset ("z3.query_cache.hits", counters ().hits);
+          Stats::uset ("z3.query_cache.misses", counters ().misses);
+          Stats::uset ("z3.query_cache.disk_hits", counters ().diskHits);
+        }), true);
+      (void) done;
+    }
+
+    static void normalize (ExprVector &v)
+    {
+      std::sort (v.begin (), v.end (),
+                 [] (Expr x, Expr y) { return x->getId () < y->getId (); });
+      v.erase (std::unique (v.begin (), v.end ()), v.end ());
+    }
+
+    /** whether a satisfies a request for a model or a core */
+    static bool covers (const Answer &a, bool model, bool core)
+    {
+      if (model && a.result && !a.model) return false;
+      if (core && !a.result && !a.hasCore) return false;
+      return true;
+    }
+
+    /** FNV-1a */
+    static uint64_t hashString (const std::string &s)
+    {
+      uint64_t h = 14695981039346656037ULL;
+      for (unsigned char c : s) { h ^= c; h *= 1099511628211ULL; }
+      return h;
+    }
+
+    /**
+     * Key of q in the backing file, the hash of text. text is the
+     * normalized SMT-LIB text of q, independent of names of terms in
+     * memory and of the order of declarations and assertions. Returns
+     * in lits the assumptions in the order used by the cores of the
+     * file
+     */
+    uint64_t diskKey (const Query &q, ExprVector &lits, std::string &text)
+    {
+      ExprVector all (q.assertions);
+      all.insert (all.end (), q.assumptions.begin (), q.assumptions.end ());
+
+      std::vector<std::string> decls;
+      std::istringstream in (m_z3.toSmtLibDecls (all));
+      for (std::string l; std::getline (in, l);) decls.push_back (l);
+      std::sort (decls.begin (), decls.end ());
+
+      std::vector<std::string> asserts;
+      for (Expr e : q.assertions) asserts.push_back (m_z3.toSmtLib (e));
+      std::sort (asserts.begin (), asserts.end ());
+
+      std::vector<std::pair<std::string,Expr> > assumps;
+      for (Expr e : q.assumptions)
+        assumps.push_back (std::make_pair (m_z3.toSmtLib (e), e));
+      std::sort (assumps.begin (), assumps.end (),
+                 [] (const std::pair<std::string,Expr> &x,
+                     const std::pair<std::string,Expr> &y)
+                 { return x.first < y.first; });
+
+      text.clear ();
+      for (const std::string &s : decls) text += s + "\n";
+      for (const std::string &s : asserts) text += "(assert " + s + ")\n";
+      text += "(check-sat";
+      lits.clear ();
+      for (auto &kv : assumps)
+      {
+        text += " " + kv.first;
+        lits.push_back (kv.second);
+      }
+      text += ")\n";
+      return hashString (text);
+    }
+
+    void store (const key_type &key, answer_ptr a)
+    {
+      auto it = m_map.find (key);
+      if (it != m_map.end ()) m_lru.erase (it->second);
+      m_lru.push_front (std::make_pair (key, a));
+      m_map [key] = m_lru.begin ();
+
+      while (m_lru.size () > m_capacity)
+      {
+        m_map.erase (m_lru.back ().first);
+        m_lru.pop_back ();
+      }
+    }
+
+    answer_ptr findOnDisk (const Query &q, bool model, bool core)
+    {
+      if (m_disk.empty ()) return answer_ptr ();
+
+      ExprVector lits;
+      std::string text;
+      auto it = m_disk.find (diskKey (q, lits, text));
+      if (it == m_disk.end ()) return answer_ptr ();
+      const DiskAnswer &d = it->second;
+      // -- a hash collision
+      if (d.text != text) return answer_ptr ();
+
+      std::shared_ptr<Answer> a = std::make_shared<Answer> ();
+      a->result = d.result == 's';
+      if (!a->result && d.hasCore)
+      {
+        a->hasCore = true;
+        for (unsigned i : d.core)
+        {
+          // -- a corrupt file
+          if (i >= lits.size ()) return answer_ptr ();
+          a->core.push_back (lits [i]);
+        }
+      }
+      if (!covers (*a, model, core)) return answer_ptr ();
+
+      store (q.key, a);
+      return a;
+    }
+
+    void writeToDisk (const Query &q, const Answer &a)
+    {
+      if (!m_out.is_open () || boost::indeterminate (a.result)) return;
+
+      ExprVector lits;
+      std::string text;
+      uint64_t h = diskKey (q, lits, text);
+
+      DiskAnswer d;
+      d.result = a.result ? 's' : 'u';
+      d.hasCore = a.hasCore;
+      d.text = text;
+      for (Expr c : a.core)
+      {
+        auto pos = std::find (lits.begin (), lits.end (), c);
+        // -- not a query assumption, the core cannot be saved
+        if (pos == lits.end ()) { d.hasCore = false; d.core.clear (); break; }
+        d.core.push_back (pos - lits.begin ());
+      }
+
+      auto it = m_disk.find (h);
+      // -- of two queries with the same hash, the first one is kept
+      if (it != m_disk.end () &&
+          (it->second.text != text || it->second.hasCore || !d.hasCore)) return;
+
+      // -- q <hash> <answer> <size of text> <core>..., then the text
+      m_out << "q " << std::hex << h << std::dec << " " << (d.hasCore ? 'c' : d.result)
+            << " " << text.size ();
+      for (unsigned i : d.core) m_out << " " << i;
+      m_out << "\n" << text << "\n";
+      m_out.flush ();
+      m_disk [h] = std::move (d);
+    }
+
+  public:
+    ZQueryCache (Z &z) : m_z3 (z), m_enabled (false),
+                         m_capacity (default_capacity)
+    { registerStats (); }
+
+    void enable (bool v = true) { m_enabled = v; }
+    bool enabled () const { return m_enabled; }
+
+    size_t size () const { return m_map.size (); }
+    void setCapacity (size_t v) { m_capacity = v; }
+
+    /**
+     * Reads the answers in the file at path and appends new answers
+     * to it. The file is created if it does not exist. Returns false
+     * if the file cannot be written
+     */
+    bool open (const std::string &path)
+    {
+      m_disk.clear ();
+      std::ifstream in (path.c_str ());
+      // -- lines that do not start a record, e.g., the entries of
+      // -- older files, which have no text, are skipped
+      for (std::string l; std::getline (in, l);)
+      {
+        std::istringstream ls (l);
+        std::string tag;
+        uint64_t h;
+        char r;
+        size_t n;
+        if (!(ls >> tag) || tag != "q") continue;
+        if (!(ls >> std::hex >> h >> std::dec >> r >> n)) continue;
+        if (r != 's' && r != 'u' && r != 'c') continue;
+
+        DiskAnswer d;
+        d.result = r == 's' ? 's' : 'u';
+        d.hasCore = r == 'c';
+        for (unsigned i; ls >> i;) d.core.push_back (i);
+        // -- a corrupt size
+        if (n > (size_t (1) << 30)) break;
+        d.text.resize (n);
+        if (n > 0 && !in.read (&d.text [0], n)) break;
+        // -- a truncated record, e.g., of a run that was killed
+        if (in.get () != '\n') break;
+        if (hashString (d.text) != h) continue;
+        m_disk [h] = std::move (d);
+      }
+
+      if (m_out.is_open ()) m_out.close ();
+      m_out.open (path.c_str (), std::ios::out | std::ios::app);
+      return m_out.is_open ();
+    }
+
+    /** normalizes the given assertions and assumptions */
+    Query query (const ExprVector &assertions, const ExprVector &assumptions)
+    {
+      Query q;
+      q.assertions = assertions;
+      q.assumptions = assumptions;
+      normalize (q.assertions);
+      normalize (q.assumptions);
+
+      Expr t = mk<TRUE> (m_z3.getExprFactory ());
+      q.key = std::make_pair (mknary<AND> (t, q.assertions),
+                              mknary<AND> (t, q.assumptions));
+      return q;
+    }
+
+    /**
+     * The answer of q if it is known and comes with a model (if sat
+     * and model is requested) and a core (if unsat and core is
+     * requested). Null otherwise
+     */
+    answer_ptr find (const Query &q, bool model = false, bool core = false)
+    {
+      auto it = m_map.find (q.key);
+      if (it != m_map.end () && covers (*it->second->second, model, core))
+      {
+        ++counters ().hits;
+        m_lru.splice (m_lru.begin (), m_lru, it->second);
+        return it->second->second;
+      }
+
+      answer_ptr a = findOnDisk (q, model, core);
+      if (a)
+      {
+        ++counters ().diskHits;
+        return a;
+      }
+      ++counters ().misses;
+      return answer_ptr ();
+    }
+
+    /** unknown answers are dropped */
+    void insert (const Query &q, const Answer &a)
+    {
+      if (boost::indeterminate (a.result)) return;
+      store (q.key, std::make_shared<Answer> (a));
+      writeToDisk (q, a);
+    }
+
+    void clear ()
+    {
+      m_map.clear ();
+      m_lru.clear ();
+    }
+  };
+
   template <typename Z>
   class ZSolver
   {
@@ -480,18 +1371,122 @@ namespace ufo
     z3::solver solver;
     ExprFactory &efac;
 
+    /** asserted terms, for the query cache */
+    ExprVector m_trail;
+    /** number of assertions that are not in m_trail. A solver with
+        such assertions does not use the query cache */
+    unsigned m_opaque;
+    /** sizes of m_trail and m_opaque at every push */
+    std::vector<std::pair<size_t,unsigned> > m_scopes;
+    /** answer of the last query if it came from the query cache */
+    typename ZQueryCache<Z>::answer_ptr m_answer;
+    /** standing budget of every call */
+    ZBudget m_budget;
+
+    boost::tribool check (const std::vector<Z3_ast> &lits, const char *kind)
+    {
+      m_answer.reset ();
+      ZQueryTimer timer (kind, m_budget);
+      uint64_t before = 0;
+      if (timer.enabled ())
+      {
+        timer.setSize (m_trail.size () + m_opaque,
+                       mknary<AND> (mk<TRUE> (efac), m_trail));
+        before = ZTelemetry::rlimitCount (ctx, Z3_solver_get_statistics (ctx, solver));
+      }
+
+      Z3_lbool r = lits.empty () ? Z3_solver_check (ctx, solver) :
+        Z3_solver_check_assumptions (ctx, solver, lits.size (), &lits [0]);
+      ctx.check_error ();
+      boost::tribool res = z3l_to_tribool (r);
+
+      if (timer.enabled ())
+      {
+        uint64_t after =
+          ZTelemetry::rlimitCount (ctx, Z3_solver_get_statistics (ctx, solver));
+        timer.done (res, after >= before ? after - before : after);
+      }
+      return res;
+    }
+
+    template <typename Range>
+    boost::tribool solveCached (const Range &lits, bool model, bool core)
+    {
+      ZQueryCache<Z> &qc = z3.queryCache ();
+      ExprVector assumptions (boost::begin (lits), boost::end (lits));
+      if (!qc.enabled () || m_opaque > 0)
+        return assumptions.empty () ? solve () : solveAssuming (assumptions);
+
+      typename ZQueryCache<Z>::Query q = qc.query (m_trail, assumptions);
+      typename ZQueryCache<Z>::answer_ptr cached = qc.find (q, model, core);
+      if (cached)
+      {
+        m_answer = cached;
+        return cached->result;
+      }
+
+      typename ZQueryCache<Z>::Answer a;
+      a.result = assumptions.empty () ? solve () : solveAssuming (assumptions);
+      if (model && a.result) a.model = std::make_shared<Model> (getModel ());
+      if (core && !a.result)
+      {
+        a.hasCore = true;
+        unsatCore (std::back_inserter (a.core));
+      }
+      qc.insert (q, a);
+      return a.result;
+    }
+
   public:
     typedef ZSolver<Z> this_type;
     typedef ZModel<Z> Model;
 
     ZSolver (Z &z) :
-      z3(z), ctx (z.get_ctx ()), solver (z.get_ctx ()), efac (z.get_efac ()) {}
+      z3(z), ctx (z.get_ctx ()), solver (z.get_ctx ()), efac (z.get_efac ()),
+      m_opaque (0) {}
 
     ZSolver (Z &z, const char *logic) :
-      z3(z), ctx (z.get_ctx ()), solver (z.get_ctx (), logic), efac (z.get_efac ()) {}
+      z3(z), ctx (z.get_ctx ()), solver (z.get_ctx (), logic), efac (z.get_efac ()),
+      m_opaque (0) {}
+
+    /**
+     * A solver that applies the tactics, in order, to the assertions
+     * before solving them, e.g., {"simplify", "solve-eqs", "smt"}.
+     * The last tactic must decide the goal. If a tactic fails, e.g.,
+     * "sat" on a goal that is not propositional, the assertions are
+     * solved by "smt" instead. Models are over the asserted terms:
+     * the model converters of the tactics map them back. Throws
+     * z3::exception if a tactic is unknown
+     */
+    ZSolver (Z &z, const std::vector<std::string> &tactics) :
+      z3(z), ctx (z.get_ctx ()), solver (fromTactics (z.get_ctx (), tactics)),
+      efac (z.get_efac ()), m_opaque (0) {}
+
+    static z3::solver fromTactics (z3::context &ctx,
+                                   const std::vector<std::string> &tactics)
+    {
+      if (tactics.empty ()) return z3::solver (ctx);
+      z3::tactic t (ctx, tactics [0].c_str ());
+      for (size_t i = 1; i < tactics.size (); ++i)
+        t = t & z3::tactic (ctx, tactics [i].c_str ());
+      return (t | z3::tactic (ctx, "smt")).mk_solver ();
+    }
 
     Z& getContext () {return z3;}
-    void set (const ZParams<Z> &p) { solver.set (p); }
+    void set (const ZParams<Z> &p)
+    {
+      solver.set (p);
+      if (p.hasBudget ()) m_budget = p.getBudget ();
+    }
+
+    /** limits every call that does not have its own budget */
+    void setBudget (const ZBudget &b)
+    {
+      ZParams<Z> p (z3);
+      p.set (b);
+      set (p);
+    }
+    const ZBudget &getBudget () const { return m_budget; }
 
     template <typename OutputStream>
     OutputStream &toSmtLib (OutputStream &out)
@@ -535,6 +1530,8 @@ namespace ufo
 					  0, NULL, ast);
       Z3_solver_assert (ctx, solver, forall);
       ctx.check_error ();
+      ++m_opaque;
+      m_answer.reset ();
     }
 
     void assertExpr (Expr e)
@@ -542,6 +1539,8 @@ namespace ufo
       z3::ast ast (z3.toAst (e));
       Z3_solver_assert (ctx, solver, ast);
       ctx.check_error ();
+      m_trail.push_back (e);
+      m_answer.reset ();
     }
 
     /// return assertions currently in the solver
@@ -556,9 +1555,15 @@ namespace ufo
 
 
     boost::tribool solve ()
+    { return check (std::vector<Z3_ast> (), "solve"); }
+
+    /** solve () within the given budget instead of the standing one */
+    boost::tribool solve (const ZBudget &b)
     {
-      boost::tribool res = z3l_to_tribool (Z3_solver_check (ctx, solver));
-      ctx.check_error ();
+      ZBudget saved = m_budget;
+      setBudget (b);
+      boost::tribool res = solve ();
+      setBudget (saved);
       return res;
     }
 
@@ -572,17 +1577,18 @@ namespace ufo
       for (unsigned i = 0; i < av.size (); ++i)
 	raw_av [i] = Z3_ast_vector_get (ctx, av, i);
 
-      boost::tribool res =
-	z3l_to_tribool (Z3_solver_check_assumptions (ctx, solver,
-						     raw_av.size (),
-						     &raw_av[0]));
-      ctx.check_error ();
-      return res;
+      return check (raw_av, "solveAssuming");
     }
 
     template <typename OutputIterator>
     void unsatCore (OutputIterator out) const
     {
+      if (m_answer && m_answer->hasCore)
+      {
+        for (const Expr &c : m_answer->core) *(out++) = c;
+        return;
+      }
+
       z3::ast_vector core (ctx, Z3_solver_get_unsat_core (ctx, solver));
       ctx.check_error ();
 
@@ -601,16 +1607,272 @@ namespace ufo
       return res;
     }
 
+    /**
+     * Like solve (), but answers from the query cache of the context
+     * if it is enabled and the same query was answered before. With
+     * model, a sat answer is only reused if its model was kept.
+     * getModel () is only available after a sat answer if model is
+     * true
+     */
+    boost::tribool solveCached (bool model = false)
+    { return solveCached (ExprVector (), model, false); }
+
+    /**
+     * Like solveAssuming (lits), but answers from the query cache of
+     * the context. unsatCore () is only available after an unsat
+     * answer if core is true
+     */
+    template <typename Range>
+    boost::tribool solveAssumingCached (const Range &lits, bool core = false)
+    { return solveCached (lits, false, core); }
 
     Model getModel () const
     {
+      if (m_answer && m_answer->model) return *m_answer->model;
       z3::model m (ctx, Z3_solver_get_model (ctx, solver));
       return ZModel<Z> (z3, m);
     }
 
-    void push () { solver.push (); }
-    void pop (unsigned n = 1) { solver.pop (n); }
-    void reset () { solver.reset (); }
+    void push ()
+    {
+      solver.push ();
+      m_scopes.push_back (std::make_pair (m_trail.size (), m_opaque));
+      m_answer.reset ();
+    }
+    void pop (unsigned n = 1)
+    {
+      solver.pop (n);
+      if (n > 0 && n <= m_scopes.size ())
+      {
+        m_trail.resize (m_scopes [m_scopes.size () - n].first);
+        m_opaque = m_scopes [m_scopes.size () - n].second;
+        m_scopes.resize (m_scopes.size () - n);
+      }
+      m_answer.reset ();
+    }
+    void reset ()
+    {
+      solver.reset ();
+      m_trail.clear ();
+      m_opaque = 0;
+      m_scopes.clear ();
+      m_answer.reset ();
+    }
+    /** number of scopes pushed and not popped yet */
+    unsigned numScopes () const 
+    { return Z3_solver_get_num_scopes (ctx, solver); }
+  };
+
+  /**
+   * Solvers of a context, handed out in leases. A lease owns a
+   * solver with one scope pushed. On release, the scopes are popped
+   * and the solver is kept for the next lease, which is cheaper than
+   * creating a new one or resetting it. Solvers are grouped by
+   * profile: a named set of parameters that are set on every solver
+   * of the profile when it is created. The default profile has no
+   * parameters. Shared by everyone using the context, see
+   * ZContext::solverPool ().
+   */
+  template <typename Z>
+  class ZSolverPool : boost::noncopyable
+  {
+  public:
+    typedef ZSolver<Z> solver_type;
+
+    class Lease
+    {
+      ZSolverPool *m_pool;
+      std::string m_profile;
+      std::unique_ptr<solver_type> m_solver;
+
+    public:
+      Lease () : m_pool (nullptr) {}
+      Lease (ZSolverPool &pool, const std::string &profile,
+             std::unique_ptr<solver_type> s) :
+        m_pool (&pool), m_profile (profile), m_solver (std::move (s)) {}
+      Lease (Lease &&o) :
+        m_pool (o.m_pool), m_profile (std::move (o.m_profile)),
+        m_solver (std::move (o.m_solver)) { o.m_pool = nullptr; }
+      Lease &operator= (Lease &&o)
+      {
+        if (this == &o) return *this;
+        release ();
+        m_pool = o.m_pool;
+        m_profile = std::move (o.m_profile);
+        m_solver = std::move (o.m_solver);
+        o.m_pool = nullptr;
+        return *this;
+      }
+      Lease (const Lease &) = delete;
+      Lease &operator= (const Lease &) = delete;
+      ~Lease () { release (); }
+
+      explicit operator bool () const { return m_solver.get () != nullptr; }
+      solver_type &operator* () const { return *m_solver; }
+      solver_type *operator-> () const { return m_solver.get (); }
+
+      /** removes all assertions. Replaces ZSolver::reset () */
+      void clear ()
+      {
+        m_solver->pop (m_solver->numScopes ());
+        m_solver->push ();
+      }
+
+      /** returns the solver to the pool */
+      void release ()
+      {
+        if (m_pool && m_solver)
+          m_pool->giveBack (m_profile, std::move (m_solver));
+        m_pool = nullptr;
+      }
+    };
+
+  private:
+    struct Profile
+    {
+      std::unique_ptr<ZParams<Z> > params;
+      /** tactics of the solvers, see ZSolver. None for a plain solver */
+      std::vector<std::string> tactics;
+      std::vector<std::unique_ptr<solver_type> > idle;
+    };
+
+    Z &m_z3;
+    std::map<std::string, Profile> m_profiles;
+    /** maximum number of idle solvers kept per profile */
+    size_t m_maxIdle;
+    /** number of solvers currently leased */
+    size_t m_leased;
+
+    void giveBack (const std::string &profile, std::unique_ptr<solver_type> s)
+    {
+      --m_leased;
+      Profile &p = m_profiles [profile];
+      s->pop (s->numScopes ());
+      if (p.idle.size () < m_maxIdle) p.idle.push_back (std::move (s));
+    }
+
+  public:
+    ZSolverPool (Z &z3) : m_z3 (z3), m_maxIdle (256), m_leased (0) {}
+    ~ZSolverPool () { assert (m_leased == 0 && "destroyed with leased solvers"); }
+
+    void setMaxIdle (size_t v) { m_maxIdle = v; }
+
+    /** defines (or redefines) a profile. Idle solvers of the profile
+        are dropped */
+    void setProfile (const std::string &name, const ZParams<Z> &params)
+    {
+      Profile &p = m_profiles [name];
+      p.params.reset (new ZParams<Z> (params));
+      p.idle.clear ();
+    }
+
+    /** defines (or redefines) a profile whose solvers apply tactics */
+    void setProfile (const std::string &name, const std::vector<std::string> &tactics)
+    {
+      Profile &p = m_profiles [name];
+      p.tactics = tactics;
+      p.idle.clear ();
+    }
+
+    bool hasProfile (const std::string &name) const
+    { return m_profiles.count (name) > 0; }
+
+    /** leases a solver with the parameters of the given profile */
+    Lease acquire (const std::string &profile = std::string ())
+    {
+      Profile &p = m_profiles [profile];
+      std::unique_ptr<solver_type> s;
+      if (!p.idle.empty ())
+      {
+        s = std::move (p.idle.back ());
+        p.idle.pop_back ();
+        static StatsCounter &reused = Stats::counter ("solver_pool.reused");
+        reused.inc ();
+      }
+      else
+      {
+        s.reset (new solver_type (m_z3, p.tactics));
+        if (p.params) s->set (*p.params);
+        static StatsCounter &created = Stats::counter ("solver_pool.created");
+        created.inc ();
+      }
+      s->push ();
+      ++m_leased;
+      return Lease (*this, profile, std::move (s));
+    }
+  };
+
+  /**
+   * The contexts of the workers of a parallel mode. Z3 contexts are
+   * not thread-safe, so a worker marshals and solves in a context of
+   * its own, with its own marshal cache. The contexts share the
+   * ExprFactory, so more than one worker requires a concurrent one.
+   *
+   * Contexts are created on first use and live as long as the set,
+   * so that their caches survive from one parallel phase to the
+   * next. Terms that every worker needs, e.g., a BMC encoding, are
+   * marshaled once and copied to the workers with share (). A set is
+   * used either by worker number, with get (), or by thread, with
+   * local ()
+   */
+  template <typename Z>
+  class ZWorkerContexts : boost::noncopyable
+  {
+    ExprFactory &m_efac;
+    /** protects m_ctxs and m_threads */
+    std::mutex m_lock;
+    std::vector<std::unique_ptr<Z> > m_ctxs;
+    /** worker of each thread that called local () */
+    std::unordered_map<std::thread::id, unsigned> m_threads;
+
+  public:
+    explicit ZWorkerContexts (ExprFactory &efac) : m_efac (efac) {}
+
+    /** number of workers that may run at once out of n: 1 unless
+        the ExprFactory is concurrent */
+    unsigned workers (unsigned n) const
+    { return m_efac.isConcurrent () ? std::max (1u, n) : 1; }
+
+    /** the context of worker w. The reference stays valid as long as
+        the set */
+    Z &get (unsigned w)
+    {
+      std::lock_guard<std::mutex> l (m_lock);
+      if (w >= m_ctxs.size ()) m_ctxs.resize (w + 1);
+      if (!m_ctxs [w]) m_ctxs [w].reset (new Z (m_efac));
+      return *m_ctxs [w];
+    }
+
+    /** the context of the calling thread, for pools whose workers
+        have no number. A thread keeps its context across phases */
+    Z &local ()
+    {
+      unsigned w;
+      {
+        std::lock_guard<std::mutex> l (m_lock);
+        auto it = m_threads.insert
+          (std::make_pair (std::this_thread::get_id (), m_threads.size ()));
+        w = it.first->second;
+      }
+      return get (w);
+    }
+
+    /** copies the terms es of the context from to the context of
+        worker w with Z3_translate, see ZContext::translate. Faster
+        than marshaling them again. Neither context may be in use by
+        another thread meanwhile */
+    template <typename Range>
+    void share (Z &from, const Range &es, unsigned w)
+    {
+      Z &to = get (w);
+      for (Expr e : es) from.translate (e, to);
+    }
+
+    size_t size ()
+    {
+      std::lock_guard<std::mutex> l (m_lock);
+      return m_ctxs.size ();
+    }
   };
 
 
@@ -630,6 +1892,8 @@ namespace ufo
     ExprVector m_vars;
     ExprVector m_rules;
     ExprVector m_queries;
+    /** standing budget of every query */
+    ZBudget m_budget;
 
   public:
 
@@ -640,6 +1904,17 @@ namespace ufo
 
     void set (const ZParams<Z> &p) { fp.set (p); }
 
+    /** limits every query that does not have its own budget. Only
+        the timeout is honoured */
+    void setBudget (const ZBudget &b)
+    {
+      ZParams<Z> p (z3);
+      p.set (":timeout", b.timeout > 0 ? b.timeout : UINT_MAX);
+      fp.set (p);
+      m_budget = b;
+    }
+    const ZBudget &getBudget () const { return m_budget; }
+
     void registerRelation (Expr fdecl)
     {
       m_rels.push_back (fdecl);
@@ -683,6 +1958,68 @@ namespace ufo
       Z3_fixedpoint_add_rule (ctx, fp, qexpr, static_cast<Z3_symbol>(0));
     }
 
+    /** registers every relation of a range, marshaled as one batch */
+    template <typename Range>
+    void registerRelations (const Range &fdecls)
+    {
+      ExprVector decls (boost::begin (fdecls), boost::end (fdecls));
+      std::vector<z3::ast> asts;
+      asts.reserve (decls.size ());
+      z3.toAsts (decls, std::back_inserter (asts));
+      for (size_t i = 0; i < decls.size (); ++i)
+      {
+        m_rels.push_back (decls [i]);
+        Z3_fixedpoint_register_relation (ctx, fp, Z3_to_func_decl (ctx, asts [i]));
+      }
+    }
+
+    /**
+     * Adds every rule of a range, as addRule (r.vars (), r.get ()).
+     * The rules and their variables are marshaled as one batch, in a
+     * single pass over the DAG they share, instead of one generation
+     * of the marshal cache per rule
+     */
+    template <typename Range>
+    void addRules (const Range &rules)
+    {
+      // -- the rule, then its variables, for every rule
+      ExprVector terms;
+      std::vector<size_t> start;
+      for (const auto &r : rules)
+      {
+        Expr rule = r.get ();
+        if (isOpX<TRUE> (rule)) continue;
+        start.push_back (terms.size ());
+        terms.push_back (rule);
+        terms.insert (terms.end (), boost::begin (r.vars ()), boost::end (r.vars ()));
+      }
+      start.push_back (terms.size ());
+
+      std::vector<z3::ast> asts;
+      asts.reserve (terms.size ());
+      z3.toAsts (terms, std::back_inserter (asts));
+
+      std::vector<Z3_app> bound;
+      for (size_t k = 0; k + 1 < start.size (); ++k)
+      {
+        size_t b = start [k], e = start [k + 1];
+        m_rules.push_back (terms [b]);
+        m_vars.insert (m_vars.end (), terms.begin () + b + 1, terms.begin () + e);
+
+        z3::ast qexpr (asts [b]);
+        // -- universally quantify all free variables
+        if (e - b > 1)
+        {
+          bound.clear ();
+          for (size_t i = b + 1; i < e; ++i)
+            bound.push_back (Z3_to_app (ctx, asts [i]));
+          qexpr = z3::ast (ctx, Z3_mk_forall_const (ctx, 0, bound.size (),
+                                                    &bound [0], 0, NULL, asts [b]));
+        }
+        Z3_fixedpoint_add_rule (ctx, fp, qexpr, static_cast<Z3_symbol>(0));
+      }
+    }
+
     void addQuery (Expr q) {m_queries.push_back (q);}
 
     void addQueries (ExprVector qs) 
@@ -721,8 +2058,35 @@ namespace ufo
                                                 &bound [0], 0, NULL, ast));
       }
       
+      ZQueryTimer timer ("query", m_budget);
+      uint64_t before = 0;
+      if (timer.enabled ())
+      {
+        ExprVector all (m_rules);
+        all.insert (all.end (), m_queries.begin (), m_queries.end ());
+        timer.setSize (all.size (), mknary<AND> (mk<TRUE> (efac), all));
+        before = ZTelemetry::rlimitCount (ctx, Z3_fixedpoint_get_statistics (ctx, fp));
+      }
+
       tribool res = z3l_to_tribool (Z3_fixedpoint_query (ctx, fp, ast));
       ctx.check_error ();
+
+      if (timer.enabled ())
+      {
+        uint64_t after =
+          ZTelemetry::rlimitCount (ctx, Z3_fixedpoint_get_statistics (ctx, fp));
+        timer.done (res, after >= before ? after - before : after);
+      }
+      return res;
+    }
+
+    /** query (q) within the given budget instead of the standing one */
+    boost::tribool query (Expr q, const ZBudget &b)
+    {
+      ZBudget saved = m_budget;
+      setBudget (b);
+      boost::tribool res = query (q);
+      setBudget (saved);
       return res;
     }
 
@@ -920,6 +2284,24 @@ namespace ufo
       return Z3_fixedpoint_get_num_levels (ctx, fp, pdecl);
     }
 
+    /** why the last query returned unknown, e.g., timeout */
+    std::string getReasonUnknown ()
+    { return Z3_fixedpoint_get_reason_unknown (ctx, fp); }
+
+    /** calls f (key, value) for every integer statistic of the
+        engine, e.g., after a query */
+    template <typename F>
+    void forEachStatistic (F f)
+    {
+      Z3_stats st = Z3_fixedpoint_get_statistics (ctx, fp);
+      Z3_stats_inc_ref (ctx, st);
+      for (unsigned i = 0; i < Z3_stats_size (ctx, st); ++i)
+        if (Z3_stats_is_uint (ctx, st, i))
+          f (std::string (Z3_stats_get_key (ctx, st, i)),
+             Z3_stats_get_uint_value (ctx, st, i));
+      Z3_stats_dec_ref (ctx, st);
+    }
+
     std::string getAnswer ()
     {
       z3::ast res (ctx, Z3_fixedpoint_get_answer (ctx, fp));
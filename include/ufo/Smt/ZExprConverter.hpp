@@ -14,9 +14,9 @@ namespace ufo
 
   struct FailMarshal
   {
-    template <typename C>
+    template <typename C, typename S>
     static z3::ast marshal (Expr e, z3::context &ctx,
-			    C &cache, expr_ast_map &seen)
+			    C &cache, S &seen)
     {
       llvm::errs () << "Cannot marshal: " << *e << "\n";
       assert (0); exit (1);
@@ -39,9 +39,211 @@ namespace ufo
   template <typename M>
   struct BasicExprMarshal
   {
-    template <typename C>
+    /** true if e is an unary operator marshaled by marshalNode */
+    static bool isUnaryOp (Expr e)
+    {
+      return isOpX<UN_MINUS> (e) || isOpX<NEG> (e) ||
+        isOpX<ARRAY_DEFAULT> (e) || isOpX<BNOT> (e) || isOpX<BNEG> (e) ||
+        isOpX<BREDAND> (e) || isOpX<BREDOR> (e) || isOpX<BV2INT> (e);
+    }
+    
+    /** 
+     * Pushes to kids the sub-terms of e that are marshaled when
+     * marshaling e. Must agree with the case analysis of marshalNode.
+     */
+    static void marshalKids (Expr e, std::vector<ENode*> &kids)
+    {
+      if (bind::isBVar (e)) 
+	kids.push_back (bind::type (e).get ());
+      else if (isOpX<ARRAY_TY> (e))
+      {
+        kids.push_back (e->left ());
+        kids.push_back (e->right ());
+      }
+      // -- sorts, numerals, and constants have no marshaled sub-terms
+      else if (isOpX<INT_TY> (e) || isOpX<REAL_TY> (e) || 
+               isOpX<BOOL_TY> (e) || isOpX<BVSORT> (e) ||
+               isOpX<INT> (e) || isOpX<MPQ> (e) || isOpX<MPZ> (e) ||
+               bv::is_bvnum (e) || bind::isBoolVar (e) || 
+               bind::isIntVar (e) || bind::isRealVar (e))
+        return;
+      else if (bind::isFdecl (e))
+      {
+        for (size_t i = 0; i < bind::domainSz (e); ++i)
+          kids.push_back (bind::domainTy (e, i).get ());
+        kids.push_back (bind::rangeTy (e).get ());
+      }
+      else if (bind::isFapp (e))
+        kids.insert (kids.end (), e->args_begin (), e->args_end ());
+      else if (isOpX<FORALL> (e) || isOpX<EXISTS> (e))
+      {
+        for (unsigned i = 0; i < bind::numBound (e); ++i)
+          kids.push_back (bind::decl (e, i).get ());
+        kids.push_back (bind::body (e).get ());
+      }
+      else if (e->arity () == 1)
+      {
+        if (isUnaryOp (e)) kids.push_back (e->left ());
+      }
+      else if (e->arity () == 2)
+      {
+        kids.push_back (e->left ());
+        kids.push_back (e->right ());
+      }
+      else if (isOpX<BEXTRACT> (e))
+        kids.push_back (bv::earg (e).get ());
+      else if (isOpX<AND> (e) || isOpX<OR> (e) ||
+               isOpX<ITE> (e) || isOpX<XOR> (e) ||
+               isOpX<PLUS> (e) || isOpX<MINUS> (e) ||
+               isOpX<MULT> (e) ||
+               isOpX<STORE> (e) || isOpX<ARRAY_MAP> (e))
+        kids.insert (kids.end (), e->args_begin (), e->args_end ());
+    }
+
+    template <typename C, typename S>
+    static bool isMarshaled (Expr e, C &cache, S &seen)
+    {
+      return isOpX<TRUE> (e) || isOpX<FALSE> (e) ||
+        cache.count (e) > 0 || seen.count (e) > 0;
+    }
+    
+    /** 
+     * Marshals e. The sub-terms of e are marshaled bottom-up using an
+     * explicit stack first, so that the recursion of marshalNode on
+     * deep expressions is shallow.
+     */
+    template <typename C, typename S>
     static z3::ast marshal (Expr e, z3::context &ctx,
-			    C &cache, expr_ast_map &seen)
+			    C &cache, S &seen)
+    {
+      assert (e);
+      if (e->arity () == 0 || isMarshaled (e, cache, seen))
+        return marshalNode (e, ctx, cache, seen);
+      
+      // -- (node, true if the kids of node have been pushed)
+      std::vector<std::pair<ENode*,bool> > stack;
+      std::unordered_set<ENode*> visited;
+      std::vector<ENode*> kids;
+      
+      marshalKids (e, kids);
+      for (auto it = kids.rbegin (), end = kids.rend (); it != end; ++it)
+        if ((*it)->arity () > 0) stack.push_back (std::make_pair (*it, false));
+      
+      while (!stack.empty ())
+      {
+        Expr n (stack.back ().first);
+        if (stack.back ().second)
+        {
+          stack.pop_back ();
+          marshalNode (n, ctx, cache, seen);
+          continue;
+        }
+        
+        if (!visited.insert (&*n).second || isMarshaled (n, cache, seen))
+        {
+          stack.pop_back ();
+          continue;
+        }
+        
+        stack.back ().second = true;
+        kids.clear ();
+        marshalKids (n, kids);
+        // -- terminals are marshaled without recursion
+        for (auto it = kids.rbegin (), end = kids.rend (); it != end; ++it)
+          if ((*it)->arity () > 0) 
+            stack.push_back (std::make_pair (*it, false));
+      }
+      
+      return marshalNode (e, ctx, cache, seen);
+    }
+    
+    typedef Z3_ast (*BinaryBuilder) (Z3_context, Z3_ast, Z3_ast);
+
+    /** the builder of a binary operator of the given kind, as by
+        opKind (), or null if it has none */
+    static BinaryBuilder binaryBuilder (unsigned kind)
+    {
+      static const std::vector<BinaryBuilder> table = binaryBuilders ();
+      return kind < table.size () ? table [kind] : nullptr;
+    }
+
+    static std::vector<BinaryBuilder> binaryBuilders ()
+    {
+      std::vector<std::pair<unsigned, BinaryBuilder> > ops = {
+        /** BoolOp */
+        {opKind<AND> (), [] (Z3_context c, Z3_ast a, Z3_ast b)
+            { Z3_ast args [2] = {a, b}; return Z3_mk_and (c, 2, args); }},
+        {opKind<OR> (), [] (Z3_context c, Z3_ast a, Z3_ast b)
+            { Z3_ast args [2] = {a, b}; return Z3_mk_or (c, 2, args); }},
+        {opKind<IMPL> (), Z3_mk_implies},
+        {opKind<IFF> (), Z3_mk_iff},
+        {opKind<XOR> (), Z3_mk_xor},
+
+        /** NumericOp */
+        {opKind<PLUS> (), [] (Z3_context c, Z3_ast a, Z3_ast b)
+            { Z3_ast args [2] = {a, b}; return Z3_mk_add (c, 2, args); }},
+        {opKind<MINUS> (), [] (Z3_context c, Z3_ast a, Z3_ast b)
+            { Z3_ast args [2] = {a, b}; return Z3_mk_sub (c, 2, args); }},
+        {opKind<MULT> (), [] (Z3_context c, Z3_ast a, Z3_ast b)
+            { Z3_ast args [2] = {a, b}; return Z3_mk_mul (c, 2, args); }},
+        {opKind<DIV> (), Z3_mk_div},
+        {opKind<IDIV> (), Z3_mk_div},
+        {opKind<MOD> (), Z3_mk_mod},
+        {opKind<REM> (), Z3_mk_rem},
+
+        /** Comparison Op */
+        {opKind<EQ> (), Z3_mk_eq},
+        {opKind<NEQ> (), [] (Z3_context c, Z3_ast a, Z3_ast b)
+            { return Z3_mk_not (c, Z3_mk_eq (c, a, b)); }},
+        {opKind<LEQ> (), Z3_mk_le},
+        {opKind<GEQ> (), Z3_mk_ge},
+        {opKind<LT> (), Z3_mk_lt},
+        {opKind<GT> (), Z3_mk_gt},
+
+        /** Array Select */
+        {opKind<SELECT> (), Z3_mk_select},
+
+        /** Bit-Vectors */
+        {opKind<BAND> (), Z3_mk_bvand},
+        {opKind<BOR> (), Z3_mk_bvor},
+        {opKind<BMUL> (), Z3_mk_bvmul},
+        {opKind<BADD> (), Z3_mk_bvadd},
+        {opKind<BSUB> (), Z3_mk_bvsub},
+        {opKind<BSDIV> (), Z3_mk_bvsdiv},
+        {opKind<BUDIV> (), Z3_mk_bvudiv},
+        {opKind<BSREM> (), Z3_mk_bvsrem},
+        {opKind<BUREM> (), Z3_mk_bvurem},
+        {opKind<BSMOD> (), Z3_mk_bvsmod},
+        {opKind<BULE> (), Z3_mk_bvule},
+        {opKind<BSLE> (), Z3_mk_bvsle},
+        {opKind<BUGE> (), Z3_mk_bvuge},
+        {opKind<BSGE> (), Z3_mk_bvsge},
+        {opKind<BULT> (), Z3_mk_bvult},
+        {opKind<BSLT> (), Z3_mk_bvslt},
+        {opKind<BUGT> (), Z3_mk_bvugt},
+        {opKind<BSGT> (), Z3_mk_bvsgt},
+        {opKind<BXOR> (), Z3_mk_bvxor},
+        {opKind<BNAND> (), Z3_mk_bvnand},
+        {opKind<BNOR> (), Z3_mk_bvnor},
+        {opKind<BXNOR> (), Z3_mk_bvxnor},
+        {opKind<BCONCAT> (), Z3_mk_concat},
+        {opKind<BSHL> (), Z3_mk_bvshl},
+        {opKind<BLSHR> (), Z3_mk_bvlshr},
+        {opKind<BASHR> (), Z3_mk_bvashr}
+      };
+
+      std::vector<BinaryBuilder> table;
+      for (auto &op : ops)
+      {
+        if (op.first >= table.size ()) table.resize (op.first + 1, nullptr);
+        table [op.first] = op.second;
+      }
+      return table;
+    }
+
+    template <typename C, typename S>
+    static z3::ast marshalNode (Expr e, z3::context &ctx,
+                                C &cache, S &seen)
     {
       assert (e);
       if (isOpX<TRUE>(e)) return z3::ast (ctx, Z3_mk_true (ctx));
@@ -55,7 +257,7 @@ namespace ufo
 
       /** check computed table */
       {
-	typename expr_ast_map::const_iterator it = seen.find (e);
+	typename S::const_iterator it = seen.find (e);
 	if (it != seen.end ()) return it->second;
       }
 
@@ -270,99 +472,37 @@ namespace ufo
 
       else if (arity == 1)
       {
-        // -- then it's a NEG or UN_MINUS
-        if (isOpX<UN_MINUS>(e))
-        {
-          z3::ast arg = marshal (e->left(), ctx, cache, seen);
-          return z3::ast (ctx, Z3_mk_unary_minus(ctx, arg));
-        }
-
-        if (isOpX<NEG>(e))
-        {
-          z3::ast arg = marshal (e->left(), ctx, cache, seen);
-          return z3::ast (ctx, Z3_mk_not(ctx, arg));
-        }
-        if (isOpX<ARRAY_DEFAULT> (e))
-        {
-          z3::ast arg = marshal (e->left(), ctx, cache, seen);
-          return z3::ast (ctx, Z3_mk_array_default (ctx, arg));
-        }
-        if (isOpX<BNOT>(e))
-        {
-          z3::ast arg = marshal (e->left(), ctx, cache, seen);
-          return z3::ast (ctx, Z3_mk_bvnot(ctx, arg));
-        }
-        if (isOpX<BNEG>(e))
-        {
-          z3::ast arg = marshal (e->left(), ctx, cache, seen);
-          return z3::ast (ctx, Z3_mk_bvneg(ctx, arg));
-        }
-        if (isOpX<BREDAND>(e))
-        {
-          z3::ast arg = marshal (e->left(), ctx, cache, seen);
-          return z3::ast (ctx, Z3_mk_bvredand(ctx, arg));
-        }
-        if (isOpX<BREDOR>(e))
-        {
-          z3::ast arg = marshal (e->left(), ctx, cache, seen);
-          return z3::ast (ctx, Z3_mk_bvredor(ctx, arg));
-        }
-
-        return M::marshal (e, ctx, cache, seen);
+        if (!isUnaryOp (e)) return M::marshal (e, ctx, cache, seen);
+        
+        z3::ast arg = marshal (e->left(), ctx, cache, seen);
+        unsigned k = opKindOf (e);
+        if (k == opKind<UN_MINUS> ())
+          res = Z3_mk_unary_minus(ctx, arg);
+        else if (k == opKind<NEG> ())
+          res = Z3_mk_not(ctx, arg);
+        else if (k == opKind<ARRAY_DEFAULT> ())
+          res = Z3_mk_array_default (ctx, arg);
+        else if (k == opKind<BNOT> ())
+          res = Z3_mk_bvnot(ctx, arg);
+        else if (k == opKind<BNEG> ())
+          res = Z3_mk_bvneg(ctx, arg);
+        else if (k == opKind<BREDAND> ())
+          res = Z3_mk_bvredand(ctx, arg);
+        else if (k == opKind<BREDOR> ())
+          res = Z3_mk_bvredor(ctx, arg);
+        else if (k == opKind<BV2INT> ())
+          res = Z3_mk_bv2int (ctx, arg, false);
       }
       else if (arity == 2)
       {
         z3::ast t1 = marshal(e->left(), ctx, cache, seen);
         z3::ast t2 = marshal(e->right(), ctx, cache, seen);
 
-        Z3_ast args [2] = {t1, t2};
-
-
-        /** BoolOp */
-        if (isOpX<AND>(e))
-          res = Z3_mk_and(ctx, 2, args);
-        else if (isOpX<OR>(e))
-          res = Z3_mk_or(ctx, 2, args);
-        else if (isOpX<IMPL>(e))
-          res = Z3_mk_implies(ctx,t1, t2);
-        else if (isOpX<IFF>(e))
-          res = Z3_mk_iff(ctx, t1, t2);
-        else if (isOpX<XOR>(e))
-          res = Z3_mk_xor(ctx, t1, t2);
-
-        /** NumericOp */
-        else if (isOpX<PLUS>(e))
-          res = Z3_mk_add(ctx, 2, args);
-        else if (isOpX<MINUS>(e))
-          res = Z3_mk_sub(ctx, 2, args);
-        else if (isOpX<MULT>(e))
-          res = Z3_mk_mul(ctx, 2, args);
-        else if (isOpX<DIV>(e) || isOpX<IDIV> (e))
-          res = Z3_mk_div (ctx, t1, t2);
-        else if (isOpX<MOD> (e))
-          res = Z3_mk_mod (ctx, t1, t2);
-        else if (isOpX<REM> (e))
-          res = Z3_mk_rem (ctx, t1, t2);
-
-        /** Comparison Op */
-        else if (isOpX<EQ>(e))
-          res = Z3_mk_eq (ctx, t1, t2);
-        else if (isOpX<NEQ>(e))
-          res = Z3_mk_not (ctx, Z3_mk_eq (ctx, t1, t2));
-        else if (isOpX<LEQ>(e))
-          res =  Z3_mk_le(ctx, t1, t2);
-        else if (isOpX<GEQ>(e))
-          res = Z3_mk_ge(ctx, t1, t2);
-        else if (isOpX<LT>(e))
-          res = Z3_mk_lt(ctx, t1, t2);
-        else if (isOpX<GT>(e))
-          res = Z3_mk_gt(ctx, t1, t2);
-
-        /** Array Select */
-        else if (isOpX<SELECT>(e))
-          res = Z3_mk_select (ctx, t1, t2);
+        unsigned k = opKindOf (e);
+        if (BinaryBuilder b = binaryBuilder (k))
+          res = b (ctx, t1, t2);
         /** Array Const */
-        else if (isOpX<CONST_ARRAY>(e)) 
+        else if (k == opKind<CONST_ARRAY> ()) 
         {
           Z3_sort domain = reinterpret_cast<Z3_sort> (static_cast<Z3_ast> (t1));
           res = Z3_mk_const_array (ctx, domain, t2);
@@ -370,76 +510,26 @@ namespace ufo
         }
           
         /** Bit-Vectors */
-        else if (isOpX<BSEXT> (e) || isOpX<BZEXT> (e) )
+        else if (k == opKind<BSEXT> () || k == opKind<BZEXT> ())
         {
           assert (Z3_get_sort_kind (ctx, Z3_get_sort (ctx, t1)) == Z3_BV_SORT);
           unsigned t1_sz = Z3_get_bv_sort_size (ctx, Z3_get_sort (ctx, t1));
           assert (t1_sz > 0);
           assert (t1_sz < bv::width (e->arg (1)));
-          if (isOpX<BSEXT> (e))
+          if (k == opKind<BSEXT> ())
             res = z3::ast (ctx,
                            Z3_mk_sign_ext (ctx,
                                            bv::width (e->arg (1)) - t1_sz,
                                            t1));
-          else if (isOpX<BZEXT> (e))
+          else if (k == opKind<BZEXT> ())
             res = z3::ast (ctx, 
                            Z3_mk_zero_ext (ctx,
                                            bv::width (e->arg (1)) - t1_sz,
                                            t1));
           else assert (0);
         }
-        else if (isOpX<BAND> (e))
-          res = Z3_mk_bvand (ctx, t1, t2);
-        else if (isOpX<BOR> (e))
-          res = Z3_mk_bvor (ctx, t1, t2);
-        else if (isOpX<BMUL> (e))
-          res = Z3_mk_bvmul (ctx, t1, t2);
-        else if (isOpX<BADD> (e))
-          res = Z3_mk_bvadd (ctx, t1, t2);
-        else if (isOpX<BSUB> (e))
-          res = Z3_mk_bvsub (ctx, t1, t2);
-        else if (isOpX<BSDIV> (e))
-          res = Z3_mk_bvsdiv (ctx, t1, t2);
-        else if (isOpX<BUDIV> (e))
-          res = Z3_mk_bvudiv (ctx, t1, t2);
-        else if (isOpX<BSREM> (e))
-          res = Z3_mk_bvsrem (ctx, t1, t2);
-        else if (isOpX<BUREM> (e))
-          res = Z3_mk_bvurem (ctx, t1, t2);
-        else if (isOpX<BSMOD> (e))
-          res = Z3_mk_bvsmod (ctx, t1, t2);
-        else if (isOpX<BULE> (e))
-          res = Z3_mk_bvule (ctx, t1, t2);
-        else if (isOpX<BSLE> (e))
-          res = Z3_mk_bvsle (ctx, t1, t2);
-        else if (isOpX<BUGE> (e))
-          res = Z3_mk_bvuge (ctx, t1, t2);
-        else if (isOpX<BSGE> (e))
-          res = Z3_mk_bvsge (ctx, t1, t2);
-        else if (isOpX<BULT> (e))
-          res = Z3_mk_bvult (ctx, t1, t2);
-        else if (isOpX<BSLT> (e))
-          res = Z3_mk_bvslt (ctx, t1, t2);
-        else if (isOpX<BUGT> (e))
-          res = Z3_mk_bvugt (ctx, t1, t2);
-        else if (isOpX<BSGT> (e))
-          res = Z3_mk_bvsgt (ctx, t1, t2);
-        else if (isOpX<BXOR> (e))
-          res = Z3_mk_bvxor (ctx, t1, t2);
-        else if (isOpX<BNAND> (e))
-          res = Z3_mk_bvnand (ctx, t1, t2);
-        else if (isOpX<BNOR> (e))
-          res = Z3_mk_bvnor (ctx, t1, t2);
-        else if (isOpX<BXNOR> (e))
-          res = Z3_mk_bvxnor (ctx, t1, t2);
-        else if (isOpX<BCONCAT> (e))
-          res = Z3_mk_concat (ctx, t1, t2);
-        else if (isOpX<BSHL> (e))
-          res = Z3_mk_bvshl (ctx, t1, t2);
-        else if (isOpX<BLSHR> (e))
-          res = Z3_mk_bvlshr (ctx, t1, t2);
-        else if (isOpX<BASHR> (e))
-          res = Z3_mk_bvashr (ctx, t1, t2);
+        else if (k == opKind<INT2BV> ())
+          res = Z3_mk_int2bv (ctx, bv::width (e->arg (1)), t1);
       
         else
           return M::marshal (e, ctx, cache, seen);
@@ -468,27 +558,28 @@ namespace ufo
         }
 
 
-        if (isOp<ITE>(e))
+        unsigned k = opKindOf (e);
+        if (k == opKind<ITE> ())
         {
           assert (e->arity () == 3);
           res = Z3_mk_ite(ctx,args[0],args[1],args[2]);
         }
-        else if (isOp<AND>(e))
+        else if (k == opKind<AND> ())
           res = Z3_mk_and (ctx, args.size (), &args[0]);
-        else if (isOp<OR>(e))
+        else if (k == opKind<OR> ())
           res = Z3_mk_or (ctx, args.size (), &args[0]);
-        else if (isOp<PLUS>(e))
+        else if (k == opKind<PLUS> ())
           res = Z3_mk_add (ctx, args.size (), &args[0]);
-        else if (isOp<MINUS>(e))
+        else if (k == opKind<MINUS> ())
           res = Z3_mk_sub (ctx, args.size (), &args[0]);
-        else if (isOp<MULT>(e))
+        else if (k == opKind<MULT> ())
           res = Z3_mk_mul (ctx, args.size (), &args[0]);
-        else if (isOp<STORE>(e))
+        else if (k == opKind<STORE> ())
         {
           assert (e->arity () == 3);
           res = Z3_mk_store (ctx, args[0], args[1], args[2]);
         }
-        else if (isOp<ARRAY_MAP> (e))
+        else if (k == opKind<ARRAY_MAP> ())
         {
           Z3_func_decl fdecl = reinterpret_cast<Z3_func_decl> (args[0]);
           res = Z3_mk_map (ctx, fdecl, e->arity ()-1, &args[1]);
@@ -502,7 +593,7 @@ namespace ufo
       
       assert (res != NULL);
       z3::ast final (ctx, res);
-      seen.insert (expr_ast_map::value_type (e, final));
+      seen.insert (typename S::value_type (e, final));
 
       return final;
 
@@ -512,10 +603,84 @@ namespace ufo
   template <typename U>
   struct BasicExprUnmarshal
   {
+    typedef std::vector<std::pair<Z3_ast,bool> > stack_type;
+    
+    /** pushes the kids of z that have kids of their own */
+    static void pushKids (z3::context &ctx, Z3_ast z, stack_type &stack)
+    {
+      Z3_ast_kind kind = Z3_get_ast_kind (ctx, z);
+      if (kind == Z3_QUANTIFIER_AST)
+      {
+        stack.push_back (std::make_pair (Z3_get_quantifier_body (ctx, z), false));
+        return;
+      }
+      if (kind != Z3_APP_AST) return;
+      
+      Z3_app app = Z3_to_app (ctx, z);
+      for (unsigned i = Z3_get_app_num_args (ctx, app); i > 0; --i)
+      {
+        Z3_ast a = Z3_get_app_arg (ctx, app, i - 1);
+        if (Z3_get_ast_kind (ctx, a) == Z3_QUANTIFIER_AST ||
+            (Z3_get_ast_kind (ctx, a) == Z3_APP_AST && 
+             Z3_get_app_num_args (ctx, Z3_to_app (ctx, a)) > 0))
+          stack.push_back (std::make_pair (a, false));
+      }
+    }
+
+    /** 
+     * Unmarshals z. The sub-terms of z are unmarshaled bottom-up
+     * using an explicit stack first, so that the recursion of
+     * unmarshalNode on deep terms is shallow. Every unmarshaled term
+     * is added to seen.
+     */
     template <typename C>
     static Expr unmarshal (const z3::ast &z,
 			   ExprFactory &efac, C &cache,
 			   ast_expr_map &seen)
+    {
+      {
+	typename ast_expr_map::const_iterator it = seen.find (z);
+	if (it != seen.end ()) return it->second;
+      }
+      
+      z3::context &ctx = z.ctx ();
+      stack_type stack;
+      pushKids (ctx, z, stack);
+      if (!stack.empty ())
+      {
+        std::unordered_set<Z3_ast> visited;
+        while (!stack.empty ())
+        {
+          // -- kids are kept alive by z
+          z3::ast n (ctx, stack.back ().first);
+          if (stack.back ().second)
+          {
+            stack.pop_back ();
+            seen.insert (ast_expr_map::value_type 
+                         (n, unmarshalNode (n, efac, cache, seen)));
+            continue;
+          }
+          
+          if (!visited.insert (n).second || seen.count (n) > 0)
+          {
+            stack.pop_back ();
+            continue;
+          }
+          
+          stack.back ().second = true;
+          pushKids (ctx, n, stack);
+        }
+      }
+      
+      Expr res = unmarshalNode (z, efac, cache, seen);
+      seen.insert (ast_expr_map::value_type (z, res));
+      return res;
+    }
+
+    template <typename C>
+    static Expr unmarshalNode (const z3::ast &z,
+                               ExprFactory &efac, C &cache,
+                               ast_expr_map &seen)
     {
       z3::context &ctx = z.ctx ();
 
@@ -698,6 +863,17 @@ namespace ufo
         }
       }
       
+      if (dkind == Z3_OP_INT2BV)
+      {
+        Expr arg = unmarshal (z3::ast (ctx, Z3_get_app_arg (ctx, app, 0)),
+                              efac, cache, seen);
+        unsigned width = Z3_get_decl_int_parameter (ctx, fdecl, 0);
+        return bv::int2bv (arg, width);
+      }
+      if (dkind == Z3_OP_BV2INT)
+        return bv::bv2int (unmarshal (z3::ast (ctx, Z3_get_app_arg (ctx, app, 0)),
+                                      efac, cache, seen));
+
       if (dkind == Z3_OP_EXTRACT)
       {
         Expr arg = unmarshal (z3::ast (ctx, Z3_get_app_arg (ctx, app, 0)),
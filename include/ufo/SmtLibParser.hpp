@@ -0,0 +1,982 @@
+#ifndef __SMTLIB_PARSER_HPP_
+#define __SMTLIB_PARSER_HPP_
+
+/**
+ * A streaming SMT-LIB2 parser that builds expressions directly in an
+ * ExprFactory, without going through Z3.
+ *
+ * The input is read in fixed-size chunks and returned one command at a
+ * time, so memory is bounded by the size of the largest command rather
+ * than the size of the file. Terms are parsed with an explicit stack
+ * and can be nested arbitrarily deep.
+ *
+ * Terms are built the same way ZExprConverter unmarshals them from Z3:
+ * declared symbols become FAPPs of FDECLs, quantifiers become
+ * FORALL/EXISTS over constant declarations with de Bruijn indexed
+ * bound variables, and bit-vector numerals become bv::bvnum.
+ *
+ * Besides the standard commands, the Z3 fixedpoint extensions
+ * (declare-rel, declare-var, rule, query) are recognized.
+ */
+
+#include <istream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+
+#include "ufo/Expr.hpp"
+
+namespace expr
+{
+  namespace smtlib
+  {
+    struct ParseError : public std::runtime_error
+    {
+      ParseError (const std::string &msg) : std::runtime_error (msg) {}
+    };
+
+    /// Tokenizer over a buffered input stream
+    class Lexer : boost::noncopyable
+    {
+    public:
+      enum Kind { LPAREN, RPAREN, SYMBOL, KEYWORD, NUMERAL, DECIMAL,
+                  HEXADECIMAL, BINARY, STRING, END };
+
+    private:
+      std::istream &m_in;
+      std::vector<char> m_buf;
+      size_t m_pos;
+      size_t m_end;
+      unsigned m_line;
+
+      bool m_peeked;
+      Kind m_kind;
+      std::string m_text;
+
+      bool fill ()
+      {
+        if (!m_in) return false;
+        m_in.read (&m_buf [0], m_buf.size ());
+        m_end = m_in.gcount ();
+        m_pos = 0;
+        return m_end > 0;
+      }
+
+      int peekChar ()
+      {
+        if (m_pos == m_end && !fill ()) return EOF;
+        return static_cast<unsigned char> (m_buf [m_pos]);
+      }
+
+      int getChar ()
+      {
+        int c = peekChar ();
+        if (c != EOF)
+        {
+          ++m_pos;
+          if (c == '\n') ++m_line;
+        }
+        return c;
+      }
+
+      static bool isSpace (int c)
+      { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+      static bool isDigit (int c) { return c >= '0' && c <= '9'; }
+
+      /// true if c may appear in a simple symbol
+      static bool isSymbolChar (int c)
+      {
+        return c != EOF && !isSpace (c) && c != '(' && c != ')' &&
+          c != '|' && c != '"' && c != ';';
+      }
+
+      void lex ()
+      {
+        m_text.clear ();
+
+        int c;
+        for (;;)
+        {
+          c = getChar ();
+          if (c == ';')
+            while (c != EOF && c != '\n') c = getChar ();
+          if (c == EOF || !isSpace (c)) break;
+        }
+
+        switch (c)
+        {
+        case EOF:
+          m_kind = END;
+          return;
+        case '(':
+          m_kind = LPAREN;
+          return;
+        case ')':
+          m_kind = RPAREN;
+          return;
+        case '|':
+          m_kind = SYMBOL;
+          for (c = getChar (); c != '|'; c = getChar ())
+          {
+            if (c == EOF) error ("unterminated quoted symbol");
+            m_text += static_cast<char> (c);
+          }
+          return;
+        case '"':
+          m_kind = STRING;
+          for (;;)
+          {
+            c = getChar ();
+            if (c == EOF) error ("unterminated string literal");
+            if (c == '"')
+            {
+              // -- "" is an escaped quote
+              if (peekChar () != '"') break;
+              getChar ();
+            }
+            m_text += static_cast<char> (c);
+          }
+          return;
+        case ':':
+          m_kind = KEYWORD;
+          while (isSymbolChar (peekChar ())) m_text += static_cast<char> (getChar ());
+          return;
+        case '#':
+          c = getChar ();
+          if (c == 'x') m_kind = HEXADECIMAL;
+          else if (c == 'b') m_kind = BINARY;
+          else error ("bad numeral literal");
+          while (isSymbolChar (peekChar ())) m_text += static_cast<char> (getChar ());
+          if (m_text.empty ()) error ("bad numeral literal");
+          return;
+        default:
+          break;
+        }
+
+        m_text += static_cast<char> (c);
+        if (isDigit (c))
+        {
+          m_kind = NUMERAL;
+          while (isDigit (peekChar ())) m_text += static_cast<char> (getChar ());
+          if (peekChar () == '.')
+          {
+            m_kind = DECIMAL;
+            m_text += static_cast<char> (getChar ());
+            while (isDigit (peekChar ())) m_text += static_cast<char> (getChar ());
+          }
+          return;
+        }
+
+        m_kind = SYMBOL;
+        while (isSymbolChar (peekChar ())) m_text += static_cast<char> (getChar ());
+      }
+
+    public:
+      Lexer (std::istream &in, size_t bufSize = 1 << 16) :
+        m_in (in), m_buf (bufSize), m_pos (0), m_end (0), m_line (1),
+        m_peeked (false), m_kind (END) {}
+
+      /// kind of the next token, without consuming it
+      Kind peek ()
+      {
+        if (!m_peeked) { lex (); m_peeked = true; }
+        return m_kind;
+      }
+
+      /// consumes the next token
+      Kind next ()
+      {
+        peek ();
+        m_peeked = false;
+        return m_kind;
+      }
+
+      /// text of the last token returned by peek() or next()
+      const std::string &text () const { return m_text; }
+      unsigned line () const { return m_line; }
+
+      void error (const std::string &msg) const
+      {
+        throw ParseError ("line " + boost::lexical_cast<std::string> (m_line) +
+                          ": " + msg);
+      }
+    };
+
+    struct Command
+    {
+      enum Kind { ASSERT, DECLARE_FUN, DEFINE_FUN, DECLARE_REL, DECLARE_VAR,
+                  RULE, QUERY, OTHER };
+      Kind kind;
+      /// name of the command, e.g., set-logic
+      std::string name;
+      /// a declaration, an asserted formula, a rule or a query. A
+      /// query of a relation with arguments is its FDECL
+      Expr expr;
+      /// outermost universally quantified variables of an asserted
+      /// formula, when they are bound to constants (see
+      /// Parser::bindQuantifiedAsConsts)
+      ExprVector vars;
+    };
+
+    class Parser : boost::noncopyable
+    {
+      ExprFactory &m_efac;
+      Lexer m_lex;
+      bool m_constBinders;
+      std::string m_error;
+
+      /// declared functions and constants
+      std::unordered_map<std::string, Expr> m_decls;
+      /// define-fun, expanded at every application
+      struct Macro { ExprVector params; Expr body; };
+      std::unordered_map<std::string, Macro> m_macros;
+      /// define-sort without parameters
+      std::unordered_map<std::string, Expr> m_sorts;
+
+      /// a symbol bound by a let, a quantifier or a define-fun parameter
+      struct Binding
+      {
+        Expr val;
+        Expr sort;
+        /// for a quantified variable, its position among all enclosing
+        /// binders. Otherwise, the number of enclosing binders at the
+        /// point of the binding
+        unsigned level;
+        bool isVar;
+        /// val may have free bound variables (a let)
+        bool isLet;
+        /// val shifted under additional binders, by shift amount
+        std::map<unsigned, Expr> shifted;
+
+        Binding () : level (0), isVar (false), isLet (false) {}
+      };
+      typedef std::unordered_map<std::string, std::vector<Binding> > scope_type;
+      scope_type m_scope;
+      /// names in the order they were bound, to undo scopes
+      std::vector<std::string> m_bound;
+      /// number of enclosing quantified variables
+      unsigned m_numBound;
+
+      struct Frame
+      {
+        enum Kind { APP, LET, QUANT, ANNOT };
+        Kind kind;
+        /// APP: function symbol and optional indices/sort qualifier
+        std::string head;
+        std::vector<unsigned> indices;
+        Expr asSort;
+        /// APP: arguments. LET: bound values. QUANT: bound variables
+        ExprVector args;
+        /// LET: bound names
+        std::vector<std::string> names;
+        /// LET: parsing the body
+        bool body;
+        /// QUANT: forall or exists; bound as constants
+        bool forall;
+        bool consts;
+        /// size of m_bound when the frame was opened
+        size_t mark;
+
+        Frame (Kind k, size_t m) :
+          kind (k), body (false), forall (false), consts (false), mark (m) {}
+      };
+
+      void error (const std::string &msg) const { m_lex.error (msg); }
+
+      void expect (Lexer::Kind k, const char *what)
+      { if (m_lex.next () != k) error (std::string ("expected ") + what); }
+
+      std::string expectSymbol ()
+      {
+        expect (Lexer::SYMBOL, "a symbol");
+        return m_lex.text ();
+      }
+
+      unsigned expectNumeral ()
+      {
+        expect (Lexer::NUMERAL, "a numeral");
+        return std::strtoul (m_lex.text ().c_str (), NULL, 10);
+      }
+
+      /// skips the rest of the current s-expression, including the
+      /// closing parenthesis
+      void skipToClose ()
+      {
+        unsigned depth = 1;
+        while (depth > 0)
+        {
+          switch (m_lex.next ())
+          {
+          case Lexer::LPAREN: ++depth; break;
+          case Lexer::RPAREN: --depth; break;
+          case Lexer::END: error ("unexpected end of input");
+          default: break;
+          }
+        }
+      }
+
+      Expr mkName (const std::string &name)
+      { return mkTerm<std::string> (name, m_efac); }
+
+      void bindName (const std::string &name, const Binding &b)
+      {
+        m_scope [name].push_back (b);
+        m_bound.push_back (name);
+      }
+
+      void popScope (size_t mark)
+      {
+        while (m_bound.size () > mark)
+        {
+          scope_type::iterator it = m_scope.find (m_bound.back ());
+          it->second.pop_back ();
+          if (it->second.empty ()) m_scope.erase (it);
+          m_bound.pop_back ();
+        }
+      }
+
+      /// shifts free bound variables of e by delta. Used when a
+      /// let-bound term is referenced under additional binders
+      Expr shiftFree (Expr e, unsigned delta)
+      {
+        // -- (node, number of binders above it)
+        typedef std::pair<ENode*, unsigned> key_type;
+        std::map<key_type, Expr> done;
+        std::vector<std::pair<key_type, size_t> > stack;
+        stack.push_back (std::make_pair (key_type (e.get (), 0), 0));
+        while (!stack.empty ())
+        {
+          key_type k = stack.back ().first;
+          size_t &next = stack.back ().second;
+          ENode *n = k.first;
+          if (bind::isBVar (n))
+          {
+            unsigned idx = bind::bvarId (n);
+            done [k] = idx < k.second ? Expr (n) :
+              bind::bvar (idx + delta, bind::type (n));
+            stack.pop_back ();
+            continue;
+          }
+          bool binder = isOpX<FORALL> (n) || isOpX<EXISTS> (n);
+          unsigned depth = k.second + (binder ? n->arity () - 1 : 0);
+          if (next < n->arity ())
+          {
+            key_type kid (n->arg (next++), depth);
+            if (!done.count (kid)) stack.push_back (std::make_pair (kid, 0));
+            continue;
+          }
+          ExprVector kids;
+          bool changed = false;
+          for (size_t i = 0; i < n->arity (); ++i)
+          {
+            kids.push_back (done [key_type (n->arg (i), depth)]);
+            changed = changed || kids.back ().get () != n->arg (i);
+          }
+          done [k] = changed ? m_efac.mkNary (n->op (), kids) : Expr (n);
+          stack.pop_back ();
+        }
+        return done [key_type (e.get (), 0)];
+      }
+
+      Expr parseSort ()
+      {
+        Lexer::Kind k = m_lex.next ();
+        if (k == Lexer::SYMBOL)
+        {
+          const std::string &s = m_lex.text ();
+          if (s == "Int") return sort::intTy (m_efac);
+          if (s == "Bool") return sort::boolTy (m_efac);
+          if (s == "Real") return sort::realTy (m_efac);
+          auto it = m_sorts.find (s);
+          if (it != m_sorts.end ()) return it->second;
+          error ("unknown sort " + s);
+        }
+        if (k != Lexer::LPAREN) error ("expected a sort");
+
+        std::string s = expectSymbol ();
+        if (s == "Array")
+        {
+          Expr idx = parseSort ();
+          Expr val = parseSort ();
+          expect (Lexer::RPAREN, "')'");
+          return sort::arrayTy (idx, val);
+        }
+        if (s == "_" && expectSymbol () == "BitVec")
+        {
+          unsigned w = expectNumeral ();
+          expect (Lexer::RPAREN, "')'");
+          return bv::bvsort (w, m_efac);
+        }
+        error ("unsupported sort " + s);
+        return Expr ();
+      }
+
+      /// (sort*)
+      void parseSorts (ExprVector &out)
+      {
+        expect (Lexer::LPAREN, "'('");
+        while (m_lex.peek () != Lexer::RPAREN) out.push_back (parseSort ());
+        m_lex.next ();
+      }
+
+      Expr parseNumeral (Lexer::Kind k, const std::string &s)
+      {
+        switch (k)
+        {
+        case Lexer::NUMERAL:
+          if (s.size () < 18)
+            return mkTerm<mpz_class> (std::strtol (s.c_str (), NULL, 10), m_efac);
+          return mkTerm (mpz_class (s), m_efac);
+        case Lexer::DECIMAL:
+          {
+            size_t dot = s.find ('.');
+            std::string frac = s.substr (dot + 1);
+            mpz_class den;
+            mpz_ui_pow_ui (den.get_mpz_t (), 10, frac.size ());
+            mpq_class v (mpz_class (s.substr (0, dot) + frac), den);
+            v.canonicalize ();
+            return mkTerm (v, m_efac);
+          }
+        case Lexer::HEXADECIMAL:
+          return bv::bvnum (mpz_class (s, 16), 4 * s.size (), m_efac);
+        case Lexer::BINARY:
+          return bv::bvnum (mpz_class (s, 2), s.size (), m_efac);
+        default:
+          error ("unsupported literal");
+          return Expr ();
+        }
+      }
+
+      Expr parseSymbol (const std::string &s)
+      {
+        auto sit = m_scope.find (s);
+        if (sit != m_scope.end ())
+        {
+          Binding &b = sit->second.back ();
+          if (b.isVar)
+            return bind::bvar (m_numBound - 1 - b.level, b.sort);
+          if (b.isLet && b.level < m_numBound)
+          {
+            Expr &res = b.shifted [m_numBound - b.level];
+            if (!res) res = shiftFree (b.val, m_numBound - b.level);
+            return res;
+          }
+          return b.val;
+        }
+
+        if (s == "true") return mk<TRUE> (m_efac);
+        if (s == "false") return mk<FALSE> (m_efac);
+
+        auto mit = m_macros.find (s);
+        if (mit != m_macros.end () && mit->second.params.empty ())
+          return mit->second.body;
+
+        auto dit = m_decls.find (s);
+        if (dit != m_decls.end () && bind::domainSz (dit->second) == 0)
+          return bind::fapp (dit->second);
+
+        error ("unknown symbol " + s);
+        return Expr ();
+      }
+
+      /// sort of e. Only used to resolve the width of bit-vector
+      /// extensions
+      Expr sortOf (Expr e)
+      {
+        if (bv::is_bvnum (e) || isOpX<BIND> (e)) return bind::type (e);
+        if (isOpX<FAPP> (e)) return bind::rangeTy (e->left ());
+        if (isOpX<BEXTRACT> (e))
+          return bv::bvsort (bv::high (e) - bv::low (e) + 1, m_efac);
+        if (isOpX<BSEXT> (e) || isOpX<BZEXT> (e)) return e->right ();
+        if (isOpX<BCONCAT> (e))
+        {
+          unsigned w = 0;
+          for (Expr a : mk_it_range (e->args_begin (), e->args_end ()))
+            w += bv::width (sortOf (a));
+          return bv::bvsort (w, m_efac);
+        }
+        if (isOpX<ITE> (e)) return sortOf (e->arg (1));
+        if (isOpX<SELECT> (e)) return sort::arrayValTy (sortOf (e->left ()));
+        if (isOpX<STORE> (e) || e->arity () > 0) return sortOf (e->arg (0));
+        error ("cannot infer the sort of a term");
+        return Expr ();
+      }
+
+      template <typename Op>
+      Expr chain (const ExprVector &args)
+      {
+        if (args.size () < 2) error ("expected at least two arguments");
+        if (args.size () == 2) return mk<Op> (args [0], args [1]);
+        ExprVector conj;
+        for (size_t i = 0; i + 1 < args.size (); ++i)
+          conj.push_back (mk<Op> (args [i], args [i + 1]));
+        return mknary<AND> (conj);
+      }
+
+      template <typename Op>
+      Expr nary (const ExprVector &args)
+      {
+        if (args.size () == 1) return args [0];
+        return mknary<Op> (args);
+      }
+
+      Expr mkApp (Frame &f)
+      {
+        ExprVector &args = f.args;
+        const std::string &h = f.head;
+
+        if (!f.indices.empty ())
+        {
+          if (h == "extract" && f.indices.size () == 2 && args.size () == 1)
+            return bv::extract (f.indices [0], f.indices [1], args [0]);
+          if ((h == "zero_extend" || h == "sign_extend") &&
+              f.indices.size () == 1 && args.size () == 1)
+          {
+            unsigned w = bv::width (sortOf (args [0])) + f.indices [0];
+            return h == "zero_extend" ?
+              bv::zext (args [0], w) : bv::sext (args [0], w);
+          }
+          error ("unsupported indexed function " + h);
+        }
+
+        if (f.asSort)
+        {
+          if (h == "const" && args.size () == 1 && isOpX<ARRAY_TY> (f.asSort))
+            return op::array::constArray (sort::arrayIndexTy (f.asSort), args [0]);
+          error ("unsupported qualified function " + h);
+        }
+
+        auto mit = m_macros.find (h);
+        if (mit != m_macros.end ())
+        {
+          const Macro &m = mit->second;
+          if (m.params.size () != args.size ())
+            error ("wrong number of arguments to " + h);
+          ExprMap sub;
+          for (size_t i = 0; i < args.size (); ++i) sub [m.params [i]] = args [i];
+          return replace (m.body, sub);
+        }
+
+        auto dit = m_decls.find (h);
+        if (dit != m_decls.end ())
+        {
+          if (bind::domainSz (dit->second) != args.size ())
+            error ("wrong number of arguments to " + h);
+          return bind::fapp (dit->second, args);
+        }
+
+        if (h == "and") return args.size () == 1 ? args [0] : mknary<AND> (args);
+        if (h == "or") return args.size () == 1 ? args [0] : mknary<OR> (args);
+        if (h == "not" && args.size () == 1) return mk<NEG> (args [0]);
+        if (h == "=>")
+        {
+          if (args.size () < 2) error ("expected at least two arguments");
+          Expr res = args.back ();
+          for (size_t i = args.size () - 1; i > 0; --i)
+            res = mk<IMPL> (args [i - 1], res);
+          return res;
+        }
+        if (h == "xor") return mknary<XOR> (args);
+        if (h == "ite" && args.size () == 3) return mknary<ITE> (args);
+        if (h == "=") return chain<EQ> (args);
+        if (h == "distinct")
+        {
+          if (args.size () == 2) return mk<NEQ> (args [0], args [1]);
+          ExprVector conj;
+          for (size_t i = 0; i < args.size (); ++i)
+            for (size_t j = i + 1; j < args.size (); ++j)
+              conj.push_back (mk<NEQ> (args [i], args [j]));
+          return mknary<AND> (conj);
+        }
+
+        if (h == "+") return nary<PLUS> (args);
+        if (h == "*") return nary<MULT> (args);
+        if (h == "-")
+          return args.size () == 1 ? mk<UN_MINUS> (args [0]) : mknary<MINUS> (args);
+        if (h == "/") return mknary<DIV> (args);
+        if (h == "div") return mknary<IDIV> (args);
+        if (h == "mod") return mknary<MOD> (args);
+        if (h == "rem") return mknary<REM> (args);
+        if (h == "abs" && args.size () == 1) return mk<ABS> (args [0]);
+        if (h == "<=") return chain<LEQ> (args);
+        if (h == ">=") return chain<GEQ> (args);
+        if (h == "<") return chain<LT> (args);
+        if (h == ">") return chain<GT> (args);
+        // -- XXX like the Z3 unmarshaler, ignore conversions
+        if ((h == "to_real" || h == "to_int") && args.size () == 1) return args [0];
+
+        if (h == "select" && args.size () == 2) return mknary<SELECT> (args);
+        if (h == "store" && args.size () == 3) return mknary<STORE> (args);
+
+        if (h == "bvnot" && args.size () == 1) return mk<BNOT> (args [0]);
+        if (h == "bvneg" && args.size () == 1) return mk<BNEG> (args [0]);
+        if (h == "bvadd") return mknary<BADD> (args);
+        if (h == "bvsub") return mknary<BSUB> (args);
+        if (h == "bvmul") return mknary<BMUL> (args);
+        if (h == "bvudiv") return mknary<BUDIV> (args);
+        if (h == "bvsdiv") return mknary<BSDIV> (args);
+        if (h == "bvurem") return mknary<BUREM> (args);
+        if (h == "bvsrem") return mknary<BSREM> (args);
+        if (h == "bvsmod") return mknary<BSMOD> (args);
+        if (h == "bvand") return mknary<BAND> (args);
+        if (h == "bvor") return mknary<BOR> (args);
+        if (h == "bvxor") return mknary<BXOR> (args);
+        if (h == "bvnand") return mknary<BNAND> (args);
+        if (h == "bvnor") return mknary<BNOR> (args);
+        if (h == "bvxnor") return mknary<BXNOR> (args);
+        if (h == "bvshl") return mknary<BSHL> (args);
+        if (h == "bvlshr") return mknary<BLSHR> (args);
+        if (h == "bvashr") return mknary<BASHR> (args);
+        if (h == "bvule") return mknary<BULE> (args);
+        if (h == "bvsle") return mknary<BSLE> (args);
+        if (h == "bvuge") return mknary<BUGE> (args);
+        if (h == "bvsge") return mknary<BSGE> (args);
+        if (h == "bvult") return mknary<BULT> (args);
+        if (h == "bvslt") return mknary<BSLT> (args);
+        if (h == "bvugt") return mknary<BUGT> (args);
+        if (h == "bvsgt") return mknary<BSGT> (args);
+        if (h == "concat") return mknary<BCONCAT> (args);
+
+        error ("unknown function " + h);
+        return Expr ();
+      }
+
+      /// opens the term that starts after a '('. Returns the term if
+      /// it is complete, and a null Expr if a frame was pushed
+      Expr openTerm (std::vector<Frame> &stack, ExprVector *topVars)
+      {
+        if (m_lex.peek () == Lexer::LPAREN)
+        {
+          // -- (_ f idx+) or (as f sort) in function position
+          m_lex.next ();
+          std::string q = expectSymbol ();
+          stack.push_back (Frame (Frame::APP, m_bound.size ()));
+          Frame &f = stack.back ();
+          f.head = expectSymbol ();
+          if (q == "_")
+            while (m_lex.peek () == Lexer::NUMERAL) f.indices.push_back (expectNumeral ());
+          else if (q == "as")
+            f.asSort = parseSort ();
+          else
+            error ("unexpected term in function position");
+          expect (Lexer::RPAREN, "')'");
+          if (m_lex.peek () == Lexer::RPAREN) error ("expected arguments");
+          return Expr ();
+        }
+
+        std::string s = expectSymbol ();
+        if (s == "let")
+        {
+          expect (Lexer::LPAREN, "'('");
+          stack.push_back (Frame (Frame::LET, m_bound.size ()));
+          expect (Lexer::LPAREN, "'('");
+          stack.back ().names.push_back (expectSymbol ());
+          return Expr ();
+        }
+
+        if (s == "forall" || s == "exists")
+        {
+          bool consts = topVars && stack.empty () && s == "forall";
+          stack.push_back (Frame (Frame::QUANT, m_bound.size ()));
+          Frame &f = stack.back ();
+          f.forall = s == "forall";
+          f.consts = consts;
+
+          expect (Lexer::LPAREN, "'('");
+          while (m_lex.peek () == Lexer::LPAREN)
+          {
+            m_lex.next ();
+            std::string name = expectSymbol ();
+            Expr sort = parseSort ();
+            expect (Lexer::RPAREN, "')'");
+
+            Binding b;
+            b.sort = sort;
+            if (consts)
+            {
+              b.val = bind::mkConst (mkName (name), sort);
+              topVars->push_back (b.val);
+            }
+            else
+            {
+              b.level = m_numBound++;
+              b.isVar = true;
+              f.args.push_back (bind::constDecl (mkName (name), sort));
+            }
+            bindName (name, b);
+          }
+          expect (Lexer::RPAREN, "')'");
+          if (f.args.empty () && !consts) error ("empty quantifier");
+          return Expr ();
+        }
+
+        if (s == "!")
+        {
+          stack.push_back (Frame (Frame::ANNOT, m_bound.size ()));
+          return Expr ();
+        }
+
+        if (s == "_")
+        {
+          // -- (_ bvN w)
+          std::string v = expectSymbol ();
+          if (v.compare (0, 2, "bv") != 0) error ("unsupported indexed term " + v);
+          unsigned w = expectNumeral ();
+          expect (Lexer::RPAREN, "')'");
+          return bv::bvnum (mpz_class (v.substr (2)), w, m_efac);
+        }
+
+        if (s == "as")
+        {
+          std::string v = expectSymbol ();
+          parseSort ();
+          expect (Lexer::RPAREN, "')'");
+          return parseSymbol (v);
+        }
+
+        stack.push_back (Frame (Frame::APP, m_bound.size ()));
+        stack.back ().head = s;
+        if (m_lex.peek () == Lexer::RPAREN) error ("expected arguments");
+        return Expr ();
+      }
+
+      /// parses a term. If topVars is not NULL, variables of an
+      /// outermost forall are bound to constants and added to topVars
+      Expr parseTerm (ExprVector *topVars = NULL)
+      {
+        std::vector<Frame> stack;
+        for (;;)
+        {
+          Expr val;
+          Lexer::Kind k = m_lex.next ();
+          if (k == Lexer::LPAREN)
+          {
+            val = openTerm (stack, topVars);
+            if (!val) continue;
+          }
+          else if (k == Lexer::SYMBOL)
+            val = parseSymbol (m_lex.text ());
+          else if (k == Lexer::RPAREN || k == Lexer::END)
+            error ("expected a term");
+          else
+            val = parseNumeral (k, m_lex.text ());
+
+          // -- pass val to the enclosing frames until one needs more input
+          for (;;)
+          {
+            if (stack.empty ()) return val;
+            Frame &f = stack.back ();
+
+            if (f.kind == Frame::APP)
+            {
+              f.args.push_back (val);
+              if (m_lex.peek () != Lexer::RPAREN) break;
+              m_lex.next ();
+              val = mkApp (f);
+            }
+            else if (f.kind == Frame::LET && !f.body)
+            {
+              f.args.push_back (val);
+              expect (Lexer::RPAREN, "')'");
+              if (m_lex.peek () == Lexer::LPAREN)
+              {
+                m_lex.next ();
+                f.names.push_back (expectSymbol ());
+                break;
+              }
+              expect (Lexer::RPAREN, "')'");
+              // -- parallel let: bind after all values are parsed
+              for (size_t i = 0; i < f.names.size (); ++i)
+              {
+                Binding b;
+                b.val = f.args [i];
+                b.level = m_numBound;
+                b.isLet = true;
+                bindName (f.names [i], b);
+              }
+              f.body = true;
+              break;
+            }
+            else if (f.kind == Frame::LET)
+            {
+              popScope (f.mark);
+              expect (Lexer::RPAREN, "')'");
+            }
+            else if (f.kind == Frame::QUANT)
+            {
+              popScope (f.mark);
+              expect (Lexer::RPAREN, "')'");
+              if (!f.consts)
+              {
+                m_numBound -= f.args.size ();
+                f.args.push_back (val);
+                val = f.forall ? mknary<FORALL> (f.args) : mknary<EXISTS> (f.args);
+              }
+            }
+            else
+            {
+              assert (f.kind == Frame::ANNOT);
+              skipToClose ();
+            }
+            stack.pop_back ();
+          }
+        }
+      }
+
+      void parseCommand (Command &cmd)
+      {
+        cmd.name = expectSymbol ();
+        cmd.expr = Expr ();
+        cmd.vars.clear ();
+        const std::string &c = cmd.name;
+
+        if (c == "assert")
+        {
+          cmd.kind = Command::ASSERT;
+          cmd.expr = parseTerm (m_constBinders ? &cmd.vars : NULL);
+          expect (Lexer::RPAREN, "')'");
+        }
+        else if (c == "declare-fun" || c == "declare-const" || c == "declare-rel")
+        {
+          std::string name = expectSymbol ();
+          ExprVector sig;
+          if (c != "declare-const") parseSorts (sig);
+          if (c == "declare-rel")
+          {
+            cmd.kind = Command::DECLARE_REL;
+            sig.push_back (sort::boolTy (m_efac));
+          }
+          else
+          {
+            cmd.kind = Command::DECLARE_FUN;
+            sig.push_back (parseSort ());
+          }
+          expect (Lexer::RPAREN, "')'");
+          cmd.expr = bind::fdecl (mkName (name), sig);
+          m_decls [name] = cmd.expr;
+        }
+        else if (c == "declare-var")
+        {
+          cmd.kind = Command::DECLARE_VAR;
+          std::string name = expectSymbol ();
+          Expr decl = bind::constDecl (mkName (name), parseSort ());
+          expect (Lexer::RPAREN, "')'");
+          m_decls [name] = decl;
+          cmd.expr = bind::fapp (decl);
+        }
+        else if (c == "define-fun")
+        {
+          cmd.kind = Command::DEFINE_FUN;
+          std::string name = expectSymbol ();
+          Macro m;
+          size_t mark = m_bound.size ();
+          expect (Lexer::LPAREN, "'('");
+          while (m_lex.peek () == Lexer::LPAREN)
+          {
+            m_lex.next ();
+            std::string p = expectSymbol ();
+            Binding b;
+            b.sort = parseSort ();
+            // -- a placeholder that is replaced by the actual argument
+            b.val = bind::mkConst (mkName (name + "!" + p), b.sort);
+            expect (Lexer::RPAREN, "')'");
+            m.params.push_back (b.val);
+            bindName (p, b);
+          }
+          expect (Lexer::RPAREN, "')'");
+          parseSort ();
+          m.body = parseTerm ();
+          popScope (mark);
+          expect (Lexer::RPAREN, "')'");
+          cmd.expr = m.body;
+          m_macros [name] = m;
+        }
+        else if (c == "define-sort")
+        {
+          cmd.kind = Command::OTHER;
+          std::string name = expectSymbol ();
+          expect (Lexer::LPAREN, "'('");
+          expect (Lexer::RPAREN, "')' (sort parameters are not supported)");
+          m_sorts [name] = parseSort ();
+          expect (Lexer::RPAREN, "')'");
+        }
+        else if (c == "rule" || c == "query")
+        {
+          cmd.kind = c == "rule" ? Command::RULE : Command::QUERY;
+          // -- (query P) for a relation P of a non-zero arity queries the
+          // -- relation itself. Its declaration is returned
+          if (cmd.kind == Command::QUERY && m_lex.peek () == Lexer::SYMBOL &&
+              m_decls.count (m_lex.text ()) &&
+              bind::domainSz (m_decls [m_lex.text ()]) > 0)
+          {
+            m_lex.next ();
+            cmd.expr = m_decls [m_lex.text ()];
+          }
+          else
+            cmd.expr = parseTerm ();
+          // -- optional rule name and query attributes
+          skipToClose ();
+        }
+        else if (c == "declare-sort")
+          error ("uninterpreted sorts are not supported");
+        else
+        {
+          cmd.kind = Command::OTHER;
+          skipToClose ();
+        }
+      }
+
+    public:
+      Parser (std::istream &in, ExprFactory &efac) :
+        m_efac (efac), m_lex (in), m_constBinders (false), m_numBound (0) {}
+
+      /// bind variables of an outermost forall of an asserted formula
+      /// to constants, as rules of a HornClauseDB expect, instead of
+      /// building a quantifier
+      void bindQuantifiedAsConsts (bool v) { m_constBinders = v; }
+
+      /// reads the next command. Returns false at the end of the
+      /// input or on error.
+      bool next (Command &cmd)
+      {
+        if (!m_error.empty ()) return false;
+        try
+        {
+          Lexer::Kind k = m_lex.next ();
+          if (k == Lexer::END) return false;
+          if (k != Lexer::LPAREN) error ("expected a command");
+          parseCommand (cmd);
+          return true;
+        }
+        catch (ParseError &e)
+        {
+          m_error = e.what ();
+          // -- reset the scope for a parser that is not used anymore
+          popScope (0);
+          m_numBound = 0;
+          return false;
+        }
+      }
+
+      bool hasError () const { return !m_error.empty (); }
+      const std::string &getError () const { return m_error; }
+    };
+
+    /// Parses all assertions of an SMT-LIB2 stream into out. Returns
+    /// false on error
+    template <typename OutputIterator>
+    bool parseAssertions (std::istream &in, ExprFactory &efac,
+                          OutputIterator out, std::string *error = NULL)
+    {
+      Parser p (in, efac);
+      Command cmd;
+      while (p.next (cmd))
+        if (cmd.kind == Command::ASSERT) *out++ = cmd.expr;
+      if (error) *error = p.getError ();
+      return !p.hasError ();
+    }
+  }
+}
+
+#endif
@@ -2,6 +2,11 @@
 #define _STATS__HPP_
 
 #include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
 
 #include <sys/time.h>
 #include <sys/resource.h>
@@ -132,6 +137,163 @@ namespace ufo
   }
 
 
+  /** 
+   * A counter that is registered once, by Stats::counter, and then
+   * incremented without a lookup. Increments are spread over shards
+   * of a cache line each, one per thread modulo numShards, so that
+   * threads counting concurrently do not contend. Printed with the
+   * other counters of Stats.
+   */
+  class StatsCounter
+  {
+  public:
+    static const unsigned numShards = 16;
+
+  private:
+    struct Shard
+    {
+      std::atomic<unsigned long> v;
+      char pad [64 - sizeof (std::atomic<unsigned long>)];
+      Shard () : v (0) {}
+    };
+
+    std::string m_name;
+    Shard m_shards [numShards];
+
+    static unsigned shard ()
+    {
+      static std::atomic<unsigned> next (0);
+      static thread_local unsigned idx = next++ % numShards;
+      return idx;
+    }
+
+  public:
+    StatsCounter (const std::string &name) : m_name (name) {}
+    StatsCounter (const StatsCounter &) = delete;
+
+    const std::string &name () const { return m_name; }
+
+    /** Adds n. Returns the value of the shard of this thread before */
+    unsigned long inc (unsigned long n = 1)
+    { return m_shards [shard ()].v.fetch_add (n, std::memory_order_relaxed); }
+
+    unsigned long value () const
+    {
+      unsigned long r = 0;
+      for (const Shard &s : m_shards) r += s.v.load (std::memory_order_relaxed);
+      return r;
+    }
+  };
+
+  /** 
+   * Estimates the time of a block that runs too often to be timed
+   * on every run. Every run is counted but only one run in period,
+   * per thread, is timed; the total is extrapolated from the timed
+   * runs. Registered by Stats::sampleTimer and printed with the timers
+   * of Stats, together with a counter name.runs. See ScopedSample.
+   */
+  class StatsSampleTimer
+  {
+    std::string m_name;
+    unsigned m_period;
+    StatsCounter m_runs;
+    StatsCounter m_sampled;
+    /** in nanoseconds */
+    StatsCounter m_sampledTime;
+
+  public:
+    StatsSampleTimer (const std::string &name, unsigned period) :
+      m_name (name), m_period (period > 0 ? period : 1),
+      m_runs (name + ".runs"), m_sampled (name), m_sampledTime (name) {}
+
+    const std::string &name () const { return m_name; }
+    const StatsCounter &runs () const { return m_runs; }
+
+    /** Counts a run. Returns true if the run is to be timed */
+    bool start () { return m_runs.inc () % m_period == 0; }
+    void addSample (unsigned long ns)
+    {
+      m_sampled.inc ();
+      m_sampledTime.inc (ns);
+    }
+
+    /** estimated total time, in seconds */
+    double toSeconds () const
+    {
+      unsigned long k = m_sampled.value ();
+      if (k == 0) return 0;
+      return m_sampledTime.value () / 1e9 * m_runs.value () / k;
+    }
+  };
+
+  /** 
+   * Distribution of a value, e.g., the latency of a phase in seconds,
+   * over buckets with the given upper bounds. Registered by
+   * Stats::histogram and, like StatsCounter, safe to use from several
+   * threads. Printed by Stats::PrintPrometheus.
+   */
+  class StatsHistogram
+  {
+    std::string m_name;
+    std::vector<double> m_bounds;
+    /** one per bound, and one for the values above the last */
+    std::unique_ptr<std::atomic<unsigned long> []> m_counts;
+    /** in millionths */
+    std::atomic<unsigned long> m_sum;
+
+  public:
+    StatsHistogram (const std::string &name, const std::vector<double> &bounds) :
+      m_name (name), m_bounds (bounds),
+      m_counts (new std::atomic<unsigned long> [bounds.size () + 1]), m_sum (0)
+    { for (size_t i = 0; i <= m_bounds.size (); ++i) m_counts [i] = 0; }
+    StatsHistogram (const StatsHistogram &) = delete;
+
+    const std::string &name () const { return m_name; }
+    const std::vector<double> &bounds () const { return m_bounds; }
+
+    void observe (double v)
+    {
+      size_t i = 0;
+      while (i < m_bounds.size () && v > m_bounds [i]) ++i;
+      m_counts [i].fetch_add (1, std::memory_order_relaxed);
+      if (v > 0) m_sum.fetch_add (v * 1e6, std::memory_order_relaxed);
+    }
+
+    /** values in bucket i, i.e., at most bounds ()[i] and above the
+        bound before. bounds ().size () is the bucket above the last */
+    unsigned long count (size_t i) const
+    { return m_counts [i].load (std::memory_order_relaxed); }
+    unsigned long total () const
+    {
+      unsigned long r = 0;
+      for (size_t i = 0; i <= m_bounds.size (); ++i) r += count (i);
+      return r;
+    }
+    double sum () const { return m_sum.load (std::memory_order_relaxed) / 1e6; }
+  };
+
+  /** 
+   * A phase of the run: the ScopedStats of one name and the phases
+   * nested in it. Times are in seconds. Memory is the peak resident
+   * set size of the process (in KB) when the phase last ended, and
+   * how much the phases of this name raised it.
+   */
+  struct StatsPhase
+  {
+    std::string name;
+    unsigned calls;
+    double wall;
+    double cpu;
+    long maxRss;
+    long rssGrowth;
+    StatsPhase *parent;
+    std::vector<std::unique_ptr<StatsPhase> > children;
+
+    StatsPhase (const std::string &n, StatsPhase *p) :
+      name (n), calls (0), wall (0), cpu (0), maxRss (0), rssGrowth (0),
+      parent (p) {}
+  };
+
   class Stats
   {
   private:
@@ -139,6 +301,24 @@ namespace ufo
     static std::map<std::string,Stopwatch> sw;
     static std::map<std::string,Averager> av;
     static std::map<std::string,std::string> ss;
+    static std::map<std::string,std::function<void ()> > hooks;
+    static std::map<std::string,
+                    std::function<void (llvm::raw_ostream&)> > jsonSections;
+    static std::map<std::string,std::unique_ptr<StatsCounter> > handles;
+    static std::map<std::string,
+                    std::unique_ptr<StatsSampleTimer> > sampleTimers;
+    static std::map<std::string,
+                    std::unique_ptr<StatsHistogram> > histograms;
+
+    static void runHooks ();
+    /** the counters of count and uset together with the handles */
+    static std::map<std::string,unsigned long> allCounters ();
+
+    friend class ScopedStats;
+    /** The phase of name nested in the current phase of this thread */
+    static StatsPhase *enterPhase (const std::string &name);
+    static void exitPhase (StatsPhase *phase, double wall, double cpu,
+                           long rss0);
 
   public:
     static unsigned  get (const std::string &n);
@@ -150,14 +330,70 @@ namespace ufo
     
     static void count (const std::string &name);
 
+    /** 
+     * The counter of the given name, created on first use. The
+     * reference stays valid until exit, so hot code looks it up once:
+     *   static ufo::StatsCounter &c = ufo::Stats::counter ("foo");
+     *   c.inc ();
+     * Unlike count, it can be used from several threads.
+     */
+    static StatsCounter &counter (const std::string &name);
+    /** The sampling timer of the given name, created on first use
+        with the given period. See ScopedSample */
+    static StatsSampleTimer &sampleTimer (const std::string &name,
+                                          unsigned period = 64);
+    /** The histogram of the given name, created on first use with the
+        given bounds, or bounds for latencies in seconds if empty */
+    static StatsHistogram &histogram (const std::string &name,
+                                      const std::vector<double> &bounds =
+                                      std::vector<double> ());
+
     static void start (const std::string &name);
     static void stop (const std::string &name);
     static void resume (const std::string &name);
 
+    /** 
+     * Registers a hook that runs before statistics are printed. Used
+     * to publish statistics that are maintained elsewhere, e.g., the
+     * node counts of an ExprFactory. Replaces a hook with the same name.
+     */
+    static void addPrintHook (const std::string &name, 
+                              std::function<void ()> hook);
+    static void removePrintHook (const std::string &name);
+
+    /** 
+     * Registers a section of the JSON output. The function writes the
+     * JSON value of the section. Replaces a section with the same name.
+     */
+    static void addJsonSection (const std::string &name,
+                                std::function<void (llvm::raw_ostream&)> fn);
+
     /** Outputs all statistics to std output */
     static void Print (std::ostream &OS);
     static void Print (llvm::raw_ostream &OS);
     static void PrintBrunch (llvm::raw_ostream &OS);
+    /** Outputs all statistics and the tree of phases as a JSON object */
+    static void PrintJson (llvm::raw_ostream &OS);
+    /** 
+     * Outputs the counter handles, the sampling timers and the
+     * histograms in the Prometheus text format, with names prefixed
+     * by sea_. Only reads what is safe to read from another thread,
+     * so it can serve a metrics endpoint while the statistics change
+     */
+    static void PrintPrometheus (llvm::raw_ostream &OS);
+
+    /** The counters, and the timers in seconds, after the print
+        hooks ran, e.g., to send them to another process */
+    static std::map<std::string,unsigned long> counterValues ();
+    static std::map<std::string,double> timerValues ();
+
+    /** Wall and CPU (user and system) time of the process in
+        seconds, and its peak resident set size in KB */
+    static double wallTime ();
+    static double cpuTime ();
+    static long maxRss ();
+    /** Current resident set size of the process in KB, 0 if unknown */
+    static long currentRss ();
   };
 
 
@@ -197,12 +433,22 @@ namespace ufo
     
   };
   
+  /** Times a block under the given name. Nested ScopedStats are
+      also recorded as a tree of phases, see Stats::PrintJson */
   class ScopedStats 
   {
     std::string m_name;
+    StatsPhase *m_phase;
+    double m_wall;
+    double m_cpu;
+    long m_rss;
   public:
     ScopedStats (const std::string &name, bool reset = false) : m_name(name) 
     { 
+      m_phase = Stats::enterPhase (name);
+      m_wall = Stats::wallTime ();
+      m_cpu = Stats::cpuTime ();
+      m_rss = Stats::maxRss ();
       if (reset) 
         { 
           m_name += ".last";
@@ -211,9 +457,32 @@ namespace ufo
       else
         Stats::resume (m_name); 
     }
-    ~ScopedStats () { Stats::stop (m_name); }
+    ~ScopedStats () 
+    { 
+      Stats::stop (m_name); 
+      Stats::exitPhase (m_phase, Stats::wallTime () - m_wall,
+                        Stats::cpuTime () - m_cpu, m_rss);
+    }
   };  
 
+  /** Times a block with a sampling timer:
+        static ufo::StatsSampleTimer &t = ufo::Stats::sampleTimer ("foo");
+        ufo::ScopedSample _s_(t);
+      Cheap enough for blocks that run millions of times */
+  class ScopedSample
+  {
+    StatsSampleTimer &m_t;
+    double m_start;
+  public:
+    ScopedSample (StatsSampleTimer &t) : m_t (t), m_start (-1)
+    { if (m_t.start ()) m_start = Stats::wallTime (); }
+    ~ScopedSample ()
+    {
+      if (m_start >= 0)
+        m_t.addSample ((Stats::wallTime () - m_start) * 1e9);
+    }
+  };
+
 }
 
 #define SEA_MEASURE_FN ufo::ScopedStats __stats__(__FUNCTION__)
@@ -0,0 +1,54 @@
+#ifndef _UFO_TRACE__HH_
+#define _UFO_TRACE__HH_
+
+#include <atomic>
+#include <string>
+
+namespace ufo
+{
+  /**
+   * Records a timeline of events in the Chrome trace format, for
+   * chrome://tracing or Perfetto. Events are begin/end pairs of a
+   * name, per thread, and are kept in memory until close writes
+   * them. When no trace is open every call checks a single flag and
+   * returns, so the hooks can stay in hot code.
+   */
+  class Trace
+  {
+    static std::atomic<bool> s_enabled;
+
+  public:
+    static bool enabled ()
+    { return s_enabled.load (std::memory_order_relaxed); }
+
+    /** Starts recording. The trace is written to path by close */
+    static void open (const std::string &path);
+    /** Writes the trace and stops recording. Called at exit if the
+        trace is still open */
+    static void close ();
+
+    /** Begins or ends an event of the given name and category on the
+        calling thread. Category must be a string literal */
+    static void begin (const std::string &name, const char *cat);
+    static void end (const std::string &name, const char *cat);
+    /** An event without duration */
+    static void instant (const std::string &name, const char *cat);
+    /** Names the calling thread in the timeline */
+    static void threadName (const std::string &name);
+  };
+
+  /** An event that spans a block */
+  class ScopedTrace
+  {
+    const char *m_name;
+    const char *m_cat;
+    bool m_on;
+  public:
+    ScopedTrace (const char *name, const char *cat) :
+      m_name (name), m_cat (cat), m_on (Trace::enabled ())
+    { if (m_on) Trace::begin (m_name, m_cat); }
+    ~ScopedTrace () { if (m_on) Trace::end (m_name, m_cat); }
+  };
+}
+
+#endif
@@ -17,124 +17,122 @@
 
 #include "seahorn/Transforms/Utils/Local.hh"
 
+#include "llvm/Support/CommandLine.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+static llvm::cl::opt<unsigned>
+ApiThreads("api-threads",
+           llvm::cl::desc("Summarize the functions of independent call graph "
+                          "SCCs for --api-config on this many threads"),
+           llvm::cl::init(1));
+
 
 namespace seahorn
 {
    using namespace llvm;
 
-   void ApiAnalysisPass::analyze(const Function *F, unsigned int& progress, ApiCallInfo& aci)
+   unsigned int ApiAnalysisPass::flow(const Function &F, unsigned int entry,
+                                      DenseMap<const BasicBlock*, unsigned int> &out)
    {
-      for (auto analyzedfunc : m_apiAnalysis)
+      // Progress only grows, and is bounded by the length of the sequence,
+      // so iterating over the loops terminates
+      ReversePostOrderTraversal<const Function*> rpo(&F);
+      bool changed = true;
+      while (changed)
       {
-         if (F->getName() == analyzedfunc.m_func->getName())
+         changed = false;
+         for (const BasicBlock *bb : rpo)
          {
-            if (analyzedfunc.getFinalAnalysis().m_progress == m_apilist.size())
+            unsigned int progress = entry;
+            for (auto it = pred_begin(bb), et = pred_end(bb); it != et; ++it)
             {
-               return;
+               auto po = out.find(*it);
+               if (po != out.end()) progress = std::max(progress, po->second);
             }
-         }
-      }
-
-
-      // First, get the basic blocks in topological order
-      std::vector<const BasicBlock*> sortedBBlocks;
-      RevTopoSort(*F,sortedBBlocks);
-      boost::reverse(sortedBBlocks);
-
-      // Required API calls are initialized for this BB
-      BBApiList bblist;
-      unsigned int initProgress = progress;
-
-      while ( progress < m_apilist.size())
-      {
-         std::string API = m_apilist.at(progress);
-
-         // It appears that two calls can occur in an LLLVM basic block? So each block
-         // must be processed again and again?
-
-         unsigned int apiIncrement=0;
 
-         for (const BasicBlock *bb : sortedBBlocks)
-         {
-            // determine if the API is called
-            for (BasicBlock::const_iterator bi = bb->begin(); bi != bb->end(); bi++)
+            for (const Instruction &I : *bb)
             {
-               const Instruction *I = &*bi;
-               if (const CallInst *CI = dyn_cast<CallInst> (I)) {
-
-                  CallSite CS (const_cast<CallInst*> (CI));
-                  const Function *cf = CS.getCalledFunction();
-
-                  // this block contains an API function call of interest
-                  if (cf)
-                  {
-                     if (cf->getName().str() == API)
-                     {
-
-                        apiIncrement++;
-
-                        if ( (progress+apiIncrement) < m_apilist.size())
-                        {
-                           API = m_apilist.at(progress+apiIncrement); // go to the next API
-                        }
-                        else
-                        {
-                           break;
-                        }
-                     }
-                     else
-                     {
-                        // handle external calls
-                        if (!cf->empty())
-                        {
-
-                           // handle function calls
-                           analyze(cf, progress, aci);
-                        }
-                     }
-                  }
+               const CallInst *CI = dyn_cast<CallInst> (&I);
+               if (!CI) continue;
+               const Function *cf = CI->getCalledFunction();
+               if (!cf) continue;
+
+               if (progress < m_apilist.size() && cf->getName() == m_apilist[progress])
+                  progress++; // go to the next API
+               else
+               {
+                  auto si = m_summaryIdx.find(cf);
+                  if (si != m_summaryIdx.end())
+                     progress = m_summaries[si->second][progress];
                }
             }
 
-            // get the predecessor and propagate analysis info
-            unsigned int max_progress = progress;
-            for (auto it = pred_begin(bb), et = pred_end(bb); it != et; ++it)
+            auto res = out.insert(std::make_pair(bb, progress));
+            if (res.second || res.first->second < progress)
             {
-               const BasicBlock* predBB = *it;
+               res.first->second = progress;
+               changed = true;
+            }
+         }
+      }
 
-               for (auto bli = bblist.begin(),ble=bblist.end(); bli!=ble; bli++)
-               {
-                  const BasicBlock* processedBB = bli->m_bb;
+      // a function that does not return does not change its callers
+      unsigned int exit = entry;
+      bool returns = false;
+      for (const BasicBlock &bb : F)
+      {
+         if (!isa<ReturnInst> (bb.getTerminator())) continue;
+         exit = returns ? std::max(exit, out[&bb]) : out[&bb];
+         returns = true;
+      }
+      return exit;
+   }
 
-                  if (processedBB == predBB) // found a direct predecessor
-                  {
-                     unsigned int prev_progress = bli->m_progress;
+   void ApiAnalysisPass::summarize(const std::vector<const Function*> &scc)
+   {
+      // recursive functions reach a fixpoint from the identity
+      for (const Function *F : scc)
+      {
+         ApiSummary &sum = m_summaries[m_summaryIdx[F]];
+         for (unsigned int p = 0; p < sum.size(); p++) sum[p] = p;
+      }
 
-                     if (prev_progress > max_progress)
-                     {
-                        max_progress = prev_progress;
-                     }
-                  }
+      bool changed = true;
+      while (changed)
+      {
+         changed = false;
+         for (const Function *F : scc)
+         {
+            ApiSummary &sum = m_summaries[m_summaryIdx[F]];
+            for (unsigned int p = 0; p < sum.size(); p++)
+            {
+               DenseMap<const BasicBlock*, unsigned int> out;
+               unsigned int exit = flow(*F, p, out);
+               if (exit > sum[p])
+               {
+                  sum[p] = exit;
+                  changed = true;
                }
             }
-
-            // Now know the progress value, save it
-
-            ApiEntry bbentry;
-            bbentry.m_bb = bb;
-            bbentry.m_progress = max_progress+apiIncrement;
-            bbentry.m_func = F->getName();
-
-            progress += apiIncrement; // go to next API(s)
-
-            apiIncrement=0;
-
-            aci.m_bblist.push_back(bbentry);
          }
+      }
+   }
 
-         // match not here
-         if (initProgress == progress ) break;
+   void ApiAnalysisPass::analyze(const Function *F, ApiCallInfo& aci)
+   {
+      DenseMap<const BasicBlock*, unsigned int> out;
+      flow(*F, 0, out);
 
+      aci.m_func = F;
+      aci.m_progress = 0;
+      ReversePostOrderTraversal<const Function*> rpo(F);
+      for (const BasicBlock *bb : rpo)
+      {
+         aci.m_bblist.push_back(ApiEntry(bb, out[bb], F->getName()));
+         aci.m_progress = std::max(aci.m_progress, out[bb]);
       }
    }
 
@@ -142,12 +140,12 @@ namespace seahorn
    // Report search results
    void ApiAnalysisPass::report()
    {
+      DenseSet<const Function*> visited;
       for (auto& analysis : m_apiAnalysis)
       {
          if (!analysis.m_bblist.empty())
          {
-            ApiEntry final = analysis.getFinalAnalysis();
-            if (final.m_progress == m_apilist.size())
+            if (analysis.m_progress == m_apilist.size())
             {
                outs () << "Found sequence in " <<  analysis.m_func->getName() << "\n";
 
@@ -159,9 +157,7 @@ namespace seahorn
                }
                outs() << "\t---\n";
 
-               std::vector<const Function *> chain;
-               chain.push_back(analysis.m_func);
-               findStartingPoints(analysis.m_func);
+               findStartingPoints(analysis.m_func, visited);
             }
          }
       }
@@ -178,8 +174,10 @@ namespace seahorn
       errs() << "\n";
    }
 
-   void ApiAnalysisPass::findStartingPoints(const Function* F)
+   void ApiAnalysisPass::findStartingPoints(const Function* F, DenseSet<const Function*> &visited)
    {
+      // each function is visited once, whatever the number of paths to it
+      if (!visited.insert(F).second) return;
 
       // Without any users, this is a possible entry point
       if (F->getNumUses() == 0)
@@ -200,7 +198,7 @@ namespace seahorn
                   // The grandparent of an instruction is a function (Inst -> BB -> Function)
                   const Function * callingFunc = Inst->getParent()->getParent();
 
-                  findStartingPoints(callingFunc);
+                  findStartingPoints(callingFunc, visited);
                }
             }
          }
@@ -222,33 +220,70 @@ namespace seahorn
    // The body of the pass
    bool ApiAnalysisPass::runOnModule (Module &M)
    {
-      std::vector<Function*> sortedFuncs;
       CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph();
 
+      // SCCs bottom-up, with the defined functions only. The level of an
+      // SCC is above the levels of the SCCs it calls, SCCs of one level are
+      // independent
+      std::vector<std::vector<const Function*> > sccs;
+      DenseMap<const Function*, unsigned> sccOf;
+      std::vector<std::vector<unsigned> > levels;
       for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
       {
-         auto &scc = *it;
-         for (CallGraphNode *cgn : scc)
+         std::vector<const Function*> scc;
+         for (CallGraphNode *cgn : *it)
          {
-            Function *f = cgn->getFunction();
-            if (!f) continue;
-            sortedFuncs.push_back(f);
+            const Function *f = cgn->getFunction();
+            if (!f || f->isDeclaration()) continue;
+            scc.push_back(f);
          }
+         if (scc.empty()) continue;
+
+         unsigned level = 0;
+         for (const Function *f : scc)
+            for (const CallGraphNode::CallRecord &cr : *CG[f])
+            {
+               const Function *callee = cr.second->getFunction();
+               auto ci = callee ? sccOf.find(callee) : sccOf.end();
+               if (ci != sccOf.end()) level = std::max<unsigned>(level, ci->second + 1);
+            }
+         for (const Function *f : scc)
+         {
+            sccOf[f] = level;
+            m_summaryIdx[f] = m_summaries.size();
+            m_summaries.push_back(ApiSummary(m_apilist.size() + 1, 0));
+         }
+         if (levels.size() <= level) levels.resize(level + 1);
+         levels[level].push_back(sccs.size());
+         sccs.push_back(scc);
       }
 
-      // This call generates API call information for each
-      unsigned int progress;
-      for (Function *F : sortedFuncs)
+      // Each function is summarized once. Workers only write the summaries
+      // of their own SCC and read the ones of lower levels
+      for (const std::vector<unsigned> &lvl : levels)
       {
-         progress=0;
-         ApiCallInfo aci;
-
-         aci.m_func = F;
-         analyze(F,progress,aci);
-
-         m_apiAnalysis.push_back(aci);
+         std::atomic<unsigned> next(0);
+         auto worker = [&] ()
+            {
+               for (unsigned k = next++; k < lvl.size(); k = next++)
+                  summarize(sccs[lvl[k]]);
+            };
+         std::vector<std::thread> pool;
+         for (unsigned t = 1; t < std::min<size_t>(ApiThreads, lvl.size()); ++t)
+            pool.emplace_back(worker);
+         worker();
+         for (std::thread &t : pool) t.join();
       }
 
+      // This call generates API call information for each
+      for (const std::vector<const Function*> &scc : sccs)
+         for (const Function *F : scc)
+         {
+            ApiCallInfo aci;
+            analyze(F, aci);
+            m_apiAnalysis.push_back(aci);
+         }
+
       report();
 
       // Once the analysis completes, we know the possible entry points. Now, make
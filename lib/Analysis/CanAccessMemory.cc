@@ -2,7 +2,6 @@
 
 #include "llvm/IR/InstIterator.h"
 #include "llvm/Analysis/CallGraph.h"
-#include "llvm/ADT/SCCIterator.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "avy/AvyDebug.h"
@@ -12,13 +11,11 @@ namespace seahorn
   
   char CanAccessMemory::ID = 0;
   
-  bool CanAccessMemory::canAccess (const Function *f) const
-  {return m_must.count (f) > 0 || m_may.count (f) > 0;}
-  
   bool CanAccessMemory::runOnModule (Module &M)
   {
     LOG ("canmem", errs () << "Running may access memory analysis\n";);
 
+    m_fns.init (M);
     for (Function &F : M)
     {
       for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) 
@@ -26,7 +23,7 @@ namespace seahorn
         Instruction *I = &*i;
         if (isa<LoadInst>(I) || isa<StoreInst>(I))
         {
-          m_must.insert (&F);
+          m_fns.setMust (&F);
           break;
         }
         if (const CallInst *CI = dyn_cast<CallInst> (I))
@@ -38,7 +35,7 @@ namespace seahorn
                 cf->getName ().startswith ("llvm.memmove") ||
                 cf->getName ().startswith ("llvm.memset")))
           {
-            m_must.insert (&F);
+            m_fns.setMust (&F);
             break;
           }
         }
@@ -46,36 +43,20 @@ namespace seahorn
     }
         
     LOG ("canmem", errs () << "Must access to memory: ";
-         for (auto v : m_must) errs () << v->getName () << ", ";
+         for (const Function &F : M)
+           if (mustAccess (&F)) errs () << F.getName () << ", ";
          errs () << "\n";);
     
     // -- no error function found at all
-    if (m_must.empty ()) return false;
+    if (m_fns.noneMust ()) return false;
     
     CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
-    for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
-    {
-      auto &scc = *it;
-      bool mark = false;
-      
-      // -- check if any of the functions in the scc calls something
-      // -- that may access to memory
-      for (CallGraphNode *cgn : scc)
-      {
-        for (auto &calls : *cgn)
-          if (canAccess (calls.second->getFunction ()))
-          {mark=true; break;}
-      }
-      if (mark)
-      {
-        for (auto *cgn : scc)
-          if (cgn->getFunction ())
-            m_may.insert (cgn->getFunction ());
-      }
-    }
+    m_fns.propagate (CG);
     
     LOG ("canmem", errs () << "May access to memory: ";
-         for (auto v : m_may) errs () << v->getName () << ", ";
+         std::vector<const Function*> may;
+         m_fns.mays (std::back_inserter (may));
+         for (auto v : may) errs () << v->getName () << ", ";
          errs () << "\n";);
     
       
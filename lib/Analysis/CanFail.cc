@@ -2,7 +2,7 @@
 #include "seahorn/Transforms/Scalar/PromoteVerifierCalls.hh"
 
 #include "llvm/Analysis/CallGraph.h"
-#include "llvm/ADT/SCCIterator.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "avy/AvyDebug.h"
@@ -12,46 +12,54 @@ namespace seahorn
   
   char CanFail::ID = 0;
   
-  bool CanFail::canFail (const Function *f) const
-  {return m_must.count (f) > 0 || m_may.count (f) > 0;}
+  bool CanFail::canFail (const BasicBlock *bb) const
+  {
+    auto it = m_bbIds.find (bb);
+    return it != m_bbIds.end () && m_bbFail.test (it->second);
+  }
   
   bool CanFail::runOnModule (Module &M)
   {
     LOG ("canfail", errs () << "Running mark-fail analysis\n";);
     
+    m_fns.init (M);
+    m_bbIds.clear ();
+    m_bbFail.clear ();
     if (const Function *errorFn = M.getFunction ("verifier.error"))
-      m_must.insert (errorFn);
+      m_fns.setMust (errorFn);
 
-    LOG ("canfail", errs () << "Number of must_fail: " << m_must.size () << "\n";);
+    LOG ("canfail", errs () << "Number of must_fail: " << m_fns.countMust () << "\n";);
     
     
     // -- no error function found at all
-    if (m_must.empty ()) return false;
+    if (m_fns.noneMust ()) return false;
     
     CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
-    for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
+    m_fns.propagate (CG);
+
+    // -- blocks of the functions that may fail
+    for (const Function &F : M)
     {
-      auto &scc = *it;
-      bool mark = false;
-      
-      // -- check if any of the functions in the scc calls something
-      // -- that may fail
-      for (CallGraphNode *cgn : scc)
-      {
-        for (auto &calls : *cgn)
-          if (canFail (calls.second->getFunction ()))
-          {mark=true; break;}
-      }
-      if (mark)
+      if (!canFail (&F)) continue;
+      for (const BasicBlock &bb : F)
       {
-        for (auto *cgn : scc)
-          if (cgn->getFunction ())
-            m_may.insert (cgn->getFunction ());
+        unsigned i = m_bbIds.size ();
+        m_bbIds [&bb] = i;
+        m_bbFail.resize (i + 1);
+        for (const Instruction &I : bb)
+        {
+          const CallInst *CI = dyn_cast<CallInst> (&I);
+          if (!CI) continue;
+          const Function *cf = dyn_cast<Function> (CI->getCalledValue ()->stripPointerCasts ());
+          if (cf && canFail (cf)) {m_bbFail.set (i); break;}
+        }
       }
     }
     
     LOG ("canfail", errs () << "Can fail: ";
-         for (auto v : m_may) errs () << v->getName () << ", ";
+         std::vector<const Function*> may;
+         m_fns.mays (std::back_inserter (may));
+         for (auto v : may) errs () << v->getName () << ", ";
          errs () << "\n";);
     
       
@@ -2,10 +2,22 @@
 #include "llvm/Transforms/Utils/UnifyFunctionExitNodes.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/IR/CFG.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/CommandLine.h"
 #include "boost/range.hpp"
 #include "seahorn/Support/CFG.hh"
+#include "seahorn/Analysis/WeakTopologicalOrderPass.hh"
 
 #include "avy/AvyDebug.h"
+
+#include <algorithm>
+#include <deque>
+
+static llvm::cl::opt<bool>
+MinCutPoints ("horn-min-cutpoints",
+              llvm::cl::desc ("Use a minimal set of cut-points that cuts every cycle"),
+              llvm::cl::init (false));
+
 namespace seahorn
 {
   char CutPointGraph::ID = 0;
@@ -16,23 +28,39 @@ namespace seahorn
     AU.setPreservesAll ();
     AU.addRequired<UnifyFunctionExitNodes> ();
     AU.addRequiredTransitive<TopologicalOrder> ();
+    if (MinCutPoints) AU.addRequired<WeakTopologicalOrderPass> ();
   }
 
 
+  bool CutPointGraph::usesWto () { return MinCutPoints; }
+
   bool CutPointGraph::runOnFunction (llvm::Function &F)
   {
       //LOG("seahorn", errs () << "CPG runOnFunction: " << F.getName () << "\n");
 
 
     const TopologicalOrder &topo = getAnalysis<TopologicalOrder> ();
+    compute (F, topo, MinCutPoints ? &getAnalysis<WeakTopologicalOrderPass> () : nullptr);
+    return false;
+  }
 
-    computeCutPoints (F, topo);
-    computeFwdReach (F, topo);
-    computeBwdReach (F, topo);
-    computeEdges (F, topo);
+  void CutPointGraph::compute (Function &F, const TopologicalOrder &topo,
+                               const WeakTopologicalOrderPass *wto)
+  {
+    releaseMemory ();
+    if (MinCutPoints)
+    {
+      assert (wto);
+      computeMinCutPoints (F, topo, *wto);
+    }
+    else
+      computeCutPoints (F, topo);
+    computeOrder (F, topo);
+    computeFwdReach (F);
+    computeBwdReach (F);
+    computeEdges (F);
 
     LOG ("cpg", print (errs (), F.getParent ()));
-    return false;
   }
 
 
@@ -69,7 +97,111 @@ namespace seahorn
         }
       
     }
+    m_numDefaultCps = m_cps.size ();
+  }
 
+  void CutPointGraph::computeMinCutPoints (const Function &F, 
+                                           const TopologicalOrder &topo,
+                                           const WeakTopologicalOrderPass &wto)
+  {
+    // -- cut-points of the default selection, only counted
+    unsigned loopCps = 0;
+    for (const BasicBlock *bb : topo)
+    {
+      bool backEdge = false;
+      for (const BasicBlock *pred :
+             boost::make_iterator_range (pred_begin (bb), pred_end (bb)))
+        backEdge = backEdge || topo.isBackEdge (*pred, *bb);
+      if (backEdge || pred_begin (bb) == pred_end (bb) || 
+          succ_begin (bb) == succ_end (bb))
+        ++loopCps;
+    }
+    
+    // -- the entry, the exit, and the heads of the wto. Every cycle
+    // -- contains the head of the innermost component around it
+    DenseSet<const BasicBlock*> cps;
+    std::vector<const BasicBlock*> heads;
+    for (const BasicBlock *bb : topo)
+    {
+      if (pred_begin (bb) == pred_end (bb) || succ_begin (bb) == succ_end (bb))
+        cps.insert (bb);
+      else if (wto.isHead (*bb))
+      {
+        cps.insert (bb);
+        heads.push_back (bb);
+      }
+    }
+    
+    // -- drop the heads whose cycles are all cut by another
+    // -- cut-point. Outer heads go first: the cycles of an outer
+    // -- loop often go through an inner one, never the other way
+    std::stable_sort (heads.begin (), heads.end (),
+                      [&wto] (const BasicBlock *a, const BasicBlock *b)
+                      { return wto.nestingDepth (*a) < wto.nestingDepth (*b); });
+    for (const BasicBlock *h : heads)
+    {
+      cps.erase (h);
+      
+      // -- is there a cycle through h that avoids the cut-points
+      bool cycle = false;
+      DenseSet<const BasicBlock*> seen;
+      SmallVector<const BasicBlock*, 16> stack;
+      stack.push_back (h);
+      while (!cycle && !stack.empty ())
+      {
+        const BasicBlock *bb = stack.pop_back_val ();
+        for (const BasicBlock *succ : succs (*bb))
+        {
+          if (succ == h) { cycle = true; break; }
+          if (cps.count (succ) || !seen.insert (succ).second) continue;
+          stack.push_back (succ);
+        }
+      }
+      
+      if (cycle) cps.insert (h);
+      else LOG ("cpg", errs () << "dropped cp: " << h->getName () << "\n");
+    }
+    
+    // -- ids follow the topological order as in the default selection
+    for (const BasicBlock *bb : topo)
+      if (cps.count (bb)) newCp (*bb);
+    m_numDefaultCps = loopCps;
+  }
+
+  void CutPointGraph::computeOrder (const Function &F, const TopologicalOrder &topo)
+  {
+    // -- with the default selection every back-edge enters a
+    // -- cut-point, and the topological order can be used as is
+    if (!MinCutPoints)
+    {
+      m_order.assign (topo.begin (), topo.end ());
+      return;
+    }
+    
+    DenseMap<const BasicBlock*, unsigned> indeg;
+    for (const BasicBlock *bb : topo) indeg [bb] = 0;
+    for (const BasicBlock *bb : topo)
+      for (const BasicBlock *succ : succs (*bb))
+        if (!isCutPoint (*succ) && indeg.count (succ)) ++indeg [succ];
+    
+    std::deque<const BasicBlock*> ready;
+    for (const BasicBlock *bb : topo)
+      if (indeg [bb] == 0) ready.push_back (bb);
+    
+    while (!ready.empty ())
+    {
+      const BasicBlock *bb = ready.front ();
+      ready.pop_front ();
+      m_order.push_back (bb);
+      for (const BasicBlock *succ : succs (*bb))
+      {
+        if (isCutPoint (*succ)) continue;
+        auto it = indeg.find (succ);
+        if (it != indeg.end () && --(it->second) == 0) ready.push_back (succ);
+      }
+    }
+    // -- the cut-points cut every cycle
+    assert (m_order.size () == indeg.size ());
   }
 
   void setbit (llvm::BitVector &b, unsigned idx)
@@ -78,61 +210,76 @@ namespace seahorn
     b.set (idx);
   }
 
-  void CutPointGraph::computeFwdReach (const Function &F, const TopologicalOrder &topo)
+  void CutPointGraph::computeFwdReach (const Function &F)
   {
-    for (auto it = topo.rbegin (), end = topo.rend (); it != end; ++it)
+    for (auto it = m_order.rbegin (), end = m_order.rend (); it != end; ++it)
     {
       const BasicBlock *bb = *it;
 
-      BitVector &r = m_fwd [bb];
+      BitVector r;
       for (const BasicBlock *succ : succs (*bb))
       {
         if (isCutPoint (*succ))
           setbit (r, getCp (*succ).id ());
         else
-          r |= m_fwd [succ];
+        {
+          auto f = m_fwd.find (succ);
+          if (f != m_fwd.end ()) r |= f->second;
+        }
       }
+      m_fwd [bb] = r;
     }
 
   }
 
-  void CutPointGraph::computeBwdReach (const Function &F, const TopologicalOrder &topo)
+  void CutPointGraph::computeBwdReach (const Function &F)
   {
-    for (const BasicBlock *bb : topo)
+    // -- blocks that are not cut-points are reached from their
+    // -- predecessors, all earlier in the order
+    for (const BasicBlock *bb : m_order)
     {
-      BitVector &r = m_bwd [bb];
-      const BasicBlock &BB = *bb;
+      if (isCutPoint (*bb)) continue;
+      
+      BitVector r;
       for (const BasicBlock *pred :
              boost::make_iterator_range (pred_begin (bb), pred_end (bb)))
       {
-        if (topo.isBackEdge (*pred, BB)) continue;
         if (isCutPoint (*pred))
           setbit (r, getCp (*pred).id ());
         else
-          r |= m_bwd [pred];
+        {
+          auto b = m_bwd.find (pred);
+          if (b != m_bwd.end ()) r |= b->second;
+        }
       }
+      m_bwd [bb] = r;
     }
 
     for (const CutPoint &cp : boost::make_iterator_range (begin (), end ()))
     {
       const BasicBlock *bb = &cp.bb ();
-      BitVector &r = m_bwd [bb];
+      BitVector r;
 
       for (const BasicBlock *pred :
              boost::make_iterator_range (pred_begin (bb), pred_end (bb)))
       {
-        if (! topo.isBackEdge (*pred, *bb)) continue;
         if (isCutPoint (*pred))
           setbit (r, getCp (*pred).id ());
         else
-          r |= m_bwd [pred];
+        {
+          auto b = m_bwd.find (pred);
+          if (b != m_bwd.end ()) r |= b->second;
+        }
       }
+      m_bwd [bb] = r;
     }
   }
 
-  void CutPointGraph::computeEdges (const Function &F, const TopologicalOrder &topo)
+  void CutPointGraph::computeEdges (const Function &F)
   {
-    for (const BasicBlock *bb : topo)
+    // -- first pass: create the edges and count their blocks
+    std::vector<unsigned> sizes;
+    for (const BasicBlock *bb : m_order)
     {
       if (isCutPoint (*bb))
       {
@@ -140,8 +287,8 @@ namespace seahorn
         CutPoint &cp = getCp (*bb);
         for (int i = r.find_first (); i >= 0; i = r.find_next (i))
         {
-          CpEdge &edg = newEdge (cp, *m_cps [i]);
-          edg.push_back (bb);
+          newEdge (cp, m_cps [i]);
+          sizes.push_back (1);
         }
       }
       else
@@ -151,30 +298,60 @@ namespace seahorn
 
         for (int i = b.find_first (); i >= 0; i = b.find_next (i))
           for (int j = f.find_first (); j >= 0; j = f.find_next (j))
-            getEdge (*m_cps [i], *m_cps [j])->push_back (bb);
+            ++sizes [getEdge (m_cps [i], m_cps [j])->id ()];
       }
+    }
 
+    // -- lay the edges out one after the other
+    unsigned total = 0;
+    std::vector<unsigned> next (sizes.size ());
+    for (unsigned i = 0; i < sizes.size (); ++i)
+    {
+      next [i] = total;
+      total += sizes [i];
     }
+    m_edgeBbs.resize (total);
+    
+    // -- second pass: fill in the blocks, in topological order
+    for (const BasicBlock *bb : m_order)
+    {
+      if (isCutPoint (*bb))
+      {
+        CutPoint &cp = getCp (*bb);
+        for (CpEdge *edg : boost::make_iterator_range (cp.succ_begin (), cp.succ_end ()))
+          m_edgeBbs [next [edg->id ()]++] = bb;
+      }
+      else
+      {
+        BitVector &b = m_bwd[bb];
+        BitVector &f = m_fwd[bb];
 
+        for (int i = b.find_first (); i >= 0; i = b.find_next (i))
+          for (int j = f.find_first (); j >= 0; j = f.find_next (j))
+            m_edgeBbs [next [getEdge (m_cps [i], m_cps [j])->id ()]++] = bb;
+      }
+    }
+    
+    for (CpEdge &edg : m_edges)
+    {
+      edg.m_end = m_edgeBbs.data () + next [edg.id ()];
+      edg.m_begin = edg.m_end - sizes [edg.id ()];
+    }
+    
+    // -- forward reachability is not needed once the edges are known
+    m_fwd.clear ();
   }
 
   CpEdge* CutPointGraph::getEdge (CutPoint &s, CutPoint &d)
   {
-    for (auto it = s.succ_begin (), end = s.succ_end (); it != end; ++it)
-    {
-      CpEdge *edg = *it;
-      if (&(edg->target ()) == &d) return edg;
-    }
-
-    return NULL;
+    auto it = m_edgeIds.find (std::make_pair (s.id (), d.id ()));
+    return it == m_edgeIds.end () ? NULL : &m_edges [it->second];
   }
 
   const CpEdge* CutPointGraph::getEdge (const CutPoint &s, const CutPoint &d) const
   {
-    for (const CpEdge *edg : boost::make_iterator_range (s.succ_begin (),
-                                                         s.succ_end ()))
-      if (&(edg->target ()) == &d) return edg;
-    return NULL;
+    auto it = m_edgeIds.find (std::make_pair (s.id (), d.id ()));
+    return it == m_edgeIds.end () ? NULL : &m_edges [it->second];
   }
 
   void CutPointGraph::print (raw_ostream &out, const Module *m) const
@@ -1,17 +1,24 @@
 #include "seahorn/Analysis/DSA/Cloner.hh"
 
+#include "llvm/Support/CommandLine.h"
+
+#include "boost/range/iterator_range.hpp"
+
 using namespace seahorn;
 using namespace seahorn::dsa;
 
+static llvm::cl::opt<bool>
+LazyClone ("sea-dsa-lazy-clone",
+           llvm::cl::desc ("DSA: clone only the nodes that do not unify with an existing node"),
+           llvm::cl::init (false));
+
 Node &Cloner::clone (const Node &n)
 {
   // -- don't clone nodes that are already in the graph
   if (n.getGraph() == &m_graph) return *const_cast<Node*> (&n);
   
   // check the cache
-  auto it = m_map.find (&n);
-  if (it != m_map.end ())
-    return *(it->second);
+  if (Node *c = findClone (n)) return *c;
 
   // -- clone the node (except for the links)
   Node &nNode = m_graph.cloneNode (n);
@@ -27,13 +34,104 @@ Node &Cloner::clone (const Node &n)
     // -- resolve any potential forwarding
     kv.second->getNode ();
     // recursively clone the node pointed by the link 
-    Cell nCell (&clone (*kv.second->getNode ()), kv.second->getOffset ());
-    // create new link
-    nNode.setLink (kv.first, nCell);
+    Cell nCell = cloneCell (*kv.second);
+    // create new link. A node collapsed by a budget has a single
+    // link that all the links are unified into
+    if (nNode.isCollapsed ()) nNode.addLink (kv.first, nCell);
+    else nNode.setLink (kv.first, nCell);
   }
   
-  // -- don't expect the new node to collapse
-  assert (!nNode.isForwarding ());
+  // -- don't expect the new node to collapse, unless it was
+  // -- collapsed by a budget
+  assert (!nNode.isForwarding () || nNode.getNode ()->isCollapsed ());
  
   return nNode;
 }
+
+Cell Cloner::cloneCell (const Cell &c)
+{
+  if (const Cell *e = findEmbed (*c.getNode ())) return Cell (*e, c.getOffset ());
+  return Cell (&clone (*c.getNode ()), c.getOffset ());
+}
+
+void Cloner::embed (const Node &n, const Cell &c, 
+                    std::vector<std::pair<Cell, Cell> > &work)
+{
+  // -- as in Node::pointTo, with n a clone
+  Node &dst = *c.getNode ();
+  unsigned offset = c.getOffset ();
+  m_embed.insert (std::make_pair (&n, Cell (dst, offset)));
+  
+  if (offset != 0 || n.getUniqueScalar () != dst.getUniqueScalar ())
+    dst.setUniqueScalar (nullptr);
+  if (n.size () + offset > dst.size ()) dst.growSize (n.size () + offset);
+  dst.joinTypes (offset, n);
+  
+  // -- adding types can collapse dst
+  Cell base (dst, offset);
+  base.getNode ()->m_nodeType.join (n.m_nodeType);
+  base.getNode ()->joinAllocSites (n.m_alloca_sites);
+  
+  for (auto &kv : n.links ())
+  {
+    if (kv.second->isNull ()) continue;
+    if (base.hasLink (kv.first))
+      work.push_back (std::make_pair (*kv.second, base.getLink (kv.first)));
+    else
+      base.setLink (kv.first, cloneCell (*kv.second));
+  }
+}
+
+void Cloner::unifyClone (const Cell &src, Cell &dst)
+{
+  if (!LazyClone || dst.isNull ())
+  {
+    Node &n = clone (*src.getNode ());
+    Cell c (n, src.getOffset ());
+    dst.unify (c);
+    return;
+  }
+  
+  // -- pairs of a cell to clone and the cell of the graph it
+  // -- unifies with
+  std::vector<std::pair<Cell, Cell> > work;
+  work.push_back (std::make_pair (src, dst));
+  while (!work.empty ())
+  {
+    Cell s = work.back ().first;
+    Cell d = work.back ().second;
+    work.pop_back ();
+    
+    const Node &sn = *s.getNode ();
+    const Node &dn = *d.getNode ();
+    bool plain = !sn.isArray () && !sn.isCollapsed () && 
+      !dn.isArray () && !dn.isCollapsed ();
+    
+    // -- embed sn into dn when unification would move it there
+    // -- unchanged. Anything else goes through a real clone
+    if (sn.getGraph () != &m_graph && !hasNode (sn) && !findEmbed (sn) && 
+        plain && d.getOffset () >= s.getOffset ())
+    {
+      embed (sn, Cell (*d.getNode (), d.getOffset () - s.getOffset ()), work);
+      continue;
+    }
+    
+    Cell c = cloneCell (s);
+    d.unify (c);
+  }
+}
+
+const Cloner &BatchCloner::globals (const Graph &callee)
+{
+  std::unique_ptr<Cloner> &C = m_globals [&callee];
+  if (C) return *C;
+  
+  C.reset (new Cloner (m_graph));
+  for (auto &kv : boost::make_iterator_range (callee.globals_begin (),
+                                              callee.globals_end ()))
+  {
+    Cell &nc = m_graph.mkCell (*kv.first, Cell ());
+    C->unifyClone (*kv.second, nc);
+  }
+  return *C;
+}
@@ -4,12 +4,19 @@
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/ADT/SmallString.h"
 
 #include "seahorn/Analysis/DSA/Info.hh"
 #include "seahorn/Analysis/DSA/Global.hh"
 #include "seahorn/Analysis/DSA/DsaAnalysis.hh"
+#include "seahorn/Analysis/DSA/Cache.hh"
 
 #include "ufo/Passes/NameValues.hpp"
+#include "ufo/Stats.hh"
 
 using namespace seahorn::dsa;
 using namespace llvm;
@@ -29,6 +36,39 @@ PrintDsaStats ("horn-dsa-stats",
                llvm::cl::desc ("Print dsa statistics"), 
                llvm::cl::init(false));
 
+static llvm::cl::opt<bool>
+DsaCache ("sea-dsa-cache",
+          llvm::cl::desc ("DSA: read the graphs from, or write them to, "
+                          "a file next to the bitcode"),
+          llvm::cl::init (false));
+
+// name of the cache file of M. Empty if M was not read from a file
+static std::string getDsaCacheFile (const Module &M)
+{
+  StringRef id = M.getModuleIdentifier ();
+  if (id.empty () || id == "-" || id == "<stdin>") return "";
+  return (id + ".dsa").str ();
+}
+
+// key of the graphs of M: a hash of its bitcode and of the kind of
+// global analysis
+static std::string getDsaCacheKey (const Module &M)
+{
+  SmallString<4096> bc;
+  {
+    raw_svector_ostream out (bc);
+    WriteBitcodeToFile (&M, out);
+  }
+  llvm::MD5 hash;
+  hash.update (bc.str ());
+  hash.update (DsaCsGlobalAnalysis ? "cs" : "ci");
+  llvm::MD5::MD5Result res;
+  hash.final (res);
+  SmallString<32> str;
+  llvm::MD5::stringifyResult (res, str);
+  return str.str ().str ();
+}
+
 void DsaAnalysis::getAnalysisUsage (AnalysisUsage &AU) const 
 {
   AU.addRequired<DataLayoutPass> ();
@@ -45,19 +85,57 @@ bool DsaAnalysis::runOnModule (Module &M)
   auto &tli = getAnalysis<TargetLibraryInfo> ();
   auto &cg = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
 
-  if (DsaCsGlobalAnalysis)
-    m_ga.reset (new ContextSensitiveGlobalAnalysis (dl, tli, cg, m_setFactory));
-  else 
-    m_ga.reset (new ContextInsensitiveGlobalAnalysis (dl, tli, cg, m_setFactory));
-  
-  m_ga->runOnModule (M);
+  std::string cacheFile, cacheKey;
+  if (DsaCache)
+  {
+    cacheFile = getDsaCacheFile (M);
+    if (!cacheFile.empty ()) cacheKey = getDsaCacheKey (M);
+  }
 
-  if (ComputeDsaInfo || PrintDsaStats)
+  bool loaded = false;
+  if (!cacheKey.empty ())
   {
-    m_ia.reset (new InfoAnalysis (dl, tli, *m_ga, !PrintDsaStats));  
-    m_ia->runOnModule (M);
+    auto buf = MemoryBuffer::getFile (cacheFile);
+    if (buf)
+    {
+      std::unique_ptr<CachedGlobalAnalysis> cached
+        (new CachedGlobalAnalysis (dl, m_setFactory,
+                                   (*buf)->getBuffer (), cacheKey));
+      cached->runOnModule (M);
+      loaded = cached->isLoaded ();
+      if (loaded) m_ga = std::move (cached);
+    }
+    ufo::Stats::sset ("DsaCache", loaded ? "hit" : "miss");
   }
 
+  if (!loaded)
+  {
+    if (DsaCsGlobalAnalysis)
+      m_ga.reset (new ContextSensitiveGlobalAnalysis (dl, tli, cg, m_setFactory));
+    else 
+      m_ga.reset (new ContextInsensitiveGlobalAnalysis (dl, tli, cg, m_setFactory));
+
+    m_ga->runOnModule (M);
+
+    if (!cacheKey.empty ())
+    {
+      std::string graphs;
+      raw_string_ostream out (graphs);
+      if (writeGraphs (M, *m_ga, cacheKey, out))
+      {
+        std::error_code EC;
+        raw_fd_ostream file (cacheFile, EC, sys::fs::F_None);
+        if (!EC) file << out.str ();
+      }
+    }
+  }
+
+  // -- the info analysis is recomputed from cached graphs as well.
+  // -- Unless requested, it is computed on the first client query
+  bool eager = ComputeDsaInfo || PrintDsaStats;
+  m_ia.reset (new InfoAnalysis (dl, tli, *m_ga, eager && !PrintDsaStats, !eager));
+  m_ia->runOnModule (M);
+
   return false;
 }
 
@@ -10,6 +10,7 @@
 #include "llvm/PassManager.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
 #include "seahorn/Analysis/DSA/Graph.hh"
@@ -17,12 +18,25 @@
 #include "seahorn/Analysis/DSA/Local.hh"
 #include "seahorn/Analysis/DSA/CallSite.hh"
 #include "seahorn/Analysis/DSA/Cloner.hh"
+#include "seahorn/Analysis/DSA/Cache.hh"
 
 #include "avy/AvyDebug.h"
 
 #include "boost/range/iterator_range.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
 using namespace llvm;
 
+static llvm::cl::opt<bool>
+SpillGraphs ("sea-dsa-bu-spill",
+             llvm::cl::desc ("DSA: write the bottom-up graph of a function to a "
+                             "temporary file once all its callers are analyzed, "
+                             "and read it back on demand"),
+             llvm::cl::init (false));
+
 namespace seahorn
 {
   namespace dsa
@@ -32,26 +46,24 @@ namespace seahorn
     void BottomUpAnalysis::
     cloneAndResolveArguments (const DsaCallSite &CS, Graph& calleeG, Graph& callerG)
     {      
-      Cloner C (callerG);
-      
-      // clone and unify globals 
-      for (auto &kv : boost::make_iterator_range (calleeG.globals_begin (),
-                                                  calleeG.globals_end ()))
-      {          
-        Node &n = C.clone (*kv.second->getNode ());
-        Cell c (n, kv.second->getOffset ());
-        Cell &nc = callerG.mkCell (*kv.first, Cell ());
-        nc.unify (c);
-      }
+      BatchCloner batch (callerG);
+      cloneAndResolveArguments (CS, calleeG, batch);
+      batch.finish ();
+    }
+
+    void BottomUpAnalysis::
+    cloneAndResolveArguments (const DsaCallSite &CS, Graph& calleeG, BatchCloner &batch)
+    {      
+      Graph &callerG = batch.graph ();
+      // -- globals are cloned and unified once per callee
+      Cloner C (callerG, batch.globals (calleeG));
 
       // clone and unify return
       const Function &callee = *CS.getCallee ();
       if (calleeG.hasRetCell (callee))
       {
-        Node &n = C.clone (*calleeG.getRetCell (callee).getNode ());
-        Cell c (n, calleeG.getRetCell (callee).getOffset ());
         Cell &nc = callerG.mkCell (*CS.getInstruction (), Cell());
-        nc.unify (c);
+        C.unifyClone (calleeG.getRetCell (callee), nc);
       }
 
       // clone and unify actuals and formals
@@ -63,112 +75,285 @@ namespace seahorn
         const Value *fml = &*FI;
         if (calleeG.hasCell (*fml))
         {
-          Node &n = C.clone (*calleeG.getCell (*fml).getNode ());
-          Cell c (n, calleeG.getCell (*fml).getOffset ());
           Cell &nc = callerG.mkCell (*arg, Cell ());
-          nc.unify (c);
+          C.unifyClone (calleeG.getCell (*fml), nc);
         }
       }
-
-      callerG.compress();
     }
 
-    bool BottomUpAnalysis::runOnModule(Module &M, GraphMap &graphs) 
+    void BottomUpAnalysis::processScc (const std::vector<CallGraphNode*> &scc,
+                                       LocalAnalysis &la, GraphMap &graphs)
     {
+      // -- compute a local graph shared between all functions in the scc
+      GraphRef fGraph = nullptr;
+      for (CallGraphNode *cgn : scc)
+      {
+        Function *fn = cgn->getFunction ();
+        if (!fn || fn->isDeclaration () || fn->empty ()) continue;
 
-      LOG("dsa-bu", errs () << "Started bottom-up analysis ... \n");
+        if (!fGraph) {
+          assert (graphs.find(fn) != graphs.end());
+          fGraph = graphs[fn];
+          assert (fGraph);
+        }
 
-      LocalAnalysis la (m_dl, m_tli);
+        la.runOnFunction (*fn, *fGraph);
+        graphs[fn] = fGraph;
+      }
 
-      for (auto it = scc_begin (&m_cg); !it.isAtEnd (); ++it)
+      for (CallGraphNode *cgn : scc)
       {
-        auto &scc = *it;
+        Function *fn = cgn->getFunction ();
+        if (!fn || fn->isDeclaration () || fn->empty ()) continue;
 
-        // -- compute a local graph shared between all functions in the scc
-        GraphRef fGraph = nullptr;
-        for (CallGraphNode *cgn : scc)
+        // -- resolve all function calls in the SCC. All call sites of
+        // -- fn are cloned in one batch, and the graph is compressed once
+        BatchCloner batch (*graphs.find (fn)->second);
+        for (auto &callRecord : *cgn)
         {
-          Function *fn = cgn->getFunction ();
-          if (!fn || fn->isDeclaration () || fn->empty ()) continue;
-
-          if (!fGraph) {
-            assert (graphs.find(fn) != graphs.end());
-            fGraph = graphs[fn];
-            assert (fGraph);
-          }
-
-          la.runOnFunction (*fn, *fGraph);
-          graphs[fn] = fGraph;
+          ImmutableCallSite CS (callRecord.first);
+          DsaCallSite dsaCS (CS);
+          const Function *callee = dsaCS.getCallee ();
+          if (!callee || callee->isDeclaration () || callee->empty ()) continue;
+            
+          assert (graphs.count (dsaCS.getCaller ()) > 0);
+          assert (graphs.count (dsaCS.getCallee ()) > 0);
+      
+          Graph &calleeG = *(graphs.find (dsaCS.getCallee())->second);
+  
+          cloneAndResolveArguments (dsaCS, calleeG, batch);
         }
+        batch.finish ();
 
-        for (CallGraphNode *cgn : scc)
+        // -- store the simulation maps from the SCC
+        for (auto &callRecord : *cgn)
         {
-          Function *fn = cgn->getFunction ();
-          if (!fn || fn->isDeclaration () || fn->empty ()) continue;
-
-          // -- resolve all function calls in the SCC
-          for (auto &callRecord : *cgn)
-          {
-            ImmutableCallSite CS (callRecord.first);
-            DsaCallSite dsaCS (CS);
-            const Function *callee = dsaCS.getCallee ();
-            if (!callee || callee->isDeclaration () || callee->empty ()) continue;
+          ImmutableCallSite CS (callRecord.first);
+          DsaCallSite dsaCS (CS);
+          const Function *callee = dsaCS.getCallee ();
+          if (!callee || callee->isDeclaration () || callee->empty ()) continue;
             
-            assert (graphs.count (dsaCS.getCaller ()) > 0);
-            assert (graphs.count (dsaCS.getCallee ()) > 0);
+          assert (graphs.count (dsaCS.getCaller ()) > 0);
+          assert (graphs.count (dsaCS.getCallee ()) > 0);
       
-            Graph &callerG = *(graphs.find (dsaCS.getCaller())->second);
-            Graph &calleeG = *(graphs.find (dsaCS.getCallee())->second);
+          Graph &callerG = *(graphs.find (dsaCS.getCaller())->second);
+          Graph &calleeG = *(graphs.find (dsaCS.getCallee())->second);
   
-            cloneAndResolveArguments (dsaCS, calleeG, callerG);
-          }
+          SimulationMapperRef sm (new SimulationMapper());
+          bool res = Graph::computeCalleeCallerMapping(dsaCS, calleeG, callerG, 
+                                                       true  /*only modified nodes*/, 
+                                                       true, /*report if sanity check failed*/
+                                                       *sm);
+          if (!res) errs () << "WARNING " 
+                            << *(dsaCS.getInstruction())  << ": "
+                            << "caller does not simulate callee\n";
+          assert (res);
+          if (!m_spill)
+            m_callee_caller_map.insert(std::make_pair(dsaCS.getInstruction(), sm));
+        }
+
+      }
 
-          // -- store the simulation maps from the SCC
+      if (fGraph) fGraph->compress();        
+    }
+
+    void BottomUpAnalysis::release (const std::vector<CallGraphNode*> &scc,
+                                    GraphMap &graphs)
+    {
+      std::vector<const Function*> fns;
+      for (CallGraphNode *cgn : scc)
+      {
+        Function *fn = cgn->getFunction ();
+        if (!fn || fn->isDeclaration () || fn->empty ()) continue;
+        auto it = graphs.find (fn);
+        if (it != graphs.end () && it->second) fns.push_back (fn);
+      }
+      if (fns.empty () || !m_spill->spill (fns, *graphs [fns [0]])) return;
+      for (const Function *fn : fns) graphs [fn].reset ();
+    }
+
+    struct BottomUpAnalysis::SccDag
+    {
+      std::vector<std::vector<CallGraphNode*> > sccs;
+      /// for each SCC, the SCCs that call into it, once per call
+      std::vector<std::vector<unsigned> > callers;
+    };
+
+    void BottomUpAnalysis::buildSccDag (SccDag &dag)
+    {
+      DenseMap<const CallGraphNode*, unsigned> sccOf;
+      for (auto it = scc_begin (&m_cg); !it.isAtEnd (); ++it)
+      {
+        unsigned id = dag.sccs.size ();
+        dag.sccs.push_back (*it);
+        dag.callers.push_back (std::vector<unsigned> ());
+        for (CallGraphNode *cgn : dag.sccs.back ()) sccOf [cgn] = id;
+        
+        for (CallGraphNode *cgn : dag.sccs.back ())
           for (auto &callRecord : *cgn)
           {
-            ImmutableCallSite CS (callRecord.first);
-            DsaCallSite dsaCS (CS);
-            const Function *callee = dsaCS.getCallee ();
-            if (!callee || callee->isDeclaration () || callee->empty ()) continue;
-            
-            assert (graphs.count (dsaCS.getCaller ()) > 0);
-            assert (graphs.count (dsaCS.getCallee ()) > 0);
-      
-            Graph &callerG = *(graphs.find (dsaCS.getCaller())->second);
-            Graph &calleeG = *(graphs.find (dsaCS.getCallee())->second);
-  
-            SimulationMapperRef sm (new SimulationMapper());
-            bool res = Graph::computeCalleeCallerMapping(dsaCS, calleeG, callerG, 
-                                                         true  /*only modified nodes*/, 
-                                                         true, /*report if sanity check failed*/
-                                                         *sm);
-            if (!res) errs () << "WARNING " 
-                              << *(dsaCS.getInstruction())  << ": "
-                              << "caller does not simulate callee\n";
-            assert (res);
-            m_callee_caller_map.insert(std::make_pair(dsaCS.getInstruction(), sm));
+            auto c = sccOf.find (callRecord.second);
+            if (c == sccOf.end () || c->second == id) continue;
+            dag.callers [c->second].push_back (id);
           }
+      }
+    }
 
-        }
+    void BottomUpAnalysis::processSccs (const SccDag &dag,
+                                        const std::vector<bool> &todo,
+                                        GraphMap &graphs)
+    {
+      LocalAnalysis la (m_dl, m_tli);
+      {
+        // -- local graphs need nothing from other functions
+        std::vector<Function*> fns;
+        for (unsigned i = 0; i < dag.sccs.size (); ++i)
+          if (todo [i])
+            for (CallGraphNode *cgn : dag.sccs [i])
+            {
+              Function *fn = cgn->getFunction ();
+              if (fn && !fn->isDeclaration () && !fn->empty ()) fns.push_back (fn);
+            }
+        if (!fns.empty ()) la.precompute (fns);
+      }
+
+      std::vector<unsigned> pending (dag.sccs.size (), 0);
+      for (unsigned i = 0; i < dag.sccs.size (); ++i)
+        if (todo [i])
+          for (unsigned c : dag.callers [i])
+            if (todo [c]) ++pending [c];
 
-        if (fGraph) fGraph->compress();        
+      // -- with a spill, the callers of every SCC still to process, and
+      // -- the SCCs every SCC calls
+      std::vector<unsigned> unprocessed (dag.sccs.size (), 0);
+      std::vector<std::vector<unsigned> > callees;
+      if (m_spill)
+      {
+        callees.resize (dag.sccs.size ());
+        for (unsigned i = 0; i < dag.sccs.size (); ++i)
+          if (todo [i])
+            for (unsigned c : dag.callers [i])
+              if (todo [c])
+              {
+                ++unprocessed [i];
+                callees [c].push_back (i);
+              }
       }
+      
+      // -- an SCC is ready once all the SCCs it calls are done. A ready
+      // -- SCC only writes its own graph and reads the graphs of its
+      // -- callees, which are final. The graphs share one type set
+      // -- factory, which is not thread-safe, so ready SCCs are still
+      // -- processed one at a time
+      std::deque<unsigned> ready;
+      for (unsigned i = 0; i < dag.sccs.size (); ++i)
+        if (todo [i] && pending [i] == 0) ready.push_back (i);
+      
+      unsigned width = 0;
+      unsigned done = 0;
+      while (!ready.empty ())
+      {
+        width = std::max<unsigned> (width, ready.size ());
+        unsigned id = ready.front ();
+        ready.pop_front ();
+        
+        processScc (dag.sccs [id], la, graphs);
+        ++done;
+
+        // -- a graph is only read by its callers
+        if (m_spill)
+        {
+          if (unprocessed [id] == 0) release (dag.sccs [id], graphs);
+          for (unsigned c : callees [id])
+            if (--unprocessed [c] == 0) release (dag.sccs [c], graphs);
+        }
+        
+        for (unsigned c : dag.callers [id])
+          if (todo [c] && --pending [c] == 0) ready.push_back (c);
+      }
+      LOG ("dsa-bu", errs () << "SCCs: " << dag.sccs.size () 
+           << ", processed: " << done
+           << ", most ready at once: " << width << "\n");
 
       LOG ("dsa-bu-graph", 
            for (auto &kv : graphs) 
            {
+             if (!kv.second) continue;
              errs () << "### Bottom-up Dsa graph for " << kv.first->getName () << "\n";
              kv.second->write (errs ());
              errs () << "\n";
            });
+    }
+
+    bool BottomUpAnalysis::runOnModule(Module &M, GraphMap &graphs) 
+    {
+
+      LOG("dsa-bu", errs () << "Started bottom-up analysis ... \n");
+
+      SccDag dag;
+      buildSccDag (dag);
+      processSccs (dag, std::vector<bool> (dag.sccs.size (), true), graphs);
       
       LOG("dsa-bu", errs () << "Finished bottom-up analysis\n");
       return false;
     }
 
+    bool BottomUpAnalysis::update (Module &M, const FunctionSet &changed,
+                                   GraphMap &graphs, Graph::SetFactory &sf)
+    {
+      LOG("dsa-bu", errs () << "Started incremental bottom-up analysis ... \n");
+
+      // -- forget the graphs of functions that are gone
+      FunctionSet live;
+      for (auto &F : M) live.insert (&F);
+      std::vector<const Function*> dead;
+      for (auto &kv : graphs)
+        if (!live.count (kv.first)) dead.push_back (kv.first);
+      for (const Function *F : dead) graphs.erase (F);
+
+      SccDag dag;
+      buildSccDag (dag);
+
+      // -- an SCC is recomputed if one of its functions changed or has
+      // -- no graph, or if it calls a recomputed SCC. Callers come
+      // -- after their callees
+      std::vector<bool> todo (dag.sccs.size (), false);
+      for (unsigned i = 0; i < dag.sccs.size (); ++i)
+      {
+        for (CallGraphNode *cgn : dag.sccs [i])
+        {
+          Function *fn = cgn->getFunction ();
+          if (!fn || fn->isDeclaration () || fn->empty ()) continue;
+          if (changed.count (fn) || !graphs.count (fn)) todo [i] = true;
+        }
+        if (todo [i])
+          for (unsigned c : dag.callers [i]) todo [c] = true;
+      }
+
+      // -- recomputed SCCs start from empty graphs
+      for (unsigned i = 0; i < dag.sccs.size (); ++i)
+      {
+        if (!todo [i]) continue;
+        for (CallGraphNode *cgn : dag.sccs [i])
+        {
+          Function *fn = cgn->getFunction ();
+          if (!fn || fn->isDeclaration () || fn->empty ()) continue;
+          graphs [fn] = std::make_shared<Graph> (m_dl, sf);
+        }
+      }
+
+      m_callee_caller_map.clear ();
+      processSccs (dag, todo, graphs);
+
+      LOG("dsa-bu", errs () << "Finished incremental bottom-up analysis\n");
+      return false;
+    }
+
   
     BottomUp::BottomUp () 
       : ModulePass (ID), m_dl (nullptr), m_tli (nullptr)  {}
+
+    BottomUp::~BottomUp () {}
           
     void BottomUp::getAnalysisUsage (AnalysisUsage &AU) const 
     {
@@ -185,6 +370,11 @@ namespace seahorn
       CallGraph &cg = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
 
       BottomUpAnalysis bu (*m_dl, *m_tli, cg);
+      if (SpillGraphs)
+      {
+        m_spill.reset (new GraphSpill (M, *m_dl, m_setFactory));
+        bu.setSpill (m_spill.get ());
+      }
       for (auto &F: M)
       { // XXX: the graphs must be created here
         if (F.isDeclaration() || F.empty())
@@ -198,7 +388,11 @@ namespace seahorn
     }
 
     Graph &BottomUp::getGraph (const Function &F) const
-    { return *(m_graphs.find (&F)->second); }
+    { 
+      GraphRef &g = m_graphs.find (&F)->second;
+      if (!g && m_spill) m_spill->reload (F, m_graphs);
+      return *(m_graphs.find (&F)->second); 
+    }
 
     bool BottomUp::hasGraph (const Function &F) const
     { return m_graphs.count (&F) > 0; }
@@ -0,0 +1,591 @@
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "seahorn/Analysis/DSA/Cache.hh"
+
+#include "boost/range/iterator_range.hpp"
+
+#include "ufo/Stats.hh"
+
+#include "avy/AvyDebug.h"
+
+using namespace llvm;
+
+namespace seahorn
+{
+  namespace dsa
+  {
+    /// -- bump when the format changes
+    static const char CacheMagic[] = "SEADSA01";
+
+    /// Positions of the values and types of a module. Two identical
+    /// modules number their values and types in the same way
+    class ModuleIndex
+    {
+      std::vector<const Value*> m_values;
+      DenseMap<const Value*, unsigned> m_valueIds;
+      std::vector<Type*> m_types;
+      DenseMap<const Type*, unsigned> m_typeIds;
+
+      void addType (Type *ty)
+      {
+        std::vector<Type*> stack (1, ty);
+        while (!stack.empty ())
+        {
+          Type *t = stack.back ();
+          stack.pop_back ();
+          if (!m_typeIds.insert (std::make_pair (t, m_types.size ())).second)
+            continue;
+          m_types.push_back (t);
+          for (Type *sub : boost::make_iterator_range (t->subtype_begin (),
+                                                       t->subtype_end ()))
+            stack.push_back (sub);
+        }
+      }
+
+      void addValue (const Value &v)
+      {
+        if (!m_valueIds.insert (std::make_pair (&v, m_values.size ())).second)
+          return;
+        m_values.push_back (&v);
+        addType (v.getType ());
+      }
+
+      /// the constants built from c, e.g., the operands of a constant GEP
+      void addConstant (const Constant &c)
+      {
+        std::vector<const Constant*> stack (1, &c);
+        while (!stack.empty ())
+        {
+          const Constant *k = stack.back ();
+          stack.pop_back ();
+          if (m_valueIds.count (k)) continue;
+          addValue (*k);
+          for (const Use &u : k->operands ())
+            if (const Constant *op = dyn_cast<Constant> (u.get ()))
+              stack.push_back (op);
+        }
+      }
+
+    public:
+      ModuleIndex (const Module &M)
+      {
+        for (const GlobalVariable &gv :
+               boost::make_iterator_range (M.global_begin (), M.global_end ()))
+          addValue (gv);
+        for (const Function &F : M) addValue (F);
+        for (const GlobalAlias &ga :
+               boost::make_iterator_range (M.alias_begin (), M.alias_end ()))
+          addValue (ga);
+
+        for (const GlobalVariable &gv :
+               boost::make_iterator_range (M.global_begin (), M.global_end ()))
+          if (gv.hasInitializer ()) addConstant (*gv.getInitializer ());
+        for (const GlobalAlias &ga :
+               boost::make_iterator_range (M.alias_begin (), M.alias_end ()))
+          if (ga.getAliasee ()) addConstant (*ga.getAliasee ());
+
+        for (const Function &F : M)
+        {
+          for (const Argument &a :
+                 boost::make_iterator_range (F.arg_begin (), F.arg_end ()))
+            addValue (a);
+          for (const BasicBlock &bb : F)
+            for (const Instruction &I : bb)
+            {
+              addValue (I);
+              for (const Use &u : I.operands ())
+                if (const Constant *c = dyn_cast<Constant> (u.get ()))
+                  addConstant (*c);
+            }
+        }
+      }
+
+      /// the position of v plus one, 0 if v has no position
+      unsigned value (const Value *v) const
+      {
+        auto it = m_valueIds.find (v);
+        return it == m_valueIds.end () ? 0 : it->second + 1;
+      }
+      unsigned type (const Type *t) const
+      {
+        auto it = m_typeIds.find (t);
+        return it == m_typeIds.end () ? 0 : it->second + 1;
+      }
+
+      /// inverse of value () and type (). Null if id is out of range
+      const Value *value (uint64_t id) const
+      { return id > 0 && id <= m_values.size () ? m_values [id - 1] : nullptr; }
+      Type *type (uint64_t id) const
+      { return id > 0 && id <= m_types.size () ? m_types [id - 1] : nullptr; }
+    };
+
+    /// Reads the integers written by encodeULEB128
+    class CacheReader
+    {
+      const uint8_t *m_cur;
+      const uint8_t *m_end;
+      bool m_error;
+
+    public:
+      CacheReader (StringRef data) :
+        m_cur (reinterpret_cast<const uint8_t*> (data.begin ())),
+        m_end (reinterpret_cast<const uint8_t*> (data.end ())),
+        m_error (false) {}
+
+      bool error () const { return m_error; }
+      bool atEnd () const { return m_cur == m_end; }
+
+      uint64_t read ()
+      {
+        if (m_error) return 0;
+        // -- a ULEB128 integer ends at the first byte without the high bit
+        const uint8_t *p = m_cur;
+        while (p != m_end && (*p & 0x80)) ++p;
+        if (p == m_end || p - m_cur >= 10) { m_error = true; return 0; }
+        unsigned n = 0;
+        uint64_t res = decodeULEB128 (m_cur, &n);
+        m_cur += n;
+        return res;
+      }
+
+      StringRef readString ()
+      {
+        uint64_t sz = read ();
+        if (m_error || sz > (uint64_t)(m_end - m_cur))
+        { m_error = true; return StringRef (); }
+        StringRef res (reinterpret_cast<const char*> (m_cur), sz);
+        m_cur += sz;
+        return res;
+      }
+    };
+
+    /// Writes and reads a single graph. A friend of Graph and Node
+    class CacheIO
+    {
+      static void writeString (StringRef s, raw_ostream &o)
+      {
+        encodeULEB128 (s.size (), o);
+        o << s;
+      }
+
+      static uint64_t packType (const Node::NodeType &t)
+      {
+        uint64_t res = 0;
+        unsigned i = 0;
+        for (unsigned bit : {t.shadow, t.alloca, t.heap, t.global, t.externFunc,
+                             t.externGlobal, t.unknown, t.incomplete, t.modified,
+                             t.read, t.array, t.collapsed, t.external,
+                             t.inttoptr, t.ptrtoint, t.vastart, t.dead})
+          res |= (uint64_t)bit << i++;
+        return res;
+      }
+
+      static void unpackType (uint64_t v, Node::NodeType &t)
+      {
+        unsigned i = 0;
+        auto bit = [&] () { return (unsigned)((v >> i++) & 1); };
+        t.shadow = bit (); t.alloca = bit (); t.heap = bit ();
+        t.global = bit (); t.externFunc = bit (); t.externGlobal = bit ();
+        t.unknown = bit (); t.incomplete = bit (); t.modified = bit ();
+        t.read = bit (); t.array = bit (); t.collapsed = bit ();
+        t.external = bit (); t.inttoptr = bit (); t.ptrtoint = bit ();
+        t.vastart = bit (); t.dead = bit ();
+      }
+
+    public:
+
+      typedef DenseMap<const Node*, unsigned> NodeIds;
+
+      /// writes the node of c as its position plus one, 0 for none
+      static bool writeCell (const Cell &c, const NodeIds &ids, raw_ostream &o)
+      {
+        if (c.isNull ())
+        {
+          encodeULEB128 (0, o);
+          encodeULEB128 (0, o);
+          return true;
+        }
+        const Node *n = c.getNode ();
+        auto it = ids.find (n);
+        if (it == ids.end ()) return false;
+        encodeULEB128 (it->second + 1, o);
+        encodeULEB128 (c.getOffset (), o);
+        return true;
+      }
+
+      static bool readCell (CacheReader &in, const std::vector<Node*> &nodes,
+                            Cell &c)
+      {
+        uint64_t n = in.read ();
+        uint64_t offset = in.read ();
+        if (in.error () || n > nodes.size ()) return false;
+        c = n == 0 ? Cell () : Cell (nodes [n - 1], offset);
+        return true;
+      }
+
+      static bool write (const ModuleIndex &idx, const Graph &g, raw_ostream &o)
+      {
+        NodeIds ids;
+        std::vector<const Node*> nodes;
+        for (const Node &n : g)
+        {
+          if (n.isForwarding ()) continue;
+          ids [&n] = nodes.size ();
+          nodes.push_back (&n);
+        }
+
+        encodeULEB128 (nodes.size (), o);
+        for (const Node *n : nodes)
+        {
+          encodeULEB128 (n->m_id, o);
+          encodeULEB128 (packType (n->m_nodeType), o);
+          encodeULEB128 (n->m_size, o);
+          encodeULEB128 (n->m_has_unique_scalar, o);
+          unsigned scalar = 0;
+          if (n->m_unique_scalar)
+          {
+            scalar = idx.value (n->m_unique_scalar);
+            if (!scalar) return false;
+          }
+          encodeULEB128 (scalar, o);
+
+          encodeULEB128 (n->m_types.size (), o);
+          for (auto &kv : n->m_types)
+          {
+            encodeULEB128 (kv.first, o);
+            std::vector<unsigned> tys;
+            for (const Type *t : kv.second)
+            {
+              tys.push_back (idx.type (t));
+              if (!tys.back ()) return false;
+            }
+            encodeULEB128 (tys.size (), o);
+            for (unsigned t : tys) encodeULEB128 (t, o);
+          }
+
+          encodeULEB128 (n->m_links.size (), o);
+          for (auto &kv : n->m_links)
+          {
+            encodeULEB128 (kv.first, o);
+            if (!writeCell (*kv.second, ids, o)) return false;
+          }
+
+          encodeULEB128 (n->m_alloca_sites.size (), o);
+          for (const Value *v : n->m_alloca_sites)
+          {
+            unsigned id = idx.value (v);
+            if (!id) return false;
+            encodeULEB128 (id, o);
+          }
+        }
+
+        // -- the scalars, formals and returns, keyed by value
+        encodeULEB128 (g.m_values.size (), o);
+        for (auto &kv : g.m_values)
+        {
+          unsigned id = idx.value (kv.first);
+          if (!id) return false;
+          encodeULEB128 (id, o);
+          if (!writeCell (*kv.second, ids, o)) return false;
+        }
+        encodeULEB128 (g.m_formals.size (), o);
+        for (auto &kv : g.m_formals)
+        {
+          unsigned id = idx.value (kv.first);
+          if (!id) return false;
+          encodeULEB128 (id, o);
+          if (!writeCell (*kv.second, ids, o)) return false;
+        }
+        encodeULEB128 (g.m_returns.size (), o);
+        for (auto &kv : g.m_returns)
+        {
+          unsigned id = idx.value (kv.first);
+          if (!id) return false;
+          encodeULEB128 (id, o);
+          if (!writeCell (*kv.second, ids, o)) return false;
+        }
+        return true;
+      }
+
+      static bool read (const ModuleIndex &idx, CacheReader &in, Graph &g)
+      {
+        uint64_t numNodes = in.read ();
+        if (in.error ()) return false;
+        std::vector<Node*> nodes;
+        nodes.reserve (numNodes);
+        for (uint64_t i = 0; i < numNodes; ++i) nodes.push_back (&g.mkNode ());
+
+        for (Node *n : nodes)
+        {
+          n->m_id = in.read ();
+          // -- nodes created later get fresh ids
+          if (Node::m_id_factory < n->m_id) Node::m_id_factory = n->m_id;
+          unpackType (in.read (), n->m_nodeType);
+          n->m_size = in.read ();
+          n->m_has_unique_scalar = in.read ();
+          if (uint64_t scalar = in.read ())
+          {
+            n->m_unique_scalar = idx.value (scalar);
+            if (!n->m_unique_scalar) return false;
+          }
+
+          uint64_t numTypes = in.read ();
+          for (uint64_t i = 0; i < numTypes && !in.error (); ++i)
+          {
+            unsigned offset = in.read ();
+            Graph::Set s = g.emptySet ();
+            uint64_t sz = in.read ();
+            for (uint64_t j = 0; j < sz && !in.error (); ++j)
+            {
+              Type *t = idx.type (in.read ());
+              if (!t) return false;
+              s = g.mkSet (s, t);
+            }
+            n->m_types [offset] = s;
+          }
+
+          uint64_t numLinks = in.read ();
+          for (uint64_t i = 0; i < numLinks && !in.error (); ++i)
+          {
+            unsigned offset = in.read ();
+            Cell c;
+            if (!readCell (in, nodes, c)) return false;
+            n->m_links [offset].reset (new Cell (c));
+          }
+
+          uint64_t numSites = in.read ();
+          for (uint64_t i = 0; i < numSites && !in.error (); ++i)
+          {
+            const Value *v = idx.value (in.read ());
+            if (!v) return false;
+            n->m_alloca_sites.insert (v);
+          }
+          if (in.error ()) return false;
+        }
+
+        uint64_t numValues = in.read ();
+        for (uint64_t i = 0; i < numValues && !in.error (); ++i)
+        {
+          const Value *v = idx.value (in.read ());
+          Cell c;
+          if (!v || !readCell (in, nodes, c)) return false;
+          g.m_values [v].reset (new Cell (c));
+        }
+        uint64_t numFormals = in.read ();
+        for (uint64_t i = 0; i < numFormals && !in.error (); ++i)
+        {
+          const Argument *a = dyn_cast_or_null<Argument> (idx.value (in.read ()));
+          Cell c;
+          if (!a || !readCell (in, nodes, c)) return false;
+          g.m_formals [a].reset (new Cell (c));
+        }
+        uint64_t numReturns = in.read ();
+        for (uint64_t i = 0; i < numReturns && !in.error (); ++i)
+        {
+          const Function *f = dyn_cast_or_null<Function> (idx.value (in.read ()));
+          Cell c;
+          if (!f || !readCell (in, nodes, c)) return false;
+          g.m_returns [f].reset (new Cell (c));
+        }
+        return !in.error ();
+      }
+
+      static void writeHeader (StringRef key, raw_ostream &o)
+      {
+        o << CacheMagic;
+        writeString (key, o);
+      }
+    };
+
+    bool writeGraphs (const Module &M, const GlobalAnalysis &ga,
+                      StringRef key, raw_ostream &o)
+    {
+      ModuleIndex idx (M);
+
+      // -- distinct graphs, in the order of their first function
+      DenseMap<const Graph*, unsigned> graphIds;
+      std::vector<const Graph*> graphs;
+      std::vector<std::pair<unsigned, unsigned> > fns;
+      for (const Function &F : M)
+      {
+        if (!ga.hasGraph (F)) continue;
+        const Graph *g = &ga.getGraph (F);
+        auto res = graphIds.insert (std::make_pair (g, graphs.size ()));
+        if (res.second) graphs.push_back (g);
+        fns.push_back (std::make_pair (idx.value (&F), res.first->second));
+      }
+
+      // -- buffer the graphs, nothing is written unless all of them are
+      std::string buf;
+      raw_string_ostream out (buf);
+      CacheIO::writeHeader (key, out);
+      encodeULEB128 (graphs.size (), out);
+      for (const Graph *g : graphs)
+        if (!CacheIO::write (idx, *g, out))
+        {
+          LOG ("dsa-cache",
+               errs () << "DSA cache: graph refers to a value outside the module\n";);
+          return false;
+        }
+      encodeULEB128 (fns.size (), out);
+      for (auto &kv : fns)
+      {
+        encodeULEB128 (kv.first, out);
+        encodeULEB128 (kv.second, out);
+      }
+      o << out.str ();
+      return true;
+    }
+
+    bool CachedGlobalAnalysis::runOnModule (Module &M)
+    {
+      m_graphs.clear ();
+      m_loaded = false;
+
+      StringRef magic (CacheMagic);
+      if (!m_data.startswith (magic)) return false;
+      CacheReader in (m_data.drop_front (magic.size ()));
+      if (in.readString () != m_key || in.error ()) return false;
+
+      ModuleIndex idx (M);
+      std::vector<GraphRef> graphs;
+      uint64_t numGraphs = in.read ();
+      for (uint64_t i = 0; i < numGraphs && !in.error (); ++i)
+      {
+        graphs.push_back (std::make_shared<Graph> (m_dl, m_setFactory));
+        if (!CacheIO::read (idx, in, *graphs.back ())) return false;
+      }
+
+      DenseMap<const Function*, GraphRef> res;
+      uint64_t numFns = in.read ();
+      for (uint64_t i = 0; i < numFns && !in.error (); ++i)
+      {
+        const Function *F = dyn_cast_or_null<Function> (idx.value (in.read ()));
+        uint64_t g = in.read ();
+        if (!F || g >= graphs.size ()) return false;
+        res [F] = graphs [g];
+      }
+      if (in.error () || !in.atEnd ()) return false;
+
+      std::swap (m_graphs, res);
+      m_loaded = true;
+      return false;
+    }
+
+    const Graph &CachedGlobalAnalysis::getGraph (const Function &fn) const
+    { return *(m_graphs.find (&fn)->second); }
+
+    Graph &CachedGlobalAnalysis::getGraph (const Function &fn)
+    { return *(m_graphs.find (&fn)->second); }
+
+    bool CachedGlobalAnalysis::hasGraph (const Function &fn) const
+    { return m_graphs.count (&fn) > 0; }
+
+    class GraphSpill::Impl
+    {
+    public:
+      ModuleIndex m_idx;
+      const DataLayout &m_dl;
+      Graph::SetFactory &m_setFactory;
+      SmallString<128> m_path;
+      int m_fd;
+      std::unique_ptr<raw_fd_ostream> m_out;
+
+      /// position of a spilled graph in the file, and its functions
+      struct Slot
+      {
+        uint64_t offset;
+        uint64_t size;
+        std::vector<const Function*> fns;
+      };
+      std::vector<Slot> m_slots;
+      DenseMap<const Function*, unsigned> m_slotOf;
+
+      Impl (const Module &M, const DataLayout &dl, Graph::SetFactory &sf)
+        : m_idx (M), m_dl (dl), m_setFactory (sf), m_fd (-1) {}
+
+      ~Impl ()
+      {
+        if (!m_out) return;
+        m_out.reset ();
+        sys::fs::remove (m_path.str ());
+      }
+
+      /// the file is created on the first spill
+      bool open ()
+      {
+        if (m_out) return true;
+        if (m_fd >= 0) return false;
+        if (sys::fs::createTemporaryFile ("seadsa", "spill", m_fd, m_path))
+        {
+          LOG ("dsa-cache", errs () << "DSA spill: cannot create a file\n";);
+          return false;
+        }
+        m_out.reset (new raw_fd_ostream (m_fd, true));
+        return true;
+      }
+    };
+
+    GraphSpill::GraphSpill (const Module &M, const DataLayout &dl,
+                            Graph::SetFactory &setFactory)
+      : m_impl (new Impl (M, dl, setFactory)) {}
+
+    GraphSpill::~GraphSpill () {}
+
+    bool GraphSpill::spill (const std::vector<const Function*> &fns, const Graph &g)
+    {
+      Impl &impl = *m_impl;
+      if (fns.empty () || !impl.open ()) return false;
+
+      std::string buf;
+      raw_string_ostream out (buf);
+      if (!CacheIO::write (impl.m_idx, g, out)) return false;
+      out.flush ();
+
+      Impl::Slot slot;
+      slot.offset = impl.m_out->tell ();
+      slot.size = buf.size ();
+      slot.fns = fns;
+      *impl.m_out << buf;
+      for (const Function *fn : fns) impl.m_slotOf [fn] = impl.m_slots.size ();
+      impl.m_slots.push_back (slot);
+      ufo::Stats::count ("DsaSpilledGraphs");
+      return true;
+    }
+
+    bool GraphSpill::isSpilled (const Function &fn) const
+    { return m_impl->m_slotOf.count (&fn) > 0; }
+
+    bool GraphSpill::reload (const Function &fn, BottomUpAnalysis::GraphMap &graphs)
+    {
+      Impl &impl = *m_impl;
+      auto it = impl.m_slotOf.find (&fn);
+      if (it == impl.m_slotOf.end ()) return false;
+      const Impl::Slot &slot = impl.m_slots [it->second];
+
+      impl.m_out->flush ();
+      auto buf = MemoryBuffer::getOpenFileSlice (impl.m_fd, impl.m_path.str (),
+                                                 slot.size, slot.offset);
+      if (!buf) return false;
+      CacheReader in ((*buf)->getBuffer ());
+      std::shared_ptr<Graph> g = std::make_shared<Graph> (impl.m_dl, impl.m_setFactory);
+      if (!CacheIO::read (impl.m_idx, in, *g)) return false;
+
+      for (const Function *f : slot.fns)
+      {
+        graphs [f] = g;
+        impl.m_slotOf.erase (f);
+      }
+      ufo::Stats::count ("DsaReloadedGraphs");
+      return true;
+    }
+  }
+}
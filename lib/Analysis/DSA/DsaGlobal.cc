@@ -11,6 +11,7 @@
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/ADT/DenseSet.h"
 
 #include "seahorn/Analysis/DSA/Graph.hh"
 #include "seahorn/Analysis/DSA/Global.hh"
@@ -33,6 +34,12 @@ normalizeUniqueScalars("horn-sea-dsa-norm-unique-scalar",
                        llvm::cl::desc("DSA: all callees and callers agree on unique scalars"),
                        llvm::cl::init (true));
 
+static llvm::cl::opt<bool>
+PriorityWorkList("horn-sea-dsa-cs-priority",
+                 llvm::cl::desc("DSA: propagate across call sites in callers "
+                                "before call sites in their callees"),
+                 llvm::cl::init (false));
+
 static llvm::cl::opt<bool>
 normalizeAllocaSites("horn-sea-dsa-norm-alloca-sites",
                      llvm::cl::desc("DSA: all callees and callers agree on allocation sites"),
@@ -86,6 +93,10 @@ namespace seahorn
       m_graph.reset (new Graph (m_dl, m_setFactory));
 
       LocalAnalysis la (m_dl, m_tli);
+      std::vector<Function*> fns;
+      for (Function &F : M)
+        if (!F.isDeclaration () && !F.empty ()) fns.push_back (&F);
+      if (!fns.empty ()) la.precompute (fns);
 
       // -- bottom-up inlining of all graphs
       for (auto it = scc_begin (&m_cg); !it.isAtEnd (); ++it)
@@ -195,7 +206,7 @@ namespace seahorn
     // A simple worklist implementation 
     template <typename T>
     struct WorkList<T>::impl 
-    { std::queue<T> m_w; };
+    { std::queue<T> m_w; T m_last; };
     template <typename T>
     WorkList<T>::WorkList () : m_pimpl (new WorkList<T>::impl ()) { }
     template <typename T>
@@ -204,7 +215,66 @@ namespace seahorn
     void WorkList<T>::enqueue(const T&e) { m_pimpl->m_w.push(e); }
     template <typename T>
     const T& WorkList<T>::dequeue() 
-    { const T& e = m_pimpl->m_w.front(); m_pimpl->m_w.pop(); return e;}
+    {
+      // -- keep the element alive after it leaves the queue
+      m_pimpl->m_last = m_pimpl->m_w.front ();
+      m_pimpl->m_w.pop ();
+      return m_pimpl->m_last;
+    }
+
+    /// Worklist of the call sites of the global propagation. A call
+    /// site is pending at most once. Call sites are taken in FIFO
+    /// order, or by the rank of the SCC of their caller, callers
+    /// first, if PriorityWorkList is set
+    class CallSiteWorkList
+    {
+      struct Item
+      {
+        unsigned rank;
+        uint64_t seq;
+        const Instruction *cs;
+        bool operator< (const Item &o) const
+        { return rank < o.rank || (rank == o.rank && seq > o.seq); }
+      };
+
+      /// rank of each function: the position of its SCC, callees first
+      DenseMap<const Function*, unsigned> m_rank;
+      std::priority_queue<Item> m_heap;
+      std::queue<const Instruction*> m_fifo;
+      DenseSet<const Instruction*> m_pending;
+      uint64_t m_seq;
+
+    public:
+      CallSiteWorkList (CallGraph &cg) : m_seq (0)
+      {
+        if (!PriorityWorkList) return;
+        unsigned rank = 0;
+        for (auto it = scc_begin (&cg); !it.isAtEnd (); ++it, ++rank)
+          for (CallGraphNode *cgn : *it)
+            if (const Function *fn = cgn->getFunction ())
+              m_rank [fn] = rank;
+      }
+
+      bool empty () const { return m_pending.empty (); }
+
+      void enqueue (const Instruction *cs)
+      {
+        if (!m_pending.insert (cs).second) return;
+        if (!PriorityWorkList) { m_fifo.push (cs); return; }
+        auto it = m_rank.find (cs->getParent ()->getParent ());
+        unsigned rank = it == m_rank.end () ? 0 : it->second;
+        m_heap.push (Item {rank, m_seq++, cs});
+      }
+
+      const Instruction *dequeue ()
+      {
+        const Instruction *cs;
+        if (PriorityWorkList) { cs = m_heap.top ().cs; m_heap.pop (); }
+        else { cs = m_fifo.front (); m_fifo.pop (); }
+        m_pending.erase (cs);
+        return cs;
+      }
+    };
 
 
     // Clone caller nodes into callee and resolve arguments
@@ -220,20 +290,16 @@ namespace seahorn
       for (auto &kv : boost::make_iterator_range (callerG.globals_begin (),
                                                   callerG.globals_end ()))
       {
-        Node &n = C.clone (*kv.second->getNode ());
-        Cell c (n, kv.second->getOffset ());
         Cell &nc = calleeG.mkCell (*kv.first, Cell ());
-        nc.unify (c);
+        C.unifyClone (*kv.second, nc);
       }
 
       // clone and unify return
       const Function &callee = *cs.getCallee ();
       if (calleeG.hasRetCell (callee) && callerG.hasCell (*cs.getInstruction ()))
       {
-        Node &n = C.clone (*callerG.getCell (*cs.getInstruction ()).getNode());
-        Cell c (n, callerG.getCell (*cs.getInstruction()).getOffset ());
         Cell &nc = calleeG.getRetCell (callee);
-        nc.unify (c);
+        C.unifyClone (callerG.getCell (*cs.getInstruction ()), nc);
       }
 
       // clone and unify actuals and formals
@@ -245,10 +311,8 @@ namespace seahorn
         const Value *fml = &*FI;
         if (callerG.hasCell (*arg) && calleeG.hasCell (*fml))
         {
-          Node &n = C.clone (*callerG.getCell (*arg).getNode ());
-          Cell c (n, callerG.getCell (*arg).getOffset ());
           Cell &nc = calleeG.mkCell (*fml, Cell ());
-          nc.unify (c);
+          C.unifyClone (callerG.getCell (*arg), nc);
         }
       }
       calleeG.compress();
@@ -259,8 +323,22 @@ namespace seahorn
     ContextSensitiveGlobalAnalysis::decidePropagation 
     (const DsaCallSite& cs, Graph &calleeG, Graph& callerG) 
     {
+      // -- reuse the last decision while neither graph changed
+      unsigned callerVersion = m_versions.lookup (&callerG);
+      unsigned calleeVersion = m_versions.lookup (&calleeG);
+      auto it = m_decisions.find (cs.getInstruction ());
+      if (it != m_decisions.end () &&
+          it->second.callerVersion == callerVersion &&
+          it->second.calleeVersion == calleeVersion)
+      {
+        ++m_decisionHits;
+        return it->second.kind;
+      }
+
       PropagationKind res = UP;
-      SimulationMapper sm;
+      // -- a mapping that is not a function means UP, stop at the
+      // -- first node simulated twice
+      SimulationMapper sm (true);
       if (Graph::computeCalleeCallerMapping(cs, calleeG, callerG, 
                                             true,  /*only modified nodes*/
                                             false, /*no report if sanity check failed*/
@@ -268,6 +346,8 @@ namespace seahorn
         if (sm.isFunction ())
           res = (sm.isInjective () ? NONE: DOWN);
       }
+      Decision d = {callerVersion, calleeVersion, res};
+      m_decisions [cs.getInstruction ()] = d;
       return res;
     }
     
@@ -275,6 +355,7 @@ namespace seahorn
     propagateTopDown (const DsaCallSite& cs, Graph &callerG, Graph& calleeG) 
     {
       cloneAndResolveArguments (cs, callerG, calleeG);
+      ++m_versions [&calleeG];
 
       LOG("dsa-global",
           if (decidePropagation (cs, calleeG, callerG) == DOWN)
@@ -290,6 +371,7 @@ namespace seahorn
     propagateBottomUp (const DsaCallSite& cs, Graph &calleeG, Graph& callerG) 
     {
       BottomUpAnalysis::cloneAndResolveArguments (cs, calleeG, callerG);
+      ++m_versions [&callerG];
       
       LOG("dsa-global",
           if (decidePropagation (cs, calleeG, callerG) == UP)
@@ -319,14 +401,54 @@ namespace seahorn
       }
 
       // -- Run bottom up analysis on the whole call graph 
-      //    and initialize worklist
       BottomUpAnalysis bu (m_dl, m_tli, m_cg);
       bu.runOnModule (M, m_graphs);
 
+      propagate (M, bu);
+
+      LOG("dsa-global", errs () << "Finished context-sensitive global analysis\n");
+
+      ufo::Stats::stop ("CS-DsaAnalysis");          
+
+      return false;
+    }
+
+    bool ContextSensitiveGlobalAnalysis::update (Module &M,
+                                                 const FunctionSet &changed)
+    {
+      LOG("dsa-global",
+          errs () << "Started incremental context-sensitive global analysis ... \n");
+
+      ufo::Stats::resume ("CS-DsaAnalysis");
+
+      // -- recompute the bottom-up graphs of the changed functions and
+      //    of their callers only. Their callees keep their global
+      //    graphs, which the callers clone
+      BottomUpAnalysis bu (m_dl, m_tli, m_cg);
+      bu.update (M, changed, m_graphs, m_setFactory);
+
+      propagate (M, bu);
+
+      LOG("dsa-global",
+          errs () << "Finished incremental context-sensitive global analysis\n");
+
+      ufo::Stats::stop ("CS-DsaAnalysis");
+
+      return false;
+    }
+
+    void ContextSensitiveGlobalAnalysis::propagate (Module &M,
+                                                    const BottomUpAnalysis &bu)
+    {
       DsaCallGraph dsaCG (m_cg);
       dsaCG.buildDependencies ();
 
-      WorkList<const Instruction*> w;
+      // -- graphs might have been replaced since the last propagation
+      m_versions.clear ();
+      m_decisions.clear ();
+      m_decisionHits = 0;
+
+      CallSiteWorkList w (m_cg);
 
       /// push in the worklist callsites for which two different
       /// callee nodes are mapped to the same caller node
@@ -342,9 +464,12 @@ namespace seahorn
 
       unsigned td_props = 0;
       unsigned bu_props = 0;
+      // -- number of times each call site is taken from the worklist
+      DenseMap<const Instruction*, unsigned> visits;
       while (!w.empty()) 
       {
         const Instruction* I = w.dequeue();
+        ++visits [I];
 
         if (const CallInst *CI = dyn_cast<CallInst> (I))
           if (CI->isInlineAsm())
@@ -387,9 +512,29 @@ namespace seahorn
         }
       }
 
+      unsigned total_visits = 0;
+      unsigned max_visits = 0;
+      const Instruction *max_cs = nullptr;
+      for (auto &kv : visits)
+      {
+        total_visits += kv.second;
+        if (kv.second > max_visits) { max_visits = kv.second; max_cs = kv.first; }
+      }
+      ufo::Stats::uset ("DsaCsCallSiteVisits",
+                        ufo::Stats::get ("DsaCsCallSiteVisits") + total_visits);
+      if (max_visits > ufo::Stats::get ("DsaCsMaxCallSiteVisits"))
+        ufo::Stats::uset ("DsaCsMaxCallSiteVisits", max_visits);
+
       LOG("dsa-global", 
           errs () << "-- Number of top-down propagations=" << td_props << "\n";
-          errs () << "-- Number of bottom-up propagations=" << bu_props << "\n";);
+          errs () << "-- Number of bottom-up propagations=" << bu_props << "\n";
+          errs () << "-- Number of reused propagation decisions="
+                  << m_decisionHits << "\n";
+          errs () << "-- Number of call sites visited=" << visits.size ()
+                  << ", visits=" << total_visits << "\n";
+          if (max_cs)
+            errs () << "-- Most visited call site (" << max_visits << "): "
+                    << *max_cs << "\n";);
 
       LOG("dsa-global", checkNoMorePropagation ());
 
@@ -415,12 +560,6 @@ namespace seahorn
              kv.second->write (errs ());
              errs () << "\n";
            });
-           
-      LOG("dsa-global", errs () << "Finished context-sensitive global analysis\n");
-
-      ufo::Stats::stop ("CS-DsaAnalysis");          
-
-      return false;
     }
 
     // Perform some sanity checks:
@@ -426,7 +426,7 @@ void InfoAnalysis::assignNodeId (const Function& fn, Graph* g)
   #endif 
 }
 
-bool InfoAnalysis::runOnFunction (Function &f) 
+bool InfoAnalysis::runOnFunction (const Function &f) 
 {  
   if (Graph* g = getDsaGraph(f))
   {
@@ -437,7 +437,7 @@ bool InfoAnalysis::runOnFunction (Function &f)
     // XXX: If the analysis is context-insensitive all functions have
     // the same graph so we just need to compute the id's for the
     // first graph.
-    if (m_seen_graphs.count (g) <= 0)
+    if (m_seen_graphs.insert (g).second)
       assignNodeId (f, g); 
 
     countMemoryAccesses (f);
@@ -445,22 +445,68 @@ bool InfoAnalysis::runOnFunction (Function &f)
   return false;
 }
 
+void InfoAnalysis::ensureFunction (const Function &f)
+{
+  if (!m_lazy || !m_module) return;
+  Graph *g = getDsaGraph (f);
+  if (!g || !m_done_graphs.insert (g).second) return;
+
+  if (m_graph_fns.empty ())
+    for (const Function &fn : *m_module)
+      if (Graph *h = getDsaGraph (fn)) m_graph_fns [h].push_back (&fn);
+
+  // -- accesses of a node are counted over all functions of its graph
+  for (const Function *fn : m_graph_fns [g]) runOnFunction (*fn);
+
+  for (const Node &n : *g)
+  {
+    auto it = m_nodes_map.find (&n);
+    if (it == m_nodes_map.end () || !is_alive_node () (it->second)) continue;
+    unsigned int site_id;
+    for (const llvm::Value *v : n.getAllocSites ())
+      AddAllocSite (v, site_id, m_alloc_sites);
+  }
+}
+
+void InfoAnalysis::ensureAll ()
+{
+  if (!m_lazy || !m_module || m_all_done) return;
+  for (const Function &f : *m_module) ensureFunction (f);
+  m_all_done = true;
+}
+
 bool InfoAnalysis::runOnModule (Module &M) 
 {
+  m_module = &M;
+  if (m_lazy) return false;
+
+  for (auto &f: M) runOnFunction (f); 
+
+  // discards output if verbose mode is disabled
+  report (m_verbose ? errs () : nulls ());
+  return false;
+}
+
+void InfoAnalysis::report (raw_ostream &o)
+{
+  if (!m_module) return;
+  ensureAll ();
 
   unsigned num_of_funcs = 0;
-  for (auto &f: M) 
-  { 
-    runOnFunction (f); 
-    if (f.isDeclaration () || f.empty ()) 
-      continue;
-    num_of_funcs++; 
-  }
+  for (auto &f: *m_module) 
+    if (!f.isDeclaration () && !f.empty ()) num_of_funcs++; 
 
   ufo::Stats::uset ("NumOfFunctions", num_of_funcs);
 
-  // discards output if verbose mode is disabled
-  raw_ostream &o = (m_verbose ? errs () : nulls ());
+  const ForwardingStats &fwd = forwardingStats ();
+  ufo::Stats::uset ("DsaForwardingChains", fwd.chains);
+  ufo::Stats::uset ("DsaForwardingSteps", fwd.steps);
+  ufo::Stats::uset ("DsaLongestForwardingChain", fwd.longest);
+
+  const BudgetStats &budget = budgetStats ();
+  ufo::Stats::uset ("DsaFieldBudgetCollapses", budget.fields);
+  ufo::Stats::uset ("DsaNodeBudgetCollapses", budget.nodes);
+  ufo::Stats::uset ("DsaUnifyBudgetCollapses", budget.unifications);
 
   o << " ========== Begin Dsa info  ==========\n";
 
@@ -469,13 +515,12 @@ bool InfoAnalysis::runOnModule (Module &M)
   assignAllocSiteIdAndPrinting  (live_nodes (), o, DsaInfoToFile);
   
   o << " ========== End Dsa info  ==========\n";
-
-  return false;
 }
 
 // External API for Dsa clients
-bool InfoAnalysis::isAccessed (const Node&n) const 
+bool InfoAnalysis::isAccessed (const Node&n) 
 { 
+  ensureAll ();
   auto it = m_nodes_map.find (&n);
   if (it != m_nodes_map.end ())
     return (it->second.getAccesses () > 0);
@@ -483,8 +528,16 @@ bool InfoAnalysis::isAccessed (const Node&n) const
     return false; // not found
 }
 
-unsigned int InfoAnalysis::getDsaNodeId (const Node&n) const 
+bool InfoAnalysis::isAccessed (const Function &f, const Node&n) 
 { 
+  ensureFunction (f);
+  auto it = m_nodes_map.find (&n);
+  return it != m_nodes_map.end () && it->second.getAccesses () > 0;
+}
+
+unsigned int InfoAnalysis::getDsaNodeId (const Node&n) 
+{ 
+  ensureAll ();
   auto it = m_nodes_map.find (&n);
   if (it != m_nodes_map.end ())
     return it->second.getId ();
@@ -492,8 +545,20 @@ unsigned int InfoAnalysis::getDsaNodeId (const Node&n) const
     return 0; // not found
 }
 
-unsigned int InfoAnalysis::getAllocSiteId (const Value* V) const
+unsigned int InfoAnalysis::getDsaNodeId (const Function &f, const Node&n) 
+{ 
+  ensureFunction (f);
+  auto it = m_nodes_map.find (&n);
+  return it != m_nodes_map.end () ? it->second.getId () : 0;
+}
+
+unsigned int InfoAnalysis::getAllocSiteId (const Value* V)
 { 
+  // -- an allocation site is a node of the graph of its function
+  if (const Instruction *I = dyn_cast<Instruction> (V))
+    ensureFunction (*I->getParent ()->getParent ());
+  else
+    ensureAll ();
   auto it = m_alloc_sites.left.find (V);
   if (it != m_alloc_sites.left.end ())
     return it->second;
@@ -501,8 +566,9 @@ unsigned int InfoAnalysis::getAllocSiteId (const Value* V) const
     return 0; // not found
 }
 
-const Value* InfoAnalysis::getAllocValue (unsigned int alloc_site_id) const
+const Value* InfoAnalysis::getAllocValue (unsigned int alloc_site_id)
 { 
+  ensureAll ();
   auto it = m_alloc_sites.right.find (alloc_site_id);
   if (it != m_alloc_sites.right.end ())
     return it->second;
@@ -10,23 +10,33 @@
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/GetElementPtrTypeIterator.h"
 #include "llvm/IR/InstVisitor.h"
+#include "llvm/IR/TypeFinder.h"
 
 #include "llvm/Analysis/MemoryBuiltins.h"
 
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/Support/CommandLine.h"
 
 #include "seahorn/Analysis/DSA/Graph.hh"
 #include "seahorn/Analysis/DSA/Local.hh"
 #include "seahorn/Support/SortTopo.hh"
+#include "seahorn/Support/TaskPool.hh"
 
 #include "boost/range/algorithm/reverse.hpp"
 #include "boost/make_shared.hpp"
 
 #include "avy/AvyDebug.h"
 
+#include <algorithm>
+
 using namespace llvm;
 using namespace seahorn;
 
+static llvm::cl::opt<unsigned>
+LocalThreads ("sea-dsa-local-threads",
+              llvm::cl::desc ("DSA: number of threads building the local graphs"),
+              llvm::cl::init (1));
+
 
 namespace
 {
@@ -705,7 +715,53 @@ namespace seahorn
   namespace dsa
   {
 
+    void LocalAnalysis::precompute (const std::vector<Function*> &fns)
+    {
+      unsigned threads = std::min<size_t> (LocalThreads, fns.size ());
+      if (threads <= 1 || hasBudgets ()) return;
+
+      // -- the data layout computes the layout of a struct on its
+      // -- first use, so it is done here for all of them
+      TypeFinder types;
+      types.run (*fns.front ()->getParent (), false);
+      for (StructType *sty : types)
+        if (!sty->isOpaque () && sty->isSized ()) m_dl.getStructLayout (sty);
+
+      unsigned base = m_precomputed.size ();
+      for (unsigned i = 0; i < fns.size (); ++i)
+        m_precomputedIdx [fns [i]] = base + i;
+      m_precomputed.resize (base + fns.size ());
+
+      unsigned firstFactory = m_factories.size ();
+      for (unsigned t = 0; t < threads; ++t)
+        m_factories.emplace_back (new Graph::SetFactory ());
+
+      TaskPool pool ("DsaLocal.precompute", threads);
+      pool.run (fns.size (), [&] (unsigned t, size_t i)
+                {
+                  Graph::SetFactory &sf = *m_factories [firstFactory + t];
+                  std::unique_ptr<Graph> g (new Graph (m_dl, sf));
+                  build (*fns [i], *g);
+                  m_precomputed [base + i] = std::move (g);
+                });
+    }
+
     void LocalAnalysis::runOnFunction (Function &F, dsa::Graph &g)
+    {
+      auto it = m_precomputedIdx.find (&F);
+      if (it == m_precomputedIdx.end () || !m_precomputed [it->second])
+      {
+        build (F, g);
+        return;
+      }
+
+      // -- the ids of the nodes follow the order of the imports
+      std::unique_ptr<Graph> local = std::move (m_precomputed [it->second]);
+      local->renumberNodes ();
+      g.import (*local, true);
+    }
+
+    void LocalAnalysis::build (Function &F, dsa::Graph &g)
     {
       // create cells and nodes for formal arguments
       for (Argument &a : F.args ())
@@ -778,8 +834,20 @@ namespace seahorn
       m_dl = &getAnalysis<DataLayoutPass>().getDataLayout ();
       m_tli = &getAnalysis<TargetLibraryInfo> ();
 
-      for (Function &F : M) runOnFunction (F);                
-        return false;
+      std::vector<Function*> fns;
+      for (Function &F : M)
+        if (!F.isDeclaration () && !F.empty ()) fns.push_back (&F);
+
+      LocalAnalysis la (*m_dl, *m_tli);
+      la.precompute (fns);
+      for (Function *F : fns)
+      {
+        LOG("progress", errs () << "DSA: " << F->getName () << "\n";);
+        GraphRef g = std::make_shared<seahorn::dsa::Graph> (*m_dl, m_setFactory);
+        la.runOnFunction (*F, *g);
+        m_graphs [F] = g;
+      }
+      return false;
     }
 
     bool Local::runOnFunction (Function &F)
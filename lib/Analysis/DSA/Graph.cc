@@ -8,6 +8,8 @@
 #include "llvm/IR/GlobalAlias.h"
 #include "llvm/IR/DataLayout.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/ADT/SmallVector.h"
 
 #include <string>
 #include <set>
@@ -24,6 +26,48 @@
 using namespace seahorn;
 using namespace llvm;
 
+static llvm::cl::opt<unsigned>
+MaxFields ("sea-dsa-max-fields",
+           llvm::cl::desc ("DSA: collapse nodes with more fields (0 is no bound)"),
+           llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+MaxNodes ("sea-dsa-max-nodes",
+          llvm::cl::desc ("DSA: collapse the new nodes of a graph with more "
+                          "nodes (0 is no bound)"),
+          llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+MaxTotalNodes ("sea-dsa-max-total-nodes",
+               llvm::cl::desc ("DSA: collapse the new nodes once all graphs "
+                               "have more nodes (0 is no bound)"),
+               llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+MaxUnify ("sea-dsa-max-unify",
+          llvm::cl::desc ("DSA: collapse the nodes of a graph unified after "
+                          "that many unifications in it (0 is no bound)"),
+          llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+MaxTotalUnify ("sea-dsa-max-total-unify",
+               llvm::cl::desc ("DSA: collapse the nodes unified after that "
+                               "many unifications in all graphs (0 is no bound)"),
+               llvm::cl::init (0));
+
+namespace
+{
+  dsa::BudgetStats g_budgetStats = {0, 0, 0};
+  /// nodes created and unifications in all graphs
+  std::atomic<uint64_t> g_totalNodes (0);
+  std::atomic<uint64_t> g_totalUnify (0);
+}
+
+const dsa::BudgetStats &dsa::budgetStats () { return g_budgetStats; }
+
+bool dsa::hasBudgets ()
+{ return MaxFields || MaxNodes || MaxTotalNodes || MaxUnify || MaxTotalUnify; }
+
 dsa::Node::Node (Graph &g, const Node &n, bool copyLinks) :
   m_graph (&g), m_unique_scalar (n.m_unique_scalar), m_size (n.m_size)
 {
@@ -372,10 +416,28 @@ void dsa::Node::unifyAt (Node &n, unsigned o)
 
   assert (!isForwarding ());
   assert (!n.isForwarding ());
+
+  // -- over budget, degrade to field-insensitive
+  if (m_graph->overUnifyBudget () && !isCollapsed ())
+  {
+    ++g_budgetStats.unifications;
+    collapse (__LINE__);
+    getNode ()->unifyAt (*n.getNode (), o);
+    return;
+  }
+
   // -- move everything from n to this node
   n.pointTo (*this, offset);
 }
 
+void dsa::Node::checkFieldBudget ()
+{
+  if (MaxFields == 0 || isForwarding () || isCollapsed ()) return;
+  if (m_types.size () <= MaxFields && m_links.size () <= MaxFields) return;
+  ++g_budgetStats.fields;
+  collapse (__LINE__);
+}
+
 
 /// pre: this simulated by n
 unsigned dsa::Node::mergeUniqueScalar (Node &n)
@@ -576,21 +638,61 @@ void dsa::Cell::unify (Cell &c)
       // TODO: other ways to break ties
       n1.unify (n2);
   }
+
+  if (Node *n = getNode ()) n->checkFieldBudget ();
 }
       
+namespace
+{
+  /// local graphs may be built on several threads
+  struct
+  {
+    std::atomic<uint64_t> chains;
+    std::atomic<uint64_t> steps;
+    std::atomic<unsigned> longest;
+  } g_fwdStats = {{0}, {0}, {0}};
+}
+
+dsa::ForwardingStats dsa::forwardingStats ()
+{
+  dsa::ForwardingStats res = {g_fwdStats.chains, g_fwdStats.steps,
+                              g_fwdStats.longest};
+  return res;
+}
+
 dsa::Node* dsa::Cell::getNode () const
 {
   if (isNull ()) return nullptr;
-      
-  Node *n = m_node->getNode ();
-  assert ((n == m_node && !m_node->isForwarding ()) || m_node->isForwarding ());
-  if (n != m_node)
+  if (!m_node->isForwarding ()) return m_node;
+
+  // -- find the representative
+  SmallVector<Node*, 8> chain;
+  Node *n = m_node;
+  while (n->isForwarding ())
   {
-    assert (m_node->isForwarding ());
-    m_offset += m_node->getOffset ();
-    m_node = n;
+    chain.push_back (n);
+    n = n->m_forward.m_node;
   }
-  
+
+  ++g_fwdStats.chains;
+  g_fwdStats.steps += chain.size ();
+  unsigned longest = g_fwdStats.longest;
+  while (chain.size () > longest &&
+         !g_fwdStats.longest.compare_exchange_weak (longest, chain.size ())) ;
+
+  // -- path compression: every node on the chain forwards directly
+  // -- to the representative. The last node is the closest to it
+  unsigned offset = 0;
+  for (auto it = chain.rbegin (), end = chain.rend (); it != end; ++it)
+  {
+    Cell &fwd = (*it)->m_forward;
+    offset += fwd.m_offset;
+    fwd.m_node = n;
+    fwd.m_offset = offset;
+  }
+
+  m_offset += offset;
+  m_node = n;
   return m_node;
 }
 
@@ -630,16 +732,48 @@ unsigned dsa::Node::getOffset () const
 
 dsa::Node& dsa::Graph::mkNode ()
 {
-  m_nodes.push_back (std::unique_ptr<Node> (new Node (*this)));
+  m_nodes.push_back (new (m_allocator.Allocate ()) Node (*this));
+  checkNodeBudget (*m_nodes.back ());
   return *m_nodes.back ();
 }
 
 dsa::Node &dsa::Graph::cloneNode (const Node &n)
 {
-  m_nodes.push_back (std::unique_ptr<Node> (new Node (*this, n, false)));
+  m_nodes.push_back (new (m_allocator.Allocate ()) Node (*this, n, false));
+  checkNodeBudget (*m_nodes.back ());
   return *m_nodes.back ();
 }
 
+void dsa::Graph::renumberNodes ()
+{
+  for (Node *n : m_nodes) n->m_id = ++Node::m_id_factory;
+}
+
+void dsa::Graph::checkNodeBudget (Node &n)
+{
+  ++g_totalNodes;
+  bool over = (MaxNodes > 0 && m_nodes.size () > MaxNodes) ||
+    (MaxTotalNodes > 0 && g_totalNodes > MaxTotalNodes);
+  if (!over || n.isCollapsed ()) return;
+
+  // -- n has no links, so it is collapsed in place rather than
+  // -- moved into a new node as Node::collapse does
+  assert (n.m_links.empty ());
+  ++g_budgetStats.nodes;
+  n.m_types.clear ();
+  n.m_unique_scalar = nullptr;
+  n.m_size = 1;
+  n.setCollapsed (true);
+}
+
+bool dsa::Graph::overUnifyBudget ()
+{
+  ++m_numUnify;
+  ++g_totalUnify;
+  return (MaxUnify > 0 && m_numUnify > MaxUnify) ||
+    (MaxTotalUnify > 0 && g_totalUnify > MaxTotalUnify);
+}
+
 dsa::Graph::const_iterator dsa::Graph::begin() const
 { return boost::make_indirect_iterator(m_nodes.begin()); }
 
@@ -684,16 +818,16 @@ dsa::Graph::global_const_iterator dsa::Graph::globals_end() const
 void dsa::Graph::compress ()
 {
   // -- resolve all forwarding
-  for (auto &n : m_nodes)
+  for (Node *n : m_nodes)
   {
     // resolve the node
     n->getNode ();
+    // -- release the storage of forwarding nodes, the arena frees
+    // -- the nodes themselves with the graph
+    n->compress ();
     // if not forwarding, resolve forwarding on all links
     if (!n->isForwarding ())
-    {
-      n->compress ();
       for (auto &kv : n->links ()) kv.second->getNode ();
-    }
   }
 
   for (auto &kv : m_values) kv.second->getNode ();
@@ -707,7 +841,7 @@ void dsa::Graph::compress ()
   
   // -- remove forwarding nodes using remove-erase idiom
   m_nodes.erase (std::remove_if (m_nodes.begin(), m_nodes.end(),
-                                 [] (const std::unique_ptr<Node> &n)
+                                 [] (const Node *n)
                                  { return n->isForwarding (); }),
                  m_nodes.end ());
 }
@@ -1030,4 +1164,4 @@ void dsa::Graph::write (raw_ostream&o) const{
 }
 
 // Initialization of static data
-uint64_t seahorn::dsa::Node::m_id_factory = 0;
+std::atomic<uint64_t> seahorn::dsa::Node::m_id_factory (0);
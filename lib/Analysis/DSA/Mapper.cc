@@ -1,6 +1,8 @@
 #include "seahorn/Analysis/DSA/Mapper.hh"
 #include "llvm/Support/raw_ostream.h"
 
+#include <unordered_set>
+
 using namespace seahorn;
 using namespace seahorn::dsa;
 
@@ -37,10 +39,17 @@ void FunctionalMapper::insert (const Cell &src, const Cell &dst)
   }
 }
 
+SimulationMapper::cells_type &SimulationMapper::cells (const Node &n)
+{
+  auto res = m_index.insert (std::make_pair (&n, m_rel.size ()));
+  if (res.second) m_rel.push_back (std::make_pair (&n, cells_type ()));
+  return m_rel [res.first->second].second;
+}
+
 bool SimulationMapper::insert (const Cell &c1, Cell &c2)
 {
   if (c1.isNull () != c2.isNull ())
-  { m_sim.clear (); return false; }
+  { clear (); return false; }
 
   if (c1.isNull ()) return true;
 
@@ -52,7 +61,7 @@ bool SimulationMapper::insert (const Cell &c1, Cell &c2)
   Node::Offset o2 (*c2.getNode(), c2.getOffset());
     
   if (o2 < o1)
-  { m_sim.clear (); return false; }
+  { clear (); return false; }
   
   return insert (*c1.getNode (), *c2.getNode (), o2 - o1);
 }
@@ -62,12 +71,17 @@ bool SimulationMapper::insert (const Node &n1, Node &n2, unsigned o)
   // XXX: adjust the offset
   Node::Offset offset (n2, o);
 
-  auto &map = m_sim[&n1];
-  if (map.count (&n2) > 0)
+  auto &map = cells (n1);
+  auto it = map.find (&n2);
+  if (it != map.end ())
   {
-    if (map.at (&n2) == offset) return true;
-    m_sim.clear (); return false;
+    if (it->second == offset) return true;
+    clear (); return false;
   }
+
+  // -- n1 is already simulated by another node
+  if (m_onlyFunction && !map.empty ())
+  { clear (); return false; }
   
   // -- not array can be simulated by array of larger size at offset 0
   // XXX probably sufficient if n1 can be completely embedded into n2,
@@ -75,22 +89,22 @@ bool SimulationMapper::insert (const Node &n1, Node &n2, unsigned o)
   if (!n1.isArray () && n2.isArray ())
   {
     if (offset > 0 || n1.size () > n2.size ())
-    { m_sim.clear (); return false; }
+    { clear (); return false; }
   }
 
   // XXX: a collapsed node can simulate an array node
   if (n1.isArray () && (!n2.isArray () && !n2.isCollapsed()))
-  { m_sim.clear (); return false; }
+  { clear (); return false; }
 
   if (n1.isArray () && offset != 0)
-  { m_sim.clear (); return false; } 
+  { clear (); return false; } 
     
   // XXX: a collapsed node can simulate an array node
   if (n1.isArray () && !n2.isCollapsed() && n1.size () != n2.size ())
-  { m_sim.clear (); return false; }
+  { clear (); return false; }
   
   if (n1.isCollapsed () && !n2.isCollapsed ())
-  { m_sim.clear (); return false; }
+  { clear (); return false; }
       
   // add n2 into the map
   map[&n2] = offset;
@@ -103,17 +117,18 @@ bool SimulationMapper::insert (const Node &n1, Node &n2, unsigned o)
 
     unsigned j = n2.isCollapsed () ? 0 : kv.first + offset;
     if (!n2.hasLink (j))      
-    { m_sim.clear (); return false; }
+    { clear (); return false; }
 
     auto &link = n2.getLink (j);
     Node *n4 = link.getNode ();
     unsigned off2 = link.getOffset ();
 
     if (off2 < off1 && !n4->isCollapsed ())
-    { m_sim.clear (); return false; }
+    { clear (); return false; }
     
     if (!insert (*n3, *n4, off2 - off1))
-    { map.clear (); return false; }
+      // -- the relation is already cleared
+      return false;
   }
   
   return true;
@@ -122,7 +137,7 @@ bool SimulationMapper::insert (const Node &n1, Node &n2, unsigned o)
 void SimulationMapper::write(llvm::raw_ostream&o) const 
 {
   o << "BEGIN simulation mapper\n";
-  for (auto &kv: m_sim)
+  for (auto &kv: m_rel)
     for (auto &c: kv.second) 
       o << "(" << *(kv.first) << ", " << *(c.first) << ", " << c.second << ")\n";
   o << "END  simulation mapper\n";
@@ -130,8 +145,8 @@ void SimulationMapper::write(llvm::raw_ostream&o) const
 
 bool SimulationMapper::isInjective (bool onlyModified)  const 
 {
-  boost::container::flat_set<Cell> inv_sim;
-  for (auto &kv: m_sim) 
+  std::unordered_set<Cell> inv_sim;
+  for (auto &kv: m_rel) 
     for (auto &c: kv.second) 
     {
       auto res = inv_sim.insert(Cell(c.first, c.second));
@@ -143,7 +158,7 @@ bool SimulationMapper::isInjective (bool onlyModified)  const
 
 bool SimulationMapper::isFunction () const 
 {
-  for (auto &kv: m_sim)
+  for (auto &kv: m_rel)
     if (kv.second.size () > 1) return false;
   return true;
 }
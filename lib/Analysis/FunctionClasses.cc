@@ -0,0 +1,131 @@
+#include "seahorn/Analysis/FunctionClasses.hh"
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/Operator.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "boost/range.hpp"
+
+#include <functional>
+
+namespace seahorn
+{
+  const Function &FunctionClasses::add (const Function &F)
+  {
+    auto r = m_rep.insert (std::make_pair (&F, &F));
+    if (!r.second) return *r.first->second;
+
+    std::string form = normalForm (F);
+    if (form.empty ()) return F;
+
+    size_t h = std::hash<std::string> () (form);
+    auto range = m_forms.equal_range (h);
+    for (auto it = range.first; it != range.second; ++it)
+      if (it->second.first == form)
+      {
+        r.first->second = it->second.second;
+        return *it->second.second;
+      }
+    m_forms.insert (std::make_pair (h, std::make_pair (std::move (form), &F)));
+    return F;
+  }
+
+  namespace
+  {
+    bool isShadowMem (const Function *fn)
+    { return fn && fn->getName ().startswith ("shadow.mem"); }
+  }
+
+  std::string FunctionClasses::normalForm (const Function &F) const
+  {
+    if (F.isDeclaration () || F.isVarArg ()) return std::string ();
+
+    // -- values by position. Instructions are numbered first, since a
+    // -- phi node may use a later one
+    DenseMap<const Value*, unsigned> num;
+    unsigned n = 0;
+    for (const Argument &arg : boost::make_iterator_range (F.arg_begin (), F.arg_end ()))
+      num [&arg] = n++;
+    for (const BasicBlock &bb : F)
+    {
+      num [&bb] = n++;
+      for (const Instruction &I : bb) num [&I] = n++;
+    }
+    DenseMap<uint64_t, unsigned> regions;
+
+    std::string res;
+    raw_string_ostream os (res);
+    F.getFunctionType ()->print (os);
+    for (const BasicBlock &bb : F)
+    {
+      os << "\nb" << num [&bb] << ":";
+      for (const Instruction &I : bb)
+      {
+        if (isa<DbgInfoIntrinsic> (&I)) continue;
+        // -- their state is not in their operands
+        if (isa<LandingPadInst> (&I) || isa<FenceInst> (&I) ||
+            isa<AtomicRMWInst> (&I) || isa<AtomicCmpXchgInst> (&I) ||
+            isa<ExtractValueInst> (&I) || isa<InsertValueInst> (&I))
+          return std::string ();
+
+        os << "\n i" << num [&I] << " " << I.getOpcodeName () << " ";
+        I.getType ()->print (os);
+        if (const OverflowingBinaryOperator *op = dyn_cast<OverflowingBinaryOperator> (&I))
+          os << (op->hasNoSignedWrap () ? " nsw" : "")
+             << (op->hasNoUnsignedWrap () ? " nuw" : "");
+        if (const PossiblyExactOperator *op = dyn_cast<PossiblyExactOperator> (&I))
+          os << (op->isExact () ? " exact" : "");
+        if (const CmpInst *ci = dyn_cast<CmpInst> (&I)) os << " p" << ci->getPredicate ();
+        if (const GetElementPtrInst *gep = dyn_cast<GetElementPtrInst> (&I))
+          os << (gep->isInBounds () ? " inbounds" : "");
+        if (const AllocaInst *ai = dyn_cast<AllocaInst> (&I))
+        { os << " "; ai->getAllocatedType ()->print (os); }
+        if (const LoadInst *li = dyn_cast<LoadInst> (&I))
+          os << (li->isVolatile () ? " volatile" : "");
+        if (const StoreInst *si = dyn_cast<StoreInst> (&I))
+          os << (si->isVolatile () ? " volatile" : "");
+
+        ImmutableCallSite CS (&I);
+        const Function *callee = CS ? CS.getCalledFunction () : nullptr;
+        for (unsigned i = 0; i < I.getNumOperands (); ++i)
+        {
+          const Value *v = I.getOperand (i);
+          os << ", ";
+          auto it = num.find (v);
+          if (it != num.end ())
+          {
+            os << (isa<Argument> (v) ? "a" : isa<BasicBlock> (v) ? "b" : "i")
+               << it->second;
+            continue;
+          }
+          // -- the region ids of DSA are global, rename them
+          if (isShadowMem (callee) && i == 0 && isa<ConstantInt> (v))
+          {
+            uint64_t id = cast<ConstantInt> (v)->getZExtValue ();
+            auto r = regions.insert (std::make_pair (id, regions.size ()));
+            os << "r" << r.first->second;
+            continue;
+          }
+          if (const Function *fn = dyn_cast<Function> (v))
+          {
+            os << "@" << rep (*fn).getName ();
+            continue;
+          }
+          if (isa<InlineAsm> (v) || !isa<Constant> (v)) return std::string ();
+          // -- constants with their types, globals by name
+          v->printAsOperand (os, true);
+        }
+        // -- not operands
+        if (const PHINode *phi = dyn_cast<PHINode> (&I))
+          for (unsigned i = 0; i < phi->getNumIncomingValues (); ++i)
+            os << ", b" << num [phi->getIncomingBlock (i)];
+      }
+    }
+    os.flush ();
+    return res;
+  }
+}
@@ -0,0 +1,364 @@
+///
+// The pre-processing and optimization pipelines of the front end
+///
+#include "llvm/PassManager.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/UnifyFunctionExitNodes.h"
+
+#include "seahorn/Pipeline.hh"
+#include "seahorn/Passes.hh"
+
+#include "seahorn/Transforms/Scalar/PromoteVerifierCalls.hh"
+#include "seahorn/Transforms/Utils/RemoveUnreachableBlocksPass.hh"
+#include "seahorn/Transforms/Utils/DummyMainFunction.hh"
+#include "seahorn/Transforms/Scalar/LowerGvInitializers.hh"
+
+#include "seahorn/Analysis/CanAccessMemory.hh"
+#include "seahorn/Transforms/Scalar/LowerCstExpr.hh"
+#include "seahorn/Transforms/Instrumentation/BufferBoundsCheck.hh"
+#include "seahorn/Transforms/Instrumentation/IntegerOverflowCheck.hh"
+#include "seahorn/Transforms/Instrumentation/NullCheck.hh"
+#include "seahorn/Transforms/Instrumentation/MixedSemantics.hh"
+
+#include <climits>
+
+static llvm::cl::opt<bool>
+InlineAll ("horn-inline-all", llvm::cl::desc ("Inline all functions"),
+           llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+InlineCost ("horn-inline-cost",
+            llvm::cl::desc ("Inline the functions that are cheap to inline "
+                            "for verification, within a code growth budget"),
+            llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+CutLoops ("horn-cut-loops", llvm::cl::desc ("Cut all natural loops"),
+           llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+UnrollLoops ("horn-unroll-loops",
+             llvm::cl::desc ("Unroll all natural loops up to their bound "
+                             "and cut them (implies --horn-cut-loops)"),
+             llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+AccelLoops ("horn-accel-loops",
+            llvm::cl::desc ("Replace counting loops by the closed forms of their "
+                            "values, and fill and copy loops by memset and memcpy"),
+            llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+BoundsChecks ("bounds-check", 
+     llvm::cl::desc ("Insert array bounds checks"), 
+     llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+OverflowChecks ("overflow-check", 
+     llvm::cl::desc ("Insert signed integer overflow checks"), 
+     llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+NullChecks ("null-check", 
+     llvm::cl::desc ("Insert null dereference checks"), 
+     llvm::cl::init (false));
+
+static llvm::cl::opt<unsigned>
+PPThreads ("pp-threads",
+           llvm::cl::desc ("Insert the overflow and null checks on this many "
+                           "partitions of the module in parallel"),
+           llvm::cl::init (1));
+
+static llvm::cl::opt<bool>
+EnumVerifierCalls ("enum-verifier-calls", 
+     llvm::cl::desc ("Assign a unique identifier to each call to verifier.error"), 
+     llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+SliceProgram ("slice-program",
+     llvm::cl::desc ("Remove the instructions and functions that cannot affect the properties"),
+     llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+MixedSem ("horn-mixed-sem", llvm::cl::desc ("Mixed-Semantics Transformation"),
+          llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+KillVaArg ("kill-vaarg", llvm::cl::desc ("Delete vaarg functions"),
+           llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+StripExtern ("strip-extern", llvm::cl::desc ("Replace external functions by nondet"),
+              llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+LowerInvoke ("lower-invoke", 
+             llvm::cl::desc ("Lower all invoke instructions"),
+             llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+DevirtualizeFuncs ("devirt-functions", 
+                   llvm::cl::desc ("Devirtualize indirect calls using only types"),
+                   llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+ExternalizeAddrTakenFuncs ("externalize-addr-taken-funcs", 
+                           llvm::cl::desc ("Externalize uses of address-taken functions"),
+                           llvm::cl::init (false));
+
+static llvm::cl::opt<int>
+SROA_Threshold ("sroa-threshold",
+                llvm::cl::desc ("Threshold for ScalarReplAggregates pass"),
+                llvm::cl::init(INT_MAX));
+
+static llvm::cl::opt<int>
+SROA_StructMemThreshold ("sroa-struct",
+                         llvm::cl::desc ("Structure threshold for ScalarReplAggregates"),
+                         llvm::cl::init (INT_MAX));
+
+static llvm::cl::opt<int>
+SROA_ArrayElementThreshold ("sroa-array",
+                            llvm::cl::desc ("Array threshold for ScalarReplAggregates"),
+                            llvm::cl::init (INT_MAX));
+
+static llvm::cl::opt<bool>
+PromoteArrays ("promote-arrays",
+               llvm::cl::desc ("Promote small local arrays accessed with variable "
+                               "indices to scalars"),
+               llvm::cl::init (false));
+
+static llvm::cl::opt<int>
+SROA_ScalarLoadThreshold ("sroa-scalar-load",
+                          llvm::cl::desc ("Scalar load threshold for ScalarReplAggregates"),
+                          llvm::cl::init (-1));
+
+namespace seahorn
+{
+  bool isInlineAll () { return InlineAll; }
+
+  void addPreProcessingPasses (llvm::PassManagerBase &pass_manager)
+  {
+    // -- Create a main function if we do not have one.
+    pass_manager.add (new seahorn::DummyMainFunction ());
+ 
+    // -- promote verifier specific functions to special names
+    pass_manager.add (new seahorn::PromoteVerifierCalls ());
+
+    // -- promote top-level mallocs to alloca
+    pass_manager.add (seahorn::createPromoteMallocPass ());
+
+    // -- turn loads from _Bool from truc to sgt
+    pass_manager.add (seahorn::createPromoteBoolLoadsPass ());
+
+    if (KillVaArg)
+      pass_manager.add (seahorn::createKillVarArgFnPass ());
+  
+    if (StripExtern)
+      pass_manager.add (seahorn::createStripUselessDeclarationsPass ());
+  
+    // -- mark entry points of all functions
+    if (!MixedSem && !CutLoops && !UnrollLoops)
+      // XXX should only be ran once. need better way to ensure that.
+      pass_manager.add (seahorn::createMarkFnEntryPass ());
+  
+    // turn all functions internal so that we can inline them if requested
+    pass_manager.add (llvm::createInternalizePass (llvm::ArrayRef<const char*>("main")));
+  
+    // -- resolve indirect calls
+    if (DevirtualizeFuncs)
+      pass_manager.add (seahorn::createDevirtualizeFunctionsPass ());
+  
+    // -- externalize uses of address-taken functions
+    if (ExternalizeAddrTakenFuncs)
+      pass_manager.add (seahorn::createExternalizeAddressTakenFunctionsPass ());
+
+    // kill internal unused code
+    pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
+  
+    // -- global optimizations
+    //pass_manager.add (llvm::createGlobalOptimizerPass());
+  
+    // -- SSA
+    pass_manager.add(llvm::createPromoteMemoryToRegisterPass());
+    // -- Turn undef into nondet
+    pass_manager.add (seahorn::createNondetInitPass ());
+  
+    // -- cleanup after SSA
+    pass_manager.add (seahorn::createInstCombine ());
+    pass_manager.add (llvm::createCFGSimplificationPass ());
+  
+    // -- small arrays with variable indices, promoted by SROA below.
+    // -- Not with bounds checks: promotion gives out-of-bounds
+    // -- accesses a meaning, so they could no longer be checked
+    if (PromoteArrays && !BoundsChecks)
+      pass_manager.add (seahorn::createPromoteSmallArraysPass ());
+
+    // -- break aggregates
+    pass_manager.add (llvm::createScalarReplAggregatesPass (SROA_Threshold,
+                                                            true,
+                                                            SROA_StructMemThreshold,
+                                                            SROA_ArrayElementThreshold,
+                                                            SROA_ScalarLoadThreshold));
+    // -- Turn undef into nondet (undef are created by SROA when it calls mem2reg)
+    pass_manager.add (seahorn::createNondetInitPass ());
+  
+    // -- cleanup after break aggregates
+    pass_manager.add (seahorn::createInstCombine ());
+    pass_manager.add (llvm::createCFGSimplificationPass ());
+  
+    // eliminate unused calls to verifier.nondet() functions
+    pass_manager.add (seahorn::createDeadNondetElimPass ());
+  
+    pass_manager.add(llvm::createLowerSwitchPass());
+  
+    pass_manager.add(llvm::createDeadInstEliminationPass());
+    pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
+
+    if (LowerInvoke) 
+    {
+      // -- lower invoke's
+      pass_manager.add(llvm::createLowerInvokePass());
+      // cleanup after lowering invoke's
+      pass_manager.add (llvm::createCFGSimplificationPass ());  
+    }
+  
+    if (InlineAll || InlineCost)
+    {
+      pass_manager.add (InlineAll ? seahorn::createMarkInternalInlinePass ()
+                        : seahorn::createMarkCostInlinePass ());
+      pass_manager.add (llvm::createAlwaysInlinerPass ());
+      pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
+      pass_manager.add (seahorn::createPromoteMallocPass ());
+      pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
+    }
+  
+    pass_manager.add(llvm::createDeadInstEliminationPass());
+    pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
+  
+    if (!MixedSem)
+      pass_manager.add (new seahorn::LowerGvInitializers ());
+    
+    pass_manager.add(llvm::createUnifyFunctionExitNodesPass ());
+
+    if (BoundsChecks)
+    { 
+      pass_manager.add (new seahorn::LowerCstExprPass ());
+      pass_manager.add (new seahorn::CanAccessMemory ());
+      pass_manager.add (new seahorn::BufferBoundsCheck ());
+      // -- Turn undef into nondet (undef might be created by
+      //    BufferBoundsCheck)
+      pass_manager.add (seahorn::createNondetInitPass ());
+    }
+
+    // -- local to functions. The bounds checks are not, they add
+    // -- arguments to functions
+    PassesFn checks = [] (llvm::PassManagerBase &pm)
+      {
+        if (OverflowChecks)
+        {
+          pm.add (new seahorn::LowerCstExprPass ());
+          pm.add (new seahorn::IntegerOverflowCheck ());
+        }
+
+        if (NullChecks)
+        {
+          pm.add (new seahorn::LowerCstExprPass ());
+          pm.add (new seahorn::NullCheck ());
+        }
+      };
+    if (PPThreads > 1 && (OverflowChecks || NullChecks))
+      pass_manager.add (createSplitModulePass (PPThreads, checks));
+    else
+      checks (pass_manager);
+
+    if (AccelLoops)
+    {
+      // -- after the checks, whose calls keep their loops
+      pass_manager.add (llvm::createLoopSimplifyPass ());
+      // -- fill and copy loops must be single blocks
+      pass_manager.add (llvm::createLoopRotatePass ());
+      pass_manager.add (llvm::createLCSSAPass ());
+      pass_manager.add (seahorn::createAccelerateLoopsPass ());
+      pass_manager.add (llvm::createCFGSimplificationPass ());
+    }
+
+    if (!MixedSem && EnumVerifierCalls)  
+    { 
+      pass_manager.add (seahorn::createEnumVerifierCallsPass ());
+    }
+
+    pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
+
+    if (SliceProgram)
+    {
+      pass_manager.add (seahorn::createSliceProgramPass ());
+      pass_manager.add (llvm::createGlobalDCEPass ()); // kill sliced functions
+    }
+
+    if (MixedSem)
+    {
+      pass_manager.add (new seahorn::MixedSemantics ());
+      pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
+      pass_manager.add (seahorn::createPromoteMallocPass ());
+    }
+
+    if (CutLoops || UnrollLoops)
+    {
+      pass_manager.add (llvm::createLoopSimplifyPass ());
+      if (UnrollLoops)
+      {
+        // -- the unroller needs loops whose latch exits
+        pass_manager.add (llvm::createLoopRotatePass ());
+        pass_manager.add (llvm::createLCSSAPass ());
+        pass_manager.add (seahorn::createUnrollLoopsPass ());
+        pass_manager.add (llvm::createLoopSimplifyPass ());
+      }
+      pass_manager.add (llvm::createLCSSAPass ());
+      pass_manager.add (seahorn::createCutLoopsPass ());
+      // pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
+    }
+  }
+
+  void addOptimizationPasses (llvm::PassManagerBase &pass_manager,
+                              unsigned level)
+  {
+    if (level == 0) return;
+
+    // -- like -O<level> but without the passes that seaopt disables
+    // -- by default (induction variables, loop idioms, vectorization)
+    pass_manager.add (llvm::createGlobalOptimizerPass ());
+    pass_manager.add (llvm::createIPSCCPPass ());
+    pass_manager.add (llvm::createDeadArgEliminationPass ());
+    pass_manager.add (llvm::createInstructionCombiningPass ());
+    pass_manager.add (llvm::createCFGSimplificationPass ());
+    if (level > 1)
+      pass_manager.add (llvm::createFunctionInliningPass (level, 0));
+    pass_manager.add (llvm::createFunctionAttrsPass ());
+
+    pass_manager.add (llvm::createSROAPass ());
+    pass_manager.add (llvm::createEarlyCSEPass ());
+    pass_manager.add (llvm::createJumpThreadingPass ());
+    pass_manager.add (llvm::createCorrelatedValuePropagationPass ());
+    pass_manager.add (llvm::createCFGSimplificationPass ());
+    pass_manager.add (llvm::createInstructionCombiningPass ());
+    pass_manager.add (llvm::createReassociatePass ());
+    pass_manager.add (llvm::createLoopRotatePass ());
+    pass_manager.add (llvm::createLICMPass ());
+    pass_manager.add (llvm::createInstructionCombiningPass ());
+    pass_manager.add (llvm::createLoopDeletionPass ());
+    if (level > 1) pass_manager.add (llvm::createGVNPass ());
+    pass_manager.add (llvm::createSCCPPass ());
+    pass_manager.add (llvm::createInstructionCombiningPass ());
+    pass_manager.add (llvm::createJumpThreadingPass ());
+    pass_manager.add (llvm::createCorrelatedValuePropagationPass ());
+    pass_manager.add (llvm::createDeadStoreEliminationPass ());
+    pass_manager.add (llvm::createAggressiveDCEPass ());
+    pass_manager.add (llvm::createCFGSimplificationPass ());
+    pass_manager.add (llvm::createInstructionCombiningPass ());
+
+    pass_manager.add (llvm::createGlobalDCEPass ());
+    pass_manager.add (llvm::createConstantMergePass ());
+  }
+}
@@ -0,0 +1,218 @@
+///
+// Function-local passes run on partitions of the module in parallel
+///
+#include "llvm/PassManager.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "seahorn/Pipeline.hh"
+#include "seahorn/Support/TaskPool.hh"
+
+#include "avy/AvyDebug.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <vector>
+
+namespace
+{
+  using namespace llvm;
+
+  /// Splits the module into partitions of whole call graph
+  /// components, runs the passes of m_addPasses on each partition in
+  /// its own LLVMContext and links the partitions back.
+  ///
+  /// A partition is a copy of the module in which only the functions
+  /// of the partition keep their bodies, so its passes must not change
+  /// the interface of a function, e.g., its arguments. Local symbols
+  /// are made external while the module is split, so that the
+  /// partitions link to the definitions of the module, and get their
+  /// linkage back afterwards
+  class SplitModulePass : public ModulePass
+  {
+    unsigned m_threads;
+    seahorn::PassesFn m_addPasses;
+
+    /// assigns the functions with a body to at most m_threads
+    /// partitions, balanced by their number of instructions
+    void partition (Module &M, std::vector<std::vector<std::string> > &parts);
+
+    /// runs the passes of m_addPasses on all of M
+    bool runPasses (Module &M)
+    {
+      PassManager pm;
+      if (M.getDataLayout ()) pm.add (new DataLayoutPass ());
+      m_addPasses (pm);
+      return pm.run (M);
+    }
+
+    /// the bitcode of partition part of the module in bc, after the
+    /// passes. Runs in a worker
+    bool runOnPartition (StringRef bc, const std::vector<std::string> &part,
+                         std::string &out, std::string &err);
+
+  public:
+    static char ID;
+    SplitModulePass (unsigned threads, seahorn::PassesFn addPasses) :
+      ModulePass (ID), m_threads (threads), m_addPasses (addPasses) {}
+
+    virtual bool runOnModule (Module &M);
+    virtual void getAnalysisUsage (AnalysisUsage &AU) const
+    { AU.addRequired<CallGraphWrapperPass> (); }
+    virtual const char *getPassName () const { return "SplitModule"; }
+  };
+
+  char SplitModulePass::ID = 0;
+
+  void SplitModulePass::partition (Module &M,
+                                   std::vector<std::vector<std::string> > &parts)
+  {
+    CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
+
+    // -- a component stays in one partition. The largest ones first,
+    // -- each in the partition with the fewest instructions
+    std::vector<std::pair<size_t, std::vector<const Function*> > > sccs;
+    for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
+    {
+      std::vector<const Function*> fns;
+      size_t size = 0;
+      for (CallGraphNode *cgn : *it)
+      {
+        const Function *f = cgn->getFunction ();
+        if (!f || f->isDeclaration ()) continue;
+        fns.push_back (f);
+        for (const BasicBlock &bb : *f) size += bb.size ();
+      }
+      if (!fns.empty ()) sccs.push_back (std::make_pair (size, fns));
+    }
+    std::stable_sort (sccs.begin (), sccs.end (),
+                      [] (const std::pair<size_t, std::vector<const Function*> > &a,
+                          const std::pair<size_t, std::vector<const Function*> > &b)
+                      { return a.first > b.first; });
+
+    parts.assign (std::min<size_t> (m_threads, sccs.size ()), std::vector<std::string> ());
+    std::vector<size_t> sizes (parts.size (), 0);
+    for (auto &scc : sccs)
+    {
+      size_t p = std::min_element (sizes.begin (), sizes.end ()) - sizes.begin ();
+      sizes [p] += scc.first;
+      for (const Function *f : scc.second) parts [p].push_back (f->getName ());
+    }
+  }
+
+  bool SplitModulePass::runOnPartition (StringRef bc,
+                                        const std::vector<std::string> &part,
+                                        std::string &out, std::string &err)
+  {
+    LLVMContext ctx;
+    ErrorOr<Module*> res = parseBitcodeFile (MemoryBufferRef (bc, "partition"), ctx);
+    if (std::error_code ec = res.getError ())
+    {
+      err = ec.message ();
+      return false;
+    }
+    std::unique_ptr<Module> P (res.get ());
+
+    // -- only the functions of the partition keep their bodies. The
+    // -- globals are dropped once linked
+    std::set<std::string> keep (part.begin (), part.end ());
+    for (Function &F : *P)
+      if (!F.isDeclaration () && !keep.count (F.getName ())) F.deleteBody ();
+    for (GlobalVariable &gv : P->globals ())
+      if (gv.hasInitializer ())
+      {
+        gv.setInitializer (nullptr);
+        gv.setLinkage (GlobalValue::ExternalLinkage);
+      }
+
+    runPasses (*P);
+    // -- the module keeps its own, e.g., the debug info and the flags
+    std::vector<NamedMDNode*> mds;
+    for (auto it = P->named_metadata_begin (), et = P->named_metadata_end ();
+         it != et; ++it)
+      mds.push_back (&*it);
+    for (NamedMDNode *md : mds) md->eraseFromParent ();
+
+    raw_string_ostream os (out);
+    WriteBitcodeToFile (P.get (), os);
+    os.flush ();
+    return true;
+  }
+
+  bool SplitModulePass::runOnModule (Module &M)
+  {
+    std::vector<std::vector<std::string> > parts;
+    partition (M, parts);
+    // -- an alias would be defined by every partition
+    if (parts.size () < 2 || !M.alias_empty ()) return runPasses (M);
+
+    // -- local symbols are linked by name, and unnamed ones get a name
+    std::map<std::string, GlobalValue::LinkageTypes> local;
+    auto externalize = [&] (GlobalValue &gv)
+      {
+        if (!gv.hasLocalLinkage ()) return;
+        if (!gv.hasName ()) gv.setName ("seapp.anon");
+        local [gv.getName ()] = gv.getLinkage ();
+        gv.setLinkage (GlobalValue::ExternalLinkage);
+      };
+    for (Function &F : M) externalize (F);
+    for (GlobalVariable &gv : M.globals ()) externalize (gv);
+
+    std::string bc;
+    {
+      raw_string_ostream os (bc);
+      WriteBitcodeToFile (&M, os);
+    }
+
+    std::vector<std::string> outs (parts.size ()), errors (parts.size ());
+    std::vector<char> ok (parts.size (), false);
+    {
+      seahorn::TaskPool pool ("seapp.partitions", m_threads);
+      pool.run (parts.size (), [&] (unsigned, size_t k)
+                { ok [k] = runOnPartition (bc, parts [k], outs [k], errors [k]); });
+    }
+
+    for (size_t k = 0; k < parts.size (); ++k)
+    {
+      if (!ok [k])
+      {
+        errs () << "ERROR: cannot split the module: " << errors [k] << "\n";
+        std::exit (3);
+      }
+      // -- the linked bodies replace those of the module
+      for (const std::string &name : parts [k])
+        if (Function *F = M.getFunction (name)) F->deleteBody ();
+
+      ErrorOr<Module*> res =
+        parseBitcodeFile (MemoryBufferRef (outs [k], "partition"), M.getContext ());
+      std::unique_ptr<Module> P (res ? res.get () : nullptr);
+      if (!P || Linker::LinkModules (&M, P.get ()))
+      {
+        errs () << "ERROR: cannot link partition " << k << " back\n";
+        std::exit (3);
+      }
+    }
+
+    for (auto &kv : local)
+      if (GlobalValue *gv = M.getNamedValue (kv.first)) gv->setLinkage (kv.second);
+
+    LOG ("split-module",
+         errs () << "split into " << parts.size () << " partitions\n";);
+    return true;
+  }
+}
+
+namespace seahorn
+{
+  ModulePass *createSplitModulePass (unsigned threads, PassesFn addPasses)
+  { return new SplitModulePass (threads, addPasses); }
+}
@@ -0,0 +1,93 @@
+#include "seahorn/Support/GzipStream.hh"
+#include "seahorn/config.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace seahorn
+{
+#ifdef HAVE_ZLIB
+  struct raw_gzip_ostream::State
+  {
+    z_stream zs;
+    bool closed;
+    char buf [1 << 16];
+  };
+
+  raw_gzip_ostream::raw_gzip_ostream (raw_ostream &out, int level) :
+    m_out (out), m_state (new State ()), m_pos (0)
+  {
+    m_state->closed = false;
+    // -- 16 + MAX_WBITS selects the gzip header and trailer
+    if (deflateInit2 (&m_state->zs, level, Z_DEFLATED, 16 + MAX_WBITS,
+                      8, Z_DEFAULT_STRATEGY) != Z_OK)
+      m_state.reset ();
+  }
+
+  void raw_gzip_ostream::write_impl (const char *ptr, size_t size)
+  {
+    m_pos += size;
+    if (!m_state || m_state->closed)
+    {
+      m_out.write (ptr, size);
+      return;
+    }
+
+    z_stream &zs = m_state->zs;
+    zs.next_in = reinterpret_cast<Bytef*> (const_cast<char*> (ptr));
+    zs.avail_in = size;
+    do
+    {
+      zs.next_out = reinterpret_cast<Bytef*> (m_state->buf);
+      zs.avail_out = sizeof (m_state->buf);
+      deflate (&zs, Z_NO_FLUSH);
+      m_out.write (m_state->buf, sizeof (m_state->buf) - zs.avail_out);
+    } while (zs.avail_out == 0);
+  }
+
+  void raw_gzip_ostream::close ()
+  {
+    flush ();
+    if (!m_state || m_state->closed) return;
+
+    z_stream &zs = m_state->zs;
+    zs.next_in = nullptr;
+    zs.avail_in = 0;
+    int ret;
+    do
+    {
+      zs.next_out = reinterpret_cast<Bytef*> (m_state->buf);
+      zs.avail_out = sizeof (m_state->buf);
+      ret = deflate (&zs, Z_FINISH);
+      m_out.write (m_state->buf, sizeof (m_state->buf) - zs.avail_out);
+    } while (ret == Z_OK);
+    deflateEnd (&zs);
+    m_state->closed = true;
+    m_out.flush ();
+  }
+
+  bool raw_gzip_ostream::compresses () { return true; }
+#else
+  struct raw_gzip_ostream::State {};
+
+  raw_gzip_ostream::raw_gzip_ostream (raw_ostream &out, int) :
+    m_out (out), m_pos (0) {}
+
+  void raw_gzip_ostream::write_impl (const char *ptr, size_t size)
+  {
+    m_pos += size;
+    m_out.write (ptr, size);
+  }
+
+  void raw_gzip_ostream::close ()
+  {
+    flush ();
+    m_out.flush ();
+  }
+
+  bool raw_gzip_ostream::compresses () { return false; }
+#endif
+
+  raw_gzip_ostream::~raw_gzip_ostream () { close (); }
+}
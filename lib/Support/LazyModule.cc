@@ -0,0 +1,143 @@
+#include "seahorn/Support/LazyModule.hh"
+
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ufo/Stats.hh"
+
+static llvm::cl::opt<bool>
+LazyLoad ("lazy-load",
+          llvm::cl::desc ("Parse only the bodies of the functions reachable "
+                          "from the entry function"),
+          llvm::cl::init (false));
+
+static llvm::cl::opt<std::string>
+Entry ("entry",
+       llvm::cl::desc ("Entry function of --lazy-load"),
+       llvm::cl::init ("main"), llvm::cl::value_desc ("function"));
+
+namespace
+{
+  using namespace llvm;
+
+  /// Functions reachable from the entry: the functions that the
+  /// parsed bodies reference, directly or through the initializers of
+  /// the globals they reference. Referenced rather than called, so
+  /// that the targets of indirect calls are kept
+  class Reachable
+  {
+    DenseSet<const Value*> m_seen;
+    SmallVector<Function*, 64> m_functions;
+
+  public:
+    void visit (Value *v)
+    {
+      SmallVector<Value*, 16> stack;
+      stack.push_back (v);
+      while (!stack.empty ())
+      {
+        Value *u = stack.pop_back_val ();
+        // -- basic blocks of block addresses are not constants
+        if (!isa<Constant> (u) || m_seen.count (u)) continue;
+        m_seen.insert (u);
+
+        if (Function *f = dyn_cast<Function> (u))
+          m_functions.push_back (f);
+        else if (GlobalVariable *gv = dyn_cast<GlobalVariable> (u))
+        {
+          if (gv->hasInitializer ()) stack.push_back (gv->getInitializer ());
+        }
+        else if (GlobalAlias *ga = dyn_cast<GlobalAlias> (u))
+          stack.push_back (ga->getAliasee ());
+        else
+          for (Value *op : cast<Constant> (u)->operands ())
+            stack.push_back (op);
+      }
+    }
+
+    /// next function to parse. Null when there is none
+    Function *next ()
+    { return m_functions.empty () ? nullptr : m_functions.pop_back_val (); }
+
+    bool reached (const Function &f) const { return m_seen.count (&f); }
+  };
+}
+
+namespace seahorn
+{
+  std::unique_ptr<Module> loadModule (StringRef filename, SMDiagnostic &err,
+                                      LLVMContext &context)
+  {
+    if (!LazyLoad) return parseIRFile (filename, err, context);
+
+    ufo::ScopedStats _st ("lazy_load");
+    std::unique_ptr<Module> module = getLazyIRFileModule (filename, err, context);
+    if (!module) return module;
+
+    auto fail = [&] (const std::error_code &ec)
+      {
+        err = SMDiagnostic (filename, SourceMgr::DK_Error, ec.message ());
+        return std::unique_ptr<Module> ();
+      };
+
+    Function *entry = module->getFunction (Entry);
+    if (!entry)
+    {
+      errs () << "WARNING: no entry function " << Entry
+              << ", reading the whole module\n";
+      if (std::error_code ec = module->materializeAllPermanently ())
+        return fail (ec);
+      return module;
+    }
+
+    Reachable reach;
+    reach.visit (entry);
+    // -- llvm.used, llvm.global_ctors, ... keep what they reference
+    for (GlobalVariable &gv : module->globals ())
+      if (gv.getName ().startswith ("llvm.")) reach.visit (&gv);
+
+    unsigned parsed = 0;
+    while (Function *f = reach.next ())
+    {
+      if (!f->isMaterializable ()) continue;
+      if (std::error_code ec = f->materialize ()) return fail (ec);
+      ++parsed;
+      for (BasicBlock &bb : *f)
+        for (Instruction &inst : bb)
+          for (Value *op : inst.operands ()) reach.visit (op);
+    }
+
+    // -- the bodies that were not parsed are replaced by declarations
+    // -- so that nothing parses them later
+    std::vector<Function*> pruned;
+    for (Function &f : *module)
+      if (f.isMaterializable () && !reach.reached (f)) pruned.push_back (&f);
+    for (Function *f : pruned)
+    {
+      Function *decl = Function::Create (f->getFunctionType (),
+                                         GlobalValue::ExternalLinkage,
+                                         "", module.get ());
+      decl->takeName (f);
+      decl->setAttributes (f->getAttributes ());
+      decl->setCallingConv (f->getCallingConv ());
+      f->replaceAllUsesWith (decl);
+      f->eraseFromParent ();
+    }
+
+    // -- nothing is left to parse but the metadata; drops the reader
+    if (std::error_code ec = module->materializeAllPermanently ())
+      return fail (ec);
+
+    ufo::Stats::uset ("LazyLoadParsed", parsed);
+    ufo::Stats::uset ("LazyLoadPruned", pruned.size ());
+    return module;
+  }
+}
@@ -0,0 +1,198 @@
+#include "seahorn/Support/PassProfiler.hh"
+
+#include "llvm/Pass.h"
+#include "llvm/Analysis/CallGraphSCCPass.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ufo/Stats.hh"
+
+#include <deque>
+
+static llvm::cl::opt<std::string>
+ProfileJson ("profile-json",
+             llvm::cl::desc ("Write statistics, phases and the time of "
+                             "every pass as JSON to this file"),
+             llvm::cl::init (""), llvm::cl::value_desc ("filename"));
+
+namespace
+{
+  using namespace llvm;
+
+  /// times of one pass of a pipeline
+  struct PassTimes
+  {
+    std::string pipeline;
+    std::string name;
+    unsigned runs;
+    double wall;
+    double cpu;
+    /// times of the last start
+    double wall0;
+    double cpu0;
+
+    PassTimes (const std::string &p, const std::string &n) :
+      pipeline (p), name (n), runs (0), wall (0), cpu (0), wall0 (0), cpu0 (0) {}
+
+    void start ()
+    {
+      wall0 = ufo::Stats::wallTime ();
+      cpu0 = ufo::Stats::cpuTime ();
+    }
+
+    void stop ()
+    {
+      ++runs;
+      wall += ufo::Stats::wallTime () - wall0;
+      cpu += ufo::Stats::cpuTime () - cpu0;
+    }
+  };
+
+  /// in the order the passes were added
+  std::deque<PassTimes> passTimes;
+
+  void printPasses (raw_ostream &OS)
+  {
+    OS << "[";
+    bool first = true;
+    for (const PassTimes &t : passTimes)
+    {
+      OS << (first ? "" : ",") << "\n{\"pipeline\": \"" << t.pipeline
+         << "\", \"name\": \"";
+      first = false;
+      // -- pass names are plain text, only quotes need escaping
+      for (char c : t.name) { if (c == '"') OS << '\\'; OS << c; }
+      OS << "\", \"runs\": " << t.runs
+         << ", \"wall\": " << format ("%.6f", t.wall)
+         << ", \"cpu\": " << format ("%.6f", t.cpu) << "}";
+    }
+    OS << "]";
+  }
+
+  // -- markers that start and stop the times of a pass. Each kind of
+  // -- pass gets a marker of the same kind so that the markers run in
+  // -- the same pass manager as the pass, e.g., on every function
+  // -- together with a function pass, and do not split its pipeline
+
+  struct ModuleMarker : public ModulePass
+  {
+    static char ID;
+    PassTimes &m_t;
+    bool m_start;
+    ModuleMarker (PassTimes &t, bool start) :
+      ModulePass (ID), m_t (t), m_start (start) {}
+    bool runOnModule (Module &M) override
+    { if (m_start) m_t.start (); else m_t.stop (); return false; }
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    { AU.setPreservesAll (); }
+    const char *getPassName () const override { return "ModuleMarker"; }
+  };
+  char ModuleMarker::ID = 0;
+
+  struct FunctionMarker : public FunctionPass
+  {
+    static char ID;
+    PassTimes &m_t;
+    bool m_start;
+    FunctionMarker (PassTimes &t, bool start) :
+      FunctionPass (ID), m_t (t), m_start (start) {}
+    bool runOnFunction (Function &F) override
+    { if (m_start) m_t.start (); else m_t.stop (); return false; }
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    { AU.setPreservesAll (); }
+    const char *getPassName () const override { return "FunctionMarker"; }
+  };
+  char FunctionMarker::ID = 0;
+
+  struct SCCMarker : public CallGraphSCCPass
+  {
+    static char ID;
+    PassTimes &m_t;
+    bool m_start;
+    SCCMarker (PassTimes &t, bool start) :
+      CallGraphSCCPass (ID), m_t (t), m_start (start) {}
+    bool runOnSCC (CallGraphSCC &SCC) override
+    { if (m_start) m_t.start (); else m_t.stop (); return false; }
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    {
+      CallGraphSCCPass::getAnalysisUsage (AU);
+      AU.setPreservesAll ();
+    }
+    const char *getPassName () const override { return "SCCMarker"; }
+  };
+  char SCCMarker::ID = 0;
+
+  struct LoopMarker : public LoopPass
+  {
+    static char ID;
+    PassTimes &m_t;
+    bool m_start;
+    LoopMarker (PassTimes &t, bool start) :
+      LoopPass (ID), m_t (t), m_start (start) {}
+    bool runOnLoop (Loop *L, LPPassManager &LPM) override
+    { if (m_start) m_t.start (); else m_t.stop (); return false; }
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    { AU.setPreservesAll (); }
+    const char *getPassName () const override { return "LoopMarker"; }
+  };
+  char LoopMarker::ID = 0;
+
+  template <typename Marker>
+  void addMarked (PassManager &pm, Pass *P, PassTimes &t)
+  {
+    pm.PassManager::add (new Marker (t, true));
+    pm.PassManager::add (P);
+    pm.PassManager::add (new Marker (t, false));
+  }
+}
+
+namespace seahorn
+{
+  ProfilingPassManager::ProfilingPassManager (StringRef pipeline) :
+    m_pipeline (pipeline)
+  {
+    if (!ProfileJson.empty ())
+      ufo::Stats::addJsonSection ("passes", printPasses);
+  }
+
+  void ProfilingPassManager::add (Pass *P)
+  {
+    if (ProfileJson.empty () || P->getAsImmutablePass ())
+    {
+      PassManager::add (P);
+      return;
+    }
+
+    passTimes.emplace_back (m_pipeline, P->getPassName ());
+    PassTimes &t = passTimes.back ();
+    switch (P->getPassKind ())
+    {
+    case PT_Module: addMarked<ModuleMarker> (*this, P, t); break;
+    case PT_Function: addMarked<FunctionMarker> (*this, P, t); break;
+    case PT_CallGraphSCC: addMarked<SCCMarker> (*this, P, t); break;
+    case PT_Loop: addMarked<LoopMarker> (*this, P, t); break;
+    default:
+      // -- basic block and region passes are not timed
+      passTimes.pop_back ();
+      PassManager::add (P);
+    }
+  }
+
+  void writeProfile ()
+  {
+    if (ProfileJson.empty ()) return;
+
+    std::error_code ec;
+    raw_fd_ostream out (ProfileJson, ec, sys::fs::F_Text);
+    if (ec)
+    {
+      errs () << "WARNING: cannot write profile to " << ProfileJson << ": "
+              << ec.message () << "\n";
+      return;
+    }
+    ufo::Stats::PrintJson (out);
+  }
+}
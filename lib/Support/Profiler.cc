@@ -11,7 +11,10 @@
 #include "llvm/Analysis/Passes.h"
 #include "llvm/Analysis/MemoryBuiltins.h"
 #include "llvm/Analysis/CallGraph.h"
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ValueTracking.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/Statistic.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/ADT/StringExtras.h"
@@ -26,9 +29,11 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Format.h"
+#include "llvm/Support/FileSystem.h"
 #include "llvm/Target/TargetLibraryInfo.h"
 
 #include <boost/unordered_map.hpp>
+#include <cstring>
 
 using namespace llvm;
 
@@ -169,6 +174,8 @@ namespace seahorn {
     const DataLayout* DL;
     TargetLibraryInfo* TLI;
     StringSet<> ExtFuncs;
+    /// if not empty, only the features are computed and written here
+    std::string FeaturesFile;
 
     unsigned int TotalFuncs;
     unsigned int TotalBlocks;
@@ -307,14 +314,150 @@ namespace seahorn {
       llvm_unreachable(nullptr);
     }
 
+    /// Features of a program that predict how hard it is for the
+    /// different engines. Computed in a single pass over the module.
+    struct Features {
+      unsigned Insts, Blocks, Funcs;
+      unsigned Loops, MaxLoopDepth;
+      /// loop headers, function entries and exits, as in the cut
+      /// point graph of the encoding
+      unsigned CutPoints;
+      /// distinct objects accessed by loads and stores
+      unsigned Regions;
+      /// predicted arity of the relations of the loop headers: live
+      /// scalars (PHI nodes) plus the regions of the function
+      unsigned MaxArity;
+      double AvgArity;
+      unsigned Assertions, Assumptions;
+      /// GEPs with a variable index and memory intrinsics
+      unsigned ArrayOps;
+      /// bitwise operations and shifts on integers wider than i1
+      unsigned BvOps;
+      unsigned Sccs, RecursiveSccs, MaxSccSize;
+    };
+
+    static bool isBvOp (const Instruction &I) {
+      switch (I.getOpcode ()) {
+      case Instruction::And: case Instruction::Or: case Instruction::Xor:
+        return !I.getType ()->isIntegerTy (1);
+      case Instruction::Shl: case Instruction::LShr: case Instruction::AShr:
+        return true;
+      default:
+        return false;
+      }
+    }
+
+    void computeFeatures (Module &M, Features &Ft) {
+      std::memset (&Ft, 0, sizeof (Ft));
+      SmallPtrSet<const Value*, 64> regions;
+      unsigned headers = 0, arities = 0;
+
+      for (Function &F : M) {
+        if (F.isDeclaration ()) continue;
+        ++Ft.Funcs;
+
+        SmallPtrSet<const Value*, 32> fregions;
+        bool hasExit = false;
+        for (BasicBlock &BB : F) {
+          ++Ft.Blocks;
+          if (isa<ReturnInst> (BB.getTerminator ())) hasExit = true;
+          for (Instruction &I : BB) {
+            ++Ft.Insts;
+            const Value *ptr = nullptr;
+            if (LoadInst *LI = dyn_cast<LoadInst> (&I))
+              ptr = LI->getPointerOperand ();
+            else if (StoreInst *SI = dyn_cast<StoreInst> (&I))
+              ptr = SI->getPointerOperand ();
+            if (ptr)
+              fregions.insert (GetUnderlyingObject (const_cast<Value*> (ptr), DL));
+
+            if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst> (&I)) {
+              if (!GEP->hasAllConstantIndices ()) ++Ft.ArrayOps;
+            }
+            else if (isa<MemIntrinsic> (&I)) ++Ft.ArrayOps;
+            else if (isBvOp (I)) ++Ft.BvOps;
+            else if (CallInst *CI = dyn_cast<CallInst> (&I)) {
+              Function *callee = CI->getCalledFunction ();
+              if (!callee) continue;
+              StringRef n = callee->getName ();
+              if (n == "verifier.error" || n == "__VERIFIER_error" ||
+                  n == "verifier.assert" || n == "__VERIFIER_assert")
+                ++Ft.Assertions;
+              else if (n == "verifier.assume" || n == "__VERIFIER_assume" ||
+                       n == "verifier.assume.not")
+                ++Ft.Assumptions;
+            }
+          }
+        }
+        regions.insert (fregions.begin (), fregions.end ());
+
+        Ft.CutPoints += 1 + (hasExit ? 1 : 0);
+        LoopInfo &LI = getAnalysis<LoopInfo> (F);
+        std::vector<Loop*> work (LI.begin (), LI.end ());
+        while (!work.empty ()) {
+          Loop *L = work.back ();
+          work.pop_back ();
+          work.insert (work.end (), L->begin (), L->end ());
+          ++Ft.Loops;
+          ++Ft.CutPoints;
+          Ft.MaxLoopDepth = std::max (Ft.MaxLoopDepth, L->getLoopDepth ());
+
+          unsigned phis = 0;
+          for (Instruction &I : *L->getHeader ()) {
+            if (!isa<PHINode> (I)) break;
+            if (!I.getType ()->isPointerTy ()) ++phis;
+          }
+          unsigned arity = phis + fregions.size ();
+          Ft.MaxArity = std::max (Ft.MaxArity, arity);
+          arities += arity;
+          ++headers;
+        }
+      }
+      Ft.Regions = regions.size ();
+      Ft.AvgArity = headers > 0 ? (double) arities / headers : 0.0;
+
+      CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
+      for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it) {
+        unsigned sz = 0;
+        for (CallGraphNode *cgn : *it)
+          if (cgn->getFunction () && !cgn->getFunction ()->isDeclaration ()) ++sz;
+        if (sz == 0) continue;
+        ++Ft.Sccs;
+        Ft.MaxSccSize = std::max (Ft.MaxSccSize, sz);
+        if (it.hasLoop ()) ++Ft.RecursiveSccs;
+      }
+    }
+
+    void writeFeatures (const Features &Ft, raw_ostream &O) {
+      double insts = Ft.Insts > 0 ? Ft.Insts : 1;
+      O << "{\"insts\": " << Ft.Insts
+        << ", \"blocks\": " << Ft.Blocks
+        << ", \"functions\": " << Ft.Funcs
+        << ", \"loops\": " << Ft.Loops
+        << ", \"max_loop_depth\": " << Ft.MaxLoopDepth
+        << ", \"cutpoints\": " << Ft.CutPoints
+        << ", \"regions\": " << Ft.Regions
+        << ", \"max_arity\": " << Ft.MaxArity
+        << ", \"avg_arity\": " << format ("%.2f", Ft.AvgArity)
+        << ", \"assertions\": " << Ft.Assertions
+        << ", \"assumptions\": " << Ft.Assumptions
+        << ", \"array_ops\": " << Ft.ArrayOps
+        << ", \"array_intensity\": " << format ("%.4f", Ft.ArrayOps / insts)
+        << ", \"bv_ops\": " << Ft.BvOps
+        << ", \"bv_intensity\": " << format ("%.4f", Ft.BvOps / insts)
+        << ", \"sccs\": " << Ft.Sccs
+        << ", \"recursive_sccs\": " << Ft.RecursiveSccs
+        << ", \"max_scc_size\": " << Ft.MaxSccSize << "}\n";
+    }
+
   public:
 
     static char ID; 
 
-    Profiler() : 
+    Profiler (const std::string &featuresFile = "") : 
         ModulePass(ID),
         CounterId (0),
-        DL (nullptr), TLI (nullptr),
+        DL (nullptr), TLI (nullptr), FeaturesFile (featuresFile),
         TotalFuncs (0), TotalBlocks (0), TotalJoins (0), TotalInsts (0),
         TotalDirectCalls (0), TotalExternalCalls (0), TotalIndirectCalls (0),
         ////////
@@ -336,6 +479,23 @@ namespace seahorn {
       DL = &getAnalysis<DataLayoutPass>().getDataLayout ();
       TLI = &getAnalysis<TargetLibraryInfo>();
 
+      if (!FeaturesFile.empty ()) {
+        Features Ft;
+        computeFeatures (M, Ft);
+        if (FeaturesFile == "-") {
+          writeFeatures (Ft, outs ());
+          return false;
+        }
+        std::error_code ec;
+        raw_fd_ostream out (FeaturesFile, ec, sys::fs::F_Text);
+        if (ec)
+          errs () << "ERROR: cannot write features to " << FeaturesFile
+                  << ": " << ec.message () << "\n";
+        else
+          writeFeatures (Ft, out);
+        return false;
+      }
+
       /// Look at the callgraph 
       // CallGraphWrapperPass *cgwp = &getAnalysis<CallGraphWrapperPass> ();
       // if (cgwp) {
@@ -420,6 +580,7 @@ namespace seahorn {
       AU.addRequired<llvm::DataLayoutPass>();
       AU.addRequired<llvm::CallGraphWrapperPass>();
       AU.addRequired<llvm::TargetLibraryInfo>();
+      AU.addRequired<llvm::LoopInfo>();
       AU.addPreserved<CallGraphWrapperPass> ();
     }
 
@@ -561,6 +722,10 @@ namespace seahorn {
     return new Profiler(); 
   }
 
+  Pass *createFeaturesPass (const std::string &file) {
+    return new Profiler (file);
+  }
+
   } // end namespace crabllvm
 
 
@@ -1,5 +1,20 @@
 #include "ufo/Stats.hh"
+#include "ufo/MemoryBudget.hpp"
+#include "ufo/Trace.hh"
+#include "llvm/Support/CommandLine.h"
+#include <cctype>
 #include <iostream>
+#include <mutex>
+
+#include <time.h>
+
+static llvm::cl::opt<unsigned, true>
+MemBudget ("mem-budget",
+           llvm::cl::desc ("Flush the caches of terms and queries, least "
+                           "recently used first, while the resident set "
+                           "size is above this many MB (0 = no budget)"),
+           llvm::cl::location (ufo::MemoryBudget::budgetMb ()),
+           llvm::cl::value_desc ("MB"));
 
 namespace ufo
 {
@@ -7,29 +22,240 @@ namespace ufo
   std::map<std::string,Stopwatch> Stats::sw;
   std::map<std::string,Averager> Stats::av;
   std::map<std::string,std::string> Stats::ss;
+  std::map<std::string,std::function<void ()> > Stats::hooks;
+  std::map<std::string,
+           std::function<void (llvm::raw_ostream&)> > Stats::jsonSections;
+  std::map<std::string,std::unique_ptr<StatsCounter> > Stats::handles;
+  std::map<std::string,std::unique_ptr<StatsSampleTimer> > Stats::sampleTimers;
+  std::map<std::string,std::unique_ptr<StatsHistogram> > Stats::histograms;
+
+  namespace
+  {
+    /// root of the phases. Guarded by phaseLock
+    StatsPhase rootPhase ("", nullptr);
+    std::mutex phaseLock;
+    /// innermost open phase of the thread, or null for the root
+    thread_local StatsPhase *curPhase = nullptr;
+    /// guards the registration of counter handles, sampling timers
+    /// and histograms
+    std::mutex handleLock;
+
+    void printJsonString (const std::string &s, llvm::raw_ostream &OS)
+    {
+      OS << '"';
+      for (unsigned char c : s)
+      {
+        if (c == '"' || c == '\\') OS << '\\' << c;
+        else if (c < 0x20) OS << llvm::format ("\\u%04x", c);
+        else OS << c;
+      }
+      OS << '"';
+    }
+
+    void printJsonPhases (const StatsPhase &p, llvm::raw_ostream &OS)
+    {
+      OS << "[";
+      bool first = true;
+      for (auto &c : p.children)
+      {
+        OS << (first ? "" : ",") << "\n{\"name\": ";
+        first = false;
+        printJsonString (c->name, OS);
+        OS << ", \"calls\": " << c->calls
+           << ", \"wall\": " << llvm::format ("%.6f", c->wall)
+           << ", \"cpu\": " << llvm::format ("%.6f", c->cpu)
+           << ", \"max_rss_kb\": " << c->maxRss
+           << ", \"rss_growth_kb\": " << c->rssGrowth
+           << ", \"phases\": ";
+        printJsonPhases (*c, OS);
+        OS << "}";
+      }
+      OS << "]";
+    }
+
+    /// name of a metric: sea_ followed by name with the characters
+    /// that Prometheus does not allow replaced by _
+    std::string promName (const std::string &name)
+    {
+      std::string res = "sea_";
+      for (char c : name)
+        res += (isalnum ((unsigned char) c) || c == '_') ? c : '_';
+      return res;
+    }
+  }
   
   void Stats::count (const std::string &name) { ++counters[name]; }
   double Stats::avg (const std::string &n, double v) { return av[n].add (v); }
   unsigned Stats::uset (const std::string &n, unsigned v)
   { return counters [n] = v; }
-  unsigned Stats::get (const std::string &n) { return counters [n]; }
+  unsigned Stats::get (const std::string &n) 
+  { 
+    unsigned r = counters [n];
+    std::lock_guard<std::mutex> lock (handleLock);
+    auto it = handles.find (n);
+    if (it != handles.end ()) r += it->second->value ();
+    return r;
+  }
 
   void Stats::sset (const std::string &n, std::string v) {ss [n] = v;}
   std::string& Stats::sget (const std::string &n) {return ss[n];}
   
-  void Stats::start (const std::string &name) { sw[name].start (); }
-  void Stats::stop (const std::string &name) { sw[name].stop (); }
-  void Stats::resume (const std::string &name) { sw[name].resume (); }
+  StatsCounter &Stats::counter (const std::string &name)
+  {
+    std::lock_guard<std::mutex> lock (handleLock);
+    std::unique_ptr<StatsCounter> &c = handles [name];
+    if (!c) c.reset (new StatsCounter (name));
+    return *c;
+  }
+
+  StatsSampleTimer &Stats::sampleTimer (const std::string &name,
+                                        unsigned period)
+  {
+    std::lock_guard<std::mutex> lock (handleLock);
+    std::unique_ptr<StatsSampleTimer> &t = sampleTimers [name];
+    if (!t) t.reset (new StatsSampleTimer (name, period));
+    return *t;
+  }
+
+  StatsHistogram &Stats::histogram (const std::string &name,
+                                    const std::vector<double> &bounds)
+  {
+    static const std::vector<double> latency =
+      {0.01, 0.1, 0.5, 1, 5, 10, 30, 60, 300, 900, 3600};
+    std::lock_guard<std::mutex> lock (handleLock);
+    std::unique_ptr<StatsHistogram> &h = histograms [name];
+    if (!h) h.reset (new StatsHistogram (name, bounds.empty () ? latency : bounds));
+    return *h;
+  }
+
+  std::map<std::string,unsigned long> Stats::allCounters ()
+  {
+    std::map<std::string,unsigned long> res (counters.begin (), counters.end ());
+    std::lock_guard<std::mutex> lock (handleLock);
+    for (auto &kv : handles) res [kv.first] += kv.second->value ();
+    for (auto &kv : sampleTimers)
+      res [kv.second->runs ().name ()] += kv.second->runs ().value ();
+    return res;
+  }
+
+  std::map<std::string,unsigned long> Stats::counterValues ()
+  {
+    runHooks ();
+    return allCounters ();
+  }
+
+  std::map<std::string,double> Stats::timerValues ()
+  {
+    runHooks ();
+    std::map<std::string,double> res;
+    for (auto &kv : sw) res [kv.first] = kv.second.toSeconds ();
+    std::lock_guard<std::mutex> lock (handleLock);
+    for (auto &kv : sampleTimers) res [kv.first] += kv.second->toSeconds ();
+    return res;
+  }
+
+  void Stats::start (const std::string &name) 
+  { 
+    if (Trace::enabled ()) Trace::begin (name, "stats");
+    sw[name].start (); 
+  }
+  void Stats::stop (const std::string &name) 
+  { 
+    sw[name].stop (); 
+    if (Trace::enabled ()) Trace::end (name, "stats");
+  }
+  void Stats::resume (const std::string &name) 
+  { 
+    if (Trace::enabled ()) Trace::begin (name, "stats");
+    sw[name].resume (); 
+  }
+
+  void Stats::addPrintHook (const std::string &name, 
+                            std::function<void ()> hook)
+  { hooks [name] = hook; }
+  void Stats::removePrintHook (const std::string &name) { hooks.erase (name); }
+  void Stats::runHooks ()
+  {
+    for (auto &kv : hooks) kv.second ();
+
+    MemoryBudget::Counters m = MemoryBudget::counters ();
+    if (MemoryBudget::budgetMb () == 0 && m.evictions == 0) return;
+    uset ("memory.budget_mb", MemoryBudget::budgetMb ());
+    uset ("memory.checks", m.checks);
+    uset ("memory.pressure", m.pressure);
+    uset ("memory.evictions", m.evictions);
+    uset ("memory.evicted_entries", m.entries);
+    for (auto &kv : m.byName) uset ("memory.evicted." + kv.first, kv.second);
+  }
+
+  void Stats::addJsonSection (const std::string &name,
+                              std::function<void (llvm::raw_ostream&)> fn)
+  { jsonSections [name] = fn; }
+
+  StatsPhase *Stats::enterPhase (const std::string &name)
+  {
+    std::lock_guard<std::mutex> lock (phaseLock);
+    StatsPhase *parent = curPhase ? curPhase : &rootPhase;
+    StatsPhase *phase = nullptr;
+    for (auto &c : parent->children)
+      if (c->name == name) { phase = c.get (); break; }
+    if (!phase)
+    {
+      parent->children.emplace_back (new StatsPhase (name, parent));
+      phase = parent->children.back ().get ();
+    }
+    curPhase = phase;
+    return phase;
+  }
+
+  void Stats::exitPhase (StatsPhase *phase, double wall, double cpu, long rss0)
+  {
+    long rss = maxRss ();
+    std::lock_guard<std::mutex> lock (phaseLock);
+    ++phase->calls;
+    phase->wall += wall;
+    phase->cpu += cpu;
+    phase->maxRss = rss;
+    phase->rssGrowth += rss - rss0;
+    curPhase = phase->parent == &rootPhase ? nullptr : phase->parent;
+  }
+
+  double Stats::wallTime ()
+  {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+  }
+
+  double Stats::cpuTime ()
+  {
+    struct rusage ru;
+    getrusage (RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+      (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+  }
+
+  long Stats::maxRss ()
+  {
+    struct rusage ru;
+    getrusage (RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+  }
+
+  long Stats::currentRss () { return MemoryBudget::rssKb (); }
 
   /** Outputs all statistics to std output */
   void Stats::Print (std::ostream &OS)
   {
+    runHooks ();
     for (auto &kv : ss)
       OS << kv.first << ": " << kv.second << "\n";
-    for (auto &kv : counters)
+    for (auto &kv : allCounters ())
       OS << kv.first << ": " << kv.second << "\n";
     for (auto &kv : sw)
       OS << kv.first << ": " << kv.second << "\n";
+    for (auto &kv : sampleTimers)
+      OS << kv.first << ": " << kv.second->toSeconds () << "s\n";
 
     for (auto &kv : av)
       OS << kv.first << ": " << kv.second << "\n";
@@ -38,16 +264,20 @@ namespace ufo
 
   void Stats::PrintBrunch (llvm::raw_ostream &OS)
   {
+    runHooks ();
     OS << "\n\n************** BRUNCH STATS ***************** \n";
     for (auto &kv : ss) 
       OS << "BRUNCH_STAT " << kv.first << " " << kv.second << "\n";
     
-    for (auto &kv : counters)
+    for (auto &kv : allCounters ())
       OS << "BRUNCH_STAT " << kv.first << " " << kv.second << "\n";
 
     for (auto &kv : sw)
       OS << "BRUNCH_STAT " << kv.first << " " 
          << llvm::format ("%.2f",  (kv.second).toSeconds()) << "\n";
+    for (auto &kv : sampleTimers)
+      OS << "BRUNCH_STAT " << kv.first << " " 
+         << llvm::format ("%.2f", kv.second->toSeconds ()) << "\n";
 
     for (auto &kv : av)
       OS << "BRUNCH_STAT " << kv.first << " " << kv.second << "\n";
@@ -56,16 +286,123 @@ namespace ufo
   }
 
 
+  void Stats::PrintJson (llvm::raw_ostream &OS)
+  {
+    runHooks ();
+    OS << "{\"strings\": {";
+    bool first = true;
+    for (auto &kv : ss)
+    {
+      OS << (first ? "" : ", ");
+      first = false;
+      printJsonString (kv.first, OS);
+      OS << ": ";
+      printJsonString (kv.second, OS);
+    }
+
+    OS << "},\n\"counters\": {";
+    first = true;
+    for (auto &kv : allCounters ())
+    {
+      OS << (first ? "" : ", ");
+      first = false;
+      printJsonString (kv.first, OS);
+      OS << ": " << kv.second;
+    }
+
+    OS << "},\n\"timers\": {";
+    first = true;
+    for (auto &kv : sw)
+    {
+      OS << (first ? "" : ", ");
+      first = false;
+      printJsonString (kv.first, OS);
+      OS << ": " << llvm::format ("%.6f", kv.second.toSeconds ());
+    }
+    for (auto &kv : sampleTimers)
+    {
+      OS << (first ? "" : ", ");
+      first = false;
+      printJsonString (kv.first, OS);
+      OS << ": " << llvm::format ("%.6f", kv.second->toSeconds ());
+    }
+
+    OS << "},\n\"averages\": {";
+    first = true;
+    for (auto &kv : av)
+    {
+      OS << (first ? "" : ", ");
+      first = false;
+      printJsonString (kv.first, OS);
+      OS << ": " << kv.second;
+    }
+    OS << "},\n\"max_rss_kb\": " << maxRss ();
+
+    OS << ",\n\"phases\": ";
+    {
+      std::lock_guard<std::mutex> lock (phaseLock);
+      printJsonPhases (rootPhase, OS);
+    }
+
+    for (auto &kv : jsonSections)
+    {
+      OS << ",\n";
+      printJsonString (kv.first, OS);
+      OS << ": ";
+      kv.second (OS);
+    }
+    OS << "}\n";
+  }
+
+  void Stats::PrintPrometheus (llvm::raw_ostream &OS)
+  {
+    std::lock_guard<std::mutex> lock (handleLock);
+    for (auto &kv : handles)
+    {
+      std::string n = promName (kv.first);
+      OS << "# TYPE " << n << " counter\n" << n << " " << kv.second->value () << "\n";
+    }
+    for (auto &kv : sampleTimers)
+    {
+      std::string n = promName (kv.first);
+      OS << "# TYPE " << n << "_seconds counter\n"
+         << n << "_seconds " << llvm::format ("%.6f", kv.second->toSeconds ()) << "\n"
+         << "# TYPE " << n << "_runs counter\n"
+         << n << "_runs " << kv.second->runs ().value () << "\n";
+    }
+    for (auto &kv : histograms)
+    {
+      const StatsHistogram &h = *kv.second;
+      std::string n = promName (kv.first);
+      OS << "# TYPE " << n << " histogram\n";
+      // -- the buckets of Prometheus are cumulative
+      unsigned long total = 0;
+      for (size_t i = 0; i < h.bounds ().size (); ++i)
+      {
+        total += h.count (i);
+        OS << n << "_bucket{le=\"" << h.bounds () [i] << "\"} " << total << "\n";
+      }
+      total += h.count (h.bounds ().size ());
+      OS << n << "_bucket{le=\"+Inf\"} " << total << "\n"
+         << n << "_sum " << llvm::format ("%.6f", h.sum ()) << "\n"
+         << n << "_count " << total << "\n";
+    }
+  }
+
   void Stats::Print (llvm::raw_ostream &OS)
   {
+    runHooks ();
     OS << "\n\n************** STATS ***************** \n";
     for (auto &kv : ss)
       OS << kv.first << ": " << kv.second << "\n";
-    for (auto &kv : counters)
+    for (auto &kv : allCounters ())
       OS << kv.first << ": " << kv.second << "\n";
 
     for (auto &kv : sw)
       OS << kv.first << ": " << kv.second << "\n";
+    for (auto &kv : sampleTimers)
+      OS << kv.first << ": " << llvm::format ("%.2f", kv.second->toSeconds ())
+         << "s\n";
 
     for (auto &kv : av)
       OS << kv.first << ": " << kv.second << "\n";
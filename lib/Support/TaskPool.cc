@@ -0,0 +1,178 @@
+#include "seahorn/Support/TaskPool.hh"
+
+#include "ufo/Stats.hh"
+
+#include <algorithm>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+
+namespace seahorn
+{
+  using namespace ufo;
+
+  CancelToken::CancelToken () :
+    m_cancelled (false),
+    m_deadline (clock::time_point::max ().time_since_epoch ().count ()),
+    m_nextHook (0) {}
+
+  void CancelToken::setTimeout (unsigned ms)
+  {
+    setDeadline (ms == 0 ? clock::time_point::max () :
+                 clock::now () + std::chrono::milliseconds (ms));
+  }
+
+  void CancelToken::setDeadline (clock::time_point t)
+  { m_deadline = t.time_since_epoch ().count (); }
+
+  void CancelToken::cancel ()
+  {
+    std::lock_guard<std::mutex> l (m_lock);
+    if (m_cancelled.exchange (true)) return;
+    for (auto &kv : m_hooks) kv.second ();
+  }
+
+  CancelToken::Hook::Hook (CancelToken &token, std::function<void ()> f) :
+    m_token (token)
+  {
+    std::lock_guard<std::mutex> l (m_token.m_lock);
+    m_id = m_token.m_nextHook++;
+    // -- a cancel after this sees the hook, one before it is seen here
+    if (m_token.m_cancelled) f ();
+    m_token.m_hooks [m_id] = std::move (f);
+  }
+
+  CancelToken::Hook::~Hook ()
+  {
+    std::lock_guard<std::mutex> l (m_token.m_lock);
+    m_token.m_hooks.erase (m_id);
+  }
+
+  CancelToken &globalCancelToken ()
+  {
+    static CancelToken token;
+    return token;
+  }
+
+  namespace
+  {
+    /// cancels the token at its deadline or when the process uses
+    /// more than the memory limit, until stopped
+    class Watchdog
+    {
+      CancelToken &m_token;
+      long m_memLimitKb;
+      const std::string &m_name;
+      std::mutex m_lock;
+      std::condition_variable m_cv;
+      bool m_done;
+      std::thread m_thread;
+
+      void watch ()
+      {
+        const auto period = std::chrono::milliseconds (50);
+        std::unique_lock<std::mutex> l (m_lock);
+        while (!m_done)
+        {
+          CancelToken::clock::time_point next = CancelToken::clock::now () + period;
+          if (m_memLimitKb == 0) next = m_token.deadline ();
+          m_cv.wait_until (l, std::min (next, m_token.deadline ()));
+          if (m_done) break;
+          if (m_memLimitKb > 0 && Stats::currentRss () > m_memLimitKb)
+          {
+            Stats::counter (m_name + ".memCancelled").inc ();
+            m_token.cancel ();
+          }
+          else if (m_token.cancelled ())
+            // -- the deadline, for the hooks
+            m_token.cancel ();
+          if (m_token.cancelled ()) break;
+        }
+      }
+
+    public:
+      Watchdog (CancelToken &token, unsigned memLimitMb, const std::string &name) :
+        m_token (token), m_memLimitKb (memLimitMb * 1024L), m_name (name),
+        m_done (false)
+      {
+        if (m_memLimitKb > 0 || m_token.hasDeadline ())
+          m_thread = std::thread (&Watchdog::watch, this);
+      }
+
+      ~Watchdog ()
+      {
+        if (!m_thread.joinable ()) return;
+        {
+          std::lock_guard<std::mutex> l (m_lock);
+          m_done = true;
+        }
+        m_cv.notify_one ();
+        m_thread.join ();
+      }
+    };
+  }
+
+  TaskPool::TaskPool (const std::string &name, unsigned threads,
+                      CancelToken *token) :
+    m_name (name), m_threads (threads), m_token (token), m_memLimitMb (0),
+    m_samplePeriod (1)
+  {
+    if (m_threads == 0) m_threads = std::max (1U, std::thread::hardware_concurrency ());
+    if (!m_token)
+    {
+      m_own.reset (new CancelToken ());
+      m_token = m_own.get ();
+    }
+  }
+
+  size_t TaskPool::run (size_t n, const Task &task)
+  {
+    ScopedStats _st_ (m_name);
+    StatsSampleTimer &timer = Stats::sampleTimer (m_name + ".task", m_samplePeriod);
+    StatsCounter &skipped = Stats::counter (m_name + ".skipped");
+    StatsCounter &rssGrowth = Stats::counter (m_name + ".taskRssGrowthKb");
+    std::atomic<long> maxGrowth (0);
+
+    Watchdog dog (*m_token, m_memLimitMb, m_name);
+    std::atomic<size_t> next (0);
+    std::atomic<size_t> ran (0);
+    auto worker = [&] (unsigned w)
+      {
+        for (size_t k = next++; k < n; k = next++)
+        {
+          if (m_token->cancelled ())
+          {
+            skipped.inc ();
+            continue;
+          }
+          ++ran;
+          if (!timer.start ())
+          {
+            task (w, k);
+            continue;
+          }
+          long rss0 = Stats::currentRss ();
+          auto t0 = std::chrono::steady_clock::now ();
+          task (w, k);
+          timer.addSample (std::chrono::duration_cast<std::chrono::nanoseconds>
+                           (std::chrono::steady_clock::now () - t0).count ());
+          long growth = std::max (0L, Stats::currentRss () - rss0);
+          rssGrowth.inc (growth);
+          long m = maxGrowth.load ();
+          while (growth > m && !maxGrowth.compare_exchange_weak (m, growth));
+        }
+      };
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<size_t> (m_threads, n); ++t)
+      pool.emplace_back (worker, t);
+    worker (0);
+    for (std::thread &t : pool) t.join ();
+
+    Stats::uset (m_name + ".threads", std::min<size_t> (m_threads, n));
+    Stats::uset (m_name + ".maxTaskRssGrowthKb",
+                 std::max ((long) Stats::get (m_name + ".maxTaskRssGrowthKb"),
+                           maxGrowth.load ()));
+    return ran;
+  }
+}
@@ -0,0 +1,147 @@
+#include "ufo/Trace.hh"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <unistd.h>
+
+namespace ufo
+{
+  std::atomic<bool> Trace::s_enabled (false);
+
+  namespace
+  {
+    struct Event
+    {
+      char ph;
+      std::string name;
+      const char *cat;
+      double ts;
+    };
+
+    /// events of one thread. Only the thread appends to it, so it
+    /// needs no lock until the trace is written
+    struct ThreadBuffer
+    {
+      unsigned tid;
+      std::vector<Event> events;
+    };
+
+    std::mutex traceLock;
+    std::string tracePath;
+    std::chrono::steady_clock::time_point traceStart;
+    /// buffers of all threads, kept after their thread exits
+    std::vector<std::unique_ptr<ThreadBuffer> > buffers;
+
+    ThreadBuffer &buffer ()
+    {
+      static thread_local ThreadBuffer *b = nullptr;
+      if (!b)
+      {
+        std::lock_guard<std::mutex> lock (traceLock);
+        buffers.emplace_back (new ThreadBuffer ());
+        b = buffers.back ().get ();
+        b->tid = buffers.size ();
+      }
+      return *b;
+    }
+
+    /// microseconds since the trace was opened
+    double now ()
+    {
+      return std::chrono::duration<double, std::micro>
+        (std::chrono::steady_clock::now () - traceStart).count ();
+    }
+
+    void record (char ph, const std::string &name, const char *cat)
+    {
+      if (!Trace::enabled ()) return;
+      Event e {ph, name, cat, now ()};
+      buffer ().events.push_back (std::move (e));
+    }
+
+    void printString (const std::string &s, llvm::raw_ostream &OS)
+    {
+      OS << '"';
+      for (unsigned char c : s)
+      {
+        if (c == '"' || c == '\\') OS << '\\' << c;
+        else if (c < 0x20) OS << llvm::format ("\\u%04x", c);
+        else OS << c;
+      }
+      OS << '"';
+    }
+
+    void closeAtExit () { Trace::close (); }
+  }
+
+  void Trace::open (const std::string &path)
+  {
+    std::lock_guard<std::mutex> lock (traceLock);
+    static bool registered = (std::atexit (closeAtExit), true);
+    (void) registered;
+    tracePath = path;
+    traceStart = std::chrono::steady_clock::now ();
+    s_enabled = true;
+  }
+
+  void Trace::close ()
+  {
+    if (!s_enabled.exchange (false)) return;
+
+    std::lock_guard<std::mutex> lock (traceLock);
+    std::error_code ec;
+    llvm::raw_fd_ostream out (tracePath, ec, llvm::sys::fs::F_Text);
+    if (ec)
+    {
+      llvm::errs () << "WARNING: cannot write trace to " << tracePath << ": "
+                    << ec.message () << "\n";
+      return;
+    }
+
+    int pid = getpid ();
+    out << "{\"traceEvents\": [";
+    bool first = true;
+    for (auto &b : buffers)
+    {
+      for (const Event &e : b->events)
+      {
+        out << (first ? "\n" : ",\n") << "{\"ph\": \"" << e.ph << "\"";
+        first = false;
+        if (e.ph == 'M')
+        {
+          out << ", \"name\": \"thread_name\", \"args\": {\"name\": ";
+          printString (e.name, out);
+          out << "}";
+        }
+        else
+        {
+          out << ", \"name\": ";
+          printString (e.name, out);
+          out << ", \"cat\": \"" << e.cat << "\""
+              << ", \"ts\": " << llvm::format ("%.3f", e.ts);
+          if (e.ph == 'i') out << ", \"s\": \"t\"";
+        }
+        out << ", \"pid\": " << pid << ", \"tid\": " << b->tid << "}";
+      }
+      b->events.clear ();
+    }
+    out << "],\n\"displayTimeUnit\": \"ms\"}\n";
+  }
+
+  void Trace::begin (const std::string &name, const char *cat)
+  { record ('B', name, cat); }
+  void Trace::end (const std::string &name, const char *cat)
+  { record ('E', name, cat); }
+  void Trace::instant (const std::string &name, const char *cat)
+  { record ('i', name, cat); }
+  void Trace::threadName (const std::string &name)
+  { record ('M', name, ""); }
+}
@@ -23,6 +23,11 @@
    those. Thus, rather than using registers we allocate them in the
    stack and pass their addresses to the callee.
 
+   With --boc-sparse-shadows, the pointers that reach a checked
+   dereference are computed first by following the def-use chains
+   backwards, across calls and returns. Only the formal parameters
+   and the return values among them get shadow parameters.
+
    If the instrumented program does not violate any of the assertions
    then the original program is free of buffer overflows/underflows.
 
@@ -43,6 +48,10 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/ADT/Statistic.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Analysis/LoopInfo.h"
 
 #include <boost/optional.hpp>
 
@@ -50,6 +59,17 @@
 
 //#include "seahorn/Analysis/Steensgaard.hh"
 
+static llvm::cl::opt<bool>
+OptimizeChecks("boc-optimize-checks",
+               llvm::cl::desc ("Remove redundant buffer overflow/underflow checks "
+                               "and hoist loop invariant ones"),
+               llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+SparseShadows("boc-sparse-shadows",
+              llvm::cl::desc ("Add shadow offsets, sizes and parameters only "
+                              "for the pointers that reach a checked dereference"),
+              llvm::cl::init (false));
 
 namespace seahorn
 {
@@ -108,6 +128,7 @@ namespace seahorn
       const Value* formalPar = &*AI;
       if (formalPar == Arg)
       {
+        if (!hasShadowArg (F, idx)) break;
         Value* shadowOffset = getArgument (F, shadow_idx);
         Value* shadowSize   = getArgument (F, shadow_idx+1);
         assert (shadowOffset && shadowSize);
@@ -115,17 +136,13 @@ namespace seahorn
         return std::make_pair (shadowOffset, shadowSize);
       }
       
-      if (IsShadowableType (formalPar->getType ()))
+      if (hasShadowArg (F, idx))
         shadow_idx += 2;
     }
     return std::pair<Value*, Value*> (NULL,NULL);
   }
 
-  // For each function parameter for which we want to propagate its
-  // offset and size we add two more *undefined* function parameters
-  // for placeholding its offset and size which will be filled out
-  // later.
-  bool  BufferBoundsCheck::addFunShadowParams (Function *F, LLVMContext &ctx)  
+  bool BufferBoundsCheck::canShadowParams (const Function *F)
   {
     if (F->isDeclaration ()) return false;
 
@@ -134,11 +151,113 @@ namespace seahorn
     // TODO: relax this case
     if (F->hasAddressTaken ()) return false;
     // TODO: relax this case
-    const FunctionType *FTy = F->getFunctionType ();
-    if (FTy->isVarArg ()) return false;
+    if (F->getFunctionType ()->isVarArg ()) return false;
 
     CanAccessMemory &CM = getAnalysis<CanAccessMemory> ();
-    if (!CM.canAccess(F)) return false;
+    return CM.canAccess(F);
+  }
+
+  void BufferBoundsCheck::computeNeededShadows (Module &M)
+  {
+    // -- the pointers of the checked dereferences, as instrumented
+    // -- by runOnFunction
+    std::vector<const Value*> WorkList;
+    ValueSet needed;
+    auto need = [&] (const Value *v)
+    {
+      if (IsShadowableType (v->getType ()) && needed.insert (v).second)
+        WorkList.push_back (v);
+    };
+
+    for (Function &F : M)
+      for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i)
+      {
+        const Instruction *I = &*i;
+        if (const LoadInst *load = dyn_cast<LoadInst> (I))
+        {
+          if (!isScalarGlobal (load->getOperand (0))) need (load->getOperand (0));
+        }
+        else if (const StoreInst *store = dyn_cast<StoreInst> (I))
+        {
+          if (!isScalarGlobal (store->getOperand (1))) need (store->getOperand (1));
+        }
+        else if (const CallInst *CI = dyn_cast<CallInst> (I))
+        {
+          const Function *cf = CI->getCalledFunction ();
+          if (!cf) continue;
+          if (cf->getName ().startswith ("llvm.memcpy") ||
+              cf->getName ().startswith ("llvm.memmove"))
+          {
+            need (CI->getArgOperand (0));
+            need (CI->getArgOperand (1));
+          }
+          else if (cf->getName ().startswith ("llvm.memset"))
+            need (CI->getArgOperand (0));
+        }
+      }
+
+    // -- what their shadow variables are computed from, following
+    // -- the cases of instrumentSizeAndOffsetPtr
+    while (!WorkList.empty ())
+    {
+      const Value *v = WorkList.back ();
+      WorkList.pop_back ();
+
+      if (const BitCastInst *Bc = dyn_cast<BitCastInst> (v))
+        need (Bc->getOperand (0));
+      else if (const GetElementPtrInst *Gep = dyn_cast<GetElementPtrInst> (v))
+        need (Gep->getPointerOperand ());
+      else if (const PHINode *PHI = dyn_cast<PHINode> (v))
+      {
+        for (unsigned i=0; i < PHI->getNumIncomingValues (); i++)
+          need (PHI->getIncomingValue (i));
+      }
+      else if (const Argument *Arg = dyn_cast<Argument> (v))
+      {
+        // -- the shadow parameters are filled by the callers
+        const Function *F = Arg->getParent ();
+        if (!canShadowParams (F)) continue;
+
+        BitVector &args = m_needed_args [F];
+        if (args.empty ()) args.resize (F->arg_size ());
+        args.set (Arg->getArgNo ());
+
+        for (const User *U : F->users ())
+        {
+          ImmutableCallSite CS (U);
+          if (CS && CS.getCalledFunction () == F)
+            need (CS.getArgument (Arg->getArgNo ()));
+        }
+      }
+      else if (const CallInst *CI = dyn_cast<CallInst> (v))
+      {
+        // -- the shadow return parameters are filled by the callee
+        const Function *cf = CI->getCalledFunction ();
+        if (!cf || !canShadowParams (cf)) continue;
+        if (!m_needed_ret.insert (cf).second) continue;
+
+        for (const BasicBlock &bb : *cf)
+          if (const ReturnInst *ret = dyn_cast<ReturnInst> (bb.getTerminator ()))
+            if (const Value *retVal = ret->getReturnValue ())
+              need (retVal);
+      }
+    }
+
+    LOG ("boc",
+         errs () << "Shadowing the pointer parameters of "
+                 << m_needed_args.size () << " functions and the returns of "
+                 << m_needed_ret.size () << " functions\n");
+  }
+
+  // For each function parameter for which we want to propagate its
+  // offset and size we add two more *undefined* function parameters
+  // for placeholding its offset and size which will be filled out
+  // later.
+  bool  BufferBoundsCheck::addFunShadowParams (Function *F, LLVMContext &ctx)  
+  {
+    if (!canShadowParams (F)) return false;
+
+    const FunctionType *FTy = F->getFunctionType ();
 
     // copy params
     // AttributeSet PAL = F->getAttributes ();
@@ -147,11 +266,12 @@ namespace seahorn
     //      stored.
     std::vector<std::string> NewNames;
     Function::arg_iterator FAI = F->arg_begin();
+    unsigned argNo = 0;
     for(FunctionType::param_iterator I =  FTy->param_begin (),             
-            E = FTy->param_end (); I!=E; ++I, ++FAI) 
+            E = FTy->param_end (); I!=E; ++I, ++FAI, ++argNo) 
     {
       Type *PTy = *I;
-      if (IsShadowableType (PTy))
+      if (hasShadowArg (F, argNo))
       {
         ParamsTy.push_back (m_Int64Ty);
         Twine offset_name = FAI->getName () + ".shadow.offset";
@@ -167,11 +287,16 @@ namespace seahorn
         //                        ParamsTy.size (), 
         //                        Attribute::ReadOnly);
       }
+      else if (IsShadowableType (PTy))
+        ShadowsSkipped++;
     }
 
     // copy return value
     Type *RetTy = F->getReturnType ();
-    if (IsShadowableType (RetTy))
+    bool shadowRet = needsShadowRet (F);
+    if (IsShadowableType (RetTy) && !shadowRet)
+      ShadowsSkipped++;
+    if (shadowRet)
     {
       ReturnInst* ret = getReturnInst (F);   
       Value * retVal = ret->getReturnValue ();
@@ -184,6 +309,9 @@ namespace seahorn
       NewNames.push_back (size_name.str ());
     }
 
+    // -- nothing to shadow
+    if (NewNames.empty ()) return false;
+
     // create function type
     FunctionType *NFTy = FunctionType::get (RetTy, 
                                             ArrayRef<llvm::Type*> (ParamsTy), 
@@ -197,6 +325,14 @@ namespace seahorn
     NF->takeName (F);
 
     m_orig_arg_size [NF] = F->arg_size ();
+    if (m_sparse)
+    {
+      BitVector args = m_needed_args.lookup (F);
+      m_needed_args.erase (F);
+      m_needed_args [NF] = args;
+      m_needed_ret.erase (F);
+      if (shadowRet) m_needed_ret.insert (NF);
+    }
 
     // new parameter names
     unsigned idx=0;
@@ -227,7 +363,7 @@ namespace seahorn
 
     // placeholders for the variables that will feed the shadow
     // variables for the return instruction of the function
-    if (IsShadowableType (RetTy))
+    if (shadowRet)
     {
       ReturnInst* ret = getReturnInst (NF);   
       B.SetInsertPoint (ret);
@@ -259,7 +395,7 @@ namespace seahorn
 
       // insert placeholders for new arguments
       unsigned added_new_args = NF->arg_size () - F->arg_size();
-      if (IsShadowableType (RetTy))
+      if (shadowRet)
       {
         for(unsigned i=0; i < added_new_args - 2; i++)
           Args.push_back (UndefValue::get (m_Int64Ty)); // for shadow formal parameters
@@ -298,7 +434,7 @@ namespace seahorn
       for (unsigned idx = 0, shadow_idx = orig_arg_size; idx < orig_arg_size; idx++)
       {
         const Value* ArgPtr = NCS.getArgument (idx);
-        if (IsShadowableType (ArgPtr->getType ()))
+        if (hasShadowArg (NCS.getCalledFunction (), idx))
         {
           std::pair <Value*,Value*> shadow_pars = 
               findShadowArg (New->getParent ()->getParent(), ArgPtr);
@@ -677,7 +813,7 @@ namespace seahorn
     {
       CallSite CS (const_cast<CallInst*> (CI));
       Function *cf = CS.getCalledFunction ();      
-      if (cf && IsShadowableFunction (*cf))
+      if (cf && IsShadowableFunction (*cf) && hasShadowRet (cf))
       {
         Value* ShadowRetOff  = CS.getArgument (CS.arg_size () - 2);
         Value* ShadowRetSize = CS.getArgument (CS.arg_size () - 1);
@@ -910,6 +1046,178 @@ namespace seahorn
     // }
   }
 
+  // The condition of the check that ends bb, if any. A check is a
+  // branch to the error block when its condition does not hold.
+  static Value* getCheck (BasicBlock &bb, BasicBlock *errBB)
+  {
+    BranchInst *br = dyn_cast<BranchInst> (bb.getTerminator ());
+    if (!br || !br->isConditional () || br->getSuccessor (1) != errBB)
+      return nullptr;
+    return br->getCondition ();
+  }
+
+  // Replaces the check that ends bb by a jump to its continuation
+  static void removeCheck (BasicBlock &bb)
+  {
+    BranchInst *br = cast<BranchInst> (bb.getTerminator ());
+    Instruction *cond = dyn_cast<Instruction> (br->getCondition ());
+    br->getSuccessor (1)->removePredecessor (&bb);
+    BranchInst::Create (br->getSuccessor (0), &bb);
+    br->eraseFromParent ();
+
+    if (!cond || !cond->use_empty ()) return;
+    // -- the range of a memcpy/memmove check is only used by the check
+    Instruction *rng = nullptr;
+    if (cast<ICmpInst> (cond)->getPredicate () == ICmpInst::ICMP_SLE)
+      rng = dyn_cast<BinaryOperator> (cond->getOperand (0));
+    cond->eraseFromParent ();
+    if (rng && rng->use_empty ()) rng->eraseFromParent ();
+  }
+
+  // True if b holds whenever a holds
+  static bool impliesCheck (const ICmpInst *a, const ICmpInst *b)
+  {
+    if (a->getOperand (0) != b->getOperand (0) ||
+        a->getPredicate () != b->getPredicate ()) return false;
+    if (a->getOperand (1) == b->getOperand (1)) return true;
+    
+    // -- underflow: x >= c1 implies x >= c2 if c1 >= c2
+    const ConstantInt *c1 = dyn_cast<ConstantInt> (a->getOperand (1));
+    const ConstantInt *c2 = dyn_cast<ConstantInt> (b->getOperand (1));
+    return (a->getPredicate () == ICmpInst::ICMP_SGE && c1 && c2 &&
+            c1->getValue ().sge (c2->getValue ()));
+  }
+
+  // True if v can be computed before entering L
+  static bool isHoistable (Value *v, Loop *L)
+  {
+    if (L->isLoopInvariant (v)) return true;
+    Instruction *I = dyn_cast<Instruction> (v);
+    return (I && (isa<BinaryOperator> (I) || isa<CastInst> (I)) &&
+            L->hasLoopInvariantOperands (I));
+  }
+
+  // True if the check that ends bb is reached, or an error is
+  // raised, on every execution that enters L
+  static bool isReachedOnEntry (BasicBlock &bb, Loop *L, BasicBlock *errBB,
+                                const DominatorTree &DT)
+  {
+    // -- an inner loop or a call might not terminate before bb
+    if (!L->empty ()) return false;
+    for (BasicBlock *b : L->getBlocks ())
+      for (Instruction &I : *b)
+      {
+        if (!isa<CallInst> (I) || isa<IntrinsicInst> (I)) continue;
+        const Function *fn = cast<CallInst> (I).getCalledFunction ();
+        if (!fn || !fn->getName ().startswith ("verifier.memsafe"))
+          return false;
+      }
+    
+    SmallVector<BasicBlock*, 8> exiting;
+    L->getExitingBlocks (exiting);
+    for (BasicBlock *b : exiting)
+      for (succ_iterator it = succ_begin (b), end = succ_end (b); it != end; ++it)
+        if (!L->contains (*it) && *it != errBB && !DT.dominates (&bb, b))
+          return false;
+
+    BasicBlock *header = L->getHeader ();
+    for (pred_iterator it = pred_begin (header), end = pred_end (header); it != end; ++it)
+      if (L->contains (*it) && !DT.dominates (&bb, *it)) return false;
+    
+    return true;
+  }
+
+  bool BufferBoundsCheck::optimizeChecks (Function &F)
+  {
+    bool change = false;
+
+    // -- discharge the checks that are constant true (e.g., because
+    // -- the offset and the size are constant)
+    for (BasicBlock &bb : F)
+    {
+      ConstantInt *c = dyn_cast_or_null<ConstantInt> (getCheck (bb, m_err_bb));
+      if (!c || !c->isOne ()) continue;
+      removeCheck (bb);
+      ChecksDischarged++;
+      change = true;
+    }
+
+    DominatorTree DT;
+    DT.recalculate (F);
+
+    // -- remove the checks implied by a dominating check
+    for (BasicBlock &bb : F)
+    {
+      ICmpInst *cmp = dyn_cast_or_null<ICmpInst> (getCheck (bb, m_err_bb));
+      if (!cmp || !DT.isReachableFromEntry (&bb)) continue;
+
+      for (DomTreeNode *n = DT.getNode (&bb)->getIDom (); n; n = n->getIDom ())
+      {
+        BasicBlock *dom = n->getBlock ();
+        ICmpInst *domCmp = dyn_cast_or_null<ICmpInst> (getCheck (*dom, m_err_bb));
+        if (!domCmp || !impliesCheck (domCmp, cmp)) continue;
+
+        BasicBlockEdge ok (dom, dom->getTerminator ()->getSuccessor (0));
+        if (!DT.dominates (ok, &bb)) continue;
+        
+        LOG ("boc", errs () << "Removed check " << *cmp
+                            << " implied by " << *domCmp << "\n");
+        removeCheck (bb);
+        ChecksRedundant++;
+        change = true;
+        break;
+      }
+    }
+
+    // -- hoist the loop invariant checks to the preheader of the
+    // -- loop. The CFG is only modified once all the checks to hoist
+    // -- are known
+    DT.recalculate (F);
+    LoopInfoBase<BasicBlock, Loop> LI;
+    LI.Analyze (DT);
+
+    std::vector<std::pair<BasicBlock*, Loop*> > hoist;
+    for (BasicBlock &bb : F)
+    {
+      ICmpInst *cmp = dyn_cast_or_null<ICmpInst> (getCheck (bb, m_err_bb));
+      if (!cmp) continue;
+      Loop *L = LI.getLoopFor (&bb);
+      if (!L || !L->getLoopPreheader ()) continue;
+      if (!isHoistable (cmp->getOperand (0), L) ||
+          !isHoistable (cmp->getOperand (1), L)) continue;
+      if (!isReachedOnEntry (bb, L, m_err_bb, DT)) continue;
+      hoist.push_back (std::make_pair (&bb, L));
+    }
+
+    for (auto &kv : hoist)
+    {
+      BasicBlock &bb = *kv.first;
+      Loop *L = kv.second;
+      // -- a preheader split by a previous check is still a preheader
+      BasicBlock *ph = L->getLoopPreheader ();
+      ICmpInst *cmp = cast<ICmpInst> (getCheck (bb, m_err_bb));
+      bool moved = false;
+      if (!L->makeLoopInvariant (cmp, moved, ph->getTerminator ())) continue;
+
+      BasicBlock *cont = ph->splitBasicBlock (ph->getTerminator ());
+      ph->getTerminator ()->eraseFromParent ();
+      BranchInst::Create (cont, m_err_bb, cmp, ph);
+      removeCheck (bb);
+      
+      LOG ("boc", errs () << "Hoisted check " << *cmp << "\n");
+      ChecksHoisted++;
+      change = true;
+    }
+
+    if (pred_begin (m_err_bb) == pred_end (m_err_bb))
+    {
+      m_err_bb->eraseFromParent ();
+      m_err_bb = nullptr;
+    }
+    
+    return change;
+  }
+
   bool BufferBoundsCheck::runOnFunction (Function &F)
   {
     if (F.isDeclaration ()) return false;
@@ -994,21 +1302,20 @@ namespace seahorn
               for (size_t idx= 0; idx < orig_arg_size; idx++)
               {
                 const Value* ArgPtr = CS.getArgument (idx);
+                if (!hasShadowArg (cf, idx)) continue;
+                shadow_idx +=2;
                 // this could be a symptom of a bug
                 if (isa<UndefValue> (ArgPtr) || isa<ConstantPointerNull> (ArgPtr))
                   continue;
-                if (IsShadowableType (ArgPtr->getType ()))
+
+                instrumentSizeAndOffsetPtr (&F, B, inst, ArgPtr);                  
+                Value *ptrSize   = m_sizes [ArgPtr];
+                Value *ptrOffset = m_offsets [ArgPtr];
+                if (ptrSize && ptrOffset)
                 {
-                  instrumentSizeAndOffsetPtr (&F, B, inst, ArgPtr);                  
-                  Value *ptrSize   = m_sizes [ArgPtr];
-                  Value *ptrOffset = m_offsets [ArgPtr];
-                  if (ptrSize && ptrOffset)
-                  {
-                    CS.setArgument (shadow_idx, ptrOffset);
-                    CS.setArgument (shadow_idx+1, ptrSize);
-                    change = true;
-                  }
-                  shadow_idx +=2;
+                  CS.setArgument (shadow_idx-2, ptrOffset);
+                  CS.setArgument (shadow_idx-1, ptrSize);
+                  change = true;
                 }
               }
             }
@@ -1019,7 +1326,7 @@ namespace seahorn
       {
         if (const Value* retVal = ret->getReturnValue ())
         {
-          if (IsShadowableType (retVal->getType ()))
+          if (hasShadowRet (&F))
           { // Resolving the shadow offset and size of the return
             // value of a function. At this point, F has this form:
             //    ...
@@ -1093,6 +1400,8 @@ namespace seahorn
         }
       }
     }
+
+    if (OptimizeChecks) change |= optimizeChecks (F);
     
     return change;
   }
@@ -1143,6 +1452,9 @@ namespace seahorn
     
     bool change = false;
 
+    m_sparse = SparseShadows;
+    if (m_sparse) computeNeededShadows (M);
+
     /* First, we shadow function parameters */
     std::vector<Function*> oldFuncs;
     for (Function &F : M) 
@@ -1157,6 +1469,13 @@ namespace seahorn
 
     errs () << "-- Added  " << ChecksAdded << " buffer overflow/underflow checks.\n" 
             << "-- Missed " << ChecksUnable << " checks.\n";
+    if (OptimizeChecks)
+      errs () << "-- Discharged " << ChecksDischarged << " checks, removed "
+              << ChecksRedundant << " redundant checks and hoisted "
+              << ChecksHoisted << " checks.\n";
+    if (m_sparse)
+      errs () << "-- Skipped " << ShadowsSkipped
+              << " shadows of pointer parameters and return values.\n";
 
     return change;
   }
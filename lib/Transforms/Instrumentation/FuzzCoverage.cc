@@ -0,0 +1,74 @@
+/**
+ * Instruments every basic block with a call to the coverage hook of
+ * the fuzzing run-time (sea-rt/fuzz.cpp)
+ */
+#define DEBUG_TYPE "fuzz-coverage"
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+STATISTIC(NumBlocks, "Number of basic blocks instrumented for fuzzing");
+
+namespace
+{
+  /// Calls __seahorn_fuzz_cov (id) at the start of every basic block.
+  /// The run-time hashes the ids of consecutive blocks into an edge
+  /// bitmap, as AFL does, so ids should look random. They are a hash
+  /// of the position of the block in the module, so that two
+  /// instrumentations of the same module agree
+  class FuzzCoverage : public ModulePass
+  {
+    Constant *m_cov;
+
+    static uint32_t blockId (uint32_t n)
+    {
+      n ^= n >> 16; n *= 0x85ebca6bu;
+      n ^= n >> 13; n *= 0xc2b2ae35u;
+      n ^= n >> 16;
+      return n;
+    }
+
+  public:
+    static char ID;
+    FuzzCoverage () : ModulePass (ID), m_cov (nullptr) {}
+
+    virtual bool runOnModule (Module &M)
+    {
+      LLVMContext &C = M.getContext ();
+      Type *i32Ty = Type::getInt32Ty (C);
+      m_cov = M.getOrInsertFunction ("__seahorn_fuzz_cov",
+                                     Type::getVoidTy (C), i32Ty, NULL);
+
+      uint32_t n = 0;
+      for (Function &F : M)
+      {
+        if (F.isDeclaration ()) continue;
+        for (BasicBlock &BB : F)
+        {
+          IRBuilder<> B (&BB, BB.getFirstInsertionPt ());
+          B.CreateCall (m_cov, ConstantInt::get (i32Ty, blockId (++n)));
+          ++NumBlocks;
+        }
+      }
+      return n > 0;
+    }
+
+    virtual void getAnalysisUsage (AnalysisUsage &AU) const
+    {AU.setPreservesCFG ();}
+  };
+
+  char FuzzCoverage::ID = 0;
+}
+
+namespace seahorn
+{
+  llvm::Pass* createFuzzCoveragePass () {return new FuzzCoverage ();}
+}
+
+static RegisterPass<FuzzCoverage> X ("fuzz-coverage",
+                                     "Instrument basic blocks with fuzzing coverage");
@@ -14,6 +14,9 @@
 #include "llvm/IR/CFG.h"
 #include "llvm/Transforms/Scalar.h"
 #include "llvm/IR/GlobalValue.h"
+#include "llvm/Support/Format.h"
+
+#include "ufo/Stats.hh"
 
 #include "boost/range.hpp"
 
@@ -22,6 +25,12 @@ ReduceMain("ms-reduce-main",
              llvm::cl::desc ("Reduce main to return paths"),
              llvm::cl::init (false));
 
+static llvm::cl::opt<unsigned>
+GrowthBudget("ms-growth-budget",
+             llvm::cl::desc ("Maximal growth of the module due to duplicated "
+                             "functions, in percent of its size (0 is unbounded)"),
+             llvm::cl::init (0));
+
 namespace seahorn
 {
   using namespace llvm;
@@ -55,6 +64,93 @@ namespace seahorn
   }
 
 
+  /// number of instructions of the functions of M
+  static unsigned moduleSize (const Module &M)
+  {
+    unsigned sz = 0;
+    for (const Function &F : M)
+      for (const BasicBlock &BB : F) sz += BB.size ();
+    return sz;
+  }
+
+  /// number of instructions of F that are on a path to a failure,
+  /// i.e., the part of F that survives in the failure-only main
+  static unsigned failureSize (const Function &F, const CanFail &CF)
+  {
+    SmallVector<const BasicBlock*, 16> roots;
+    for (const BasicBlock &BB : F)
+      for (const Instruction &I : BB)
+      {
+        const CallInst *ci = dyn_cast<CallInst> (&I);
+        const Function *cf = ci ? ci->getCalledFunction () : nullptr;
+        if (cf && CF.canFail (cf))
+        {
+          roots.push_back (&BB);
+          break;
+        }
+      }
+
+    DenseSet<const BasicBlock*> region;
+    markAncestorBlocks (roots, region);
+    unsigned sz = 0;
+    for (const BasicBlock *bb : region) sz += bb->size ();
+    return sz;
+  }
+
+  /// adds to unsplit f and all the functions that f calls that could
+  /// be split. Their failures are only visible through the calls from
+  /// f that keep the standard semantics.
+  static void markUnsplit (CallGraphNode *cgn, const CanFail &CF,
+                           DenseSet<const Function*> &unsplit)
+  {
+    SmallVector<CallGraphNode*, 16> W (1, cgn);
+    while (!W.empty ())
+    {
+      CallGraphNode *n = W.back ();
+      W.pop_back ();
+      const Function *F = n->getFunction ();
+      if (!F || F->isDeclaration () || F->getName ().equals ("main")) continue;
+      if (!CF.canFail (F) || CF.mustFail (F)) continue;
+      if (!unsplit.insert (F).second) continue;
+      for (auto &kv : *n) W.push_back (kv.second);
+    }
+  }
+
+  /// Functions that keep the standard semantics so that the functions
+  /// duplicated into main fit the budget. Callers are decided before
+  /// their callees since the callees of an unsplit function cannot be
+  /// split. Recursive functions are decided together.
+  static void selectUnsplit (CallGraph &CG, const CanFail &CF,
+                             const Function &main, unsigned budget,
+                             DenseSet<const Function*> &unsplit)
+  {
+    std::vector<std::vector<CallGraphNode*> > sccs;
+    for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it) sccs.push_back (*it);
+
+    // -- main is always duplicated
+    unsigned used = failureSize (main, CF);
+    for (auto it = sccs.rbegin (), end = sccs.rend (); it != end; ++it)
+    {
+      unsigned cost = 0;
+      bool split = true;
+      for (CallGraphNode *cgn : *it)
+      {
+        const Function *F = cgn->getFunction ();
+        if (!F || F == &main || F->isDeclaration ()) continue;
+        if (!CF.canFail (F) || CF.mustFail (F)) continue;
+        if (unsplit.count (F) > 0) split = false;
+        cost += failureSize (*F, CF);
+      }
+
+      if (split && used + cost <= budget)
+      {
+        used += cost;
+        continue;
+      }
+      for (CallGraphNode *cgn : *it) markUnsplit (cgn, CF, unsplit);
+    }
+  }
+
   static bool ExternalizeDeclarations (Module &M)
   {
     bool change = false;
@@ -84,7 +180,12 @@ namespace seahorn
       if (ReduceMain) reduceToReturnPaths (*main);
       return false;
     }
-    
+
+    unsigned origSize = moduleSize (M);
+    DenseSet<const Function*> unsplit;
+    if (GrowthBudget > 0)
+      selectUnsplit (getAnalysis<CallGraphWrapperPass> ().getCallGraph (),
+                     CF, *main, origSize * GrowthBudget / 100, unsplit);
     
     main->setName ("orig.main");
     FunctionType *mainTy = main->getFunctionType ();
@@ -135,6 +236,8 @@ namespace seahorn
         if (!F.isDeclaration ()) reduceToReturnPaths (F);
         continue;
       }
+      // -- keeps its errors and is called as usual from main
+      if (unsplit.count (&F) > 0) continue;
       
       BasicBlock *bb = BasicBlock::Create (M.getContext (), F.getName (), newM);
       entryBlocks [&F] = bb;
@@ -166,6 +269,7 @@ namespace seahorn
     }
     
     std::vector<CallInst*> workList;
+    std::vector<CallInst*> unsplitCalls;
     
     Constant *ndFn = M.getOrInsertFunction ("nondet.bool", 
                                             Type::getInt1Ty (M.getContext ()), NULL);
@@ -176,6 +280,7 @@ namespace seahorn
         CallInst *ci = dyn_cast<CallInst> (&I);
         if (!ci) continue;
         Function *cf = ci->getCalledFunction ();
+        if (unsplit.count (cf) > 0) unsplitCalls.push_back (ci);
         if (entryBlocks.count (cf) <= 0) continue;
         // -- would create a back-jump
         if (entryBlocks [cf] == &BB) continue;
@@ -238,11 +343,59 @@ namespace seahorn
       Builder.CreateCall (failureFn);
     }      
 
-    reduceToAncestors (*newM, SmallVector<const BasicBlock*, 4> (errBlocks.begin (), 
-                                                                 errBlocks.end()));
+    SmallVector<const BasicBlock*, 4> exits (errBlocks.begin (), errBlocks.end ());
+    if (!unsplitCalls.empty ())
+    {
+      // -- the failures of unsplit functions are only known through
+      // -- the error flag of main. Failures of the duplicated code
+      // -- must set it as well.
+      Constant *errorFn = M.getOrInsertFunction ("verifier.error",
+                                                 Type::getVoidTy (M.getContext ()),
+                                                 NULL);
+      for (auto errB : errBlocks)
+      {
+        Builder.SetInsertPoint (errB->getTerminator ());
+        Builder.CreateCall (errorFn);
+      }
+
+      // -- main may return right after an unsplit function fails
+      BasicBlock *failBb = BasicBlock::Create (M.getContext (), "unsplit.fail", newM);
+      Builder.SetInsertPoint (failBb);
+      Builder.CreateRet (Builder.getInt32 (42));
+      exits.push_back (failBb);
+
+      for (auto *ci : unsplitCalls)
+      {
+        BasicBlock *bb = ci->getParent ();
+        BasicBlock::iterator next = ci;
+        BasicBlock *post = bb->splitBasicBlock (++next, "postcall");
+        bb->getTerminator ()->eraseFromParent ();
+        Builder.SetInsertPoint (bb);
+        BranchInst *br = Builder.CreateCondBr (Builder.CreateCall (ndFn), post, failBb);
+        br->setDebugLoc (ci->getDebugLoc ());
+      }
+    }
+
+    reduceToAncestors (*newM, exits);
     
     ExternalizeDeclarations (M);
 
+    unsigned size = moduleSize (M);
+    ufo::Stats::uset ("MsOrigSize", origSize);
+    ufo::Stats::uset ("MsSize", size);
+    ufo::Stats::uset ("MsUnsplitFunctions", unsplit.size ());
+    std::string growth;
+    {
+      raw_string_ostream os (growth);
+      os << format ("%.2f", (double) size / origSize);
+    }
+    ufo::Stats::sset ("MsGrowth", growth);
+    errs () << "-- Mixed semantics: " << origSize << " instructions before, "
+            << size << " after (x" << growth << ")";
+    if (!unsplit.empty ())
+      errs () << ", " << unsplit.size () << " functions not duplicated";
+    errs () << ".\n";
+
     return true;
   }
   
@@ -9,9 +9,19 @@
 #include "llvm/Transforms/Utils/BasicBlockUtils.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/PostOrderIterator.h"
+#include "llvm/IR/CFG.h"
 
 #include "avy/AvyDebug.h"
 
+static llvm::cl::opt<bool>
+RemoveNonNullChecks ("null-check-remove-non-null",
+                     llvm::cl::desc ("Do not check accesses through pointers "
+                                     "that cannot be null"),
+                     llvm::cl::init (false));
+
 namespace seahorn
 {
   using namespace llvm;
@@ -82,10 +92,96 @@ namespace seahorn
     return errBB;
   }
 
+  // The pointer accessed by I, if any
+  static Value* getAccessedPtr (Instruction *I) {
+    if (auto *LI = dyn_cast<LoadInst>(I)) return LI->getPointerOperand();
+    if (auto *SI = dyn_cast<StoreInst>(I)) return SI->getPointerOperand();
+    return nullptr;
+  }
+
+  // True if V is never null
+  static bool isNonNullBase (const Value *V) {
+    if (isa<AllocaInst> (V)) return true;
+    if (const GlobalValue *GV = dyn_cast<GlobalValue> (V))
+      return !GV->hasExternalWeakLinkage ();
+    if (const Argument *A = dyn_cast<Argument> (V))
+      return A->hasNonNullAttr ();
+    return false;
+  }
+
+  // A must-be-non-null dataflow over the accessed pointers, up to
+  // casts. A pointer is non-null after it is accessed since the check
+  // of the access branches to the error block otherwise. Nothing is
+  // derived for the base of an offset pointer: if the base is null,
+  // the offset pointer is not, and its check passes.
+  void NullCheck::findNonNullAccesses (Function &F, 
+                                       DenseSet<const Instruction*> &Safe) {
+    DenseMap<const Value*, unsigned> Ids;
+    for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i)
+      if (Value *Ptr = getAccessedPtr (&*i)) {
+        if (!isNonNullBase (Ptr->stripInBoundsOffsets ()))
+          Ids.insert (std::make_pair (Ptr->stripPointerCasts (), Ids.size ()));
+      }
+
+    // -- applies the accesses of BB to Facts. Records the safe
+    // -- accesses if Record is set
+    auto Transfer = [&] (BasicBlock &BB, BitVector &Facts, bool Record) {
+      for (Instruction &I : BB) {
+        // -- a new instance of I, e.g., in the next loop iteration
+        auto It = Ids.find (&I);
+        if (It != Ids.end ()) Facts.reset (It->second);
+
+        Value *Ptr = getAccessedPtr (&I);
+        if (!Ptr) continue;
+        // -- an offset of an object that is never null
+        if (isNonNullBase (Ptr->stripInBoundsOffsets ())) {
+          if (Record) Safe.insert (&I);
+          continue;
+        }
+        unsigned Id = Ids [Ptr->stripPointerCasts ()];
+        if (Record && Facts.test (Id)) Safe.insert (&I);
+        Facts.set (Id);
+      }
+    };
+
+    // -- facts at the exit of each block. Unvisited blocks are top
+    ReversePostOrderTraversal<Function*> RPOT (&F);
+    DenseMap<const BasicBlock*, BitVector> Out;
+    bool Changed = true;
+    while (Changed) {
+      Changed = false;
+      for (BasicBlock *BB : RPOT) {
+        BitVector Facts (Ids.size (), BB != &F.getEntryBlock ());
+        for (pred_iterator PI = pred_begin (BB), PE = pred_end (BB); PI != PE; ++PI) {
+          auto It = Out.find (*PI);
+          if (It != Out.end ()) Facts &= It->second;
+        }
+        Transfer (*BB, Facts, false);
+        auto It = Out.find (BB);
+        if (It == Out.end () || It->second != Facts) {
+          Out [BB] = Facts;
+          Changed = true;
+        }
+      }
+    }
+
+    for (BasicBlock *BB : RPOT) {
+      BitVector Facts (Ids.size (), BB != &F.getEntryBlock ());
+      for (pred_iterator PI = pred_begin (BB), PE = pred_end (BB); PI != PE; ++PI) {
+        auto It = Out.find (*PI);
+        if (It != Out.end ()) Facts &= It->second;
+      }
+      Transfer (*BB, Facts, true);
+    }
+  }
+
   bool NullCheck::runOnFunction (Function &F)
   {
     if (F.isDeclaration ()) return false;
 
+    DenseSet<const Instruction*> Safe;
+    if (RemoveNonNullChecks) findNonNullAccesses (F, Safe);
+
     std::vector<Instruction*> Worklist;
     for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i)  {
       Instruction *I = &*i;
@@ -109,6 +205,13 @@ namespace seahorn
       }
 
 
+      if (Ptr && Safe.count (I)) {
+        LOG ("null-check",
+             errs () << "Pointer cannot be null: " << *I << "\n";);
+        RemovedChecks++;
+        continue;
+      }
+
       // Dereferencing a pointer so we insert a check if the pointer is null
       if (Ptr) {
         insertNullCheck (Ptr, B, I);
@@ -149,7 +252,10 @@ namespace seahorn
     }
 
     errs () << "-- Inserted " << ChecksAdded << " null dereference checks " 
-            << " (skipped " << TrivialChecks << " trivial checks).\n";
+            << " (skipped " << TrivialChecks << " trivial checks";
+    if (RemoveNonNullChecks)
+      errs () << ", removed " << RemovedChecks << " checks of non-null pointers";
+    errs () << ").\n";
 
     return change;
   }
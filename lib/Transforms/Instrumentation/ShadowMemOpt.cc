@@ -0,0 +1,220 @@
+/**
+ * Removes the shadow memory tokens that no memory operation observes,
+ * once the shadow.mem variables are promoted to registers
+ */
+#define DEBUG_TYPE "shadow-opt"
+
+#include "llvm/Pass.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <vector>
+
+#include "avy/AvyDebug.h"
+
+using namespace llvm;
+STATISTIC(NumPhis, "Number of redundant shadow token phis removed");
+STATISTIC(NumDefs, "Number of unobserved shadow token definitions removed");
+
+namespace seahorn
+{
+  namespace
+  {
+    /// the shadow.mem function called by v, empty if none
+    StringRef shadowFn (const Value *v)
+    {
+      if (const CallInst *ci = dyn_cast<CallInst> (v))
+        if (const Function *fn = ci->getCalledFunction ())
+          if (fn->getName ().startswith ("shadow.mem")) return fn->getName ();
+      return StringRef ();
+    }
+
+    /// definitions of a new token that only feed other tokens, so that
+    /// they can be dropped when no operation observes them
+    bool isDroppableDef (StringRef fn)
+    { return fn == "shadow.mem.store" || fn == "shadow.mem.init"; }
+
+    /// the token operand of a shadow.mem call. Every shadow.mem
+    /// function but the inits takes the token second
+    Value *tokenOperand (CallInst &ci)
+    {
+      StringRef fn = shadowFn (&ci);
+      if (fn == "shadow.mem.init" || fn == "shadow.mem.arg.init") return nullptr;
+      return ci.getNumArgOperands () > 1 ? ci.getArgOperand (1) : nullptr;
+    }
+  }
+
+  /// After ShadowMemDsa or ShadowMemSeaDsa and mem2reg, the tokens of
+  /// a region flow through phi nodes and shadow.mem.store. A token
+  /// phi whose incoming values are all one token is replaced by it,
+  /// and a token store or init whose token reaches no load, call
+  /// argument or shadow.mem.in/out is removed with the phi nodes it
+  /// feeds. The plain store of a removed shadow.mem.store is then
+  /// untracked, as for regions without a shadow
+  class ShadowMemOpt : public FunctionPass
+  {
+    /// phi nodes over tokens, and the token phi nodes they use
+    void tokenPhis (Function &F, DenseSet<PHINode*> &out)
+    {
+      bool changed = true;
+      while (changed)
+      {
+        changed = false;
+        for (BasicBlock &bb : F)
+          for (Instruction &I : bb)
+          {
+            PHINode *phi = dyn_cast<PHINode> (&I);
+            if (!phi) break;
+            if (out.count (phi)) continue;
+            for (unsigned i = 0, e = phi->getNumIncomingValues (); i != e; ++i)
+            {
+              Value *v = phi->getIncomingValue (i);
+              if (!shadowFn (v).empty () ||
+                  (isa<PHINode> (v) && out.count (cast<PHINode> (v))))
+              {
+                out.insert (phi);
+                changed = true;
+                break;
+              }
+            }
+          }
+      }
+    }
+
+    bool simplifyPhis (DenseSet<PHINode*> &phis)
+    {
+      bool res = false;
+      bool changed = true;
+      while (changed)
+      {
+        changed = false;
+        std::vector<PHINode*> todo (phis.begin (), phis.end ());
+        for (PHINode *phi : todo)
+        {
+          // -- a phi of one token, and of itself on a loop
+          Value *same = nullptr;
+          bool unique = true;
+          for (unsigned i = 0, e = phi->getNumIncomingValues (); i != e; ++i)
+          {
+            Value *v = phi->getIncomingValue (i);
+            if (v == phi || v == same) continue;
+            if (same) { unique = false; break; }
+            same = v;
+          }
+          if (!unique || !same) continue;
+          phi->replaceAllUsesWith (same);
+          phis.erase (phi);
+          phi->eraseFromParent ();
+          ++NumPhis;
+          changed = res = true;
+        }
+      }
+      return res;
+    }
+
+  public:
+    static char ID;
+    ShadowMemOpt () : FunctionPass (ID) {}
+
+    bool runOnFunction (Function &F) override
+    {
+      DenseSet<PHINode*> phis;
+      tokenPhis (F, phis);
+
+      bool changed = simplifyPhis (phis);
+
+      // -- mark the tokens observed by a memory operation, then the
+      // -- tokens they are defined from
+      DenseSet<Value*> live;
+      SmallVector<Value*, 32> worklist;
+      auto observe = [&] (Value *v)
+        { if (v && live.insert (v).second) worklist.push_back (v); };
+
+      for (BasicBlock &bb : F)
+        for (Instruction &I : bb)
+        {
+          if (PHINode *phi = dyn_cast<PHINode> (&I))
+          {
+            // -- a token phi used by something else than a token is live
+            if (!phis.count (phi)) continue;
+            for (User *u : phi->users ())
+              if (!isa<PHINode> (u) && !isDroppableDef (shadowFn (u)))
+              { observe (phi); break; }
+            continue;
+          }
+          CallInst *ci = dyn_cast<CallInst> (&I);
+          if (!ci) continue;
+          StringRef fn = shadowFn (ci);
+          if (fn.empty ()) continue;
+          if (!isDroppableDef (fn))
+          {
+            // -- the token is observed, and a new one, if any, is kept
+            observe (tokenOperand (*ci));
+            observe (ci);
+          }
+          else
+            // -- a token used by a non-shadow instruction is live
+            for (User *u : ci->users ())
+              if (!isa<PHINode> (u) && shadowFn (u).empty ())
+              { observe (ci); break; }
+        }
+
+      while (!worklist.empty ())
+      {
+        Value *v = worklist.pop_back_val ();
+        if (PHINode *phi = dyn_cast<PHINode> (v))
+          for (unsigned i = 0, e = phi->getNumIncomingValues (); i != e; ++i)
+            observe (phi->getIncomingValue (i));
+        else if (CallInst *ci = dyn_cast<CallInst> (v))
+          if (isDroppableDef (shadowFn (ci))) observe (tokenOperand (*ci));
+      }
+
+      // -- drop everything else: dead phis first, they may use defs
+      SmallVector<Instruction*, 32> dead;
+      for (PHINode *phi : phis)
+        if (!live.count (phi)) dead.push_back (phi);
+      for (BasicBlock &bb : F)
+        for (Instruction &I : bb)
+          if (isa<CallInst> (&I) && isDroppableDef (shadowFn (&I)) && !live.count (&I))
+            dead.push_back (&I);
+
+      for (Instruction *I : dead)
+        I->replaceAllUsesWith (UndefValue::get (I->getType ()));
+      for (Instruction *I : dead)
+      {
+        if (CallInst *ci = dyn_cast<CallInst> (I))
+        {
+          Value *last = ci->getArgOperand (ci->getNumArgOperands () - 1);
+          ci->eraseFromParent ();
+          RecursivelyDeleteTriviallyDeadInstructions (last);
+          ++NumDefs;
+        }
+        else
+          I->eraseFromParent ();
+      }
+
+      LOG ("shadow-opt",
+           errs () << F.getName () << ": " << dead.size ()
+                   << " unobserved shadow tokens\n";);
+      return changed || !dead.empty ();
+    }
+
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    { AU.setPreservesCFG (); }
+
+    const char *getPassName () const override
+    { return "Redundant shadow memory token elimination"; }
+  };
+
+  char ShadowMemOpt::ID = 0;
+
+  llvm::Pass* createShadowMemOptPass () {return new ShadowMemOpt ();}
+}
+
+static llvm::RegisterPass<seahorn::ShadowMemOpt>
+X ("shadow-opt", "Remove redundant shadow memory tokens");
@@ -9,12 +9,17 @@
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/ADT/SCCIterator.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 
 #include "avy/AvyDebug.h"
 #include "boost/range.hpp"
 #include "boost/range/algorithm/sort.hpp"
 #include "boost/range/algorithm/set_algorithm.hpp"
 #include "boost/range/algorithm/binary_search.hpp"
+#include "boost/range/adaptor/reversed.hpp"
+
+#include <algorithm>
 
 #include "seahorn/Analysis/DSA/CallSite.hh"
 #include "seahorn/Analysis/DSA/Mapper.hh"
@@ -30,6 +35,22 @@ LocalReadMod ("horn-sea-dsa-local-mod",
               llvm::cl::desc ("DSA: Compute read/mod info locally"),
               llvm::cl::init (false));
 
+static llvm::cl::opt<bool>
+SlimShadowArgs ("horn-sea-dsa-slim-args",
+                llvm::cl::desc ("DSA: pass to a function only the regions it "
+                                "reads or modifies, and fold the regions "
+                                "never written into one constant region"),
+                llvm::cl::init (false));
+
+static bool useReadMod () { return LocalReadMod || SlimShadowArgs; }
+
+static llvm::cl::opt<std::string>
+ShadowRegionsFile ("horn-sea-dsa-regions-to-file",
+                   llvm::cl::desc ("DSA: write the shadow memory regions, "
+                                   "heaviest first, into a file"),
+                   llvm::cl::init (""),
+                   llvm::cl::Hidden);
+
 namespace seahorn
 {
   using namespace llvm;
@@ -147,7 +168,7 @@ namespace seahorn
   bool ShadowMemSeaDsa::isRead (const Node *n, const Function &f)
   {
     LOG("shadow_mod",
-          if (LocalReadMod && n->isRead () != (m_readList[&f].count (n) > 0))
+          if (useReadMod () && n->isRead () != (m_readList[&f].count (n) > 0))
           {
             errs () << f.getName ()
                     << " readNode: " << n->isRead ()
@@ -156,23 +177,29 @@ namespace seahorn
           }
         );
     
-    return LocalReadMod ?  m_readList[&f].count(n) > 0 : n->isRead ();
+    return useReadMod () ?  m_readList[&f].count(n) > 0 : n->isRead ();
   }
   bool ShadowMemSeaDsa::isModified (const Node *n, const Function &f)
   {
     LOG ("shadow_mod",
-         if (LocalReadMod && n->isModified () != (m_modList[&f].count (n) > 0))
+         if (useReadMod () && n->isModified () != (m_modList[&f].count (n) > 0))
          {
            errs () << f.getName ()
                    << " modNode: " << n->isModified ()
                    << " modList: " << m_modList[&f].count(n) << "\n";
            if (n->isModified ()) n->write(errs());
          });
-    return LocalReadMod ? m_modList[&f].count (n) > 0 : n->isModified ();
+    return useReadMod () ? m_modList[&f].count (n) > 0 : n->isModified ();
   }
+
+  bool ShadowMemSeaDsa::isConstantRegion (const Node *n, const Function &f)
+  { return SlimShadowArgs && n && m_writtenList[&f].count (n) <= 0; }
   
-  AllocaInst* ShadowMemSeaDsa::allocaForNode (const Node *n, const unsigned offset)
+  AllocaInst* ShadowMemSeaDsa::allocaForNode (const Node *n, unsigned offset)
   {
+    // -- the constant region is the shadow of the null node
+    if (m_fn && isConstantRegion (n, *m_fn)) { n = nullptr; offset = 0; }
+    
     auto &offmap = m_shadows[n];
     
     auto it = offmap.find (offset);
@@ -185,13 +212,15 @@ namespace seahorn
     
   unsigned ShadowMemSeaDsa::getId (const Node *n, unsigned offset)
   {
+    if (m_fn && isConstantRegion (n, *m_fn)) { n = nullptr; offset = 0; }
+    
     auto it = m_node_ids.find (n);
     if (it != m_node_ids.end ()) return it->second + offset;
     
     unsigned id = m_max_id;
     m_node_ids[n] = id;
 
-    if (n->size() == 0) {
+    if (!n || n->size() == 0) {
       // XXX: nodes can have zero size
       assert (offset == 0);
       m_max_id++;
@@ -275,17 +304,77 @@ namespace seahorn
                                        (Type*) 0);
   }
   
+  ShadowMemSeaDsa::RegionInfo &ShadowMemSeaDsa::region (const Cell &c)
+  {
+    RegionInfo &r = m_regions [getId (c)];
+    if (!r.node && !(m_fn && isConstantRegion (c.getNode (), *m_fn)))
+    {
+      r.node = c.getNode ();
+      r.offset = getOffset (c);
+    }
+    return r;
+  }
+
+  void ShadowMemSeaDsa::writeRegions (raw_ostream &o) const
+  {
+    std::vector<const std::pair<const unsigned, RegionInfo>*> regions;
+    unsigned total = 0;
+    for (auto &kv : m_regions)
+    {
+      regions.push_back (&kv);
+      total += kv.second.weight ();
+    }
+    std::stable_sort (regions.begin (), regions.end (),
+                      [] (const std::pair<const unsigned, RegionInfo> *a,
+                          const std::pair<const unsigned, RegionInfo> *b)
+                      { return a->second.weight () > b->second.weight (); });
+
+    // -- the share is over the shadow operations and arguments, which
+    // -- is what the regions contribute to the formulas
+    o << "region,ds_node,offset,alloc_sites,loads,stores,rel_args,call_args,share\n";
+    for (auto *kv : regions)
+    {
+      const RegionInfo &r = kv->second;
+      o << kv->first << ",";
+      if (r.node) o << r.node->getId () << "," << r.offset << ",";
+      else o << "const,0,";
+      bool first = true;
+      if (r.node)
+        for (const Value *v : r.node->getAllocSites ())
+        {
+          if (!first) o << ";";
+          first = false;
+          if (v->hasName ()) o << v->getName ();
+          else o << "<unnamed>";
+        }
+      o << "," << r.loads << "," << r.stores << "," << r.relArgs
+        << "," << r.callArgs << ",";
+      o << format ("%.2f", total ? 100.0 * r.weight () / total : 0.0) << "\n";
+    }
+  }
+
   bool ShadowMemSeaDsa::runOnModule (llvm::Module &M)
   {
     if (M.begin () == M.end ()) return false;
   
     m_dsa = &getAnalysis<DsaAnalysis>().getDsaAnalysis ();
     
-    if (LocalReadMod) computeReadMod ();
+    if (useReadMod ()) computeReadMod ();
+    if (SlimShadowArgs) computeWritten ();
     
     declareFunctions(M);
     m_node_ids.clear ();
+    m_regions.clear ();
     for (Function &f : M) runOnFunction (f);
+    m_fn = nullptr;
+
+    if (ShadowRegionsFile != "")
+    {
+      std::error_code EC;
+      raw_fd_ostream file (ShadowRegionsFile, EC, sys::fs::F_Text);
+      if (!EC) writeRegions (file);
+      else errs () << "WARNING: cannot write " << ShadowRegionsFile << "\n";
+    }
       
     return false;
   }
@@ -355,8 +444,30 @@ namespace seahorn
           }
           else if (m_dsa->hasGraph (*cf))
           {            
-            readSet.insert (m_readList[cf].begin (), m_readList[cf].end ());
-            modSet.insert (m_modList[cf].begin (), m_modList[cf].end ());
+            Graph &calleeG = m_dsa->getGraph (*cf);
+            if (&calleeG == &G)
+            {
+              readSet.insert (m_readList[cf].begin (), m_readList[cf].end ());
+              modSet.insert (m_modList[cf].begin (), m_modList[cf].end ());
+              continue;
+            }
+            
+            // -- the nodes of another graph are summarized by the
+            // -- caller nodes that simulate them
+            ImmutableCallSite ICS (ci);
+            DsaCallSite DCS (ICS);
+            SimulationMapper simMap;
+            dsa::Graph::computeCalleeCallerMapping (DCS, calleeG, G, false, false, simMap);
+            for (const Node *n : m_readList[cf])
+            {
+              Cell c = simMap.get (*n);
+              if (!c.isNull ()) readSet.insert (c.getNode ());
+            }
+            for (const Node *n : m_modList[cf])
+            {
+              Cell c = simMap.get (*n);
+              if (!c.isNull ()) modSet.insert (c.getNode ());
+            }
           }            
           
         }
@@ -365,6 +476,66 @@ namespace seahorn
     }
   }
   
+  void ShadowMemSeaDsa::computeWritten ()
+  {
+    CallGraph &cg = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
+    std::vector<std::vector<CallGraphNode*> > sccs;
+    for (auto it = scc_begin (&cg); !it.isAtEnd(); ++it) sccs.push_back (*it);
+    
+    // -- callers first. The functions of an SCC share a graph
+    for (auto &scc : boost::adaptors::reverse (sccs))
+    {
+      NodeSet written;
+      for (CallGraphNode *cgn : scc)
+      {
+        Function *f = cgn->getFunction ();
+        if (!f) continue;
+        written.insert (m_modList[f].begin (), m_modList[f].end ());
+        written.insert (m_writtenList[f].begin (), m_writtenList[f].end ());
+      }
+      for (CallGraphNode *cgn : scc)
+      {
+        Function *f = cgn->getFunction ();
+        if (!f) continue;
+        m_writtenList[f] = written;
+      }
+      
+      // -- a callee node is written if the node of the caller that
+      // -- simulates it is
+      for (CallGraphNode *cgn : scc)
+      {
+        Function *f = cgn->getFunction ();
+        if (!f || !m_dsa->hasGraph (*f)) continue;
+        Graph &G = m_dsa->getGraph (*f);
+        
+        for (auto &callRecord : *cgn)
+        {
+          if (!callRecord.first) continue;
+          ImmutableCallSite ICS (callRecord.first);
+          DsaCallSite DCS (ICS);
+          const Function *cf = DCS.getCallee ();
+          if (!cf || !m_dsa->hasGraph (*cf)) continue;
+          Graph &calleeG = m_dsa->getGraph (*cf);
+          if (&calleeG == &G) continue;
+          
+          NodeSet &calleeW = m_writtenList[cf];
+          SimulationMapper simMap;
+          bool res = dsa::Graph::computeCalleeCallerMapping (DCS, calleeG, G,
+                                                             false, false, simMap);
+          for (const Node &n : calleeG)
+          {
+            if (n.isForwarding ()) continue;
+            Cell c = simMap.get (n);
+            // -- without a functional simulation, assume every node is written
+            if (!res || !simMap.isFunction () ||
+                (!c.isNull () && written.count (c.getNode ())))
+              calleeW.insert (&n);
+          }
+        }
+      }
+    }
+  }
+  
   static Value *getUniqueScalar (LLVMContext &ctx, IRBuilder<> &B, const Cell &c)
   {
     const Node* n = c.getNode ();
@@ -393,6 +564,7 @@ namespace seahorn
     if (!m_dsa->hasGraph(F)) return false;
 
     Graph &G = m_dsa->getGraph (F);
+    m_fn = &F;
 
     LOG ("shadow",
          errs () << "Looking into globals\n";
@@ -421,6 +593,7 @@ namespace seahorn
           if (c.isNull ()) continue;
           
           B.SetInsertPoint (&inst);
+          region (c).loads++;
           B.CreateCall3 (m_memLoadFn, B.getInt32 (getId (c)),
                          B.CreateLoad (allocaForNode (c)),
                          getUniqueScalar (ctx, B, c));
@@ -432,6 +605,7 @@ namespace seahorn
           if (c.isNull ()) continue;
           
           B.SetInsertPoint (&inst);
+          region (c).stores++;
           AllocaInst *v = allocaForNode (c);
           B.CreateStore (B.CreateCall3 (m_memStoreFn, 
                                         B.getInt32 (getId (c)),
@@ -471,6 +645,7 @@ namespace seahorn
             // TODO: handle multiple nodes
             assert (c.getOffset () == 0 && "TODO");
             B.SetInsertPoint (call);
+            region (c).stores++;
             AllocaInst *v = allocaForNode (c);
             B.CreateStore (B.CreateCall3 (m_memStoreFn,
                                           B.getInt32 (getId (c)),
@@ -520,6 +695,8 @@ namespace seahorn
             
             // skip nodes that are not read/written by the callee
             if (!isRead (n, CF) && !isModified (n, CF)) continue;
+            // -- the callee reads a constant region of its own
+            if (isConstantRegion (n, CF)) continue;
 
             // TODO: This must be done for every possible offset of the caller node,
             // TODO: not just for offset 0
@@ -535,6 +712,7 @@ namespace seahorn
             // -- from the return of the function
             if (isRead (n, CF) && !isModified (n, CF) && retReach.count(n) <= 0)
             {
+              region (callerC).callArgs++;
               B.CreateCall4 (m_argRefFn, B.getInt32 (id),
                              B.CreateLoad (v),
                              B.getInt32 (idx), getUniqueScalar (ctx, B, callerC));
@@ -544,6 +722,7 @@ namespace seahorn
             {
               // -- n is new node iff it is reachable only from the return node
               Constant* argFn = retReach.count (n) ? m_argNewFn : m_argModFn;
+              region (callerC).callArgs += retReach.count (n) ? 1 : 2;
               B.CreateStore (B.CreateCall4 (argFn, 
                                             B.getInt32 (id),
                                             B.CreateLoad (v),
@@ -565,7 +744,7 @@ namespace seahorn
     // -- create shadows for all nodes that are modified by this
     // -- function and escape to a parent function
     for (const Node *n : reach)
-      if (isModified (n, F) || isRead (n, F))
+      if ((isModified (n, F) || isRead (n, F)) && !isConstantRegion (n, F))
       {
         // TODO: allocate for all slices of n, not just offset 0
         allocaForNode (n, 0);
@@ -624,9 +803,12 @@ namespace seahorn
       // n is read and is not only return-node reachable (for
       // return-only reachable nodes, there is no initial value
       // because they are created within this function)
+      if (isConstantRegion (n, F)) { ++idx; continue; }
+      
       if ((isRead (n, F) || isModified (n, F)) && retReach.count (n) <= 0)
       {
         assert (!inits[n].empty());
+        region (c).relArgs++;
         /// initial value
         B.CreateCall4 (m_markIn,
                        B.getInt32 (getId (c)),
@@ -638,6 +820,7 @@ namespace seahorn
       if (isModified (n, F))
       {
         assert (!inits[n].empty());
+        region (c).relArgs++;
         /// final value
         B.CreateCall4 (m_markOut, 
                        B.getInt32 (getId (c)),
@@ -0,0 +1,354 @@
+#define DEBUG_TYPE "slice-program"
+
+#include "llvm/Pass.h"
+#include "llvm/Analysis/PostDominators.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Module.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "seahorn/Analysis/DSA/Global.hh"
+#include "seahorn/Analysis/DSA/Graph.hh"
+
+#include "avy/AvyDebug.h"
+
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+STATISTIC (NumSlicedInsts, "Number of instructions sliced away");
+STATISTIC (NumSlicedBranches, "Number of branches made nondeterministic");
+
+namespace
+{
+  /// Removes what cannot affect the properties. The slice is the
+  /// backward closure, over data and control dependences, of the
+  /// calls to verifier.error and of the assumptions. A load depends
+  /// on the writers of its DSA node in the context-insensitive graph,
+  /// which is shared by every function, so that stores in a callee
+  /// are found from a load in a caller.
+  ///
+  /// The CFG is kept: a branch outside of the slice branches on a
+  /// call to verifier.nondet.sliced instead of its condition, so
+  /// that a counterexample of the sliced program names the blocks of
+  /// the original one and HornCex can tell which of its branches
+  /// were sliced. Calls to functions with nothing in the slice are
+  /// removed, and GlobalDCE removes the functions.
+  class SliceProgram : public ModulePass
+  {
+    typedef dsa::Node Node;
+
+    dsa::GlobalAnalysis *m_dsa;
+
+    /// instructions and arguments in the slice
+    DenseSet<const Value*> m_live;
+    /// functions with an instruction in the slice
+    DenseSet<const Function*> m_liveFns;
+    std::vector<const Value*> m_wl;
+    /// branches not post-dominated by an exit
+    std::vector<const Instruction*> m_keep;
+
+    DenseMap<const Function*, std::vector<const Instruction*> > m_calls;
+    DenseMap<const Function*, std::vector<const ReturnInst*> > m_rets;
+    /// blocks whose terminators control every block
+    DenseMap<const BasicBlock*, std::vector<const BasicBlock*> > m_cdeps;
+    /// instructions that write memory, by the node they write. The
+    /// nodes of m_anyWriters are unknown
+    std::map<const Node*, std::vector<const Instruction*> > m_writers;
+    std::vector<const Instruction*> m_anyWriters;
+
+    /// the node of pointer v of instruction I, null if DSA does not
+    /// know it
+    const Node *node (const Instruction &I, const Value *v)
+    {
+      const Function &F = *I.getParent ()->getParent ();
+      if (!m_dsa->hasGraph (F)) return nullptr;
+      dsa::Graph &g = m_dsa->getGraph (F);
+      return g.hasCell (*v) ? g.getCell (*v).getNode () : nullptr;
+    }
+
+    void addWriter (const Instruction &I, const Value *ptr)
+    {
+      const Node *n = node (I, ptr);
+      if (n) m_writers [n].push_back (&I);
+      else m_anyWriters.push_back (&I);
+    }
+
+    /// marks the writers of the memory that I reads through ptr
+    void markReaders (const Instruction &I, const Value *ptr)
+    {
+      const Node *n = node (I, ptr);
+      if (n) { for (const Instruction *w : m_writers [n]) mark (w); }
+      else for (auto &kv : m_writers)
+             for (const Instruction *w : kv.second) mark (w);
+      for (const Instruction *w : m_anyWriters) mark (w);
+    }
+
+    void mark (const Value *v)
+    { if (m_live.insert (v).second) m_wl.push_back (v); }
+    void close ();
+
+    void collect (Function &F);
+    bool isSeed (const Instruction &I);
+    bool slice (Function &F);
+
+  public:
+
+    static char ID;
+
+    SliceProgram () : ModulePass (ID), m_dsa (nullptr) {}
+
+    virtual bool runOnModule (Module &M);
+
+    virtual void getAnalysisUsage (AnalysisUsage &AU) const
+    {
+      AU.addRequired<dsa::ContextInsensitiveGlobal> ();
+      AU.addRequired<PostDominatorTree> ();
+    }
+
+    virtual const char* getPassName () const {return "SliceProgram";}
+  };
+
+  char SliceProgram::ID = 0;
+
+  /// the properties, the assumptions, and what the semantics cannot
+  /// see through
+  bool SliceProgram::isSeed (const Instruction &I)
+  {
+    if (const TerminatorInst *t = dyn_cast<TerminatorInst> (&I))
+      return !isa<BranchInst> (t) && !isa<ReturnInst> (t) &&
+        !isa<UnreachableInst> (t);
+
+    if (isa<DbgInfoIntrinsic> (&I)) return false;
+    if (isa<MemIntrinsic> (&I)) return false;
+    if (isa<StoreInst> (&I)) return false;
+
+    ImmutableCallSite CS (&I);
+    if (!CS) return I.mayWriteToMemory ();
+
+    const Function *fn = CS.getCalledFunction ();
+    // -- indirect calls, and calls that do not return
+    if (!fn || CS.doesNotReturn ()) return true;
+    if (!fn->isDeclaration () || fn->isIntrinsic ()) return false;
+
+    StringRef name = fn->getName ();
+    if (name.startswith ("verifier.nondet")) return false;
+    if (name.startswith ("verifier.") || name.startswith ("__VERIFIER_"))
+      return true;
+    return name.equals ("seahorn.fail") || name.equals ("seahorn.error");
+  }
+
+  void SliceProgram::collect (Function &F)
+  {
+    if (F.isDeclaration ()) return;
+
+    for (BasicBlock &bb : F)
+      for (Instruction &I : bb)
+      {
+        if (ReturnInst *ret = dyn_cast<ReturnInst> (&I))
+          m_rets [&F].push_back (ret);
+        else if (StoreInst *st = dyn_cast<StoreInst> (&I))
+          addWriter (I, st->getPointerOperand ());
+        else if (MemIntrinsic *mi = dyn_cast<MemIntrinsic> (&I))
+          addWriter (I, mi->getRawDest ());
+        else if (CallInst *ci = dyn_cast<CallInst> (&I))
+        {
+          ImmutableCallSite CS (ci);
+          const Function *fn = CS.getCalledFunction ();
+          if (fn) m_calls [fn].push_back (ci);
+          // -- an external function writes the memory of its pointer
+          // -- arguments
+          if (fn && fn->isDeclaration () && !fn->isIntrinsic () &&
+              !CS.onlyReadsMemory ())
+            for (unsigned i = 0; i < CS.arg_size (); ++i)
+              if (CS.getArgument (i)->getType ()->isPointerTy ())
+                addWriter (I, CS.getArgument (i));
+        }
+      }
+
+    // -- block x is control dependent on b if x post-dominates a
+    // -- successor of b but not b itself
+    PostDominatorTree &pdt = getAnalysis<PostDominatorTree> (F);
+    for (BasicBlock &bb : F)
+    {
+      TerminatorInst *t = bb.getTerminator ();
+      if (t->getNumSuccessors () < 2) continue;
+
+      DomTreeNode *n = pdt.getNode (&bb);
+      DomTreeNode *ipdom = n ? n->getIDom () : nullptr;
+      for (unsigned i = 0; i < t->getNumSuccessors (); ++i)
+      {
+        DomTreeNode *runner = pdt.getNode (t->getSuccessor (i));
+        if (!n || !runner)
+        {
+          // -- not post-dominated by an exit. Keep the branch
+          m_keep.push_back (t);
+          break;
+        }
+        for (; runner && runner != ipdom; runner = runner->getIDom ())
+          if (runner->getBlock ())
+            m_cdeps [runner->getBlock ()].push_back (&bb);
+      }
+    }
+  }
+
+  void SliceProgram::close ()
+  {
+    while (!m_wl.empty ())
+    {
+      const Value *v = m_wl.back ();
+      m_wl.pop_back ();
+
+      if (const Argument *arg = dyn_cast<Argument> (v))
+      {
+        for (const Instruction *call : m_calls [arg->getParent ()])
+        {
+          ImmutableCallSite CS (call);
+          if (arg->getArgNo () < CS.arg_size ())
+            mark (CS.getArgument (arg->getArgNo ()));
+        }
+        continue;
+      }
+
+      const Instruction *I = dyn_cast<Instruction> (v);
+      if (!I) continue;
+
+      for (const Value *op : I->operands ())
+        if (isa<Instruction> (op) || isa<Argument> (op)) mark (op);
+
+      const BasicBlock &bb = *I->getParent ();
+      for (const BasicBlock *c : m_cdeps [&bb]) mark (c->getTerminator ());
+
+      // -- a phi node depends on the edge it is reached by
+      if (const PHINode *phi = dyn_cast<PHINode> (I))
+        for (unsigned i = 0; i < phi->getNumIncomingValues (); ++i)
+          mark (phi->getIncomingBlock (i)->getTerminator ());
+
+      // -- a function in the slice is executed by all its calls
+      const Function *F = bb.getParent ();
+      if (m_liveFns.insert (F).second)
+        for (const Instruction *call : m_calls [F]) mark (call);
+
+      if (const LoadInst *li = dyn_cast<LoadInst> (I))
+        markReaders (*I, li->getPointerOperand ());
+      else if (const MemTransferInst *mt = dyn_cast<MemTransferInst> (I))
+        markReaders (*I, mt->getRawSource ());
+      else if (isa<CallInst> (I))
+      {
+        ImmutableCallSite CS (I);
+        const Function *fn = CS.getCalledFunction ();
+        if (fn && !fn->isDeclaration ())
+        {
+          for (const ReturnInst *ret : m_rets [fn])
+            if (ret->getReturnValue ()) mark (ret->getReturnValue ());
+        }
+        else if (!CS.doesNotAccessMemory ())
+          for (unsigned i = 0; i < CS.arg_size (); ++i)
+            if (CS.getArgument (i)->getType ()->isPointerTy ())
+              markReaders (*I, CS.getArgument (i));
+      }
+    }
+  }
+
+  /// the seahorn.* calls that mark where functions are entered, for
+  /// the counterexamples
+  static bool isMarker (const Instruction &I)
+  {
+    ImmutableCallSite CS (&I);
+    const Function *fn = CS ? CS.getCalledFunction () : nullptr;
+    return fn && fn->isDeclaration () && fn->getName ().startswith ("seahorn.");
+  }
+
+  bool SliceProgram::slice (Function &F)
+  {
+    if (F.isDeclaration ()) return false;
+
+    Constant *nondetFn = nullptr;
+    bool change = false;
+    std::vector<Instruction*> dead;
+    for (BasicBlock &bb : F)
+      for (Instruction &I : bb)
+      {
+        if (m_live.count (&I) || isa<DbgInfoIntrinsic> (&I)) continue;
+
+        if (BranchInst *br = dyn_cast<BranchInst> (&I))
+        {
+          if (!br->isConditional () || isa<Constant> (br->getCondition ()))
+            continue;
+          if (!nondetFn)
+            nondetFn = F.getParent ()->getOrInsertFunction
+              ("verifier.nondet.sliced", Type::getInt1Ty (F.getContext ()), NULL);
+          br->setCondition (CallInst::Create (nondetFn, "", br));
+          ++NumSlicedBranches;
+          change = true;
+        }
+        else if (ReturnInst *ret = dyn_cast<ReturnInst> (&I))
+        {
+          // -- the value is live if a live call uses it, see close ()
+          Value *v = ret->getReturnValue ();
+          if (v && !isa<Constant> (v) && !m_live.count (v))
+          {
+            ret->setOperand (0, Constant::getNullValue (v->getType ()));
+            change = true;
+          }
+        }
+        else if (!isa<TerminatorInst> (&I) && !isMarker (I))
+          dead.push_back (&I);
+      }
+
+    // -- only dead instructions use dead instructions
+    for (Instruction *I : dead)
+      if (!I->use_empty ()) I->replaceAllUsesWith (UndefValue::get (I->getType ()));
+    for (Instruction *I : dead) I->eraseFromParent ();
+    NumSlicedInsts += dead.size ();
+
+    return change || !dead.empty ();
+  }
+
+  bool SliceProgram::runOnModule (Module &M)
+  {
+    m_dsa = &getAnalysis<dsa::ContextInsensitiveGlobal> ().getGlobalAnalysis ();
+
+    for (Function &F : M) collect (F);
+
+    for (const Instruction *t : m_keep) mark (t);
+    for (Function &F : M)
+      for (BasicBlock &bb : F)
+        for (Instruction &I : bb)
+          if (isSeed (I)) mark (&I);
+    close ();
+
+    LOG ("slice-program",
+         errs () << "program slice: " << m_live.size () << " values in "
+         << m_liveFns.size () << " functions\n";);
+
+    bool change = false;
+    for (Function &F : M) change |= slice (F);
+
+    m_live.clear ();
+    m_keep.clear ();
+    m_liveFns.clear ();
+    m_calls.clear ();
+    m_rets.clear ();
+    m_cdeps.clear ();
+    m_writers.clear ();
+    m_anyWriters.clear ();
+    return change;
+  }
+}
+
+namespace seahorn
+{
+  llvm::Pass* createSliceProgramPass () {return new SliceProgram ();}
+}
+
+static RegisterPass<SliceProgram>
+X("slice-program",
+  "Remove the instructions and functions that cannot affect the properties");
@@ -0,0 +1,124 @@
+#define DEBUG_TYPE "slice-properties"
+
+#include "llvm/Pass.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "llvm/IR/IRBuilder.h"
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+NumGroups ("slice-properties-groups",
+           cl::desc ("Number of groups of properties"),
+           cl::init (1));
+
+static cl::opt<unsigned>
+LiveGroup ("slice-properties-group",
+           cl::desc ("Group of properties to keep"),
+           cl::init (0));
+
+namespace
+{
+  /// Keeps one group of properties. Properties are the calls to
+  /// seahorn.error(id) inserted by EnumVerifierCalls and the group of
+  /// a property is id modulo the number of groups. The calls to
+  /// verifier.error of the other groups are replaced by
+  /// verifier.assume(false) so that their checks become assumptions.
+  class SliceProperties : public ModulePass
+  {
+    unsigned m_groups;
+    unsigned m_group;
+    Constant *m_assumeFn;
+
+  public:
+
+    static char ID;
+
+    SliceProperties () : ModulePass (ID),
+                         m_groups (NumGroups), m_group (LiveGroup),
+                         m_assumeFn (nullptr) {}
+
+    SliceProperties (unsigned groups, unsigned group) :
+        ModulePass (ID), m_groups (groups), m_group (group),
+        m_assumeFn (nullptr) {}
+
+    virtual bool runOnModule (Module &M)
+    {
+      if (m_groups <= 1) return false;
+
+      LLVMContext &ctx = M.getContext ();
+      m_assumeFn = M.getOrInsertFunction ("verifier.assume",
+                                          Type::getVoidTy (ctx),
+                                          Type::getInt1Ty (ctx),
+                                          NULL);
+
+      bool change = false;
+      for (auto &F : M) change |= runOnFunction (F);
+
+      return change;
+    }
+
+    virtual bool runOnFunction (Function &F)
+    {
+      if (F.empty ()) return false;
+
+      std::vector<CallInst*> Worklist;
+      for (auto &BB : F)
+        for (auto &I : BB)
+        {
+          CallInst *CI = dyn_cast<CallInst> (&I);
+          if (!CI || CI->getNumArgOperands () != 1) continue;
+          Function* CF = CI->getCalledFunction ();
+          if (!CF || !CF->getName ().equals ("seahorn.error")) continue;
+          ConstantInt *id = dyn_cast<ConstantInt> (CI->getArgOperand (0));
+          if (id && id->getZExtValue () % m_groups != m_group)
+            Worklist.push_back (CI);
+        }
+
+      if (Worklist.empty ()) return false;
+
+      IRBuilder<> Builder (F.getContext ());
+      for (CallInst *CI : Worklist)
+      {
+        // -- EnumVerifierCalls inserts seahorn.error(id) right before
+        // -- the call to verifier.error
+        BasicBlock::iterator it = CI;
+        CallInst *err = dyn_cast<CallInst> (++it);
+        if (err && err->getCalledFunction () &&
+            err->getCalledFunction ()->getName ().equals ("verifier.error"))
+        {
+          Builder.SetInsertPoint (err);
+          CallInst *assume = Builder.CreateCall (m_assumeFn, Builder.getFalse ());
+          assume->setDebugLoc (err->getDebugLoc ());
+          err->eraseFromParent ();
+        }
+        CI->eraseFromParent ();
+      }
+
+      return true;
+    }
+
+    virtual void getAnalysisUsage (AnalysisUsage &AU) const {
+      AU.setPreservesAll ();
+    }
+
+    virtual const char* getPassName () const {return "SliceProperties";}
+  };
+
+  char SliceProperties::ID = 0;
+}
+
+namespace seahorn
+{
+  llvm::Pass* createSlicePropertiesPass (unsigned groups, unsigned group)
+  {return new SliceProperties (groups, group);}
+}
+
+static RegisterPass<SliceProperties>
+X("slice-properties",
+  "Keep one group of properties and assume the others");
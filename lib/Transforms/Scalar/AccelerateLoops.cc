@@ -0,0 +1,402 @@
+/** Replace simple counting, fill and copy loops by their effect */
+
+/**
+ * A loop whose trip count is known to scalar evolution and whose
+ * values used after the loop are linear functions of the count is
+ * replaced by these closed forms, e.g.,
+ *
+ *   for (i = 0; i < n; i++) a += k;   ==>   a = a0 + k * n; i = n;
+ *
+ * Such loops cost the Horn solver an iteration per lemma, while the
+ * closed form is loop-free. Non-linear closed forms (k * n for a
+ * variable k) are left alone so that the encoding stays linear.
+ *
+ * A single-block loop may in addition store one element per
+ * iteration, either a loop invariant value whose bytes are all
+ * equal (fill), or the element at the same offset of another object
+ * (copy). It becomes a memset or a memcpy of the whole range. The
+ * Horn encoding havocs the region written by a memory intrinsic, so
+ * the first and the last element are assumed to hold their value.
+ *
+ * No accelerated loop calls a function, so the nondet values of a
+ * counterexample, and its harness, are unchanged. The instructions of
+ * a summary get the debug location of the loop, and every accelerated
+ * loop is recorded in the named metadata seahorn.accel as
+ *   !{!"function", !"header", !"count|fill|copy", i32 line}
+ * so that a counterexample through a summary is mapped back to its
+ * loop.
+ */
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AliasAnalysis.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "avy/AvyDebug.h"
+
+using namespace llvm;
+
+STATISTIC (LoopsCount, "Number of counting loops replaced by closed forms");
+STATISTIC (LoopsFill, "Number of fill loops replaced by memset");
+STATISTIC (LoopsCopy, "Number of copy loops replaced by memcpy");
+
+namespace
+{
+  class AccelerateLoops : public LoopPass
+  {
+    ScalarEvolution *m_se;
+    const DataLayout *m_dl;
+
+    /// the store of a fill or a copy loop, and the load of a copy
+    struct MemIdiom
+    {
+      StoreInst *store;
+      LoadInst *load;
+      MemIdiom () : store (nullptr), load (nullptr) {}
+    };
+
+    bool isLinear (const SCEV *S);
+    const SCEV *getAffineStart (Value *ptr, Type *elemTy, Loop *L);
+    bool getMemIdiom (Loop *L, MemIdiom &idiom);
+    void emitMemIdiom (Loop *L, const MemIdiom &idiom, SCEVExpander &expander);
+    void deleteLoop (Loop *L, LPPassManager &LPM);
+    void record (Loop *L, const char *kind);
+
+  public:
+    static char ID;
+    AccelerateLoops () : LoopPass (ID), m_se (nullptr), m_dl (nullptr) {}
+
+    bool runOnLoop (Loop *L, LPPassManager &LPM) override;
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    {
+      AU.addRequired<DataLayoutPass>();
+      AU.addRequired<DominatorTreeWrapperPass>();
+      AU.addRequired<LoopInfo>();
+      AU.addRequiredID(LoopSimplifyID);
+      AU.addRequiredID(LCSSAID);
+      AU.addRequired<ScalarEvolution>();
+
+      AU.addPreserved<DominatorTreeWrapperPass>();
+      AU.addPreserved<LoopInfo>();
+      AU.addPreservedID(LoopSimplifyID);
+      AU.addPreservedID(LCSSAID);
+      AU.addPreserved<ScalarEvolution>();
+    }
+  };
+}
+
+char AccelerateLoops::ID = 0;
+
+/// true if S is loop-free and linear: a product has at most one
+/// operand that is not a constant, and a division is by a constant
+bool AccelerateLoops::isLinear (const SCEV *S)
+{
+  switch (S->getSCEVType ())
+  {
+  case scConstant:
+  case scUnknown:
+    return true;
+  case scTruncate:
+  case scZeroExtend:
+  case scSignExtend:
+    return isLinear (cast<SCEVCastExpr> (S)->getOperand ());
+  case scAddExpr:
+  case scSMaxExpr:
+  case scUMaxExpr:
+  {
+    const SCEVNAryExpr *N = cast<SCEVNAryExpr> (S);
+    for (auto it = N->op_begin (), end = N->op_end (); it != end; ++it)
+      if (!isLinear (*it)) return false;
+    return true;
+  }
+  case scMulExpr:
+  {
+    const SCEVMulExpr *M = cast<SCEVMulExpr> (S);
+    unsigned vars = 0;
+    for (auto it = M->op_begin (), end = M->op_end (); it != end; ++it)
+    {
+      if (isa<SCEVConstant> (*it)) continue;
+      if (++vars > 1 || !isLinear (*it)) return false;
+    }
+    return true;
+  }
+  case scUDivExpr:
+  {
+    const SCEVUDivExpr *D = cast<SCEVUDivExpr> (S);
+    return isa<SCEVConstant> (D->getRHS ()) && isLinear (D->getLHS ());
+  }
+  default:
+    return false;
+  }
+}
+
+/// the address of the first iteration if ptr advances by one element
+/// of elemTy per iteration of L, or null
+const SCEV *AccelerateLoops::getAffineStart (Value *ptr, Type *elemTy, Loop *L)
+{
+  const SCEVAddRecExpr *AR = dyn_cast<SCEVAddRecExpr> (m_se->getSCEV (ptr));
+  if (!AR || AR->getLoop () != L || !AR->isAffine ()) return nullptr;
+  const SCEVConstant *step = dyn_cast<SCEVConstant> (AR->getStepRecurrence (*m_se));
+  uint64_t size = m_dl->getTypeStoreSize (elemTy);
+  // -- elements with padding are not contiguous
+  if (!step || size != m_dl->getTypeAllocSize (elemTy) ||
+      step->getValue ()->getSExtValue () != (int64_t) size)
+    return nullptr;
+  if (!m_se->isLoopInvariant (AR->getStart (), L)) return nullptr;
+  return AR->getStart ();
+}
+
+/// true if the memory accesses of L are those of a fill or a copy
+/// loop, or if L does not access memory at all
+bool AccelerateLoops::getMemIdiom (Loop *L, MemIdiom &idiom)
+{
+  SmallVector<LoadInst*, 2> loads;
+  for (BasicBlock *BB : L->getBlocks ())
+    for (Instruction &I : *BB)
+    {
+      if (isa<DbgInfoIntrinsic> (&I)) continue;
+      if (LoadInst *LI = dyn_cast<LoadInst> (&I))
+      {
+        if (!LI->isSimple ()) return false;
+        loads.push_back (LI);
+      }
+      else if (StoreInst *SI = dyn_cast<StoreInst> (&I))
+      {
+        if (!SI->isSimple () || idiom.store) return false;
+        idiom.store = SI;
+      }
+      else if (I.mayHaveSideEffects () || I.mayReadOrWriteMemory ())
+        return false;
+    }
+
+  // -- loads of memory that the loop does not change are handled as
+  // -- any other value
+  if (!idiom.store) return true;
+
+  // -- every instruction executes once per iteration
+  if (L->getNumBlocks () != 1) return false;
+
+  StoreInst *SI = idiom.store;
+  Value *val = SI->getValueOperand ();
+  Type *elemTy = val->getType ();
+  const SCEV *dst = getAffineStart (SI->getPointerOperand (), elemTy, L);
+  if (!dst) return false;
+
+  if (L->isLoopInvariant (val))
+    return loads.empty () && isBytewiseValue (val);
+
+  // -- a copy: the stored value is the only load, of the same element
+  // -- of another object
+  LoadInst *LI = dyn_cast<LoadInst> (val);
+  if (!LI || loads.size () != 1 || loads [0] != LI || !LI->hasOneUse ()) return false;
+  if (!getAffineStart (LI->getPointerOperand (), elemTy, L)) return false;
+  Value *dstObj = GetUnderlyingObject (SI->getPointerOperand (), m_dl);
+  Value *srcObj = GetUnderlyingObject (LI->getPointerOperand (), m_dl);
+  if (dstObj == srcObj || !isIdentifiedObject (dstObj) || !isIdentifiedObject (srcObj))
+    return false;
+  idiom.load = LI;
+  return true;
+}
+
+/// emits the memset or memcpy of a fill or copy loop, and the
+/// assumptions on its first and last element, in the preheader of L
+void AccelerateLoops::emitMemIdiom (Loop *L, const MemIdiom &idiom,
+                                    SCEVExpander &expander)
+{
+  BasicBlock *preheader = L->getLoopPreheader ();
+  Instruction *insertPt = preheader->getTerminator ();
+  Module &M = *preheader->getParent ()->getParent ();
+  LLVMContext &C = M.getContext ();
+
+  StoreInst *SI = idiom.store;
+  Type *elemTy = SI->getValueOperand ()->getType ();
+  Type *ptrTy = SI->getPointerOperand ()->getType ();
+  IntegerType *intPtrTy = m_dl->getIntPtrType (C, SI->getPointerAddressSpace ());
+  uint64_t size = m_dl->getTypeStoreSize (elemTy);
+
+  // -- every instruction of a single-block loop runs count + 1 times
+  const SCEV *count = m_se->getTruncateOrZeroExtend (m_se->getBackedgeTakenCount (L),
+                                                     intPtrTy);
+  const SCEV *one = m_se->getConstant (intPtrTy, 1);
+  const SCEV *elemSz = m_se->getConstant (intPtrTy, size);
+  const SCEV *bytes = m_se->getMulExpr (m_se->getAddExpr (count, one), elemSz);
+  const SCEV *lastOff = m_se->getMulExpr (count, elemSz);
+
+  const SCEV *dstS = getAffineStart (SI->getPointerOperand (), elemTy, L);
+  Value *dst = expander.expandCodeFor (dstS, ptrTy, insertPt);
+  Value *dstLast = expander.expandCodeFor (m_se->getAddExpr (dstS, lastOff),
+                                           ptrTy, insertPt);
+  Value *len = expander.expandCodeFor (bytes, intPtrTy, insertPt);
+  Value *src = nullptr, *srcLast = nullptr;
+  if (idiom.load)
+  {
+    const SCEV *srcS = getAffineStart (idiom.load->getPointerOperand (), elemTy, L);
+    Type *srcTy = idiom.load->getPointerOperand ()->getType ();
+    src = expander.expandCodeFor (srcS, srcTy, insertPt);
+    srcLast = expander.expandCodeFor (m_se->getAddExpr (srcS, lastOff), srcTy, insertPt);
+  }
+
+  IRBuilder<> B (insertPt);
+  B.SetCurrentDebugLocation (L->getHeader ()->getTerminator ()->getDebugLoc ());
+  unsigned align = std::max (1u, SI->getAlignment ());
+  if (idiom.load)
+  {
+    align = std::min (align, std::max (1u, idiom.load->getAlignment ()));
+    B.CreateMemCpy (dst, src, len, align);
+  }
+  else
+    B.CreateMemSet (dst, isBytewiseValue (SI->getValueOperand ()), len, align);
+
+  Function *assumeFn = M.getFunction ("verifier.assume");
+  if (!assumeFn || !(elemTy->isIntegerTy () || elemTy->isPointerTy ())) return;
+  // -- the loop wrote both elements, so they can be read
+  Value *first = idiom.load ? B.CreateLoad (src) : SI->getValueOperand ();
+  Value *last = idiom.load ? B.CreateLoad (srcLast) : SI->getValueOperand ();
+  B.CreateCall (assumeFn, B.CreateICmpEQ (B.CreateLoad (dst), first));
+  B.CreateCall (assumeFn, B.CreateICmpEQ (B.CreateLoad (dstLast), last));
+}
+
+/// removes L once nothing after it uses its values. As LoopDeletion
+void AccelerateLoops::deleteLoop (Loop *L, LPPassManager &LPM)
+{
+  BasicBlock *preheader = L->getLoopPreheader ();
+  BasicBlock *exitBlock = L->getExitBlock ();
+  BasicBlock *exitingBlock = L->getExitingBlock ();
+
+  m_se->forgetLoop (L);
+
+  preheader->getTerminator ()->replaceUsesOfWith (L->getHeader (), exitBlock);
+  for (BasicBlock::iterator BI = exitBlock->begin (); PHINode *P = dyn_cast<PHINode> (BI); ++BI)
+    P->setIncomingBlock (P->getBasicBlockIndex (exitingBlock), preheader);
+
+  DominatorTree &DT = getAnalysis<DominatorTreeWrapperPass> ().getDomTree ();
+  SmallVector<DomTreeNode*, 8> children;
+  for (BasicBlock *BB : L->getBlocks ())
+  {
+    children.insert (children.begin (), DT [BB]->begin (), DT [BB]->end ());
+    for (DomTreeNode *child : children)
+      DT.changeImmediateDominator (child, DT [preheader]);
+    children.clear ();
+    DT.eraseNode (BB);
+    BB->dropAllReferences ();
+  }
+  for (BasicBlock *BB : L->getBlocks ()) BB->eraseFromParent ();
+
+  LoopInfo &LI = getAnalysis<LoopInfo> ();
+  SmallPtrSet<BasicBlock*, 8> blocks;
+  blocks.insert (L->block_begin (), L->block_end ());
+  for (BasicBlock *BB : blocks) LI.removeBlock (BB);
+
+  LPM.deleteLoopFromQueue (L);
+}
+
+void AccelerateLoops::record (Loop *L, const char *kind)
+{
+  BasicBlock *header = L->getHeader ();
+  Function &F = *header->getParent ();
+  LLVMContext &C = F.getContext ();
+
+  unsigned line = 0;
+  for (const Instruction &I : *header)
+    if (!I.getDebugLoc ().isUnknown ()) { line = I.getDebugLoc ().getLine (); break; }
+
+  Metadata *ops[] = {MDString::get (C, F.getName ()),
+                     MDString::get (C, header->getName ()),
+                     MDString::get (C, kind),
+                     ConstantAsMetadata::get (ConstantInt::get (Type::getInt32Ty (C), line))};
+  F.getParent ()->getOrInsertNamedMetadata ("seahorn.accel")->addOperand (MDNode::get (C, ops));
+}
+
+bool AccelerateLoops::runOnLoop (Loop *L, LPPassManager &LPM)
+{
+  if (!L->empty ()) return false;
+  BasicBlock *preheader = L->getLoopPreheader ();
+  BasicBlock *exitBlock = L->getExitBlock ();
+  BasicBlock *exitingBlock = L->getExitingBlock ();
+  if (!preheader || !exitBlock || !exitingBlock || !L->hasDedicatedExits ())
+  {
+    LOG ("accel-loops", errs () << "Warning: no-accel: not a simple loop\n";);
+    return false;
+  }
+
+  m_se = &getAnalysis<ScalarEvolution> ();
+  m_dl = &getAnalysis<DataLayoutPass> ().getDataLayout ();
+  const SCEV *btc = m_se->getBackedgeTakenCount (L);
+  if (isa<SCEVCouldNotCompute> (btc))
+  {
+    LOG ("accel-loops", errs () << "Warning: no-accel: unknown trip count\n";);
+    return false;
+  }
+
+  MemIdiom idiom;
+  if (!getMemIdiom (L, idiom))
+  {
+    LOG ("accel-loops", errs () << "Warning: no-accel: unsupported side effects\n";);
+    return false;
+  }
+
+  // -- the closed forms of the values used after the loop. In LCSSA,
+  // -- they are all used by the phi-nodes of the exit block
+  SmallVector<std::pair<PHINode*, const SCEV*>, 8> exits;
+  for (BasicBlock::iterator BI = exitBlock->begin (); PHINode *P = dyn_cast<PHINode> (BI); ++BI)
+  {
+    Value *V = P->getIncomingValueForBlock (exitingBlock);
+    if (!m_se->isSCEVable (V->getType ()))
+    {
+      LOG ("accel-loops", errs () << "Warning: no-accel: live-out " << *V << "\n";);
+      return false;
+    }
+    const SCEV *S = m_se->getSCEVAtScope (V, L->getParentLoop ());
+    if (!m_se->isLoopInvariant (S, L) || !isLinear (S))
+    {
+      LOG ("accel-loops", errs () << "Warning: no-accel: live-out " << *V << "\n";);
+      return false;
+    }
+    exits.push_back (std::make_pair (P, S));
+  }
+
+  LOG ("accel-loops", errs () << "Accelerating loop: " << *L << "\n";);
+
+  SCEVExpander expander (*m_se, "accel");
+  Instruction *insertPt = preheader->getTerminator ();
+  for (auto &kv : exits)
+  {
+    Value *V = expander.expandCodeFor (kv.second, kv.first->getType (), insertPt);
+    kv.first->setIncomingValue (kv.first->getBasicBlockIndex (exitingBlock), V);
+  }
+
+  const char *kind = "count";
+  if (idiom.store)
+  {
+    emitMemIdiom (L, idiom, expander);
+    kind = idiom.load ? "copy" : "fill";
+    if (idiom.load) ++LoopsCopy;
+    else ++LoopsFill;
+  }
+  else
+    ++LoopsCount;
+
+  record (L, kind);
+  deleteLoop (L, LPM);
+  return true;
+}
+
+namespace seahorn
+{
+  Pass *createAccelerateLoopsPass ()
+  {return new AccelerateLoops ();}
+}
+
+static llvm::RegisterPass<AccelerateLoops>
+X ("accel-loops", "Replace simple counting, fill and copy loops by their effect");
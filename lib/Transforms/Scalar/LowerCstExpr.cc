@@ -3,6 +3,9 @@
 #include "boost/range.hpp"
 
 #include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/MapVector.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Support/CommandLine.h"
 //#include "llvm/ADT/SmallVector.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Debug.h"
@@ -13,6 +16,12 @@ using namespace llvm;
 
 #define DEBUG_TYPE "lower-cst-expr"
 
+static llvm::cl::opt<bool>
+MemoCstExpr ("lower-cst-expr-memo",
+             llvm::cl::desc ("Lower each distinct constant expression once "
+                             "per function"),
+             llvm::cl::init (false));
+
 namespace seahorn
 {
 
@@ -32,9 +41,75 @@ namespace seahorn
   }
 
 
+  // The instruction before which the value of U is needed
+  static Instruction* getUsePoint (Use &U)
+  {
+    Instruction *I = cast<Instruction> (U.getUser ());
+    if (PHINode *PHI = dyn_cast<PHINode> (I))
+      return PHI->getIncomingBlock (U)->getTerminator ();
+    return I;
+  }
+
+  // Lowers each distinct constant expression operand of F once, at
+  // the nearest common dominator of its uses. Expressions that can
+  // trap are not moved and are left to the lowering at each use.
+  bool LowerCstExprPass::shareCstExprs(Function &F)
+  {
+    DominatorTree DT;
+    DT.recalculate (F);
+
+    bool change = false;
+    bool again = true;
+    // -- the operands of the new instructions are lowered in the next
+    // -- round
+    while (again)
+    {
+      again = false;
+      
+      MapVector<ConstantExpr*, SmallVector<Use*, 4> > uses;
+      for (BasicBlock &BB : F)
+      {
+        if (!DT.isReachableFromEntry (&BB)) continue;
+        for (Instruction &I : BB)
+          for (Use &U : I.operands ())
+            if (ConstantExpr *CE = dyn_cast<ConstantExpr> (U.get ()))
+              if (!CE->canTrap ()) uses [CE].push_back (&U);
+      }
+
+      for (auto &kv : uses)
+      {
+        SmallPtrSet<Instruction*, 8> points;
+        BasicBlock *Dom = nullptr;
+        for (Use *U : kv.second)
+        {
+          Instruction *P = getUsePoint (*U);
+          points.insert (P);
+          Dom = Dom ? DT.findNearestCommonDominator (Dom, P->getParent ()) 
+              : P->getParent ();
+        }
+
+        Instruction *InsertLoc = Dom->getTerminator ();
+        for (Instruction &I : *Dom)
+          if (points.count (&I)) { InsertLoc = &I; break; }
+        
+        Instruction *NewInst = lowerCstExpr (kv.first, InsertLoc);
+        LOG("lower-cst-expr",
+            errs () << "Lowering " << *kv.first << " once for " 
+                    << kv.second.size () << " uses\n");
+        for (Use *U : kv.second) U->set (NewInst);
+        again = true;
+        change = true;
+      }
+    }
+    return change;
+  }
+
   bool LowerCstExprPass::runOnFunction(Function & F) 
   {
     
+    bool shared = false;
+    if (MemoCstExpr && !F.isDeclaration ()) shared = shareCstExprs (F);
+
     SmallPtrSet<Instruction*, 8> worklist;
 
     for (inst_iterator It = inst_begin(F), E = inst_end(F); It != E; ++It)
@@ -49,7 +124,7 @@ namespace seahorn
     }
     
     
-    bool change = !worklist.empty ();
+    bool change = shared || !worklist.empty ();
 
     while (!worklist.empty()) 
     {
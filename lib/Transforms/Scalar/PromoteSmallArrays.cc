@@ -0,0 +1,238 @@
+/**
+ * Promotes small local arrays accessed with variable indices to one
+ * scalar per element, so that they are not encoded with arrays
+ */
+#define DEBUG_TYPE "promote-arrays"
+
+#include "llvm/Pass.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "avy/AvyDebug.h"
+
+using namespace llvm;
+STATISTIC(NumPromoted, "Number of arrays promoted to scalars");
+
+static llvm::cl::opt<unsigned>
+MaxElements ("promote-arrays-size",
+             llvm::cl::desc ("Largest number of elements of a promoted array"),
+             llvm::cl::init (8));
+
+static llvm::cl::opt<unsigned>
+MaxCost ("promote-arrays-cost",
+         llvm::cl::desc ("Largest number of selects created for a promoted array"),
+         llvm::cl::init (128));
+
+namespace
+{
+  /// A local array [N x T] of scalars whose address is only used by
+  /// loads and stores through getelementptr a, 0, i, or by a memset
+  /// to zero of the whole array, does not escape. Each element becomes
+  /// an alloca of its own, promoted by mem2reg later on. An access at
+  /// a variable i selects over the elements: a load is a chain of N-1
+  /// selects, a store one select per element. An access out of bounds
+  /// is undefined, a load reads the first element and a store is lost.
+  /// This hides overflows, so the pipeline does not promote arrays
+  /// when it inserts bounds checks.
+  ///
+  /// Promotion pays off while the selects stay few, so an array is
+  /// promoted if it has at most --promote-arrays-size elements and its
+  /// variable accesses create at most --promote-arrays-cost selects
+  class PromoteSmallArrays : public FunctionPass
+  {
+    const DataLayout *m_dl;
+
+    /// getelementptr a, 0, i and its loads and stores, or false
+    bool isElementAccess (GetElementPtrInst *gep, unsigned &cost, unsigned n)
+    {
+      if (gep->getNumIndices () != 2) return false;
+      ConstantInt *zero = dyn_cast<ConstantInt> (gep->getOperand (1));
+      if (!zero || !zero->isZero ()) return false;
+      bool variable = !isa<ConstantInt> (gep->getOperand (2));
+      for (User *u : gep->users ())
+      {
+        if (isa<LoadInst> (u))
+        { if (variable) cost += n - 1; }
+        else if (StoreInst *si = dyn_cast<StoreInst> (u))
+        {
+          if (si->getPointerOperand () != gep) return false;
+          if (variable) cost += n;
+        }
+        else return false;
+        if (isa<LoadInst> (u) && cast<LoadInst> (u)->isVolatile ()) return false;
+        if (isa<StoreInst> (u) && cast<StoreInst> (u)->isVolatile ()) return false;
+      }
+      return true;
+    }
+
+    /// a memset to zero of the whole of a, a lifetime marker, or false
+    bool isWholeInit (Value *v, uint64_t size)
+    {
+      for (User *u : v->users ())
+      {
+        if (MemSetInst *ms = dyn_cast<MemSetInst> (u))
+        {
+          ConstantInt *val = dyn_cast<ConstantInt> (ms->getValue ());
+          ConstantInt *len = dyn_cast<ConstantInt> (ms->getLength ());
+          if (!val || !val->isZero () || !len || len->getZExtValue () != size ||
+              ms->isVolatile ())
+            return false;
+        }
+        else if (IntrinsicInst *ii = dyn_cast<IntrinsicInst> (u))
+        {
+          if (ii->getIntrinsicID () != Intrinsic::lifetime_start &&
+              ii->getIntrinsicID () != Intrinsic::lifetime_end)
+            return false;
+        }
+        else return false;
+      }
+      return true;
+    }
+
+    bool isPromotable (AllocaInst &a)
+    {
+      ArrayType *aty = dyn_cast<ArrayType> (a.getAllocatedType ());
+      if (!aty || a.isArrayAllocation ()) return false;
+      Type *ety = aty->getElementType ();
+      if (!ety->isSingleValueType () || ety->isVectorTy ()) return false;
+      unsigned n = aty->getNumElements ();
+      if (n == 0 || n > MaxElements) return false;
+
+      unsigned cost = 0;
+      for (User *u : a.users ())
+      {
+        if (GetElementPtrInst *gep = dyn_cast<GetElementPtrInst> (u))
+        { if (!isElementAccess (gep, cost, n)) return false; }
+        else if (BitCastInst *bc = dyn_cast<BitCastInst> (u))
+        { if (!isWholeInit (bc, m_dl->getTypeAllocSize (aty))) return false; }
+        else return false;
+      }
+      return cost <= MaxCost;
+    }
+
+    void promote (AllocaInst &a)
+    {
+      ArrayType *aty = cast<ArrayType> (a.getAllocatedType ());
+      Type *ety = aty->getElementType ();
+      IRBuilder<> B (&a);
+      SmallVector<AllocaInst*, 8> elems;
+      for (unsigned k = 0; k < aty->getNumElements (); ++k)
+        elems.push_back (B.CreateAlloca (ety, nullptr, a.getName () + "." + Twine (k)));
+
+      SmallVector<Instruction*, 16> kill;
+      for (User *u : a.users ())
+      {
+        Instruction *I = cast<Instruction> (u);
+        kill.push_back (I);
+        if (BitCastInst *bc = dyn_cast<BitCastInst> (I))
+        {
+          for (User *v : bc->users ())
+          {
+            Instruction *J = cast<Instruction> (v);
+            if (isa<MemSetInst> (J))
+            {
+              B.SetInsertPoint (J);
+              for (AllocaInst *e : elems)
+                B.CreateStore (Constant::getNullValue (ety), e);
+            }
+            kill.push_back (J);
+          }
+          continue;
+        }
+
+        GetElementPtrInst *gep = cast<GetElementPtrInst> (I);
+        Value *idx = gep->getOperand (2);
+        ConstantInt *cidx = dyn_cast<ConstantInt> (idx);
+        for (User *v : gep->users ())
+        {
+          Instruction *J = cast<Instruction> (v);
+          kill.push_back (J);
+          B.SetInsertPoint (J);
+          if (cidx && cidx->getZExtValue () >= elems.size ())
+          {
+            // -- out of bounds, undefined
+            if (isa<LoadInst> (J)) J->replaceAllUsesWith (UndefValue::get (ety));
+            continue;
+          }
+          if (LoadInst *li = dyn_cast<LoadInst> (J))
+          {
+            Value *res;
+            if (cidx) res = B.CreateLoad (elems [cidx->getZExtValue ()]);
+            else
+            {
+              res = B.CreateLoad (elems [0]);
+              for (unsigned k = 1; k < elems.size (); ++k)
+                res = B.CreateSelect (B.CreateICmpEQ (idx, ConstantInt::get (idx->getType (), k)),
+                                      B.CreateLoad (elems [k]), res);
+            }
+            li->replaceAllUsesWith (res);
+          }
+          else
+          {
+            Value *val = cast<StoreInst> (J)->getValueOperand ();
+            if (cidx) B.CreateStore (val, elems [cidx->getZExtValue ()]);
+            else
+              for (unsigned k = 0; k < elems.size (); ++k)
+              {
+                Value *old = B.CreateLoad (elems [k]);
+                B.CreateStore (B.CreateSelect (B.CreateICmpEQ (idx, ConstantInt::get (idx->getType (), k)),
+                                               val, old), elems [k]);
+              }
+          }
+        }
+      }
+
+      // -- users before their operands
+      for (auto it = kill.rbegin (); it != kill.rend (); ++it)
+        if ((*it)->use_empty ()) (*it)->eraseFromParent ();
+      a.eraseFromParent ();
+    }
+
+  public:
+    static char ID;
+    PromoteSmallArrays () : FunctionPass (ID), m_dl (nullptr) {}
+
+    bool runOnFunction (Function &F)
+    {
+      if (F.isDeclaration ()) return false;
+      m_dl = &getAnalysis<DataLayoutPass> ().getDataLayout ();
+
+      SmallVector<AllocaInst*, 8> todo;
+      for (Instruction &I : F.getEntryBlock ())
+        if (AllocaInst *a = dyn_cast<AllocaInst> (&I))
+          if (isPromotable (*a)) todo.push_back (a);
+
+      for (AllocaInst *a : todo)
+      {
+        LOG ("promote-arrays", errs () << "Promoting " << *a << "\n";);
+        promote (*a);
+        ++NumPromoted;
+      }
+      return !todo.empty ();
+    }
+
+    void getAnalysisUsage (AnalysisUsage &AU) const
+    {
+      AU.setPreservesCFG ();
+      AU.addRequired<DataLayoutPass> ();
+    }
+  };
+
+  char PromoteSmallArrays::ID = 0;
+}
+
+namespace seahorn
+{
+  Pass* createPromoteSmallArraysPass ()
+  {return new PromoteSmallArrays ();}
+}
+
+static llvm::RegisterPass<PromoteSmallArrays>
+X ("promote-arrays", "Promote small arrays accessed with variable indices to scalars");
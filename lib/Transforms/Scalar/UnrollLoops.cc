@@ -0,0 +1,220 @@
+/** Unroll natural loops up to a bound before their back-edges are cut */
+
+/**
+ * The bound of a loop is taken, in order, from
+ *
+ *  1. the bounds file (--unroll-bounds-file). Each line is
+ *       <function> <line> <bound>
+ *     where <line> is the source line of the loop header, or * for
+ *     all the loops of the function. Lines starting with # are ignored.
+ *  2. the unroll pragma of the loop (llvm.loop.unroll.count)
+ *  3. the trip count computed by scalar evolution (--unroll-trip-count)
+ *  4. --unroll-default-bound
+ *
+ * A loop is unrolled in place so that its first <bound> iterations are
+ * explicit and every exit test is kept. The remaining back-edges are
+ * then cut by CutLoops. Both are wired into seapp --horn-unroll-loops.
+ */
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Utils/UnrollLoop.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Analysis/AssumptionCache.h"
+#include "llvm/Analysis/LoopPass.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/IR/Metadata.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "avy/AvyDebug.h"
+
+#include <map>
+
+using namespace llvm;
+
+static llvm::cl::opt<std::string>
+BoundsFile ("unroll-bounds-file",
+            llvm::cl::desc ("File with the unrolling bound of loops"),
+            llvm::cl::init (""), llvm::cl::value_desc ("filename"));
+
+static llvm::cl::opt<bool>
+UseTripCount ("unroll-trip-count",
+              llvm::cl::desc ("Unroll loops with a constant trip count "
+                              "that have no other bound"),
+              llvm::cl::init (true));
+
+static llvm::cl::opt<unsigned>
+DefaultBound ("unroll-default-bound",
+              llvm::cl::desc ("Bound of loops without any other bound "
+                              "(0 = do not unroll)"),
+              llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+MaxBound ("unroll-max-bound",
+          llvm::cl::desc ("Largest bound that is used for unrolling"),
+          llvm::cl::init (1024));
+
+namespace
+{
+  class UnrollLoops : public LoopPass
+  {
+    /// bounds from the file keyed by function and line. Line 0
+    /// stands for all the loops of the function
+    std::map<std::pair<std::string, unsigned>, unsigned> m_bounds;
+    bool m_loaded;
+
+    void loadBounds ();
+    unsigned getBound (Loop *L, unsigned tripCount);
+
+  public:
+    static char ID;
+    UnrollLoops () : LoopPass (ID), m_loaded (false) {}
+
+    bool runOnLoop (Loop *L, LPPassManager &LPM) override;
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    {
+      AU.addRequired<AssumptionCacheTracker>();
+      AU.addRequired<LoopInfo>();
+      AU.addRequiredID(LoopSimplifyID);
+      AU.addRequiredID(LCSSAID);
+      AU.addRequired<ScalarEvolution>();
+
+      AU.addPreserved<LoopInfo>();
+      AU.addPreservedID(LoopSimplifyID);
+      AU.addPreservedID(LCSSAID);
+      AU.addPreserved<ScalarEvolution>();
+      AU.addPreserved<DominatorTreeWrapperPass>();
+    }
+  };
+}
+
+char UnrollLoops::ID = 0;
+
+STATISTIC (LoopsUnrolled, "Number of loops unrolled");
+STATISTIC (LoopsFullyUnrolled, "Number of loops completely unrolled");
+
+/// source line of the header of L, or 0 if unknown
+static unsigned getLoopLine (const Loop &L)
+{
+  for (const Instruction &I : *L.getHeader ())
+    if (!I.getDebugLoc ().isUnknown ()) return I.getDebugLoc ().getLine ();
+  return 0;
+}
+
+/// the count of the unroll pragma of L, or 0 if there is none
+static unsigned getPragmaCount (const Loop &L)
+{
+  MDNode *LoopID = L.getLoopID ();
+  if (!LoopID) return 0;
+
+  // -- the first operand is the loop id itself
+  for (unsigned i = 1, e = LoopID->getNumOperands (); i < e; ++i)
+  {
+    MDNode *MD = dyn_cast<MDNode> (LoopID->getOperand (i));
+    if (!MD || MD->getNumOperands () != 2) continue;
+    MDString *S = dyn_cast<MDString> (MD->getOperand (0));
+    if (!S || !S->getString ().equals ("llvm.loop.unroll.count")) continue;
+    if (ConstantInt *C = mdconst::dyn_extract<ConstantInt> (MD->getOperand (1)))
+      return C->getZExtValue ();
+  }
+  return 0;
+}
+
+void UnrollLoops::loadBounds ()
+{
+  m_loaded = true;
+  if (BoundsFile.empty ()) return;
+
+  auto buf = MemoryBuffer::getFile (BoundsFile);
+  if (!buf)
+  {
+    errs () << "WARNING: cannot read loop bounds from " << BoundsFile << "\n";
+    return;
+  }
+
+  SmallVector<StringRef, 64> lines;
+  (*buf)->getBuffer ().split (lines, "\n", -1, false);
+  for (StringRef line : lines)
+  {
+    line = line.trim ();
+    if (line.empty () || line.startswith ("#")) continue;
+
+    SmallVector<StringRef, 3> fields;
+    line.split (fields, " ", -1, false);
+    unsigned lineNo = 0, bound;
+    if (fields.size () != 3 ||
+        (fields [1] != "*" && fields [1].getAsInteger (10, lineNo)) ||
+        fields [2].getAsInteger (10, bound))
+    {
+      errs () << "WARNING: ignoring malformed loop bound: " << line << "\n";
+      continue;
+    }
+    m_bounds [std::make_pair (fields [0].str (), lineNo)] = bound;
+  }
+}
+
+unsigned UnrollLoops::getBound (Loop *L, unsigned tripCount)
+{
+  const Function &F = *L->getHeader ()->getParent ();
+  unsigned line = getLoopLine (*L);
+
+  auto it = m_bounds.find (std::make_pair (F.getName ().str (), line));
+  if (it == m_bounds.end () && line != 0)
+    it = m_bounds.find (std::make_pair (F.getName ().str (), 0u));
+  if (it != m_bounds.end ()) return it->second;
+
+  if (unsigned count = getPragmaCount (*L)) return count;
+  if (UseTripCount && tripCount > 0) return tripCount;
+  return DefaultBound;
+}
+
+bool UnrollLoops::runOnLoop (Loop *L, LPPassManager &LPM)
+{
+  if (!m_loaded) loadBounds ();
+
+  BasicBlock *latch = L->getLoopLatch ();
+  if (!latch)
+  {
+    LOG ("unroll-loops", errs () << "Warning: no-unroll: multiple latches\n";);
+    return false;
+  }
+
+  ScalarEvolution &SE = getAnalysis<ScalarEvolution> ();
+  unsigned tripCount = SE.getSmallConstantTripCount (L, latch);
+  unsigned tripMultiple = SE.getSmallConstantTripMultiple (L, latch);
+
+  unsigned bound = std::min<unsigned> (getBound (L, tripCount), MaxBound);
+  // -- no need to unroll more than the loop can iterate
+  if (tripCount > 0 && bound > tripCount) bound = tripCount;
+  if (bound <= 1) return false;
+
+  LOG ("unroll-loops",
+       errs () << "Unrolling loop " << bound << " times: " << *L << "\n";);
+
+  Function &F = *L->getHeader ()->getParent ();
+  AssumptionCache &AC = getAnalysis<AssumptionCacheTracker> ().getAssumptionCache (F);
+  LoopInfo &LI = getAnalysis<LoopInfo> ();
+  // -- no runtime unrolling: every copy keeps its exit test so that
+  // -- cutting the remaining back-edges bounds the loop by bound
+  if (!UnrollLoop (L, bound, tripCount, false, tripMultiple, &LI, this, &LPM, &AC))
+  {
+    LOG ("unroll-loops", errs () << "Warning: no-unroll: unsupported loop\n";);
+    return false;
+  }
+
+  ++LoopsUnrolled;
+  if (bound == tripCount) ++LoopsFullyUnrolled;
+  return true;
+}
+
+namespace seahorn
+{
+  Pass *createUnrollLoopsPass ()
+  {return new UnrollLoops ();}
+}
+
+static llvm::RegisterPass<UnrollLoops>
+X ("unroll-loops", "Unroll natural loops up to a bound");
@@ -3,7 +3,8 @@
 // This class is almost the same than Devirt in DSA but it does not
 // use alias analysis to compute the possible targets of an indirect
 // call. Instead, it simply selects those functions whose signatures
-// match.
+// match. Optionally, the targets are narrowed with the functions that
+// SeaDsa says the called pointer may point to.
 //
 //===----------------------------------------------------------------------===//
 
@@ -27,9 +28,12 @@
 #include "llvm/ADT/Statistic.h"
 
 #include "seahorn/Transforms/Utils/Local.hh"
+#include "seahorn/Analysis/DSA/DsaAnalysis.hh"
 
 #include "avy/AvyDebug.h"
 
+#include <map>
+
 using namespace llvm;
 
 static llvm::cl::opt<bool>
@@ -38,6 +42,13 @@ AllowIndirectCalls ("allow-indirect-calls",
                                     "during devirtualization "
                                     "(required for soundness)"),
                     llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
+DevirtWithDsa ("devirt-functions-with-dsa",
+               llvm::cl::desc ("Narrow the targets of indirect calls "
+                               "using SeaDsa"),
+               llvm::cl::init (false));
+
 namespace
 {
 
@@ -76,11 +87,22 @@ namespace
     
     /// maps alias set id to an existing bounce function
     DenseMap<AliasSetId, Function*> m_bounceMap;
+
+    /// maps a set of targets narrowed by DSA to an existing bounce function
+    std::map<AliasSet, Function*> m_dsaBounceMap;
+
+    /// global DSA analysis, if targets are narrowed
+    seahorn::dsa::GlobalAnalysis *m_dsa;
     
     /// turn the indirect call-site into a direct one
-    void mkDirectCall (CallSite CS);
-    /// create a bounce function that calls functions directly
-    Function* mkBounceFn (CallSite &CS);
+    void mkDirectCall (CallSite CS, const AliasSet *dsaTargets);
+    /// returns a bounce function for the call site, creating it if needed
+    Function* getBounceFn (CallSite &CS, const AliasSet *dsaTargets);
+    /// create a bounce function that calls Targets directly
+    Function* mkBounceFn (CallSite &CS, const AliasSet &Targets);
+    /// the targets of CS that DSA allows. Returns false if DSA does
+    /// not narrow the alias set of CS
+    bool narrowTargets (CallSite &CS, AliasSet &out);
     
     
     /// returns an AliasId of the called value
@@ -101,7 +123,7 @@ namespace
     
    public:
     static char ID;
-    DevirtualizeFunctions() : ModulePass(ID), CG (nullptr) {}
+    DevirtualizeFunctions() : ModulePass(ID), CG (nullptr), m_dsa (nullptr) {}
     
     virtual bool runOnModule(Module & M);
     
@@ -110,6 +132,7 @@ namespace
       AU.setPreservesAll ();
       AU.addRequired<CallGraphWrapperPass> ();
       AU.addPreserved<CallGraphWrapperPass> ();
+      if (DevirtWithDsa) AU.addRequired<seahorn::dsa::DsaAnalysis> ();
     }
     
     // -- VISITOR IMPLEMENTATION --
@@ -137,6 +160,7 @@ namespace
   // Pass statistics
   STATISTIC(FuncAdded, "Number of bounce functions added");
   STATISTIC(CSConvert, "Number of call sites resolved");
+  STATISTIC(CSNarrowed, "Number of call sites narrowed by DSA");
 
   static inline PointerType * getVoidPtrType (LLVMContext & C)
   {
@@ -161,25 +185,75 @@ namespace
     return CastInst::CreateZExtOrBitCast (V, Ty, Name, InsertPt);
   }
 
-  /**
-   * Creates a bounce function that calls functions in an alias set directly
-   */
-  Function* DevirtualizeFunctions::mkBounceFn (CallSite &CS)
+  bool DevirtualizeFunctions::narrowTargets (CallSite &CS, AliasSet &out)
   {
-    ++FuncAdded;
+    using namespace seahorn::dsa;
+
+    auto it = m_aliasSets.find (typeAliasId (CS));
+    if (it == m_aliasSets.end ()) return false;
+
+    const Function &F = *CS.getInstruction ()->getParent ()->getParent ();
+    if (!m_dsa->hasGraph (F)) return false;
+    Graph &g = m_dsa->getGraph (F);
+
+    const Value &v = *CS.getCalledValue ()->stripPointerCasts ();
+    if (!g.hasCell (v)) return false;
+    const Node *n = g.getCell (v).getNode ();
+    // -- the pointer may come from outside of the module
+    if (!n || n->isExternal () || n->isIntToPtr ()) return false;
+
+    // -- keep the order of the alias set so that equal sets of
+    // -- targets share a bounce function
+    out.clear ();
+    for (const Function *fn : it->second)
+      if (n->getAllocSites ().count (fn) > 0) out.push_back (fn);
+
+    LOG ("devirt",
+         if (out.empty ())
+           errs () << "DSA found no target of the alias set of:\n"
+                   << *CS.getInstruction () << "\n";);
+
+    return !out.empty () && out.size () < it->second.size ();
+  }
+
+  Function* DevirtualizeFunctions::getBounceFn (CallSite &CS,
+                                                const AliasSet *dsaTargets)
+  {
+    assert (isIndirectCall (CS) && "Not an indirect call");
+
+    if (dsaTargets)
+    {
+      auto it = m_dsaBounceMap.find (*dsaTargets);
+      if (it != m_dsaBounceMap.end ()) return it->second;
+
+      Function *F = mkBounceFn (CS, *dsaTargets);
+      m_dsaBounceMap.insert (std::make_pair (*dsaTargets, F));
+      return F;
+    }
 
     AliasSetId id = typeAliasId (CS);
     {
-      assert (isIndirectCall (CS) && "Not an indirect call");
       auto it = m_bounceMap.find (id);
       if (it != m_bounceMap.end ()) return it->second;
     }
-    
+
     // -- no direct calls in this alias set, nothing to construct
-    if (m_aliasSets.count (id) <= 0) return nullptr;
-    
-    AliasSet &Targets = m_aliasSets [id];
-    
+    auto it = m_aliasSets.find (id);
+    if (it == m_aliasSets.end ()) return nullptr;
+
+    Function *F = mkBounceFn (CS, it->second);
+    // -- log the newly created function
+    m_bounceMap.insert (std::make_pair (id, F));
+    return F;
+  }
+
+  /**
+   * Creates a bounce function that calls functions in an alias set directly
+   */
+  Function* DevirtualizeFunctions::mkBounceFn (CallSite &CS,
+                                               const AliasSet &Targets)
+  {
+    ++FuncAdded;
 
     LOG("devirt",
         errs () << "Building a bounce for call site:\n"
@@ -309,17 +383,15 @@ namespace
     // Make the entry basic block branch to the first comparison basic block.
     InsertPt->setSuccessor(0, tailBB);
 
-    // -- log the newly created function
-    m_bounceMap.insert (std::make_pair (id, F));
-    
     // Return the newly created bounce function.
     return F;
   }
 
 
-  void DevirtualizeFunctions::mkDirectCall (CallSite CS)
+  void DevirtualizeFunctions::mkDirectCall (CallSite CS,
+                                            const AliasSet *dsaTargets)
   {
-    const Function *bounceFn = mkBounceFn (CS);
+    const Function *bounceFn = getBounceFn (CS, dsaTargets);
     // -- something failed
     LOG("devirt", if (!bounceFn)
                     errs () << "No bounce function for: "
@@ -410,6 +482,8 @@ namespace
   {
     // -- Get the call graph
     CG = &(getAnalysis<CallGraphWrapperPass> ().getCallGraph ());
+    if (DevirtWithDsa)
+      m_dsa = &getAnalysis<seahorn::dsa::DsaAnalysis> ().getDsaAnalysis ();
 
     // -- Create alias sets
     for (auto const &F: M)
@@ -439,11 +513,25 @@ namespace
     // Visit all of the call instructions in this function and record those that
     // are indirect function calls.
     visit (M);
+
+    // -- DSA is queried before any call site is transformed since its
+    // -- graphs describe the original module. An empty set means that
+    // -- the call site uses its whole alias set.
+    std::vector<AliasSet> narrowed (m_worklist.size ());
+    if (m_dsa)
+      for (unsigned i = 0, sz = m_worklist.size (); i < sz; ++i)
+      {
+        CallSite CS (m_worklist [i]);
+        if (narrowTargets (CS, narrowed [i])) ++CSNarrowed;
+        else narrowed [i].clear ();
+      }
     
     // Now go through and transform all of the indirect calls that we found that
     // need transforming.
     bool Changed = !m_worklist.empty ();
-    for (auto &I : m_worklist) mkDirectCall (I);
+    for (unsigned i = 0, sz = m_worklist.size (); i < sz; ++i)
+      mkDirectCall (m_worklist [i],
+                    narrowed [i].empty () ? nullptr : &narrowed [i]);
 
     // Conservatively assume that we've changed one or more call sites.
     return Changed;
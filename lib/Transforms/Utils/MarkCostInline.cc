@@ -0,0 +1,149 @@
+#define DEBUG_TYPE "mark-cost-inline"
+
+#include "llvm/Pass.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "avy/AvyDebug.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+SmallSize ("horn-inline-small",
+           cl::desc ("With --horn-inline-cost, inline the functions of at most "
+                     "this many instructions"),
+           cl::init (20));
+
+static cl::opt<unsigned>
+WideSummary ("horn-inline-wide",
+             cl::desc ("With --horn-inline-cost, inline the functions whose "
+                       "summaries would have at least this many memory arguments"),
+             cl::init (6));
+
+static cl::opt<unsigned>
+GrowthBudget ("horn-inline-budget",
+              cl::desc ("With --horn-inline-cost, percentage by which inlining "
+                        "may grow the module"),
+              cl::init (50));
+
+STATISTIC (NumMarked, "Number of functions marked for inlining");
+
+namespace seahorn
+{
+  /// marks with AlwaysInline the internal functions that are cheap to
+  /// inline for verification, while the code growth is within the
+  /// budget. The functions with one call site come first, then the
+  /// small ones and the ones whose summaries would be wide, then the
+  /// others, each by increasing growth. Large functions with many
+  /// call sites are left to be encoded with summaries
+  struct MarkCostInline : public ModulePass
+  {
+    static char ID;
+    MarkCostInline () : ModulePass (ID) {}
+
+    void getAnalysisUsage (AnalysisUsage &AU) const
+    {
+      AU.addRequired<CallGraphWrapperPass> ();
+      AU.setPreservesAll ();
+    }
+
+    struct Candidate
+    {
+      Function *fn;
+      /// 0 for one call site, 1 for small or wide, 2 otherwise
+      unsigned rank;
+      /// instructions added to the module by inlining fn everywhere
+      uint64_t growth;
+      bool operator< (const Candidate &o) const
+      { return rank < o.rank || (rank == o.rank && growth < o.growth); }
+    };
+
+    /// memory the summary of F would pass: the pointer arguments and
+    /// the globals that F uses. Shadow memory is not there yet, and
+    /// each of them is a region of the summary at most
+    static unsigned memoryWidth (const Function &F)
+    {
+      SmallPtrSet<const Value*, 16> globals;
+      unsigned res = 0;
+      for (const Argument &arg : F.getArgumentList ())
+        if (arg.getType ()->isPointerTy ()) ++res;
+      for (const BasicBlock &bb : F)
+        for (const Instruction &I : bb)
+          for (const Value *op : I.operands ())
+            if (isa<GlobalVariable> (op)) globals.insert (op);
+      return res + globals.size ();
+    }
+
+    bool runOnModule (Module &M)
+    {
+      // -- functions in a recursive SCC are never inlined
+      SmallPtrSet<const Function*, 16> recursive;
+      CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
+      for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
+        if (it.hasLoop ())
+          for (CallGraphNode *cgn : *it)
+            if (cgn->getFunction ()) recursive.insert (cgn->getFunction ());
+
+      uint64_t moduleSize = 0;
+      for (Function &F : M)
+        for (BasicBlock &bb : F) moduleSize += bb.size ();
+
+      std::vector<Candidate> candidates;
+      for (Function &F : M)
+      {
+        if (F.isDeclaration () || !F.hasLocalLinkage () || F.isVarArg ()) continue;
+        if (recursive.count (&F) || F.hasFnAttribute (Attribute::NoInline)) continue;
+
+        unsigned calls = 0;
+        bool onlyCalled = true;
+        for (User *u : F.users ())
+        {
+          CallSite CS (u);
+          if (CS && CS.getCalledFunction () == &F) ++calls;
+          else onlyCalled = false;
+        }
+        if (calls == 0) continue;
+
+        uint64_t size = 0;
+        for (BasicBlock &bb : F) size += bb.size ();
+
+        // -- with its address taken, F stays in the module
+        uint64_t growth = size * (onlyCalled ? calls - 1 : calls);
+        unsigned rank = 2;
+        if (calls == 1) rank = 0;
+        else if (size <= SmallSize || memoryWidth (F) >= WideSummary) rank = 1;
+        candidates.push_back (Candidate {&F, rank, growth});
+      }
+
+      // -- by rank, then the cheapest first, while the budget allows
+      std::sort (candidates.begin (), candidates.end ());
+      uint64_t budget = moduleSize * GrowthBudget / 100;
+      for (const Candidate &c : candidates)
+      {
+        if (c.growth > budget) continue;
+        budget -= c.growth;
+        LOG ("inline", errs () << "inlining " << c.fn->getName () << ": rank "
+             << c.rank << " growth " << c.growth << "\n";);
+        c.fn->addFnAttr (Attribute::AlwaysInline);
+        ++NumMarked;
+      }
+      return true;
+    }
+
+  };
+
+  char MarkCostInline::ID = 0;
+
+  Pass *createMarkCostInlinePass () {return new MarkCostInline ();}
+
+}
@@ -0,0 +1,246 @@
+#include "seahorn/Aig.hh"
+
+#include "ufo/Stats.hh"
+#include "avy/AvyDebug.h"
+
+#include "boost/lexical_cast.hpp"
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace seahorn
+{
+  namespace
+  {
+    /// 64-bit words of random inputs per node in fraig
+    const unsigned SimWords = 4;
+    /// resources of a proof of a merge, in Z3 units
+    const unsigned FraigRlimit = 20000;
+    /// proofs that fail before fraig gives up
+    const unsigned FraigMaxFailures = 1000;
+  }
+
+  Aig::Lit Aig::mkInput ()
+  {
+    m_nodes.push_back (std::make_pair (0u, 0u));
+    m_input.push_back (true);
+    ++m_inputs;
+    return mkLit (m_nodes.size () - 1, false);
+  }
+
+  Aig::Lit Aig::strash (Lit a, Lit b)
+  {
+    uint64_t key = ((uint64_t) a << 32) | b;
+    auto it = m_strash.find (key);
+    if (it != m_strash.end ()) return mkLit (it->second, false);
+    m_nodes.push_back (std::make_pair (a, b));
+    m_input.push_back (false);
+    unsigned n = m_nodes.size () - 1;
+    m_strash [key] = n;
+    return mkLit (n, false);
+  }
+
+  Aig::Lit Aig::mkAnd (Lit a, Lit b)
+  {
+    if (a > b) std::swap (a, b);
+    if (a == mkFalse ()) return a;
+    if (a == mkTrue ()) return b;
+    if (a == b) return a;
+    if (a == neg (b)) return mkFalse ();
+
+    // -- two-level rules over the children of the arguments
+    for (int k = 0; k < 2; ++k)
+    {
+      Lit x = k ? b : a;
+      Lit y = k ? a : b;
+      unsigned n = node (x);
+      if (!isAnd (n)) continue;
+      Lit l = left (n), r = right (n);
+      if (!isNeg (x))
+      {
+        // -- (l & r) & l = l & r and (l & r) & !l = false
+        if (y == l || y == r) return x;
+        if (y == neg (l) || y == neg (r)) return mkFalse ();
+        unsigned m = node (y);
+        if (!isNeg (y) && isAnd (m))
+        {
+          Lit l2 = left (m), r2 = right (m);
+          if (l == neg (l2) || l == neg (r2) || r == neg (l2) || r == neg (r2))
+            return mkFalse ();
+        }
+      }
+      else
+      {
+        // -- !(l & r) & l = l & !r and !(l & r) & !l = !l
+        if (y == l) return mkAnd (y, neg (r));
+        if (y == r) return mkAnd (y, neg (l));
+        if (y == neg (l) || y == neg (r)) return y;
+      }
+    }
+    return strash (a, b);
+  }
+
+  Aig::Lit Aig::mkXor (Lit a, Lit b)
+  {
+    if (a == b) return mkFalse ();
+    if (a == neg (b)) return mkTrue ();
+    if (a == mkFalse ()) return b;
+    if (b == mkFalse ()) return a;
+    if (a == mkTrue ()) return neg (b);
+    if (b == mkTrue ()) return neg (a);
+    return mkOr (mkAnd (a, neg (b)), mkAnd (neg (a), b));
+  }
+
+  Aig::Lit Aig::mkIte (Lit c, Lit t, Lit e)
+  {
+    if (c == mkTrue () || t == e) return t;
+    if (c == mkFalse ()) return e;
+    if (t == mkTrue ()) return mkOr (c, e);
+    if (t == mkFalse ()) return mkAnd (neg (c), e);
+    if (e == mkTrue ()) return mkOr (neg (c), t);
+    if (e == mkFalse ()) return mkAnd (c, t);
+    return mkOr (mkAnd (c, t), mkAnd (neg (c), e));
+  }
+
+  std::vector<Aig::Lit> Aig::fraig (std::vector<Lit> &roots, ufo::EZ3 &z3)
+  {
+    ufo::ScopedStats _st ("BmcFraig");
+    // -- simulation on random inputs, node by node
+    std::mt19937_64 rng (0);
+    std::vector<std::vector<uint64_t> > sim (size (), std::vector<uint64_t> (SimWords, 0));
+    auto value = [&sim] (Lit l, unsigned w)
+      { return isNeg (l) ? ~sim [node (l)][w] : sim [node (l)][w]; };
+    for (unsigned n = 1; n < size (); ++n)
+      for (unsigned w = 0; w < SimWords; ++w)
+        sim [n][w] = isInput (n) ? rng () : value (left (n), w) & value (right (n), w);
+
+    // -- the candidate of a node is the first node with the same
+    // -- values, up to complement of all of them
+    std::map<std::vector<uint64_t>, unsigned> classes;
+    std::vector<bool> phase (size ());
+    std::vector<int> cand (size (), -1);
+    for (unsigned n = 0; n < size (); ++n)
+    {
+      phase [n] = sim [n][0] & 1;
+      std::vector<uint64_t> sig (sim [n]);
+      if (phase [n]) for (uint64_t &v : sig) v = ~v;
+      auto r = classes.insert (std::make_pair (sig, n));
+      if (!r.second && isAnd (n)) cand [n] = r.first->second;
+    }
+    sim.clear ();
+
+    // -- prove the merges on the old graph, and rebuild
+    AigSat sat (*this, z3, "fraig!");
+    ufo::ZBudget budget (0, FraigRlimit);
+    unsigned failures = 0, merged = 0;
+
+    Aig res;
+    std::vector<Lit> map (size (), mkFalse ());
+    auto remap = [&map] (Lit l) { return isNeg (l) ? neg (map [node (l)]) : map [node (l)]; };
+    for (unsigned n = 1; n < size (); ++n)
+    {
+      if (isInput (n)) { map [n] = res.mkInput (); continue; }
+      if (cand [n] >= 0 && failures < FraigMaxFailures)
+      {
+        Lit x = mkLit (n, false);
+        Lit y = mkLit (cand [n], phase [n] != phase [cand [n]]);
+        // -- x = y if neither x & !y nor !x & y
+        if (!sat.solve (std::vector<Lit> {x, neg (y)}, budget) &&
+            !sat.solve (std::vector<Lit> {neg (x), y}, budget))
+        {
+          map [n] = remap (y);
+          ++merged;
+          continue;
+        }
+        ++failures;
+      }
+      map [n] = res.mkAnd (remap (left (n)), remap (right (n)));
+    }
+
+    for (Lit &r : roots) r = remap (r);
+    LOG ("bmc", errs () << "fraig: " << numAnds () << " to " << res.numAnds ()
+         << " ands, " << merged << " merged\n";);
+    ufo::Stats::uset ("BmcFraigMerged", merged);
+    *this = std::move (res);
+    return map;
+  }
+
+  Expr AigSat::var (unsigned n)
+  {
+    if (m_vars.size () <= n) m_vars.resize (n + 1);
+    if (!m_vars [n])
+      m_vars [n] = bind::boolConst
+        (mkTerm<std::string> (m_prefix + boost::lexical_cast<std::string> (n), m_efac));
+    return m_vars [n];
+  }
+
+  Expr AigSat::encode (Aig::Lit l)
+  {
+    unsigned n = Aig::node (l);
+    if (n == 0) return Aig::isNeg (l) ? mk<TRUE> (m_efac) : mk<FALSE> (m_efac);
+
+    // -- the cone of n, children first
+    std::vector<unsigned> stack {n};
+    while (!stack.empty ())
+    {
+      unsigned m = stack.back ();
+      if (m < m_vars.size () && m_vars [m]) { stack.pop_back (); continue; }
+      if (!m_aig.isAnd (m)) { var (m); stack.pop_back (); continue; }
+
+      unsigned a = Aig::node (m_aig.left (m)), b = Aig::node (m_aig.right (m));
+      bool ready = true;
+      for (unsigned c : {a, b})
+        if (c > 0 && (c >= m_vars.size () || !m_vars [c])) { stack.push_back (c); ready = false; }
+      if (!ready) continue;
+      stack.pop_back ();
+
+      // -- v = l & r
+      auto lit = [this] (Aig::Lit x)
+        {
+          if (Aig::node (x) == 0) return Aig::isNeg (x) ? mk<TRUE> (m_efac) : mk<FALSE> (m_efac);
+          Expr v = m_vars [Aig::node (x)];
+          return Aig::isNeg (x) ? mk<NEG> (v) : v;
+        };
+      Expr v = var (m);
+      Expr lhs = lit (m_aig.left (m)), rhs = lit (m_aig.right (m));
+      m_solver.assertExpr (mk<OR> (mk<NEG> (v), lhs));
+      m_solver.assertExpr (mk<OR> (mk<NEG> (v), rhs));
+      m_solver.assertExpr (mk<OR> (v, mk<NEG> (lhs), mk<NEG> (rhs)));
+    }
+    Expr v = m_vars [n];
+    return Aig::isNeg (l) ? mk<NEG> (v) : v;
+  }
+
+  void AigSat::assertLit (Aig::Lit l) { m_solver.assertExpr (encode (l)); }
+
+  boost::tribool AigSat::solve (const std::vector<Aig::Lit> &assumptions,
+                                const ufo::ZBudget &budget)
+  {
+    ExprVector lits;
+    for (Aig::Lit l : assumptions)
+    {
+      if (l == Aig::mkTrue ()) continue;
+      if (l == Aig::mkFalse ()) return false;
+      lits.push_back (encode (l));
+    }
+    ufo::ZBudget saved = m_solver.getBudget ();
+    if (!budget.unbounded ()) m_solver.setBudget (budget);
+    boost::tribool res = m_solver.solveAssuming (lits);
+    if (!budget.unbounded ()) m_solver.setBudget (saved);
+    if (res) m_model = m_solver.getModel ();
+    return res;
+  }
+
+  bool AigSat::value (Aig::Lit l)
+  {
+    unsigned n = Aig::node (l);
+    bool v;
+    if (n == 0) v = false;
+    else if (n < m_vars.size () && m_vars [n])
+      v = isOpX<TRUE> (m_model.eval (m_vars [n], true));
+    else if (m_aig.isInput (n)) v = false;
+    else v = value (m_aig.left (n)) && value (m_aig.right (n));
+    return Aig::isNeg (l) ? !v : v;
+  }
+}
@@ -0,0 +1,427 @@
+#include "seahorn/BitBlast.hh"
+
+#include "boost/range.hpp"
+
+namespace seahorn
+{
+  namespace
+  {
+    Expr sortOf (Expr c) { return bind::rangeTy (bind::fname (c)); }
+
+    bool isArray (Expr e)
+    {
+      if (isOpX<STORE> (e) || isOpX<CONST_ARRAY> (e)) return true;
+      if (isOpX<ITE> (e)) return isArray (e->arg (1));
+      return bind::isConst (e) && isOpX<ARRAY_TY> (sortOf (e));
+    }
+
+    bool isBool (Expr e)
+    {
+      if (isOpX<TRUE> (e) || isOpX<FALSE> (e) || bind::isBoolConst (e)) return true;
+      if (isOpX<NEG> (e) || isOpX<AND> (e) || isOpX<OR> (e) || isOpX<IMPL> (e) ||
+          isOpX<IFF> (e) || isOpX<XOR> (e) || isOpX<EQ> (e) || isOpX<NEQ> (e))
+        return true;
+      if (isOpX<BULT> (e) || isOpX<BULE> (e) || isOpX<BUGT> (e) || isOpX<BUGE> (e) ||
+          isOpX<BSLT> (e) || isOpX<BSLE> (e) || isOpX<BSGT> (e) || isOpX<BSGE> (e))
+        return true;
+      if (isOpX<ITE> (e)) return isBool (e->arg (1));
+      return false;
+    }
+  }
+
+  bool BitBlaster::define (Expr x, Expr t)
+  {
+    if (!bind::isConst (x) || !isArray (x) || !isArray (t)) return false;
+    return m_arrays.insert (std::make_pair (x, t)).second;
+  }
+
+  BitBlaster::Bits BitBlaster::input (Expr term, unsigned width)
+  {
+    Bits b;
+    for (unsigned i = 0; i < width; ++i) b.push_back (m_aig.mkInput ());
+    m_inputs.push_back (std::make_pair (term, b));
+    return b;
+  }
+
+  Aig::Lit BitBlaster::lit (Expr e)
+  {
+    auto it = m_lits.find (e);
+    if (it != m_lits.end ()) return it->second;
+    Aig::Lit l = litRaw (e);
+    if (m_ok) m_lits [e] = l;
+    return l;
+  }
+
+  BitBlaster::Bits BitBlaster::bits (Expr e)
+  {
+    auto it = m_bits.find (e);
+    if (it != m_bits.end ()) return it->second;
+    Bits b = bitsRaw (e);
+    if (!m_ok) return Bits ();
+    m_bits [e] = b;
+    return b;
+  }
+
+  Aig::Lit BitBlaster::litRaw (Expr e)
+  {
+    if (!m_ok) return Aig::mkFalse ();
+    if (isOpX<TRUE> (e)) return Aig::mkTrue ();
+    if (isOpX<FALSE> (e)) return Aig::mkFalse ();
+    if (bind::isBoolConst (e)) return input (e, 1) [0];
+    if (isOpX<NEG> (e)) return Aig::neg (lit (e->arg (0)));
+
+    if (isOpX<AND> (e) || isOpX<OR> (e))
+    {
+      bool conj = isOpX<AND> (e);
+      Aig::Lit res = conj ? Aig::mkTrue () : Aig::mkFalse ();
+      for (Expr a : boost::make_iterator_range (e->args_begin (), e->args_end ()))
+        res = conj ? m_aig.mkAnd (res, lit (a)) : m_aig.mkOr (res, lit (a));
+      return res;
+    }
+    if (isOpX<IMPL> (e)) return m_aig.mkOr (Aig::neg (lit (e->arg (0))), lit (e->arg (1)));
+    if (isOpX<IFF> (e)) return m_aig.mkIff (lit (e->arg (0)), lit (e->arg (1)));
+    if (isOpX<XOR> (e)) return m_aig.mkXor (lit (e->arg (0)), lit (e->arg (1)));
+    if (isOpX<ITE> (e))
+      return m_aig.mkIte (lit (e->arg (0)), lit (e->arg (1)), lit (e->arg (2)));
+
+    if (isOpX<EQ> (e) || isOpX<NEQ> (e))
+    {
+      Expr a = e->arg (0), b = e->arg (1);
+      // -- equalities of arrays are only supported as definitions
+      if (isArray (a)) return fail ();
+      Aig::Lit eq;
+      if (isBool (a)) eq = m_aig.mkIff (lit (a), lit (b));
+      else
+      {
+        Bits x = bits (a), y = bits (b);
+        if (!m_ok || x.size () != y.size ()) return fail ();
+        eq = equal (x, y);
+      }
+      return isOpX<EQ> (e) ? eq : Aig::neg (eq);
+    }
+
+    // -- comparisons, as < or <= with the arguments swapped if needed
+    bool swap = isOpX<BUGT> (e) || isOpX<BUGE> (e) || isOpX<BSGT> (e) || isOpX<BSGE> (e);
+    bool strict = isOpX<BULT> (e) || isOpX<BUGT> (e) || isOpX<BSLT> (e) || isOpX<BSGT> (e);
+    bool sign = isOpX<BSLT> (e) || isOpX<BSLE> (e) || isOpX<BSGT> (e) || isOpX<BSGE> (e);
+    if (swap || strict || sign || isOpX<BULE> (e))
+    {
+      Bits x = bits (e->arg (swap ? 1 : 0)), y = bits (e->arg (swap ? 0 : 1));
+      if (!m_ok || x.size () != y.size () || x.empty ()) return fail ();
+      // -- x <= y iff !(y < x)
+      if (strict) return sign ? slt (x, y) : ult (x, y);
+      return Aig::neg (sign ? slt (y, x) : ult (y, x));
+    }
+    return fail ();
+  }
+
+  BitBlaster::Bits BitBlaster::bitsRaw (Expr e)
+  {
+    if (!m_ok) return Bits ();
+
+    if (bv::is_bvnum (e))
+    {
+      mpz_class v = bv::toMpz (e);
+      unsigned w = bv::width (e->arg (1));
+      Bits b;
+      for (unsigned i = 0; i < w; ++i)
+        b.push_back (mpz_tstbit (v.get_mpz_t (), i) ? Aig::mkTrue () : Aig::mkFalse ());
+      return b;
+    }
+    if (bind::isConst (e))
+    {
+      Expr sort = sortOf (e);
+      if (!isOpX<BVSORT> (sort)) { fail (); return Bits (); }
+      return input (e, bv::width (sort));
+    }
+    if (isOpX<ITE> (e))
+    {
+      Aig::Lit c = lit (e->arg (0));
+      Bits t = bits (e->arg (1)), f = bits (e->arg (2));
+      if (!m_ok || t.size () != f.size ()) { fail (); return Bits (); }
+      return mux (c, t, f);
+    }
+    if (isOpX<BEXTRACT> (e))
+    {
+      Bits a = bits (bv::earg (e));
+      unsigned hi = bv::high (e), lo = bv::low (e);
+      if (!m_ok || hi < lo || hi >= a.size ()) { fail (); return Bits (); }
+      return Bits (a.begin () + lo, a.begin () + hi + 1);
+    }
+    if (isOpX<BSEXT> (e) || isOpX<BZEXT> (e))
+    {
+      Bits a = bits (e->arg (0));
+      unsigned w = bv::width (e->arg (1));
+      if (!m_ok || a.empty () || w < a.size ()) { fail (); return Bits (); }
+      Aig::Lit fill = isOpX<BSEXT> (e) ? a.back () : Aig::mkFalse ();
+      a.resize (w, fill);
+      return a;
+    }
+    if (isOpX<SELECT> (e))
+    {
+      Expr idx = e->arg (1);
+      Bits i = bits (idx);
+      if (!m_ok) return Bits ();
+      return read (e->arg (0), idx, i);
+    }
+
+    // -- the other operators only have bit-vector arguments
+    std::vector<Bits> args;
+    for (Expr a : boost::make_iterator_range (e->args_begin (), e->args_end ()))
+    {
+      args.push_back (bits (a));
+      if (!m_ok) return Bits ();
+    }
+    if (args.empty () || args [0].empty ()) { fail (); return Bits (); }
+
+    if (isOpX<BCONCAT> (e))
+    {
+      // -- the first argument has the most significant bits
+      Bits res;
+      for (unsigned k = args.size (); k-- > 0;)
+        res.insert (res.end (), args [k].begin (), args [k].end ());
+      return res;
+    }
+    for (const Bits &a : args)
+      if (a.size () != args [0].size ()) { fail (); return Bits (); }
+    const Bits &a = args [0];
+    unsigned w = a.size ();
+
+    if (isOpX<BNOT> (e))
+    {
+      Bits r (a);
+      for (Aig::Lit &l : r) l = Aig::neg (l);
+      return r;
+    }
+    if (isOpX<BNEG> (e)) return negate (a);
+
+    // -- bitwise operators, possibly n-ary
+    bool band = isOpX<BAND> (e) || isOpX<BNAND> (e);
+    bool bor = isOpX<BOR> (e) || isOpX<BNOR> (e);
+    bool bxor = isOpX<BXOR> (e) || isOpX<BXNOR> (e);
+    if (band || bor || bxor)
+    {
+      Bits r (a);
+      for (unsigned k = 1; k < args.size (); ++k)
+        for (unsigned i = 0; i < w; ++i)
+          r [i] = band ? m_aig.mkAnd (r [i], args [k][i]) :
+            bor ? m_aig.mkOr (r [i], args [k][i]) : m_aig.mkXor (r [i], args [k][i]);
+      if (isOpX<BNAND> (e) || isOpX<BNOR> (e) || isOpX<BXNOR> (e))
+        for (Aig::Lit &l : r) l = Aig::neg (l);
+      return r;
+    }
+    if (isOpX<BADD> (e) || isOpX<BMUL> (e))
+    {
+      Bits r (a);
+      for (unsigned k = 1; k < args.size (); ++k)
+        r = isOpX<BADD> (e) ? add (r, args [k], Aig::mkFalse ()) : mul (r, args [k]);
+      return r;
+    }
+
+    if (args.size () != 2) { fail (); return Bits (); }
+    const Bits &b = args [1];
+    if (isOpX<BSUB> (e))
+    {
+      Bits nb (b);
+      for (Aig::Lit &l : nb) l = Aig::neg (l);
+      return add (a, nb, Aig::mkTrue ());
+    }
+    if (isOpX<BUDIV> (e) || isOpX<BUREM> (e))
+    {
+      Bits q, r;
+      udivrem (a, b, q, r);
+      return isOpX<BUDIV> (e) ? q : r;
+    }
+    if (isOpX<BSDIV> (e)) return sdiv (a, b);
+    if (isOpX<BSREM> (e)) return srem (a, b);
+    if (isOpX<BSHL> (e)) return shift (a, b, true, false);
+    if (isOpX<BLSHR> (e)) return shift (a, b, false, false);
+    if (isOpX<BASHR> (e)) return shift (a, b, false, true);
+
+    fail ();
+    return Bits ();
+  }
+
+  BitBlaster::Bits BitBlaster::read (Expr a, Expr idx, const Bits &i)
+  {
+    auto key = std::make_pair (a, idx);
+    auto it = m_reads.find (key);
+    if (it != m_reads.end ()) return it->second;
+
+    Bits res;
+    if (isOpX<STORE> (a))
+    {
+      Bits j = bits (a->arg (1)), v = bits (a->arg (2));
+      if (!m_ok || j.size () != i.size ()) { fail (); return Bits (); }
+      Bits below = read (a->arg (0), idx, i);
+      if (!m_ok || below.size () != v.size ()) { fail (); return Bits (); }
+      res = mux (equal (i, j), v, below);
+    }
+    else if (isOpX<ITE> (a))
+    {
+      Aig::Lit c = lit (a->arg (0));
+      Bits t = read (a->arg (1), idx, i), e = read (a->arg (2), idx, i);
+      if (!m_ok || t.size () != e.size ()) { fail (); return Bits (); }
+      res = mux (c, t, e);
+    }
+    else if (isOpX<CONST_ARRAY> (a)) res = bits (a->arg (1));
+    else if (bind::isConst (a) && m_arrays.count (a))
+      res = read (m_arrays [a], idx, i);
+    else if (bind::isConst (a) && isArray (a))
+    {
+      Expr valTy = sortOf (a)->arg (1);
+      if (!isOpX<BVSORT> (valTy)) { fail (); return Bits (); }
+      res = input (op::array::select (a, idx), bv::width (valTy));
+      // -- reads of equal indices are equal
+      auto &reads = m_free [a];
+      for (auto &r : reads)
+        if (r.first.size () == i.size ())
+          m_constraints.push_back (m_aig.mkOr (Aig::neg (equal (i, r.first)),
+                                               equal (res, r.second)));
+      reads.push_back (std::make_pair (i, res));
+    }
+    else { fail (); return Bits (); }
+
+    if (m_ok) m_reads [key] = res;
+    return res;
+  }
+
+  Aig::Lit BitBlaster::equal (const Bits &a, const Bits &b)
+  {
+    Aig::Lit res = Aig::mkTrue ();
+    for (unsigned i = 0; i < a.size (); ++i)
+      res = m_aig.mkAnd (res, m_aig.mkIff (a [i], b [i]));
+    return res;
+  }
+
+  Aig::Lit BitBlaster::ult (const Bits &a, const Bits &b)
+  {
+    // -- a < b iff a + !b + 1 does not carry out
+    Aig::Lit carry = Aig::mkTrue ();
+    for (unsigned i = 0; i < a.size (); ++i)
+    {
+      Aig::Lit nb = Aig::neg (b [i]);
+      carry = m_aig.mkOr (m_aig.mkAnd (a [i], nb),
+                          m_aig.mkAnd (carry, m_aig.mkXor (a [i], nb)));
+    }
+    return Aig::neg (carry);
+  }
+
+  Aig::Lit BitBlaster::slt (const Bits &a, const Bits &b)
+  {
+    // -- signed order is the unsigned order with the signs flipped
+    Bits x (a), y (b);
+    x.back () = Aig::neg (x.back ());
+    y.back () = Aig::neg (y.back ());
+    return ult (x, y);
+  }
+
+  BitBlaster::Bits BitBlaster::mux (Aig::Lit c, const Bits &t, const Bits &e)
+  {
+    Bits r (t.size ());
+    for (unsigned i = 0; i < t.size (); ++i) r [i] = m_aig.mkIte (c, t [i], e [i]);
+    return r;
+  }
+
+  BitBlaster::Bits BitBlaster::add (const Bits &a, const Bits &b, Aig::Lit carry)
+  {
+    Bits r (a.size ());
+    for (unsigned i = 0; i < a.size (); ++i)
+    {
+      Aig::Lit x = m_aig.mkXor (a [i], b [i]);
+      r [i] = m_aig.mkXor (x, carry);
+      carry = m_aig.mkOr (m_aig.mkAnd (a [i], b [i]), m_aig.mkAnd (carry, x));
+    }
+    return r;
+  }
+
+  BitBlaster::Bits BitBlaster::negate (const Bits &a)
+  {
+    Bits na (a);
+    for (Aig::Lit &l : na) l = Aig::neg (l);
+    return add (na, Bits (a.size (), Aig::mkFalse ()), Aig::mkTrue ());
+  }
+
+  BitBlaster::Bits BitBlaster::mul (const Bits &a, const Bits &b)
+  {
+    unsigned w = a.size ();
+    Bits r (w, Aig::mkFalse ());
+    for (unsigned i = 0; i < w; ++i)
+    {
+      if (b [i] == Aig::mkFalse ()) continue;
+      // -- (a << i) & b[i]
+      Bits p (w, Aig::mkFalse ());
+      for (unsigned j = i; j < w; ++j) p [j] = m_aig.mkAnd (a [j - i], b [i]);
+      r = add (r, p, Aig::mkFalse ());
+    }
+    return r;
+  }
+
+  void BitBlaster::udivrem (const Bits &a, const Bits &b, Bits &q, Bits &r)
+  {
+    // -- restoring division. Dividing by 0 gives all ones and a, as
+    // -- in SMT-LIB
+    unsigned w = a.size ();
+    q.assign (w, Aig::mkFalse ());
+    r.assign (w, Aig::mkFalse ());
+    Bits d (b);
+    d.push_back (Aig::mkFalse ());
+    for (unsigned k = w; k-- > 0;)
+    {
+      // -- s = 2r + a[k], on w + 1 bits
+      Bits s;
+      s.push_back (a [k]);
+      s.insert (s.end (), r.begin (), r.end ());
+      Aig::Lit ge = Aig::neg (ult (s, d));
+      q [k] = ge;
+      Bits nd (d);
+      for (Aig::Lit &l : nd) l = Aig::neg (l);
+      Bits diff = add (s, nd, Aig::mkTrue ());
+      Bits next = mux (ge, diff, s);
+      r.assign (next.begin (), next.begin () + w);
+    }
+  }
+
+  BitBlaster::Bits BitBlaster::sdiv (const Bits &a, const Bits &b)
+  {
+    // -- as defined in SMT-LIB, from the division of the magnitudes
+    Aig::Lit sa = a.back (), sb = b.back ();
+    Bits q, r;
+    udivrem (mux (sa, negate (a), a), mux (sb, negate (b), b), q, r);
+    return mux (m_aig.mkXor (sa, sb), negate (q), q);
+  }
+
+  BitBlaster::Bits BitBlaster::srem (const Bits &a, const Bits &b)
+  {
+    // -- the sign of the remainder is the sign of a
+    Aig::Lit sa = a.back (), sb = b.back ();
+    Bits q, r;
+    udivrem (mux (sa, negate (a), a), mux (sb, negate (b), b), q, r);
+    return mux (sa, negate (r), r);
+  }
+
+  BitBlaster::Bits BitBlaster::shift (const Bits &a, const Bits &amount,
+                                      bool left, bool arith)
+  {
+    unsigned w = a.size ();
+    Aig::Lit fill = arith ? a.back () : Aig::mkFalse ();
+    Bits r (a);
+    unsigned k = 0;
+    // -- a barrel shifter over the bits of the amount below w
+    for (; k < amount.size () && (1ull << k) < w; ++k)
+    {
+      unsigned s = 1u << k;
+      Bits shifted (w, fill);
+      for (unsigned i = 0; i < w; ++i)
+      {
+        if (left && i >= s) shifted [i] = r [i - s];
+        else if (!left && i + s < w) shifted [i] = r [i + s];
+      }
+      r = mux (amount [k], shifted, r);
+    }
+    // -- a larger amount shifts every bit out
+    Aig::Lit big = Aig::mkFalse ();
+    for (; k < amount.size (); ++k) big = m_aig.mkOr (big, amount [k]);
+    return mux (big, Bits (w, fill), r);
+  }
+}
@@ -1,14 +1,56 @@
 #include "seahorn/Bmc.hh"
 #include "seahorn/UfoSymExec.hh"
+#include "seahorn/BvSymExec.hh"
+#include "seahorn/Aig.hh"
+#include "seahorn/BitBlast.hh"
 
-#include "boost/container/flat_set.hpp"
+#include "llvm/Support/CommandLine.h"
+#include "ufo/Stats.hh"
+#include "ufo/Trace.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+static llvm::cl::opt<bool>
+SimplifySide ("horn-bmc-simplify",
+              llvm::cl::desc ("Simplify the path condition of BMC before asserting it"),
+              llvm::cl::init (false));
+
+static llvm::cl::opt<std::string>
+Tactics ("horn-bmc-tactics",
+         llvm::cl::desc ("Preprocess the path condition of BMC with Z3 tactics: "
+                         "none, int, bv, auto (int or bv by the encoding), or a "
+                         "comma-separated list of tactics"),
+         llvm::cl::init ("none"));
+
+static llvm::cl::opt<bool>
+Fraig ("horn-bmc-fraig",
+       llvm::cl::desc ("Merge equivalent nodes of the AIG of --horn-bmc-aig"),
+       llvm::cl::init (true), llvm::cl::Hidden);
 
 namespace seahorn
 {
+  namespace
+  {
+    /// resources of a lookahead query on a literal, in Z3 units
+    const unsigned LookaheadRlimit = 200000;
+    /// literals looked ahead per literal of the split
+    const unsigned LookaheadWidth = 4;
+    /// at most 2^MaxCubeLits cubes
+    const unsigned MaxCubeLits = 20;
+  }
+  
   /// computes an implicant of f (interpreted as a conjunction) that
   /// contains the given model
   static void get_model_implicant (const ExprVector &f, 
-                                   ufo::ZModel<ufo::EZ3> &model, ExprVector &out);
+                                   const std::function<Expr (Expr)> &model, 
+                                   ExprVector &out);
   /// true if I is a call to a void function
   static bool isCallToVoidFn (const llvm::Instruction &I);
   
@@ -27,40 +69,477 @@ namespace seahorn
 
   boost::tribool BmcEngine::solve ()
   {
+    ufo::ScopedTrace _t_("bmc solve", "bmc");
     encode ();
-    m_result =  m_smt_solver.solve ();
+    m_result =  m_smt_solver.solveCached (true);
     return m_result;
   }
 
+  bool BmcEngine::splitLiterals (unsigned k, ExprVector &lits, ExprVector &units)
+  {
+    // -- the variables of the blocks inside the edges, as in
+    // -- BmcTrace::build
+    ExprHashSet cands;
+    ExprVector order;
+    for (unsigned i = 0; i < m_edges.size (); ++i)
+      for (auto it = m_edges [i]->begin (), end = m_edges [i]->end (); it != end; ++it)
+      {
+        if (it == m_edges [i]->begin ()) continue;
+        Expr v = m_states [i + 1].eval (m_sem.symb (*it));
+        if (bind::isBoolConst (v) && cands.insert (v).second) order.push_back (v);
+      }
+    
+    // -- a variable used by many side conditions splits more of the
+    // -- path condition
+    ExprHashMap<unsigned> occ;
+    for (Expr e : m_side)
+    {
+      ExprVector used;
+      filter (e, [&cands] (Expr t) { return cands.count (t) > 0; },
+              std::back_inserter (used));
+      for (Expr t : used) ++occ [t];
+    }
+    std::stable_sort (order.begin (), order.end (),
+                      [&occ] (Expr a, Expr b) { return occ [a] > occ [b]; });
+    
+    // -- lookahead: a literal whose one polarity is quickly unsat
+    // -- does not split anything, its other polarity holds
+    ufo::ZBudget saved = m_smt_solver.getBudget ();
+    m_smt_solver.setBudget (ufo::ZBudget (0, LookaheadRlimit));
+    bool sat = true;
+    for (unsigned i = 0; i < order.size () && i < k * LookaheadWidth && lits.size () < k; ++i)
+    {
+      Expr l = order [i];
+      Expr nl = mk<NEG> (l);
+      boost::tribool pos = m_smt_solver.solveAssuming (ExprVector {l});
+      boost::tribool neg = m_smt_solver.solveAssuming (ExprVector {nl});
+      if (!pos && !neg) { sat = false; break; }
+      if (!pos) units.push_back (nl);
+      else if (!neg) units.push_back (l);
+      else lits.push_back (l);
+    }
+    m_smt_solver.setBudget (saved);
+    return sat;
+  }
+  
+  boost::tribool BmcEngine::solveCubes (unsigned k, unsigned threads)
+  {
+    ufo::ScopedTrace _t_("bmc cubes", "bmc");
+    encode ();
+    // -- the cubes are over the variables of the raw conditions
+    if (m_simp) restoreSolver ();
+    
+    ExprVector lits, units;
+    if (!splitLiterals (std::min (k, MaxCubeLits), lits, units))
+      return m_result = false;
+    ufo::Stats::uset ("BmcCubeUnits", units.size ());
+    for (Expr u : units) m_smt_solver.assertExpr (u);
+    if (lits.empty ()) return solve ();
+    
+    // -- other solvers share the expressions of the engine
+    if (!m_efac.isConcurrent ()) threads = 1;
+    unsigned ncubes = 1u << lits.size ();
+    threads = std::max (1u, std::min (threads, ncubes));
+    ufo::Stats::uset ("BmcCubes", ncubes);
+    
+    std::mutex lock;
+    unsigned next = 0;
+    bool done = false, unsat = false, incomplete = false;
+    int foundBy = -1;
+    ExprVector cex;
+    /// unsat cores of the cubes, each one is a clause once negated
+    std::vector<ExprVector> cores;
+    std::vector<ufo::EZ3*> ctxs (threads, nullptr);
+    unsigned solved = 0, pruned = 0;
+    
+    auto stop = [&] (unsigned t)
+      {
+        done = true;
+        for (unsigned o = 0; o < ctxs.size (); ++o)
+          if (o != t && ctxs [o]) ctxs [o]->interrupt ();
+      };
+    
+    auto work = [&] (unsigned t, ufo::ZSolver<ufo::EZ3> &solver)
+      {
+        ExprFactory &efac = m_efac;
+        Expr trueE = mk<TRUE> (efac);
+        unsigned learned = 0;
+        while (true)
+        {
+          unsigned c;
+          ExprVector cube;
+          std::vector<ExprVector> fresh;
+          {
+            std::lock_guard<std::mutex> l (lock);
+            if (done || next >= ncubes) break;
+            c = next++;
+            for (unsigned i = 0; i < lits.size (); ++i)
+              cube.push_back ((c >> i) & 1 ? lits [i] : mk<NEG> (lits [i]));
+            
+            // -- a cube that contains a core is unsat
+            ExprHashSet in (cube.begin (), cube.end ());
+            bool subsumed = false;
+            for (const ExprVector &core : cores)
+              if (std::all_of (core.begin (), core.end (),
+                               [&in] (Expr e) { return in.count (e) > 0; }))
+              { subsumed = true; break; }
+            if (subsumed) { ++pruned; continue; }
+            fresh.assign (cores.begin () + learned, cores.end ());
+            learned = cores.size ();
+          }
+          
+          // -- cores of the other workers
+          for (const ExprVector &core : fresh)
+            solver.assertExpr (mk<NEG> (mknary<AND> (trueE, core.begin (), core.end ())));
+          
+          ExprVector core;
+          boost::tribool res = solver.solveAssuming (cube, std::back_inserter (core));
+          
+          std::lock_guard<std::mutex> l (lock);
+          if (done) break;
+          ++solved;
+          if (res)
+          {
+            foundBy = t;
+            cex = cube;
+            stop (t);
+            break;
+          }
+          if (!res)
+          {
+            // -- unsat without the cube
+            if (core.empty ()) { unsat = true; stop (t); break; }
+            cores.push_back (core);
+          }
+          else incomplete = true;
+        }
+      };
+    
+    ufo::ZBudget budget = m_smt_solver.getBudget ();
+    // -- a context per thread, contexts are not thread safe. The
+    // -- encoding is marshaled by the engine, the workers take a copy
+    ufo::ZWorkerContexts<ufo::EZ3> contexts (m_efac);
+    for (unsigned t = 1; t < threads; ++t)
+    {
+      contexts.share (zctx (), m_side, t);
+      contexts.share (zctx (), units, t);
+    }
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t)
+      pool.emplace_back ([&, t] ()
+                         {
+                           ufo::EZ3 &z3 = contexts.get (t);
+                           ufo::ZSolver<ufo::EZ3> solver (z3, m_tactics);
+                           if (!budget.unbounded ()) solver.setBudget (budget);
+                           {
+                             std::lock_guard<std::mutex> l (lock);
+                             if (done) return;
+                             ctxs [t] = &z3;
+                           }
+                           for (Expr e : m_side) solver.assertExpr (e);
+                           for (Expr u : units) solver.assertExpr (u);
+                           work (t, solver);
+                           std::lock_guard<std::mutex> l (lock);
+                           ctxs [t] = nullptr;
+                         });
+    {
+      std::lock_guard<std::mutex> l (lock);
+      ctxs [0] = &zctx ();
+    }
+    work (0, m_smt_solver);
+    for (std::thread &t : pool) t.join ();
+    
+    ufo::Stats::uset ("BmcCubesSolved", solved);
+    ufo::Stats::uset ("BmcCubesPruned", pruned);
+    LOG ("bmc", errs () << "BMC cubes: " << ncubes << " over " << lits.size ()
+         << " literals, " << solved << " solved, " << pruned << " pruned\n";);
+    
+    if (unsat) return m_result = false;
+    if (foundBy == 0) return m_result = true;
+    // -- the model is in the solver of another worker
+    if (foundBy > 0) return m_result = m_smt_solver.solveAssuming (cex);
+    if (incomplete) return m_result = boost::indeterminate;
+    return m_result = false;
+  }
+  
+  boost::tribool BmcEngine::solveAig ()
+  {
+    ufo::ScopedTrace _t_("bmc aig", "bmc");
+    encode ();
+    
+    // -- the conjuncts of the path condition. The equalities that
+    // -- define array constants, e.g., memories, are not translated
+    Aig aig;
+    BitBlaster blaster (aig);
+    ExprVector conjs;
+    ExprVector todo (m_side.rbegin (), m_side.rend ());
+    while (!todo.empty ())
+    {
+      Expr e = todo.back ();
+      todo.pop_back ();
+      if (isOpX<AND> (e))
+      {
+        for (unsigned i = e->arity (); i-- > 0;) todo.push_back (e->arg (i));
+        continue;
+      }
+      if (isOpX<EQ> (e) && (blaster.define (e->arg (0), e->arg (1)) ||
+                            blaster.define (e->arg (1), e->arg (0))))
+        continue;
+      conjs.push_back (e);
+    }
+    
+    std::vector<Aig::Lit> roots;
+    for (Expr e : conjs)
+    {
+      roots.push_back (blaster.lit (e));
+      if (!blaster.ok ()) break;
+    }
+    if (!blaster.ok ())
+    {
+      LOG ("bmc", errs () << "BMC aig: the path condition is not bit-level\n";);
+      ufo::Stats::count ("BmcAigFallback");
+      return solve ();
+    }
+    roots.insert (roots.end (), blaster.constraints ().begin (), blaster.constraints ().end ());
+    ufo::Stats::uset ("BmcAigInputs", aig.numInputs ());
+    ufo::Stats::uset ("BmcAigAnds", aig.numAnds ());
+    
+    std::vector<Aig::Lit> map;
+    if (Fraig) map = aig.fraig (roots, zctx ());
+    auto remap = [&map] (Aig::Lit l)
+      {
+        if (map.empty ()) return l;
+        Aig::Lit m = map [Aig::node (l)];
+        return Aig::isNeg (l) ? Aig::neg (m) : m;
+      };
+    
+    AigSat sat (aig, zctx (), "bmc.aig!");
+    for (Aig::Lit r : roots) sat.assertLit (r);
+    boost::tribool res = sat.solve (std::vector<Aig::Lit> (), m_smt_solver.getBudget ());
+    if (!res || boost::indeterminate (res)) return m_result = res;
+    
+    // -- lift the values of the inputs to the solver of the engine,
+    // -- where BmcTrace finds its model
+    ExprVector vals;
+    for (auto &in : blaster.inputs ())
+    {
+      Expr term = in.first;
+      const BitBlaster::Bits &b = in.second;
+      if (bind::isBoolConst (term))
+      {
+        vals.push_back (sat.value (remap (b [0])) ? term : mk<NEG> (term));
+        continue;
+      }
+      mpz_class v = 0;
+      for (unsigned i = b.size (); i-- > 0;)
+      {
+        v *= 2;
+        if (sat.value (remap (b [i]))) v += 1;
+      }
+      vals.push_back (mk<EQ> (term, bv::bvnum (v, b.size (), m_efac)));
+    }
+    static std::atomic<unsigned> lifts (0);
+    Expr lift = bind::boolConst
+      (mkTerm<std::string> ("bmc.aig.lift!" + std::to_string (lifts++), m_efac));
+    m_smt_solver.assertExpr (mk<IMPL> (lift, mknary<AND> (mk<TRUE> (m_efac),
+                                                         vals.begin (), vals.end ())));
+    m_result = m_smt_solver.solveAssuming (ExprVector {lift});
+    if (m_result) return m_result;
+    
+    LOG ("bmc", errs () << "BMC aig: the model does not lift, solving with z3\n";);
+    ufo::Stats::count ("BmcAigLiftFailed");
+    return solve ();
+  }
+  
   void BmcEngine::encode ()
   {
+    if (m_cps.empty ()) return;
     
-    // -- only run the encoding once
-    if (!m_side.empty ()) return;
+    // -- only encode the edges added since the last call
+    if (m_states.size () == m_cps.size () && m_asserted == m_side.size ()) return;
     
     assert (m_cpg);
     assert (m_fn);
     UfoLargeSymExec sexec (m_sem);
-    m_states.push_back (SymStore (m_efac));
+    if (m_states.empty ()) m_states.push_back (SymStore (m_efac));
     
-    const CutPoint *prev = nullptr;
-    for (const CutPoint *cp : m_cps)
+    for (unsigned i = m_states.size (); i < m_cps.size (); ++i)
     {
-      if (prev)
-      {
-        const CpEdge *edg = m_cpg->getEdge (*prev, *cp);
-        assert (edg);
-        m_edges.push_back (edg);
+      const CpEdge *edg = m_cpg->getEdge (*m_cps [i - 1], *m_cps [i]);
+      assert (edg);
+      m_edges.push_back (edg);
       
-        m_states.push_back (m_states.back ());
-        SymStore &s = m_states.back ();
-        sexec.execCpEdg (s, *edg, m_side);
-      }
-      prev = cp;
+      m_states.push_back (m_states.back ());
+      SymStore &s = m_states.back ();
+      sexec.execCpEdg (s, *edg, m_side);
+      m_sideEnd.push_back (m_side.size ());
     }
     
-    for (Expr v : m_side) m_smt_solver.assertExpr (v);
-    
+    for (; m_asserted < m_side.size (); ++m_asserted) assertSide (m_asserted);
+  }
+  
+  namespace
+  {
+    /// folds a node whose kids are folded
+    struct FoldNode : public std::unary_function<Expr, Expr>
+    {
+      boolop::TrivialSimplifier m_bool;
+      FoldNode (ExprFactory &efac) : m_bool (efac) {}
+
+      Expr operator() (Expr e)
+      {
+        ExprFactory &efac = e->efac ();
+        if (isOpX<ITE> (e))
+        {
+          if (isOpX<TRUE> (e->arg (0))) return e->arg (1);
+          if (isOpX<FALSE> (e->arg (0))) return e->arg (2);
+          if (e->arg (1) == e->arg (2)) return e->arg (1);
+          return e;
+        }
+        if (e->arity () == 2 && isOpX<MPZ> (e->arg (0)) && isOpX<MPZ> (e->arg (1)))
+        {
+          mpz_class a = getTerm<mpz_class> (e->arg (0));
+          mpz_class b = getTerm<mpz_class> (e->arg (1));
+          Expr trueE = mk<TRUE> (efac), falseE = mk<FALSE> (efac);
+          if (isOpX<PLUS> (e)) return mkTerm<mpz_class> (a + b, efac);
+          if (isOpX<MINUS> (e)) return mkTerm<mpz_class> (a - b, efac);
+          if (isOpX<MULT> (e)) return mkTerm<mpz_class> (a * b, efac);
+          if (isOpX<EQ> (e)) return a == b ? trueE : falseE;
+          if (isOpX<NEQ> (e)) return a != b ? trueE : falseE;
+          if (isOpX<LT> (e)) return a < b ? trueE : falseE;
+          if (isOpX<LEQ> (e)) return a <= b ? trueE : falseE;
+          if (isOpX<GT> (e)) return a > b ? trueE : falseE;
+          if (isOpX<GEQ> (e)) return a >= b ? trueE : falseE;
+        }
+        if (isOpX<EQ> (e) && e->arg (0) == e->arg (1)) return mk<TRUE> (efac);
+        if (isOp<BoolOp> (e)) return m_bool (e);
+        return e;
+      }
+    };
+
+    struct FoldVisitor
+    {
+      std::shared_ptr<FoldNode> m_fold;
+      FoldVisitor (ExprFactory &efac) : m_fold (std::make_shared<FoldNode> (efac)) {}
+
+      VisitAction operator() (Expr e)
+      {
+        // -- constants are left alone
+        if (e->arity () == 0 || bind::IsConst () (e) || isOpX<FDECL> (e))
+          return VisitAction::skipKids ();
+        return VisitAction::changeDoKidsRewrite (e, m_fold);
+      }
+    };
+  }
+
+  void BmcSimplifier::see (Expr e)
+  {
+    ExprVector consts;
+    filter (e, bind::IsConst (), std::back_inserter (consts));
+    for (Expr c : consts)
+      if (m_seen.insert (c).second) m_seenLog.push_back (c);
+  }
+
+  bool BmcSimplifier::define (Expr x, Expr v)
+  {
+    if (!bind::IsConst () (x) || m_seen.count (x)) return false;
+    // -- x = f (x) is not a definition
+    ExprVector consts;
+    filter (v, bind::IsConst (), std::back_inserter (consts));
+    if (std::find (consts.begin (), consts.end (), x) != consts.end ()) return false;
+
+    m_defs [x] = v;
+    m_defLog.push_back (x);
+    see (x);
+    see (v);
+    return true;
+  }
+
+  Expr BmcSimplifier::simplify (Expr e)
+  {
+    static ufo::StatsCounter &before = ufo::Stats::counter ("BmcSideSize");
+    static ufo::StatsCounter &after = ufo::Stats::counter ("BmcSimplifiedSize");
+    before.inc (dagSize (e));
+
+    FoldVisitor fold (m_efac);
+    e = dagVisit (fold, expand (e));
+    if (isOpX<TRUE> (e)) return Expr ();
+    if (isOpX<EQ> (e) && (define (e->arg (0), e->arg (1)) ||
+                          define (e->arg (1), e->arg (0))))
+      return Expr ();
+
+    see (e);
+    after.inc (dagSize (e));
+    return e;
+  }
+
+  void BmcSimplifier::undo (const Mark &m)
+  {
+    while (m_defLog.size () > m.first)
+    {
+      m_defs.erase (m_defLog.back ());
+      m_defLog.pop_back ();
+    }
+    while (m_seenLog.size () > m.second)
+    {
+      m_seen.erase (m_seenLog.back ());
+      m_seenLog.pop_back ();
+    }
+  }
+
+  BmcSimplifier *BmcEngine::makeSimplifier (ExprFactory &efac)
+  { return SimplifySide ? new BmcSimplifier (efac) : nullptr; }
+
+  std::vector<std::string> BmcEngine::tactics (SmallStepSymExec &sem)
+  {
+    std::string preset = Tactics;
+    if (preset == "auto")
+      preset = dynamic_cast<BvSmallSymExec*> (&sem) ? "bv" : "int";
+
+    std::vector<std::string> res;
+    if (preset == "none" || preset.empty ()) return res;
+    if (preset == "int")
+      return {"simplify", "propagate-values", "solve-eqs", "elim-uncnstr", "smt"};
+    // -- memory stays an array after bit-blasting, so smt and not sat
+    if (preset == "bv")
+      return {"simplify", "propagate-values", "solve-eqs", "elim-uncnstr",
+              "simplify", "bit-blast", "smt"};
+
+    std::istringstream in (preset);
+    std::string t;
+    while (std::getline (in, t, ','))
+      if (!t.empty ()) res.push_back (t);
+    if (!res.empty () && res.back () != "smt" && res.back () != "sat")
+      res.push_back ("smt");
+    return res;
+  }
+
+  ufo::ZSolverPool<ufo::EZ3>::Lease
+  BmcEngine::leaseSolver (ufo::EZ3 &zctx, std::vector<std::string> &tactics)
+  {
+    ufo::ZSolverPool<ufo::EZ3> &pool = zctx.solverPool ();
+    if (tactics.empty ()) return pool.acquire ();
+
+    std::string profile = "bmc-tactics";
+    for (const std::string &t : tactics) profile += ":" + t;
+    if (!pool.hasProfile (profile)) pool.setProfile (profile, tactics);
+    try
+    {
+      return pool.acquire (profile);
+    }
+    catch (z3::exception &e)
+    {
+      errs () << "WARNING: ignoring --horn-bmc-tactics: " << e.msg () << "\n";
+      tactics.clear ();
+      return pool.acquire ();
+    }
+  }
+
+  void BmcEngine::assertSide (unsigned i)
+  {
+    Expr e = m_side [i];
+    if (m_simp) e = m_simp->simplify (e);
+    if (e) m_smt_solver.assertExpr (e);
   }
 
   void BmcEngine::reset ()
@@ -68,18 +547,71 @@ namespace seahorn
     m_cps.clear ();
     m_cpg = nullptr;
     m_fn = nullptr;
-    m_smt_solver.reset ();
+    m_lease.clear ();
 
     m_side.clear ();
     m_states.clear ();
     m_edges.clear ();
+    m_sideEnd.clear ();
+    m_asserted = 0;
+    m_frames.clear ();
+    if (m_simp) m_simp->reset ();
+    m_simpFrames.clear ();
+    m_result = boost::indeterminate;
+  }
+  
+  void BmcEngine::push ()
+  {
+    encode ();
+    m_frames.push_back (std::make_pair (m_cps.size (), m_side.size ()));
+    m_simpFrames.push_back (m_simp ? m_simp->mark () : BmcSimplifier::Mark ());
+    m_smt_solver.push ();
+  }
+  
+  void BmcEngine::pop ()
+  {
+    assert (!m_frames.empty ());
+    unsigned cps = m_frames.back ().first;
+    unsigned side = m_frames.back ().second;
+    m_frames.pop_back ();
+    if (m_simp) m_simp->undo (m_simpFrames.back ());
+    m_simpFrames.pop_back ();
+    m_smt_solver.pop ();
+    
+    m_cps.resize (cps);
+    if (m_states.size () > cps) m_states.erase (m_states.begin () + cps, m_states.end ());
+    m_edges.resize (cps > 0 ? cps - 1 : 0);
+    m_sideEnd.resize (m_edges.size ());
+    m_side.resize (side);
+    m_asserted = side;
+    m_result = boost::indeterminate;
+    if (m_cps.empty ())
+    {
+      m_cpg = nullptr;
+      m_fn = nullptr;
+    }
+  }
+  
+  void BmcEngine::restoreSolver ()
+  {
+    // -- the raw conditions are equivalent to the simplified ones
+    // -- together with the definitions of the simplifier
+    m_lease.clear ();
+    unsigned k = 0;
+    for (auto &f : m_frames)
+    {
+      for (; k < f.second; ++k) m_smt_solver.assertExpr (m_side [k]);
+      m_smt_solver.push ();
+    }
+    for (; k < m_side.size (); ++k) m_smt_solver.assertExpr (m_side [k]);
+    m_asserted = m_side.size ();
   }
   
   
   void BmcEngine::unsatCore (ExprVector &out)
   {
     // -- re-assert the path-condition with assumptions
-    m_smt_solver.reset ();
+    m_lease.clear ();
     ExprVector assumptions;
     assumptions.reserve (m_side.size ());
     for (Expr v : m_side)
@@ -91,10 +623,10 @@ namespace seahorn
     
     ExprVector core;
     m_smt_solver.push ();
-    boost::tribool res = m_smt_solver.solveAssuming (assumptions);
+    boost::tribool res = m_smt_solver.solveAssumingCached (assumptions, true);
     if (!res) m_smt_solver.unsatCore (std::back_inserter (core));
     m_smt_solver.pop ();
-    if (res) return;
+    if (res) { restoreSolver (); return; }
 
     
     // simplify core
@@ -103,7 +635,7 @@ namespace seahorn
       assumptions.assign (core.begin (), core.end ());
       core.clear ();
       m_smt_solver.push ();
-      res = m_smt_solver.solveAssuming (assumptions);
+      res = m_smt_solver.solveAssumingCached (assumptions, true);
       assert (!res ? 1 : 0);
       m_smt_solver.unsatCore (std::back_inserter (core));
       m_smt_solver.pop ();
@@ -114,7 +646,7 @@ namespace seahorn
     {
       Expr saved = core [i];
       core [i] = core.back ();
-      res = m_smt_solver.solveAssuming 
+      res = m_smt_solver.solveAssumingCached
         (boost::make_iterator_range (core.begin (), core.end () - 1));
       if (res) core [i++] = saved;
       else if (!res)
@@ -125,6 +657,17 @@ namespace seahorn
     // unwrap the core from ASM to corresponding expressions
     for (Expr c : core)
       out.push_back (bind::fname (bind::fname (c))->arg (0));
+    
+    // -- keep the engine incremental
+    restoreSolver ();
+  }
+  
+  int BmcEngine::edgeOf (Expr e) const
+  {
+    for (unsigned i = 0; i < m_side.size (); ++i)
+      if (m_side [i] == e)
+        return std::upper_bound (m_sideEnd.begin (), m_sideEnd.end (), i) - m_sideEnd.begin ();
+    return -1;
   }
   
   BmcTrace BmcEngine::getTrace ()
@@ -135,24 +678,31 @@ namespace seahorn
   }
   
   BmcTrace::BmcTrace (BmcEngine &bmc, ufo::ZModel<ufo::EZ3> &model) :
-    m_bmc (bmc), m_model(m_bmc.m_smt_solver.getContext ())
+    m_bmc (bmc), m_model(m_bmc.m_smt_solver.getContext ()),
+    m_evalMemo (bmc.m_states.size ()), m_built (false)
   {
     assert ((bool)bmc.result ());
     
     m_model = bmc.m_smt_solver.getModel ();
-    
+  }
+  
+  void BmcTrace::build ()
+  {
+    if (m_built) return;
+    m_built = true;
 
     // construct an implicant of the side condition
     ExprVector trace;
     trace.reserve (m_bmc.m_side.size ());
-    get_model_implicant (m_bmc.m_side, m_model, trace);
-    boost::container::flat_set<Expr> implicant (trace.begin (), trace.end ());
+    get_model_implicant (m_bmc.m_side, 
+                         [this] (Expr e) { return modelEval (e, false); }, trace);
+    ExprHashSet implicant (trace.begin (), trace.end ());
     
     
     // construct the trace
     
-    // -- reference to the first state
-    auto st = m_bmc.m_states.begin ();
+    // -- the first state
+    unsigned st = 0;
     // -- reference to the fist cutpoint in the trace
     unsigned id = 0;
     for (const CpEdge *edg : m_bmc.m_edges)
@@ -163,13 +713,13 @@ namespace seahorn
       assert (&(edg->source ()) == m_bmc.m_cps [id]);
       assert (&(edg->target ()) == m_bmc.m_cps [id+1]);
       
-      SymStore &s = *(++st);
+      ++st;
       for (auto it = edg->begin (), end = edg->end (); it != end; ++it)
       {
         const BasicBlock &BB = *it;
         
         if (it != edg->begin () && 
-            implicant.count (s.eval (m_bmc.m_sem.symb (BB))) <= 0) 
+            implicant.count (evalStore (st, m_bmc.m_sem.symb (BB))) <= 0) 
           continue;
         
         m_bbs.push_back (&BB);
@@ -197,6 +747,7 @@ namespace seahorn
   
   Expr BmcTrace::symb (unsigned loc, const llvm::Value &val)
   {
+    build ();
     // assert (cast<Instruction>(&val)->getParent () == bb(loc));
     
     if (!m_bmc.m_sem.isTracked (val)) return Expr ();
@@ -210,16 +761,20 @@ namespace seahorn
     // -- out of bounds, no value in the model
     if (stateidx >= m_bmc.m_states.size ()) return Expr ();
     
-    SymStore &store = m_bmc.m_states[stateidx];
-    return store.eval (u);
+    return evalStore (stateidx, u);
   }
   
   Expr BmcTrace::eval (unsigned loc,
                        const llvm::Value &val,
                        bool complete) 
   {
+    auto key = std::make_pair (loc, &val);
+    auto it = m_valMemo [complete].find (key);
+    if (it != m_valMemo [complete].end ()) return it->second;
+    
     Expr v = symb (loc, val);
-    if (v) v = m_model.eval (v, complete);
+    if (v) v = modelEval (v, complete);
+    m_valMemo [complete][key] = v;
     return v;
   }
   
@@ -227,15 +782,34 @@ namespace seahorn
                        Expr u, 
                        bool complete) 
   {
-    
+    build ();
     unsigned stateidx = cpid(loc);
     stateidx++;
     // -- out of bounds, no value in the model
     if (stateidx >= m_bmc.m_states.size ()) return Expr ();
     
-    SymStore &store = m_bmc.m_states[stateidx];
-    Expr v = store.eval (u);
-    return m_model.eval (v, complete);
+    Expr v = evalStore (stateidx, u);
+    return modelEval (v, complete);
+  }
+  
+  Expr BmcTrace::modelEval (Expr e, bool complete)
+  {
+    // -- values are memoized, so that clients can query the same
+    // -- registers and the implicant without going back to Z3
+    auto it = m_modelMemo [complete].find (e);
+    if (it != m_modelMemo [complete].end ()) return it->second;
+    Expr v = m_model.eval (m_bmc.expand (e), complete);
+    m_modelMemo [complete][e] = v;
+    return v;
+  }
+
+  Expr BmcTrace::evalStore (unsigned stateidx, Expr u)
+  {
+    // -- states do not change once the engine is encoded, so the
+    // -- results of evaluation are kept between calls
+    std::shared_ptr<DagVisitMemo> &memo = m_evalMemo [stateidx];
+    if (!memo) memo = std::make_shared<DagVisitMemo> (m_bmc.efac ());
+    return m_bmc.m_states [stateidx].eval (u, *memo);
   }
 
   
@@ -250,7 +824,8 @@ namespace seahorn
 
 
   static void get_model_implicant (const ExprVector &f, 
-                                   ufo::ZModel<ufo::EZ3> &model, ExprVector &out)
+                                   const std::function<Expr (Expr)> &model, 
+                                   ExprVector &out)
   {
     // XXX This is a partial implementation. Specialized to the
     // constraints expected to occur in m_side.
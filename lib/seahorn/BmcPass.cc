@@ -32,6 +32,41 @@ DM-0002198
 #include "seahorn/BvSymExec.hh"
 
 #include "seahorn/Analysis/CanFail.hh"
+#include "seahorn/FunctionAnalysisCache.hh"
+
+#include "llvm/Support/CommandLine.h"
+
+#include "boost/range.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+static llvm::cl::opt<unsigned>
+BmcPaths ("horn-bmc-paths",
+          llvm::cl::desc ("Enumerate the cutpoint paths of main with at most this many "
+                          "edges instead of checking the entry-to-return edge (0 = off)"),
+          llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+BmcThreads ("horn-bmc-threads",
+            llvm::cl::desc ("Number of BMC engines checking paths of --horn-bmc-paths, "
+                            "or solvers checking cubes of --horn-bmc-cubes"),
+            llvm::cl::init (1));
+
+static llvm::cl::opt<unsigned>
+BmcCubes ("horn-bmc-cubes",
+          llvm::cl::desc ("Split the BMC query into 2^k cubes over the edge variables "
+                          "of the path and solve them concurrently (0 = off)"),
+          llvm::cl::init (0));
+
+static llvm::cl::opt<bool>
+BmcAig ("horn-bmc-aig",
+        llvm::cl::desc ("Solve the BMC query at the bit level, over an AIG"),
+        llvm::cl::init (false));
 
 namespace
 {
@@ -39,6 +74,195 @@ namespace
   using namespace seahorn;
   using namespace ufo;
   
+  typedef std::vector<const CutPoint*> CpPath;
+  
+  /// Enumerates the cutpoint paths from src breadth-first and checks
+  /// them with a pool of incremental BMC engines. Every path is
+  /// checked as soon as it is dequeued, extending the prefix that
+  /// its engine has encoded last. The edges of the unsat core of an
+  /// infeasible path form a segment, and paths that contain a
+  /// blocked segment are not explored
+  class PathBmc
+  {
+    const CutPoint &m_src;
+    const CutPoint &m_dst;
+    unsigned m_bound;
+    
+    /// protects everything below
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::deque<CpPath> m_queue;
+    /// number of workers expanding a path
+    unsigned m_busy;
+    bool m_found;
+    CpPath m_cex;
+    /// true if a path was cut by the bound or could not be decided
+    bool m_incomplete;
+    /// infeasible segments, as sequences of cutpoint ids
+    std::set<std::vector<unsigned> > m_blocked;
+    unsigned m_checked;
+    unsigned m_pruned;
+    
+    bool next (CpPath &path)
+    {
+      std::unique_lock<std::mutex> l (m_lock);
+      while (true)
+      {
+        if (m_found) return false;
+        while (!m_queue.empty ())
+        {
+          path = std::move (m_queue.front ());
+          m_queue.pop_front ();
+          // -- segments may have been blocked since path was queued
+          if (isBlocked (path)) { ++m_pruned; continue; }
+          ++m_busy;
+          return true;
+        }
+        if (m_busy == 0) return false;
+        m_cv.wait (l);
+      }
+    }
+    
+    /// true if a suffix of path is blocked. Requires m_lock
+    bool isBlocked (const CpPath &path) const
+    {
+      std::vector<unsigned> seg;
+      for (unsigned i = path.size (); i-- > 0;)
+      {
+        seg.insert (seg.begin (), path [i]->id ());
+        if (seg.size () > 1 && m_blocked.count (seg) > 0) return true;
+      }
+      return false;
+    }
+    
+    void done (std::vector<CpPath> &children, bool incomplete)
+    {
+      std::lock_guard<std::mutex> l (m_lock);
+      m_incomplete = m_incomplete || incomplete;
+      for (CpPath &c : children)
+      {
+        if (isBlocked (c)) ++m_pruned;
+        else m_queue.push_back (std::move (c));
+      }
+      --m_busy;
+      m_cv.notify_all ();
+    }
+    
+    void found (const CpPath &path)
+    {
+      std::lock_guard<std::mutex> l (m_lock);
+      if (!m_found) m_cex = path;
+      m_found = true;
+      --m_busy;
+      m_cv.notify_all ();
+    }
+    
+    /// blocks the segment of path formed by the edges of core
+    void block (BmcEngine &bmc, const CpPath &path, const ExprVector &core)
+    {
+      int first = path.size (), last = -1;
+      for (Expr c : core)
+      {
+        int e = bmc.edgeOf (c);
+        if (e < 0) continue;
+        first = std::min (first, e);
+        last = std::max (last, e);
+      }
+      // -- no core, the whole path is infeasible
+      if (last < 0) { first = 0; last = path.size () - 2; }
+      
+      std::vector<unsigned> seg;
+      for (int i = first; i <= last + 1; ++i) seg.push_back (path [i]->id ());
+      std::lock_guard<std::mutex> l (m_lock);
+      m_blocked.insert (seg);
+    }
+    
+    void worker (SmallStepSymExec &sem, EZ3 &zctx)
+    {
+      BmcEngine bmc (sem, zctx);
+      // -- the engine has a frame before every cutpoint but the first
+      CpPath loaded;
+      CpPath path;
+      while (next (path))
+      {
+        if (loaded.empty ())
+        {
+          bmc.addCutPoint (*path [0]);
+          loaded.push_back (path [0]);
+        }
+        unsigned common = 1;
+        while (common < loaded.size () && common < path.size () &&
+               loaded [common] == path [common]) ++common;
+        while (bmc.numFrames () + 1 > common) bmc.pop ();
+        for (unsigned i = common; i < path.size (); ++i)
+        {
+          bmc.push ();
+          bmc.addCutPoint (*path [i]);
+        }
+        loaded = path;
+        
+        boost::tribool res = bmc.solve ();
+        {
+          std::lock_guard<std::mutex> l (m_lock);
+          ++m_checked;
+        }
+        if (!res)
+        {
+          ExprVector core;
+          bmc.unsatCore (core);
+          block (bmc, path, core);
+          std::vector<CpPath> none;
+          done (none, false);
+          continue;
+        }
+        if (res && path.back () == &m_dst)
+        {
+          found (path);
+          break;
+        }
+        
+        // -- unknown paths are extended as if they were feasible
+        std::vector<CpPath> children;
+        const CutPoint &last = *path.back ();
+        bool bounded = path.size () > m_bound && last.succ_begin () != last.succ_end ();
+        if (!bounded)
+          for (const CpEdge *edg : boost::make_iterator_range (last.succ_begin (), last.succ_end ()))
+          {
+            children.push_back (path);
+            children.back ().push_back (&edg->target ());
+          }
+        done (children, bounded || boost::indeterminate (res));
+      }
+    }
+    
+  public:
+    PathBmc (const CutPoint &src, const CutPoint &dst, unsigned bound) :
+      m_src (src), m_dst (dst), m_bound (bound), m_busy (0),
+      m_found (false), m_incomplete (false), m_checked (0), m_pruned (0) {}
+    
+    /// true if a path from src to dst is feasible. It is then in cex.
+    /// Indeterminate if no path is feasible but some were cut by the
+    /// bound or undecided
+    boost::tribool run (std::vector<std::unique_ptr<SmallStepSymExec> > &sems,
+                        std::vector<std::unique_ptr<EZ3> > &zctxs, CpPath &cex)
+    {
+      m_queue.push_back (CpPath (1, &m_src));
+      std::vector<std::thread> pool;
+      for (unsigned t = 1; t < sems.size (); ++t)
+        pool.emplace_back ([this, &sems, &zctxs, t] () { worker (*sems [t], *zctxs [t]); });
+      worker (*sems [0], *zctxs [0]);
+      for (std::thread &t : pool) t.join ();
+      
+      Stats::uset ("BmcPathsChecked", m_checked);
+      Stats::uset ("BmcPathsPruned", m_pruned);
+      Stats::uset ("BmcBlockedSegments", m_blocked.size ());
+      
+      if (m_found) { cex = m_cex; return true; }
+      if (m_incomplete) return boost::indeterminate;
+      return false;
+    }
+  };
+  
   class BmcPass : public llvm::ModulePass
   {
     /// output stream for encoded bmc problem
@@ -66,13 +290,13 @@ namespace
       AU.addRequired<seahorn::CanFail> ();
       AU.addRequired<ufo::NameValues>();
       AU.addRequired<seahorn::TopologicalOrder>();
-      AU.addRequired<CutPointGraph> ();
+      AU.addRequired<FunctionAnalysisCache> ();
     }      
 
     virtual bool runOnFunction (Function &F)
     {
       
-      const CutPointGraph &cpg = getAnalysis<CutPointGraph> (F);
+      const CutPointGraph &cpg = getAnalysis<FunctionAnalysisCache> ().cpg (F);
       const CutPoint &src = cpg.getCp (F.getEntryBlock ());
       const CutPoint *dst = nullptr;
       
@@ -85,19 +309,51 @@ namespace
         }
 
       if (dst == nullptr) return false;
-      if (!cpg.getEdge (src, *dst)) return false;
+      if (!BmcPaths && !cpg.getEdge (src, *dst)) return false;
 
       
-      ExprFactory efac;
+      ExprFactory efac ((BmcPaths || BmcCubes) && BmcThreads > 1);
       BvSmallSymExec sem (efac, *this, MEM);
       
       EZ3 zctx (efac);
+      
+      CpPath path;
+      path.push_back (&src);
+      path.push_back (dst);
+      if (BmcPaths)
+      {
+        // -- engines of the workers. The first one is the main one
+        std::vector<std::unique_ptr<SmallStepSymExec> > sems;
+        std::vector<std::unique_ptr<EZ3> > zctxs;
+        for (unsigned t = 0; t < std::max (1u, (unsigned) BmcThreads); ++t)
+        {
+          sems.emplace_back (new BvSmallSymExec (efac, *this, MEM));
+          sems.back ()->shareEncoding (sem);
+          zctxs.emplace_back (new EZ3 (efac));
+        }
+        
+        Stats::resume ("BMC");
+        PathBmc driver (src, *dst, BmcPaths);
+        boost::tribool res = driver.run (sems, zctxs, path);
+        Stats::stop ("BMC");
+        
+        // -- no feasible path. Otherwise it is replayed below
+        if (!res || boost::indeterminate (res))
+        {
+          if (!res) outs () << "unsat";
+          else outs () << "unknown";
+          outs () << "\n";
+          if (!res) Stats::sset ("Result", "TRUE");
+          return false;
+        }
+      }
+      
       BmcEngine bmc (sem, zctx);
       
-      bmc.addCutPoint (src);
-      bmc.addCutPoint (*dst);
+      for (const CutPoint *cp : path) bmc.addCutPoint (*cp);
       LOG("bmc", errs () << "BMC from: " << src.bb ().getName ()
-          << " to " << dst->bb ().getName () << "\n";);
+          << " to " << dst->bb ().getName () << " over "
+          << path.size () << " cutpoints\n";);
       
       bmc.encode ();
       if (m_out) bmc.toSmtLib (*m_out);
@@ -105,7 +361,8 @@ namespace
       if (!m_solve) return false;
       
       Stats::resume ("BMC");
-      auto res = bmc.solve ();
+      auto res = BmcAig ? bmc.solveAig () :
+        BmcCubes ? bmc.solveCubes (BmcCubes, BmcThreads) : bmc.solve ();
       Stats::stop ("BMC");
      
       if (res) outs () << "sat";
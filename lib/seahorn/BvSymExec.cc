@@ -8,6 +8,8 @@
 #include "ufo/ufo_iterators.hpp"
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+
 //#include <queue>
 
 using namespace seahorn;
@@ -56,13 +58,10 @@ PartMem ("horn-bv-part-mem",
           cl::init (false),
           cl::Hidden);
 
-static const Value *extractUniqueScalar (CallSite &cs)
-{
-   if (!EnableUniqueScalars) 
-     return nullptr;
-   else
-     return seahorn::shadow_dsa::extractUniqueScalar (cs);
-}
+static llvm::cl::opt<bool>
+SimplifyBv ("horn-bv-simplify",
+            llvm::cl::desc ("Rewrite bit-vector terms at the word level while encoding"),
+            cl::init (false));
 
 static const Value* extractUniqueScalar (const CallInst *ci)
 {
@@ -299,13 +298,13 @@ namespace
       switch (I.getOpcode ())
       {
       case BinaryOperator::Add:
-        rhs = mk<BADD> (op0, op1);
+        rhs = m_sem.rw ().add (op0, op1);
         break;
       case BinaryOperator::Sub:
-        rhs = mk<BSUB> (op0, op1);
+        rhs = m_sem.rw ().sub (op0, op1);
         break;
       case BinaryOperator::Mul:
-        rhs = mk<BMUL> (op0, op1);
+        rhs = m_sem.rw ().mul (op0, op1);
         break;
       case BinaryOperator::UDiv:
         rhs = mk<BUDIV> (op0, op1);
@@ -314,10 +313,10 @@ namespace
         rhs = mk<BSDIV> (op0, op1);
         break;
       case BinaryOperator::Shl:
-        rhs = mk<BSHL> (op0, op1);
+        rhs = m_sem.rw ().shl (op0, op1);
         break;
       case BinaryOperator::AShr:
-        rhs = mk<BASHR> (op0, op1);
+        rhs = m_sem.rw ().ashr (op0, op1);
         break;
       case BinaryOperator::SRem:
         rhs = mk<BSREM> (op0, op1);
@@ -327,24 +326,24 @@ namespace
         break;
       case BinaryOperator::And:
         if (v0.getType ()->isIntegerTy (1) && v1.getType ()->isIntegerTy (1))
-          rhs = mk<AND> (op0, op1);
+          rhs = canon::mk<AND> (op0, op1);
         else
-          rhs = mk<BAND> (op0, op1);
+          rhs = m_sem.rw ().band (op0, op1);
         break;
       case BinaryOperator::Or:
         if (v0.getType ()->isIntegerTy (1) && v1.getType ()->isIntegerTy (1))
-          rhs = mk<OR> (op0, op1);
+          rhs = canon::mk<OR> (op0, op1);
         else
-          rhs = mk<BOR> (op0, op1);
+          rhs = m_sem.rw ().bor (op0, op1);
         break;
       case BinaryOperator::Xor:
         if (v0.getType ()->isIntegerTy (1) && v1.getType ()->isIntegerTy (1))
           rhs = mk<XOR> (op0, op1);
         else
-          rhs = mk<BXOR> (op0, op1);
+          rhs = m_sem.rw ().bxor (op0, op1);
         break;
       case BinaryOperator::LShr:
-        rhs = mk<BLSHR> (op0, op1);
+        rhs = m_sem.rw ().lshr (op0, op1);
         break;
       default:
         break;
@@ -377,7 +376,7 @@ namespace
       if (!op0) return;
       
       uint64_t width = m_sem.sizeInBits (I);
-      Expr rhs = bv::extract (width-1, 0, op0);
+      Expr rhs = m_sem.rw ().extract (width-1, 0, op0);
       
       if (I.getType ()->isIntegerTy (1)) rhs = bvToBool (rhs);
 
@@ -395,7 +394,7 @@ namespace
       if (I.getOperand (0)->getType ()->isIntegerTy (1))
         op0 = boolToBv (op0);
       
-      Expr rhs = bv::zext (op0, m_sem.sizeInBits (I));
+      Expr rhs = m_sem.rw ().zext (op0, m_sem.sizeInBits (I));
       if (UseWrite) write (I, rhs);
       else side (lhs, rhs);
     }
@@ -409,7 +408,7 @@ namespace
       if (I.getOperand (0)->getType ()->isIntegerTy (1))
         op0 = boolToBv (op0);
       
-      Expr rhs = bv::sext (op0, m_sem.sizeInBits (I));
+      Expr rhs = m_sem.rw ().sext (op0, m_sem.sizeInBits (I));
       if (UseWrite) write (I, rhs);
       else side (lhs, rhs);
     }
@@ -427,8 +426,8 @@ namespace
       Expr rhs;
 
       if (dsz == ssz) rhs = op0;
-      else if (dsz > ssz) rhs = bv::zext (op0, dsz);
-      else rhs = bv::extract (dsz-1, 0, op0);
+      else if (dsz > ssz) rhs = m_sem.rw ().zext (op0, dsz);
+      else rhs = m_sem.rw ().extract (dsz-1, 0, op0);
       
       if (UseWrite) write (I, rhs);
       else side (lhs, rhs);
@@ -447,8 +446,8 @@ namespace
       Expr rhs;
 
       if (dsz == ssz) rhs = op0;
-      else if (dsz > ssz) rhs = bv::zext (op0, dsz);
-      else rhs = bv::extract (dsz-1, 0, op0);
+      else if (dsz > ssz) rhs = m_sem.rw ().zext (op0, dsz);
+      else rhs = m_sem.rw ().extract (dsz-1, 0, op0);
       
       if (UseWrite) write (I, rhs);
       else side (lhs, rhs);
@@ -464,14 +463,24 @@ namespace
       Expr base = lookup (*ptrOp);
       if (!base) return;
 
-      SmallVector<Value*, 8> Indicies (gep.op_begin () + 1, gep.op_end ());
-      Expr off = m_sem.symbolicIndexedOffset (m_s, ptrOp->getType (), Indicies);
-      if (!off) return;
+      // -- the address only depends on the base and the indices
+      // -- that are not constant
+      ExprVector ops (1, base);
+      for (auto &t : m_sem.encoding ().inst (gep).terms)
+        ops.push_back (lookup (*t.first));
+      Expr rhs = m_sem.cachedValue (gep, ops);
+      if (!rhs)
+      {
+        Expr off = m_sem.symbolicIndexedOffset (m_s, gep);
+        if (!off) return;
+        rhs = m_sem.rw ().add (base, off);
+        m_sem.cacheValue (gep, ops, rhs);
+      }
       
       if (UseWrite)
-        write (gep, mk<BADD> (base, off));
+        write (gep, rhs);
       else
-        side (lhs, mk<BADD> (base, off));
+        side (lhs, rhs);
       
       if (InferMemSafety)
       {
@@ -591,14 +600,16 @@ namespace
         m_fparams.push_back (falseE);
         m_fparams.push_back (falseE);
       }
-      else if (F.getName ().startswith ("shadow.mem") && 
-               m_sem.isTracked (I))
+      else if (m_sem.encoding ().inst (I).isShadow () && m_sem.isTracked (I))
       {
-        if (F.getName ().equals ("shadow.mem.init"))
+        const EncInst &enc = m_sem.encoding ().inst (I);
+        switch (enc.kind)
+        {
+        case EncInst::SHADOW_INIT:
         {
           m_s.havoc (symb(I));
-          unsigned id = shadow_dsa::getShadowId (CS);
-          assert (id >= 0);
+          assert (enc.region >= 0);
+          unsigned id = enc.region;
           
           // -- add constraints only if asked
           if (PartMem)
@@ -619,55 +630,47 @@ namespace
             m_startMem= memStart (id);
             m_endMem = memEnd (id);
           }
-          
+          break;
         }
-        else if (F.getName ().equals ("shadow.mem.load"))
-        {
-          const Value &v = *CS.getArgument (1);
-          m_inMem = m_s.read (symb (v));
-          m_uniq = extractUniqueScalar (CS) != nullptr;
+        case EncInst::SHADOW_LOAD:
+          m_inMem = m_s.read (symb (*CS.getArgument (1)));
+          m_uniq = EnableUniqueScalars && enc.scalar;
           if (PartMem)
           {
-            m_startMem = memStart (shadow_dsa::getShadowId (CS));
-            m_endMem = memEnd (shadow_dsa::getShadowId (CS));
+            m_startMem = memStart (enc.region);
+            m_endMem = memEnd (enc.region);
           }
-        }
-        else if (F.getName ().equals ("shadow.mem.store"))
-        {
+          break;
+        case EncInst::SHADOW_STORE:
           m_inMem = m_s.read (symb (*CS.getArgument (1)));
           m_outMem = m_s.havoc (symb (I));
-          m_uniq = extractUniqueScalar (CS) != nullptr;
+          m_uniq = EnableUniqueScalars && enc.scalar;
           if (PartMem)
           {
-            m_startMem = memStart (shadow_dsa::getShadowId (CS));
-            m_endMem = memEnd (shadow_dsa::getShadowId (CS));
+            m_startMem = memStart (enc.region);
+            m_endMem = memEnd (enc.region);
           }
-        }
-        else if (F.getName ().equals ("shadow.mem.arg.ref"))
+          break;
+        case EncInst::SHADOW_ARG_REF:
           m_fparams.push_back (m_s.read (symb (*CS.getArgument (1))));
-        else if (F.getName ().equals ("shadow.mem.arg.mod"))
-        {
+          break;
+        case EncInst::SHADOW_ARG_MOD:
           m_fparams.push_back (m_s.read (symb (*CS.getArgument (1))));
           m_fparams.push_back (m_s.havoc (symb (I)));
-        }
-        else if (F.getName ().equals ("shadow.mem.arg.new"))
+          break;
+        case EncInst::SHADOW_ARG_NEW:
           m_fparams.push_back (m_s.havoc (symb (I)));
-        else if (!PF.getName ().equals ("main") && 
-                 F.getName ().equals ("shadow.mem.in"))
-        {
-          m_s.read (symb (*CS.getArgument (1)));
-        }
-        else if (!PF.getName ().equals ("main") &&
-                 F.getName ().equals ("shadow.mem.out"))
-        {
-          m_s.read (symb (*CS.getArgument (1)));
-        }
-        else if (!PF.getName ().equals ("main") && 
-                 F.getName ().equals ("shadow.mem.arg.init"))
-        {
+          break;
+        case EncInst::SHADOW_IN:
+        case EncInst::SHADOW_OUT:
+          if (!PF.getName ().equals ("main"))
+            m_s.read (symb (*CS.getArgument (1)));
+          break;
+        default:
           // regions initialized in main are global. We want them to
-          // flow to the arguments
-          /* do nothing */
+          // flow to the arguments. Nothing to do for
+          // shadow.mem.arg.init
+          break;
         }
       }
       else
@@ -882,6 +885,341 @@ namespace
 
 namespace seahorn
 {
+  Expr BvSmallSymExec::cachedValue (const Instruction &I, const ExprVector &ops)
+  {
+    if (std::find (ops.begin (), ops.end (), Expr ()) != ops.end ()) return Expr ();
+    auto it = m_instCache.find (&I);
+    if (it == m_instCache.end () || it->second.first != ops) return Expr ();
+    return it->second.second;
+  }
+  
+  void BvSmallSymExec::cacheValue (const Instruction &I, const ExprVector &ops, Expr v)
+  {
+    if (std::find (ops.begin (), ops.end (), Expr ()) != ops.end ()) return;
+    m_instCache [&I] = std::make_pair (ops, v);
+  }
+  
+  unsigned BvRewriter::width (Expr e)
+  {
+    if (bv::is_bvnum (e)) return bv::width (e->arg (1));
+    if (bind::isFapp (e))
+    {
+      Expr ty = bind::rangeTy (bind::fname (e));
+      return isOpX<BVSORT> (ty) ? bv::width (ty) : 0;
+    }
+    if (isOpX<BEXTRACT> (e)) return bv::high (e) - bv::low (e) + 1;
+    if (isOpX<BZEXT> (e) || isOpX<BSEXT> (e)) return bv::width (e->arg (1));
+    if (isOpX<BCONCAT> (e))
+    {
+      unsigned hi = width (e->arg (0)), lo = width (e->arg (1));
+      return hi && lo ? hi + lo : 0;
+    }
+    if (isOpX<ITE> (e)) return width (e->arg (1));
+    if (isOpX<BADD> (e) || isOpX<BSUB> (e) || isOpX<BMUL> (e) || 
+        isOpX<BAND> (e) || isOpX<BOR> (e) || isOpX<BXOR> (e) ||
+        isOpX<BSHL> (e) || isOpX<BLSHR> (e) || isOpX<BASHR> (e) ||
+        isOpX<BNOT> (e) || isOpX<BNEG> (e))
+      return width (e->arg (0));
+    return 0;
+  }
+  
+  bool BvRewriter::isNum (Expr e, mpz_class &n)
+  {
+    if (!bv::is_bvnum (e)) return false;
+    uint64_t k;
+    if (isNum64 (e, k))
+    {
+      n = bv::uint64ToMpz (k);
+      return true;
+    }
+    mpz_class m = 1;
+    m <<= bv::width (e->arg (1));
+    // -- numerals of negative constants are signed
+    n = bv::toMpz (e) % m;
+    if (n < 0) n += m;
+    return true;
+  }
+  
+  Expr BvRewriter::num (mpz_class n, unsigned w)
+  {
+    if (w <= 64 && sizeof (long) >= sizeof (int64_t) && n.fits_slong_p ())
+      return num64 (static_cast<uint64_t> (n.get_si ()), w);
+    mpz_class m = 1;
+    m <<= w;
+    n %= m;
+    if (n < 0) n += m;
+    return bv::bvnum (n, w, m_efac);
+  }
+  
+  Expr BvRewriter::extract (unsigned high, unsigned low, Expr v)
+  {
+    // -- bv::extract () does not take single bits
+    Expr plain = mk<BEXTRACT> (mkTerm<unsigned> (high, m_efac),
+                               mkTerm<unsigned> (low, m_efac), v);
+    if (!SimplifyBv) return plain;
+    
+    unsigned w = width (v);
+    mpz_class n;
+    uint64_t p;
+    if (low == 0 && w == high + 1) return v;
+    if (low < 64 && isNum64 (v, p)) return num64 (p >> low, high - low + 1);
+    if (isNum (v, n)) return num (n >> low, high - low + 1);
+    if (isOpX<BEXTRACT> (v))
+      return extract (high + bv::low (v), low + bv::low (v), bv::earg (v));
+    if (isOpX<BZEXT> (v))
+    {
+      Expr u = v->arg (0);
+      unsigned wu = width (u);
+      if (wu && high < wu) return extract (high, low, u);
+      if (wu && low >= wu) return num (0, high - low + 1);
+    }
+    if (isOpX<BCONCAT> (v))
+    {
+      unsigned wlo = width (v->arg (1));
+      if (wlo && high < wlo) return extract (high, low, v->arg (1));
+      if (wlo && low >= wlo) return extract (high - wlo, low - wlo, v->arg (0));
+    }
+    return plain;
+  }
+  
+  Expr BvRewriter::concat (Expr hi, Expr lo)
+  {
+    if (!SimplifyBv) return mk<BCONCAT> (hi, lo);
+    
+    unsigned whi = width (hi), wlo = width (lo);
+    uint64_t p, q;
+    if (whi + wlo <= 64 && isNum64 (hi, p) && isNum64 (lo, q))
+      return num64 ((p << wlo) | q, whi + wlo);
+    mpz_class a, b;
+    bool ka = isNum (hi, a), kb = isNum (lo, b);
+    if (ka && kb) return num ((a << wlo) + b, whi + wlo);
+    // -- concat of zero is a zero extension
+    if (ka && a == 0 && wlo) return zext (lo, whi + wlo);
+    // -- adjacent extracts of the same term
+    if (isOpX<BEXTRACT> (hi) && isOpX<BEXTRACT> (lo) && 
+        bv::earg (hi) == bv::earg (lo) && bv::low (hi) == bv::high (lo) + 1)
+      return extract (bv::high (hi), bv::low (lo), bv::earg (hi));
+    return mk<BCONCAT> (hi, lo);
+  }
+  
+  Expr BvRewriter::zext (Expr v, unsigned w)
+  {
+    if (!SimplifyBv) return bv::zext (v, w);
+    
+    unsigned wv = width (v);
+    mpz_class n;
+    uint64_t p;
+    if (wv == w) return v;
+    if (w <= 64 && isNum64 (v, p)) return num64 (p, w);
+    if (isNum (v, n) && wv) return num (n, w);
+    if (isOpX<BZEXT> (v)) return zext (v->arg (0), w);
+    return bv::zext (v, w);
+  }
+  
+  Expr BvRewriter::sext (Expr v, unsigned w)
+  {
+    if (!SimplifyBv) return bv::sext (v, w);
+    
+    unsigned wv = width (v);
+    mpz_class n;
+    uint64_t p;
+    if (wv == w) return v;
+    if (w <= 64 && isNum64 (v, p))
+      return num64 (static_cast<uint64_t> (bv::sext64 (p, wv)), w);
+    if (wv && isNum (v, n))
+    {
+      mpz_class m = 1;
+      m <<= wv - 1;
+      // -- sign bit set
+      if (n >= m) n -= m * 2;
+      return num (n, w);
+    }
+    return bv::sext (v, w);
+  }
+  
+  Expr BvRewriter::add (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BADD> (a, b);
+    
+    unsigned w = width (a);
+    if (!w) w = width (b);
+    uint64_t p, q;
+    if (w && w <= 64 && isNum64 (a, p) && isNum64 (b, q)) return num64 (p + q, w);
+    mpz_class x, y;
+    bool ka = isNum (a, x), kb = isNum (b, y);
+    if (ka && kb && w) return num (x + y, w);
+    
+    // -- numerals last: base + symbolic + numeral
+    if (ka) { std::swap (a, b); std::swap (x, y); std::swap (ka, kb); }
+    if (kb && y == 0) return a;
+    if (kb && isOpX<BADD> (a) && w)
+    {
+      mpz_class z;
+      if (isNum (a->arg (1), z)) return add (a->arg (0), num (z + y, w));
+    }
+    // -- a + (s + n) == (a + s) + n
+    if (!kb && isOpX<BADD> (b) && w)
+    {
+      mpz_class z;
+      if (isNum (b->arg (1), z)) return add (add (a, b->arg (0)), b->arg (1));
+    }
+    return mk<BADD> (a, b);
+  }
+  
+  Expr BvRewriter::sub (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BSUB> (a, b);
+    
+    unsigned w = width (a);
+    if (!w) w = width (b);
+    uint64_t p, q;
+    if (w && w <= 64 && isNum64 (a, p) && isNum64 (b, q)) return num64 (p - q, w);
+    mpz_class x, y;
+    bool kb = isNum (b, y);
+    if (isNum (a, x) && kb && w) return num (x - y, w);
+    if (kb && w) return add (a, num (-y, w));
+    if (a == b && w) return num (0, w);
+    return mk<BSUB> (a, b);
+  }
+  
+  Expr BvRewriter::mul (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BMUL> (a, b);
+    
+    unsigned w = width (a);
+    if (!w) w = width (b);
+    uint64_t p, q;
+    if (w && w <= 64 && isNum64 (a, p) && isNum64 (b, q)) return num64 (p * q, w);
+    mpz_class x, y;
+    bool ka = isNum (a, x), kb = isNum (b, y);
+    if (ka && kb && w) return num (x * y, w);
+    if (ka) { std::swap (a, b); std::swap (y, x); kb = true; ka = false; }
+    if (kb && y == 1) return a;
+    if (kb && y == 0 && w) return num (0, w);
+    return mk<BMUL> (a, b);
+  }
+  
+  Expr BvRewriter::band (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BAND> (a, b);
+    
+    unsigned w = width (a);
+    if (!w) w = width (b);
+    uint64_t p, q;
+    if (w && w <= 64 && isNum64 (a, p) && isNum64 (b, q)) return num64 (p & q, w);
+    mpz_class x, y;
+    bool ka = isNum (a, x), kb = isNum (b, y);
+    if (ka && kb && w)
+    {
+      mpz_class r;
+      mpz_and (r.get_mpz_t (), x.get_mpz_t (), y.get_mpz_t ());
+      return num (r, w);
+    }
+    if (ka) { std::swap (a, b); std::swap (y, x); kb = true; }
+    if (kb && w)
+    {
+      if (y == 0) return b;
+      // -- a mask of the k low bits keeps the low bits
+      mpz_class low = y + 1;
+      if ((low & y) == 0)
+      {
+        unsigned k = mpz_sizeinbase (y.get_mpz_t (), 2);
+        if (k >= w) return a;
+        return zext (extract (k - 1, 0, a), w);
+      }
+    }
+    if (a == b) return a;
+    return mk<BAND> (a, b);
+  }
+  
+  Expr BvRewriter::bor (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BOR> (a, b);
+    
+    unsigned w = width (a);
+    if (!w) w = width (b);
+    uint64_t p, q;
+    if (w && w <= 64 && isNum64 (a, p) && isNum64 (b, q)) return num64 (p | q, w);
+    mpz_class x, y;
+    bool ka = isNum (a, x), kb = isNum (b, y);
+    if (ka && kb && w)
+    {
+      mpz_class r;
+      mpz_ior (r.get_mpz_t (), x.get_mpz_t (), y.get_mpz_t ());
+      return num (r, w);
+    }
+    if (ka && x == 0) return b;
+    if (kb && y == 0) return a;
+    if (a == b) return a;
+    return mk<BOR> (a, b);
+  }
+  
+  Expr BvRewriter::bxor (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BXOR> (a, b);
+    
+    unsigned w = width (a);
+    if (!w) w = width (b);
+    uint64_t p, q;
+    if (w && w <= 64 && isNum64 (a, p) && isNum64 (b, q)) return num64 (p ^ q, w);
+    mpz_class x, y;
+    bool ka = isNum (a, x), kb = isNum (b, y);
+    if (ka && kb && w)
+    {
+      mpz_class r;
+      mpz_xor (r.get_mpz_t (), x.get_mpz_t (), y.get_mpz_t ());
+      return num (r, w);
+    }
+    if (ka && x == 0) return b;
+    if (kb && y == 0) return a;
+    if (a == b && w) return num (0, w);
+    return mk<BXOR> (a, b);
+  }
+  
+  Expr BvRewriter::shl (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BSHL> (a, b);
+    
+    unsigned w = width (a);
+    mpz_class x, c;
+    if (!w || !isNum (b, c)) return mk<BSHL> (a, b);
+    if (c >= w) return num (0, w);
+    unsigned k = c.get_ui ();
+    uint64_t p;
+    if (k == 0) return a;
+    if (w <= 64 && isNum64 (a, p)) return num64 (p << k, w);
+    if (isNum (a, x)) return num (x << k, w);
+    return concat (extract (w - 1 - k, 0, a), num (0, k));
+  }
+  
+  Expr BvRewriter::lshr (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BLSHR> (a, b);
+    
+    unsigned w = width (a);
+    mpz_class x, c;
+    if (!w || !isNum (b, c)) return mk<BLSHR> (a, b);
+    if (c >= w) return num (0, w);
+    unsigned k = c.get_ui ();
+    uint64_t p;
+    if (k == 0) return a;
+    if (w <= 64 && isNum64 (a, p)) return num64 (p >> k, w);
+    if (isNum (a, x)) return num (x >> k, w);
+    return zext (extract (w - 1, k, a), w);
+  }
+  
+  Expr BvRewriter::ashr (Expr a, Expr b)
+  {
+    if (!SimplifyBv) return mk<BASHR> (a, b);
+    
+    unsigned w = width (a);
+    mpz_class c;
+    if (!w || !isNum (b, c) || c >= w) return mk<BASHR> (a, b);
+    unsigned k = c.get_ui ();
+    if (k == 0) return a;
+    return sext (extract (w - 1, k, a), w);
+  }
+  
   Expr BvSmallSymExec::errorFlag (const BasicBlock &BB)
   {
     // -- if BB belongs to a function that cannot fail, errorFlag is always false
@@ -929,62 +1267,26 @@ namespace seahorn
   }
 
   Expr BvSmallSymExec::symbolicIndexedOffset (SymStore &s,
-                                              Type *ptrTy,
-                                              ArrayRef<Value *> Indicies) 
+                                              const GetElementPtrInst &gep)
   {
     unsigned ptrSz = pointerSizeInBits ();
-    Type *Ty = ptrTy;
-    assert (Ty->isPointerTy ());
+    const EncInst &enc = m_ir->inst (gep);
     
-    // numeric offset
-    uint64_t noffset = 0;
     // symbolic offset
     Expr soffset;
-
-    generic_gep_type_iterator<Value* const*>
-      TI = gep_type_begin (ptrTy, Indicies);
-    for (unsigned CurIDX = 0, EndIDX = Indicies.size (); CurIDX != EndIDX;
-         ++CurIDX, ++TI)
-    {
-      if (StructType *STy = dyn_cast<StructType> (*TI))
-      {
-        unsigned fieldNo = cast<ConstantInt> (Indicies [CurIDX])->getZExtValue ();
-        noffset += fieldOff (STy, fieldNo);
-        Ty = STy->getElementType (fieldNo);
-      }
-      else
-      {
-        Ty = cast<SequentialType> (Ty)->getElementType ();
-        if (ConstantInt *ci = dyn_cast<ConstantInt> (Indicies [CurIDX]))
-        {
-          int64_t arrayIdx = ci->getSExtValue ();
-          noffset += (uint64_t)arrayIdx * storageSize (Ty);
-        }
-        else
-        {
-          Expr a = lookup (s, *Indicies [CurIDX]);
-          assert (a);
-          a =  mk<BMUL> (a, bv::bvnum (storageSize (Ty), ptrSz, m_efac));
-          if (soffset) soffset = mk<BADD> (soffset, a);
-          else soffset = a;
-        }
-      }
-      
-    }
-    
-    Expr res;
-    if (noffset > 0)
-      res = bv::bvnum (/* cast to make clang on osx happy */
-                       (unsigned long int)noffset, ptrSz, m_efac);
-    if (soffset) res = res ? mk<BADD> (soffset, res) : soffset;
-
-    if (!res)
+    for (auto &t : enc.terms)
     {
-      assert (noffset == 0);
-      assert (!soffset);
-      res = bv::bvnum ((unsigned long int)noffset, ptrSz, m_efac);
+      Expr a = lookup (s, *t.first);
+      assert (a);
+      a = m_rw.mul (a, bv::bvnum ((unsigned long int)t.second, ptrSz, m_efac));
+      if (soffset) soffset = m_rw.add (soffset, a);
+      else soffset = a;
     }
     
+    // numeric offset
+    Expr res = bv::bvnum (/* cast to make clang on osx happy */
+                          (unsigned long int)(uint64_t)enc.offset, ptrSz, m_efac);
+    if (soffset) res = enc.offset != 0 ? m_rw.add (soffset, res) : soffset;
     return res;
   }
   
@@ -997,17 +1299,17 @@ namespace seahorn
   uint64_t BvSmallSymExec::sizeInBits (const llvm::Value &v) const
   {return sizeInBits (*v.getType ());}
   
-  
-  unsigned BvSmallSymExec::storageSize (const llvm::Type *t) const
-  {return m_td->getTypeStoreSize (const_cast<Type*> (t));}
-  
-  unsigned BvSmallSymExec::fieldOff (const StructType *t, unsigned field) const
-  {
-    return m_td->getStructLayout
-      (const_cast<StructType*>(t))->getElementOffset (field);
-  }
     
   Expr BvSmallSymExec::symb (const Value &I)
+  {
+    Expr res;
+    if (m_symbols->find (I, res)) return res;
+    res = mkSymb (I);
+    m_symbols->insert (I, res);
+    return res;
+  }
+  
+  Expr BvSmallSymExec::mkSymb (const Value &I)
   {
     assert (!isa<UndefValue>(&I));
 
@@ -295,16 +295,7 @@ namespace
       if (!m_sem.isTracked (gep)) return;
       Expr lhs = havoc (gep);
       
-      SmallVector<const Value*, 4> ps;
-      SmallVector<const Type*, 4> ts;
-      gep_type_iterator typeIt = gep_type_begin (gep);
-      for (unsigned i = 1; i < gep.getNumOperands (); ++i, ++typeIt)
-      {
-        ps.push_back (gep.getOperand (i));
-        ts.push_back (*typeIt);
-      }
-      
-      Expr op = m_sem.ptrArith (m_s, *gep.getPointerOperand (), ps, ts);
+      Expr op = m_sem.ptrArith (m_s, gep);
       if (op) m_side.push_back (mk<EQ> (lhs, op));
     }
 
@@ -434,46 +425,40 @@ namespace
         m_fparams.push_back (falseE);
         m_fparams.push_back (falseE);
       }
-      else if (F.getName ().startswith ("shadow.mem") && 
-               m_sem.isTracked (I))
+      else if (m_sem.encoding ().inst (I).isShadow () && m_sem.isTracked (I))
       {
-        if (F.getName ().equals ("shadow.mem.init"))
-          m_s.havoc (symb(I));
-        else if (F.getName ().equals ("shadow.mem.load"))
-        {
-          const Value &v = *CS.getArgument (1);
-          m_inMem = m_s.read (symb (v));
-        }
-        else if (F.getName ().equals ("shadow.mem.store"))
+        switch (m_sem.encoding ().inst (I).kind)
         {
+        case EncInst::SHADOW_INIT:
+          m_s.havoc (symb(I));
+          break;
+        case EncInst::SHADOW_LOAD:
+          m_inMem = m_s.read (symb (*CS.getArgument (1)));
+          break;
+        case EncInst::SHADOW_STORE:
           m_inMem = m_s.read (symb (*CS.getArgument (1)));
           m_outMem = m_s.havoc (symb (I));
-        }
-        else if (F.getName ().equals ("shadow.mem.arg.ref"))
+          break;
+        case EncInst::SHADOW_ARG_REF:
           m_fparams.push_back (m_s.read (symb (*CS.getArgument (1))));
-        else if (F.getName ().equals ("shadow.mem.arg.mod"))
-        {
+          break;
+        case EncInst::SHADOW_ARG_MOD:
           m_fparams.push_back (m_s.read (symb (*CS.getArgument (1))));
           m_fparams.push_back (m_s.havoc (symb (I)));
-        }
-        else if (F.getName ().equals ("shadow.mem.arg.new"))
+          break;
+        case EncInst::SHADOW_ARG_NEW:
           m_fparams.push_back (m_s.havoc (symb (I)));
-        else if (!PF.getName ().equals ("main") && 
-                 F.getName ().equals ("shadow.mem.in"))
-        {
-          m_s.read (symb (*CS.getArgument (1)));
-        }
-        else if (!PF.getName ().equals ("main") &&
-                 F.getName ().equals ("shadow.mem.out"))
-        {
-          m_s.read (symb (*CS.getArgument (1)));
-        }
-        else if (!PF.getName ().equals ("main") && 
-                 F.getName ().equals ("shadow.mem.arg.init"))
-        {
+          break;
+        case EncInst::SHADOW_IN:
+        case EncInst::SHADOW_OUT:
+          if (!PF.getName ().equals ("main"))
+            m_s.read (symb (*CS.getArgument (1)));
+          break;
+        default:
           // regions initialized in main are global. We want them to
-          // flow to the arguments
-          /* do nothing */
+          // flow to the arguments. Nothing to do for
+          // shadow.mem.arg.init
+          break;
         }
       }
       else
@@ -502,7 +487,7 @@ namespace
       //   Expr rhs = op::array::select (m_inMem, op0);
       //   if (I.getType ()->isIntegerTy (1))
       //     // -- convert to Boolean
-      //     rhs = mk<NEQ> (rhs, mkTerm (mpz_class(0), m_efac));
+      //     rhs = mk<NEQ> (rhs, mkTerm<mpz_class> (0, m_efac));
         
       //   m_side.push_back (mk<EQ> (lhs, rhs));
       // }
@@ -519,8 +504,8 @@ namespace
       
       // if (v && I.getOperand (0)->getType ()->isIntegerTy (1))
       //   // -- convert to int
-      //   v = boolop::lite (v, mkTerm (mpz_class (1), m_efac),
-      //                     mkTerm (mpz_class (0), m_efac));
+      //   v = boolop::lite (v, mkTerm<mpz_class> (1, m_efac),
+      //                     mkTerm<mpz_class> (0, m_efac));
       
       // if (idx && v)
       //   m_side.push_back (mk<EQ> (m_outMem, 
@@ -622,41 +607,23 @@ namespace seahorn
     v.visit (const_cast<BasicBlock&>(bb));
   }
 
-  Expr ClpSmallSymExec::ptrArith (SymStore &s, 
-                                  const Value &base,
-                                  SmallVectorImpl<const Value*> &ps,
-                                  SmallVectorImpl<const Type*> &ts)
+  Expr ClpSmallSymExec::ptrArith (SymStore &s, const GetElementPtrInst &gep)
   {
-    Expr res = lookup (s, base);
+    Expr res = lookup (s, *gep.getPointerOperand ());
     if (!res) return res;
     
-    for (unsigned i = 0; i < ps.size (); ++i)
+    const EncInst &enc = m_ir->inst (gep);
+    if (enc.offset != 0)
+      res = mk<PLUS> (res, mkTerm<mpz_class> ((signed long)enc.offset, m_efac));
+    for (auto &t : enc.terms)
     {
-      if (const StructType *st = dyn_cast<const StructType> (ts [i]))
-      {
-        if (const ConstantInt *ci = dyn_cast<const ConstantInt> (ps [i]))
-        {
-          Expr off = mkTerm<mpz_class> (fieldOff (st, ci->getZExtValue ()), m_efac);
-          res = mk<PLUS> (res, off);
-        }
-        else assert (0);
-      }
-      else if (const SequentialType *seqt = dyn_cast<const SequentialType> (ts [i]))
-      {
-        Expr sz = mkTerm<mpz_class> (storageSize (seqt->getElementType ()), m_efac);
-        res = mk<PLUS> (res, mk<MULT> (lookup (s, *ps[i]), sz));
-      }
+      Expr idx = lookup (s, *t.first);
+      if (!idx) return Expr ();
+      Expr sz = mkTerm<mpz_class> ((unsigned long)t.second, m_efac);
+      res = mk<PLUS> (res, mk<MULT> (idx, sz));
     }
     return res;
   }
-  
-  unsigned ClpSmallSymExec::storageSize (const llvm::Type *t) 
-  {return m_td->getTypeStoreSize (const_cast<Type*> (t));}
-  
-  unsigned ClpSmallSymExec::fieldOff (const StructType *t, unsigned field)
-  {
-    return m_td->getStructLayout (const_cast<StructType*>(t))->getElementOffset (field);
-  }
     
   Expr ClpSmallSymExec::symb (const Value &I)
   {
@@ -672,8 +639,7 @@ namespace seahorn
       {
         if (c->getType ()->isIntegerTy (1))
           return c->isOne () ? trueE : falseE;
-        mpz_class k = toMpz (c->getValue ());
-        return mkTerm<mpz_class> (k, m_efac);
+        return mkTerm (c->getValue (), m_efac);
       }
       else if (cv->isNullValue () || isa<ConstantPointerNull> (&I))
         return mkTerm<mpz_class> (0, m_efac);
@@ -688,8 +654,7 @@ namespace seahorn
         {
           if (const ConstantInt* val = dyn_cast<const ConstantInt>(ce->getOperand (0)))
           {
-            mpz_class k = toMpz (val->getValue ());
-            return mkTerm<mpz_class> (k, m_efac);
+            return mkTerm (val->getValue (), m_efac);
           }
           // -- strip cast
           else return symb (*ce->getOperand (0));
@@ -6,6 +6,9 @@
 #include "boost/algorithm/string/replace.hpp"
 #include "boost/algorithm/string/predicate.hpp"
 #include "avy/AvyDebug.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
 #include <unordered_map>
 
 static llvm::cl::opt<bool>
@@ -14,125 +17,64 @@ PrintClpFapp ("horn-clp-fapp",
               llvm::cl::init (false),
               llvm::cl::Hidden);
 
+static llvm::cl::opt<unsigned>
+ClpShare ("horn-clp-share",
+          llvm::cl::desc ("Name the numeric subterms of a rule that occur more than "
+                          "once and have more than this many nodes (0 = never)"),
+          llvm::cl::init (16));
+
 namespace seahorn
 {
   using namespace expr;
   using namespace std;
   using namespace llvm;
 
-  enum exprStrOp { _AND, _OR, _PLUS, _MINUS, _MULT};
-
-  class ExprStr
+  /// Prints the head and the body of a rule in CLP syntax directly
+  /// to a stream. A numeric subterm that occurs more than once in the
+  /// rule and has more than --horn-clp-share nodes is printed once,
+  /// as the definition of a fresh variable at the start of the body,
+  /// and replaced by the variable wherever it occurs. Boolean
+  /// subterms cannot be named in CLP and are printed in full
+  class ClpPrinter
   {
-    string m_s;
-
-    static string to_str (exprStrOp op)
-    {
-      switch (op)
-      {
-        case (_AND):  return ",";
-        case (_OR):   return ";";
-        case (_PLUS): return "+";
-        case (_MINUS):return "-";
-        case (_MULT): return "*";
-        default: assert (false && "unreachable");
-      }
-    }
-    
-   public:
-
-    ExprStr () {} ;
-    ExprStr (string s, bool isVar=false): m_s (s) 
+    raw_ostream &m_out;
+    const HornClauseDB::expr_set_type &m_rels;
+    ExprFactory &m_efac;
+
+    /// number of parents of every subterm of the rule
+    std::unordered_map<Expr, unsigned> m_parents;
+    /// size of the printed subterm, in nodes
+    std::unordered_map<Expr, unsigned> m_size;
+    /// named subterms, in the order of their definitions
+    std::unordered_map<Expr, unsigned> m_names;
+    ExprVector m_defs;
+
+    static std::string mangle (std::string s, bool isVar)
     {
-      boost::replace_all(m_s, "%", "");
-      boost::replace_all(m_s, "@", "_");
-      boost::replace_all(m_s, ".", "_");
+      boost::replace_all(s, "%", "");
+      boost::replace_all(s, "@", "_");
+      boost::replace_all(s, ".", "_");
 
-      if (isVar && !m_s.empty ())
-      { m_s [0] = std::toupper(m_s [0]); }
+      if (isVar && !s.empty ())
+      { s [0] = std::toupper(s [0]); }
 
-      if (!isVar && !m_s.empty ())
+      if (!isVar && !s.empty ())
       {
-        m_s [0] = std::tolower(m_s [0]);
-        if (m_s [0] == '_') 
+        s [0] = std::tolower(s [0]);
+        if (s [0] == '_') 
         {
           // some unlikely prefix
-          boost::replace_first(m_s, "_", "p___");
+          boost::replace_first(s, "_", "p___");
         }
       }
-
-    } 
-
-    static ExprStr True ()  { return ExprStr ("true"); }
-    static ExprStr False () { return ExprStr ("false"); }
-
-    bool empty () const { return m_s.empty (); }
-
-    void print (ostream& o) const { o << m_s ; }
-
-    string str () const { return m_s; }
-
-    // build formulae
-    ExprStr  operator+(ExprStr e)
-    { return ExprStr ("(" + m_s + "+" + e.m_s + ")"); }
-    ExprStr  operator-(ExprStr e)
-    { return ExprStr ("(" + m_s + "-" + e.m_s + ")"); }
-    ExprStr  operator*(ExprStr e)
-    { return ExprStr ("(" + m_s + "*" + e.m_s + ")"); }
-    ExprStr  operator/(ExprStr e)
-    { return ExprStr ("(" + m_s + "/" + e.m_s + ")"); }
-    ExprStr  operator-()
-    { return ExprStr ("(0 - " + m_s + ")"); }
-    ExprStr  operator~()
-    { return ExprStr ("\\+(" + m_s + ")"); }
-    ExprStr  operator&&(ExprStr e)
-    { return ExprStr ("(" + m_s + "," + e.m_s + ")"); }
-    ExprStr  operator||(ExprStr e)
-    { return ExprStr ("(" + m_s + ";" + e.m_s + ")"); }
-    ExprStr  operator<(ExprStr e)
-    { return ExprStr ("(" + m_s + "<" + e.m_s + ")"); }
-    ExprStr  operator<=(ExprStr e)
-    { return ExprStr ("(" + m_s + "=<" + e.m_s + ")"); }
-    ExprStr  operator==(ExprStr e)
-    { return ExprStr ("(" + m_s + "=" + e.m_s + ")"); }
-    ExprStr  operator>(ExprStr e)
-    { return ExprStr ("(" + m_s + ">" + e.m_s + ")"); }
-    ExprStr  operator>=(ExprStr e)
-    { return ExprStr ("(" + m_s + ">=" + e.m_s + ")"); }
-    ExprStr  operator!=(ExprStr e)
-    { return (*this < e) || (*this > e); }
-
-    static ExprStr mknary (exprStrOp op, std::vector<ExprStr> args)
-    {
-      if (std::distance (args.begin (), args.end ()) == 0) 
-        return ExprStr ();
-      typedef typename std::vector<ExprStr>::iterator iterator;
-      string s = (*args.begin ()).str ();
-      for(iterator it = ++ (args.begin ()), end = args.end (); it!=end ; ++it )
-      {
-        ExprStr arg = *it;
-        s = "(" + s + to_str (op) + arg.str () + ")";
-      }
-      return ExprStr (s);
+      return s;
     }
 
-  };
- 
-  typedef std::unordered_map<Expr,ExprStr> expr_str_map;
-  struct FailPrettyPrinter
-  {
-    template <typename C, typename Range>
-    static ExprStr print (Expr e, Expr parent, const Range &rels, 
-                          ExprFactory &efac, C &cache, expr_str_map &seen)
-    { std::cout << "Cannot print: " << *e << "\n";
-      assert (false);
-      return ExprStr ();
+    static bool isNumeric (Expr e)
+    {
+      return isOpX<PLUS> (e) || isOpX<MINUS> (e) || isOpX<MULT> (e) ||
+        isOpX<DIV> (e) || isOpX<UN_MINUS> (e);
     }
-  };
-
-  template <typename M>    
-  struct ExprPrettyPrinter
-  {
 
     static bool isTopLevelExpr (Expr e, Expr parent)
     {
@@ -151,12 +93,11 @@ namespace seahorn
       return false;
     }
 
-
     // negate e if it is a literal otherwise return null
-    static Expr negate (Expr e, ExprFactory &efac)
+    Expr negate (Expr e)
     {
       if (bind::isBoolConst (e) || bind::isIntConst (e))
-        return mk<EQ>(e, mkTerm<mpz_class> (0, efac)); 
+        return mk<EQ>(e, mkTerm<mpz_class> (0, m_efac)); 
       if (isOpX<GT> (e))
         return mk<LEQ> (e->left (), e->right ());
       if (isOpX<GEQ> (e))
@@ -173,209 +114,260 @@ namespace seahorn
       
       return NULL;
     }
+    
+    void fail (Expr e)
+    {
+      errs () << "Cannot print: " << *e << "\n";
+      assert (false);
+    }
+
+    /// counts the parents of the subterms of e
+    void countParents (Expr e)
+    {
+      if (m_parents.count (e)) return;
+      m_parents [e] = 0;
+      for (unsigned i = 0, sz = e->arity (); i < sz; ++i)
+      {
+        countParents (e->arg (i));
+        ++m_parents [e->arg (i)];
+      }
+    }
 
-    template <typename C, typename Range>
-    static ExprStr print (Expr e, Expr parent, const Range &rels, 
-                          ExprFactory &efac, C &cache, expr_str_map &seen)
-                          
+    /// computes the printed size of e and names its shared subterms,
+    /// kids before parents
+    unsigned nameShared (Expr e)
+    {
+      auto it = m_size.find (e);
+      if (it != m_size.end ()) return m_names.count (e) ? 1 : it->second;
+
+      unsigned sz = 1;
+      for (unsigned i = 0, n = e->arity (); i < n; ++i)
+        sz = std::min (sz + nameShared (e->arg (i)), 1U << 30);
+      m_size [e] = sz;
+
+      if (ClpShare > 0 && sz > ClpShare && m_parents [e] > 1 && isNumeric (e))
+      {
+        m_names [e] = m_defs.size ();
+        m_defs.push_back (e);
+        return 1;
+      }
+      return sz;
+    }
+
+    void nary (const char *op, Expr e)
+    {
+      // -- left nested: (((a op b) op c) op d)
+      for (unsigned i = 1, sz = e->arity (); i < sz; ++i) m_out << "(";
+      print (e->arg (0), e);
+      for (unsigned i = 1, sz = e->arity (); i < sz; ++i)
+      {
+        m_out << op;
+        print (e->arg (i), e);
+        m_out << ")";
+      }
+    }
+
+    void binary (const char *op, Expr e)
+    {
+      m_out << "(";
+      print (e->left (), e);
+      m_out << op;
+      print (e->right (), e);
+      m_out << ")";
+    }
+
+   public:
+
+    ClpPrinter (raw_ostream &out, const HornClauseDB::expr_set_type &rels,
+                ExprFactory &efac) :
+      m_out (out), m_rels (rels), m_efac (efac) {}
+
+    /// finds the shared subterms of the rule with the given parts
+    void shareIn (Expr head, Expr body)
+    {
+      countParents (head);
+      if (body) countParents (body);
+      nameShared (head);
+      if (body) nameShared (body);
+    }
+
+    bool hasDefs () const { return !m_defs.empty (); }
+
+    /// prints the definitions of the named subterms, separated by ", "
+    void printDefs ()
+    {
+      for (unsigned i = 0; i < m_defs.size (); ++i)
+      {
+        Expr e = m_defs [i];
+        m_out << (i ? ", " : "") << "(SH___" << i << "=";
+        // -- print e itself, not its name
+        m_names.erase (e);
+        print (e, nullptr);
+        m_names [e] = i;
+        m_out << ")";
+      }
+    }
+
+    void print (Expr e, Expr parent)
     {
       assert (e);
 
       if (isOpX<TRUE>(e))
       { 
-        if (!isTopLevelExpr (e, parent))
-        { return ExprStr ("1"); }
-        else 
-        { return ExprStr::True ();}
+        m_out << (isTopLevelExpr (e, parent) ? "true" : "1");
+        return;
       }
 
       if (isOpX<FALSE>(e)) 
       {
-        if (!isTopLevelExpr (e, parent))
-        { return ExprStr ("0"); }
-        else
-        { return ExprStr::False (); }
+        m_out << (isTopLevelExpr (e, parent) ? "false" : "0");
+        return;
       }
-            
-      // { /** check the cache */
-      //   typename C::const_iterator it = cache.find (e);
-      //   if (it != cache.end ()) return it->second;
-      // }
-
-      { /** check computed table */
-        typename expr_str_map::const_iterator it = seen.find (e);
-         if (it != seen.end ()) return it->second;
+
+      {
+        auto it = m_names.find (e);
+        if (it != m_names.end ())
+        {
+          m_out << "SH___" << it->second;
+          return;
+        }
       }
-       
-      ExprStr res;
-      
+
       if (isOpX<MPZ>(e)) 
       { 
         const MPZ& op = dynamic_cast<const MPZ&>(e->op ());
         if (op.get () < 0)
-          res = ExprStr ("(" + boost::lexical_cast<std::string>(op.get()) + ")");
+          m_out << "(" << boost::lexical_cast<std::string>(op.get()) << ")";
         else
-          res = ExprStr (boost::lexical_cast<std::string>(op.get()));
+          m_out << boost::lexical_cast<std::string>(op.get());
+        return;
       }
-      else if (isOpX<MPQ>(e))
-      { return M::print (e, parent, rels, efac, cache, seen); }      
-      else if (bind::isBoolConst (e))
+      if (isOpX<MPQ>(e) || bind::isRealConst (e))
+      {
+        fail (e);
+        return;
+      }
+      if (bind::isBoolConst (e))
       { // e can be positive or negative
         Expr fname = bind::fname (bind::fname (e));
         std::string sname = boost::lexical_cast<std::string> (fname);
-        bool isVar = (std::find (std::begin (rels), std::end (rels), bind::fname (e)) == rels.end ());
+        bool isVar = m_rels.count (bind::fname (e)) == 0;
         if (isTopLevelExpr (e, parent) && isVar)
-        { res = (ExprStr (sname, true) == ExprStr ("1")); }
+          m_out << "(" << mangle (sname, true) << "=1)";
         else 
-        { res = ExprStr (sname, isVar); }
+          m_out << mangle (sname, isVar);
+        return;
       }
-      else if (bind::isIntConst (e) )
+      if (bind::isIntConst (e) )
       {
         Expr fname = bind::fname (bind::fname (e));        
-        res = ExprStr (boost::lexical_cast<std::string> (fname), true); 
+        m_out << mangle (boost::lexical_cast<std::string> (fname), true); 
+        return;
       }
-      else if (bind::isRealConst (e))
-      { return M::print (e, parent, rels, efac, cache, seen); }
-      else if (bind::isFapp (e))
+      if (bind::isFapp (e))
       {
         Expr fname = bind::fname (bind::fname (e));
-        string fapp = boost::lexical_cast<std::string> (fname) ;              
+        m_out << mangle (boost::lexical_cast<std::string> (fname), false);
         ENode::args_iterator it = ++ (e->args_begin ());
         ENode::args_iterator end = e->args_end ();
 
         if (std::distance (it, end) > 0)
         {
-          fapp += (PrintClpFapp ? "(" : "-[");
+          m_out << (PrintClpFapp ? "(" : "-[");
           for (; it != end; )
           {
-            ExprStr arg = print (*it, e, rels, efac, cache, seen);
-              fapp += arg.str (); 
-              ++it;
-              if (it != end)
-                fapp += ",";
+            print (*it, e);
+            ++it;
+            if (it != end)
+              m_out << ",";
           }
-          fapp += (PrintClpFapp ? ")" : "]");
+          m_out << (PrintClpFapp ? ")" : "]");
         }
-        res = ExprStr (fapp);          
+        return;
       }
 
-      if (!res.empty ())
-      { // -- cache the result for pretty printing
-        // cache.insert (typename C::value_type (e, res));
-        return res;
-      }
-      
       int arity = e->arity ();
       /** other terminal expressions */
       if (arity == 0) 
-      {  return M::print (e, parent, rels, efac, cache, seen); }
+        fail (e);
       else if (arity == 1)
       {
         if (isOpX<UN_MINUS> (e))
-        { res = -print (e->left(), e, rels, efac, cache, seen); }
+        { 
+          m_out << "(0 - ";
+          print (e->left(), e);
+          m_out << ")";
+        }
         else if (isOpX<NEG> (e))
         { 
-          Expr not_e = negate (e->left (), efac);
+          Expr not_e = negate (e->left ());
           if (not_e) 
-          { res = print (not_e, e, rels, efac, cache, seen); }          
+            print (not_e, e);
           else
-          { res = ~print (e->left(), e, rels, efac, cache, seen); }
+          { 
+            m_out << "\\+(";
+            print (e->left(), e);
+            m_out << ")";
+          }
         }
+        else
+          fail (e);
       }          
       else if (arity == 2)
       {
-        
-        ExprStr s1 = print (e->left(), e, rels, efac, cache, seen);
-        ExprStr s2 = print (e->right(), e, rels, efac, cache, seen);
-        
         /** BoolOp */
-        if (isOpX<AND> (e)) 
-        { res = s1 && s2;  }
-        else if (isOpX<OR>(e))
-        { res = s1 || s2; }
-        else if (isOpX<IMPL>(e))
-        { return M::print (e, parent, rels, efac, cache, seen); }
-        else if (isOpX<IFF>(e))
-        { return M::print (e, parent, rels, efac, cache, seen); }
-        else if (isOpX<XOR>(e))
-        { return M::print (e, parent, rels, efac, cache, seen); }
+        if (isOpX<AND> (e)) binary (",", e);
+        else if (isOpX<OR>(e)) binary (";", e);
         /** NumericOp */
-        else if (isOpX<PLUS>(e))
-        { res = s1 + s2; }
-        else if (isOpX<MINUS>(e))
-        { res = s1 - s2; }
-        else if (isOpX<MULT>(e))
-        { res = s1 * s2; }
-        else if (isOpX<DIV>(e))
-        { res = s1 / s2;}
+        else if (isOpX<PLUS>(e)) binary ("+", e);
+        else if (isOpX<MINUS>(e)) binary ("-", e);
+        else if (isOpX<MULT>(e)) binary ("*", e);
+        else if (isOpX<DIV>(e)) binary ("/", e);
         /** Comparisson Op */
-        else if (isOpX<EQ>(e))
-        { res = s1 == s2; }
+        else if (isOpX<EQ>(e)) binary ("=", e);
         else if (isOpX<NEQ>(e))
-        { res = s1 != s2;}
-        else if (isOpX<LEQ>(e))
-        { res = s1 <= s2; }
-        else if (isOpX<GEQ>(e))
-        { res = s1 >= s2; }
-        else if (isOpX<LT>(e))
-        { res = s1 < s2; }
-        else if (isOpX<GT>(e))
-        { res = s1 > s2; }
-        else
-        { return M::print (e, parent, rels, efac, cache, seen); }
-      }
-      else if (isOpX<AND> (e) || isOpX<OR> (e) ||
-               isOpX<PLUS> (e) || isOpX<MINUS> (e) ||
-               isOpX<MULT> (e))
-      {
-        vector<ExprStr> args;
-        for (ENode::args_iterator it = e->args_begin(), end = e->args_end();
-             it != end; ++it)
         {
-          ExprStr a = print (*it, e, rels, efac, cache, seen);
-          args.push_back (a);
+          m_out << "(";
+          binary ("<", e);
+          m_out << ";";
+          binary (">", e);
+          m_out << ")";
         }
-        
-        if (isOp<AND>(e))
-        { res = ExprStr::mknary (_AND, args); }
-        else if (isOp<OR>(e))
-        { res = ExprStr::mknary (_OR, args); }
-        else if (isOp<PLUS>(e))
-        { res = ExprStr::mknary (_PLUS, args); }
-        else if (isOp<MINUS>(e))
-        { res = ExprStr::mknary (_MINUS, args); }
-        else if (isOp<MULT>(e))
-        { res = ExprStr::mknary (_MULT, args);  }
-        else
-        {  return M::print (e, parent, rels, efac, cache, seen); }
+        else if (isOpX<LEQ>(e)) binary ("=<", e);
+        else if (isOpX<GEQ>(e)) binary (">=", e);
+        else if (isOpX<LT>(e)) binary ("<", e);
+        else if (isOpX<GT>(e)) binary (">", e);
+        else fail (e);
       }
-      
-      assert (!res.empty());
-      seen.insert (expr_str_map::value_type (e, res ));
-      return res;
+      else if (isOpX<AND> (e)) nary (",", e);
+      else if (isOpX<OR> (e)) nary (";", e);
+      else if (isOpX<PLUS> (e)) nary ("+", e);
+      else if (isOpX<MINUS> (e)) nary ("-", e);
+      else if (isOpX<MULT> (e)) nary ("*", e);
+      else fail (e);
     }
   }; 
 
-  void ClpWrite::ClpRule::normalize () 
-  { m_body = op::boolop::gather (op::boolop::nnf (m_body)); }
-
-  void ClpWrite::ClpRule::print (ostream &o) const 
+  void ClpWrite::ClpRule::print (raw_ostream &o) const 
   {        
+    Expr body = m_body;
+    if (body && m_nnf) body = op::boolop::gather (op::boolop::nnf (body));
 
-    expr_str_map seen, cache;
-    ExprStr str_head = ExprPrettyPrinter<FailPrettyPrinter>::
-        print (m_head, NULL, m_rels, m_efac, cache, seen);    
-    str_head.print (o); 
+    ClpPrinter p (o, m_rels, m_efac);
+    p.shareIn (m_head, body);
+    p.print (m_head, NULL);
 
-    if (isFact()) 
+    if (!body && !p.hasDefs ()) 
     { o << ".\n";  }
     else
     {
       o << " :- ";
-      seen.clear ();
-      ExprStr str_body = ExprPrettyPrinter<FailPrettyPrinter>::
-          print (m_body, NULL, m_rels, m_efac, cache, seen);
-      str_body.print (o);
+      p.printDefs ();
+      if (body)
+      {
+        if (p.hasDefs ()) o << ", ";
+        p.print (body, NULL);
+      }
       o << ".\n";
     }
   }    
@@ -420,10 +412,46 @@ namespace seahorn
     }
   }
 
+  void ClpWrite::write (raw_ostream &out, unsigned threads) const
+  {
+    if (threads <= 1 || m_rules.size () <= 1)
+    {
+      for (auto &rule : m_rules) { rule.print (out); }
+      return;
+    }
+
+    // -- enough rules to keep the threads busy, few enough to keep
+    // -- the text of a window small
+    const size_t window = 64 * threads;
+    std::vector<std::string> text;
+    for (size_t base = 0; base < m_rules.size (); base += window)
+    {
+      size_t n = std::min (window, m_rules.size () - base);
+      text.assign (n, std::string ());
+      std::atomic<size_t> next (0);
+      auto worker = [&] ()
+        {
+          for (size_t k = next++; k < n; k = next++)
+          {
+            raw_string_ostream os (text [k]);
+            m_rules [base + k].print (os);
+          }
+        };
+      std::vector<std::thread> pool;
+      for (unsigned t = 1; t < std::min<size_t> (threads, n); ++t)
+        pool.emplace_back (worker);
+      worker ();
+      for (std::thread &t : pool) t.join ();
+
+      for (const std::string &s : text) out << s;
+    }
+  }
+
   string ClpWrite::toString () const
   {
-    std::ostringstream oss;
-    for (auto &rule : m_rules) { rule.print (oss); }
+    std::string str;
+    raw_string_ostream oss (str);
+    write (oss);
     return oss.str ();
   }
 }
@@ -0,0 +1,276 @@
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Support/raw_ostream.h"
+#include "seahorn/config.h"
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  /// Removes the checks inserted by the instrumentation passes
+  /// (e.g., BufferBoundsCheck, IntegerOverflowCheck) that are
+  /// implied by Crab invariants
+  class CrabDischarge: public llvm::ModulePass
+  {
+    unsigned m_checks;
+    unsigned m_discharged;
+
+  public:
+    static char ID;
+
+    CrabDischarge () : ModulePass(ID), m_checks (0), m_discharged (0) {}
+    virtual ~CrabDischarge () {}
+
+    virtual bool runOnModule (Module &M);
+    virtual void getAnalysisUsage (AnalysisUsage &AU) const;
+    virtual const char* getPassName () const {return "CrabDischarge";}
+  };
+
+  char CrabDischarge::ID = 0;
+  Pass* createCrabDischargePass () {return new CrabDischarge ();}
+
+} // end namespace seahorn
+
+#ifndef HAVE_CRAB_LLVM
+/// Dummy implementation when Crab is not compiled in
+namespace seahorn
+{
+  void CrabDischarge::getAnalysisUsage (AnalysisUsage &AU) const
+  {AU.setPreservesAll ();}
+
+  bool CrabDischarge::runOnModule (Module &M)
+  {
+    errs () << "WARNING: Not discharging checks. Compiled without Crab support.\n";
+    return false;
+  }
+}
+#else
+/// Real implementation starts here
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/InstrTypes.h"
+#include "ufo/Stats.hh"
+#include "avy/AvyDebug.h"
+
+#include <crab_llvm/CrabLlvm.hh>
+#include <crab_llvm/AbstractDomains.hh>
+
+#include <gmpxx.h>
+#include <map>
+
+namespace seahorn
+{
+  using namespace llvm;
+  using namespace crab::cfg_impl;
+  using namespace crab_llvm;
+
+  // A linear inequality sum (terms) + k <= 0, or an equality if isEq
+  struct LinCst
+  {
+    std::map<const Value*, mpz_class> terms;
+    mpz_class k;
+    bool isEq;
+    LinCst () : k (0), isEq (false) {}
+  };
+
+  static mpz_class toMpz (const ConstantInt &c)
+  { return mpz_class (c.getValue ().toString (10, true)); }
+
+  // Adds c*v to l. Values computed in bb are expanded since the
+  // invariant holds at the entry of bb.
+  static bool linearize (const Value *v, const mpz_class &c,
+                         const BasicBlock *bb, LinCst &l)
+  {
+    if (const ConstantInt *ci = dyn_cast<ConstantInt> (v))
+    {
+      l.k += c * toMpz (*ci);
+      return true;
+    }
+
+    const Instruction *I = dyn_cast<Instruction> (v);
+    if (!I || I->getParent () != bb)
+    {
+      l.terms [v] += c;
+      return true;
+    }
+
+    if (const BinaryOperator *bo = dyn_cast<BinaryOperator> (I))
+    {
+      if (bo->getOpcode () == Instruction::Add)
+        return linearize (bo->getOperand (0), c, bb, l) &&
+            linearize (bo->getOperand (1), c, bb, l);
+      if (bo->getOpcode () == Instruction::Sub)
+        return linearize (bo->getOperand (0), c, bb, l) &&
+            linearize (bo->getOperand (1), -c, bb, l);
+    }
+    else if (isa<SExtInst> (I))
+      return linearize (I->getOperand (0), c, bb, l);
+
+    return false;
+  }
+
+  // The condition of a check that ends bb as an inequality
+  static bool checkToCst (const ICmpInst &cmp, const BasicBlock *bb, LinCst &l)
+  {
+    const Value *a = cmp.getOperand (0);
+    const Value *b = cmp.getOperand (1);
+    switch (cmp.getPredicate ())
+    {
+    case ICmpInst::ICMP_SGT: l.k += 1; // fall through
+    case ICmpInst::ICMP_SGE: std::swap (a, b); break;
+    case ICmpInst::ICMP_SLT: l.k += 1; break;
+    case ICmpInst::ICMP_SLE: break;
+    default: return false;
+    }
+    return linearize (a, 1, bb, l) && linearize (b, -1, bb, l);
+  }
+
+  // The condition of the check that ends bb, if any. A check is a
+  // branch to a block that calls verifier.error when its condition
+  // does not hold.
+  static ICmpInst* getCheck (BasicBlock &bb)
+  {
+    BranchInst *br = dyn_cast<BranchInst> (bb.getTerminator ());
+    if (!br || !br->isConditional ()) return nullptr;
+    const CallInst *ci = dyn_cast<CallInst> (&br->getSuccessor (1)->front ());
+    const Function *fn = ci ? ci->getCalledFunction () : nullptr;
+    if (!fn || !fn->getName ().equals ("verifier.error")) return nullptr;
+    return dyn_cast<ICmpInst> (br->getCondition ());
+  }
+
+  // Crab constraints whose variables are all llvm values. Sets
+  // bottom if the invariant is false.
+  static void crabToCsts (const z_lin_cst_sys_t &csts,
+                          std::vector<LinCst> &res, bool &bottom)
+  {
+    bottom = false;
+    for (auto cst : csts)
+    {
+      if (cst.is_contradiction ()) { bottom = true; return; }
+      if (cst.is_tautology () || cst.is_disequation ()) continue;
+
+      LinCst l;
+      l.isEq = cst.is_equality ();
+      l.k = (mpz_class) cst.expression ().constant ();
+      auto e = cst.expression() - cst.expression().constant();
+      bool ok = true;
+      for (auto t : e)
+      {
+        varname_t v = t.second.name ();
+        // -- a shadow variable of Crab
+        if (!(v.get ())) { ok = false; break; }
+        l.terms [*(v.get ())] += (mpz_class) t.first;
+      }
+      if (ok) res.push_back (l);
+    }
+  }
+
+  // True if check holds whenever all csts hold
+  static bool entails (const std::vector<LinCst> &csts, const LinCst &check)
+  {
+    // -- a single constraint that is a multiple of the check
+    for (const LinCst &c : csts)
+    {
+      if (c.terms.size () != check.terms.size ()) continue;
+
+      // -- check = lambda * c on the variables
+      mpq_class lambda (0);
+      bool ok = true;
+      for (auto &kv : check.terms)
+      {
+        auto it = c.terms.find (kv.first);
+        if (it == c.terms.end () || it->second == 0) { ok = false; break; }
+        mpq_class l (kv.second, it->second);
+        l.canonicalize ();
+        if (lambda == 0) lambda = l;
+        else if (l != lambda) { ok = false; break; }
+      }
+      if (!ok || lambda == 0) continue;
+      if (!c.isEq && lambda < 0) continue;
+
+      // -- sum (check.terms) = lambda * sum (c.terms) <= -lambda * c.k
+      if (check.k - lambda * c.k <= 0) return true;
+    }
+
+    // -- the bounds of each variable of the check
+    mpq_class max (check.k);
+    for (auto &kv : check.terms)
+    {
+      bool found = false;
+      mpq_class best;
+      for (const LinCst &c : csts)
+      {
+        if (c.terms.size () != 1 || c.terms.begin ()->first != kv.first) continue;
+        // -- a*x + m <= 0 bounds kv.second*x by kv.second/a * -m if
+        // -- kv.second/a is positive
+        mpq_class l (kv.second, c.terms.begin ()->second);
+        l.canonicalize ();
+        if (!c.isEq && l < 0) continue;
+        mpq_class v = -l * c.k;
+        if (!found || v < best) best = v;
+        found = true;
+      }
+      if (!found) return false;
+      max += best;
+    }
+    return max <= 0;
+  }
+
+  // Replaces the check that ends bb by a jump to its continuation
+  static void removeCheck (BasicBlock &bb)
+  {
+    BranchInst *br = cast<BranchInst> (bb.getTerminator ());
+    Instruction *cond = dyn_cast<Instruction> (br->getCondition ());
+    br->getSuccessor (1)->removePredecessor (&bb);
+    BranchInst::Create (br->getSuccessor (0), &bb);
+    br->eraseFromParent ();
+    if (cond && cond->use_empty ()) cond->eraseFromParent ();
+  }
+
+  bool CrabDischarge::runOnModule (Module &M)
+  {
+    CrabLlvm &crab = getAnalysis<CrabLlvm> ();
+
+    // -- the invariants are only valid for the unmodified module
+    std::vector<BasicBlock*> safe;
+    for (Function &F : M)
+      for (BasicBlock &BB : F)
+      {
+        ICmpInst *cmp = getCheck (BB);
+        if (!cmp) continue;
+        m_checks++;
+
+        LinCst check;
+        if (!checkToCst (*cmp, &BB, check)) continue;
+
+        std::vector<LinCst> csts;
+        bool bottom;
+        GenericAbsDomWrapperPtr abs = crab [&BB];
+        crabToCsts (abs->to_linear_constraints (), csts, bottom);
+        if (!bottom && !entails (csts, check)) continue;
+
+        LOG ("crab-discharge",
+             errs () << "Discharged " << *cmp << " in " << F.getName () << "\n";);
+        safe.push_back (&BB);
+      }
+
+    for (BasicBlock *BB : safe) removeCheck (*BB);
+    m_discharged = safe.size ();
+
+    ufo::Stats::uset ("CrabChecks", m_checks);
+    ufo::Stats::uset ("CrabDischargedChecks", m_discharged);
+    errs () << "-- Discharged " << m_discharged << " of " << m_checks
+            << " checks using Crab invariants";
+    if (m_checks > 0)
+      errs () << " (" << (100 * m_discharged) / m_checks << "%)";
+    errs () << ".\n";
+
+    return !safe.empty ();
+  }
+
+  void CrabDischarge::getAnalysisUsage (AnalysisUsage &AU) const
+  {
+    AU.addRequired<CrabLlvm> ();
+  }
+} // end namespace seahorn
+#endif
@@ -0,0 +1,124 @@
+#include "seahorn/EncodingIR.hh"
+#include "seahorn/Transforms/Instrumentation/ShadowMemDsa.hh"
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/GetElementPtrTypeIterator.h"
+#include "llvm/IR/Instructions.h"
+
+#include "llvm/ADT/StringSwitch.h"
+
+namespace seahorn
+{
+  void EncInst::gepOffset (const GEPOperator &gep, const DataLayout &dl,
+                           EncInst &out)
+  {
+    out.kind = GEP;
+    uint64_t offset = 0;
+    gep_type_iterator TI = gep_type_begin (gep);
+    for (unsigned i = 1, e = gep.getNumOperands (); i != e; ++i, ++TI)
+    {
+      const Value *idx = gep.getOperand (i);
+      if (StructType *STy = dyn_cast<StructType> (*TI))
+      {
+        unsigned fieldNo = cast<ConstantInt> (idx)->getZExtValue ();
+        offset += dl.getStructLayout (STy)->getElementOffset (fieldNo);
+        continue;
+      }
+
+      Type *Ty = cast<SequentialType> (*TI)->getElementType ();
+      uint64_t sz = dl.getTypeStoreSize (Ty);
+      if (const ConstantInt *ci = dyn_cast<ConstantInt> (idx))
+        offset += (uint64_t)ci->getSExtValue () * sz;
+      else
+        out.terms.push_back (std::make_pair (idx, sz));
+    }
+    out.offset = (int64_t)offset;
+  }
+
+  /// true if the integer value of I is not its value as an unbounded
+  /// integer
+  static bool isBitPrecise (const Instruction &I)
+  {
+    if (!I.getType ()->isIntegerTy () || I.getType ()->isIntegerTy (1))
+      return false;
+    for (const User *u : I.users ())
+      if (isa<ReturnInst> (u)) return false;
+
+    if (const BinaryOperator *bo = dyn_cast<BinaryOperator> (&I))
+    {
+      switch (bo->getOpcode ())
+      {
+      case Instruction::And:
+      case Instruction::Or:
+      case Instruction::Xor:
+      case Instruction::Shl:
+      case Instruction::LShr:
+      case Instruction::AShr:
+      case Instruction::UDiv:
+      case Instruction::URem:
+        return true;
+      case Instruction::Add:
+      case Instruction::Sub:
+      case Instruction::Mul:
+        return !bo->hasNoSignedWrap () && !bo->hasNoUnsignedWrap ();
+      default:
+        return false;
+      }
+    }
+    if (isa<TruncInst> (I)) return true;
+    if (isa<ZExtInst> (I))
+      return !I.getOperand (0)->getType ()->isIntegerTy (1);
+    return false;
+  }
+
+  FunctionEncoding::FunctionEncoding (const Function &F, const DataLayout &dl)
+  {
+    for (const BasicBlock &bb : F)
+      for (const Instruction &I : bb)
+      {
+        if (isBitPrecise (I)) m_insts [&I].bitPrecise = true;
+        else if (const GEPOperator *gep = dyn_cast<GEPOperator> (&I))
+          EncInst::gepOffset (*gep, dl, m_insts [&I]);
+        else if (const CallInst *ci = dyn_cast<CallInst> (&I))
+        {
+          const Function *fn = ci->getCalledFunction ();
+          if (!fn || !fn->getName ().startswith ("shadow.mem")) continue;
+
+          EncInst &enc = m_insts [&I];
+          enc.kind = StringSwitch<EncInst::Kind> (fn->getName ())
+            .Case ("shadow.mem.init", EncInst::SHADOW_INIT)
+            .Case ("shadow.mem.load", EncInst::SHADOW_LOAD)
+            .Case ("shadow.mem.store", EncInst::SHADOW_STORE)
+            .Case ("shadow.mem.arg.ref", EncInst::SHADOW_ARG_REF)
+            .Case ("shadow.mem.arg.mod", EncInst::SHADOW_ARG_MOD)
+            .Case ("shadow.mem.arg.new", EncInst::SHADOW_ARG_NEW)
+            .Case ("shadow.mem.in", EncInst::SHADOW_IN)
+            .Case ("shadow.mem.out", EncInst::SHADOW_OUT)
+            .Case ("shadow.mem.arg.init", EncInst::SHADOW_ARG_INIT)
+            .Default (EncInst::SHADOW_OTHER);
+
+          ImmutableCallSite CS (ci);
+          if (CS.arg_size () == 0) continue;
+          enc.region = shadow_dsa::getShadowId (CS);
+          if (enc.kind == EncInst::SHADOW_LOAD || enc.kind == EncInst::SHADOW_STORE)
+            enc.scalar = shadow_dsa::extractUniqueScalar (CS);
+        }
+      }
+  }
+
+  const FunctionEncoding &EncodingIR::function (const Function &F)
+  {
+    std::unique_lock<std::mutex> lock (m_mutex, std::defer_lock);
+    if (m_efac.isConcurrent ()) lock.lock ();
+    std::unique_ptr<FunctionEncoding> &res = m_functions [&F];
+    if (!res) res.reset (new FunctionEncoding (F, m_dl));
+    return *res;
+  }
+
+  void EncodingIR::removeFunction (const Function &F)
+  {
+    std::unique_lock<std::mutex> lock (m_mutex, std::defer_lock);
+    if (m_efac.isConcurrent ()) lock.lock ();
+    m_functions.erase (&F);
+  }
+}
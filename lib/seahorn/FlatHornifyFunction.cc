@@ -270,41 +270,36 @@ namespace seahorn
     
     UfoLargeSymExec lsem (m_sem);
     
-    for (const CutPoint &cp : cpg)
+    encodeEdges (cpg, [&] (const CpEdge &edge, SymStore &s, ExprSet &allVars)
       {
-        for (const CpEdge *edge : boost::make_iterator_range (cp.succ_begin (),
-                                                              cp.succ_end ()))
-        {
-          allVars.clear ();
-          args.clear ();
-          s.reset ();
-          
-          s.write (pc, mkTerm<mpz_class> (cpgOrder [&cp.bb ()], m_efac));
-          args.push_back (s.read (pc));
-          for (const Expr &v : glive) args.push_back (s.read (v));
-          allVars.insert (++args.begin (), args.end ());
+        // -- may run on several threads: cpgOrder and glive are only read
+        ExprVector args;
+        const BasicBlock &src = edge.source ().bb ();
+        s.write (pc, mkTerm<mpz_class> (cpgOrder.lookup (&src), m_efac));
+        args.push_back (s.read (pc));
+        for (const Expr &v : glive) args.push_back (s.read (v));
+        allVars.insert (++args.begin (), args.end ());
           
-          Expr pre = bind::fapp (step, args);
+        Expr pre = bind::fapp (step, args);
           
-          ExprVector side;
-          side.push_back (boolop::lneg ((s.read (m_sem.errorFlag (cp.bb ())))));
-          lsem.execCpEdg (s, *edge, side);
-          Expr tau = mknary<AND> (mk<TRUE> (m_efac), side);
-          expr::filter (tau, bind::IsConst(), 
-                        std::inserter (allVars, allVars.begin ()));
+        ExprVector side;
+        side.push_back (boolop::lneg ((s.read (m_sem.errorFlag (src)))));
+        lsem.execCpEdg (s, edge, side);
+        Expr tau = mknary<AND> (mk<TRUE> (m_efac), side);
+        expr::filter (tau, bind::IsConst(), 
+                      std::inserter (allVars, allVars.begin ()));
 
-          const BasicBlock &dst = edge->target ().bb ();
-          args.clear ();
+        const BasicBlock &dst = edge.target ().bb ();
+        args.clear ();
           
-          s.write (pc, mkTerm<mpz_class> (cpgOrder [&dst], m_efac));
-          args.push_back (s.read (pc));
-          for (const Expr &v : glive) args.push_back (s.read (v));
-          allVars.insert (++args.begin (), args.end ());
+        s.write (pc, mkTerm<mpz_class> (cpgOrder.lookup (&dst), m_efac));
+        args.push_back (s.read (pc));
+        for (const Expr &v : glive) args.push_back (s.read (v));
+        allVars.insert (++args.begin (), args.end ());
           
-          Expr post = bind::fapp (step, args);
-          m_db.addRule (allVars, boolop::limp (boolop::land (pre, tau), post));
-        }
-      }
+        Expr post = bind::fapp (step, args);
+        return boolop::limp (boolop::land (pre, tau), post);
+      });
     
     allVars.clear ();
     args.clear ();
@@ -0,0 +1,87 @@
+#include "seahorn/FunctionAnalysisCache.hh"
+
+#include "llvm/Transforms/Utils/UnifyFunctionExitNodes.h"
+
+#include "ufo/Stats.hh"
+
+#include "boost/functional/hash.hpp"
+
+namespace seahorn
+{
+  char FunctionAnalysisCache::ID = 0;
+
+  size_t FunctionAnalysisCache::stamp (const Function &F)
+  {
+    size_t h = 0;
+    for (const BasicBlock &bb : F)
+    {
+      boost::hash_combine (h, &bb);
+      boost::hash_combine (h, bb.size ());
+      boost::hash_combine (h, bb.getTerminator ());
+    }
+    return h;
+  }
+
+  FunctionAnalysisCache::Entry &FunctionAnalysisCache::entry (Function &F)
+  {
+    auto it = m_fns.find (&F);
+    if (it != m_fns.end ())
+    {
+      if (it->second.stamp == stamp (F)) return it->second;
+      ufo::Stats::count ("AnalysisCacheInvalidated");
+      m_fns.erase (it);
+    }
+
+    // -- the passes are only used for their results. As the pass
+    // -- manager does, the exit nodes are unified first
+    UnifyFunctionExitNodes unify;
+    unify.runOnFunction (F);
+
+    Entry &e = m_fns [&F];
+    e.topo.reset (new TopologicalOrder ());
+    e.topo->runOnFunction (F);
+    if (CutPointGraph::usesWto ())
+    {
+      e.wto.reset (new WeakTopologicalOrderPass ());
+      e.wto->runOnFunction (F);
+    }
+    e.cpg.reset (new CutPointGraph ());
+    e.cpg->compute (F, *e.topo, e.wto.get ());
+    e.stamp = stamp (F);
+    ufo::Stats::count ("AnalysisCacheMisses");
+    return e;
+  }
+
+  const TopologicalOrder &FunctionAnalysisCache::topo (Function &F)
+  { return *entry (F).topo; }
+
+  CutPointGraph &FunctionAnalysisCache::cpg (Function &F)
+  { return *entry (F).cpg; }
+
+  LiveSymbols &FunctionAnalysisCache::liveSymbols (Function &F, ExprFactory &efac,
+                                                   SmallStepSymExec &sem)
+  {
+    std::unique_ptr<LiveSymbols> &ls = entry (F).live [&sem];
+    if (!ls) ls.reset (new LiveSymbols (F, efac, sem));
+    else ufo::Stats::count ("AnalysisCacheLiveHits");
+    return *ls;
+  }
+
+  const LiveSymbols *FunctionAnalysisCache::findLiveSymbols (const Function &F,
+                                                             const SmallStepSymExec &sem) const
+  {
+    auto it = m_fns.find (&F);
+    if (it == m_fns.end ()) return nullptr;
+    auto jt = it->second.live.find (&sem);
+    return jt == it->second.live.end () ? nullptr : jt->second.get ();
+  }
+
+  void FunctionAnalysisCache::forget (const SmallStepSymExec &sem)
+  {
+    for (auto &kv : m_fns) kv.second.live.erase (&sem);
+  }
+}
+
+static llvm::RegisterPass<seahorn::FunctionAnalysisCache>
+X ("fn-analysis-cache", "Analyses of functions shared by the passes",
+   true, true);
@@ -6,79 +6,127 @@
 #include <iostream>
 #include <boost/tokenizer.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 namespace seahorn
 {
-  ExprVector applyTemplatesFromExperimentFile(Expr fdecl, const std::string &filepath)
+  namespace
   {
-    ExprVector bvars;
-    ExprVector lemmas;
-
-    int bvar_count = 0;
-    for(int i=0; i<bind::domainSz(fdecl); i++)
+    /// the template of a line OP,VALUE over var, null if malformed
+    Expr parseTemplate (const std::string &line, Expr var)
     {
-      if(isOpX<INT_TY>(bind::domainTy(fdecl, i)))
-      {
-        Expr bvar = bind::bvar(i, mk<INT_TY>(bind::domainTy(fdecl, i)->efac()));
-        bvars.push_back(bvar);
-        bvar_count ++;
-      }
+      boost::char_separator<char> sep(",");
+      typedef boost::tokenizer< boost::char_separator<char>> t_tokenizer;
+      t_tokenizer tok(line, sep);
+      auto it = tok.begin();
+      if (it == tok.end()) return Expr();
+      std::string op = *it;
+      if (++it == tok.end()) return Expr();
+      Expr value = mkTerm<mpz_class>(std::atoi(it->c_str()), var->efac());
+      if(op == "LEQ") return mk<LEQ>(var, value);
+      else if(op == "GEQ") return mk<GEQ>(var, value);
+      else if(op == "LT") return mk<LT>(var, value);
+      else if(op == "GT") return mk<GT>(var, value);
+      return Expr();
     }
-    Expr one = mkTerm<mpz_class> (1, fdecl->efac());
-    Expr zero = mkTerm<mpz_class> (0, fdecl->efac());
-    Expr two = mkTerm<mpz_class> (2, fdecl->efac());
-    if(bvar_count == 0)
+  }
+
+  CandidateTemplates::CandidateTemplates (ExprFactory &efac) :
+    m_efac (efac), m_var (bind::intConst (mkTerm<std::string> ("candidate.var", efac)))
+  {
+    Expr one = mkTerm<mpz_class> (1, efac);
+    Expr zero = mkTerm<mpz_class> (0, efac);
+    Expr two = mkTerm<mpz_class> (2, efac);
+    m_templates.push_back(mk<GEQ>(m_var, one));
+    m_templates.push_back(mk<LEQ>(m_var, one));
+    m_templates.push_back(mk<GEQ>(m_var, zero));
+    m_templates.push_back(mk<GEQ>(m_var, two));
+    m_templates.push_back(mk<LEQ>(m_var, two));
+  }
+
+  bool CandidateTemplates::load (const std::string &filepath)
+  {
+    std::ifstream in(filepath);
+    if (!in)
     {
-      lemmas.push_back(mk<TRUE>(fdecl->efac()));
+      errs() << "FILE NOT EXIST!\n";
+      return false;
     }
-    else if(bvar_count == 1)
+    std::string line;
+    while (getline (in, line))
+      if (Expr t = parseTemplate (line, m_var)) m_templates.push_back (t);
+    m_bySignature.clear ();
+    return true;
+  }
+
+  ExprVector CandidateTemplates::instantiate (Expr fdecl) const
+  {
+    ExprVector lemmas;
+    for(unsigned i=0; i<bind::domainSz(fdecl); i++)
     {
-      lemmas.push_back(mk<GEQ>(bvars[0], one));
-      lemmas.push_back(mk<LEQ>(bvars[0], one));
-      lemmas.push_back(mk<GEQ>(bvars[0], zero));
-      lemmas.push_back(mk<GEQ>(bvars[0], two));
-      lemmas.push_back(mk<LEQ>(bvars[0], two));
-      parseLemmasFromExpFile(bvars[0], lemmas, filepath);
+      if(!isOpX<INT_TY>(bind::domainTy(fdecl, i))) continue;
+      ExprMap sub;
+      sub [m_var] = bind::bvar(i, mk<INT_TY>(m_efac));
+      for (Expr t : m_templates) lemmas.push_back (replace (t, sub));
     }
-    else
+    if (lemmas.empty ()) lemmas.push_back(mk<TRUE>(m_efac));
+    return lemmas;
+  }
+
+  const ExprVector &CandidateTemplates::apply (Expr fdecl)
+  {
+    ExprVector sig;
+    for(unsigned i=0; i<bind::domainSz(fdecl); i++) sig.push_back (bind::domainTy(fdecl, i));
     {
-      for(int i=0; i<bvars.size(); i++)
-      {
-        lemmas.push_back(mk<GEQ>(bvars[i], one));
-        lemmas.push_back(mk<LEQ>(bvars[i], one));
-        lemmas.push_back(mk<GEQ>(bvars[i], zero));
-        lemmas.push_back(mk<GEQ>(bvars[i], two));
-        lemmas.push_back(mk<LEQ>(bvars[i], two));
-        parseLemmasFromExpFile(bvars[i], lemmas, filepath);
-      }
+      std::lock_guard<std::mutex> l (m_lock);
+      auto it = m_bySignature.find (sig);
+      if (it != m_bySignature.end ()) return it->second;
     }
-    return lemmas;
+    // -- instantiated outside of the lock. Another worker may have
+    // -- added the same signature, its candidates are the same
+    ExprVector lemmas = instantiate (fdecl);
+    std::lock_guard<std::mutex> l (m_lock);
+    return m_bySignature.insert (std::make_pair (sig, lemmas)).first->second;
+  }
+
+  void CandidateTemplates::applyAll (const ExprVector &rels,
+                                     std::vector<ExprVector> &out, unsigned threads)
+  {
+    out.assign (rels.size (), ExprVector ());
+    threads = m_efac.isConcurrent () ? std::max (1U, threads) : 1;
+    std::atomic<unsigned> next (0);
+    auto worker = [&] ()
+      {
+        for (unsigned k = next++; k < rels.size (); k = next++)
+          out [k] = apply (rels [k]);
+      };
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < std::min<size_t> (threads, rels.size ()); ++t)
+      pool.emplace_back (worker);
+    worker ();
+    for (std::thread &t : pool) t.join ();
+  }
+
+  ExprVector applyTemplatesFromExperimentFile(Expr fdecl, const std::string &filepath)
+  {
+    CandidateTemplates templates (fdecl->efac ());
+    templates.load (filepath);
+    return templates.apply (fdecl);
   }
 
   void parseLemmasFromExpFile(Expr bvar, ExprVector& lemmas, const std::string &filepath)
   {
     std::ifstream in(filepath);
     std::string line;
-    if(in)
-    {
-      while (getline (in, line))
-      {
-        boost::char_separator<char> sep(",");
-        typedef boost::tokenizer< boost::char_separator<char>> t_tokenizer;
-        t_tokenizer tok(line, sep);
-        std::string op = *(tok.begin());
-        std::string number = *(++tok.begin());
-        int value = std::atoi(number.c_str());
-        if(op == "LEQ") lemmas.push_back(mk<LEQ>(bvar, mkTerm<mpz_class>(value, bvar->efac())));
-        else if(op == "GEQ") lemmas.push_back(mk<GEQ>(bvar, mkTerm<mpz_class>(value, bvar->efac())));
-        else if(op == "LT") lemmas.push_back(mk<LT>(bvar, mkTerm<mpz_class>(value, bvar->efac())));
-        else if(op == "GT") lemmas.push_back(mk<GT>(bvar, mkTerm<mpz_class>(value, bvar->efac())));
-      }
-    }
-    else
+    if(!in)
     {
       errs() << "FILE NOT EXIST!\n";
       return;
     }
+    while (getline (in, line))
+      if (Expr t = parseTemplate (line, bvar)) lemmas.push_back (t);
   }
 
   //	ExprVector relToCand(Expr fdecl)
@@ -4,9 +4,13 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/ValueMap.h"
 #include "llvm/IR/DataLayout.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include "boost/algorithm/string/replace.hpp"
 
+#include <algorithm>
 #include <memory>
 
 using namespace llvm;
@@ -21,8 +25,8 @@ namespace seahorn
       return Constant::getNullValue (ty);
     else if (isOpX<MPZ> (e) || bv::is_bvnum (e))
     {
-      mpz_class mpz;
-      mpz = isOpX<MPZ> (e) ? getTerm<mpz_class> (e) : getTerm<mpz_class> (e->arg (0));
+      const mpz_class &mpz =
+        isOpX<MPZ> (e) ? getTerm<mpz_class> (e) : getTerm<mpz_class> (e->arg (0));
       if (ty->isIntegerTy () || ty->isPointerTy())
       {
         // return Constant::getIntegerValue (ty,
@@ -42,12 +46,65 @@ namespace seahorn
     llvm_unreachable("Unhandled expression");
   }
 
-  std::unique_ptr<Module>  createLLVMHarness(BmcTrace &trace, const DataLayout &dl)
+  /// the bits of a value of the trace, as stored in a values file
+  static uint64_t exprToWord (Expr e)
   {
+    if (isOpX<TRUE> (e)) return 1;
+    if (isOpX<MPZ> (e)) return toAPInt (64, getTerm<mpz_class> (e)).getZExtValue ();
+    if (bv::is_bvnum (e)) return toAPInt (64, bv::toMpz (e)).getZExtValue ();
+    // -- false and all that is not handled, as by exprToLlvm
+    return 0;
+  }
 
-    std::unique_ptr<Module> Harness = make_unique<Module>("harness", getGlobalContext());
+  /// writes the values of every harness function as one table. The
+  /// format, in host byte order, is
+  ///   "SEAV" version:u32 tables:u32 reserved:u32
+  ///   tables x (first:u64 count:u64)
+  ///   values:u64...
+  /// where the values of a table are values [first, first + count)
+  static bool writeValuesFile (StringRef file,
+                               const std::vector<const ExprVector*> &tables)
+  {
+    std::error_code ec;
+    raw_fd_ostream out (file, ec, sys::fs::F_None);
+    if (ec)
+    {
+      errs () << "ERROR: cannot write harness values to " << file << ": "
+              << ec.message () << "\n";
+      return false;
+    }
+
+    auto put = [&out] (uint64_t w, unsigned bytes)
+      { out.write (reinterpret_cast<const char*> (&w), bytes); };
+    uint32_t version = 1;
+    uint32_t numTables = tables.size ();
+    out << "SEAV";
+    out.write (reinterpret_cast<const char*> (&version), 4);
+    out.write (reinterpret_cast<const char*> (&numTables), 4);
+    put (0, 4);
+
+    uint64_t first = 0;
+    for (const ExprVector *t : tables)
+    {
+      put (first, 8);
+      put (t->size (), 8);
+      first += t->size ();
+    }
+    for (const ExprVector *t : tables)
+      for (Expr e : *t) put (exprToWord (e), 8);
+    return true;
+  }
+
+  typedef ValueMap<const Function*, ExprVector> FuncValues;
+
+  static std::unique_ptr<Module> emitHarness (FuncValues &FuncValueMap,
+                                              const DataLayout &dl,
+                                              StringRef valuesFile);
 
-    ValueMap<const Function*, ExprVector> FuncValueMap;
+  std::unique_ptr<Module>  createLLVMHarness(BmcTrace &trace, const DataLayout &dl,
+                                             StringRef valuesFile)
+  {
+    FuncValues FuncValueMap;
 
     // Look for calls in the trace
     for (unsigned loc = 0; loc < trace.size(); loc++)
@@ -89,12 +146,82 @@ namespace seahorn
         }
       }
     }
+    return emitHarness (FuncValueMap, dl, valuesFile);
+  }
+
+  std::unique_ptr<Module> createLLVMHarness (const Module &M, StringRef fuzzLog,
+                                             const DataLayout &dl,
+                                             StringRef valuesFile)
+  {
+    auto buf = MemoryBuffer::getFile (fuzzLog);
+    if (!buf)
+    {
+      errs () << "ERROR: cannot read fuzzing log " << fuzzLog << ": "
+              << buf.getError ().message () << "\n";
+      return nullptr;
+    }
+
+    // -- the values outlive the harness functions that embed them
+    ExprFactory efac;
+    FuncValues FuncValueMap;
+
+    // -- one "name value" line per value returned by a stub of
+    // -- KleeInternalize, in the order they were returned
+    SmallVector<StringRef, 64> lines;
+    (*buf)->getBuffer ().split (lines, "\n", -1, false);
+    for (StringRef line : lines)
+    {
+      std::pair<StringRef, StringRef> nv = line.trim ().split (' ');
+      uint64_t word;
+      if (nv.first.empty () || nv.second.getAsInteger (10, word))
+      {
+        errs () << "WARNING: ignoring line of fuzzing log: " << line << "\n";
+        continue;
+      }
+
+      const Function *CF = M.getFunction (nv.first);
+      if (!CF || !CF->isDeclaration () ||
+          !(CF->getReturnType ()->isIntegerTy () ||
+            CF->getReturnType ()->isPointerTy ()))
+      {
+        LOG("cex", errs () << "Skipping harness for " << nv.first << "\n";);
+        continue;
+      }
+      FuncValueMap[CF].push_back (mkTerm (mpz_class (nv.second.str ()), efac));
+    }
+    return emitHarness (FuncValueMap, dl, valuesFile);
+  }
+
+  /// the harness functions of the values of every function
+  static std::unique_ptr<Module> emitHarness (FuncValues &FuncValueMap,
+                                              const DataLayout &dl,
+                                              StringRef valuesFile)
+  {
+    std::unique_ptr<Module> Harness = make_unique<Module>("harness", getGlobalContext());
+
+    // -- with a values file, the harness fetches the values from the
+    // -- table of its function, which the run-time maps from the file
+    bool useTables = !valuesFile.empty ();
+    std::vector<const ExprVector*> tables;
+    if (useTables)
+    {
+      Constant *path = ConstantDataArray::getString (getGlobalContext (), valuesFile);
+      new GlobalVariable (*Harness, path->getType (), true,
+                          GlobalValue::ExternalLinkage, path, "__seahorn_cex_values");
+    }
+
+    // -- in the order of their names, so that the tables of harnesses
+    // -- of the same program are numbered alike
+    std::vector<const Function*> Funcs;
+    for (auto &CFV : FuncValueMap) Funcs.push_back (CFV.first);
+    std::sort (Funcs.begin (), Funcs.end (),
+               [] (const Function *a, const Function *b)
+               { return a->getName () < b->getName (); });
 
     // Build harness functions
-    for (auto CFV : FuncValueMap) {
+    for (const Function *CF : Funcs) {
 
-      auto CF = CFV.first;
-      auto& values = CFV.second;
+      auto& values = FuncValueMap[CF];
 
       // This is where we will build the harness function
       Function *HF =
@@ -109,20 +236,6 @@ namespace seahorn
       else pRT = Type::getInt8PtrTy (getGlobalContext());
 
 
-      ArrayType* AT = ArrayType::get(RT, values.size());
-
-      // Convert Expr to LLVM constants
-      SmallVector<Constant*, 20> LLVMarray;
-      std::transform(values.begin(), values.end(), std::back_inserter(LLVMarray),
-                     [RT, dl](Expr e) { return exprToLlvm(RT, e, dl); });
-
-      // This is an array containing the values to be returned
-      GlobalVariable* CA = new GlobalVariable(*Harness,
-                                              AT,
-                                              true,
-                                              GlobalValue::PrivateLinkage,
-                                              ConstantArray::get(AT, LLVMarray));
-
       // Build the body of the harness function
       BasicBlock *BB = BasicBlock::Create(getGlobalContext(), "entry", HF);
       IRBuilder<> Builder(BB);
@@ -141,12 +254,40 @@ namespace seahorn
                           Counter);
 
       std::string name;
-      std::vector <Type *> ArgTypes =
-        {CountType, pRT, CountType};
-      std::vector <Value *> Args =
-        {LoadCounter,
-         Builder.CreateBitCast(CA, pRT),
-         ConstantInt::get(CountType, values.size())};
+      std::vector <Type *> ArgTypes;
+      std::vector <Value *> Args;
+      std::string prefix;
+      if (useTables)
+      {
+        // -- __seahorn_get_value_tbl_<ty> (table, counter)
+        prefix = "__seahorn_get_value_tbl_";
+        ArgTypes = {CountType, CountType};
+        Args = {ConstantInt::get (CountType, tables.size ()), LoadCounter};
+        tables.push_back (&values);
+      }
+      else
+      {
+        ArrayType* AT = ArrayType::get(RT, values.size());
+
+        // Convert Expr to LLVM constants
+        SmallVector<Constant*, 20> LLVMarray;
+        std::transform(values.begin(), values.end(), std::back_inserter(LLVMarray),
+                       [RT, dl](Expr e) { return exprToLlvm(RT, e, dl); });
+
+        // This is an array containing the values to be returned
+        GlobalVariable* CA = new GlobalVariable(*Harness,
+                                                AT,
+                                                true,
+                                                GlobalValue::PrivateLinkage,
+                                                ConstantArray::get(AT, LLVMarray));
+
+        // -- __seahorn_get_value_<ty> (counter, array, size)
+        prefix = "__seahorn_get_value_";
+        ArgTypes = {CountType, pRT, CountType};
+        Args = {LoadCounter,
+                Builder.CreateBitCast(CA, pRT),
+                ConstantInt::get(CountType, values.size())};
+      }
 
       if (RT->isIntegerTy ())
       {
@@ -154,10 +295,10 @@ namespace seahorn
         llvm::raw_string_ostream RSO(RS);
         RT->print(RSO);
 
-        name = Twine("__seahorn_get_value_").concat(RSO.str()).str();
+        name = Twine(prefix).concat(RSO.str()).str();
       }
       else if (RT->getSequentialElementType ()) {
-        name = "__seahorn_get_value_ptr";
+        name = prefix + "ptr";
         ArgTypes.push_back (Type::getInt32Ty (getGlobalContext ()));
 
         // If we can tell how big the return type is, tell the
@@ -182,6 +323,8 @@ namespace seahorn
       Builder.CreateRet(RetValue);
     }
 
+    if (useTables) writeValuesFile (valuesFile, tables);
+
     return (Harness);
   }
 }
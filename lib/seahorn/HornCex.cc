@@ -18,6 +18,7 @@
 
 #include "seahorn/Transforms/Utils/Local.hh"
 #include "seahorn/Bmc.hh"
+#include "seahorn/FunctionAnalysisCache.hh"
 
 #include "boost/range.hpp"
 #include "boost/range/adaptor/reversed.hpp"
@@ -44,19 +45,36 @@
 
 
 #include <gmpxx.h>
+#include <memory>
+#include <thread>
 
 static llvm::cl::opt<std::string>
 HornCexFile("horn-cex", llvm::cl::desc("Counterexample in SV-COMP (.xml) or LLVM bitcode (.bc or .ll) format"),
               llvm::cl::init(""), llvm::cl::value_desc("filename"));
 
+static llvm::cl::opt<std::string>
+HornCexValues("horn-cex-values",
+              llvm::cl::desc("Write the values of an LLVM counterexample harness to this "
+                             "file, loaded by the run-time, instead of embedding them"),
+              llvm::cl::init(""), llvm::cl::value_desc("filename"));
+
 static llvm::cl::opt<bool>
 UseBv ("horn-cex-bv",
        llvm::cl::desc("Construct bit-precise counterexamples"),
        llvm::cl::init (false));
 
+static llvm::cl::opt<bool>
+Direct ("horn-cex-direct",
+        llvm::cl::desc ("Take the states at the cutpoints of the counterexample "
+                        "from the ground refutation of the solver, so that "
+                        "validation only fills in the edges between them. "
+                        "Ignored with --horn-cex-bv"),
+        llvm::cl::init (false));
+
 static llvm::cl::opt<bool>
 MemSim ("horn-cex-bv-memsim",
-        llvm::cl::desc ("Run memory simulation on the counterexample"),
+        llvm::cl::desc ("Run memory simulation on the counterexample "
+                        "(only with --horn-cex or --horn-bmc-slice)"),
         llvm::cl::init (false));
 
 static llvm::cl::opt<std::string>
@@ -96,7 +114,91 @@ namespace seahorn
   static void dumpLLVMCex (BmcTrace &trace, StringRef CexFile, const DataLayout &dl);
   static void dumpLLVMBitcode(const Module &M, StringRef BcFile);
 
+  /// true if the branch of bb was sliced away by --slice-program,
+  /// i.e., the trace could take either of its successors
+  static bool isSlicedBranch (const BasicBlock &bb)
+  {
+    const BranchInst *br = dyn_cast<BranchInst> (bb.getTerminator ());
+    if (!br || !br->isConditional ()) return false;
+    const CallInst *ci = dyn_cast<CallInst> (br->getCondition ());
+    return ci && ci->getCalledFunction () &&
+      ci->getCalledFunction ()->getName ().equals ("verifier.nondet.sliced");
+  }
+
   char HornCex::ID = 0;
+
+  namespace
+  {
+    /// validation of a cut-point trace under one semantics
+    struct CexCheck
+    {
+      BmcEngine bmc;
+      boost::tribool res;
+
+      template <typename Range>
+      CexCheck (SmallStepSymExec &sem, EZ3 &zctx, const Range &cps) :
+        bmc (sem, zctx), res (boost::indeterminate)
+      { for (const CutPoint *cp : cps) bmc.addCutPoint (*cp); }
+
+      void run () { bmc.encode (); res = bmc.solve (); }
+    };
+
+    /// true if e is a value that can be pinned, i.e., not an array
+    bool isGroundValue (Expr e)
+    {
+      return isOpX<MPZ> (e) || isOpX<TRUE> (e) || isOpX<FALSE> (e) ||
+        bv::is_bvnum (e);
+    }
+
+    /// the applications of the ground refutation apps at the cutpoints
+    /// of cpTrace after the entry, one for each. False if the
+    /// refutation does not follow cpTrace
+    bool groundPath (const ExprVector &apps, HornifyModule &hm,
+                     const CutPointGraph &cpg, const Function &F,
+                     ArrayRef<const CutPoint*> cpTrace, ExprVector &path)
+    {
+      for (Expr a : apps)
+      {
+        if (!hm.isBbPredicate (a)) continue;
+        const BasicBlock &bb = hm.predicateBb (a);
+        if (bb.getParent () != &F || !cpg.isCutPoint (bb)) continue;
+        path.push_back (a);
+      }
+      // -- bottom-up, from the query
+      if (!path.empty () && &hm.predicateBb (path.back ()) == &F.getEntryBlock ())
+        boost::reverse (path);
+      // -- as the rules, with or without the entry
+      if (!path.empty () && &hm.predicateBb (path [0]) == &F.getEntryBlock ())
+        path.erase (path.begin ());
+
+      if (path.size () + 1 != cpTrace.size ()) return false;
+      for (unsigned i = 0; i < path.size (); ++i)
+        if (&hm.predicateBb (path [i]) != &cpTrace [i + 1]->bb ()) return false;
+      return true;
+    }
+
+    /// assumes the values of path at the states of the cutpoints of
+    /// bmc after the entry. Returns the number of pinned registers
+    unsigned pinStates (BmcEngine &bmc, HornifyModule &hm, const ExprVector &path)
+    {
+      bmc.encode ();
+      unsigned pinned = 0;
+      for (unsigned i = 0; i < path.size (); ++i)
+      {
+        Expr app = path [i];
+        const ExprVector &live = hm.live (hm.predicateBb (app));
+        if (live.size () + 1 != app->arity ()) continue;
+        for (unsigned j = 0; j < live.size (); ++j)
+        {
+          Expr v = app->arg (j + 1);
+          if (!isGroundValue (v)) continue;
+          bmc.assume (mk<EQ> (bmc.state (i + 1).eval (live [j]), v));
+          ++pinned;
+        }
+      }
+      return pinned;
+    }
+  }
   
   bool HornCex::runOnModule (Module &M)
   {
@@ -116,11 +218,10 @@ namespace seahorn
          << F << "\n";);
 
     HornifyModule &hm = getAnalysis<HornifyModule> ();
-    const CutPointGraph &cpg = getAnalysis<CutPointGraph> (F);
+    const CutPointGraph &cpg = getAnalysis<FunctionAnalysisCache> ().cpg (F);
     
-    auto &fp = hs.getZFixedPoint ();
     ExprVector rules;
-    fp.getCexRules (rules);
+    hs.getCexRules (hm.getHornClauseDB (), rules);
     boost::reverse (rules);
     
     // extract a trace of basic blocks corresponding to the counterexample
@@ -176,41 +277,116 @@ namespace seahorn
          {
            errs () << bb->getName ();
            if (cpg.isCutPoint (*bb)) errs () << " C";
+           if (isSlicedBranch (*bb)) errs () << " S";
            errs () << "\n";
          }
          errs () << "TRACE END\n";);
+
+    // -- the trace is over the sliced program. Its blocks are the
+    // -- blocks of the original one, but the branches that were
+    // -- sliced away need not agree with their original conditions
+    unsigned sliced = 0;
+    for (auto bb : bbTrace) if (isSlicedBranch (*bb)) ++sliced;
+    if (sliced > 0)
+    {
+      Stats::uset ("HornCex.SlicedBranches", sliced);
+      errs () << "Warning: cex takes " << sliced
+              << " branches removed by --slice-program\n";
+    }
     
     // -- release trace resources
     bbTrace.clear ();
     
-    // -- create a BMC engine. Use fixed symbolic execution
+    // -- validate the trace with BMC. Use fixed symbolic execution
     // -- semantics. Possibly different than the semantics used by the
-    // -- HornSolver
+    // -- HornSolver. With --horn-cex-bv the trace is validated both
+    // -- over integers and bit-precisely, concurrently if the factory
+    // -- allows it
     ExprFactory &efac = hm.getExprFactory ();
-    
+
     UfoSmallSymExec semUfo (efac, *this, MEM);
-    BvSmallSymExec semBv (efac, *this, MEM);
-    
-    SmallStepSymExec *sem = UseBv ? static_cast<SmallStepSymExec*>(&semBv) :
-      static_cast<SmallStepSymExec*>(&semUfo);
-    BmcEngine bmc (*sem, hm.getZContext ());
-    
-    // -- load the trace into the engine
-    for (const CutPoint *cp : cpTrace)
-      bmc.addCutPoint (*cp);
-    
-    // -- construct BMC instance
-    bmc.encode ();
+    CexCheck intCheck (semUfo, hm.getZContext (), cpTrace);
+
+    std::unique_ptr<EZ3> bvCtx;
+    std::unique_ptr<BvSmallSymExec> semBv;
+    std::unique_ptr<CexCheck> bvCheck;
+    if (UseBv)
+    {
+      // -- a context of its own, Z3 contexts are not thread-safe
+      bvCtx.reset (new EZ3 (efac));
+      semBv.reset (new BvSmallSymExec (efac, *this, MEM));
+      // -- the theory-neutral analysis of the trace is done once
+      semBv->shareEncoding (semUfo);
+      bvCheck.reset (new CexCheck (*semBv, *bvCtx, cpTrace));
+    }
+
+    // -- with the states at the cutpoints given by the refutation,
+    // -- the edges between them are solved on their own
+    ExprVector groundApps, path;
+    if (Direct && !UseBv && hs.getGroundCex (groundApps))
+    {
+      if (groundPath (groundApps, hm, cpg, F, cpTrace, path))
+        Stats::uset ("HornCex.PinnedRegisters", pinStates (intCheck.bmc, hm, path));
+      else
+      {
+        errs () << "Warning: the ground refutation does not follow the cex. "
+                << "Validating with BMC\n";
+        path.clear ();
+      }
+    }
+
+    {
+      ScopedStats _st ("HornCex.validate");
+      if (bvCheck && efac.isConcurrent ())
+      {
+        std::thread bvThread ([&bvCheck] () { bvCheck->run (); });
+        intCheck.run ();
+        bvThread.join ();
+      }
+      else
+      {
+        intCheck.run ();
+        if (bvCheck) bvCheck->run ();
+      }
+    }
+
+    // -- the values of the refutation may be over another semantics,
+    // -- e.g., of --horn-sem-lvl, than the one of the validation
+    std::unique_ptr<CexCheck> fullCheck;
+    if (!path.empty () && !static_cast<bool> (intCheck.res))
+    {
+      errs () << "Warning: the states of the ground refutation are infeasible. "
+              << "Validating with BMC\n";
+      ScopedStats _st ("HornCex.validate");
+      fullCheck.reset (new CexCheck (semUfo, hm.getZContext (), cpTrace));
+      fullCheck->run ();
+    }
+    else if (!path.empty ())
+      Stats::count ("HornCex.Direct");
+
+    CexCheck *check = bvCheck ? bvCheck.get () : 
+      fullCheck ? fullCheck.get () : &intCheck;
+    if (bvCheck && intCheck.res)
+    {
+      if (!bvCheck->res)
+        errs () << "Warning: cex is feasible over integers only\n";
+      else if (boost::indeterminate (bvCheck->res))
+      {
+        errs () << "Warning: bit-precise validation is unknown. "
+                << "Using the integer cex\n";
+        check = &intCheck;
+      }
+    }
 
     if (!HornCexSmtFilename.empty ())
     {
       std::error_code EC;
       raw_fd_ostream file (HornCexSmtFilename, EC, sys::fs::F_Text);
-      if (!EC) bmc.toSmtLib (file);
+      if (!EC) check->bmc.toSmtLib (file);
       else errs () << "Could not open: " << HornCexSmtFilename << "\n";
     }
     
-    auto res = bmc.solve ();
+    auto res = check->res;
     LOG ("cex",
          errs () << "BMC: " 
          << (res ? "sat" : (!res ? "unsat" : "unknown")) << "\n";);
@@ -222,29 +398,33 @@ namespace seahorn
       errs () << "Warning: failed to validate cex\n";
       errs () << "Computing unsat core\n";
       ExprVector core;
-      bmc.unsatCore (core);
+      check->bmc.unsatCore (core);
       errs () << "Final core: " << core.size () << "\n";
       errs () << "Failed to validate CEX. Core is: \n";
-      for (Expr c : core) errs () << *c << "\n";
+      for (Expr c : core) errs () << dag (c) << "\n";
       
       Stats::sset("Result", "FAILED");
       return false;
     }
     
     // get bmc trace
-    BmcTrace trace (bmc.getTrace ());
+    BmcTrace trace (check->bmc.getTrace ());
     LOG ("cex", trace.print (errs ()););
 
-    
-    if (UseBv)
+    // -- the memory simulation only matters to the outputs built
+    // -- from the trace
+    if (MemSim && check == bvCheck.get ())
     {
-      const DataLayout &dl = getAnalysis<DataLayoutPass> ().getDataLayout();
-      const TargetLibraryInfo &tli = getAnalysis<TargetLibraryInfo> ();
-      if (MemSim)
+      if (!HornCexFile.empty () || !BmcSliceOutputFile.empty ())
       {
+        const DataLayout &dl = getAnalysis<DataLayoutPass> ().getDataLayout();
+        const TargetLibraryInfo &tli = getAnalysis<TargetLibraryInfo> ();
         MemSimulator memSim (trace, dl, tli);
-        bool simRes = memSim.simulate ();
+        memSim.simulate ();
       }
+      else
+        LOG ("cex", errs () << "Skipping memory simulation: "
+             << "no --horn-cex or --horn-bmc-slice\n";);
     }
     
     StringRef HornCexFileRef(HornCexFile);
@@ -273,16 +453,10 @@ namespace seahorn
       for (int i = 0; i < cpTrace.size(); i++) {
         const CutPoint *cp = cpTrace[i];
         region.insert(&cp->bb());
-        for (CutPoint::const_iterator it = cp->succ_begin();
-             it != cp->succ_end(); it++) {
-          const CpEdge *const edge = *it;
-          if (&edge->target() == cpTrace[i + 1]) {
-            for (CpEdge::const_iterator bb = edge->begin(); bb != edge->end();
-                 bb++) {
-              region.insert(&*bb);
-            }
-          }
-        }
+        if (i + 1 == cpTrace.size()) continue;
+        if (const CpEdge *edge = cpg.getEdge(*cp, *cpTrace[i + 1]))
+          for (const BasicBlock &bb : *edge)
+            region.insert(&bb);
       }
       reduceToRegion(F, region);
       dumpLLVMBitcode(M, CpSliceOutputFile.c_str());
@@ -297,7 +471,7 @@ namespace seahorn
     AU.setPreservesAll ();
     AU.addRequired<DataLayoutPass> ();
     AU.addRequired<TargetLibraryInfo> ();
-    AU.addRequired<CutPointGraph> ();
+    AU.addRequired<FunctionAnalysisCache> ();
     AU.addRequired<HornifyModule> ();
     AU.addRequired<HornSolver> ();
     AU.addRequired<CanFail> ();
@@ -440,7 +614,7 @@ namespace seahorn
 
   static void dumpLLVMCex(BmcTrace &trace, StringRef CexFile, const DataLayout &dl)
   {
-    std::unique_ptr<Module> Harness = createLLVMHarness(trace, dl);
+    std::unique_ptr<Module> Harness = createLLVMHarness(trace, dl, HornCexValues);
     std::error_code error_code;
     llvm::tool_output_file out(CexFile, error_code, sys::fs::F_None);
     assert (!error_code);
@@ -0,0 +1,80 @@
+#include "seahorn/HornCheckpoint.hh"
+
+#include "llvm/Support/CommandLine.h"
+#include "ufo/ExprIO.hpp"
+
+#include <algorithm>
+
+static llvm::cl::opt<std::string>
+CheckpointPrefix ("horn-checkpoint",
+                  llvm::cl::desc ("Write checkpoints of the solver to files "
+                                  "starting with this prefix"),
+                  llvm::cl::init (""), llvm::cl::value_desc ("prefix"));
+
+static llvm::cl::opt<unsigned>
+CheckpointPeriod ("horn-checkpoint-period",
+                  llvm::cl::desc ("Seconds between two checkpoints"),
+                  llvm::cl::init (600));
+
+static llvm::cl::opt<bool>
+Resume ("horn-resume",
+        llvm::cl::desc ("Start from the checkpoints of --horn-checkpoint "
+                        "that exist"),
+        llvm::cl::init (false));
+
+namespace seahorn
+{
+  using namespace expr;
+
+  bool HornCheckpoint::enabled () { return !CheckpointPrefix.empty (); }
+
+  bool HornCheckpoint::resume () { return enabled () && Resume; }
+
+  unsigned HornCheckpoint::periodMs ()
+  { return std::max (1U, (unsigned) CheckpointPeriod) * 1000; }
+
+  std::string HornCheckpoint::file (const std::string &part)
+  { return CheckpointPrefix + "." + part; }
+
+  bool HornCheckpoint::due (clock::time_point &last)
+  {
+    if (!enabled ()) return false;
+    clock::time_point now = clock::now ();
+    // -- the first call starts the clock
+    if (last == clock::time_point ())
+    {
+      last = now;
+      return false;
+    }
+    if (now - last < std::chrono::milliseconds (periodMs ())) return false;
+    last = now;
+    return true;
+  }
+
+  bool HornCheckpoint::saveDepth (const std::string &part, unsigned depth,
+                                  const std::vector<unsigned> &sig,
+                                  ExprFactory &efac)
+  {
+    ExprVector roots;
+    roots.push_back (mkTerm<std::string> (part, efac));
+    roots.push_back (mkTerm<unsigned> (depth, efac));
+    for (unsigned v : sig) roots.push_back (mkTerm<unsigned> (v, efac));
+    return exprio::saveAtomic (file (part), roots);
+  }
+
+  unsigned HornCheckpoint::loadDepth (const std::string &part,
+                                      const std::vector<unsigned> &sig,
+                                      ExprFactory &efac)
+  {
+    ExprVector roots;
+    if (!exprio::load (file (part), efac, std::back_inserter (roots))) return 0;
+    if (roots.size () != sig.size () + 2) return 0;
+    if (!isOpX<STRING> (roots [0]) || getTerm<std::string> (roots [0]) != part)
+      return 0;
+    for (size_t i = 1; i < roots.size (); ++i)
+      if (!isOpX<UINT> (roots [i])) return 0;
+    for (size_t i = 0; i < sig.size (); ++i)
+      if (getTerm<unsigned> (roots [i + 2]) != sig [i]) return 0;
+    return getTerm<unsigned> (roots [1]);
+  }
+}
@@ -7,9 +7,12 @@
 #include <boost/lexical_cast.hpp>
 
 #include "ufo/ExprLlvm.hpp"
+#include "ufo/ExprIO.hpp"
 #include "avy/AvyDebug.h"
 
 #include <sstream>
+#include <cstdio>
+#include <unistd.h>
 
 namespace seahorn
 {
@@ -18,51 +21,159 @@ namespace seahorn
   {
     m_body_idx.clear ();
     m_head_idx.clear ();
+    m_rule_idx.clear ();
+    m_rule_ids.clear ();
+    m_num_tombstones = 0;
+    m_pending_rels.clear ();
   }
   
+  void HornClauseDB::clear ()
+  {
+    m_rels.clear ();
+    m_vars.clear ();
+    m_var_set.clear ();
+    m_rules.clear ();
+    m_queries.clear ();
+    m_constraints.clear ();
+    resetIndexes ();
+  }
+  
+  void HornClauseDB::indexRule (RuleId id)
+  {
+    HornRule &r = *m_rule_ids [id];
+    m_rule_idx.insert (std::make_pair (r.hash (), id));
+    // -- update head index
+    m_head_idx [bind::fname (r.head ())].insert (id);
+    // -- update body index
+    ExprVector use;
+    r.used_relations (*this, std::back_inserter (use));
+    for (Expr decl : use) m_body_idx[decl].insert (id);
+  }
+
+  void HornClauseDB::unindexRule (RuleId id)
+  {
+    HornRule &r = *m_rule_ids [id];
+    auto range = m_rule_idx.equal_range (r.hash ());
+    for (auto i = range.first; i != range.second; ++i)
+      if (i->second == id) { m_rule_idx.erase (i); break; }
+
+    auto head = m_head_idx.find (bind::fname (r.head ()));
+    if (head != m_head_idx.end ())
+    {
+      head->second.erase (id);
+      if (head->second.empty ()) m_head_idx.erase (head->first);
+    }
+
+    ExprVector use;
+    r.used_relations (*this, std::back_inserter (use));
+    for (Expr decl : use)
+    {
+      auto body = m_body_idx.find (decl);
+      if (body == m_body_idx.end ()) continue;
+      body->second.erase (id);
+      if (body->second.empty ()) m_body_idx.erase (decl);
+    }
+  }
+
+  void HornClauseDB::registerRelation (Expr fdecl)
+  {
+    if (m_rels.insert (fdecl).second && !m_rules.empty ())
+      m_pending_rels.push_back (fdecl);
+  }
+
+  void HornClauseDB::indexPendingRelations () const
+  {
+    std::sort (m_pending_rels.begin (), m_pending_rels.end ());
+    // -- one pass over the rules for all relations registered late
+    for (RuleId id = 0; id < m_rule_ids.size (); ++id)
+    {
+      if (!isLive (id)) continue;
+      ExprVector use;
+      getRule (id).used_relations (*this, std::back_inserter (use));
+      for (Expr decl : use)
+        if (std::binary_search (m_pending_rels.begin (), 
+                                m_pending_rels.end (), decl))
+          m_body_idx [decl].insert (id);
+    }
+    m_pending_rels.clear ();
+  }
+
   void HornClauseDB::buildIndexes ()
   {
     resetIndexes ();
       
     /// update indexes
-    for (HornRule &r : m_rules)
+    for (auto it = m_rules.begin (), end = m_rules.end (); it != end; ++it)
     {
-      // -- update head index
-      m_head_idx [bind::fname (r.head ())].insert (&r);
-      // -- update body index
-      ExprVector use;
-      r.used_relations (*this, std::back_inserter (use));
-      for (Expr decl : use) m_body_idx[decl].insert (&r);
+      m_rule_ids.push_back (it);
+      indexRule (m_rule_ids.size () - 1);
+    }
+  }
+
+  void HornClauseDBCallGraph::ruleEdges 
+  (const HornRule &rule, std::vector<std::pair<Expr, Expr> > &out) const
+  {
+    Expr head = bind::fname (rule.head ());
+    ExprVector body;
+    rule.used_relations (m_db, std::back_inserter (body));
+    for (Expr p : body) out.push_back (std::make_pair (p, head));
+  }
+
+  bool HornClauseDBCallGraph::addRule (const HornRule &rule)
+  {
+    std::vector<std::pair<Expr, Expr> > edges;
+    ruleEdges (rule, edges);
+    bool changed = false;
+    for (auto &e : edges)
+    {
+      if (m_edge_count [e]++ > 0) continue;
+      m_callees [e.first].insert (e.second);
+      m_callers [e.second].insert (e.first);
+      changed = true;
+    }
+    // -- the entry has no callers
+    if (changed && hasEntry () && !callers (m_cg_entry).empty ()) findEntry ();
+    return changed;
+  }
 
+  bool HornClauseDBCallGraph::removeRule (const HornRule &rule)
+  {
+    std::vector<std::pair<Expr, Expr> > edges;
+    ruleEdges (rule, edges);
+    bool changed = false;
+    for (auto &e : edges)
+    {
+      auto it = m_edge_count.find (e);
+      if (it == m_edge_count.end () || --it->second > 0) continue;
+      m_edge_count.erase (it);
+      m_callees [e.first].erase (e.second);
+      m_callers [e.second].erase (e.first);
+      changed = true;
     }
+    if (changed && !hasEntry ()) findEntry ();
+    return changed;
   }
 
   void HornClauseDBCallGraph::buildCallGraph ()
   {
-    // indexes must be first computed
-    m_db.buildIndexes ();
-    
+    m_callers.clear ();
+    m_callees.clear ();
+    m_edge_count.clear ();
     for (auto p: m_db.getRelations ())
     {
-      // -- callees
-      HornClauseDB::expr_set_type callees;
-      const boost::container::flat_set<HornRule*>& uses = m_db.use(p);
-      for (const HornRule* r: uses)
-      { callees.insert(bind::fname(r->head())); }
-      m_callees.insert(std::make_pair(p, callees));
-
-      // -- callers
-      HornClauseDB::expr_set_type callers;
-      const boost::container::flat_set<HornRule*>& defs = m_db.def(p);
-      for (const HornRule* r: defs)
-        filter (r->body (), HornClauseDB::IsRelation(m_db),
-                std::inserter(callers, callers.begin())); 
-      m_callers.insert(std::make_pair(p, callers));
-
-      LOG("horn-cg", 
+      m_callers [p];
+      m_callees [p];
+    }
+    for (const HornRule &r : m_db.getRules ()) addRule (r);
+
+    LOG("horn-cg", 
+        for (auto p: m_db.getRelations ())
+        {
+          const HornClauseDB::expr_set_type &callers = this->callers (p);
+          const HornClauseDB::expr_set_type &callees = this->callees (p);
           errs () << *(bind::fname(p)) << "\n"
-          << "\tNumber of callers=" << callers.size() << "\n"
-          << "\tNumber of callees=" << callees.size() << "\n";
+                  << "\tNumber of callers=" << callers.size() << "\n"
+                  << "\tNumber of callees=" << callees.size() << "\n";
           if (!callers.empty()) {
             errs () << "\tCALLERS=";
             for (auto c: callers) {
@@ -76,9 +187,15 @@ namespace seahorn
               errs ()  << *(bind::fname(c)) << "  ";
             }
             errs () << "\n";
-          });
-    }
+          }
+        });
 
+    findEntry ();
+  }
+
+  void HornClauseDBCallGraph::findEntry ()
+  {
+    m_cg_entry = mk<FALSE> (m_db.getExprFactory ());
     // XXX: we are looking for a predicate that corresponds to the
     // entry block of main. It is not enough to search for a predicate
     // with no callers since predicates from each function entry won't
@@ -94,16 +211,18 @@ namespace seahorn
     }
 
     LOG("horn-cg", 
-        errs () << "Entry=" << *(bind::fname(m_cg_entry)) << "\n";);
+        if (hasEntry ()) errs () << "Entry=" << *(bind::fname(m_cg_entry)) << "\n";);
   }
 
-  const ExprVector &HornClauseDB::getVars () const
+  void HornClauseDB::reserve (size_t rules, size_t rels, size_t vars)
   {
-    boost::sort (m_vars);
-    m_vars.resize (std::distance (m_vars.begin (),
-                                  std::unique (m_vars.begin (),
-                                               m_vars.end ())));
-    return m_vars;
+    m_rels.reserve (rels);
+    m_head_idx.reserve (rels);
+    m_body_idx.reserve (rels);
+    m_var_set.reserve (vars);
+    m_vars.reserve (vars);
+    m_rule_ids.reserve (rules);
+    m_rule_idx.reserve (rules);
   }
 
   void HornClauseDB::addConstraint (Expr pred, Expr lemma)
@@ -123,6 +242,19 @@ namespace seahorn
     m_constraints [reln].push_back (replace (lemma, sub));
   }
 
+  void HornClauseDB::merge (const HornClauseDB &o)
+  {
+    for (Expr rel : o.m_rels) registerRelation (rel);
+    for (const HornRule &r : o.m_rules) addRule (r);
+    for (Expr q : o.m_queries) addQuery (q);
+    // -- constraints are already over bound variables
+    for (auto &kv : o.m_constraints)
+    {
+      ExprVector &lemmas = m_constraints [kv.first];
+      lemmas.insert (lemmas.end (), kv.second.begin (), kv.second.end ());
+    }
+  }
+
   Expr HornClauseDB::getConstraints (Expr pred) const
   {
     assert (bind::isFapp (pred));
@@ -146,6 +278,124 @@ namespace seahorn
     return replace (lemma, sub);
   }
   
+  namespace
+  {
+    Expr mkCount (size_t n, ExprFactory &efac)
+    { return mkTerm<unsigned> (n, efac); }
+
+    /// reads the roots written by HornClauseDB::save
+    struct RootReader
+    {
+      const ExprVector &m_roots;
+      size_t m_pos;
+      RootReader (const ExprVector &roots) : m_roots (roots), m_pos (0) {}
+
+      bool next (Expr &e)
+      {
+        if (m_pos >= m_roots.size ()) return false;
+        e = m_roots [m_pos++];
+        return true;
+      }
+      bool count (unsigned &n)
+      {
+        Expr e;
+        if (!next (e) || !isOpX<UINT> (e)) return false;
+        n = getTerm<unsigned> (e);
+        return n <= m_roots.size () - m_pos;
+      }
+    };
+  }
+
+  bool HornClauseDB::save (const std::string &fname) const
+  {
+    ufo::ScopedStats _st_("HornClauseDB::save");
+
+    ExprVector roots;
+    roots.push_back (mkCount (m_rels.size (), m_efac));
+    roots.insert (roots.end (), m_rels.begin (), m_rels.end ());
+    roots.push_back (mkCount (m_rules.size (), m_efac));
+    for (const HornRule &r : m_rules)
+    {
+      roots.push_back (mkCount (r.vars ().size (), m_efac));
+      roots.insert (roots.end (), r.vars ().begin (), r.vars ().end ());
+      roots.push_back (r.head ());
+      roots.push_back (r.body ());
+    }
+    roots.push_back (mkCount (m_queries.size (), m_efac));
+    roots.insert (roots.end (), m_queries.begin (), m_queries.end ());
+    roots.push_back (mkCount (m_constraints.size (), m_efac));
+    for (auto &kv : m_constraints)
+    {
+      roots.push_back (kv.first);
+      roots.push_back (mkCount (kv.second.size (), m_efac));
+      roots.insert (roots.end (), kv.second.begin (), kv.second.end ());
+    }
+
+    exprio::nameOpaqueTerminals (roots, m_efac);
+    return exprio::saveAtomic (fname, roots);
+  }
+
+  bool HornClauseDB::load (const std::string &fname)
+  {
+    ufo::ScopedStats _st_("HornClauseDB::load");
+
+    ExprVector roots;
+    if (!exprio::load (fname, m_efac, std::back_inserter (roots))) return false;
+
+    // -- read everything before changing the database
+    RootReader in (roots);
+    unsigned n;
+    ExprVector rels;
+    if (!in.count (n)) return false;
+    for (unsigned i = 0; i < n; ++i)
+    {
+      Expr rel;
+      if (!in.next (rel) || !bind::isFdecl (rel)) return false;
+      rels.push_back (rel);
+    }
+
+    std::vector<HornRule> rules;
+    if (!in.count (n)) return false;
+    for (unsigned i = 0; i < n; ++i)
+    {
+      unsigned nvars;
+      if (!in.count (nvars)) return false;
+      ExprVector vars (nvars);
+      for (Expr &v : vars) if (!in.next (v)) return false;
+      Expr head, body;
+      if (!in.next (head) || !in.next (body)) return false;
+      rules.push_back (HornRule (vars, head, body));
+    }
+
+    ExprVector queries;
+    if (!in.count (n)) return false;
+    queries.resize (n);
+    for (Expr &q : queries) if (!in.next (q)) return false;
+
+    std::map<Expr, ExprVector> constraints;
+    if (!in.count (n)) return false;
+    for (unsigned i = 0; i < n; ++i)
+    {
+      Expr rel;
+      unsigned nlemmas;
+      if (!in.next (rel) || !in.count (nlemmas)) return false;
+      ExprVector &lemmas = constraints [rel];
+      lemmas.resize (nlemmas);
+      for (Expr &l : lemmas) if (!in.next (l)) return false;
+    }
+
+    for (Expr rel : rels) registerRelation (rel);
+    for (const HornRule &r : rules) addRule (r);
+    for (Expr q : queries) addQuery (q);
+    // -- constraints are already over bound variables
+    for (auto &kv : constraints)
+    {
+      ExprVector &lemmas = m_constraints [kv.first];
+      lemmas.insert (lemmas.end (), kv.second.begin (), kv.second.end ());
+    }
+    return true;
+  }
+
   raw_ostream& HornClauseDB::write (raw_ostream& o) const
   {
     std::ostringstream oss;
@@ -163,33 +413,29 @@ namespace seahorn
     return o;
   }
 
-  HornClauseDB::horn_set_type HornClauseDB::m_empty_set;
+  HornClauseDB::rule_id_set HornClauseDB::m_empty_set;
   HornClauseDB::expr_set_type HornClauseDBCallGraph::m_expr_empty_set;
 
   Expr extractTransitionRelation(HornRule r, HornClauseDB &db)
   {
-    Expr ruleBody = r.body();
-    ExprMap body_map;
-    ExprVector body_pred_apps;
-    get_all_pred_apps(ruleBody, db, std::back_inserter(body_pred_apps));
-
-    for (Expr p : body_pred_apps)
-      body_map.insert (std::make_pair (p, mk<TRUE> (p->efac ())));
-
-    Expr body_constraints = replace(ruleBody, body_map);
-    return body_constraints;
+    ExprVector constraints;
+    IsPredApp isApp (db);
+    for (Expr c : r.conjuncts ())
+      if (!isApp (c)) constraints.push_back (c);
+    if (constraints.empty ()) return mk<TRUE> (db.getExprFactory ());
+    return boolop::land (constraints);
   }
 
   bool hasBvarInRule(HornRule r, HornClauseDB &db,
-                          std::map<Expr, ExprVector> currentCandidates)
+                          const std::map<Expr, ExprVector> &currentCandidates)
   {
     ExprVector pred_vector;
-    get_all_pred_apps(r.body(), db, std::back_inserter(pred_vector));
+    r.pred_apps(db, std::back_inserter(pred_vector));
     pred_vector.push_back(r.head());
 
     for (Expr pred : pred_vector)
     {
-      ExprVector term_vec = currentCandidates.find(bind::fname(pred))->second;
+      const ExprVector &term_vec = currentCandidates.find(bind::fname(pred))->second;
       if(term_vec.size() > 1 || (term_vec.size() == 1 && !isOpX<TRUE>(term_vec[0])))
         return true;
     }
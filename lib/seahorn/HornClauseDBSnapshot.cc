@@ -0,0 +1,174 @@
+#include "seahorn/HornClauseDBSnapshot.hh"
+
+namespace seahorn
+{
+  const unsigned HornClauseDBSnapshot::ChunkSize;
+  HornClauseDBSnapshot::rule_id_set HornClauseDBSnapshot::m_empty_set;
+
+  HornClauseDBSnapshot::Ptr HornClauseDBSnapshot::make (const HornClauseDB &db)
+  {
+    HornClauseDBSnapshot empty;
+    empty.m_rels = std::make_shared<const expr_set_type> ();
+    empty.m_queries = std::make_shared<const ExprVector> ();
+    empty.m_use = std::make_shared<const index_type> ();
+    empty.m_def = std::make_shared<const index_type> ();
+
+    Builder b (empty);
+    // -- before the rules, so that the use index sees them
+    for (Expr rel : db.getRelations ()) b.registerRelation (rel);
+    for (RuleId id = 0; id < db.ruleIdBound (); ++id)
+    {
+      if (db.isLive (id)) b.addRule (db.getRule (id));
+      else
+      {
+        // -- keep the ids of db
+        b.chunk (id / ChunkSize);
+        ++b.m_next.m_bound;
+      }
+    }
+    b.setQueries (db.getQueries ());
+    return b.commit ();
+  }
+
+  void HornClauseDBSnapshot::toDB (HornClauseDB &db) const
+  {
+    for (Expr rel : getRelations ()) db.registerRelation (rel);
+    forEachRule ([&db] (RuleId, const HornRule &r) { db.addRule (r); });
+    for (Expr q : getQueries ()) db.addQuery (q);
+  }
+
+  HornClauseDBSnapshot::Builder::Builder (const HornClauseDBSnapshot &base) :
+    m_next (base), m_use (nullptr), m_def (nullptr), m_rels (nullptr) {}
+
+  void HornClauseDBSnapshot::Builder::reset ()
+  {
+    m_chunks.clear ();
+    m_use_sets.clear ();
+    m_def_sets.clear ();
+    m_use = m_def = nullptr;
+    m_rels = nullptr;
+  }
+
+  HornClauseDBSnapshot::Chunk &HornClauseDBSnapshot::Builder::chunk (unsigned k)
+  {
+    if (m_chunks.size () <= k) m_chunks.resize (k + 1, nullptr);
+    if (!m_chunks [k])
+    {
+      assert (k <= m_next.m_chunks.size ());
+      bool fresh = k == m_next.m_chunks.size ();
+      std::shared_ptr<Chunk> c = fresh ? std::make_shared<Chunk> (ChunkSize) :
+        std::make_shared<Chunk> (*m_next.m_chunks [k]);
+      m_chunks [k] = c.get ();
+      if (fresh) m_next.m_chunks.push_back (c);
+      else m_next.m_chunks [k] = c;
+    }
+    return *m_chunks [k];
+  }
+
+  HornClauseDBSnapshot::rule_id_set &
+  HornClauseDBSnapshot::Builder::indexSet (std::shared_ptr<const index_type> &idx,
+                                           index_type *&own,
+                                           std::map<Expr, rule_id_set*> &sets,
+                                           Expr fdecl)
+  {
+    if (!own)
+    {
+      std::shared_ptr<index_type> c = std::make_shared<index_type> (*idx);
+      own = c.get ();
+      idx = c;
+    }
+    auto it = sets.find (fdecl);
+    if (it != sets.end ()) return *it->second;
+
+    std::shared_ptr<const rule_id_set> &slot = (*own) [fdecl];
+    std::shared_ptr<rule_id_set> s = slot ? std::make_shared<rule_id_set> (*slot) :
+      std::make_shared<rule_id_set> ();
+    slot = s;
+    sets [fdecl] = s.get ();
+    return *s;
+  }
+
+  void HornClauseDBSnapshot::Builder::unindex (std::shared_ptr<const index_type> &idx,
+                                               index_type *&own,
+                                               std::map<Expr, rule_id_set*> &sets,
+                                               Expr fdecl, RuleId id)
+  {
+    rule_id_set &s = indexSet (idx, own, sets, fdecl);
+    s.erase (id);
+    if (!s.empty ()) return;
+    sets.erase (fdecl);
+    own->erase (fdecl);
+  }
+
+  void HornClauseDBSnapshot::Builder::usedRelations (const HornRule &r,
+                                                     ExprVector &out) const
+  {
+    r.used_relations (m_next, std::back_inserter (out));
+  }
+
+  HornClauseDBSnapshot::RuleId
+  HornClauseDBSnapshot::Builder::addRule (const HornRule &r)
+  {
+    RuleId id = m_next.m_bound;
+    chunk (id / ChunkSize) [id % ChunkSize] = std::make_shared<const HornRule> (r);
+    ++m_next.m_bound;
+    ++m_next.m_size;
+
+    if (bind::isFapp (r.head ()))
+      indexSet (m_next.m_def, m_def, m_def_sets, bind::fname (r.head ())).insert (id);
+    ExprVector used;
+    usedRelations (r, used);
+    for (Expr rel : used)
+      indexSet (m_next.m_use, m_use, m_use_sets, rel).insert (id);
+    return id;
+  }
+
+  void HornClauseDBSnapshot::Builder::removeRule (RuleId id)
+  {
+    if (!m_next.isLive (id)) return;
+    std::shared_ptr<const HornRule> &slot = chunk (id / ChunkSize) [id % ChunkSize];
+    // -- keep the rule alive while it is unindexed
+    std::shared_ptr<const HornRule> r = slot;
+    slot.reset ();
+    --m_next.m_size;
+
+    if (bind::isFapp (r->head ()))
+      unindex (m_next.m_def, m_def, m_def_sets, bind::fname (r->head ()), id);
+    ExprVector used;
+    usedRelations (*r, used);
+    for (Expr rel : used) unindex (m_next.m_use, m_use, m_use_sets, rel, id);
+  }
+
+  void HornClauseDBSnapshot::Builder::registerRelation (Expr fdecl)
+  {
+    if (m_next.hasRelation (fdecl)) return;
+    if (!m_rels)
+    {
+      std::shared_ptr<expr_set_type> c = std::make_shared<expr_set_type> (*m_next.m_rels);
+      m_rels = c.get ();
+      m_next.m_rels = c;
+    }
+    m_rels->insert (fdecl);
+  }
+
+  void HornClauseDBSnapshot::Builder::setQueries (const ExprVector &qs)
+  { m_next.m_queries = std::make_shared<const ExprVector> (qs); }
+
+  HornClauseDBSnapshot::Ptr HornClauseDBSnapshot::Builder::commit ()
+  {
+    ++m_next.m_version;
+    // -- everything is shared with the new version from now on
+    reset ();
+    return std::make_shared<const HornClauseDBSnapshot> (m_next);
+  }
+
+  Expr extractTransitionRelation (const HornRule &r, const HornClauseDBSnapshot &db)
+  {
+    ExprVector constraints;
+    IsSnapshotPredApp isApp (db);
+    for (Expr c : r.conjuncts ())
+      if (!isApp (c)) constraints.push_back (c);
+    if (constraints.empty ()) return mk<TRUE> (r.head ()->efac ());
+    return boolop::land (constraints);
+  }
+}
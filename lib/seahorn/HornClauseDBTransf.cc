@@ -1,5 +1,13 @@
 #include "seahorn/HornClauseDBTransf.hh"
+#include "seahorn/HornModelConverter.hh"
+#include "seahorn/HornRelGraph.hh"
 #include "ufo/Expr.hpp"
+#include "ufo/ExprHash.hpp"
+#include "ufo/Smt/Z3n.hpp"
+#include "ufo/Stats.hh"
+#include "avy/AvyDebug.h"
+
+#include <deque>
 
 namespace seahorn
 {
@@ -58,14 +66,733 @@ namespace seahorn
 
   void normalizeHornClauseHeads (HornClauseDB &db)
   {
-    vector<HornRule> worklist;
-    boost::copy (db.getRules (), std::back_inserter(worklist));
-
-    for (auto rule: worklist)
+    // -- rules added by the loop get new ids and are not visited
+    HornClauseDB::RuleId end = db.ruleIdBound ();
+    for (HornClauseDB::RuleId id = 0; id < end; ++id)
     {
-      HornRule new_rule = replaceNonVarsInHead (rule);        
-      db.removeRule (rule);
+      if (!db.isLive (id)) continue;
+      HornRule new_rule = replaceNonVarsInHead (db.getRule (id));
+      db.removeRule (id);
       db.addRule (new_rule);
     }
   }
+
+  unsigned sliceHornClauseDB (HornClauseDB &db, HornSliceModelConverter &conv)
+  {
+    ufo::ScopedStats _st_("HornClauseDB::slice");
+    typedef HornClauseDB::RuleId RuleId;
+    typedef HornRelGraph::RelId RelId;
+    RuleId bound = db.ruleIdBound ();
+    HornRelGraph g (db);
+
+    // -- forward: a relation is derived once all relations in the body
+    // -- of one of its rules are derived
+    std::vector<unsigned> missing (bound, 0);
+    std::vector<bool> derived (g.size (), false);
+    std::vector<RelId> worklist;
+    for (RuleId id = 0; id < bound; ++id)
+    {
+      if (!db.isLive (id)) continue;
+      missing [id] = g.bodySize (id);
+      RelId head = g.head (id);
+      if (missing [id] == 0 && head != HornRelGraph::NoRel && !derived [head])
+      {
+        derived [head] = true;
+        worklist.push_back (head);
+      }
+    }
+    while (!worklist.empty ())
+    {
+      RelId rel = worklist.back ();
+      worklist.pop_back ();
+      for (const HornRelGraph::Edge &e : g.succs (rel))
+      {
+        if (--missing [e.rule] > 0 || derived [e.rel]) continue;
+        derived [e.rel] = true;
+        worklist.push_back (e.rel);
+      }
+    }
+
+    // -- backward: from the queries, over rules whose body is derived
+    HornClauseDB::expr_set_type queried;
+    for (Expr q : db.getQueries ())
+      filter (q, HornClauseDB::IsRelation (db), 
+              std::inserter (queried, queried.begin ()));
+    std::vector<bool> relevant (g.size (), false);
+    for (Expr q : queried)
+    {
+      relevant [g.id (q)] = true;
+      worklist.push_back (g.id (q));
+    }
+    while (!worklist.empty ())
+    {
+      RelId rel = worklist.back ();
+      worklist.pop_back ();
+      for (const HornRelGraph::Edge &e : g.preds (rel))
+      {
+        if (missing [e.rule] > 0 || relevant [e.rel]) continue;
+        relevant [e.rel] = true;
+        worklist.push_back (e.rel);
+      }
+    }
+
+    unsigned removed = 0;
+    for (RuleId id = 0; id < bound; ++id)
+    {
+      if (!db.isLive (id)) continue;
+      if (missing [id] == 0 && g.head (id) != HornRelGraph::NoRel &&
+          relevant [g.head (id)]) continue;
+      db.removeRule (id);
+      ++removed;
+    }
+
+    for (RelId i = 0; i < g.size (); ++i)
+    {
+      Expr rel = g.rel (i);
+      if (queried.count (rel) || (derived [i] && relevant [i]))
+      {
+        conv.addKept (rel);
+        continue;
+      }
+      if (derived [i]) conv.addFree (rel);
+      else conv.addEmpty (rel);
+      db.removeRelation (rel);
+    }
+
+    ufo::Stats::uset ("HornSliceRules", removed);
+    ufo::Stats::uset ("HornSliceRelations", 
+                      conv.getEmpty ().size () + conv.getFree ().size ());
+    return removed;
+  }
+
+  namespace
+  {
+    /// relations of the queries
+    HornClauseDB::expr_set_type queriedRelations (HornClauseDB &db)
+    {
+      HornClauseDB::expr_set_type res;
+      for (Expr q : db.getQueries ())
+        filter (q, HornClauseDB::IsRelation (db), std::inserter (res, res.begin ()));
+      return res;
+    }
+
+    /// original relations of the source and destination of a linear rule
+    typedef std::pair<Expr, Expr> rule_pair;
+    bool linearPair (HornClauseDB &db, const HornRule &r,
+                     HornSimplifyModelConverter &conv, rule_pair &out)
+    {
+      ExprVector apps;
+      r.pred_apps (db, std::back_inserter (apps));
+      if (apps.size () > 1) return false;
+      out.first = apps.empty () ? mk<TRUE> (db.getExprFactory ()) :
+        conv.origin (bind::fname (apps [0]));
+      out.second = conv.origin (bind::fname (r.head ()));
+      return true;
+    }
+
+    /// existentially quantifies the variables of r that occur only in
+    /// its constraints
+    HornRule eliminateLocals (HornClauseDB &db, const HornRule &r, EZ3 &z3)
+    {
+      ExprVector apps, constraints;
+      for (Expr c : r.conjuncts ())
+        (IsPredApp (db) (c) ? apps : constraints).push_back (c);
+
+      Expr shared = r.head ();
+      for (Expr app : apps) shared = mk<AND> (shared, app);
+      Expr constraint = constraints.empty () ? mk<TRUE> (r.head ()->efac ()) :
+        boolop::land (constraints);
+      ExprSet locals;
+      ExprVector vars;
+      for (Expr v : r.vars ())
+      {
+        if (!contains (shared, v) && contains (constraint, v)) locals.insert (v);
+        else vars.push_back (v);
+      }
+      if (locals.empty ()) return r;
+
+      try
+      {
+        constraint = boolop::lneg (z3_forall_elim (z3, boolop::lneg (constraint), 
+                                                   locals));
+      }
+      catch (z3::exception &e) { return r; }
+      apps.push_back (constraint);
+      return HornRule (vars, r.head (), apps);
+    }
+  }
+
+  unsigned inlineHornClauseDB (HornClauseDB &db, HornSimplifyModelConverter &conv,
+                               EZ3 *z3)
+  {
+    ufo::ScopedStats _st_("HornClauseDB::inline");
+    typedef HornClauseDB::RuleId RuleId;
+    HornClauseDB::expr_set_type queried = queriedRelations (db);
+
+    // -- counterexamples identify rules by their source and
+    // -- destination. Merged rules must not be confused with others
+    std::map<rule_pair, unsigned> pairs;
+    for (RuleId id = 0, bound = db.ruleIdBound (); id < bound; ++id)
+    {
+      rule_pair p;
+      if (db.isLive (id) && linearPair (db, db.getRule (id), conv, p)) ++pairs [p];
+    }
+
+    unsigned inlined = 0;
+    ExprVector rels (db.getRelations ().begin (), db.getRelations ().end ());
+    for (Expr rel : rels)
+    {
+      if (queried.count (rel) || db.hasConstraints (rel)) continue;
+      if (db.def (rel).size () != 1 || db.use (rel).size () != 1) continue;
+      RuleId d = *db.def (rel).begin ();
+      RuleId u = *db.use (rel).begin ();
+      if (d == u) continue;
+
+      HornRule def = db.getRule (d);
+      HornRule use = db.getRule (u);
+      rule_pair dp, up;
+      if (!linearPair (db, def, conv, dp) || !linearPair (db, use, conv, up)) 
+        continue;
+      rule_pair merged (dp.first, up.second);
+      if (pairs [merged] > 0) continue;
+
+      ExprVector defApps, useApps;
+      def.pred_apps (db, std::back_inserter (defApps));
+      use.pred_apps (db, std::back_inserter (useApps));
+      Expr app = useApps [0];
+
+      // -- variables of the head of def become the arguments of app,
+      // -- the other variables of def are renamed apart
+      ExprSet defVars (def.vars ().begin (), def.vars ().end ());
+      ExprMap sub;
+      ExprVector vars (use.vars ());
+      std::vector<std::pair<Expr, Expr> > eqs;
+      for (unsigned i = 0, sz = bind::domainSz (rel); i < sz; ++i)
+      {
+        Expr t = def.head ()->arg (i + 1);
+        if (defVars.count (t) && !sub.count (t)) sub [t] = app->arg (i + 1);
+        else eqs.push_back (std::make_pair (app->arg (i + 1), t));
+      }
+      // -- the names are fresh across rounds and distinct from the
+      // -- variables of both rules
+      ExprSet taken (use.vars ().begin (), use.vars ().end ());
+      taken.insert (defVars.begin (), defVars.end ());
+      unsigned idx = conv.freshIndex ();
+      auto mkFresh = [] (Expr v, unsigned i)
+        {
+          std::string tag = "inl" + boost::lexical_cast<std::string> (i);
+          return bind::mkConst (variant::tag (bind::fname (bind::fname (v)), tag),
+                                bind::typeOf (v));
+        };
+      for (Expr v : def.vars ())
+      {
+        if (sub.count (v)) continue;
+        Expr fresh = mkFresh (v, idx);
+        while (taken.count (fresh)) fresh = mkFresh (v, conv.freshIndex ());
+        taken.insert (fresh);
+        sub [v] = fresh;
+        vars.push_back (fresh);
+      }
+      Expr inst = replace (def.body (), sub);
+      for (auto &eq : eqs)
+        inst = boolop::land (inst, mk<EQ> (eq.first, replace (eq.second, sub)));
+
+      ExprMap appSub;
+      appSub [app] = inst;
+      HornRule rule (vars, use.head (), replace (use.body (), appSub));
+      if (z3) rule = eliminateLocals (db, rule, *z3);
+
+      db.removeRule (d);
+      db.removeRule (u);
+      db.addRule (rule);
+      db.removeRelation (rel);
+
+      --pairs [dp];
+      --pairs [up];
+      ++pairs [merged];
+      Expr orig = conv.origin (rel);
+      ExprVector chain (conv.getChain (dp.first, orig));
+      chain.push_back (orig);
+      const ExprVector &tail = conv.getChain (orig, up.second);
+      chain.insert (chain.end (), tail.begin (), tail.end ());
+      conv.addChain (merged.first, merged.second, chain);
+      conv.addInlined (rel, def, defApps);
+      ++inlined;
+    }
+
+    ufo::Stats::uset ("HornInlinedRelations", 
+                      ufo::Stats::get ("HornInlinedRelations") + inlined);
+    return inlined;
+  }
+
+  unsigned reduceHornClauseDBArity (HornClauseDB &db, 
+                                    HornSimplifyModelConverter &conv)
+  {
+    ufo::ScopedStats _st_("HornClauseDB::reduceArity");
+    typedef HornClauseDB::RuleId RuleId;
+    HornClauseDB::expr_set_type queried = queriedRelations (db);
+
+    unsigned removed = 0;
+    ExprVector rels (db.getRelations ().begin (), db.getRelations ().end ());
+    for (Expr rel : rels)
+    {
+      if (queried.count (rel) || db.hasConstraints (rel)) continue;
+      unsigned sz = bind::domainSz (rel);
+      if (sz == 0) continue;
+
+      // -- an argument is read if, in some use, it is not a variable
+      // -- or its variable occurs elsewhere in the rule
+      std::vector<bool> read (sz, false);
+      for (RuleId id : db.use (rel))
+      {
+        const HornRule &r = db.getRule (id);
+        ExprSet vars (r.vars ().begin (), r.vars ().end ());
+        ExprVector apps;
+        r.pred_apps (db, std::back_inserter (apps));
+        for (Expr app : apps)
+        {
+          if (bind::fname (app) != rel) continue;
+          for (unsigned i = 0; i < sz; ++i)
+          {
+            if (read [i]) continue;
+            Expr v = app->arg (i + 1);
+            if (!vars.count (v)) { read [i] = true; continue; }
+
+            ExprVector args (app->args_begin (), app->args_end ());
+            args.erase (args.begin () + i + 1);
+            ExprMap sub;
+            sub [app] = mknary<FAPP> (args);
+            read [i] = contains (r.head (), v) || 
+              contains (replace (r.body (), sub), v);
+          }
+        }
+      }
+
+      std::vector<unsigned> kept;
+      for (unsigned i = 0; i < sz; ++i) if (read [i]) kept.push_back (i);
+      if (kept.size () == sz) continue;
+
+      ExprVector decl;
+      decl.push_back (variant::tag (bind::fname (rel), "red"));
+      for (unsigned i : kept) decl.push_back (bind::domainTy (rel, i));
+      decl.push_back (bind::rangeTy (rel));
+      Expr newRel = mknary<FDECL> (decl);
+      db.registerRelation (newRel);
+
+      HornClauseDB::rule_id_set ids (db.def (rel));
+      ids.insert (db.use (rel).begin (), db.use (rel).end ());
+      for (RuleId id : ids)
+      {
+        const HornRule &r = db.getRule (id);
+        ExprVector apps;
+        get_all_pred_apps (r.get (), db, std::back_inserter (apps));
+        ExprMap sub;
+        for (Expr app : apps)
+        {
+          if (bind::fname (app) != rel) continue;
+          ExprVector args;
+          for (unsigned i : kept) args.push_back (app->arg (i + 1));
+          sub [app] = bind::fapp (newRel, args);
+        }
+        HornRule nr (r.vars (), replace (r.head (), sub), replace (r.body (), sub));
+        db.removeRule (id);
+        db.addRule (nr);
+      }
+      db.removeRelation (rel);
+      conv.addReduced (rel, newRel, kept);
+      removed += sz - kept.size ();
+    }
+
+    ufo::Stats::uset ("HornRemovedArguments", 
+                      ufo::Stats::get ("HornRemovedArguments") + removed);
+    return removed;
+  }
+
+  namespace
+  {
+    /// true if e is a literal value of its sort
+    bool isValue (Expr e)
+    {
+      return isOpX<MPZ> (e) || isOpX<MPQ> (e) || isOpX<TRUE> (e) ||
+        isOpX<FALSE> (e) || bv::is_bvnum (e);
+    }
+
+    /// what is known of the tuples of a relation: for every argument,
+    /// its constant value or null, and the smallest argument that is
+    /// always equal to it. Nothing is known of a relation that is not
+    /// reached yet
+    struct ArgInfo
+    {
+      bool reached;
+      ExprVector value;
+      std::vector<unsigned> cls;
+      ArgInfo () : reached (false) {}
+    };
+
+    /// union-find over the terms of a rule. A class with a value is
+    /// represented by it
+    class TermClasses
+    {
+      ExprHashMap<Expr> m_parent;
+    public:
+      Expr find (Expr e)
+      {
+        for (;;)
+        {
+          auto it = m_parent.find (e);
+          if (it == m_parent.end ()) return e;
+          e = it->second;
+        }
+      }
+
+      /// merges the classes of a and b. Returns false if they have
+      /// different values
+      bool merge (Expr a, Expr b)
+      {
+        Expr ra = find (a), rb = find (b);
+        if (ra == rb) return true;
+        if (isValue (ra) && isValue (rb)) return false;
+        if (isValue (rb)) std::swap (ra, rb);
+        m_parent [rb] = ra;
+        return true;
+      }
+    };
+
+    /// the arguments of the head of r in terms of what is known of the
+    /// relations of its body. Returns false if r derives nothing yet
+    bool evalRule (HornClauseDB &db, const HornRule &r,
+                   const ExprHashMap<ArgInfo> &info, ArgInfo &out)
+    {
+      const ExprVector &conjuncts = r.conjuncts ();
+      TermClasses tc;
+      Expr trueE = mk<TRUE> (r.head ()->efac ());
+      Expr falseE = mk<FALSE> (r.head ()->efac ());
+      for (Expr c : conjuncts)
+      {
+        bool ok = true;
+        if (isOpX<FALSE> (c)) return false;
+        if (bind::isFapp (c) && db.hasRelation (bind::fname (c)))
+        {
+          auto it = info.find (bind::fname (c));
+          if (it == info.end () || !it->second.reached) return false;
+          const ArgInfo &a = it->second;
+          for (unsigned i = 0; ok && i + 1 < c->arity (); ++i)
+          {
+            Expr t = c->arg (i + 1);
+            if (a.value [i]) ok = tc.merge (t, a.value [i]);
+            if (ok && a.cls [i] != i) ok = tc.merge (t, c->arg (a.cls [i] + 1));
+          }
+        }
+        else if (isOpX<EQ> (c) || isOpX<IFF> (c))
+          ok = tc.merge (c->left (), c->right ());
+        else if (bind::IsConst () (c))
+          ok = tc.merge (c, trueE);
+        else if (isOpX<NEG> (c) && bind::IsConst () (c->left ()))
+          ok = tc.merge (c->left (), falseE);
+        if (!ok) return false;
+      }
+
+      Expr head = r.head ();
+      unsigned sz = head->arity () - 1;
+      out.reached = true;
+      out.value.assign (sz, Expr ());
+      out.cls.resize (sz);
+      ExprVector reps (sz);
+      for (unsigned i = 0; i < sz; ++i)
+      {
+        reps [i] = tc.find (head->arg (i + 1));
+        if (isValue (reps [i])) out.value [i] = reps [i];
+        out.cls [i] = i;
+        for (unsigned j = 0; j < i; ++j)
+          if (reps [j] == reps [i]) { out.cls [i] = j; break; }
+      }
+      return true;
+    }
+
+    /// joins b into a. Returns true if a changed
+    bool joinArgInfo (ArgInfo &a, const ArgInfo &b)
+    {
+      if (!b.reached) return false;
+      if (!a.reached) { a = b; return true; }
+
+      bool changed = false;
+      unsigned sz = a.value.size ();
+      for (unsigned i = 0; i < sz; ++i)
+        if (a.value [i] && a.value [i] != b.value [i])
+        {
+          a.value [i] = Expr ();
+          changed = true;
+        }
+      // -- two arguments stay equal if they are equal in both
+      std::vector<unsigned> cls (sz);
+      for (unsigned i = 0; i < sz; ++i)
+      {
+        cls [i] = i;
+        for (unsigned j = 0; j < i; ++j)
+          if (a.cls [j] == a.cls [i] && b.cls [j] == b.cls [i])
+          { cls [i] = j; break; }
+      }
+      if (cls != a.cls) { a.cls.swap (cls); changed = true; }
+      return changed;
+    }
+  }
+
+  unsigned propagateHornClauseDBArgs (HornClauseDB &db,
+                                      HornSimplifyModelConverter &conv)
+  {
+    ufo::ScopedStats _st_("HornClauseDB::propagateArgs");
+    typedef HornClauseDB::RuleId RuleId;
+    HornClauseDB::expr_set_type queried = queriedRelations (db);
+
+    // -- least fixpoint over the rules. Every relation is in info
+    // -- before the first lookup, so references into it stay valid
+    ExprHashMap<ArgInfo> info;
+    for (Expr rel : db.getRelations ()) info [rel];
+
+    std::deque<RuleId> work;
+    std::vector<bool> queued (db.ruleIdBound (), false);
+    for (RuleId id = 0; id < db.ruleIdBound (); ++id)
+      if (db.isLive (id)) { work.push_back (id); queued [id] = true; }
+    while (!work.empty ())
+    {
+      RuleId id = work.front ();
+      work.pop_front ();
+      queued [id] = false;
+      const HornRule &r = db.getRule (id);
+      if (!bind::isFapp (r.head ())) continue;
+      auto it = info.find (bind::fname (r.head ()));
+      if (it == info.end ()) continue;
+
+      ArgInfo res;
+      if (!evalRule (db, r, info, res) || !joinArgInfo (it->second, res))
+        continue;
+      for (RuleId u : db.use (bind::fname (r.head ())))
+        if (!queued [u]) { work.push_back (u); queued [u] = true; }
+    }
+
+    unsigned removed = 0;
+    ExprVector rels (db.getRelations ().begin (), db.getRelations ().end ());
+    for (Expr rel : rels)
+    {
+      if (queried.count (rel) || db.hasConstraints (rel)) continue;
+      unsigned sz = bind::domainSz (rel);
+      const ArgInfo &a = info.find (rel)->second;
+      if (sz == 0 || !a.reached) continue;
+
+      std::vector<unsigned> kept;
+      std::vector<HornSimplifyModelConverter::FixedArg> fixed;
+      for (unsigned i = 0; i < sz; ++i)
+      {
+        if (a.value [i])
+          fixed.push_back (HornSimplifyModelConverter::FixedArg {i, a.value [i], 0});
+        else if (a.cls [i] != i)
+          fixed.push_back (HornSimplifyModelConverter::FixedArg {i, Expr (), a.cls [i]});
+        else kept.push_back (i);
+      }
+      if (fixed.empty ()) continue;
+
+      ExprVector decl;
+      decl.push_back (variant::tag (bind::fname (rel), "prop"));
+      for (unsigned i : kept) decl.push_back (bind::domainTy (rel, i));
+      decl.push_back (bind::rangeTy (rel));
+      Expr newRel = mknary<FDECL> (decl);
+      db.registerRelation (newRel);
+
+      HornClauseDB::rule_id_set ids (db.def (rel));
+      ids.insert (db.use (rel).begin (), db.use (rel).end ());
+      for (RuleId id : ids)
+      {
+        const HornRule &r = db.getRule (id);
+        ExprVector apps, bodyApps;
+        get_all_pred_apps (r.get (), db, std::back_inserter (apps));
+        r.pred_apps (db, std::back_inserter (bodyApps));
+        ExprSet inBody (bodyApps.begin (), bodyApps.end ());
+
+        // -- the fixed arguments of the uses become equalities
+        ExprMap appSub;
+        std::vector<std::pair<Expr,Expr> > eqs;
+        for (Expr app : apps)
+        {
+          if (bind::fname (app) != rel) continue;
+          ExprVector args;
+          for (unsigned i : kept) args.push_back (app->arg (i + 1));
+          appSub [app] = bind::fapp (newRel, args);
+          if (!inBody.count (app)) continue;
+          for (const HornSimplifyModelConverter::FixedArg &f : fixed)
+            eqs.push_back (std::make_pair (app->arg (f.pos + 1),
+                                           f.value ? f.value : app->arg (f.same + 1)));
+        }
+
+        // -- an equality on a variable of the rule is substituted
+        ExprSet vars (r.vars ().begin (), r.vars ().end ());
+        ExprMap sub;
+        ExprVector conj;
+        for (auto &eq : eqs)
+        {
+          Expr x = replace (eq.first, sub), t = replace (eq.second, sub);
+          if (x == t) continue;
+          if (!vars.count (x) && vars.count (t)) std::swap (x, t);
+          if (vars.count (x) && !contains (t, x))
+          {
+            ExprMap one;
+            one [x] = t;
+            for (auto &kv : sub) kv.second = replace (kv.second, one);
+            sub [x] = t;
+          }
+          else conj.push_back (mk<EQ> (x, t));
+        }
+        conj.insert (conj.begin (), replace (replace (r.body (), appSub), sub));
+
+        ExprVector nvars;
+        for (Expr v : r.vars ()) if (!sub.count (v)) nvars.push_back (v);
+        HornRule nr (nvars, replace (replace (r.head (), appSub), sub), conj);
+        db.removeRule (id);
+        db.addRule (nr);
+      }
+      db.removeRelation (rel);
+      conv.addReduced (rel, newRel, kept, fixed);
+      removed += fixed.size ();
+      LOG ("horn-prop", errs () << "propagated " << fixed.size ()
+           << " arguments of " << *bind::fname (rel) << "\n";);
+    }
+
+    ufo::Stats::uset ("HornPropagatedArguments", 
+                      ufo::Stats::get ("HornPropagatedArguments") + removed);
+    return removed;
+  }
+
+  unsigned simplifyHornClauseDB (HornClauseDB &db, HornSimplifyModelConverter &conv,
+                                 EZ3 *z3)
+  {
+    unsigned steps = 0;
+    for (;;)
+    {
+      unsigned n = inlineHornClauseDB (db, conv, z3);
+      n += reduceHornClauseDBArity (db, conv);
+      n += propagateHornClauseDBArgs (db, conv);
+      if (n == 0) break;
+      steps += n;
+    }
+    return steps;
+  }
+
+  namespace
+  {
+    /// at most this many rules with the same head are checked for
+    /// subsuming a rule
+    const unsigned MaxSubsumeChecks = 64;
+
+    /// a rule up to the names of its variables. Variables are
+    /// replaced by bound variables numbered by their first occurrence
+    /// in the head and then in the conjuncts of the body
+    struct RuleKey
+    {
+      HornClauseDB::RuleId id;
+      Expr head;
+      /// the conjuncts of the body, ordered by id, without duplicates
+      ExprVector body;
+      /// the head and the body. Equal for alpha-equivalent rules
+      Expr key;
+    };
+
+    bool idLess (const Expr &a, const Expr &b) { return a->getId () < b->getId (); }
+
+    /// the variables of e not in seen, in preorder
+    void varsByOccurrence (Expr e, const ExprHashSet &vars, ExprHashSet &seen,
+                           ExprVector &out)
+    {
+      ExprVector todo {e};
+      while (!todo.empty ())
+      {
+        Expr t = todo.back ();
+        todo.pop_back ();
+        if (!seen.insert (t).second) continue;
+        if (vars.count (t)) { out.push_back (t); continue; }
+        for (size_t i = t->arity (); i > 0; --i) todo.push_back (t->arg (i - 1));
+      }
+    }
+
+    RuleKey ruleKey (const HornRule &r, HornClauseDB::RuleId id)
+    {
+      ExprHashSet vars (r.vars ().begin (), r.vars ().end ());
+      const ExprVector &conjuncts = r.conjuncts ();
+
+      ExprHashSet seen;
+      ExprVector order;
+      varsByOccurrence (r.head (), vars, seen, order);
+      for (Expr c : conjuncts) varsByOccurrence (c, vars, seen, order);
+
+      RuleKey k;
+      k.id = id;
+      k.head = expr::details::absConstants (order, r.head ());
+      for (Expr c : conjuncts)
+        if (!isOpX<TRUE> (c))
+          k.body.push_back (expr::details::absConstants (order, c));
+      std::sort (k.body.begin (), k.body.end (), idLess);
+      k.body.erase (std::unique (k.body.begin (), k.body.end ()), k.body.end ());
+
+      ExprVector all {k.head};
+      all.insert (all.end (), k.body.begin (), k.body.end ());
+      k.key = mknary<TUPLE> (all);
+      return k;
+    }
+  }
+
+  unsigned dedupHornClauseDB (HornClauseDB &db)
+  {
+    ufo::ScopedStats _st_("HornClauseDB::dedup");
+    typedef HornClauseDB::RuleId RuleId;
+
+    std::vector<RuleKey> keys;
+    for (RuleId id = 0; id < db.ruleIdBound (); ++id)
+      if (db.isLive (id)) keys.push_back (ruleKey (db.getRule (id), id));
+    // -- a rule can only be subsumed by a rule with fewer conjuncts
+    std::stable_sort (keys.begin (), keys.end (),
+                      [] (const RuleKey &a, const RuleKey &b)
+                      { return a.body.size () < b.body.size (); });
+
+    ExprHashSet distinct;
+    /// kept rules of every head, as indexes in keys
+    ExprHashMap<std::vector<unsigned> > kept;
+    std::vector<RuleId> removed;
+    unsigned dups = 0, subsumed = 0;
+    for (unsigned i = 0; i < keys.size (); ++i)
+    {
+      const RuleKey &k = keys [i];
+      if (!distinct.insert (k.key).second)
+      {
+        ++dups;
+        removed.push_back (k.id);
+        continue;
+      }
+
+      // -- h <- C1 subsumes h <- C2 if C1 is a subset of C2
+      std::vector<unsigned> &group = kept [k.head];
+      bool sub = false;
+      for (unsigned j = 0; j < group.size () && j < MaxSubsumeChecks && !sub; ++j)
+      {
+        const ExprVector &b = keys [group [j]].body;
+        sub = b.size () < k.body.size () &&
+          std::includes (k.body.begin (), k.body.end (), b.begin (), b.end (), idLess);
+      }
+      if (sub)
+      {
+        ++subsumed;
+        removed.push_back (k.id);
+        continue;
+      }
+      group.push_back (i);
+    }
+
+    for (RuleId id : removed) db.removeRule (id);
+
+    LOG ("horn-dedup",
+         errs () << "Removed " << dups << " duplicate and "
+                 << subsumed << " subsumed rules\n";);
+    ufo::Stats::uset ("HornDuplicateRules", 
+                      ufo::Stats::get ("HornDuplicateRules") + dups);
+    ufo::Stats::uset ("HornSubsumedRules", 
+                      ufo::Stats::get ("HornSubsumedRules") + subsumed);
+    return dups + subsumed;
+  }
 }
@@ -0,0 +1,599 @@
+#include "seahorn/HornCompositional.hh"
+#include "seahorn/HornProgress.hh"
+#include "seahorn/HornRelStats.hh"
+#include "seahorn/Support/TaskPool.hh"
+
+#include "llvm/IR/Function.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ufo/ExprIO.hpp"
+#include "ufo/Stats.hh"
+#include "avy/AvyDebug.h"
+
+#include "boost/lexical_cast.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <unistd.h>
+
+namespace seahorn
+{
+  using namespace ufo;
+
+  namespace
+  {
+    std::string md5 (const std::vector<std::string> &parts)
+    {
+      MD5 hash;
+      for (const std::string &p : parts)
+      {
+        hash.update (p);
+        hash.update (StringRef ("\0", 1));
+      }
+      MD5::MD5Result res;
+      hash.final (res);
+      SmallString<32> str;
+      MD5::stringifyResult (res, str);
+      return str.str ().str ();
+    }
+
+    /// hash of the IR of F. Metadata and attribute groups are
+    /// numbered across the module, so their numbers are left out
+    std::string functionHash (const Function &F)
+    {
+      std::string ir;
+      raw_string_ostream os (ir);
+      F.print (os);
+      os.flush ();
+
+      std::string norm;
+      norm.reserve (ir.size ());
+      for (size_t i = 0; i < ir.size (); ++i)
+      {
+        norm.push_back (ir [i]);
+        if (ir [i] != '!' && ir [i] != '#') continue;
+        while (i + 1 < ir.size () && std::isdigit ((unsigned char) ir [i + 1])) ++i;
+      }
+      return md5 (std::vector<std::string> {norm});
+    }
+
+    /// rel with its name replaced by how it prints, as in the files
+    /// of --horn-houdini-invs
+    Expr relKey (Expr rel)
+    {
+      std::ostringstream os;
+      os << *bind::fname (rel);
+      ExprVector sorts;
+      for (unsigned i = 0, sz = bind::domainSz (rel); i < sz; ++i)
+        sorts.push_back (bind::domainTy (rel, i));
+      sorts.push_back (bind::rangeTy (rel));
+      return bind::fdecl (mkTerm<std::string> (os.str (), rel->efac ()), sorts);
+    }
+
+    /// true for terminals that exprio cannot write
+    struct IsOpaqueTerminal : public std::unary_function<Expr, bool>
+    {
+      bool operator() (Expr e)
+      {
+        return e->arity () == 0 &&
+          !exprio::detail::TerminalCodec::id (e->op ()) &&
+          !OpRegistry::get ().id (e->op ());
+      }
+    };
+
+    Expr mkCount (size_t n, ExprFactory &efac)
+    { return mkTerm<unsigned> (n, efac); }
+  }
+
+  bool HornCompositional::split (Module &M)
+  {
+    // -- the function of every relation
+    std::map<Expr, const Function*> owner;
+    std::set<Expr> summaries;
+    for (const Function &F : M)
+    {
+      Expr sum = m_hm.summaryPredicate (F);
+      if (sum)
+      {
+        owner [sum] = &F;
+        summaries.insert (sum);
+      }
+      for (const BasicBlock &bb : F)
+        if (m_hm.hasBbPredicate (bb)) owner [m_hm.bbPredicate (bb)] = &F;
+    }
+
+    std::vector<const Function*> fns;
+    DenseMap<const Function*, unsigned> fidx;
+    std::vector<ExprVector> frels;
+    for (Expr rel : m_db.getRelations ())
+    {
+      auto it = owner.find (rel);
+      if (it == owner.end ())
+      {
+        LOG ("horn-comp", errs () << "compositional: no function for "
+             << *bind::fname (rel) << "\n";);
+        return false;
+      }
+      auto r = fidx.insert (std::make_pair (it->second, fns.size ()));
+      if (r.second)
+      {
+        fns.push_back (it->second);
+        frels.push_back (ExprVector ());
+      }
+      frels [r.first->second].push_back (rel);
+    }
+
+    // -- rules of every function, and functions whose summaries they use
+    std::vector<std::vector<HornClauseDB::RuleId> > frules (fns.size ());
+    std::vector<std::set<unsigned> > fcallees (fns.size ());
+    for (HornClauseDB::RuleId id = 0; id < m_db.ruleIdBound (); ++id)
+    {
+      if (!m_db.isLive (id)) continue;
+      const HornRule &rule = m_db.getRule (id);
+      if (!bind::isFapp (rule.head ())) return false;
+      unsigned f = fidx [owner [bind::fname (rule.head ())]];
+      frules [f].push_back (id);
+
+      ExprVector apps;
+      rule.pred_apps (m_db, std::back_inserter (apps));
+      for (Expr app : apps)
+      {
+        Expr rel = bind::fname (app);
+        unsigned g = fidx [owner [rel]];
+        if (g == f) continue;
+        // -- another function is only used through its summary
+        if (!summaries.count (rel)) return false;
+        fcallees [f].insert (g);
+      }
+    }
+
+    int rootFn = -1;
+    for (Expr q : m_db.getQueries ())
+    {
+      if (!bind::isFapp (q) || !m_db.hasRelation (bind::fname (q))) return false;
+      int f = fidx [owner [bind::fname (q)]];
+      if (rootFn >= 0 && rootFn != f) return false;
+      rootFn = f;
+    }
+    if (rootFn < 0) return false;
+
+    // -- units are the strongly connected components of the call
+    // -- graph. Tarjan's algorithm finds the callees first
+    std::vector<int> index (fns.size (), -1), low (fns.size (), 0);
+    std::vector<bool> onStack (fns.size (), false);
+    std::vector<unsigned> stack;
+    std::vector<unsigned> unitOfFn (fns.size ());
+    int next = 0;
+    std::function<void (unsigned)> visit = [&] (unsigned f)
+      {
+        index [f] = low [f] = next++;
+        stack.push_back (f);
+        onStack [f] = true;
+        for (unsigned g : fcallees [f])
+        {
+          if (index [g] < 0)
+          {
+            visit (g);
+            low [f] = std::min (low [f], low [g]);
+          }
+          else if (onStack [g]) low [f] = std::min (low [f], index [g]);
+        }
+        if (low [f] != index [f]) return;
+
+        unsigned u = m_units.size ();
+        m_units.push_back (Unit ());
+        Unit &unit = m_units.back ();
+        unit.name = fns [f]->getName ().str ();
+        unsigned g;
+        do
+        {
+          g = stack.back ();
+          stack.pop_back ();
+          onStack [g] = false;
+          unitOfFn [g] = u;
+          unit.fns.push_back (fns [g]);
+          unit.rels.insert (unit.rels.end (), frels [g].begin (), frels [g].end ());
+          unit.rules.insert (unit.rules.end (), frules [g].begin (), frules [g].end ());
+        } while (g != f);
+      };
+    for (unsigned f = 0; f < fns.size (); ++f)
+      if (index [f] < 0) visit (f);
+
+    for (unsigned f = 0; f < fns.size (); ++f)
+    {
+      Unit &unit = m_units [unitOfFn [f]];
+      for (unsigned g : fcallees [f])
+        if (unitOfFn [g] != unitOfFn [f]) unit.callees.insert (unitOfFn [g]);
+    }
+    for (unsigned u = 0; u < m_units.size (); ++u)
+    {
+      Unit &unit = m_units [u];
+      for (Expr rel : unit.rels)
+      {
+        m_unitOf [rel] = u;
+        if (summaries.count (rel)) unit.sums.push_back (rel);
+      }
+      // -- callees come first
+      for (unsigned c : unit.callees)
+        unit.level = std::max (unit.level, m_units [c].level + 1);
+    }
+    m_root = unitOfFn [rootFn];
+    return true;
+  }
+
+  bool HornCompositional::init (Module &M)
+  {
+    if (!split (M)) return false;
+    // -- without summaries there is nothing to compose
+    if (m_units.size () < 2) return false;
+    Stats::uset ("HornCompUnits", m_units.size ());
+    return true;
+  }
+
+  Expr HornCompositional::canonicalApp (Expr rel)
+  {
+    ExprFactory &efac = rel->efac ();
+    ExprVector args;
+    for (unsigned i = 0, sz = bind::domainSz (rel); i < sz; ++i)
+    {
+      Expr argName = mkTerm<std::string>
+        ("arg_" + boost::lexical_cast<std::string> (i), efac);
+      args.push_back (bind::mkConst (argName, bind::domainTy (rel, i)));
+    }
+    return bind::fapp (rel, args);
+  }
+
+  void HornCompositional::load (ZFixedPoint<EZ3> &fp,
+                                const std::set<unsigned> &concrete,
+                                std::set<Expr> &abstract)
+  {
+    for (unsigned u : concrete)
+      for (Expr rel : m_units [u].rels) fp.registerRelation (rel);
+
+    for (unsigned u : concrete)
+    {
+      const Unit &unit = m_units [u];
+      for (HornClauseDB::RuleId id : unit.rules)
+      {
+        const HornRule &rule = m_db.getRule (id);
+        fp.addRule (rule.vars (), rule.get ());
+      }
+
+      // -- a callee that is not concrete is a rule from an
+      // -- over-approximation of its summary
+      for (unsigned c : unit.callees)
+      {
+        if (concrete.count (c)) continue;
+        for (Expr sum : m_units [c].sums)
+        {
+          if (!abstract.insert (sum).second) continue;
+          fp.registerRelation (sum);
+          Expr app = canonicalApp (sum);
+          Expr inv = mk<TRUE> (sum->efac ());
+          {
+            std::lock_guard<std::mutex> l (m_mutex);
+            auto it = m_summaries.find (sum);
+            if (it != m_summaries.end ()) inv = it->second;
+          }
+          if (m_db.hasConstraints (sum))
+            inv = boolop::land (inv, m_db.getConstraints (app));
+          ExprVector vars;
+          for (unsigned i = 1; i < app->arity (); ++i) vars.push_back (app->arg (i));
+          fp.addRule (vars, isOpX<TRUE> (inv) ? app : mk<IMPL> (inv, app));
+        }
+      }
+    }
+
+    if (m_skipConstraints) return;
+    for (unsigned u : concrete)
+      for (Expr rel : m_units [u].rels)
+        if (m_db.hasConstraints (rel))
+        {
+          Expr app = canonicalApp (rel);
+          fp.addCover (app, m_db.getConstraints (app));
+        }
+  }
+
+  void HornCompositional::solveTime (const Unit &unit,
+                                     std::chrono::steady_clock::time_point start)
+  {
+    if (!HornRelStats::enabled ()) return;
+    double secs = std::chrono::duration<double>
+      (std::chrono::steady_clock::now () - start).count ();
+    HornRelStats::addSolveTime (unit.rels, secs, unit.name);
+    HornRelStats::addSolveTime (unit.sums, secs, unit.name);
+  }
+
+  void HornCompositional::summarize (unsigned u, EZ3 &z3)
+  {
+    const Unit &unit = m_units [u];
+    if (unit.sums.empty ()) return;
+    ExprFactory &efac = z3.get_efac ();
+
+    ZFixedPoint<EZ3> fp (z3);
+    m_setup (fp);
+    std::set<unsigned> concrete {u};
+    std::set<Expr> abstract;
+    load (fp, concrete, abstract);
+
+    // -- fail () holds if a summary of the unit goes from no error
+    // -- to an error
+    Expr fail = bind::fdecl (mkTerm<std::string> ("compositional.fail." + unit.name, efac),
+                             ExprVector {sort::boolTy (efac)});
+    fp.registerRelation (fail);
+    Expr trueE = mk<TRUE> (efac);
+    Expr falseE = mk<FALSE> (efac);
+    for (Expr sum : unit.sums)
+    {
+      Expr app = canonicalApp (sum);
+      ExprVector args;
+      for (unsigned i = 1; i < app->arity (); ++i) args.push_back (app->arg (i));
+      assert (args.size () >= 3);
+      args [0] = trueE;
+      args [1] = falseE;
+      args [2] = trueE;
+      ExprVector vars (args.begin () + 3, args.end ());
+      fp.addRule (vars, mk<IMPL> (bind::fapp (sum, args), bind::fapp (fail)));
+    }
+
+    auto start = std::chrono::steady_clock::now ();
+    boost::tribool res = fp.query (bind::fapp (fail));
+    solveTime (unit, start);
+    LOG ("horn-comp", errs () << "compositional: " << unit.name
+         << (res ? " can fail" : !res ? " is safe" : " is unknown") << "\n";);
+    if (boost::indeterminate (res)) return;
+    if (res)
+    {
+      std::lock_guard<std::mutex> l (m_mutex);
+      m_canFail.insert (u);
+      return;
+    }
+
+    for (Expr sum : unit.sums)
+    {
+      Expr inv = fp.getCoverDelta (canonicalApp (sum));
+      std::lock_guard<std::mutex> l (m_mutex);
+      m_summaries [sum] = inv;
+    }
+    Stats::count ("HornCompSummaries");
+  }
+
+  void HornCompositional::hashUnits ()
+  {
+    for (Unit &unit : m_units)
+    {
+      std::vector<std::string> fns, rels, callees;
+      for (const Function *F : unit.fns) fns.push_back (functionHash (*F));
+      // -- the sorts of the relations depend on the whole module,
+      // -- e.g., the memory regions of the functions
+      for (Expr rel : unit.rels)
+      {
+        std::ostringstream os;
+        os << *relKey (rel);
+        rels.push_back (os.str ());
+      }
+      for (unsigned c : unit.callees) callees.push_back (m_units [c].hash);
+      // -- the order of the functions of the module does not matter
+      std::sort (fns.begin (), fns.end ());
+      std::sort (rels.begin (), rels.end ());
+      std::sort (callees.begin (), callees.end ());
+
+      std::vector<std::string> parts;
+      parts.insert (parts.end (), fns.begin (), fns.end ());
+      parts.push_back ("rels");
+      parts.insert (parts.end (), rels.begin (), rels.end ());
+      parts.push_back ("callees");
+      parts.insert (parts.end (), callees.begin (), callees.end ());
+      unit.hash = md5 (parts);
+    }
+  }
+
+  void HornCompositional::loadStore (std::vector<bool> &solved)
+  {
+    ExprVector roots;
+    if (!exprio::load (m_store, m_db.getExprFactory (), std::back_inserter (roots)))
+      return;
+
+    std::map<std::string, unsigned> unitOfHash;
+    for (unsigned u = 0; u < m_units.size (); ++u)
+      if (u != m_root && !m_units [u].sums.empty ())
+        unitOfHash [m_units [u].hash] = u;
+
+    size_t pos = 0;
+    auto count = [&] (unsigned &n)
+      {
+        if (pos >= roots.size () || !isOpX<UINT> (roots [pos])) return false;
+        n = getTerm<unsigned> (roots [pos++]);
+        return n <= roots.size () - pos;
+      };
+    unsigned n;
+    if (!count (n)) return;
+    unsigned reused = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+      // -- hash, whether the unit is safe, and the invariant of each
+      // -- summary
+      if (pos >= roots.size () || !isOpX<STRING> (roots [pos])) return;
+      std::string hash = getTerm<std::string> (roots [pos++]);
+      unsigned safe, nsums;
+      if (!count (safe) || !count (nsums) || 2 * nsums > roots.size () - pos) return;
+      std::map<Expr, Expr> invs;
+      for (unsigned j = 0; j < nsums; ++j, pos += 2)
+        invs [roots [pos]] = roots [pos + 1];
+
+      auto it = unitOfHash.find (hash);
+      if (it == unitOfHash.end ()) continue;
+      unsigned u = it->second;
+      const Unit &unit = m_units [u];
+      if (!safe)
+      {
+        m_canFail.insert (u);
+        solved [u] = true;
+        reused++;
+        continue;
+      }
+
+      bool all = true;
+      for (Expr sum : unit.sums) all = all && invs.count (relKey (sum));
+      if (!all) continue;
+      for (Expr sum : unit.sums) m_summaries [sum] = invs [relKey (sum)];
+      solved [u] = true;
+      reused++;
+    }
+    LOG ("horn-comp", errs () << "compositional: reused " << reused
+         << " units of " << m_store << "\n";);
+    Stats::uset ("HornCompReused", reused);
+  }
+
+  bool HornCompositional::saveStore ()
+  {
+    ExprFactory &efac = m_db.getExprFactory ();
+    ExprVector entries;
+    unsigned n = 0;
+    for (unsigned u = 0; u < m_units.size (); ++u)
+    {
+      const Unit &unit = m_units [u];
+      if (u == m_root || unit.sums.empty ()) continue;
+      bool safe = !m_canFail.count (u);
+      ExprVector invs;
+      bool known = true;
+      for (Expr sum : unit.sums)
+      {
+        if (!safe) break;
+        auto it = m_summaries.find (sum);
+        // -- unknown, or not needed by main
+        if (it == m_summaries.end ()) { known = false; break; }
+        ExprVector opaque;
+        filter (it->second, IsOpaqueTerminal (), std::back_inserter (opaque));
+        if (!opaque.empty ()) { known = false; break; }
+        invs.push_back (relKey (sum));
+        invs.push_back (it->second);
+      }
+      if (!known) continue;
+
+      entries.push_back (mkTerm<std::string> (unit.hash, efac));
+      entries.push_back (mkCount (safe ? 1 : 0, efac));
+      entries.push_back (mkCount (invs.size () / 2, efac));
+      entries.insert (entries.end (), invs.begin (), invs.end ());
+      n++;
+    }
+    ExprVector roots;
+    roots.push_back (mkCount (n, efac));
+    roots.insert (roots.end (), entries.begin (), entries.end ());
+
+    // -- write to a temporary file first so that a concurrent run
+    // -- never reads a partial file
+    std::string tmp = m_store + ".tmp" + boost::lexical_cast<std::string> (::getpid ());
+    if (!exprio::save (tmp, roots))
+    {
+      std::remove (tmp.c_str ());
+      return false;
+    }
+    return std::rename (tmp.c_str (), m_store.c_str ()) == 0;
+  }
+
+  boost::tribool HornCompositional::solve ()
+  {
+    ScopedStats _st ("HornCompositional");
+
+    // -- the units that main may use
+    std::vector<bool> needed (m_units.size (), false);
+    std::vector<unsigned> worklist {m_root};
+    needed [m_root] = true;
+    while (!worklist.empty ())
+    {
+      unsigned u = worklist.back ();
+      worklist.pop_back ();
+      for (unsigned c : m_units [u].callees)
+        if (!needed [c]) { needed [c] = true; worklist.push_back (c); }
+    }
+
+    std::vector<bool> solved (m_units.size (), false);
+    if (!m_store.empty ())
+    {
+      hashUnits ();
+      loadStore (solved);
+    }
+
+    std::vector<std::vector<unsigned> > levels;
+    for (unsigned u = 0; u < m_units.size (); ++u)
+    {
+      if (!needed [u] || u == m_root || solved [u]) continue;
+      unsigned l = m_units [u].level;
+      if (levels.size () <= l) levels.resize (l + 1);
+      levels [l].push_back (u);
+    }
+
+    size_t toSolve = 0;
+    for (const std::vector<unsigned> &lvl : levels) toSolve += lvl.size ();
+    HornProgress::set ("compositional.units", toSolve);
+
+    // -- a context per worker, contexts are not thread safe. Kept
+    // -- from one level to the next with their marshal caches
+    ufo::ZWorkerContexts<EZ3> contexts (m_hm.getExprFactory ());
+
+    // -- leaves first. The units of a level are independent
+    for (const std::vector<unsigned> &lvl : levels)
+    {
+      if (m_threads <= 1 || lvl.size () < 2)
+      {
+        for (unsigned u : lvl)
+        {
+          summarize (u, m_hm.getZContext ());
+          HornProgress::add ("compositional.solved", 1);
+        }
+        continue;
+      }
+
+      TaskPool pool ("HornCompositional.level", m_threads);
+      pool.run (lvl.size (), [&] (unsigned w, size_t k)
+                {
+                  summarize (lvl [k], contexts.get (w));
+                  HornProgress::add ("compositional.solved", 1);
+                });
+    }
+    if (!m_store.empty () && !saveStore ())
+      errs () << "WARNING: could not write " << m_store << "\n";
+
+    // -- main, refining the callees its counterexamples go through
+    std::set<unsigned> concrete {m_root};
+    while (true)
+    {
+      m_fp.reset (new ZFixedPoint<EZ3> (m_hm.getZContext ()));
+      m_setup (*m_fp);
+      std::set<Expr> abstract;
+      load (*m_fp, concrete, abstract);
+      m_fp->addQueries (m_db.getQueries ());
+
+      auto start = std::chrono::steady_clock::now ();
+      boost::tribool res = m_fp->query ();
+      solveTime (m_units [m_root], start);
+      if (!res || boost::indeterminate (res)) return res;
+
+      ExprVector cex;
+      m_fp->getCexRules (cex);
+      std::set<unsigned> refine;
+      for (Expr r : cex)
+      {
+        Expr head = isOpX<IMPL> (r) ? r->arg (1) : r;
+        if (!bind::isFapp (head)) continue;
+        Expr rel = bind::fname (head);
+        if (abstract.count (rel)) refine.insert (m_unitOf [rel]);
+      }
+      if (refine.empty ()) return res;
+
+      for (unsigned u : refine)
+      {
+        LOG ("horn-comp", errs () << "compositional: refining "
+             << m_units [u].name << "\n";);
+        concrete.insert (u);
+        Stats::count ("HornCompRefinements");
+      }
+    }
+  }
+}
@@ -33,12 +33,32 @@ namespace seahorn
     }
 
     m_defs[bind::fname(fapp)] = lemma_def;
+    m_lazy.erase (bind::fname (fapp));
+  }
+
+  void HornDbModel::addLazyDef (Expr fapp, std::function<Expr ()> lemma)
+  {
+    Expr fdecl = bind::fname (fapp);
+    m_defs.erase (fdecl);
+    m_lazy [fdecl] = std::make_pair (fapp, lemma);
+  }
+
+  void HornDbModel::materialize (Expr fdecl)
+  {
+    auto it = m_lazy.find (fdecl);
+    if (it == m_lazy.end ()) return;
+    
+    Expr fapp = it->second.first;
+    std::function<Expr ()> lemma = it->second.second;
+    // -- addDef removes the entry
+    addDef (fapp, lemma ());
   }
 
   Expr HornDbModel::getDef(Expr fapp)
   {
     Expr fdecl = bind::fname(fapp);
-    ExprMap::iterator it = m_defs.find(fdecl);
+    materialize (fdecl);
+    auto it = m_defs.find(fdecl);
 
     if(it == m_defs.end())
       return mk<TRUE>(fdecl->efac());
@@ -62,7 +82,7 @@ namespace seahorn
   bool HornDbModel::hasDef (Expr v)
   {
     if (bind::isFapp (v)) v = bind::fname (v);
-    return m_defs.count (v);
+    return m_defs.count (v) || m_lazy.count (v);
   }
 
   void initDBModelFromFP(HornDbModel &dbModel, HornClauseDB &db, ZFixedPoint<EZ3> &fp)
@@ -79,8 +99,7 @@ namespace seahorn
         actual_args.push_back (var);
       }
       Expr fapp = bind::fapp(rel, actual_args);
-      Expr def_app = fp.getCoverDelta(fapp);
-      dbModel.addDef(fapp, def_app);
+      dbModel.addLazyDef (fapp, [&fp, fapp] () { return fp.getCoverDelta (fapp); });
     }
   }
 }
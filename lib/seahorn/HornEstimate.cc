@@ -0,0 +1,232 @@
+/// Predicts the size of the Horn encoding of every --horn-step
+/// option without building it. The counts follow the construction of
+/// HornifyFunction and FlatHornifyFunction: a relation per block or
+/// per cut-point (or one flat relation per function) over the symbols
+/// that LiveSymbols finds live there, and a rule per edge, per error
+/// exit and for the entry and the summary.
+#include "llvm/Pass.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "seahorn/Passes.hh"
+#include "seahorn/LiveSymbols.hh"
+#include "seahorn/UfoSymExec.hh"
+#include "seahorn/Analysis/CutPointGraph.hh"
+#include "seahorn/FunctionAnalysisCache.hh"
+
+#include "ufo/Expr.hpp"
+
+static llvm::cl::opt<enum seahorn::TrackLevel>
+EstimateTL ("horn-estimate-sem-lvl",
+            llvm::cl::desc ("Track level assumed by the encoding estimate"),
+            llvm::cl::values (clEnumValN (seahorn::REG, "reg", "Primitive registers only"),
+                              clEnumValN (seahorn::PTR, "ptr", "REG + pointers"),
+                              clEnumValN (seahorn::MEM, "mem", "PTR + memory content"),
+                              clEnumValEnd),
+            llvm::cl::init (seahorn::MEM));
+
+namespace
+{
+  using namespace llvm;
+  using namespace seahorn;
+  using namespace expr;
+
+  struct Size
+  {
+    unsigned relations;
+    /// sum of the arities of the relations
+    unsigned arity;
+    unsigned rules;
+    Size () : relations (0), arity (0), rules (0) {}
+    Size &operator+= (const Size &o)
+    {
+      relations += o.relations; arity += o.arity; rules += o.rules;
+      return *this;
+    }
+  };
+
+  enum { SMALL, LARGE, FLARGE, FSMALL, NUM_STEPS };
+  const char *stepNames [NUM_STEPS] = {"small", "large", "flarge", "fsmall"};
+
+  struct FunctionSize
+  {
+    std::string name;
+    Size steps [NUM_STEPS];
+  };
+
+  const BasicBlock *exitBlock (const Function &F)
+  {
+    for (const BasicBlock &bb : F)
+      if (isa<ReturnInst> (bb.getTerminator ())) return &bb;
+    return nullptr;
+  }
+
+  class HornEstimate : public ModulePass
+  {
+    std::string m_file;
+
+    void printSize (const Size &s, raw_ostream &OS)
+    {
+      OS << "{\"relations\": " << s.relations << ", \"arity\": " << s.arity
+         << ", \"rules\": " << s.rules << "}";
+    }
+
+    void printSteps (const Size *steps, raw_ostream &OS)
+    {
+      OS << "{";
+      for (unsigned i = 0; i < NUM_STEPS; ++i)
+      {
+        OS << (i ? ", " : "") << "\"" << stepNames [i] << "\": ";
+        printSize (steps [i], OS);
+      }
+      OS << "}";
+    }
+
+    void write (const std::vector<FunctionSize> &fns, raw_ostream &OS)
+    {
+      Size total [NUM_STEPS];
+      for (const FunctionSize &f : fns)
+        for (unsigned i = 0; i < NUM_STEPS; ++i) total [i] += f.steps [i];
+
+      // -- the cost of a step is the number of rules and of the
+      // -- arguments of its relations, which is what the solvers pay
+      // -- for most
+      unsigned cheapest = 0;
+      for (unsigned i = 1; i < NUM_STEPS; ++i)
+        if (total [i].rules + total [i].arity <
+            total [cheapest].rules + total [cheapest].arity) cheapest = i;
+
+      OS << "{\"functions\": [";
+      bool first = true;
+      for (const FunctionSize &f : fns)
+      {
+        OS << (first ? "" : ",") << "\n{\"name\": \"";
+        first = false;
+        for (char c : f.name) { if (c == '"' || c == '\\') OS << '\\'; OS << c; }
+        OS << "\", \"steps\": ";
+        printSteps (f.steps, OS);
+        OS << "}";
+      }
+      OS << "],\n\"total\": ";
+      printSteps (total, OS);
+      OS << ",\n\"cheapest\": \"" << stepNames [cheapest] << "\"}\n";
+    }
+
+  public:
+    static char ID;
+
+    HornEstimate (const std::string &file) : ModulePass (ID), m_file (file) {}
+
+    bool runOnModule (Module &M) override
+    {
+      ExprFactory efac;
+      UfoSmallSymExec sem (efac, *this, EstimateTL);
+      std::vector<FunctionSize> fns;
+
+      for (Function &F : M)
+      {
+        if (F.isDeclaration () || F.empty ()) continue;
+
+        // -- the cut-point graph unifies the exit nodes, so it must
+        // -- be built before the liveness, as by HornifyModule
+        const CutPointGraph &cpg = getAnalysis<FunctionAnalysisCache> ().cpg (F);
+        LiveSymbols ls (F, efac, sem);
+        ls.run ();
+
+        const BasicBlock *exit = exitBlock (F);
+        if (!exit) continue;
+
+        fns.push_back (FunctionSize ());
+        FunctionSize &fs = fns.back ();
+        fs.name = F.getName ();
+
+        bool isMain = F.getName ().equals ("main");
+        // -- the rules of the summary of a function other than main:
+        // -- its success and its error. Main gets a query instead
+        unsigned sumRules = isMain ? 0 : 2;
+
+        // -- small: a relation per block, a rule per CFG edge
+        ExprSet glive;
+        unsigned cfgEdges = 0;
+        for (const BasicBlock &bb : F)
+        {
+          const ExprVector &live = ls.live (&bb);
+          fs.steps [SMALL].arity += live.size ();
+          glive.insert (live.begin (), live.end ());
+          cfgEdges += std::distance (succ_begin (&bb), succ_end (&bb));
+        }
+        unsigned blocks = F.size ();
+        fs.steps [SMALL].relations = blocks;
+        fs.steps [SMALL].rules = 1 + cfgEdges + (blocks - 1) + sumRules;
+
+        // -- fsmall: the same rules over a single relation of the pc
+        // -- and of all symbols live somewhere
+        fs.steps [FSMALL].relations = 1;
+        fs.steps [FSMALL].arity = 1 + glive.size ();
+        fs.steps [FSMALL].rules = fs.steps [SMALL].rules;
+
+        // -- large: a relation per cut-point, a rule per cut-point edge
+        ExprSet cplive;
+        for (const CutPoint &cp : cpg)
+        {
+          const ExprVector &live = ls.live (&cp.bb ());
+          fs.steps [LARGE].arity += live.size ();
+          cplive.insert (live.begin (), live.end ());
+        }
+        fs.steps [LARGE].relations = cpg.size ();
+        fs.steps [LARGE].rules = 1 + cpg.numEdges () + (cpg.size () - 1) + sumRules;
+
+        fs.steps [FLARGE].relations = 1;
+        fs.steps [FLARGE].arity = 1 + cplive.size ();
+        fs.steps [FLARGE].rules = fs.steps [LARGE].rules;
+
+        if (!isMain)
+        {
+          // -- the summary is over three flags and the symbols live at
+          // -- the exit, which are the regions, arguments, globals and
+          // -- the return value of the function
+          for (unsigned i = 0; i < NUM_STEPS; ++i)
+          {
+            fs.steps [i].relations += 1;
+            fs.steps [i].arity += 3 + ls.live (exit).size ();
+          }
+        }
+      }
+
+      if (m_file == "-")
+      {
+        write (fns, outs ());
+        return false;
+      }
+      std::error_code ec;
+      raw_fd_ostream out (m_file, ec, sys::fs::F_Text);
+      if (ec)
+        errs () << "ERROR: cannot write the encoding estimate to " << m_file
+                << ": " << ec.message () << "\n";
+      else
+        write (fns, out);
+      return false;
+    }
+
+    void getAnalysisUsage (AnalysisUsage &AU) const override
+    {
+      AU.setPreservesAll ();
+      AU.addRequired<FunctionAnalysisCache> ();
+    }
+
+    const char *getPassName () const override { return "HornEstimate"; }
+  };
+
+  char HornEstimate::ID = 0;
+}
+
+namespace seahorn
+{
+  Pass *createHornEstimatePass (const std::string &file)
+  { return new HornEstimate (file); }
+}
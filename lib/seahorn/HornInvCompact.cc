@@ -0,0 +1,153 @@
+#include "seahorn/HornInvCompact.hh"
+
+#include "ufo/Smt/Z3n.hpp"
+#include "ufo/Stats.hh"
+
+#include <algorithm>
+#include <set>
+
+namespace seahorn
+{
+  using namespace ufo;
+
+  namespace
+  {
+    /// term <= k, term < k, term >= k or term > k, for a numeral k
+    struct Bound
+    {
+      Expr term;
+      bool upper;
+      bool strict;
+      mpz_class k;
+    };
+
+    bool asBound (Expr e, Bound &b)
+    {
+      if (isOpX<LEQ> (e)) { b.upper = true; b.strict = false; }
+      else if (isOpX<LT> (e)) { b.upper = true; b.strict = true; }
+      else if (isOpX<GEQ> (e)) { b.upper = false; b.strict = false; }
+      else if (isOpX<GT> (e)) { b.upper = false; b.strict = true; }
+      else return false;
+
+      if (isOpX<MPZ> (e->right ()))
+      {
+        b.term = e->left ();
+        b.k = getTerm<mpz_class> (e->right ());
+      }
+      else if (isOpX<MPZ> (e->left ()))
+      {
+        // -- k <= term is a lower bound
+        b.term = e->right ();
+        b.k = getTerm<mpz_class> (e->left ());
+        b.upper = !b.upper;
+      }
+      else return false;
+      return true;
+    }
+
+    /// a implies b, syntactically
+    bool implies (Expr a, Expr b)
+    {
+      if (a == b) return true;
+      if (isOpX<OR> (b))
+      {
+        for (unsigned i = 0; i < b->arity (); ++i)
+          if (implies (a, b->arg (i))) return true;
+        return false;
+      }
+
+      Bound ba, bb;
+      if (!asBound (a, ba) || !asBound (b, bb)) return false;
+      if (ba.term != bb.term || ba.upper != bb.upper) return false;
+      int c = cmp (ba.k, bb.k);
+      if (!ba.upper) c = -c;
+      // -- e.g., x <= 3 implies x <= 5, and x < 5 implies x <= 5
+      return c < 0 || (c == 0 && (ba.strict || !bb.strict));
+    }
+
+    void flatten (Expr e, ExprVector &out, std::set<Expr> &seen)
+    {
+      if (isOpX<AND> (e))
+      {
+        for (unsigned i = 0; i < e->arity (); ++i) flatten (e->arg (i), out, seen);
+        return;
+      }
+      if (isOpX<TRUE> (e)) return;
+      if (seen.insert (e).second) out.push_back (e);
+    }
+  }
+
+  void HornInvCompactor::compactConjuncts (Expr inv, ExprVector &kept)
+  {
+    ExprVector conj;
+    std::set<Expr> seen;
+    flatten (inv, conj, seen);
+    for (Expr c : conj)
+      if (isOpX<FALSE> (c))
+      {
+        kept.push_back (c);
+        return;
+      }
+
+    // -- a conjunct is only removed for one that stays, so that of two
+    // -- equivalent ones the last is kept
+    std::vector<bool> removed (conj.size (), false);
+    unsigned syntactic = 0;
+    for (size_t i = 0; i < conj.size (); ++i)
+      for (size_t j = 0; j < conj.size (); ++j)
+        if (i != j && !removed [j] && implies (conj [j], conj [i]))
+        {
+          removed [i] = true;
+          ++syntactic;
+          break;
+        }
+    if (syntactic > 0)
+      Stats::uset ("InvCompactSyntactic", Stats::get ("InvCompactSyntactic") + syntactic);
+
+    for (size_t i = 0; i < conj.size (); ++i)
+      if (!removed [i]) kept.push_back (conj [i]);
+    if (!m_zctx || m_smtTimeout == 0 || kept.size () < 2) return;
+
+    ZSolver<EZ3> solver (*m_zctx);
+    ZParams<EZ3> params (*m_zctx);
+    params.set (ZBudget (m_smtTimeout));
+    solver.set (params);
+    for (size_t i = kept.size (); i > 0; --i)
+    {
+      Expr c = kept [i - 1];
+      solver.reset ();
+      for (Expr d : kept)
+        if (d != c) solver.assertExpr (d);
+      solver.assertExpr (mk<NEG> (c));
+      boost::tribool res = boost::indeterminate;
+      try { res = solver.solve (); }
+      catch (z3::exception &e) {}
+      if (res || boost::indeterminate (res)) continue;
+      kept.erase (kept.begin () + (i - 1));
+      Stats::count ("InvCompactSmt");
+    }
+  }
+
+  Expr HornInvCompactor::compact (Expr inv)
+  {
+    auto it = m_cache.find (inv);
+    if (it != m_cache.end ()) return it->second;
+
+    Expr res = op::boolop::simplify (inv);
+    if (m_zctx)
+    {
+      Expr s = z3_simplify (*m_zctx, res);
+      if (dagSize (s) <= dagSize (res)) res = s;
+    }
+
+    if (!isOpX<FALSE> (res))
+    {
+      ExprVector kept;
+      compactConjuncts (res, kept);
+      res = mknary<AND> (mk<TRUE> (inv->efac ()), kept);
+    }
+    if (dagSize (res) > dagSize (inv)) res = inv;
+    m_cache [inv] = res;
+    return res;
+  }
+}
@@ -0,0 +1,45 @@
+#include "seahorn/HornLemmaQueue.hh"
+
+namespace seahorn
+{
+  void HornLemmaQueue::start ()
+  {
+    if (!m_producer || m_worker.joinable () || m_done) return;
+    m_worker = std::thread ([this] ()
+                            {
+                              m_producer (*this);
+                              std::lock_guard<std::mutex> l (m_lock);
+                              m_done = true;
+                            });
+  }
+
+  void HornLemmaQueue::run ()
+  {
+    if (m_worker.joinable ()) { m_worker.join (); return; }
+    if (!m_producer || m_done) return;
+    m_producer (*this);
+    std::lock_guard<std::mutex> l (m_lock);
+    m_done = true;
+  }
+
+  void HornLemmaQueue::stop ()
+  {
+    if (!m_worker.joinable ()) return;
+    m_cancel = true;
+    m_worker.join ();
+  }
+
+  void HornLemmaQueue::push (Expr pred, Expr lemma)
+  {
+    std::lock_guard<std::mutex> l (m_lock);
+    m_lemmas.push_back (HornLemma (pred, lemma));
+  }
+
+  bool HornLemmaQueue::take (std::vector<HornLemma> &out)
+  {
+    std::lock_guard<std::mutex> l (m_lock);
+    out.insert (out.end (), m_lemmas.begin (), m_lemmas.end ());
+    m_lemmas.clear ();
+    return !m_done || !out.empty ();
+  }
+}
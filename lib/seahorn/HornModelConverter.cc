@@ -4,11 +4,203 @@
 #include "seahorn/HornClauseDB.hh"
 
 #include "ufo/Expr.hpp"
+#include <memory>
 #include <vector>
 
 #include "ufo/Stats.hh"
 
 namespace seahorn
 {
+  /// application of fdecl to fresh constants
+  static Expr mkGenericFapp (Expr fdecl)
+  {
+    ExprVector args;
+    for (unsigned i = 0, sz = bind::domainSz (fdecl); i < sz; ++i)
+    {
+      Expr name = variant::variant (i, mkTerm<std::string> ("V", fdecl->efac ()));
+      args.push_back (bind::fapp (bind::constDecl (name, bind::domainTy (fdecl, i))));
+    }
+    return bind::fapp (fdecl, args);
+  }
 
+  bool HornSliceModelConverter::convert (HornDbModel &in, HornDbModel &out)
+  {
+    // -- out may outlive in, or replace it
+    std::shared_ptr<HornDbModel> src = std::make_shared<HornDbModel> (in);
+    for (Expr fdecl : m_kept)
+    {
+      Expr fapp = mkGenericFapp (fdecl);
+      out.addLazyDef (fapp, [src, fapp] () { return src->getDef (fapp); });
+    }
+    for (Expr fdecl : m_empty)
+      out.addDef (mkGenericFapp (fdecl), mk<FALSE> (fdecl->efac ()));
+    for (Expr fdecl : m_free)
+      out.addDef (mkGenericFapp (fdecl), mk<TRUE> (fdecl->efac ()));
+    return true;
+  }
+}
+
+namespace seahorn
+{
+  const ExprVector HornSimplifyModelConverter::m_empty_chain;
+
+  void HornSimplifyModelConverter::addInlined (Expr rel, const HornRule &def, 
+                                               const ExprVector &apps)
+  {
+    Inlined s;
+    s.rel = rel;
+    s.head = def.head ();
+    s.body = def.body ();
+    s.vars = def.vars ();
+    s.apps = apps;
+    m_steps.push_back (std::make_pair (true, m_inlined.size ()));
+    m_inlined.push_back (s);
+  }
+
+  void HornSimplifyModelConverter::addReduced (Expr rel, Expr newRel,
+                                               const std::vector<unsigned> &kept,
+                                               const std::vector<FixedArg> &fixed)
+  {
+    Reduced s;
+    s.rel = rel;
+    s.newRel = newRel;
+    s.kept = kept;
+    s.fixed = fixed;
+    m_newRels [newRel] = m_reduced.size ();
+    m_steps.push_back (std::make_pair (false, m_reduced.size ()));
+    m_reduced.push_back (s);
+  }
+
+  Expr HornSimplifyModelConverter::origin (Expr fdecl) const
+  {
+    for (auto it = m_newRels.find (fdecl); it != m_newRels.end (); 
+         it = m_newRels.find (fdecl))
+      fdecl = m_reduced [it->second].rel;
+    return fdecl;
+  }
+
+  const ExprVector &HornSimplifyModelConverter::getChain (Expr src, Expr dst) const
+  {
+    auto it = m_chains.find (std::make_pair (src, dst));
+    return it == m_chains.end () ? m_empty_chain : it->second;
+  }
+
+  Expr HornSimplifyModelConverter::restoreApp (Expr app) const
+  {
+    for (auto it = m_newRels.find (bind::fname (app)); it != m_newRels.end ();
+         it = m_newRels.find (bind::fname (app)))
+    {
+      const Reduced &s = m_reduced [it->second];
+      Expr generic = mkGenericFapp (s.rel);
+      ExprVector args (++generic->args_begin (), generic->args_end ());
+      for (unsigned i = 0; i < s.kept.size (); ++i)
+        args [s.kept [i]] = app->arg (i + 1);
+      for (const FixedArg &f : s.fixed)
+        args [f.pos] = f.value ? f.value : args [f.same];
+      app = bind::fapp (s.rel, args);
+    }
+    return app;
+  }
+
+  bool HornSimplifyModelConverter::convert (HornDbModel &in, HornDbModel &out)
+  {
+    HornDbModel m (in);
+    try
+    {
+      for (auto step = m_steps.rbegin (); step != m_steps.rend (); ++step)
+      {
+        if (!step->first)
+        {
+          const Reduced &s = m_reduced [step->second];
+          Expr generic = mkGenericFapp (s.rel);
+          ExprVector args;
+          for (unsigned i : s.kept) args.push_back (generic->arg (i + 1));
+          Expr def = m.getDef (bind::fapp (s.newRel, args));
+          for (const FixedArg &f : s.fixed)
+            def = boolop::land (def, mk<EQ> (generic->arg (f.pos + 1),
+                                             f.value ? f.value : 
+                                             generic->arg (f.same + 1)));
+          m.addDef (generic, def);
+          continue;
+        }
+
+        // -- rel (V) is the projection of body /\ V = head on V
+        const Inlined &s = m_inlined [step->second];
+        Expr generic = mkGenericFapp (s.rel);
+        ExprMap defs;
+        for (Expr app : s.apps) defs [app] = m.getDef (app);
+        Expr body = replace (s.body, defs);
+
+        ExprSet vars (s.vars.begin (), s.vars.end ());
+        ExprMap sub;
+        ExprVector eqs;
+        for (unsigned i = 0, sz = bind::domainSz (s.rel); i < sz; ++i)
+        {
+          Expr t = s.head->arg (i + 1);
+          if (vars.count (t) && !sub.count (t)) sub [t] = generic->arg (i + 1);
+          else eqs.push_back (mk<EQ> (generic->arg (i + 1), t));
+        }
+        for (Expr eq : eqs) body = boolop::land (body, eq);
+        body = replace (body, sub);
+
+        ExprSet locals;
+        for (Expr v : s.vars) 
+          if (!sub.count (v) && contains (body, v)) locals.insert (v);
+        if (!locals.empty ())
+          body = boolop::lneg (z3_forall_elim (m_z3, boolop::lneg (body), locals));
+        m.addDef (generic, body);
+      }
+    }
+    catch (z3::exception &e)
+    {
+      errs () << "WARNING: cannot rebuild the model of inlined relations: " 
+              << e.msg () << "\n";
+      return false;
+    }
+    out = m;
+    return true;
+  }
+
+  void HornSimplifyModelConverter::convertCex (HornClauseDB &db, 
+                                               const ExprVector &in,
+                                               ExprVector &out) const
+  {
+    ExprFactory &efac = db.getExprFactory ();
+    ExprVector res;
+    // -- the rules of in are from the last step to the first
+    for (auto it = in.rbegin (); it != in.rend (); ++it)
+    {
+      Expr r = *it;
+      Expr dst = isOpX<IMPL> (r) ? r->arg (1) : r;
+      if (!bind::isFapp (dst))
+      {
+        res.push_back (r);
+        continue;
+      }
+      ExprVector apps;
+      if (isOpX<IMPL> (r)) get_all_pred_apps (r->arg (0), db, std::back_inserter (apps));
+
+      Expr src = apps.size () == 1 ? origin (bind::fname (apps [0])) : mk<TRUE> (efac);
+      const ExprVector &chain = getChain (src, origin (bind::fname (dst)));
+      if (apps.size () > 1 || chain.empty ())
+      {
+        ExprMap restored;
+        for (Expr app : apps) restored [app] = restoreApp (app);
+        restored [dst] = restoreApp (dst);
+        res.push_back (replace (r, restored));
+        continue;
+      }
+
+      // -- one rule per skipped relation
+      Expr prev = apps.empty () ? Expr () : restoreApp (apps [0]);
+      for (Expr rel : chain)
+      {
+        Expr next = mkGenericFapp (rel);
+        res.push_back (prev ? mk<IMPL> (prev, next) : next);
+        prev = next;
+      }
+      res.push_back (mk<IMPL> (prev, restoreApp (dst)));
+    }
+    out.insert (out.end (), res.rbegin (), res.rend ());
+  }
 }
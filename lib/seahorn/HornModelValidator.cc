@@ -0,0 +1,152 @@
+#include "seahorn/HornModelValidator.hh"
+#include "seahorn/Support/TaskPool.hh"
+
+#include "llvm/Support/CommandLine.h"
+
+#include "ufo/Smt/Z3n.hpp"
+#include "ufo/Smt/EZ3.hh"
+#include "ufo/Stats.hh"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+static llvm::cl::opt<bool>
+ValidateModel ("horn-validate-model",
+               llvm::cl::desc ("Check the invariants found against every rule "
+                               "with a solver of their own"),
+               llvm::cl::init (false));
+
+static llvm::cl::opt<unsigned>
+ValidateTimeout ("horn-validate-timeout",
+                 llvm::cl::desc ("Timeout of the check of a rule by "
+                                 "--horn-validate-model in milliseconds (0 = none)"),
+                 llvm::cl::init (0));
+
+namespace seahorn
+{
+  namespace
+  {
+    enum Answer { HOLDS, FAILS, UNKNOWN };
+  }
+
+  bool HornModelValidator::enabled () { return ValidateModel; }
+
+  boost::tribool HornModelValidator::validate (HornClauseDB &db, HornDbModel &model,
+                                               unsigned threads, bool queries)
+  {
+    ufo::ScopedStats _st_("HornValidate");
+    ExprFactory &efac = db.getExprFactory ();
+    m_failed.reset ();
+    m_checked = m_cached = 0;
+
+    // -- the model may be lazy, e.g., over a fixedpoint, so the
+    // -- queries are built here and only solved by the workers
+    std::vector<HornRule> rules (db.getRules ().begin (), db.getRules ().end ());
+    if (queries)
+    {
+      ExprVector none;
+      for (Expr q : db.getQueries ())
+        rules.push_back (HornRule (none, mk<FALSE> (efac), q));
+    }
+
+    ExprVector checks;
+    std::vector<unsigned> todo;
+    for (unsigned i = 0; i < rules.size (); ++i)
+    {
+      const HornRule &r = rules [i];
+      ExprVector conj;
+      ExprVector apps;
+      r.pred_apps (db, std::back_inserter (apps));
+      for (Expr app : apps) conj.push_back (model.getDef (app));
+      conj.push_back (extractTransitionRelation (r, db));
+      conj.push_back (mk<NEG> (bind::isFapp (r.head ()) ?
+                               model.getDef (r.head ()) : r.head ()));
+      checks.push_back (mknary<AND> (mk<TRUE> (efac), conj));
+
+      auto it = m_cache.find (checks.back ());
+      if (it == m_cache.end ()) todo.push_back (i);
+      else if (it->second) ++m_cached;
+      else
+      {
+        ++m_cached;
+        m_failed.reset (new HornRule (r));
+        return false;
+      }
+    }
+
+    threads = efac.isConcurrent () ? std::max (1U, threads) : 1;
+    std::vector<char> answers (todo.size (), UNKNOWN);
+    if (!m_contexts) m_contexts.reset (new ZWorkerContexts<EZ3> (efac));
+    // -- the first failure interrupts the checks of the other workers
+    TaskPool pool ("HornValidate.checks", threads);
+    if (m_timeLimit > 0) pool.token ().setTimeout (m_timeLimit);
+    std::vector<std::unique_ptr<ZSolver<EZ3> > > solvers (pool.threads ());
+    pool.run (todo.size (), [&] (unsigned w, size_t k)
+              {
+                // -- kept across calls, with the terms they marshaled
+                EZ3 &z3 = m_contexts->get (w);
+                if (!solvers [w])
+                {
+                  solvers [w].reset (new ZSolver<EZ3> (z3));
+                  if (ValidateTimeout > 0)
+                  {
+                    ZParams<EZ3> params (z3);
+                    params.set (ZBudget (ValidateTimeout));
+                    solvers [w]->set (params);
+                  }
+                }
+                ZSolver<EZ3> &solver = *solvers [w];
+                boost::tribool res = boost::indeterminate;
+                try
+                {
+                  solver.reset ();
+                  solver.assertExpr (checks [todo [k]]);
+                  CancelToken::Hook h (pool.token (), [&z3] { z3.interrupt (); });
+                  res = solver.solve ();
+                }
+                catch (z3::exception &e) {}
+                if (res) pool.token ().cancel ();
+                answers [k] = res ? FAILS : (!res ? HOLDS : UNKNOWN);
+              });
+
+    // -- in the order of db, whichever worker found it first
+    boost::tribool res = true;
+    for (unsigned k = 0; k < todo.size (); ++k)
+    {
+      if (answers [k] == UNKNOWN)
+      {
+        // -- skipped after a failure, or unknown
+        if (res) res = boost::indeterminate;
+        continue;
+      }
+      ++m_checked;
+      m_cache [checks [todo [k]]] = answers [k] == HOLDS;
+      if (answers [k] == FAILS && !m_failed)
+      {
+        m_failed.reset (new HornRule (rules [todo [k]]));
+        res = false;
+      }
+    }
+    return res;
+  }
+
+  void HornModelValidator::report (boost::tribool res, llvm::raw_ostream &out) const
+  {
+    if (res)
+      out << "model validation: valid, " << m_checked << " checks and "
+          << m_cached << " cached\n";
+    else if (!res)
+    {
+      out << "WARNING: model validation failed at rule\n";
+      if (m_failed)
+        out << "  " << *m_failed->body () << "\n  -> " << *m_failed->head () << "\n";
+    }
+    else
+      out << "WARNING: model validation is unknown\n";
+
+    ufo::Stats::sset ("HornValidate", res ? "valid" : (!res ? "invalid" : "unknown"));
+    ufo::Stats::uset ("HornValidateChecked", m_checked);
+    ufo::Stats::uset ("HornValidateCached", m_cached);
+  }
+}
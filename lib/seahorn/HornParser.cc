@@ -0,0 +1,181 @@
+#include "seahorn/HornParser.hh"
+
+#include "ufo/SmtLibParser.hpp"
+
+#include <fstream>
+#include <set>
+
+namespace seahorn
+{
+  namespace
+  {
+    class HornLoader
+    {
+      HornClauseDB &m_db;
+      ExprFactory &m_efac;
+      /// variables declared with declare-var
+      std::set<Expr> m_globals;
+      unsigned m_queryCnt;
+
+      struct IsGlobal : public std::unary_function<Expr, bool>
+      {
+        const std::set<Expr> &m_vars;
+        IsGlobal (const std::set<Expr> &vars) : m_vars (vars) {}
+        bool operator() (Expr e) { return m_vars.count (e) > 0; }
+      };
+
+      /// a fresh nullary relation that stands for a query
+      Expr mkQueryRel ()
+      {
+        Expr name = mkTerm<std::string>
+          ("query!" + boost::lexical_cast<std::string> (m_queryCnt++), m_efac);
+        Expr rel = bind::boolConstDecl (name);
+        m_db.registerRelation (rel);
+        return rel;
+      }
+
+      bool isRelApp (Expr e) const
+      { return bind::isFapp (e) && m_db.hasRelation (bind::fname (e)); }
+
+    public:
+      HornLoader (HornClauseDB &db) :
+        m_db (db), m_efac (db.getExprFactory ()), m_queryCnt (0) {}
+
+      void declareVar (Expr v) { m_globals.insert (v); }
+
+      /// vars of a fixedpoint rule are the declared variables it uses
+      ExprVector ruleVars (Expr rule)
+      {
+        ExprVector vars;
+        filter (rule, IsGlobal (m_globals), std::back_inserter (vars));
+        return vars;
+      }
+
+      bool addClause (const ExprVector &vars, Expr clause)
+      {
+        Expr body = mk<TRUE> (m_efac);
+        Expr head = clause;
+        if (isOpX<IMPL> (clause) && clause->arity () == 2)
+        {
+          body = clause->left ();
+          head = clause->right ();
+        }
+
+        // -- (not B) is B => false
+        if (isOpX<NEG> (head))
+        {
+          body = isOpX<TRUE> (body) ? head->left () : mk<AND> (body, head->left ());
+          head = mk<FALSE> (m_efac);
+        }
+
+        if (isOpX<FALSE> (head))
+        {
+          Expr q = bind::fapp (mkQueryRel ());
+          m_db.addRule (HornRule (vars, q, body));
+          m_db.addQuery (q);
+          return true;
+        }
+
+        if (!isRelApp (head)) return false;
+        m_db.addRule (HornRule (vars, head, body));
+        return true;
+      }
+
+      void addQuery (Expr q)
+      {
+        if (bind::isFdecl (q))
+        {
+          // -- query of a relation: exists args . P (args)
+          ExprVector args;
+          for (unsigned i = 0, sz = bind::domainSz (q); i < sz; ++i)
+          {
+            Expr name = mkTerm<std::string>
+              ("query_arg_" + boost::lexical_cast<std::string> (i), m_efac);
+            args.push_back (bind::mkConst (name, bind::domainTy (q, i)));
+          }
+          Expr rel = bind::fapp (mkQueryRel ());
+          m_db.addRule (HornRule (args, rel, bind::fapp (q, args)));
+          m_db.addQuery (rel);
+          return;
+        }
+
+        if (isRelApp (q))
+        {
+          m_db.addQuery (q);
+          return;
+        }
+        // -- an arbitrary formula over relations and declared variables
+        Expr rel = bind::fapp (mkQueryRel ());
+        ExprVector vars = ruleVars (q);
+        m_db.addRule (HornRule (vars, rel, q));
+        m_db.addQuery (rel);
+      }
+    };
+  }
+
+  bool loadHornClauseDB (std::istream &in, HornClauseDB &db,
+                         std::string &error)
+  {
+    ufo::ScopedStats _st_("HornParser");
+
+    expr::smtlib::Parser parser (in, db.getExprFactory ());
+    parser.bindQuantifiedAsConsts (true);
+    HornLoader loader (db);
+
+    typedef expr::smtlib::Command Command;
+    Command cmd;
+    while (parser.next (cmd))
+    {
+      switch (cmd.kind)
+      {
+      case Command::DECLARE_FUN:
+        // -- in the HORN logic, every uninterpreted predicate is a relation
+        if (isOpX<BOOL_TY> (bind::rangeTy (cmd.expr)))
+          db.registerRelation (cmd.expr);
+        break;
+      case Command::DECLARE_REL:
+        db.registerRelation (cmd.expr);
+        break;
+      case Command::DECLARE_VAR:
+        loader.declareVar (cmd.expr);
+        break;
+      case Command::ASSERT:
+        if (!loader.addClause (cmd.vars, cmd.expr))
+        {
+          error = "assertion is not a Horn clause: " +
+            boost::lexical_cast<std::string> (*cmd.expr);
+          return false;
+        }
+        break;
+      case Command::RULE:
+        if (!loader.addClause (loader.ruleVars (cmd.expr), cmd.expr))
+        {
+          error = "rule is not a Horn clause: " +
+            boost::lexical_cast<std::string> (*cmd.expr);
+          return false;
+        }
+        break;
+      case Command::QUERY:
+        loader.addQuery (cmd.expr);
+        break;
+      default:
+        break;
+      }
+    }
+
+    error = parser.getError ();
+    return !parser.hasError ();
+  }
+
+  bool loadHornClauseDB (const std::string &fname, HornClauseDB &db,
+                         std::string &error)
+  {
+    std::ifstream in (fname.c_str ());
+    if (!in)
+    {
+      error = "cannot open " + fname;
+      return false;
+    }
+    return loadHornClauseDB (in, db, error);
+  }
+}
@@ -0,0 +1,241 @@
+#include "seahorn/HornPortfolio.hh"
+
+#include "llvm/Support/raw_ostream.h"
+#include "ufo/Stats.hh"
+
+#include <csignal>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+namespace seahorn
+{
+  namespace
+  {
+    void (*cancelHook) (void*) = nullptr;
+    void *cancelArg = nullptr;
+
+    extern "C" void onCancel (int) { if (cancelHook) cancelHook (cancelArg); }
+
+    char encode (boost::tribool r)
+    {
+      if (r) return 's';
+      if (!r) return 'u';
+      return '?';
+    }
+
+    /// body of a worker. Never returns
+    void runWorker (const PortfolioJob &job, int fd, unsigned memLimitMb)
+    {
+      if (memLimitMb > 0)
+      {
+        struct rlimit rl;
+        rl.rlim_cur = rl.rlim_max = static_cast<rlim_t> (memLimitMb) << 20;
+        setrlimit (RLIMIT_AS, &rl);
+      }
+      signal (SIGTERM, onCancel);
+
+      char res = '?';
+      try { res = encode (job ()); }
+      // -- most likely out of memory
+      catch (...) { res = '?'; }
+
+      while (write (fd, &res, 1) < 0 && errno == EINTR);
+      close (fd);
+      // -- skip destructors and exit handlers of the parent
+      _exit (0);
+    }
+
+    /// waits for pid for at most ms milliseconds
+    bool waitFor (pid_t pid, unsigned ms)
+    {
+      for (unsigned i = 0; i <= ms; i += 10)
+      {
+        if (waitpid (pid, NULL, WNOHANG) == pid) return true;
+        usleep (10000);
+      }
+      return false;
+    }
+  }
+
+  bool PortfolioConfig::parse (const std::string &spec, PortfolioConfig &out)
+  {
+    out = PortfolioConfig ();
+    out.name = spec;
+
+    std::string s = spec;
+    const std::string prefix = "houdini+";
+    if (s.compare (0, prefix.size (), prefix) == 0)
+    {
+      out.houdini = true;
+      s = s.substr (prefix.size ());
+    }
+
+    size_t pos = s.find (':');
+    out.engine = s.substr (0, pos);
+    if (out.engine.empty ()) return false;
+
+    while (pos != std::string::npos)
+    {
+      size_t next = s.find (':', pos + 1);
+      std::string kv = s.substr (pos + 1, next == std::string::npos ?
+                                 std::string::npos : next - pos - 1);
+      size_t eq = kv.find ('=');
+      if (eq == std::string::npos || eq == 0) return false;
+      out.params.push_back (std::make_pair (":" + kv.substr (0, eq),
+                                            kv.substr (eq + 1)));
+      pos = next;
+    }
+    return true;
+  }
+
+  bool loadTunedConfigs (const std::string &file, const std::string &cluster,
+                         std::vector<std::string> &specs)
+  {
+    std::ifstream in (file.c_str ());
+    if (!in) return false;
+
+    std::vector<std::string> mine, fallback;
+    std::string line;
+    while (std::getline (in, line))
+    {
+      line = line.substr (0, line.find ('#'));
+      std::istringstream fields (line);
+      std::string name, spec;
+      if (!(fields >> name >> spec)) continue;
+      if (name == cluster) mine.push_back (spec);
+      else if (name == "default") fallback.push_back (spec);
+    }
+    const std::vector<std::string> &res = mine.empty () ? fallback : mine;
+    specs.insert (specs.end (), res.begin (), res.end ());
+    return true;
+  }
+
+  void setPortfolioCancelHook (void (*hook) (void*), void *arg)
+  {
+    cancelHook = hook;
+    cancelArg = arg;
+  }
+
+  void runEach (const std::vector<PortfolioJob> &jobs, unsigned memLimitMb,
+                unsigned parallel, PortfolioAnswerFn onAnswer, unsigned graceMs)
+  {
+    // -- buffered output would be written by every worker
+    llvm::outs ().flush ();
+    llvm::errs ().flush ();
+    std::cout.flush ();
+    std::cerr.flush ();
+
+    if (parallel == 0) parallel = jobs.size ();
+    std::vector<pid_t> pids;
+    /// the pipe of every started job, -1 once it answered
+    std::vector<struct pollfd> fds;
+    size_t running = 0;
+    bool stop = false;
+    // -- no more jobs start once a fork fails
+    bool failed = false;
+    while (!stop)
+    {
+      // -- start jobs while there is room
+      while (!failed && running < parallel && fds.size () < jobs.size ())
+      {
+        int p [2];
+        if (pipe (p) != 0)
+        {
+          llvm::errs () << "portfolio: cannot create pipe\n";
+          failed = true;
+          break;
+        }
+
+        pid_t pid = fork ();
+        if (pid < 0)
+        {
+          llvm::errs () << "portfolio: cannot fork\n";
+          close (p [0]);
+          close (p [1]);
+          failed = true;
+          break;
+        }
+        if (pid == 0)
+        {
+          close (p [0]);
+          for (struct pollfd &f : fds) if (f.fd >= 0) close (f.fd);
+          runWorker (jobs [fds.size ()], p [1], memLimitMb);
+        }
+
+        close (p [1]);
+        pids.push_back (pid);
+        struct pollfd f;
+        f.fd = p [0];
+        f.events = POLLIN;
+        f.revents = 0;
+        fds.push_back (f);
+        ++running;
+      }
+      // -- the jobs that did not start get no answer
+      if (running == 0) break;
+
+      if (poll (&fds [0], fds.size (), -1) < 0)
+      {
+        if (errno == EINTR) continue;
+        break;
+      }
+
+      for (size_t i = 0; i < fds.size () && !stop; ++i)
+      {
+        if (fds [i].fd < 0 || fds [i].revents == 0) continue;
+
+        char c = '?';
+        ssize_t n = read (fds [i].fd, &c, 1);
+        if (n < 0 && errno == EINTR) continue;
+        // -- a worker that dies without answering, e.g., because it
+        // -- ran out of memory, closes the pipe
+        if (n <= 0) c = '?';
+
+        close (fds [i].fd);
+        fds [i].fd = -1;
+        --running;
+
+        boost::tribool answer = boost::indeterminate;
+        if (c == 's') answer = true;
+        else if (c == 'u') answer = false;
+        stop = !onAnswer (i, answer);
+      }
+    }
+
+    for (struct pollfd &f : fds) if (f.fd >= 0) close (f.fd);
+
+    // -- stop the slower workers, cooperatively first
+    for (pid_t pid : pids) kill (pid, SIGTERM);
+    for (pid_t pid : pids)
+      if (!waitFor (pid, graceMs))
+      {
+        kill (pid, SIGKILL);
+        waitpid (pid, NULL, 0);
+      }
+    ufo::Stats::uset ("PortfolioWorkers", pids.size ());
+  }
+
+  PortfolioResult runPortfolio (const std::vector<PortfolioJob> &jobs,
+                                unsigned memLimitMb, unsigned graceMs)
+  {
+    PortfolioResult res;
+    // -- until the first definitive answer
+    runEach (jobs, memLimitMb, 0,
+             [&res] (size_t i, boost::tribool answer)
+             {
+               if (boost::indeterminate (answer)) return true;
+               res.winner = i;
+               res.answer = answer;
+               return false;
+             }, graceMs);
+    if (res.winner >= 0) ufo::Stats::uset ("PortfolioWinner", res.winner);
+    return res;
+  }
+}
@@ -0,0 +1,250 @@
+#include "seahorn/HornProgress.hh"
+
+#include "llvm/Support/raw_ostream.h"
+#include "ufo/Stats.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace seahorn
+{
+  namespace
+  {
+    typedef std::chrono::steady_clock clock;
+
+    struct Monitor
+    {
+      std::mutex lock;
+      std::condition_variable wake;
+      std::atomic<bool> running {false};
+      /// the process of the monitor. A child of fork, e.g., a worker
+      /// of the portfolio, has no monitor thread and may have copied
+      /// the lock held
+      pid_t owner = 0;
+      bool stopping = false;
+      std::thread worker;
+
+      /// file descriptor of the file or the socket
+      int fd = -1;
+      bool socket = false;
+      unsigned periodMs = 1000;
+      const expr::ExprFactory *efac = nullptr;
+      clock::time_point start;
+      /// last time a value changed
+      clock::time_point changed;
+
+      std::string phase;
+      std::map<std::string, unsigned long> values;
+    };
+
+    Monitor &monitor ()
+    {
+      static Monitor m;
+      return m;
+    }
+
+    double seconds (clock::duration d)
+    { return std::chrono::duration<double> (d).count (); }
+
+    /// one JSON line. With the lock of m held
+    std::string snapshot (Monitor &m)
+    {
+      std::string res;
+      llvm::raw_string_ostream OS (res);
+      clock::time_point now = clock::now ();
+      OS << "{\"time\":" << seconds (now - m.start)
+         << ",\"idle\":" << seconds (now - m.changed)
+         << ",\"phase\":\"";
+      OS.write_escaped (m.phase);
+      OS << "\",\"rss_kb\":" << ufo::Stats::currentRss ()
+         << ",\"max_rss_kb\":" << ufo::Stats::maxRss ();
+      if (m.efac) OS << ",\"expr_bytes\":" << m.efac->bytes ();
+      OS << ",\"values\":{";
+      bool first = true;
+      for (auto &kv : m.values)
+      {
+        if (!first) OS << ",";
+        first = false;
+        OS << "\"";
+        OS.write_escaped (kv.first);
+        OS << "\":" << kv.second;
+      }
+      OS << "}}\n";
+      return OS.str ();
+    }
+
+    void writeAll (const Monitor &m, const std::string &s)
+    {
+      size_t done = 0;
+      while (done < s.size ())
+      {
+        // -- no SIGPIPE if the reader of the socket is gone
+        ssize_t n = m.socket ?
+          ::send (m.fd, s.data () + done, s.size () - done, MSG_NOSIGNAL) :
+          ::write (m.fd, s.data () + done, s.size () - done);
+        // -- a reader that went away does not stop the job
+        if (n <= 0) return;
+        done += n;
+      }
+    }
+
+    int openDest (const std::string &dest)
+    {
+      if (dest.compare (0, 5, "unix:") != 0)
+        return open (dest.c_str (), O_WRONLY | O_CREAT | O_APPEND, 0644);
+
+      std::string path = dest.substr (5);
+      struct sockaddr_un addr;
+      int s = socket (AF_UNIX, SOCK_STREAM, 0);
+      if (s < 0 || path.size () >= sizeof (addr.sun_path))
+      {
+        if (s >= 0) close (s);
+        return -1;
+      }
+      memset (&addr, 0, sizeof (addr));
+      addr.sun_family = AF_UNIX;
+      strncpy (addr.sun_path, path.c_str (), sizeof (addr.sun_path) - 1);
+      if (connect (s, (struct sockaddr*) &addr, sizeof (addr)) < 0)
+      {
+        close (s);
+        return -1;
+      }
+      return s;
+    }
+  }
+
+  bool HornProgress::start (const std::string &dest, unsigned periodMs,
+                            const expr::ExprFactory *efac)
+  {
+    Monitor &m = monitor ();
+    if (m.running) return true;
+
+    int fd = openDest (dest);
+    if (fd < 0) return false;
+
+    std::lock_guard<std::mutex> l (m.lock);
+    m.fd = fd;
+    m.socket = dest.compare (0, 5, "unix:") == 0;
+    m.periodMs = std::max (1U, periodMs);
+    m.efac = efac;
+    m.owner = getpid ();
+    m.start = m.changed = clock::now ();
+    m.running = true;
+    m.stopping = false;
+    m.worker = std::thread ([&m] ()
+      {
+        std::unique_lock<std::mutex> l (m.lock);
+        while (!m.stopping)
+        {
+          std::string line = snapshot (m);
+          // -- do not hold the lock while the reader is slow
+          l.unlock ();
+          writeAll (m, line);
+          l.lock ();
+          m.wake.wait_for (l, std::chrono::milliseconds (m.periodMs),
+                           [&m] { return m.stopping; });
+        }
+      });
+    return true;
+  }
+
+  void HornProgress::stop ()
+  {
+    Monitor &m = monitor ();
+    if (!enabled ()) return;
+    {
+      std::lock_guard<std::mutex> l (m.lock);
+      m.stopping = true;
+    }
+    m.wake.notify_all ();
+    m.worker.join ();
+
+    std::string line;
+    {
+      std::lock_guard<std::mutex> l (m.lock);
+      line = snapshot (m);
+    }
+    writeAll (m, line);
+    close (m.fd);
+    m.fd = -1;
+    m.running = false;
+    toStats ();
+  }
+
+  bool HornProgress::enabled ()
+  {
+    Monitor &m = monitor ();
+    return m.running && m.owner == getpid ();
+  }
+
+  void HornProgress::phase (const std::string &name)
+  {
+    Monitor &m = monitor ();
+    if (!enabled ()) return;
+    std::lock_guard<std::mutex> l (m.lock);
+    m.phase = name;
+    m.changed = clock::now ();
+  }
+
+  void HornProgress::set (const std::string &key, unsigned long v)
+  {
+    Monitor &m = monitor ();
+    if (!enabled ()) return;
+    std::lock_guard<std::mutex> l (m.lock);
+    unsigned long &old = m.values [key];
+    if (old != v) m.changed = clock::now ();
+    old = v;
+  }
+
+  void HornProgress::add (const std::string &key, unsigned long d)
+  {
+    Monitor &m = monitor ();
+    if (!enabled () || d == 0) return;
+    std::lock_guard<std::mutex> l (m.lock);
+    m.values [key] += d;
+    m.changed = clock::now ();
+  }
+
+  void HornProgress::clear (const std::string &prefix)
+  {
+    Monitor &m = monitor ();
+    if (!enabled ()) return;
+    std::lock_guard<std::mutex> l (m.lock);
+    auto it = m.values.lower_bound (prefix);
+    while (it != m.values.end () && it->first.compare (0, prefix.size (), prefix) == 0)
+      it = m.values.erase (it);
+  }
+
+  void HornProgress::toStats ()
+  {
+    Monitor &m = monitor ();
+    if (!enabled ()) return;
+    std::lock_guard<std::mutex> l (m.lock);
+    for (auto &kv : m.values) ufo::Stats::uset ("Progress." + kv.first, kv.second);
+  }
+
+  ProgressPhase::ProgressPhase (const std::string &name)
+  {
+    Monitor &m = monitor ();
+    if (!HornProgress::enabled ()) return;
+    {
+      std::lock_guard<std::mutex> l (m.lock);
+      m_prev = m.phase;
+    }
+    HornProgress::phase (name);
+  }
+
+  ProgressPhase::~ProgressPhase () { HornProgress::phase (m_prev); }
+}
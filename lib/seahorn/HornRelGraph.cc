@@ -0,0 +1,113 @@
+#include "seahorn/HornRelGraph.hh"
+
+#include <algorithm>
+
+namespace seahorn
+{
+  HornRelGraph::HornRelGraph (const HornClauseDB &db)
+  {
+    const HornClauseDB::expr_set_type &rels = db.getRelations ();
+    m_rels.assign (rels.begin (), rels.end ());
+    RuleId bound = db.ruleIdBound ();
+    m_head.assign (bound, NoRel);
+    m_body_size.assign (bound, 0);
+    for (RuleId r = 0; r < bound; ++r)
+    {
+      if (!db.isLive (r)) continue;
+      Expr h = db.getRule (r).head ();
+      if (bind::isFapp (h)) m_head [r] = id (bind::fname (h));
+    }
+
+    // -- a rule is in the use index of a relation once, however many
+    // -- times the relation appears in its body
+    m_out_off.assign (size () + 1, 0);
+    std::vector<unsigned> indeg (size (), 0);
+    for (RelId p = 0; p < size (); ++p)
+    {
+      m_out_off [p] = m_out.size ();
+      for (RuleId r : db.use (m_rels [p]))
+      {
+        if (head (r) == NoRel) continue;
+        Edge e = {head (r), r};
+        m_out.push_back (e);
+        ++m_body_size [r];
+        ++indeg [e.rel];
+      }
+    }
+    m_out_off [size ()] = m_out.size ();
+
+    // -- in edges by a counting sort of the out edges on their target
+    m_in_off.assign (size () + 1, 0);
+    for (RelId q = 0; q < size (); ++q) m_in_off [q + 1] = m_in_off [q] + indeg [q];
+    m_in.resize (m_out.size ());
+    std::vector<unsigned> pos (m_in_off.begin (), m_in_off.end () - 1);
+    for (RelId p = 0; p < size (); ++p)
+      for (const Edge &e : succs (p))
+      {
+        Edge rev = {p, e.rule};
+        m_in [pos [e.rel]++] = rev;
+      }
+  }
+
+  HornRelGraph::RelId HornRelGraph::id (Expr fdecl) const
+  {
+    auto it = std::lower_bound (m_rels.begin (), m_rels.end (), fdecl);
+    if (it == m_rels.end () || *it != fdecl) return NoRel;
+    return it - m_rels.begin ();
+  }
+
+  unsigned HornRelGraph::sccs (std::vector<unsigned> &out) const
+  {
+    // -- Tarjan's algorithm with an explicit stack
+    const unsigned none = (unsigned) -1;
+    out.assign (size (), none);
+    std::vector<unsigned> index (size (), none), low (size (), 0);
+    std::vector<bool> onStack (size (), false);
+    std::vector<RelId> stack;
+    std::vector<std::pair<RelId, edge_iterator> > dfs;
+    unsigned next = 0, count = 0;
+
+    auto push = [&] (RelId v)
+      {
+        index [v] = low [v] = next++;
+        stack.push_back (v);
+        onStack [v] = true;
+        dfs.push_back (std::make_pair (v, succs (v).begin ()));
+      };
+
+    for (RelId root = 0; root < size (); ++root)
+    {
+      if (index [root] != none) continue;
+      push (root);
+      while (!dfs.empty ())
+      {
+        RelId v = dfs.back ().first;
+        edge_iterator &it = dfs.back ().second;
+        if (it != succs (v).end ())
+        {
+          RelId w = (it++)->rel;
+          if (index [w] == none) push (w);
+          else if (onStack [w]) low [v] = std::min (low [v], index [w]);
+          continue;
+        }
+        dfs.pop_back ();
+        if (!dfs.empty ())
+        {
+          RelId u = dfs.back ().first;
+          low [u] = std::min (low [u], low [v]);
+        }
+        if (low [v] != index [v]) continue;
+        RelId w;
+        do
+        {
+          w = stack.back ();
+          stack.pop_back ();
+          onStack [w] = false;
+          out [w] = count;
+        } while (w != v);
+        ++count;
+      }
+    }
+    return count;
+  }
+}
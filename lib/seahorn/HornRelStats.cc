@@ -0,0 +1,284 @@
+#include "seahorn/HornRelStats.hh"
+#include "seahorn/HornClauseDBWto.hh"
+
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+
+#include "ufo/Expr.hpp"
+#include "ufo/ExprBv.hh"
+#include "ufo/Stats.hh"
+
+#include "boost/lexical_cast.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+static llvm::cl::opt<std::string>
+RelStatsFile ("horn-rel-stats",
+              llvm::cl::desc ("Write statistics of every relation of the Horn "
+                              "clause database as JSON to FILE"),
+              llvm::cl::init (""), llvm::cl::value_desc ("FILE"));
+
+namespace seahorn
+{
+  using namespace expr;
+
+  namespace
+  {
+    enum { INT_ARG, BV_ARG, ARRAY_ARG, BOOL_ARG, REAL_ARG, OTHER_ARG, NUM_SORTS };
+    const char *sortNames [NUM_SORTS] = {"int", "bv", "array", "bool", "real", "other"};
+
+    struct RelInfo
+    {
+      std::string name;
+      unsigned sorts [NUM_SORTS];
+      unsigned defs;
+      unsigned uses;
+      /// sums over the rules that define the relation
+      size_t bodyDag;
+      size_t maxBodyDag;
+      double bodyTree;
+      double maxBodyTree;
+      unsigned scc;
+      unsigned sccSize;
+      bool inWto;
+      unsigned wtoDepth;
+      /// head of the innermost component, empty if none
+      std::string wtoHead;
+      double solveSecs;
+      std::string solveGroup;
+      /// -1 if unknown
+      long invariantDag;
+
+      RelInfo () : defs (0), uses (0), bodyDag (0), maxBodyDag (0),
+                   bodyTree (0), maxBodyTree (0), scc (0), sccSize (0),
+                   inWto (false), wtoDepth (0), solveSecs (0), invariantDag (-1)
+      { std::fill (sorts, sorts + NUM_SORTS, 0); }
+    };
+
+    struct Snapshot
+    {
+      std::string phase;
+      std::vector<RelInfo> rels;
+      std::map<Expr, size_t> index;
+    };
+
+    struct State
+    {
+      std::mutex lock;
+      std::vector<Snapshot> snapshots;
+    };
+
+    State &state ()
+    {
+      static State s;
+      return s;
+    }
+
+    std::string relName (Expr fdecl)
+    { return boost::lexical_cast<std::string> (*bind::fname (fdecl)); }
+
+    unsigned sortKind (Expr ty)
+    {
+      if (isOpX<INT_TY> (ty)) return INT_ARG;
+      if (isOpX<BVSORT> (ty)) return BV_ARG;
+      if (isOpX<ARRAY_TY> (ty)) return ARRAY_ARG;
+      if (isOpX<BOOL_TY> (ty)) return BOOL_ARG;
+      if (isOpX<REAL_TY> (ty)) return REAL_ARG;
+      return OTHER_ARG;
+    }
+
+    /// size of e as a tree. A double, since it grows exponentially
+    /// with the sharing of the DAG
+    double treeSize (Expr e, std::unordered_map<ENode*, double> &memo)
+    {
+      auto it = memo.find (&*e);
+      if (it != memo.end ()) return it->second;
+      double sz = 1;
+      for (unsigned i = 0; i < e->arity (); ++i) sz += treeSize (e->arg (i), memo);
+      memo [&*e] = sz;
+      return sz;
+    }
+
+    void printJsonString (const std::string &s, llvm::raw_ostream &OS)
+    {
+      OS << '"';
+      for (unsigned char c : s)
+      {
+        if (c == '"' || c == '\\') OS << '\\' << c;
+        else if (c < 0x20) OS << llvm::format ("\\u%04x", c);
+        else OS << c;
+      }
+      OS << '"';
+    }
+
+    void printRel (const RelInfo &r, llvm::raw_ostream &OS)
+    {
+      OS << "{\"name\": ";
+      printJsonString (r.name, OS);
+      unsigned arity = 0;
+      for (unsigned k = 0; k < NUM_SORTS; ++k) arity += r.sorts [k];
+      OS << ", \"arity\": " << arity << ", \"sorts\": {";
+      for (unsigned k = 0; k < NUM_SORTS; ++k)
+        OS << (k ? ", " : "") << "\"" << sortNames [k] << "\": " << r.sorts [k];
+      OS << "}, \"defs\": " << r.defs << ", \"uses\": " << r.uses
+         << ", \"body_dag\": " << r.bodyDag << ", \"max_body_dag\": " << r.maxBodyDag
+         << ", \"body_tree\": " << llvm::format ("%.0f", r.bodyTree)
+         << ", \"max_body_tree\": " << llvm::format ("%.0f", r.maxBodyTree)
+         << ", \"scc\": " << r.scc << ", \"scc_size\": " << r.sccSize
+         << ", \"in_wto\": " << (r.inWto ? "true" : "false")
+         << ", \"wto_depth\": " << r.wtoDepth << ", \"wto_head\": ";
+      if (r.wtoHead.empty ()) OS << "null";
+      else printJsonString (r.wtoHead, OS);
+      if (!r.solveGroup.empty ())
+      {
+        OS << ", \"solve_s\": " << llvm::format ("%.6f", r.solveSecs)
+           << ", \"solve_group\": ";
+        printJsonString (r.solveGroup, OS);
+      }
+      if (r.invariantDag >= 0) OS << ", \"invariant_dag\": " << r.invariantDag;
+      OS << "}";
+    }
+  }
+
+  bool HornRelStats::enabled () { return !RelStatsFile.empty (); }
+
+  void HornRelStats::snapshot (const std::string &phase, HornClauseDB &db)
+  {
+    ufo::ScopedStats _st ("HornRelStats");
+    Snapshot snap;
+    snap.phase = phase;
+
+    HornClauseDBCallGraph callgraph (db);
+    callgraph.buildCallGraph ();
+    bool hasWto = callgraph.hasEntry ();
+    HornClauseDBWto wto (callgraph);
+    if (hasWto) wto.buildWto ();
+
+    std::unordered_map<ENode*, double> memo;
+    std::map<unsigned, unsigned> sccSizes;
+    for (Expr rel : db.getRelations ())
+    {
+      RelInfo r;
+      r.name = relName (rel);
+      for (unsigned i = 0; i < bind::domainSz (rel); ++i)
+        r.sorts [sortKind (bind::domainTy (rel, i))]++;
+
+      r.uses = db.use (rel).size ();
+      for (HornClauseDB::RuleId id : db.def (rel))
+      {
+        Expr body = db.getRule (id).body ();
+        size_t dag = dagSize (body);
+        double tree = treeSize (body, memo);
+        r.defs++;
+        r.bodyDag += dag;
+        r.bodyTree += tree;
+        r.maxBodyDag = std::max (r.maxBodyDag, dag);
+        r.maxBodyTree = std::max (r.maxBodyTree, tree);
+      }
+
+      r.scc = wto.scc (rel);
+      sccSizes [r.scc]++;
+      if (hasWto && wto.contains (rel))
+      {
+        r.inWto = true;
+        r.wtoDepth = wto.depth (rel);
+        for (auto it = wto.heads_begin (rel), et = wto.heads_end (rel); it != et; ++it)
+          r.wtoHead = relName (*it);
+      }
+      snap.index [rel] = snap.rels.size ();
+      snap.rels.push_back (r);
+    }
+    for (RelInfo &r : snap.rels) r.sccSize = sccSizes [r.scc];
+
+    State &s = state ();
+    std::lock_guard<std::mutex> l (s.lock);
+    auto it = std::find_if (s.snapshots.begin (), s.snapshots.end (),
+                            [&] (const Snapshot &o) { return o.phase == phase; });
+    if (it != s.snapshots.end ()) s.snapshots.erase (it);
+    s.snapshots.push_back (std::move (snap));
+
+    static bool registered = false;
+    if (!registered)
+    {
+      registered = true;
+      ufo::Stats::addJsonSection ("relations", HornRelStats::write);
+    }
+  }
+
+  void HornRelStats::addSolveTime (const ExprVector &rels, double secs,
+                                   const std::string &group)
+  {
+    State &s = state ();
+    std::lock_guard<std::mutex> l (s.lock);
+    if (s.snapshots.empty ()) return;
+    Snapshot &snap = s.snapshots.back ();
+    for (Expr rel : rels)
+    {
+      auto it = snap.index.find (rel);
+      if (it == snap.index.end ()) continue;
+      RelInfo &r = snap.rels [it->second];
+      r.solveSecs += secs;
+      r.solveGroup = group;
+    }
+  }
+
+  void HornRelStats::setInvariantSize (Expr rel, size_t dag)
+  {
+    State &s = state ();
+    std::lock_guard<std::mutex> l (s.lock);
+    if (s.snapshots.empty ()) return;
+    Snapshot &snap = s.snapshots.back ();
+    auto it = snap.index.find (rel);
+    if (it != snap.index.end ()) snap.rels [it->second].invariantDag = dag;
+  }
+
+  void HornRelStats::write (llvm::raw_ostream &OS)
+  {
+    State &s = state ();
+    std::lock_guard<std::mutex> l (s.lock);
+    OS << "{";
+    bool firstSnap = true;
+    for (const Snapshot &snap : s.snapshots)
+    {
+      OS << (firstSnap ? "" : ",") << "\n";
+      firstSnap = false;
+      printJsonString (snap.phase, OS);
+      OS << ": [";
+
+      // -- the hardest first
+      std::vector<const RelInfo*> rels;
+      for (const RelInfo &r : snap.rels) rels.push_back (&r);
+      std::stable_sort (rels.begin (), rels.end (),
+                        [] (const RelInfo *a, const RelInfo *b)
+                        { return a->bodyDag > b->bodyDag; });
+      bool first = true;
+      for (const RelInfo *r : rels)
+      {
+        OS << (first ? "" : ",") << "\n";
+        first = false;
+        printRel (*r, OS);
+      }
+      OS << "]";
+    }
+    OS << "}";
+  }
+
+  void writeRelStats ()
+  {
+    if (RelStatsFile.empty ()) return;
+
+    std::error_code ec;
+    llvm::raw_fd_ostream out (RelStatsFile, ec, llvm::sys::fs::F_Text);
+    if (ec)
+    {
+      llvm::errs () << "WARNING: cannot write relation statistics to "
+                    << RelStatsFile << ": " << ec.message () << "\n";
+      return;
+    }
+    HornRelStats::write (out);
+    out << "\n";
+  }
+}
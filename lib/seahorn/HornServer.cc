@@ -0,0 +1,641 @@
+#include "seahorn/HornServer.hh"
+
+#include "llvm/Pass.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Format.h"
+#include "ufo/Stats.hh"
+
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include <chrono>
+#include <csignal>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+namespace seahorn
+{
+  namespace
+  {
+    struct Job
+    {
+      std::string id;
+      std::vector<std::string> args;
+      unsigned timeoutSec;
+      unsigned memLimitMb;
+    };
+
+    struct JobResult
+    {
+      std::string status;
+      std::string result;
+      int exitCode;
+      int signal;
+      double time;
+      std::string output;
+      JobResult () : status ("error"), result ("unknown"),
+                     exitCode (-1), signal (0), time (0) {}
+    };
+
+    typedef std::chrono::steady_clock clock;
+
+    /// in the process of a job, the pipe of its phases and counters
+    /// to the server
+    int statusFd = -1;
+    /// socket of the metrics, closed in the process of a job
+    int metricsFd = -1;
+
+    /// the job in flight, read by the thread of the metrics. Also
+    /// held while the server forks, so that the job does not start
+    /// with a lock of Stats held by that thread
+    struct ServerState
+    {
+      std::mutex lock;
+      bool busy = false;
+      std::string id;
+      std::string phase;
+      clock::time_point jobStart;
+      clock::time_point phaseStart;
+    };
+
+    ServerState &state ()
+    {
+      static ServerState s;
+      return s;
+    }
+
+    double seconds (clock::duration d)
+    { return std::chrono::duration<double> (d).count (); }
+
+    void writeAll (int fd, const char *buf, size_t n)
+    {
+      while (n > 0)
+      {
+        ssize_t k = write (fd, buf, n);
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return;
+        buf += k;
+        n -= k;
+      }
+    }
+
+    void quote (const std::string &s, llvm::raw_ostream &o)
+    {
+      o << '"';
+      for (unsigned char c : s)
+      {
+        switch (c)
+        {
+        case '"': o << "\\\""; break;
+        case '\\': o << "\\\\"; break;
+        case '\n': o << "\\n"; break;
+        case '\r': o << "\\r"; break;
+        case '\t': o << "\\t"; break;
+        default:
+          if (c < 0x20) o << llvm::format ("\\u%04x", c);
+          else o << c;
+        }
+      }
+      o << '"';
+    }
+
+    /// sends the counters and the timers of the job to the server
+    void sendStats ()
+    {
+      std::string lines;
+      llvm::raw_string_ostream o (lines);
+      for (auto &kv : ufo::Stats::counterValues ())
+        o << "counter " << kv.second << " " << kv.first << "\n";
+      for (auto &kv : ufo::Stats::timerValues ())
+        o << "timer " << llvm::format ("%.6f", kv.second) << " " << kv.first << "\n";
+      o.flush ();
+      writeAll (statusFd, lines.data (), lines.size ());
+    }
+
+    /// body of the process of a job. Never returns
+    void runChild (const ServerJobFn &fn, const Job &job, int out, int ans,
+                   int status)
+    {
+      statusFd = status;
+      if (metricsFd >= 0) close (metricsFd);
+      // -- a group of its own so that a timeout also stops the
+      // -- workers of the job, e.g., of --horn-portfolio
+      setpgid (0, 0);
+      signal (SIGPIPE, SIG_DFL);
+
+      int devnull = open ("/dev/null", O_RDONLY);
+      if (devnull >= 0) { dup2 (devnull, 0); close (devnull); }
+      dup2 (out, 1);
+      close (out);
+
+      if (job.memLimitMb > 0)
+      {
+        struct rlimit rl;
+        rl.rlim_cur = rl.rlim_max = static_cast<rlim_t> (job.memLimitMb) << 20;
+        setrlimit (RLIMIT_AS, &rl);
+      }
+
+      char res = 'e';
+      int rc = 3;
+      try
+      {
+        rc = fn (job.args);
+        const std::string &r = ufo::Stats::sget ("Result");
+        res = r == "FALSE" ? 's' : r == "TRUE" ? 'u' : '?';
+        sendStats ();
+      }
+      catch (std::bad_alloc &) { res = 'm'; }
+      catch (...) { res = 'e'; }
+      close (statusFd);
+
+      llvm::outs ().flush ();
+      std::cout.flush ();
+      while (write (ans, &res, 1) < 0 && errno == EINTR);
+      close (ans);
+      // -- skip destructors and exit handlers of the server
+      _exit (rc);
+    }
+
+    /// the time of the phase of the job that ends now
+    void endPhase (ServerState &st, clock::time_point now)
+    {
+      if (st.phase.empty ()) return;
+      ufo::Stats::histogram ("server.phase." + st.phase).observe
+        (seconds (now - st.phaseStart));
+      st.phase.clear ();
+    }
+
+    /// handles a line of the status of a job: phase NAME, or
+    /// counter VALUE NAME and timer SECONDS NAME at the end of the job
+    void onStatus (const std::string &line)
+    {
+      std::istringstream in (line);
+      std::string kind;
+      in >> kind;
+      if (kind == "phase")
+      {
+        std::string name;
+        in >> name;
+        ServerState &st = state ();
+        std::lock_guard<std::mutex> l (st.lock);
+        clock::time_point now = clock::now ();
+        endPhase (st, now);
+        st.phase = name;
+        st.phaseStart = now;
+        return;
+      }
+
+      double v = 0;
+      std::string name;
+      if (!(in >> v)) return;
+      in.get ();
+      std::getline (in, name);
+      if (name.empty () || v <= 0) return;
+      // -- sums over the jobs. Timers in milliseconds
+      if (kind == "counter")
+        ufo::Stats::counter ("job." + name).inc (v);
+      else if (kind == "timer")
+        ufo::Stats::counter ("job." + name + ".ms").inc (v * 1000);
+    }
+
+    /// reads the status of a job from fd. Returns the result of read
+    ssize_t readStatus (int fd, std::string &pending)
+    {
+      char buf [4096];
+      ssize_t k = read (fd, buf, sizeof (buf));
+      if (k <= 0) return k;
+      pending.append (buf, k);
+      size_t eol;
+      while ((eol = pending.find ('\n')) != std::string::npos)
+      {
+        onStatus (pending.substr (0, eol));
+        pending.erase (0, eol + 1);
+      }
+      return k;
+    }
+
+    void runJob (const ServerJobFn &fn, const Job &job, JobResult &res)
+    {
+      int out [2], ans [2], status [2];
+      if (pipe (out) != 0) return;
+      if (pipe (ans) != 0) { close (out [0]); close (out [1]); return; }
+      if (pipe (status) != 0)
+      {
+        for (int fd : {out [0], out [1], ans [0], ans [1]}) close (fd);
+        return;
+      }
+
+      // -- buffered output would be written by the child too
+      llvm::outs ().flush ();
+      llvm::errs ().flush ();
+      std::cout.flush ();
+      std::cerr.flush ();
+
+      ServerState &st = state ();
+      st.lock.lock ();
+      auto start = clock::now ();
+      pid_t pid = fork ();
+      if (pid < 0)
+      {
+        st.lock.unlock ();
+        llvm::errs () << "server: cannot fork\n";
+        for (int fd : {out [0], out [1], ans [0], ans [1], status [0], status [1]})
+          close (fd);
+        return;
+      }
+      if (pid == 0)
+      {
+        close (out [0]);
+        close (ans [0]);
+        close (status [0]);
+        runChild (fn, job, out [1], ans [1], status [1]);
+      }
+      st.busy = true;
+      st.id = job.id;
+      st.phase.clear ();
+      st.jobStart = start;
+      st.lock.unlock ();
+
+      // -- also set here in case the job is killed before it runs
+      setpgid (pid, pid);
+      close (out [1]);
+      close (ans [1]);
+      close (status [1]);
+      std::string pending;
+      bool statusOpen = true;
+
+      // -- collect the output until the job ends or runs out of time
+      bool timeout = false;
+      char buf [4096];
+      for (;;)
+      {
+        int wait = -1;
+        if (job.timeoutSec > 0)
+        {
+          auto spent = std::chrono::duration_cast<std::chrono::milliseconds>
+            (clock::now () - start).count ();
+          wait = static_cast<int> (job.timeoutSec * 1000) - spent;
+          if (wait <= 0) { timeout = true; break; }
+        }
+
+        struct pollfd f [2];
+        f [0].fd = out [0];
+        f [1].fd = statusOpen ? status [0] : -1;
+        f [0].events = f [1].events = POLLIN;
+        f [0].revents = f [1].revents = 0;
+        int n = poll (f, 2, wait);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) break;
+        if (n == 0) continue;
+
+        if (f [1].revents != 0)
+        {
+          ssize_t k = readStatus (status [0], pending);
+          if (k == 0 || (k < 0 && errno != EINTR)) statusOpen = false;
+        }
+        if (f [0].revents == 0) continue;
+        ssize_t k = read (out [0], buf, sizeof (buf));
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) break;
+        res.output.append (buf, k);
+      }
+      close (out [0]);
+
+      if (timeout) kill (-pid, SIGKILL);
+      int ws = 0;
+      while (waitpid (pid, &ws, 0) < 0 && errno == EINTR);
+      clock::time_point end = clock::now ();
+      res.time = seconds (end - start);
+
+      // -- what the job wrote before it ended. Workers of the job may
+      // -- still hold the pipe, so do not wait for them
+      fcntl (status [0], F_SETFL, O_NONBLOCK);
+      while (statusOpen && readStatus (status [0], pending) > 0);
+      close (status [0]);
+
+      char c = 'e';
+      if (read (ans [0], &c, 1) != 1) c = 'e';
+      close (ans [0]);
+
+      if (WIFEXITED (ws)) res.exitCode = WEXITSTATUS (ws);
+      if (WIFSIGNALED (ws)) res.signal = WTERMSIG (ws);
+
+      if (timeout) res.status = "timeout";
+      else if (c == 'm') res.status = "memout";
+      else if (res.signal != 0) res.status = "crash";
+      else if (c == 'e' || res.exitCode != 0) res.status = "error";
+      else res.status = "done";
+
+      if (c == 's') res.result = "sat";
+      else if (c == 'u') res.result = "unsat";
+
+      std::lock_guard<std::mutex> l (st.lock);
+      endPhase (st, end);
+      st.busy = false;
+      ufo::Stats::histogram ("server.job").observe (res.time);
+      ufo::Stats::counter ("server.jobs." + res.status).inc ();
+    }
+
+    void writeResult (int fd, const std::string &id, const JobResult &res)
+    {
+      std::string line;
+      llvm::raw_string_ostream o (line);
+      o << "{\"id\": ";
+      quote (id, o);
+      o << ", \"status\": \"" << res.status << "\""
+        << ", \"result\": \"" << res.result << "\""
+        << ", \"exit\": " << res.exitCode;
+      if (res.signal != 0) o << ", \"signal\": " << res.signal;
+      o << ", \"time\": " << llvm::format ("%.3f", res.time)
+        << ", \"output\": ";
+      quote (res.output, o);
+      o << "}\n";
+      o.flush ();
+      writeAll (fd, line.data (), line.size ());
+    }
+
+    /// parses a job. Returns false, and sets err, if line is malformed
+    bool parseJob (const std::string &line, const ServerConfig &cfg,
+                   Job &job, bool &shutdown, std::string &err)
+    {
+      namespace pt = boost::property_tree;
+      pt::ptree tree;
+      try
+      {
+        std::istringstream in (line);
+        pt::read_json (in, tree);
+
+        job.id = tree.get<std::string> ("id", "");
+        shutdown = tree.get<std::string> ("cmd", "") == "shutdown";
+        if (shutdown) return true;
+
+        job.timeoutSec = tree.get<unsigned> ("timeout", cfg.timeoutSec);
+        job.memLimitMb = tree.get<unsigned> ("mem", cfg.memLimitMb);
+        job.args.clear ();
+        if (auto args = tree.get_child_optional ("args"))
+          for (auto &kv : *args) job.args.push_back (kv.second.data ());
+
+        std::string file = tree.get<std::string> ("file", "");
+        if (file.empty ())
+        {
+          err = "job has no file";
+          return false;
+        }
+        job.args.push_back (file);
+      }
+      catch (pt::ptree_error &e)
+      {
+        err = e.what ();
+        return false;
+      }
+      return true;
+    }
+
+    /// the metrics of the server, in the Prometheus text format
+    std::string metricsText ()
+    {
+      std::string res;
+      llvm::raw_string_ostream o (res);
+      ServerState &st = state ();
+      std::lock_guard<std::mutex> l (st.lock);
+      clock::time_point now = clock::now ();
+      o << "# TYPE sea_server_jobs_in_flight gauge\n"
+        << "sea_server_jobs_in_flight " << (st.busy ? 1 : 0) << "\n";
+      if (st.busy)
+      {
+        // -- label values are escaped as JSON strings
+        o << "# TYPE sea_server_job_seconds gauge\n"
+          << "sea_server_job_seconds{id=";
+        quote (st.id, o);
+        o << "} " << llvm::format ("%.3f", seconds (now - st.jobStart)) << "\n";
+        if (!st.phase.empty ())
+        {
+          o << "# TYPE sea_server_job_phase_seconds gauge\n"
+            << "sea_server_job_phase_seconds{id=";
+          quote (st.id, o);
+          o << ",phase=";
+          quote (st.phase, o);
+          o << "} " << llvm::format ("%.3f", seconds (now - st.phaseStart)) << "\n";
+        }
+      }
+      ufo::Stats::PrintPrometheus (o);
+      o.flush ();
+      return res;
+    }
+
+    /// answers an HTTP request on c with the metrics, whatever it asks
+    void answerMetrics (int c)
+    {
+      struct pollfd f;
+      f.fd = c;
+      f.events = POLLIN;
+      f.revents = 0;
+      char buf [4096];
+      if (poll (&f, 1, 1000) > 0 && read (c, buf, sizeof (buf)) < 0) return;
+
+      std::string body = metricsText ();
+      std::string head = "HTTP/1.0 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: " + std::to_string (body.size ()) + "\r\n"
+        "Connection: close\r\n\r\n";
+      writeAll (c, head.data (), head.size ());
+      writeAll (c, body.data (), body.size ());
+    }
+
+    /// a thread that serves the metrics on a port of localhost while
+    /// alive
+    class MetricsEndpoint
+    {
+      std::thread m_thread;
+
+    public:
+      bool start (unsigned port)
+      {
+        int s = socket (AF_INET, SOCK_STREAM, 0);
+        if (s < 0) return false;
+        int one = 1;
+        setsockopt (s, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+        struct sockaddr_in addr;
+        memset (&addr, 0, sizeof (addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons (port);
+        addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+        if (bind (s, reinterpret_cast<struct sockaddr*> (&addr), sizeof (addr)) != 0 ||
+            listen (s, 16) != 0)
+        {
+          close (s);
+          return false;
+        }
+
+        metricsFd = s;
+        m_thread = std::thread ([s] ()
+          {
+            for (;;)
+            {
+              int c = accept (s, NULL, NULL);
+              if (c < 0 && errno == EINTR) continue;
+              if (c < 0) return;
+              answerMetrics (c);
+              close (c);
+            }
+          });
+        return true;
+      }
+
+      ~MetricsEndpoint ()
+      {
+        if (metricsFd < 0) return;
+        // -- wakes up accept
+        shutdown (metricsFd, SHUT_RDWR);
+        m_thread.join ();
+        close (metricsFd);
+        metricsFd = -1;
+      }
+    };
+
+    /// serves the jobs read from in. Returns false on shutdown
+    bool serve (const ServerConfig &cfg, const ServerJobFn &fn,
+                int in, int out)
+    {
+      std::string pending;
+      char buf [4096];
+      for (;;)
+      {
+        size_t eol;
+        while ((eol = pending.find ('\n')) != std::string::npos)
+        {
+          std::string line = pending.substr (0, eol);
+          pending.erase (0, eol + 1);
+          if (line.find_first_not_of (" \t\r") == std::string::npos) continue;
+
+          Job job;
+          bool shutdown = false;
+          JobResult res;
+          if (!parseJob (line, cfg, job, shutdown, res.output))
+          {
+            writeResult (out, job.id, res);
+            continue;
+          }
+          if (shutdown) return false;
+
+          runJob (fn, job, res);
+          ufo::Stats::count ("ServerJobs");
+          writeResult (out, job.id, res);
+        }
+
+        ssize_t k = read (in, buf, sizeof (buf));
+        if (k < 0 && errno == EINTR) continue;
+        if (k <= 0) return true;
+        pending.append (buf, k);
+      }
+    }
+  }
+
+  int runServer (const ServerConfig &cfg, ServerJobFn fn)
+  {
+    // -- a client that goes away must not stop the server
+    signal (SIGPIPE, SIG_IGN);
+
+    MetricsEndpoint metrics;
+    if (cfg.metricsPort > 0 && !metrics.start (cfg.metricsPort))
+    {
+      llvm::errs () << "server: cannot serve metrics on port "
+                    << cfg.metricsPort << ": " << strerror (errno) << "\n";
+      return 1;
+    }
+
+    if (cfg.socket.empty ())
+    {
+      serve (cfg, fn, 0, 1);
+      return 0;
+    }
+
+    int s = socket (AF_UNIX, SOCK_STREAM, 0);
+    struct sockaddr_un addr;
+    memset (&addr, 0, sizeof (addr));
+    addr.sun_family = AF_UNIX;
+    if (s < 0 || cfg.socket.size () >= sizeof (addr.sun_path))
+    {
+      llvm::errs () << "server: cannot create socket " << cfg.socket << "\n";
+      if (s >= 0) close (s);
+      return 1;
+    }
+    strncpy (addr.sun_path, cfg.socket.c_str (), sizeof (addr.sun_path) - 1);
+    unlink (cfg.socket.c_str ());
+    if (bind (s, reinterpret_cast<struct sockaddr*> (&addr), sizeof (addr)) != 0 ||
+        listen (s, 16) != 0)
+    {
+      llvm::errs () << "server: cannot listen on " << cfg.socket << ": "
+                    << strerror (errno) << "\n";
+      close (s);
+      return 1;
+    }
+
+    // -- one client at a time, jobs of a client in order
+    bool running = true;
+    while (running)
+    {
+      int c = accept (s, NULL, NULL);
+      if (c < 0)
+      {
+        if (errno == EINTR) continue;
+        llvm::errs () << "server: accept failed: " << strerror (errno) << "\n";
+        break;
+      }
+      running = serve (cfg, fn, c, c);
+      close (c);
+    }
+
+    close (s);
+    unlink (cfg.socket.c_str ());
+    return 0;
+  }
+
+  bool inServerJob () { return statusFd >= 0; }
+
+  void setServerJobPhase (const std::string &phase)
+  {
+    if (statusFd < 0) return;
+    std::string line = "phase " + phase + "\n";
+    writeAll (statusFd, line.data (), line.size ());
+  }
+
+  namespace
+  {
+    struct ServerPhasePass : public llvm::ModulePass
+    {
+      static char ID;
+      std::string m_phase;
+      ServerPhasePass (const std::string &phase) :
+        llvm::ModulePass (ID), m_phase (phase) {}
+
+      bool runOnModule (llvm::Module &M) override
+      {
+        setServerJobPhase (m_phase);
+        return false;
+      }
+      void getAnalysisUsage (llvm::AnalysisUsage &AU) const override
+      { AU.setPreservesAll (); }
+      const char *getPassName () const override { return "ServerPhase"; }
+    };
+    char ServerPhasePass::ID = 0;
+  }
+
+  llvm::Pass *createServerPhasePass (const std::string &phase)
+  { return new ServerPhasePass (phase); }
+}
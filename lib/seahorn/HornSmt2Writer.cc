@@ -0,0 +1,52 @@
+#include "seahorn/HornSmt2Writer.hh"
+#include "ufo/Stats.hh"
+
+namespace seahorn
+{
+  void HornSmt2Writer::writeRelation (raw_ostream &out, Expr decl)
+  {
+    // -- Z3 prints a declaration as (declare-fun NAME (SORTS) Bool),
+    // -- with NAME quoted as in the rules
+    std::string str = m_z3.toSmtLib (decl);
+    const std::string fun = "(declare-fun ";
+    const std::string range = " Bool)";
+    if (str.compare (0, fun.size (), fun) == 0 &&
+        str.size () > fun.size () + range.size () &&
+        str.compare (str.size () - range.size (), range.size (), range) == 0)
+    {
+      out << "(declare-rel " 
+          << str.substr (fun.size (), str.size () - fun.size () - range.size ())
+          << ")\n";
+      return;
+    }
+
+    out << "(declare-rel " << *bind::fname (decl) << " (";
+    for (unsigned i = 0, sz = bind::domainSz (decl); i < sz; ++i)
+      out << m_z3.toSmtLib (bind::domainTy (decl, i)) << " ";
+    out << "))\n";
+  }
+
+  void HornSmt2Writer::write (raw_ostream &out)
+  {
+    ScopedStats _st_("HornSmt2Writer");
+
+    for (Expr decl : m_db.getRelations ()) writeRelation (out, decl);
+
+    for (Expr v : m_db.getVars ())
+    {
+      assert (bind::IsConst () (v));
+      out << "(declare-var " << m_z3.toSmtLib (v) << " " 
+          << m_z3.toSmtLib (bind::typeOf (v)) << ")\n";
+    }
+
+    for (const HornRule &rule : m_db.getRules ())
+    {
+      Expr r = rule.get ();
+      if (isOpX<TRUE> (r)) continue;
+      out << "(rule " << m_z3.toSmtLib (r) << ")\n";
+    }
+
+    for (Expr q : m_db.getQueries ())
+      out << "(query " << m_z3.toSmtLib (q) << ")\n";
+  }
+}
@@ -1,13 +1,36 @@
 #include "seahorn/HornSolver.hh"
 #include "seahorn/HornifyModule.hh"
+#include "seahorn/HornCheckpoint.hh"
 #include "seahorn/HornClauseDBTransf.hh"
+#include "seahorn/HornCompositional.hh"
 #include "seahorn/HornDbModel.hh"
+#include "seahorn/HornInvCompact.hh"
+#include "seahorn/HornModelConverter.hh"
+#include "seahorn/HornModelValidator.hh"
+#include "seahorn/HornPortfolio.hh"
+#include "seahorn/HornProgress.hh"
+#include "seahorn/HornRelStats.hh"
+#include "seahorn/Houdini.hh"
+#include "seahorn/SummaryPack.hh"
+#include "seahorn/KInduction.hh"
+#include "seahorn/Analysis/CutPointGraph.hh"
+#include "seahorn/FunctionAnalysisCache.hh"
+#include "seahorn/Support/TaskPool.hh"
 
 #include "llvm/IR/Function.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
 #include "ufo/Stats.hh"
 
 #include "boost/range/algorithm/reverse.hpp"
+#include "boost/lexical_cast.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <limits>
+#include <map>
 
 using namespace llvm;
 
@@ -26,6 +49,20 @@ EstimateSizeInvars ("horn-estimate-size-invars",
              cl::desc ("Give an estimation about the size of all inferred invariants"), 
              cl::init (false));
 
+static llvm::cl::opt<bool>
+AnswerCompact ("horn-answer-compact",
+               cl::desc ("Simplify the invariants of --horn-answer, "
+                         "--horn-estimate-size-invars and --horn-anytime-json, "
+                         "and drop the conjuncts that the others imply"),
+               cl::init (true));
+
+static llvm::cl::opt<unsigned>
+AnswerCompactSmt ("horn-answer-compact-smt",
+                  cl::desc ("Also drop the conjuncts of an invariant that the others "
+                            "imply in an SMT query of at most this many milliseconds "
+                            "(0 = syntactic checks only)"),
+                  cl::init (0));
+
 static llvm::cl::opt<bool>
 SkipConstraints ("horn-skip-constraints",
                  cl::Hidden, cl::init(false),
@@ -44,46 +81,925 @@ HornChildren ("horn-child-order", cl::Hidden, cl::init(true));
 static llvm::cl::opt<unsigned>
 PdrContexts ("horn-pdr-contexts", cl::Hidden, cl::init (500));
 
+static llvm::cl::opt<std::string>
+CompStore ("horn-comp-store",
+           cl::desc ("File of the function summaries of the compositional "
+                     "engine. Functions that did not change, nor their callees, "
+                     "are not solved again"),
+           cl::init (""));
+
+static llvm::cl::opt<bool>
+Slice ("horn-slice",
+       cl::desc ("Remove rules and relations that are not in the cone of "
+                 "influence of the queries before solving"),
+       cl::init (false));
+
+static llvm::cl::opt<bool>
+Dedup ("horn-dedup",
+       cl::desc ("Remove duplicate rules, up to the names of their variables, "
+                 "and rules subsumed by a rule with fewer constraints, before "
+                 "solving"),
+       cl::init (false));
+
+static llvm::cl::opt<bool>
+Inline ("horn-inline",
+        cl::desc ("Inline relations with a single definition and a single use, "
+                  "and remove unused, constant and duplicated arguments, "
+                  "before solving"),
+        cl::init (false));
+
+static llvm::cl::opt<bool>
+InlineQe ("horn-inline-qe",
+          cl::desc ("Eliminate the local variables of inlined rules"),
+          cl::init (false));
+
+static llvm::cl::opt<unsigned>
+SolveTimeout ("horn-solve-timeout",
+              cl::desc ("Timeout of the Horn query in milliseconds (0 = none)"),
+              cl::init (0));
+
+static llvm::cl::opt<std::string>
+AnytimeJson ("horn-anytime-json",
+             cl::desc ("Write as JSON which queries are proven, refuted or unknown, "
+                       "the counterexample, and the invariants found so far, e.g., "
+                       "at the deadline of --horn-deadline"),
+             cl::init (""), cl::value_desc ("filename"));
+
+static llvm::cl::opt<unsigned>
+LemmaSlice ("horn-lemma-slice",
+            cl::desc ("First time slice of the Horn query, in milliseconds, while "
+                      "lemmas are still produced, e.g. by --horn-crab-pipeline. "
+                      "Doubles at every slice"),
+            cl::init (500));
+
+static llvm::cl::list<std::string>
+Portfolio ("horn-portfolio",
+           cl::desc ("Run configurations concurrently and keep the first answer. "
+                     "A configuration is [houdini+]ENGINE[:PARAM=VALUE]..."),
+           cl::ZeroOrMore);
+
+static llvm::cl::opt<std::string>
+PortfolioTuned ("horn-portfolio-tuned",
+                cl::desc ("Add to the portfolio the configurations tuned for "
+                          "--horn-portfolio-cluster in this file, see py/sea_tune.py"),
+                cl::init (""), cl::value_desc ("filename"));
+
+static llvm::cl::opt<std::string>
+PortfolioCluster ("horn-portfolio-cluster",
+                  cl::desc ("Feature cluster of the program, to pick the configurations "
+                            "of --horn-portfolio-tuned"),
+                  cl::init ("default"));
+
+static llvm::cl::opt<unsigned>
+PortfolioMem ("horn-portfolio-mem",
+              cl::desc ("Memory limit of every portfolio worker in MB (0 = none)"),
+              cl::init (0));
+
+static llvm::cl::opt<bool>
+PortfolioReplay ("horn-portfolio-replay",
+                 cl::desc ("Re-run the winning configuration in-process so that "
+                           "answers and counterexamples are available"),
+                 cl::init (true));
+
+static llvm::cl::opt<unsigned>
+SplitQueries ("horn-split-queries",
+              cl::desc ("Solve the queries in groups of this many, each group in "
+                        "a worker of its own, at most --horn-threads at a time, "
+                        "instead of as one query (0 = off)"),
+              cl::init (0));
+
+static llvm::cl::opt<std::string>
+SpacerLemmas ("horn-spacer-lemmas",
+              cl::desc ("Start the solver from the lemmas in this file that are "
+                        "still invariants, if it exists, and write the lemmas "
+                        "found to it"),
+              cl::init (""), cl::value_desc ("filename"));
+
+static llvm::cl::opt<std::string>
+WritePack ("horn-write-pack",
+           cl::desc ("Write the rules of the functions of the module, and the "
+                     "summaries proven for them, as a summary pack"),
+           cl::init (""), cl::value_desc ("filename"));
+
+static llvm::cl::opt<bool>
+LeanMem ("horn-lean-mem",
+         cl::desc ("Release what the query does not need before it starts: "
+                   "the marshal caches of the Z3 context and, unless a "
+                   "counterexample is wanted, the bodies of the functions"),
+         cl::init (false));
+
+static llvm::cl::opt<unsigned>
+StagedCrabSlice ("horn-staged-crab-slice",
+                 cl::desc ("Time slice of the check of the Crab invariants by the "
+                           "staged engine, in milliseconds (0 = none)"),
+                 cl::init (2000));
+
+static llvm::cl::opt<unsigned>
+StagedHoudiniSlice ("horn-staged-houdini-slice",
+                    cl::desc ("Time slice of Houdini and of the check of its "
+                              "invariants by the staged engine, in milliseconds "
+                              "(0 = none)"),
+                    cl::init (10000));
+
+static llvm::cl::opt<std::string>
+StagedLog ("horn-staged-log",
+           cl::desc ("Append the outcome and the time of every stage of the "
+                     "staged engine to this file, as a line of JSON"),
+           cl::init (""), cl::value_desc ("filename"));
+
+static llvm::cl::opt<unsigned>
+KindMax ("horn-kind-max",
+         cl::desc ("Maximal depth of the kind engine (k-induction)"),
+         cl::init (20));
+
 namespace seahorn
 {
   char HornSolver::ID = 0;
 
-  bool HornSolver::runOnModule (Module &M)
+  namespace
   {
-    Stats::sset ("Result", "UNKNOWN");
-    
-    HornifyModule &hm = getAnalysis<HornifyModule> ();
+    /// configurations of --horn-portfolio, then those tuned for the
+    /// cluster of the program
+    const std::vector<std::string> &portfolioSpecs ()
+    {
+      static std::vector<std::string> specs;
+      static bool done = false;
+      if (done) return specs;
+      done = true;
+      specs.assign (Portfolio.begin (), Portfolio.end ());
+      if (!PortfolioTuned.empty () &&
+          !loadTunedConfigs (PortfolioTuned, PortfolioCluster, specs))
+        errs () << "WARNING: cannot read tuned configurations from "
+                << PortfolioTuned << "\n";
+      return specs;
+    }
+
+    void interruptZ3 (void *z3) { static_cast<EZ3*> (z3)->interrupt (); }
+
+    /// the constraints of the relations of db as a model, e.g., the
+    /// invariants of Crab or of Houdini
+    void constraintsModel (HornClauseDB &db, HornDbModel &model)
+    {
+      for (Expr rel : db.getRelations ())
+      {
+        if (!db.hasConstraints (rel)) continue;
+        ExprVector args;
+        for (unsigned i = 0; i < bind::domainSz (rel); ++i)
+          args.push_back (bind::bvar (i, bind::domainTy (rel, i)));
+        Expr app = bind::fapp (rel, args);
+        model.addDef (app, db.getConstraints (app));
+      }
+    }
+
+    /// the budget of a query in milliseconds: the least of
+    /// --horn-solve-timeout and of the time left until the deadline of
+    /// globalCancelToken. 0 means none
+    unsigned solveTimeout ()
+    {
+      CancelToken &token = globalCancelToken ();
+      if (!token.hasDeadline ()) return SolveTimeout;
+      long long left = std::chrono::duration_cast<std::chrono::milliseconds>
+        (token.deadline () - CancelToken::clock::now ()).count ();
+      // -- past the deadline, the query stops at once
+      unsigned ms = left < 1 ? 1U :
+        (unsigned) std::min<long long> (left, std::numeric_limits<unsigned>::max ());
+      return SolveTimeout > 0 ? std::min ((unsigned) SolveTimeout, ms) : ms;
+    }
+
+    /// sets a parameter given as a string to a value of the right type
+    void setParam (ZParams<EZ3> &params, const std::string &k, const std::string &v)
+    {
+      if (v == "true" || v == "false") 
+        params.set (k, v == "true");
+      else if (!v.empty () && v.find_first_not_of ("0123456789") == std::string::npos)
+        params.set (k, boost::lexical_cast<unsigned> (v));
+      else
+        params.set (k, v);
+    }
+
+    /// sets the parameters of fp for cfg, with the given engine, and
+    /// the budget of solveTimeout
+    void configure (ZFixedPoint<EZ3> &fp, const PortfolioConfig &cfg,
+                    const std::string &engine)
+    {
+      ZParams<EZ3> params (fp.getContext ());
+      params.set (":engine", engine);
+      // -- disable slicing so that we can use cover
+      params.set (":xform.slice", false);
+      params.set (":use_heavy_mev", true);
+      params.set (":reset_obligation_queue", true);
+      params.set (":pdr.flexible_trace", FlexTrace);
+      params.set (":xform.inline-linear", false);
+      params.set (":xform.inline-eager", false);
+      // -- disable utvpi. It is unstable.
+      params.set (":pdr.utvpi", false);
+      // -- disable propagate_variable_equivalences in tail_simplifier
+      params.set (":xform.tail_simplifier_pve", false);
+      params.set (":xform.subsumption_checker", Subsumption);
+      params.set (":order_children", HornChildren ? 1U : 0U);
+      params.set (":pdr.max_num_contexts", PdrContexts);
+      for (auto &kv : cfg.params) setParam (params, kv.first, kv.second);
+      fp.set (params);
+      unsigned timeout = solveTimeout ();
+      if (timeout > 0) fp.setBudget (ZBudget (timeout));
+    }
+
+    /// publishes the levels and the lemmas of the relations of db in
+    /// fp, and the statistics of fp, to HornProgress. Between two
+    /// queries only: Z3 cannot be read while it solves
+    void publishProgress (HornClauseDB &db, ZFixedPoint<EZ3> &fp)
+    {
+      if (!HornProgress::enabled ()) return;
+      ExprFactory &efac = db.getExprFactory ();
+
+      unsigned maxLevel = 0;
+      // -- lemmas by level, -1 is for the lemmas at every level
+      std::map<int, unsigned long> perLevel;
+      std::vector<std::pair<unsigned long, std::string> > perRel;
+      for (Expr rel : db.getRelations ())
+      {
+        ExprVector args;
+        for (size_t i = 0, sz = bind::domainSz (rel); i < sz; ++i)
+          args.push_back (bind::mkConst
+                          (mkTerm<std::string>
+                           ("progress.arg." + boost::lexical_cast<std::string> (i), efac),
+                           bind::domainTy (rel, i)));
+        Expr app = bind::fapp (rel, args);
+
+        unsigned levels = fp.getNumLevels (rel);
+        maxLevel = std::max (maxLevel, levels);
+        unsigned long total = 0;
+        for (int lvl = -1; lvl < (int) levels; ++lvl)
+        {
+          Expr delta = fp.getCoverDelta (app, lvl);
+          unsigned long n = isOpX<TRUE> (delta) ? 0 :
+            isOpX<AND> (delta) ? delta->arity () : 1;
+          perLevel [lvl] += n;
+          total += n;
+        }
+        perRel.push_back (std::make_pair
+                          (total, boost::lexical_cast<std::string> (*bind::fname (rel))));
+      }
+
+      HornProgress::set ("spacer.levels", maxLevel);
+      HornProgress::clear ("spacer.lemmas.");
+      for (auto &kv : perLevel)
+        HornProgress::set (kv.first < 0 ? std::string ("spacer.lemmas.inf") :
+                           "spacer.lemmas.L" + boost::lexical_cast<std::string> (kv.first),
+                           kv.second);
+
+      // -- the relations with the most lemmas
+      std::sort (perRel.rbegin (), perRel.rend ());
+      if (perRel.size () > 10) perRel.resize (10);
+      HornProgress::clear ("spacer.rel.");
+      for (auto &kv : perRel) HornProgress::set ("spacer.rel." + kv.second, kv.first);
+
+      fp.forEachStatistic ([] (const std::string &k, unsigned v)
+                           {
+                             std::string key = k;
+                             std::replace (key.begin (), key.end (), ' ', '_');
+                             HornProgress::set ("z3." + key, v);
+                           });
+      HornProgress::toStats ();
+    }
+
+    /// adds lemmas to db and, if fp is not null, to fp. Lemmas of
+    /// relations that were sliced or inlined away are dropped
+    void addLemmas (HornClauseDB &db, std::vector<HornLemma> &lemmas,
+                    ZFixedPoint<EZ3> *fp)
+    {
+      for (const HornLemma &l : lemmas)
+      {
+        if (!db.hasRelation (bind::fname (l.first))) continue;
+        db.addConstraint (l.first, l.second);
+        if (fp) fp->addCover (l.first, l.second);
+        Stats::count ("HornLemmas");
+      }
+      HornProgress::add ("lemmas", lemmas.size ());
+      lemmas.clear ();
+    }
+
+    /// runs the query of fp while the producer of the queue runs. The
+    /// query is stopped after every time slice to add the lemmas that
+    /// became ready, and resumes over the same rules with its own
+    /// lemmas and the new ones. The slices double so that the
+    /// restarts cost at most as much as the last slice
+    boost::tribool queryWithLemmas (HornClauseDB &db, HornLemmaQueue &queue,
+                                    ZFixedPoint<EZ3> &fp,
+                                    const std::function<void ()> &onSlice)
+    {
+      typedef std::chrono::steady_clock clock;
+      ZBudget saved = fp.getBudget ();
+      unsigned slice = std::max (1U, (unsigned) LemmaSlice);
+      unsigned spent = 0;
+      unsigned timeout = solveTimeout ();
+
+      std::vector<HornLemma> lemmas;
+      queue.start ();
+      while (queue.take (lemmas))
+      {
+        addLemmas (db, lemmas, SkipConstraints ? nullptr : &fp);
+        if (timeout > 0 && spent >= timeout) break;
+
+        unsigned budget = slice;
+        if (timeout > 0) budget = std::min (budget, timeout - spent);
+        fp.setBudget (ZBudget (budget));
+        clock::time_point start = clock::now ();
+        boost::tribool res = fp.query ();
+        spent += std::chrono::duration_cast<std::chrono::milliseconds>
+          (clock::now () - start).count ();
+        Stats::count ("HornLemmaSlices");
+        publishProgress (db, fp);
+        onSlice ();
 
-    // Load the Horn clause database
+        if (res || !res)
+        {
+          // -- the remaining lemmas only go to the database
+          queue.stop ();
+          queue.take (lemmas);
+          addLemmas (db, lemmas, nullptr);
+          fp.setBudget (saved);
+          return res;
+        }
+        if (globalCancelToken ().cancelled ()) break;
+        if (slice < (1U << 30)) slice *= 2;
+      }
+
+      // -- every lemma was added. The rest of the budget
+      if ((timeout > 0 && spent >= timeout) || globalCancelToken ().cancelled ())
+      {
+        fp.setBudget (saved);
+        return boost::indeterminate;
+      }
+      fp.setBudget (timeout > 0 ? ZBudget (timeout - spent) : saved);
+      boost::tribool res = fp.query ();
+      fp.setBudget (saved);
+      publishProgress (db, fp);
+      return res;
+    }
+
+    /// runs the query of fp in doubling time slices of
+    /// --horn-progress-slice, and publishes the progress after each.
+    /// Spacer keeps its frames between two queries, so a slice goes
+    /// on from where the last one stopped. With checkpoints, the
+    /// slices do not grow over the period of the checkpoints
+    boost::tribool querySliced (HornClauseDB &db, ZFixedPoint<EZ3> &fp,
+                                const std::function<void ()> &onSlice)
+    {
+      typedef std::chrono::steady_clock clock;
+      ZBudget saved = fp.getBudget ();
+      unsigned maxSlice = HornCheckpoint::enabled () ?
+        HornCheckpoint::periodMs () : (1U << 30);
+      unsigned slice = ProgressSlice > 0 ?
+        std::min ((unsigned) ProgressSlice, maxSlice) : maxSlice;
+      unsigned spent = 0;
+      unsigned timeout = solveTimeout ();
+
+      boost::tribool res = boost::indeterminate;
+      for (;;)
+      {
+        unsigned budget = slice;
+        if (timeout > 0) budget = std::min (budget, timeout - spent);
+        fp.setBudget (ZBudget (budget));
+        clock::time_point start = clock::now ();
+        res = fp.query ();
+        spent += std::chrono::duration_cast<std::chrono::milliseconds>
+          (clock::now () - start).count ();
+        HornProgress::add ("spacer.slices", 1);
+        publishProgress (db, fp);
+        onSlice ();
+
+        if (res || !res) break;
+        if (timeout > 0 && spent >= timeout) break;
+        if (globalCancelToken ().cancelled ()) break;
+        // -- unknown for another reason than the slice, e.g. incompleteness
+        std::string reason = fp.getReasonUnknown ();
+        if (reason.find ("timeout") == std::string::npos &&
+            reason.find ("canceled") == std::string::npos) break;
+        if (slice < maxSlice) slice = std::min (2 * slice, maxSlice);
+      }
+      fp.setBudget (saved);
+      return res;
+    }
+  }
+
+  boost::tribool HornSolver::solve (HornifyModule &hm, const PortfolioConfig &cfg)
+  {
     auto &db = hm.getHornClauseDB ();
 
+    // -- Houdini does not stop midway, its survivors are only invariants
+    // -- once it is done
+    if (cfg.houdini && !globalCancelToken ().cancelled ())
+    {
+      Stats::resume ("Houdini inv");
+      Houdini houdini (hm);
+      houdini.guessCandidates (db);
+      // -- one solver per rule, as HoudiniPass
+      houdini.runHoudini (1);
+      Stats::stop ("Houdini inv");
+    }
+
+    m_kind = cfg.engine == "kind";
+    m_compositional = false;
+    m_staged = false;
+    if (m_kind) return solveKInduction (hm, cfg);
+    if (cfg.engine == "staged") return solveStaged (hm, cfg);
+
+    if (cfg.engine == "compositional") return solveCompositional (hm, cfg);
+
     m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
     ZFixedPoint<EZ3> &fp = *m_fp;
-
-    ZParams<EZ3> params (hm.getZContext ());
-    params.set (":engine", PdrEngine);
-    // -- disable slicing so that we can use cover
-    params.set (":xform.slice", false);
-    params.set (":use_heavy_mev", true);
-    params.set (":reset_obligation_queue", true);
-    params.set (":pdr.flexible_trace", FlexTrace);
-    params.set (":xform.inline-linear", false);
-    params.set (":xform.inline-eager", false);
-    // -- disable utvpi. It is unstable.
-    params.set (":pdr.utvpi", false);
-    // -- disable propagate_variable_equivalences in tail_simplifier
-    params.set (":xform.tail_simplifier_pve", false);
-    params.set (":xform.subsumption_checker", Subsumption);
-    params.set (":order_children", HornChildren ? 1U : 0U);
-    params.set (":pdr.max_num_contexts", PdrContexts);
-    fp.set (params);
+    configure (fp, cfg, cfg.engine);
     
     db.loadZFixedPoint (fp, SkipConstraints);
+    HornLemmaQueue &lemmas = hm.getLemmaQueue ();
+    {
+      // -- lemmas that are ready before the query, e.g., of Houdini
+      std::vector<HornLemma> ready;
+      lemmas.take (ready);
+      if (!ready.empty ()) addLemmas (db, ready, SkipConstraints ? nullptr : &fp);
+    }
+    if (LeanMem) releaseBeforeQuery (hm);
     
     Stats::resume ("Horn");
-    m_result = fp.query ();
+    HornCheckpoint::clock::time_point last;
+    HornCheckpoint::due (last);
+    auto checkpoint = [&] ()
+      {
+        if (!HornCheckpoint::due (last)) return;
+        Houdini houdini (hm);
+        initDBModelFromFP (houdini.getCandidateModel (), db, fp);
+        if (houdini.saveInvariants (HornCheckpoint::file ("spacer")))
+          Stats::count ("HornCheckpoints");
+        else
+          errs () << "WARNING: cannot write checkpoint "
+                  << HornCheckpoint::file ("spacer") << "\n";
+      };
+    boost::tribool res;
+    // -- the deadline is in the budget, an explicit cancel interrupts
+    CancelToken::Hook interrupt (globalCancelToken (),
+                                 [&hm] { hm.getZContext ().interrupt (); });
+    if (lemmas.hasProducer ()) res = queryWithLemmas (db, lemmas, fp, checkpoint);
+    else if ((ProgressSlice > 0 && HornProgress::enabled ()) ||
+             HornCheckpoint::enabled ())
+      res = querySliced (db, fp, checkpoint);
+    else
+    {
+      res = fp.query ();
+      publishProgress (db, fp);
+    }
+    Stats::stop ("Horn");
+    return res;
+  }
+
+  boost::tribool HornSolver::solveCompositional (HornifyModule &hm,
+                                                 const PortfolioConfig &cfg)
+  {
+    // -- functions are only solved concurrently if the factory is
+    unsigned threads = hm.getExprFactory ().isConcurrent () ? hm.getThreads () : 1;
+    HornCompositional comp (hm,
+                            [&cfg] (ZFixedPoint<EZ3> &fp)
+                            { configure (fp, cfg, "spacer"); },
+                            threads, SkipConstraints);
+    if (!CompStore.empty ()) comp.setStore (CompStore);
+    if (!comp.init (*m_module))
+    {
+      errs () << "WARNING: the compositional engine needs the summaries of "
+              << "--horn-inter-proc. Solving the whole database with spacer\n";
+      PortfolioConfig whole (cfg);
+      whole.engine = "spacer";
+      // -- Houdini already ran
+      whole.houdini = false;
+      return solve (hm, whole);
+    }
+
+    m_compositional = true;
+    Stats::resume ("Horn");
+    boost::tribool res;
+    {
+      CancelToken::Hook interrupt (globalCancelToken (),
+                                   [&hm] { hm.getZContext ().interrupt (); });
+      res = comp.solve ();
+    }
     Stats::stop ("Horn");
+    m_fp = std::move (comp.getZFixedPoint ());
+    if (!m_fp) m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
+    return res;
+  }
+
+  boost::tribool HornSolver::solveStaged (HornifyModule &hm, const PortfolioConfig &cfg)
+  {
+    typedef std::chrono::steady_clock clock;
+    auto &db = hm.getHornClauseDB ();
+
+    struct Outcome
+    {
+      const char *stage;
+      const char *result;
+      unsigned ms;
+      unsigned slice;
+    };
+    std::vector<Outcome> outcomes;
+    auto elapsed = [] (clock::time_point t0)
+      {
+        return (unsigned) std::chrono::duration_cast<std::chrono::milliseconds>
+          (clock::now () - t0).count ();
+      };
+    auto record = [&] (const char *stage, const char *result,
+                       clock::time_point t0, unsigned slice)
+      {
+        unsigned ms = elapsed (t0);
+        outcomes.push_back (Outcome {stage, result, ms, slice});
+        Stats::sset (std::string ("Staged.") + stage, result);
+        Stats::uset (std::string ("Staged.") + stage + ".ms", ms);
+        LOG ("horn-staged",
+             errs () << "stage " << stage << ": " << result << " in " << ms << " ms\n";);
+      };
+    auto finish = [&] (const char *winner)
+      {
+        Stats::sset ("StagedWinner", winner);
+        if (StagedLog.empty ()) return;
+        std::error_code ec;
+        raw_fd_ostream OS (StagedLog, ec, sys::fs::F_Append | sys::fs::F_Text);
+        if (ec)
+        {
+          errs () << "WARNING: cannot write " << StagedLog << ": " << ec.message () << "\n";
+          return;
+        }
+        OS << "{\"module\":\"";
+        OS.write_escaped (m_module->getModuleIdentifier ());
+        OS << "\",\"winner\":\"" << winner << "\",\"stages\":[";
+        for (size_t i = 0; i < outcomes.size (); ++i)
+          OS << (i > 0 ? "," : "") << "{\"stage\":\"" << outcomes [i].stage
+             << "\",\"result\":\"" << outcomes [i].result
+             << "\",\"ms\":" << outcomes [i].ms
+             << ",\"slice\":" << outcomes [i].slice << "}";
+        OS << "]}\n";
+      };
+    // -- a slice is cut short by the deadline of the run
+    auto budget = [] (unsigned slice)
+      {
+        unsigned t = solveTimeout ();
+        return t == 0 ? slice : slice == 0 ? t : std::min (slice, t);
+      };
+    // -- the constraints of the database are invariants. If they also
+    // -- refute the queries, they are a model of the database
+    auto check = [&] (unsigned ms)
+      {
+        HornDbModel model;
+        constraintsModel (db, model);
+        HornModelValidator validator;
+        validator.setTimeLimit (ms);
+        return validator.validate (db, model, hm.getThreads ());
+      };
+    auto proven = [&] (const char *winner)
+      {
+        finish (winner);
+        m_staged = true;
+        m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
+        return boost::tribool (false);
+      };
+
+    // -- 1. the constraints as they are, e.g., the invariants of Crab
+    clock::time_point t0 = clock::now ();
+    unsigned slice = budget (StagedCrabSlice);
+    bool constrained = false;
+    for (Expr rel : db.getRelations ())
+      if (db.hasConstraints (rel))
+      {
+        constrained = true;
+        break;
+      }
+    if (!constrained) record ("crab", "skipped", t0, slice);
+    else
+    {
+      boost::tribool res = check (slice);
+      record ("crab", res ? "proven" : !res ? "inconclusive" : "unknown", t0, slice);
+      if (res) return proven ("crab");
+    }
+
+    // -- 2. Houdini over the guessed candidates. It adds the
+    // -- invariants it finds to the constraints
+    t0 = clock::now ();
+    slice = budget (StagedHoudiniSlice);
+    if (globalCancelToken ().cancelled ()) record ("houdini", "skipped", t0, slice);
+    else
+    {
+      Houdini houdini (hm);
+      if (slice > 0) houdini.setDeadline (t0 + std::chrono::milliseconds (slice));
+      houdini.guessCandidates (db);
+      if (!houdini.runHoudini (1)) record ("houdini", "timeout", t0, slice);
+      else
+      {
+        unsigned spent = elapsed (t0);
+        boost::tribool res = check (slice == 0 ? 0 : slice > spent ? slice - spent : 1);
+        record ("houdini", res ? "proven" : !res ? "inconclusive" : "unknown", t0, slice);
+        if (res) return proven ("houdini");
+      }
+    }
+
+    // -- 3. spacer, from the constraints of the stages before
+    t0 = clock::now ();
+    slice = solveTimeout ();
+    PortfolioConfig spacer (cfg);
+    spacer.engine = "spacer";
+    spacer.houdini = false;
+    boost::tribool res = solve (hm, spacer);
+    record ("spacer", res ? "refuted" : !res ? "proven" : "unknown", t0, slice);
+    finish (res || !res ? "spacer" : "none");
+    return res;
+  }
+
+  void HornSolver::getModel (HornClauseDB &db, HornDbModel &model)
+  {
+    if (m_staged) constraintsModel (db, model);
+    else initDBModelFromFP (model, db, *m_fp);
+  }
+
+  boost::tribool HornSolver::solveKInduction (HornifyModule &hm, const PortfolioConfig &cfg)
+  {
+    // -- nothing to print answers or counterexamples from
+    m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
+
+    unsigned maxK = KindMax;
+    for (auto &kv : cfg.params)
+      if (kv.first == ":max_k") maxK = boost::lexical_cast<unsigned> (kv.second);
+
+    Function *F = m_module->getFunction ("main");
+    if (!F || F->isDeclaration ()) return boost::indeterminate;
+
+    // -- as BmcPass, the return of main is bad
+    const CutPointGraph &cpg = getAnalysis<FunctionAnalysisCache> ().cpg (*F);
+    const CutPoint *bad = nullptr;
+    for (auto &bb : *F)
+      if (isa<ReturnInst> (bb.getTerminator ()) && cpg.isCutPoint (bb))
+      {
+        bad = &cpg.getCp (bb);
+        break;
+      }
+    if (!bad) return boost::indeterminate;
+
+    KInduction kind (hm.symExec (), hm.getZContext (),
+                     cpg.getCp (F->getEntryBlock ()), *bad);
+    auto &db = hm.getHornClauseDB ();
+    for (const CutPoint &cp : cpg)
+    {
+      if (!hm.hasBbPredicate (cp.bb ())) continue;
+      Expr pred = hm.bbPredicate (cp.bb ());
+      if (!db.hasRelation (pred) || !db.hasConstraints (pred)) continue;
+      kind.addInvariant (cp, db.getConstraints (bind::fapp (pred, hm.live (cp.bb ()))));
+    }
+
+    // -- the depth of a checkpoint is only taken for the same program
+    std::vector<unsigned> sig;
+    sig.push_back (std::distance (cpg.begin (), cpg.end ()));
+    sig.push_back (db.getRules ().size ());
+    unsigned from = 1;
+    if (HornCheckpoint::resume ())
+    {
+      from = HornCheckpoint::loadDepth ("kind", sig, hm.getExprFactory ()) + 1;
+      Stats::uset ("KInductionResumed", from - 1);
+    }
+    HornCheckpoint::clock::time_point last;
+    HornCheckpoint::due (last);
+    kind.onBase ([&] (unsigned k)
+                 {
+                   if (HornCheckpoint::due (last) &&
+                       HornCheckpoint::saveDepth ("kind", k, sig, hm.getExprFactory ()))
+                     Stats::count ("HornCheckpoints");
+                 });
+
+    Stats::resume ("KInduction");
+    boost::tribool res;
+    {
+      CancelToken::Hook interrupt (globalCancelToken (),
+                                   [&hm] { hm.getZContext ().interrupt (); });
+      res = kind.run (maxK, from);
+    }
+    Stats::stop ("KInduction");
+    Stats::uset ("KInductionDepth", kind.depth ());
+    return res;
+  }
+
+  boost::tribool HornSolver::solvePortfolio (HornifyModule &hm)
+  {
+    std::vector<PortfolioConfig> configs;
+    for (const std::string &spec : portfolioSpecs ())
+    {
+      PortfolioConfig cfg;
+      if (!PortfolioConfig::parse (spec, cfg))
+      {
+        errs () << "WARNING: ignoring malformed portfolio configuration: " 
+                << spec << "\n";
+        continue;
+      }
+      configs.push_back (cfg);
+    }
+    if (configs.empty ()) return boost::indeterminate;
+
+    std::vector<PortfolioJob> jobs;
+    for (const PortfolioConfig &cfg : configs)
+      jobs.push_back ([this, &hm, &cfg] ()
+                      {
+                        setPortfolioCancelHook (interruptZ3, &hm.getZContext ());
+                        return solve (hm, cfg);
+                      });
+
+    PortfolioResult res = runPortfolio (jobs, PortfolioMem);
+    // -- an empty fixedpoint, unless the winner is replayed
+    m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
+    if (res.winner < 0) return boost::indeterminate;
+
+    const PortfolioConfig &winner = configs [res.winner];
+    Stats::sset ("PortfolioConfig", winner.name);
+    LOG ("horn-portfolio", 
+         errs () << "portfolio: " << winner.name << " answered first\n";);
+
+    // -- the answer, model, and counterexample are only in the worker
+    if (PortfolioReplay || PrintAnswer || EstimateSizeInvars)
+      return solve (hm, winner);
+    return res.answer;
+  }
+
+  void HornSolver::loadLemmas (HornifyModule &hm, const std::string &fname)
+  {
+    ScopedStats _st ("HornSolver.loadLemmas");
+    Houdini houdini (hm);
+    unsigned loaded = houdini.loadCandidates (fname);
+    Stats::uset ("HornWarmRelations", loaded);
+    if (loaded == 0) return;
+
+    // -- the solver trusts its covers, only the lemmas that are still
+    // -- inductive become constraints of the database
+    if (hm.getThreads () > 1 && hm.getExprFactory ().isConcurrent ())
+      houdini.runHoudiniParallel (hm.getThreads ());
+    else
+      houdini.runHoudini (1);
+  }
+
+  boost::tribool HornSolver::solveSplit (HornifyModule &hm, const PortfolioConfig &cfg)
+  {
+    auto &db = hm.getHornClauseDB ();
+    ExprVector queries = db.getQueries ();
+    std::vector<ExprVector> groups;
+    for (size_t i = 0; i < queries.size (); i += SplitQueries)
+      groups.push_back (ExprVector (queries.begin () + i,
+                                    queries.begin () +
+                                    std::min<size_t> (queries.size (), i + SplitQueries)));
+
+    std::vector<PortfolioJob> jobs;
+    for (const ExprVector &group : groups)
+      jobs.push_back ([this, &hm, &db, &cfg, &group] ()
+                      {
+                        setPortfolioCancelHook (interruptZ3, &hm.getZContext ());
+                        // -- the worker has a copy of the database of its own
+                        db.setQueries (group);
+                        return solve (hm, cfg);
+                      });
+
+    int failing = -1;
+    unsigned unsat = 0;
+    m_groups.clear ();
+    for (const ExprVector &group : groups)
+      m_groups.push_back (QueryGroup {group, boost::indeterminate});
+    runEach (jobs, PortfolioMem, std::max (1U, hm.getThreads ()),
+             [&] (size_t i, boost::tribool res)
+             {
+               m_groups [i].result = res;
+               outs () << "query " << i << ": "
+                       << (res ? "sat" : !res ? "unsat" : "unknown") << "\n";
+               outs ().flush ();
+               LOG ("horn-split",
+                    for (Expr q : groups [i]) errs () << "query " << i << ": " << *q << "\n";);
+               if (!res) ++unsat;
+               if (res)
+               {
+                 failing = i;
+                 return false;
+               }
+               // -- once cancelled, the groups that still run stay unknown
+               return !globalCancelToken ().cancelled ();
+             });
+    Stats::uset ("HornQueryGroups", groups.size ());
+    Stats::uset ("HornQueryGroupsUnsat", unsat);
+
+    m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
+    m_split = false;
+    if (failing < 0)
+    {
+      m_split = true;
+      return unsat == groups.size () ? boost::tribool (false) : boost::indeterminate;
+    }
+
+    // -- the counterexample is only in the worker
+    Stats::uset ("HornQueryGroupFailing", failing);
+    db.setQueries (groups [failing]);
+    boost::tribool res = solve (hm, cfg);
+    db.setQueries (queries);
+    if (res) return res;
+    // -- without a counterexample, nothing after the solver can use the answer
+    errs () << "WARNING: query " << failing << " is sat in its worker but not "
+            << "when solved again\n";
+    m_split = true;
+    return boost::indeterminate;
+  }
+
+  bool HornSolver::runOnModule (Module &M)
+  {
+    Stats::sset ("Result", "UNKNOWN");
+    m_module = &M;
     
+    HornifyModule &hm = getAnalysis<HornifyModule> ();
+    if (!Progress.empty () &&
+        !HornProgress::start (Progress, ProgressPeriod, &hm.getExprFactory ()))
+      errs () << "WARNING: cannot write progress to " << Progress << "\n";
+
+    if (SplitQueries > 0 && !portfolioSpecs ().empty ())
+      errs () << "WARNING: --horn-split-queries is ignored with --horn-portfolio\n";
+    bool split = SplitQueries > 0 && portfolioSpecs ().empty () && PdrEngine != "kind" &&
+      hm.getHornClauseDB ().getQueries ().size () > 1;
+
+    // -- the portfolio and split queries fork, and k-induction and the
+    // -- compositional engine do not take lemmas while they run, so
+    // -- they take every lemma first
+    HornLemmaQueue &lemmas = hm.getLemmaQueue ();
+    if (split || !portfolioSpecs ().empty () || PdrEngine == "kind" ||
+        PdrEngine == "compositional" || PdrEngine == "staged")
+    {
+      std::vector<HornLemma> all;
+      lemmas.run ();
+      lemmas.take (all);
+      addLemmas (hm.getHornClauseDB (), all, nullptr);
+    }
+
+    if (!SpacerLemmas.empty ()) loadLemmas (hm, SpacerLemmas);
+    if (HornCheckpoint::resume ()) loadLemmas (hm, HornCheckpoint::file ("spacer"));
+
+    HornSliceModelConverter slice;
+    // -- the rules of the pack, before slicing and inlining
+    std::unique_ptr<HornClauseDB> packDb;
+    for (;;)
+    {
+      if (!WritePack.empty ())
+      {
+        packDb.reset (new HornClauseDB (hm.getExprFactory ()));
+        packDb->merge (hm.getHornClauseDB ());
+      }
+      // -- before the portfolio forks, so that every worker gets the slice
+      slice = HornSliceModelConverter ();
+      if (Dedup)
+      {
+        ProgressPhase phase ("dedup");
+        dedupHornClauseDB (hm.getHornClauseDB ());
+      }
+      {
+        ProgressPhase phase ("slice");
+        if (Slice) sliceHornClauseDB (hm.getHornClauseDB (), slice);
+      }
+      m_simplify.reset (new HornSimplifyModelConverter (hm.getZContext ()));
+      if (Inline)
+      {
+        ProgressPhase phase ("inline");
+        simplifyHornClauseDB (hm.getHornClauseDB (), *m_simplify,
+                              InlineQe ? &hm.getZContext () : nullptr);
+      }
+
+      if (HornRelStats::enabled ())
+        HornRelStats::snapshot ("solve", hm.getHornClauseDB ());
+
+      {
+        ProgressPhase phase ("solve");
+        if (portfolioSpecs ().empty ())
+        {
+          PortfolioConfig cfg;
+          cfg.engine = PdrEngine;
+          if (split) m_result = solveSplit (hm, cfg);
+          else
+          {
+            m_result = solve (hm, cfg);
+            m_groups.assign (1, QueryGroup {hm.getHornClauseDB ().getQueries (), m_result});
+          }
+        }
+        else
+        {
+          m_result = solvePortfolio (hm);
+          m_groups.assign (1, QueryGroup {hm.getHornClauseDB ().getQueries (), m_result});
+        }
+      }
+
+      // -- with --horn-sem-regions, a counterexample may read memory
+      // -- that is not tracked. Track it and solve again
+      if (!static_cast<bool> (m_result) || !hm.tracksRegions ()) break;
+      ProgressPhase phase ("refine");
+      ExprVector cex;
+      getCexRules (hm.getHornClauseDB (), cex);
+      if (!hm.refineRegions (cex)) break;
+    }
+    HornProgress::phase ("answer");
+    
+    auto &db = hm.getHornClauseDB ();
+    ZFixedPoint<EZ3> &fp = *m_fp;
+
     if (m_result) outs () << "sat"; 
     else if (!m_result) outs () << "unsat"; 
     else outs () << "unknown"; 
@@ -93,43 +1009,162 @@ namespace seahorn
     else if (!m_result) Stats::sset ("Result", "TRUE");
     
     LOG ("answer",
-         if (m_result || !m_result) errs () << fp.getAnswer () << "\n";);
-
+         if (!m_kind && !m_split && !m_staged && (m_result || !m_result))
+           errs () << fp.getAnswer () << "\n";);
 
-    if (PrintAnswer && !m_result)
+    if (m_kind && (PrintAnswer || EstimateSizeInvars))
+      errs () << "WARNING: k-induction has no invariants or counterexample to print\n";
+    else if (m_compositional && !m_result && (PrintAnswer || EstimateSizeInvars))
+      errs () << "WARNING: the compositional engine has no invariants to print\n";
+    else if (m_split && (PrintAnswer || EstimateSizeInvars))
+      errs () << "WARNING: queries solved on their own have no common "
+              << "invariants or counterexample to print\n";
+    else if (PrintAnswer && !m_result)
     {
       HornDbModel dbModel;
-      initDBModelFromFP(dbModel, db, fp);
-      printInvars(M, dbModel);
+      getModel (db, dbModel);
+      if (!m_simplify->isIdentity ())
+      {
+        HornDbModel origModel;
+        if (!m_simplify->convert (dbModel, origModel))
+          errs () << "WARNING: invariants of inlined relations are missing\n";
+        dbModel = origModel;
+      }
+      if (Slice)
+      {
+        HornDbModel fullModel;
+        slice.convert (dbModel, fullModel);
+        printInvars(M, fullModel);
+      }
+      else
+        printInvars(M, dbModel);
     }
     else if (PrintAnswer && m_result)
-      printCex ();
+      printCex (db);
 
-    if (EstimateSizeInvars)
+    if (EstimateSizeInvars && !m_kind && !m_compositional && !m_split && !m_staged)
       estimateSizeInvars(M);
 
+    if (HornRelStats::enabled () && !m_result && !m_kind && !m_compositional && !m_split)
+    {
+      // -- of the database that was solved, before the model converters
+      HornDbModel dbModel;
+      getModel (db, dbModel);
+      for (Expr rel : db.getRelations ())
+      {
+        ExprVector args;
+        for (unsigned i = 0; i < bind::domainSz (rel); ++i)
+          args.push_back (bind::bvar (i, bind::domainTy (rel, i)));
+        HornRelStats::setInvariantSize (rel, dagSize (dbModel.getDef (bind::fapp (rel, args))));
+      }
+    }
+
+    if (HornModelValidator::enabled () && !m_result && !m_kind &&
+        !m_compositional && !m_split && portfolioSpecs ().empty ())
+    {
+      ProgressPhase phase ("validate");
+      HornDbModel dbModel;
+      getModel (db, dbModel);
+      HornModelValidator validator;
+      validator.report (validator.validate (db, dbModel, hm.getThreads ()), errs ());
+    }
+
+    // -- the fixedpoint of the portfolio is empty unless replayed
+    if (!SpacerLemmas.empty () && !m_kind && !m_compositional && !m_split &&
+        portfolioSpecs ().empty ())
+    {
+      Houdini houdini (hm);
+      getModel (db, houdini.getCandidateModel ());
+      if (!houdini.saveInvariants (SpacerLemmas))
+        errs () << "WARNING: cannot write lemmas to " << SpacerLemmas << "\n";
+    }
+
+    if (!AnytimeJson.empty ()) writeAnytime (M, slice);
+
+    if (packDb)
+    {
+      // -- proven summaries only come with the invariants of every relation
+      std::unique_ptr<HornDbModel> model;
+      if (!m_result && !m_kind && !m_compositional && !m_split && m_fp)
+      {
+        model.reset (new HornDbModel ());
+        getModel (db, *model);
+        if (!m_simplify->isIdentity ())
+        {
+          HornDbModel origModel;
+          m_simplify->convert (*model, origModel);
+          *model = origModel;
+        }
+        if (Slice)
+        {
+          HornDbModel fullModel;
+          slice.convert (*model, fullModel);
+          *model = fullModel;
+        }
+      }
+      writePack (M, *packDb, model.get ());
+    }
+
+    HornProgress::stop ();
     return false;
   }
 
   void HornSolver::getAnalysisUsage (AnalysisUsage &AU) const
   {
     AU.addRequired<HornifyModule> ();
+    AU.addRequired<FunctionAnalysisCache> ();
     AU.setPreservesAll ();
   }
 
-  void HornSolver::printCex ()
+  void HornSolver::getCexRules (HornClauseDB &db, ExprVector &rules)
   {
-    ZFixedPoint<EZ3> fp = *m_fp;
-    //outs () << *fp.getCex () << "\n";
-    
-    ExprVector rules;
-    fp.getCexRules (rules);
-    boost::reverse (rules);
-    for (Expr r : rules) 
+    // -- k-induction does not produce rules
+    if (m_kind) return;
+    if (!m_simplify || m_simplify->isIdentity ()) 
     {
-      Expr src;
-      Expr dst;
-      
+      m_fp->getCexRules (rules);
+      return;
+    }
+    ExprVector simplified;
+    m_fp->getCexRules (simplified);
+    m_simplify->convertCex (db, simplified, rules);
+  }
+
+  bool HornSolver::getGroundCex (ExprVector &apps)
+  {
+    if (!m_fp || m_kind || m_split) return false;
+    if (m_simplify && !m_simplify->isIdentity ()) return false;
+
+    Expr ans;
+    try { ans = m_fp->getGroundSatAnswer (); }
+    catch (z3::exception &e)
+    {
+      LOG ("cex", errs () << "no ground answer: " << e.msg () << "\n";);
+      return false;
+    }
+    if (!ans) return false;
+
+    // -- a conjunction of ground applications, in order
+    ExprVector todo (1, ans);
+    while (!todo.empty ())
+    {
+      Expr e = todo.back ();
+      todo.pop_back ();
+      if (isOpX<AND> (e))
+        for (size_t i = e->arity (); i > 0; --i) todo.push_back (e->arg (i - 1));
+      else if (bind::isFapp (e))
+        apps.push_back (e);
+    }
+    return !apps.empty ();
+  }
+
+  namespace
+  {
+    /// the names of the relations of the body, if any, and of the head
+    /// of a rule of a counterexample
+    void cexEdge (Expr r, Expr &src, Expr &dst)
+    {
+      src.reset (0);
       if (isOpX<IMPL> (r)) 
       { 
         dst = r->arg (1);
@@ -144,73 +1179,266 @@ namespace seahorn
         if (!bind::isFapp (src)) src.reset (0);
         else src = bind::fname (bind::fname (src));
       }
-      
+      dst = bind::fname (bind::fname (dst));
+    }
+  }
 
+  void HornSolver::printCex (HornClauseDB &db)
+  {
+    ExprVector rules;
+    getCexRules (db, rules);
+    boost::reverse (rules);
+    for (Expr r : rules) 
+    {
+      Expr src;
+      Expr dst;
+      cexEdge (r, src, dst);
       if (src) outs () << *src << " --> ";
-      
-      dst = bind::fname (bind::fname (dst));
       outs () << *dst << "\n";
     }
     
   }
 
+  void HornSolver::writeAnytime (Module &M, HornSliceModelConverter &slice)
+  {
+    std::error_code ec;
+    raw_fd_ostream OS (AnytimeJson, ec, sys::fs::F_Text);
+    if (ec)
+    {
+      errs () << "WARNING: cannot write " << AnytimeJson << ": "
+              << ec.message () << "\n";
+      return;
+    }
+    HornifyModule &hm = getAnalysis<HornifyModule> ();
+    HornClauseDB &db = hm.getHornClauseDB ();
+    auto str = [&OS] (Expr e)
+      {
+        OS << "\"";
+        OS.write_escaped (boost::lexical_cast<std::string> (*e));
+        OS << "\"";
+      };
+    auto answer = [] (boost::tribool r)
+      { return r ? "refuted" : !r ? "proven" : "unknown"; };
+
+    OS << "{\"result\":\"" << answer (m_result) << "\""
+       << ",\"cancelled\":" << (globalCancelToken ().cancelled () ? "true" : "false")
+       << ",\"groups\":[";
+    for (size_t i = 0; i < m_groups.size (); ++i)
+    {
+      OS << (i > 0 ? "," : "") << "{\"status\":\"" << answer (m_groups [i].result)
+         << "\",\"queries\":[";
+      for (size_t j = 0; j < m_groups [i].queries.size (); ++j)
+      {
+        if (j > 0) OS << ",";
+        str (m_groups [i].queries [j]);
+      }
+      OS << "]}";
+    }
+    OS << "]";
+
+    // -- as --horn-answer, the steps of the counterexample
+    OS << ",\"counterexample\":[";
+    // -- the fixedpoint of the portfolio is empty unless replayed
+    bool hasFp = m_fp && !m_kind && !m_staged && portfolioSpecs ().empty ();
+    if (m_result && hasFp)
+    {
+      ExprVector rules;
+      getCexRules (db, rules);
+      boost::reverse (rules);
+      for (size_t i = 0; i < rules.size (); ++i)
+      {
+        Expr src, dst;
+        cexEdge (rules [i], src, dst);
+        OS << (i > 0 ? "," : "") << "{\"from\":";
+        if (src) str (src);
+        else OS << "null";
+        OS << ",\"to\":";
+        str (dst);
+        OS << "}";
+      }
+    }
+    OS << "]";
+
+    // -- the lemmas of the fixedpoint hold even if it did not finish.
+    // -- Without one, the constraints of the database, e.g., of Houdini
+    bool fromFp = hasFp && !m_split;
+    HornDbModel dbModel;
+    if (fromFp) initDBModelFromFP (dbModel, db, *m_fp);
+    else constraintsModel (db, dbModel);
+    if (!m_simplify->isIdentity ())
+    {
+      HornDbModel origModel;
+      m_simplify->convert (dbModel, origModel);
+      dbModel = origModel;
+    }
+    if (Slice)
+    {
+      HornDbModel fullModel;
+      slice.convert (dbModel, fullModel);
+      dbModel = fullModel;
+    }
+
+    OS << ",\"invariants\":{\"source\":\"" << (fromFp ? "fixedpoint" : "constraints")
+       << "\",\"complete\":" << (fromFp && !m_result && !m_compositional ? "true" : "false")
+       << ",\"functions\":[";
+    if (m_answerIndex.empty ()) indexAnswer (M, hm);
+    bool firstFn = true;
+    for (const FuncAnswer &fa : m_answerIndex)
+    {
+      if (fa.blocks.empty ()) continue;
+      OS << (firstFn ? "" : ",") << "{\"name\":\"";
+      firstFn = false;
+      OS.write_escaped (fa.name);
+      OS << "\",\"blocks\":[";
+      for (size_t i = 0; i < fa.blocks.size (); ++i)
+      {
+        const BlockAnswer &ba = fa.blocks [i];
+        OS << (i > 0 ? "," : "") << "{\"relation\":";
+        str (bind::fname (ba.pred));
+        OS << ",\"invariant\":";
+        str (compactInvariant (dbModel.getDef (bind::fapp (ba.pred, ba.live))));
+        OS << "}";
+      }
+      OS << "]}";
+    }
+    OS << "]}}\n";
+  }
+
   void HornSolver::estimateSizeInvars (Module &M)
   {
     HornifyModule &hm = getAnalysis<HornifyModule> ();
-    ZFixedPoint<EZ3> fp = *m_fp;
+    HornClauseDB &db = hm.getHornClauseDB ();
+    ZFixedPoint<EZ3> &fp = *m_fp;
+    if (m_answerIndex.empty ()) indexAnswer (M, hm);
 
-    Expr allInvars;
-    bool first = true;
-    unsigned numBlocks = 0;
-    for (auto &F : M) 
+    // -- the size of the dag of all of them, shared terms once
+    ExprVector all, raw;
+    for (const FuncAnswer &fa : m_answerIndex) 
     {
-      if (F.isDeclaration ()) continue;
-      for (auto &BB : F)
+      for (const BlockAnswer &ba : fa.blocks)
       {
-        if (!hm.hasBbPredicate (BB)) continue;
-        Expr bbPred = hm.bbPredicate (BB);
-        const ExprVector &live = hm.live (BB);
-        Expr invars = fp.getCoverDelta (bind::fapp (bbPred, live));
-        numBlocks++;
-        if (first) {
-          allInvars = invars;
-          first = false;
-        } else {
-          allInvars = mk<AND> (allInvars, invars);
-        }
+        // -- removed by --horn-slice
+        if (!db.hasRelation (ba.pred)) continue;
+        Expr invars = fp.getCoverDelta (bind::fapp (ba.pred, ba.live));
+        raw.push_back (invars);
+        all.push_back (compactInvariant (invars));
       }
     }
-    Stats::uset ("NumOfBlocksWithInvariants", numBlocks);
-    Stats::uset ("SizeOfInvariants", (allInvars ? dagSize(allInvars) : 0));
+    Stats::uset ("NumOfBlocksWithInvariants", all.size ());
+    Stats::uset ("SizeOfInvariants", all.empty () ? 0 :
+                 dagSize (mknary<AND> (mk<TRUE> (hm.getExprFactory ()), all)));
+    if (AnswerCompact)
+      Stats::uset ("SizeOfInvariantsRaw", raw.empty () ? 0 :
+                   dagSize (mknary<AND> (mk<TRUE> (hm.getExprFactory ()), raw)));
   }
 
-  void HornSolver::printInvars (Module &M, HornDbModel &model)
+  Expr HornSolver::compactInvariant (Expr inv)
   {
-    for (auto &F : M) printInvars (F, model);
+    if (!AnswerCompact) return inv;
+    if (!m_compactor)
+      m_compactor.reset (new HornInvCompactor (&getAnalysis<HornifyModule> ().getZContext (),
+                                               AnswerCompactSmt));
+    return m_compactor->compact (inv);
   }
 
-  void HornSolver::printInvars(Function &F, HornDbModel &model)
+  void HornSolver::indexAnswer (Module &M, HornifyModule &hm)
   {
-    if (F.isDeclaration ()) return;
+    m_answerIndex.clear ();
+    for (Function &F : M)
+    {
+      if (F.isDeclaration ()) continue;
+      m_answerIndex.push_back (FuncAnswer ());
+      FuncAnswer &fa = m_answerIndex.back ();
+      fa.name = F.getName ();
+      for (auto &BB : F)
+        if (hm.hasBbPredicate (BB))
+          fa.blocks.push_back (BlockAnswer {hm.bbPredicate (BB), hm.live (BB)});
+    }
+  }
 
-    HornifyModule &hm = getAnalysis<HornifyModule> ();
-    outs () << "Function: " << F.getName () << "\n";
+  void HornSolver::releaseBeforeQuery (HornifyModule &hm)
+  {
+    // -- the rules are in the fixedpoint now, which keeps their terms
+    // -- alive. Producers of lemmas still marshal into the context
+    if (!hm.getLemmaQueue ().hasProducer ())
+    {
+      Stats::uset ("HornLeanMarshalTerms", hm.getZContext ().getMarshalCache ().size ());
+      hm.getZContext ().clearMarshalCache ();
+    }
 
-    // -- not used for now
-    Expr summary = hm.summaryPredicate (F);
+    // -- HornCex, --horn-sem-regions and --horn-write-pack read the
+    // -- module after the query, --horn-answer reads the index only
+    if (m_keepModule || !m_answerIndex.empty () || hm.tracksRegions () ||
+        !WritePack.empty ())
+      return;
+    indexAnswer (*m_module, hm);
 
-    ZFixedPoint<EZ3> fp = *m_fp;
+    unsigned bodies = 0;
+    for (Function &F : *m_module)
+      if (!F.isDeclaration ()) F.dropAllReferences ();
+    for (Function &F : *m_module)
+      if (!F.isDeclaration ())
+      {
+        F.deleteBody ();
+        ++bodies;
+      }
+    Stats::uset ("HornLeanBodies", bodies);
+    LOG ("lean", errs () << "lean: dropped " << bodies << " function bodies\n";);
+  }
 
-    for (auto &BB : F)
+  void HornSolver::writePack (Module &M, HornClauseDB &db, HornDbModel *model)
+  {
+    HornifyModule &hm = getAnalysis<HornifyModule> ();
+    ExprFactory &efac = hm.getExprFactory ();
+    SummaryPack pack (efac);
+
+    for (Function &F : M)
     {
-      if (!hm.hasBbPredicate (BB)) continue;
+      if (F.isDeclaration () || F.getName ().equals ("main")) continue;
+      Expr sumPred = hm.summaryPredicate (F);
+      if (!sumPred) continue;
+
+      ExprVector rels;
+      for (auto &BB : F)
+        if (hm.hasBbPredicate (BB)) rels.push_back (hm.bbPredicate (BB));
+
+      Expr sumApp, lemma;
+      if (model)
+      {
+        ExprVector args;
+        for (unsigned i = 1; i + 1 < sumPred->arity (); ++i)
+          args.push_back
+            (bind::mkConst (mkTerm<std::string> ("arg." + 
+                                                 boost::lexical_cast<std::string> (i),
+                                                 efac),
+                            sumPred->arg (i)));
+        sumApp = bind::fapp (sumPred, args);
+        lemma = model->getDef (sumApp);
+        if (isOpX<TRUE> (lemma)) lemma = Expr ();
+      }
+      pack.add (F.getName (), sumPred, rels, db, sumApp, lemma);
+    }
 
-      Expr bbPred = hm.bbPredicate (BB);
+    if (!pack.save (WritePack))
+      errs () << "WARNING: cannot write summary pack " << WritePack << "\n";
+    Stats::uset ("HornPackWritten", pack.size ());
+  }
 
-      outs () << *bind::fname (bbPred) << ":";
-      const ExprVector &live = hm.live (BB);
-      //Expr invars = fp.getCoverDelta (bind::fapp (bbPred, live));
-      Expr invars = model.getDef(bind::fapp(bbPred, live));
+  void HornSolver::printInvars (Module &M, HornDbModel &model)
+  {
+    if (m_answerIndex.empty ()) indexAnswer (M, getAnalysis<HornifyModule> ());
+    for (const FuncAnswer &fa : m_answerIndex) printInvars (fa, model);
+  }
+
+  void HornSolver::printInvars(const FuncAnswer &fa, HornDbModel &model)
+  {
+    outs () << "Function: " << fa.name << "\n";
+
+    for (const BlockAnswer &ba : fa.blocks)
+    {
+      outs () << *bind::fname (ba.pred) << ":";
+      //Expr invars = fp.getCoverDelta (bind::fapp (ba.pred, ba.live));
+      Expr invars = compactInvariant (model.getDef(bind::fapp(ba.pred, ba.live)));
 
       if (isOpX<AND> (invars))
       {
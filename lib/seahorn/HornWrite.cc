@@ -3,6 +3,8 @@
 #include "seahorn/HornClauseDBTransf.hh"
 #include "seahorn/ClpWrite.hh"
 #include "seahorn/McMtWriter.hh"
+#include "seahorn/HornSmt2Writer.hh"
+#include "seahorn/Support/GzipStream.hh"
 
 #include "seahorn/config.h"
 
@@ -13,6 +15,11 @@ InternalWriter("horn-fp-internal-writer",
                llvm::cl::desc("Use internal writer for Horn SMT2 format. (Default)"),
                llvm::cl::init(true),llvm::cl::Hidden);
 
+static llvm::cl::opt<bool>
+Gzip("horn-write-gzip",
+     llvm::cl::desc("Compress the written Horn clauses with gzip"),
+     llvm::cl::init(false));
+
 enum HCFormat { SMT2, CLP, PURESMT2, MCMT};
 static llvm::cl::opt<HCFormat>
 HornClauseFormat("horn-format",
@@ -52,51 +59,68 @@ namespace seahorn
     HornClauseDB &db  = hm.getHornClauseDB ();
     ExprFactory &efac = hm.getExprFactory ();
 
+    raw_ostream *out = &m_out;
+    std::unique_ptr<raw_gzip_ostream> gz;
+    if (Gzip)
+    {
+      if (!raw_gzip_ostream::compresses ())
+        errs () << "WARNING: no zlib, writing uncompressed Horn clauses\n";
+      gz.reset (new raw_gzip_ostream (m_out));
+      out = gz.get ();
+    }
+
     if (HornClauseFormat == CLP)
     {
       normalizeHornClauseHeads (db);
       ClpWrite writer (db, efac);
-      m_out << writer.toString ();
+      writer.write (*out, efac.isConcurrent () ? hm.getThreads () : 1);
     }
     else if (HornClauseFormat == MCMT)
     {
       // -- normalize db
       // -- create writer
-      McMtWriter<llvm::raw_fd_ostream> writer (db, hm.getZContext ());
-      writer.write (m_out);
+      McMtWriter<llvm::raw_ostream> writer (db, hm.getZContext ());
+      writer.write (*out);
     }
     else 
     {
-      // Use local ZFixedPoint object to translate to SMT2. 
-      //
-      // When HornWrite is called hm.getZFixedPoint () might be still
-      // empty so we need to dump first the content of HornClauseDB
-      // into fp.
-      ZFixedPoint<EZ3> fp (hm.getZContext ());
-      // -- skip constraints since they are not supported.
-      // -- do not skip the query
-      db.loadZFixedPoint (fp, true, false);
-
-      if (HornClauseFormat == PURESMT2)
-      {
-        // -- disable fixedpoint extension
-        ZParams<EZ3> params (hm.getZContext ());
-        params.set (":print_fixedpoint_extensions", false);
-        fp.set (params);
-      }
-      
       // -- write header
-      setInfo (m_out, "original", M.getModuleIdentifier ());
+      setInfo (*out, "original", M.getModuleIdentifier ());
       std::string version ("SeaHorn v.");
       version += SEAHORN_VERSION_INFO;
-      setInfo (m_out, "authors", version);
-      
+      setInfo (*out, "authors", version);
+
       if (HornClauseFormat == PURESMT2 || !InternalWriter)
-        m_out << fp.toString () << "\n";
+      {
+        // Use local ZFixedPoint object to translate to SMT2. 
+        //
+        // When HornWrite is called hm.getZFixedPoint () might be still
+        // empty so we need to dump first the content of HornClauseDB
+        // into fp.
+        ZFixedPoint<EZ3> fp (hm.getZContext ());
+        // -- skip constraints since they are not supported.
+        // -- do not skip the query
+        db.loadZFixedPoint (fp, true, false);
+
+        if (HornClauseFormat == PURESMT2)
+        {
+          // -- disable fixedpoint extension
+          ZParams<EZ3> params (hm.getZContext ());
+          params.set (":print_fixedpoint_extensions", false);
+          fp.set (params);
+        }
+        *out << fp.toString () << "\n";
+      }
       else
-        m_out << fp << "\n";
+      {
+        // -- streams the rules without loading them into a fixedpoint
+        HornSmt2Writer writer (db, hm.getZContext ());
+        writer.write (*out);
+        *out << "\n";
+      }
     }
     
+    if (gz) gz->close ();
     m_out.flush ();
     return false;
   }
@@ -2,10 +2,60 @@
 #include "seahorn/LiveSymbols.hh"
 #include "seahorn/Support/CFG.hh"
 #include "seahorn/Support/ExprSeahorn.hh"
+#include "seahorn/Support/TaskPool.hh"
 
 #include "ufo/Stats.hh"
+
+#include <memory>
+
 namespace seahorn
 {
+  void HornifyFunction::encodeEdges (const CutPointGraph &cpg, EdgeEncoder encode)
+  {
+    // -- below this, threads cost more than they save
+    const size_t minParallelEdges = 64;
+
+    std::vector<const CpEdge*> edges;
+    for (const CutPoint &cp : cpg)
+      for (const CpEdge *edge : boost::make_iterator_range (cp.succ_begin (),
+                                                            cp.succ_end ()))
+        edges.push_back (edge);
+
+    unsigned threads = m_efac.isConcurrent () ? m_parent.getThreads () : 1;
+    if (edges.size () < minParallelEdges) threads = 1;
+
+    if (threads <= 1)
+    {
+      SymStore s (m_efac);
+      ExprSet allVars;
+      for (const CpEdge *edge : edges)
+      {
+        s.reset ();
+        allVars.clear ();
+        Expr rule = encode (*edge, s, allVars);
+        m_db.addRule (allVars, rule);
+      }
+      return;
+    }
+
+    ScopedStats _st_("HornifyFunction.parallelEdges");
+    std::vector<ExprSet> vars (edges.size ());
+    ExprVector rules (edges.size ());
+    TaskPool pool ("HornifyFunction.edges", threads);
+    // -- an edge is too small to be measured on every run
+    pool.setSamplePeriod (64);
+    std::vector<std::unique_ptr<SymStore> > stores (pool.threads ());
+    pool.run (edges.size (), [&] (unsigned w, size_t k)
+              {
+                if (!stores [w]) stores [w].reset (new SymStore (m_efac));
+                SymStore &s = *stores [w];
+                s.reset ();
+                rules [k] = encode (*edges [k], s, vars [k]);
+              });
+
+    // -- in the order of the edges, whatever the number of threads
+    for (size_t k = 0; k < edges.size (); ++k) m_db.addRule (vars [k], rules [k]);
+  }
   
   void HornifyFunction::extractFunctionInfo (const BasicBlock &BB)
   {
@@ -298,37 +348,31 @@ namespace seahorn
     
     UfoLargeSymExec lsem (m_sem);
     
-    for (const CutPoint &cp : cpg)
+    encodeEdges (cpg, [&] (const CpEdge &edge, SymStore &s, ExprSet &allVars)
       {
-        for (const CpEdge *edge : boost::make_iterator_range (cp.succ_begin (),
-                                                              cp.succ_end ()))
-        {
-          allVars.clear ();
-          args.clear ();
-          s.reset ();
-          const ExprVector &live = ls.live (&cp.bb ());
-
-          for (const Expr &v : live) args.push_back (s.read (v));
-          allVars.insert (args.begin (), args.end ());
+        // -- may run on several threads: everything here is local
+        ExprVector args;
+        const BasicBlock &src = edge.source ().bb ();
+        for (const Expr &v : ls.live (&src)) args.push_back (s.read (v));
+        allVars.insert (args.begin (), args.end ());
           
-          Expr pre = bind::fapp (m_parent.bbPredicate (cp.bb ()), args);
+        Expr pre = bind::fapp (m_parent.bbPredicate (src), args);
           
-          ExprVector side;
-          side.push_back (boolop::lneg ((s.read (m_sem.errorFlag (cp.bb ())))));
-          lsem.execCpEdg (s, *edge, side);
-          Expr tau = mknary<AND> (mk<TRUE> (m_efac), side);
-          expr::filter (tau, bind::IsConst(), 
-                        std::inserter (allVars, allVars.begin ()));
+        ExprVector side;
+        side.push_back (boolop::lneg ((s.read (m_sem.errorFlag (src)))));
+        lsem.execCpEdg (s, edge, side);
+        Expr tau = mknary<AND> (mk<TRUE> (m_efac), side);
+        expr::filter (tau, bind::IsConst(), 
+                      std::inserter (allVars, allVars.begin ()));
 
-          const BasicBlock &dst = edge->target ().bb ();
-          args.clear ();
-          for (const Expr &v : ls.live (&dst)) args.push_back (s.read (v));
-          allVars.insert (args.begin (), args.end ());
+        const BasicBlock &dst = edge.target ().bb ();
+        args.clear ();
+        for (const Expr &v : ls.live (&dst)) args.push_back (s.read (v));
+        allVars.insert (args.begin (), args.end ());
           
-          Expr post = bind::fapp (m_parent.bbPredicate (dst), args);
-          m_db.addRule (allVars, boolop::limp (boolop::land (pre, tau), post));
-        }
-      }
+        Expr post = bind::fapp (m_parent.bbPredicate (dst), args);
+        return boolop::limp (boolop::land (pre, tau), post);
+      });
     
     allVars.clear ();
     args.clear ();
@@ -18,9 +18,14 @@
 #include "boost/range.hpp"
 #include "boost/scoped_ptr.hpp"
 
+#include <set>
+
 #include "seahorn/Support/SortTopo.hh"
+#include "seahorn/Support/TaskPool.hh"
+#include "seahorn/Support/CFG.hh"
 
 #include "seahorn/SymStore.hh"
+#include "seahorn/HornRelStats.hh"
 #include "seahorn/LiveSymbols.hh"
 
 #include "seahorn/Analysis/CutPointGraph.hh"
@@ -49,9 +54,17 @@ TL("horn-sem-lvl",
    cl::init (seahorn::REG));
 
 
+static llvm::cl::opt<bool>
+TrackRegions ("horn-sem-regions",
+              llvm::cl::desc ("With --horn-sem-lvl=mem, track only the memory regions "
+                              "in the slice of the assertions, and add the regions "
+                              "read on a counterexample"),
+              cl::init (false));
+
 namespace hm_detail {enum Step {SMALL_STEP, LARGE_STEP,
                                 CLP_SMALL_STEP, CLP_FLAT_SMALL_STEP,
-                                FLAT_SMALL_STEP, FLAT_LARGE_STEP};}
+                                FLAT_SMALL_STEP, FLAT_LARGE_STEP,
+                                ADAPTIVE_STEP};}
 
 static llvm::cl::opt<enum hm_detail::Step>
 Step("horn-step",
@@ -62,14 +75,47 @@ Step("horn-step",
                  clEnumValN (hm_detail::FLAT_LARGE_STEP, "flarge", "Flat Large Step"),
                  clEnumValN (hm_detail::CLP_SMALL_STEP, "clpsmall", "CLP Small Step"),
                  clEnumValN (hm_detail::CLP_FLAT_SMALL_STEP, "clpfsmall","CLP Flat Small Step"),
+                 clEnumValN (hm_detail::ADAPTIVE_STEP, "adaptive",
+                             "Small or Large Step, whichever is cheaper for each function"),
                  clEnumValEnd),
      cl::init (hm_detail::SMALL_STEP));
 
+static llvm::cl::opt<unsigned>
+AdaptiveMaxEdge("horn-adaptive-max-edge",
+                llvm::cl::desc ("With --horn-step=adaptive, use Small Step for the "
+                                "functions with a cut-point edge of more instructions"),
+                cl::init (2000));
+
 static llvm::cl::opt<bool>
 InterProc("horn-inter-proc",
           llvm::cl::desc ("Use inter-procedural encoding"),
           cl::init (false));
 
+static llvm::cl::list<std::string>
+SummaryPacks("horn-summary-pack",
+             llvm::cl::desc ("With --horn-inter-proc, link the rules of the functions "
+                             "in a summary pack instead of encoding their bodies"),
+             llvm::cl::ZeroOrMore, llvm::cl::value_desc ("filename"));
+
+static llvm::cl::opt<bool>
+ShareSummaries("horn-share-summaries",
+               llvm::cl::desc ("With --horn-inter-proc, encode once the functions "
+                               "whose bodies are identical up to names, and give "
+                               "them one summary"),
+               cl::init (false));
+
+static llvm::cl::opt<bool>
+Lazy("horn-lazy",
+     llvm::cl::desc ("Only encode the functions that main may call"),
+     cl::init (false));
+
+static llvm::cl::opt<bool>
+LazySkipSafe("horn-lazy-skip-safe",
+             llvm::cl::desc ("With --horn-lazy, also skip the functions that "
+                             "cannot fail. Calls to them are abstracted, so "
+                             "counterexamples may be spurious"),
+             cl::init (false));
+
 static llvm::cl::opt<bool>
 AbortOnRecursion("horn-abort-on-recursion",
                  llvm::cl::desc ("Abort if program has a recursive call"),
@@ -80,6 +126,59 @@ NoVerification("horn-no-verif",
           llvm::cl::desc ("Generate only SMT2 encoding (i.e. even if there are no assertions)"),
           cl::init (false));
 
+static llvm::cl::opt<bool>
+ExprRegion("horn-expr-region",
+           llvm::cl::desc ("Allocate the expressions of the job in a region "
+                           "that is freed at once when the job ends"),
+           cl::init (false));
+
+static llvm::cl::opt<bool>
+ExprProfile("horn-expr-profile",
+            llvm::cl::desc ("Report per-operator expression node counts "
+                            "and memory with the statistics"),
+            cl::init (false));
+
+static llvm::cl::opt<bool>
+QueryCache("horn-query-cache",
+           llvm::cl::desc ("Reuse the answers of repeated SMT queries"),
+           cl::init (false));
+
+static llvm::cl::opt<std::string>
+QueryCacheFile("horn-query-cache-file",
+               llvm::cl::desc ("Keep the answers of SMT queries in a file "
+                               "across runs (implies --horn-query-cache)"),
+               llvm::cl::init (""), llvm::cl::value_desc ("filename"));
+
+static llvm::cl::opt<bool>
+SmtTelemetry("horn-smt-telemetry",
+             llvm::cl::desc ("Report the slowest SMT queries with the statistics"),
+             cl::init (false));
+
+static llvm::cl::opt<std::string>
+SmtTelemetryLog("horn-smt-telemetry-log",
+                llvm::cl::desc ("Log every SMT query as a line of JSON "
+                                "(implies --horn-smt-telemetry)"),
+                llvm::cl::init (""), llvm::cl::value_desc ("filename"));
+
+static llvm::cl::opt<unsigned>
+SmtTimeout("horn-smt-timeout",
+           llvm::cl::desc ("Timeout of every SMT query in milliseconds (0 = none)"),
+           cl::init (0));
+
+static llvm::cl::opt<unsigned>
+SmtRlimit("horn-smt-rlimit",
+          llvm::cl::desc ("Resource limit of every SMT query (0 = none)"),
+          cl::init (0));
+
+static llvm::cl::opt<unsigned>
+Threads("horn-threads",
+        llvm::cl::desc ("Encode functions that do not call each other, the "
+                        "edges of large functions, and run Houdini on "
+                        "independent components, on this many threads. "
+                        "Functions only with --horn-step=small, edges only "
+                        "with --horn-step=large and flarge"),
+        cl::init (1));
+
 
 
 namespace seahorn
@@ -87,24 +186,128 @@ namespace seahorn
   char HornifyModule::ID = 0;
 
   HornifyModule::HornifyModule () :
-    ModulePass (ID), m_zctx (m_efac),  m_db (m_efac),
-    m_td(0), m_canFail(0)
+    ModulePass (ID), m_efac (Threads > 1, ExprRegion), m_zctx (m_efac),  m_db (m_efac),
+    m_td(0), m_canFail(0), m_cache (nullptr), m_module (nullptr), m_loadCache (false)
+  {
+  }
+
+  HornifyModule::HornifyModule (const std::string &cacheFile, bool load) :
+    ModulePass (ID), m_efac (Threads > 1, ExprRegion), m_zctx (m_efac),  m_db (m_efac),
+    m_td(0), m_canFail(0), m_cache (nullptr), m_module (nullptr), m_cacheFile (cacheFile),
+    m_loadCache (load)
+  {
+  }
+
+  unsigned HornifyModule::getThreads () const { return Threads; }
+
+  HornifyModule::~HornifyModule ()
   {
+    if (m_efac.getProfile ()) removeExprProfileHook (m_efac, "HornifyModule.expr");
   }
 
   bool HornifyModule::runOnModule (Module &M)
   {
     ScopedStats _st ("HornifyModule");
+    if (ExprProfile)
+    {
+      m_efac.enableProfiling ();
+      addExprProfileHook (m_efac, "HornifyModule.expr");
+    }
+    ExprProfileScope _p ("HornifyModule");
+
+    if (QueryCache || !QueryCacheFile.empty ())
+      m_zctx.queryCache ().enable ();
+    if (!QueryCacheFile.empty () &&
+        !m_zctx.queryCache ().open (QueryCacheFile))
+      errs () << "WARNING: cannot write query cache file "
+              << QueryCacheFile << "\n";
+
+    if (SmtTelemetry || !SmtTelemetryLog.empty ()) ZTelemetry::enable ();
+    if (!SmtTelemetryLog.empty () && !ZTelemetry::setLog (SmtTelemetryLog))
+      errs () << "WARNING: cannot write SMT telemetry log "
+              << SmtTelemetryLog << "\n";
+
+    // -- every pooled solver, e.g., of Houdini and BMC, gets the budget
+    if (SmtTimeout > 0 || SmtRlimit > 0)
+    {
+      ZParams<EZ3> params (m_zctx);
+      params.set (ZBudget (SmtTimeout, SmtRlimit));
+      m_zctx.solverPool ().setProfile ("", params);
+    }
+
+    if (m_loadCache)
+    {
+      if (!m_db.load (m_cacheFile))
+      {
+        // -- drop it so that the next run encodes the program again
+        errs () << "ERROR: cannot read Horn clause cache " << m_cacheFile << "\n";
+        std::remove (m_cacheFile.c_str ());
+        std::exit (3);
+      }
+      Stats::sset ("HornCache", "hit");
+      Stats::uset ("HornRules", m_db.getRules ().size ());
+      Stats::uset ("HornRelations", m_db.relSize ());
+      if (HornRelStats::enabled ()) HornRelStats::snapshot ("hornify", m_db);
+      return false;
+    }
+
+    bool Changed = encodeModule (M);
+    // -- what the encoding dropped, before the solvers add their own
+    Stats::uset ("HornExprCompacted", m_efac.compact ());
+    Stats::uset ("HornRules", m_db.getRules ().size ());
+    Stats::uset ("HornRelations", m_db.relSize ());
+    if (HornRelStats::enabled ()) HornRelStats::snapshot ("hornify", m_db);
+    if (!m_cacheFile.empty ())
+    {
+      if (m_db.save (m_cacheFile))
+        Stats::sset ("HornCache", "miss");
+      else
+        errs () << "WARNING: cannot write Horn clause cache " << m_cacheFile << "\n";
+    }
+    return Changed;
+  }
 
+  bool HornifyModule::encodeModule (Module &M)
+  {
     bool Changed = false;
     m_td = &getAnalysis<DataLayoutPass> ().getDataLayout ();
     m_canFail = getAnalysisIfAvailable<CanFail> ();
+    m_cache = &getAnalysis<FunctionAnalysisCache> ();
+    // -- the live symbols are computed again with the new semantics
+    if (m_sem) m_cache->forget (*m_sem);
+
+    m_module = &M;
+    m_classes.clear ();
+
+    if (!SummaryPacks.empty () && !m_pack)
+    {
+      m_pack.reset (new SummaryPack (m_efac));
+      if (!InterProc)
+        errs () << "WARNING: summary packs require --horn-inter-proc. Ignoring them\n";
+      else
+        for (const std::string &file : SummaryPacks)
+          if (!m_pack->load (file))
+            errs () << "WARNING: cannot read summary pack " << file << "\n";
+      Stats::uset ("HornPackFunctions", m_pack->size ());
+    }
 
     if (Step == hm_detail::CLP_SMALL_STEP || 
         Step == hm_detail::CLP_FLAT_SMALL_STEP)
       m_sem.reset (new ClpSmallSymExec (m_efac, *this, TL));
     else
-      m_sem.reset (new UfoSmallSymExec (m_efac, *this, TL));
+    {
+      UfoSmallSymExec *sem = new UfoSmallSymExec (m_efac, *this, TL);
+      if (TrackRegions && TL == MEM)
+      {
+        if (!m_regions) m_regions.reset (new RegionSlice (M));
+        sem->setRegions (m_regions.get ());
+        Stats::uset ("HornTrackedRegions", m_regions->numTracked ());
+        Stats::uset ("HornRegions", m_regions->numRegions ());
+      }
+      m_sem.reset (sem);
+    }
+
+    reserve (M);
 
     Function *main = M.getFunction ("main");
     if (!main)
@@ -196,7 +399,23 @@ namespace seahorn
     }
 
 
+    unsigned threads = Threads;
+    // -- the edges of a function are still encoded on the threads, see
+    // -- HornifyFunction::encodeEdges
+    if (threads > 1 && Step != hm_detail::SMALL_STEP)
+    {
+      errs () << "WARNING: encoding functions concurrently requires "
+              << "--horn-step=small. Encoding functions sequentially, and "
+              << "the edges of large functions on " << threads << " threads\n";
+      threads = 1;
+    }
+    std::vector<Function*> fns;
+    std::vector<bool> recursive;
+
     CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
+    DenseSet<const Function*> needed;
+    if (Lazy) neededFunctions (CG, *main, needed);
+    unsigned skipped = 0;
     for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
     {
       const std::vector<CallGraphNode*> &scc = *it;
@@ -222,8 +441,21 @@ namespace seahorn
       
       // assert (!it.hasLoop () && "Recursion not yet supported");
       // assert (scc.size () == 1 && "Recursion not supported");
-      if (f) Changed = (runOnFunction (*f) || Changed);
+      if (!f) continue;
+      if (Lazy && !needed.count (f))
+      {
+        if (!f->isDeclaration ()) ++skipped;
+        continue;
+      }
+      if (threads > 1)
+      {
+        fns.push_back (f);
+        recursive.push_back (it.hasLoop () || scc.size () > 1);
+      }
+      else Changed = (runOnFunction (*f) || Changed);
     }
+    if (threads > 1) runOnSccsParallel (fns, recursive, threads);
+    if (Lazy) Stats::uset ("HornSkippedFunctions", skipped);
 
     if (!m_db.hasQuery ())
     { 
@@ -232,6 +464,13 @@ namespace seahorn
       m_db.addQuery (mk<TRUE> (m_efac));
     }
 
+    if (ExprFactoryProfile *p = m_efac.getProfile ())
+    {
+      ExprVector rules;
+      for (auto &r : m_db.getRules ()) rules.push_back (r.get ());
+      p->recordFormula ("rules", mknary<AND> (mk<TRUE> (m_efac), rules));
+    }
+
     /**
        TODO:
          - name basic blocks so that there are no name clashes between functions (DONE)
@@ -283,51 +522,331 @@ namespace seahorn
     return Changed;
   }
 
+  bool HornifyModule::refineRegions (const ExprVector &cex)
+  {
+    if (!m_regions || !m_module) return false;
+
+    // -- the functions of the relations of the counterexample
+    std::set<const Function*> fns;
+    auto addFn = [&] (Expr app)
+      {
+        if (!bind::isFapp (app)) return;
+        Expr d = bind::fname (app);
+        if (isBbPredicate (d)) fns.insert (predicateBb (d).getParent ());
+        else if (isOpX<FUNCTION> (bind::fname (d)))
+          fns.insert (getTerm<const Function*> (bind::fname (d)));
+      };
+    for (Expr r : cex)
+    {
+      if (isOpX<IMPL> (r))
+      {
+        Expr body = r->arg (0);
+        if (isOpX<AND> (body)) for (Expr b : *body) addFn (b);
+        else addFn (body);
+        r = r->arg (1);
+      }
+      addFn (r);
+    }
+    if (cex.empty ())
+      for (const Function &F : *m_module) fns.insert (&F);
+
+    if (!m_regions->refine (fns)) return false;
+    Stats::count ("HornRegionRefinements");
+    LOG ("region-slice",
+         errs () << "refined to " << m_regions->numTracked () << " regions\n";);
+
+    m_db.clear ();
+    m_bbPreds.clear ();
+    encodeModule (*m_module);
+    Stats::uset ("HornRules", m_db.getRules ().size ());
+    Stats::uset ("HornRelations", m_db.relSize ());
+    return true;
+  }
+
   bool HornifyModule::runOnFunction (Function &F)
   {
     // -- skip functions without a body
     if (F.isDeclaration () || F.empty ()) return false;
-    LOG("horn-step", errs () << "HornifyModule: runOnFunction: " << F.getName () << "\n");
+    prepareFunction (F);
+    const Function *rep = summaryClass (F);
+    if (!rep || !shareSummary (F, *rep)) encodeFunction (F, m_db);
+    return false;
+  }
 
+  void HornifyModule::neededFunctions (CallGraph &CG, const Function &main,
+                                       DenseSet<const Function*> &out)
+  {
+    // -- functions whose summaries the encoding of main may reference.
+    // -- Indirect calls are not encoded with summaries, and are not
+    // -- followed
+    SmallVector<const Function*, 16> worklist;
+    out.insert (&main);
+    worklist.push_back (&main);
+    while (!worklist.empty ())
+    {
+      const Function *f = worklist.pop_back_val ();
+      for (auto &cr : *CG [f])
+      {
+        const Function *g = cr.second->getFunction ();
+        if (!g || g->isDeclaration ()) continue;
+        if (LazySkipSafe && m_canFail && !m_canFail->canFail (g)) continue;
+        if (out.insert (g).second) worklist.push_back (g);
+      }
+    }
+  }
 
+  bool HornifyModule::preferLargeStep (Function &F)
+  {
+    // -- estimated size of the rules of either step. The instructions
+    // -- of a block are in every rule of an edge through the block,
+    // -- and every rule has the live symbols of its source and
+    // -- destination, and of the exit for the error rules
+    const BasicBlock *exit = findExitBlock (F);
+    unsigned exitLive = exit ? live (*exit).size () : 0;
+
+    uint64_t small = 0;
+    for (const BasicBlock &bb : F)
+    {
+      unsigned l = live (bb).size ();
+      small += l + exitLive;
+      for (const BasicBlock *dst : succs (bb))
+        small += bb.size () + l + live (*dst).size ();
+    }
 
-    // XXX: between we run LiveSymbols and hornify function (see
-    // below) the CFG can change because the construction of the
-    // cutpoint graph calls a pass that unifies return nodes that
-    // ultimately might change the CFG. 
-    // 
-    // This is a temporary hook to force computing the cutpoint graph
-    // (and unifying return nodes) before computing liveness so that
-    // we make sure the CFG does not change between LiveSymbols and
-    // hornify function.
-    /*CutPointGraph &cpg =*/ getAnalysis<CutPointGraph> (F);
+    const CutPointGraph &cpg = getCpg (F);
+    uint64_t large = 0;
+    unsigned maxEdge = 0;
+    for (const CutPoint &cp : cpg)
+    {
+      unsigned l = live (cp.bb ()).size ();
+      large += l + exitLive;
+      for (const CpEdge *edge : boost::make_iterator_range (cp.succ_begin (),
+                                                            cp.succ_end ()))
+      {
+        unsigned insts = cp.bb ().size ();
+        for (const BasicBlock &bb : *edge) insts += bb.size ();
+        maxEdge = std::max (maxEdge, insts);
+        large += insts + l + live (edge->target ().bb ()).size ();
+      }
+    }
+
+    bool res = large <= small && maxEdge <= AdaptiveMaxEdge;
+    LOG ("horn-step",
+         errs () << F.getName () << ": small " << small << " large " << large
+         << " largest edge " << maxEdge << (res ? " -> large\n" : " -> small\n"););
+    return res;
+  }
 
-    boost::scoped_ptr<HornifyFunction> hf (new SmallHornifyFunction
-                                           (*this, InterProc));
+  HornifyFunction *HornifyModule::mkHornifyFunction (Function &F, HornClauseDB &db)
+  {
+    if (Step == hm_detail::ADAPTIVE_STEP)
+    {
+      // -- both steps declare the same summaries, so their rules can
+      // -- be mixed in one database
+      bool large = preferLargeStep (F);
+      Stats::count (large ? "HornLargeStepFunctions" : "HornSmallStepFunctions");
+      if (large) return new LargeHornifyFunction (*this, db, InterProc);
+      return new SmallHornifyFunction (*this, db, InterProc);
+    }
     if (Step == hm_detail::LARGE_STEP)
-      hf.reset (new LargeHornifyFunction (*this, InterProc));
+      return new LargeHornifyFunction (*this, db, InterProc);
     else if (Step == hm_detail::FLAT_SMALL_STEP ||
              Step == hm_detail::CLP_FLAT_SMALL_STEP)
-      hf.reset (new FlatSmallHornifyFunction (*this, InterProc));
+      return new FlatSmallHornifyFunction (*this, db, InterProc);
     else if (Step == hm_detail::FLAT_LARGE_STEP)
-      hf.reset (new FlatLargeHornifyFunction (*this, InterProc));
+      return new FlatLargeHornifyFunction (*this, db, InterProc);
+    return new SmallHornifyFunction (*this, db, InterProc);
+  }
 
+  void HornifyModule::prepareFunction (Function &F)
+  {
+    LOG("horn-step", errs () << "HornifyModule: runOnFunction: " << F.getName () << "\n");
+
+    // -- the cut-point graph unifies the return nodes, so it is built
+    // -- before the liveness, so that the CFG does not change between
+    // -- LiveSymbols and the encoding. It stays cached for the solver
+    // -- and the counterexample
+    CutPointGraph &cpg = getCpg (F);
+    // -- one relation per cut-point, with and without --horn-min-cutpoints
+    Stats::uset ("HornCutPoints", Stats::get ("HornCutPoints") + cpg.size ());
+    Stats::uset ("HornDefaultCutPoints", 
+                 Stats::get ("HornDefaultCutPoints") + cpg.numDefaultCutPoints ());
+
+    // -- the symbols of F, shared by LiveSymbols and the encoders,
+    // -- over the final CFG
+    m_sem->addSymbols (F);
 
     /// -- allocate LiveSymbols
-    auto r = m_ls.insert (std::make_pair (&F, LiveSymbols (F, m_efac, *m_sem)));
-    assert (r.second);
+    m_cache->liveSymbols (F, m_efac, *m_sem);
+  }
+
+  void HornifyModule::encodeFunction (Function &F, HornClauseDB &db)
+  {
+    ExprProfileScope _p ("HornifyFunction");
+
     /// -- run LiveSymbols
-    r.first->second.run ();
+    LiveSymbols *ls = m_cache->findLiveSymbols (F, *m_sem);
+    assert (ls);
+    ls->run ();
+
+    if (linkFunction (F, db)) return;
 
     /// -- hornify function
+    boost::scoped_ptr<HornifyFunction> hf (mkHornifyFunction (F, db));
     hf->runOnFunction (F);
+  }
 
-    return false;
+  void HornifyModule::reserve (const Module &M)
+  {
+    // -- a relation per block, a rule per edge, a variable per live
+    // -- value and its next-state copy, a few nodes per instruction
+    size_t insts = 0, blocks = 0, edges = 0;
+    for (const Function &F : M)
+      for (const BasicBlock &bb : F)
+      {
+        ++blocks;
+        insts += bb.size ();
+        edges += bb.getTerminator ()->getNumSuccessors ();
+      }
+    m_db.reserve (edges + M.size (), blocks + M.size (), 2 * insts);
+    m_efac.reserve (8 * insts);
+  }
+
+  bool HornifyModule::linkFunction (Function &F, HornClauseDB &db)
+  {
+    // -- main has no summary
+    if (!m_pack || !InterProc || !m_pack->has (F.getName ()) ||
+        F.getName ().equals ("main"))
+      return false;
+
+    // -- the summary of F, by its exit block, as if it was encoded
+    HornClauseDB decl (m_efac);
+    SummaryHornifyFunction (*this, decl, InterProc).runOnFunction (F);
+
+    FunctionInfo &fi = m_sem->getFunctionInfo (F);
+    auto summary = [this] (StringRef name)
+      {
+        const Function *g = m_module->getFunction (name);
+        return g ? summaryPredicate (*g) : Expr (0);
+      };
+    if (!fi.sumPred || !m_pack->link (F.getName (), fi.sumPred, summary, decl))
+    {
+      // -- F is encoded from scratch
+      fi = FunctionInfo ();
+      errs () << "WARNING: the summary of " << F.getName ()
+              << " in the pack does not match. Encoding it\n";
+      Stats::count ("HornPackMismatches");
+      return false;
+    }
+
+    db.merge (decl);
+    Stats::count ("HornPackLinked");
+    return true;
+  }
+
+  const Function *HornifyModule::summaryClass (const Function &F)
+  {
+    // -- the regions tracked in two functions may differ
+    if (!ShareSummaries || !InterProc || m_regions ||
+        F.getName ().equals ("main"))
+      return nullptr;
+    const Function &rep = m_classes.add (F);
+    return &rep == &F ? nullptr : &rep;
+  }
+
+  bool HornifyModule::shareSummary (const Function &F, const Function &rep)
+  {
+    if (!m_sem->hasFunctionInfo (rep) || !m_sem->getFunctionInfo (rep).sumPred)
+      return false;
+
+    // -- a copy, the map may grow. The arguments are those of F, the
+    // -- calls of F pass them by position
+    FunctionInfo fi = m_sem->getFunctionInfo (rep);
+    std::vector<const Argument*> args;
+    for (const Argument &arg : boost::make_iterator_range (F.arg_begin (), F.arg_end ()))
+      args.push_back (&arg);
+    for (const Argument *&arg : fi.args) arg = args [arg->getArgNo ()];
+    m_sem->getFunctionInfo (F) = fi;
+
+    Stats::count ("HornSharedSummaries");
+    LOG ("horn-share",
+         errs () << F.getName () << " shares the summary of "
+                 << rep.getName () << "\n";);
+    return true;
+  }
+
+  void HornifyModule::runOnSccsParallel (const std::vector<Function*> &fns,
+                                         const std::vector<bool> &recursive,
+                                         unsigned threads)
+  {
+    ScopedStats _st ("HornifyModule.parallel");
+    CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
+
+    // -- a function is encoded in a later level than the functions
+    // -- it calls, whose summaries it uses
+    DenseMap<const Function*, unsigned> level;
+    std::vector<std::vector<unsigned> > levels;
+    for (unsigned i = 0; i < fns.size (); ++i)
+    {
+      unsigned l = 0;
+      for (auto &cr : *CG [fns [i]])
+      {
+        const Function *g = cr.second->getFunction ();
+        auto it = g ? level.find (g) : level.end ();
+        if (it != level.end ()) l = std::max (l, it->second + 1);
+      }
+      level [fns [i]] = l;
+      if (levels.size () <= l) levels.resize (l + 1);
+      levels [l].push_back (i);
+    }
+
+    for (const std::vector<unsigned> &lvl : levels)
+    {
+      std::vector<std::unique_ptr<HornClauseDB> > bufs (lvl.size ());
+      std::vector<unsigned> par;
+      // -- functions that share the summary of another one, which may
+      // -- be in this level
+      std::vector<std::pair<Function*, const Function*> > shared;
+      for (unsigned j = 0; j < lvl.size (); ++j)
+      {
+        Function &F = *fns [lvl [j]];
+        if (F.isDeclaration () || F.empty ()) continue;
+        // -- uses the pass manager, which is not thread safe
+        prepareFunction (F);
+        if (const Function *rep = summaryClass (F))
+        {
+          shared.push_back (std::make_pair (&F, rep));
+          continue;
+        }
+        bufs [j].reset (new HornClauseDB (m_efac));
+        // -- a recursive function must not see its own info until it
+        // -- is encoded
+        if (recursive [lvl [j]]) encodeFunction (F, *bufs [j]);
+        else
+        {
+          // -- created here so that the workers only read the map
+          m_sem->getFunctionInfo (F);
+          par.push_back (j);
+        }
+      }
+
+      TaskPool pool ("HornifyModule.parallelFunctions", threads);
+      pool.run (par.size (), [&] (unsigned, size_t k)
+                { encodeFunction (*fns [lvl [par [k]]], *bufs [par [k]]); });
+
+      // -- in call graph order, whatever the number of threads
+      for (auto &buf : bufs) if (buf) m_db.merge (*buf);
+      // -- no function of the level calls them
+      for (auto &fr : shared)
+        if (!shareSummary (*fr.first, *fr.second)) encodeFunction (*fr.first, m_db);
+    }
   }
 
   void HornifyModule::getAnalysisUsage (llvm::AnalysisUsage &AU) const
   {
     AU.setPreservesAll ();
+    // -- the database is read from the cache
+    if (m_loadCache) return;
     AU.addRequired<llvm::DataLayoutPass>();
 
     AU.addRequired<seahorn::CanFail> ();
@@ -336,8 +855,7 @@ namespace seahorn
     AU.addRequired<llvm::CallGraphWrapperPass> ();
     AU.addPreserved<llvm::CallGraphWrapperPass> ();
 
-    AU.addRequired<seahorn::TopologicalOrder>();
-    AU.addRequired<seahorn::CutPointGraph>();
+    AU.addRequired<seahorn::FunctionAnalysisCache>();
 #ifdef HAVE_CRAB_LLVM
     AU.addPreserved<crab_llvm::CrabLlvm> ();
 #endif 
@@ -346,13 +864,16 @@ namespace seahorn
 
   const LiveSymbols& HornifyModule::getLiveSybols (const Function &F) const
   {
-    auto it = m_ls.find (&F);
-    assert (it != m_ls.end ());
-    return it->second;
+    const LiveSymbols *ls = m_cache->findLiveSymbols (F, *m_sem);
+    assert (ls);
+    return *ls;
   }
 
   const Expr HornifyModule::bbPredicate (const BasicBlock &BB)
   {
+    std::unique_lock<std::mutex> l (m_bbPredsLock, std::defer_lock);
+    if (m_efac.isConcurrent ()) l.lock ();
+
     const BasicBlock *bb = &BB;
     Expr res = m_bbPreds [bb];
     if (res) return res;
@@ -2,7 +2,10 @@
 #include "seahorn/HornifyModule.hh"
 #include "seahorn/HornClauseDBTransf.hh"
 #include "seahorn/HornClauseDB.hh"
+#include "seahorn/HornClauseDBSnapshot.hh"
+#include "seahorn/HornRelGraph.hh"
 #include "seahorn/GuessCandidates.hh"
+#include "seahorn/HornModelValidator.hh"
 
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
@@ -10,12 +13,23 @@
 #include "ufo/Expr.hpp"
 #include "ufo/Smt/Z3n.hpp"
 #include "ufo/Smt/EZ3.hh"
+#include "ufo/ExprIO.hpp"
+#include "ufo/ExprEval.hpp"
 #include <vector>
 #include <boost/logic/tribool.hpp>
 #include "seahorn/HornClauseDBWto.hh"
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <sstream>
+#include <cstdio>
+#include <unistd.h>
+#include <boost/lexical_cast.hpp>
 
 #include "ufo/Stats.hh"
+#include "ufo/Trace.hh"
 
 using namespace llvm;
 
@@ -27,6 +41,504 @@ namespace seahorn
   #define NAIVE 0
   #define EACH_RULE_A_SOLVER 1
   #define EACH_RELATION_A_SOLVER 2
+  #define ASSUMPTIONS 3
+
+  static llvm::cl::opt<int>
+  HoudiniStrategy("horn-houdini-strategy",
+         llvm::cl::desc ("Strategy of Houdini to validate candidates"),
+         llvm::cl::values
+         (clEnumValN (NAIVE, "naive",
+                      "A single solver, reset for every check"),
+          clEnumValN (EACH_RULE_A_SOLVER, "each-rule",
+                      "A solver per rule (default)"),
+          clEnumValN (EACH_RELATION_A_SOLVER, "each-relation",
+                      "A solver per relation"),
+          clEnumValN (ASSUMPTIONS, "assumptions",
+                      "A solver per rule, checked under indicator literals of the lemmas"),
+          clEnumValEnd),
+         llvm::cl::init (EACH_RULE_A_SOLVER));
+
+  static llvm::cl::opt<bool>
+  BatchWeaken("horn-houdini-batch",
+         llvm::cl::desc ("Drop every lemma falsified by a counterexample, "
+                         "not only the first one"),
+         llvm::cl::init (false));
+
+  static llvm::cl::opt<unsigned>
+  BatchModels("horn-houdini-batch-models",
+         llvm::cl::desc ("With --horn-houdini-batch, the number of counter-models "
+                         "of a check whose falsified lemmas are dropped together. "
+                         "Each further model must falsify a lemma that is kept"),
+         llvm::cl::init (4));
+
+  static llvm::cl::opt<unsigned>
+  PositiveSamples("horn-houdini-samples",
+         llvm::cl::desc ("Before Houdini, drop the lemmas that are false in "
+                         "states reached by unrolling the rules this many times "
+                         "from the facts"),
+         llvm::cl::init (0));
+
+  static llvm::cl::opt<bool>
+  HoudiniLemmas("horn-houdini-lemmas",
+         llvm::cl::desc ("Give the invariants of Houdini to the solver as lemmas "
+                         "once the rules are loaded, instead of adding them to "
+                         "the database as constraints"),
+         llvm::cl::init (false));
+
+  static llvm::cl::opt<std::string>
+  HoudiniInvs("horn-houdini-invs",
+         llvm::cl::desc ("Start Houdini from the invariants in this file, if it "
+                         "exists, and write the invariants found to it"),
+         llvm::cl::init (""), llvm::cl::value_desc ("FILE"));
+
+  namespace
+  {
+  /*
+   * Weakens the candidate of ruleHead_app in model by a lemma that is
+   * false in m, or by all of them with --horn-houdini-batch. memo is
+   * used to instantiate the candidate at the arguments of
+   * ruleHead_app. Unless guess is false, a lemma is dropped even if
+   * none is false in m. Returns the number of dropped lemmas
+   */
+  unsigned weakenCand(HornDbModel &model, Expr ruleHead_app, DagVisitMemo &memo, ZModel<EZ3> &m,
+                      bool guess = true)
+  {
+	  Expr ruleHead_cand_app = model.getDef(ruleHead_app);
+
+	  LOG("houdini", errs() << "HEAD CAND APP: " << dag(ruleHead_cand_app) << "\n";);
+
+	  if(isOpX<TRUE>(ruleHead_cand_app))
+	  {
+			return 0;
+	  }
+	  unsigned dropped = 1;
+	  if(!isOpX<AND>(ruleHead_cand_app))
+	  {
+			Expr weaken_cand = mk<TRUE>(ruleHead_cand_app->efac());
+			model.addDef(ruleHead_app, weaken_cand);
+	  }
+	  else
+	  {
+			ExprVector head_cand_args;
+			head_cand_args.insert(head_cand_args.end(), ruleHead_cand_app->args_begin(), ruleHead_cand_app->args_end());
+			int num_of_lemmas = head_cand_args.size();
+
+			for(ExprVector::iterator it = head_cand_args.begin(); it != head_cand_args.end();)
+			{
+				LOG("houdini", errs() << "EVAL: " << *(m.eval(*it)) << "\n";);
+				if(isOpX<FALSE>(m.eval(*it)))
+				{
+					it = head_cand_args.erase(it);
+					if(!BatchWeaken) break;
+				}
+				else ++it;
+			}
+
+			// This condition can be reached only when the solver answers Indeterminate
+			// In this case, we remove an arbitrary lemma (the first one)
+			if(head_cand_args.size() == num_of_lemmas)
+			{
+				if(!guess) return 0;
+				LOG("houdini", errs() << "INDETERMINATE REACHED" << "\n");
+				head_cand_args.erase(head_cand_args.begin());
+			}
+			dropped = num_of_lemmas - head_cand_args.size();
+
+			ExprMap bvarToArgMap;
+			for(int i=0; i<bind::domainSz(bind::fname(ruleHead_app)); i++)
+			{
+				Expr arg_i = ruleHead_app->arg(i+1);
+				Expr bvar_i = bind::bvar(i, bind::typeOf(arg_i));
+				bvarToArgMap.insert(std::make_pair(bvar_i, arg_i));
+			}
+
+			if(head_cand_args.size() > 1)
+			{
+				Expr weaken_cand = mknary<AND>(head_cand_args.begin(), head_cand_args.end());
+				Expr weaken_cand_app = replace(weaken_cand, bvarToArgMap, memo);
+				model.addDef(ruleHead_app, weaken_cand_app);
+			}
+			else if(head_cand_args.size() == 1)
+			{
+				Expr weaken_cand = head_cand_args[0];
+				Expr weaken_cand_app = replace(weaken_cand, bvarToArgMap, memo);
+				model.addDef(ruleHead_app, weaken_cand_app);
+			}
+			else
+			{
+				model.addDef(ruleHead_app, mk<TRUE>(ruleHead_cand_app->efac()));
+			}
+	  }
+	  LOG("houdini", errs() << "HEAD AFTER WEAKEN: " << dag(model.getDef(ruleHead_app)) << "\n";);
+	  return dropped;
+  }
+
+  /// the lemmas of the conjunction cand
+  void candLemmas(Expr cand, ExprVector &out)
+  {
+    if(isOpX<TRUE>(cand)) return;
+    if(isOpX<AND>(cand)) out.insert(out.end(), cand->args_begin(), cand->args_end());
+    else out.push_back(cand);
+  }
+
+  /// application of rel to its bound variables, as in the candidate model
+  Expr relApp(Expr rel)
+  {
+    ExprVector args;
+    for(unsigned i = 0; i < bind::domainSz(rel); i++)
+      args.push_back(bind::fapp(bind::bvar(i, bind::domainTy(rel, i))));
+    return bind::fapp(rel, args);
+  }
+
+  /// rel with its name replaced by how it prints, e.g. main@bb. Keys
+  /// the invariants in the files of --horn-houdini-invs
+  Expr relKey(Expr rel)
+  {
+    std::ostringstream os;
+    os << *bind::fname(rel);
+    ExprVector sorts(++rel->args_begin(), rel->args_end());
+    return bind::fdecl(mkTerm<std::string>(os.str(), rel->efac()), sorts);
+  }
+
+  /// true for terminals that exprio cannot write
+  struct IsOpaqueTerminal : public std::unary_function<Expr, bool>
+  {
+    bool operator() (Expr e)
+    {
+      return e->arity () == 0 &&
+        !exprio::detail::TerminalCodec::id (e->op ()) &&
+        !OpRegistry::get ().id (e->op ());
+    }
+  };
+
+  /// A strongly connected component of the call graph of the database
+  struct HoudiniTask
+  {
+    /// relations of the component
+    ExprVector rels;
+    /// rules whose head is in the component
+    std::vector<const HornRule*> rules;
+    /// components that use the relations of this one
+    std::vector<unsigned> succs;
+    /// number of unfinished components this one uses
+    unsigned preds;
+    HoudiniTask() : preds(0) {}
+  };
+
+  /// Runs Houdini on the components of the call graph in
+  /// topological order. A component is ready once every component it
+  /// uses reached a fixpoint, since the candidates of its relations
+  /// are then final. Every worker has a queue of ready components
+  /// and steals from the others when its own queue is empty
+  class HoudiniScheduler
+  {
+    /// read by every worker
+    const HornClauseDBSnapshot &m_db;
+    ExprFactory &m_efac;
+    HornDbModel &m_model;
+    std::vector<HoudiniTask> &m_tasks;
+
+    /// protects m_model, m_ready, m_left and the preds of tasks
+    std::mutex m_lock;
+    std::condition_variable m_cv;
+    std::vector<std::deque<unsigned> > m_ready;
+    unsigned m_left;
+    unsigned m_steals;
+    /// weakening rounds and lemmas they dropped, over all tasks
+    unsigned m_rounds;
+    unsigned m_dropped;
+
+    bool next(unsigned w, unsigned &task)
+    {
+      std::unique_lock<std::mutex> l(m_lock);
+      while(true)
+      {
+        if(!m_ready[w].empty())
+        {
+          task = m_ready[w].front();
+          m_ready[w].pop_front();
+          return true;
+        }
+        for(unsigned i = 1; i < m_ready.size(); i++)
+        {
+          std::deque<unsigned> &q = m_ready[(w + i) % m_ready.size()];
+          if(q.empty()) continue;
+          task = q.back();
+          q.pop_back();
+          ++m_steals;
+          return true;
+        }
+        if(m_left == 0) return false;
+        m_cv.wait(l);
+      }
+    }
+
+    /// copies the candidates of the relations used by task from the
+    /// global model
+    void import(const HoudiniTask &task, HornDbModel &local)
+    {
+      ExprSet rels(task.rels.begin(), task.rels.end());
+      for(const HornRule *r : task.rules)
+      {
+        ExprVector apps;
+        r->pred_apps(m_db, std::back_inserter(apps));
+        for(Expr app : apps) rels.insert(bind::fname(app));
+      }
+      std::lock_guard<std::mutex> l(m_lock);
+      for(Expr rel : rels)
+      {
+        Expr app = relApp(rel);
+        local.addDef(app, m_model.getDef(app));
+      }
+    }
+
+    /// publishes the candidates of task and readies its successors
+    void done(unsigned w, const HoudiniTask &task, HornDbModel &local,
+              unsigned rounds, unsigned dropped)
+    {
+      std::lock_guard<std::mutex> l(m_lock);
+      m_rounds += rounds;
+      m_dropped += dropped;
+      for(Expr rel : task.rels)
+      {
+        Expr app = relApp(rel);
+        m_model.addDef(app, local.getDef(app));
+      }
+      for(unsigned s : task.succs)
+        if(--m_tasks[s].preds == 0) m_ready[w].push_back(s);
+      --m_left;
+      m_cv.notify_all();
+    }
+
+    /// the Each_Solver_Per_Rule strategy, restricted to the rules
+    /// of the component. The candidates are weakened in local
+    void runTask(const HoudiniTask &task, EZ3 &z3, HornDbModel &local,
+                 unsigned &rounds, unsigned &dropped)
+    {
+      import(task, local);
+      std::map<Expr, std::shared_ptr<DagVisitMemo> > memos;
+
+      // -- rules of the component that use each of its relations
+      std::map<Expr, std::vector<unsigned> > users;
+      ExprSet rels(task.rels.begin(), task.rels.end());
+      std::vector<ZSolverPool<EZ3>::Lease> solvers;
+      for(unsigned i = 0; i < task.rules.size(); i++)
+      {
+        const HornRule &r = *task.rules[i];
+        ExprVector apps;
+        r.pred_apps(m_db, std::back_inserter(apps));
+        for(Expr app : apps)
+          if(rels.count(bind::fname(app))) users[bind::fname(app)].push_back(i);
+
+        ZSolverPool<EZ3>::Lease solver = z3.solverPool().acquire();
+        solver->assertExpr(extractTransitionRelation(r, m_db));
+        solver->push();
+        solvers.push_back(std::move(solver));
+      }
+
+      std::deque<unsigned> workList;
+      std::vector<bool> queued(task.rules.size(), true);
+      for(unsigned i = task.rules.size(); i-- > 0;) workList.push_back(i);
+
+      while(!workList.empty())
+      {
+        unsigned i = workList.front();
+        workList.pop_front();
+        queued[i] = false;
+        const HornRule &r = *task.rules[i];
+        ZSolver<EZ3> &solver = *solvers[i];
+
+        while(true)
+        {
+          solver.assertExpr(mk<NEG>(local.getDef(r.head())));
+          ExprVector apps;
+          r.pred_apps(m_db, std::back_inserter(apps));
+          for(Expr app : apps) solver.assertExpr(local.getDef(app));
+          boost::tribool sat;
+          {
+            static ufo::StatsSampleTimer &t = Stats::sampleTimer ("HoudiniCheck");
+            ufo::ScopedSample _s_(t);
+            ufo::ScopedTrace _t_("houdini check", "houdini");
+            sat = solver.solveCached(true);
+          }
+          if(!sat) break;
+
+          for(unsigned j : users[bind::fname(r.head())])
+            if(!queued[j] && j != i)
+            {
+              queued[j] = true;
+              workList.push_back(j);
+            }
+          ZModel<EZ3> m = solver.getModel();
+          std::shared_ptr<DagVisitMemo> &memo = memos[r.head()];
+          if(!memo) memo = std::make_shared<DagVisitMemo>(r.head()->efac());
+          dropped += weakenCand(local, r.head(), *memo, m);
+          ++rounds;
+          // -- further models of the same check, each falsifying a
+          // -- lemma that is kept. The scope is popped below
+          for(unsigned k = 1; BatchWeaken && k < BatchModels; ++k)
+          {
+            if(isOpX<TRUE>(local.getDef(r.head()))) break;
+            solver.assertExpr(mk<NEG>(local.getDef(r.head())));
+            boost::tribool more = solver.solve();
+            if(!more || boost::indeterminate(more)) break;
+            ZModel<EZ3> m2 = solver.getModel();
+            unsigned d = weakenCand(local, r.head(), *memo, m2, false);
+            if(d == 0) break;
+            dropped += d;
+          }
+          solver.pop();
+          solver.push();
+        }
+        solver.pop();
+        solver.push();
+      }
+    }
+
+    void work(unsigned w)
+    {
+      if(ufo::Trace::enabled())
+        ufo::Trace::threadName("houdini worker " + std::to_string(w));
+      EZ3 z3(m_efac);
+      unsigned t;
+      // -- the gaps between components on the timeline are the time
+      // -- the worker waited for work
+      while(next(w, t))
+      {
+        HornDbModel local;
+        unsigned rounds = 0, dropped = 0;
+        try
+        {
+          ufo::ScopedTrace _t_("houdini component", "houdini");
+          runTask(m_tasks[t], z3, local, rounds, dropped);
+        }
+        catch(z3::exception &e)
+        {
+          // -- giving up on the component is sound
+          for(Expr rel : m_tasks[t].rels)
+            local.addDef(relApp(rel), mk<TRUE>(rel->efac()));
+        }
+        done(w, m_tasks[t], local, rounds, dropped);
+      }
+    }
+
+  public:
+    HoudiniScheduler(const HornClauseDBSnapshot &db, ExprFactory &efac, HornDbModel &model,
+                     std::vector<HoudiniTask> &tasks) :
+      m_db(db), m_efac(efac), m_model(model), m_tasks(tasks), m_left(tasks.size()), m_steals(0),
+      m_rounds(0), m_dropped(0) {}
+
+    void run(unsigned threads)
+    {
+      threads = std::max(1u, std::min<unsigned>(threads, m_tasks.size()));
+      m_ready.resize(threads);
+      unsigned w = 0;
+      for(unsigned t = 0; t < m_tasks.size(); t++)
+        if(m_tasks[t].preds == 0) m_ready[w++ % threads].push_back(t);
+
+      std::vector<std::thread> workers;
+      for(unsigned i = 0; i < threads; i++)
+        workers.push_back(std::thread(&HoudiniScheduler::work, this, i));
+      for(std::thread &t : workers) t.join();
+
+      Stats::uset("HoudiniWorkers", threads);
+      Stats::uset("HoudiniComponents", m_tasks.size());
+      Stats::uset("HoudiniSteals", m_steals);
+      Stats::uset("HoudiniRounds", m_rounds);
+      Stats::uset("HoudiniDropped", m_dropped);
+    }
+  };
+  }
+
+  /*HoudiniCandidates methods begin*/
+
+  HoudiniCandidates::Rel &HoudiniCandidates::rel(Expr fdecl)
+  {
+	  auto it = m_rels.find(fdecl);
+	  if(it != m_rels.end()) return it->second;
+
+	  assert(m_model);
+	  Rel &r = m_rels[fdecl];
+	  Expr app = relApp(fdecl);
+	  ExprVector &lemmas = r.insts[app];
+	  candLemmas(m_model->getDef(app), lemmas);
+	  r.alive.resize(lemmas.size(), true);
+	  return r;
+  }
+
+  const ExprVector &HoudiniCandidates::lemmas(Expr app)
+  {
+	  Rel &r = rel(bind::fname(app));
+	  auto it = r.insts.find(app);
+	  if(it != r.insts.end()) return it->second;
+
+	  // -- from the lemmas at the bound variables, so that the
+	  // -- model can be updated meanwhile
+	  Expr base = relApp(bind::fname(app));
+	  const ExprVector &all = r.insts[base];
+	  ExprMap sub;
+	  for(unsigned i = 0; i + 1 < app->arity(); i++)
+		  sub[base->arg(i + 1)] = app->arg(i + 1);
+	  DagVisitMemo memo(app->efac());
+	  ExprVector lemmas;
+	  lemmas.reserve(all.size());
+	  for(Expr l : all) lemmas.push_back(replace(l, sub, memo));
+	  // -- inserting app may move the lemmas of base
+	  ExprVector &res = r.insts[app];
+	  res.swap(lemmas);
+	  return res;
+  }
+
+  Expr HoudiniCandidates::conj(Expr app)
+  {
+	  const ExprVector &all = lemmas(app);
+	  const llvm::BitVector &alive = rel(bind::fname(app)).alive;
+	  ExprVector kept;
+	  kept.reserve(alive.count());
+	  for(int i = alive.find_first(); i >= 0; i = alive.find_next(i))
+		  kept.push_back(all[i]);
+	  return mknary<AND>(mk<TRUE>(app->efac()), kept);
+  }
+
+  unsigned HoudiniCandidates::weaken(Expr app, ZModel<EZ3> &m, bool batch, bool guess)
+  {
+	  const ExprVector &all = lemmas(app);
+	  llvm::BitVector &alive = rel(bind::fname(app)).alive;
+	  unsigned dropped = 0;
+	  for(int i = alive.find_first(); i >= 0; i = alive.find_next(i))
+	  {
+		  LOG("houdini", errs() << "EVAL: " << *(m.eval(all[i])) << "\n";);
+		  if(!isOpX<FALSE>(m.eval(all[i]))) continue;
+		  alive.reset(i);
+		  dropped++;
+		  if(!batch) break;
+	  }
+
+	  // This condition can be reached only when the solver answers Indeterminate
+	  // In this case, we remove an arbitrary lemma (the first one)
+	  if(dropped == 0 && guess && alive.any())
+	  {
+		  LOG("houdini", errs() << "INDETERMINATE REACHED" << "\n");
+		  alive.reset(alive.find_first());
+		  dropped++;
+	  }
+	  return dropped;
+  }
+
+  void HoudiniCandidates::update()
+  {
+	  assert(m_model);
+	  for(auto &kv : m_rels)
+	  {
+		  Expr rel = kv.first;
+		  const ExprVector &all = kv.second.insts[relApp(rel)];
+		  const llvm::BitVector &alive = kv.second.alive;
+		  ExprVector kept;
+		  for(int i = alive.find_first(); i >= 0; i = alive.find_next(i))
+			  kept.push_back(all[i]);
+		  m_model->addDef(relApp(rel), mknary<AND>(mk<TRUE>(rel->efac()), kept));
+	  }
+  }
 
   /*HoudiniPass methods begin*/
 
@@ -36,15 +548,39 @@ namespace seahorn
   {
     HornifyModule &hm = getAnalysis<HornifyModule> ();
 
-    //Use commandline option to replace it.
-    int config = EACH_RULE_A_SOLVER;
+    int config = HoudiniStrategy;
 
     Stats::resume ("Houdini inv");
     Houdini houdini(hm);
     houdini.guessCandidates(hm.getHornClauseDB());
-    houdini.runHoudini(config);
+    if (!HoudiniInvs.empty())
+      Stats::uset("HoudiniWarmRelations", houdini.loadCandidates(HoudiniInvs));
+    // -- a checkpoint only has candidates that are left of the guesses
+    if (HornCheckpoint::resume())
+      Stats::uset("HoudiniResumedRelations",
+                  houdini.loadCandidates(HornCheckpoint::file("houdini")));
+    houdini.setCheckpoint("houdini");
+    if (PositiveSamples > 0)
+    {
+      std::map<Expr, ExprVector> relationToPositiveStateMap;
+      houdini.generatePositiveWitness(relationToPositiveStateMap, PositiveSamples);
+    }
+    if (hm.getThreads() > 1 && hm.getExprFactory().isConcurrent())
+      houdini.runHoudiniParallel(hm.getThreads());
+    else
+      houdini.runHoudini(config);
+    if (!HoudiniInvs.empty() && !houdini.saveInvariants(HoudiniInvs))
+      errs () << "WARNING: cannot write Houdini invariants " << HoudiniInvs << "\n";
     Stats::stop ("Houdini inv");
 
+    // -- the invariants are inductive, they need not be safe
+    if (HornModelValidator::enabled ())
+    {
+      HornModelValidator validator;
+      validator.report (validator.validate (hm.getHornClauseDB(), houdini.getCandidateModel(),
+                                            hm.getThreads(), false), errs ());
+    }
+
     return false;
   }
 
@@ -74,7 +610,16 @@ namespace seahorn
 		  Expr cand_app = m_candidate_model.getDef(fapp);
 		  LOG("candidates", errs() << "HEAD: " << *fapp << "\n";);
 		  LOG("candidates", errs() << "CAND: " << *cand_app << "\n";);
-		  if(!isOpX<TRUE>(cand_app))
+		  if(isOpX<TRUE>(cand_app)) continue;
+		  // -- as lemmas, the relations stay free of constraints, so
+		  // -- that the solver may still slice and inline them
+		  if(HoudiniLemmas)
+		  {
+			  LOG("candidates", errs() << "ADD LEMMA\n";);
+			  m_hm.getLemmaQueue().push(fapp, cand_app);
+			  Stats::count("HoudiniLemmas");
+		  }
+		  else
 		  {
 			  LOG("candidates", errs() << "ADD CONSTRAINT\n";);
 			  db.addConstraint(fapp, cand_app);
@@ -86,7 +631,7 @@ namespace seahorn
 //			Expr rhead_app = r.head();
 //			Expr rhead_cand_app = m_candidate_model.getDef(rhead_app);
 //			LOG("candidates", errs() << "HEAD: " << *rhead_app << "\n";);
-//			LOG("candidates", errs() << "CAND: " << *rhead_cand_app << "\n";);
+//			LOG("candidates", errs() << "CAND: " << dag(rhead_cand_app) << "\n";);
 //			if(!isOpX<TRUE>(rhead_cand_app))
 //			{
 //				LOG("candidates", errs() << "ADD CONSTRAINT\n";);
@@ -121,16 +666,107 @@ namespace seahorn
 		  {
 			  cand = mknary<AND>(lemmas.begin(), lemmas.end());
 		  }
-		  Expr cand_app = replace(cand, bvarToArgMap);
+		  // -- the map only depends on the domain so the memo is shared by all relations
+		  Expr cand_app = replace(cand, bvarToArgMap, m_bvarToArgMemo);
 
 		  m_candidate_model.addDef(fapp, cand_app);
 	  }
   }
 
+  unsigned Houdini::loadCandidates(const std::string &fname)
+  {
+	  auto &db = m_hm.getHornClauseDB();
+	  ExprVector roots;
+	  if(!exprio::load(fname, db.getExprFactory(), std::back_inserter(roots))) return 0;
+
+	  // -- read everything before changing the candidates
+	  std::map<Expr, ExprVector> keyToLemmas;
+	  size_t pos = 0;
+	  auto count = [&](unsigned &n)
+	  {
+		  if(pos >= roots.size() || !isOpX<UINT>(roots[pos])) return false;
+		  n = getTerm<unsigned>(roots[pos++]);
+		  return n <= roots.size() - pos;
+	  };
+	  unsigned n;
+	  if(!count(n)) return 0;
+	  for(unsigned i = 0; i < n; i++)
+	  {
+		  if(pos >= roots.size()) return 0;
+		  Expr key = roots[pos++];
+		  unsigned nlemmas;
+		  if(!bind::isFdecl(key) || !count(nlemmas)) return 0;
+		  ExprVector &lemmas = keyToLemmas[key];
+		  lemmas.insert(lemmas.end(), roots.begin() + pos, roots.begin() + pos + nlemmas);
+		  pos += nlemmas;
+	  }
+
+	  // -- lemmas that are no longer invariants, e.g., because the
+	  // -- code of the relation changed, are dropped by Houdini
+	  unsigned loaded = 0;
+	  for(Expr rel : db.getRelations())
+	  {
+		  auto it = keyToLemmas.find(relKey(rel));
+		  if(it == keyToLemmas.end()) continue;
+		  m_candidate_model.addDef(relApp(rel), mknary<AND>(mk<TRUE>(rel->efac()), it->second));
+		  loaded++;
+	  }
+	  return loaded;
+  }
+
+  bool Houdini::saveInvariants(const std::string &fname)
+  {
+	  auto &db = m_hm.getHornClauseDB();
+	  ExprFactory &efac = db.getExprFactory();
+	  ExprVector entries;
+	  unsigned n = 0;
+	  for(Expr rel : db.getRelations())
+	  {
+		  ExprVector lemmas;
+		  candLemmas(m_candidate_model.getDef(relApp(rel)), lemmas);
+		  lemmas.erase(std::remove_if(lemmas.begin(), lemmas.end(), [](Expr l)
+		  {
+			  ExprVector opaque;
+			  filter(l, IsOpaqueTerminal(), std::back_inserter(opaque));
+			  return !opaque.empty();
+		  }), lemmas.end());
+		  if(lemmas.empty()) continue;
+
+		  entries.push_back(relKey(rel));
+		  entries.push_back(mkTerm<unsigned>(lemmas.size(), efac));
+		  entries.insert(entries.end(), lemmas.begin(), lemmas.end());
+		  n++;
+	  }
+	  ExprVector roots;
+	  roots.push_back(mkTerm<unsigned>(n, efac));
+	  roots.insert(roots.end(), entries.begin(), entries.end());
+
+	  // -- write to a temporary file first so that a concurrent run
+	  // -- never reads a partial file
+	  std::string tmp = fname + ".tmp" + boost::lexical_cast<std::string>(::getpid());
+	  if(!exprio::save(tmp, roots))
+	  {
+		  std::remove(tmp.c_str());
+		  return false;
+	  }
+	  return std::rename(tmp.c_str(), fname.c_str()) == 0;
+  }
+
+  void Houdini::checkpoint()
+  {
+	  if(m_checkpoint.empty() || !HornCheckpoint::due(m_lastCheckpoint)) return;
+	  if(m_cands.active()) m_cands.update();
+	  if(saveInvariants(HornCheckpoint::file(m_checkpoint)))
+		  Stats::count("HoudiniCheckpoints");
+	  else
+		  errs() << "WARNING: cannot write checkpoint "
+		         << HornCheckpoint::file(m_checkpoint) << "\n";
+  }
+
   /*
    * Main loop of Houdini algorithm
    */
-  void Houdini::runHoudini(int config)
+  bool Houdini::runHoudini(int config)
   {
 	  //load the Horn clause database
 	  auto &db = m_hm.getHornClauseDB ();
@@ -141,10 +777,6 @@ namespace seahorn
 	  HornClauseDBWto db_wto(callgraph);
 	  db_wto.buildWto();
 
-	  //generate positive states
-	  std::map<Expr, ExprVector> relationToPositiveStateMap;
-	  //generatePositiveWitness(relationToPositiveStateMap, db, hm);
-
 //	  LOG("houdini", errs() << "CAND MAP:\n";);
 //	  LOG("houdini", errs() << "MAP SIZE: " << m_candidate_model.m_defs.size() << "\n";);
 //	  for(std::map<Expr, Expr>::iterator it = m_candidate_model.m_defs.begin(); it!= m_candidate_model.m_defs.end(); ++it)
@@ -157,6 +789,7 @@ namespace seahorn
 	  workList.insert(workList.end(), db.getRules().begin(), db.getRules().end());
 	  workList.reverse();
 
+	  m_cands.init(m_candidate_model);
 	  if (config == EACH_RULE_A_SOLVER)
 	  {
 		  Houdini_Each_Solver_Per_Rule houdini_solver_per_rule(*this, db_wto, workList);
@@ -172,51 +805,124 @@ namespace seahorn
 		  Houdini_Naive houdini_naive(*this, db_wto, workList);
 		  houdini_naive.run();
 	  }
+	  else if (config == ASSUMPTIONS)
+	  {
+		  Houdini_Assumptions houdini_assumptions(*this, db_wto, workList);
+		  houdini_assumptions.run();
+	  }
+	  // -- the candidates are not inductive until the worklist is empty
+	  if(!workList.empty())
+	  {
+		  m_cands.clear();
+		  Stats::count("HoudiniGaveUp");
+		  return false;
+	  }
+	  m_cands.update();
+	  m_cands.clear();
+
+	  Stats::uset("HoudiniRounds", m_rounds);
+	  Stats::uset("HoudiniDropped", m_dropped);
+
+	  addInvarCandsToProgramSolver();
+	  return true;
+  }
+
+  void Houdini::runHoudiniParallel(unsigned threads)
+  {
+	  auto &db = m_hm.getHornClauseDB ();
+	  assert(db.getExprFactory().isConcurrent());
+
+	  HornRelGraph graph(db);
+	  std::vector<unsigned> scc;
+	  graph.sccs(scc);
+
+	  // -- one task per component of the call graph
+	  std::map<unsigned, unsigned> sccToTask;
+	  std::vector<HoudiniTask> tasks;
+	  for(HornRelGraph::RelId i = 0; i < graph.size(); ++i)
+	  {
+		  auto it = sccToTask.insert(std::make_pair(scc[i], tasks.size()));
+		  if(it.second) tasks.push_back(HoudiniTask());
+		  tasks[it.first->second].rels.push_back(graph.rel(i));
+	  }
+	  // -- the workers share a snapshot of db, which needs no locks
+	  HornClauseDBSnapshot::Ptr snap = HornClauseDBSnapshot::make(db);
+	  snap->forEachRule([&](HornClauseDB::RuleId, const HornRule &r)
+	    { tasks[sccToTask[scc[graph.id(bind::fname(r.head()))]]].rules.push_back(&r); });
+
+	  std::set<std::pair<unsigned, unsigned> > edges;
+	  for(HornRelGraph::RelId i = 0; i < graph.size(); ++i)
+	  {
+		  unsigned src = sccToTask[scc[i]];
+		  for(const HornRelGraph::Edge &e : graph.succs(i))
+		  {
+			  unsigned dst = sccToTask[scc[e.rel]];
+			  if(src == dst || !edges.insert(std::make_pair(src, dst)).second) continue;
+			  tasks[src].succs.push_back(dst);
+			  tasks[dst].preds++;
+		  }
+	  }
+
+	  HoudiniScheduler scheduler(*snap, db.getExprFactory(), m_candidate_model, tasks);
+	  scheduler.run(threads);
 
 	  addInvarCandsToProgramSolver();
   }
 
   void Houdini_Naive::run()
   {
-  	  while(!m_workList.empty())
+  	  while(!m_workList.empty() && !m_houdini.expired())
   	  {
   		  LOG("houdini", errs() << "WORKLIST SIZE: " << m_workList.size() << "\n";);
+  		  m_houdini.checkpoint();
   		  HornRule r = m_workList.front();
   		  m_workList.pop_front();
   		  LOG("houdini", errs() << "RULE HEAD: " << *(r.head()) << "\n";);
-  		  LOG("houdini", errs() << "RULE BODY: " << *(r.body()) << "\n";);
-  		  while (validateRule(r, m_solver) != UNSAT)
+  		  LOG("houdini", errs() << "RULE BODY: " << dag(r.body()) << "\n";);
+  		  while (validateRule(r, *m_solver) != UNSAT)
   		  {
   			  addUsedRulesBackToWorkList(m_db_wto, m_workList, r);
-  			  ZModel<EZ3> m = m_solver.getModel();
-  			  weakenRuleHeadCand(r, m);
+  			  ZModel<EZ3> m = m_solver->getModel();
+  			  weakenRuleHeadCand(r, *m_solver, m);
   		  }
   	  }
   }
 
   bool Houdini_Naive::validateRule(HornRule r, ZSolver<EZ3> &solver)
   {
-	  solver.reset();
+	  // -- the leased solver has a single scope, popping it is
+	  // -- cheaper than a reset
+	  solver.pop();
+	  solver.push();
 
 	  auto &m_hm = m_houdini.getHornifyModule();
 	  auto &db = m_hm.getHornClauseDB();
 
-	  Expr ruleHead_cand_app = m_houdini.getCandidateModel().getDef(r.head());
+	  Expr ruleHead_cand_app = m_houdini.getCandidates().conj(r.head());
 	  Expr neg_ruleHead_cand_app = mk<NEG>(ruleHead_cand_app);
 	  solver.assertExpr(neg_ruleHead_cand_app);
 
-	  Expr ruleBody = r.body();
 	  ExprVector body_pred_apps;
-	  get_all_pred_apps(ruleBody, db, std::back_inserter(body_pred_apps));
+	  r.pred_apps(db, std::back_inserter(body_pred_apps));
 	  for(Expr body_app : body_pred_apps)
 	  {
-		  solver.assertExpr(m_houdini.getCandidateModel().getDef(body_app)); //add each body predicate app
+		  solver.assertExpr(m_houdini.getCandidates().conj(body_app)); //add each body predicate app
 	  }
 
-	  solver.assertExpr(extractTransitionRelation(r, db));
+	  // -- the transition relation is re-asserted after every reset,
+	  // -- keep it marshaled
+	  Expr tr = extractTransitionRelation(r, db);
+	  solver.getContext().pinAst(tr);
+	  solver.assertExpr(tr);
 
 	  //solver.toSmtLib(errs());
-	  boost::tribool isSat = solver.solve();
+	  static ufo::StatsSampleTimer &t = Stats::sampleTimer ("HoudiniCheck");
+	  boost::tribool isSat;
+	  {
+	    ufo::ScopedSample _s_(t);
+	    ufo::ScopedTrace _t_("houdini check", "houdini");
+	    isSat = solver.solveCached(true);
+	  }
 	  if(isSat)
 	  {
 		  LOG("houdini", errs() << "SAT\n";);
@@ -236,23 +942,24 @@ namespace seahorn
 
   void Houdini_Each_Solver_Per_Rule::run()
   {
-	  while(!m_workList.empty())
+	  while(!m_workList.empty() && !m_houdini.expired())
 	  {
 		  LOG("houdini", errs() << "WORKLIST SIZE: " << m_workList.size() << "\n";);
+		  m_houdini.checkpoint();
 		  HornRule r = m_workList.front();
 		  m_workList.pop_front();
 		  LOG("houdini", errs() << "RULE HEAD: " << *(r.head()) << "\n";);
-		  LOG("houdini", errs() << "RULE BODY: " << *(r.body()) << "\n";);
+		  LOG("houdini", errs() << "RULE BODY: " << dag(r.body()) << "\n";);
 
 		  assert(m_ruleToSolverMap.find(r) != m_ruleToSolverMap.end());
 
-		  ZSolver<EZ3> &solver = m_ruleToSolverMap.find(r)->second;
+		  ZSolver<EZ3> &solver = *m_ruleToSolverMap.find(r)->second;
 
 		  while (validateRule(r, solver) != UNSAT)
 		  {
 			  addUsedRulesBackToWorkList(m_db_wto, m_workList, r);
 			  ZModel<EZ3> m = solver.getModel();
-			  weakenRuleHeadCand(r, m);
+			  weakenRuleHeadCand(r, solver, m);
 			  solver.pop();
 			  solver.push();
 			  //LOG("houdini", errs() << "AFTER POP: \n";);
@@ -273,27 +980,26 @@ namespace seahorn
   		  Expr rhead_app = r.head();
   		  Expr rhead_cand_app = fAppToCandApp(rhead_app);
   		  LOG("houdini", errs() << "HEAD: " << *rhead_app << "\n";);
-  		  LOG("houdini", errs() << "CAND: " << *rhead_cand_app << "\n";);
+  		  LOG("houdini", errs() << "CAND: " << dag(rhead_cand_app) << "\n";);
   	  }*/
   	  ////////////////////////////////////////
 	  auto &m_hm = m_houdini.getHornifyModule();
 	  auto &db = m_hm.getHornClauseDB();
 
-	  Expr ruleHead_cand_app = m_houdini.getCandidateModel().getDef(r.head());
+	  Expr ruleHead_cand_app = m_houdini.getCandidates().conj(r.head());
   	  Expr neg_ruleHead_cand_app = mk<NEG>(ruleHead_cand_app);
   	  solver.assertExpr(neg_ruleHead_cand_app);
 
-  	  Expr ruleBody = r.body();
   	  ExprVector body_pred_apps;
-  	  get_all_pred_apps(ruleBody, db, std::back_inserter(body_pred_apps));
+  	  r.pred_apps(db, std::back_inserter(body_pred_apps));
   	  for(Expr body_app : body_pred_apps)
 	  {
-		  solver.assertExpr(m_houdini.getCandidateModel().getDef(body_app)); //add each body predicate app
+		  solver.assertExpr(m_houdini.getCandidates().conj(body_app)); //add each body predicate app
 	  }
 
   	  //LOG("houdini", errs() << "AFTER PUSH: \n";);
   	  //solver.toSmtLib(errs());
-  	  boost::tribool isSat = solver.solve();
+  	  boost::tribool isSat = solver.solveCached(true);
   	  if(isSat)
   	  {
   		  LOG("houdini", errs() << "SAT\n";);
@@ -311,43 +1017,44 @@ namespace seahorn
   	  }
   }
 
-  std::map<HornRule, ZSolver<EZ3>> Houdini_Each_Solver_Per_Rule::assignEachRuleASolver()
+  std::map<HornRule, ZSolverPool<EZ3>::Lease> Houdini_Each_Solver_Per_Rule::assignEachRuleASolver()
   {
 	  auto &m_hm = m_houdini.getHornifyModule();
 	  auto &db = m_hm.getHornClauseDB();
-  	  std::map<HornRule, ZSolver<EZ3>> ruleToSolverMap;
+  	  std::map<HornRule, ZSolverPool<EZ3>::Lease> ruleToSolverMap;
   	  for(HornClauseDB::RuleVector::iterator it = db.getRules().begin(); it != db.getRules().end(); ++it)
   	  {
   		  HornRule r = *it;
   		  Expr tr = extractTransitionRelation(r, db);
-  		  ZSolver<EZ3> solver(m_hm.getZContext());
-  		  solver.assertExpr(tr);
-  		  solver.push();
+  		  ZSolverPool<EZ3>::Lease solver = m_hm.getZContext().solverPool().acquire();
+  		  solver->assertExpr(tr);
+  		  solver->push();
 
-  		  ruleToSolverMap.insert(std::make_pair(r, solver));
+  		  ruleToSolverMap.insert(std::make_pair(r, std::move(solver)));
   	  }
   	  return ruleToSolverMap;
   }
 
   void Houdini_Each_Solver_Per_Relation::run()
   {
-	  while(!m_workList.empty())
+	  while(!m_workList.empty() && !m_houdini.expired())
 	  {
 		  LOG("houdini", errs() << "WORKLIST SIZE: " << m_workList.size() << "\n";);
+		  m_houdini.checkpoint();
 		  HornRule r = m_workList.front();
 		  m_workList.pop_front();
 		  LOG("houdini", errs() << "RULE HEAD: " << *(r.head()) << "\n";);
-		  LOG("houdini", errs() << "RULE BODY: " << *(r.body()) << "\n";);
+		  LOG("houdini", errs() << "RULE BODY: " << dag(r.body()) << "\n";);
 
 		  assert(m_relationToSolverMap.find(r.head()) != m_relationToSolverMap.end());
 
-		  ZSolver<EZ3> &solver = m_relationToSolverMap.find(r.head())->second;
+		  ZSolver<EZ3> &solver = *m_relationToSolverMap.find(r.head())->second;
 
 		  while (validateRule(r, solver) != UNSAT)
 		  {
 			  addUsedRulesBackToWorkList(m_db_wto, m_workList, r);
 			  ZModel<EZ3> m = solver.getModel();
-			  weakenRuleHeadCand(r, m);
+			  weakenRuleHeadCand(r, solver, m);
 			  solver.pop();
 			  solver.push();
 			  //LOG("houdini", errs() << "AFTER POP: \n";);
@@ -376,21 +1083,20 @@ namespace seahorn
 		  }
 	  }
 
-	  Expr ruleHead_cand_app = m_houdini.getCandidateModel().getDef(r.head());
+	  Expr ruleHead_cand_app = m_houdini.getCandidates().conj(r.head());
   	  Expr neg_ruleHead_cand_app = mk<NEG>(ruleHead_cand_app);
   	  solver.assertExpr(neg_ruleHead_cand_app);
 
-  	  Expr ruleBody = r.body();
   	  ExprVector body_pred_apps;
-  	  get_all_pred_apps(ruleBody, db, std::back_inserter(body_pred_apps));
+  	  r.pred_apps(db, std::back_inserter(body_pred_apps));
   	  for(Expr body_app : body_pred_apps)
 	  {
-		  solver.assertExpr(m_houdini.getCandidateModel().getDef(body_app)); //add each body predicate app
+		  solver.assertExpr(m_houdini.getCandidates().conj(body_app)); //add each body predicate app
 	  }
 
   	  //LOG("houdini", errs() << "AFTER PUSH: \n";);
   	  //solver.toSmtLib(errs());
-  	  boost::tribool isSat = solver.solve();
+  	  boost::tribool isSat = solver.solveCached(true);
   	  if(isSat)
   	  {
   		  LOG("houdini", errs() << "SAT\n";);
@@ -408,103 +1114,182 @@ namespace seahorn
   	  }
   }
 
-  std::map<Expr, ZSolver<EZ3>> Houdini_Each_Solver_Per_Relation::assignEachRelationASolver()
+  std::map<Expr, ZSolverPool<EZ3>::Lease> Houdini_Each_Solver_Per_Relation::assignEachRelationASolver()
   {
 	  auto &m_hm = m_houdini.getHornifyModule();
 	  auto &db = m_hm.getHornClauseDB();
-  	  std::map<Expr, ZSolver<EZ3>> relationToSolverMap;
+  	  std::map<Expr, ZSolverPool<EZ3>::Lease> relationToSolverMap;
   	  for(HornClauseDB::RuleVector::iterator it = db.getRules().begin(); it != db.getRules().end(); ++it)
   	  {
   		  HornRule r = *it;
   		  Expr ruleHead = r.head();
   		  if(relationToSolverMap.find(ruleHead) != relationToSolverMap.end())
   		  {
-  			  ZSolver<EZ3> &solver = relationToSolverMap.find(ruleHead)->second;
+  			  ZSolver<EZ3> &solver = *relationToSolverMap.find(ruleHead)->second;
   			  Expr var = bind::boolVar(mkTerm<std::string>(std::string("tag2"), ruleHead->efac()));
   			  solver.assertExpr(mk<IMPL>(var, extractTransitionRelation(r, db)));
   			  solver.push();
   		  }
   		  else
   		  {
-  			  ZSolver<EZ3> solver(m_hm.getZContext());
+  			  ZSolverPool<EZ3>::Lease solver = m_hm.getZContext().solverPool().acquire();
   			  Expr tagVar = bind::boolVar(mkTerm<std::string>(std::string("tag"), ruleHead->efac()));
-  			  solver.assertExpr(mk<IMPL>(tagVar, extractTransitionRelation(r, db)));
-  			  solver.push();
-  			  relationToSolverMap.insert(std::make_pair(ruleHead, solver));
+  			  solver->assertExpr(mk<IMPL>(tagVar, extractTransitionRelation(r, db)));
+  			  solver->push();
+  			  relationToSolverMap.insert(std::make_pair(ruleHead, std::move(solver)));
   		  }
   	  }
   	  return relationToSolverMap;
   }
 
-  /*
-   * Given a rule, weaken its head's candidate
-   */
-  void HoudiniContext::weakenRuleHeadCand(HornRule r, ZModel<EZ3> m)
+  void Houdini_Assumptions::run()
   {
-	  Expr ruleHead_app = r.head();
-	  Expr ruleHead_cand_app = m_houdini.getCandidateModel().getDef(ruleHead_app);
+	  while(!m_workList.empty() && !m_houdini.expired())
+	  {
+		  LOG("houdini", errs() << "WORKLIST SIZE: " << m_workList.size() << "\n";);
+		  m_houdini.checkpoint();
+		  HornRule r = m_workList.front();
+		  m_workList.pop_front();
+		  LOG("houdini", errs() << "RULE HEAD: " << *(r.head()) << "\n";);
+		  LOG("houdini", errs() << "RULE BODY: " << dag(r.body()) << "\n";);
 
-	  LOG("houdini", errs() << "HEAD CAND APP: " << *ruleHead_cand_app << "\n";);
+		  assert(m_ruleToSolverMap.find(r) != m_ruleToSolverMap.end());
 
-	  if(isOpX<TRUE>(ruleHead_cand_app))
+		  ZSolver<EZ3> &solver = *m_ruleToSolverMap.find(r)->second;
+
+		  // -- nothing stays asserted after weakening, the solver is never reset
+		  while (validateRule(r, solver) != UNSAT)
+		  {
+			  addUsedRulesBackToWorkList(m_db_wto, m_workList, r);
+			  ZModel<EZ3> m = solver.getModel();
+			  // -- further models are checked under the same indicators
+			  ExprVector assumptions;
+			  for(Expr rel : m_ruleRels[r]) addAssumptions(rel, assumptions);
+			  weakenRuleHeadCand(r, solver, m, assumptions);
+		  }
+	  }
+  }
+
+  bool Houdini_Assumptions::validateRule(HornRule r, ZSolver<EZ3> &solver)
+  {
+	  ExprVector assumptions;
+	  for(Expr rel : m_ruleRels[r]) addAssumptions(rel, assumptions);
+
+	  boost::tribool isSat = solver.solveAssuming(assumptions);
+	  if(isSat)
 	  {
-			return;
+		  LOG("houdini", errs() << "SAT\n";);
+		  return SAT_OR_INDETERMIN;
 	  }
-	  if(!isOpX<AND>(ruleHead_cand_app))
+	  else if(!isSat)
 	  {
-			Expr weaken_cand = mk<TRUE>(ruleHead_cand_app->efac());
-			m_houdini.getCandidateModel().addDef(ruleHead_app, weaken_cand);
+		  LOG("houdini", errs() << "UNSAT\n";);
+		  return UNSAT;
 	  }
-	  else
+	  else //if indeterminate
 	  {
-			ExprVector head_cand_args;
-			head_cand_args.insert(head_cand_args.end(), ruleHead_cand_app->args_begin(), ruleHead_cand_app->args_end());
-			int num_of_lemmas = head_cand_args.size();
+		  LOG("houdini", errs() << "INDETERMINATE\n";);
+		  return SAT_OR_INDETERMIN;
+	  }
+  }
 
-			for(ExprVector::iterator it = head_cand_args.begin(); it != head_cand_args.end(); ++it)
-			{
-				LOG("houdini", errs() << "EVAL: " << *(m.eval(*it)) << "\n";);
-				if(isOpX<FALSE>(m.eval(*it)))
-				{
-					head_cand_args.erase(it);
-					break;
-				}
-			}
+  void Houdini_Assumptions::addAssumptions(Expr rel, ExprVector &assumptions)
+  {
+	  const ExprVector &inds = m_indicators[rel];
+	  const llvm::BitVector &alive = m_houdini.getCandidates().alive(rel);
+	  // -- the indicators of dropped lemmas are assumed false, otherwise
+	  // -- the solver may pick them to strengthen the body
+	  for(unsigned i = 0; i < inds.size(); i++)
+		  assumptions.push_back(alive.test(i) ? inds[i] : mk<NEG>(inds[i]));
+  }
 
-			// This condition can be reached only when the solver answers Indeterminate
-			// In this case, we remove an arbitrary lemma (the first one)
-			if(head_cand_args.size() == num_of_lemmas)
-			{
-				LOG("houdini", errs() << "INDETERMINATE REACHED" << "\n");
-				head_cand_args.erase(head_cand_args.begin());
-			}
+  void Houdini_Assumptions::assignEachRuleASolver()
+  {
+	  auto &m_hm = m_houdini.getHornifyModule();
+	  auto &db = m_hm.getHornClauseDB();
+	  HoudiniCandidates &cands = m_houdini.getCandidates();
 
-			ExprMap bvarToArgMap;
-			for(int i=0; i<bind::domainSz(bind::fname(ruleHead_app)); i++)
-			{
-				Expr arg_i = ruleHead_app->arg(i+1);
-				Expr bvar_i = bind::bvar(i, bind::typeOf(arg_i));
-				bvarToArgMap.insert(std::make_pair(bvar_i, arg_i));
-			}
+	  for(Expr rel : db.getRelations())
+	  {
+		  unsigned n = cands.alive(rel).size();
+		  ExprVector &inds = m_indicators[rel];
+		  for(unsigned i = 0; i < n; i++)
+			  inds.push_back(bind::boolConst(variant::variant(i, variant::tag(bind::fname(rel), "houdini"))));
+	  }
 
-			if(head_cand_args.size() > 1)
-			{
-				Expr weaken_cand = mknary<AND>(head_cand_args.begin(), head_cand_args.end());
-				Expr weaken_cand_app = replace(weaken_cand, bvarToArgMap);
-				m_houdini.getCandidateModel().addDef(ruleHead_app, weaken_cand_app);
-			}
-			else
-			{
-				Expr weaken_cand = head_cand_args[0];
-				Expr weaken_cand_app = replace(weaken_cand, bvarToArgMap);
-				m_houdini.getCandidateModel().addDef(ruleHead_app, weaken_cand_app);
-			}
+	  for(HornRule r : db.getRules())
+	  {
+		  ZSolverPool<EZ3>::Lease solver = m_hm.getZContext().solverPool().acquire();
+		  solver->assertExpr(extractTransitionRelation(r, db));
+
+		  Expr head_rel = bind::fname(r.head());
+		  ExprSet rels;
+		  rels.insert(head_rel);
+
+		  ExprVector body_pred_apps;
+		  r.pred_apps(db, std::back_inserter(body_pred_apps));
+		  for(Expr body_app : body_pred_apps)
+		  {
+			  rels.insert(bind::fname(body_app));
+			  const ExprVector &lemmas = cands.lemmas(body_app);
+			  const ExprVector &inds = m_indicators[bind::fname(body_app)];
+			  assert(lemmas.size() == inds.size());
+			  for(unsigned i = 0; i < lemmas.size(); i++)
+				  solver->assertExpr(mk<IMPL>(inds[i], lemmas[i]));
+		  }
+
+		  // -- the head is violated if one of its active lemmas is false
+		  const ExprVector &head_lemmas = cands.lemmas(r.head());
+		  const ExprVector &inds = m_indicators[head_rel];
+		  assert(head_lemmas.size() == inds.size());
+		  ExprVector violations;
+		  for(unsigned i = 0; i < head_lemmas.size(); i++)
+			  violations.push_back(mk<AND>(inds[i], mk<NEG>(head_lemmas[i])));
+		  solver->assertExpr(mknary<OR>(mk<FALSE>(head_rel->efac()), violations));
+
+		  m_ruleRels[r].assign(rels.begin(), rels.end());
+		  m_ruleToSolverMap.insert(std::make_pair(r, std::move(solver)));
 	  }
-	  LOG("houdini", errs() << "HEAD AFTER WEAKEN: " << *(m_houdini.getCandidateModel().getDef(ruleHead_app)) << "\n";);
   }
 
   /*
-   * Given a rule head, extract all rules using it in body, then add all such rules to the end of workList
+   * Given a rule, weaken its head's candidate by the lemmas false in m.
+   * With --horn-houdini-batch, the check that gave m is repeated in a
+   * new scope of solver, under assumptions, with the remaining head
+   * candidate negated as well, so that each further model falsifies a
+   * lemma that is kept. The body candidates are the ones of the first
+   * check, so every dropped lemma is falsified by a counterexample of
+   * that check
+   */
+  void HoudiniContext::weakenRuleHeadCand(HornRule r, ZSolver<EZ3> &solver, ZModel<EZ3> m,
+                                          const ExprVector &assumptions)
+  {
+	  HoudiniCandidates &cands = m_houdini.getCandidates();
+	  unsigned dropped = cands.weaken(r.head(), m, BatchWeaken);
+	  if(BatchWeaken && BatchModels > 1)
+	  {
+		  solver.push();
+		  for(unsigned k = 1; k < BatchModels; ++k)
+		  {
+			  Expr kept = cands.conj(r.head());
+			  if(isOpX<TRUE>(kept)) break;
+			  solver.assertExpr(mk<NEG>(kept));
+			  boost::tribool more = assumptions.empty() ? solver.solve() : solver.solveAssuming(assumptions);
+			  if(!more || boost::indeterminate(more)) break;
+			  ZModel<EZ3> m2 = solver.getModel();
+			  unsigned d = cands.weaken(r.head(), m2, true, false);
+			  if(d == 0) break;
+			  LOG("houdini", errs() << "MODEL " << k + 1 << " DROPPED: " << d << "\n";);
+			  dropped += d;
+		  }
+		  solver.pop();
+	  }
+	  m_houdini.addWeakening(dropped);
+  }
+
+  /*
+   * Given a rule head, extract all rules using it in body, then add all such rules to workList,
+   * ahead of the rules of outer wto components
    */
   void HoudiniContext::addUsedRulesBackToWorkList(HornClauseDBWto &db_wto, std::list<HornRule> &workList, HornRule r)
   {
@@ -524,29 +1309,32 @@ namespace seahorn
   			  }
   			  if(bind::fname((*it).head()) == fdecl)
   			  {
-  				  LOG("houdini", errs() << "[NEED RULE]: " << *((*it).head()) << " <===== " << *((*it).body()) << "\n";);
+  				  LOG("houdini", errs() << "[NEED RULE]: " << *((*it).head()) << " <===== " << dag((*it).body()) << "\n";);
   				  if(std::find(workList.begin(), workList.end(), *it) == workList.end())
   				  {
-  					  workList.push_back(*it);
+  					  // rules of the innermost components are processed first
+  					  unsigned depth = db_wto.depth(fdecl);
+  					  auto pos = std::find_if(workList.begin(), workList.end(), [&](const HornRule &w)
+  					  { return db_wto.depth(bind::fname(w.head())) < depth; });
+  					  workList.insert(pos, *it);
   				  }
   			  }
   		  }
   	  }
   }
 
-  void Houdini::generatePositiveWitness(std::map<Expr, ExprVector> &relationToPositiveStateMap)
+  void Houdini::generatePositiveWitness(std::map<Expr, ExprVector> &relationToPositiveStateMap, unsigned rounds)
   {
-	  auto &db = m_hm.getHornClauseDB();
-	  for(HornClauseDB::RuleVector::iterator it = db.getRules().begin(); it != db.getRules().end(); ++it)
+	  // -- every round unrolls each rule once more from the newest
+	  // -- states of its body, the first round starts from the facts
+	  unsigned dropped = 0;
+	  for(unsigned i = 0; i < rounds; i++)
 	  {
-		  HornRule r = *it;
-		  ExprVector body_pred_list;
-		  get_all_pred_apps(r.body(), db, std::back_inserter(body_pred_list));
-		  if(body_pred_list.size() == 0) // this rule doesn't have predicates in its body.
-		  {
-			  getRuleHeadState(relationToPositiveStateMap, r, mk<TRUE>(r.head()->efac()));
-		  }
+		  if(!getReachableStates(relationToPositiveStateMap, dropped)) break;
 	  }
+	  dropped += filterSampledStates(relationToPositiveStateMap);
+	  Stats::uset("HoudiniPrefiltered", dropped);
+
 	  LOG("houdini", errs() << "THE WHOLE STATE MAP:\n";);
 	  for(std::map<Expr, ExprVector>::iterator itr = relationToPositiveStateMap.begin(); itr != relationToPositiveStateMap.end(); ++itr)
 	  {
@@ -560,96 +1348,160 @@ namespace seahorn
 	  }
   }
 
-  void Houdini::getReachableStates(std::map<Expr, ExprVector> &relationToPositiveStateMap, Expr from_pred, Expr from_pred_state)
+  unsigned Houdini::filterSampledStates(const std::map<Expr, ExprVector> &relationToPositiveStateMap)
   {
-	  auto &db = m_hm.getHornClauseDB();
-	  LOG("houdini", errs() << "COME IN\n";);
-	  for(HornClauseDB::RuleVector::iterator itr = db.getRules().begin(); itr != db.getRules().end(); ++itr)
-	  {
-		  HornRule r = *itr;
-		  ExprVector body_preds;
-		  get_all_pred_apps(r.body(), db, std::back_inserter(body_preds));
-		  LOG("houdini", errs() << "BODY PRED SIZE: " << body_preds.size() << "\n";);
-		  if(body_preds.size() > 0)
+	  unsigned dropped = 0, compiled = 0;
+	  for(auto &kv : relationToPositiveStateMap)
+	  {
+		  Expr rel = kv.first;
+		  const ExprVector &states = kv.second;
+		  Expr rel_app = relApp(rel);
+		  ExprVector lemmas;
+		  candLemmas(m_candidate_model.getDef(rel_app), lemmas);
+		  if(lemmas.empty() || states.empty()) continue;
+
+		  // -- a column per argument, a lane per state
+		  eval::Program prog;
+		  std::map<Expr, unsigned> column;
+		  for(unsigned i = 0; i < bind::domainSz(rel); i++)
+			  column[rel_app->arg(i+1)] = prog.addVar(rel_app->arg(i+1), bind::domainTy(rel, i));
+		  eval::Batch in(prog.numVars(), states.size());
+		  for(size_t j = 0; j < states.size(); j++)
+		  {
+			  ExprVector eqs;
+			  candLemmas(states[j], eqs);
+			  for(Expr eq : eqs)
+			  {
+				  int64_t v;
+				  if(!isOpX<EQ>(eq) || !eval::toValue(eq->right(), v)) continue;
+				  auto it = column.find(eq->left());
+				  if(it != column.end()) in.set(it->second, j, v);
+			  }
+		  }
+
+		  std::vector<int> roots;
+		  for(Expr lemma : lemmas) roots.push_back(prog.addRoot(lemma));
+		  eval::Batch out;
+		  prog.eval(in, out);
+
+		  ExprVector kept;
+		  for(unsigned l = 0; l < lemmas.size(); l++)
 		  {
-			  LOG("houdini", errs() << "BODY PRED 0: " << *(body_preds[0]) << "\n";);
-			  LOG("houdini", errs() << "FROM PRED: " << *from_pred << "\n";);
+			  bool falsified = false;
+			  if(roots[l] >= 0)
+			  {
+				  ++compiled;
+				  for(size_t j = 0; j < states.size() && !falsified; j++)
+					  falsified = out.known(roots[l], j) && !out.value(roots[l], j);
+			  }
+			  else
+			  {
+				  // -- not compiled, the state is substituted and simplified
+				  for(size_t j = 0; j < states.size() && !falsified; j++)
+				  {
+					  ExprVector eqs;
+					  candLemmas(states[j], eqs);
+					  ExprMap values;
+					  for(Expr eq : eqs) values.insert(std::make_pair(eq->left(), eq->right()));
+					  falsified = isOpX<FALSE>(z3_simplify(m_hm.getZContext(), replace(lemmas[l], values)));
+				  }
+			  }
+			  if(falsified) dropped++;
+			  else kept.push_back(lemmas[l]);
 		  }
-		  if(body_preds.size() == 1 && bind::fname(body_preds[0]) == bind::fname(from_pred))
+		  if(kept.size() < lemmas.size())
 		  {
-			  getRuleHeadState(relationToPositiveStateMap, r, from_pred_state);
+			  LOG("houdini", errs() << "PREFILTER: " << *rel << " drops "
+					  << lemmas.size() - kept.size() << " lemmas\n";);
+			  m_candidate_model.addDef(rel_app, mknary<AND>(mk<TRUE>(rel->efac()), kept));
 		  }
 	  }
+	  Stats::uset("HoudiniCompiledLemmas", compiled);
+	  return dropped;
   }
 
-  void Houdini::getRuleHeadState(std::map<Expr, ExprVector> &relationToPositiveStateMap, HornRule r, Expr from_pred_state)
+  bool Houdini::getReachableStates(std::map<Expr, ExprVector> &relationToPositiveStateMap, unsigned &dropped)
   {
-		LOG("houdini", errs() << "RULE HEAD: " << *(r.head()) << "\n";);
-		LOG("houdini", errs() << "RULE BODY: " << *(r.body()) << "\n";);
-		auto &db = m_hm.getHornClauseDB();
-		ZSolver<EZ3> solver(m_hm.getZContext());
-		solver.assertExpr(from_pred_state);
-		solver.assertExpr(extractTransitionRelation(r, db));
-		solver.toSmtLib(outs());
-		boost::tribool isSat = solver.solve();
-		if(isSat)
-		{
-		  LOG("houdini", errs() << "SAT\n";);
-		  if(bind::domainSz(bind::fname(r.head())) == 0) //reach a predicate with empty signature. Error state.
-		  {
-			  LOG("houdini", errs() << "BAD STATE REACHED!\n";);
-			  return;
-		  }
-		  ZModel<EZ3> model = solver.getModel();
-		  ExprVector equations;
-		  for(int i=0; i<=bind::domainSz(r.head()); i++)
-		  {
-			  Expr var = bind::domainTy(r.head(), i);
-			  Expr value = model.eval(var);
-			  LOG("houdini", errs() << "VAR: " << *var << "\n";);
-			  LOG("houdini", errs() << "VALUE: " << *value << "\n";);
-			  equations.push_back(mk<EQ>(var, value));
-		  }
-		  Expr state_assignment;
-		  if(equations.size() > 1)
-		  {
-			  state_assignment = mknary<AND>(equations.begin(), equations.end());
-		  }
-		  else
-		  {
-			  state_assignment = equations[0];
-		  }
-		  LOG("houdini", errs() << "STATE ASSIGNMENT: " << *state_assignment << "\n";);
+	  auto &db = m_hm.getHornClauseDB();
+	  bool found = false;
+	  for(const HornRule &r : db.getRules())
+	  {
+		  if(getRuleHeadState(relationToPositiveStateMap, r, dropped)) found = true;
+	  }
+	  return found;
+  }
+
+  bool Houdini::getRuleHeadState(std::map<Expr, ExprVector> &relationToPositiveStateMap, HornRule r, unsigned &dropped)
+  {
+	  auto &db = m_hm.getHornClauseDB();
+	  Expr head_rel = bind::fname(r.head());
+	  //reach a predicate with empty signature. Error state.
+	  if(bind::domainSz(head_rel) == 0) return false;
+
+	  ZSolverPool<EZ3>::Lease lease = m_hm.getZContext().solverPool().acquire();
+	  ZSolver<EZ3> &solver = *lease;
+
+	  ExprVector body_pred_apps;
+	  r.pred_apps(db, std::back_inserter(body_pred_apps));
+	  for(Expr body_app : body_pred_apps)
+	  {
+		  // -- states are kept at the application of the relation to its
+		  // -- bound variables, they are moved to the arguments of body_app
+		  auto it = relationToPositiveStateMap.find(bind::fname(body_app));
+		  if(it == relationToPositiveStateMap.end()) return false;
+		  Expr rel_app = relApp(bind::fname(body_app));
+		  ExprMap argMap;
+		  for(unsigned i = 0; i < bind::domainSz(bind::fname(body_app)); i++)
+			  argMap.insert(std::make_pair(rel_app->arg(i+1), body_app->arg(i+1)));
+		  solver.assertExpr(replace(it->second.back(), argMap));
+	  }
+	  solver.assertExpr(extractTransitionRelation(r, db));
+
+	  boost::tribool isSat = solver.solve();
+	  if(!isSat || boost::indeterminate(isSat)) return false;
+
+	  ZModel<EZ3> model = solver.getModel();
+
+	  Expr head_app = relApp(head_rel);
+	  ExprVector equations;
+	  bool chained = true;
+	  for(unsigned i = 0; i < bind::domainSz(head_rel); i++)
+	  {
+		  // -- states are only chained through values that can be
+		  // -- asserted again
+		  if(isOpX<ARRAY_TY>(bind::domainTy(head_rel, i))) { chained = false; break; }
+		  Expr value = model.eval(r.head()->arg(i+1), true);
+		  if(isOpX<NONDET>(value)) { chained = false; break; }
+		  equations.push_back(mk<EQ>(head_app->arg(i+1), value));
+	  }
 
-		  if(relationToPositiveStateMap.find(bind::fname(r.head())) == relationToPositiveStateMap.end())
+	  if(!chained)
+	  {
+		  // -- the model is a reachable state of the head that is not
+		  // -- kept, drop the lemmas of its candidate that are false in it
+		  ExprVector lemmas, kept;
+		  candLemmas(m_candidate_model.getDef(r.head()), lemmas);
+		  for(Expr lemma : lemmas)
 		  {
-			  ExprVector states;
-			  states.push_back(state_assignment);
-			  relationToPositiveStateMap.insert(std::make_pair(bind::fname(r.head()), states));
+			  if(isOpX<FALSE>(model.eval(lemma, true))) dropped++;
+			  else kept.push_back(lemma);
 		  }
-		  else
+		  if(kept.size() < lemmas.size())
 		  {
-			  ExprVector &states = relationToPositiveStateMap.find(bind::fname(r.head()))->second;
-			  states.push_back(state_assignment);
+			  LOG("houdini", errs() << "PREFILTER: " << *head_rel << " drops "
+					  << lemmas.size() - kept.size() << " lemmas\n";);
+			  m_candidate_model.addDef(r.head(), mknary<AND>(mk<TRUE>(head_rel->efac()), kept));
 		  }
-		  /*LOG("houdini", errs() << "STATE MAP:\n";);
-		  for(std::map<Expr, ExprVector>::iterator itr = relationToPositiveStateMap.begin(); itr != relationToPositiveStateMap.end(); ++itr)
-		  {
-			  LOG("houdini", errs() << "KEY: " << *(itr->first) << "\n";);
-			  LOG("houdini", errs() << "VALUE: [";);
-			  for(ExprVector::iterator itr2 = itr->second.begin(); itr2 != itr->second.end(); ++itr2)
-			  {
-				  LOG("houdini", errs() << *(*itr2) << ", ";);
-			  }
-			  LOG("houdini", errs() << "]\n";);
-		  }*/
-		  getReachableStates(relationToPositiveStateMap, r.head(), state_assignment);
-		}
-		else
-		{
-		  LOG("houdini", errs() << "UNSAT\n";);
-		  return;
-		}
+		  return false;
+	  }
+
+	  Expr state_assignment = mknary<AND>(mk<TRUE>(head_rel->efac()), equations);
+	  LOG("houdini", errs() << "STATE ASSIGNMENT: " << dag(state_assignment) << "\n";);
+
+	  ExprVector &states = relationToPositiveStateMap[head_rel];
+	  if(std::find(states.begin(), states.end(), state_assignment) != states.end()) return false;
+	  states.push_back(state_assignment);
+	  return true;
   }
 
 }
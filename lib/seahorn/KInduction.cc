@@ -0,0 +1,128 @@
+#include "seahorn/KInduction.hh"
+#include "seahorn/HornProgress.hh"
+#include "seahorn/Support/TaskPool.hh"
+
+#include "llvm/Support/raw_ostream.h"
+#include "avy/AvyDebug.h"
+#include "ufo/Stats.hh"
+
+#include "boost/range.hpp"
+
+#include <algorithm>
+
+namespace seahorn
+{
+  void KInduction::addInvariant (const CutPoint &cp, Expr inv)
+  {
+    if (isOpX<TRUE> (inv)) return;
+    m_invs [&cp].push_back (inv);
+  }
+
+  void KInduction::strengthen (BmcEngine &bmc, const CutPoint &cp)
+  {
+    auto it = m_invs.find (&cp);
+    if (it == m_invs.end ()) return;
+
+    bmc.encode ();
+    SymStore &s = bmc.state (bmc.size () - 1);
+    for (Expr inv : it->second)
+    {
+      // -- reading a register defines it in s, so that the edges
+      // -- executed from s use the same value
+      ExprVector regs;
+      filter (inv, bind::IsConst (), std::back_inserter (regs));
+      ExprMap sub;
+      for (Expr r : regs) sub [r] = s.read (r);
+      bmc.assume (replace (inv, sub));
+    }
+  }
+
+  boost::tribool KInduction::search (Unrolling &u, const CutPoint &cp,
+                                     unsigned left, bool useInvs)
+  {
+    BmcEngine &bmc = u.bmc;
+    bool undecided = false;
+    for (const CpEdge *edg : boost::make_iterator_range (cp.succ_begin (), cp.succ_end ()))
+    {
+      const CutPoint &dst = edg->target ();
+      // -- paths end at the bad cutpoint and nowhere else
+      if ((left == 1) != (&dst == &m_bad)) continue;
+
+      u.path.push_back (&dst);
+      // -- a prefix solved at a smaller depth is not solved again, and
+      // -- an infeasible one is not even encoded
+      auto it = u.feasible.find (u.path);
+      if (it != u.feasible.end () && !it->second)
+      {
+        u.path.pop_back ();
+        continue;
+      }
+
+      bmc.push ();
+      bmc.addCutPoint (dst);
+      if (useInvs) strengthen (bmc, dst);
+
+      boost::tribool res = true;
+      if (it == u.feasible.end ())
+      {
+        res = bmc.solve ();
+        // -- a path to the bad cutpoint is only checked at one depth
+        if (left > 1 && !boost::indeterminate (res))
+          u.feasible [u.path] = bool (res);
+      }
+      else
+        ufo::Stats::count ("KInductionReused");
+      if (res && left > 1) res = search (u, dst, left - 1, useInvs);
+      bmc.pop ();
+      u.path.pop_back ();
+
+      if (res) return true;
+      if (boost::indeterminate (res)) undecided = true;
+    }
+    return undecided ? boost::indeterminate : boost::tribool (false);
+  }
+
+  boost::tribool KInduction::run (unsigned maxK, unsigned from)
+  {
+    Unrolling base (m_sem, m_zctx);
+    base.bmc.addCutPoint (m_entry);
+    std::map<const CutPoint*, std::unique_ptr<Unrolling> > steps;
+    const CutPointGraph &cpg = m_entry.parent ();
+
+    // -- base cases that could not be decided
+    bool undecided = false;
+    for (unsigned k = std::max (1U, from); k <= maxK; ++k)
+    {
+      // -- the depth of the base cases proven so far is the answer
+      if (globalCancelToken ().cancelled ()) break;
+      m_depth = k;
+      HornProgress::set ("kind.depth", k);
+      LOG ("kind", errs () << "k-induction: depth " << k << "\n";);
+
+      // -- base case
+      boost::tribool res = search (base, m_entry, k, false);
+      if (res) return true;
+      if (boost::indeterminate (res)) undecided = true;
+      else if (!undecided && m_onBase) m_onBase (k);
+
+      // -- step case, from every cutpoint
+      bool proved = true;
+      for (const CutPoint &cp : cpg)
+      {
+        if (&cp == &m_bad) continue;
+        std::unique_ptr<Unrolling> &step = steps [&cp];
+        if (!step)
+        {
+          step.reset (new Unrolling (m_sem, m_zctx));
+          step->bmc.addCutPoint (cp);
+          strengthen (step->bmc, cp);
+        }
+        if (!search (*step, cp, k, true)) continue;
+        proved = false;
+        break;
+      }
+      if (proved) return undecided ? boost::indeterminate : boost::tribool (false);
+    }
+    return boost::indeterminate;
+  }
+}
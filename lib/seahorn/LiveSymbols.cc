@@ -5,7 +5,17 @@
 #include "avy/AvyDebug.h"
 
 #include "llvm/Analysis/CFG.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/Support/CommandLine.h"
 #include "seahorn/Support/SortTopo.hh"
+#include "ufo/ExprHash.hpp"
+
+#include <deque>
+
+static llvm::cl::opt<bool>
+DenseLive ("horn-live-bitsets",
+           llvm::cl::desc ("Propagate live symbols as bit-vectors of numbered symbols"),
+           llvm::cl::init (false));
 
 
 namespace seahorn
@@ -64,7 +74,8 @@ namespace seahorn
     if (!m_f.getName ().equals ("main"))
       patchArgsAndGlobals ();
     // -- propagate local def/use over the CFG.
-    globalPass ();
+    if (DenseLive) globalPassDense ();
+    else globalPass ();
     
     // HACK: skip main() because it is not treated as a function (i.e., no summary)
     if (m_f.getName ().equals ("main")) return;
@@ -214,6 +225,100 @@ namespace seahorn
     } while (dirty);
   }  
   
+  void LiveSymbols::globalPassDense ()
+  {
+    // -- number the symbols of the function in their order, so that
+    // -- a bit-vector lists its symbols sorted
+    ExprVector syms;
+    for (const BasicBlock *bb : m_rtopo)
+    {
+      const LiveInfo &li = m_liveInfo [bb];
+      syms.insert (syms.end (), li.live ().begin (), li.live ().end ());
+      syms.insert (syms.end (), li.defs ().begin (), li.defs ().end ());
+      for (unsigned i = 0; i < li.numEdgeDefs (); ++i)
+        syms.insert (syms.end (), li.edge_defs (i).begin (), li.edge_defs (i).end ());
+    }
+    boost::sort (syms);
+    syms.erase (std::unique (syms.begin (), syms.end ()), syms.end ());
+    
+    ExprHashMap<unsigned> ids;
+    ids.reserve (syms.size ());
+    for (unsigned i = 0; i < syms.size (); ++i) ids [syms [i]] = i;
+    
+    auto toBits = [&] (const ExprVector &v)
+    {
+      BitVector res (syms.size ());
+      for (Expr e : v) res.set (ids [e]);
+      return res;
+    };
+    
+    DenseMap<const BasicBlock*, unsigned> blockIds;
+    for (unsigned i = 0; i < m_rtopo.size (); ++i) blockIds [m_rtopo [i]] = i;
+    
+    std::vector<BitVector> live, defs;
+    std::vector<std::vector<BitVector> > edgeDefs (m_rtopo.size ());
+    for (unsigned i = 0; i < m_rtopo.size (); ++i)
+    {
+      const LiveInfo &li = m_liveInfo [m_rtopo [i]];
+      live.push_back (toBits (li.live ()));
+      defs.push_back (toBits (li.defs ()));
+      for (unsigned j = 0; j < li.numEdgeDefs (); ++j)
+        edgeDefs [i].push_back (toBits (li.edge_defs (j)));
+    }
+    
+    // -- a block is revisited only when the live symbols of one of its
+    // -- successors grow. Blocks start in reverse topological order
+    std::deque<unsigned> work;
+    std::vector<bool> queued (m_rtopo.size (), true);
+    for (unsigned i = 0; i < m_rtopo.size (); ++i) work.push_back (i);
+    
+    while (!work.empty ())
+    {
+      unsigned src = work.front ();
+      work.pop_front ();
+      queued [src] = false;
+      
+      bool grew = false;
+      unsigned idx = 0;
+      for (const BasicBlock *dst : 
+             boost::make_iterator_range (succ_begin (m_rtopo [src]), 
+                                         succ_end (m_rtopo [src])))
+      {
+        auto it = blockIds.find (dst);
+        unsigned edge = idx++;
+        if (it == blockIds.end ()) continue;
+        
+        BitVector flow (live [it->second]);
+        flow.reset (edgeDefs [src][edge]);
+        flow.reset (defs [src]);
+        flow.reset (live [src]);
+        if (flow.none ()) continue;
+        live [src] |= flow;
+        grew = true;
+      }
+      
+      if (!grew) continue;
+      for (const BasicBlock *pred : 
+             boost::make_iterator_range (pred_begin (m_rtopo [src]), 
+                                         pred_end (m_rtopo [src])))
+      {
+        auto it = blockIds.find (pred);
+        if (it == blockIds.end () || queued [it->second]) continue;
+        queued [it->second] = true;
+        work.push_back (it->second);
+      }
+    }
+    
+    for (unsigned i = 0; i < m_rtopo.size (); ++i)
+    {
+      ExprVector v;
+      v.reserve (live [i].count ());
+      for (int b = live [i].find_first (); b >= 0; b = live [i].find_next (b))
+        v.push_back (syms [b]);
+      m_liveInfo [m_rtopo [i]].setLive (v);
+    }
+  }
+  
   void LiveSymbols::symExec (SymStore &s, const BasicBlock &bb) 
   {
     m_semantics.exec (s, bb, m_side, trueE);
@@ -5,6 +5,8 @@
 #include "seahorn/config.h"
 #include "ufo/Smt/EZ3.hh"
 
+namespace crab_llvm { class CrabInvCache; }
+
 namespace seahorn
 {
   using namespace llvm;
@@ -12,11 +14,13 @@ namespace seahorn
   /// Loads Crab invariants into a Horn Solver
   class LoadCrab: public llvm::ModulePass
   {
+    /// translations of invariants shared by all functions of the module
+    crab_llvm::CrabInvCache *m_cache;
 
   public:
     static char ID;
     
-    LoadCrab () : ModulePass(ID) {}
+    LoadCrab () : ModulePass(ID), m_cache (nullptr) {}
     virtual ~LoadCrab () {}
     
     virtual bool runOnModule (Module &M);
@@ -55,10 +59,24 @@ namespace seahorn
 
 #include "llvm/Support/CommandLine.h"
 
+#include "ufo/Stats.hh"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <tuple>
+
 #include <crab_llvm/CfgBuilder.hh>
 #include <crab_llvm/CrabLlvm.hh>
 #include <crab_llvm/AbstractDomains.hh>
 
+static llvm::cl::opt<bool>
+CrabPipeline ("horn-crab-pipeline",
+              llvm::cl::desc ("Translate the Crab invariants while the Horn solver runs "
+                              "and give them to it as they are ready. "
+                              "Needs --horn-threads > 1"),
+              llvm::cl::init (false));
+
 namespace crab_llvm
 {
   using namespace llvm;
@@ -362,6 +380,38 @@ namespace crab_llvm
   // TODO: a ldd is precisely translated only if all its variables can
   // be mapped to llvm Value. Unlike in class LinConstToExpr here we
   // do not even translate global singletons.
+  class LDDToExpr;
+
+  // Translations of LDD nodes, shared by all blocks and functions.
+  //
+  // The manager hash-conses the nodes and the boxes domain numbers its
+  // variables once for all its values, so a node of a manager denotes
+  // the same formula wherever it occurs. Only regular nodes are kept:
+  // a complemented node is the negation of its regular one. The cache
+  // holds a reference to its nodes so that their addresses are not
+  // reused while they are in it.
+  class LddExprCache
+  {
+    friend class LDDToExpr;
+
+    typedef std::pair<LddManager*, LddNode*> node_key_t;
+    typedef std::pair<LddManager*, int> var_key_t;
+
+    std::map<node_key_t, Expr> m_nodes;
+    std::map<var_key_t, Expr> m_vars;
+
+   public:
+    LddExprCache () {}
+    LddExprCache (const LddExprCache &) = delete;
+    ~LddExprCache ()
+    {
+      for (auto &kv : m_nodes)
+        Ldd_RecursiveDeref (kv.first.first, kv.first.second);
+    }
+
+    unsigned size () const { return m_nodes.size (); }
+  };
+
   class LDDToExpr
   {
    public:
@@ -388,25 +438,26 @@ namespace crab_llvm
    protected:
     
     boost::shared_ptr<VarMap> varMap;
+    LddExprCache &m_cache;
+    /// manager of the translated node
+    LddManager *m_ldd;
     
    public:
     
     template <typename T>
-    LDDToExpr (const T *vm) : 
-        varMap(new VarMapT<T>(vm)) { }
+    LDDToExpr (const T *vm, LddExprCache &cache) : 
+        varMap(new VarMapT<T>(vm)), m_cache (cache), m_ldd (nullptr) { }
     
     Expr toExpr (LddNodePtr n, ExprFactory &efac)
     {
       LddManager *ldd = getLddManager (n);
+      m_ldd = ldd;
       
       LddNode *N = Ldd_Regular(&(*n));
       if (Ldd_GetTrue (ldd) == N)
         return &*n == N ? mk<TRUE>(efac) : mk<FALSE>(efac);
       
-      /** cache holds pointers because anything that is placed in the
-          cache will not disapear until 'n' is deleted */
-      std::map<LddNode*, Expr> cache; 
-      Expr res = toExprRecur(ldd, &*n, efac, cache);
+      Expr res = toExprRecur(ldd, &*n, efac);
       if (!res) 
         return mk<TRUE> (efac);
       else
@@ -415,42 +466,40 @@ namespace crab_llvm
     
    protected: 
 
-    Expr toExprRecur(LddManager* ldd, LddNode* n, 
-                     ExprFactory &efac, std::map<LddNode*, Expr> &cache)
+    Expr toExprRecur(LddManager* ldd, LddNode* n, ExprFactory &efac)
     {
       
       LddNode *N = Ldd_Regular (n);
       Expr res = nullptr;
       
       if (N == Ldd_GetTrue (ldd)) 
+        return N == n ? mk<TRUE> (efac) : mk<FALSE> (efac);
+      if (N == Ldd_GetFalse (ldd)) 
+        return N == n ? mk<FALSE> (efac) : mk<TRUE> (efac);
+
+      auto key = std::make_pair (ldd, N);
+      auto it = m_cache.m_nodes.find (key);
+      if (it != m_cache.m_nodes.end ())
       {
-        res = mk<TRUE> (efac);
-      } 
-      else if (N == Ldd_GetFalse (ldd)) 
-      {
-        res = mk<FALSE> (efac);
-      } 
-      else if (N->ref != 1) 
-      {
-        std::map<LddNode*,Expr>::const_iterator it = cache.find (N);
-        if (it != cache.end ()) res = it->second;
+        res = it->second;
+        if (!res) return res;
+        return N == n ? res : boolop::lneg (res);
       }
-      
-      if (res) return (N == n ? res : boolop::lneg (res));
 
       Expr c = exprFromCons (Ldd_GetCons (ldd, N), 
                              Ldd_GetTheory (ldd), efac);
 
       // This should not happen because we project boxes onto live
       // vars before translation.
-      if (!c) return nullptr;
-
-      res = lite (c, 
-                  toExprRecur (ldd, Ldd_T (N), efac, cache),
-                  toExprRecur (ldd, Ldd_E (N), efac, cache));
-      
-      if (N->ref != 1) cache [N] = res;
+      if (c)
+        res = lite (c, 
+                    toExprRecur (ldd, Ldd_T (N), efac),
+                    toExprRecur (ldd, Ldd_E (N), efac));
       
+      Ldd_Ref (N);
+      m_cache.m_nodes [key] = res;
+
+      if (!res) return res;
       return n == N ? res : boolop::lneg (res);
     }
     
@@ -485,11 +534,15 @@ namespace crab_llvm
     
     // TODO: translation of Crab global singleton cells
     Expr exprFromIntVar (int v, ExprFactory &efac) {
-      if (const Value* V = varMap->lookup(v)) {
-        return bind::intConst (mkTerm (V, efac));
-      }
-      
-      return nullptr; // this should not happen
+      auto key = std::make_pair (m_ldd, v);
+      auto it = m_cache.m_vars.find (key);
+      if (it != m_cache.m_vars.end ()) return it->second;
+
+      Expr res = nullptr; // this should not happen
+      if (const Value* V = varMap->lookup(v)) 
+        res = bind::intConst (mkTerm (V, efac));
+      m_cache.m_vars [key] = res;
+      return res;
     }
     
     Expr exprFromTerm (linterm_t term, theory_t *theory, ExprFactory &efac)
@@ -516,6 +569,22 @@ namespace crab_llvm
   };
   #endif 
 
+   // Translations of intervals, shared by all blocks and functions.
+   //
+   // The translation of a Crab variable depends on the block (on its
+   // live variables), so an interval is keyed by the translated
+   // variable and by its finite bounds.
+   class IntervalExprCache
+   {
+     typedef typename dis_interval_domain_t::number_t number_t;
+
+    public:
+     typedef std::tuple<Expr, bool, number_t, bool, number_t> key_t;
+     std::map<key_t, Expr> m_map;
+
+     unsigned size () const { return m_map.size (); }
+   };
+
    // Conversion from domain of disjunctive intervals to Expr
    class DisIntervalToExpr
    {
@@ -524,11 +593,13 @@ namespace crab_llvm
      typedef typename dis_interval_domain_t::number_t number_t;
 
      LinConstToExpr m_t;
+     IntervalExprCache &m_cache;
 
     public:
 
-     DisIntervalToExpr (CrabLlvm* crab, const llvm::BasicBlock* bb, const ExprVector &live): 
-         m_t (crab, bb, live) { }
+     DisIntervalToExpr (CrabLlvm* crab, const llvm::BasicBlock* bb, const ExprVector &live,
+                        IntervalExprCache &cache): 
+         m_t (crab, bb, live), m_cache (cache) { }
 
      Expr toExpr (dis_interval_domain_t inv, ExprFactory &efac)
      {
@@ -564,7 +635,21 @@ namespace crab_llvm
          // we could not translate the crab variable
          return mk<TRUE> (efac);
        }
-       
+
+       bool lbf = i.lb ().is_finite ();
+       bool ubf = i.ub ().is_finite ();
+       number_t zero ("0");
+       IntervalExprCache::key_t key (e, lbf, lbf ? *(i.lb ().number ()) : zero,
+                                     ubf, ubf ? *(i.ub ().number ()) : zero);
+       auto it = m_cache.m_map.find (key);
+       if (it != m_cache.m_map.end ()) return it->second;
+
+       Expr res = boundsToExpr (e, i, efac);
+       m_cache.m_map [key] = res;
+       return res;
+     }
+
+     Expr boundsToExpr (Expr e, interval_t i, ExprFactory &efac) {
        if (i.lb ().is_finite () && i.ub ().is_finite ()) {
          auto lb = *(i.lb ().number());
          auto ub = *(i.ub ().number());
@@ -590,6 +675,16 @@ namespace crab_llvm
      }    
    };
 
+   // Translations of invariants kept by LoadCrab for a whole module
+   class CrabInvCache
+   {
+    public:
+     #ifdef HAVE_LDD
+     LddExprCache ldd;
+     #endif
+     IntervalExprCache intervals;
+   };
+
 } // end namespace crab_llvm
 
 
@@ -622,7 +717,7 @@ namespace seahorn
   Expr CrabInvToExpr (const llvm::BasicBlock* B,
                       CrabLlvm* crab,
                       const ExprVector &live, 
-                      EZ3& zctx,
+                      CrabInvCache &cache,
                       ExprFactory &efac) 
   {
     Expr e = mk<TRUE> (efac);
@@ -644,7 +739,7 @@ namespace seahorn
                                                              vars.begin (), 
                                                              vars.end ());
 
-      LDDToExpr t = LDDToExpr (&boxes);
+      LDDToExpr t = LDDToExpr (&boxes, cache.ldd);
       e = t.toExpr (boxes.getLdd (), efac);
     }
     else if (abs->getId () == GenericAbsDomWrapper::id_t::arr_boxes) {
@@ -658,7 +753,7 @@ namespace seahorn
                                                              vars.begin (),
                                                              vars.end ());
 
-      LDDToExpr t = LDDToExpr (&boxes);
+      LDDToExpr t = LDDToExpr (&boxes, cache.ldd);
       e = t.toExpr (boxes.getLdd (), efac);
     }
     else 
@@ -668,13 +763,13 @@ namespace seahorn
       if (abs->getId () == GenericAbsDomWrapper::id_t::dis_intv) {
         dis_interval_domain_t inv;
         getAbsDomWrappee (abs, inv);        
-        DisIntervalToExpr t (crab, B, live);
+        DisIntervalToExpr t (crab, B, live, cache.intervals);
         e = t.toExpr (inv, efac);
       }
       else if (abs->getId () == GenericAbsDomWrapper::id_t::arr_dis_intv) {
         arr_dis_interval_domain_t inv;
         getAbsDomWrappee (abs, inv);        
-        DisIntervalToExpr t (crab, B, live);
+        DisIntervalToExpr t (crab, B, live, cache.intervals);
         e = t.toExpr (inv.get_content_domain (), efac);
       }
       else {
@@ -691,11 +786,66 @@ namespace seahorn
     return e;
   }
 
+  // Registers the translation of the invariants as the producer of
+  // the lemma queue of hm. HornSolver runs it on a worker thread, in
+  // the order of the relations of the database, while it solves.
+  static void loadPipelined (Module &M, HornifyModule &hm, CrabLlvm &crab)
+  {
+    std::map<Expr, unsigned> order;
+    for (Expr rel : hm.getHornClauseDB ().getRelations ())
+      order.insert (std::make_pair (rel, order.size ()));
+
+    std::vector<std::pair<unsigned, const BasicBlock*> > blocks;
+    for (auto &F : M)
+      for (auto &BB : F)
+      {
+        if (! hm.hasBbPredicate (BB)) continue;
+        auto it = order.find (hm.bbPredicate (BB));
+        if (it != order.end ()) blocks.push_back (std::make_pair (it->second, &BB));
+      }
+    std::sort (blocks.begin (), blocks.end ());
+
+    hm.getLemmaQueue ().setProducer ([&hm, &crab, blocks] (HornLemmaQueue &q)
+      {
+        CrabInvCache cache;
+        for (auto &b : blocks)
+        {
+          if (q.cancelled ()) return;
+          const BasicBlock &BB = *b.second;
+          const ExprVector &live = hm.live (BB);
+          Expr exp = CrabInvToExpr (&BB, &crab, live, cache, hm.getExprFactory ());
+          if (isOpX<TRUE> (exp)) continue;
+          q.push (bind::fapp (hm.bbPredicate (BB), live), exp);
+        }
+      });
+  }
+
   bool LoadCrab::runOnModule (Module &M)
   {
+    if (CrabPipeline)
+    {
+      HornifyModule &hm = getAnalysis<HornifyModule> ();
+      if (hm.getExprFactory ().isConcurrent ())
+      {
+        loadPipelined (M, hm, getAnalysis<CrabLlvm> ());
+        return false;
+      }
+      errs () << "WARNING: --horn-crab-pipeline needs --horn-threads > 1. "
+              << "Loading the invariants first\n";
+    }
+
+    ufo::ScopedStats _st ("LoadCrab");
+    CrabInvCache cache;
+    m_cache = &cache;
     for (auto &F : M) {
       runOnFunction (F);
     }
+    m_cache = nullptr;
+
+    #ifdef HAVE_LDD
+    LOG ("crab", errs () << "Translated LDD nodes: " << cache.ldd.size () << "\n";);
+    #endif
+    LOG ("crab", errs () << "Translated intervals: " << cache.intervals.size () << "\n";);
     return false;
   }
 
@@ -705,6 +855,11 @@ namespace seahorn
     CrabLlvm &crab = getAnalysis<CrabLlvm> ();
     
     auto &db = hm.getHornClauseDB ();
+
+    // -- called outside of runOnModule, the cache is only for F
+    std::unique_ptr<CrabInvCache> local;
+    if (!m_cache) local.reset (new CrabInvCache ());
+    CrabInvCache &cache = m_cache ? *m_cache : *local;
     
     for (auto &BB : F)
     {
@@ -714,7 +869,7 @@ namespace seahorn
       const ExprVector &live = hm.live (BB);
 
       Expr exp = CrabInvToExpr (&BB, &crab, live,
-                                hm.getZContext (), hm.getExprFactory ());
+                                cache, hm.getExprFactory ());
                                 
       Expr pred = hm.bbPredicate (BB);
 
@@ -3,12 +3,20 @@
 #include "ufo/Expr.hpp"
 
 #include "llvm/Analysis/MemoryBuiltins.h"
+
+#include <algorithm>
+#include <unordered_map>
+
 namespace seahorn
 {
   using namespace llvm;
   using namespace ufo;
   using namespace expr;
 
+  /// the value of a bit-vector numeral of at most 64 bits
+  static bool toWord (Expr v, uint64_t &w)
+  {return v && bv::toUint64 (v, w);}
+
 
   /*
     
@@ -31,28 +39,18 @@ namespace seahorn
     ExprVector &m_side;
     
     // -- map from concrete addresses to representative pointers
-    ExprMap m_equiv;
+    std::unordered_map<uint64_t, Expr> m_equiv;
     
     const BasicBlock *m_prev;
     unsigned m_loc;
     
-    Expr m_largestPtr;
     Expr m_oidFn;
     Expr m_oidStartFn;
     Expr m_oidEndFn;
     
     MemSimVisitor (MemSimulator &sim, ExprVector &side) : m_sim (sim), m_side (side)
     {
-      mpz_class val;
-      static const mpz_class ones64("0xFFFFFFFFFFFFFFFF");
-      if (ptrSz() == 64)
-        val = ones64;
-      else if (ptrSz () == 32)
-        val = 0xFFFFFFFF;
-      else
-        assert (false && "Unexpected pointer size");
-      m_largestPtr = bv::bvnum (val, ptrSz (), efac());
-      
+      assert ((ptrSz () == 32 || ptrSz () == 64) && "Unexpected pointer size");
       Expr bv = bv::bvsort (ptrSz (), efac ());
       Expr sort[2] = {bv, bv};
       m_oidFn = bind::fdecl (mkTerm<std::string> ("oid", efac()), sort);
@@ -68,6 +66,11 @@ namespace seahorn
 
 
     unsigned ptrSz () const {return m_sim.getDataLayout ().getPointerSizeInBits ();}
+    /// all ones, the largest pointer
+    uint64_t ptrMask () const
+    {return ptrSz () >= 64 ? ~uint64_t (0) : (uint64_t (1) << ptrSz ()) - 1;}
+    Expr word (uint64_t w)
+    {return bv::bvnum64 (w, ptrSz (), efac ());}
     unsigned storeSz (const llvm::Type *t) const
     {return m_sim.getDataLayout ().getTypeStoreSize (const_cast<Type*> (t));}
     unsigned storeSz (const llvm::Value *v) const
@@ -75,22 +78,29 @@ namespace seahorn
     
     void add (Expr c) {m_side.push_back (c);}
     void addEq (Expr lhs, Expr rhs) {if (lhs && rhs) add (mk<EQ> (lhs, rhs));}
-    /// add value v to equivalence class c
+    /// add value v to equivalence class of the concrete address c
     void addEquiv (Expr v, Expr c)
     {
-      if (!v || !c) return;
-      if (c == m_largestPtr) return;
-      Expr &u = m_equiv [c];
+      uint64_t addr;
+      if (!v || !toWord (c, addr)) return;
+      if (addr == ptrMask ()) return;
+      Expr &u = m_equiv [addr];
       if (u) addEq (v, u);
       else u = v;
     }
 
-    void addPtrDiff (Expr gep, Expr base, const mpz_class &diff)
+    void addPtrDiff (Expr gep, Expr base, uint64_t diff)
     {
       if (diff == 0) addEq (gep, base);
-      else
-        add (mk<EQ> (mk<BSUB> (gep, base),
-                     bv::bvnum (diff, ptrSz (), efac ())));
+      else add (mk<EQ> (mk<BSUB> (gep, base), word (diff)));
+    }
+
+    /// ptr points to the start of the allocation chunk
+    void addAlloc (Expr ptr, const MemSimulator::AllocInfo &chunk)
+    {
+      addEq (oidE (ptr), word (chunk.id));
+      addEq (startE (ptr), word (chunk.start));
+      addEq (endE (ptr), word (chunk.end));
     }
     
     Expr symb (const Value &V)
@@ -198,17 +208,15 @@ namespace seahorn
       
       Expr gepPtr = symb (I);
       Expr basePtr = symb (*I.getPointerOperand ());
-      if (gepVal && baseVal && gepPtr && basePtr)
+      uint64_t gepW, baseW;
+      if (gepPtr && basePtr && toWord (gepVal, gepW) && toWord (baseVal, baseW))
       {
-        mpz_class gepZ = bv::toMpz (gepVal);
-        mpz_class baseZ = bv::toMpz (baseVal);
-
-        assert (baseZ <= gepZ);
-        if (baseZ == gepZ)
+        if (baseW == gepW)
           addEq (gepPtr, basePtr);
         else
         {
-          addPtrDiff (gepPtr, basePtr, gepZ - baseZ);
+          // -- modulo the pointer width, as BSUB. Negative offsets wrap
+          addPtrDiff (gepPtr, basePtr, (gepW - baseW) & ptrMask ());
           add (mk<EQ> (oidE (gepPtr), oidE (basePtr)));
         }
       }
@@ -243,10 +251,7 @@ namespace seahorn
         
         LOG ("memsim", errs () << "\n";);
         
-        auto &chunk = m_sim.alloc (sz);
-        addEq (oidE (symb (I)), bv::bvnum (chunk.id, ptrSz (), efac ()));
-        addEq (startE (symb (I)), bv::bvnum (chunk.start, ptrSz (), efac ()));
-        addEq (endE (symb (I)), bv::bvnum (chunk.end, ptrSz (), efac ()));
+        addAlloc (symb (I), m_sim.alloc (sz));
       }
       
       visitInstruction (*CS.getInstruction ());
@@ -271,10 +276,7 @@ namespace seahorn
         
       LOG ("memsim", errs () << "\n";);
       
-      auto &chunk = m_sim.alloc (sz);
-      addEq (oidE (symb (I)), bv::bvnum (chunk.id, ptrSz (), efac ()));
-      addEq (startE (symb (I)), bv::bvnum (chunk.start, ptrSz (), efac ()));
-      addEq (endE (symb (I)), bv::bvnum (chunk.end, ptrSz (), efac ()));
+      addAlloc (symb (I), m_sim.alloc (sz));
         
       // update size and pointer values
       visitInstruction (I);
@@ -286,11 +288,18 @@ namespace seahorn
       visitInstruction (I);
 
       Value *ptr = I.getPointerOperand ();
+      LOG ("memsim",
+           uint64_t addr;
+           if (toWord (m_sim.trace ().eval (m_loc, *ptr), addr))
+           {
+             const MemSimulator::AllocInfo *a = m_sim.findAlloc (addr);
+             errs () << "\tin allocation " << (a ? (int) a->id : -1) << "\n";
+           });
       // start(oid(ptr)) <= ptr
       add (mk<BULE> (startE (symb (*ptr)), symb (*ptr)));
       // ptr + storeSz <= end (oid (ptr))
 
-      Expr sz = bv::bvnum (storeSz (I.getType ()), ptrSz(), efac());
+      Expr sz = word (storeSz (I.getType ()));
       add (mk<BULE> (mk<BADD> (symb (*ptr), sz), endE (symb (*ptr))));
     }
     
@@ -302,7 +311,7 @@ namespace seahorn
       add (mk<BULE> (startE (symb (*ptr)), symb (*ptr)));
       
       // ptr + storeSz <= end (oid (ptr))
-      Expr sz = bv::bvnum (storeSz (I.getValueOperand ()->getType ()), ptrSz(), efac());
+      Expr sz = word (storeSz (I.getValueOperand ()->getType ()));
       add (mk<BULE> (mk<BADD> (symb (*ptr), sz), endE (symb (*ptr))));
     }      
     
@@ -334,10 +343,7 @@ namespace seahorn
       LOG ("memsim",
            errs () << "  ALLOCATION: " << sz << "\n";);
       // -- compute size of global based on size
-      auto &chunk = m_sim.alloc (sz);
-      addEq (oidE (symb (GV)), bv::bvnum (chunk.id, ptrSz (), efac ()));
-      addEq (startE (symb (GV)), bv::bvnum (chunk.start, ptrSz (), efac ()));
-      addEq (endE (symb (GV)), bv::bvnum (chunk.end, ptrSz (), efac ()));
+      addAlloc (symb (GV), m_sim.alloc (sz));
 
       
       LOG ("memsim",
@@ -347,19 +353,38 @@ namespace seahorn
     }
   };
   
-  const MemSimulator::AllocInfo &MemSimulator::alloc (unsigned sz)
+  const MemSimulator::AllocInfo &MemSimulator::alloc (uint64_t sz)
   {
-    unsigned start = m_allocs.empty () ? m_intMemStart : m_allocs.back ().end;
-    AllocInfo *last = nullptr;
+    uint64_t start = m_allocs.empty () ? m_intMemStart : m_allocs.back ().end;
+    unsigned bits = m_dl.getPointerSizeInBits ();
+    uint64_t limit = bits >= 64 ? ~uint64_t (0) : (uint64_t (1) << bits) - 1;
     
     m_allocs.push_back (AllocInfo());
     AllocInfo &n = m_allocs.back ();
     
     n.id = m_allocs.size ();
     n.start = start;
-    n.end = n.start + sz;
+    if (start > limit || sz > limit - start)
+    {
+      // -- keep the chunks ordered, the simulation fails anyway
+      m_overflow = true;
+      n.end = limit;
+    }
+    else
+      n.end = n.start + sz;
     return n;
   }
+
+  const MemSimulator::AllocInfo *MemSimulator::findAlloc (uint64_t addr) const
+  {
+    // -- the last chunk that starts at or before addr
+    auto it = std::upper_bound (m_allocs.begin (), m_allocs.end (), addr,
+                                [] (uint64_t a, const AllocInfo &c)
+                                { return a < c.start; });
+    if (it == m_allocs.begin ()) return nullptr;
+    --it;
+    return addr < it->end ? &*it : nullptr;
+  }
   
   bool MemSimulator::simulate ()
   {
@@ -382,7 +407,14 @@ namespace seahorn
       v.visit (const_cast<BasicBlock*> (bb));
       last = bb;
     }
-    
+
+    if (m_overflow)
+    {
+      LOG ("memsim",
+           errs () << "Memory simulation: allocations do not fit "
+           << "in the address space\n";);
+      return false;
+    }
     
     ZSolver<EZ3> solver (zctx ());
     LOG ("memsim",
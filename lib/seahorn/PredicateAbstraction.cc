@@ -6,6 +6,8 @@
 
 #include "seahorn/HornDbModel.hh"
 #include "seahorn/HornModelConverter.hh"
+#include "seahorn/Analysis/CutPointGraph.hh"
+#include "seahorn/Bmc.hh"
 
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
@@ -15,11 +17,38 @@
 #include "ufo/Smt/EZ3.hh"
 #include <vector>
 #include <boost/logic/tribool.hpp>
+#include "boost/range/algorithm/reverse.hpp"
 #include "seahorn/HornClauseDBWto.hh"
+#include "seahorn/FunctionAnalysisCache.hh"
 #include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
 
 #include "ufo/Stats.hh"
 
+static llvm::cl::opt<unsigned>
+PabsRefinements("horn-pabs-refinements",
+                llvm::cl::desc("Maximal number of refinements of the predicates on spurious counterexamples"),
+                llvm::cl::init(0));
+
+static llvm::cl::opt<std::string>
+PabsTemplates("horn-pabs-templates",
+              llvm::cl::desc("File of the candidate templates of predicate abstraction, "
+                             "one OP,VALUE per line"),
+              llvm::cl::init("/home/chenguang/Desktop/seahorn/test/pabs-experiment/preds_temp"));
+
+static llvm::cl::opt<bool>
+PabsAllSat("horn-pabs-allsat",
+           llvm::cl::desc("Abstract each rule by enumerating the assignments of its predicates"),
+           llvm::cl::init(false));
+
+static llvm::cl::opt<unsigned>
+PabsAllSatLimit("horn-pabs-allsat-limit",
+                llvm::cl::desc("Maximal number of assignments enumerated for one rule, "
+                               "beyond which it keeps its constraint"),
+                llvm::cl::init(1000));
+
 using namespace llvm;
 
 namespace seahorn
@@ -29,6 +58,7 @@ namespace seahorn
   bool PredicateAbstraction::runOnModule (Module &M)
   {
     HornifyModule &hm = getAnalysis<HornifyModule> ();
+    expr::ExprProfileScope _p ("PredicateAbstraction");
     PredicateAbstractionAnalysis pabs(hm);
 
     Stats::resume ("Pabs solve");
@@ -47,37 +77,55 @@ namespace seahorn
     HornClauseDB new_db(db.getExprFactory());
     pabs.generateAbstractDB(db, new_db, converter);
 
-    //initialize spacer based on new DB
-    m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
-    ZFixedPoint<EZ3> &fp = *m_fp;
-    ZParams<EZ3> params (hm.getZContext ());
-    params.set (":engine", "spacer");
-    // -- disable slicing so that we can use cover
-    params.set (":xform.slice", false);
-    params.set (":use_heavy_mev", true);
-    params.set (":reset_obligation_queue", true);
-    params.set (":pdr.flexible_trace", false);
-    params.set (":xform.inline-linear", false);
-    params.set (":xform.inline-eager", false);
-    // -- disable utvpi. It is unstable.
-    params.set (":pdr.utvpi", false);
-    // -- disable propagate_variable_equivalences in tail_simplifier
-    params.set (":xform.tail_simplifier_pve", false);
-    params.set (":xform.subsumption_checker", true);
-    //		params.set (":order_children", true);
-    //		params.set (":pdr.max_num_contexts", "500");
-    fp.set (params);
-    new_db.loadZFixedPoint (fp, false);
-    boost::tribool result = fp.query ();
-
-    LOG("pabs-smt2", outs() << "SMT2: " << fp << "\n";);
+    boost::tribool result = boost::indeterminate;
+    for(unsigned round = 0; ; round++)
+    {
+      //initialize spacer based on new DB
+      m_fp.reset (new ZFixedPoint<EZ3> (hm.getZContext ()));
+      ZFixedPoint<EZ3> &fp = *m_fp;
+      ZParams<EZ3> params (hm.getZContext ());
+      params.set (":engine", "spacer");
+      // -- disable slicing so that we can use cover
+      params.set (":xform.slice", false);
+      params.set (":use_heavy_mev", true);
+      params.set (":reset_obligation_queue", true);
+      params.set (":pdr.flexible_trace", false);
+      params.set (":xform.inline-linear", false);
+      params.set (":xform.inline-eager", false);
+      // -- disable utvpi. It is unstable.
+      params.set (":pdr.utvpi", false);
+      // -- disable propagate_variable_equivalences in tail_simplifier
+      params.set (":xform.tail_simplifier_pve", false);
+      params.set (":xform.subsumption_checker", true);
+      //		params.set (":order_children", true);
+      //		params.set (":pdr.max_num_contexts", "500");
+      fp.set (params);
+      new_db.loadZFixedPoint (fp, false);
+      result = fp.query ();
+
+      LOG("pabs-smt2", outs() << "SMT2: " << fp << "\n";);
+
+      // -- only a counterexample of the abstraction can be spurious
+      if (result) ; else break;
+      if (round >= PabsRefinements) break;
+
+      std::map<Expr, ExprVector> preds;
+      boost::tribool feasible = checkCex (M, pabs, preds);
+      if (feasible) break;
+      // -- spurious, but the predicates cannot exclude it
+      if (boost::indeterminate (feasible) || !pabs.refine (db, new_db, converter, preds))
+      {
+        result = boost::indeterminate;
+        break;
+      }
+    }
 
     if (result) outs () << "sat";
     else if (!result)
     {
       outs() << "unsat\n";
       HornDbModel absModel;
-      initDBModelFromFP(absModel, new_db, fp);
+      initDBModelFromFP(absModel, new_db, *m_fp);
 
       converter.convert(absModel, oldModel);
       LOG("pabs-debug", outs() << "FINAL RESULT:\n";);
@@ -94,9 +142,80 @@ namespace seahorn
   void PredicateAbstraction::getAnalysisUsage (AnalysisUsage &AU) const
   {
     AU.addRequired<HornifyModule> ();
+    AU.addRequired<FunctionAnalysisCache> ();
     AU.setPreservesAll();
   }
 
+  boost::tribool PredicateAbstraction::checkCex (Module &M, PredicateAbstractionAnalysis &pabs,
+                                                 std::map<Expr, ExprVector> &preds)
+  {
+    Function *F = M.getFunction ("main");
+    if (!F || F->isDeclaration ()) return boost::indeterminate;
+
+    HornifyModule &hm = getAnalysis<HornifyModule> ();
+    const CutPointGraph &cpg = getAnalysis<FunctionAnalysisCache> ().cpg (*F);
+
+    ExprVector rules;
+    m_fp->getCexRules (rules);
+    boost::reverse (rules);
+
+    // -- cutpoints of main along the counterexample, as in HornCex
+    SmallVector<const CutPoint*, 8> cpTrace;
+    cpTrace.push_back (&cpg.getCp (F->getEntryBlock ()));
+    for (Expr r : rules)
+    {
+      Expr dst = isOpX<IMPL> (r) ? r->arg (1) : r;
+      if (!bind::isFapp (dst)) continue;
+      Expr rel = pabs.getOrigRel (bind::fname (dst));
+      if (!rel || !hm.isBbPredicate (rel)) continue;
+      const BasicBlock &bb = hm.predicateBb (rel);
+      if (bb.getParent () != F || &bb == &F->getEntryBlock ()) continue;
+      if (cpg.isCutPoint (bb)) cpTrace.push_back (&cpg.getCp (bb));
+    }
+
+    BmcEngine bmc (hm.symExec (), hm.getZContext ());
+    for (const CutPoint *cp : cpTrace) bmc.addCutPoint (*cp);
+    boost::tribool res = bmc.solve ();
+    if (res || boost::indeterminate (res)) return res;
+    LOG ("pabs", errs () << "spurious counterexample over "
+         << cpTrace.size () << " cutpoints\n";);
+
+    ExprVector core;
+    bmc.unsatCore (core);
+    ExprVector atoms;
+    for (Expr c : core)
+      expr::filter (c, [] (Expr e) {return isOp<ComparissonOp> (e);}, std::back_inserter (atoms));
+
+    // -- the atoms over the values of the live variables of a
+    // -- cutpoint are predicates of its relation
+    for (unsigned i = 1; i < cpTrace.size (); ++i)
+    {
+      const BasicBlock &bb = cpTrace [i]->bb ();
+      Expr rel = hm.bbPredicate (bb);
+      const ExprVector &live = hm.live (bb);
+      SymStore &s = bmc.state (i);
+
+      ExprMap valToBvar;
+      for (unsigned j = 0; j < live.size (); ++j)
+      {
+        Expr v = s.at (live [j]);
+        if (v) valToBvar [v] = bind::bvar (j, bind::domainTy (rel, j));
+      }
+
+      for (Expr a : atoms)
+      {
+        Expr p = replace (a, valToBvar);
+        if (p == a) continue;
+        ExprVector consts;
+        expr::filter (p, bind::IsConst (), std::back_inserter (consts));
+        if (!consts.empty ()) continue;
+        ExprVector &out = preds [rel];
+        if (std::find (out.begin (), out.end (), p) == out.end ()) out.push_back (p);
+      }
+    }
+    return false;
+  }
+
   void PredicateAbstraction::printInvars (Module &M, HornDbModel &origModel)
   {
     for (auto &F : M) printInvars (F, origModel);
@@ -154,142 +273,165 @@ namespace seahorn
   {
     //For each relation, generate its abstract version
     for(Expr rel : db.getRelations())
+      generateAbstractRelation(rel, new_DB, converter);
+    converter.setNewToOldPredMap(m_newToOldPredMap); //set converter
+  }
+
+  void PredicateAbstractionAnalysis::generateAbstractRelation(Expr rel, HornClauseDB &new_DB, PredAbsHornModelConverter &converter)
+  {
+    LOG("pabs-debug", outs() << "OLD REL: " << *rel << "\n";);
+    ExprVector new_args;
+
+    Expr old_fdecl_name = bind::fname(rel);
+    //new pred name. A refined relation is a new variant of it
+    std::string postfix = "pabs";
+    Expr new_fdecl_name = variant::tag(old_fdecl_name, postfix);
+    if(m_refinements > 0) new_fdecl_name = variant::variant(m_refinements, new_fdecl_name);
+    new_args.push_back(new_fdecl_name);
+    //Push boolean types
+    const ExprVector &term_vec = m_currentCandidates.find(rel)->second;
+    if(!isTrivialCand(rel))
     {
-      LOG("pabs-debug", outs() << "OLD REL: " << *rel << "\n";);
-      ExprVector new_args;
-
-      Expr old_fdecl_name = bind::fname(rel);
-      //new pred name
-      std::string postfix = "pabs";
-      Expr new_fdecl_name = variant::tag(old_fdecl_name, postfix);
-      new_args.push_back(new_fdecl_name);
-      //Push boolean types
-      ExprVector term_vec = m_currentCandidates.find(rel)->second;
-      if(term_vec.size() > 1 || (term_vec.size() == 1 && !isOpX<TRUE>(term_vec[0])))
+      for(int i=0; i<term_vec.size(); i++)
       {
-        for(int i=0; i<term_vec.size(); i++)
-        {
-          new_args.push_back(mk<BOOL_TY>(rel->efac()));
-        }
+        new_args.push_back(mk<BOOL_TY>(rel->efac()));
       }
-      else // the candidate term is just 'true' or 'false'
+    }
+    else // the candidate term is just 'true' or 'false'
+    {
+      for (int i=0; i<bind::domainSz(rel); i++ )
       {
-        for (int i=1; i<=bind::domainSz(rel); i++ )
-        {
-          new_args.push_back(bind::domainTy(rel, i));
-        }
+        new_args.push_back(bind::domainTy(rel, i));
       }
-      //Push return type
-      new_args.push_back(bind::rangeTy(rel));
-      Expr new_rel = mknary<FDECL>(new_args);
+    }
+    //Push return type
+    new_args.push_back(bind::rangeTy(rel));
+    Expr new_rel = mknary<FDECL>(new_args);
 
-      LOG("pabs-debug", outs() << "NEW REL: " << *new_rel << "\n";);
-      new_DB.registerRelation(new_rel);
+    LOG("pabs-debug", outs() << "NEW REL: " << *new_rel << "\n";);
+    new_DB.registerRelation(new_rel);
 
-      m_oldToNewPredMap.insert(std::make_pair(rel, new_rel));
-      m_newToOldPredMap.insert(std::make_pair(new_rel, rel));
+    m_oldToNewPredMap[rel] = new_rel;
+    m_newToOldPredMap[new_rel] = rel;
+
+    //bvars of the candidate, instantiated by every application of rel
+    ExprSet bvars;
+    for(Expr term : term_vec) get_all_bvars(term, std::inserter(bvars, bvars.end()));
+    m_candBvars[rel].assign(bvars.begin(), bvars.end());
+
+    //for converter
+    if(bind::domainSz(rel) != 0 && !isTrivialCand(rel))
+    {
+      ExprMap boolToTermMap;
+      for(unsigned index = 0; index < term_vec.size(); index++)
+        boolToTermMap.insert(std::make_pair(bind::bvar(index, mk<BOOL_TY>(rel->efac())), term_vec[index]));
+      converter.addRelToBoolToTerm(rel, boolToTermMap);
     }
-    converter.setNewToOldPredMap(m_newToOldPredMap); //set converter
   }
 
-  void PredicateAbstractionAnalysis::generateAbstractRules(HornClauseDB &db, HornClauseDB &new_DB, PredAbsHornModelConverter &converter)
+  bool PredicateAbstractionAnalysis::isTrivialCand(Expr rel) const
   {
-    for(HornClauseDB::RuleVector::iterator it = db.getRules().begin(); it != db.getRules().end(); ++it)
-    {
-      HornRule r = *it;
-      LOG("pabs-debug", outs() << "OLD RULE HEAD: " << *(r.head()) << "\n";);
-      LOG("pabs-debug", outs() << "OLD RULE BODY: " << *(r.body()) << "\n";);
+    const ExprVector &term_vec = m_currentCandidates.find(rel)->second;
+    return !(term_vec.size() > 1 || (term_vec.size() == 1 && !isOpX<TRUE>(term_vec[0])));
+  }
 
-      //old rule variables
-      ExprVector rule_vars;
-      rule_vars.insert(rule_vars.end(), r.vars().begin(), r.vars().end());
+  HornRule PredicateAbstractionAnalysis::generateAbstractRule(const HornRule &r, HornClauseDB &db) const
+  {
+    LOG("pabs-debug", outs() << "OLD RULE HEAD: " << *(r.head()) << "\n";);
+    LOG("pabs-debug", outs() << "OLD RULE BODY: " << *(r.body()) << "\n";);
 
-      //Map for counting occurrence time for each relation in per rule
-      std::map<Expr, int> relOccurrenceTimesMap;
+    //old rule variables
+    ExprVector rule_vars;
+    rule_vars.insert(rule_vars.end(), r.vars().begin(), r.vars().end());
 
-      ExprVector pred_vector;
-      get_all_pred_apps(r.body(), db, std::back_inserter(pred_vector));
-      pred_vector.push_back(r.head());
+    //Map for counting occurrence time for each relation in per rule
+    std::map<Expr, int> relOccurrenceTimesMap;
 
-      //Deal with the rules that have no predicates
-      if(!hasBvarInRule(r, db, m_currentCandidates))
-      {
-        ExprMap replaceMap;
-        for(Expr pred : pred_vector)
-        {
-          Expr new_fdecl = m_oldToNewPredMap.find(bind::fname(pred))->second;
-          Expr new_pred = bind::reapp(pred, new_fdecl);
-          replaceMap.insert(std::make_pair(pred, new_pred));
-        }
-        Expr new_head = replace(r.head(), replaceMap);
-        Expr new_body = replace(r.body(), replaceMap);
-        HornRule new_rule(r.vars(), new_head, new_body);
-        new_DB.addRule(new_rule);
-        continue;
-      }
+    ExprVector pred_vector;
+    r.pred_apps(db, std::back_inserter(pred_vector));
+    pred_vector.push_back(r.head());
 
-      //initialize the occurrence count map
-      for(ExprVector::iterator it = pred_vector.begin(); it!= pred_vector.end(); ++it)
+    //Deal with the rules that have no predicates
+    if(!hasBvarInRule(r, db, m_currentCandidates))
+    {
+      ExprMap replaceMap;
+      for(Expr pred : pred_vector)
       {
-        relOccurrenceTimesMap.insert(std::make_pair(bind::fname(*it), 0));
+        Expr new_fdecl = m_oldToNewPredMap.find(bind::fname(pred))->second;
+        Expr new_pred = bind::reapp(pred, new_fdecl);
+        replaceMap.insert(std::make_pair(pred, new_pred));
       }
+      Expr new_head = replace(r.head(), replaceMap);
+      Expr new_body = replace(r.body(), replaceMap);
+      return HornRule(r.vars(), new_head, new_body);
+    }
+
+    //initialize the occurrence count map
+    for(ExprVector::iterator it = pred_vector.begin(); it!= pred_vector.end(); ++it)
+    {
+      relOccurrenceTimesMap.insert(std::make_pair(bind::fname(*it), 0));
+    }
 
-      //construct new body
-      ExprVector new_body_exprs;
+    //construct new body
+    ExprVector new_body_exprs;
 
-      //For each predicate in the body, construct new version of predicate.
-      Expr rule_body = r.body();
-      ExprVector body_pred_apps;
-      get_all_pred_apps(rule_body, db, std::back_inserter(body_pred_apps));
-      for(ExprVector::iterator it = body_pred_apps.begin(); it != body_pred_apps.end(); ++it)
+    //For each predicate in the body, construct new version of predicate.
+    ExprVector body_pred_apps;
+    r.pred_apps(db, std::back_inserter(body_pred_apps));
+    for(ExprVector::iterator it = body_pred_apps.begin(); it != body_pred_apps.end(); ++it)
+    {
+      Expr rule_body_pred = *it;
+      Expr new_rule_body_rel = m_oldToNewPredMap.find(bind::fname(rule_body_pred))->second;
+      if(isTrivialCand(bind::fname(rule_body_pred)))
       {
-        Expr rule_body_pred = *it;
-        Expr new_rule_body_rel = m_oldToNewPredMap.find(bind::fname(rule_body_pred))->second;
-
-        int pred_order = relOccurrenceTimesMap.find(bind::fname(rule_body_pred))->second;
-        relOccurrenceTimesMap[bind::fname(rule_body_pred)] += 1;
+        new_body_exprs.push_back(bind::reapp(rule_body_pred, new_rule_body_rel));
+        continue;
+      }
 
-        ExprVector new_rule_body_args;
-        //Push boolean variables into arguments of new predicate
+      int pred_order = relOccurrenceTimesMap.find(bind::fname(rule_body_pred))->second;
+      relOccurrenceTimesMap[bind::fname(rule_body_pred)] += 1;
 
-        for(int i=0; i<bind::domainSz(new_rule_body_rel); i++)
-        {
-          Expr var_tag = variant::variant(pred_order, variant::variant(i, variant::tag(bind::fname(new_rule_body_rel), mkTerm<std::string> ("p", new_rule_body_rel->efac ())))); //noprime
-          Expr boolVar = bind::boolConst(var_tag);
-          rule_vars.push_back(boolVar);
-          new_rule_body_args.push_back(boolVar);
-        }
+      ExprVector new_rule_body_args;
+      //Push boolean variables into arguments of new predicate
 
-        Expr new_rule_body_pred = bind::fapp(new_rule_body_rel, new_rule_body_args);
-        new_body_exprs.push_back(new_rule_body_pred);
+      for(int i=0; i<bind::domainSz(new_rule_body_rel); i++)
+      {
+        Expr var_tag = variant::variant(pred_order, variant::variant(i, variant::tag(bind::fname(new_rule_body_rel), mkTerm<std::string> ("p", new_rule_body_rel->efac ())))); //noprime
+        Expr boolVar = bind::boolConst(var_tag);
+        rule_vars.push_back(boolVar);
+        new_rule_body_args.push_back(boolVar);
+      }
 
-        //for each predicate in the body, create iff
-        if(bind::domainSz(bind::fname(new_rule_body_pred)) == 0)
-        {
-          continue;
-        }
-        int index = 0;
-        //for converter
-        ExprMap boolToTermMap;
-        for(Expr term : m_currentCandidates.find(bind::fname(*it))->second)
-        {
-          Expr term_app = applyArgsToBvars(term, *it, m_currentCandidates);
-          Expr equal_expr = mk<IFF>(new_rule_body_pred->arg(index + 1), term_app);
-          //converter
-          boolToTermMap.insert(std::make_pair(bind::bvar(index, mk<BOOL_TY>(term_app->efac())), term));
+      Expr new_rule_body_pred = bind::fapp(new_rule_body_rel, new_rule_body_args);
+      new_body_exprs.push_back(new_rule_body_pred);
 
-          new_body_exprs.push_back(equal_expr);
-          index ++;
-        }
-        converter.addRelToBoolToTerm(bind::fname(*it), boolToTermMap);
-        //converter.getRelToBoolToTermMap().insert(std::pair<Expr, ExprMap>(bind::fname(*it), boolToTermMap));
+      //for each predicate in the body, create iff
+      if(bind::domainSz(bind::fname(new_rule_body_pred)) == 0)
+      {
+        continue;
+      }
+      int index = 0;
+      ExprMap bvar_map = getBvarsToArgsMap(*it);
+      DagVisitMemo memo(rule_body_pred->efac());
+      for(Expr term : m_currentCandidates.find(bind::fname(*it))->second)
+      {
+        Expr term_app = replace(term, bvar_map, memo);
+        Expr equal_expr = mk<IFF>(new_rule_body_pred->arg(index + 1), term_app);
+        new_body_exprs.push_back(equal_expr);
+        index ++;
       }
+    }
 
-      Expr rule_head = r.head();
+    Expr rule_head = r.head();
 
-      //construct new rule head.
-      Expr new_rule_head_rel = m_oldToNewPredMap.find(bind::fname(rule_head))->second;
+    //construct new rule head.
+    Expr new_rule_head_rel = m_oldToNewPredMap.find(bind::fname(rule_head))->second;
+    Expr new_rule_head;
 
+    if(isTrivialCand(bind::fname(rule_head)))
+      new_rule_head = bind::reapp(rule_head, new_rule_head_rel);
+    else
+    {
       ExprVector new_rule_head_args;
       int pred_order = relOccurrenceTimesMap.find(bind::fname(rule_head))->second;
       relOccurrenceTimesMap[bind::fname(rule_head)] += 1;
@@ -300,42 +442,216 @@ namespace seahorn
         rule_vars.push_back(boolVar);
         new_rule_head_args.push_back(boolVar);
       }
+      new_rule_head = bind::fapp(new_rule_head_rel, new_rule_head_args);
+
+      //construct head equality expr, put in new body
+      int index = 0;
+      ExprMap bvar_map = getBvarsToArgsMap(rule_head);
+      DagVisitMemo memo(rule_head->efac());
+      for(Expr term : m_currentCandidates.find(bind::fname(rule_head))->second)
+      {
+        Expr term_app = replace(term, bvar_map, memo);
+        Expr equal_expr = mk<IFF>(new_rule_head->arg(index + 1), term_app);
+        new_body_exprs.push_back(equal_expr);
+        index ++;
+      }
+    }
+    LOG("pabs-debug", outs() << "NEW RULE HEAD: " << *new_rule_head << "\n";);
+
+    //Extract the constraints
+    Expr constraints = extractTransitionRelation(r, db);
+    new_body_exprs.push_back(constraints);
+
+    //Construct new body
+    Expr new_rule_body = mknary<AND>(new_body_exprs.begin(), new_body_exprs.end());
+    LOG("pabs-debug", outs() << "NEW RULE BODY :" << *new_rule_body << "\n";);
+
+    return HornRule(rule_vars, new_rule_head, new_rule_body);
+  }
 
-      Expr new_rule_head = bind::fapp(new_rule_head_rel, new_rule_head_args);
-      LOG("pabs-debug", outs() << "NEW RULE HEAD: " << *new_rule_head << "\n";);
+  void PredicateAbstractionAnalysis::generateAbstractRules(HornClauseDB &db, HornClauseDB &new_DB, PredAbsHornModelConverter &converter)
+  {
+    std::vector<const HornRule*> &rules = m_rules;
+    rules.clear();
+    for(const HornRule &r : db.getRules()) rules.push_back(&r);
+
+    // -- rules are abstracted independently. The workers only read
+    // -- the maps built by generateAbstractRelations
+    unsigned threads = db.getExprFactory().isConcurrent() ? m_hm.getThreads() : 1;
+    std::vector<std::unique_ptr<HornRule> > new_rules(rules.size());
+    std::atomic<unsigned> next(0);
+    auto worker = [&] ()
+      {
+        for(unsigned k = next++; k < rules.size(); k = next++)
+          new_rules[k].reset(new HornRule(abstractRule(*rules[k], db)));
+      };
+    std::vector<std::thread> pool;
+    for(unsigned t = 1; t < std::min<size_t>(threads, rules.size()); ++t)
+      pool.emplace_back(worker);
+    worker();
+    for(std::thread &t : pool) t.join();
+
+    // -- in the order of db, whatever the number of threads
+    m_absRuleIds.clear();
+    for(auto &new_rule : new_rules) m_absRuleIds.push_back(new_DB.addRule(*new_rule));
+  }
 
+  HornRule PredicateAbstractionAnalysis::abstractRule(const HornRule &r, HornClauseDB &db)
+  {
+    HornRule absRule = generateAbstractRule(r, db);
+    if(!PabsAllSat) return absRule;
+    return allSatAbstractRule(absRule, m_contexts->local());
+  }
 
-      if(bind::domainSz(bind::fname(rule_head)) != 0)
+  HornRule PredicateAbstractionAnalysis::allSatAbstractRule(const HornRule &absRule, EZ3 &z3)
+  {
+    ExprFactory &efac = absRule.head()->efac();
+    auto isAbsApp = [this] (Expr e)
+      { return bind::isFapp(e) && m_newToOldPredMap.count(bind::fname(e)) > 0; };
+
+    //split the body into the applications and the constraint
+    ExprVector conj, apps, constraint;
+    Expr body = absRule.body();
+    if(isOpX<AND>(body)) conj.assign(body->args_begin(), body->args_end());
+    else conj.push_back(body);
+    for(Expr c : conj) (isAbsApp(c) ? apps : constraint).push_back(c);
+    if(!isAbsApp(absRule.head())) return absRule;
+
+    //the indicators, in the order of the applications, and their
+    //canonical names, so that rules with the same constraint share
+    //their abstraction
+    ExprVector lits, canon;
+    ExprMap toCanon, fromCanon;
+    ExprVector all(apps);
+    all.push_back(absRule.head());
+    for(Expr app : all)
+      for(unsigned i = 1; i < app->arity(); i++)
       {
-        //construct head equality expr, put in new body
-        int index = 0;
-        //for converter
-        ExprMap boolToTermMap;
-        for(Expr term : m_currentCandidates.find(bind::fname(rule_head))->second)
-        {
-          Expr term_app = applyArgsToBvars(term, rule_head, m_currentCandidates);
-          Expr equal_expr = mk<IFF>(new_rule_head->arg(index + 1), term_app);
-          //converter
-          boolToTermMap.insert(std::make_pair(bind::bvar(index, mk<BOOL_TY>(term_app->efac())), term));
+        Expr b = app->arg(i);
+        if(!bind::isBoolConst(b)) return absRule;
+        if(toCanon.count(b) > 0) continue;
+        Expr c = bind::boolConst(variant::variant(lits.size(), mkTerm<std::string>("pabs!b", efac)));
+        lits.push_back(b);
+        canon.push_back(c);
+        toCanon[b] = c;
+        fromCanon[c] = b;
+      }
+
+    Expr key = replace(mknary<AND>(mk<TRUE>(efac), constraint), toCanon);
+    Expr dnf;
+    {
+      std::lock_guard<std::mutex> l(m_allSatLock);
+      auto it = m_allSatCache.find(key);
+      if(it != m_allSatCache.end()) dnf = it->second;
+    }
 
-          new_body_exprs.push_back(equal_expr);
-          index ++;
+    if(dnf)
+    {
+      static StatsCounter &hits = Stats::counter("PabsAllSatCacheHits");
+      hits.inc();
+    }
+    else
+    {
+      //each model is an abstract transition, blocked once found
+      ExprVector cubes;
+      try
+      {
+        ZSolver<EZ3> solver(z3);
+        solver.assertExpr(key);
+        for(;;)
+        {
+          boost::tribool res = solver.solve();
+          if(!res) break;
+          if(boost::indeterminate(res) || cubes.size() >= PabsAllSatLimit)
+          {
+            static StatsCounter &failed = Stats::counter("PabsAllSatGaveUp");
+            failed.inc();
+            return absRule;
+          }
+
+          ZModel<EZ3> m = solver.getModel();
+          ExprVector cube;
+          for(Expr c : canon) cube.push_back(isOpX<TRUE>(m.eval(c, true)) ? c : mk<NEG>(c));
+          cubes.push_back(mknary<AND>(mk<TRUE>(efac), cube));
+          solver.assertExpr(mk<NEG>(cubes.back()));
         }
-        converter.addRelToBoolToTerm(bind::fname(rule_head), boolToTermMap);
-        //converter.getRelToBoolToTermMap().insert(std::pair<Expr, ExprMap>(bind::fname(rule_head), boolToTermMap));
       }
+      catch(z3::exception &e)
+      {
+        LOG("pabs", errs() << "All-SAT failed: " << e.msg() << "\n";);
+        return absRule;
+      }
+      dnf = mknary<OR>(mk<FALSE>(efac), cubes);
 
-      //Extract the constraints
-      Expr constraints = extractTransitionRelation(r, db);
-      new_body_exprs.push_back(constraints);
+      static StatsCounter &transitions = Stats::counter("PabsAllSatCubes");
+      transitions.inc(cubes.size());
+      std::lock_guard<std::mutex> l(m_allSatLock);
+      m_allSatCache[key] = dnf;
+    }
 
-      //Construct new body
-      Expr new_rule_body = mknary<AND>(new_body_exprs.begin(), new_body_exprs.end());
-      LOG("pabs-debug", outs() << "NEW RULE BODY :" << *new_rule_body << "\n";);
+    ExprVector new_body(apps);
+    new_body.push_back(replace(dnf, fromCanon));
+    return HornRule(lits, absRule.head(), mknary<AND>(new_body.begin(), new_body.end()));
+  }
 
-      HornRule new_rule(rule_vars, new_rule_head, new_rule_body);
-      new_DB.addRule(new_rule);
+  bool PredicateAbstractionAnalysis::refine(HornClauseDB &db, HornClauseDB &new_DB, PredAbsHornModelConverter &converter,
+                                            const std::map<Expr, ExprVector> &preds)
+  {
+    //add the new predicates to the candidates
+    ExprSet refined;
+    ExprSet queryRels;
+    for(Expr q : db.getQueries()) queryRels.insert(bind::fname(q));
+    for(auto &kv : preds)
+    {
+      Expr rel = kv.first;
+      // -- queries refer to the abstract relation, keep it
+      if(!db.hasRelation(rel) || queryRels.count(rel) > 0) continue;
+      ExprVector &terms = m_currentCandidates[rel];
+      for(Expr p : kv.second)
+      {
+        if(std::find(terms.begin(), terms.end(), p) != terms.end()) continue;
+        if(terms.size() == 1 && isOpX<TRUE>(terms[0])) terms.clear();
+        terms.push_back(p);
+        refined.insert(rel);
+      }
     }
+    if(refined.empty()) return false;
+    m_refinements++;
+    Stats::count("PabsRefinements");
+
+    ExprVector oldAbsRels;
+    for(Expr rel : refined)
+    {
+      oldAbsRels.push_back(m_oldToNewPredMap[rel]);
+      m_newToOldPredMap.erase(oldAbsRels.back());
+      generateAbstractRelation(rel, new_DB, converter);
+    }
+
+    //re-abstract the rules the refined relations appear in
+    for(unsigned k = 0; k < m_rules.size(); k++)
+    {
+      const HornRule &r = *m_rules[k];
+      ExprVector pred_vector;
+      r.pred_apps(db, std::back_inserter(pred_vector));
+      pred_vector.push_back(r.head());
+      bool touched = false;
+      for(Expr pred : pred_vector) touched = touched || refined.count(bind::fname(pred)) > 0;
+      if(!touched) continue;
+
+      new_DB.removeRule(m_absRuleIds[k]);
+      m_absRuleIds[k] = new_DB.addRule(abstractRule(r, db));
+    }
+    for(Expr absRel : oldAbsRels) new_DB.removeRelation(absRel);
+
+    LOG("pabs-debug", outs() << "REFINED DB: \n" << new_DB << "\n";);
+    converter.setNewToOldPredMap(m_newToOldPredMap);
+    return true;
+  }
+
+  Expr PredicateAbstractionAnalysis::getOrigRel(Expr absRel) const
+  {
+    auto it = m_newToOldPredMap.find(absRel);
+    return it == m_newToOldPredMap.end() ? Expr() : it->second;
   }
 
   void PredicateAbstractionAnalysis::generateAbstractQueries(HornClauseDB &db, HornClauseDB &new_DB)
@@ -352,57 +668,45 @@ namespace seahorn
 
   void PredicateAbstractionAnalysis::guessCandidate(HornClauseDB &db)
   {
+    // -- the file is parsed once, for all relations
+    CandidateTemplates templates(db.getExprFactory());
+    templates.load(PabsTemplates);
+
+    ExprVector rels;
     for(Expr rel : db.getRelations())
-    {
-      if(bind::isFdecl(rel))
-      {
-        //ExprVector terms = relToCand(rel);
-        ExprVector terms = applyTemplatesFromExperimentFile(rel, "/home/chenguang/Desktop/seahorn/test/pabs-experiment/preds_temp");
-        m_currentCandidates.insert(std::make_pair(rel, terms));
-      }
-    }
+      if(bind::isFdecl(rel)) rels.push_back(rel);
+    std::vector<ExprVector> terms;
+    templates.applyAll(rels, terms, m_hm.getThreads());
+    for(unsigned i = 0; i < rels.size(); i++)
+      m_currentCandidates.insert(std::make_pair(rels[i], terms[i]));
   }
 
-  Expr PredicateAbstractionAnalysis::applyArgsToBvars(Expr cand, Expr fapp, std::map<Expr, ExprVector> currentCandidates)
+  Expr PredicateAbstractionAnalysis::applyArgsToBvars(Expr cand, Expr fapp) const
   {
-    ExprMap bvar_map = getBvarsToArgsMap(fapp, currentCandidates);
+    ExprMap bvar_map = getBvarsToArgsMap(fapp);
     return replace(cand, bvar_map);
   }
 
-  ExprMap PredicateAbstractionAnalysis::getBvarsToArgsMap(Expr fapp, std::map<Expr, ExprVector> currentCandidates)
+  ExprMap PredicateAbstractionAnalysis::getBvarsToArgsMap(Expr fapp) const
   {
-    Expr fdecl = bind::fname(fapp);
-    ExprVector terms = currentCandidates[fdecl];
-    Expr cand;
-    if(terms.size() == 1)
-    {
-      cand = currentCandidates[fdecl][0];
-    }
-    else if(terms.size() > 1)
-    {
-      cand = mknary<AND>(terms.begin(), terms.end());
-    }
-    else
-    {
-      errs() << "terms size wrong!\n";
-      assert(false);
-    }
+    auto it = m_candBvars.find(bind::fname(fapp));
+    assert(it != m_candBvars.end());
 
     ExprMap bvar_map;
-    ExprVector bvars;
-    get_all_bvars(cand, std::back_inserter(bvars));
-
-    for(ExprVector::iterator it = bvars.begin(); it != bvars.end(); ++it)
+    for(Expr bvar : it->second)
     {
-      unsigned bvar_id = bind::bvarId(*it);
+      unsigned bvar_id = bind::bvarId(bvar);
       Expr app_arg = fapp->arg(bvar_id + 1);// To improve
-      bvar_map.insert(std::make_pair(*it, app_arg));
+      bvar_map.insert(std::make_pair(bvar, app_arg));
     }
     return bvar_map;
   }
 
   bool PredAbsHornModelConverter::convert (HornDbModel &in, HornDbModel &out)
   {
+    // -- each definition is converted when first queried. The
+    // -- converter does not outlive the analysis, the definitions may
+    std::shared_ptr<HornDbModel> src = std::make_shared<HornDbModel> (in);
     for(Expr abs_rel : m_abs_db->getRelations())
     {
       LOG("pabs-debug", outs() << "ABS REL: " << *abs_rel << "\n";);
@@ -410,48 +714,6 @@ namespace seahorn
       Expr orig_rel = m_newToOldPredMap.find(abs_rel)->second;
       LOG("pabs-debug", outs() << "ORIG REL: " << *orig_rel << "\n";);
 
-      ExprVector abs_arg_list;
-      for(int i=0; i<bind::domainSz(abs_rel); i++)
-      {
-        Expr boolVar = bind::boolConst(variant::variant(i, mkTerm<std::string>("b", orig_rel->efac())));
-        abs_arg_list.push_back(boolVar);
-      }
-      Expr abs_rel_app = bind::fapp(abs_rel, abs_arg_list);
-      LOG("pabs-debug", outs() << "ABS REL APP: " << *abs_rel_app << "\n";);
-
-      Expr abs_def_app = in.getDef(abs_rel_app);
-      LOG("pabs-debug", outs() << "ABS DEF APP: " << *abs_def_app << "\n";);
-
-      ExprMap boolVarToBvarMap;
-      ExprVector bools;
-      get_all_booleans(abs_def_app, std::back_inserter(bools));
-      for(Expr boolvar: bools)
-      {
-        Expr bool_bvar = bind::boolBVar(variant::variantNum(bind::fname(bind::fname(boolvar))), boolvar->efac());
-        boolVarToBvarMap.insert(std::make_pair(boolvar, bool_bvar));
-      }
-      Expr abs_def = replace(abs_def_app, boolVarToBvarMap);
-      LOG("pabs-debug", outs() << "ABS DEF: " << *abs_def << "\n";);
-
-      Expr orig_def;
-      if(isOpX<TRUE>(abs_def) || isOpX<FALSE>(abs_def))
-      {
-        orig_def = abs_def;
-      }
-      else
-      {
-        ExprMap abs_bvar_to_term_map;
-        ExprVector abs_bvars;
-        get_all_bvars(abs_def, std::back_inserter(abs_bvars));
-        for(Expr abs_bvar : abs_bvars)
-        {
-          Expr term = (getRelToBoolToTermMap().find(orig_rel)->second).find(abs_bvar)->second;
-          abs_bvar_to_term_map.insert(std::make_pair(abs_bvar, term));
-        }
-        orig_def = replace(abs_def, abs_bvar_to_term_map);
-      }
-      LOG("pabs-debug", outs() << "ORIG DEF: " << *orig_def << "\n";);
-
       ExprVector orig_fapp_args;
       for(int i=0; i<bind::domainSz(orig_rel); i++)
       {
@@ -462,19 +724,73 @@ namespace seahorn
       Expr orig_fapp = bind::fapp(orig_rel, orig_fapp_args);
       LOG("pabs-debug", outs() << "ORIG FAPP: " << *orig_fapp << "\n";);
 
-      ExprVector bvars;
-      get_all_bvars(orig_def, std::back_inserter(bvars));
-      ExprMap bvarIdMap;
-      for(Expr bvar : bvars)
+      //relations with a trivial candidate keep their arguments
+      if(getRelToBoolToTermMap().count(orig_rel) == 0)
       {
-        int bvar_id = bind::bvarId(bvar);
-        Expr bvar_type = bind::typeOf(bvar);
-        Expr var = bind::fapp(bind::constDecl(variant::variant(bvar_id, mkTerm<std::string> ("V", bvar->efac ())), bvar_type));
-        bvarIdMap.insert(std::make_pair(bvar, var));
+        Expr abs_fapp = bind::reapp(orig_fapp, abs_rel);
+        out.addLazyDef(orig_fapp, [src, abs_fapp] () { return src->getDef(abs_fapp); });
+        continue;
       }
-      Expr orig_def_app = replace(orig_def, bvarIdMap);
-      LOG("pabs-debug", outs() << "ORIG DEF APP: " << *orig_def_app << "\n";);
-      out.addDef(orig_fapp, orig_def_app);
+
+      ExprMap boolToTerm = getRelToBoolToTermMap().find(orig_rel)->second;
+      out.addLazyDef(orig_fapp, [src, abs_rel, orig_rel, boolToTerm] ()
+      {
+        ExprVector abs_arg_list;
+        for(int i=0; i<bind::domainSz(abs_rel); i++)
+        {
+          Expr boolVar = bind::boolConst(variant::variant(i, mkTerm<std::string>("b", orig_rel->efac())));
+          abs_arg_list.push_back(boolVar);
+        }
+        Expr abs_rel_app = bind::fapp(abs_rel, abs_arg_list);
+        LOG("pabs-debug", outs() << "ABS REL APP: " << *abs_rel_app << "\n";);
+
+        Expr abs_def_app = src->getDef(abs_rel_app);
+        LOG("pabs-debug", outs() << "ABS DEF APP: " << *abs_def_app << "\n";);
+
+        ExprMap boolVarToBvarMap;
+        ExprVector bools;
+        get_all_booleans(abs_def_app, std::back_inserter(bools));
+        for(Expr boolvar: bools)
+        {
+          Expr bool_bvar = bind::boolBVar(variant::variantNum(bind::fname(bind::fname(boolvar))), boolvar->efac());
+          boolVarToBvarMap.insert(std::make_pair(boolvar, bool_bvar));
+        }
+        Expr abs_def = replace(abs_def_app, boolVarToBvarMap);
+        LOG("pabs-debug", outs() << "ABS DEF: " << *abs_def << "\n";);
+
+        Expr orig_def;
+        if(isOpX<TRUE>(abs_def) || isOpX<FALSE>(abs_def))
+        {
+          orig_def = abs_def;
+        }
+        else
+        {
+          ExprMap abs_bvar_to_term_map;
+          ExprVector abs_bvars;
+          get_all_bvars(abs_def, std::back_inserter(abs_bvars));
+          for(Expr abs_bvar : abs_bvars)
+          {
+            Expr term = boolToTerm.find(abs_bvar)->second;
+            abs_bvar_to_term_map.insert(std::make_pair(abs_bvar, term));
+          }
+          orig_def = replace(abs_def, abs_bvar_to_term_map);
+        }
+        LOG("pabs-debug", outs() << "ORIG DEF: " << *orig_def << "\n";);
+
+        ExprVector bvars;
+        get_all_bvars(orig_def, std::back_inserter(bvars));
+        ExprMap bvarIdMap;
+        for(Expr bvar : bvars)
+        {
+          int bvar_id = bind::bvarId(bvar);
+          Expr bvar_type = bind::typeOf(bvar);
+          Expr var = bind::fapp(bind::constDecl(variant::variant(bvar_id, mkTerm<std::string> ("V", bvar->efac ())), bvar_type));
+          bvarIdMap.insert(std::make_pair(bvar, var));
+        }
+        Expr orig_def_app = replace(orig_def, bvarIdMap);
+        LOG("pabs-debug", outs() << "ORIG DEF APP: " << *orig_def_app << "\n";);
+        return orig_def_app;
+      });
     }
     return true;
   }
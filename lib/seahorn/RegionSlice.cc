@@ -0,0 +1,229 @@
+#include "seahorn/RegionSlice.hh"
+#include "seahorn/Transforms/Instrumentation/ShadowMemDsa.hh"
+
+#include "llvm/IR/CallSite.h"
+#include "llvm/IR/Instructions.h"
+
+#include "avy/AvyDebug.h"
+
+namespace seahorn
+{
+  namespace
+  {
+    /// the shadow.mem function called by v, empty if none
+    StringRef shadowFn (const Value *v)
+    {
+      if (const CallInst *ci = dyn_cast_or_null<CallInst> (v))
+        if (const Function *fn = ci->getCalledFunction ())
+          if (fn->getName ().startswith ("shadow.mem")) return fn->getName ();
+      return StringRef ();
+    }
+
+    /// true if the shadow.mem function reads its region
+    bool readsRegion (StringRef fn)
+    {
+      return fn == "shadow.mem.load" || fn == "shadow.mem.arg.ref" ||
+        fn == "shadow.mem.arg.mod";
+    }
+
+    /// the index of the region argument of a shadow.mem.arg.*, in or
+    /// out call
+    int64_t argIndex (ImmutableCallSite cs)
+    {
+      if (cs.arg_size () < 3) return -1;
+      if (const ConstantInt *c = dyn_cast<ConstantInt> (cs.getArgument (2)))
+        return c->getZExtValue ();
+      return -1;
+    }
+  }
+
+  int64_t RegionSlice::regionOf (const Value &v)
+  {
+    // -- through the phi nodes, to the shadow.mem call
+    std::vector<const Value*> wl (1, &v);
+    DenseSet<const Value*> seen;
+    while (!wl.empty ())
+    {
+      const Value *u = wl.back ();
+      wl.pop_back ();
+      if (!seen.insert (u).second) continue;
+      if (!shadowFn (u).empty ())
+        return shadow_dsa::getShadowId (ImmutableCallSite (cast<CallInst> (u)));
+      if (const PHINode *phi = dyn_cast<PHINode> (u))
+        for (unsigned i = 0; i < phi->getNumIncomingValues (); ++i)
+          wl.push_back (phi->getIncomingValue (i));
+      else return -1;
+    }
+    return -1;
+  }
+
+  int64_t RegionSlice::find (int64_t id) const
+  {
+    // -- without path compression, so that lookups only read
+    for (;;)
+    {
+      auto it = m_parent.find (id);
+      if (it == m_parent.end () || it->second == id) return id;
+      id = it->second;
+    }
+  }
+
+  void RegionSlice::unite (int64_t a, int64_t b)
+  {
+    a = find (a);
+    b = find (b);
+    m_parent.insert (std::make_pair (a, a));
+    m_parent.insert (std::make_pair (b, b));
+    if (a != b) m_parent [std::max (a, b)] = std::min (a, b);
+  }
+
+  unsigned RegionSlice::numRegions () const
+  {
+    std::set<int64_t> roots;
+    for (auto &kv : m_parent) roots.insert (find (kv.first));
+    return roots.size ();
+  }
+
+  RegionSlice::RegionSlice (const Module &M)
+  {
+    // -- regions of the summary of every function, by index
+    std::map<std::pair<const Function*, int64_t>, int64_t> formals;
+    std::vector<std::pair<ImmutableCallSite, int64_t> > actuals;
+
+    std::vector<const Value*> wl;
+    std::vector<std::pair<const Instruction*, int64_t> > stores;
+    for (const Function &F : M)
+      for (const BasicBlock &bb : F)
+        for (const Instruction &I : bb)
+        {
+          if (const ReturnInst *ret = dyn_cast<ReturnInst> (&I))
+            m_rets [&F].push_back (ret);
+          else if (const BranchInst *br = dyn_cast<BranchInst> (&I))
+          {
+            if (br->isConditional ()) wl.push_back (br->getCondition ());
+          }
+          else if (const SwitchInst *sw = dyn_cast<SwitchInst> (&I))
+            wl.push_back (sw->getCondition ());
+          else if (const StoreInst *st = dyn_cast<StoreInst> (&I))
+          {
+            // -- the shadow.mem.store of a store is right before it
+            const Instruction *prev = st->getPrevNode ();
+            if (shadowFn (prev) == "shadow.mem.store")
+              stores.push_back
+                (std::make_pair (st, shadow_dsa::getShadowId (ImmutableCallSite (prev))));
+          }
+
+          const CallInst *ci = dyn_cast<CallInst> (&I);
+          if (!ci) continue;
+          ImmutableCallSite CS (ci);
+          const Function *fn = CS.getCalledFunction ();
+          if (!fn) continue;
+          StringRef name = shadowFn (ci);
+          if (name.empty ())
+          {
+            m_calls [fn].push_back (ci);
+            // -- the properties and the assumptions
+            if (fn->getName ().startswith ("verifier."))
+              for (auto a = CS.arg_begin (); a != CS.arg_end (); ++a)
+                wl.push_back (*a);
+            continue;
+          }
+
+          int64_t id = shadow_dsa::getShadowId (CS);
+          if (id < 0) continue;
+          m_parent.insert (std::make_pair (id, id));
+          if (name == "shadow.mem.in" || name == "shadow.mem.out")
+            formals [std::make_pair (&F, argIndex (CS))] = id;
+          else if (name.startswith ("shadow.mem.arg.") && name != "shadow.mem.arg.init")
+            actuals.push_back (std::make_pair (CS, id));
+        }
+
+    // -- a region of a call site is the region of the callee at the
+    // -- same index
+    for (auto &a : actuals)
+    {
+      const Instruction *inst = a.first.getInstruction ();
+      // -- the call follows its shadow.mem.arg calls
+      const Instruction *call = inst->getNextNode ();
+      while (call && !shadowFn (call).empty ()) call = call->getNextNode ();
+      const CallInst *ci = dyn_cast_or_null<CallInst> (call);
+      if (!ci || !ci->getCalledFunction ()) continue;
+      auto it = formals.find (std::make_pair (ci->getCalledFunction (),
+                                              argIndex (a.first)));
+      if (it != formals.end ()) unite (a.second, it->second);
+    }
+
+    for (auto &s : stores) m_stores [find (s.second)].push_back (s.first);
+
+    close (wl);
+    LOG ("region-slice",
+         errs () << "region slice: " << numTracked () << " of "
+         << numRegions () << " regions\n";);
+  }
+
+  void RegionSlice::addRegion (int64_t id, std::vector<const Value*> &wl)
+  {
+    if (!m_tracked.insert (find (id)).second) return;
+    for (const Instruction *st : m_stores [find (id)])
+    {
+      wl.push_back (st->getOperand (0));
+      wl.push_back (st->getOperand (1));
+    }
+  }
+
+  void RegionSlice::close (std::vector<const Value*> &wl)
+  {
+    while (!wl.empty ())
+    {
+      const Value *v = wl.back ();
+      wl.pop_back ();
+      if (!m_values.insert (v).second) continue;
+
+      if (const Argument *arg = dyn_cast<Argument> (v))
+      {
+        // -- the actual arguments of every call
+        for (const CallInst *ci : m_calls [arg->getParent ()])
+          if (arg->getArgNo () < ci->getNumArgOperands ())
+            wl.push_back (ci->getArgOperand (arg->getArgNo ()));
+        continue;
+      }
+
+      const Instruction *I = dyn_cast<Instruction> (v);
+      if (!I) continue;
+
+      if (isa<LoadInst> (I))
+      {
+        // -- the shadow.mem.load of a load is right before it
+        const Instruction *prev = I->getPrevNode ();
+        if (shadowFn (prev) == "shadow.mem.load")
+        {
+          int64_t id = shadow_dsa::getShadowId (ImmutableCallSite (prev));
+          if (id >= 0) addRegion (id, wl);
+        }
+      }
+      else if (const CallInst *ci = dyn_cast<CallInst> (I))
+        if (const Function *fn = ci->getCalledFunction ())
+          for (const ReturnInst *ret : m_rets [fn])
+            if (ret->getReturnValue ()) wl.push_back (ret->getReturnValue ());
+
+      for (const Value *op : I->operands ())
+        if (isa<Instruction> (op) || isa<Argument> (op)) wl.push_back (op);
+    }
+  }
+
+  bool RegionSlice::refine (const std::set<const Function*> &fns)
+  {
+    std::vector<const Value*> wl;
+    unsigned before = numTracked ();
+    for (const Function *F : fns)
+      for (const BasicBlock &bb : *F)
+        for (const Instruction &I : bb)
+          if (readsRegion (shadowFn (&I)))
+          {
+            int64_t id = shadow_dsa::getShadowId (ImmutableCallSite (&I));
+            if (id >= 0) addRegion (id, wl);
+          }
+    close (wl);
+    return numTracked () > before;
+  }
+}
@@ -0,0 +1,217 @@
+#include "seahorn/SummaryPack.hh"
+
+#include "llvm/IR/Function.h"
+
+#include "ufo/ExprLlvm.hpp"
+#include "ufo/ExprIO.hpp"
+#include "ufo/Stats.hh"
+
+namespace seahorn
+{
+  namespace
+  {
+    const char *packTag = "seahorn.summary-pack";
+
+    /// applications of the summary of a function
+    struct IsSummaryApp : public std::unary_function<Expr, bool>
+    {
+      bool operator() (Expr e)
+      {
+        return bind::isFapp (e) &&
+          isOpX<FUNCTION> (bind::fname (bind::fname (e)));
+      }
+    };
+
+    /// same sorts of the arguments and of the range
+    bool sameSignature (Expr a, Expr b)
+    {
+      if (a->arity () != b->arity ()) return false;
+      for (unsigned i = 1; i < a->arity (); ++i)
+        if (a->arg (i) != b->arg (i)) return false;
+      return true;
+    }
+
+    Expr mkCount (size_t n, ExprFactory &efac)
+    { return mkTerm<unsigned> (n, efac); }
+
+    /// reads the roots written by SummaryPack::save
+    struct RootReader
+    {
+      const ExprVector &m_roots;
+      size_t m_pos;
+      RootReader (const ExprVector &roots) : m_roots (roots), m_pos (0) {}
+
+      bool next (Expr &e)
+      {
+        if (m_pos >= m_roots.size ()) return false;
+        e = m_roots [m_pos++];
+        return true;
+      }
+      bool count (unsigned &n)
+      {
+        Expr e;
+        if (!next (e) || !isOpX<UINT> (e)) return false;
+        n = getTerm<unsigned> (e);
+        return n <= m_roots.size () - m_pos;
+      }
+      bool name (std::string &s)
+      {
+        Expr e;
+        if (!next (e) || !isOpX<STRING> (e)) return false;
+        s = getTerm<std::string> (e);
+        return true;
+      }
+    };
+  }
+
+  void SummaryPack::add (llvm::StringRef fn, Expr sumPred, const ExprVector &rels,
+                         const HornClauseDB &db, Expr sumApp, Expr lemma)
+  {
+    Entry &e = m_fns [fn.str ()];
+    e.sumPred = sumPred;
+    e.rels = rels;
+    e.sumApp = sumApp;
+    e.lemma = lemma;
+
+    ExprSet heads (rels.begin (), rels.end ());
+    heads.insert (sumPred);
+
+    ExprSet callees;
+    for (const HornRule &r : db.getRules ())
+    {
+      if (!bind::isFapp (r.head ())) continue;
+      Expr head = bind::fname (r.head ());
+      if (!heads.count (head)) continue;
+      if (head == sumPred && isOpX<TRUE> (r.body ())) continue;
+      e.rules.push_back (r);
+
+      ExprSet apps;
+      filter (r.body (), IsSummaryApp (), std::inserter (apps, apps.end ()));
+      for (Expr app : apps)
+        if (bind::fname (app) != sumPred) callees.insert (bind::fname (app));
+    }
+
+    for (Expr c : callees)
+    {
+      const llvm::Function *g = getTerm<const llvm::Function*> (bind::fname (c));
+      e.callees.push_back (std::make_pair (g->getName ().str (), c));
+    }
+  }
+
+  bool SummaryPack::save (const std::string &fname) const
+  {
+    ufo::ScopedStats _st_("SummaryPack::save");
+
+    ExprVector roots;
+    roots.push_back (mkTerm<std::string> (packTag, m_efac));
+    roots.push_back (mkCount (version, m_efac));
+    roots.push_back (mkCount (m_fns.size (), m_efac));
+    for (auto &kv : m_fns)
+    {
+      const Entry &e = kv.second;
+      roots.push_back (mkTerm<std::string> (kv.first, m_efac));
+      roots.push_back (e.sumPred);
+      roots.push_back (mkCount (e.callees.size (), m_efac));
+      for (auto &c : e.callees)
+      {
+        roots.push_back (mkTerm<std::string> (c.first, m_efac));
+        roots.push_back (c.second);
+      }
+      roots.push_back (mkCount (e.rels.size (), m_efac));
+      roots.insert (roots.end (), e.rels.begin (), e.rels.end ());
+      roots.push_back (mkCount (e.rules.size (), m_efac));
+      for (const HornRule &r : e.rules)
+      {
+        roots.push_back (mkCount (r.vars ().size (), m_efac));
+        roots.insert (roots.end (), r.vars ().begin (), r.vars ().end ());
+        roots.push_back (r.head ());
+        roots.push_back (r.body ());
+      }
+      roots.push_back (mkCount (e.lemma ? 1 : 0, m_efac));
+      if (e.lemma)
+      {
+        roots.push_back (e.sumApp);
+        roots.push_back (e.lemma);
+      }
+    }
+
+    // -- the names of functions, blocks and values become strings
+    exprio::nameOpaqueTerminals (roots, m_efac);
+    return exprio::saveAtomic (fname, roots);
+  }
+
+  bool SummaryPack::load (const std::string &fname)
+  {
+    ufo::ScopedStats _st_("SummaryPack::load");
+
+    ExprVector roots;
+    if (!exprio::load (fname, m_efac, std::back_inserter (roots))) return false;
+
+    // -- read everything before changing the pack
+    RootReader in (roots);
+    std::string tag;
+    unsigned ver, n;
+    if (!in.name (tag) || tag != packTag) return false;
+    if (!in.count (ver) || ver != version) return false;
+    if (!in.count (n)) return false;
+
+    std::vector<std::pair<std::string, Entry> > fns (n);
+    for (auto &kv : fns)
+    {
+      Entry &e = kv.second;
+      unsigned k;
+      if (!in.name (kv.first) || !in.next (e.sumPred) || !bind::isFdecl (e.sumPred))
+        return false;
+      if (!in.count (k)) return false;
+      e.callees.resize (k);
+      for (auto &c : e.callees)
+        if (!in.name (c.first) || !in.next (c.second) || !bind::isFdecl (c.second))
+          return false;
+      if (!in.count (k)) return false;
+      e.rels.resize (k);
+      for (Expr &rel : e.rels) if (!in.next (rel) || !bind::isFdecl (rel)) return false;
+      if (!in.count (k)) return false;
+      for (unsigned i = 0; i < k; ++i)
+      {
+        unsigned nvars;
+        if (!in.count (nvars)) return false;
+        ExprVector vars (nvars);
+        for (Expr &v : vars) if (!in.next (v)) return false;
+        Expr head, body;
+        if (!in.next (head) || !in.next (body)) return false;
+        e.rules.push_back (HornRule (vars, head, body));
+      }
+      if (!in.count (k) || k > 1) return false;
+      if (k == 1 && (!in.next (e.sumApp) || !in.next (e.lemma))) return false;
+    }
+
+    for (auto &kv : fns) m_fns.insert (kv);
+    return true;
+  }
+
+  bool SummaryPack::link (llvm::StringRef fn, Expr sumPred,
+                          std::function<Expr (llvm::StringRef)> summary,
+                          HornClauseDB &db) const
+  {
+    auto it = m_fns.find (fn.str ());
+    if (it == m_fns.end ()) return false;
+    const Entry &e = it->second;
+
+    ExprMap sub;
+    if (!sameSignature (e.sumPred, sumPred)) return false;
+    sub [e.sumPred] = sumPred;
+    for (auto &c : e.callees)
+    {
+      Expr s = summary (c.first);
+      if (!s || !sameSignature (c.second, s)) return false;
+      sub [c.second] = s;
+    }
+
+    for (Expr rel : e.rels) db.registerRelation (rel);
+    for (const HornRule &r : e.rules)
+      db.addRule (HornRule (r.vars (), replace (r.head (), sub),
+                            replace (r.body (), sub)));
+    if (e.lemma) db.addConstraint (replace (e.sumApp, sub), e.lemma);
+    return true;
+  }
+}
@@ -1,4 +1,7 @@
 #include "seahorn/SymExec.hh"
+#include "ufo/Stats.hh"
+
+#include <atomic>
 
 using namespace seahorn;
 
@@ -152,4 +155,125 @@ namespace seahorn
   
  
 
+  namespace
+  {
+    /// lookups of CpEdgeCache, published as CpEdgeCacheHits and
+    /// CpEdgeCacheMisses
+    std::atomic<unsigned> g_edgeHits (0);
+    std::atomic<unsigned> g_edgeMisses (0);
+    
+    void registerEdgeCacheStats ()
+    {
+      static bool done = (Stats::addPrintHook ("cp_edge_cache", [] ()
+        {
+          Stats::uset ("CpEdgeCacheHits", g_edgeHits);
+          Stats::uset ("CpEdgeCacheMisses", g_edgeMisses);
+        }), true);
+      (void) done;
+    }
+  }
+  
+  CpEdgeCache::EncodingPtr CpEdgeCache::lookup (const CpEdge &edg)
+  {
+    registerEdgeCacheStats ();
+    std::lock_guard<std::mutex> lock (m_mutex);
+    auto it = m_encodings.find (&edg);
+    if (it != m_encodings.end ())
+    {
+      const Encoding &enc = *it->second;
+      const Value *src = enc.src, *dst = enc.dst;
+      if (src == &edg.source ().bb () && dst == &edg.target ().bb ())
+      {
+        ++g_edgeHits;
+        return it->second;
+      }
+      // -- the edge is gone and its address is reused
+      m_encodings.erase (it);
+    }
+    ++g_edgeMisses;
+    return EncodingPtr ();
+  }
+  
+  void CpEdgeCache::insert (const CpEdge &edg, EncodingPtr enc)
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_encodings [&edg] = enc;
+  }
+  
+  void CpEdgeCache::clear ()
+  {
+    std::lock_guard<std::mutex> lock (m_mutex);
+    m_encodings.clear ();
+  }
+
+  namespace
+  {
+    const Function *parentFunction (const Value &v)
+    {
+      if (const Instruction *inst = dyn_cast<const Instruction> (&v))
+        return inst->getParent ()->getParent ();
+      if (const BasicBlock *bb = dyn_cast<const BasicBlock> (&v))
+        return bb->getParent ();
+      if (const Argument *arg = dyn_cast<const Argument> (&v))
+        return arg->getParent ();
+      return nullptr;
+    }
+  }
+  
+  bool SymbolTable::find (const Value &v, Expr &out)
+  {
+    if (const Function *F = parentFunction (v))
+    {
+      auto it = m_functions.find (F);
+      if (it != m_functions.end ())
+      {
+        auto jt = it->second.find (&v);
+        if (jt == it->second.end ()) return false;
+        out = jt->second;
+        return true;
+      }
+    }
+    
+    std::unique_lock<std::mutex> lock (m_mutex, std::defer_lock);
+    if (m_efac.isConcurrent ()) lock.lock ();
+    auto it = m_other.find (&v);
+    if (it == m_other.end ()) return false;
+    out = it->second;
+    return true;
+  }
+  
+  void SymbolTable::insert (const Value &v, Expr sym)
+  {
+    // -- the table of a function is complete
+    if (const Function *F = parentFunction (v))
+      if (m_functions.count (F)) return;
+    
+    std::unique_lock<std::mutex> lock (m_mutex, std::defer_lock);
+    if (m_efac.isConcurrent ()) lock.lock ();
+    m_other.insert (std::make_pair (&v, sym));
+  }
+  
+  void SymbolTable::addFunction (const Function &F, SmallStepSymExec &sem)
+  {
+    if (m_functions.count (&F)) return;
+    
+    ValueMap syms;
+    for (const Argument &arg : F.getArgumentList ())
+      syms [&arg] = sem.symb (arg);
+    for (const BasicBlock &bb : F)
+    {
+      syms [&bb] = sem.symb (bb);
+      for (const Instruction &inst : bb)
+        if (!inst.getType ()->isVoidTy ()) syms [&inst] = sem.symb (inst);
+    }
+    
+    // -- drop what was entered before the table was complete
+    {
+      std::unique_lock<std::mutex> lock (m_mutex, std::defer_lock);
+      if (m_efac.isConcurrent ()) lock.lock ();
+      for (auto &kv : syms) m_other.erase (kv.first);
+    }
+    m_functions [&F] = std::move (syms);
+  }
+
 }
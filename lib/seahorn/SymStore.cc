@@ -19,7 +19,7 @@ namespace seahorn
       
     std::swap (m_Parent, o.m_Parent);
     std::swap (m_ownedParent, o.m_ownedParent);
-    std::swap (m_Store, o.m_Store);
+    m_Store.swap (o.m_Store);
     std::swap (m_trackUse, o.m_trackUse);
     std::swap (m_uses, o.m_uses);
     std::swap (m_defs, o.m_defs);
@@ -39,7 +39,7 @@ namespace seahorn
   { 
     assert (!isValue (key));
     
-    m_Store[key] = val; 
+    m_Store.insert (key, val);
     if (m_trackUse) m_defs.push_back (key);
   }
     
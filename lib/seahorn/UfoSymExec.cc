@@ -6,8 +6,14 @@
 #include "seahorn/Transforms/Instrumentation/ShadowMemDsa.hh"
 
 #include "ufo/ufo_iterators.hpp"
+#include "ufo/ExprBv.hh"
 #include "llvm/Support/CommandLine.h"
 
+#include "boost/logic/tribool.hpp"
+
+#include <algorithm>
+#include <map>
+
 //#include <queue>
 
 using namespace seahorn;
@@ -54,20 +60,37 @@ IgnoreCalloc ("horn-ignore-calloc",
               cl::init (false),
               cl::Hidden);
 
+static llvm::cl::opt<bool>
+CacheCpEdges ("horn-cache-cp-edges",
+              llvm::cl::desc ("Encode every cutpoint edge once and reuse its encoding"),
+              cl::init (false));
+
+static llvm::cl::opt<bool>
+CompactMem ("horn-compact-mem",
+            llvm::cl::desc ("Fold the stores of a block into one array term per "
+                            "memory and forward loads through them"),
+            cl::init (false));
+
+static llvm::cl::opt<bool>
+PtrBaseOffset ("horn-ptr-base-offset",
+               llvm::cl::desc ("Encode a pointer derived from an object by geps and "
+                               "casts as the object plus an offset. Pointers into "
+                               "the same object are compared by their offsets"),
+               cl::init (false));
+
+static llvm::cl::opt<bool>
+HybridBv ("horn-hybrid-bv",
+          llvm::cl::desc ("Encode the values that depend on their bits, e.g., of "
+                          "bitwise operations, as bit-vectors and all others as "
+                          "integers"),
+          cl::init (false));
+
 static llvm::cl::opt<bool>
 SplitCriticalEdgesOnly ("horn-split-only-critical",
               llvm::cl::desc ("Introduce edge variables only for critical edges"),
               cl::init (true),
               cl::Hidden);
 
-static const Value *extractUniqueScalar (CallSite &cs)
-{
-   if (!EnableUniqueScalars) 
-     return nullptr;
-   else
-     return seahorn::shadow_dsa::extractUniqueScalar (cs);
-}
-
 static const Value* extractUniqueScalar (const CallInst *ci)
 {
    if (!EnableUniqueScalars) 
@@ -86,6 +109,12 @@ static bool isShadowMem (const Value &V, const Value **out)
 
 namespace
 {
+  /// stores that storeTerm looks through for one to the same address
+  const unsigned MaxStoreChain = 64;
+  /// geps and casts that ptrOffset looks through for the object of a
+  /// pointer
+  const unsigned MaxPtrChain = 16;
+  
   struct SymExecBase
   {
     SymStore &m_s;
@@ -104,6 +133,14 @@ namespace
     Expr m_outMem;
     /// --- true if the current read/write is to unique memory location
     bool m_uniq;
+    /// -- the shadow.mem.store that defines m_outMem
+    const Instruction *m_outMemInst;
+    
+    /// -- true if the stores of a whole block are folded together
+    bool m_compact;
+    /// -- the array term of every memory written in the block so far,
+    /// -- over the memories at the start of the block
+    std::map<Expr, Expr> m_memDefs;
     
     /// -- parameters for a function call
     ExprVector m_fparams;
@@ -118,6 +155,8 @@ namespace
       zeroE = mkTerm<mpz_class> (0, m_efac);
       oneE = mkTerm<mpz_class> (1, m_efac);
       m_uniq = false;
+      m_outMemInst = nullptr;
+      m_compact = false;
       resetActiveLit ();
       // -- first two arguments are reserved for error flag
       m_fparams.push_back (falseE);
@@ -141,6 +180,99 @@ namespace
     // -- add conditional side condition
     void addCondSide (Expr c) {m_side.push_back (boolop::limp (m_activeLit, c));}
     
+    /// -- the array term of memory m, in terms of the memories at the
+    /// -- start of the block when m is written in the block
+    Expr memTerm (Expr m)
+    {
+      auto it = m_memDefs.find (m);
+      return it == m_memDefs.end () ? m : it->second;
+    }
+    
+    /// -- splits an address into a base and a numeric offset. The base
+    /// -- of a numeral is null
+    static void splitAddr (Expr a, Expr &base, mpz_class &off)
+    {
+      base = a;
+      off = 0;
+      if (isOpX<MPZ> (a)) { base = Expr (); off = getTerm<mpz_class> (a); }
+      else if (isOpX<PLUS> (a) && a->arity () == 2 && isOpX<MPZ> (a->right ()))
+      { base = a->left (); off = getTerm<mpz_class> (a->right ()); }
+    }
+    
+    /// -- true if addresses a and b are equal, false if they are
+    /// -- distinct, unknown otherwise
+    static boost::tribool sameAddr (Expr a, Expr b)
+    {
+      if (a == b) return true;
+      Expr ba, bb;
+      mpz_class oa, ob;
+      splitAddr (a, ba, oa);
+      splitAddr (b, bb, ob);
+      if (ba != bb) return boost::indeterminate;
+      return oa == ob;
+    }
+    
+    /// -- reads arr at idx, through the stores whose address is known
+    /// -- to be equal or distinct
+    static Expr selectTerm (Expr arr, Expr idx)
+    {
+      while (isOpX<STORE> (arr))
+      {
+        boost::tribool eq = sameAddr (arr->arg (1), idx);
+        if (eq) return arr->arg (2);
+        if (boost::indeterminate (eq)) break;
+        arr = arr->arg (0);
+      }
+      return op::array::select (arr, idx);
+    }
+    
+    /// -- writes v at idx in arr. A store to the same address below
+    /// -- stores to distinct addresses is overwritten
+    static Expr storeTerm (Expr arr, Expr idx, Expr v, unsigned depth = 0)
+    {
+      if (isOpX<STORE> (arr) && depth < MaxStoreChain)
+      {
+        boost::tribool eq = sameAddr (arr->arg (1), idx);
+        if (eq) return op::array::store (arr->arg (0), idx, v);
+        if (!eq)
+        {
+          Expr below = storeTerm (arr->arg (0), idx, v, depth + 1);
+          if (isOpX<STORE> (below) && below->arg (0) == arr->arg (0))
+            // -- nothing to overwrite below, keep the order
+            return op::array::store (arr, idx, v);
+          return op::array::store (below, arr->arg (1), arr->arg (2));
+        }
+      }
+      return op::array::store (arr, idx, v);
+    }
+    
+    /// -- true if the memory defined by I is only read by the loads
+    /// -- and stores of its block, so that it needs no equation
+    bool isInternalMem (const Instruction &I)
+    {
+      for (const User *u : I.users ())
+      {
+        const CallInst *ci = dyn_cast<CallInst> (u);
+        if (!ci || ci->getParent () != I.getParent ()) return false;
+        EncInst::Kind k = m_sem.encoding ().inst (*ci).kind;
+        if (k != EncInst::SHADOW_LOAD && k != EncInst::SHADOW_STORE) return false;
+      }
+      return true;
+    }
+    
+    /// -- a successful access of sz bytes at ptr is within the object
+    /// -- of ptr, if its size is known
+    void addAccessBounds (const Value &ptr, uint64_t sz)
+    {
+      const Value *base;
+      Expr off = m_sem.ptrOffset (m_s, ptr, base);
+      uint64_t objSz = off ? m_sem.objectSize (*base) : 0;
+      if (objSz < sz || objSz == 0) return;
+      Expr max = mkTerm<mpz_class> ((unsigned long)(objSz - sz), m_efac);
+      m_side.push_back (boolop::limp (m_activeLit,
+                                      mk<AND> (mk<GEQ> (off, zeroE),
+                                               mk<LEQ> (off, max))));
+    }
   };
   
   struct SymExecVisitor : public InstVisitor<SymExecVisitor>, 
@@ -198,14 +330,30 @@ namespace
       const Value& v0 = *I.getOperand (0);
       const Value& v1 = *I.getOperand (1);
       
-      Expr op0 = lookup (v0);
-      Expr op1 = lookup (v1);
+      Expr op0, op1;
+      CmpInst::Predicate pred = I.getPredicate ();
+      if (PtrBaseOffset && v0.getType ()->isPointerTy ())
+      {
+        // -- pointers into the same object are ordered as their
+        // -- offsets, which are signed and do not wrap
+        const Value *b0, *b1;
+        Expr o0 = m_sem.ptrOffset (m_s, v0, b0);
+        Expr o1 = m_sem.ptrOffset (m_s, v1, b1);
+        if (o0 && o1 && b0 == b1)
+        {
+          op0 = o0;
+          op1 = o1;
+          pred = ICmpInst::getSignedPredicate (pred);
+        }
+      }
+      if (!op0) op0 = lookup (v0);
+      if (!op1) op1 = lookup (v1);
 
       if (!(op0 && op1)) return;
 
       Expr res;
       
-      switch (I.getPredicate ())
+      switch (pred)
       {
       case CmpInst::ICMP_EQ:
         res = mk<IFF>(lhs, mk<EQ>(op0,op1));
@@ -275,6 +423,7 @@ namespace
     void visitBinaryOperator(BinaryOperator &I)
     {
       if (!m_sem.isTracked (I)) return;
+      if (m_sem.isBv (I)) return doBvArithmetic (I);
       
       Expr lhs = havoc (I);
       
@@ -303,6 +452,44 @@ namespace
       }
     }
     
+    /// -- I over bit-vectors. Its operands are converted if they
+    /// -- are integers
+    void doBvArithmetic (BinaryOperator &I)
+    {
+      Expr lhs = havoc (I);
+      unsigned w = I.getType ()->getIntegerBitWidth ();
+      Expr op0 = m_sem.lookupBv (m_s, *I.getOperand (0), w);
+      Expr op1 = m_sem.lookupBv (m_s, *I.getOperand (1), w);
+      if (!(op0 && op1)) return;
+      
+      Expr res;
+      Expr act = GlobalConstraints ? trueE : m_activeLit;
+      switch (I.getOpcode ())
+      {
+      case BinaryOperator::Add: res = mk<BADD> (op0, op1); break;
+      case BinaryOperator::Sub: res = mk<BSUB> (op0, op1); break;
+      case BinaryOperator::Mul: res = mk<BMUL> (op0, op1); break;
+      case BinaryOperator::And: res = mk<BAND> (op0, op1); break;
+      case BinaryOperator::Or: res = mk<BOR> (op0, op1); break;
+      case BinaryOperator::Xor: res = mk<BXOR> (op0, op1); break;
+      case BinaryOperator::Shl: res = mk<BSHL> (op0, op1); break;
+      case BinaryOperator::LShr: res = mk<BLSHR> (op0, op1); break;
+      case BinaryOperator::AShr: res = mk<BASHR> (op0, op1); break;
+      // -- always guard division
+      case BinaryOperator::UDiv:
+        res = mk<BUDIV> (op0, op1); act = m_activeLit; break;
+      case BinaryOperator::SDiv:
+        res = mk<BSDIV> (op0, op1); act = m_activeLit; break;
+      case BinaryOperator::URem:
+        res = mk<BUREM> (op0, op1); act = m_activeLit; break;
+      case BinaryOperator::SRem:
+        res = mk<BSREM> (op0, op1); act = m_activeLit; break;
+      default:
+        break;
+      }
+      if (res) m_side.push_back (boolop::limp (act, mk<EQ> (lhs, res)));
+    }
+    
     void doBitLogic (Expr lhs, BinaryOperator &i)
     {
       const Value& v0 = *(i.getOperand (0));
@@ -367,10 +554,10 @@ namespace
       switch(i.getOpcode())
 	{
 	case BinaryOperator::And:
-	  res = mk<IFF>(lhs, mk<AND>(op0,op1));
+	  res = mk<IFF>(lhs, canon::mk<AND>(op0,op1));
           break;
 	case BinaryOperator::Or:
-	  res = mk<IFF>(lhs, mk<OR>(op0,op1));
+	  res = mk<IFF>(lhs, canon::mk<OR>(op0,op1));
           break;
         case BinaryOperator::Xor:
 	  res = mk<IFF>(lhs, mk<XOR>(op0,op1));
@@ -391,7 +578,7 @@ namespace
       {
           factor = factor * 2;
       }
-      Expr res = mk<EQ>(lhs ,mk<MULT>(op1, mkTerm<mpz_class> (factor, m_efac)));        
+      Expr res = mk<EQ>(lhs ,canon::mk<MULT>(op1, mkTerm<mpz_class> (factor, m_efac)));        
       return res;
     }
     Expr doAShr (Expr lhs, Expr op1, const ConstantInt *op2)
@@ -421,7 +608,7 @@ namespace
       switch(i.getOpcode())
       {
       case BinaryOperator::Add:
-        res = mk<EQ>(lhs ,mk<PLUS>(op1, op2));
+        res = mk<EQ>(lhs ,canon::mk<PLUS>(op1, op2));
         break;
       case BinaryOperator::Sub:
         res = mk<EQ>(lhs ,mk<MINUS>(op1, op2));
@@ -432,7 +619,7 @@ namespace
         if (!StrictlyLinear || 
             isOpX<MPZ> (op1) || isOpX<MPZ> (op2) || 
             isOpX<MPQ> (op1) || isOpX<MPQ> (op2))
-          res = mk<EQ>(lhs ,mk<MULT>(op1, op2));
+          res = mk<EQ>(lhs ,canon::mk<MULT>(op1, op2));
         break;
       case BinaryOperator::SDiv:
       case BinaryOperator::UDiv:
@@ -492,6 +679,17 @@ namespace
     void visitTruncInst(TruncInst &I)              
     {
       if (!m_sem.isTracked (I)) return;
+      if (m_sem.isBv (I))
+      {
+        Expr lhs = havoc (I);
+        unsigned w = I.getType ()->getIntegerBitWidth ();
+        Expr op0 = m_sem.lookupBv (m_s, *I.getOperand (0),
+                                   I.getOperand (0)->getType ()->getIntegerBitWidth ());
+        Expr act = GlobalConstraints ? trueE : m_activeLit;
+        if (op0)
+          m_side.push_back (boolop::limp (act, mk<EQ> (lhs, bv::extract (w - 1, 0, op0))));
+        return;
+      }
       Expr lhs = havoc (I);
       Expr op0 = lookup (*I.getOperand (0));
       
@@ -511,7 +709,17 @@ namespace
         m_side.push_back (boolop::limp (act, mk<EQ> (lhs, op0)));
     }
     
-    void visitZExtInst (ZExtInst &I) {doExtCast (I, false);}
+    void visitZExtInst (ZExtInst &I)
+    {
+      if (!m_sem.isTracked (I) || !m_sem.isBv (I)) return doExtCast (I, false);
+      
+      Expr lhs = havoc (I);
+      unsigned w = I.getType ()->getIntegerBitWidth ();
+      Expr op0 = m_sem.lookupBv (m_s, *I.getOperand (0),
+                                 I.getOperand (0)->getType ()->getIntegerBitWidth ());
+      Expr act = GlobalConstraints ? trueE : m_activeLit;
+      if (op0) m_side.push_back (boolop::limp (act, mk<EQ> (lhs, bv::zext (op0, w))));
+    }
     void visitSExtInst (SExtInst &I) {doExtCast (I, true);}
     
     void visitGetElementPtrInst (GetElementPtrInst &gep)
@@ -519,16 +727,8 @@ namespace
       if (!m_sem.isTracked (gep)) return;
       Expr lhs = havoc (gep);
       
-      SmallVector<const Value*, 4> ps;
-      SmallVector<const Type*, 4> ts;
-      gep_type_iterator typeIt = gep_type_begin (gep);
-      for (unsigned i = 1; i < gep.getNumOperands (); ++i, ++typeIt)
-      {
-        ps.push_back (gep.getOperand (i));
-        ts.push_back (*typeIt);
-      }
-      
-      Expr op = m_sem.ptrArith (m_s, *gep.getPointerOperand (), ps, ts);
+      Expr op = PtrBaseOffset ? m_sem.ptrBaseOffset (m_s, gep) :
+        m_sem.ptrArith (m_s, gep);
       Expr act = GlobalConstraints ? trueE : m_activeLit;
       if (op)
       {
@@ -543,6 +743,8 @@ namespace
           m_side.push_back (boolop::limp (m_activeLit,
                                           mk<OR> (mk<LEQ> (base, zeroE),
                                                   mk<GT> (lhs, zeroE))));
+        // -- an inbounds gep is at most one past the end of its object
+        if (PtrBaseOffset) addAccessBounds (gep, 0);
       }
       
     }
@@ -643,7 +845,11 @@ namespace
         // error flag out
         m_fparams [2] = (m_s.havoc (m_sem.errorFlag (BB)));
         for (const Argument *arg : fi.args)
-          m_fparams.push_back (m_s.read (symb (*CS.getArgument (arg->getArgNo ()))));
+        {
+          const Value &v = *CS.getArgument (arg->getArgNo ());
+          // -- the parameters of a summary are integers
+          m_fparams.push_back (m_sem.isBv (v) ? lookup (v) : m_s.read (symb (v)));
+        }
         for (const GlobalVariable *gv : fi.globals)
           m_fparams.push_back (m_s.read (symb (*gv)));
         
@@ -682,50 +888,47 @@ namespace
         m_fparams.push_back (falseE);
         m_fparams.push_back (falseE);
       }
-      else if (F.getName ().startswith ("shadow.mem"))
+      else if (m_sem.encoding ().inst (I).isShadow ())
       {
         if (!m_sem.isTracked (I)) 
           return;
         
-        if (F.getName ().equals ("shadow.mem.init"))
-          m_s.havoc (symb(I));
-        else if (F.getName ().equals ("shadow.mem.load"))
-        {
-          const Value &v = *CS.getArgument (1);
-          m_inMem = m_s.read (symb (v));
-          m_uniq = extractUniqueScalar (CS) != nullptr;
-        }
-        else if (F.getName ().equals ("shadow.mem.store"))
+        const EncInst &enc = m_sem.encoding ().inst (I);
+        switch (enc.kind)
         {
+        case EncInst::SHADOW_INIT:
+          m_s.havoc (symb(I));
+          break;
+        case EncInst::SHADOW_LOAD:
+          m_inMem = m_s.read (symb (*CS.getArgument (1)));
+          m_uniq = EnableUniqueScalars && enc.scalar;
+          break;
+        case EncInst::SHADOW_STORE:
           m_inMem = m_s.read (symb (*CS.getArgument (1)));
           m_outMem = m_s.havoc (symb (I));
-          m_uniq = extractUniqueScalar (CS) != nullptr;
-        }
-        else if (F.getName ().equals ("shadow.mem.arg.ref"))
+          m_outMemInst = &I;
+          m_uniq = EnableUniqueScalars && enc.scalar;
+          break;
+        case EncInst::SHADOW_ARG_REF:
           m_fparams.push_back (m_s.read (symb (*CS.getArgument (1))));
-        else if (F.getName ().equals ("shadow.mem.arg.mod"))
-        {
+          break;
+        case EncInst::SHADOW_ARG_MOD:
           m_fparams.push_back (m_s.read (symb (*CS.getArgument (1))));
           m_fparams.push_back (m_s.havoc (symb (I)));
-        }
-        else if (F.getName ().equals ("shadow.mem.arg.new"))
+          break;
+        case EncInst::SHADOW_ARG_NEW:
           m_fparams.push_back (m_s.havoc (symb (I)));
-        else if (!PF.getName ().equals ("main") && 
-                 F.getName ().equals ("shadow.mem.in"))
-        {
-          m_s.read (symb (*CS.getArgument (1)));
-        }
-        else if (!PF.getName ().equals ("main") &&
-                 F.getName ().equals ("shadow.mem.out"))
-        {
-          m_s.read (symb (*CS.getArgument (1)));
-        }
-        else if (!PF.getName ().equals ("main") && 
-                 F.getName ().equals ("shadow.mem.arg.init"))
-        {
+          break;
+        case EncInst::SHADOW_IN:
+        case EncInst::SHADOW_OUT:
+          if (!PF.getName ().equals ("main"))
+            m_s.read (symb (*CS.getArgument (1)));
+          break;
+        default:
           // regions initialized in main are global. We want them to
-          // flow to the arguments
-          /* do nothing */
+          // flow to the arguments. Nothing to do for
+          // shadow.mem.arg.init
+          break;
         }
       }
       else
@@ -766,6 +969,9 @@ namespace
           if (base)
             m_side.push_back (boolop::limp (m_activeLit, mk<GT> (base, zeroE)));
         }
+        if (PtrBaseOffset)
+          addAccessBounds (*I.getPointerOperand (),
+                           m_sem.dataLayout ().getTypeStoreSize (I.getType ()));
       }
       
       if (!m_sem.isTracked (I)) return;
@@ -780,17 +986,18 @@ namespace
         Expr rhs = m_inMem;
         if (I.getType ()->isIntegerTy (1))
           // -- convert to Boolean
-          rhs = mk<NEQ> (rhs, mkTerm (mpz_class(0), m_efac));
+          rhs = mk<NEQ> (rhs, mkTerm<mpz_class> (0, m_efac));
        
         m_side.push_back (boolop::limp (act,
                                         mk<EQ> (lhs, rhs)));
       }
       else if (Expr op0 = lookup (*I.getPointerOperand ()))
       {
-        Expr rhs = op::array::select (m_inMem, op0);
+        Expr rhs = m_compact ? selectTerm (memTerm (m_inMem), op0) :
+          op::array::select (m_inMem, op0);
         if (I.getType ()->isIntegerTy (1))
           // -- convert to Boolean
-          rhs = mk<NEQ> (rhs, mkTerm (mpz_class(0), m_efac));
+          rhs = mk<NEQ> (rhs, mkTerm<mpz_class> (0, m_efac));
 
         if (!ArrayGlobalConstraints) act = m_activeLit;
         m_side.push_back (boolop::limp (act,
@@ -814,6 +1021,10 @@ namespace
           if (base)
             m_side.push_back (boolop::limp (m_activeLit, mk<GT> (base, zeroE)));
         }
+        if (PtrBaseOffset)
+          addAccessBounds (*I.getPointerOperand (),
+                           m_sem.dataLayout ().getTypeStoreSize
+                           (I.getValueOperand ()->getType ()));
       }
 
       if (!m_inMem || !m_outMem || !m_sem.isTracked (*I.getOperand (0))) return;
@@ -822,8 +1033,8 @@ namespace
       Expr v = lookup (*I.getOperand (0));
       if (v && I.getOperand (0)->getType ()->isIntegerTy (1))
         // -- convert to int
-        v = boolop::lite (v, mkTerm (mpz_class (1), m_efac),
-                          mkTerm (mpz_class (0), m_efac));
+        v = boolop::lite (v, mkTerm<mpz_class> (1, m_efac),
+                          mkTerm<mpz_class> (0, m_efac));
       if (m_uniq)
       {
         if (v)
@@ -834,7 +1045,16 @@ namespace
         Expr idx = lookup (*I.getPointerOperand ());
       
         if (!ArrayGlobalConstraints) act = m_activeLit;
-        if (idx && v)
+        if (idx && v && m_compact)
+        {
+          // -- memories that do not leave the block get no equation,
+          // -- their readers use the term instead
+          Expr term = storeTerm (memTerm (m_inMem), idx, v);
+          m_memDefs [m_outMem] = term;
+          if (!m_outMemInst || !isInternalMem (*m_outMemInst))
+            m_side.push_back (boolop::limp (act, mk<EQ> (m_outMem, term)));
+        }
+        else if (idx && v)
           m_side.push_back (boolop::limp (act,
                                           mk<EQ> (m_outMem, 
                                                   op::array::store (m_inMem, idx, v))));
@@ -842,6 +1062,7 @@ namespace
       
       m_inMem.reset ();
       m_outMem.reset ();
+      m_outMemInst = nullptr;
     }
     
     
@@ -943,6 +1164,9 @@ namespace seahorn
                               Expr act)
   {
     SymExecVisitor v(s, *this, side);
+    // -- the memories of a block are only folded when all of it is
+    // -- executed at once
+    v.m_compact = CompactMem;
     v.setActiveLit (act);
     v.visit (const_cast<BasicBlock&>(bb));
     v.resetActiveLit ();
@@ -965,43 +1189,106 @@ namespace seahorn
     v.resetActiveLit ();
   }
 
-  Expr UfoSmallSymExec::ptrArith (SymStore &s, 
-                                  const Value &base,
-                                  SmallVectorImpl<const Value*> &ps,
-                                  SmallVectorImpl<const Type*> &ts)
+  Expr UfoSmallSymExec::ptrArith (SymStore &s, const GetElementPtrInst &gep)
   {
-    Expr res = lookup (s, base);
+    Expr res = lookup (s, *gep.getPointerOperand ());
     if (!res) return res;
     
-    for (unsigned i = 0; i < ps.size (); ++i)
+    const EncInst &enc = m_ir->inst (gep);
+    if (enc.offset != 0)
+      res = canon::mk<PLUS> (res, mkTerm<mpz_class> ((signed long)enc.offset, m_efac));
+    for (auto &t : enc.terms)
+    {
+      Expr idx = lookup (s, *t.first);
+      if (!idx) return Expr ();
+      Expr sz = mkTerm<mpz_class> ((unsigned long)t.second, m_efac);
+      res = canon::mk<PLUS> (res, canon::mk<MULT> (idx, sz));
+    }
+    return res;
+  }
+    
+  Expr UfoSmallSymExec::ptrOffset (SymStore &s, const Value &p, const Value *&base)
+  {
+    ExprVector terms;
+    mpz_class off = 0;
+    const Value *v = &p;
+    // -- the operands of a gep dominate it, and so every use of the
+    // -- pointer, and their current values are those the gep used
+    for (unsigned depth = 0; depth < MaxPtrChain; ++depth)
     {
-      if (const StructType *st = dyn_cast<const StructType> (ts [i]))
+      if (const GetElementPtrInst *gep = dyn_cast<GetElementPtrInst> (v))
       {
-        if (const ConstantInt *ci = dyn_cast<const ConstantInt> (ps [i]))
+        const EncInst &enc = m_ir->inst (*gep);
+        off += (signed long)enc.offset;
+        for (auto &t : enc.terms)
         {
-          Expr off = mkTerm<mpz_class> (fieldOff (st, ci->getZExtValue ()), m_efac);
-          res = mk<PLUS> (res, off);
+          Expr idx = lookup (s, *t.first);
+          if (!idx) return Expr ();
+          Expr sz = mkTerm<mpz_class> ((unsigned long)t.second, m_efac);
+          terms.push_back (canon::mk<MULT> (idx, sz));
         }
-        else assert (0);
+        v = gep->getPointerOperand ();
       }
-      else if (const SequentialType *seqt = dyn_cast<const SequentialType> (ts [i]))
+      else if (const GEPOperator *ce = dyn_cast<GEPOperator> (v))
       {
-        Expr sz = mkTerm<mpz_class> (storageSize (seqt->getElementType ()), m_efac);
-        res = mk<PLUS> (res, mk<MULT> (lookup (s, *ps[i]), sz));
+        EncInst enc;
+        EncInst::gepOffset (*ce, *m_td, enc);
+        if (!enc.terms.empty ()) break;
+        off += (signed long)enc.offset;
+        v = ce->getPointerOperand ();
       }
+      else if (const BitCastOperator *bc = dyn_cast<BitCastOperator> (v))
+        v = bc->getOperand (0);
+      else break;
     }
-    return res;
+    base = v;
+    
+    if (off != 0 || terms.empty ()) terms.push_back (mkTerm<mpz_class> (off, m_efac));
+    return terms.size () == 1 ? terms [0] : mknary<PLUS> (terms);
   }
   
-  unsigned UfoSmallSymExec::storageSize (const llvm::Type *t) 
-  {return m_td->getTypeStoreSize (const_cast<Type*> (t));}
+  Expr UfoSmallSymExec::ptrBaseOffset (SymStore &s, const GetElementPtrInst &gep)
+  {
+    const Value *base;
+    Expr off = ptrOffset (s, gep, base);
+    Expr res = off ? lookup (s, *base) : Expr ();
+    if (!res) return ptrArith (s, gep);
+    if (isOpX<MPZ> (off) && getTerm<mpz_class> (off) == 0) return res;
+    return canon::mk<PLUS> (res, off);
+  }
   
-  unsigned UfoSmallSymExec::fieldOff (const StructType *t, unsigned field)
+  uint64_t UfoSmallSymExec::objectSize (const Value &base)
   {
-    return m_td->getStructLayout (const_cast<StructType*>(t))->getElementOffset (field);
+    if (const AllocaInst *a = dyn_cast<AllocaInst> (&base))
+    {
+      const ConstantInt *n = dyn_cast<ConstantInt> (a->getArraySize ());
+      if (!n || !a->getAllocatedType ()->isSized ()) return 0;
+      return m_td->getTypeAllocSize (a->getAllocatedType ()) * n->getZExtValue ();
+    }
+    if (const GlobalVariable *gv = dyn_cast<GlobalVariable> (&base))
+    {
+      Type *ty = gv->getType ()->getElementType ();
+      return ty->isSized () ? m_td->getTypeAllocSize (ty) : 0;
+    }
+    // -- malloc of a constant size
+    if (const CallInst *ci = dyn_cast<CallInst> (&base))
+      if (const Function *fn = ci->getCalledFunction ())
+        if (fn->getName ().equals ("malloc") && ci->getNumArgOperands () == 1)
+          if (const ConstantInt *n = dyn_cast<ConstantInt> (ci->getArgOperand (0)))
+            return n->getZExtValue ();
+    return 0;
   }
     
   Expr UfoSmallSymExec::symb (const Value &I)
+  {
+    Expr res;
+    if (m_symbols->find (I, res)) return res;
+    res = mkSymb (I);
+    m_symbols->insert (I, res);
+    return res;
+  }
+  
+  Expr UfoSmallSymExec::mkSymb (const Value &I)
   {
     assert (!isa<UndefValue>(&I));
 
@@ -1017,8 +1304,7 @@ namespace seahorn
       {
         if (c->getType ()->isIntegerTy (1))
           return c->isOne () ? mk<TRUE> (m_efac) : mk<FALSE> (m_efac);
-        mpz_class k = toMpz (c->getValue ());
-        return mkTerm<mpz_class> (k, m_efac);
+        return mkTerm (c->getValue (), m_efac);
       }
       else if (cv->isNullValue () || isa<ConstantPointerNull> (&I))
         return mkTerm<mpz_class> (0, m_efac);
@@ -1033,8 +1319,7 @@ namespace seahorn
         {
           if (const ConstantInt* val = dyn_cast<const ConstantInt>(ce->getOperand (0)))
           {
-            mpz_class k = toMpz (val->getValue ());
-            return mkTerm<mpz_class> (k, m_efac);
+            return mkTerm (val->getValue (), m_efac);
           }
           // -- strip cast
           else return symb (*ce->getOperand (0));
@@ -1053,7 +1338,7 @@ namespace seahorn
         return bind::intConst
           (op::array::select (v, mkTerm<const Value*> (scalar, m_efac)));
     
-      if (m_trackLvl >= MEM)
+      if (m_trackLvl >= MEM && isTracked (I))
       {
         Expr intTy = sort::intTy (m_efac);
         Expr ty = sort::arrayTy (intTy, intTy);
@@ -1062,6 +1347,9 @@ namespace seahorn
     }
     
       
+    if (isTracked (I) && isBv (I))
+      return bv::bvConst (v, I.getType ()->getIntegerBitWidth ());
+    
     if (isTracked (I))
       return I.getType ()->isIntegerTy (1) ? 
         bind::boolConst (v) : bind::intConst (v);
@@ -1088,7 +1376,9 @@ namespace seahorn
     // -- shadow values represent memory regions
     // -- only track them when memory is tracked
     if (isShadowMem (v, &scalar))
-      return scalar != nullptr || m_trackLvl >= MEM;
+      return scalar != nullptr ||
+        (m_trackLvl >= MEM &&
+         (!m_regions || m_regions->isTracked (RegionSlice::regionOf (v))));
     
     
     // -- a pointer
@@ -1116,10 +1406,45 @@ namespace seahorn
   Expr UfoSmallSymExec::lookup (SymStore &s, const Value &v)
   {
     Expr u = symb (v);
+    if (u && isBv (v))
+      return bvToInt (s.read (u), v.getType ()->getIntegerBitWidth ());
     // if u is defined it is either an fapp or a constant
     if (u) return bind::isFapp (u) ? s.read (u) : u;
     return Expr (0);
   }
+  
+  bool UfoSmallSymExec::isBv (const Value &v)
+  {
+    if (!HybridBv) return false;
+    const Instruction *I = dyn_cast<Instruction> (&v);
+    return I && m_ir->inst (*I).bitPrecise;
+  }
+  
+  Expr UfoSmallSymExec::lookupBv (SymStore &s, const Value &v, unsigned width)
+  {
+    if (isBv (v)) return s.read (symb (v));
+    if (const ConstantInt *c = dyn_cast<ConstantInt> (&v))
+    {
+      mpz_class k = expr::toMpz (c->getValue ());
+      mpz_class mod = 1;
+      mod <<= width;
+      k %= mod;
+      if (k < 0) k += mod;
+      return bv::bvnum (k, width, m_efac);
+    }
+    Expr u = lookup (s, v);
+    return u ? bv::int2bv (u, width) : u;
+  }
+  
+  Expr UfoSmallSymExec::bvToInt (Expr u, unsigned width)
+  {
+    // -- integers are signed
+    mpz_class mod = 1;
+    mod <<= width;
+    Expr n = bv::bv2int (u);
+    return mk<ITE> (mk<BSLT> (u, bv::bvnum (0, width, m_efac)),
+                    mk<MINUS> (n, mkTerm<mpz_class> (mod, m_efac)), n);
+  }
 
   void UfoSmallSymExec::execEdg (SymStore &s, const BasicBlock &src,
                                  const BasicBlock &dst, ExprVector &side)
@@ -1167,6 +1492,90 @@ namespace seahorn
   
   void UfoLargeSymExec::execCpEdg (SymStore &s, const CpEdge &edge, 
                                    ExprVector &side)
+  {
+    // -- stores that track uses need the reads of the edge
+    if (!CacheCpEdges || s.tracksUse ()) 
+    {
+      encodeCpEdg (s, edge, side);
+      return;
+    }
+    
+    CpEdgeCache &cache = m_sem.edgeCache ();
+    CpEdgeCache::EncodingPtr enc = cache.lookup (edge);
+    if (!enc)
+    {
+      enc = canonicalCpEdg (edge);
+      cache.insert (edge, enc);
+    }
+    instantiate (*enc, s, side);
+  }
+  
+  namespace sem_detail
+  {
+    /// the j-th variant of key, as created by SymStore::havoc ()
+    static Expr variantOf (Expr key, int j)
+    {
+      Expr fdecl = bind::fname (key);
+      return bind::reapp (key, bind::rename (fdecl, variant::variant (j, bind::fname (fdecl))));
+    }
+  }
+  
+  CpEdgeCache::EncodingPtr UfoLargeSymExec::canonicalCpEdg (const CpEdge &edge)
+  {
+    ExprFactory &efac = m_sem.getExprFactory ();
+    auto enc = std::make_shared<CpEdgeCache::Encoding> ();
+    enc->src = const_cast<BasicBlock*> (&edge.source ().bb ());
+    enc->dst = const_cast<BasicBlock*> (&edge.target ().bb ());
+    
+    // -- find the registers that are read before they are written
+    {
+      SymStore root (efac, false, true);
+      SymStore cs (root, true);
+      ExprVector scratch;
+      encodeCpEdg (cs, edge, scratch);
+      enc->inputs.assign (cs.uses ().begin (), cs.uses ().end ());
+      std::sort (enc->inputs.begin (), enc->inputs.end ());
+      enc->inputs.erase (std::unique (enc->inputs.begin (), enc->inputs.end ()),
+                         enc->inputs.end ());
+    }
+    
+    // -- encode with every input defined, as its 0-th variant, so that
+    // -- all other values are created by havoc
+    SymStore root (efac, false, true);
+    SymStore cs (root, false);
+    for (Expr u : enc->inputs) cs.read (u);
+    encodeCpEdg (cs, edge, enc->side);
+    
+    for (auto &kv : root)
+    {
+      int last = variant::variantNum (bind::fname (bind::fname (kv.second)));
+      int first = std::binary_search (enc->inputs.begin (), enc->inputs.end (), 
+                                      kv.first) ? 1 : 0;
+      assert (sem_detail::variantOf (kv.first, last) == kv.second);
+      if (first <= last) 
+        enc->havocs.push_back (std::make_pair (kv.first, std::make_pair (first, last)));
+    }
+    enc->outputs.assign (cs.begin (), cs.end ());
+    return enc;
+  }
+  
+  void UfoLargeSymExec::instantiate (const CpEdgeCache::Encoding &enc, 
+                                     SymStore &s, ExprVector &side)
+  {
+    ExprMap sub;
+    for (Expr u : enc.inputs) sub [sem_detail::variantOf (u, 0)] = s.read (u);
+    // -- fresh values in s, in the order the canonical ones were created
+    for (auto &h : enc.havocs)
+      for (int j = h.second.first; j <= h.second.second; ++j)
+        sub [sem_detail::variantOf (h.first, j)] = s.havoc (h.first);
+    
+    DagVisitMemo memo (m_sem.getExprFactory ());
+    for (auto &o : enc.outputs) s.write (o.first, replace (o.second, sub, memo));
+    for (Expr e : enc.side) side.push_back (replace (e, sub, memo));
+  }
+  
+  void UfoLargeSymExec::encodeCpEdg (SymStore &s, const CpEdge &edge, 
+                                     ExprVector &side)
   {
     const CutPoint &target = edge.target ();
     
@@ -1239,27 +1648,27 @@ namespace seahorn
         // -- has one successor
         if (e == 1 || preds [i]->getTerminator ()->getNumSuccessors () == 1)
           // -- single successor is non-critical
-          edges [i] = mk<AND> (bbV, edges [i]);
+          edges [i] = canon::mk<AND> (bbV, edges [i]);
         else // -- critical edge, add edge variable
         {
           Expr edgV = bind::boolConst (mk<TUPLE> (edges [i], bbV));
           side.push_back (mk<IMPL> (edgV, edges [i]));
-          edges [i] = mk<AND> (edges [i], edgV);
+          edges [i] = canon::mk<AND> (edges [i], edgV);
         }
       }
     }
     else
     {
       // -- b_i & e_{i,j}
-      for (Expr &e : edges) e = mk<AND> (e, bind::boolConst (mk<TUPLE> (e, bbV)));
+      for (Expr &e : edges) e = canon::mk<AND> (e, bind::boolConst (mk<TUPLE> (e, bbV)));
     }
     
 
     // -- encode control flow
     // -- b_j -> (b1 & e_{1,j} | b2 & e_{2,j} | ...)
     side.push_back (mk<IMPL> (bbV, 
-                              mknary<OR> 
-                              (mk<FALSE> (m_sem.getExprFactory ()), edges)));
+                              canon::mknary<OR> 
+                              (m_sem.getExprFactory (), edges)));
       
     // unique node with no successors is asserted to always be reachable
     if (last) side.push_back (bbV);
@@ -34,7 +34,11 @@ def which(program):
 # inspired from:
 # http://stackoverflow.com/questions/4158502/python-kill-or-terminate-subprocess-when-timeout
 class TimeLimitedExec(threading.Thread):
-    def __init__(self, cmd, cpu=0, mem=0, verbose=0):
+    # -- processes that run, for SeqCmd to stop the commands of a pipe
+    running = set ()
+    running_lock = threading.Lock ()
+
+    def __init__(self, cmd, cpu=0, mem=0, verbose=0, **popen_args):
         threading.Thread.__init__(self)
         self.cmd = cmd
         self.cpu = cpu
@@ -43,8 +47,10 @@ class TimeLimitedExec(threading.Thread):
         self.stdout = None
         self.stderr = None
         self.verbose = verbose
+        self.popen_args = popen_args
 
-    def run(self, **popen_args):
+    def run(self):
+        popen_args = self.popen_args
         def set_limits ():
             import resource as r
             if self.cpu > 0:
@@ -57,7 +63,18 @@ class TimeLimitedExec(threading.Thread):
         self.p = subprocess.Popen(self.cmd,
                                   preexec_fn=set_limits,
                                   **popen_args)
-        self.stdout, self.stderr = self.p.communicate()
+        with TimeLimitedExec.running_lock: TimeLimitedExec.running.add (self.p)
+        try:
+            self.stdout, self.stderr = self.p.communicate()
+        finally:
+            with TimeLimitedExec.running_lock:
+                TimeLimitedExec.running.discard (self.p)
+
+    @staticmethod
+    def terminateAll ():
+        with TimeLimitedExec.running_lock:
+            for p in TimeLimitedExec.running:
+                if p.poll () is None: p.terminate ()
 
     def Run(self):
         self.start()
@@ -82,9 +99,26 @@ class TimeLimitedExec(threading.Thread):
         return self.p.returncode
 
 
+def scratchDir (min_free_mb=512):
+    """A directory on tmpfs for the files passed between commands, if
+    there is one with min_free_mb MB free. None means the default of
+    tempfile, which is also used when TMPDIR is set. Files that are
+    kept are not written to tmpfs"""
+    if 'TMPDIR' in os.environ: return None
+    d = '/dev/shm'
+    if not os.path.isdir (d) or not os.access (d, os.W_OK | os.X_OK):
+        return None
+    try:
+        st = os.statvfs (d)
+    except OSError:
+        return None
+    if st.f_bavail * st.f_frsize < min_free_mb * 1024 * 1024: return None
+    return d
+
 def createWorkDir (dname=None, save=False, prefix='tmp-'):
     if dname is None:
-        workdir = tempfile.mkdtemp (prefix=prefix)
+        scratch = None if save else scratchDir ()
+        workdir = tempfile.mkdtemp (prefix=prefix, dir=scratch)
     else:
         if not os.path.isdir (dname): os.mkdir (dname)
         workdir = dname
@@ -126,6 +160,14 @@ class CliCmd (object):
             out_file = os.path.join (work_dir, out_file)
         return out_file
 
+    def cache_extra (self, extra):
+        """The extra arguments that change the result of the command"""
+        return extra
+
+    def cache_outputs (self, args):
+        """Files written by the command besides its output file"""
+        return []
+
     def main (self, argv):
         import argparse
         ap = argparse.ArgumentParser (prog=self.name, description=self.help)
@@ -167,6 +209,136 @@ class AgregateCmd (CliCmd):
     def run (self, args=None, extra=[]):
         return args.func (args, extra)
 
+def _file_digest (fname):
+    """Digest of the contents of a file. The ModuleID of LLVM assembly
+    names the file it was produced from and is skipped"""
+    import hashlib
+    h = hashlib.sha256 ()
+    with open (fname, 'rb') as f:
+        if fname.endswith ('.ll'):
+            for line in f:
+                if not line.startswith ('; ModuleID'): h.update (line)
+        else:
+            for chunk in iter (lambda: f.read (1 << 20), ''): h.update (chunk)
+    return h.hexdigest ()
+
+def _tools_digest ():
+    """Digest of the installed tools. Results of other tools are not reused"""
+    import hashlib
+    h = hashlib.sha256 ()
+    for t in ['seahorn', 'seapp', 'seaopt',
+              ['clang-mp-3.6', 'clang-3.6', 'clang', 'clang-mp-3.5', 'clang-mp-3.4']]:
+        p = which (t)
+        if p is None: continue
+        st = os.stat (p)
+        h.update ('{0}:{1}:{2}\n'.format (p, st.st_size, int (st.st_mtime)))
+    return h.hexdigest ()
+
+class ResultCache (object):
+    """Content-addressed cache of the results of the commands of a SeqCmd.
+
+    A result is keyed by the command, the installed tools, the options
+    of the command and the contents of its inputs. It holds the output
+    file, the other files written by the command (e.g., a
+    counterexample) and the standard output, which has the verdict,
+    invariants and statistics. Entries are published by renaming a
+    complete directory so that the cache can be shared by several
+    machines, e.g., on NFS"""
+
+    # -- options that do not change the result of a command
+    ignored = ['out_file', 'in_files', 'cpu', 'mem', 'save_temps',
+               'temp_dir', 'func', 'fe_jobs', 'unit_cache']
+
+    def __init__ (self, dname):
+        self.dname = dname
+        self.tools = _tools_digest ()
+        if not os.path.isdir (dname):
+            try: os.makedirs (dname)
+            except OSError:
+                if not os.path.isdir (dname): raise
+
+    def key (self, cmd, argv):
+        import hashlib
+        ap = argparse.ArgumentParser (prog=cmd.name)
+        ap = cmd.mk_arg_parser (ap)
+        args, extra = ap.parse_known_args (argv)
+
+        opts = dict ((k, v) for k, v in vars (args).items ()
+                     if k not in self.ignored)
+        h = hashlib.sha256 ()
+        h.update (cmd.name + '\n')
+        h.update (self.tools + '\n')
+        h.update (repr (sorted (opts.items ())) + '\n')
+        h.update (repr (cmd.cache_extra (extra)) + '\n')
+        for f in args.in_files: h.update (_file_digest (f) + '\n')
+        return h.hexdigest (), args
+
+    def _entry (self, key):
+        return os.path.join (self.dname, key [:2], key)
+
+    def lookup (self, cmd, key, args, out_file):
+        """Replays a cached result. Returns None on a miss"""
+        import sys
+        entry = self._entry (key)
+        if not os.path.isfile (os.path.join (entry, 'rc')): return None
+
+        outputs = [out_file] + cmd.cache_outputs (args)
+        for i, dst in enumerate (outputs):
+            src = os.path.join (entry, 'out{0}'.format (i))
+            if dst is not None and os.path.isfile (src):
+                shutil.copyfile (src, dst)
+        with open (os.path.join (entry, 'stdout'), 'rb') as f:
+            sys.stdout.write (f.read ())
+        sys.stdout.flush ()
+        print >> sys.stderr, 'cache: hit for {0} ({1})'.format (cmd.name, key [:12])
+        with open (os.path.join (entry, 'rc')) as f: return int (f.read ())
+
+    def run (self, cmd, argv, out_file):
+        """Runs cmd on argv unless its result is cached"""
+        import sys
+        key, args = self.key (cmd, argv)
+        res = self.lookup (cmd, key, args, out_file)
+        if res is not None: return res
+
+        tmp = tempfile.mkdtemp (prefix='tmp-', dir=self.dname)
+        try:
+            # -- standard output of the command and of its tools
+            sys.stdout.flush ()
+            saved = os.dup (1)
+            with open (os.path.join (tmp, 'stdout'), 'wb') as f:
+                os.dup2 (f.fileno (), 1)
+            try:
+                res = cmd.main (argv)
+            finally:
+                sys.stdout.flush ()
+                os.dup2 (saved, 1)
+                os.close (saved)
+            with open (os.path.join (tmp, 'stdout'), 'rb') as f:
+                sys.stdout.write (f.read ())
+            sys.stdout.flush ()
+
+            # -- only successful runs are cached
+            if res != 0: return res
+            outputs = [out_file] + cmd.cache_outputs (args)
+            for i, src in enumerate (outputs):
+                if src is not None and os.path.isfile (src) and \
+                   src not in args.in_files:
+                    shutil.copyfile (src, os.path.join (tmp, 'out{0}'.format (i)))
+            with open (os.path.join (tmp, 'rc'), 'w') as f: f.write (str (res))
+
+            entry = self._entry (key)
+            if not os.path.isdir (os.path.dirname (entry)):
+                try: os.makedirs (os.path.dirname (entry))
+                except OSError: pass
+            # -- another run may have published the same entry
+            try:
+                os.rename (tmp, entry)
+                tmp = None
+            except OSError: pass
+            return res
+        finally:
+            if tmp is not None: shutil.rmtree (tmp, ignore_errors=True)
+
 class SeqCmd (AgregateCmd):
     def __init__ (self, name='', help='', cmds=[]):
         super (SeqCmd, self).__init__ (name, help, cmds)
@@ -174,6 +346,13 @@ class SeqCmd (AgregateCmd):
     def mk_arg_parser (self, ap):
         add_in_out_args (ap)
         add_tmp_dir_args (ap)
+        ap.add_argument ('--cache-dir', dest='cache_dir', metavar='DIR',
+                         help='Reuse the results of each command cached in DIR',
+                         default=os.environ.get ('SEA_CACHE_DIR'))
+        ap.add_argument ('--pipe', dest='pipe', action='store_true',
+                         default=False,
+                         help='Run the commands concurrently, every one '
+                         'reading the output of the previous one from a pipe')
         return ap
 
     def run (self, args, extra):
@@ -183,6 +362,19 @@ class SeqCmd (AgregateCmd):
 
 
         work_dir = createWorkDir (args.temp_dir, args.save_temps, 'sea-')
+        cache = None
+        if args.cache_dir is not None: cache = ResultCache (args.cache_dir)
+
+        if args.pipe:
+            if cache is None and not args.save_temps:
+                return self.run_piped (args, extra, work_dir)
+            import sys
+            print >> sys.stderr, \
+                'WARNING: --pipe is ignored with --cache-dir and --save-temps'
+
+        def run_cmd (c, argv, out_file):
+            if cache is None: return c.main (argv)
+            return cache.run (c, argv, out_file)
 
         # all but last command
         for c in self.cmds[:-1]:
@@ -191,7 +383,7 @@ class SeqCmd (AgregateCmd):
             out_file = c.name_out_file (in_files, args, work_dir)
             argv.extend (['-o', out_file])
             argv.extend (in_files)
-            res = c.main (argv)
+            res = run_cmd (c, argv, out_file)
             if res <> 0: return res
 
             in_files = [out_file]
@@ -203,9 +395,86 @@ class SeqCmd (AgregateCmd):
         argv.extend (extra)
         argv.extend (['-o', args.out_file])
         argv.extend (in_files)
-        res = c.main (argv)
+        res = run_cmd (c, argv, args.out_file)
         return res
 
+    def run_piped (self, args, extra, work_dir):
+        """Runs all the commands at once. The output of every command but
+        the last is a named pipe in work_dir, which the next command
+        reads as it is written. A command whose output is its input,
+        e.g., clang on a .bc file, runs first. seahorn reads its input
+        twice with --horn-cache, so the input of the last command is
+        then a file, written before it starts. Once a command fails the
+        others are stopped"""
+        import sys
+        horn_cache = any (a.lstrip ('-').startswith ('horn-cache')
+                          for a in extra)
+
+        # -- (command, argv, output, output is a pipe)
+        stages = []
+        in_files = args.in_files
+        for i, c in enumerate (self.cmds):
+            last = i == len (self.cmds) - 1
+            if last: out_file = args.out_file
+            else: out_file = c.name_out_file (in_files, args, work_dir)
+            argv = list (extra)
+            if out_file is not None: argv.extend (['-o', out_file])
+            argv.extend (in_files)
+            if not last and os.path.exists (out_file):
+                # -- nothing to stream
+                res = c.main (argv)
+                if res <> 0: return res
+            else:
+                fifo = not last and not (horn_cache and i == len (self.cmds) - 2)
+                if fifo: os.mkfifo (out_file)
+                stages.append ((c, argv, out_file, fifo))
+            in_files = [out_file]
+
+        fifos = [s [2] for s in stages if s [3]]
+        results = [None] * len (stages)
+        # -- the command that failed first, the others may be stopped
+        failed = []
+        lock = threading.Lock ()
+
+        def stage (i):
+            try:
+                res = stages [i][0].main (stages [i][1])
+            except Exception as e:
+                print >> sys.stderr, 'ERROR: {0}: {1}'.format (stages [i][0].name, e)
+                res = 1
+            with lock:
+                results [i] = res
+                if res <> 0 and not failed: failed.append (i)
+
+        def abort ():
+            TimeLimitedExec.terminateAll ()
+            # -- wakes up the commands that wait to open a pipe
+            for f in fifos:
+                try:
+                    os.close (os.open (f, os.O_RDWR | os.O_NONBLOCK))
+                except OSError: pass
+
+        def wait (ts):
+            """waits for ts. Once a command fails, stops all of them"""
+            while any (t.is_alive () for t in ts):
+                for t in ts: t.join (0.05)
+                if failed: abort ()
+            return failed
+
+        threads = []
+        for i, s in enumerate (stages):
+            # -- a command waits for an input that is not a pipe
+            if i > 0 and not stages [i - 1][3]:
+                if wait ([threads [-1]]): break
+            t = threading.Thread (target=stage, args=(i,))
+            t.daemon = True
+            t.start ()
+            threads.append (t)
+
+        wait (threads)
+        if failed: return results [failed [0]]
+        return results [-1]
+
 class ExtCmd (LimitedCmd):
     def __init__ (self, name, help='', quiet=False):
         super (ExtCmd, self).__init__ (name, help, allow_extra=True)
@@ -25,11 +25,68 @@ def _bc_or_ll_file (name):
     ext = os.path.splitext (name)[1]
     return ext == '.bc' or ext == '.ll'
 
+class UnitCache (object):
+    """Cache of the bitcode of translation units, shared by the runs of
+    clang. A unit is keyed by its preprocessed source, the options it
+    is compiled with and the compiler, so that a change of a header
+    recompiles the units that include it. Entries are published by
+    renaming a complete file"""
+    def __init__ (self, dname, clang):
+        self.dname = dname
+        st = os.stat (clang)
+        self.tool = '{0}:{1}:{2}'.format (clang, st.st_size, int (st.st_mtime))
+        if not os.path.isdir (dname):
+            try: os.makedirs (dname)
+            except OSError:
+                if not os.path.isdir (dname): raise
+
+    def key (self, clang, argv, in_file):
+        """None if in_file cannot be preprocessed"""
+        import hashlib
+        import subprocess
+        pp_argv = [a for a in argv if a not in ['-c', '-emit-llvm', '-S']]
+        p = subprocess.Popen ([clang, '-E'] + pp_argv + [in_file],
+                              stdout=subprocess.PIPE)
+        h = hashlib.sha256 ()
+        h.update (self.tool + '\n')
+        h.update (repr (argv) + '\n')
+        for chunk in iter (lambda: p.stdout.read (1 << 20), ''): h.update (chunk)
+        if p.wait () <> 0: return None
+        return h.hexdigest ()
+
+    def _entry (self, key):
+        return os.path.join (self.dname, key [:2], key + '.bc')
+
+    def lookup (self, key, out_file):
+        import shutil
+        entry = self._entry (key)
+        if not os.path.isfile (entry): return False
+        shutil.copyfile (entry, out_file)
+        return True
+
+    def store (self, key, out_file):
+        import shutil
+        import tempfile
+        entry = self._entry (key)
+        if not os.path.isdir (os.path.dirname (entry)):
+            try: os.makedirs (os.path.dirname (entry))
+            except OSError: pass
+        fd, tmp = tempfile.mkstemp (prefix='tmp-', dir=os.path.dirname (entry))
+        os.close (fd)
+        try:
+            shutil.copyfile (out_file, tmp)
+            os.rename (tmp, entry)
+        except (IOError, OSError):
+            if os.path.exists (tmp): os.unlink (tmp)
+
 class Clang(sea.LimitedCmd):
     def __init__ (self, quiet=False):
         super (Clang, self).__init__('clang', 'Compile', allow_extra=True)
         self.clangCmd = None
 
+    def cache_extra (self, extra):
+        return filter (lambda s : s.startswith ('-D'), extra)
+
     def mk_arg_parser (self, ap):
         ap = super (Clang, self).mk_arg_parser (ap)
         ap.add_argument ('-m', type=int, dest='machine',
@@ -38,6 +95,13 @@ class Clang(sea.LimitedCmd):
                          dest='debug_info', help='Compile with debug info')
         ap.add_argument ('-I', default=None,
                          dest='include_dir', help='Include')
+        ap.add_argument ('--fe-jobs', dest='fe_jobs', type=int, default=0,
+                         metavar='N', help='Number of files compiled at once '
+                         '(default: number of CPUs)')
+        ap.add_argument ('--unit-cache', dest='unit_cache', metavar='DIR',
+                         default=os.environ.get ('SEA_UNIT_CACHE'),
+                         help='Reuse the bitcode of the files whose '
+                         'preprocessed source is cached in DIR')
         add_tmp_dir_args (ap)
         add_in_out_args (ap)
         _add_S_arg (ap)
@@ -88,16 +152,41 @@ class Clang(sea.LimitedCmd):
             out_files = [_remap_file_name (f, '.bc', workdir)
                          for f in args.in_files]
 
-        for in_file, out_file in zip(args.in_files, out_files):
-            if out_file is not None:
-                argv.extend (['-o', out_file])
-
-            # clone argv
-            argv1 = list ()
-            argv1.extend (argv)
-
+        cache = None
+        if args.unit_cache is not None:
+            cache = UnitCache (args.unit_cache, cmd_name)
+
+        def compile (unit):
+            in_file, out_file = unit
+            key = None
+            # -- without -o, clang names the output
+            if cache is not None and out_file is not None:
+                key = cache.key (cmd_name, argv, in_file)
+                if key is not None and cache.lookup (key, out_file):
+                    print >> sys.stderr, 'cache: hit for {0} ({1})'.format (in_file, key [:12])
+                    return 0
+
+            argv1 = list (argv)
+            if out_file is not None: argv1.extend (['-o', out_file])
             argv1.append (in_file)
+            self.clangCmd = sea.ExtCmd (cmd_name)
             ret = self.clangCmd.run (args, argv1)
+            if ret == 0 and key is not None: cache.store (key, out_file)
+            return ret
+
+        units = zip (args.in_files, out_files)
+        if len (units) == 1:
+            rets = [compile (units [0])]
+        else:
+            import multiprocessing
+            from multiprocessing.pool import ThreadPool
+            jobs = args.fe_jobs if args.fe_jobs > 0 else multiprocessing.cpu_count ()
+            pool = ThreadPool (min (jobs, len (units)))
+            try:
+                rets = pool.map (compile, units)
+            finally:
+                pool.close ()
+        for ret in rets:
             if ret <> 0: return ret
 
         if len(out_files) > 1:
@@ -119,6 +208,105 @@ class Clang(sea.LimitedCmd):
     def stdout (self):
         return self.clangCmd.stdout
 
+def _add_pp_args (ap):
+    """Options of the pre-processor (seapp)"""
+    ap.add_argument ('--inline', dest='inline', help='Inline all functions',
+                     default=False, action='store_true')
+    ap.add_argument ('--inline-cost', dest='inline_cost',
+                     help='Inline the functions that are cheap to inline',
+                     default=False, action='store_true')
+    ap.add_argument ('--entry', dest='entry', help='Entry point if main does not exist',
+                     default=None, metavar='FUNCTION')
+    ap.add_argument ('--do-bounds-check', dest='boc', help='Insert buffer overflow checks',
+                     default=False, action='store_true')
+    ap.add_argument ('--overflow-check', dest='ioc', help='Insert signed integer overflow checks',
+                     default=False, action='store_true')
+    ap.add_argument ('--null-check', dest='ndc', help='Insert null dereference checks',
+                     default=False, action='store_true')
+    ap.add_argument ('--null-check-remove-non-null', dest='ndc_non_null',
+                     help='Do not check accesses through pointers that cannot be null',
+                     default=False, action='store_true')
+    ap.add_argument ('--externalize-addr-taken-functions',
+                     help='Externalize uses of address-taken functions',
+                     dest='enable_ext_funcs', default=False,
+                     action='store_true')
+    ap.add_argument ('--enum-verifier-calls', dest='enum_verifier_calls',
+                     help='Assign an unique identifier to each verifier.error call',
+                     default=False, action='store_true')
+    ap.add_argument ('--slice-program', dest='slice_program',
+                     help='Remove what cannot affect the properties',
+                     default=False, action='store_true')
+    ap.add_argument ('--promote-arrays', dest='promote_arrays',
+                     help='Promote small local arrays accessed with variable indices to scalars',
+                     default=False, action='store_true')
+    ap.add_argument ('--accel-loops', dest='accel_loops',
+                     help='Replace simple counting, fill and copy loops by their effect',
+                     default=False, action='store_true')
+    ap.add_argument ('--lower-invoke',
+                     help='Lower invoke instructions',
+                     dest='lower_invoke', default=False,
+                     action='store_true')
+    ap.add_argument ('--devirt-functions',
+                     help='Devirtualize indirect functions',
+                     dest='devirt_funcs', default=False,
+                     action='store_true')
+    ap.add_argument ('--no-kill-vaarg', help='Do not delete variadic functions',
+                     dest='kill_vaarg', default=True, action='store_false')
+    ap.add_argument ('--strip-extern', help='Replace external function calls ' +
+                     'by non-determinism', default=False, action='store_true',
+                     dest='strip_external')
+    return ap
+
+def _pp_argv (args):
+    """seapp options for the arguments parsed by _add_pp_args"""
+    argv = list()
+    if args.inline: argv.append ('--horn-inline-all')
+    elif args.inline_cost: argv.append ('--horn-inline-cost')
+
+    if args.strip_external:
+        argv.append ('--strip-extern=true')
+    else:
+        argv.append ('--strip-extern=false')
+
+    if args.lower_invoke:
+        argv.append ('--lower-invoke')
+
+    if args.devirt_funcs:
+        argv.append ('--devirt-functions')
+
+    if args.enable_ext_funcs:
+        argv.append ('--externalize-addr-taken-funcs')
+
+    if args.enum_verifier_calls:
+        argv.append ('--enum-verifier-calls')
+
+    if args.slice_program:
+        argv.append ('--slice-program')
+
+    if args.accel_loops:
+        argv.append ('--horn-accel-loops')
+
+    if args.promote_arrays:
+        argv.append ('--promote-arrays')
+
+    if args.boc:
+        argv.append ('--bounds-check')
+    if args.ioc:
+        argv.append ('--overflow-check')
+    if args.ndc:
+        argv.append ('--null-check')
+        if args.ndc_non_null: argv.append ('--null-check-remove-non-null')
+
+    if args.entry is not None:
+        argv.append ('--entry-point={0}'.format (args.entry))
+
+    if args.kill_vaarg:
+        argv.append('--kill-vaarg=true')
+    else:
+        argv.append('--kill-vaarg=false')
+
+    return argv
+
 class Seapp(sea.LimitedCmd):
     def __init__(self, quiet=False):
         super(Seapp, self).__init__('pp', 'Pre-processing', allow_extra=True)
@@ -133,38 +321,12 @@ class Seapp(sea.LimitedCmd):
         # if args.llvm_asm: ext = '.pp.ll'
         return _remap_file_name (in_files[0], ext, work_dir)
 
+    def cache_extra (self, extra):
+        return []
+
     def mk_arg_parser (self, ap):
         ap = super (Seapp, self).mk_arg_parser (ap)
-        ap.add_argument ('--inline', dest='inline', help='Inline all functions',
-                         default=False, action='store_true')
-        ap.add_argument ('--entry', dest='entry', help='Entry point if main does not exist',
-                         default=None, metavar='FUNCTION')
-        ap.add_argument ('--do-bounds-check', dest='boc', help='Insert buffer overflow checks',
-                         default=False, action='store_true')
-        ap.add_argument ('--overflow-check', dest='ioc', help='Insert signed integer overflow checks',
-                         default=False, action='store_true')
-        ap.add_argument ('--null-check', dest='ndc', help='Insert null dereference checks',
-                         default=False, action='store_true')
-        ap.add_argument ('--externalize-addr-taken-functions',
-                         help='Externalize uses of address-taken functions',
-                         dest='enable_ext_funcs', default=False,
-                         action='store_true')
-        ap.add_argument ('--enum-verifier-calls', dest='enum_verifier_calls',
-                         help='Assign an unique identifier to each verifier.error call',
-                         default=False, action='store_true')
-        ap.add_argument ('--lower-invoke',
-                         help='Lower invoke instructions',
-                         dest='lower_invoke', default=False,
-                         action='store_true')
-        ap.add_argument ('--devirt-functions',
-                         help='Devirtualize indirect functions',
-                         dest='devirt_funcs', default=False,
-                         action='store_true')
-        ap.add_argument ('--no-kill-vaarg', help='Do not delete variadic functions',
-                         dest='kill_vaarg', default=True, action='store_false')
-        ap.add_argument ('--strip-extern', help='Replace external function calls ' +
-                         'by non-determinism', default=False, action='store_true',
-                         dest='strip_external')
+        _add_pp_args (ap)
         add_in_out_args (ap)
         _add_S_arg (ap)
         return ap
@@ -176,40 +338,7 @@ class Seapp(sea.LimitedCmd):
 
         argv = list()
         if args.out_file is not None: argv.extend (['-o', args.out_file])
-        if args.inline: argv.append ('--horn-inline-all')
-
-        if args.strip_external:
-            argv.append ('--strip-extern=true')
-        else:
-            argv.append ('--strip-extern=false')
-
-        if args.lower_invoke:
-            argv.append ('--lower-invoke')
-
-        if args.devirt_funcs:
-            argv.append ('--devirt-functions')
-
-        if args.enable_ext_funcs:
-            argv.append ('--externalize-addr-taken-funcs')
-
-        if args.enum_verifier_calls:
-            argv.append ('--enum-verifier-calls')
-
-        if args.boc:
-            argv.append ('--bounds-check')
-        if args.ioc:
-            argv.append ('--overflow-check')
-        if args.ndc:
-            argv.append ('--null-check')
-
-        if args.entry is not None:
-            argv.append ('--entry-point={0}'.format (args.entry))
-
-        if args.kill_vaarg:
-            argv.append('--kill-vaarg=true')
-        else:
-            argv.append('--kill-vaarg=false')
-
+        argv.extend (_pp_argv (args))
         if args.llvm_asm: argv.append ('-S')
         argv.extend (args.in_files)
         return self.seappCmd.run (args, argv)
@@ -228,6 +357,9 @@ class MixedSem(sea.LimitedCmd):
         # if args.llvm_asm: ext = '.ms.ll'
         return _remap_file_name (in_files[0], ext, work_dir)
 
+    def cache_extra (self, extra):
+        return []
+
     def mk_arg_parser (self, ap):
         ap = super (MixedSem, self).mk_arg_parser (ap)
         ap.add_argument ('--no-ms', dest='ms_skip', help='Skip mixed semantics',
@@ -265,10 +397,23 @@ class CutLoops(sea.LimitedCmd):
         ext = '.cut.bc'
         return _remap_file_name (in_files[0], ext, work_dir)
 
+    def cache_extra (self, extra):
+        return []
+
     def mk_arg_parser (self, ap):
         ap = super (CutLoops, self).mk_arg_parser (ap)
         ap.add_argument ('--log', dest='log', default=None,
                          metavar='STR', help='Log level')
+        ap.add_argument ('--unroll', dest='unroll', default=False,
+                         action='store_true',
+                         help='Unroll loops up to their bound before cutting them')
+        ap.add_argument ('--unroll-bound', dest='unroll_bound', default=0,
+                         type=int, metavar='B',
+                         help='Bound of loops without pragma, bounds file, ' +
+                         'or constant trip count')
+        ap.add_argument ('--unroll-bounds-file', dest='unroll_bounds_file',
+                         default=None, metavar='FILE',
+                         help='File with lines: <function> <line|*> <bound>')
         add_in_out_args (ap)
         _add_S_arg (ap)
         return ap
@@ -281,6 +426,12 @@ class CutLoops(sea.LimitedCmd):
         argv = list()
         if args.out_file is not None: argv.extend (['-o', args.out_file])
         argv.append ('--horn-cut-loops')
+        if args.unroll:
+            argv.append ('--horn-unroll-loops')
+            if args.unroll_bound > 0:
+                argv.append ('--unroll-default-bound={b}'.format (b=args.unroll_bound))
+            if args.unroll_bounds_file is not None:
+                argv.append ('--unroll-bounds-file={f}'.format (f=args.unroll_bounds_file))
         if args.llvm_asm: argv.append ('-S')
         argv.extend (args.in_files)
 
@@ -303,6 +454,9 @@ class Seaopt(sea.LimitedCmd):
         # if args.llvm_asm: ext = 'o{0}.ll'.format(args.opt_level)
         return _remap_file_name (in_files[0], ext, work_dir)
 
+    def cache_extra (self, extra):
+        return []
+
     def mk_arg_parser (self, ap):
         ap = super (Seaopt, self).mk_arg_parser (ap)
         ap.add_argument ('-O', type=int, dest='opt_level', metavar='INT',
@@ -362,6 +516,9 @@ class Unroll(sea.LimitedCmd):
         ext = '.ul.bc'
         return _remap_file_name (in_files[0], ext, work_dir)
 
+    def cache_extra (self, extra):
+        return []
+
     def mk_arg_parser (self, ap):
         ap = super (Unroll, self).mk_arg_parser (ap)
         ap.add_argument ('--threshold', type=int, help='Unrolling threshhold. ' +
@@ -414,11 +571,13 @@ def _is_seahorn_opt (x):
     return False
 
 class Seahorn(sea.LimitedCmd):
-    def __init__ (self, solve=False, quiet=False):
-        super (Seahorn, self).__init__ ('horn', 'Generate (and solve) ' +
-                                        'Constrained Horn Clauses in SMT-LIB format',
-                                        allow_extra=True)
+    def __init__ (self, solve=False, quiet=False, pp=False):
+        name = 'horn-pp' if pp else 'horn'
+        help = 'Generate (and solve) Constrained Horn Clauses in SMT-LIB format'
+        if pp: help += ' after running pp|ms|opt in the same process'
+        super (Seahorn, self).__init__ (name, help, allow_extra=True)
         self.solve = solve
+        self.pp = pp
 
     @property
     def stdout (self):
@@ -427,11 +586,21 @@ class Seahorn(sea.LimitedCmd):
     def name_out_file (self, in_files, args=None, work_dir=None):
         return _remap_file_name (in_files[0], '.smt2', work_dir)
 
+    def cache_extra (self, extra):
+        return filter (_is_seahorn_opt, extra)
+
+    def cache_outputs (self, args):
+        return [args.cex, args.asm_out_file, args.cex_values]
+
     def mk_arg_parser (self, ap):
         ap = super (Seahorn, self).mk_arg_parser (ap)
         add_in_out_args (ap)
         ap.add_argument ('--cex', dest='cex', help='Destination for a cex',
                          default=None, metavar='FILE')
+        ap.add_argument ('--cex-values', dest='cex_values', default=None,
+                         metavar='FILE',
+                         help='Write the values of a .ll/.bc cex to FILE, '
+                         'loaded by the run-time, instead of embedding them')
         ap.add_argument ('--solve', dest='solve', action='store_true',
                          help='Solve', default=self.solve)
         ap.add_argument ('--ztrace', dest='ztrace', metavar='STR',
@@ -444,7 +613,7 @@ class Seahorn(sea.LimitedCmd):
                          help='LLVM assembly output file')
         ap.add_argument ('--step',
                          help='Step to use for encoding',
-                         choices=['small', 'large', 'fsmall', 'flarge'],
+                         choices=['small', 'large', 'fsmall', 'flarge', 'adaptive'],
                          dest='step', default='large')
         ap.add_argument ('--track',
                          help='Track registers, pointers, and memory',
@@ -458,6 +627,21 @@ class Seahorn(sea.LimitedCmd):
         ap.add_argument ('--bmc',
                          help='Use BMC engine',
                          dest='bmc', default=False, action='store_true')
+        ap.add_argument ('--checkpoint', dest='checkpoint', default=None,
+                         metavar='PREFIX',
+                         help='Write checkpoints of the solver to PREFIX.*')
+        ap.add_argument ('--resume', dest='resume', default=False,
+                         action='store_true',
+                         help='Start from the checkpoints of --checkpoint')
+        if self.pp:
+            _add_pp_args (ap)
+            ap.add_argument ('--no-ms', dest='ms_skip', help='Skip mixed semantics',
+                             default=False, action='store_true')
+            ap.add_argument ('--no-reduce-main', dest='reduce_main',
+                             help='Do not reduce main to return paths only',
+                             default=True, action='store_false')
+            ap.add_argument ('-O', type=int, dest='opt_level', metavar='INT',
+                             help='Optimization level L:[0,1,2,3]', default=3)
         return ap
 
     def run (self, args, extra):
@@ -470,6 +654,13 @@ class Seahorn(sea.LimitedCmd):
         if args.bmc:
             argv.append ('--horn-bmc')
 
+        if self.pp:
+            argv.append ('--horn-pp')
+            argv.extend (_pp_argv (args))
+            if not args.ms_skip: argv.append ('--horn-mixed-sem')
+            if args.reduce_main: argv.append ('--ms-reduce-main')
+            argv.append ('--horn-pp-opt={0}'.format (args.opt_level))
+
         # if args.crab:
         #     argv.append ('--horn-crab')
 
@@ -484,8 +675,13 @@ class Seahorn(sea.LimitedCmd):
         if args.cex is not None and args.solve:
             argv.append ('-horn-cex-pass')
             argv.append ('-horn-cex={0}'.format (args.cex))
+            if args.cex_values is not None:
+                argv.append ('-horn-cex-values={0}'.format (args.cex_values))
             #argv.extend (['-log', 'cex'])
         if args.asm_out_file is not None: argv.extend (['-oll', args.asm_out_file])
+        if args.checkpoint is not None:
+            argv.append ('--horn-checkpoint={0}'.format (args.checkpoint))
+            if args.resume: argv.append ('--horn-resume')
 
         argv.extend (['-horn-inter-proc',
                       '-horn-sem-lvl={0}'.format (args.track),
@@ -507,6 +703,116 @@ class Seahorn(sea.LimitedCmd):
 
         return self.seahornCmd.run (args, argv)
 
+class ParSolve(sea.LimitedCmd):
+    def __init__ (self, quiet=False):
+        super (ParSolve, self).__init__ ('par-horn', 'Split the properties ' +
+                                         'and solve them in parallel',
+                                         allow_extra=True)
+
+    def name_out_file (self, in_files, args=None, work_dir=None):
+        return _remap_file_name (in_files[0], '.split.bc', work_dir)
+
+    def cache_extra (self, extra):
+        return filter (_is_seahorn_opt, extra)
+
+    def mk_arg_parser (self, ap):
+        ap = super (ParSolve, self).mk_arg_parser (ap)
+        add_in_out_args (ap)
+        add_tmp_dir_args (ap)
+        ap.add_argument ('--split', dest='split', type=int, default=0,
+                         metavar='N', help='Number of verification tasks ' +
+                         '(default: number of CPUs)')
+        ap.add_argument ('--jobs', '-j', dest='jobs', type=int, default=0,
+                         metavar='N', help='Number of tasks run at once ' +
+                         '(default: number of CPUs)')
+        ap.add_argument ('--step',
+                         help='Step to use for encoding',
+                         choices=['small', 'large', 'fsmall', 'flarge', 'adaptive'],
+                         dest='step', default='large')
+        ap.add_argument ('--track',
+                         help='Track registers, pointers, and memory',
+                         choices=['reg', 'ptr', 'mem'], default='mem')
+        return ap
+
+    def run (self, args, extra):
+        import glob
+        import multiprocessing
+        import subprocess
+        import threading
+
+        seapp = which ('seapp')
+        if seapp is None: raise IOError ('seapp not found')
+        seahorn = which ('seahorn')
+        if seahorn is None: raise IOError ('seahorn not found')
+
+        ncpus = multiprocessing.cpu_count ()
+        split = args.split if args.split > 0 else ncpus
+        jobs = args.jobs if args.jobs > 0 else ncpus
+
+        work_dir = createWorkDir (args.temp_dir, args.save_temps, 'par-')
+        split_file = self.name_out_file (args.in_files, args, work_dir)
+        argv = [seapp, '--split-properties={0}'.format (split),
+                '-o', split_file]
+        argv.extend (args.in_files)
+        print ' '.join (argv)
+        ret = subprocess.call (argv)
+        if ret <> 0: return ret
+
+        base = os.path.splitext (split_file)[0]
+        tasks = sorted (glob.glob (base + '.*.bc'))
+        if len (tasks) == 0: tasks = [split_file]
+
+        horn_argv = ['--horn-solve', '-horn-inter-proc',
+                     '-horn-sem-lvl={0}'.format (args.track),
+                     '--horn-step={0}'.format (args.step)]
+        horn_argv.extend (filter (_is_seahorn_opt, extra))
+
+        results = dict ()
+        procs = dict ()
+        lock = threading.Lock ()
+        sem = threading.Semaphore (jobs)
+        done = threading.Event ()
+
+        def set_limits ():
+            import resource as r
+            if args.cpu > 0:
+                r.setrlimit (r.RLIMIT_CPU, [args.cpu, args.cpu])
+            if args.mem > 0:
+                mem_bytes = args.mem * 1024 * 1024
+                r.setrlimit (r.RLIMIT_AS, [mem_bytes, mem_bytes])
+
+        def solve (task):
+            with sem:
+                # -- a counterexample was found, skip the remaining tasks
+                if done.is_set (): return
+                p = subprocess.Popen ([seahorn] + horn_argv + [task],
+                                      stdout=subprocess.PIPE,
+                                      preexec_fn=set_limits)
+                with lock: procs [task] = p
+                out, _ = p.communicate ()
+                lines = out.split ()
+                res = 'unknown'
+                if 'sat' in lines: res = 'sat'
+                elif 'unsat' in lines: res = 'unsat'
+                with lock: results [task] = res
+                print task, res
+                if res == 'sat':
+                    done.set ()
+                    with lock:
+                        for q in procs.itervalues ():
+                            if q.poll () is None: q.terminate ()
+
+        threads = [threading.Thread (target=solve, args=(t,)) for t in tasks]
+        for t in threads: t.start ()
+        for t in threads: t.join ()
+
+        vals = [results.get (t, 'unknown') for t in tasks]
+        if 'sat' in vals: answer = 'sat'
+        elif all (v == 'unsat' for v in vals): answer = 'unsat'
+        else: answer = 'unknown'
+        print answer
+        return 0
+
 class SeahornClp(sea.LimitedCmd):
     def __init__ (self, quiet=False):
         super (SeahornClp, self).__init__ ('horn-clp', allow_extra=True)
@@ -519,6 +825,9 @@ class SeahornClp(sea.LimitedCmd):
     def name_out_file (self, in_files, args=None, work_dir=None):
         return _remap_file_name (in_files[0], '.clp', work_dir)
 
+    def cache_extra (self, extra):
+        return filter (_is_seahorn_opt, extra)
+
     def mk_arg_parser (self, ap):
         ap = super (SeahornClp, self).mk_arg_parser (ap)
         add_in_out_args (ap)
@@ -631,6 +940,9 @@ class Crab (sea.LimitedCmd):
         ext = 'crab.ll'
         return _remap_file_name (in_files[0], ext, work_dir)
 
+    def cache_extra (self, extra):
+        return filter (_is_seahorn_opt, extra)
+
     def mk_arg_parser (self, ap):
         ap = super (Crab, self).mk_arg_parser (ap)
         add_in_out_args (ap)
@@ -686,6 +998,95 @@ class SeaTerm(sea.LimitedCmd):
 
 
 
+class FuzzRun(sea.LimitedCmd):
+    def __init__ (self, quiet=False):
+        super (FuzzRun, self).__init__ ('fuzz-run', 'Fuzz a program to find ' +
+                                        'a counterexample', allow_extra=True)
+
+    def name_out_file (self, in_files, args=None, work_dir=None):
+        return _remap_file_name (in_files[0], '.fuzz.log', work_dir)
+
+    def mk_arg_parser (self, ap):
+        ap = super (FuzzRun, self).mk_arg_parser (ap)
+        add_in_out_args (ap)
+        add_tmp_dir_args (ap)
+        ap.add_argument ('-m', type=int, dest='machine',
+                         help='Machine architecture MACHINE:[32,64]', default=32)
+        ap.add_argument ('--cex', dest='cex', default=None, metavar='FILE',
+                         help='Destination for a .ll/.bc harness of the bug')
+        ap.add_argument ('--cex-values', dest='cex_values', default=None,
+                         metavar='FILE',
+                         help='Write the values of the harness to FILE, '
+                         'loaded by the run-time, instead of embedding them')
+        ap.add_argument ('--fuzz-time', dest='fuzz_time', type=int, default=60,
+                         metavar='SEC', help='Time budget, 0 for none')
+        ap.add_argument ('--fuzz-runs', dest='fuzz_runs', type=int, default=0,
+                         metavar='N', help='Largest number of runs, 0 for none')
+        ap.add_argument ('--fuzz-seed', dest='fuzz_seed', type=int, default=0,
+                         metavar='N', help='Seed of the mutations')
+        ap.add_argument ('--rt', dest='rt', default=None, metavar='FILE',
+                         help='Fuzzing run-time library ' +
+                         '(default: lib/libsea-rt-fuzz.a of the installation)')
+        return ap
+
+    def run (self, args, extra):
+        import subprocess
+
+        seapp = which ('seapp')
+        if seapp is None: raise IOError ('seapp not found')
+        clang = which (['clang-mp-3.6', 'clang-3.6', 'clang',
+                        'clang-mp-3.5', 'clang-mp-3.4'])
+        if clang is None: raise IOError ('clang not found')
+        rt = args.rt
+        if rt is None:
+            root = os.path.dirname (os.path.dirname (sys.argv[0]))
+            rt = os.path.join (root, 'lib', 'libsea-rt-fuzz.a')
+
+        work_dir = createWorkDir (args.temp_dir, args.save_temps, 'fuzz-')
+        in_file = args.in_files[0]
+        inst = _remap_file_name (in_file, '.fuzz.bc', work_dir)
+        exe = _remap_file_name (in_file, '.fuzz', work_dir)
+        log = args.out_file
+        if log is None: log = self.name_out_file (args.in_files, args, work_dir)
+        if os.path.exists (log): os.remove (log)
+
+        # -- nondet functions read the input of the fuzzer, and
+        # -- verifier.error is a crash
+        argv = [seapp, '--fuzz-instrument', '-o', inst, in_file]
+        print ' '.join (argv)
+        ret = subprocess.call (argv)
+        if ret <> 0: return ret
+        argv = [clang, '-m{0}'.format (args.machine), '-o', exe, inst, rt, '-lstdc++']
+        print ' '.join (argv)
+        ret = subprocess.call (argv)
+        if ret <> 0: return ret
+
+        env = dict (os.environ)
+        env ['SEAHORN_FUZZ_LOG'] = log
+        env ['SEAHORN_FUZZ_TIME'] = str (args.fuzz_time)
+        env ['SEAHORN_FUZZ_RUNS'] = str (args.fuzz_runs)
+        env ['SEAHORN_FUZZ_SEED'] = str (args.fuzz_seed)
+        print exe
+        # -- a run that runs out of budget is not an error
+        subprocess.call ([exe], env=env)
+        if not os.path.exists (log):
+            print 'BRUNCH_STAT Result UNKNOWN'
+            return 0
+
+        print 'BRUNCH_STAT Result FALSE'
+        if args.cex is not None:
+            seahorn = which ('seahorn')
+            if seahorn is None: raise IOError ('seahorn not found')
+            argv = [seahorn, '--horn-fuzz-log={0}'.format (log), '-o', args.cex]
+            if args.cex_values is not None:
+                argv.append ('--horn-fuzz-values={0}'.format (args.cex_values))
+            argv.append (in_file)
+            print ' '.join (argv)
+            ret = subprocess.call (argv)
+            if ret <> 0: return ret
+        return 0
+
+
 FrontEnd = sea.SeqCmd ('fe', 'Front end: alias for clang|pp|ms|opt',
                        [Clang(), Seapp(), MixedSem(), Seaopt ()])
 Smt = sea.SeqCmd ('smt', 'alias for fe|horn', FrontEnd.cmds + [Seahorn()])
@@ -699,5 +1100,10 @@ BndSmt = sea.SeqCmd ('bnd-smt', 'alias for fe|unroll|cut-loops|ms|opt|horn',
                                       Seaopt(), Seahorn()])
 Bpf = sea.SeqCmd ('bpf', 'alias for fe|unroll|cut-loops|opt|horn --solve',
                   FrontEnd.cmds + [Unroll(), CutLoops(), Seaopt(), Seahorn(solve=True)])
+Ipf = sea.SeqCmd ('ipf', 'alias for clang|horn-pp --solve',
+                  [Clang(), Seahorn(solve=True, pp=True)])
+ParPf = sea.SeqCmd ('par-pf', 'alias for fe|par-horn',
+                   FrontEnd.cmds + [ParSolve()])
 feCrab = sea.SeqCmd ('fe-crab', 'alias for fe|crab', FrontEnd.cmds + [Crab()])
+Fuzz = sea.SeqCmd ('fuzz', 'alias for clang|fuzz-run', [Clang(), FuzzRun()])
 seaTerm = sea.SeqCmd ('term', 'SeaHorn Termination analysis', Smt.cmds + [SeaTerm()])
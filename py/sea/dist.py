@@ -0,0 +1,352 @@
+"""Distributed verification: a coordinator hands out sea tasks to workers"""
+
+import os
+import os.path
+import sys
+import time
+import json
+import shlex
+import socket
+import threading
+
+from multiprocessing.managers import BaseManager
+
+import sea
+from sea import which
+
+def _address (s):
+    host, _, port = s.rpartition (':')
+    return (host, int (port))
+
+def _authkey (args):
+    if args.authkey is not None: return args.authkey
+    return os.environ.get ('SEA_DIST_KEY', 'seahorn')
+
+def _add_dist_args (ap):
+    ap.add_argument ('--address', dest='address', metavar='HOST:PORT',
+                     default='localhost:50070',
+                     help='Address of the coordinator')
+    ap.add_argument ('--authkey', dest='authkey', metavar='KEY', default=None,
+                     help='Shared secret of the coordinator and its workers ' +
+                     '(default: $SEA_DIST_KEY)')
+    return ap
+
+class _Manager (BaseManager): pass
+
+class TaskBoard (object):
+    """Tasks of the coordinator.
+
+    A task is leased to the worker that takes it until the worker
+    reports its result. Workers renew their leases while a task runs,
+    so a lease that expires belongs to a dead worker and its task is
+    queued again, at most retries times. A split task runs the front
+    end and splits the properties of its module. Its parts are then
+    queued as tasks of their own and its result combines theirs"""
+
+    def __init__ (self, lease, retries):
+        self._lock = threading.Lock ()
+        self._queue = list ()
+        self._tasks = dict ()
+        self._leases = dict ()
+        self._results = dict ()
+        self._lease = lease
+        self._retries = retries
+
+    def _add (self, kind, argv, cpu, mem, parent=None, split=0):
+        tid = str (len (self._tasks))
+        self._tasks [tid] = dict (id=tid, kind=kind, argv=argv, cpu=cpu,
+                                  mem=mem, parent=parent, split=split,
+                                  attempts=0, parts=list ())
+        self._queue.append (tid)
+        return tid
+
+    def add (self, kind, argv, cpu, mem, split=0):
+        with self._lock: return self._add (kind, argv, cpu, mem, split=split)
+
+    def _expire (self):
+        now = time.time ()
+        for tid, (worker, t) in self._leases.items ():
+            if now - t < self._lease: continue
+            del self._leases [tid]
+            task = self._tasks [tid]
+            print >> sys.stderr, 'dist: lost task {0} on {1}'.format (tid, worker)
+            if task ['attempts'] > self._retries:
+                self._finish (tid, dict (status='lost', worker=worker))
+            else: self._queue.insert (0, tid)
+
+    def _combine (self, tid):
+        """Result of a split task once all its parts are done"""
+        task = self._tasks [tid]
+        parts = [self._results.get (p) for p in task ['parts']]
+        if any (r is None for r in parts): return
+        verdicts = [r.get ('verdict') for r in parts]
+        if 'FALSE' in verdicts: verdict = 'FALSE'
+        elif all (v == 'TRUE' for v in verdicts): verdict = 'TRUE'
+        else: verdict = 'UNKNOWN'
+        res = dict (task.get ('frontend', dict ()))
+        res ['verdict'] = verdict
+        res ['time'] = res.get ('time', 0) + sum (r.get ('time', 0) for r in parts)
+        self._finish (tid, res)
+
+    def _finish (self, tid, res):
+        res ['id'] = tid
+        res ['argv'] = self._tasks [tid]['argv']
+        self._results [tid] = res
+        parent = self._tasks [tid]['parent']
+        if parent is not None: self._combine (parent)
+
+    def get_task (self, worker):
+        """The next task for worker, or None if there is none now"""
+        with self._lock:
+            self._expire ()
+            if len (self._queue) == 0: return None
+            tid = self._queue.pop (0)
+            task = self._tasks [tid]
+            task ['attempts'] += 1
+            self._leases [tid] = (worker, time.time ())
+            return task
+
+    def renew (self, worker, tid):
+        with self._lock:
+            if tid in self._leases: self._leases [tid] = (worker, time.time ())
+
+    def put_result (self, worker, tid, res):
+        with self._lock:
+            # -- a late answer of a task that was queued again
+            if tid in self._results: return
+            self._leases.pop (tid, None)
+            if tid in self._queue: self._queue.remove (tid)
+            res ['worker'] = worker
+            task = self._tasks [tid]
+            parts = res.pop ('parts', None)
+            if task ['kind'] != 'split' or res.get ('status') != 'done' or not parts:
+                if task ['kind'] == 'split': res ['verdict'] = 'UNKNOWN'
+                self._finish (tid, res)
+                return
+            # -- the front-end result is combined with those of the parts
+            task ['frontend'] = res
+            for p in parts:
+                pid = self._add ('sea', ['horn', '--solve'] + task ['argv'][:-1] + [p],
+                                 task ['cpu'], task ['mem'], parent=tid)
+                task ['parts'].append (pid)
+
+    def expire (self):
+        with self._lock: self._expire ()
+
+    def finished (self):
+        with self._lock: return len (self._results) == len (self._tasks)
+
+    def results (self):
+        with self._lock:
+            return [self._results [t] for t in sorted (self._results, key=int)
+                    if self._tasks [t]['parent'] is None]
+
+def _stats (output):
+    """BRUNCH_STAT values of the output of sea and its verdict"""
+    stats = dict ()
+    verdict = 'UNKNOWN'
+    for line in output.splitlines ():
+        w = line.split ()
+        if len (w) == 3 and w [0] == 'BRUNCH_STAT': stats [w [1]] = w [2]
+        elif w == ['sat']: verdict = 'FALSE'
+        elif w == ['unsat']: verdict = 'TRUE'
+    return stats, stats.get ('Result', verdict)
+
+class Coordinator (sea.LimitedCmd):
+    def __init__ (self):
+        super (Coordinator, self).__init__ ('dist', 'Run sea tasks on ' +
+                                            'the workers of a cluster',
+                                            allow_extra=False)
+
+    def mk_arg_parser (self, ap):
+        ap = super (Coordinator, self).mk_arg_parser (ap)
+        _add_dist_args (ap)
+        ap.add_argument ('--tasks', dest='tasks', metavar='FILE', default=None,
+                         help='File with one task per line: the arguments ' +
+                         'of sea, e.g., pf --inline a.c')
+        ap.add_argument ('--cmd', dest='cmd', default='pf',
+                         help='Command of sea run on each input file')
+        ap.add_argument ('--split', dest='split', type=int, default=0,
+                         metavar='N', help='Split the properties of each ' +
+                         'input file into N tasks. Lines of --tasks are then ' +
+                         'options followed by a file')
+        ap.add_argument ('--lease', dest='lease', type=int, default=60,
+                         metavar='SEC', help='Time after which a silent ' +
+                         'worker is considered dead')
+        ap.add_argument ('--retries', dest='retries', type=int, default=2,
+                         help='Number of times a task of a dead worker is retried')
+        ap.add_argument ('--results', dest='results', metavar='FILE', default=None,
+                         help='Write the result of each task as a JSON line')
+        ap.add_argument ('in_files', metavar='FILE', nargs='*',
+                         help='Input files')
+        return ap
+
+    def run (self, args, extra):
+        board = TaskBoard (args.lease, args.retries)
+        lines = list ()
+        if args.tasks is not None:
+            with open (args.tasks) as f:
+                lines = [shlex.split (l) for l in f
+                         if l.strip () and not l.startswith ('#')]
+        if args.split > 0:
+            lines.extend ([[f] for f in args.in_files])
+        else:
+            lines.extend ([[args.cmd, f] for f in args.in_files])
+
+        for argv in lines:
+            if args.split > 0:
+                board.add ('split', argv, args.cpu, args.mem, split=args.split)
+            else: board.add ('sea', argv, args.cpu, args.mem)
+        if len (lines) == 0:
+            print >> sys.stderr, 'dist: no tasks'
+            return 1
+
+        _Manager.register ('board', callable=lambda: board)
+        m = _Manager (address=_address (args.address), authkey=_authkey (args))
+        server = m.get_server ()
+        t = threading.Thread (target=server.serve_forever)
+        t.daemon = True
+        t.start ()
+        print 'dist: serving {0} tasks on {1}'.format (len (lines), args.address)
+
+        while not board.finished ():
+            time.sleep (1)
+            board.expire ()
+        # -- let the workers see that there is nothing left
+        time.sleep (2)
+
+        results = board.results ()
+        if args.results is not None:
+            with open (args.results, 'w') as f:
+                for r in results: f.write (json.dumps (r, sort_keys=True) + '\n')
+        self._summary (results)
+        return 0
+
+    def _summary (self, results):
+        """Aggregated BRUNCH_STAT of all tasks"""
+        counts = dict ()
+        totals = dict ()
+        for r in results:
+            v = r.get ('verdict', r.get ('status', 'UNKNOWN'))
+            counts [v] = counts.get (v, 0) + 1
+            for k, x in r.get ('stats', dict ()).iteritems ():
+                try: totals [k] = totals.get (k, 0.0) + float (x)
+                except ValueError: pass
+        print 'BRUNCH_STAT Tasks {0}'.format (len (results))
+        for v in sorted (counts):
+            print 'BRUNCH_STAT Result_{0} {1}'.format (v, counts [v])
+        for k in sorted (totals):
+            print 'BRUNCH_STAT {0}_total {1:.2f}'.format (k, totals [k])
+
+class Worker (sea.CliCmd):
+    def __init__ (self):
+        super (Worker, self).__init__ ('dist-worker', 'Run the tasks of ' +
+                                       'a dist coordinator', allow_extra=False)
+
+    def mk_arg_parser (self, ap):
+        ap = super (Worker, self).mk_arg_parser (ap)
+        _add_dist_args (ap)
+        ap.add_argument ('--jobs', '-j', dest='jobs', type=int, default=0,
+                         metavar='N', help='Number of tasks run at once ' +
+                         '(default: number of CPUs)')
+        ap.add_argument ('--shared-dir', dest='shared_dir', metavar='DIR',
+                         default=None, help='Directory shared by the workers ' +
+                         'for the parts of split tasks')
+        ap.add_argument ('--poll', dest='poll', type=int, default=5,
+                         metavar='SEC', help='Wait between requests when ' +
+                         'there is no task')
+        return ap
+
+    def _exec (self, argv, cpu, mem):
+        import subprocess
+        cmd = sea.TimeLimitedExec (argv, cpu, mem, stdout=subprocess.PIPE,
+                                   stderr=subprocess.STDOUT)
+        rc = cmd.Run ()
+        return rc, cmd.stdout or ''
+
+    def _split (self, task, sea_cmd, shared_dir):
+        """Front end and property splitting of a split task"""
+        import glob
+        seapp = which ('seapp')
+        if seapp is None: raise IOError ('seapp not found')
+        base = os.path.join (shared_dir, 'task{0}'.format (task ['id']))
+        fe = base + '.fe.bc'
+        split = base + '.bc'
+        argv = task ['argv']
+        rc, out = self._exec ([sea_cmd, 'fe'] + argv [:-1] + ['-o', fe, argv [-1]],
+                              task ['cpu'], task ['mem'])
+        if rc != 0: return rc, out, None
+        rc, out2 = self._exec ([seapp, '--split-properties={0}'.format (task ['split']),
+                                '-o', split, fe], task ['cpu'], task ['mem'])
+        parts = sorted (glob.glob (base + '.*.bc'))
+        parts = [p for p in parts if p != fe]
+        return rc, out + out2, parts or [split]
+
+    def _run_task (self, board, wid, task, sea_cmd, args):
+        renewed = threading.Event ()
+        def heartbeat ():
+            while not renewed.wait (max (1, args.poll)):
+                try: board.renew (wid, task ['id'])
+                except Exception: return
+        hb = threading.Thread (target=heartbeat)
+        hb.daemon = True
+        hb.start ()
+
+        start = time.time ()
+        parts = None
+        try:
+            if task ['kind'] == 'split':
+                rc, out, parts = self._split (task, sea_cmd, args.shared_dir)
+            else:
+                rc, out = self._exec ([sea_cmd] + task ['argv'],
+                                      task ['cpu'], task ['mem'])
+        finally:
+            renewed.set ()
+
+        stats, verdict = _stats (out)
+        res = dict (status='done' if rc == 0 else 'error', rc=rc,
+                    time=time.time () - start, stats=stats, verdict=verdict,
+                    host=socket.gethostname ())
+        if rc != 0: res ['output'] = out [-4096:]
+        if parts is not None: res ['parts'] = parts
+        board.put_result (wid, task ['id'], res)
+        print 'dist: task {0} {1} {2}'.format (task ['id'], res ['status'], verdict)
+
+    def run (self, args, extra):
+        import multiprocessing
+        sea_cmd = which ('sea')
+        if sea_cmd is None: raise IOError ('sea not found')
+        if args.shared_dir is not None and not os.path.isdir (args.shared_dir):
+            os.makedirs (args.shared_dir)
+
+        _Manager.register ('board')
+        m = _Manager (address=_address (args.address), authkey=_authkey (args))
+        m.connect ()
+        jobs = args.jobs if args.jobs > 0 else multiprocessing.cpu_count ()
+        host = socket.gethostname ()
+
+        def loop (i):
+            # -- a proxy per thread, proxies are not thread safe
+            board = m.board ()
+            wid = '{0}:{1}:{2}'.format (host, os.getpid (), i)
+            while True:
+                try:
+                    task = board.get_task (wid)
+                    if task is None:
+                        if board.finished (): return
+                        time.sleep (args.poll)
+                        continue
+                    if task ['kind'] == 'split' and args.shared_dir is None:
+                        board.put_result (wid, task ['id'],
+                                          dict (status='error', rc=-1,
+                                                output='no --shared-dir'))
+                        continue
+                    self._run_task (board, wid, task, sea_cmd, args)
+                except (EOFError, IOError, socket.error):
+                    # -- the coordinator is gone
+                    return
+
+        threads = [threading.Thread (target=loop, args=(i,)) for i in range (jobs)]
+        for t in threads: t.start ()
+        for t in threads: t.join ()
+        return 0
@@ -14,6 +14,7 @@ import re
 import fileinput
 import shutil
 import itertools
+import time
 
 
 root = os.path.dirname (os.path.dirname (os.path.realpath (__file__)))
@@ -92,6 +93,11 @@ def initProfiles():
     profiles ['no_inline'] = base
     profiles ['houdini_no_inline'] = base + [ '--horn-houdini']
     profiles ['houdini_inline'] = base + [ '--horn-houdini', '--inline']
+    profiles ['sea_dsa'] = base + [ '--horn-sea-dsa']
+    profiles ['sea_dsa_inline'] = base + [ '--horn-sea-dsa', '--inline']
+    profiles ['small_inline'] = base + [ '--step=small', '--inline']
+    # -- finds shallow bugs fast, never proves a program correct
+    profiles ['fuzz'] = ['fuzz', '-g', '--fuzz-time=900']
     profiles ['term_lex'] = ['term', '-O0', '--horn-no-verif', '--step=flarge', '--inline']
     profiles ['term_max'] = ['term', '-O0', '--horn-no-verif', '--step=flarge', '--inline', '--rank_func=max']
     return profiles
@@ -126,7 +132,21 @@ def parseOpt (argv):
                        help='Machine architecture 32 or 64')
     parser.add_option ('--profiles', '-p', dest='profiles',
                        default='inline:no_inline',
-                       help='Colon separated list of profiles')
+                       help='Colon separated list of profiles, or all')
+    parser.add_option ('--jobs', '-j', type='int', dest='jobs', default=None,
+                       help='Number of profiles run at the same time ' +
+                       '(default: number of cores)')
+    parser.add_option ('--history', dest='history',
+                       default=os.path.expanduser ('~/.sea_par_history.json'),
+                       help='File with the win rates of the profiles. ' +
+                       'Profiles that won more often run first. Empty to disable')
+    parser.add_option ('--no-features', dest='features', action='store_false',
+                       default=True,
+                       help='Do not order and limit the profiles by the ' +
+                       'features of the input')
+    parser.add_option ('--tuned', dest='tuned', default=None,
+                       help='Configurations tuned per feature cluster by ' +
+                       'sea_tune.py, raced by the horn runs')
     parser.add_option ('--list-profiles', dest='list_profiles',
                        action='store_true', default=False)
     parser.add_option ('--cex', dest='cex', default=None,
@@ -157,6 +177,14 @@ def parseOpt (argv):
         listProfiles ()
         sys.exit (0)
 
+    if options.profiles == 'all':
+        options.profiles = ':'.join (k for k in sorted (profiles.iterkeys ())
+                                     if not k.startswith ('term'))
+
+    if options.jobs is None:
+        import multiprocessing
+        options.jobs = multiprocessing.cpu_count ()
+
     if options.arch != 32 and options.arch != 64:
         parser.error ('Unknown architecture {0}'.format (opt.arch))
 
@@ -182,20 +210,68 @@ def getSea ():
         raise IOError ("Cannot find sea")
     return seahorn
 
+def getSeaInspect ():
+    """seainspect, used to extract the features of the input. None if
+    it is not installed"""
+    inspect = os.path.join (root, "bin/seainspect")
+    if not isexec (inspect): return None
+    return inspect
+
 
 def cat (in_file, out_file): out_file.write (in_file.read ())
 
 running = list()
 
-def runSeahorn (args, fname, stdout, stderr):
-
-    args = args + [fname]
-    if verbose: print ' '.join (args)
-    return sub.Popen (args,
-                      stdout=open (stdout, 'w'),
-                      stderr=open (stderr, 'w'))
-
-
+class Task (object):
+    """A run of sea. It starts once the task it depends on, if any, is done"""
+    def __init__ (self, name, argv, stdout, stderr, dep=None, profile=True):
+        self.name = name
+        self.argv = argv
+        self.stdout = stdout
+        self.stderr = stderr
+        self.dep = dep
+        self.profile = profile
+        self.proc = None
+        self.returnvalue = None
+        self.started = None
+        self.time = None
+        # -- seconds the task may run, None for no limit
+        self.budget = None
+
+    def ready (self):
+        return self.dep is None or self.dep.returnvalue == 0
+
+    def blocked (self):
+        """True if the task it depends on failed"""
+        return self.dep is not None and self.dep.returnvalue not in [None, 0]
+
+    def start (self):
+        if verbose: print ' '.join (self.argv)
+        self.started = time.time ()
+        # -- a process group of its own so that killing the task also
+        # -- kills the tools run by sea
+        self.proc = sub.Popen (self.argv,
+                               stdout=open (self.stdout, 'w'),
+                               stderr=open (self.stderr, 'w'),
+                               preexec_fn=os.setpgrp)
+        running.append (self.proc)
+
+    def expired (self):
+        return self.budget is not None and self.started is not None and \
+            time.time () - self.started > self.budget
+
+    def finish (self, returnvalue):
+        self.returnvalue = returnvalue
+        self.time = time.time () - self.started
+
+    def kill (self, grace=1.0):
+        for sig in [signal.SIGTERM, signal.SIGKILL]:
+            try: os.killpg (self.proc.pid, sig)
+            except OSError: return
+            deadline = time.time () + grace
+            while time.time () < deadline:
+                if self.proc.poll () is not None: return
+                time.sleep (0.05)
 
 def getAnswer(out_file):
     output = open(out_file).read()
@@ -206,9 +282,95 @@ def getAnswer(out_file):
     else:
         return None
 
+def loadHistory (fname):
+    import json
+    if not fname: return dict ()
+    try:
+        with open (fname) as f: return json.load (f)
+    except (IOError, ValueError): return dict ()
+
+def saveHistory (fname, hist):
+    import json
+    if not fname: return
+    # -- concurrent runs may update the history, the last one wins
+    tmp = '{0}.{1}.tmp'.format (fname, os.getpid ())
+    try:
+        with open (tmp, 'w') as f: json.dump (hist, f, indent=1, sort_keys=True)
+        os.rename (tmp, fname)
+    except (IOError, OSError): pass
+
+def profileRank (hist, prof):
+    """Profiles with a higher win rate, then faster verdicts, first. The
+    win rate is smoothed so that new profiles run before losing ones"""
+    h = hist.get (prof, dict ())
+    wins = h.get ('wins', 0)
+    rate = (wins + 1.0) / (h.get ('runs', 0) + 2.0)
+    avg = h.get ('time', 0.0) / wins if wins > 0 else float ('inf')
+    return (-rate, avg)
+
+def loadFeatures (fname):
+    import json
+    try:
+        with open (fname) as f: return json.load (f)
+    except (IOError, ValueError): return None
+
+def featureRank (feat, prof):
+    """Adjusts the order of a profile for a program with the features
+    written by seainspect --features. Negative runs it earlier,
+    positive later"""
+    if feat is None: return 0
+    rank = 0
+    inline = 'inline' in prof and not prof.startswith ('no_')
+    # -- inlining cannot remove recursion and blows up large programs
+    if inline and (feat ['recursive_sccs'] > 0 or feat ['insts'] > 20000):
+        rank += 1
+    if prof == 'no_inline' and feat ['recursive_sccs'] > 0: rank -= 1
+    # -- many memory regions or array accesses favour the precise DSA
+    if 'sea_dsa' in prof and \
+       (feat ['regions'] > 50 or feat ['array_intensity'] > 0.05):
+        rank -= 1
+    # -- Houdini guesses candidates over the arguments of the loop
+    # -- relations. It pays off for loops over few variables
+    if 'houdini' in prof and feat ['loops'] > 0:
+        if feat ['max_arity'] <= 20: rank -= 1
+        elif feat ['max_arity'] > 60: rank += 1
+    return rank
+
+def featureCluster (feat):
+    """Name of the cluster of programs with features like feat, e.g.,
+    loops+arrays. The clusters split on the same features as
+    featureRank. Configurations are tuned per cluster by sea_tune.py"""
+    if feat is None: return 'default'
+    traits = list ()
+    if feat ['recursive_sccs'] > 0: traits.append ('recursive')
+    if feat ['loops'] > 0:
+        traits.append ('loops' if feat ['max_arity'] <= 20 else 'wide_loops')
+    if feat ['regions'] > 50 or feat ['array_intensity'] > 0.05:
+        traits.append ('arrays')
+    if feat ['bv_intensity'] > 0.01: traits.append ('bv')
+    if feat ['insts'] > 20000: traits.append ('large')
+    return '+'.join (traits) if traits else 'straight'
+
+def featureBudget (feat, prof, cpu):
+    """Seconds that a profile unlikely to win may take from the cores,
+    None for no limit"""
+    if feat is None or cpu <= 0: return None
+    if featureRank (feat, prof) > 0: return 0.25 * cpu
+    return None
+
+def updateHistory (hist, tasks, winner):
+    for t in tasks:
+        if not t.profile or t.proc is None: continue
+        h = hist.setdefault (t.name, dict ())
+        h ['runs'] = h.get ('runs', 0) + 1
+        if t is winner:
+            h ['wins'] = h.get ('wins', 0) + 1
+            h ['time'] = h.get ('time', 0.0) + t.time
+
 
 def run (workdir, fname, sea_args = [], profs = [],
-         cex = None, arch=32, cpu=-1, mem=-1):
+         cex = None, arch=32, cpu=-1, mem=-1, jobs=1, history=None,
+         use_features=True, tuned=None):
 
     print "BRUNCH_STAT Result UNKNOWN"
     sys.stdout.flush ()
@@ -228,87 +390,164 @@ def run (workdir, fname, sea_args = [], profs = [],
         cex_base = os.path.splitext (cex_base)[0]
         cex_base = os.path.join (workdir, cex_base)
 
+    conf_name = list (profs)
+    hist = loadHistory (history)
+    profs = sorted (profs, key=lambda p: profileRank (hist, p))
 
-    conf_name = list ()
-    sea = list ()
-
+    name = os.path.splitext (os.path.basename (fname))[0]
+    def logs (tag):
+        return (os.path.join (workdir, '{0}_{1}.stdout'.format (name, tag)),
+                os.path.join (workdir, '{0}_{1}.stderr'.format (name, tag)))
+
+    # -- tasks in the order they should start. pf profiles are split
+    # -- into fe and horn so that profiles with the same front-end
+    # -- options share its result
+    tasks = list ()
+    fes = dict ()
+    # -- features of the first front-end result. Once known, they
+    # -- reorder the profiles that did not start and limit the time of
+    # -- the ones unlikely to win
+    inspect = getSeaInspect () if use_features else None
+    feat_task = None
+    feat_file = os.path.join (workdir, '{0}.features.json'.format (name))
     for prof in profs:
-        conf_name.append (prof)
-        p_args = base_args + profiles [prof]
+        cmd = profiles [prof][0]
+        p_args = base_args + profiles [prof][1:]
+        out, err = logs (prof)
+
+        cex_args = list ()
         if cex is not None:
             cex_name = '{0}.{1}.trace'.format (cex_base, prof)
-            p_args.append ('--cex={0}'.format (cex_name))
-        sea.append (p_args)
-
-    name = os.path.splitext (os.path.basename (fname))[0]
-    stdout = [os.path.join (workdir, name + '_seahorn{0}.stdout'.format (i))
-              for i in range(len (sea))]
-    stderr = [os.path.join (workdir, name + '_seahorn{0}.stderr'.format (i))
-              for i in range (len (sea))]
-    global running
-    running.extend ([runSeahorn (sea [i], fname, stdout[i], stderr [i])
-                     for i in range (len (sea))])
-
-
-    orig_pids = [p.pid for p in running]
-    pids = [p.pid for p in running ]
-    pid = -1
+            cex_args.append ('--cex={0}'.format (cex_name))
+
+        if cmd != 'pf':
+            tasks.append (Task (prof, p_args [:1] + [cmd] + p_args [1:] +
+                                cex_args + [fname], out, err))
+            continue
+
+        fe_args = filter (non_seahorn_opt, p_args [1:])
+        key = tuple (fe_args)
+        if key not in fes:
+            fe_name = 'fe{0}'.format (len (fes))
+            fe_out, fe_err = logs (fe_name)
+            bc = os.path.join (workdir, '{0}.{1}.bc'.format (name, fe_name))
+            fe = Task (fe_name, [sea_cmd, 'fe'] + fe_args + ['-o', bc, fname],
+                       fe_out, fe_err, profile=False)
+            fe.bc = bc
+            fes [key] = fe
+            tasks.append (fe)
+            if inspect is not None and feat_task is None:
+                feat_out, feat_err = logs ('features')
+                feat_task = Task ('features',
+                                  [inspect, '--features={0}'.format (feat_file), bc],
+                                  feat_out, feat_err, dep=fe, profile=False)
+                tasks.append (feat_task)
+        fe = fes [key]
+        tasks.append (Task (prof, [sea_cmd, 'horn', '--solve'] + p_args [1:] +
+                            cex_args + [fe.bc], out, err, dep=fe))
+
+    pending = list (tasks)
+    active = dict ()
+    winner = None
     returnvalue = -1
-    while len (pids) != 0:
-        print 'Running: ', pids
-
-        (pid, returnvalue, ru_child) = os.wait4 (-1, 0)
-
-        print 'Finished pid {0} with'.format (pid),
+    while winner is None:
+        # -- the most promising tasks that can run take the free cores
+        for t in list (pending):
+            if t.blocked (): pending.remove (t)
+            elif len (active) < jobs and t.ready ():
+                pending.remove (t)
+                t.start ()
+                active [t.proc.pid] = t
+        if len (active) == 0: break
+
+        print 'Running: ', ' '.join (t.name for t in active.itervalues ())
+        if any (t.budget is not None for t in active.itervalues ()):
+            # -- poll so that the tasks out of budget can be stopped
+            (pid, returnvalue, ru_child) = os.wait4 (-1, os.WNOHANG)
+            if pid == 0:
+                for t in [t for t in active.itervalues () if t.expired ()]:
+                    print 'Stopping {0}: out of its time budget'.format (t.name)
+                    # -- kill reaps the process, so wait4 will not see it
+                    t.kill ()
+                    active.pop (t.proc.pid)
+                    running.remove (t.proc)
+                    rc = t.proc.returncode
+                    t.finish (-rc if rc is not None and rc < 0 else 256 * (rc or 0))
+                time.sleep (0.05)
+                continue
+        else:
+            (pid, returnvalue, ru_child) = os.wait4 (-1, 0)
+        t = active.pop (pid, None)
+        if t is None: continue
+        t.finish (returnvalue)
+        running.remove (t.proc)
+
+        if t is feat_task and returnvalue == 0:
+            feat = loadFeatures (feat_file)
+            if feat is not None:
+                print 'Features:', ' '.join ('{0}={1}'.format (k, v)
+                                             for (k, v) in sorted (feat.iteritems ()))
+                for p in pending + list (active.itervalues ()):
+                    if p.profile: p.budget = featureBudget (feat, p.name, cpu)
+                if tuned is not None:
+                    # -- the horn runs that did not start race the
+                    # -- configurations tuned for the cluster
+                    cluster = featureCluster (feat)
+                    print 'BRUNCH_STAT feature_cluster', cluster
+                    for p in pending:
+                        if p.profile and 'horn' in p.argv:
+                            p.argv [-1:-1] = ['--horn-portfolio-tuned={0}'.format (tuned),
+                                              '--horn-portfolio-cluster={0}'.format (cluster)]
+                pending.sort (key=lambda p: (p.profile,
+                                             featureRank (feat, p.name) if p.profile else 0))
+            continue
+
+        print 'Finished {0} (pid {1}) with'.format (t.name, pid),
         print ' code {0} and signal {1}'.format((returnvalue // 256),
                                                 (returnvalue % 256))
-        pids.remove (pid)
-        idx = orig_pids.index (pid)
-        out_f = stdout[idx]
 
-        # if a process terminated successfully and produced True/False
+        # if a profile terminated successfully and produced True/False
         # answer kill all other processes
-        if returnvalue == 0 and getAnswer (out_f) is not None:
-            for p in pids:
-                try:
-                    os.kill (p, signal.SIGTERM)
-                except OSError: pass
-                finally:
-                    try:
-                        os.waitpid (p, 0)
-                    except OSError: pass
-            break
-
-    if returnvalue == 0 and getAnswer(out_f) is not None:
-        cat (open (out_f), sys.stdout)
-        cat (open (stderr[idx]), sys.stderr)
+        if t.profile and returnvalue == 0 and getAnswer (t.stdout) is not None:
+            winner = t
+
+    for t in active.itervalues (): t.kill ()
+    running[:] = []
+
+    updateHistory (hist, tasks, winner)
+    saveHistory (history, hist)
+
+    if winner is not None:
+        cat (open (winner.stdout), sys.stdout)
+        cat (open (winner.stderr), sys.stderr)
         if cex is not None:
-            cex_name = '{0}.{1}.trace'.format (cex_base, conf_name [idx])
+            cex_name = '{0}.{1}.trace'.format (cex_base, winner.name)
             if os.path.isfile (cex_name):
                 print 'Copying {0} to {1}'.format (cex_name, cex)
                 shutil.copy2 (cex_name, cex)
                 print 'Counterexample trace is in {0}'.format (cex)
 
 
-        print 'WINNER: ', ' '.join (sea [idx])
-        print 'BRUNCH_STAT config {0}'.format (idx)
-        print 'BRUNCH_STAT config_name {0}'.format (conf_name [idx])
+        print 'WINNER: ', ' '.join (winner.argv)
+        print 'BRUNCH_STAT config {0}'.format (conf_name.index (winner.name))
+        print 'BRUNCH_STAT config_name {0}'.format (winner.name)
+        print 'BRUNCH_STAT config_time {0:.2f}'.format (winner.time)
 
     else:
         # print failed logs if we do not have a good one
         # useful for debugging
-        for idx, cname, std, err in zip (itertools.count (), conf_name, stdout, stderr):
-            print >> sys.stdout, 'LOG BEGIN', cname
-            cat (open (std), sys.stdout)
-            print >> sys.stdout, 'LOG END', cname
-            print >> sys.stderr, 'LOG BEGIN', cname
-            cat (open (err), sys.stderr)
-            print >> sys.stderr, 'LOG END', cname
+        for t in tasks:
+            if t.proc is None: continue
+            print >> sys.stdout, 'LOG BEGIN', t.name
+            cat (open (t.stdout), sys.stdout)
+            print >> sys.stdout, 'LOG END', t.name
+            print >> sys.stderr, 'LOG BEGIN', t.name
+            cat (open (t.stderr), sys.stderr)
+            print >> sys.stderr, 'LOG END', t.name
         print "ALL INSTANCES FAILED"
         print 'Calling sys.exit with {0}'.format (returnvalue // 256)
         sys.exit (returnvalue // 256)
 
-    running[:] = []
     return returnvalue
 
 def seahorn_opt (x):
@@ -349,7 +588,8 @@ def main (argv):
                 print "HERE"
                 fname = strain.removeLinePragma(workdir, fname)
             returnvalue = run (workdir, fname, seahorn_args, opt.profiles.split (':'),
-                               opt.cex, opt.arch, opt.cpu, opt.mem)
+                               opt.cex, opt.arch, opt.cpu, opt.mem,
+                               opt.jobs, opt.history, opt.features, opt.tuned)
         else:
             print "BRUNCH_STAT Result UNKNOWN"
     return returnvalue
@@ -360,10 +600,9 @@ def killall ():
     for p in running:
         try:
             if p.poll () == None:
-                p.terminate ()
-                p.kill ()
+                # -- the process group has the tools run by sea
+                os.killpg (p.pid, signal.SIGKILL)
                 p.wait ()
-                # no need to kill pg since it kills its children
         except OSError:   pass
     running[:] = []
 
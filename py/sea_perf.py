@@ -0,0 +1,257 @@
+#!/usr/bin/env python
+"""
+Performance regression harness.
+
+Runs the inputs of a suite (test/perf/suite.json by default) under the
+fixed configurations of the suite, records the wall time, peak memory,
+Z3 time, hornification time and Horn clause database size of every
+run, and compares them against a stored baseline:
+
+   sea_perf.py --update-baseline     # record the baseline
+   sea_perf.py                       # compare against it
+
+Every input is run --repeat times and the median is kept, together
+with the median absolute deviation (MAD) as the noise of the
+metric. A metric regresses if it is more than --threshold (relative)
+above the baseline and the difference is larger than both the
+absolute noise floor of the metric and three times the MAD of the
+baseline and of the new runs. The exit code is 1 if a metric
+regressed or a verdict changed.
+"""
+
+import sys
+import os
+import os.path
+import json
+import signal
+import subprocess as sub
+import time
+
+root = os.path.dirname (os.path.dirname (os.path.realpath (__file__)))
+
+# -- metrics: name, BRUNCH_STAT key (None if measured by the harness),
+# -- scale to the unit of the metric and absolute noise floor
+metrics = [
+    ('wall', None, 1.0, 0.1),
+    ('max_rss_mb', None, 1.0, 5.0),
+    ('hornify', 'HornifyModule', 1.0, 0.05),
+    ('z3', 'z3.telemetry.wall_ms', 0.001, 0.05),
+    ('rules', 'HornRules', 1.0, 0.0),
+    ('relations', 'HornRelations', 1.0, 0.0),
+]
+
+
+def parseOpt (argv):
+    from optparse import OptionParser
+
+    parser = OptionParser (usage='%prog [options]', description=__doc__.strip ())
+    parser.add_option ('--suite', default=os.path.join (root, 'test', 'perf', 'suite.json'),
+                       help='Suite of inputs and configurations')
+    parser.add_option ('--baseline', default=None,
+                       help='Baseline file (default: baseline.json next to the suite)')
+    parser.add_option ('--update-baseline', dest='update', action='store_true',
+                       default=False, help='Record the results as the new baseline')
+    parser.add_option ('--sea', default=None, help='sea command (default: bin/sea)')
+    parser.add_option ('--repeat', type='int', default=3,
+                       help='Runs of every input (default: 3)')
+    parser.add_option ('--threshold', type='float', default=0.15,
+                       help='Relative slowdown reported as a regression')
+    parser.add_option ('--cpu', type='int', default=300,
+                       help='Time limit of a run in seconds')
+    parser.add_option ('--filter', default='',
+                       help='Only run inputs whose name contains this string')
+    parser.add_option ('--json', dest='json_out', default=None,
+                       help='Write the results and the comparison to this file')
+    (opt, args) = parser.parse_args (argv)
+
+    if opt.baseline is None:
+        opt.baseline = os.path.join (os.path.dirname (opt.suite), 'baseline.json')
+    if opt.sea is None:
+        opt.sea = os.path.join (root, 'bin', 'sea')
+    if opt.repeat < 1:
+        parser.error ('--repeat must be positive')
+    return opt
+
+
+def median (v):
+    v = sorted (v)
+    n = len (v)
+    if n == 0: return None
+    if n % 2 == 1: return v [n / 2]
+    return (v [n / 2 - 1] + v [n / 2]) / 2.0
+
+
+def mad (v):
+    m = median (v)
+    if m is None: return None
+    return median ([abs (x - m) for x in v])
+
+
+def parseStats (out):
+    stats = {}
+    for line in out.splitlines ():
+        if not line.startswith ('BRUNCH_STAT '): continue
+        fields = line.split (None, 2)
+        if len (fields) == 3: stats [fields [1]] = fields [2].strip ()
+    return stats
+
+
+def getAnswer (out):
+    for line in out.splitlines ():
+        line = line.strip ()
+        if line in ('sat', 'unsat', 'unknown'): return line
+    return 'unknown'
+
+
+def runOnce (opt, cmd, workdir):
+    """ Runs cmd. Returns the metrics of the run and its answer """
+    out_name = os.path.join (workdir, 'out')
+    with open (out_name, 'w') as out:
+        start = time.time ()
+        p = sub.Popen (cmd, stdout=out, stderr=sub.STDOUT,
+                       preexec_fn=os.setsid)
+        deadline = start + opt.cpu
+        while True:
+            pid, status, ru = os.wait4 (p.pid, os.WNOHANG)
+            if pid != 0: break
+            if time.time () > deadline:
+                os.killpg (p.pid, signal.SIGKILL)
+                pid, status, ru = os.wait4 (p.pid, 0)
+                break
+            time.sleep (0.01)
+        wall = time.time () - start
+    with open (out_name) as f: text = f.read ()
+
+    stats = parseStats (text)
+    res = {'wall': wall}
+    # -- in KB on Linux. Includes the tools that sea waited for
+    res ['max_rss_mb'] = ru.ru_maxrss / 1024.0
+    for (name, key, scale, floor) in metrics:
+        if key is None or key not in stats: continue
+        try:
+            res [name] = float (stats [key]) * scale
+        except ValueError:
+            pass
+    timeout = wall >= opt.cpu
+    answer = 'timeout' if timeout else getAnswer (text)
+    return res, answer
+
+
+def runSuite (opt, suite, workdir):
+    results = {}
+    for inp in suite ['inputs']:
+        name = '{0}:{1}'.format (inp ['file'], inp ['config'])
+        if opt.filter not in name: continue
+        cmd = [opt.sea] + suite ['configs'][inp ['config']] + \
+              [os.path.join (root, inp ['file'])]
+        runs = []
+        answers = set ()
+        for i in range (opt.repeat):
+            r, a = runOnce (opt, cmd, workdir)
+            runs.append (r)
+            answers.add (a)
+        entry = {'answer': '/'.join (sorted (answers)),
+                 'expect': inp.get ('expect'), 'metrics': {}}
+        for (m, key, scale, floor) in metrics:
+            vals = [r [m] for r in runs if m in r]
+            if len (vals) == 0: continue
+            entry ['metrics'][m] = {'median': median (vals), 'mad': mad (vals),
+                                    'runs': vals}
+        results [name] = entry
+        print >> sys.stderr, 'ran', name, entry ['answer'], \
+            '{0:.2f}s'.format (entry ['metrics']['wall']['median'])
+    return results
+
+
+def compare (opt, base, new):
+    """ Returns the rows of the comparison and whether one regressed """
+    rows = []
+    failed = False
+    floors = dict ((m, floor) for (m, key, scale, floor) in metrics)
+    for name in sorted (new.iterkeys ()):
+        n = new [name]
+        b = base.get (name)
+        row = {'input': name, 'answer': n ['answer'], 'metrics': {}}
+
+        status = 'ok'
+        if n ['expect'] is not None and n ['answer'] != n ['expect']:
+            status = 'wrong'
+        elif b is not None and b ['answer'] != n ['answer']:
+            status = 'changed'
+        if status != 'ok': failed = True
+
+        for m, nm in n ['metrics'].iteritems ():
+            cell = {'new': nm ['median']}
+            if b is not None and m in b ['metrics']:
+                bm = b ['metrics'][m]
+                diff = nm ['median'] - bm ['median']
+                noise = max (floors [m], 3 * bm ['mad'], 3 * nm ['mad'])
+                cell ['base'] = bm ['median']
+                cell ['ratio'] = nm ['median'] / bm ['median'] if bm ['median'] > 0 else None
+                if diff > noise and diff > opt.threshold * bm ['median']:
+                    cell ['regressed'] = True
+                    if status == 'ok': status = 'slower'
+                    failed = True
+                elif -diff > noise and -diff > opt.threshold * bm ['median']:
+                    cell ['improved'] = True
+            row ['metrics'][m] = cell
+        row ['status'] = status
+        rows.append (row)
+    return rows, failed
+
+
+def printTable (rows):
+    names = [m for (m, key, scale, floor) in metrics]
+    width = max ([len (r ['input']) for r in rows] + [5])
+    print '{0:<{w}}  {1:<8} {2:<8}'.format ('input', 'status', 'answer', w=width) + \
+        ''.join ('{0:>18}'.format (m) for m in names)
+    for r in rows:
+        line = '{0:<{w}}  {1:<8} {2:<8}'.format (r ['input'], r ['status'],
+                                                r ['answer'], w=width)
+        for m in names:
+            c = r ['metrics'].get (m)
+            if c is None:
+                line += '{0:>18}'.format ('-')
+                continue
+            txt = '{0:.2f}'.format (c ['new'])
+            if c.get ('ratio') is not None:
+                txt += ' ({0:+.0f}%)'.format (100 * (c ['ratio'] - 1))
+            if c.get ('regressed'): txt += '!'
+            line += '{0:>18}'.format (txt)
+        print line
+
+
+def main (argv):
+    opt = parseOpt (argv [1:])
+    with open (opt.suite) as f: suite = json.load (f)
+
+    import tempfile, shutil
+    workdir = tempfile.mkdtemp (prefix='seaperf-')
+    try:
+        results = runSuite (opt, suite, workdir)
+    finally:
+        shutil.rmtree (workdir, ignore_errors=True)
+
+    if opt.update:
+        with open (opt.baseline, 'w') as f:
+            json.dump (results, f, indent=1, sort_keys=True)
+        print 'Baseline written to', opt.baseline
+        return 0
+
+    base = {}
+    if os.path.isfile (opt.baseline):
+        with open (opt.baseline) as f: base = json.load (f)
+    else:
+        print >> sys.stderr, 'WARNING: no baseline', opt.baseline
+
+    rows, failed = compare (opt, base, results)
+    printTable (rows)
+    if opt.json_out is not None:
+        with open (opt.json_out, 'w') as f:
+            json.dump ({'results': results, 'comparison': rows,
+                        'regressed': failed}, f, indent=1, sort_keys=True)
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit (main (sys.argv))
@@ -0,0 +1,106 @@
+#!/usr/bin/env python
+"""
+Replays counterexample harnesses in bulk.
+
+A harness built with --cex-values reads the values of its trace from a
+file that the run-time maps at start-up. The same executable replays
+any values file of the same program whose nondet functions are the
+same, given through SEAHORN_CEX_VALUES:
+
+   sea_replay.py ./out a.values b.values ...
+
+runs ./out once per values file, --jobs at a time, and reports whether
+every run reached the error. The exit code is 1 if a run did not.
+"""
+
+import sys
+import os
+import os.path
+import signal
+import subprocess as sub
+import tempfile
+import time
+
+
+def parseOpt (argv):
+    from optparse import OptionParser
+
+    parser = OptionParser (usage='%prog [options] EXE VALUES...',
+                           description=__doc__.strip ())
+    parser.add_option ('--jobs', '-j', type='int', default=None,
+                       help='Runs at the same time (default: number of cores)')
+    parser.add_option ('--cpu', type='int', default=10,
+                       help='Time limit of a run in seconds')
+    parser.add_option ('--verbose', action='store_true', default=False,
+                       help='Trace value requests and memory accesses of the runs')
+    (opt, args) = parser.parse_args (argv)
+    if len (args) < 2:
+        parser.error ('expected an executable and values files')
+    if opt.jobs is None:
+        import multiprocessing
+        opt.jobs = multiprocessing.cpu_count ()
+    return opt, args [0], args [1:]
+
+
+# -- printed by the run-time when the trace reaches the error
+error_markers = ('__VERIFIER_error was executed', '__assert_fail was executed')
+
+
+def verdict (out, status, timeout):
+    if timeout: return 'timeout'
+    if any (m in out for m in error_markers): return 'error'
+    if os.WIFSIGNALED (status): return 'crash'
+    return 'no-error'
+
+
+def replay (opt, exe, files):
+    env = dict (os.environ)
+    if opt.verbose: env ['SEAHORN_RT_VERBOSE'] = '1'
+
+    pending = list (files)
+    active = {}
+    results = {}
+    while pending or active:
+        while pending and len (active) < opt.jobs:
+            f = pending.pop (0)
+            env ['SEAHORN_CEX_VALUES'] = f
+            # -- a file, so that a long output does not block the run
+            out = tempfile.TemporaryFile ()
+            p = sub.Popen ([exe], stdout=out, stderr=sub.STDOUT,
+                           env=dict (env), preexec_fn=os.setsid)
+            active [p.pid] = (p, f, time.time (), out)
+        done = []
+        for pid, (p, f, start, out) in active.items ():
+            if p.poll () is not None:
+                done.append (pid)
+            elif time.time () - start > opt.cpu:
+                os.killpg (p.pid, signal.SIGKILL)
+                p.wait ()
+                out.close ()
+                results [f] = 'timeout'
+                del active [pid]
+        for pid in done:
+            p, f, start, out_f = active.pop (pid)
+            out_f.seek (0)
+            out = out_f.read ()
+            out_f.close ()
+            # -- Popen.returncode is negative for signals
+            status = (-p.returncode) if p.returncode < 0 else (p.returncode << 8)
+            results [f] = verdict (out, status, False)
+            if opt.verbose: sys.stdout.write (out)
+        if active and not done: time.sleep (0.01)
+    return results
+
+
+def main (argv):
+    opt, exe, files = parseOpt (argv [1:])
+    results = replay (opt, exe, files)
+    failed = False
+    for f in files:
+        print '{0}: {1}'.format (f, results [f])
+        if results [f] != 'error': failed = True
+    return 1 if failed else 0
+
+
+if __name__ == '__main__':
+    sys.exit (main (sys.argv))
@@ -0,0 +1,194 @@
+#!/usr/bin/env python
+"""
+Tunes the configurations of the Horn portfolio per feature cluster.
+
+The inputs of a suite (test/perf/suite.json by default) are grouped by
+the cluster of their features (see featureCluster in sea_par.py). For
+every cluster, and for the suite as a whole as the cluster default,
+the configurations of a search space (test/perf/tune.json by default)
+race by successive halving: every round runs the configurations left
+on the inputs of the cluster under a time budget, keeps the best
+1/--eta of them and multiplies the budget by --eta, up to --cpu. A
+configuration is scored by the number of inputs it solves, then by its
+PAR-2 time (the time of a solved input, twice the budget otherwise). A
+configuration that gives a wrong verdict is dropped.
+
+The result is written to --out as CLUSTER SPEC lines, best first, to
+be read by
+
+   sea pf --horn-portfolio-tuned=FILE --horn-portfolio-cluster=CLUSTER
+   sea_par.py --tuned=FILE
+
+which picks the cluster from the features of the input.
+"""
+
+import sys
+import os
+import os.path
+import json
+import math
+import subprocess as sub
+
+import sea_perf
+import sea_par
+
+root = sea_perf.root
+
+
+def parseOpt (argv):
+    from optparse import OptionParser
+
+    parser = OptionParser (usage='%prog [options]', description=__doc__.strip ())
+    parser.add_option ('--suite', default=os.path.join (root, 'test', 'perf', 'suite.json'),
+                       help='Suite of inputs and configurations')
+    parser.add_option ('--space', default=os.path.join (root, 'test', 'perf', 'tune.json'),
+                       help='JSON list of the portfolio specs to tune')
+    parser.add_option ('--sea', default=None, help='sea command (default: bin/sea)')
+    parser.add_option ('--inspect', default=None,
+                       help='seainspect command (default: bin/seainspect)')
+    parser.add_option ('--cpu', type='int', default=300,
+                       help='Time limit of a run in the last round, in seconds')
+    parser.add_option ('--eta', type='int', default=3,
+                       help='Configurations kept in a round are 1/ETA of them')
+    parser.add_option ('--keep', type='int', default=3,
+                       help='Configurations written per cluster')
+    parser.add_option ('--filter', default='',
+                       help='Only use inputs whose name contains this string')
+    parser.add_option ('--out', default='tuned.txt',
+                       help='Tuned configurations (default: tuned.txt)')
+    parser.add_option ('--json', dest='json_out', default=None,
+                       help='Write the scores of every round to this file')
+    (opt, args) = parser.parse_args (argv)
+
+    if opt.sea is None:
+        opt.sea = os.path.join (root, 'bin', 'sea')
+    if opt.inspect is None:
+        opt.inspect = os.path.join (root, 'bin', 'seainspect')
+    if opt.eta < 2:
+        parser.error ('--eta must be at least 2')
+    if opt.keep < 1:
+        parser.error ('--keep must be positive')
+    return opt
+
+
+class Budget (object):
+    """ The options of sea_perf.runOnce with a time limit of cpu """
+    def __init__ (self, cpu): self.cpu = cpu
+
+
+def inputFeatures (opt, inp, config, workdir):
+    """ Features of an input, None if they cannot be computed """
+    bc = os.path.join (workdir, 'input.bc')
+    feat = os.path.join (workdir, 'features.json')
+    fe_args = filter (sea_par.non_seahorn_opt, config [1:])
+    with open (os.devnull, 'w') as null:
+        if sub.call ([opt.sea, 'fe'] + fe_args +
+                     ['-o', bc, os.path.join (root, inp ['file'])],
+                     stdout=null, stderr=null) != 0:
+            return None
+        if sub.call ([opt.inspect, '--features={0}'.format (feat), bc],
+                     stdout=null, stderr=null) != 0:
+            return None
+    return sea_par.loadFeatures (feat)
+
+
+def score (runs, expect, budget):
+    """ (solved, PAR-2 time) of the runs of a configuration, None if a
+    verdict is wrong """
+    solved = 0
+    par2 = 0.0
+    for (name, res, answer) in runs:
+        if answer in ('sat', 'unsat'):
+            if expect [name] is not None and answer != expect [name]: return None
+            solved += 1
+            par2 += res ['wall']
+        else:
+            par2 += 2 * budget
+    return (solved, par2)
+
+
+def halving (opt, suite, space, inputs, workdir, report):
+    """ Successive halving of the specs of space on inputs. Returns the
+    specs that are left, best first """
+    expect = dict ((i ['file'], i.get ('expect')) for i in inputs)
+    cands = list (space)
+    rounds = max (1, int (math.ceil (math.log (len (cands), opt.eta))))
+    budget = max (1, opt.cpu / opt.eta ** (rounds - 1))
+    while True:
+        scores = []
+        for spec in cands:
+            runs = []
+            for inp in inputs:
+                cmd = [opt.sea] + suite ['configs'][inp ['config']] + \
+                      ['--horn-portfolio={0}'.format (spec),
+                       os.path.join (root, inp ['file'])]
+                res, answer = sea_perf.runOnce (Budget (budget), cmd, workdir)
+                runs.append ((inp ['file'], res, answer))
+                print >> sys.stderr, 'ran', inp ['file'], spec, answer, \
+                    '{0:.2f}s'.format (res ['wall'])
+            s = score (runs, expect, budget)
+            if s is None:
+                print >> sys.stderr, 'WARNING: wrong verdict, dropping', spec
+                continue
+            scores.append ((spec, s))
+        # -- most solved first, then fastest. Ties keep the order of the space
+        scores.sort (key=lambda (spec, s): (-s [0], s [1]))
+        report.append ({'budget': budget,
+                        'scores': [{'spec': spec, 'solved': s [0], 'par2': s [1]}
+                                   for (spec, s) in scores]})
+        cands = [spec for (spec, s) in scores]
+        if budget >= opt.cpu or len (cands) <= opt.keep: return cands
+        cands = cands [:max (opt.keep, len (cands) / opt.eta)]
+        budget = min (opt.cpu, budget * opt.eta)
+
+
+def main (argv):
+    opt = parseOpt (argv [1:])
+    with open (opt.suite) as f: suite = json.load (f)
+    with open (opt.space) as f: space = json.load (f)
+    if len (space) == 0:
+        print >> sys.stderr, 'ERROR: empty search space', opt.space
+        return 1
+    inputs = [i for i in suite ['inputs'] if opt.filter in i ['file']]
+
+    import tempfile, shutil
+    workdir = tempfile.mkdtemp (prefix='seatune-')
+    clusters = {}
+    report = {}
+    try:
+        for inp in inputs:
+            feat = inputFeatures (opt, inp, suite ['configs'][inp ['config']], workdir)
+            cluster = sea_par.featureCluster (feat)
+            print >> sys.stderr, inp ['file'], 'is in', cluster
+            clusters.setdefault (cluster, []).append (inp)
+
+        tuned = []
+        for cluster in sorted (clusters.iterkeys ()) + ['default']:
+            members = inputs if cluster == 'default' else clusters [cluster]
+            if cluster == 'default' and len (clusters) == 1:
+                # -- the same inputs as the only cluster
+                best = tuned [-1][1]
+            else:
+                report [cluster] = []
+                best = halving (opt, suite, space, members, workdir, report [cluster])
+            tuned.append ((cluster, best [:opt.keep]))
+    finally:
+        shutil.rmtree (workdir, ignore_errors=True)
+
+    with open (opt.out, 'w') as f:
+        print >> f, '# written by sea_tune.py from', os.path.basename (opt.suite)
+        for (cluster, best) in tuned:
+            print >> f, '# {0}: {1} inputs'.format \
+                (cluster, len (inputs if cluster == 'default' else clusters [cluster]))
+            for spec in best: print >> f, cluster, spec
+    print 'Tuned configurations written to', opt.out
+    if opt.json_out is not None:
+        with open (opt.json_out, 'w') as f:
+            json.dump ({'clusters': dict ((c, [i ['file'] for i in m])
+                                          for (c, m) in clusters.iteritems ()),
+                        'rounds': report}, f, indent=1, sort_keys=True)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit (main (sys.argv))
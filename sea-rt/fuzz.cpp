@@ -0,0 +1,300 @@
+/** Run-time of programs instrumented by seapp --fuzz-instrument.
+
+    The stubs of KleeInternalize get their values from
+    klee_make_symbolic, which reads them from an input of 8-byte
+    words, and the blocks report their coverage to __seahorn_fuzz_cov.
+    If SEAHORN_FUZZ_RUNS or SEAHORN_FUZZ_TIME is set, a constructor
+    runs a coverage-guided fuzzer before main: it forks one child per
+    input, and the child runs the program. Inputs that reach new edges
+    are kept and mutated further, until an error is reached or the
+    budget is spent. Otherwise the program runs once on the input of
+    SEAHORN_FUZZ_INPUT, zeros if it is not set.
+
+    Reaching __VERIFIER_error or __assert_fail is a crash: the values
+    returned so far are written to SEAHORN_FUZZ_LOG, one "name value"
+    line each, and the program aborts. seahorn --horn-fuzz-log turns
+    the log into a harness for libsea-rt.a.
+
+    Never link with libsea-rt.a, both define klee_make_symbolic. */
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+const unsigned MAP_SIZE = 1 << 16;
+/// longest input, in words
+const size_t MAX_WORDS = 4096;
+
+/// state shared by the fuzzer and its children
+struct Shared {
+  uint32_t error;
+  /// words read by the child, may exceed the input
+  uint64_t consumed;
+  uint8_t map[MAP_SIZE];
+};
+
+// -- plain globals only: the constructor may run before the dynamic
+// -- initialization of this file
+Shared localShared;
+Shared *shared = &localShared;
+uint32_t prevLoc;
+
+const uint64_t *input;
+size_t inputWords;
+
+/// values returned so far, for the log
+struct Logged {
+  const char *name;
+  uint64_t value;
+};
+Logged *logged;
+size_t numLogged, capLogged;
+
+bool verbose () { return getenv ("SEAHORN_RT_VERBOSE") != nullptr; }
+
+void writeLog () {
+  const char *path = getenv ("SEAHORN_FUZZ_LOG");
+  if (!path) path = "seahorn-fuzz.log";
+  FILE *f = fopen (path, "w");
+  if (!f) {
+    fprintf (stderr, "seahorn-fuzz: cannot write %s\n", path);
+    return;
+  }
+  for (size_t i = 0; i < numLogged; ++i)
+    fprintf (f, "%s %llu\n", logged [i].name,
+             (unsigned long long) logged [i].value);
+  fclose (f);
+}
+
+void error (const char *what) {
+  printf ("%s was executed\n", what);
+  fflush (stdout);
+  shared->error = 1;
+  writeLog ();
+  abort ();
+}
+
+uint64_t nextWord () {
+  uint64_t i = shared->consumed++;
+  return i < inputWords ? input [i] : 0;
+}
+
+/// xorshift64*, the fuzzer needs speed rather than quality
+uint64_t rngState = 88172645463325252ull;
+uint64_t rnd () {
+  rngState ^= rngState >> 12;
+  rngState ^= rngState << 25;
+  rngState ^= rngState >> 27;
+  return rngState * 2685821657736338717ull;
+}
+uint64_t rnd (uint64_t n) { return n ? rnd () % n : 0; }
+
+const uint64_t interesting[] = {
+  0, 1, 2, 3, 4, 8, 16, 32, 64, 100, 127, 128, 255, 256, 1000, 1024,
+  4096, 32767, 32768, 65535, 65536, 0x7fffffffull, 0x80000000ull,
+  0xffffffffull, 0x7fffffffffffffffull, 0x8000000000000000ull,
+  (uint64_t) -1, (uint64_t) -2, (uint64_t) -100};
+const size_t numInteresting = sizeof (interesting) / sizeof (interesting [0]);
+
+void mutate (std::vector<uint64_t> &in, uint64_t consumed) {
+  // -- the last run read past the input, make room for what it read
+  if (consumed > in.size () && rnd (2) == 0)
+    in.resize (consumed < MAX_WORDS ? consumed : MAX_WORDS, interesting [rnd (numInteresting)]);
+  if (in.empty ()) in.push_back (0);
+
+  unsigned ops = 1 + rnd (4);
+  for (unsigned k = 0; k < ops; ++k) {
+    uint64_t &w = in [rnd (in.size ())];
+    switch (rnd (7)) {
+    case 0: w = rnd (); break;
+    case 1: w = interesting [rnd (numInteresting)]; break;
+    case 2: w += 1 + rnd (35); break;
+    case 3: w -= 1 + rnd (35); break;
+    case 4: w ^= 1ull << rnd (64); break;
+    // -- another word, or close to it, for comparisons between values
+    case 5: w = in [rnd (in.size ())] + rnd (7) - 3; break;
+    default:
+      if (in.size () < MAX_WORDS) in.push_back (interesting [rnd (numInteresting)]);
+      else if (in.size () > 1) in.pop_back ();
+    }
+  }
+}
+
+/// bucket of a hit count, as AFL: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+
+uint8_t bucket (uint8_t c) {
+  if (c <= 3) return c == 3 ? 4 : c;
+  if (c < 8) return 8;
+  if (c < 16) return 16;
+  if (c < 32) return 32;
+  if (c < 128) return 64;
+  return 128;
+}
+
+/// true if the last run covered an edge or a hit count not seen before
+bool newCoverage (uint8_t *virgin) {
+  bool res = false;
+  for (unsigned i = 0; i < MAP_SIZE; ++i) {
+    if (!shared->map [i]) continue;
+    uint8_t b = bucket (shared->map [i]);
+    if (virgin [i] & b) { virgin [i] &= ~b; res = true; }
+  }
+  return res;
+}
+
+uint64_t envNumber (const char *name, uint64_t dflt) {
+  const char *v = getenv (name);
+  return v ? strtoull (v, nullptr, 10) : dflt;
+}
+
+double now () {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/// runs the fuzzer in the parent, returns in every child
+void fuzz (uint64_t runs, uint64_t seconds) {
+  void *p = mmap (nullptr, sizeof (Shared), PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    fprintf (stderr, "seahorn-fuzz: cannot map coverage\n");
+    exit (2);
+  }
+  shared = static_cast<Shared*> (p);
+  rngState ^= envNumber ("SEAHORN_FUZZ_SEED", 0) * 0x9e3779b97f4a7c15ull;
+  uint64_t timeoutMs = envNumber ("SEAHORN_FUZZ_TIMEOUT", 1000);
+  bool quiet = !verbose ();
+
+  static uint8_t virgin[MAP_SIZE];
+  memset (virgin, 0xff, sizeof (virgin));
+  std::vector<std::vector<uint64_t> > corpus (1);
+  std::vector<uint64_t> consumed (1, 0);
+  std::vector<uint64_t> cur;
+
+  double start = now ();
+  uint64_t n = 0;
+  bool found = false;
+  for (; !runs || n < runs; ++n) {
+    if (seconds && now () - start > seconds) break;
+
+    size_t parent = rnd (corpus.size ());
+    cur = corpus [parent];
+    // -- the first run is on the empty input
+    if (n) mutate (cur, consumed [parent]);
+    inputWords = cur.size ();
+    memset (shared, 0, sizeof (Shared));
+
+    fflush (stdout);
+    fflush (stderr);
+    pid_t pid = fork ();
+    if (pid < 0) {
+      fprintf (stderr, "seahorn-fuzz: fork failed\n");
+      break;
+    }
+    if (pid == 0) {
+      // -- the vectors of the fuzzer are freed when it returns
+      uint64_t *words = static_cast<uint64_t*> (malloc ((cur.size () + 1) * sizeof (uint64_t)));
+      memcpy (words, cur.data (), cur.size () * sizeof (uint64_t));
+      input = words;
+      if (quiet) {
+        int null = open ("/dev/null", O_WRONLY);
+        if (null >= 0) { dup2 (null, 1); dup2 (null, 2); close (null); }
+      }
+      struct itimerval t;
+      memset (&t, 0, sizeof (t));
+      t.it_value.tv_sec = timeoutMs / 1000;
+      t.it_value.tv_usec = (timeoutMs % 1000) * 1000;
+      setitimer (ITIMER_REAL, &t, nullptr);
+      return;
+    }
+
+    int status;
+    waitpid (pid, &status, 0);
+    if (shared->error) { found = true; ++n; break; }
+    if (newCoverage (virgin)) {
+      corpus.push_back (cur);
+      consumed.push_back (shared->consumed);
+    }
+  }
+
+  if (found)
+    printf ("seahorn-fuzz: error found after %llu runs\n", (unsigned long long) n);
+  else
+    printf ("seahorn-fuzz: no error in %llu runs, %zu inputs kept\n",
+            (unsigned long long) n, corpus.size () - 1);
+  fflush (stdout);
+  _exit (found ? 1 : 0);
+}
+
+/// reads the input of a single run from SEAHORN_FUZZ_INPUT
+void readInput () {
+  const char *path = getenv ("SEAHORN_FUZZ_INPUT");
+  if (!path) return;
+  FILE *f = fopen (path, "rb");
+  if (!f) {
+    fprintf (stderr, "seahorn-fuzz: cannot read %s\n", path);
+    exit (2);
+  }
+  uint64_t *words = static_cast<uint64_t*> (malloc (MAX_WORDS * sizeof (uint64_t)));
+  inputWords = fread (words, sizeof (uint64_t), MAX_WORDS, f);
+  input = words;
+  fclose (f);
+}
+
+__attribute__((constructor)) void fuzzMain () {
+  uint64_t runs = envNumber ("SEAHORN_FUZZ_RUNS", 0);
+  uint64_t seconds = envNumber ("SEAHORN_FUZZ_TIME", 0);
+  if (runs || seconds) fuzz (runs, seconds);
+  else readInput ();
+}
+
+}
+
+extern "C" {
+
+void __seahorn_fuzz_cov (uint32_t id) {
+  shared->map [(id ^ prevLoc) & (MAP_SIZE - 1)]++;
+  prevLoc = id >> 1;
+}
+
+void klee_make_symbolic (void *v, size_t sz, char *name) {
+  uint64_t w = nextWord ();
+  if (sz < sizeof (w)) w &= (1ull << (8 * sz)) - 1;
+  memset (v, 0, sz);
+  memcpy (v, &w, sz < sizeof (w) ? sz : sizeof (w));
+
+  if (numLogged == capLogged) {
+    capLogged = capLogged ? 2 * capLogged : 64;
+    logged = static_cast<Logged*> (realloc (logged, capLogged * sizeof (Logged)));
+  }
+  logged [numLogged].name = name;
+  logged [numLogged].value = w;
+  ++numLogged;
+}
+
+/// an assumption that does not hold ends the run, it is not a bug
+void klee_assume (int b) {
+  if (!b) _exit (0);
+}
+
+void __VERIFIER_assume (int b) { klee_assume (b); }
+
+void __VERIFIER_error () { error ("__VERIFIER_error"); }
+
+void __assert_fail (const char *assertion, const char *file,
+                    unsigned int line, const char *function) {
+  error ("__assert_fail");
+}
+
+}
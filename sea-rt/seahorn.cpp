@@ -5,11 +5,27 @@
 #include <cassert>
 #include <cstdlib>
 #include <cstring>
-#include <map>
-#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// true if SEAHORN_RT_VERBOSE is set: trace every value request and
+/// memory access
+static bool verbose ()
+{
+  static const bool v = getenv ("SEAHORN_RT_VERBOSE") != nullptr;
+  return v;
+}
 
 extern "C" {
 
+/// path of the values file of the harness, if it was built with one
+extern const char __seahorn_cex_values[] __attribute__((weak));
+
 void __VERIFIER_error() {
   printf("__VERIFIER_error was executed\n");
   exit(1);
@@ -22,7 +38,8 @@ void __VERIFIER_assume(int x) {
 #define get_value_helper(ctype, llvmtype)                               \
   ctype __seahorn_get_value_ ## llvmtype (int ctr, ctype *g_arr, int g_arr_sz) { \
     assert (ctr < g_arr_sz && "Unexpected index");                      \
-    printf("__seahorn_get_value_" #llvmtype " %d %d\n", ctr, g_arr_sz); \
+    if (verbose ())                                                     \
+      printf("__seahorn_get_value_" #llvmtype " %d %d\n", ctr, g_arr_sz); \
     return g_arr[ctr];                                                  \
   }
 
@@ -35,50 +52,117 @@ get_value_int(8)
 
 get_value_helper(intptr_t, ptr_internal)
 
-const int MEM_REGION_SIZE_GUESS = 4000;
-const int TYPE_GUESS = sizeof(int);
-
-  std::map<intptr_t, intptr_t, std::greater<intptr_t>> absptrmap;
+/** Values files written by seahorn --horn-cex-values. See
+    writeValuesFile in Harness.cc for the format */
+struct ValuesFile {
+  const uint64_t *tables; // pairs of first and count
+  const uint64_t *values;
+  uint32_t numTables;
+};
+
+static const ValuesFile &valuesFile () {
+  static ValuesFile vf = [] {
+    // -- SEAHORN_CEX_VALUES replays the harness on another trace of
+    // -- the same program
+    const char *path = getenv ("SEAHORN_CEX_VALUES");
+    if (!path) path = __seahorn_cex_values;
+    if (!path) {
+      fprintf (stderr, "seahorn-rt: no values file\n");
+      exit (2);
+    }
+    int fd = open (path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat (fd, &st) != 0 || st.st_size < 16) {
+      fprintf (stderr, "seahorn-rt: cannot read values file %s\n", path);
+      exit (2);
+    }
+    void *p = mmap (nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close (fd);
+    const char *base = static_cast<const char*> (p);
+    if (p == MAP_FAILED || memcmp (base, "SEAV", 4) != 0 ||
+        *reinterpret_cast<const uint32_t*> (base + 4) != 1) {
+      fprintf (stderr, "seahorn-rt: %s is not a values file\n", path);
+      exit (2);
+    }
+    ValuesFile r;
+    r.numTables = *reinterpret_cast<const uint32_t*> (base + 8);
+    r.tables = reinterpret_cast<const uint64_t*> (base + 16);
+    r.values = r.tables + 2 * r.numTables;
+    if (16 + 8 * (2 * (uint64_t) r.numTables) > (uint64_t) st.st_size) {
+      fprintf (stderr, "seahorn-rt: %s is truncated\n", path);
+      exit (2);
+    }
+    return r;
+  } ();
+  return vf;
+}
 
-  /*intptr_t __seahorn_get_value_ptr(int ctr, intptr_t *g_arr, int g_arr_sz, int ebits) {
-  static std::unordered_map<intptr_t, intptr_t> absptrmap;
-  intptr_t absptr = __seahorn_get_value_ptr_internal(ctr, g_arr, g_arr_sz);
+static uint64_t tableValue (int table, int ctr) {
+  const ValuesFile &vf = valuesFile ();
+  assert ((unsigned) table < vf.numTables && "Unexpected table");
+  assert ((uint64_t) ctr < vf.tables [2 * table + 1] && "Unexpected index");
+  return vf.values [vf.tables [2 * table] + ctr];
+}
 
-  auto concptrfind = absptrmap.find(absptr);
-  intptr_t concptr;
-  if (concptrfind == absptrmap.end()) {
-    concptr = (intptr_t) calloc(MEM_REGION_SIZE_GUESS, ebits == 0 ? TYPE_GUESS : ebits);
-    absptrmap.insert({absptr, concptr});
-  } else {
-    concptr = concptrfind->second;
+#define get_value_tbl_helper(ctype, llvmtype)                           \
+  ctype __seahorn_get_value_tbl_ ## llvmtype (int table, int ctr) {     \
+    if (verbose ())                                                     \
+      printf("__seahorn_get_value_tbl_" #llvmtype " %d %d\n", table, ctr); \
+    return (ctype) tableValue (table, ctr);                             \
   }
 
-  printf("Returning %#lx for abstract pointer %#lx\n", concptr, absptr);
+#define get_value_tbl_int(bits) get_value_tbl_helper(int ## bits ## _t, i ## bits)
 
-  return concptr;
-  }*/
+get_value_tbl_int(64)
+get_value_tbl_int(32)
+get_value_tbl_int(16)
+get_value_tbl_int(8)
 
-  intptr_t __seahorn_get_value_ptr(int ctr, intptr_t *g_arr, int g_arr_sz, int ebits) {
-    intptr_t absptr = __seahorn_get_value_ptr_internal(ctr, g_arr, g_arr_sz);
+const int MEM_REGION_SIZE_GUESS = 4000;
+const int TYPE_GUESS = sizeof(int);
 
-    size_t sz = MEM_REGION_SIZE_GUESS * (ebits == 0 ? TYPE_GUESS : ebits);
+  /** Regions returned for abstract pointers: the end of the region
+      of every start, and the starts of the regions that overlap each
+      page, so that an address is found by hashing its page */
+  const int PAGE_BITS = 12;
+  std::unordered_map<intptr_t, intptr_t> absptrEnd;
+  std::unordered_map<intptr_t, std::vector<intptr_t>> absptrPages;
 
-    absptrmap[absptr] = absptr + sz;
+  static void addAbsPtr (intptr_t absptr, int ebits) {
+    size_t sz = MEM_REGION_SIZE_GUESS * (ebits == 0 ? TYPE_GUESS : ebits);
+    intptr_t &end = absptrEnd[absptr];
+    // -- only the pages the region grows into are new
+    intptr_t from = end ? end : absptr;
+    if (end < absptr + (intptr_t) sz) {
+      end = absptr + sz;
+      for (intptr_t pg = from >> PAGE_BITS; pg <= (end - 1) >> PAGE_BITS; ++pg) {
+        std::vector<intptr_t> &starts = absptrPages[pg];
+        if (starts.empty () || starts.back () != absptr) starts.push_back (absptr);
+      }
+    }
+    if (verbose ())
+      printf("Returning abstract pointer from %#lx to %#lx\n", absptr, end);
+  }
 
-    printf("Returning abstract pointer from %#lx to %#lx\n", absptr, absptrmap.at(absptr));
+  intptr_t __seahorn_get_value_ptr(int ctr, intptr_t *g_arr, int g_arr_sz, int ebits) {
+    intptr_t absptr = __seahorn_get_value_ptr_internal(ctr, g_arr, g_arr_sz);
+    addAbsPtr (absptr, ebits);
+    return absptr;
+  }
 
+  intptr_t __seahorn_get_value_tbl_ptr(int table, int ctr, int ebits) {
+    intptr_t absptr = (intptr_t) tableValue (table, ctr);
+    addAbsPtr (absptr, ebits);
     return absptr;
   }
 
   bool is_dummy_address (void *addr) {
-
     intptr_t ip = intptr_t (addr);
-    auto it = absptrmap.lower_bound (ip+1);
-    if (it == absptrmap.end()) return false;
-    intptr_t lb = it->first;
-    intptr_t ub = it->second;
-
-    return (ip >= lb && ip < ub);
+    auto it = absptrPages.find (ip >> PAGE_BITS);
+    if (it == absptrPages.end()) return false;
+    for (intptr_t lb : it->second)
+      if (ip >= lb && ip < absptrEnd[lb]) return true;
+    return false;
   }
 
   bool is_legal_address (void *addr) {
@@ -89,26 +173,25 @@ const int TYPE_GUESS = sizeof(int);
 
 void __seahorn_mem_store (void *src, void *dst, size_t sz)
 {
-  printf("__seahorn_mem_store from %p to %p\n", src, dst);
-  if (is_legal_address (dst)) {
+  bool legal = is_legal_address (dst);
+  if (verbose ())
+    printf("__seahorn_mem_store from %p to %p\n%s\n", src, dst,
+           legal ? "legal" : "illegal");
   /* if dst is a legal address */
-    printf("legal\n");
-    memcpy (dst, src, sz);
-  }
+  if (legal) memcpy (dst, src, sz);
   /* else if dst is illegal, do nothing */
-  else printf("illegal\n");
 }
 
 void __seahorn_mem_load (void *dst, void *src, size_t sz)
 {
-  printf("__seahorn_mem_load from %p to %p\n", src, dst);
-  if (is_legal_address (src)) {
+  bool legal = is_legal_address (src);
+  if (verbose ())
+    printf("__seahorn_mem_load from %p to %p\n%s\n", src, dst,
+           legal ? "legal" : "illegal");
   /* if src is a legal address */
-    printf("legal\n");
-    memcpy (dst, src, sz);
-  }
+  if (legal) memcpy (dst, src, sz);
   /* else, if src is illegal, return a dummy value */
-  else { printf("illegal\n"); bzero(dst, sz); }
+  else bzero(dst, sz);
 }
 
 // Dummy klee_make_symbolic function
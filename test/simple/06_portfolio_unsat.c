@@ -0,0 +1,19 @@
+// RUN: %sea pf --horn-portfolio=spacer --horn-portfolio=pdr --horn-portfolio=houdini+spacer "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+
+int main()
+{
+ int x=1; int y=1;
+ while(unknown1()) {
+   int t1 = x;
+   int t2 = y;
+   x = t1+ t2;
+   y = t1 + t2;
+ }
+  sassert(y >=1);
+}
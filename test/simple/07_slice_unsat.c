@@ -0,0 +1,26 @@
+// RUN: %sea pf --horn-slice "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* not called from main, sliced away if it is not inlined */
+int unrelated(int n)
+{
+  int s = 0;
+  while (unknown1()) s += n;
+  return s;
+}
+
+int main()
+{
+ int x=1; int y=1;
+ while(unknown1()) {
+   int t1 = x;
+   int t2 = y;
+   x = t1+ t2;
+   y = t1 + t2;
+ }
+  sassert(y >=1);
+}
@@ -0,0 +1,21 @@
+// RUN: %sea pf --step=small --horn-inline --horn-inline-qe "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* small steps give a chain of relations with one definition and one use */
+int main()
+{
+ int x=1; int y=1; int z=0;
+ int a = unknown1 ();
+ if (a > 0) z = a; else z = -a;
+ while(unknown1()) {
+   int t1 = x;
+   int t2 = y;
+   x = t1+ t2;
+   y = t1 + t2;
+ }
+  sassert(y >=1 && z >= 0);
+}
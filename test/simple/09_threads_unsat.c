@@ -0,0 +1,29 @@
+// RUN: %sea pf --step=small --horn-threads=4 "%s"  2>&1 | OutputCheck %s
+// CHECK-NOT: Encoding functions sequentially
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* leaves of the call graph, encoded concurrently */
+__attribute__((noinline)) int inc (int x) { return x + 1; }
+__attribute__((noinline)) int twice (int x) { return x + x; }
+__attribute__((noinline)) int sq (int x) { return x * x; }
+__attribute__((noinline)) int pos (int x) { return x > 0 ? x : 1; }
+__attribute__((noinline)) int add3 (int x) { return x + 3; }
+__attribute__((noinline)) int dec (int x) { return x > 1 ? x - 1 : x; }
+
+int main()
+{
+  int x = 1, y = 1, z = 1;
+  while (unknown1 ())
+  {
+    x = inc (twice (x));
+    y = pos (sq (y));
+    z = dec (add3 (z));
+  }
+  sassert (x >= 1);
+  sassert (y >= 1);
+  sassert (z >= 1);
+}
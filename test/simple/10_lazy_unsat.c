@@ -0,0 +1,25 @@
+// RUN: %sea pf --horn-inter-proc --horn-lazy "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* never called from main and not encoded */
+__attribute__((noinline)) int unused (int n)
+{
+  int s = 0;
+  while (unknown1 ()) s += n;
+  sassert (s >= 0);
+  return s;
+}
+
+__attribute__((noinline)) int inc (int x) { return x + 1; }
+
+int main()
+{
+  int x = 1;
+  while (unknown1 ()) x = inc (x);
+  sassert (x >= 1);
+  return unknown1 () ? 0 : 1;
+}
@@ -0,0 +1,22 @@
+// RUN: rm -rf %t.cache
+// RUN: %sea pf --horn-cache=%t.cache "%s"  2>&1 | OutputCheck %s
+// RUN: %sea pf --horn-cache=%t.cache "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* the second run loads the clauses written by the first */
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+int main()
+{
+  int x = 1;
+  int y = 0;
+  while (unknown1 ())
+  {
+    x = x + y;
+    y++;
+  }
+  sassert (x >= y);
+  return 0;
+}
@@ -0,0 +1,22 @@
+// RUN: rm -f %t.invs
+// RUN: %sea pf --horn-houdini --horn-houdini-invs=%t.invs "%s"  2>&1 | OutputCheck %s
+// RUN: %sea pf --horn-houdini --horn-houdini-invs=%t.invs "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* the second run starts Houdini from the invariants of the first */
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+int main()
+{
+  int x = 0;
+  int y = 0;
+  while (unknown1 ())
+  {
+    x++;
+    y++;
+  }
+  sassert (x == y);
+  return 0;
+}
@@ -0,0 +1,14 @@
+// RUN: %sea pf --horn-portfolio=kind "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+#include "seahorn/seahorn.h"
+extern int nd ();
+
+int main()
+{
+  int x = nd ();
+  if (x > 0) x = x - 1;
+  else x = -x;
+  sassert (x >= 0);
+  return 0;
+}
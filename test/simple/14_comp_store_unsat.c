@@ -0,0 +1,23 @@
+// RUN: rm -f %t.sums
+// RUN: %sea pf --horn-inter-proc --horn-pdr-engine=compositional --horn-comp-store=%t.sums "%s"  2>&1 | OutputCheck %s
+// RUN: %sea pf --horn-inter-proc --horn-pdr-engine=compositional --horn-comp-store=%t.sums "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* the second run reuses the summary of inc from the first */
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+__attribute__((noinline)) int inc(int x)
+{
+  return x + 1;
+}
+
+int main()
+{
+  int x = 0;
+  while (unknown1 ())
+    x = inc (x);
+  sassert (x >= 0);
+  return 0;
+}
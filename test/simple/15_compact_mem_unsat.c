@@ -0,0 +1,21 @@
+// RUN: %sea pf -O0 --horn-compact-mem "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* the stores to the fields of p are folded into one array term */
+
+#include "seahorn/seahorn.h"
+extern int nd ();
+
+struct point { int x; int y; int z; };
+
+int main()
+{
+  struct point p;
+  p.x = 1;
+  p.y = 2;
+  p.z = 3;
+  p.x = nd ();
+  assume (p.x > 0);
+  sassert (p.x + p.y + p.z > 5);
+  return 0;
+}
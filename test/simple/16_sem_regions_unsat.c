@@ -0,0 +1,24 @@
+// RUN: %sea pf --horn-sem-lvl=mem --horn-sem-regions "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* only the region of a is in the slice of the assertion */
+
+#include "seahorn/seahorn.h"
+extern int nd ();
+
+int a[10];
+int b[10];
+
+int main()
+{
+  int i;
+  for (i = 0; i < 10; i++)
+  {
+    a[i] = 1;
+    b[i] = nd ();
+  }
+  int k = nd ();
+  assume (k >= 0 && k < 10);
+  sassert (a[k] == 1);
+  return 0;
+}
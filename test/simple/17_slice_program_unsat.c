@@ -0,0 +1,29 @@
+// RUN: %sea pf --slice-program "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+int a[10];
+
+/* nothing it does reaches the assertion */
+void unrelated(int n)
+{
+  int i;
+  for (i = 0; i < 10; i++) a[i] = n + i;
+}
+
+int main()
+{
+  int x = 1; int y = 1; int z = 0;
+  while (unknown1()) {
+    int t1 = x;
+    int t2 = y;
+    x = t1 + t2;
+    y = t1 + t2;
+    z += unknown1 ();
+    unrelated (z);
+  }
+  sassert(y >= 1);
+}
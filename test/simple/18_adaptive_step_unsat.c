@@ -0,0 +1,26 @@
+// RUN: %sea pf --step=adaptive "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* a loop, cheaper with large steps, and a function without one */
+int abs_val(int a)
+{
+  if (a > 0) return a;
+  return -a;
+}
+
+int main()
+{
+ int x=1; int y=1;
+ int z = abs_val (unknown1 ());
+ while(unknown1()) {
+   int t1 = x;
+   int t2 = y;
+   x = t1+ t2;
+   y = t1 + t2;
+ }
+  sassert(y >=1 && z >= 0);
+}
@@ -0,0 +1,32 @@
+// RUN: %sea pf --inline-cost "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* small and called twice: inlined */
+static int abs_val(int a)
+{
+  if (a > 0) return a;
+  return -a;
+}
+
+/* one call site: inlined */
+static int fib(int n)
+{
+  int x = 1; int y = 1;
+  while (n-- > 0) {
+    int t = x + y;
+    x = y;
+    y = t;
+  }
+  return y;
+}
+
+int main()
+{
+  int z = abs_val (unknown1 ()) + abs_val (unknown1 ());
+  int y = fib (unknown1 ());
+  sassert(y >= 1 && z >= 0);
+}
@@ -0,0 +1,22 @@
+// RUN: rm -f %t.lemmas
+// RUN: %sea pf --horn-spacer-lemmas=%t.lemmas "%s"  2>&1 | OutputCheck %s
+// RUN: %sea pf --horn-spacer-lemmas=%t.lemmas "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* the second run starts the solver from the lemmas of the first */
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+int main()
+{
+  int x = 0;
+  int y = 10;
+  while (unknown1 ())
+  {
+    x += 2;
+    y += 2;
+  }
+  sassert (y == x + 10);
+  return 0;
+}
@@ -0,0 +1,20 @@
+// RUN: %sea pf --horn-validate-model "%s"  2>&1 | OutputCheck %s
+// CHECK: ^model validation: valid
+
+/* the invariants of Spacer are checked rule by rule */
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+int main()
+{
+  int x = 1;
+  int y = 0;
+  while (unknown1 ())
+  {
+    x = x + y;
+    y++;
+  }
+  sassert (x >= y);
+  return 0;
+}
@@ -0,0 +1,18 @@
+// RUN: %sea pf -O0 --accel-loops "%s" 2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+#include <seahorn/seahorn.h>
+
+extern int nd(void);
+
+int main(void)
+{
+  int n = nd ();
+  assume (n > 0 && n < 1000);
+
+  int i, a = 0;
+  for (i = 0; i < n; i++) a += 3;
+
+  sassert (i == n);
+  sassert (a == 3 * n);
+  return 0;
+}
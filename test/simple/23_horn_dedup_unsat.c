@@ -0,0 +1,18 @@
+// RUN: %sea pf -O0 --horn-dedup "%s" 2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+#include <seahorn/seahorn.h>
+
+extern int nd(void);
+
+int main(void)
+{
+  int x = 0, y = 0;
+  while (nd ())
+  {
+    // -- both branches give the same rule up to variable names
+    if (nd ()) { x++; y++; }
+    else { x++; y++; }
+  }
+  sassert (x == y);
+  return 0;
+}
@@ -0,0 +1,24 @@
+// RUN: %sea pf --horn-rel-stats=%t.json "%s" > %t.out 2>&1
+// RUN: cat %t.out %t.json | OutputCheck %s
+// CHECK: ^unsat$
+// CHECK: "hornify": \[
+// CHECK: "wto_depth": [1-9]
+// CHECK: "solve": \[
+// CHECK: "invariant_dag":
+
+/* per-relation statistics of the encoding and of the solved database */
+
+#include "seahorn/seahorn.h"
+extern int nd(void);
+
+int main(void)
+{
+  int x = 0, y = 0;
+  while (nd ())
+  {
+    x++;
+    y++;
+  }
+  sassert (x == y);
+  return 0;
+}
@@ -0,0 +1,24 @@
+// RUN: %sea pf -O0 --horn-ptr-base-offset "%s" 2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* the pointers into a are compared by their offsets in a */
+
+#include "seahorn/seahorn.h"
+extern int nd (void);
+
+int a[10];
+
+int main ()
+{
+  int *p = a;
+  int *end = a + 10;
+  int n = 0;
+  while (p < end && nd ())
+  {
+    *p = 1;
+    p++;
+    n++;
+  }
+  sassert (n <= 10);
+  return 0;
+}
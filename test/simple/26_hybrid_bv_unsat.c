@@ -0,0 +1,20 @@
+// RUN: %sea pf --horn-hybrid-bv "%s" 2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+/* the masks are bit-vectors, the loop counter is an integer */
+
+#include "seahorn/seahorn.h"
+extern int nd (void);
+
+int main ()
+{
+  int n = nd ();
+  int i;
+  unsigned acc = 0;
+  for (i = 0; i < n; i++)
+    acc += (unsigned) nd () & 7u;
+  unsigned low = acc & 0xffu;
+  sassert (low <= 255u);
+  sassert (i >= 0);
+  return 0;
+}
@@ -0,0 +1,23 @@
+// RUN: %sea pf --horn-inter-proc --horn-share-summaries "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* identical up to names, encoded once */
+__attribute__((noinline)) int inc_a (int x) { return x + 1; }
+__attribute__((noinline)) int inc_b (int y) { return y + 1; }
+
+int main()
+{
+  int x = 1, y = 2;
+  while (unknown1 ())
+  {
+    x = inc_a (x);
+    y = inc_b (y);
+  }
+  sassert (x >= 1);
+  sassert (y >= 2);
+  return 0;
+}
@@ -0,0 +1,20 @@
+// RUN: %sea pf --horn-pdr-engine=staged "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* the stages before spacer may answer, spacer answers otherwise */
+int main()
+{
+  int x = 1, y = 0;
+  while (unknown1 ())
+  {
+    x = x + y;
+    y = y + 1;
+  }
+  sassert (x >= 1);
+  sassert (y >= 0);
+  return 0;
+}
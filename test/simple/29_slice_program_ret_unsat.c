@@ -0,0 +1,17 @@
+// RUN: %sea pf --slice-program "%s"  2>&1 | OutputCheck %s
+// CHECK: ^unsat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* its return value reaches the assertion */
+__attribute__((noinline)) int f (int x) { return x + 1; }
+
+int main()
+{
+  int x = unknown1 ();
+  assume (x >= 0);
+  int y = f (x);
+  sassert (y >= 1);
+}
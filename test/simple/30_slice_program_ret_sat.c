@@ -0,0 +1,15 @@
+// RUN: %sea pf --slice-program "%s"  2>&1 | OutputCheck %s
+// CHECK: ^sat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+/* its return value reaches the assertion */
+__attribute__((noinline)) int f (int x) { return x + 1; }
+
+int main()
+{
+  int y = f (unknown1 ());
+  sassert (y != 1);
+}
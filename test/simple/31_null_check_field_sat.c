@@ -0,0 +1,18 @@
+// RUN: %sea pf --null-check --null-check-remove-non-null "%s"  2>&1 | OutputCheck %s
+// CHECK: ^sat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+struct S { int a; int f; };
+struct S s;
+
+int main()
+{
+  struct S *p = unknown1 () ? &s : 0;
+  /* the check of p->f passes when p is null, it does not make *p safe */
+  p->f = 1;
+  int x = *(int*) p;
+  return x;
+}
@@ -0,0 +1,17 @@
+// RUN: %sea pf --promote-arrays --do-bounds-check "%s"  2>&1 | OutputCheck %s
+// CHECK: ^sat$
+
+
+#include "seahorn/seahorn.h"
+int unknown1();
+
+int main()
+{
+  int a[4];
+  int i = unknown1 ();
+  assume (i >= 0);
+  assume (i <= 4);
+  /* overflows for i == 4, which the bounds check must still see */
+  a[i] = 1;
+  return a[0];
+}
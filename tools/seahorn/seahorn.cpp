@@ -9,6 +9,8 @@
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IRReader/IRReader.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/Verifier.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/Debug.h"
@@ -19,16 +21,28 @@
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/Path.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
 #include "llvm/Transforms/IPO.h"
 
 #include "seahorn/config.h"
 #include "seahorn/Passes.hh"
+#include "seahorn/Pipeline.hh"
 #include "seahorn/HornWrite.hh"
 #include "seahorn/HornifyModule.hh"
 #include "seahorn/HornSolver.hh"
+#include "seahorn/HornServer.hh"
+#include "seahorn/HornRelStats.hh"
+#include "seahorn/Support/PassProfiler.hh"
+#include "seahorn/Support/TaskPool.hh"
+#include "seahorn/Support/LazyModule.hh"
 #include "seahorn/Houdini.hh"
 #include "seahorn/PredicateAbstraction.hh"
 #include "seahorn/HornCex.hh"
+#include "seahorn/Harness.hh"
 #include "seahorn/Transforms/Scalar/PromoteVerifierCalls.hh"
 #include "seahorn/Transforms/Scalar/LowerGvInitializers.hh"
 #include "seahorn/Transforms/Scalar/LowerCstExpr.hh"
@@ -42,6 +56,7 @@
 #include "ufo/Smt/EZ3.hh"
 #include "ufo/Passes/NameValues.hpp"
 #include "ufo/Stats.hh"
+#include "ufo/Trace.hh"
 
 void print_seahorn_version()
 {
@@ -85,7 +100,7 @@ VerboseOption ("zverbose",
 
 static llvm::cl::opt<std::string>
 InputFilename(llvm::cl::Positional, llvm::cl::desc("<input LLVM bitcode file>"),
-              llvm::cl::Required, llvm::cl::value_desc("filename"));
+              llvm::cl::Optional, llvm::cl::value_desc("filename"));
 
 static llvm::cl::opt<std::string>
 OutputFilename("o", llvm::cl::desc("Override output filename"),
@@ -102,8 +117,16 @@ DefaultDataLayout("default-data-layout",
                   llvm::cl::init(""), llvm::cl::value_desc("layout-string"));
 
 static llvm::cl::opt<bool>
-InlineAll ("horn-inline-all", llvm::cl::desc ("Inline all functions"),
-           llvm::cl::init (false));
+PreProcess ("horn-pp",
+            llvm::cl::desc ("Run the pre-processing, mixed semantics and "
+                            "optimization stages of seapp and seaopt in this "
+                            "process, with the seapp options"),
+            llvm::cl::init (false));
+
+static llvm::cl::opt<unsigned>
+PreProcessOptLevel ("horn-pp-opt",
+                    llvm::cl::desc ("Optimization level of --horn-pp (0 to 3)"),
+                    llvm::cl::init (3));
 
 static llvm::cl::opt<bool>
 Solve ("horn-solve", llvm::cl::desc ("Run Horn solver"), llvm::cl::init (false));
@@ -111,6 +134,11 @@ Solve ("horn-solve", llvm::cl::desc ("Run Horn solver"), llvm::cl::init (false))
 static llvm::cl::opt<bool>
 Crab ("horn-crab", llvm::cl::desc ("Use Crab invariants"), llvm::cl::init (false));
 
+static llvm::cl::opt<bool>
+CrabDischarge ("horn-crab-discharge",
+               llvm::cl::desc ("Remove instrumented checks proved safe by Crab"),
+               llvm::cl::init (false));
+
 static llvm::cl::opt<bool>
 PrintStats ("horn-stats",
             llvm::cl::desc ("Print statistics"), llvm::cl::init(false));
@@ -123,6 +151,12 @@ static llvm::cl::opt<bool>
 KeepShadows ("keep-shadows", llvm::cl::desc ("Do not strip shadow.mem functions"),
              llvm::cl::init (false), llvm::cl::Hidden);
 
+static llvm::cl::opt<bool>
+ShadowOpt ("horn-shadow-opt",
+           llvm::cl::desc ("Remove the shadow memory tokens that no memory "
+                           "operation observes"),
+           llvm::cl::init (false));
+
 static llvm::cl::opt<bool>
 Bmc ("horn-bmc",
      llvm::cl::desc ("Use BMC engine. Currently restricted to intra-procedural analysis"),
@@ -143,6 +177,124 @@ PredAbs ("horn-pred-abs",
         llvm::cl::desc ("Use Predicate Abstraction to generate inductive invariants"),
         llvm::cl::init (false));
 
+static llvm::cl::opt<bool>
+Server ("horn-server",
+        llvm::cl::desc ("Serve verification jobs read as JSON lines from stdin. "
+                        "Options given to the server apply to every job"),
+        llvm::cl::init (false));
+
+static llvm::cl::opt<std::string>
+ServerSocket ("horn-server-socket",
+              llvm::cl::desc ("Serve verification jobs on this Unix socket"),
+              llvm::cl::init (""), llvm::cl::value_desc ("path"));
+
+static llvm::cl::opt<unsigned>
+ServerTimeout ("horn-server-timeout",
+               llvm::cl::desc ("Time limit of a server job in seconds (0 = none)"),
+               llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+ServerMem ("horn-server-mem",
+           llvm::cl::desc ("Memory limit of a server job in MB (0 = none)"),
+           llvm::cl::init (0));
+
+static llvm::cl::opt<unsigned>
+ServerMetrics ("horn-server-metrics",
+               llvm::cl::desc ("Serve the metrics of the server over HTTP on this "
+                               "port of localhost, in the Prometheus text format"),
+               llvm::cl::init (0), llvm::cl::value_desc ("port"));
+
+static llvm::cl::opt<std::string>
+TraceFile ("trace-json",
+           llvm::cl::desc ("Write a timeline of phases, solver calls and workers "
+                           "to this file, for chrome://tracing or Perfetto"),
+           llvm::cl::init (""), llvm::cl::value_desc ("filename"));
+
+static llvm::cl::opt<std::string>
+HornCacheDir ("horn-cache",
+              llvm::cl::desc ("Cache the Horn clauses of the input in this directory. "
+                              "Runs on the same bitcode and front-end options "
+                              "load the clauses instead of encoding the program"),
+              llvm::cl::init (""), llvm::cl::value_desc ("dir"));
+
+static llvm::cl::opt<std::string>
+FuzzLog ("horn-fuzz-log",
+         llvm::cl::desc ("Write the harness (-o) of the values logged by a failing "
+                         "run of the fuzzing run-time instead of analyzing the input"),
+         llvm::cl::init (""), llvm::cl::value_desc ("filename"));
+
+static llvm::cl::opt<std::string>
+FuzzValues ("horn-fuzz-values",
+            llvm::cl::desc ("Write the values of the --horn-fuzz-log harness to "
+                            "this file, loaded by the run-time"),
+            llvm::cl::init (""), llvm::cl::value_desc ("filename"));
+
+static llvm::cl::opt<unsigned>
+Deadline ("horn-deadline",
+          llvm::cl::desc ("Deadline of the run in milliseconds from its start "
+                          "(0 = none). The engines stop at the deadline and "
+                          "report what they found so far"),
+          llvm::cl::init (0));
+
+// options that do not change the Horn clauses of a program
+static const char *cacheNeutralOptions [] =
+  {"o", "horn-solve", "horn-stats", "horn-cache", "horn-houdini",
+   "horn-houdini-strategy", "horn-houdini-batch", "horn-houdini-batch-models",
+   "horn-houdini-samples",
+   "horn-houdini-invs", "horn-comp-store",
+   "horn-answer", "horn-pdr-engine", "horn-pdr-contexts", "horn-portfolio",
+   "horn-portfolio-mem", "horn-portfolio-replay", "horn-solve-timeout",
+   "horn-deadline", "horn-anytime-json", "horn-answer-compact",
+   "horn-answer-compact-smt", "horn-staged-crab-slice",
+   "horn-staged-houdini-slice", "horn-staged-log",
+   "horn-slice", "horn-inline", "horn-inline-qe", "horn-subsumption",
+   "horn-flex-trace", "horn-child-order", "horn-skip-constraints",
+   "horn-estimate-size-invars", "horn-spacer-lemmas", "horn-smt-timeout",
+   "horn-smt-rlimit", "horn-smt-telemetry", "horn-smt-telemetry-log", "horn-query-cache",
+   "horn-query-cache-file", "horn-format", "horn-fp-internal-writer",
+   "horn-write-gzip", "horn-threads", "horn-expr-profile",
+   "horn-server", "horn-server-socket", "horn-server-timeout",
+   "horn-server-mem", "horn-server-metrics", "horn-validate-model",
+   "horn-validate-timeout", "horn-rel-stats", "trace-json", "profile-json",
+   "ztrace", "zverbose",
+   nullptr};
+
+// name of the cache file of the input: a hash of the bitcode, of the
+// front-end options in argv and of the version. Empty on error
+static std::string getHornCacheFile (int argc, const char *const *argv)
+{
+  auto buf = llvm::MemoryBuffer::getFile (InputFilename);
+  if (!buf) return "";
+
+  llvm::MD5 hash;
+  hash.update ((*buf)->getBuffer ());
+  hash.update (SEAHORN_VERSION_INFO);
+  for (int i = 1; i < argc; ++i)
+  {
+    llvm::StringRef arg (argv [i]);
+    if (arg == InputFilename) continue;
+    llvm::StringRef name = arg.ltrim ('-').split ('=').first;
+    bool neutral = false;
+    for (const char **o = cacheNeutralOptions; *o && !neutral; ++o)
+      neutral = (name == *o);
+    if (neutral)
+    {
+      // -- -o takes its value as the next argument
+      if (name == "o" && !arg.count ('=')) ++i;
+      continue;
+    }
+    hash.update (arg);
+    hash.update (llvm::StringRef ("\0", 1));
+  }
+  llvm::MD5::MD5Result res;
+  hash.final (res);
+  llvm::SmallString<32> str;
+  llvm::MD5::stringifyResult (res, str);
+
+  llvm::SmallString<256> path (HornCacheDir);
+  llvm::sys::path::append (path, llvm::Twine (str) + ".hdb");
+  return path.str ().str ();
+}
 
 // removes extension from filename if there is one
 std::string getFileName(const std::string &str) {
@@ -153,17 +305,16 @@ std::string getFileName(const std::string &str) {
   return filename;
 }
 
-int main(int argc, char **argv) {
-  ufo::ScopedStats _st ("seahorn_total");
-
-  llvm::llvm_shutdown_obj shutdown;  // calls llvm_shutdown() on exit
-  llvm::cl::AddExtraVersionPrinter (print_seahorn_version);
-  llvm::cl::ParseCommandLineOptions(argc, argv,
-                                    "SeaHorn -- LLVM bitcode to Horn/SMT2 transformation\n");
+// in a job of the server, marks the start of a phase of the job
+static void addServerPhase (llvm::PassManagerBase &pm, const char *phase)
+{
+  if (seahorn::inServerJob ()) pm.add (seahorn::createServerPhasePass (phase));
+}
 
-  llvm::sys::PrintStackTraceOnErrorSignal();
-  llvm::PrettyStackTraceProgram PSTP(argc, argv);
-  llvm::EnableDebugBuffering = true;
+// runs seahorn on InputFilename. argv are the options of the run
+static int runSeahorn (int argc, const char *const *argv)
+{
+  ufo::ScopedStats _st ("seahorn_total");
 
   std::error_code error_code;
   llvm::SMDiagnostic err;
@@ -172,8 +323,8 @@ int main(int argc, char **argv) {
   std::unique_ptr<llvm::tool_output_file> output;
   std::unique_ptr<llvm::tool_output_file> asmOutput;
 
-
-  module = llvm::parseIRFile(InputFilename, err, context);
+  seahorn::setServerJobPhase ("load");
+  module = seahorn::loadModule (InputFilename, err, context);
   if (module.get() == 0)
   {
     if (llvm::errs().has_colors()) llvm::errs().changeColor(llvm::raw_ostream::RED);
@@ -208,16 +359,31 @@ int main(int argc, char **argv) {
   }
 
 
+  // -- the cache keeps only the clauses, passes that relate them to
+  // -- the program cannot use it
+  std::string cacheFile;
+  bool cacheHit = false;
+  if (!HornCacheDir.empty ())
+  {
+    if (Bmc || Cex || Crab || PredAbs || !AsmOutputFilename.empty ())
+      llvm::errs () << "WARNING: --horn-cache is ignored with BMC, "
+                    << "counterexamples, Crab, predicate abstraction "
+                    << "and -oll\n";
+    else if (llvm::sys::fs::create_directories (HornCacheDir.getValue ()))
+      llvm::errs () << "WARNING: cannot create cache directory "
+                    << HornCacheDir << "\n";
+    else
+    {
+      cacheFile = getHornCacheFile (argc, argv);
+      cacheHit = !cacheFile.empty () && llvm::sys::fs::exists (cacheFile);
+    }
+  }
+
   ///////////////////////////////
   // initialise and run passes //
   ///////////////////////////////
 
-  llvm::PassManager pass_manager;
-  llvm::PassRegistry &Registry = *llvm::PassRegistry::getPassRegistry();
-  llvm::initializeAnalysis(Registry);
-
-  /// call graph and other IPA passes
-  llvm::initializeIPA (Registry);
+  seahorn::ProfilingPassManager pass_manager ("seahorn");
 
   // add an appropriate DataLayout instance for the module
   const llvm::DataLayout *dl = module->getDataLayout ();
@@ -227,13 +393,57 @@ int main(int argc, char **argv) {
     dl = module->getDataLayout ();
   }
 
+  if (!FuzzLog.empty ())
+  {
+    if (!output || !dl)
+    {
+      llvm::errs () << "error: --horn-fuzz-log needs -o and a data layout\n";
+      return 3;
+    }
+    std::unique_ptr<llvm::Module> harness =
+      seahorn::createLLVMHarness (*module, FuzzLog, *dl, FuzzValues);
+    if (!harness) return 3;
+    llvm::verifyModule (*harness, &llvm::errs ());
+    if (llvm::StringRef (OutputFilename).endswith (".ll")) output->os () << *harness;
+    else llvm::WriteBitcodeToFile (harness.get (), output->os ());
+    output->keep ();
+    return 0;
+  }
+
+  if (cacheHit)
+  {
+    // -- the clauses are loaded, skip straight to the Horn passes
+    addServerPhase (pass_manager, "hornify");
+    pass_manager.add (new seahorn::HornifyModule (cacheFile, true));
+    if (!OutputFilename.empty ()) pass_manager.add (new seahorn::HornWrite (output->os ()));
+    addServerPhase (pass_manager, "solve");
+    if (HoudiniInv) pass_manager.add (new seahorn::HoudiniPass ());
+    if (Solve) pass_manager.add (new seahorn::HornSolver (false));
+    pass_manager.run (*module.get ());
+
+    if (!OutputFilename.empty ()) output->keep();
+    if (PrintStats) ufo::Stats::PrintBrunch (llvm::outs ());
+    seahorn::writeProfile ();
+    seahorn::writeRelStats ();
+    return 0;
+  }
+
   if (dl) pass_manager.add (new llvm::DataLayoutPass ());
 
+  addServerPhase (pass_manager, "seapp");
+  if (PreProcess)
+  {
+    // -- same passes as sea fe without writing intermediate bitcode
+    seahorn::addPreProcessingPasses (pass_manager);
+    seahorn::addOptimizationPasses (pass_manager, PreProcessOptLevel);
+    pass_manager.add (llvm::createVerifierPass ());
+  }
+
   // turn all functions internal so that we can inline them if requested
   pass_manager.add (llvm::createInternalizePass (llvm::ArrayRef<const char*>("main")));
   pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
 
-  if (InlineAll)
+  if (seahorn::isInlineAll ())
   {
     pass_manager.add (seahorn::createMarkInternalInlinePass ());
     pass_manager.add (llvm::createAlwaysInlinerPass ());
@@ -251,15 +461,19 @@ int main(int argc, char **argv) {
 
   pass_manager.add(llvm::createUnifyFunctionExitNodesPass ());
 
+  if (CrabDischarge) pass_manager.add (seahorn::createCrabDischargePass ());
+
   // -- it invalidates DSA passes so it should be run before
   // -- ShadowMemDsa
   pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
+  addServerPhase (pass_manager, "dsa");
   if (SeaHornDsa)
     pass_manager.add (seahorn::createShadowMemSeaDsaPass ());
   else
     pass_manager.add (seahorn::createShadowMemDsaPass ());
   // lowers shadow.mem variables created by ShadowMemDsa pass
   pass_manager.add (seahorn::createPromoteMemoryToRegisterPass ());
+  if (ShadowOpt) pass_manager.add (seahorn::createShadowMemOptPass ());
 
   pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
   pass_manager.add (seahorn::createStripLifetimePass ());
@@ -278,8 +492,10 @@ int main(int argc, char **argv) {
   // --- verify if an undefined value can be read
   pass_manager.add (seahorn::createCanReadUndefPass ());
 
+  addServerPhase (pass_manager, "hornify");
   if (!Bmc)
-    pass_manager.add (new seahorn::HornifyModule ());
+    pass_manager.add (cacheFile.empty () ? new seahorn::HornifyModule () :
+                      new seahorn::HornifyModule (cacheFile, false));
   if (!AsmOutputFilename.empty ())
   {
     if (!KeepShadows)
@@ -301,11 +517,12 @@ int main(int argc, char **argv) {
   else
   {
     if (!OutputFilename.empty ()) pass_manager.add (new seahorn::HornWrite (output->os ()));
+    addServerPhase (pass_manager, "solve");
     if (Crab) pass_manager.add (seahorn::createLoadCrabPass ());
     if (HoudiniInv) pass_manager.add (new seahorn::HoudiniPass ());
     if (PredAbs) pass_manager.add(new seahorn::PredicateAbstraction());
     if (Solve)
-    { 	  pass_manager.add (new seahorn::HornSolver ());
+    { 	  pass_manager.add (new seahorn::HornSolver (Cex));
           if (Cex) pass_manager.add (new seahorn::HornCex ());
     }
   }
@@ -315,5 +532,130 @@ int main(int argc, char **argv) {
   if (!AsmOutputFilename.empty ()) asmOutput->keep ();
   if (!OutputFilename.empty ()) output->keep();
   if (PrintStats) ufo::Stats::PrintBrunch (llvm::outs ());
+  seahorn::writeProfile ();
+  seahorn::writeRelStats ();
   return 0;
 }
+
+// runs seahorn, recording a trace of the run if asked to
+static int runTraced (int argc, const char *const *argv)
+{
+  if (Deadline > 0) seahorn::globalCancelToken ().setTimeout (Deadline);
+  if (!TraceFile.empty ())
+  {
+    ufo::Trace::open (TraceFile);
+    ufo::Trace::threadName ("seahorn");
+  }
+  int rc = runSeahorn (argc, argv);
+  ufo::Trace::close ();
+  return rc;
+}
+
+static const char *Overview =
+  "SeaHorn -- LLVM bitcode to Horn/SMT2 transformation\n";
+
+// an option of the job that the server already set and that may
+// only occur once, or the empty string. The options of the job are
+// parsed on top of the options of the server and occurrences of
+// already parsed options cannot be reset
+static std::string jobDuplicateOption (const std::vector<std::string> &args)
+{
+  llvm::StringMap<llvm::cl::Option*> opts;
+  llvm::cl::getRegisteredOptions (opts);
+  for (size_t i = 0; i < args.size (); ++i)
+  {
+    llvm::StringRef a (args [i]);
+    if (a == "--") break;
+    if (!a.startswith ("-") || a == "-") continue;
+    llvm::StringRef name = a.ltrim ('-');
+    bool inlineValue = name.find ('=') != llvm::StringRef::npos;
+    name = name.split ('=').first;
+
+    auto it = opts.find (name);
+    if (it == opts.end ()) continue;
+    llvm::cl::Option *o = it->second;
+    // -- the value of the option is the next argument
+    if (!inlineValue && o->getValueExpectedFlag () == llvm::cl::ValueRequired) ++i;
+    if (o->getNumOccurrences () == 0) continue;
+    if (o->getNumOccurrencesFlag () == llvm::cl::Optional ||
+        o->getNumOccurrencesFlag () == llvm::cl::Required)
+      return name.str ();
+  }
+  return "";
+}
+
+// runs a job of the server, in its own process. The options of the
+// job are parsed on top of the options of the server
+static int runServerJob (int argc, char **argv,
+                         const std::vector<std::string> &args)
+{
+  std::string dup = jobDuplicateOption (args);
+  if (!dup.empty ())
+  {
+    llvm::errs () << "error: job sets option '" << dup
+                  << "', which the server already sets\n";
+    return 3;
+  }
+
+  std::vector<const char*> jobArgv (1, argv [0]);
+  for (const std::string &a : args) jobArgv.push_back (a.c_str ());
+  llvm::cl::ParseCommandLineOptions (jobArgv.size (), jobArgv.data (), Overview);
+  if (InputFilename.empty ())
+  {
+    llvm::errs () << "error: job has no input file\n";
+    return 3;
+  }
+
+  // -- the clauses depend on the options of both
+  std::vector<const char*> allArgv (argv, argv + argc);
+  allArgv.insert (allArgv.end (), jobArgv.begin () + 1, jobArgv.end ());
+  return runTraced (allArgv.size (), allArgv.data ());
+}
+
+int main(int argc, char **argv) {
+  llvm::llvm_shutdown_obj shutdown;  // calls llvm_shutdown() on exit
+  llvm::cl::AddExtraVersionPrinter (print_seahorn_version);
+  llvm::cl::ParseCommandLineOptions(argc, argv, Overview);
+
+  llvm::sys::PrintStackTraceOnErrorSignal();
+  llvm::PrettyStackTraceProgram PSTP(argc, argv);
+  llvm::EnableDebugBuffering = true;
+
+  llvm::PassRegistry &Registry = *llvm::PassRegistry::getPassRegistry();
+  llvm::initializeAnalysis(Registry);
+
+  /// call graph and other IPA passes
+  llvm::initializeIPA (Registry);
+
+  if (Server || !ServerSocket.empty ())
+  {
+    // -- every job names its input file, which may only occur once
+    if (!InputFilename.empty ())
+    {
+      llvm::errs () << "error: the server takes no input file, jobs do\n";
+      return 3;
+    }
+
+    // -- initialize Z3 once so that jobs start warm
+    {
+      expr::ExprFactory efac;
+      ufo::EZ3 zctx (efac);
+    }
+
+    seahorn::ServerConfig cfg;
+    cfg.socket = ServerSocket;
+    cfg.timeoutSec = ServerTimeout;
+    cfg.memLimitMb = ServerMem;
+    cfg.metricsPort = ServerMetrics;
+    return seahorn::runServer
+      (cfg, [argc, argv] (const std::vector<std::string> &args)
+       { return runServerJob (argc, argv, args); });
+  }
+
+  if (InputFilename.empty ())
+  {
+    llvm::errs () << argv [0] << ": no input file\n";
+    return 3;
+  }
+  return runTraced (argc, argv);
+}
@@ -47,6 +47,19 @@ Profiler("profiler",
          llvm::cl::desc("Profile a program for static analysis purposes"),
          llvm::cl::init(false));
 
+static llvm::cl::opt<std::string>
+Features("features",
+         llvm::cl::desc("Write features of the program used to choose "
+                        "verification engines as JSON to this file (- for stdout)"),
+         llvm::cl::init(""), llvm::cl::value_desc("filename"));
+
+static llvm::cl::opt<std::string>
+HornEstimate("horn-estimate",
+             llvm::cl::desc("Write the predicted size of the Horn encoding of "
+                            "every --horn-step option as JSON to this file "
+                            "(- for stdout)"),
+             llvm::cl::init(""), llvm::cl::value_desc("filename"));
+
 static llvm::cl::opt<bool>
 CfgDot("cfg-dot",
        llvm::cl::desc("Print CFG of function to dot format"),
@@ -128,6 +141,9 @@ int main(int argc, char **argv) {
   if (Profiler)
     pass_manager.add (seahorn::createProfilerPass ());
 
+  if (!Features.empty ())
+    pass_manager.add (seahorn::createFeaturesPass (Features));
+
   if (CfgDot)
     pass_manager.add (seahorn::createCFGPrinterPass ());
 
@@ -140,6 +156,16 @@ int main(int argc, char **argv) {
   if (CfgOnlyViewer)
     pass_manager.add (seahorn::createCFGOnlyViewerPass ());
 
+  if (!HornEstimate.empty ()) {
+    // -- memory is encoded over the regions of the shadow memory
+    // -- instrumentation that seahorn adds before hornifying
+    if (!module->getFunction ("shadow.mem.init")) {
+      pass_manager.add (seahorn::createShadowMemSeaDsaPass ());
+      pass_manager.add (seahorn::createPromoteMemoryToRegisterPass ());
+    }
+    pass_manager.add (seahorn::createHornEstimatePass (HornEstimate));
+  }
+
   // XXX: for now we just call the analysis pass.
   // Later we will have a pass that call this analysis pass and do
   // some pretty printer of the heap.
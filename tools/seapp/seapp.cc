@@ -27,20 +27,13 @@
 #include "llvm/Bitcode/BitcodeWriterPass.h"
 
 #include "llvm/IR/Verifier.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/Transforms/Utils/Cloning.h"
 
 #include "seahorn/Passes.hh"
-
-#include "seahorn/Transforms/Scalar/PromoteVerifierCalls.hh"
-#include "seahorn/Transforms/Utils/RemoveUnreachableBlocksPass.hh"
-#include "seahorn/Transforms/Utils/DummyMainFunction.hh"
-#include "seahorn/Transforms/Scalar/LowerGvInitializers.hh"
-
-#include "seahorn/Analysis/CanAccessMemory.hh"
-#include "seahorn/Transforms/Scalar/LowerCstExpr.hh"
-#include "seahorn/Transforms/Instrumentation/BufferBoundsCheck.hh"
-#include "seahorn/Transforms/Instrumentation/IntegerOverflowCheck.hh"
-#include "seahorn/Transforms/Instrumentation/NullCheck.hh"
-#include "seahorn/Transforms/Instrumentation/MixedSemantics.hh"
+#include "seahorn/Pipeline.hh"
+#include "seahorn/Support/PassProfiler.hh"
+#include "seahorn/Support/LazyModule.hh"
 
 #include "ufo/Smt/EZ3.hh"
 #include "ufo/Stats.hh"
@@ -70,93 +63,32 @@ DefaultDataLayout("default-data-layout",
                   llvm::cl::desc("data layout string to use if not specified by module"),
                   llvm::cl::init(""), llvm::cl::value_desc("layout-string"));
 
-static llvm::cl::opt<bool>
-InlineAll ("horn-inline-all", llvm::cl::desc ("Inline all functions"),
-           llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-CutLoops ("horn-cut-loops", llvm::cl::desc ("Cut all natural loops"),
-           llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-BoundsChecks ("bounds-check", 
-     llvm::cl::desc ("Insert array bounds checks"), 
-     llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-OverflowChecks ("overflow-check", 
-     llvm::cl::desc ("Insert signed integer overflow checks"), 
-     llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-NullChecks ("null-check", 
-     llvm::cl::desc ("Insert null dereference checks"), 
-     llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-EnumVerifierCalls ("enum-verifier-calls", 
-     llvm::cl::desc ("Assign a unique identifier to each call to verifier.error"), 
-     llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-MixedSem ("horn-mixed-sem", llvm::cl::desc ("Mixed-Semantics Transformation"),
-          llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-KillVaArg ("kill-vaarg", llvm::cl::desc ("Delete vaarg functions"),
-           llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-StripExtern ("strip-extern", llvm::cl::desc ("Replace external functions by nondet"),
-              llvm::cl::init (false));
+static llvm::cl::opt<unsigned>
+SplitProperties ("split-properties",
+     llvm::cl::desc ("Write N modules, each keeping one group of "
+                     "calls to verifier.error and assuming the others"),
+     llvm::cl::init (0), llvm::cl::value_desc ("N"));
 
 static llvm::cl::opt<bool>
 OnlyStripExtern ("only-strip-extern", llvm::cl::desc ("Replace external functions by nondet and perform no other changes"),
               llvm::cl::init (false));
 
-static llvm::cl::opt<bool>
-LowerInvoke ("lower-invoke", 
-             llvm::cl::desc ("Lower all invoke instructions"),
-             llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-DevirtualizeFuncs ("devirt-functions", 
-                   llvm::cl::desc ("Devirtualize indirect calls using only types"),
-                   llvm::cl::init (false));
-
-static llvm::cl::opt<bool>
-ExternalizeAddrTakenFuncs ("externalize-addr-taken-funcs", 
-                           llvm::cl::desc ("Externalize uses of address-taken functions"),
-                           llvm::cl::init (false));
-
-static llvm::cl::opt<int>
-SROA_Threshold ("sroa-threshold",
-                llvm::cl::desc ("Threshold for ScalarReplAggregates pass"),
-                llvm::cl::init(INT_MAX));
-static llvm::cl::opt<int>
-SROA_StructMemThreshold ("sroa-struct",
-                         llvm::cl::desc ("Structure threshold for ScalarReplAggregates"),
-                         llvm::cl::init (INT_MAX));
-
 static llvm::cl::opt<std::string>
 ApiConfig("api-config",
          llvm::cl::desc("Comma separated API function calls"),
          llvm::cl::init(""), llvm::cl::value_desc("api-string"));
 
-static llvm::cl::opt<int>
-SROA_ArrayElementThreshold ("sroa-array",
-                            llvm::cl::desc ("Array threshold for ScalarReplAggregates"),
-                            llvm::cl::init (INT_MAX));
-static llvm::cl::opt<int>
-SROA_ScalarLoadThreshold ("sroa-scalar-load",
-                          llvm::cl::desc ("Scalar load threshold for ScalarReplAggregates"),
-                          llvm::cl::init (-1));
-
 static llvm::cl::opt<bool>
 KleeInternalize ("klee-internalize", 
                    llvm::cl::desc ("Internalizes definitions for Klee"),
                    llvm::cl::init (false));
 static llvm::cl::opt<bool>
+FuzzInstrument ("fuzz-instrument",
+                llvm::cl::desc ("Internalizes definitions as for Klee and instruments "
+                                "basic blocks with coverage for the fuzzing run-time"),
+                llvm::cl::init (false));
+
+static llvm::cl::opt<bool>
 WrapMem ("wrap-mem",
          llvm::cl::desc ("Wrap memory accesses with special functions"),
          llvm::cl::init (false));
@@ -180,6 +112,16 @@ std::string getFileName(const std::string &str) {
   return filename;
 }
 
+// number of properties enumerated by EnumVerifierCalls
+static unsigned numProperties (const llvm::Module &M) {
+  const llvm::Function *fn = M.getFunction ("seahorn.error");
+  if (!fn) return 0;
+  unsigned n = 0;
+  for (const llvm::User *U : fn->users ())
+    if (llvm::isa<llvm::CallInst> (U)) n++;
+  return n;
+}
+
 int main(int argc, char **argv) {
   llvm::llvm_shutdown_obj shutdown;  // calls llvm_shutdown() on exit
   llvm::cl::AddExtraVersionPrinter (print_seapp_version);
@@ -196,7 +138,7 @@ int main(int argc, char **argv) {
   std::unique_ptr<llvm::Module> module;
   std::unique_ptr<llvm::tool_output_file> output;
   
-  module = llvm::parseIRFile(InputFilename, err, context);
+  module = seahorn::loadModule (InputFilename, err, context);
   if (!module)
   {
     if (llvm::errs().has_colors()) llvm::errs().changeColor(llvm::raw_ostream::RED);
@@ -222,7 +164,7 @@ int main(int argc, char **argv) {
   // initialise and run passes //
   ///////////////////////////////
 
-  llvm::PassManager pass_manager;
+  seahorn::ProfilingPassManager pass_manager ("seapp");
   llvm::PassRegistry &Registry = *llvm::PassRegistry::getPassRegistry();
   llvm::initializeAnalysis(Registry);
   
@@ -248,153 +190,24 @@ int main(int argc, char **argv) {
     pass_manager.add (seahorn::createStripShadowMemPass ());
   else if (KleeInternalize)
     pass_manager.add (seahorn::createKleeInternalizePass ());
+  else if (FuzzInstrument) {
+    pass_manager.add (seahorn::createKleeInternalizePass ());
+    pass_manager.add (seahorn::createFuzzCoveragePass ());
+  }
   else if (WrapMem)
     pass_manager.add (seahorn::createWrapMemPass ());
+  else if (SplitProperties > 1) {
+    // -- the properties of a module that is already enumerated keep
+    // -- their identifiers
+    if (numProperties (*module) == 0)
+      pass_manager.add (seahorn::createEnumVerifierCallsPass ());
+  }
   else if (OnlyStripExtern) {
     pass_manager.add (seahorn::createDevirtualizeFunctionsPass ());
     pass_manager.add (seahorn::createStripUselessDeclarationsPass ());
   }
   else
-  {
-    // -- Create a main function if we do not have one.
-    pass_manager.add (new seahorn::DummyMainFunction ());
- 
-    // -- promote verifier specific functions to special names
-    pass_manager.add (new seahorn::PromoteVerifierCalls ());
-
-    // -- promote top-level mallocs to alloca
-    pass_manager.add (seahorn::createPromoteMallocPass ());
-
-    // -- turn loads from _Bool from truc to sgt
-    pass_manager.add (seahorn::createPromoteBoolLoadsPass ());
-
-    if (KillVaArg)
-      pass_manager.add (seahorn::createKillVarArgFnPass ());
-  
-    if (StripExtern)
-      pass_manager.add (seahorn::createStripUselessDeclarationsPass ());
-  
-    // -- mark entry points of all functions
-    if (!MixedSem && !CutLoops)
-      // XXX should only be ran once. need better way to ensure that.
-      pass_manager.add (seahorn::createMarkFnEntryPass ());
-  
-    // turn all functions internal so that we can inline them if requested
-    pass_manager.add (llvm::createInternalizePass (llvm::ArrayRef<const char*>("main")));
-  
-    // -- resolve indirect calls
-    if (DevirtualizeFuncs)
-      pass_manager.add (seahorn::createDevirtualizeFunctionsPass ());
-  
-    // -- externalize uses of address-taken functions
-    if (ExternalizeAddrTakenFuncs)
-      pass_manager.add (seahorn::createExternalizeAddressTakenFunctionsPass ());
-
-    // kill internal unused code
-    pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
-  
-    // -- global optimizations
-    //pass_manager.add (llvm::createGlobalOptimizerPass());
-  
-    // -- SSA
-    pass_manager.add(llvm::createPromoteMemoryToRegisterPass());
-    // -- Turn undef into nondet
-    pass_manager.add (seahorn::createNondetInitPass ());
-  
-    // -- cleanup after SSA
-    pass_manager.add (seahorn::createInstCombine ());
-    pass_manager.add (llvm::createCFGSimplificationPass ());
-  
-    // -- break aggregates
-    pass_manager.add (llvm::createScalarReplAggregatesPass (SROA_Threshold,
-                                                            true,
-                                                            SROA_StructMemThreshold,
-                                                            SROA_ArrayElementThreshold,
-                                                            SROA_ScalarLoadThreshold));
-    // -- Turn undef into nondet (undef are created by SROA when it calls mem2reg)
-    pass_manager.add (seahorn::createNondetInitPass ());
-  
-    // -- cleanup after break aggregates
-    pass_manager.add (seahorn::createInstCombine ());
-    pass_manager.add (llvm::createCFGSimplificationPass ());
-  
-    // eliminate unused calls to verifier.nondet() functions
-    pass_manager.add (seahorn::createDeadNondetElimPass ());
-  
-    pass_manager.add(llvm::createLowerSwitchPass());
-  
-    pass_manager.add(llvm::createDeadInstEliminationPass());
-    pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
-
-    if (LowerInvoke) 
-    {
-      // -- lower invoke's
-      pass_manager.add(llvm::createLowerInvokePass());
-      // cleanup after lowering invoke's
-      pass_manager.add (llvm::createCFGSimplificationPass ());  
-    }
-  
-    if (InlineAll)
-    {
-      pass_manager.add (seahorn::createMarkInternalInlinePass ());
-      pass_manager.add (llvm::createAlwaysInlinerPass ());
-      pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
-      pass_manager.add (seahorn::createPromoteMallocPass ());
-      pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
-    }
-  
-    pass_manager.add(llvm::createDeadInstEliminationPass());
-    pass_manager.add (llvm::createGlobalDCEPass ()); // kill unused internal global
-  
-    if (!MixedSem)
-      pass_manager.add (new seahorn::LowerGvInitializers ());
-    
-    pass_manager.add(llvm::createUnifyFunctionExitNodesPass ());
-
-    if (BoundsChecks)
-    { 
-      pass_manager.add (new seahorn::LowerCstExprPass ());
-      pass_manager.add (new seahorn::CanAccessMemory ());
-      pass_manager.add (new seahorn::BufferBoundsCheck ());
-      // -- Turn undef into nondet (undef might be created by
-      //    BufferBoundsCheck)
-      pass_manager.add (seahorn::createNondetInitPass ());
-    }
-
-    if (OverflowChecks)
-    { 
-      pass_manager.add (new seahorn::LowerCstExprPass ());
-      pass_manager.add (new seahorn::IntegerOverflowCheck ());
-    }
-
-    if (NullChecks)
-    {
-      pass_manager.add (new seahorn::LowerCstExprPass ());
-      pass_manager.add (new seahorn::NullCheck ());
-    }
-
-    if (!MixedSem && EnumVerifierCalls)  
-    { 
-      pass_manager.add (seahorn::createEnumVerifierCallsPass ());
-    }
-
-    pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
-
-    if (MixedSem)
-    {
-      pass_manager.add (new seahorn::MixedSemantics ());
-      pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
-      pass_manager.add (seahorn::createPromoteMallocPass ());
-    }
-
-    if (CutLoops)
-    {
-      pass_manager.add (llvm::createLoopSimplifyPass ());
-      pass_manager.add (llvm::createLCSSAPass ());
-      pass_manager.add (seahorn::createCutLoopsPass ());
-      // pass_manager.add (new seahorn::RemoveUnreachableBlocksPass ());
-    }
-  }
+    seahorn::addPreProcessingPasses (pass_manager);
   
   pass_manager.add (llvm::createVerifierPass());
     
@@ -409,5 +222,37 @@ int main(int argc, char **argv) {
   pass_manager.run(*module.get());
   
   if (!OutputFilename.empty ()) output->keep();
+
+  if (SplitProperties > 1 && !OutputFilename.empty ())
+  {
+    unsigned props = numProperties (*module);
+    unsigned groups = std::min<unsigned> (SplitProperties, props);
+    for (unsigned g = 0; g < groups; ++g)
+    {
+      std::string name = getFileName (OutputFilename) + "." + std::to_string (g) +
+        (OutputAssembly ? ".ll" : ".bc");
+      llvm::tool_output_file slice_output (name.c_str (), error_code, 
+                                           llvm::sys::fs::F_None);
+      if (error_code) {
+        llvm::errs() << "error: Could not open " << name << ": " 
+                     << error_code.message () << "\n";
+        return 3;
+      }
+      
+      std::unique_ptr<llvm::Module> slice (llvm::CloneModule (module.get ()));
+      llvm::PassManager slice_manager;
+      slice_manager.add (seahorn::createSlicePropertiesPass (groups, g));
+      slice_manager.add (llvm::createVerifierPass());
+      if (OutputAssembly)
+        slice_manager.add (createPrintModulePass (slice_output.os ()));
+      else 
+        slice_manager.add (createBitcodeWriterPass (slice_output.os ()));
+      slice_manager.run (*slice);
+      slice_output.keep ();
+    }
+    llvm::errs () << "-- Split " << props << " properties into " 
+                  << groups << " modules.\n";
+  }
+  seahorn::writeProfile ();
   return 0;
 }
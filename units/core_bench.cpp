@@ -0,0 +1,276 @@
+/// Micro-benchmarks of the core data structures.
+///
+///   core_bench [filter] [min-seconds]
+///
+/// runs every benchmark whose name contains filter, each for at least
+/// min-seconds (default 0.5), and prints one JSON object per line:
+///   {"benchmark": "expr.mk", "iterations": 12, "ops": 2400000,
+///    "seconds": 0.61, "ns_per_op": 254.2}
+/// so that results can be collected and compared across commits.
+#include "ufo/Expr.hpp"
+#include "ufo/Smt/EZ3.hh"
+
+#include "seahorn/SymStore.hh"
+#include "seahorn/HornClauseDB.hh"
+#include "seahorn/Analysis/DSA/Graph.hh"
+
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <string>
+
+using namespace expr;
+
+namespace
+{
+  std::string filter;
+  double minSeconds = 0.5;
+
+  /// runs body, which performs ops operations, until minSeconds
+  /// passed and prints the result. setup runs before every
+  /// iteration and is not timed
+  void bench (const std::string &name, size_t ops,
+              std::function<void ()> setup, std::function<void ()> body)
+  {
+    if (name.find (filter) == std::string::npos) return;
+
+    typedef std::chrono::steady_clock clock;
+    clock::duration spent (0);
+    unsigned iterations = 0;
+    do
+    {
+      if (setup) setup ();
+      clock::time_point start = clock::now ();
+      body ();
+      spent += clock::now () - start;
+      ++iterations;
+    }
+    while (std::chrono::duration<double> (spent).count () < minSeconds);
+
+    double seconds = std::chrono::duration<double> (spent).count ();
+    size_t total = ops * iterations;
+    llvm::outs () << "{\"benchmark\": \"" << name << "\""
+                  << ", \"iterations\": " << iterations
+                  << ", \"ops\": " << total
+                  << ", \"seconds\": " << llvm::format ("%.6f", seconds)
+                  << ", \"ns_per_op\": "
+                  << llvm::format ("%.2f", 1e9 * seconds / total) << "}\n";
+    llvm::outs ().flush ();
+  }
+
+  ExprVector mkVars (ExprFactory &efac, unsigned n, const std::string &pfx)
+  {
+    ExprVector vars;
+    for (unsigned i = 0; i < n; ++i)
+      vars.push_back (bind::intConst
+                      (mkTerm<std::string> (pfx + std::to_string (i), efac)));
+    return vars;
+  }
+
+  /// a conjunction of linear constraints over vars, similar to what
+  /// the symbolic execution produces for a straight-line block
+  Expr mkBlock (const ExprVector &vars, unsigned salt)
+  {
+    ExprFactory &efac = vars [0]->efac ();
+    ExprVector conj;
+    for (unsigned i = 0; i + 1 < vars.size (); ++i)
+    {
+      Expr k = mkTerm<mpz_class> ((i * 7 + salt) % 64, efac);
+      Expr sum = mk<PLUS> (vars [i], k);
+      conj.push_back (mk<EQ> (vars [i+1], sum));
+      conj.push_back (mk<LEQ> (sum, vars [(i * 13) % vars.size ()]));
+    }
+    return mknary<AND> (conj);
+  }
+
+  struct CountVisitor : public std::unary_function<Expr, VisitAction>
+  {
+    size_t n;
+    CountVisitor () : n (0) {}
+    VisitAction operator() (Expr e) { ++n; return VisitAction::doKids (); }
+  };
+
+  void benchExpr ()
+  {
+    const unsigned nVars = 1000;
+
+    bench ("expr.mk", 2 * 3 * (nVars - 1), nullptr, [&] ()
+      {
+        ExprFactory efac;
+        ExprVector vars = mkVars (efac, nVars, "v");
+        for (unsigned r = 0; r < 2; ++r) mkBlock (vars, r);
+      });
+
+    // -- the same terms again: every mk is found in the unique table
+    {
+      ExprFactory efac;
+      ExprVector vars = mkVars (efac, nVars, "v");
+      Expr keep = mkBlock (vars, 0);
+      bench ("expr.mk.existing", 3 * (nVars - 1), nullptr,
+             [&] () { mkBlock (vars, 0); });
+
+      bench ("expr.dagVisit", 1, nullptr, [&] ()
+        {
+          CountVisitor v;
+          dagVisit (v, keep);
+        });
+
+      ExprMap subst;
+      ExprVector fresh = mkVars (efac, nVars, "w");
+      for (unsigned i = 0; i < nVars; i += 2) subst [vars [i]] = fresh [i];
+      bench ("expr.replace", 1, nullptr, [&] () { replace (keep, subst); });
+    }
+  }
+
+  void benchZ3 ()
+  {
+    ExprFactory efac;
+    ExprVector vars = mkVars (efac, 500, "v");
+    Expr e = mkBlock (vars, 0);
+
+    // -- a context per iteration so that nothing is cached
+    std::unique_ptr<ufo::EZ3> z3;
+    bench ("z3.marshal", 1, [&] () { z3.reset (new ufo::EZ3 (efac)); },
+           [&] () { z3->toAst (e); });
+
+    ufo::EZ3 warm (efac);
+    warm.toAst (e);
+    bench ("z3.marshal.cached", 1, nullptr, [&] () { warm.toAst (e); });
+
+    z3::ast a (warm.toAst (e));
+    bench ("z3.unmarshal", 1, nullptr, [&] () { warm.toExpr (a); });
+  }
+
+  void benchSymStore ()
+  {
+    using seahorn::SymStore;
+    ExprFactory efac;
+    const unsigned nVars = 1000;
+    ExprVector vars = mkVars (efac, nVars, "v");
+    Expr block = mkBlock (vars, 0);
+
+    SymStore store (efac);
+    for (Expr v : vars) store.havoc (v);
+
+    bench ("symstore.copy", 1, nullptr, [&] ()
+      {
+        SymStore copy (store);
+        copy.write (vars [0], vars [1]);
+      });
+
+    bench ("symstore.havoc", nVars, nullptr, [&] ()
+      {
+        SymStore s (store);
+        for (Expr v : vars) s.havoc (v);
+      });
+
+    bench ("symstore.eval", 1, nullptr, [&] () { store.eval (block); });
+  }
+
+  void benchHornDB ()
+  {
+    using seahorn::HornClauseDB;
+    using seahorn::HornRule;
+    ExprFactory efac;
+    const unsigned nRels = 500;
+
+    Expr iTy = mk<INT_TY> (efac);
+    Expr bTy = mk<BOOL_TY> (efac);
+    ExprVector x = mkVars (efac, 2, "x");
+    ExprVector rels;
+    for (unsigned i = 0; i < nRels; ++i)
+    {
+      ExprVector ty {iTy, iTy, bTy};
+      rels.push_back (bind::fdecl (mkTerm<std::string>
+                                   ("R" + std::to_string (i), efac), ty));
+    }
+
+    // -- a chain of relations with a self loop at each of them
+    HornClauseDB db (efac);
+    for (Expr r : rels) db.registerRelation (r);
+    for (unsigned i = 0; i < nRels; ++i)
+    {
+      ExprVector args {x [0], x [1]};
+      Expr head = bind::fapp (rels [i], args);
+      Expr body = i == 0 ? mk<TRUE> (efac) : bind::fapp (rels [i-1], args);
+      db.addRule (HornRule (x, head, body));
+      Expr next = bind::fapp (rels [i], ExprVector {x [1], x [0]});
+      db.addRule (HornRule (x, head, boolop::land (next, mk<LT> (x [0], x [1]))));
+    }
+
+    bench ("horndb.buildIndexes", 2 * nRels, nullptr,
+           [&] () { db.buildIndexes (); });
+  }
+
+  void benchDsa ()
+  {
+    using namespace seahorn::dsa;
+    llvm::LLVMContext ctx;
+    llvm::Module m ("bench", ctx);
+    llvm::DataLayout dl ("");
+    Graph::SetFactory sf;
+
+    const unsigned nValues = 500;
+    llvm::Type *i8 = llvm::Type::getInt8Ty (ctx);
+    std::vector<llvm::GlobalVariable*> gvs;
+    for (unsigned i = 0; i < nValues; ++i)
+      gvs.push_back (new llvm::GlobalVariable
+                     (m, i8, false, llvm::GlobalValue::InternalLinkage,
+                      llvm::ConstantInt::get (i8, 0), "g" + std::to_string (i)));
+
+    // -- every value points to a node that links to two others, as in
+    // -- a graph of a function with lists and trees
+    auto build = [&] (Graph &g)
+      {
+        std::vector<Node*> nodes;
+        for (unsigned i = 0; i < nValues; ++i) nodes.push_back (&g.mkNode ());
+        for (unsigned i = 0; i < nValues; ++i)
+        {
+          Cell c (*nodes [i], 0);
+          c.setLink (0, Cell (*nodes [(i + 1) % nValues], 0));
+          c.setLink (8, Cell (*nodes [(i * 7) % nValues], 0));
+          g.mkCell (*gvs [i], c);
+        }
+      };
+
+    std::unique_ptr<Graph> g;
+    bench ("dsa.unify", nValues / 2,
+           [&] () { g.reset (new Graph (dl, sf)); build (*g); },
+           [&] ()
+           {
+             // -- merges pairs of values, and so whole parts of the graph
+             for (unsigned i = 0; i + 1 < nValues; i += 2)
+             {
+               Cell a = g->getCell (*gvs [i]);
+               Cell b = g->getCell (*gvs [i + 1]);
+               a.unify (b);
+             }
+           });
+
+    Graph callee (dl, sf);
+    build (callee);
+    bench ("dsa.import", 1, [&] () { g.reset (new Graph (dl, sf)); },
+           [&] () { g->import (callee); });
+  }
+}
+
+int main (int argc, char **argv)
+{
+  if (argc > 1) filter = argv [1];
+  if (argc > 2) minSeconds = atof (argv [2]);
+
+  benchExpr ();
+  benchZ3 ();
+  benchSymStore ();
+  benchHornDB ();
+  benchDsa ();
+  return 0;
+}
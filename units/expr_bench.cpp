@@ -0,0 +1,65 @@
+/// Micro-benchmark for term construction in ExprFactory.
+///
+/// Build once as is, and once with -DEXPR_LEGACY_UNIQUE_TABLE
+/// (target expr_bench_legacy) to compare unique table layouts.
+#include "ufo/Expr.hpp"
+#include "ufo/Stats.hh"
+
+#include <cstdlib>
+
+using namespace expr;
+
+namespace
+{
+  /// builds linear constraints over nVars variables, similar to what
+  /// the symbolic execution produces for a straight-line block
+  size_t buildTerms (ExprFactory &efac, unsigned nVars, unsigned nRounds)
+  {
+    ExprVector vars;
+    for (unsigned i = 0; i < nVars; ++i)
+      vars.push_back (bind::intConst 
+                      (mkTerm<std::string> ("v" + std::to_string (i), efac)));
+
+    ExprVector side;
+    size_t count = 0;
+    for (unsigned r = 0; r < nRounds; ++r)
+      for (unsigned i = 0; i + 1 < nVars; ++i)
+      {
+        // -- many constants are small and repeated
+        Expr k = mkTerm<mpz_class> ((i * 7 + r) % 64, efac);
+        Expr sum = mk<PLUS> (vars [i], k);
+        Expr eq = mk<EQ> (vars [i+1], sum);
+        Expr le = mk<LEQ> (sum, vars [(i * 13) % nVars]);
+        side.push_back (boolop::land (eq, le));
+        count += 4;
+      }
+    // -- keep everything alive until the end to exercise table growth
+    return count + side.size ();
+  }
+}
+
+int main (int argc, char **argv)
+{
+  unsigned nVars = argc > 1 ? atoi (argv [1]) : 2000;
+  unsigned nRounds = argc > 2 ? atoi (argv [2]) : 200;
+  unsigned nReps = argc > 3 ? atoi (argv [3]) : 5;
+
+  ufo::Stopwatch sw;
+  size_t terms = 0;
+  for (unsigned i = 0; i < nReps; ++i)
+  {
+    ExprFactory efac;
+    terms += buildTerms (efac, nVars, nRounds);
+  }
+  sw.stop ();
+  
+#ifdef EXPR_LEGACY_UNIQUE_TABLE
+  std::cout << "unique table: legacy (map of unordered_set)\n";
+#else
+  std::cout << "unique table: open addressing by operator id\n";
+#endif
+  std::cout << "mk calls: " << terms << "\n"
+            << "time: " << sw.toSeconds () << "s\n"
+            << "ns/mk: " << (1e9 * sw.toSeconds ()) / terms << "\n";
+  return 0;
+}
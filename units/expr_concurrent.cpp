@@ -0,0 +1,229 @@
+#include "ufo/Expr.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#define BOOST_TEST_MODULE expr_concurrent_test
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE( expr_concurrent_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  ExprFactory efac (true);
+  BOOST_CHECK (efac.isConcurrent ());
+
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+
+  const unsigned nThreads = 8;
+  vector<Expr> res (nThreads);
+  vector<thread> workers;
+
+  // -- every thread builds the same terms, and drops most of them
+  // -- right away, racing on the unique table and reference counts
+  for (unsigned t = 0; t < nThreads; ++t)
+    workers.push_back (thread ([&res, &efac, x, t] 
+    {
+      Expr acc = x;
+      for (unsigned i = 0; i < 10000; ++i)
+      {
+        Expr k = mkTerm<mpz_class> (i % 100, efac);
+        Expr e = mk<GT> (mk<PLUS> (x, k), k);
+        if (i % 100 == 99)
+        {
+          res [t] = acc;
+          acc = x;
+        }
+        else
+          acc = mk<AND> (acc, e);
+      }
+    }));
+
+  for (thread &w : workers) w.join ();
+
+  // -- hash-consing must give the same node to every thread
+  for (unsigned t = 1; t < nThreads; ++t) 
+    BOOST_CHECK (res [t] == res [0]);
+  BOOST_CHECK_EQUAL (dagSize (res [0]), 400);
+}
+
+BOOST_AUTO_TEST_CASE( expr_profile_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  ExprFactory efac (true);
+  efac.enableProfiling ();
+  const ExprFactoryProfile &p = *efac.getProfile ();
+
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  size_t base = p.nodes ().live;
+
+  const unsigned nThreads = 4;
+  vector<thread> workers;
+  for (unsigned t = 0; t < nThreads; ++t)
+    workers.push_back (thread ([&efac, x] 
+    {
+      ExprProfileScope _p ("worker");
+      for (unsigned i = 0; i < 1000; ++i)
+        Expr e = mk<PLUS> (x, mkTerm<mpz_class> (i, efac));
+    }));
+  for (thread &w : workers) w.join ();
+
+  // -- everything built by the workers is gone
+  BOOST_CHECK_EQUAL (p.nodes ().live, base);
+  BOOST_CHECK (p.nodes ().peak > base);
+
+  Expr e = mk<AND> (mk<LT> (x, x), mk<GT> (x, x));
+  efac.getProfile ()->recordFormula ("e", e);
+
+  size_t plus = 0, worker = 0, dag = 0, tree = 0;
+  p.forEach ([&] (const string &name, size_t v)
+             {
+               if (name == "op.PLUS.total") plus = v;
+               else if (name == "tag.worker") worker = v;
+               else if (name == "formula.e.dag") dag = v;
+               else if (name == "formula.e.tree") tree = v;
+             });
+  // -- concurrent threads may create a node that loses the race to
+  // -- be canonical, but only canonical nodes are counted
+  BOOST_CHECK (plus >= 1000 && plus <= nThreads * 1000);
+  BOOST_CHECK (worker >= 2000);
+  BOOST_CHECK_EQUAL (dag, dagSize (e));
+  BOOST_CHECK (tree > dag);
+}
+
+BOOST_AUTO_TEST_CASE( expr_region_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  for (bool concurrent : {false, true})
+  {
+    ExprFactory efac (concurrent, true);
+    BOOST_CHECK (efac.isRegion ());
+    efac.enableProfiling ();
+    const ExprFactoryProfile &p = *efac.getProfile ();
+
+    Expr x = bind::intConst (mkTerm<string> ("x", efac));
+    size_t base = p.nodes ().live;
+
+    unsigned id;
+    {
+      Expr e = mk<GT> (mk<PLUS> (x, mkTerm<mpz_class> (1, efac)), x);
+      id = e->getId ();
+    }
+    // -- garbage of a region is resurrected
+    Expr e = mk<GT> (mk<PLUS> (x, mkTerm<mpz_class> (1, efac)), x);
+    BOOST_CHECK_EQUAL (e->getId (), id);
+
+    for (unsigned i = 0; i < 1000; ++i)
+      Expr g = mk<PLUS> (x, mkTerm<mpz_class> (i + 2, efac));
+    BOOST_CHECK_EQUAL (p.nodes ().live, base + 3 + 2000);
+
+    // -- e and its kids stay
+    BOOST_CHECK (efac.compact () >= 2000);
+    BOOST_CHECK_EQUAL (p.nodes ().live, base + 3);
+    BOOST_CHECK_EQUAL (dagSize (e), dagSize (x) + 3);
+    e.reset ();
+    x.reset ();
+  }
+}
+
+BOOST_AUTO_TEST_CASE( expr_string_pool_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  ExprFactory efac (true);
+  string name (200, 'n');
+
+  const unsigned nThreads = 8;
+  vector<Expr> res (nThreads);
+  vector<thread> workers;
+  for (unsigned t = 0; t < nThreads; ++t)
+    workers.push_back (thread ([&res, &efac, &name, t]
+    {
+      for (unsigned i = 0; i < 1000; ++i)
+        res [t] = mkTerm<string> (name + to_string (i % 10), efac);
+    }));
+  for (thread &w : workers) w.join ();
+
+  for (unsigned t = 1; t < nThreads; ++t)
+    BOOST_CHECK (res [t] == res [0]);
+  BOOST_CHECK_EQUAL (getTerm<string> (res [0]), name + "9");
+
+  // -- names are shared by all factories, the terms are not
+  ExprFactory other;
+  Expr y = mkTerm<string> (name + "9", other);
+  BOOST_CHECK_EQUAL (dynamic_cast<const STRING&> (y->op ()).id (),
+                     dynamic_cast<const STRING&> (res [0]->op ()).id ());
+  BOOST_CHECK (y != res [0]);
+
+  // -- order is that of the strings
+  Expr a = mkTerm<string> ("a", efac);
+  Expr b = mkTerm<string> ("b", efac);
+  BOOST_CHECK (a->op () < b->op ());
+  BOOST_CHECK (!(b->op () < a->op ()));
+  BOOST_CHECK (!(a->op () < a->op ()));
+}
+
+BOOST_AUTO_TEST_CASE( expr_canon_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  ExprFactory efac;
+  Expr a = bind::boolConst (mkTerm<string> ("a", efac));
+  Expr b = bind::boolConst (mkTerm<string> ("b", efac));
+  Expr c = bind::boolConst (mkTerm<string> ("c", efac));
+
+  // -- the same conjunction, whatever the order and nesting
+  Expr e = canon::mk<AND> (a, mk<AND> (b, c));
+  BOOST_CHECK (e == canon::mk<AND> (mk<AND> (c, b), a));
+  BOOST_CHECK (e == canon::mk<AND> (e, mk<TRUE> (efac), b));
+  BOOST_CHECK_EQUAL (e->arity (), 3);
+  BOOST_CHECK (isOpX<FALSE> (canon::mk<AND> (a, mk<NEG> (a))));
+  BOOST_CHECK (isOpX<TRUE> (canon::mk<OR> (b, mk<NEG> (b))));
+  BOOST_CHECK (canon::mk<OR> (a, a) == a);
+
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr two = mkTerm<mpz_class> (2, efac);
+  Expr s = canon::mk<PLUS> (x, mk<PLUS> (two, y), two);
+  BOOST_CHECK (s == canon::mk<PLUS> (y, mk<PLUS> (mkTerm<mpz_class> (4, efac), x)));
+  BOOST_CHECK (s->arg (0) == mkTerm<mpz_class> (4, efac));
+  // -- no idempotence for sums
+  BOOST_CHECK_EQUAL (canon::mk<PLUS> (x, x)->arity (), 2);
+  BOOST_CHECK (canon::mk<PLUS> (x, mkTerm<mpz_class> (0, efac)) == x);
+  BOOST_CHECK (canon::mk<MULT> (x, mkTerm<mpz_class> (0, efac)) == 
+               mkTerm<mpz_class> (0, efac));
+  BOOST_CHECK (canon::mk<MULT> (two, two) == mkTerm<mpz_class> (4, efac));
+}
+
+BOOST_AUTO_TEST_CASE( expr_canon_order_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  // -- the order of the arguments does not depend on the order in
+  // -- which their nodes were created
+  vector<string> printed;
+  for (bool reversed : {false, true})
+  {
+    ExprFactory efac (true);
+    vector<string> names = {"a", "b", "c"};
+    if (reversed) std::reverse (names.begin (), names.end ());
+    ExprVector vs;
+    for (const string &n : names) vs.push_back (bind::intConst (mkTerm<string> (n, efac)));
+    if (reversed) std::reverse (vs.begin (), vs.end ());
+
+    Expr e = canon::mk<PLUS> (vs [2], mk<MULT> (vs [0], vs [1]), vs [0]);
+    ostringstream os;
+    os << *e;
+    printed.push_back (os.str ());
+  }
+  BOOST_CHECK_EQUAL (printed [0], printed [1]);
+}
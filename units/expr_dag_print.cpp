@@ -0,0 +1,46 @@
+#include "ufo/Expr.hpp"
+#include "ufo/ExprDagPrint.hpp"
+
+#include <sstream>
+
+#define BOOST_TEST_MODULE expr_dag_print_test
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE( expr_dag_print_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  ExprFactory efac;
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+
+  // -- a tree of 2^40 nodes: each level uses the one below twice
+  Expr e = x;
+  for (unsigned i = 0; i < 40; ++i) e = mk<PLUS> (e, e);
+
+  DagPrintOpts opts;
+  opts.inlineSize = 4;
+  ostringstream OS;
+  printDag (OS, e, opts);
+  string out = OS.str ();
+
+  // -- one binding per level, x is small enough to be inlined
+  size_t lets = 0;
+  for (size_t p = out.find ("let $"); p != string::npos; p = out.find ("let $", p + 1))
+    ++lets;
+  BOOST_CHECK_EQUAL (lets, 40);
+  BOOST_CHECK (out.find ("in $40") != string::npos);
+
+  // -- a small term is printed as by operator<<
+  ostringstream small, tree;
+  printDag (small, mk<PLUS> (x, x));
+  tree << *mk<PLUS> (x, x);
+  BOOST_CHECK_EQUAL (small.str (), tree.str ());
+
+  // -- with a cutoff, only the bindings closest to the root
+  opts.maxNodes = 5;
+  ostringstream cut;
+  printDag (cut, e, opts);
+  BOOST_CHECK (cut.str ().find ("; 35 named subterms omitted") == 0);
+  BOOST_CHECK (cut.str ().find ("let $36 = (PLUS ... ...)") != string::npos);
+}
@@ -0,0 +1,137 @@
+#include "ufo/Expr.hpp"
+#include "ufo/ExprEval.hpp"
+
+#define BOOST_TEST_MODULE expr_eval_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+
+BOOST_AUTO_TEST_CASE( expr_eval_int_test )
+{
+  ExprFactory efac;
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr intTy = mk<INT_TY> (efac);
+
+  eval::Program p;
+  BOOST_CHECK_EQUAL (p.addVar (x, intTy), 0);
+  BOOST_CHECK_EQUAL (p.addVar (y, intTy), 1);
+
+  Expr sum = mk<PLUS> (x, y);
+  int r0 = p.addRoot (mk<LEQ> (sum, mkTerm (mpz_class (10), efac)));
+  int r1 = p.addRoot (mk<OR> (mk<GT> (x, y), mk<EQ> (sum, x)));
+  int r2 = p.addRoot (mk<MOD> (x, mkTerm (mpz_class (3), efac)));
+  BOOST_CHECK_EQUAL (r0, 0);
+  BOOST_CHECK_EQUAL (r1, 1);
+  BOOST_CHECK_EQUAL (r2, 2);
+  // -- x + y is shared
+  size_t sz = p.size ();
+  p.addRoot (mk<GEQ> (sum, y));
+  BOOST_CHECK_EQUAL (p.size (), sz + 1);
+
+  // -- more assignments than a block, y is unknown in the last one
+  const size_t n = 100;
+  eval::Batch in (p.numVars (), n);
+  for (size_t j = 0; j < n; ++j)
+  {
+    in.set (0, j, (int64_t) j - 50);
+    if (j + 1 < n) in.set (1, j, 3);
+  }
+  eval::Batch out;
+  p.eval (in, out);
+  BOOST_CHECK_EQUAL (out.size (), n);
+  for (size_t j = 0; j + 1 < n; ++j)
+  {
+    int64_t xv = (int64_t) j - 50;
+    BOOST_CHECK (out.known (0, j));
+    BOOST_CHECK_EQUAL (out.value (0, j), xv + 3 <= 10);
+    BOOST_CHECK_EQUAL (out.value (1, j), xv > 3);
+    BOOST_CHECK_EQUAL (out.value (2, j), ((xv % 3) + 3) % 3);
+  }
+  // -- without y, only x mod 3 is known
+  BOOST_CHECK (!out.known (0, n - 1));
+  BOOST_CHECK (!out.known (1, n - 1));
+  BOOST_CHECK (out.known (2, n - 1));
+
+  // -- an overflow is unknown
+  Expr big = mkTerm (mpz_class ("9223372036854775807"), efac);
+  int r3 = p.addRoot (mk<LT> (mk<PLUS> (x, big), x));
+  p.eval (in, out);
+  BOOST_CHECK (!out.known (r3, 99));
+  BOOST_CHECK (out.known (r3, 0));
+  BOOST_CHECK_EQUAL (out.value (r3, 0), 0);
+
+  // -- reals are not supported
+  Expr z = bind::realConst (mkTerm<string> ("z", efac));
+  BOOST_CHECK_EQUAL (p.addRoot (mk<LT> (z, x)), -1);
+}
+
+BOOST_AUTO_TEST_CASE( expr_eval_bv_test )
+{
+  ExprFactory efac;
+  Expr sort8 = bv::bvsort (8, efac);
+  Expr a = bv::bvConst (mkTerm<string> ("a", efac), 8);
+  Expr b = bv::bvConst (mkTerm<string> ("b", efac), 8);
+
+  eval::Program p;
+  p.addVar (a, sort8);
+  p.addVar (b, sort8);
+
+  int add = p.addRoot (mk<BADD> (a, b));
+  int slt = p.addRoot (mk<BSLT> (a, b));
+  int ult = p.addRoot (mk<BULT> (a, b));
+  int ext = p.addRoot (bv::sext (a, 16));
+  int cat = p.addRoot (mk<BCONCAT> (a, b));
+  int hi = p.addRoot (bv::extract (7, 4, a));
+  int div = p.addRoot (mk<BUDIV> (a, b));
+  BOOST_CHECK (add >= 0 && slt >= 0 && ult >= 0 && ext >= 0 &&
+               cat >= 0 && hi >= 0 && div >= 0);
+  BOOST_CHECK_EQUAL (p.rootSort (cat).width, 16);
+  BOOST_CHECK_EQUAL (p.rootSort (hi).width, 4);
+
+  eval::Batch in (2, 2);
+  in.set (0, 0, 0xf0); in.set (1, 0, 0x20);
+  in.set (0, 1, 0x01); in.set (1, 1, 0x00);
+  eval::Batch out;
+  p.eval (in, out);
+
+  BOOST_CHECK_EQUAL (out.value (add, 0), 0x10);
+  BOOST_CHECK_EQUAL (out.value (slt, 0), 1);
+  BOOST_CHECK_EQUAL (out.value (ult, 0), 0);
+  BOOST_CHECK_EQUAL (out.value (ext, 0), 0xfff0);
+  BOOST_CHECK_EQUAL (out.value (cat, 0), 0xf020);
+  BOOST_CHECK_EQUAL (out.value (hi, 0), 0xf);
+  BOOST_CHECK_EQUAL (out.value (div, 0), 7);
+  // -- division by zero is all ones
+  BOOST_CHECK_EQUAL (out.value (div, 1), 0xff);
+
+  int64_t v;
+  BOOST_CHECK (eval::toValue (bv::bvnum (mpz_class (300), 8, efac), v));
+  BOOST_CHECK_EQUAL (v, 300 - 256);
+}
+
+BOOST_AUTO_TEST_CASE( expr_bvnum64_test )
+{
+  ExprFactory efac;
+  uint64_t n;
+
+  // -- numerals are reduced modulo 2^width, negative ones included
+  BOOST_CHECK (bv::toUint64 (bv::bvnum (mpz_class (300), 8, efac), n));
+  BOOST_CHECK_EQUAL (n, 300 - 256);
+  BOOST_CHECK (bv::toUint64 (bv::bvnum (mpz_class (-1), 32, efac), n));
+  BOOST_CHECK_EQUAL (n, 0xffffffffULL);
+
+  mpz_class big ("18446744073709551615");
+  BOOST_CHECK (bv::toUint64 (bv::bvnum (big, 64, efac), n));
+  BOOST_CHECK_EQUAL (n, ~uint64_t (0));
+  BOOST_CHECK (!bv::toUint64 (bv::bvnum (big, 65, efac), n));
+  BOOST_CHECK (!bv::toUint64 (mkTerm (big, efac), n));
+
+  BOOST_CHECK (bv::bvnum64 (0x1ff, 8, efac) == bv::bvnum (mpz_class (255), 8, efac));
+  BOOST_CHECK (bv::bvnum64 (~uint64_t (0), 64, efac) == bv::bvnum (big, 64, efac));
+
+  BOOST_CHECK_EQUAL (bv::sext64 (0x80, 8), -128);
+  BOOST_CHECK_EQUAL (bv::sext64 (0x7f, 8), 127);
+  BOOST_CHECK_EQUAL (bv::sext64 (0x180, 8), -128);
+}
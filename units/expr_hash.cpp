@@ -0,0 +1,64 @@
+#include "ufo/Expr.hpp"
+#include "ufo/ExprHash.hpp"
+
+#define BOOST_TEST_MODULE expr_hash_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+
+BOOST_AUTO_TEST_CASE( expr_hash_test )
+{
+  ExprFactory efac;
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+
+  ExprVector terms;
+  for (unsigned i = 0; i < 1000; ++i)
+    terms.push_back (mk<PLUS> (x, mkTerm<mpz_class> (i, efac)));
+
+  ExprHashSet s;
+  ExprHashMap<unsigned> m;
+  for (unsigned i = 0; i < terms.size (); ++i)
+  {
+    BOOST_CHECK (s.insert (terms [i]).second);
+    m [terms [i]] = i;
+  }
+  BOOST_CHECK (!s.insert (terms [7]).second);
+  BOOST_CHECK_EQUAL (s.size (), terms.size ());
+  BOOST_CHECK_EQUAL (m.size (), terms.size ());
+
+  // -- a term built again is the same key
+  Expr t = mk<PLUS> (x, mkTerm<mpz_class> (42, efac));
+  BOOST_CHECK_EQUAL (s.count (t), 1);
+  BOOST_CHECK_EQUAL (m.find (t)->second, 42);
+  BOOST_CHECK (s.find (x) == s.end ());
+
+  // -- remove every other term, the rest must stay reachable
+  for (unsigned i = 0; i < terms.size (); i += 2)
+  {
+    BOOST_CHECK_EQUAL (s.erase (terms [i]), 1);
+    BOOST_CHECK_EQUAL (m.erase (terms [i]), 1);
+  }
+  BOOST_CHECK_EQUAL (s.erase (terms [0]), 0);
+  BOOST_CHECK_EQUAL (s.size (), terms.size () / 2);
+  for (unsigned i = 0; i < terms.size (); ++i)
+  {
+    BOOST_CHECK_EQUAL (s.count (terms [i]), i % 2);
+    if (i % 2) BOOST_CHECK_EQUAL (m.find (terms [i])->second, i);
+    else BOOST_CHECK (m.find (terms [i]) == m.end ());
+  }
+
+  size_t n = 0, sum = 0;
+  for (const auto &kv : m) { ++n; sum += kv.second; }
+  BOOST_CHECK_EQUAL (n, m.size ());
+  BOOST_CHECK_EQUAL (sum, 500 * 500);
+
+  const ExprHashSet &cs = s;
+  n = 0;
+  for (Expr e : cs) { BOOST_CHECK (isOpX<PLUS> (e)); ++n; }
+  BOOST_CHECK_EQUAL (n, s.size ());
+
+  s.clear ();
+  BOOST_CHECK (s.empty ());
+  BOOST_CHECK (s.begin () == s.end ());
+}
@@ -0,0 +1,60 @@
+#include "ufo/Expr.hpp"
+#include "ufo/ExprIO.hpp"
+
+#include <sstream>
+
+#define BOOST_TEST_MODULE expr_io_test
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_CASE( expr_io_test )
+{
+  using namespace std;
+  using namespace expr;
+
+  ExprFactory efac;
+
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr big = mkTerm (mpz_class ("123456789012345678901234567890"), efac);
+  Expr bv = bv::bvConst (mkTerm<string> ("b", efac), 32);
+
+  Expr s = mk<PLUS> (x, mkTerm<mpz_class> (-5, efac));
+  Expr f = mk<AND> (mk<GT> (s, y), mk<LT> (s, big), mk<TRUE> (efac));
+  Expr g = mk<IMPL> (f, mk<EQ> (mk<BADD> (bv, bv), bv::bvnum (mpz_class (7), 32, efac)));
+  Expr q = mk<FORALL> (bind::fdecl (mkTerm<string> ("B0", efac),
+                                    ExprVector (1, mk<INT_TY> (efac))),
+                       mk<GEQ> (bind::intBVar (0, efac), mkTerm (mpq_class (3, 4), efac)));
+
+  ExprVector roots;
+  roots.push_back (g);
+  roots.push_back (q);
+  roots.push_back (s);
+
+  ostringstream OS;
+  BOOST_REQUIRE (exprio::write (OS, roots));
+  string buf = OS.str ();
+
+  // -- read into the same factory: hash-consing gives back the same nodes
+  ExprVector same;
+  BOOST_REQUIRE (exprio::read (buf.data (), buf.size (), efac,
+                               back_inserter (same)));
+  BOOST_CHECK (same == roots);
+
+  // -- read into a fresh factory: structure and sharing are preserved
+  ExprFactory efac2;
+  ExprVector other;
+  BOOST_REQUIRE (exprio::read (buf.data (), buf.size (), efac2,
+                               back_inserter (other)));
+  BOOST_REQUIRE_EQUAL (other.size (), 3);
+  BOOST_CHECK_EQUAL (boost::lexical_cast<string> (*other [0]),
+                     boost::lexical_cast<string> (*g));
+  BOOST_CHECK_EQUAL (boost::lexical_cast<string> (*other [1]),
+                     boost::lexical_cast<string> (*q));
+  BOOST_CHECK (other [2] == other [0]->left ()->left ()->left ());
+  BOOST_CHECK_EQUAL (dagSize (other [0]), dagSize (g));
+
+  // -- truncated input is rejected
+  ExprVector none;
+  BOOST_CHECK (!exprio::read (buf.data (), buf.size () / 2, efac2,
+                              back_inserter (none)));
+}
@@ -0,0 +1,56 @@
+#include "seahorn/HornInvCompact.hh"
+
+#define BOOST_TEST_MODULE horn_inv_compact_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace ufo;
+using namespace expr;
+using namespace seahorn;
+
+BOOST_AUTO_TEST_CASE( horn_inv_compact_syntactic_test )
+{
+  ExprFactory efac;
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr three = mkTerm (mpz_class (3), efac);
+  Expr five = mkTerm (mpz_class (5), efac);
+
+  HornInvCompactor comp;
+  // -- x <= 3 implies x <= 5 and 5 >= x, and the disjunction
+  Expr inv = mk<AND> (mk<AND> (mk<LEQ> (x, five), mk<LEQ> (x, three)),
+                      mk<AND> (mk<GEQ> (five, x),
+                               mk<OR> (mk<LEQ> (x, three), mk<GT> (y, x))));
+  BOOST_CHECK_EQUAL (comp.compact (inv), mk<LEQ> (x, three));
+
+  // -- of two equal bounds, one is kept
+  Expr eq = mk<AND> (mk<LT> (x, five), mk<GT> (five, x));
+  BOOST_CHECK_EQUAL (comp.compact (eq), mk<GT> (five, x));
+
+  // -- bounds of different directions, or of different terms, stay
+  Expr both = mk<AND> (mk<LEQ> (x, five), mk<GEQ> (x, three), mk<LEQ> (y, three));
+  BOOST_CHECK_EQUAL (comp.compact (both), both);
+
+  Expr f = mk<AND> (mk<LEQ> (x, five), mk<FALSE> (efac));
+  BOOST_CHECK_EQUAL (comp.compact (f), mk<FALSE> (efac));
+  BOOST_CHECK_EQUAL (comp.compact (mk<TRUE> (efac)), mk<TRUE> (efac));
+}
+
+BOOST_AUTO_TEST_CASE( horn_inv_compact_smt_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr zero = mkTerm (mpz_class (0), efac);
+
+  // -- x = y and y >= 0 imply x >= 0, which no syntactic check sees
+  Expr inv = mk<AND> (mk<GEQ> (x, zero), mk<EQ> (x, y), mk<GEQ> (y, zero));
+  HornInvCompactor syntactic (&z3);
+  BOOST_CHECK_EQUAL (dagSize (syntactic.compact (inv)), dagSize (inv));
+
+  HornInvCompactor smt (&z3, 1000);
+  Expr res = smt.compact (inv);
+  BOOST_CHECK (isOpX<AND> (res));
+  BOOST_CHECK_EQUAL (res->arity (), 2);
+}
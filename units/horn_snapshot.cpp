@@ -0,0 +1,143 @@
+#include "seahorn/HornClauseDBSnapshot.hh"
+
+#define BOOST_TEST_MODULE horn_snapshot_test
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+using namespace std;
+using namespace expr;
+using namespace seahorn;
+
+BOOST_AUTO_TEST_CASE( horn_snapshot_versions_test )
+{
+  // -- the readers copy expressions
+  ExprFactory efac (true);
+  HornClauseDB db (efac);
+  Expr intTy = mk<INT_TY> (efac);
+  Expr boolTy = mk<BOOL_TY> (efac);
+  Expr p = bind::fdecl (mkTerm<string> ("p", efac), ExprVector {intTy, boolTy});
+  Expr q = bind::fdecl (mkTerm<string> ("q", efac), ExprVector {intTy, boolTy});
+  db.registerRelation (p);
+  db.registerRelation (q);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  ExprVector vars {x};
+  db.addRule (HornRule (vars, bind::fapp (p, x),
+                        mk<EQ> (x, mkTerm (mpz_class (0), efac))));
+  // -- more rules than a chunk
+  for (int i = 0; i < 200; ++i)
+    db.addRule (HornRule (vars, bind::fapp (q, x),
+                          mk<AND> (bind::fapp (p, x),
+                                   mk<EQ> (x, mkTerm (mpz_class (i), efac)))));
+  db.removeRule (5);
+
+  HornClauseDBSnapshot::Ptr s1 = HornClauseDBSnapshot::make (db);
+  BOOST_CHECK_EQUAL (s1->size (), 200);
+  BOOST_CHECK_EQUAL (s1->ruleIdBound (), db.ruleIdBound ());
+  BOOST_CHECK (!s1->isLive (5));
+  BOOST_CHECK (s1->getRule (7) == db.getRule (7));
+  BOOST_CHECK_EQUAL (s1->use (p).size (), 199);
+  BOOST_CHECK_EQUAL (s1->def (q).size (), 199);
+
+  HornClauseDBSnapshot::Builder b (*s1);
+  b.removeRule (3);
+  HornClauseDBSnapshot::RuleId id =
+    b.addRule (HornRule (vars, bind::fapp (p, x),
+                         mk<EQ> (x, mkTerm (mpz_class (7), efac))));
+  HornClauseDBSnapshot::Ptr s2 = b.commit ();
+  BOOST_CHECK_EQUAL (id, db.ruleIdBound ());
+  BOOST_CHECK_EQUAL (s2->version (), s1->version () + 1);
+
+  // -- the old version is unchanged
+  BOOST_CHECK (s1->isLive (3));
+  BOOST_CHECK_EQUAL (s1->use (p).size (), 199);
+  BOOST_CHECK_EQUAL (s1->def (p).size (), 1);
+  BOOST_CHECK (!s2->isLive (3));
+  BOOST_CHECK_EQUAL (s2->use (p).size (), 198);
+  BOOST_CHECK_EQUAL (s2->def (p).size (), 2);
+  // -- rules are shared, changed or not
+  BOOST_CHECK_EQUAL (&s1->getRule (150), &s2->getRule (150));
+  BOOST_CHECK_EQUAL (&s1->getRule (1), &s2->getRule (1));
+
+  HornClauseDB db2 (efac);
+  s2->toDB (db2);
+  BOOST_CHECK_EQUAL (db2.getRules ().size (), s2->size ());
+
+  // -- readers of s1 while the builder derives more versions
+  vector<size_t> uses (4, 0);
+  vector<thread> readers;
+  for (unsigned t = 0; t < uses.size (); ++t)
+    readers.emplace_back ([&, t] ()
+      {
+        for (int k = 0; k < 100; ++k)
+          s1->forEachRule ([&] (HornClauseDBSnapshot::RuleId, const HornRule &r)
+            { if (bind::fname (r.head ()) == q) ++uses [t]; });
+      });
+  for (int i = 0; i < 50; ++i)
+  {
+    b.removeRule (10 + i);
+    b.commit ();
+  }
+  for (thread &t : readers) t.join ();
+  for (size_t u : uses) BOOST_CHECK_EQUAL (u, 100 * 199);
+  BOOST_CHECK_EQUAL (b.current ().size (), 150);
+}
+
+BOOST_AUTO_TEST_CASE( horn_rule_conjuncts_test )
+{
+  ExprFactory efac (true);
+  HornClauseDB db (efac);
+  Expr intTy = mk<INT_TY> (efac);
+  Expr boolTy = mk<BOOL_TY> (efac);
+  Expr p = bind::fdecl (mkTerm<string> ("p", efac), ExprVector {intTy, boolTy});
+  Expr q = bind::fdecl (mkTerm<string> ("q", efac), ExprVector {intTy, boolTy});
+  db.registerRelation (p);
+  db.registerRelation (q);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr b = bind::boolConst (mkTerm<string> ("b", efac));
+  Expr zero = mkTerm (mpz_class (0), efac);
+  ExprVector vars {x, b};
+
+  // -- nested conjunctions are flattened, true is dropped
+  Expr px = bind::fapp (p, x);
+  Expr eq = mk<EQ> (x, zero);
+  HornRule r1 (vars, bind::fapp (q, x),
+               mk<AND> (px, mk<AND> (b, mk<TRUE> (efac), eq), px));
+  BOOST_CHECK_EQUAL (r1.conjuncts ().size (), 4);
+  // -- b is an application, but not of a relation
+  BOOST_CHECK_EQUAL (r1.apps ().size (), 2);
+  ExprVector apps, rels;
+  r1.pred_apps (db, std::back_inserter (apps));
+  r1.used_relations (db, std::back_inserter (rels));
+  BOOST_CHECK_EQUAL (apps.size (), 1);
+  BOOST_CHECK (apps [0] == px);
+  BOOST_CHECK_EQUAL (rels.size (), 1);
+  BOOST_CHECK (rels [0] == p);
+
+  // -- the same rule from its conjuncts, the body is built on demand
+  HornRule r2 (vars, bind::fapp (q, x), ExprVector {px, b, eq, px});
+  BOOST_CHECK (r1 == r2);
+  BOOST_CHECK_EQUAL (r1.hash (), r2.hash ());
+  HornRule r3 (r2);
+  BOOST_CHECK (r3.body () == mknary<AND> (r2.conjuncts ()));
+  BOOST_CHECK (r2.body () == r3.body ());
+  r3 = r1;
+  BOOST_CHECK (r3 == r1);
+
+  HornRule fact (vars, px, ExprVector ());
+  BOOST_CHECK (isOpX<TRUE> (fact.body ()));
+  BOOST_CHECK (fact.get () == px);
+
+  db.addRule (r2);
+  BOOST_CHECK_EQUAL (db.use (p).size (), 1);
+  BOOST_CHECK (isOpX<AND> (extractTransitionRelation (r2, db)));
+
+  // -- bodies built by concurrent readers
+  HornRule r4 (vars, bind::fapp (q, x), ExprVector {px, eq, b});
+  vector<Expr> bodies (4);
+  vector<thread> readers;
+  for (unsigned t = 0; t < bodies.size (); ++t)
+    readers.emplace_back ([&, t] () { bodies [t] = r4.body (); });
+  for (thread &t : readers) t.join ();
+  for (Expr e : bodies) BOOST_CHECK (e == bodies [0]);
+}
@@ -0,0 +1,68 @@
+#include "ufo/Expr.hpp"
+#include "ufo/MemoryBudget.hpp"
+
+#define BOOST_TEST_MODULE memory_budget_test
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+using namespace std;
+using namespace expr;
+using namespace ufo;
+
+namespace
+{
+  /// flushed only by its own poll
+  struct OwnedCache : public BudgetedCache
+  {
+    size_t entries;
+    OwnedCache () : BudgetedCache ("test.owned", false), entries (10) {}
+    size_t flush () { size_t n = entries; entries = 0; return n; }
+    void use () { poll (); }
+  };
+
+  void nextCheck ()
+  { std::this_thread::sleep_for (std::chrono::milliseconds (20)); }
+}
+
+BOOST_AUTO_TEST_CASE( memory_budget_lru_test )
+{
+  ExprFactory efac (true);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+
+  OwnedCache owned;
+  {
+    DagVisitMemo memo (efac);
+    // -- keys are weak
+    Expr e1 = mk<PLUS> (x, y);
+    Expr e2 = mk<MINUS> (x, y);
+    memo.insert (e1, mk<PLUS> (y, x));
+    memo.insert (e2, x);
+    BOOST_CHECK_EQUAL (memo.size (), 2);
+
+    // -- no budget, nothing is flushed
+    nextCheck ();
+    owned.use ();
+    BOOST_CHECK_EQUAL (owned.entries, 10);
+
+    // -- any process is over 1 MB. The memo is the least recently
+    // -- used, and is flushed at once by the poll of the other cache
+    MemoryBudget::budgetMb () = 1;
+    nextCheck ();
+    owned.use ();
+    BOOST_CHECK_EQUAL (memo.size (), 0);
+    BOOST_CHECK_EQUAL (owned.entries, 10);
+  }
+
+  // -- then the other cache, by its own poll
+  nextCheck ();
+  owned.use ();
+  BOOST_CHECK_EQUAL (owned.entries, 0);
+
+  MemoryBudget::Counters c = MemoryBudget::counters ();
+  BOOST_CHECK_EQUAL (c.evictions, 2);
+  BOOST_CHECK_EQUAL (c.byName ["dagVisitMemo"], 2);
+  BOOST_CHECK_EQUAL (c.byName ["test.owned"], 10);
+  MemoryBudget::budgetMb () = 0;
+}
@@ -85,3 +85,72 @@ BOOST_AUTO_TEST_CASE( muz_test )
   BOOST_REQUIRE_EQUAL (res, true);
   
  }
+
+namespace
+{
+  /// a rule as the bulk loader of ZFixedPoint expects it
+  struct TestRule
+  {
+    expr::ExprVector m_vars;
+    expr::Expr m_rule;
+    const expr::ExprVector &vars () const { return m_vars; }
+    expr::Expr get () const { return m_rule; }
+  };
+}
+
+BOOST_AUTO_TEST_CASE( muz_bulk_test )
+{
+  using namespace std;
+  using namespace ufo;
+  using namespace expr;
+
+  ExprFactory efac;
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr iTy = mk<INT_TY> (efac);
+  Expr bTy = mk<BOOL_TY> (efac);
+  Expr zero = mkTerm<mpz_class> (0, efac);
+
+  ExprVector ftype;
+  ftype.push_back (iTy);
+  ftype.push_back (bTy);
+  Expr fdecl = bind::fdecl (mkTerm<string> ("f", efac), ftype);
+
+  EZ3 z3 (efac);
+  ZFixedPoint<EZ3> fp (z3);
+  ZParams<EZ3> params (z3);
+  params.set (":engine", "spacer");
+  fp.set (params);
+
+  ExprVector rels;
+  rels.push_back (fdecl);
+  fp.registerRelations (rels);
+
+  // -- f (x) for x = 0, 2, 4, ... The rules share the successor term
+  vector<TestRule> rules;
+  TestRule init;
+  init.m_vars.push_back (x);
+  init.m_rule = boolop::limp (mk<EQ> (x, zero), bind::fapp (fdecl, x));
+  rules.push_back (init);
+  TestRule step;
+  step.m_vars.push_back (x);
+  step.m_vars.push_back (y);
+  step.m_rule = boolop::limp (mk<AND> (bind::fapp (fdecl, x),
+                                       mk<EQ> (y, mk<PLUS> (x, mkTerm<mpz_class> (2, efac)))),
+                              bind::fapp (fdecl, y));
+  rules.push_back (step);
+  TestRule trivial;
+  trivial.m_rule = mk<TRUE> (efac);
+  rules.push_back (trivial);
+  fp.addRules (rules);
+
+  BOOST_CHECK_EQUAL (fp.getVars ().size (), 2);
+  tribool reach4 = fp.query (bind::fapp (fdecl, mkTerm<mpz_class> (4, efac)));
+  BOOST_CHECK (bool (reach4));
+  ZFixedPoint<EZ3> fp2 (z3);
+  fp2.set (params);
+  fp2.registerRelations (rels);
+  fp2.addRules (rules);
+  tribool reach3 = fp2.query (bind::fapp (fdecl, mkTerm<mpz_class> (3, efac)));
+  BOOST_CHECK (bool (!reach3));
+}
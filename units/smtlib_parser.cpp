@@ -0,0 +1,120 @@
+#include "ufo/Expr.hpp"
+#include "ufo/SmtLibParser.hpp"
+
+#include <sstream>
+
+#define BOOST_TEST_MODULE smtlib_parser_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+
+BOOST_AUTO_TEST_CASE( smtlib_parser_terms )
+{
+  ExprFactory efac;
+  istringstream in
+    ("(set-logic QF_AUFBV) ; a comment\n"
+     "(declare-fun x () Int)\n"
+     "(declare-fun |a b| () (Array Int Int))\n"
+     "(declare-fun f (Int Bool) Int)\n"
+     "(declare-const v (_ BitVec 8))\n"
+     "(define-fun inc ((y Int)) Int (+ y 1))\n"
+     "(assert (let ((z (inc x))) (and (< 0 z 10) (= (select |a b| z) (f z true)))))\n"
+     "(assert (= ((_ zero_extend 8) v) (concat #x00 ((_ extract 7 0) v)) (_ bv3 16)))\n"
+     "(assert (forall ((i Int) (j Int)) (exists ((k Int)) (! (= (+ i j) (* 2 k)) :named n))))\n"
+     "(check-sat)\n");
+
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr a = bind::mkConst (mkTerm<string> ("a b", efac),
+                          sort::arrayTy (sort::intTy (efac), sort::intTy (efac)));
+  Expr z = mk<PLUS> (x, mkTerm<mpz_class> (1, efac));
+
+  ExprVector asserts;
+  string error;
+  BOOST_REQUIRE (smtlib::parseAssertions (in, efac, back_inserter (asserts), &error));
+  BOOST_REQUIRE_EQUAL (asserts.size (), 3);
+
+  Expr fdecl = asserts [0]->right ()->right ()->left ();
+  BOOST_CHECK (bind::isFdecl (fdecl));
+  Expr expected = mk<AND> (mk<AND> (mk<LT> (mkTerm<mpz_class> (0, efac), z),
+                                    mk<LT> (z, mkTerm<mpz_class> (10, efac))),
+                           mk<EQ> (mk<SELECT> (a, z),
+                                   bind::fapp (fdecl, z, mk<TRUE> (efac))));
+  BOOST_CHECK (asserts [0] == expected);
+
+  Expr v = bv::bvConst (mkTerm<string> ("v", efac), 8);
+  Expr zext = bv::zext (v, 16);
+  Expr cat = mk<BCONCAT> (bv::bvnum (mpz_class (0), 8, efac), bv::extract (7, 0, v));
+  BOOST_CHECK (asserts [1] == mk<AND> (mk<EQ> (zext, cat),
+                                       mk<EQ> (cat, bv::bvnum (mpz_class (3), 16, efac))));
+
+  // -- de Bruijn indices count binders of enclosing quantifiers
+  Expr q = asserts [2];
+  BOOST_REQUIRE (isOpX<FORALL> (q) && q->arity () == 3);
+  Expr e = q->last ();
+  BOOST_REQUIRE (isOpX<EXISTS> (e));
+  Expr eq = e->last ();
+  Expr i = eq->left ()->left ();
+  Expr j = eq->left ()->right ();
+  Expr k = eq->right ()->right ();
+  BOOST_CHECK_EQUAL (bind::bvarId (i), 2);
+  BOOST_CHECK_EQUAL (bind::bvarId (j), 1);
+  BOOST_CHECK_EQUAL (bind::bvarId (k), 0);
+}
+
+BOOST_AUTO_TEST_CASE( smtlib_parser_horn )
+{
+  ExprFactory efac;
+  istringstream in
+    ("(set-logic HORN)\n"
+     "(declare-fun inv (Int) Bool)\n"
+     "(assert (forall ((x Int)) (=> (= x 0) (inv x))))\n"
+     "(assert (forall ((x Int) (y Int)) "
+     "  (=> (and (inv x) (= y (+ x 1))) (inv y))))\n"
+     "(assert (forall ((x Int)) (=> (and (inv x) (< x 0)) false)))\n");
+
+  smtlib::Parser p (in, efac);
+  p.bindQuantifiedAsConsts (true);
+  smtlib::Command cmd;
+
+  unsigned asserts = 0;
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  while (p.next (cmd))
+  {
+    if (cmd.kind != smtlib::Command::ASSERT) continue;
+    ++asserts;
+    BOOST_CHECK (isOpX<IMPL> (cmd.expr));
+    BOOST_REQUIRE (!cmd.vars.empty ());
+    BOOST_CHECK (cmd.vars [0] == x);
+  }
+  BOOST_CHECK (!p.hasError ());
+  BOOST_CHECK_EQUAL (asserts, 3);
+}
+
+BOOST_AUTO_TEST_CASE( smtlib_parser_deep )
+{
+  // -- nesting far deeper than the native stack allows for recursion
+  const unsigned depth = 200000;
+  string s = "(declare-fun x () Int)(assert (= x ";
+  for (unsigned i = 0; i < depth; ++i) s += "(+ 1 ";
+  s += "x";
+  s.append (depth, ')');
+  s += "))";
+
+  ExprFactory efac;
+  istringstream in (s);
+  ExprVector asserts;
+  BOOST_REQUIRE (smtlib::parseAssertions (in, efac, back_inserter (asserts)));
+  BOOST_CHECK_EQUAL (asserts.size (), 1);
+}
+
+BOOST_AUTO_TEST_CASE( smtlib_parser_errors )
+{
+  ExprFactory efac;
+  istringstream in ("(declare-fun x () Int)\n(assert (< x y))\n");
+  ExprVector asserts;
+  string error;
+  BOOST_CHECK (!smtlib::parseAssertions (in, efac, back_inserter (asserts), &error));
+  BOOST_CHECK (error.find ("line 2") != string::npos);
+  BOOST_CHECK (error.find ("y") != string::npos);
+}
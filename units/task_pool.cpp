@@ -0,0 +1,68 @@
+#include "seahorn/Support/TaskPool.hh"
+
+#define BOOST_TEST_MODULE task_pool_test
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace seahorn;
+
+BOOST_AUTO_TEST_CASE( task_pool_run_test )
+{
+  TaskPool pool ("TaskPoolTest", 4);
+  std::vector<int> done (1000, 0);
+  std::atomic<bool> badWorker (false);
+  size_t ran = pool.run (done.size (), [&] (unsigned w, size_t k)
+                         {
+                           if (w >= 4) badWorker = true;
+                           ++done [k];
+                         });
+  BOOST_CHECK_EQUAL (ran, done.size ());
+  BOOST_CHECK (!badWorker);
+  for (int d : done) BOOST_CHECK_EQUAL (d, 1);
+  BOOST_CHECK_EQUAL (pool.run (0, [] (unsigned, size_t) {}), 0);
+}
+
+BOOST_AUTO_TEST_CASE( task_pool_cancel_test )
+{
+  CancelToken token;
+  TaskPool pool ("TaskPoolCancel", 2, &token);
+  std::atomic<unsigned> ran (0);
+  // -- cancelled by the first task, the others are skipped
+  size_t n = pool.run (100, [&] (unsigned, size_t k)
+                       {
+                         ++ran;
+                         if (k == 0) token.cancel ();
+                         std::this_thread::sleep_for (std::chrono::milliseconds (1));
+                       });
+  BOOST_CHECK_EQUAL (n, ran.load ());
+  BOOST_CHECK (n < 100);
+  BOOST_CHECK (token.cancelled ());
+
+  // -- a hook of a cancelled token runs at once
+  bool called = false;
+  CancelToken::Hook h (token, [&called] { called = true; });
+  BOOST_CHECK (called);
+}
+
+BOOST_AUTO_TEST_CASE( task_pool_deadline_test )
+{
+  CancelToken token;
+  token.setTimeout (50);
+  BOOST_CHECK (token.hasDeadline ());
+  TaskPool pool ("TaskPoolDeadline", 2, &token);
+  std::atomic<unsigned> interrupted (0);
+  // -- the tasks block until their hook runs, as a solver would
+  size_t n = pool.run (10, [&] (unsigned, size_t)
+                       {
+                         std::atomic<bool> stop (false);
+                         CancelToken::Hook h (token, [&stop] { stop = true; });
+                         while (!stop) std::this_thread::yield ();
+                         ++interrupted;
+                       });
+  BOOST_CHECK (token.cancelled ());
+  BOOST_CHECK_EQUAL (n, interrupted.load ());
+  BOOST_CHECK (n <= 2);
+}
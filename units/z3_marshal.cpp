@@ -0,0 +1,155 @@
+#include "ufo/Smt/EZ3.hh"
+#include "ufo/ExprBv.hh"
+
+#define BOOST_TEST_MODULE z3_marshal_test
+#include <boost/test/unit_test.hpp>
+
+#include <thread>
+
+using namespace std;
+using namespace expr;
+using namespace ufo;
+
+namespace
+{
+  Expr mkChain (Expr x, unsigned n)
+  {
+    ExprFactory &efac = x->efac ();
+    Expr acc = mk<TRUE> (efac);
+    for (unsigned i = 0; i < n; ++i)
+      acc = mk<AND> (acc, mk<GEQ> (mk<PLUS> (x, mkTerm<mpz_class> (i, efac)), x));
+    return acc;
+  }
+}
+
+BOOST_AUTO_TEST_CASE( marshal_cache_reuse_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr e = mkChain (x, 50);
+
+  ZSolver<EZ3> solver (z3);
+  solver.assertExpr (e);
+  BOOST_CHECK (z3.getMarshalCache ().size () > 0);
+
+  // -- after a reset, the whole term is found in the cache
+  size_t misses = ZMarshalCache::counters ().misses;
+  size_t hits = ZMarshalCache::counters ().hits;
+  solver.reset ();
+  solver.assertExpr (e);
+  BOOST_CHECK_EQUAL (ZMarshalCache::counters ().misses, misses);
+  BOOST_CHECK (ZMarshalCache::counters ().hits > hits);
+  BOOST_CHECK (bool (solver.solve ()));
+
+  // -- a fresh solver of the same context shares the cache
+  ZSolver<EZ3> other (z3);
+  other.assertExpr (mk<NEG> (e));
+  BOOST_CHECK_EQUAL (ZMarshalCache::counters ().misses, misses + 1);
+  BOOST_CHECK (bool (!other.solve ()));
+}
+
+BOOST_AUTO_TEST_CASE( marshal_cache_budget_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  z3.setMarshalCacheBudget (10);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr pinned = mk<LT> (x, mkTerm<mpz_class> (1000, efac));
+  z3.pinAst (pinned);
+
+  ZSolver<EZ3> solver (z3);
+  for (unsigned i = 1; i < 20; ++i)
+  {
+    solver.reset ();
+    solver.assertExpr (mkChain (x, i));
+    solver.assertExpr (pinned);
+    BOOST_CHECK (bool (solver.solve ()));
+  }
+
+  BOOST_CHECK (ZMarshalCache::counters ().evictions > 0);
+  // -- a new generation trims the cache to the budget, plus the
+  // -- pinned term
+  solver.assertExpr (pinned);
+  BOOST_CHECK (z3.getMarshalCache ().size () <= 11);
+
+  // -- the pinned term survived every eviction
+  size_t misses = ZMarshalCache::counters ().misses;
+  solver.assertExpr (pinned);
+  BOOST_CHECK_EQUAL (ZMarshalCache::counters ().misses, misses);
+}
+
+BOOST_AUTO_TEST_CASE( marshal_cache_memory_budget_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr pinned = mk<LT> (x, mkTerm<mpz_class> (1000, efac));
+  z3.pinAst (pinned);
+  ZSolver<EZ3> solver (z3);
+  solver.assertExpr (mkChain (x, 20));
+  BOOST_CHECK (z3.getMarshalCache ().size () > 1);
+
+  // -- any process is over 1 MB. The only context is flushed at its
+  // -- next marshaling, except for the pinned term
+  MemoryBudget::budgetMb () = 1;
+  std::this_thread::sleep_for (std::chrono::milliseconds (20));
+  solver.assertExpr (pinned);
+  MemoryBudget::budgetMb () = 0;
+  BOOST_CHECK_EQUAL (z3.getMarshalCache ().size (), 1);
+  BOOST_CHECK (MemoryBudget::counters ().byName ["z3.context"] > 0);
+  BOOST_CHECK (bool (solver.solve ()));
+}
+
+BOOST_AUTO_TEST_CASE( unmarshal_deep_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  
+  // -- deep enough to exhaust the stack of a recursive unmarshal
+  Expr t = x;
+  for (unsigned i = 0; i < 100000; ++i)
+    t = mk<PLUS> (t, mkTerm<mpz_class> (i % 7, efac));
+  Expr e = mk<GEQ> (t, x);
+
+  ZSolver<EZ3> solver (z3);
+  solver.assertExpr (e);
+  ExprVector asserts;
+  solver.assertions (std::back_inserter (asserts));
+  BOOST_REQUIRE_EQUAL (asserts.size (), 1);
+  BOOST_CHECK (asserts [0] == e);
+
+  // -- the second conversion is answered by the cache of the context
+  asserts.clear ();
+  solver.assertions (std::back_inserter (asserts));
+  BOOST_CHECK (asserts [0] == e);
+}
+
+BOOST_AUTO_TEST_CASE( marshal_int2bv_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr b = bv::bvConst (mkTerm<string> ("b", efac), 8);
+
+  // -- int2bv is modulo 2^8 and bv2int is unsigned
+  ZSolver<EZ3> solver (z3);
+  solver.assertExpr (mk<EQ> (x, mkTerm<mpz_class> (300, efac)));
+  solver.assertExpr (mk<EQ> (b, bv::int2bv (x, 8)));
+  solver.assertExpr (mk<NEQ> (bv::bv2int (b), mkTerm<mpz_class> (44, efac)));
+  BOOST_CHECK (bool (!solver.solve ()));
+
+  solver.reset ();
+  solver.assertExpr (mk<EQ> (x, mkTerm<mpz_class> (-1, efac)));
+  solver.assertExpr (mk<EQ> (b, bv::int2bv (x, 8)));
+  BOOST_CHECK (bool (solver.solve ()));
+  Expr v = solver.getModel ().eval (b);
+  BOOST_CHECK (bv::is_bvnum (v) && bv::toMpz (v) == 255);
+
+  // -- both conversions unmarshal to themselves
+  Expr e1 = bv::int2bv (x, 8);
+  Expr e2 = bv::bv2int (b);
+  BOOST_CHECK (z3_lite_simplify (z3, e1) == e1);
+  BOOST_CHECK (z3_lite_simplify (z3, e2) == e2);
+}
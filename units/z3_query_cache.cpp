@@ -0,0 +1,160 @@
+#include "ufo/Smt/EZ3.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+
+#define BOOST_TEST_MODULE z3_query_cache_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+using namespace ufo;
+
+BOOST_AUTO_TEST_CASE( query_cache_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  z3.queryCache ().enable ();
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr zero = mkTerm<mpz_class> (0, efac);
+
+  ZQueryCache<EZ3>::Counters before = ZQueryCache<EZ3>::counters ();
+
+  ZSolver<EZ3> s1 (z3);
+  s1.assertExpr (mk<GT> (x, zero));
+  s1.assertExpr (mk<GT> (y, x));
+  BOOST_CHECK (bool (s1.solveCached (true)));
+  BOOST_CHECK_EQUAL (ZQueryCache<EZ3>::counters ().misses, before.misses + 1);
+
+  // -- the same query, asserted in another order by another solver
+  ZSolver<EZ3> s2 (z3);
+  s2.assertExpr (mk<GT> (y, x));
+  s2.assertExpr (mk<GT> (x, zero));
+  s2.assertExpr (mk<GT> (y, x));
+  BOOST_CHECK (bool (s2.solveCached (true)));
+  BOOST_CHECK_EQUAL (ZQueryCache<EZ3>::counters ().hits, before.hits + 1);
+  // -- the kept model answers for the new solver
+  ZModel<EZ3> m = s2.getModel ();
+  BOOST_CHECK (isOpX<TRUE> (m.eval (mk<GT> (y, zero))));
+
+  // -- a popped scope is not part of the query
+  s2.push ();
+  s2.assertExpr (mk<LT> (y, zero));
+  BOOST_CHECK (bool (!s2.solveCached ()));
+  s2.pop ();
+  BOOST_CHECK (bool (s2.solveCached (true)));
+  BOOST_CHECK_EQUAL (ZQueryCache<EZ3>::counters ().hits, before.hits + 2);
+
+  // -- unsat cores are kept for the normalized assumptions
+  Expr a = bind::boolConst (mkTerm<string> ("a", efac));
+  Expr b = bind::boolConst (mkTerm<string> ("b", efac));
+  ZSolver<EZ3> s3 (z3);
+  s3.assertExpr (mk<IMPL> (a, mk<LT> (x, zero)));
+  s3.assertExpr (mk<GT> (x, zero));
+  ExprVector lits;
+  lits.push_back (b);
+  lits.push_back (a);
+  BOOST_CHECK (bool (!s3.solveAssumingCached (lits, true)));
+
+  ZSolver<EZ3> s4 (z3);
+  s4.assertExpr (mk<GT> (x, zero));
+  s4.assertExpr (mk<IMPL> (a, mk<LT> (x, zero)));
+  std::reverse (lits.begin (), lits.end ());
+  BOOST_CHECK (bool (!s4.solveAssumingCached (lits, true)));
+  BOOST_CHECK_EQUAL (ZQueryCache<EZ3>::counters ().hits, before.hits + 3);
+  ExprVector core;
+  s4.unsatCore (back_inserter (core));
+  BOOST_CHECK_EQUAL (core.size (), 1);
+  BOOST_CHECK (core [0] == a);
+}
+
+BOOST_AUTO_TEST_CASE( query_cache_disk_test )
+{
+  string path = "z3_query_cache.txt";
+  remove (path.c_str ());
+
+  {
+    ExprFactory efac;
+    EZ3 z3 (efac);
+    z3.queryCache ().enable ();
+    BOOST_CHECK (z3.queryCache ().open (path));
+    Expr x = bind::intConst (mkTerm<string> ("x", efac));
+    Expr zero = mkTerm<mpz_class> (0, efac);
+
+    ZSolver<EZ3> s (z3);
+    s.assertExpr (mk<GT> (x, zero));
+    s.assertExpr (mk<LT> (x, zero));
+    BOOST_CHECK (bool (!s.solveCached ()));
+  }
+
+  // -- a new run, with terms created in another order
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  z3.queryCache ().enable ();
+  BOOST_CHECK (z3.queryCache ().open (path));
+  Expr zero = mkTerm<mpz_class> (0, efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+
+  size_t diskHits = ZQueryCache<EZ3>::counters ().diskHits;
+  ZSolver<EZ3> s (z3);
+  s.assertExpr (mk<LT> (x, zero));
+  s.assertExpr (mk<GT> (x, zero));
+  BOOST_CHECK (bool (!s.solveCached ()));
+  BOOST_CHECK_EQUAL (ZQueryCache<EZ3>::counters ().diskHits, diskHits + 1);
+
+  remove (path.c_str ());
+}
+
+BOOST_AUTO_TEST_CASE( query_cache_disk_text_test )
+{
+  string path = "z3_query_cache_text.txt";
+  remove (path.c_str ());
+
+  {
+    ExprFactory efac;
+    EZ3 z3 (efac);
+    z3.queryCache ().enable ();
+    BOOST_CHECK (z3.queryCache ().open (path));
+    Expr x = bind::intConst (mkTerm<string> ("x", efac));
+    Expr zero = mkTerm<mpz_class> (0, efac);
+
+    ZSolver<EZ3> s (z3);
+    s.assertExpr (mk<GT> (x, zero));
+    s.assertExpr (mk<LT> (x, zero));
+    BOOST_CHECK (bool (!s.solveCached ()));
+  }
+
+  // -- the entry names its query in full. One whose text does not
+  // -- match its hash is not used
+  string contents;
+  {
+    ifstream in (path.c_str ());
+    contents.assign (istreambuf_iterator<char> (in), istreambuf_iterator<char> ());
+  }
+  BOOST_CHECK_EQUAL (contents.compare (0, 2, "q "), 0);
+  size_t pos = contents.find ("(check-sat");
+  BOOST_REQUIRE (pos != string::npos);
+  contents [pos + 1] = 'C';
+  {
+    ofstream out (path.c_str (), ios::trunc);
+    out << contents;
+  }
+
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  z3.queryCache ().enable ();
+  BOOST_CHECK (z3.queryCache ().open (path));
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr zero = mkTerm<mpz_class> (0, efac);
+
+  size_t diskHits = ZQueryCache<EZ3>::counters ().diskHits;
+  ZSolver<EZ3> s (z3);
+  s.assertExpr (mk<GT> (x, zero));
+  s.assertExpr (mk<LT> (x, zero));
+  BOOST_CHECK (bool (!s.solveCached ()));
+  BOOST_CHECK_EQUAL (ZQueryCache<EZ3>::counters ().diskHits, diskHits);
+
+  remove (path.c_str ());
+}
@@ -0,0 +1,52 @@
+#include "ufo/Smt/EZ3.hh"
+
+#define BOOST_TEST_MODULE z3_solver_pool_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+using namespace ufo;
+
+BOOST_AUTO_TEST_CASE( solver_pool_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr zero = mkTerm<mpz_class> (0, efac);
+
+  ZSolverPool<EZ3> &pool = z3.solverPool ();
+  ZSolver<EZ3> *first;
+  {
+    ZSolverPool<EZ3>::Lease l = pool.acquire ();
+    first = &*l;
+    l->assertExpr (mk<LT> (x, zero));
+    l->assertExpr (mk<GT> (x, zero));
+    BOOST_CHECK (bool (!l->solve ()));
+
+    // -- clear drops the assertions but keeps the solver
+    l.clear ();
+    l->assertExpr (mk<GT> (x, zero));
+    BOOST_CHECK (bool (l->solve ()));
+  }
+
+  // -- a released solver is reused, without the old assertions
+  ZSolverPool<EZ3>::Lease l = pool.acquire ();
+  BOOST_CHECK_EQUAL (&*l, first);
+  ExprVector asserts;
+  l->assertions (back_inserter (asserts));
+  BOOST_CHECK (asserts.empty ());
+
+  // -- solvers of other profiles, or already leased, are not shared
+  ZParams<EZ3> params (z3);
+  params.set (":timeout", 1000u);
+  pool.setProfile ("timeout", params);
+  ZSolverPool<EZ3>::Lease t = pool.acquire ("timeout");
+  ZSolverPool<EZ3>::Lease d = pool.acquire ();
+  BOOST_CHECK (&*t != first && &*d != first && &*t != &*d);
+
+  // -- leases can be moved, e.g., into containers
+  std::map<int, ZSolverPool<EZ3>::Lease> m;
+  m.insert (make_pair (0, std::move (d)));
+  BOOST_CHECK (!d);
+  BOOST_CHECK (bool (m [0]->solve ()));
+}
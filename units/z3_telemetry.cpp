@@ -0,0 +1,70 @@
+#include "ufo/Smt/EZ3.hh"
+
+#define BOOST_TEST_MODULE z3_telemetry_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+using namespace ufo;
+
+BOOST_AUTO_TEST_CASE( budget_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr zero = mkTerm<mpz_class> (0, efac);
+
+  ZSolver<EZ3> s (z3);
+  s.assertExpr (mk<GT> (mk<MULT> (x, y), zero));
+  s.assertExpr (mk<LT> (x, zero));
+
+  // -- a per-call budget that is too small
+  BOOST_CHECK (boost::indeterminate (s.solve (ZBudget (0, 1))));
+  // -- and the standing (unbounded) budget is back
+  BOOST_CHECK (s.getBudget ().unbounded ());
+  BOOST_CHECK (bool (s.solve ()));
+
+  // -- budgets that come with the parameters are standing budgets
+  ZParams<EZ3> p (z3);
+  p.set (ZBudget (0, 1));
+  s.set (p);
+  BOOST_CHECK_EQUAL (s.getBudget ().rlimit, 1);
+  BOOST_CHECK (boost::indeterminate (s.solve ()));
+  BOOST_CHECK (bool (s.solve (ZBudget ())));
+  BOOST_CHECK (boost::indeterminate (s.solve ()));
+}
+
+BOOST_AUTO_TEST_CASE( telemetry_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr zero = mkTerm<mpz_class> (0, efac);
+
+  ZTelemetry::clear ();
+  ZTelemetry::enable ();
+
+  ZSolver<EZ3> s (z3);
+  s.assertExpr (mk<GT> (x, zero));
+  s.assertExpr (mk<LT> (x, zero));
+  BOOST_CHECK (bool (!s.solve ()));
+
+  std::vector<ZQueryRecord> v = ZTelemetry::slowest ();
+  BOOST_REQUIRE_EQUAL (v.size (), 1);
+  BOOST_CHECK_EQUAL (string (v [0].kind), "solve");
+  BOOST_CHECK_EQUAL (v [0].assertions, 2);
+  BOOST_CHECK_EQUAL (v [0].dagSize,
+                     dagSize (mk<AND> (mk<GT> (x, zero), mk<LT> (x, zero))));
+  BOOST_CHECK (bool (!v [0].result));
+  BOOST_CHECK (v [0].wall >= 0);
+
+  ExprVector lits;
+  lits.push_back (bind::boolConst (mkTerm<string> ("a", efac)));
+  s.solveAssuming (lits);
+  BOOST_CHECK_EQUAL (ZTelemetry::slowest ().size (), 2);
+
+  ZTelemetry::enable (false);
+  s.solve ();
+  BOOST_CHECK_EQUAL (ZTelemetry::slowest ().size (), 2);
+}